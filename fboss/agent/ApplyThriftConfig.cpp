@@ -12,6 +12,10 @@
 #include <folly/FileUtil.h>
 #include "fboss/agent/FbossError.h"
 #include "fboss/agent/Platform.h"
+#include "fboss/agent/state/AclEntry.h"
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
 #include "fboss/agent/state/ArpResponseTable.h"
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/InterfaceMap.h"
@@ -28,6 +32,14 @@
 #include "fboss/agent/state/RouteUpdater.h"
 
 #include <boost/container/flat_set.hpp>
+#include <gflags/gflags.h>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+DEFINE_bool(incremental_config_apply, true,
+            "Skip the config sections that did not change since the last "
+            "config was applied, instead of comparing all of their nodes");
 
 using boost::container::flat_map;
 using boost::container::flat_set;
@@ -42,6 +54,164 @@ using std::shared_ptr;
 
 namespace facebook { namespace fboss {
 
+namespace {
+
+/*
+ * The config sections of the last successfully applied config, and the nodes
+ * they resulted in.
+ *
+ * A section whose config did not change since then does not need to be
+ * processed again, as long as the state it is applied to still holds the
+ * nodes that were produced from it.  The nodes are held by weak_ptr, so an
+ * unrelated state (or one that was discarded) never matches.
+ */
+struct AppliedConfig {
+  std::vector<cfg::Port> ports;
+  std::vector<cfg::VlanPort> vlanPorts;
+  std::vector<cfg::Vlan> vlans;
+  std::vector<int32_t> supportedMTUs;
+  std::vector<cfg::Interface> interfaces;
+  MacAddress localMac;
+
+  std::weak_ptr<PortMap> portMap;
+  std::weak_ptr<InterfaceMap> intfMap;
+  /*
+   * The VLANs change whenever their ARP or NDP tables do, so they are
+   * recognized by their neighbor response tables instead.  These are only
+   * ever set from the config, and are replaced whenever the config of their
+   * VLAN changes.
+   */
+  typedef std::pair<std::weak_ptr<ArpResponseTable>,
+                    std::weak_ptr<NdpResponseTable>> ResponseTables;
+  flat_map<VlanID, ResponseTables> vlanResponseTables;
+};
+
+/*
+ * The ACL entries of the neighborSuppression, controlPlaneTraps and
+ * dropUnhandledControlFrames have the IDs from here up, which the
+ * configured entries may not use.  Each protocol's entries start at a
+ * multiple of 100 above this, so they keep their IDs when other protocols
+ * are added or removed.  The neighbor suppression entries come first, so
+ * they win over the ARP and NDP traps.
+ */
+constexpr int32_t kControlPlaneAclBase = 100000;
+constexpr int32_t kNeighborSuppressionAclBase = kControlPlaneAclBase;
+constexpr int32_t kDropControlFramesAclBase = kControlPlaneAclBase + 10000;
+
+constexpr uint16_t kEtherTypeArp = 0x0806;
+constexpr uint16_t kEtherTypeLldp = 0x88cc;
+constexpr uint16_t kEtherTypeEapol = 0x888e;
+constexpr uint8_t kIpProtoTcp = 6;
+constexpr uint8_t kIpProtoUdp = 17;
+constexpr uint8_t kIpProtoIcmpv6 = 58;
+constexpr uint8_t kIcmpv6NeighborSolicitation = 135;
+
+struct ControlPlaneAcl {
+  cfg::AclAction action;
+  uint16_t etherType;
+  const char* dstMac;
+  uint8_t ipProtocol;
+  uint16_t l4SrcPort;
+  uint16_t l4DstPort;
+  uint8_t icmpv6Type;
+};
+
+/*
+ * The entries that trap each control protocol.  The link local protocols
+ * are trapped outright.  The packets of the others are only put in the
+ * protocol's queue if they are sent to the CPU anyway, as those addressed
+ * to the switch are, so the sessions of other routers through the switch
+ * are not copied to its CPU.  DHCP requests are broadcast to the relay,
+ * while the replies are sent to its address.
+ */
+const std::vector<ControlPlaneAcl>& getControlPlaneAcls(
+    cfg::ControlProtocol protocol) {
+  using cfg::AclAction;
+  static const std::vector<ControlPlaneAcl> kArp = {
+    {AclAction::TRAP, kEtherTypeArp, "", 0, 0, 0, 0},
+  };
+  static const std::vector<ControlPlaneAcl> kNdp = {
+    // Router and neighbor solicitations and advertisements
+    {AclAction::TRAP, 0, "", kIpProtoIcmpv6, 0, 0, 133},
+    {AclAction::TRAP, 0, "", kIpProtoIcmpv6, 0, 0, 134},
+    {AclAction::TRAP, 0, "", kIpProtoIcmpv6, 0, 0,
+     kIcmpv6NeighborSolicitation},
+    {AclAction::TRAP, 0, "", kIpProtoIcmpv6, 0, 0, 136},
+  };
+  static const std::vector<ControlPlaneAcl> kDhcp = {
+    {AclAction::TRAP, 0, "ff:ff:ff:ff:ff:ff", kIpProtoUdp, 0, 67, 0},
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoUdp, 0, 67, 0},
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoUdp, 0, 68, 0},
+    // All_DHCP_Relay_Agents_and_Servers
+    {AclAction::TRAP, 0, "33:33:00:01:00:02", kIpProtoUdp, 0, 547, 0},
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoUdp, 0, 547, 0},
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoUdp, 0, 546, 0},
+  };
+  static const std::vector<ControlPlaneAcl> kLldp = {
+    {AclAction::TRAP, kEtherTypeLldp, "", 0, 0, 0, 0},
+  };
+  static const std::vector<ControlPlaneAcl> kBgp = {
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoTcp, 0, 179, 0},
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoTcp, 179, 0, 0},
+  };
+  static const std::vector<ControlPlaneAcl> kBfd = {
+    // Single hop and multihop
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoUdp, 0, 3784, 0},
+    {AclAction::CPU_QUEUE, 0, "", kIpProtoUdp, 0, 4784, 0},
+  };
+  switch (protocol) {
+    case cfg::ControlProtocol::ARP:
+      return kArp;
+    case cfg::ControlProtocol::NDP:
+      return kNdp;
+    case cfg::ControlProtocol::DHCP:
+      return kDhcp;
+    case cfg::ControlProtocol::LLDP:
+      return kLldp;
+    case cfg::ControlProtocol::BGP:
+      return kBgp;
+    case cfg::ControlProtocol::BFD:
+      return kBfd;
+  }
+  throw FbossError("unknown control protocol ", static_cast<int>(protocol));
+}
+
+/*
+ * The link local control frames the agent does not handle, which are
+ * dropped with dropUnhandledControlFrames.
+ */
+const std::vector<ControlPlaneAcl> kDropControlFrames = {
+  // CDP, VTP, DTP and PAgP
+  {cfg::AclAction::DROP, 0, "01:00:0c:cc:cc:cc", 0, 0, 0, 0},
+  // PVST+
+  {cfg::AclAction::DROP, 0, "01:00:0c:cc:cc:cd", 0, 0, 0, 0},
+  // Spanning tree BPDUs
+  {cfg::AclAction::DROP, 0, "01:80:c2:00:00:00", 0, 0, 0, 0},
+  {cfg::AclAction::DROP, kEtherTypeEapol, "", 0, 0, 0, 0},
+};
+
+cfg::AclEntry makeAclConfig(int32_t id, const ControlPlaneAcl& acl,
+                            int32_t queue) {
+  cfg::AclEntry config;
+  config.id = id;
+  config.action = acl.action;
+  config.etherType = acl.etherType;
+  config.dstMac = acl.dstMac;
+  config.ipProtocol = acl.ipProtocol;
+  config.l4SrcPort = acl.l4SrcPort;
+  config.l4DstPort = acl.l4DstPort;
+  config.icmpv6Type = acl.icmpv6Type;
+  config.cpuQueue = queue;
+  return config;
+}
+
+// Config is normally only applied from the update thread, but nothing
+// stops tests or tools from calling applyThriftConfig() concurrently.
+std::mutex lastAppliedLock;
+AppliedConfig lastApplied;
+
+} // unnamed namespace
+
 /*
  * A class for implementing applyThriftConfig().
  *
@@ -90,17 +260,44 @@ class ThriftConfigApplier {
   typedef boost::container::flat_map<RouterID, IntfRoute> IntfRouteTable;
   IntfRouteTable intfRouteTables_;
 
+  bool portsUnchanged() const;
+  bool interfacesUnchanged() const;
+  bool vlansUnchanged() const;
+  void recordApplied(const std::shared_ptr<SwitchState>& state);
+  ICMPErrorLimits getICMPErrorLimits() const;
+  CpuRxConfig getCpuRxConfig() const;
+  EcmpHashConfig getEcmpHashConfig() const;
+  SflowConfig getSflowConfig() const;
+  std::vector<BfdSessionConfig> getBfdSessions() const;
+  std::vector<RouteCounterConfig> getRouteCounters() const;
+
   void processVlanPorts();
   void updateVlanInterfaces(const Interface* intf);
   std::shared_ptr<PortMap> updatePorts();
   std::shared_ptr<Port> updatePort(const std::shared_ptr<Port>& orig,
                                    const cfg::Port* cfg);
+  Port::QosConfig getPortQos(PortID port, const cfg::PortQos& cfg) const;
+  Port::BufferConfig getPortBuffer(PortID port,
+                                   const cfg::PortBuffer& cfg) const;
+  std::shared_ptr<AggregatePortMap> updateAggregatePorts();
+  std::shared_ptr<AggregatePort> createAggregatePort(
+      const cfg::AggregatePort* config);
+  std::shared_ptr<AggregatePort> updateAggregatePort(
+      const std::shared_ptr<AggregatePort>& orig,
+      const cfg::AggregatePort* config);
+  AggregatePort::Members getAggregatePortMembers(
+      const std::shared_ptr<AggregatePort>& orig,
+      const cfg::AggregatePort* config);
+  std::shared_ptr<AclMap> updateAcls();
+  std::vector<cfg::AclEntry> getAclConfigs() const;
+  std::shared_ptr<AclEntry> createAcl(const cfg::AclEntry* config) const;
   std::shared_ptr<VlanMap> updateVlans();
   std::shared_ptr<Vlan> createVlan(const cfg::Vlan* config);
   std::shared_ptr<Vlan> updateVlan(const std::shared_ptr<Vlan>& orig,
                                    const cfg::Vlan* config);
   bool updateNeighborResponseTables(Vlan* vlan, const cfg::Vlan* config);
   bool updateDhcpOverrides(Vlan* vlan, const cfg::Vlan* config);
+  bool updateDhcpV6ExtraRelays(Vlan* vlan, const cfg::Vlan* config);
   std::shared_ptr<InterfaceMap> updateInterfaces();
   std::shared_ptr<RouteTableMap> updateRouteTables();
   shared_ptr<Interface> createInterface(const cfg::Interface* config,
@@ -147,12 +344,13 @@ class ThriftConfigApplier {
 };
 
 shared_ptr<SwitchState> ThriftConfigApplier::run() {
+  std::lock_guard<std::mutex> guard(lastAppliedLock);
   auto newState = orig_->clone();
   bool changed = false;
 
   processVlanPorts();
 
-  {
+  if (!portsUnchanged()) {
     auto newPorts = updatePorts();
     if (newPorts) {
       newState->resetPorts(std::move(newPorts));
@@ -161,6 +359,29 @@ shared_ptr<SwitchState> ThriftConfigApplier::run() {
   }
 
   {
+    auto newAggPorts = updateAggregatePorts();
+    if (newAggPorts) {
+      newState->resetAggregatePorts(std::move(newAggPorts));
+      changed = true;
+    }
+  }
+
+  {
+    auto newAcls = updateAcls();
+    if (newAcls) {
+      newState->resetAcls(std::move(newAcls));
+      changed = true;
+    }
+  }
+
+  bool intfsUnchanged = interfacesUnchanged();
+  if (intfsUnchanged) {
+    // The interfaces already match the config, but updateVlans() still
+    // needs to know which addresses each VLAN has.
+    for (const auto& intf : *orig_->getInterfaces()) {
+      updateVlanInterfaces(intf.get());
+    }
+  } else {
     auto newIntfs = updateInterfaces();
     if (newIntfs) {
       newState->resetIntfs(std::move(newIntfs));
@@ -170,7 +391,7 @@ shared_ptr<SwitchState> ThriftConfigApplier::run() {
 
   // Note: updateInterfaces() must be called before updateVlans(),
   // as updateInterfaces() populates the vlanInterfaces_ data structure.
-  {
+  if (!intfsUnchanged || !vlansUnchanged()) {
     auto newVlans = updateVlans();
     if (newVlans) {
       newState->resetVlans(std::move(newVlans));
@@ -180,7 +401,10 @@ shared_ptr<SwitchState> ThriftConfigApplier::run() {
 
   // Note: updateInterfaces() must be called before updateRouteTables(),
   // as updateInterfaces() populates the intfRouteTables_ data structure.
-  {
+  // The interface routes only depend on the interfaces, and route updates
+  // from clients never remove them, so they are still in place if the
+  // interfaces did not change.
+  if (!intfsUnchanged) {
     auto newTables = updateRouteTables();
     if (newTables) {
       newState->resetRouteTables(std::move(newTables));
@@ -213,12 +437,282 @@ shared_ptr<SwitchState> ThriftConfigApplier::run() {
     changed = true;
   }
 
+  auto icmpErrorLimits = getICMPErrorLimits();
+  if (orig_->getICMPErrorLimits() != icmpErrorLimits) {
+    newState->setICMPErrorLimits(icmpErrorLimits);
+    changed = true;
+  }
+
+  auto cpuRxConfig = getCpuRxConfig();
+  if (orig_->getCpuRxConfig() != cpuRxConfig) {
+    newState->setCpuRxConfig(cpuRxConfig);
+    changed = true;
+  }
+
+  auto ecmpHashConfig = getEcmpHashConfig();
+  if (orig_->getEcmpHashConfig() != ecmpHashConfig) {
+    newState->setEcmpHashConfig(ecmpHashConfig);
+    changed = true;
+  }
+
+  auto sFlowConfig = getSflowConfig();
+  if (orig_->getSflowConfig() != sFlowConfig) {
+    newState->setSflowConfig(sFlowConfig);
+    changed = true;
+  }
+
+  auto bfdSessions = getBfdSessions();
+  if (orig_->getBfdSessions() != bfdSessions) {
+    newState->setBfdSessions(std::move(bfdSessions));
+    changed = true;
+  }
+
+  auto routeCounters = getRouteCounters();
+  if (orig_->getRouteCounters() != routeCounters) {
+    newState->setRouteCounters(std::move(routeCounters));
+    changed = true;
+  }
+
+  if (orig_->getNeighborSuppression() != cfg_->neighborSuppression) {
+    newState->setNeighborSuppression(cfg_->neighborSuppression);
+    changed = true;
+  }
+
+  recordApplied(changed ? newState : orig_);
   if (!changed) {
     return nullptr;
   }
   return newState;
 }
 
+ICMPErrorLimits ThriftConfigApplier::getICMPErrorLimits() const {
+  auto check = [](const char* name, int32_t rate, int32_t burst) {
+    if (rate < 0 || burst < 0) {
+      throw FbossError("invalid ICMP error ", name, " limit: rate ", rate,
+                       ", burst ", burst);
+    }
+    if (rate > 0 && burst == 0) {
+      throw FbossError("ICMP error ", name, " limit has a rate but no "
+                       "burst size");
+    }
+  };
+  check("source", cfg_->icmpErrorSourceRate, cfg_->icmpErrorSourceBurst);
+  check("interface", cfg_->icmpErrorIntfRate, cfg_->icmpErrorIntfBurst);
+
+  ICMPErrorLimits limits;
+  limits.sourceRate = cfg_->icmpErrorSourceRate;
+  limits.sourceBurst = cfg_->icmpErrorSourceBurst;
+  limits.intfRate = cfg_->icmpErrorIntfRate;
+  limits.intfBurst = cfg_->icmpErrorIntfBurst;
+  return limits;
+}
+
+CpuRxConfig ThriftConfigApplier::getCpuRxConfig() const {
+  auto checkQueue = [](int32_t id) {
+    if (id < 0 || id > std::numeric_limits<uint16_t>::max()) {
+      throw FbossError("invalid CPU queue ", id);
+    }
+  };
+
+  CpuRxConfig config;
+  for (const auto& queue : cfg_->cpuQueues) {
+    checkQueue(queue.id);
+    if (queue.rate < 0 || queue.burst < 0) {
+      throw FbossError("invalid limit for CPU queue ", queue.id, ": rate ",
+                       queue.rate, ", burst ", queue.burst);
+    }
+    if (queue.rate > 0 && queue.burst == 0) {
+      throw FbossError("CPU queue ", queue.id, " has a rate but no burst "
+                       "size");
+    }
+    CpuRxConfig::QueueLimit limit;
+    limit.rate = queue.rate;
+    limit.burst = queue.burst;
+    if (!config.queueLimits.emplace(queue.id, limit).second) {
+      throw FbossError("duplicate CPU queue ", queue.id);
+    }
+  }
+
+  flat_set<cfg::PacketRxReason> reasons;
+  for (const auto& entry : cfg_->cpuRxReasonToQueue) {
+    checkQueue(entry.queueId);
+    if (!reasons.insert(entry.reason).second) {
+      throw FbossError("duplicate CPU queue entry for packet rx reason ",
+                       static_cast<int>(entry.reason));
+    }
+    // The UNMATCHED entry matches every packet, so any entry after it
+    // would never be used
+    if (reasons.count(cfg::PacketRxReason::UNMATCHED) &&
+        entry.reason != cfg::PacketRxReason::UNMATCHED) {
+      throw FbossError("the UNMATCHED packet rx reason must be the last "
+                       "CPU queue entry");
+    }
+    config.reasonToQueue.emplace_back(entry.reason, entry.queueId);
+  }
+
+  if (cfg_->cpuRxPoolSize < 0 || cfg_->cpuRxRate < 0) {
+    throw FbossError("invalid CPU receive pool size ", cfg_->cpuRxPoolSize,
+                     " or rate ", cfg_->cpuRxRate);
+  }
+  config.poolSize = cfg_->cpuRxPoolSize;
+  config.rate = cfg_->cpuRxRate;
+  return config;
+}
+
+EcmpHashConfig ThriftConfigApplier::getEcmpHashConfig() const {
+  const auto& hash = cfg_->ecmpHash;
+  auto getFields = [](const char* family,
+                      const std::vector<cfg::EcmpHashField>& fields) {
+    if (fields.empty()) {
+      throw FbossError("the ", family, " ECMP hash needs at least one field");
+    }
+    return EcmpHashConfig::Fields(fields.begin(), fields.end());
+  };
+
+  EcmpHashConfig config;
+  config.ipv4Fields = getFields("IPv4", hash.ipv4Fields);
+  if (config.ipv4Fields.count(cfg::EcmpHashField::FLOW_LABEL)) {
+    throw FbossError("IPv4 packets have no flow label to hash");
+  }
+  config.ipv6Fields = getFields("IPv6", hash.ipv6Fields);
+  if (hash.seedRotation < 0) {
+    throw FbossError("invalid ECMP hash seed rotation ", hash.seedRotation);
+  }
+  config.algorithm = hash.algorithm;
+  config.seedRotation = hash.seedRotation;
+  return config;
+}
+
+SflowConfig ThriftConfigApplier::getSflowConfig() const {
+  SflowConfig config;
+  for (const auto& collector : cfg_->sFlowCollectors) {
+    if (collector.port <= 0 || collector.port > 0xffff) {
+      throw FbossError("invalid sFlow collector port ", collector.port);
+    }
+    config.collectors.emplace_back(IPAddress(collector.ip), collector.port);
+  }
+  config.agentIp = IPAddress(cfg_->sFlowAgentIp);
+  if (cfg_->sFlowHeaderSize <= 0 ||
+      uint32_t(cfg_->sFlowHeaderSize) > SflowConfig::kMaxHeaderSize) {
+    throw FbossError("invalid sFlow header size ", cfg_->sFlowHeaderSize);
+  }
+  config.headerSize = cfg_->sFlowHeaderSize;
+  return config;
+}
+
+std::vector<BfdSessionConfig> ThriftConfigApplier::getBfdSessions() const {
+  std::vector<BfdSessionConfig> sessions;
+  flat_set<std::pair<RouterID, IPAddress>> peers;
+  for (const auto& sessionCfg : cfg_->bfdSessions) {
+    BfdSessionConfig session;
+    session.peer = IPAddress(sessionCfg.peer);
+    session.router = RouterID(sessionCfg.routerID);
+    if (!peers.emplace(session.router, session.peer).second) {
+      throw FbossError("duplicate BFD session with ", session.peer);
+    }
+    if (sessionCfg.minTxIntervalMs <= 0 || sessionCfg.minRxIntervalMs <= 0) {
+      throw FbossError("invalid BFD intervals for ", session.peer);
+    }
+    if (sessionCfg.multiplier <= 0 || sessionCfg.multiplier > 255) {
+      throw FbossError("invalid BFD multiplier ", sessionCfg.multiplier,
+                       " for ", session.peer);
+    }
+    session.minTxInterval =
+      std::chrono::milliseconds(sessionCfg.minTxIntervalMs);
+    session.minRxInterval =
+      std::chrono::milliseconds(sessionCfg.minRxIntervalMs);
+    session.multiplier = sessionCfg.multiplier;
+    sessions.push_back(std::move(session));
+  }
+  return sessions;
+}
+
+std::vector<RouteCounterConfig>
+ThriftConfigApplier::getRouteCounters() const {
+  std::vector<RouteCounterConfig> counters;
+  flat_set<std::string> names;
+  for (const auto& counterCfg : cfg_->routeCounters) {
+    if (counterCfg.name.empty()) {
+      throw FbossError("route counter without a name");
+    }
+    if (!names.insert(counterCfg.name).second) {
+      throw FbossError("duplicate route counter ", counterCfg.name);
+    }
+    RouteCounterConfig counter;
+    counter.name = counterCfg.name;
+    counter.router = RouterID(counterCfg.routerID);
+    if (counterCfg.unresolvedPuntRate < 0 ||
+        counterCfg.unresolvedDropAfter < 0 ||
+        counterCfg.unresolvedDropSeconds < 0) {
+      throw FbossError("invalid unresolved next hop policy for route "
+                       "counter ", counterCfg.name);
+    }
+    counter.unresolvedPuntRate = counterCfg.unresolvedPuntRate;
+    counter.unresolvedDropAfter = counterCfg.unresolvedDropAfter;
+    counter.unresolvedDropSeconds = counterCfg.unresolvedDropSeconds;
+    for (const auto& prefix : counterCfg.prefixes) {
+      // Masks the host bits, so "10.1.2.3/16" counts 10.1.0.0/16
+      counter.prefixes.push_back(IPAddress::createNetwork(prefix));
+    }
+    counters.push_back(std::move(counter));
+  }
+  return counters;
+}
+
+bool ThriftConfigApplier::portsUnchanged() const {
+  return FLAGS_incremental_config_apply &&
+    lastApplied.portMap.lock() == orig_->getPorts() &&
+    lastApplied.ports == cfg_->ports &&
+    lastApplied.vlanPorts == cfg_->vlanPorts;
+}
+
+bool ThriftConfigApplier::interfacesUnchanged() const {
+  return FLAGS_incremental_config_apply &&
+    lastApplied.intfMap.lock() == orig_->getInterfaces() &&
+    lastApplied.interfaces == cfg_->interfaces &&
+    lastApplied.localMac == platform_->getLocalMac();
+}
+
+bool ThriftConfigApplier::vlansUnchanged() const {
+  if (!FLAGS_incremental_config_apply ||
+      lastApplied.vlans != cfg_->vlans ||
+      lastApplied.vlanPorts != cfg_->vlanPorts ||
+      lastApplied.supportedMTUs != cfg_->supportedMTUs) {
+    return false;
+  }
+  auto origVlans = orig_->getVlans();
+  if (origVlans->size() != lastApplied.vlanResponseTables.size()) {
+    return false;
+  }
+  for (const auto& vlan : *origVlans) {
+    auto it = lastApplied.vlanResponseTables.find(vlan->getID());
+    if (it == lastApplied.vlanResponseTables.end() ||
+        it->second.first.lock() != vlan->getArpResponseTable() ||
+        it->second.second.lock() != vlan->getNdpResponseTable()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ThriftConfigApplier::recordApplied(const shared_ptr<SwitchState>& state) {
+  lastApplied.ports = cfg_->ports;
+  lastApplied.vlanPorts = cfg_->vlanPorts;
+  lastApplied.vlans = cfg_->vlans;
+  lastApplied.supportedMTUs = cfg_->supportedMTUs;
+  lastApplied.interfaces = cfg_->interfaces;
+  lastApplied.localMac = platform_->getLocalMac();
+  lastApplied.portMap = state->getPorts();
+  lastApplied.intfMap = state->getInterfaces();
+  lastApplied.vlanResponseTables.clear();
+  for (const auto& vlan : *state->getVlans()) {
+    lastApplied.vlanResponseTables.emplace(
+        vlan->getID(),
+        std::make_pair(vlan->getArpResponseTable(),
+                       vlan->getNdpResponseTable()));
+  }
+}
+
 void ThriftConfigApplier::processVlanPorts() {
   // Build the Port --> Vlan mappings
   //
@@ -333,11 +827,22 @@ shared_ptr<Port> ThriftConfigApplier::updatePort(const shared_ptr<Port>& orig,
                                                  const cfg::Port* cfg) {
   CHECK_EQ(orig->getID(), cfg->logicalID);
 
+  if (cfg->sFlowIngressRate < 0 || cfg->sFlowEgressRate < 0) {
+    throw FbossError("invalid sFlow sampling rate for port ", orig->getID());
+  }
+
+  auto qos = getPortQos(orig->getID(), cfg->qos);
+  auto buffer = getPortBuffer(orig->getID(), cfg->buffer);
+
   auto vlans = portVlans_[orig->getID()];
   if (cfg->state == orig->getState() &&
       VlanID(cfg->ingressVlan) == orig->getIngressVlan() &&
       vlans == orig->getVlans() &&
-      cfg->speed == orig->getSpeed()) {
+      cfg->speed == orig->getSpeed() &&
+      uint32_t(cfg->sFlowIngressRate) == orig->getSflowIngressRate() &&
+      uint32_t(cfg->sFlowEgressRate) == orig->getSflowEgressRate() &&
+      qos == orig->getQos() &&
+      buffer == orig->getBuffer()) {
     return nullptr;
   }
 
@@ -346,9 +851,320 @@ shared_ptr<Port> ThriftConfigApplier::updatePort(const shared_ptr<Port>& orig,
   newPort->setIngressVlan(VlanID(cfg->ingressVlan));
   newPort->setVlans(vlans);
   newPort->setSpeed(cfg->speed);
+  newPort->setSflowIngressRate(cfg->sFlowIngressRate);
+  newPort->setSflowEgressRate(cfg->sFlowEgressRate);
+  newPort->setQos(qos);
+  newPort->setBuffer(buffer);
   return newPort;
 }
 
+Port::QosConfig ThriftConfigApplier::getPortQos(
+    PortID port, const cfg::PortQos& cfg) const {
+  Port::QosConfig qos;
+  auto getQueue = [&](int16_t queue) -> uint8_t {
+    if (queue < 0 || queue >= Port::QosConfig::kNumQueues) {
+      throw FbossError("port ", port, " has no queue ", queue);
+    }
+    return queue;
+  };
+  for (const auto& entry : cfg.dscpToQueue) {
+    if (entry.first < 0 || entry.first >= Port::QosConfig::kNumDscps) {
+      throw FbossError("invalid DSCP ", entry.first, " for port ", port);
+    }
+    qos.dscpToQueue.emplace(entry.first, getQueue(entry.second));
+  }
+  for (const auto& entry : cfg.pcpToQueue) {
+    if (entry.first < 0 || entry.first >= Port::QosConfig::kNumPcps) {
+      throw FbossError("invalid PCP ", entry.first, " for port ", port);
+    }
+    qos.pcpToQueue.emplace(entry.first, getQueue(entry.second));
+  }
+  for (const auto& entry : cfg.queueWeights) {
+    if (entry.second < 0) {
+      throw FbossError("invalid weight ", entry.second, " for queue ",
+                       entry.first, " of port ", port);
+    }
+    qos.queueWeights.emplace(getQueue(entry.first), entry.second);
+  }
+  return qos;
+}
+
+Port::BufferConfig ThriftConfigApplier::getPortBuffer(
+    PortID port, const cfg::PortBuffer& cfg) const {
+  auto getBytes = [&](int32_t bytes, const char* name) -> uint32_t {
+    if (bytes < 0) {
+      throw FbossError("invalid ", name, " ", bytes, " for port ", port);
+    }
+    return bytes;
+  };
+  Port::BufferConfig buffer;
+  buffer.cutThrough = cfg.cutThrough;
+  buffer.ingressMinBytes = getBytes(cfg.ingressMinBytes, "ingressMinBytes");
+  buffer.ingressSharedLimitBytes = getBytes(cfg.ingressSharedLimitBytes,
+                                            "ingressSharedLimitBytes");
+  buffer.headroomBytes = getBytes(cfg.headroomBytes, "headroomBytes");
+  buffer.egressMinBytes = getBytes(cfg.egressMinBytes, "egressMinBytes");
+  buffer.egressSharedLimitBytes = getBytes(cfg.egressSharedLimitBytes,
+                                           "egressSharedLimitBytes");
+  return buffer;
+}
+
+shared_ptr<AggregatePortMap> ThriftConfigApplier::updateAggregatePorts() {
+  auto origAggPorts = orig_->getAggregatePorts();
+  AggregatePortMap::NodeContainer newAggPorts;
+  bool changed = false;
+
+  size_t numExistingProcessed = 0;
+  flat_map<PortID, AggregatePortID> memberOf;
+  for (const auto& aggPortCfg : cfg_->aggregatePorts) {
+    AggregatePortID id(aggPortCfg.key);
+    for (auto port : aggPortCfg.memberPorts) {
+      auto ret = memberOf.emplace(PortID(port), id);
+      if (!ret.second) {
+        throw FbossError("port ", port, " cannot be a member of both "
+                         "aggregate port ", ret.first->second, " and ", id);
+      }
+    }
+
+    auto origAggPort = origAggPorts->getAggregatePortIf(id);
+    shared_ptr<AggregatePort> newAggPort;
+    if (origAggPort) {
+      newAggPort = updateAggregatePort(origAggPort, &aggPortCfg);
+      ++numExistingProcessed;
+    } else {
+      newAggPort = createAggregatePort(&aggPortCfg);
+    }
+    changed |= updateMap(&newAggPorts, origAggPort, newAggPort);
+  }
+
+  if (numExistingProcessed != origAggPorts->size()) {
+    // Some existing aggregate ports were removed.
+    CHECK_LT(numExistingProcessed, origAggPorts->size());
+    changed = true;
+  }
+
+  if (!changed) {
+    return nullptr;
+  }
+
+  return origAggPorts->clone(std::move(newAggPorts));
+}
+
+shared_ptr<AggregatePort> ThriftConfigApplier::createAggregatePort(
+    const cfg::AggregatePort* config) {
+  auto aggPort = make_shared<AggregatePort>(AggregatePortID(config->key),
+                                            config->name);
+  aggPort->setLacpEnabled(config->lacp);
+  aggPort->setMembers(getAggregatePortMembers(nullptr, config));
+  return aggPort;
+}
+
+shared_ptr<AggregatePort> ThriftConfigApplier::updateAggregatePort(
+    const shared_ptr<AggregatePort>& orig,
+    const cfg::AggregatePort* config) {
+  auto members = getAggregatePortMembers(orig, config);
+  if (orig->getName() == config->name &&
+      orig->isLacpEnabled() == config->lacp &&
+      orig->getMembers() == members) {
+    return nullptr;
+  }
+
+  auto newAggPort = orig->clone();
+  newAggPort->setName(config->name);
+  newAggPort->setLacpEnabled(config->lacp);
+  newAggPort->setMembers(std::move(members));
+  return newAggPort;
+}
+
+AggregatePort::Members ThriftConfigApplier::getAggregatePortMembers(
+    const shared_ptr<AggregatePort>& orig,
+    const cfg::AggregatePort* config) {
+  AggregatePortID id(config->key);
+  if (config->memberPorts.empty()) {
+    throw FbossError("aggregate port ", id, " has no member ports");
+  }
+  auto ports = orig_->getPorts();
+  const Port::VlanMembership* vlans = nullptr;
+  const Port::VlanMembership noVlans;
+  AggregatePort::Members members;
+  for (auto port : config->memberPorts) {
+    PortID portID(port);
+    if (!ports->getPortIf(portID)) {
+      throw FbossError("aggregate port ", id, " has non-existent member ",
+                       portID);
+    }
+    // Traffic for the aggregate port may leave through any member, so all
+    // of them must be in the same VLANs.
+    auto it = portVlans_.find(portID);
+    const auto& portVlans = it == portVlans_.end() ? noVlans : it->second;
+    if (vlans && *vlans != portVlans) {
+      throw FbossError("the members of aggregate port ", id,
+                       " are not all in the same VLANs");
+    }
+    vlans = &portVlans;
+
+    // LACP brings new members into the aggregate once the partner agrees.
+    // Members that stay keep their current state, unless LACP is turned on
+    // or off, which starts them over.
+    bool forwarding = !config->lacp;
+    if (orig && orig->isLacpEnabled() == config->lacp &&
+        orig->isMember(portID)) {
+      forwarding = orig->isForwarding(portID);
+    }
+    members.emplace(portID, forwarding);
+  }
+  return members;
+}
+
+shared_ptr<AclMap> ThriftConfigApplier::updateAcls() {
+  auto origAcls = orig_->getAcls();
+  AclMap::NodeContainer newAcls;
+  bool changed = false;
+
+  size_t numExistingProcessed = 0;
+  for (const auto& aclCfg : getAclConfigs()) {
+    auto newAcl = createAcl(&aclCfg);
+    auto origAcl = origAcls->getEntryIf(newAcl->getID());
+    if (origAcl) {
+      ++numExistingProcessed;
+      if (origAcl->isSame(*newAcl)) {
+        newAcl = nullptr;
+      }
+    }
+    changed |= updateMap(&newAcls, origAcl, newAcl);
+  }
+
+  if (numExistingProcessed != origAcls->size()) {
+    // Some existing ACL entries were removed.
+    CHECK_LT(numExistingProcessed, origAcls->size());
+    changed = true;
+  }
+
+  if (!changed) {
+    return nullptr;
+  }
+
+  return origAcls->clone(std::move(newAcls));
+}
+
+std::vector<cfg::AclEntry> ThriftConfigApplier::getAclConfigs() const {
+  std::vector<cfg::AclEntry> configs;
+  for (const auto& aclCfg : cfg_->acls) {
+    if (aclCfg.id < 0 || aclCfg.id >= kControlPlaneAclBase) {
+      throw FbossError("invalid ACL entry id ", aclCfg.id, ", the ids from ",
+                       kControlPlaneAclBase, " up are reserved");
+    }
+    configs.push_back(aclCfg);
+  }
+
+  flat_set<cfg::ControlProtocol> protocols;
+  for (const auto& trap : cfg_->controlPlaneTraps) {
+    if (!protocols.insert(trap.protocol).second) {
+      throw FbossError("duplicate control plane trap for protocol ",
+                       static_cast<int>(trap.protocol));
+    }
+    auto id = kControlPlaneAclBase + static_cast<int32_t>(trap.protocol) * 100;
+    for (const auto& acl : getControlPlaneAcls(trap.protocol)) {
+      configs.push_back(makeAclConfig(id++, acl, trap.queueId));
+    }
+  }
+
+  if (cfg_->neighborSuppression) {
+    // Punt the broadcast ARP requests, and the solicitations sent to the
+    // solicited-node multicast addresses, instead of flooding them.
+    // The unicast ones, which refresh known neighbors, are still switched.
+    int32_t arpQueue = 0;
+    int32_t ndpQueue = 0;
+    for (const auto& trap : cfg_->controlPlaneTraps) {
+      if (trap.protocol == cfg::ControlProtocol::ARP) {
+        arpQueue = trap.queueId;
+      } else if (trap.protocol == cfg::ControlProtocol::NDP) {
+        ndpQueue = trap.queueId;
+      }
+    }
+    cfg::AclEntry arp;
+    arp.id = kNeighborSuppressionAclBase;
+    arp.action = cfg::AclAction::PUNT;
+    arp.etherType = kEtherTypeArp;
+    arp.dstMac = "ff:ff:ff:ff:ff:ff";
+    arp.cpuQueue = arpQueue;
+    configs.push_back(arp);
+
+    cfg::AclEntry ndp;
+    ndp.id = kNeighborSuppressionAclBase + 1;
+    ndp.action = cfg::AclAction::PUNT;
+    ndp.dstMac = "33:33:ff:00:00:00";
+    ndp.dstMacMask = "ff:ff:ff:00:00:00";
+    ndp.ipProtocol = kIpProtoIcmpv6;
+    ndp.icmpv6Type = kIcmpv6NeighborSolicitation;
+    ndp.cpuQueue = ndpQueue;
+    configs.push_back(ndp);
+  }
+
+  if (cfg_->dropUnhandledControlFrames) {
+    auto id = kDropControlFramesAclBase;
+    for (const auto& acl : kDropControlFrames) {
+      configs.push_back(makeAclConfig(id++, acl, 0));
+    }
+  }
+  return configs;
+}
+
+shared_ptr<AclEntry> ThriftConfigApplier::createAcl(
+    const cfg::AclEntry* config) const {
+  auto checkRange = [&](int32_t value, int32_t max, const char* field) {
+    if (value < 0 || value > max) {
+      throw FbossError("invalid ", field, " ", value, " in ACL entry ",
+                       config->id);
+    }
+  };
+  checkRange(config->etherType, std::numeric_limits<uint16_t>::max(),
+             "etherType");
+  checkRange(config->ipProtocol, std::numeric_limits<uint8_t>::max(),
+             "ipProtocol");
+  checkRange(config->l4SrcPort, std::numeric_limits<uint16_t>::max(),
+             "l4SrcPort");
+  checkRange(config->l4DstPort, std::numeric_limits<uint16_t>::max(),
+             "l4DstPort");
+  checkRange(config->icmpv6Type, std::numeric_limits<uint8_t>::max(),
+             "icmpv6Type");
+  checkRange(config->cpuQueue, std::numeric_limits<uint16_t>::max(),
+             "cpuQueue");
+  if ((config->l4SrcPort || config->l4DstPort) &&
+      config->ipProtocol != kIpProtoTcp && config->ipProtocol != kIpProtoUdp) {
+    throw FbossError("ACL entry ", config->id, " matches L4 ports, but not "
+                     "TCP or UDP");
+  }
+  if (config->icmpv6Type && config->ipProtocol != kIpProtoIcmpv6) {
+    throw FbossError("ACL entry ", config->id, " matches an ICMPv6 type, but "
+                     "not ICMPv6");
+  }
+  if (!config->dstMacMask.empty() && config->dstMac.empty()) {
+    throw FbossError("ACL entry ", config->id, " has a dstMacMask, but no "
+                     "dstMac");
+  }
+
+  AclEntry::Match match;
+  match.etherType = config->etherType;
+  if (!config->dstMac.empty()) {
+    match.dstMac = MacAddress(config->dstMac);
+  }
+  if (!config->dstMacMask.empty()) {
+    match.dstMacMask = MacAddress(config->dstMacMask);
+  }
+  match.ipProtocol = config->ipProtocol;
+  match.l4SrcPort = config->l4SrcPort;
+  match.l4DstPort = config->l4DstPort;
+  match.icmpv6Type = config->icmpv6Type;
+
+  auto acl = make_shared<AclEntry>(AclEntryID(config->id), config->action);
+  acl->setMatch(match);
+  if (config->action != cfg::AclAction::DROP) {
+    acl->setCpuQueue(config->cpuQueue);
+  }
+  return acl;
+}
+
 shared_ptr<VlanMap> ThriftConfigApplier::updateVlans() {
   auto origVlans = orig_->getVlans();
   VlanMap::NodeContainer newVlans;
@@ -388,6 +1204,7 @@ shared_ptr<Vlan> ThriftConfigApplier::createVlan(const cfg::Vlan* config) {
   auto vlan = make_shared<Vlan>(config, mtu, ports);
   updateNeighborResponseTables(vlan.get(), config);
   updateDhcpOverrides(vlan.get(), config);
+  updateDhcpV6ExtraRelays(vlan.get(), config);
   return vlan;
 }
 
@@ -400,6 +1217,7 @@ shared_ptr<Vlan> ThriftConfigApplier::updateVlan(const shared_ptr<Vlan>& orig,
   bool changed_neighbor_table =
       updateNeighborResponseTables(newVlan.get(), config);
   bool changed_dhcp_overrides = updateDhcpOverrides(newVlan.get(), config);
+  bool changed_dhcp_relays = updateDhcpV6ExtraRelays(newVlan.get(), config);
   auto oldDhcpV4Relay = orig->getDhcpV4Relay();
   auto newDhcpV4Relay = config->__isset.dhcpRelayAddressV4 ?
     IPAddressV4(config->dhcpRelayAddressV4) : IPAddressV4();
@@ -413,10 +1231,16 @@ shared_ptr<Vlan> ThriftConfigApplier::updateVlan(const shared_ptr<Vlan>& orig,
   if (orig->getName() == config->name && orig->getPorts() == ports &&
       orig->getMTU() == mtu && oldDhcpV4Relay == newDhcpV4Relay &&
       oldDhcpV6Relay == newDhcpV6Relay && !changed_neighbor_table &&
-      !changed_dhcp_overrides) {
+      !changed_dhcp_overrides && !changed_dhcp_relays) {
     return nullptr;
   }
 
+  if (!changed_neighbor_table) {
+    // Give the new VLAN its own response tables anyway, so that they
+    // identify this version of the VLAN config (see vlansUnchanged()).
+    newVlan->setArpResponseTable(orig->getArpResponseTable()->clone());
+    newVlan->setNdpResponseTable(orig->getNdpResponseTable()->clone());
+  }
   newVlan->setName(config->name);
   newVlan->setPorts(ports);
   newVlan->setMTU(mtu);
@@ -461,6 +1285,24 @@ bool ThriftConfigApplier::updateDhcpOverrides(Vlan* vlan,
   return changed;
 }
 
+bool ThriftConfigApplier::updateDhcpV6ExtraRelays(Vlan* vlan,
+                                                  const cfg::Vlan* config) {
+  DhcpV6RelayList newRelays;
+  for (const auto& address : config->dhcpRelayAddressesV6) {
+    try {
+      newRelays.emplace_back(address);
+    } catch (const IPAddressFormatException& ex) {
+      throw FbossError("Invalid IPv6 address in DHCPv6 relay addresses: ",
+                       ex.what());
+    }
+  }
+  if (vlan->getDhcpV6ExtraRelays() == newRelays) {
+    return false;
+  }
+  vlan->setDhcpV6ExtraRelays(std::move(newRelays));
+  return true;
+}
+
 bool ThriftConfigApplier::updateNeighborResponseTables(
     Vlan* vlan,
     const cfg::Vlan* config) {
@@ -602,6 +1444,7 @@ shared_ptr<Interface> ThriftConfigApplier::createInterface(
   if (config->__isset.ndp) {
     intf->setNdpConfig(config->ndp);
   }
+  intf->setMtu(config->mtu);
   return intf;
 }
 
@@ -622,7 +1465,8 @@ shared_ptr<Interface> ThriftConfigApplier::updateInterface(
       orig->getName() == name &&
       orig->getMac() == mac &&
       orig->getAddresses() == addrs &&
-      orig->getNdpConfig() == ndp) {
+      orig->getNdpConfig() == ndp &&
+      orig->getMtu() == config->mtu) {
     // No change
     return nullptr;
   }
@@ -634,6 +1478,7 @@ shared_ptr<Interface> ThriftConfigApplier::updateInterface(
   newIntf->setMac(mac);
   newIntf->setAddresses(addrs);
   newIntf->setNdpConfig(ndp);
+  newIntf->setMtu(config->mtu);
   return newIntf;
 }
 
@@ -685,6 +1530,15 @@ shared_ptr<SwitchState> applyThriftConfig(
   return ThriftConfigApplier(state, config, platform).run();
 }
 
+shared_ptr<SwitchState> applyThriftConfigJson(
+    const shared_ptr<SwitchState>& state,
+    StringPiece json,
+    const Platform* platform) {
+  cfg::SwitchConfig config;
+  config.readFromJson(json.data(), json.size());
+  return ThriftConfigApplier(state, &config, platform).run();
+}
+
 shared_ptr<SwitchState> applyThriftConfigFile(
     const shared_ptr<SwitchState>& state,
     StringPiece path,
@@ -695,14 +1549,11 @@ shared_ptr<SwitchState> applyThriftConfigFile(
   // except that we manually read the file from disk for now.
   // We may not be able to rely on the configerator infrastructure for
   // distributing the config files.
-  cfg::SwitchConfig config;
   std::string contents;
   if (!folly::readFile(path.toString().c_str(), contents)) {
     throw FbossError("unable to read ", path);
   }
-  config.readFromJson(contents.c_str());
-
-  return ThriftConfigApplier(state, &config, platform).run();
+  return applyThriftConfigJson(state, contents, platform);
 }
 
 }} // facebook::fboss
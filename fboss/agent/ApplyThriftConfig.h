@@ -31,6 +31,16 @@ std::shared_ptr<SwitchState> applyThriftConfig(
     const std::shared_ptr<SwitchState>& state,
     const cfg::SwitchConfig* config,
     const Platform* platform);
+/*
+ * Apply a config given as JSON text.
+ *
+ * The new state is only computed, so this can also be used to find out what a
+ * config would change, by diffing the result against the original state.
+ */
+std::shared_ptr<SwitchState> applyThriftConfigJson(
+    const std::shared_ptr<SwitchState>& state,
+    folly::StringPiece json,
+    const Platform* platform);
 std::shared_ptr<SwitchState> applyThriftConfigFile(
     const std::shared_ptr<SwitchState>& state,
     folly::StringPiece path,
@@ -14,11 +14,14 @@
 #include <folly/io/Cursor.h>
 #include "fboss/agent/FbossError.h"
 #include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/NeighborLimits.h"
+#include "fboss/agent/NeighborSuppression.h"
 #include "fboss/agent/PortStats.h"
 #include "fboss/agent/RxPacket.h"
 #include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/TxPacket.h"
+#include "fboss/agent/packet/HdrView.h"
 #include "fboss/agent/packet/PktUtil.h"
 #include "fboss/agent/state/ArpEntry.h"
 #include "fboss/agent/state/ArpTable.h"
@@ -29,12 +32,21 @@
 #include "fboss/agent/state/VlanMap.h"
 #include "fboss/agent/state/Vlan.h"
 
+#include <gflags/gflags.h>
+
+DEFINE_int32(arp_request_retry_ms, 1000,
+             "Don't send another ARP request for an unresolved address "
+             "within this many milliseconds of the last one sent for it.  "
+             "0 sends a request for every packet to an unresolved address");
+
 using folly::IPAddressV4;
 using folly::MacAddress;
 using folly::io::Cursor;
 using folly::io::RWPrivateCursor;
 using std::unique_ptr;
 using std::shared_ptr;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
 
 enum : uint16_t {
   ARP_HTYPE_ETHERNET = 1,
@@ -54,54 +66,40 @@ enum : uint8_t {
 namespace facebook { namespace fboss {
 
 ArpHandler::ArpHandler(SwSwitch* sw)
-  : sw_(sw) {
+  : sw_(sw),
+    neighborUpdates_(std::make_shared<NeighborUpdateQueue<ArpTable>>()) {
 }
 
 void ArpHandler::handlePacket(unique_ptr<RxPacket> pkt,
                               MacAddress dst,
                               MacAddress src,
-                              Cursor cursor) {
-  PortID port = pkt->getSrcPort();
-  auto stats = sw_->stats();
-  stats->port(port)->arpPkt();
-  // Read htype, ptype, hlen, and plen
-  auto htype = cursor.readBE<uint16_t>();
-  if (htype != ARP_HTYPE_ETHERNET) {
-    stats->port(port)->arpUnsupported();
-    return;
-  }
-  auto ptype = cursor.readBE<uint16_t>();
-  if (ptype != ARP_PTYPE_IPV4) {
-    stats->port(port)->arpUnsupported();
-    return;
-  }
-  auto hlen = cursor.readBE<uint8_t>();
-  if (hlen != ARP_HLEN_ETHERNET) {
-    stats->port(port)->arpUnsupported();
-    return;
-  }
-  auto plen = cursor.readBE<uint8_t>();
-  if (plen != ARP_PLEN_IPV4) {
-    stats->port(port)->arpUnsupported();
+                              Cursor cursor,
+                              PortStats* portStats) {
+  portStats->arpPkt();
+  ArpHdrView arp(&cursor);
+  if (arp.htype() != ARP_HTYPE_ETHERNET ||
+      arp.ptype() != ARP_PTYPE_IPV4 ||
+      arp.hlen() != ARP_HLEN_ETHERNET ||
+      arp.plen() != ARP_PLEN_IPV4) {
+    portStats->arpUnsupported();
     return;
   }
 
   // Look up the Vlan state.
-  auto state = sw_->getState();
+  auto stateReader = sw_->readState();
+  const auto& state = stateReader.get();
   auto vlan = state->getVlans()->getVlanIf(pkt->getSrcVlan());
   if (!vlan) {
     // Hmm, we don't actually have this VLAN configured.
     // Perhaps the state has changed since we received the packet.
-    stats->port(port)->pktDropped();
+    portStats->pktDropped();
     return;
   }
 
-  // Parse the remaining data in the packet
-  auto op = cursor.readBE<uint16_t>();
-  auto senderMac = PktUtil::readMac(&cursor);
-  auto senderIP = PktUtil::readIPv4(&cursor);
-  auto targetMac = PktUtil::readMac(&cursor);
-  auto targetIP = PktUtil::readIPv4(&cursor);
+  auto op = arp.op();
+  auto senderMac = arp.senderMac();
+  auto senderIP = arp.senderIP();
+  auto targetIP = arp.targetIP();
 
   // Check to see if this IP address is in our ARP response table.
   auto entry = vlan->getArpResponseTable()->getEntry(targetIP);
@@ -109,11 +107,15 @@ void ArpHandler::handlePacket(unique_ptr<RxPacket> pkt,
     // The target IP does not refer to us.
     VLOG(5) << "ignoring ARP message for " << targetIP.str()
             << " on vlan " << pkt->getSrcVlan();
-    stats->port(port)->arpNotMine();
+    portStats->arpNotMine();
     // Update the sender IP --> sender MAC entry in our ARP table
     // only if it already exists.
     // (This behavior follows RFC 826.)
     updateExistingArpEntry(vlan, senderIP, senderMac, pkt->getSrcPort());
+    if (dst.isBroadcast() && state->getNeighborSuppression()) {
+      suppressArpMessage(state, vlan.get(), pkt.get(), op, senderMac,
+                         senderIP, targetIP);
+    }
     return;
   }
 
@@ -124,29 +126,29 @@ void ArpHandler::handlePacket(unique_ptr<RxPacket> pkt,
 
   // Send a reply if this is an ARP request.
   if (op == ARP_OP_REQUEST) {
-    stats->port(port)->arpRequestRx();
-    sendArpReply(pkt->getSrcVlan(), pkt->getSrcPort(),
-                 entry.value().mac, targetIP,
+    portStats->arpRequestRx();
+    VLOG(3) << "sending ARP reply on vlan " << pkt->getSrcVlan()
+            << " to " << senderIP.str() << " (" << senderMac << "): "
+            << targetIP.str() << " is " << entry.value().mac;
+    sendArpReply(pkt->getSrcPort(), getArpReply(vlan.get(), targetIP),
                  senderMac, senderIP);
     return;
   } else if (op == ARP_OP_REPLY) {
-    stats->port(port)->arpReplyRx();
+    portStats->arpReplyRx();
     return;
   } else {
-    stats->port(port)->arpBadOp();
+    portStats->arpBadOp();
     return;
   }
-
-  (void)targetMac; // unused
 }
 
-static void sendArp(SwSwitch *sw,
-                    VlanID vlan,
-                    ArpOpCode op,
-                    MacAddress senderMac,
-                    IPAddressV4 senderIP,
-                    MacAddress targetMac,
-                    IPAddressV4 targetIP) {
+static unique_ptr<TxPacket> createArpPacket(SwSwitch *sw,
+                                            VlanID vlan,
+                                            ArpOpCode op,
+                                            MacAddress senderMac,
+                                            IPAddressV4 senderIP,
+                                            MacAddress targetMac,
+                                            IPAddressV4 targetIP) {
   VLOG(3) << "sending ARP " << ((op == ARP_OP_REQUEST) ? "request" : "reply")
           << " on vlan " << vlan
           << " to " << targetIP.str() << " (" << targetMac << "): "
@@ -178,11 +180,32 @@ static void sendArp(SwSwitch *sw,
   cursor.write<uint32_t>(targetIP.toLong());
   // Fill the padding with 0s
   memset(cursor.writableData(), 0, cursor.length());
+  return pkt;
+}
+
+static void sendArp(SwSwitch *sw,
+                    VlanID vlan,
+                    ArpOpCode op,
+                    MacAddress senderMac,
+                    IPAddressV4 senderIP,
+                    MacAddress targetMac,
+                    IPAddressV4 targetIP) {
+  sw->sendPacketSwitched(createArpPacket(sw, vlan, op, senderMac, senderIP,
+                                         targetMac, targetIP));
+}
 
-  sw->sendPacketSwitched(std::move(pkt));
+void ArpHandler::sendGratuitousArp(const shared_ptr<Interface>& intf,
+                                   IPAddressV4 addr) {
+  // Gratuitous arps have both source and destination IPs set to
+  // originator's address
+  sendArp(sw_, intf->getVlanID(), ARP_OP_REQUEST, intf->getMac(), addr,
+          MacAddress::BROADCAST, addr);
 }
 
 void ArpHandler::floodGratuituousArp() {
+  // Build the ARPs for every interface first, so they can be handed to the
+  // hardware as a single batch.
+  std::vector<unique_ptr<TxPacket>> pkts;
   for (const auto& intf: *sw_->getState()->getInterfaces()) {
     for (const auto& addrEntry: intf->getAddresses()) {
       if (!addrEntry.first.isV4()) {
@@ -191,11 +214,11 @@ void ArpHandler::floodGratuituousArp() {
       auto v4Addr = addrEntry.first.asV4();
       // Gratuitous arps have both source and destination IPs set to
       // originator's address
-      sendArp(sw_, intf->getVlanID(), ARP_OP_REQUEST, intf->getMac(), v4Addr,
-          MacAddress::BROADCAST, v4Addr);
+      pkts.push_back(createArpPacket(sw_, intf->getVlanID(), ARP_OP_REQUEST,
+          intf->getMac(), v4Addr, MacAddress::BROADCAST, v4Addr));
     }
   }
-
+  sw_->sendPacketsSwitched(std::move(pkts));
 }
 
 uint32_t ArpHandler::flushArpEntryBlocking(IPAddressV4 ip, VlanID vlan) {
@@ -203,7 +226,17 @@ uint32_t ArpHandler::flushArpEntryBlocking(IPAddressV4 ip, VlanID vlan) {
   auto updateFn = [&](const std::shared_ptr<SwitchState>& state) {
     return performNeighborFlush(state, vlan, ip, &count);
   };
-  sw_->updateStateBlocking("flush ARP entry", updateFn);
+  sw_->updateStateBlocking("flush ARP entry", updateFn,
+                           StateUpdatePriority::NEIGHBOR);
+  // Let the next packet to the flushed address re-ARP right away
+  forgetArpRequests(ip, vlan);
+  return count;
+}
+
+uint32_t ArpHandler::flushArpEntry(std::shared_ptr<SwitchState>* state,
+                                   IPAddressV4 ip, VlanID vlan) {
+  uint32_t count{0};
+  *state = performNeighborFlush(*state, vlan, ip, &count);
   return count;
 }
 
@@ -244,24 +277,143 @@ bool ArpHandler::performNeighborFlush(std::shared_ptr<SwitchState>* state,
   return true;
 }
 
-void ArpHandler::sendArpReply(VlanID vlan,
-                              PortID port,
-                              MacAddress senderMac,
-                              IPAddressV4 senderIP,
+shared_ptr<const ArpHandler::VlanReplies> ArpHandler::buildVlanReplies(
+    VlanID vlan, const shared_ptr<ArpResponseTable>& table) {
+  auto replies = std::make_shared<VlanReplies>();
+  replies->table = table;
+  replies->replies.reserve(table->getTable().size());
+  for (const auto& entry : table->getTable()) {
+    replies->replies.emplace(entry.first, ArpReplyTemplate(
+        entry.second.mac, vlan, entry.first));
+  }
+  return replies;
+}
+
+ArpReplyTemplate ArpHandler::getArpReply(const Vlan* vlan, IPAddressV4 ip) {
+  auto table = vlan->getArpResponseTable();
+  shared_ptr<const VlanReplies> replies;
+  {
+    folly::SpinLockGuard guard(repliesLock_);
+    auto it = replies_.find(vlan->getID());
+    if (it != replies_.end() && it->second->table == table) {
+      replies = it->second;
+    }
+  }
+  if (!replies) {
+    // The response table changed since the replies were last built
+    replies = buildVlanReplies(vlan->getID(), table);
+    folly::SpinLockGuard guard(repliesLock_);
+    replies_[vlan->getID()] = replies;
+  }
+  auto it = replies->replies.find(ip);
+  CHECK(it != replies->replies.end());
+  return it->second;
+}
+
+void ArpHandler::sendArpReply(PortID port,
+                              const ArpReplyTemplate& reply,
                               MacAddress targetMac,
                               IPAddressV4 targetIP) {
   sw_->stats()->port(port)->arpReplyTx();
-  sendArp(sw_, vlan, ARP_OP_REPLY, senderMac, senderIP, targetMac, targetIP);
+  auto pkt = sw_->allocatePacket(ArpReplyTemplate::SIZE);
+  RWPrivateCursor cursor(pkt->buf());
+  reply.serialize(&cursor, targetMac, targetIP);
+  sw_->sendPacketSwitched(std::move(pkt));
+}
+
+void ArpHandler::suppressArpMessage(const shared_ptr<SwitchState>& state,
+                                    const Vlan* vlan,
+                                    const RxPacket* pkt,
+                                    uint16_t op,
+                                    MacAddress senderMac,
+                                    IPAddressV4 senderIP,
+                                    IPAddressV4 targetIP) {
+  // Gratuitous ARPs, and the probes of hosts checking that an address is
+  // free, are for every host to see
+  if (op == ARP_OP_REQUEST && !senderIP.isZero() && senderIP != targetIP) {
+    auto neighbor = vlan->getArpTable()->getEntryIf(targetIP);
+    if (neighbor && !neighbor->isPending() &&
+        neighbor->getMac() != senderMac) {
+      VLOG(4) << "answering ARP request on vlan " << vlan->getID()
+              << " from " << senderIP.str() << " for " << targetIP.str()
+              << " at " << neighbor->getMac();
+      sw_->stats()->neighborRequestSuppressed();
+      // The reply goes straight back out of the port the request came in
+      // on, so that the hardware never learns the host's MAC on the CPU
+      ArpReplyTemplate reply(neighbor->getMac(), vlan->getID(), targetIP);
+      auto replyPkt = sw_->allocatePacket(ArpReplyTemplate::SIZE);
+      RWPrivateCursor cursor(replyPkt->buf());
+      reply.serialize(&cursor, senderMac, senderIP);
+      sw_->sendPacketOutOfPort(std::move(replyPkt), pkt->getSrcPort());
+      return;
+    }
+  }
+  sw_->stats()->neighborRequestFlooded();
+  floodNeighborRequest(sw_, state, pkt);
 }
 
 void ArpHandler::sendArpRequest(shared_ptr<Vlan> vlan,
                                 shared_ptr<Interface> intf,
                                 IPAddressV4 senderIP,
                                 IPAddressV4 targetIP) {
+  auto key = std::make_pair(vlan->getID(), targetIP);
+  bool scheduleUpdate = false;
+  {
+    std::lock_guard<std::mutex> guard(requestsLock_);
+    auto now = steady_clock::now();
+    auto retry = milliseconds(FLAGS_arp_request_retry_ms);
+    auto it = lastRequest_.find(key);
+    if (it != lastRequest_.end() && now - it->second < retry) {
+      sw_->stats()->arpRequestSuppressed();
+      return;
+    }
+
+    // Forget requests that are outside the retry window, at most once per
+    // window, so lastRequest_ only holds recently requested addresses.
+    if (now - lastRequestSweep_ >= retry) {
+      for (auto iter = lastRequest_.begin(); iter != lastRequest_.end();) {
+        if (now - iter->second >= retry) {
+          iter = lastRequest_.erase(iter);
+        } else {
+          ++iter;
+        }
+      }
+      lastRequestSweep_ = now;
+    }
+    lastRequest_[key] = now;
+
+    if (!vlan->getArpTable()->getNodeIf(targetIP)) {
+      VLOG(4) << "setting pending entry on vlan " << key.first << " with ip "
+              << targetIP.str() << " and intf " << intf->getID();
+      pendingEntries_.push_back(PendingEntry{key, intf->getID()});
+      if (!pendingUpdateScheduled_) {
+        pendingUpdateScheduled_ = true;
+        scheduleUpdate = true;
+      }
+    }
+  }
+
   sw_->stats()->arpRequestTx();
   sendArp(sw_, vlan->getID(), ARP_OP_REQUEST, intf->getMac(), senderIP,
           MacAddress::BROADCAST, targetIP);
-  setPendingArpEntry(intf->getID(), vlan, targetIP);
+  if (scheduleUpdate) {
+    // This update adds every entry queued until it runs, not just this one
+    sw_->updateState("add pending ARP entries",
+                     [this](const shared_ptr<SwitchState>& state) {
+                       return addPendingArpEntries(state);
+                     },
+                     StateUpdatePriority::NEIGHBOR);
+  }
+}
+
+void ArpHandler::sendArpProbe(const shared_ptr<Interface>& intf,
+                              IPAddressV4 senderIP,
+                              IPAddressV4 targetIP,
+                              MacAddress targetMac) {
+  sw_->stats()->arpRequestTx();
+  sw_->stats()->neighborProbeTx();
+  sendArp(sw_, intf->getVlanID(), ARP_OP_REQUEST, intf->getMac(), senderIP,
+          targetMac, targetIP);
 }
 
 void ArpHandler::updateExistingArpEntry(const shared_ptr<Vlan>& origVlan,
@@ -286,59 +438,78 @@ void ArpHandler::updateExistingArpEntry(const shared_ptr<Vlan>& origVlan,
                     entry->getIntfID(), false);
 }
 
-void ArpHandler::setPendingArpEntry(InterfaceID intfID, shared_ptr<Vlan> vlan,
-                                    IPAddressV4 ip) {
-  auto vlanID = vlan->getID();
-  VLOG(4) << "setting pending entry on vlan " << vlanID << " with ip "
-          << ip.str() << " and intf " << intfID;
-
-  auto arpTable = vlan->getArpTable();
-  auto entry = arpTable->getNodeIf(ip);
-  if (entry) {
-    // Don't overwrite any entry with a pending entry
-    return;
+shared_ptr<SwitchState> ArpHandler::addPendingArpEntries(
+    const shared_ptr<SwitchState>& state) {
+  std::vector<PendingEntry> entries;
+  {
+    std::lock_guard<std::mutex> guard(requestsLock_);
+    entries.swap(pendingEntries_);
+    pendingUpdateScheduled_ = false;
   }
 
-  auto updateFn = [=](const shared_ptr<SwitchState>& state)
-    -> shared_ptr<SwitchState> {
-    auto vlans = state->getVlans();
-    auto vlan1 = vlans->getVlanIf(vlanID);
-    auto* newVlan = vlan1.get();
+  // Each VLAN and ARP table is only cloned by the first entry added to it,
+  // since modify() returns the unpublished copy after that.
+  shared_ptr<SwitchState> newState{state};
+  NeighborLimits limits(state.get());
+  uint64_t rejected = 0;
+  bool changed = false;
+  for (const auto& pending : entries) {
+    auto vlanID = pending.key.first;
+    auto ip = pending.key.second;
+    auto intfID = pending.intfID;
+    auto* newVlan = newState->getVlans()->getVlanIf(vlanID).get();
     if (!newVlan) {
       // This VLAN no longer exists.  Just ignore the ARP entry update.
       VLOG(4) << "VLAN " << vlanID <<
         " deleted before pending ARP entry could be added";
-      return nullptr;
+      continue;
     }
 
-    auto intfs = state->getInterfaces();
-    auto intf = intfs->getInterfaceIf(intfID);
+    auto intf = newState->getInterfaces()->getInterfaceIf(intfID);
     if (!intf) {
       VLOG(4) << "Interface " << intfID <<
         " deleted before pending ARP entry could be added";
-      return nullptr;
+      continue;
     }
     if (!intf->canReachAddress(ip)) {
       VLOG(4) << ip << " deleted from interface " << intfID <<
         " before pending ARP entry could be added";
-      return nullptr;
+      continue;
     }
 
-    shared_ptr<SwitchState> newState{state};
     auto* arpTable = newVlan->getArpTable().get();
-    auto entry = arpTable->getNodeIf(ip);
-    if (!entry) {
-      // only set a pending entry when we have no entry
-      arpTable = arpTable->modify(&newVlan, &newState);
-      arpTable->addPendingEntry(ip, intfID);
+    if (arpTable->getNodeIf(ip)) {
+      // Don't overwrite any entry with a pending entry
+      continue;
     }
-
+    if (!limits.tryAdd(vlanID)) {
+      VLOG(4) << "neighbor limit reached, not adding pending ARP entry for "
+              << ip.str();
+      ++rejected;
+      continue;
+    }
+    arpTable = arpTable->modify(&newVlan, &newState);
+    arpTable->addPendingEntry(ip, intfID);
+    changed = true;
     VLOG(4) << "Adding pending ARP entry for " << ip.str() <<
       " on interface " << intfID;
-    return newState;
-  };
+  }
+  if (rejected > 0) {
+    sw_->stats()->neighborLearnRejected(rejected);
+  }
+  return changed ? newState : nullptr;
+}
 
-  sw_->updateState("add pending ARP entry", updateFn);
+void ArpHandler::forgetArpRequests(IPAddressV4 ip, VlanID vlanID) {
+  std::lock_guard<std::mutex> guard(requestsLock_);
+  for (auto it = lastRequest_.begin(); it != lastRequest_.end();) {
+    if (it->first.second == ip &&
+        (vlanID == VlanID(0) || it->first.first == vlanID)) {
+      it = lastRequest_.erase(it);
+    } else {
+      ++it;
+    }
+  }
 }
 
 void ArpHandler::updateArpEntry(const shared_ptr<Vlan>& origVlan,
@@ -370,55 +541,27 @@ void ArpHandler::arpUpdateRequired(VlanID vlanID,
                                    InterfaceID intfID,
                                    bool addNewEntry) {
   // Ignore the entry if the IP isn't locally reachable on this interface
-  if (!Interface::isIpAttached(ip, intfID, sw_->getState())) {
+  if (!Interface::isIpAttached(ip, intfID, sw_->readState().get())) {
     LOG(WARNING) << "Skip updating un-reachable ARP entry " << ip << " --> "
       << mac << " on interface " << intfID;
     return;
   }
 
-  auto updateFn = [=](const shared_ptr<SwitchState>& state)
-      -> shared_ptr<SwitchState> {
-    auto* vlan = state->getVlans()->getVlanIf(vlanID).get();
-    if (!vlan) {
-      // This VLAN no longer exists.  Just ignore the ARP entry update.
-      VLOG(1) << "VLAN " << vlanID << " deleted before ARP entry " <<
-        ip << " --> " << mac << " could be updated";
-      return nullptr;
-    }
-
-    // The interfaces may be different now, so re-verify the address
-    if (!Interface::isIpAttached(ip, intfID, state)) {
-      LOG(WARNING) << "ARP entry " << ip << " --> "
-        << mac << " on interface " << intfID << " became unreachable before "
-        "it could be updated";
-      return nullptr;
-    }
-
-    shared_ptr<SwitchState> newState{state};
-    auto* arpTable = vlan->getArpTable().get();
-    auto entry = arpTable->getNodeIf(ip);
-    if (!entry) {
-      if (!addNewEntry) {
-        // This entry was deleted while we were waiting on the lock, and we
-        // aren't supposed to re-add it.
-        return nullptr;
-      }
-      arpTable = arpTable->modify(&vlan, &newState);
-      arpTable->addEntry(ip, mac, port, intfID);
-    } else {
-      if (entry->getMac() == mac &&
-          entry->getPort() == port &&
-          entry->getIntfID() == intfID) {
-        // This entry was already updated while we were waiting on the lock.
-        return nullptr;
-      }
-      arpTable = arpTable->modify(&vlan, &newState);
-      arpTable->updateEntry(ip, mac, port, intfID);
-    }
-    VLOG(3) << "Adding ARP entry for " << ip.str() << " --> " << mac;
-    return newState;
-  };
-  sw_->updateState("add ARP entry", updateFn);
+  auto updates = neighborUpdates_;
+  auto* sw = sw_;
+  if (!updates->add(vlanID, ip, {port, intfID, mac, addNewEntry})) {
+    return;
+  }
+  sw_->updateState("add ARP entries",
+                   [updates, sw](const shared_ptr<SwitchState>& state) {
+                     uint64_t rejected = 0;
+                     auto newState = updates->applyUpdates(state, &rejected);
+                     if (rejected > 0) {
+                       sw->stats()->neighborLearnRejected(rejected);
+                     }
+                     return newState;
+                   },
+                   StateUpdatePriority::NEIGHBOR);
 }
 
 }} // facebook::fboss
@@ -9,15 +9,23 @@
  */
 #pragma once
 
+#include "fboss/agent/NeighborUpdateQueue.h"
+#include "fboss/agent/packet/NeighborReplyTemplate.h"
 #include "fboss/agent/types.h"
 #include "fboss/agent/state/NeighborEntry.h"
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/Vlan.h"
 
+#include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
+#include <boost/container/flat_map.hpp>
 #include <folly/IPAddressV4.h>
 #include <folly/MacAddress.h>
+#include <folly/SpinLock.h>
 
 namespace folly { namespace io {
 class Cursor;
@@ -25,6 +33,9 @@ class Cursor;
 
 namespace facebook { namespace fboss {
 
+class ArpResponseTable;
+class ArpTable;
+class PortStats;
 class RxPacket;
 class SwSwitch;
 class SwitchState;
@@ -39,11 +50,26 @@ class ArpHandler {
   void handlePacket(std::unique_ptr<RxPacket> pkt,
                     folly::MacAddress dst,
                     folly::MacAddress src,
-                    folly::io::Cursor cursor);
+                    folly::io::Cursor cursor,
+                    PortStats* portStats);
   void sendArpRequest(std::shared_ptr<Vlan> vlan,
                       std::shared_ptr<Interface> intf,
                       folly::IPAddressV4 senderIP,
                       folly::IPAddressV4 targetIP);
+  /*
+   * Send a unicast ARP request to refresh an existing entry.  Unlike
+   * sendArpRequest(), this never adds a pending entry.
+   */
+  void sendArpProbe(const std::shared_ptr<Interface>& intf,
+                    folly::IPAddressV4 senderIP,
+                    folly::IPAddressV4 targetIP,
+                    folly::MacAddress targetMac);
+
+  /*
+   * Send a gratuitous ARP announcing one of the interface's addresses.
+   */
+  void sendGratuitousArp(const std::shared_ptr<Interface>& intf,
+                         folly::IPAddressV4 addr);
 
   /*
    * Send gratuitous arp on all vlans
@@ -51,16 +77,53 @@ class ArpHandler {
   void floodGratuituousArp();
   uint32_t flushArpEntryBlocking(folly::IPAddressV4, VlanID vlan);
 
+  /*
+   * Remove the ARP entry for ip on the VLAN, or on every VLAN if it is 0,
+   * from *state, for flushing several neighbors in one state update.
+   * Returns the number of entries removed.  Call forgetArpRequests() for the
+   * address once the update is applied.
+   */
+  uint32_t flushArpEntry(std::shared_ptr<SwitchState>* state,
+                         folly::IPAddressV4 ip, VlanID vlan);
+  // Let the next packet to the address send an ARP request right away
+  void forgetArpRequests(folly::IPAddressV4 ip, VlanID vlan);
+
  private:
   // Forbidden copy constructor and assignment operator
   ArpHandler(ArpHandler const &) = delete;
   ArpHandler& operator=(ArpHandler const &) = delete;
 
-  void sendArpReply(VlanID vlan, PortID port,
-                    folly::MacAddress senderMac,
-                    folly::IPAddressV4 senderIP,
+  /*
+   * The ARP replies for our addresses on one VLAN, built from its ARP
+   * response table.
+   */
+  struct VlanReplies {
+    std::shared_ptr<ArpResponseTable> table;
+    boost::container::flat_map<folly::IPAddressV4, ArpReplyTemplate> replies;
+  };
+
+  static std::shared_ptr<const VlanReplies> buildVlanReplies(
+      VlanID vlan, const std::shared_ptr<ArpResponseTable>& table);
+  /*
+   * Get the reply for ip, which must be in the VLAN's response table.
+   */
+  ArpReplyTemplate getArpReply(const Vlan* vlan, folly::IPAddressV4 ip);
+  void sendArpReply(PortID port,
+                    const ArpReplyTemplate& reply,
                     folly::MacAddress targetMac,
                     folly::IPAddressV4 targetIP);
+  /*
+   * With neighbor suppression, answer a broadcast ARP message the hardware
+   * punted for an address that is not ours on behalf of the host, if it is
+   * a request for a host in the VLAN's ARP table, or flood it otherwise.
+   */
+  void suppressArpMessage(const std::shared_ptr<SwitchState>& state,
+                          const Vlan* vlan,
+                          const RxPacket* pkt,
+                          uint16_t op,
+                          folly::MacAddress senderMac,
+                          folly::IPAddressV4 senderIP,
+                          folly::IPAddressV4 targetIP);
   void updateExistingArpEntry(const std::shared_ptr<Vlan>& vlan,
                               folly::IPAddressV4 ip,
                               folly::MacAddress mac,
@@ -70,8 +133,8 @@ class ArpHandler {
                       folly::MacAddress mac,
                       PortID port,
                       InterfaceID intfID);
-  void setPendingArpEntry(InterfaceID intf, std::shared_ptr<Vlan> vlan,
-                          folly::IPAddressV4 ip);
+  std::shared_ptr<SwitchState> addPendingArpEntries(
+      const std::shared_ptr<SwitchState>& state);
   void arpUpdateRequired(VlanID vlanID,
                          folly::IPAddressV4 ip,
                          folly::MacAddress mac,
@@ -88,7 +151,54 @@ class ArpHandler {
                             Vlan* vlan,
                             folly::IPAddressV4 ip);
 
+  typedef std::pair<VlanID, folly::IPAddressV4> RequestKey;
+  struct PendingEntry {
+    RequestKey key;
+    InterfaceID intfID;
+  };
+
   SwSwitch* sw_{nullptr};
+
+  /*
+   * IPv4Handler::resolveMac() calls sendArpRequest() for every packet sent
+   * to an unresolved next hop, until the pending entry shows up in the
+   * SwitchState.  During a burst of traffic towards an unresolved subnet
+   * this would send an ARP request and schedule a state update per packet.
+   *
+   * Instead, we remember when we last sent a request for each (VLAN, IP),
+   * and don't send another one within --arp_request_retry_ms.  Pending
+   * entries are queued in pendingEntries_, and all the entries queued
+   * before the update thread gets to them are added by a single state
+   * update.
+   *
+   * All of these are protected by requestsLock_, since packets are handled
+   * from multiple threads.
+   */
+  std::mutex requestsLock_;
+  std::map<RequestKey, std::chrono::steady_clock::time_point> lastRequest_;
+  std::chrono::steady_clock::time_point lastRequestSweep_;
+  std::vector<PendingEntry> pendingEntries_;
+  bool pendingUpdateScheduled_{false};
+
+  /*
+   * ARP entries learned from received packets that have not been added to
+   * the SwitchState yet.  All the entries queued before the update thread
+   * gets to them are added by a single state update.
+   *
+   * This is shared with the scheduled update, which may run after the
+   * ArpHandler has been destroyed.
+   */
+  std::shared_ptr<NeighborUpdateQueue<ArpTable>> neighborUpdates_;
+
+  /*
+   * The replies for our addresses on every VLAN, so that answering an ARP
+   * request is a copy of a preformatted reply.  The replies of a VLAN are
+   * built again the first time they are needed after its response table
+   * changed.
+   */
+  boost::container::flat_map<VlanID, std::shared_ptr<const VlanReplies>>
+    replies_;
+  folly::SpinLock repliesLock_;
 };
 
 }} // facebook::fboss
@@ -0,0 +1,546 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/BfdManager.h"
+
+#include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/SysError.h"
+#include "fboss/agent/ThreadSampler.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Random.h>
+#include <folly/SocketAddress.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using folly::ByteRange;
+using folly::IPAddress;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+constexpr uint8_t kBfdVersion = 1;
+constexpr uint8_t kTtl = 255;
+
+// The flags in the second byte of a control packet
+enum : uint8_t {
+  kFlagPoll = 0x20,
+  kFlagFinal = 0x10,
+  kFlagAuth = 0x04,
+  kFlagMultipoint = 0x01,
+};
+
+void writeBE32(uint32_t value, uint8_t* buf) {
+  buf[0] = value >> 24;
+  buf[1] = value >> 16;
+  buf[2] = value >> 8;
+  buf[3] = value;
+}
+
+uint32_t readBE32(const uint8_t* buf) {
+  return (uint32_t(buf[0]) << 24) | (uint32_t(buf[1]) << 16) |
+    (uint32_t(buf[2]) << 8) | buf[3];
+}
+
+uint32_t toMicroseconds(microseconds interval) {
+  return std::min<uint64_t>(interval.count(),
+                            std::numeric_limits<uint32_t>::max());
+}
+
+void incrementCounter(const char* name) {
+  fbData->incrementCounter(SwitchStats::kCounterPrefix + name, 1);
+}
+
+int openSocket(int family, uint16_t port) {
+  int sock = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    return -1;
+  }
+  int one = 1;
+  int ttl = kTtl;
+  bool ok;
+  if (family == AF_INET) {
+    ok = ::setsockopt(sock, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl)) == 0 &&
+      ::setsockopt(sock, IPPROTO_IP, IP_RECVTTL, &one, sizeof(one)) == 0;
+  } else {
+    // The IPv4 socket has the port for IPv4
+    ok = ::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY,
+                      &one, sizeof(one)) == 0 &&
+      ::setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_HOPS,
+                   &ttl, sizeof(ttl)) == 0 &&
+      ::setsockopt(sock, IPPROTO_IPV6, IPV6_RECVHOPLIMIT,
+                   &one, sizeof(one)) == 0;
+  }
+  if (ok) {
+    folly::SocketAddress addr(
+        family == AF_INET ? IPAddress("0.0.0.0") : IPAddress("::"), port);
+    sockaddr_storage storage;
+    auto len = addr.getAddress(&storage);
+    ok = ::bind(sock, reinterpret_cast<sockaddr*>(&storage), len) == 0;
+  }
+  if (!ok) {
+    auto err = errno;
+    ::close(sock);
+    errno = err;
+    return -1;
+  }
+  return sock;
+}
+
+int openTxSocket(int family) {
+  // Single hop BFD must send from a port in 49152-65535
+  for (uint32_t port = BfdManager::BFD_SOURCE_PORT_MIN; port <= 65535;
+       ++port) {
+    auto sock = openSocket(family, port);
+    if (sock >= 0 || errno != EADDRINUSE) {
+      return sock;
+    }
+  }
+  return -1;
+}
+
+} // unnamed namespace
+
+constexpr size_t BfdManager::kPacketLength;
+
+BfdManager::Session::Session(const BfdSessionConfig& config,
+                             uint32_t discriminator)
+  : config_(config),
+    discriminator_(discriminator) {
+}
+
+microseconds BfdManager::Session::getDesiredMinTx() const {
+  // RFC 5880 6.8.3: at least one second while the session is not up
+  if (state_ == State::UP) {
+    return config_.minTxInterval;
+  }
+  return std::max<microseconds>(config_.minTxInterval, seconds(1));
+}
+
+void BfdManager::Session::setState(State state, uint8_t diag,
+                                   TimePoint now) {
+  if (state == state_) {
+    return;
+  }
+  state_ = state;
+  diag_ = diag;
+  // Tell the peer straight away
+  nextTx_ = now;
+}
+
+bool BfdManager::Session::receive(const ControlPacket& pkt, TimePoint now) {
+  remoteDiscriminator_ = pkt.myDiscriminator;
+  remoteState_ = pkt.state;
+  remoteDetectMult_ = pkt.detectMult;
+  remoteMinRx_ = microseconds(pkt.requiredMinRx);
+  remoteDesiredMinTx_ = microseconds(pkt.desiredMinTx);
+  detectDeadline_ = now + remoteDetectMult_ *
+    std::max<microseconds>(config_.minRxInterval, remoteDesiredMinTx_);
+
+  // The state machine of RFC 5880 6.8.6
+  if (remoteState_ == State::ADMIN_DOWN) {
+    setState(State::DOWN, DIAG_NEIGHBOR_DOWN, now);
+  } else if (state_ == State::DOWN) {
+    if (remoteState_ == State::DOWN) {
+      setState(State::INIT, DIAG_NONE, now);
+    } else if (remoteState_ == State::INIT) {
+      setState(State::UP, DIAG_NONE, now);
+    }
+  } else if (state_ == State::INIT) {
+    if (remoteState_ == State::INIT || remoteState_ == State::UP) {
+      setState(State::UP, DIAG_NONE, now);
+    }
+  } else if (state_ == State::UP && remoteState_ == State::DOWN) {
+    setState(State::DOWN, DIAG_NEIGHBOR_DOWN, now);
+  }
+  return pkt.poll;
+}
+
+void BfdManager::Session::checkTimeout(TimePoint now) {
+  if (isDetecting() && now >= detectDeadline_) {
+    setState(State::DOWN, DIAG_DETECT_TIMEOUT, now);
+    remoteDiscriminator_ = 0;
+  }
+}
+
+BfdManager::ControlPacket BfdManager::Session::makePacket(bool final) const {
+  ControlPacket pkt;
+  pkt.diag = diag_;
+  pkt.state = state_;
+  pkt.final = final;
+  pkt.detectMult = config_.multiplier;
+  pkt.myDiscriminator = discriminator_;
+  pkt.yourDiscriminator = remoteDiscriminator_;
+  pkt.desiredMinTx = toMicroseconds(getDesiredMinTx());
+  pkt.requiredMinRx = toMicroseconds(config_.minRxInterval);
+  return pkt;
+}
+
+void BfdManager::Session::scheduleTx(TimePoint now) {
+  auto interval = std::max(getDesiredMinTx(), remoteMinRx_);
+  // RFC 5880 6.8.7: 75-100% of the interval, or 75-90% if the peer
+  // declares us down after a single missed packet
+  uint32_t maxPercent = config_.multiplier == 1 ? 90 : 100;
+  interval = interval * folly::Random::rand32(75, maxPercent + 1) / 100;
+  nextTx_ = now + interval;
+}
+
+BfdManager::BfdManager(SwSwitch* sw)
+  : sw_(sw) {
+}
+
+BfdManager::~BfdManager() {
+  stop();
+}
+
+void BfdManager::start() {
+  CHECK(!thread_.joinable());
+  sysCheckError(::pipe2(wakeFds_, O_NONBLOCK | O_CLOEXEC),
+                "cannot create BFD wake pipe");
+  thread_ = std::thread([this] { this->threadLoop(); });
+}
+
+void BfdManager::stop() {
+  stopping_ = true;
+  if (thread_.joinable()) {
+    char c = 0;
+    ::write(wakeFds_[1], &c, 1);
+    thread_.join();
+  }
+  for (auto* fd : {&wakeFds_[0], &wakeFds_[1]}) {
+    if (*fd >= 0) {
+      ::close(*fd);
+      *fd = -1;
+    }
+  }
+}
+
+void BfdManager::stateChanged(const StateDelta& delta) {
+  const auto& newSessions = delta.newState()->getBfdSessions();
+  if (delta.oldState()->getBfdSessions() == newSessions) {
+    return;
+  }
+  {
+    lock_guard<mutex> g(mutex_);
+    pendingConfig_ = newSessions;
+    configChanged_ = true;
+  }
+  if (wakeFds_[1] >= 0) {
+    char c = 0;
+    ::write(wakeFds_[1], &c, 1);
+  }
+}
+
+void BfdManager::threadLoop() {
+  // The pthread name can be at most 15 bytes long
+  pthread_setname_np(pthread_self(), "fbossBfd");
+  ThreadSampler::registerThread("fbossBfd");
+
+  while (!stopping_) {
+    applyConfig();
+
+    auto now = steady_clock::now();
+    auto wakeUp = now + seconds(1);
+    for (auto& entry : sessions_) {
+      auto& session = entry.second;
+      bool wasUp = session.getState() == State::UP;
+      session.checkTimeout(now);
+      sessionChanged(session, wasUp);
+      if (now >= session.getNextTx()) {
+        send(session, false);
+        session.scheduleTx(now);
+      }
+      wakeUp = std::min(wakeUp, session.getNextTx());
+      if (session.isDetecting()) {
+        wakeUp = std::min(wakeUp, session.getDetectDeadline());
+      }
+    }
+
+    pollfd fds[3];
+    nfds_t numFds = 0;
+    for (auto fd : {wakeFds_[0], rxSock4_, rxSock6_}) {
+      if (fd >= 0) {
+        fds[numFds].fd = fd;
+        fds[numFds].events = POLLIN;
+        fds[numFds].revents = 0;
+        ++numFds;
+      }
+    }
+    // Round up, so that we don't spin until a deadline
+    auto timeout = duration_cast<milliseconds>(
+        wakeUp - now + milliseconds(1) - microseconds(1));
+    auto ret = ::poll(fds, numFds, std::max<int>(timeout.count(), 0));
+    if (ret < 0 && errno != EINTR) {
+      LOG(ERROR) << "BFD poll failed: " << folly::errnoStr(errno);
+      std::this_thread::sleep_for(milliseconds(10));
+      continue;
+    }
+    for (nfds_t i = 0; ret > 0 && i < numFds; ++i) {
+      if (!(fds[i].revents & POLLIN)) {
+        continue;
+      }
+      if (fds[i].fd == wakeFds_[0]) {
+        char buf[64];
+        while (::read(wakeFds_[0], buf, sizeof(buf)) > 0) {
+        }
+      } else {
+        receivePackets(fds[i].fd);
+      }
+    }
+  }
+  closeSockets();
+}
+
+void BfdManager::applyConfig() {
+  std::vector<BfdSessionConfig> configs;
+  {
+    lock_guard<mutex> g(mutex_);
+    if (!configChanged_) {
+      return;
+    }
+    configs.swap(pendingConfig_);
+    configChanged_ = false;
+  }
+
+  // Keep the state of the sessions that are still configured, so that a
+  // config change does not bring them down
+  std::map<SessionKey, Session> sessions;
+  for (const auto& config : configs) {
+    SessionKey key(config.router, config.peer);
+    auto it = sessions_.find(key);
+    if (it != sessions_.end()) {
+      it->second.setConfig(config);
+      sessions.emplace(key, std::move(it->second));
+      sessions_.erase(it);
+    } else {
+      LOG(INFO) << "starting BFD session with " << config.peer;
+      sessions.emplace(key, Session(config, newDiscriminator()));
+    }
+  }
+  for (const auto& entry : sessions_) {
+    LOG(INFO) << "stopping BFD session with " << entry.first.second;
+    if (entry.second.getState() != State::UP) {
+      // Don't leave the paths through the neighbor pruned
+      sw_->getHw()->setNeighborReachable(entry.first.first,
+                                         entry.first.second, true);
+    }
+  }
+  sessions_.swap(sessions);
+
+  if (sessions_.empty()) {
+    closeSockets();
+  } else {
+    openSockets();
+  }
+}
+
+void BfdManager::openSockets() {
+  struct {
+    int* sock;
+    int family;
+    bool rx;
+  } socks[] = {
+    {&rxSock4_, AF_INET, true},
+    {&rxSock6_, AF_INET6, true},
+    {&txSock4_, AF_INET, false},
+    {&txSock6_, AF_INET6, false},
+  };
+  for (const auto& s : socks) {
+    if (*s.sock >= 0) {
+      continue;
+    }
+    *s.sock = s.rx ? openSocket(s.family, BFD_PORT) : openTxSocket(s.family);
+    if (*s.sock < 0) {
+      LOG(ERROR) << "cannot open BFD " << (s.rx ? "receive" : "send")
+                 << " socket: " << folly::errnoStr(errno);
+    }
+  }
+}
+
+void BfdManager::closeSockets() {
+  for (auto* sock : {&rxSock4_, &rxSock6_, &txSock4_, &txSock6_}) {
+    if (*sock >= 0) {
+      ::close(*sock);
+      *sock = -1;
+    }
+  }
+}
+
+void BfdManager::receivePackets(int sock) {
+  while (true) {
+    uint8_t buf[128];
+    sockaddr_storage src;
+    char control[CMSG_SPACE(sizeof(int)) * 2];
+    iovec iov{buf, sizeof(buf)};
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &src;
+    msg.msg_namelen = sizeof(src);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto len = ::recvmsg(sock, &msg, 0);
+    if (len < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOG(ERROR) << "cannot receive BFD packet: " << folly::errnoStr(errno);
+      }
+      return;
+    }
+
+    // RFC 5881 5: single hop packets must arrive with a TTL of 255, so that
+    // they cannot come from further away
+    int ttl = -1;
+    for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if ((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TTL) ||
+          (cmsg->cmsg_level == IPPROTO_IPV6 &&
+           cmsg->cmsg_type == IPV6_HOPLIMIT)) {
+        memcpy(&ttl, CMSG_DATA(cmsg), sizeof(ttl));
+      }
+    }
+    ControlPacket pkt;
+    if (ttl != kTtl || !parsePacket(ByteRange(buf, len), &pkt)) {
+      incrementCounter("bfd.rx_invalid");
+      continue;
+    }
+
+    folly::SocketAddress addr;
+    addr.setFromSockaddr(reinterpret_cast<sockaddr*>(&src), msg.msg_namelen);
+    auto peer = addr.getIPAddress();
+    Session* session = nullptr;
+    for (auto& entry : sessions_) {
+      if (entry.first.second != peer) {
+        continue;
+      }
+      if (pkt.yourDiscriminator != 0 ?
+          entry.second.getDiscriminator() == pkt.yourDiscriminator :
+          pkt.state == State::DOWN || pkt.state == State::ADMIN_DOWN) {
+        session = &entry.second;
+        break;
+      }
+    }
+    if (!session) {
+      VLOG(4) << "ignoring BFD packet from " << peer;
+      incrementCounter("bfd.rx_unknown");
+      continue;
+    }
+
+    bool wasUp = session->getState() == State::UP;
+    if (session->receive(pkt, steady_clock::now())) {
+      send(*session, true);
+    }
+    sessionChanged(*session, wasUp);
+  }
+}
+
+void BfdManager::send(const Session& session, bool final) {
+  const auto& peer = session.getConfig().peer;
+  auto sock = peer.isV4() ? txSock4_ : txSock6_;
+  if (sock < 0) {
+    return;
+  }
+  uint8_t buf[kPacketLength];
+  writePacket(session.makePacket(final), buf);
+  folly::SocketAddress addr(peer, BFD_PORT);
+  sockaddr_storage storage;
+  auto len = addr.getAddress(&storage);
+  if (::sendto(sock, buf, sizeof(buf), 0,
+               reinterpret_cast<sockaddr*>(&storage), len) < 0) {
+    VLOG(3) << "cannot send BFD packet to " << peer << ": "
+            << folly::errnoStr(errno);
+    incrementCounter("bfd.send_errors");
+  }
+}
+
+void BfdManager::sessionChanged(const Session& session, bool wasUp) {
+  bool up = session.getState() == State::UP;
+  if (up == wasUp) {
+    return;
+  }
+  const auto& config = session.getConfig();
+  // Only prune paths to neighbors whose session was once up, so that a
+  // neighbor that does not run BFD yet is not cut off
+  LOG(INFO) << "BFD session with " << config.peer
+            << (up ? " is up" : " went down");
+  incrementCounter(up ? "bfd.session_up" : "bfd.session_down");
+  if (!sw_->getHw()->setNeighborReachable(config.router, config.peer, up)) {
+    VLOG(2) << "the hardware cannot prune the paths to " << config.peer;
+  }
+}
+
+uint32_t BfdManager::newDiscriminator() const {
+  while (true) {
+    auto discriminator = folly::Random::rand32();
+    if (discriminator == 0) {
+      continue;
+    }
+    bool used = false;
+    for (const auto& entry : sessions_) {
+      used = used || entry.second.getDiscriminator() == discriminator;
+    }
+    if (!used) {
+      return discriminator;
+    }
+  }
+}
+
+void BfdManager::writePacket(const ControlPacket& pkt, uint8_t* buf) {
+  buf[0] = (kBfdVersion << 5) | (pkt.diag & 0x1f);
+  buf[1] = (static_cast<uint8_t>(pkt.state) << 6) |
+    (pkt.poll ? kFlagPoll : 0) | (pkt.final ? kFlagFinal : 0);
+  buf[2] = pkt.detectMult;
+  buf[3] = kPacketLength;
+  writeBE32(pkt.myDiscriminator, buf + 4);
+  writeBE32(pkt.yourDiscriminator, buf + 8);
+  writeBE32(pkt.desiredMinTx, buf + 12);
+  writeBE32(pkt.requiredMinRx, buf + 16);
+  // We don't support echo packets
+  writeBE32(0, buf + 20);
+}
+
+bool BfdManager::parsePacket(ByteRange buf, ControlPacket* pkt) {
+  // The checks of RFC 5880 6.8.6.  Authentication is not supported.
+  if (buf.size() < kPacketLength || (buf[0] >> 5) != kBfdVersion ||
+      buf[3] < kPacketLength || buf[3] > buf.size() ||
+      (buf[1] & (kFlagAuth | kFlagMultipoint)) || buf[2] == 0) {
+    return false;
+  }
+  pkt->diag = buf[0] & 0x1f;
+  pkt->state = static_cast<State>(buf[1] >> 6);
+  pkt->poll = buf[1] & kFlagPoll;
+  pkt->final = buf[1] & kFlagFinal;
+  pkt->detectMult = buf[2];
+  pkt->myDiscriminator = readBE32(buf.data() + 4);
+  pkt->yourDiscriminator = readBE32(buf.data() + 8);
+  pkt->desiredMinTx = readBE32(buf.data() + 12);
+  pkt->requiredMinRx = readBE32(buf.data() + 16);
+  return pkt->myDiscriminator != 0;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,199 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/StateObserver.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/types.h"
+
+#include <folly/IPAddress.h>
+#include <folly/Range.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class StateDelta;
+class SwSwitch;
+
+/*
+ * BfdManager runs asynchronous mode BFD sessions (RFC 5880 and 5881) with
+ * the neighbors listed in the config, to notice within milliseconds that a
+ * neighbor stopped forwarding.
+ *
+ * When a session goes down, the paths through its neighbor are pruned from
+ * the ECMP groups in hardware straight away, through
+ * HwSwitch::setNeighborReachable(), and are added back when the session
+ * comes up again.  The routes themselves are left to the routing protocol
+ * to converge.
+ *
+ * The sessions run on their own thread, which does nothing but send and
+ * receive BFD packets, so that a busy update or background thread never
+ * delays them enough to bring a session down.
+ */
+class BfdManager : public StateObserver {
+ public:
+  enum : uint16_t {
+    BFD_PORT = 3784,
+    // Single hop BFD packets must come from a source port in this range
+    BFD_SOURCE_PORT_MIN = 49152,
+  };
+  enum class State : uint8_t {
+    ADMIN_DOWN = 0,
+    DOWN = 1,
+    INIT = 2,
+    UP = 3,
+  };
+  enum : uint8_t {
+    DIAG_NONE = 0,
+    DIAG_DETECT_TIMEOUT = 1,
+    DIAG_NEIGHBOR_DOWN = 3,
+  };
+  static constexpr size_t kPacketLength = 24;
+
+  struct ControlPacket {
+    uint8_t diag{DIAG_NONE};
+    State state{State::DOWN};
+    bool poll{false};
+    bool final{false};
+    uint8_t detectMult{0};
+    uint32_t myDiscriminator{0};
+    uint32_t yourDiscriminator{0};
+    // In microseconds
+    uint32_t desiredMinTx{0};
+    uint32_t requiredMinRx{0};
+  };
+
+  /*
+   * The state of one session, apart from the sockets it runs over.
+   */
+  class Session {
+   public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    Session(const BfdSessionConfig& config, uint32_t discriminator);
+
+    const BfdSessionConfig& getConfig() const {
+      return config_;
+    }
+    void setConfig(const BfdSessionConfig& config) {
+      config_ = config;
+    }
+    State getState() const {
+      return state_;
+    }
+    uint32_t getDiscriminator() const {
+      return discriminator_;
+    }
+    uint32_t getRemoteDiscriminator() const {
+      return remoteDiscriminator_;
+    }
+
+    /*
+     * Process a packet from the peer.  Returns true if it asked for a
+     * packet with the final bit in reply.
+     */
+    bool receive(const ControlPacket& pkt, TimePoint now);
+    /*
+     * Bring the session down if nothing was heard from the peer for the
+     * detection time.
+     */
+    void checkTimeout(TimePoint now);
+
+    /*
+     * The next time a packet is due, or the peer is due to be declared
+     * down.  The detection deadline only applies while the session is
+     * initializing or up.
+     */
+    TimePoint getNextTx() const {
+      return nextTx_;
+    }
+    bool isDetecting() const {
+      return state_ == State::INIT || state_ == State::UP;
+    }
+    TimePoint getDetectDeadline() const {
+      return detectDeadline_;
+    }
+
+    ControlPacket makePacket(bool final) const;
+    /*
+     * Schedule the next packet after one sent now, with the jitter RFC
+     * 5880 asks for.
+     */
+    void scheduleTx(TimePoint now);
+
+   private:
+    std::chrono::microseconds getDesiredMinTx() const;
+    void setState(State state, uint8_t diag, TimePoint now);
+
+    BfdSessionConfig config_;
+    const uint32_t discriminator_{0};
+    State state_{State::DOWN};
+    uint8_t diag_{DIAG_NONE};
+    uint32_t remoteDiscriminator_{0};
+    State remoteState_{State::DOWN};
+    uint8_t remoteDetectMult_{0};
+    std::chrono::microseconds remoteMinRx_{1};
+    std::chrono::microseconds remoteDesiredMinTx_{0};
+    TimePoint nextTx_;
+    TimePoint detectDeadline_;
+  };
+
+  explicit BfdManager(SwSwitch* sw);
+  ~BfdManager();
+
+  void start();
+  void stop();
+
+  void stateChanged(const StateDelta& delta) override;
+
+  static void writePacket(const ControlPacket& pkt, uint8_t* buf);
+  static bool parsePacket(folly::ByteRange buf, ControlPacket* pkt);
+
+ private:
+  typedef std::pair<RouterID, folly::IPAddress> SessionKey;
+
+  // Forbidden copy constructor and assignment operator
+  BfdManager(BfdManager const &) = delete;
+  BfdManager& operator=(BfdManager const &) = delete;
+
+  void threadLoop();
+  void openSockets();
+  void closeSockets();
+  void applyConfig();
+  void receivePackets(int sock);
+  void send(const Session& session, bool final);
+  void sessionChanged(const Session& session, bool wasUp);
+  uint32_t newDiscriminator() const;
+
+  SwSwitch* sw_{nullptr};
+  std::thread thread_;
+  // Written to wake the thread up for a new config, or to stop
+  int wakeFds_[2]{-1, -1};
+  std::atomic<bool> stopping_{false};
+
+  // The sessions the next config update asks for
+  std::mutex mutex_;
+  std::vector<BfdSessionConfig> pendingConfig_;
+  bool configChanged_{false};
+
+  // Only accessed by the BFD thread
+  std::map<SessionKey, Session> sessions_;
+  int rxSock4_{-1};
+  int rxSock6_{-1};
+  int txSock4_{-1};
+  int txSock6_{-1};
+};
+
+}} // facebook::fboss
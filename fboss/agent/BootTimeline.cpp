@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/BootTimeline.h"
+#include "fboss/agent/SwitchStats.h"
+#include "common/stats/ServiceData.h"
+
+#include <glog/logging.h>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+BootTimeline::PhaseTimer::PhaseTimer(folly::StringPiece name)
+  : name_(name.str()),
+    start_(steady_clock::now()) {
+}
+
+BootTimeline::PhaseTimer::~PhaseTimer() {
+  BootTimeline::get()->recordPhase(name_, start_, steady_clock::now());
+}
+
+BootTimeline::BootTimeline()
+  : start_(steady_clock::now()) {
+}
+
+BootTimeline* BootTimeline::get() {
+  static BootTimeline timeline;
+  return &timeline;
+}
+
+void BootTimeline::recordPhase(folly::StringPiece name, TimePoint start,
+                               TimePoint end) {
+  Phase phase;
+  phase.name = name.str();
+  phase.start = duration_cast<milliseconds>(start - start_);
+  phase.duration = duration_cast<milliseconds>(end - start);
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    for (const auto& existing : phases_) {
+      if (existing.name == phase.name) {
+        return;
+      }
+    }
+    phases_.push_back(phase);
+  }
+  LOG(INFO) << "boot phase " << phase.name << " took "
+            << phase.duration.count() << "ms, starting at "
+            << phase.start.count() << "ms";
+  fbData->setCounter(SwitchStats::kCounterPrefix + "boot." + phase.name +
+                     "_ms", phase.duration.count());
+}
+
+std::vector<BootTimeline::Phase> BootTimeline::getPhases() const {
+  std::lock_guard<std::mutex> g(lock_);
+  return phases_;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * BootTimeline records how long each stage of bringing up the agent took,
+ * so that boot time regressions can be tracked through counters rather
+ * than by reading the logs.
+ *
+ * There is one timeline per process, starting when it is first used.  Each
+ * phase is exported as a <prefix>boot.<name>_ms counter.  Phases may be
+ * recorded from any thread; only the first timing of a phase is kept, so
+ * code that runs again after boot doesn't overwrite it.
+ */
+class BootTimeline {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Phase {
+    std::string name;
+    // When the phase started, relative to the start of the timeline
+    std::chrono::milliseconds start;
+    std::chrono::milliseconds duration;
+  };
+
+  /*
+   * Records the time from its construction to its destruction as a phase.
+   */
+  class PhaseTimer {
+   public:
+    explicit PhaseTimer(folly::StringPiece name);
+    ~PhaseTimer();
+
+   private:
+    // Forbidden copy constructor and assignment operator
+    PhaseTimer(PhaseTimer const &) = delete;
+    PhaseTimer& operator=(PhaseTimer const &) = delete;
+
+    std::string name_;
+    TimePoint start_;
+  };
+
+  static BootTimeline* get();
+
+  void recordPhase(folly::StringPiece name, TimePoint start, TimePoint end);
+
+  // The recorded phases, in the order they finished
+  std::vector<Phase> getPhases() const;
+
+ private:
+  BootTimeline();
+  // Forbidden copy constructor and assignment operator
+  BootTimeline(BootTimeline const &) = delete;
+  BootTimeline& operator=(BootTimeline const &) = delete;
+
+  const TimePoint start_;
+  mutable std::mutex lock_;
+  std::vector<Phase> phases_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,234 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/DHCPRelayCache.h"
+
+#include "fboss/agent/UDPHeader.h"
+#include "fboss/agent/packet/DHCPv6Packet.h"
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/state/DeltaFunctions.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/NodeMapDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/state/VlanMapDelta.h"
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using folly::io::RWPrivateCursor;
+using std::shared_ptr;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+void buildRelayHeaderV6(DHCPRelayCache::VlanRelay* relay) {
+  IPv6Hdr ipHdr(relay->switchIpV6, IPAddressV6());
+  ipHdr.nextHeader = IP_PROTO_UDP;
+  ipHdr.trafficClass = 0x00;
+  ipHdr.hopLimit = 255;
+  UDPHeader udpHdr(DHCPv6Packet::DHCP6_SERVERAGENT_UDPPORT,
+                   DHCPv6Packet::DHCP6_SERVERAGENT_UDPPORT, 0);
+
+  folly::IOBuf buf(folly::IOBuf::WRAP_BUFFER, relay->relayHeaderV6.data(),
+                   relay->relayHeaderV6.size());
+  RWPrivateCursor cursor(&buf);
+  ipHdr.serialize(&cursor);
+  udpHdr.write(&cursor);
+  // With a zero destination and length, the pseudo-header sums to just the
+  // source address and next header
+  relay->relayHeaderV6Csum = ipHdr.pseudoHdrPartialCsum(0) + udpHdr.srcPort +
+    udpHdr.dstPort;
+}
+
+shared_ptr<const DHCPRelayCache::VlanRelay> buildVlanRelay(
+    const Vlan* vlan, const InterfaceMap* intfs) {
+  auto relay = std::make_shared<DHCPRelayCache::VlanRelay>();
+  relay->serverV4 = vlan->getDhcpV4Relay();
+  relay->serverV6 = vlan->getDhcpV6Relay();
+  if (!relay->serverV6.isZero()) {
+    relay->serversV6.push_back(relay->serverV6);
+  }
+  for (const auto& server : vlan->getDhcpV6ExtraRelays()) {
+    if (!server.isZero() &&
+        std::find(relay->serversV6.begin(), relay->serversV6.end(),
+                  server) == relay->serversV6.end()) {
+      relay->serversV6.push_back(server);
+    }
+  }
+  for (const auto& entry : vlan->getDhcpV4RelayOverrides()) {
+    relay->overridesV4.emplace(entry.first.u64HBO(), entry.second);
+  }
+  for (const auto& entry : vlan->getDhcpV6RelayOverrides()) {
+    relay->overridesV6.emplace(entry.first.u64HBO(), entry.second);
+  }
+  for (const auto& intf : intfs->getInterfacesInVlanIf(vlan->getID())) {
+    for (const auto& address : intf->getAddresses()) {
+      if (address.first.isV4() && relay->switchIpV4.isZero()) {
+        relay->switchIpV4 = address.first.asV4();
+      } else if (address.first.isV6() && relay->switchIpV6.isZero()) {
+        relay->switchIpV6 = address.first.asV6();
+      }
+    }
+  }
+  buildRelayHeaderV6(relay.get());
+  return relay;
+}
+
+} // unnamed namespace
+
+IPAddressV4 DHCPRelayCache::VlanRelay::getServerV4(MacAddress client) const {
+  auto it = overridesV4.find(client.u64HBO());
+  return it == overridesV4.end() ? serverV4 : it->second;
+}
+
+IPAddressV6 DHCPRelayCache::VlanRelay::getServerV6(MacAddress client) const {
+  auto it = overridesV6.find(client.u64HBO());
+  return it == overridesV6.end() ? serverV6 : it->second;
+}
+
+folly::Range<const IPAddressV6*> DHCPRelayCache::VlanRelay::getServersV6(
+    MacAddress client) const {
+  auto it = overridesV6.find(client.u64HBO());
+  if (it != overridesV6.end()) {
+    return folly::Range<const IPAddressV6*>(&it->second, 1);
+  }
+  return folly::Range<const IPAddressV6*>(serversV6.data(),
+                                          serversV6.size());
+}
+
+const DHCPRelayCache::VlanRelay* DHCPRelayCache::Snapshot::getVlan(
+    VlanID vlan) const {
+  if (vlan >= vlans.size()) {
+    return nullptr;
+  }
+  return vlans[vlan].get();
+}
+
+bool DHCPRelayCache::Snapshot::getReplyVlan(const IPAddress& switchIp,
+                                            VlanID* vlan) const {
+  auto it = replyVlans.find(switchIp);
+  if (it == replyVlans.end()) {
+    return false;
+  }
+  *vlan = it->second;
+  return true;
+}
+
+shared_ptr<const DHCPRelayCache::Snapshot> DHCPRelayCache::get(
+    const shared_ptr<SwitchState>& state) {
+  const auto& vlans = state->getVlans();
+  const auto& intfs = state->getInterfaces();
+  shared_ptr<const Snapshot> old;
+  shared_ptr<VlanMap> oldVlans;
+  shared_ptr<InterfaceMap> oldIntfs;
+  {
+    std::lock_guard<folly::SpinLock> guard(lock_);
+    if (vlans == vlans_ && intfs == intfs_) {
+      return snapshot_;
+    }
+    old = snapshot_;
+    oldVlans = vlans_;
+    oldIntfs = intfs_;
+  }
+
+  // Build outside the lock, so packets for states the cache already covers
+  // are not held up.  If two threads race to update the cache, the loser's
+  // snapshot is simply replaced on a later call.
+  auto snapshot = update(old, oldVlans, oldIntfs, vlans, intfs);
+  std::lock_guard<folly::SpinLock> guard(lock_);
+  vlans_ = vlans;
+  intfs_ = intfs;
+  snapshot_ = snapshot;
+  return snapshot;
+}
+
+shared_ptr<const DHCPRelayCache::Snapshot> DHCPRelayCache::update(
+    const shared_ptr<const Snapshot>& old,
+    const shared_ptr<VlanMap>& oldVlans,
+    const shared_ptr<InterfaceMap>& oldIntfs,
+    const shared_ptr<VlanMap>& vlans,
+    const shared_ptr<InterfaceMap>& intfs) {
+  auto snapshot = old ? std::make_shared<Snapshot>(*old) :
+    std::make_shared<Snapshot>();
+
+  // Find the VLANs whose relay configuration may have changed: those that
+  // changed themselves, and those with interfaces that changed
+  std::set<VlanID> changed;
+  if (!old) {
+    for (const auto& vlan : *vlans) {
+      changed.insert(vlan->getID());
+    }
+  } else {
+    VlanMapDelta vlansDelta(oldVlans.get(), vlans.get());
+    DeltaFunctions::forEachChanged(
+        vlansDelta,
+        [&](const shared_ptr<Vlan>& oldVlan, const shared_ptr<Vlan>& newVlan) {
+          changed.insert(newVlan->getID());
+        },
+        [&](const shared_ptr<Vlan>& newVlan) {
+          changed.insert(newVlan->getID());
+        },
+        [&](const shared_ptr<Vlan>& oldVlan) {
+          changed.insert(oldVlan->getID());
+        });
+    NodeMapDelta<InterfaceMap> intfsDelta(oldIntfs.get(), intfs.get());
+    DeltaFunctions::forEachChanged(
+        intfsDelta,
+        [&](const shared_ptr<Interface>& oldIntf,
+            const shared_ptr<Interface>& newIntf) {
+          changed.insert(oldIntf->getVlanID());
+          changed.insert(newIntf->getVlanID());
+        },
+        [&](const shared_ptr<Interface>& newIntf) {
+          changed.insert(newIntf->getVlanID());
+        },
+        [&](const shared_ptr<Interface>& oldIntf) {
+          changed.insert(oldIntf->getVlanID());
+        });
+  }
+
+  for (auto id : changed) {
+    if (id >= snapshot->vlans.size()) {
+      snapshot->vlans.resize(id + 1);
+    }
+    auto vlan = vlans->getVlanIf(id);
+    snapshot->vlans[id] = vlan ? buildVlanRelay(vlan.get(), intfs.get()) :
+      nullptr;
+  }
+
+  if (!old || oldIntfs != intfs) {
+    // Replies are only relayed in router 0, as there is only one VRF
+    snapshot->replyVlans.clear();
+    for (const auto& intf : *intfs) {
+      if (intf->getRouterID() != RouterID(0)) {
+        continue;
+      }
+      for (const auto& address : intf->getAddresses()) {
+        snapshot->replyVlans.emplace(address.first, intf->getVlanID());
+      }
+    }
+  }
+
+  VLOG(3) << "Updated DHCP relay cache for " << changed.size() << " VLANs";
+  return snapshot;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/IPAddress.h>
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <folly/MacAddress.h>
+#include <folly/Range.h>
+#include <folly/SpinLock.h>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "fboss/agent/packet/IPv6Hdr.h"
+#include "fboss/agent/types.h"
+
+namespace facebook { namespace fboss {
+
+class InterfaceMap;
+class SwitchState;
+class VlanMap;
+
+/*
+ * DHCPRelayCache holds what the DHCP relays need to know about each VLAN,
+ * compiled from the SwitchState.
+ *
+ * Relaying a packet used to mean looking up its VLAN, copying the VLAN's
+ * relay override map, and searching the VLAN's interfaces for a source
+ * address, all for every packet.  The cache does that work once, and only
+ * again for the VLANs whose configuration or interfaces change.  It notices
+ * changes by comparing the VLAN and interface maps of the state it is given
+ * with those it was last built from, so it needs no hooks into the state
+ * update path.  The same goes for the headers of relayed DHCPv6 messages,
+ * which are prebuilt per VLAN rather than per packet.
+ */
+class DHCPRelayCache {
+ public:
+  /*
+   * The relay configuration of one VLAN.
+   */
+  struct VlanRelay {
+    enum : uint32_t {
+      // The IPv6 and UDP headers of a relayed DHCPv6 message
+      RELAY_HEADER_V6_SIZE = IPv6Hdr::SIZE + 8,
+    };
+
+    // The DHCP servers to relay requests to, unless overridden per client
+    folly::IPAddressV4 serverV4;
+    folly::IPAddressV6 serverV6;
+    // serverV6 and the VLAN's extra DHCPv6 servers, without duplicates.
+    // Each request is relayed to all of them.
+    std::vector<folly::IPAddressV6> serversV6;
+    // Per client overrides of the servers, keyed by MacAddress::u64HBO()
+    std::unordered_map<uint64_t, folly::IPAddressV4> overridesV4;
+    std::unordered_map<uint64_t, folly::IPAddressV6> overridesV6;
+    // The switch addresses to relay requests from, or zero if the VLAN has
+    // no interface address of that family
+    folly::IPAddressV4 switchIpV4;
+    folly::IPAddressV6 switchIpV6;
+    // The IPv6 and UDP headers of the relay forward messages sent to the
+    // DHCPv6 servers, built from switchIpV6 when the entry is.  The
+    // destination address, the lengths and the checksum are left zero, to
+    // be filled in for each message.
+    std::array<uint8_t, RELAY_HEADER_V6_SIZE> relayHeaderV6;
+    // The part of the UDP checksum that is the same for every message: the
+    // source address and next header of the pseudo-header, and the ports
+    uint32_t relayHeaderV6Csum{0};
+
+    folly::IPAddressV4 getServerV4(folly::MacAddress client) const;
+    folly::IPAddressV6 getServerV6(folly::MacAddress client) const;
+    /*
+     * All of the DHCPv6 servers to relay the client's requests to: its
+     * override if it has one, otherwise serversV6.
+     */
+    folly::Range<const folly::IPAddressV6*> getServersV6(
+        folly::MacAddress client) const;
+  };
+
+  /*
+   * The relay configuration of every VLAN, as of one SwitchState.
+   * Snapshots are immutable once built, and so can be used without locking.
+   */
+  struct Snapshot {
+    // Indexed by VlanID; null for VLANs that do not exist
+    std::vector<std::shared_ptr<const VlanRelay>> vlans;
+    // The VLAN of each interface address in router 0, for relaying replies
+    // from the DHCP servers back to the clients
+    std::unordered_map<folly::IPAddress, VlanID> replyVlans;
+
+    /*
+     * Returns null if the VLAN does not exist.
+     */
+    const VlanRelay* getVlan(VlanID vlan) const;
+    /*
+     * Find the VLAN of the interface that owns switchIp.  Returns false if
+     * no interface does.
+     */
+    bool getReplyVlan(const folly::IPAddress& switchIp, VlanID* vlan) const;
+  };
+
+  DHCPRelayCache() {}
+
+  /*
+   * Get the relay configuration for the given state, updating the cache
+   * first if the state's VLANs or interfaces have changed since the last
+   * call.
+   */
+  std::shared_ptr<const Snapshot> get(
+      const std::shared_ptr<SwitchState>& state);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  DHCPRelayCache(DHCPRelayCache const &) = delete;
+  DHCPRelayCache& operator=(DHCPRelayCache const &) = delete;
+
+  /*
+   * Build a snapshot for the new maps, reusing the entries of 'old' for the
+   * VLANs that have not changed.  'old' may be null.
+   */
+  static std::shared_ptr<const Snapshot> update(
+      const std::shared_ptr<const Snapshot>& old,
+      const std::shared_ptr<VlanMap>& oldVlans,
+      const std::shared_ptr<InterfaceMap>& oldIntfs,
+      const std::shared_ptr<VlanMap>& vlans,
+      const std::shared_ptr<InterfaceMap>& intfs);
+
+  folly::SpinLock lock_;
+  // The maps snapshot_ was built from.  Only these, and not the whole
+  // SwitchState, are kept, so the cache does not hold old routes alive.
+  std::shared_ptr<VlanMap> vlans_;
+  std::shared_ptr<InterfaceMap> intfs_;
+  std::shared_ptr<const Snapshot> snapshot_;
+};
+
+}} // facebook::fboss
@@ -9,21 +9,22 @@
  */
 #include "DHCPv4Handler.h"
 #include <arpa/inet.h>
+#include <algorithm>
+#include <limits>
 #include <string>
 #include <folly/io/IOBuf.h>
 #include <folly/io/Cursor.h>
 #include <folly/IPAddress.h>
+#include <gflags/gflags.h>
 #include "FbossError.h"
+#include "fboss/agent/DHCPRelayCache.h"
 #include "fboss/agent/packet/DHCPv4Packet.h"
+#include "fboss/agent/packet/HdrView.h"
 #include "fboss/agent/packet/IPv4Hdr.h"
 #include "fboss/agent/packet/IPProto.h"
 #include "fboss/agent/packet/EthHdr.h"
 #include "fboss/agent/packet/Ethertype.h"
-#include "fboss/agent/state/Interface.h"
-#include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/SwitchState.h"
-#include "fboss/agent/state/Vlan.h"
-#include "fboss/agent/state/VlanMap.h"
 #include "Platform.h"
 #include "RxPacket.h"
 #include "SwSwitch.h"
@@ -43,7 +44,27 @@ using namespace facebook::fboss;
 
 typedef EthHdr::VlanTags_t VlanTags_t;
 
+DEFINE_bool(dhcp_relay_fast_path, true,
+    "Relay ordinary DHCPv4 packets straight from the received bytes, "
+    "parsing only unusual packets into a DHCPv4Packet");
+
 namespace {
+
+// Offsets of the fields the relay rewrites or reads in the fixed part of a
+// DHCP packet
+enum : size_t {
+  kOpOffset = 0,
+  kHopsOffset = 3,
+  kFlagsOffset = 10,
+  kYiaddrOffset = 16,
+  kGiaddrOffset = 24,
+  kChaddrOffset = 28,
+};
+
+// Size of the agent option added to requests: the option code and length,
+// then the circuit id sub-option holding an IPv4 address
+const size_t kAgentOptionBytes = 4 + IPAddressV4::byteCount();
+
 IPv4Hdr makeIpv4Header(IPAddressV4 srcIp, IPAddressV4 dstIp, uint8_t ttl,
     uint16_t length) {
   // Prepare IPv4 header
@@ -72,14 +93,19 @@ EthHdr makeEthHdr(MacAddress srcMac, MacAddress dstMac, VlanID vlan) {
   return EthHdr(dstMac, srcMac, vlanTags, ETHERTYPE_IPV4);
 }
 
+/*
+ * Send a DHCP packet of dhcpLen bytes, which writeDhcp writes to the
+ * cursor it is given.
+ */
+template<typename WriteFn>
 void sendDHCPPacket(SwSwitch* sw, const EthHdr& ethHdr, const IPv4Hdr& ipHdr,
-    const UDPHeader& udpHdr, const DHCPv4Packet& dhcpPacket) {
+    const UDPHeader& udpHdr, size_t dhcpLen, WriteFn writeDhcp) {
   // Allocate packet
   auto txPacket = sw->allocatePacket(
       18 + // ethernet header
       ipHdr.size() +
       udpHdr.size() +
-      dhcpPacket.size());
+      dhcpLen);
   const auto& vlanTags = ethHdr.getVlanTags();
   CHECK(!vlanTags.empty());
 
@@ -95,7 +121,7 @@ void sendDHCPPacket(SwSwitch* sw, const EthHdr& ethHdr, const IPv4Hdr& ipHdr,
   rwCursor.skip(2);
   folly::io::Cursor payloadStart(rwCursor);
 
-  dhcpPacket.write(&rwCursor);
+  writeDhcp(&rwCursor);
   uint16_t csum = udpHdr.computeChecksum(ipHdr, payloadStart);
   csumCursor.writeBE<uint16_t>(csum);
 
@@ -107,6 +133,79 @@ void sendDHCPPacket(SwSwitch* sw, const EthHdr& ethHdr, const IPv4Hdr& ipHdr,
   sw->sendPacketSwitched(std::move(txPacket));
 }
 
+void sendDHCPPacket(SwSwitch* sw, const EthHdr& ethHdr, const IPv4Hdr& ipHdr,
+    const UDPHeader& udpHdr, const DHCPv4Packet& dhcpPacket) {
+  sendDHCPPacket(sw, ethHdr, ipHdr, udpHdr, dhcpPacket.size(),
+      [&](RWPrivateCursor* cursor) { dhcpPacket.write(cursor); });
+}
+
+/*
+ * Walk the DHCP options in opts up to the END option, copying the ones to
+ * relay to 'out' if it is not null.  The END option itself is not copied.
+ * Requests keep all their options, while replies lose their agent options.
+ *
+ * Returns the number of option bytes relayed, or -1 if the packet needs the
+ * full parse.  This mirrors addAgentOptions() and stripAgentOptions(), and
+ * gives up wherever they would drop the packet or treat it specially.
+ */
+ssize_t relayOptions(const uint8_t* opts, size_t len, bool request,
+    RWPrivateCursor* out) {
+  bool isDHCP = false;
+  size_t relayed = 0;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t op = opts[i];
+    if (op == DHCPv4Handler::END) {
+      return isDHCP ? ssize_t(relayed) : -1;
+    }
+    size_t optLen = 1;
+    if (!DHCPv4Packet::isOptionWithoutLength(op)) {
+      if (i + 2 > len || i + 2 + opts[i + 1] > len) {
+        return -1;
+      }
+      optLen = 2 + opts[i + 1];
+    }
+    bool relay = true;
+    switch (op) {
+      case DHCPv4Handler::DHCP_MESSAGE_TYPE:
+        isDHCP = true;
+        break;
+      case DHCPv4Handler::DHCP_MAX_MESSAGE_SIZE:
+        if (request) {
+          return -1;
+        }
+        break;
+      case DHCPv4Handler::DHCP_AGENT_OPTIONS:
+        if (isDHCP) {
+          if (request) {
+            return -1;
+          }
+          relay = false;
+        }
+        break;
+    }
+    if (relay) {
+      if (out) {
+        out->push(opts + i, optLen);
+      }
+      relayed += optLen;
+    }
+    i += optLen;
+  }
+  // No END option
+  return -1;
+}
+
+// Pad out a DHCP packet with PAD options
+void writePadding(RWPrivateCursor* cursor, size_t length) {
+  static const uint8_t kPadding[DHCPv4Packet::kMinSize] = {};
+  while (length > 0) {
+    auto chunk = std::min(length, sizeof(kPadding));
+    cursor->push(kPadding, chunk);
+    length -= chunk;
+  }
+}
+
 int processOption(const DHCPv4Packet::Options& optionsIn, int optIndex,
     DHCPv4Packet& dhcpPacketOut, bool toAppend) {
 
@@ -140,14 +239,21 @@ bool DHCPv4Handler::isDHCPv4Packet(const UDPHeader& udpHdr) {
 }
 
 void DHCPv4Handler::handlePacket(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
-    MacAddress srcMac, MacAddress dstMac, const IPv4Hdr& ipHdr,
+    MacAddress srcMac, MacAddress dstMac, const IPv4HdrView& ipHdr,
     const UDPHeader& udpHdr, Cursor cursor) {
   sw->stats()->port(pkt->getSrcPort())->dhcpV4Pkt();
-  if (ipHdr.ttl <= 1) {
+  if (ipHdr.ttl() <= 1) {
     sw->stats()->port(pkt->getSrcPort())->dhcpV4BadPkt();
-    VLOG(4) << "Dropped DHCP packet with TTL of " << ipHdr.ttl;
+    VLOG(4) << "Dropped DHCP packet with TTL of " << int(ipHdr.ttl());
+    return;
+  }
+
+  if (FLAGS_dhcp_relay_fast_path &&
+      relayFast(sw, pkt.get(), srcMac, ipHdr, cursor)) {
+    sw->stats()->dhcpV4FastPath();
     return;
   }
+  sw->stats()->dhcpV4SlowPath();
 
   // Parse dhcp packet
   DHCPv4Packet dhcpPkt;
@@ -182,55 +288,165 @@ void DHCPv4Handler::handlePacket(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
 }
 
 
-void DHCPv4Handler::processRequest(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
-    MacAddress srcMac, const IPv4Hdr& origIPHdr,
-    const DHCPv4Packet& dhcpPacket) {
-  auto dhcpPacketOut(dhcpPacket);
-  auto vlan = sw->getState()->getVlans()->getVlanIf(pkt->getSrcVlan());
+bool DHCPv4Handler::relayFast(SwSwitch* sw, const RxPacket* pkt,
+    MacAddress srcMac, const IPv4HdrView& origIPHdr, Cursor cursor) {
+  // The packet has to be in one buffer to be read in place
+  auto len = cursor.length();
+  if (len != cursor.totalLength() || len < DHCPv4Packet::minSize()) {
+    return false;
+  }
+  const uint8_t* data = cursor.data();
+  if (memcmp(data + DHCPv4Packet::kFixedPartBytes,
+        DHCPv4Packet::kOptionsCookie, DHCPv4Packet::kOptionsCookieSize)) {
+    return false;
+  }
+  uint8_t op = data[kOpOffset];
+  if (op != BOOTREQUEST && op != BOOTREPLY) {
+    return false;
+  }
+  bool request = op == BOOTREQUEST;
+  const uint8_t* opts = data + DHCPv4Packet::minSize();
+  size_t optsLen = len - DHCPv4Packet::minSize();
+  auto scanned = relayOptions(opts, optsLen, request, nullptr);
+  if (scanned < 0) {
+    return false;
+  }
+  size_t relayed = scanned;
+  size_t dhcpLen = DHCPv4Packet::minSize() + relayed +
+    (request ? kAgentOptionBytes : 0) + 1;
+  dhcpLen = std::max(dhcpLen, size_t(DHCPv4Packet::kMinSize));
+  MacAddress cpuMac = sw->getPlatform()->getLocalMac();
+
+  if (request) {
+    VLOG(4) << " Got boot request ";
+    IPAddressV4 dhcpServer;
+    IPAddressV4 switchIp;
+    if (!getRequestRelay(sw, pkt, srcMac, &dhcpServer, &switchIp)) {
+      return true;
+    }
+    // See processRequest() for why hops is incremented
+    uint8_t hops = data[kHopsOffset];
+    if (hops == std::numeric_limits<uint8_t>::max()) {
+      VLOG(4) << "Max hops exceeded for dhcp packet";
+      sw->stats()->port(pkt->getSrcPort())->dhcpV4BadPkt();
+      return true;
+    }
+
+    EthHdr ethHdr = makeEthHdr(cpuMac, cpuMac, pkt->getSrcVlan());
+    auto ipHdr = makeIpv4Header(switchIp, dhcpServer, origIPHdr.ttl() - 1,
+        IPv4Hdr::minSize() + UDPHeader::size() + dhcpLen);
+    UDPHeader udpHdr(kBootPSPort, kBootPSPort, UDPHeader::size() + dhcpLen);
+    sendDHCPPacket(sw, ethHdr, ipHdr, udpHdr, dhcpLen,
+        [&](RWPrivateCursor* out) {
+      out->push(data, kHopsOffset);
+      out->write<uint8_t>(hops + 1);
+      out->push(data + kHopsOffset + 1, kGiaddrOffset - kHopsOffset - 1);
+      out->push(switchIp.bytes(), IPAddressV4::byteCount());
+      out->push(data + kChaddrOffset,
+          DHCPv4Packet::minSize() - kChaddrOffset);
+      relayOptions(opts, optsLen, true, out);
+      out->write<uint8_t>(DHCP_AGENT_OPTIONS);
+      out->write<uint8_t>(kAgentOptionBytes - 2);
+      out->write<uint8_t>(AGENT_CIRCUIT_ID);
+      out->write<uint8_t>(IPAddressV4::byteCount());
+      out->push(switchIp.bytes(), IPAddressV4::byteCount());
+      out->write<uint8_t>(END);
+      writePadding(out, dhcpLen - DHCPv4Packet::minSize() - relayed -
+          kAgentOptionBytes - 1);
+    });
+    return true;
+  }
+
+  VLOG(4) << " Got boot reply";
+  IPAddressV4 clientIP = IPAddressV4::fromLong(INADDR_BROADCAST);
+  uint16_t flags = (data[kFlagsOffset] << 8) | data[kFlagsOffset + 1];
+  if (!(flags & DHCPv4Packet::kFlagBroadcast)) {
+    clientIP = IPAddressV4::fromBinary(folly::ByteRange(
+          data + kYiaddrOffset, IPAddressV4::byteCount()));
+  }
+  auto switchIp = origIPHdr.dstAddr();
+  MacAddress dstMac = MacAddress::fromBinary(
+      folly::ByteRange(data + kChaddrOffset, MacAddress::SIZE));
+  VlanID vlan;
+  if (!getReplyVlan(sw, pkt, switchIp, &vlan)) {
+    return true;
+  }
+
+  EthHdr ethHdr = makeEthHdr(cpuMac, dstMac, vlan);
+  auto ipHdr = makeIpv4Header(switchIp, clientIP, origIPHdr.ttl() - 1,
+      IPv4Hdr::minSize() + UDPHeader::size() + dhcpLen);
+  UDPHeader udpHdr(kBootPSPort, kBootPCPort, UDPHeader::size() + dhcpLen);
+  sendDHCPPacket(sw, ethHdr, ipHdr, udpHdr, dhcpLen,
+      [&](RWPrivateCursor* out) {
+    // Copy the fixed part, clearing the relay address
+    out->push(data, kGiaddrOffset);
+    writePadding(out, IPAddressV4::byteCount());
+    out->push(data + kChaddrOffset, DHCPv4Packet::minSize() - kChaddrOffset);
+    relayOptions(opts, optsLen, false, out);
+    out->write<uint8_t>(END);
+    writePadding(out, dhcpLen - DHCPv4Packet::minSize() - relayed - 1);
+  });
+  return true;
+}
+
+bool DHCPv4Handler::getRequestRelay(SwSwitch* sw, const RxPacket* pkt,
+    MacAddress srcMac, IPAddressV4* dhcpServer, IPAddressV4* switchIp) {
+  auto relays = sw->getDHCPRelayCache()->get(sw->getState());
+  auto vlan = relays->getVlan(pkt->getSrcVlan());
   if (!vlan) {
     sw->stats()->dhcpV4DropPkt();
     VLOG(4) << " VLAN  "<< pkt->getSrcVlan() << " is no longer present "
       << " dropped dhcp packet received on a port in this VLAN";
-    return;
+    return false;
   }
-  auto dhcpServer = vlan->getDhcpV4Relay();
 
   VLOG(4) << "srcMac: " << srcMac.toString();
-  // look in the override map, and use relevant destination
-  auto dhcpOverrideMap = vlan->getDhcpV4RelayOverrides();
-  if (dhcpOverrideMap.find(srcMac) != dhcpOverrideMap.end()) {
-    dhcpServer = dhcpOverrideMap[srcMac];
-    VLOG(4) << "dhcpServer: " << dhcpServer;
-  }
-
-  if (dhcpServer.isZero()) {
+  // Use the override for this client, if there is one
+  *dhcpServer = vlan->getServerV4(srcMac);
+  if (dhcpServer->isZero()) {
     sw->stats()->dhcpV4DropPkt();
-    VLOG(4) << " No relay configured for VLAN : "<< vlan->getID()
+    VLOG(4) << " No relay configured for VLAN : "<< pkt->getSrcVlan()
       << " dropped dhcp packet ";
-    return;
-  }
-
-  IPAddressV4 switchIp;
-  auto vlanInterfaces = sw->getState()->getInterfaces()->getInterfacesInVlanIf(
-      pkt->getSrcVlan());
-  for (auto vlanIntf: vlanInterfaces) {
-    auto& addresses = vlanIntf->getAddresses();
-    for (auto address: addresses) {
-      if (address.first.isV4()) {
-        switchIp = address.first.asV4();
-        break;
-      }
-    }
+    return false;
   }
+  VLOG(4) << "dhcpServer: " << *dhcpServer;
 
-  if (switchIp.isZero()) {
+  *switchIp = vlan->switchIpV4;
+  if (switchIp->isZero()) {
     sw->stats()->dhcpV4DropPkt();
     LOG(ERROR) << "Could not find a SVI interface on vlan : "
       << pkt->getSrcVlan()<< "DHCP packet dropped ";
+    return false;
+  }
+  VLOG(4) << " Got switch ip : " << *switchIp;
+  return true;
+}
+
+bool DHCPv4Handler::getReplyVlan(SwSwitch* sw, const RxPacket* pkt,
+    IPAddressV4 switchIp, VlanID* vlan) {
+  // TODO we should add router id information to the packet
+  // to get the VRF of the interface that this packet came
+  // in on. Assuming 0 for now since we have only one VRF
+  auto relays = sw->getDHCPRelayCache()->get(sw->getState());
+  if (!relays->getReplyVlan(IPAddress(switchIp), vlan)) {
+    sw->stats()->port(pkt->getSrcPort())->dhcpV4DropPkt();
+    LOG (INFO) << "Could not lookup interface for : " << switchIp
+      << "DHCP packet dropped ";
+    return false;
+  }
+  return true;
+}
+
+void DHCPv4Handler::processRequest(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
+    MacAddress srcMac, const IPv4HdrView& origIPHdr,
+    const DHCPv4Packet& dhcpPacket) {
+  auto dhcpPacketOut(dhcpPacket);
+  IPAddressV4 dhcpServer;
+  IPAddressV4 switchIp;
+  if (!getRequestRelay(sw, pkt.get(), srcMac, &dhcpServer, &switchIp)) {
     return;
   }
 
-  VLOG(4) << " Got switch ip : " << switchIp;
   // Prepare DHCP packet to relay
   if (!addAgentOptions(sw, pkt->getSrcPort(), switchIp, dhcpPacket,
         dhcpPacketOut)) {
@@ -257,7 +473,7 @@ void DHCPv4Handler::processRequest(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
 
   // Prepare the packet to be sent out
   EthHdr ethHdr = makeEthHdr(cpuMac, cpuMac, pkt->getSrcVlan());
-  auto ipHdr = makeIpv4Header(switchIp, dhcpServer, origIPHdr.ttl - 1,
+  auto ipHdr = makeIpv4Header(switchIp, dhcpServer, origIPHdr.ttl() - 1,
       IPv4Hdr::minSize() + UDPHeader::size() + dhcpPacketOut.size());
   UDPHeader udpHdr(kBootPSPort, kBootPSPort,
       UDPHeader::size() + dhcpPacketOut.size());
@@ -266,7 +482,7 @@ void DHCPv4Handler::processRequest(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
 }
 
 void DHCPv4Handler::processReply(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
-      const IPv4Hdr& origIPHdr, const DHCPv4Packet& dhcpPacket) {
+      const IPv4HdrView& origIPHdr, const DHCPv4Packet& dhcpPacket) {
   auto dhcpPacketOut(dhcpPacket);
   if (!stripAgentOptions(sw, pkt->getSrcPort(), dhcpPacket, dhcpPacketOut)) {
     sw->stats()->port(pkt->getSrcPort())->dhcpV4BadPkt();
@@ -278,7 +494,7 @@ void DHCPv4Handler::processReply(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
   if (!(dhcpPacket.flags & DHCPv4Packet::kFlagBroadcast)) {
     clientIP = dhcpPacket.yiaddr;
   }
-  auto switchIp = origIPHdr.dstAddr;
+  auto switchIp = origIPHdr.dstAddr();
   MacAddress cpuMac = sw->getPlatform()->getLocalMac();
   // Extract client MAC address from dhcp reply
   uint8_t chaddr[MacAddress::SIZE];
@@ -289,21 +505,14 @@ void DHCPv4Handler::processReply(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
   // Clear out the relay address field
   dhcpPacketOut.giaddr = IPAddressV4();
 
-  // TODO we should add router id information to the packet
-  // to get the VRF of the interface that this packet came
-  // in on. Assuming 0 for now since we have only one VRF
-  auto intf = sw->getState()->getInterfaces()->getInterface(RouterID(0),
-      IPAddress(switchIp));
-  if (!intf) {
-    sw->stats()->port(pkt->getSrcPort())->dhcpV4DropPkt();
-    LOG (INFO) << "Could not lookup interface for : " << switchIp
-      << "DHCP packet dropped ";
+  VlanID vlan;
+  if (!getReplyVlan(sw, pkt.get(), switchIp, &vlan)) {
     return;
   }
 
   // Prepare the packet to be sent out
-  EthHdr ethHdr = makeEthHdr(cpuMac, dstMac, intf->getVlanID());
-  auto ipHdr = makeIpv4Header(switchIp, clientIP, origIPHdr.ttl - 1,
+  EthHdr ethHdr = makeEthHdr(cpuMac, dstMac, vlan);
+  auto ipHdr = makeIpv4Header(switchIp, clientIP, origIPHdr.ttl() - 1,
       IPv4Hdr::minSize() + UDPHeader::size() + dhcpPacketOut.size());
   UDPHeader udpHdr(kBootPSPort, kBootPCPort,
       UDPHeader::size() + dhcpPacketOut.size());
@@ -21,7 +21,7 @@ class RxPacket;
 class UDPHeader;
 class DHCPv4Packet;
 class TxPacket;
-class IPv4Hdr;
+class IPv4HdrView;
 
 class DHCPv4Handler {
  public:
@@ -41,13 +41,41 @@ class DHCPv4Handler {
   static void handlePacket(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
       folly::MacAddress srcMac,
       folly::MacAddress dstMac,
-      const IPv4Hdr& ipHdr, const UDPHeader& udpHdr, folly::io::Cursor cursor);
+      const IPv4HdrView& ipHdr, const UDPHeader& udpHdr, folly::io::Cursor cursor);
  private:
+  /*
+   * Relay a DHCP packet straight from the received bytes, without parsing it
+   * into a DHCPv4Packet.  The fixed part and the options are copied into the
+   * relayed packet in one pass, rewriting hops and giaddr and adding or
+   * removing the agent option on the way.
+   *
+   * Returns false, without doing anything, for packets that need the full
+   * parse: packets split across buffers, BOOTP packets, packets with
+   * malformed options, and requests that carry a maximum message size or
+   * already have agent options.
+   */
+  static bool relayFast(SwSwitch* sw, const RxPacket* pkt,
+      folly::MacAddress srcMac, const IPv4HdrView& ipHdr,
+      folly::io::Cursor cursor);
+  /*
+   * Find the DHCP server to relay a request from srcMac to, and the switch
+   * address to relay it from.  Returns false, counting the drop, if the
+   * request cannot be relayed.
+   */
+  static bool getRequestRelay(SwSwitch* sw, const RxPacket* pkt,
+      folly::MacAddress srcMac, folly::IPAddressV4* dhcpServer,
+      folly::IPAddressV4* switchIp);
+  /*
+   * Find the VLAN to send a reply addressed to switchIp out on.  Returns
+   * false, counting the drop, if no interface owns switchIp.
+   */
+  static bool getReplyVlan(SwSwitch* sw, const RxPacket* pkt,
+      folly::IPAddressV4 switchIp, VlanID* vlan);
   static void processRequest(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
-      folly::MacAddress srcMac, const IPv4Hdr& ipHdr,
+      folly::MacAddress srcMac, const IPv4HdrView& ipHdr,
       const DHCPv4Packet& dhcpPacket);
   static void processReply(SwSwitch* sw, std::unique_ptr<RxPacket> pkt,
-      const IPv4Hdr& ipHdr, const DHCPv4Packet& dhcpPacket);
+      const IPv4HdrView& ipHdr, const DHCPv4Packet& dhcpPacket);
   static bool addAgentOptions(SwSwitch* sw, PortID port,
       folly::IPAddressV4 relayAddr,
       const DHCPv4Packet& dhcpPacketIn, DHCPv4Packet& dhcpPacketOut);
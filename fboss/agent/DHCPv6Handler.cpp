@@ -10,6 +10,7 @@
 #include "DHCPv6Handler.h"
 #include <arpa/inet.h>
 #include <string>
+#include <vector>
 #include <folly/io/IOBuf.h>
 #include <folly/io/Cursor.h>
 #include <folly/IPAddressV6.h>
@@ -17,13 +18,11 @@
 #include "fboss/agent/packet/DHCPv6Packet.h"
 #include "fboss/agent/packet/IPv6Hdr.h"
 #include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/packet/PktUtil.h"
 #include "fboss/agent/packet/EthHdr.h"
 #include "fboss/agent/packet/Ethertype.h"
-#include "fboss/agent/state/Interface.h"
-#include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/SwitchState.h"
-#include "fboss/agent/state/Vlan.h"
-#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/DHCPRelayCache.h"
 #include "fboss/agent/Platform.h"
 #include "fboss/agent/RxPacket.h"
 #include "fboss/agent/SwSwitch.h"
@@ -46,6 +45,89 @@ typedef EthHdr::VlanTags_t VlanTags_t;
 
 namespace {
 
+// The offsets of the fields of a relay forward message that are filled in
+// for each message, after the tagged ethernet header
+enum : uint32_t {
+  kRelayEthHdrSize = 18,
+  kRelayIpLenOffset = kRelayEthHdrSize + 4,
+  kRelayIpDstOffset = kRelayEthHdrSize + 24,
+  kRelayUdpLenOffset = kRelayEthHdrSize + IPv6Hdr::SIZE + 4,
+};
+
+uint32_t addrPartialCsum(const IPAddressV6& addr) {
+  const uint8_t* bytes = addr.bytes();
+  uint32_t sum = 0;
+  for (size_t n = 0; n < IPAddressV6::byteCount(); n += 2) {
+    sum += (bytes[n] << 8) | bytes[n + 1];
+  }
+  return sum;
+}
+
+/*
+ * Relay a relay forward message to each of the DHCPv6 servers.
+ *
+ * The message for the first server is built from the VLAN's prebuilt
+ * headers, and the others are copies of it with the destination and
+ * checksum rewritten, so the message is only serialized and summed once
+ * however many servers there are.
+ */
+void sendRelayForward(SwSwitch* sw, VlanID vlanId,
+    const DHCPRelayCache::VlanRelay& relay,
+    folly::Range<const IPAddressV6*> servers,
+    const DHCPv6Packet& relayFwdPkt) {
+  uint32_t dhcpLength = relayFwdPkt.computePacketLength();
+  uint16_t udpLength = UDPHeader::size() + dhcpLength;
+  uint32_t pktLength = kRelayEthHdrSize +
+    DHCPRelayCache::VlanRelay::RELAY_HEADER_V6_SIZE + dhcpLength;
+  MacAddress cpuMac = sw->getPlatform()->getLocalMac();
+
+  std::vector<unique_ptr<TxPacket>> pkts;
+  pkts.reserve(servers.size());
+  uint32_t csum = 0;
+  for (const auto& server : servers) {
+    auto txPacket = sw->allocatePacket(pktLength);
+    RWPrivateCursor rwCursor(txPacket->buf());
+    if (pkts.empty()) {
+      txPacket->writeEthHeader(&rwCursor, cpuMac, cpuMac, vlanId,
+                               ETHERTYPE_IPV6);
+      rwCursor.push(relay.relayHeaderV6.data(), relay.relayHeaderV6.size());
+      Cursor payloadStart(rwCursor);
+      relayFwdPkt.write(&rwCursor);
+
+      // The IPv6 payload length and UDP length are the same, and the UDP
+      // length is summed twice, once for the pseudo-header
+      RWPrivateCursor lenCursor(txPacket->buf());
+      lenCursor.skip(kRelayIpLenOffset);
+      lenCursor.writeBE<uint16_t>(udpLength);
+      lenCursor.skip(kRelayUdpLenOffset - kRelayIpLenOffset - 2);
+      lenCursor.writeBE<uint16_t>(udpLength);
+      csum = static_cast<uint16_t>(~PktUtil::finalizeChecksum(
+          payloadStart, dhcpLength,
+          relay.relayHeaderV6Csum + 2 * udpLength));
+    } else {
+      rwCursor.push(pkts[0]->buf()->data(), pktLength);
+    }
+
+    uint16_t udpCsum = PktUtil::finalizeChecksum(
+        csum + addrPartialCsum(server));
+    // A 0 checksum should be transmitted as all ones
+    if (udpCsum == 0) {
+      udpCsum = 0xffff;
+    }
+    RWPrivateCursor patchCursor(txPacket->buf());
+    patchCursor.skip(kRelayIpDstOffset);
+    patchCursor.push(server.bytes(), IPAddressV6::byteCount());
+    patchCursor.skip(kRelayUdpLenOffset + 2 - kRelayIpDstOffset -
+                     IPAddressV6::byteCount());
+    patchCursor.writeBE<uint16_t>(udpCsum);
+    pkts.push_back(std::move(txPacket));
+  }
+
+  VLOG(4) << "Relay DHCPv6 packet from " << relay.switchIpV6 << " to "
+          << servers.size() << " servers, dhcpLength: " << dhcpLength;
+  sw->sendPacketsSwitched(std::move(pkts));
+}
+
 template<typename DHCPBodyFn>
 void sendDHCPv6Packet(SwSwitch* sw, MacAddress dstMac, MacAddress srcMac,
     VlanID vlan, IPAddressV6 dstIp, IPAddressV6 srcIp,
@@ -140,8 +222,8 @@ void DHCPv6Handler::processDHCPv6Packet(SwSwitch* sw,
     std::unique_ptr<RxPacket> pkt, MacAddress srcMac, MacAddress dstMac,
     const IPv6Hdr& ipHdr, const DHCPv6Packet& dhcpPacket) {
   auto vlanId = pkt->getSrcVlan();
-  auto states = sw->getState();
-  auto vlan = states->getVlans()->getVlanIf(vlanId);
+  auto relays = sw->getDHCPRelayCache()->get(sw->getState());
+  auto vlan = relays->getVlan(vlanId);
   if (!vlan) {
     sw->stats()->dhcpV6DropPkt();
     VLOG(2) << "VLAN " << vlanId << " is no longer present"
@@ -149,27 +231,22 @@ void DHCPv6Handler::processDHCPv6Packet(SwSwitch* sw,
     return;
   }
 
-  auto dhcp6ServerIp = vlan->getDhcpV6Relay();
-
-  // look in the override map, and use relevant destination
+  // Use the override for this client, if there is one
   VLOG(4) << "srcMac: " << srcMac.toString();
-  auto dhcpOverrideMap = vlan->getDhcpV6RelayOverrides();
-  for (auto o : dhcpOverrideMap) {
-    if (MacAddress(o.first) == srcMac) {
-      dhcp6ServerIp = o.second;
-      VLOG(4) << "dhcp6ServerIp: " << dhcp6ServerIp;
-      break;
-    }
-  }
+  auto servers = vlan->getServersV6(srcMac);
+  VLOG(4) << "dhcp6 servers: " << servers.size();
 
-  if (dhcp6ServerIp.isZero()) {
-    VLOG(4) << "No DHCPv6 relay configured for Vlan " << vlan->getID()
+  if (servers.empty()) {
+    VLOG(4) << "No DHCPv6 relay configured for Vlan " << vlanId
             << " dropped DHCPv6 packet";
     sw->stats()->dhcpV6DropPkt();
     return;
   }
 
-  IPAddressV6 switchIp = getSwitchVlanIPv6(states, vlanId);
+  IPAddressV6 switchIp = vlan->switchIpV6;
+  if (switchIp.isZero()) {
+    throw FbossError("Cannot find IPv6 address for vlan ", vlanId);
+  }
   // link address set to unspecified
   IPAddressV6 la("::");
   // ip src -> peer-address
@@ -188,17 +265,8 @@ void DHCPv6Handler::processDHCPv6Packet(SwSwitch* sw,
     return;
   }
 
-  // create the dhcpv6 packet
-  // vlanIp -> ip src, ipHdr.dst -> ip dst, srcMac -> mac src, dstMac -> mac dst
-  MacAddress cpuMac = sw->getPlatform()->getLocalMac();
-  auto serializeBody = [&](RWPrivateCursor* sendCursor) {
-    relayFwdPkt.write(sendCursor);
-  };
-
-  sendDHCPv6Packet(sw, cpuMac, cpuMac, vlanId, dhcp6ServerIp, switchIp,
-      DHCPv6Packet::DHCP6_SERVERAGENT_UDPPORT,
-      DHCPv6Packet::DHCP6_SERVERAGENT_UDPPORT,
-      relayFwdPkt.computePacketLength(), serializeBody);
+  // switchIp -> ip src, each server -> ip dst, cpu mac -> mac src and dst
+  sendRelayForward(sw, vlanId, *vlan, servers, relayFwdPkt);
 }
 
 void DHCPv6Handler::processDHCPv6RelayForward(SwSwitch* sw,
@@ -231,9 +299,9 @@ void DHCPv6Handler::processDHCPv6RelayReply(SwSwitch* sw,
     const IPv6Hdr& ipHdr, DHCPv6Packet& dhcpPacket) {
 
   IPAddressV6 switchIp = ipHdr.dstAddr;
-  auto intf = sw->getState()->getInterfaces()->getInterface(RouterID(0),
-      switchIp);
-  if (!intf) {
+  auto relays = sw->getDHCPRelayCache()->get(sw->getState());
+  VlanID vlan;
+  if (!relays->getReplyVlan(IPAddress(switchIp), &vlan)) {
     sw->stats()->port(pkt->getSrcPort())->dhcpV6DropPkt();
     VLOG(2) << "Could not look up interface for " << switchIp
             << "DHCPv6 packet dropped";
@@ -272,7 +340,7 @@ void DHCPv6Handler::processDHCPv6RelayReply(SwSwitch* sw,
   auto serializeBody = [&](RWPrivateCursor* sendCursor) {
     sendCursor->push(relayData, relayLen);
   };
-  sendDHCPv6Packet(sw, destMac, cpuMac, intf->getVlanID(),
+  sendDHCPv6Packet(sw, destMac, cpuMac, vlan,
       dhcpPacket.peerAddr, switchIp, DHCPv6Packet::DHCP6_CLIENT_UDPPORT,
       DHCPv6Packet::DHCP6_SERVERAGENT_UDPPORT,
       relayLen, serializeBody);
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/DeferredInit.h"
+
+#include "fboss/agent/BootTimeline.h"
+
+#include <folly/String.h>
+#include <folly/io/async/EventBase.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <memory>
+
+DEFINE_bool(defer_init, true,
+            "Hold back the parts of startup that forwarding doesn't depend "
+            "on until the first FIB sync");
+DEFINE_string(deferred_init_order, "stats,lldp,sfp,metrics,thread_sampler",
+              "The order to run the deferred startup tasks in, once the FIB "
+              "is synced.  Tasks not listed run last.");
+DEFINE_int32(deferred_init_spacing_ms, 100,
+             "How long to wait between the deferred startup tasks");
+DEFINE_int32(deferred_init_timeout_s, 120,
+             "Run the deferred startup tasks this long after the initial "
+             "config is applied, if the FIB hasn't been synced by then.  0 "
+             "waits for the FIB sync however long it takes.");
+
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+std::vector<std::string> parseOrder(folly::StringPiece order) {
+  std::vector<std::string> names;
+  folly::split(',', order, names, true /* ignoreEmpty */);
+  for (auto& name : names) {
+    name = folly::trimWhitespace(name).str();
+  }
+  return names;
+}
+
+} // unnamed namespace
+
+DeferredInit::DeferredInit(folly::EventBase* evb)
+  : evb_(evb),
+    order_(parseOrder(FLAGS_deferred_init_order)) {
+}
+
+void DeferredInit::add(folly::StringPiece name, Task task) {
+  auto it = std::find(order_.begin(), order_.end(), name);
+  Entry entry{name.str(), std::move(task),
+              static_cast<size_t>(it - order_.begin())};
+  {
+    lock_guard<mutex> g(mutex_);
+    if (stopped_) {
+      return;
+    }
+    if (!released_ && FLAGS_defer_init) {
+      // After the tasks of the same rank added before it
+      auto pos = std::upper_bound(
+          pending_.begin(), pending_.end(), entry.rank,
+          [](size_t rank, const Entry& other) { return rank < other.rank; });
+      pending_.insert(pos, std::move(entry));
+      return;
+    }
+  }
+  auto shared = std::make_shared<Entry>(std::move(entry));
+  evb_->runInEventBaseThread([this, shared] { run(*shared); });
+}
+
+void DeferredInit::release(folly::StringPiece reason) {
+  size_t numPending;
+  {
+    lock_guard<mutex> g(mutex_);
+    if (released_ || stopped_) {
+      return;
+    }
+    released_ = true;
+    numPending = pending_.size();
+  }
+  LOG(INFO) << "running " << numPending << " deferred startup tasks: "
+            << reason;
+  evb_->runInEventBaseThread([this] { runNext(); });
+}
+
+void DeferredInit::startTimeout() {
+  if (!FLAGS_defer_init || FLAGS_deferred_init_timeout_s <= 0) {
+    return;
+  }
+  evb_->runInEventBaseThread([this] {
+    evb_->runAfterDelay([this] {
+      release("timed out waiting for the FIB sync");
+    }, FLAGS_deferred_init_timeout_s * 1000);
+  });
+}
+
+void DeferredInit::stop() {
+  {
+    lock_guard<mutex> g(mutex_);
+    stopped_ = true;
+    pending_.clear();
+  }
+  lock_guard<mutex> g(runMutex_);
+}
+
+bool DeferredInit::isReleased() const {
+  lock_guard<mutex> g(mutex_);
+  return released_;
+}
+
+std::vector<std::string> DeferredInit::getPendingOrder() const {
+  lock_guard<mutex> g(mutex_);
+  std::vector<std::string> names;
+  for (const auto& entry : pending_) {
+    names.push_back(entry.name);
+  }
+  return names;
+}
+
+void DeferredInit::runNext() {
+  Entry entry;
+  {
+    lock_guard<mutex> g(mutex_);
+    if (stopped_ || pending_.empty()) {
+      return;
+    }
+    entry = std::move(pending_.front());
+    pending_.erase(pending_.begin());
+  }
+  run(entry);
+  {
+    lock_guard<mutex> g(mutex_);
+    if (stopped_ || pending_.empty()) {
+      return;
+    }
+  }
+  evb_->runAfterDelay([this] { runNext(); }, FLAGS_deferred_init_spacing_ms);
+}
+
+void DeferredInit::run(const Entry& entry) {
+  lock_guard<mutex> runGuard(runMutex_);
+  {
+    lock_guard<mutex> g(mutex_);
+    if (stopped_) {
+      return;
+    }
+  }
+  VLOG(2) << "running deferred startup task " << entry.name;
+  auto start = steady_clock::now();
+  try {
+    entry.task();
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "deferred startup task " << entry.name << " failed: "
+               << folly::exceptionStr(ex);
+  }
+  BootTimeline::get()->recordPhase("deferred_" + entry.name, start,
+                                   steady_clock::now());
+}
+
+}} // facebook::fboss
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace fboss {
+
+/*
+ * DeferredInit holds back the parts of startup that forwarding doesn't
+ * depend on, like SFP polling, LLDP and the stats collection, until the
+ * first FIB sync is done.  Until then they would compete for CPU and SDK
+ * access with the programming of the initial routes.
+ *
+ * Once released, the tasks run one at a time in the given event base, in
+ * the order of --deferred_init_order, with --deferred_init_spacing_ms
+ * between them so they don't all hit the SDK at once.  Tasks not named in
+ * the order run last, in the order they were added.  Tasks added after the
+ * release are run right away.
+ *
+ * If the FIB is never synced, for instance on a switch without a routing
+ * daemon, the tasks are released --deferred_init_timeout_s after
+ * startTimeout() anyway.  With --nodefer_init, tasks run as soon as they
+ * are added.
+ */
+class DeferredInit {
+ public:
+  typedef std::function<void()> Task;
+
+  explicit DeferredInit(folly::EventBase* evb);
+
+  /*
+   * Run a task once the deferred tasks are released.
+   */
+  void add(folly::StringPiece name, Task task);
+
+  /*
+   * Start running the deferred tasks.  Only the first call does anything.
+   */
+  void release(folly::StringPiece reason);
+
+  /*
+   * Release the tasks after --deferred_init_timeout_s, if nothing else
+   * released them by then.
+   */
+  void startTimeout();
+
+  /*
+   * Stop running tasks, and wait for the one running, if any.  This must
+   * not be called from the event base's thread.
+   */
+  void stop();
+
+  bool isReleased() const;
+
+  /*
+   * The names of the tasks, in the order they will run.  This is only
+   * public for use in unit tests.
+   */
+  std::vector<std::string> getPendingOrder() const;
+
+ private:
+  struct Entry {
+    std::string name;
+    Task task;
+    // The position in --deferred_init_order, if named there
+    size_t rank;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  DeferredInit(DeferredInit const &) = delete;
+  DeferredInit& operator=(DeferredInit const &) = delete;
+
+  void runNext();
+  void run(const Entry& entry);
+
+  folly::EventBase* const evb_;
+  const std::vector<std::string> order_;
+
+  mutable std::mutex mutex_;
+  // Sorted by rank, then by when they were added
+  std::vector<Entry> pending_;
+  bool released_{false};
+  bool stopped_{false};
+
+  // Held while a task runs, so that stop() can wait for it
+  std::mutex runMutex_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * DenseIdIndex looks objects up by a small, dense integer ID, such as a
+ * PortID or a BCM port number, with a bounds checked array index rather
+ * than a search.
+ *
+ * It only holds pointers: the objects are owned, and iterated over in
+ * order, by whatever map the index sits next to.  IDs out of range,
+ * including negative ones, are simply not found.
+ */
+template<typename IdT, typename T>
+class DenseIdIndex {
+ public:
+  /*
+   * Returns nullptr if there is no object with this ID.
+   */
+  T* get(IdT id) const {
+    auto index = static_cast<size_t>(id);
+    return index < items_.size() ? items_[index] : nullptr;
+  }
+
+  void set(IdT id, T* item) {
+    auto index = static_cast<size_t>(id);
+    if (index >= items_.size()) {
+      items_.resize(index + 1, nullptr);
+    }
+    items_[index] = item;
+  }
+
+ private:
+  std::vector<T*> items_;
+};
+
+}} // facebook::fboss
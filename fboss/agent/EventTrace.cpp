@@ -0,0 +1,419 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/EventTrace.h"
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/IPAddressV4.h>
+#include <folly/Memory.h>
+#include <folly/String.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <time.h>
+#include <unordered_map>
+
+DEFINE_int32(event_trace_size, 4096,
+             "The number of events each thread keeps in its event trace, "
+             "rounded up to a power of two.  0 disables the event trace.");
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::chrono::system_clock;
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+typedef EventTrace::Type Type;
+
+// How many rings of threads that exited are kept
+const size_t kMaxRetiredRings = 16;
+
+struct Record {
+  uint64_t timeNs;
+  uint64_t arg2;
+  EventTrace::Name name;
+  uint32_t arg1;
+  Type type;
+};
+
+struct Ring {
+  Ring(std::string thread, size_t size)
+    : thread(std::move(thread)),
+      records(size),
+      mask(size - 1) {}
+
+  const std::string thread;
+  std::vector<Record> records;
+  const uint64_t mask;
+  // The number of records ever written.  Only the owning thread writes
+  // the records, and it publishes each one by bumping this.
+  std::atomic<uint64_t> next{0};
+  std::atomic<uint64_t> rxPackets{0};
+  std::atomic<uint64_t> txPackets{0};
+  // The counts at the last recordPacketCounts(), under registryMutex()
+  uint64_t lastRxPackets{0};
+  uint64_t lastTxPackets{0};
+};
+
+// These are never destroyed, as threads may record events, and the trace
+// may be dumped, during static destruction
+mutex& registryMutex() {
+  static auto* m = new mutex();
+  return *m;
+}
+std::vector<shared_ptr<Ring>>& liveRings() {
+  static auto* rings = new std::vector<shared_ptr<Ring>>();
+  return *rings;
+}
+// The rings of the threads that exited, newest first
+std::deque<shared_ptr<Ring>>& retiredRings() {
+  static auto* rings = new std::deque<shared_ptr<Ring>>();
+  return *rings;
+}
+
+class RingHolder {
+ public:
+  ~RingHolder() {
+    if (!ring_) {
+      return;
+    }
+    // Keep the last events of the thread around after it exits
+    lock_guard<mutex> g(registryMutex());
+    auto& live = liveRings();
+    live.erase(std::find(live.begin(), live.end(), ring_));
+    auto& retired = retiredRings();
+    retired.push_front(std::move(ring_));
+    if (retired.size() > kMaxRetiredRings) {
+      retired.pop_back();
+    }
+  }
+  Ring* get() const {
+    return ring_.get();
+  }
+  void reset(shared_ptr<Ring> ring) {
+    ring_ = std::move(ring);
+  }
+
+ private:
+  shared_ptr<Ring> ring_;
+};
+
+thread_local RingHolder tlRing;
+
+Ring* getRing() {
+  auto* ring = tlRing.get();
+  if (ring || FLAGS_event_trace_size <= 0) {
+    return ring;
+  }
+  size_t size = 1;
+  while (size < static_cast<size_t>(FLAGS_event_trace_size)) {
+    size <<= 1;
+  }
+  // The pthread name can be at most 15 bytes long
+  char name[16] = "";
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+  auto newRing = std::make_shared<Ring>(name, size);
+  {
+    lock_guard<mutex> g(registryMutex());
+    liveRings().push_back(newRing);
+  }
+  tlRing.reset(newRing);
+  return newRing.get();
+}
+
+std::vector<shared_ptr<Ring>> allRings() {
+  lock_guard<mutex> g(registryMutex());
+  std::vector<shared_ptr<Ring>> rings(liveRings());
+  rings.insert(rings.end(), retiredRings().begin(), retiredRings().end());
+  return rings;
+}
+
+// Copy out the records of a ring that are not being overwritten
+void readRing(const Ring& ring, nanoseconds toSystemTime,
+              std::vector<EventTrace::Entry>* entries) {
+  const uint64_t size = ring.records.size();
+  auto end = ring.next.load(std::memory_order_acquire);
+  auto begin = end > size ? end - size : 0;
+  std::vector<Record> copy;
+  copy.reserve(end - begin);
+  for (auto pos = begin; pos < end; ++pos) {
+    copy.push_back(ring.records[pos & ring.mask]);
+  }
+  // The writer may have moved on while we copied.  The records it has
+  // written since, and the one it is writing now, replaced the oldest ones
+  // we copied, which may be torn.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  auto after = ring.next.load(std::memory_order_relaxed);
+  auto firstValid = after >= size ? after - size + 1 : 0;
+  for (auto pos = std::max(begin, firstValid); pos < end; ++pos) {
+    const auto& record = copy[pos - begin];
+    EventTrace::Entry entry;
+    entry.thread = ring.thread;
+    entry.time = nanoseconds(record.timeNs) + toSystemTime;
+    entry.type = record.type;
+    entry.arg1 = record.arg1;
+    entry.arg2 = record.arg2;
+    if (record.name) {
+      entry.name = *record.name;
+    }
+    entries->push_back(std::move(entry));
+  }
+}
+
+// The labels of the arguments of each type of event, if used
+struct ArgNames {
+  const char* arg1;
+  const char* arg2;
+};
+
+ArgNames getArgNames(Type type) {
+  switch (type) {
+    case Type::UPDATE_START:
+      return {nullptr, nullptr};
+    case Type::UPDATE_END:
+      return {"ok", nullptr};
+    case Type::PROGRAM_START:
+    case Type::PROGRAM_END:
+      return {"updates", "generation"};
+    case Type::LINK_UP:
+    case Type::LINK_DOWN:
+      return {"port", nullptr};
+    case Type::ARP_ADD:
+    case Type::ARP_REMOVE:
+    case Type::NDP_ADD:
+    case Type::NDP_REMOVE:
+      return {"vlan", "ip"};
+    case Type::ROUTE_ADD:
+    case Type::ROUTE_DELETE:
+    case Type::ROUTE_SYNC:
+      return {"client", "routes"};
+    case Type::RX_PACKETS:
+    case Type::TX_PACKETS:
+      return {nullptr, "packets"};
+    case Type::NUM_TYPES:
+      break;
+  }
+  return {"arg1", "arg2"};
+}
+
+std::string* failurePath = nullptr;
+
+void dumpAndAbort() {
+  EventTrace::dumpToFile(*failurePath);
+  abort();
+}
+
+} // unnamed namespace
+
+bool EventTrace::isEnabled() {
+  return FLAGS_event_trace_size > 0;
+}
+
+void EventTrace::record(Type type, uint32_t arg1, uint64_t arg2, Name name) {
+  auto* ring = getRing();
+  if (!ring) {
+    return;
+  }
+  auto pos = ring->next.load(std::memory_order_relaxed);
+  auto& record = ring->records[pos & ring->mask];
+  record.timeNs = duration_cast<nanoseconds>(
+      steady_clock::now().time_since_epoch()).count();
+  record.arg2 = arg2;
+  record.name = name;
+  record.arg1 = arg1;
+  record.type = type;
+  ring->next.store(pos + 1, std::memory_order_release);
+}
+
+EventTrace::Name EventTrace::intern(folly::StringPiece name) {
+  static auto* m = new mutex();
+  static auto* names =
+    new std::unordered_map<std::string, std::unique_ptr<std::string>>();
+
+  lock_guard<mutex> g(*m);
+  auto key = name.str();
+  auto it = names->find(key);
+  if (it != names->end()) {
+    return it->second.get();
+  }
+  auto value = folly::make_unique<std::string>(key);
+  return names->emplace(key, std::move(value)).first->second.get();
+}
+
+void EventTrace::countRxPacket() {
+  auto* ring = getRing();
+  if (ring) {
+    // Only this thread writes the count, so there is no need for an
+    // atomic increment
+    ring->rxPackets.store(ring->rxPackets.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+  }
+}
+
+void EventTrace::countTxPackets(uint32_t count) {
+  auto* ring = getRing();
+  if (ring) {
+    ring->txPackets.store(
+        ring->txPackets.load(std::memory_order_relaxed) + count,
+        std::memory_order_relaxed);
+  }
+}
+
+void EventTrace::recordPacketCounts() {
+  if (!isEnabled()) {
+    return;
+  }
+  uint64_t rx = 0;
+  uint64_t tx = 0;
+  {
+    lock_guard<mutex> g(registryMutex());
+    auto count = [&](Ring* ring) {
+      auto ringRx = ring->rxPackets.load(std::memory_order_relaxed);
+      auto ringTx = ring->txPackets.load(std::memory_order_relaxed);
+      rx += ringRx - ring->lastRxPackets;
+      tx += ringTx - ring->lastTxPackets;
+      ring->lastRxPackets = ringRx;
+      ring->lastTxPackets = ringTx;
+    };
+    for (auto& ring : liveRings()) {
+      count(ring.get());
+    }
+    for (auto& ring : retiredRings()) {
+      count(ring.get());
+    }
+  }
+  record(Type::RX_PACKETS, 0, rx);
+  record(Type::TX_PACKETS, 0, tx);
+}
+
+std::vector<EventTrace::Entry> EventTrace::dump() {
+  auto toSystemTime = duration_cast<nanoseconds>(
+      system_clock::now().time_since_epoch() -
+      steady_clock::now().time_since_epoch());
+  std::vector<Entry> entries;
+  for (const auto& ring : allRings()) {
+    readRing(*ring, toSystemTime, &entries);
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Entry& a, const Entry& b) {
+    return a.time < b.time;
+  });
+  return entries;
+}
+
+const char* EventTrace::getTypeName(Type type) {
+  switch (type) {
+    case Type::UPDATE_START:
+      return "update_start";
+    case Type::UPDATE_END:
+      return "update_end";
+    case Type::PROGRAM_START:
+      return "program_start";
+    case Type::PROGRAM_END:
+      return "program_end";
+    case Type::LINK_UP:
+      return "link_up";
+    case Type::LINK_DOWN:
+      return "link_down";
+    case Type::ARP_ADD:
+      return "arp_add";
+    case Type::ARP_REMOVE:
+      return "arp_remove";
+    case Type::NDP_ADD:
+      return "ndp_add";
+    case Type::NDP_REMOVE:
+      return "ndp_remove";
+    case Type::ROUTE_ADD:
+      return "route_add";
+    case Type::ROUTE_DELETE:
+      return "route_delete";
+    case Type::ROUTE_SYNC:
+      return "route_sync";
+    case Type::RX_PACKETS:
+      return "rx_packets";
+    case Type::TX_PACKETS:
+      return "tx_packets";
+    case Type::NUM_TYPES:
+      break;
+  }
+  return "unknown";
+}
+
+std::string EventTrace::format(const Entry& entry) {
+  auto secs = duration_cast<std::chrono::seconds>(entry.time);
+  time_t t = secs.count();
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char timeStr[32];
+  strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", &tm);
+  auto ret = folly::sformat("{}.{:09d} {:<15} {}", timeStr,
+                            (entry.time - secs).count(), entry.thread,
+                            getTypeName(entry.type));
+  if (!entry.name.empty()) {
+    ret += " ";
+    ret += entry.name;
+  }
+  auto names = getArgNames(entry.type);
+  if (names.arg1) {
+    folly::toAppend(" ", names.arg1, "=", entry.arg1, &ret);
+  }
+  if (!names.arg2) {
+    return ret;
+  }
+  if (entry.type == Type::ARP_ADD || entry.type == Type::ARP_REMOVE) {
+    folly::toAppend(" ", names.arg2, "=",
+                    folly::IPAddressV4::fromLongHBO(entry.arg2).str(), &ret);
+  } else if (entry.type == Type::NDP_ADD || entry.type == Type::NDP_REMOVE) {
+    // Only the interface ID of the address is recorded
+    folly::toAppend(" ", names.arg2, "=::",
+                    folly::sformat("{:x}:{:x}:{:x}:{:x}",
+                                   (entry.arg2 >> 48) & 0xffff,
+                                   (entry.arg2 >> 32) & 0xffff,
+                                   (entry.arg2 >> 16) & 0xffff,
+                                   entry.arg2 & 0xffff), &ret);
+  } else {
+    folly::toAppend(" ", names.arg2, "=", entry.arg2, &ret);
+  }
+  return ret;
+}
+
+void EventTrace::dumpToFile(const std::string& path) {
+  std::string data;
+  for (const auto& entry : dump()) {
+    data += format(entry);
+    data += "\n";
+  }
+  if (!folly::writeFile(data, path.c_str())) {
+    PLOG(ERROR) << "failed to write the event trace to " << path;
+  }
+}
+
+void EventTrace::dumpOnFailure(const std::string& path) {
+  if (!isEnabled()) {
+    return;
+  }
+  failurePath = new std::string(path);
+  google::InstallFailureFunction(&dumpAndAbort);
+}
+
+}} // facebook::fboss
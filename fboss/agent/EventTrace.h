@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * EventTrace keeps the last few thousand events of each thread in memory,
+ * so the sequence of events leading up to an incident can be read back
+ * afterwards, through thrift or from the file written when the agent dies
+ * on a fatal error.
+ *
+ * The events are compact binary records with a nanosecond timestamp, an
+ * event type and two integer arguments, appended to a ring owned by the
+ * recording thread.  Recording takes no lock and allocates nothing once the
+ * thread has its ring, so it is cheap enough to leave on, unlike verbose
+ * logging.  Readers copy the rings without stopping the writers, and drop
+ * the records that may have been overwritten while they copied.
+ *
+ * The rings hold --event_trace_size records each; 0 disables tracing.
+ */
+class EventTrace {
+ public:
+  enum class Type : uint8_t {
+    // A state update was prepared.  arg1 is 1 if it succeeded.
+    UPDATE_START,
+    UPDATE_END,
+    // A batch of updates was programmed.  arg1 is the number of updates,
+    // arg2 the generation of the new state.
+    PROGRAM_START,
+    PROGRAM_END,
+    // A linkscan event, on port arg1
+    LINK_UP,
+    LINK_DOWN,
+    // A neighbor entry changed on VLAN arg1.  arg2 is the IPv4 address,
+    // or the low 64 bits of the IPv6 address.
+    ARP_ADD,
+    ARP_REMOVE,
+    NDP_ADD,
+    NDP_REMOVE,
+    // A route call of client arg1, for arg2 routes
+    ROUTE_ADD,
+    ROUTE_DELETE,
+    ROUTE_SYNC,
+    // The packets received and sent since the last interval, in arg2
+    RX_PACKETS,
+    TX_PACKETS,
+    NUM_TYPES,
+  };
+
+  // A name interned with intern(), which lives forever
+  typedef const std::string* Name;
+
+  struct Entry {
+    std::string thread;
+    // Since the epoch
+    std::chrono::nanoseconds time{0};
+    Type type{Type::NUM_TYPES};
+    uint32_t arg1{0};
+    uint64_t arg2{0};
+    std::string name;
+  };
+
+  static bool isEnabled();
+
+  /*
+   * Record an event in the calling thread's ring.
+   */
+  static void record(Type type, uint32_t arg1 = 0, uint64_t arg2 = 0,
+                     Name name = nullptr);
+
+  /*
+   * Return the interned name for a state update.  This takes a lock, as
+   * ThreadSampler::intern() does.
+   */
+  static Name intern(folly::StringPiece name);
+
+  /*
+   * Count packets received and sent by the calling thread.  These only
+   * bump counters in its ring; recordPacketCounts() turns them into
+   * RX_PACKETS and TX_PACKETS events.
+   */
+  static void countRxPacket();
+  static void countTxPackets(uint32_t count = 1);
+
+  /*
+   * Record the packets received and sent by all threads since the last
+   * call.  This is called periodically from the stats thread.
+   */
+  static void recordPacketCounts();
+
+  /*
+   * Read back the events of all the threads, oldest first.
+   */
+  static std::vector<Entry> dump();
+
+  static const char* getTypeName(Type type);
+  /*
+   * Format an entry as one line of text.
+   */
+  static std::string format(const Entry& entry);
+
+  /*
+   * Write the events to a file, one per line.  Errors are logged.
+   */
+  static void dumpToFile(const std::string& path);
+
+  /*
+   * Write the events to a file when the agent dies on a CHECK or
+   * LOG(FATAL), before aborting.
+   */
+  static void dumpOnFailure(const std::string& path);
+
+ private:
+  // Not constructible
+  EventTrace() = delete;
+};
+
+}} // facebook::fboss
@@ -35,4 +35,35 @@ class FbossError : public thrift::FbossBaseError {
   ~FbossError() throw() {}
 };
 
+/**
+ * The error returned when a request is turned away because the agent is
+ * overloaded.  It is marked retryable, so that clients know to back off and
+ * send the same request again.
+ */
+class FbossOverloadError : public FbossError {
+ public:
+  template<typename... Args>
+  explicit FbossOverloadError(Args&&... args)
+    : FbossError(std::forward<Args>(args)...) {
+    retryable = true;
+  }
+
+  ~FbossOverloadError() throw() {}
+};
+
+/**
+ * The error HwSwitch::stateChanged() throws when it could not apply a
+ * change, but put the hardware back the way it was before the change.
+ * The hardware then still matches the old state, so the agent can carry
+ * on with it.
+ */
+class FbossHwRolledBackError : public FbossError {
+ public:
+  template<typename... Args>
+  explicit FbossHwRolledBackError(Args&&... args)
+    : FbossError(std::forward<Args>(args)...) {}
+
+  ~FbossHwRolledBackError() throw() {}
+};
+
 }} // facebook::fboss
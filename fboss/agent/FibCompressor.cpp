@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/FibCompressor.h"
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+
+#include <iterator>
+#include <limits>
+
+namespace {
+
+// The last address of the prefix network/len
+template<typename AddrT>
+AddrT lastAddress(const AddrT& network, uint8_t len) {
+  auto bytes = network.toByteArray();
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    size_t bit = i * 8;
+    if (bit + 8 <= len) {
+      continue;
+    }
+    uint8_t hostBits = len > bit ? (0xff >> (len - bit)) : 0xff;
+    bytes[i] |= hostBits;
+  }
+  return AddrT(bytes);
+}
+
+template<typename ChangesT>
+void append(ChangesT* changes, const ChangesT& more) {
+  changes->insert(changes->end(), more.begin(), more.end());
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+template<typename RouteT>
+void FibCompressor<RouteT>::update(const std::shared_ptr<RouteT>& route,
+                                   Changes* changes) {
+  const auto& prefix = route->prefix();
+  const auto& fwd = route->getForwardInfo();
+  auto iter = rib_.find(prefix);
+  if (iter == rib_.end()) {
+    iter = rib_.emplace(prefix, Entry(route)).first;
+    ++numRoutesByLength_[prefix.mask];
+  } else if (iter->second.route->getForwardInfo() == fwd) {
+    // Nothing to change in the FIB
+    iter->second.route = route;
+    return;
+  } else {
+    iter->second.route = route;
+  }
+
+  Changes added;
+  Changes removed;
+  updateChildren(iter, &fwd, &added, &removed);
+  auto* cover = findCover(prefix);
+  bool inFib = !cover || !(cover->route->getForwardInfo() == fwd);
+  append(changes, added);
+  if (inFib) {
+    changes->emplace_back(route, true);
+  } else if (iter->second.inFib) {
+    changes->emplace_back(route, false);
+  }
+  setInFib(&iter->second, inFib);
+  append(changes, removed);
+}
+
+template<typename RouteT>
+void FibCompressor<RouteT>::remove(const Prefix& prefix, Changes* changes) {
+  auto iter = rib_.find(prefix);
+  if (iter == rib_.end()) {
+    return;
+  }
+  Changes added;
+  Changes removed;
+  auto* cover = findCover(prefix);
+  updateChildren(iter, cover ? &cover->route->getForwardInfo() : nullptr,
+                 &added, &removed);
+  append(changes, added);
+  if (iter->second.inFib) {
+    changes->emplace_back(iter->second.route, false);
+  }
+  setInFib(&iter->second, false);
+  --numRoutesByLength_[prefix.mask];
+  rib_.erase(iter);
+  append(changes, removed);
+}
+
+template<typename RouteT>
+bool FibCompressor<RouteT>::isInFib(const Prefix& prefix) const {
+  auto iter = rib_.find(prefix);
+  return iter != rib_.end() && iter->second.inFib;
+}
+
+template<typename RouteT>
+const typename FibCompressor<RouteT>::Entry*
+FibCompressor<RouteT>::findCover(const Prefix& prefix) const {
+  for (int len = prefix.mask - 1; len >= 0; --len) {
+    if (!numRoutesByLength_[len]) {
+      continue;
+    }
+    Prefix cover{prefix.network.mask(len), static_cast<uint8_t>(len)};
+    auto iter = rib_.find(cover);
+    if (iter != rib_.end()) {
+      return &iter->second;
+    }
+  }
+  return nullptr;
+}
+
+template<typename RouteT>
+void FibCompressor<RouteT>::updateChildren(typename Rib::iterator iter,
+                                           const RouteForwardInfo* coverFwd,
+                                           Changes* added,
+                                           Changes* removed) {
+  const auto& parent = iter->first;
+  auto last = lastAddress(parent.network, parent.mask);
+  auto child = std::next(iter);
+  while (child != rib_.end() && !(last < child->first.network)) {
+    auto& entry = child->second;
+    bool inFib = !coverFwd || !(entry.route->getForwardInfo() == *coverFwd);
+    if (inFib && !entry.inFib) {
+      added->emplace_back(entry.route, true);
+    } else if (!inFib && entry.inFib) {
+      removed->emplace_back(entry.route, false);
+    }
+    setInFib(&entry, inFib);
+    // Skip the routes the child covers, which still fall through to it
+    Prefix end{lastAddress(child->first.network, child->first.mask),
+               std::numeric_limits<uint8_t>::max()};
+    child = rib_.upper_bound(end);
+  }
+}
+
+template<typename RouteT>
+void FibCompressor<RouteT>::setInFib(Entry* entry, bool inFib) {
+  if (entry->inFib == inFib) {
+    return;
+  }
+  entry->inFib = inFib;
+  if (inFib) {
+    ++fibSize_;
+  } else {
+    --fibSize_;
+  }
+}
+
+template class FibCompressor<RouteV4>;
+template class FibCompressor<RouteV6>;
+
+}} // facebook::fboss
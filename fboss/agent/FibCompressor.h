@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/state/Route.h"
+
+#include <array>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * FibCompressor decides which routes of a RIB need to be in the FIB.
+ *
+ * A route forwarding the same way as its longest covering route in the RIB
+ * is redundant: without it, a longest prefix match for its addresses falls
+ * through to the covering route, or to whichever route is programmed in the
+ * covering route's place, which forwards the same way.  So such routes are
+ * suppressed, and only the rest are programmed.
+ *
+ * The decisions are maintained incrementally.  Adding, changing or removing
+ * a route can only change the decision for the route itself, and for its
+ * immediate children, the routes it is the longest covering route of.
+ * Each update returns the FIB changes that follow from it, ordered so that
+ * every address keeps forwarding correctly while they are applied one by
+ * one: routes that stop being suppressed are added first, then the updated
+ * route itself is changed, and routes that become suppressed are removed
+ * last.
+ *
+ * The compressor only suppresses routes, rather than also replacing sets of
+ * routes by new aggregates as ORTC does, so the FIB is always a subset of
+ * the RIB.
+ *
+ * RouteT is RouteV4 or RouteV6.  The routes given to the compressor should
+ * be resolved ones, which are the only routes programmed in the FIB.
+ */
+template<typename RouteT>
+class FibCompressor {
+ public:
+  typedef typename RouteT::Prefix Prefix;
+
+  struct Change {
+    Change(const std::shared_ptr<RouteT>& route, bool add)
+      : route(route), add(add) {}
+    std::shared_ptr<RouteT> route;
+    // Whether to add the route to the FIB, or change it, rather than remove
+    // it from the FIB
+    bool add;
+  };
+  typedef std::vector<Change> Changes;
+
+  FibCompressor() {}
+
+  /*
+   * Add the route to the RIB, or replace the route with the same prefix.
+   * The resulting FIB changes are appended to *changes.
+   */
+  void update(const std::shared_ptr<RouteT>& route, Changes* changes);
+
+  /*
+   * Remove the route with this prefix from the RIB, if there is one.  The
+   * resulting FIB changes are appended to *changes.
+   */
+  void remove(const Prefix& prefix, Changes* changes);
+
+  /*
+   * Whether the route with this prefix is in the FIB.  Returns false if
+   * there is no such route.
+   */
+  bool isInFib(const Prefix& prefix) const;
+
+  size_t getRibSize() const {
+    return rib_.size();
+  }
+  size_t getFibSize() const {
+    return fibSize_;
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  FibCompressor(FibCompressor const &) = delete;
+  FibCompressor& operator=(FibCompressor const &) = delete;
+
+  struct Entry {
+    explicit Entry(const std::shared_ptr<RouteT>& route) : route(route) {}
+    std::shared_ptr<RouteT> route;
+    bool inFib{false};
+  };
+  // Orders prefixes by network, then length, so that every route covered
+  // by a prefix directly follows it.
+  struct PrefixLess {
+    bool operator()(const Prefix& p1, const Prefix& p2) const {
+      if (p1.network != p2.network) {
+        return p1.network < p2.network;
+      }
+      return p1.mask < p2.mask;
+    }
+  };
+  typedef std::map<Prefix, Entry, PrefixLess> Rib;
+
+  // The longest route in the RIB covering the prefix, other than the route
+  // for the prefix itself, or nullptr if there is none.
+  const Entry* findCover(const Prefix& prefix) const;
+  // Decide again whether each immediate child of the route at iter is
+  // suppressed, now that it would fall through to a route forwarding as
+  // coverFwd, or to no route if coverFwd is nullptr.
+  void updateChildren(typename Rib::iterator iter,
+                      const RouteForwardInfo* coverFwd,
+                      Changes* added, Changes* removed);
+  void setInFib(Entry* entry, bool inFib);
+
+  Rib rib_;
+  // The number of routes in the RIB of each prefix length, so that finding
+  // a covering route only looks at the lengths in use.
+  std::array<uint32_t, 129> numRoutesByLength_{{}};
+  size_t fibSize_{0};
+};
+
+}} // facebook::fboss
@@ -9,6 +9,30 @@
  */
 #include "fboss/agent/HwSwitch.h"
 
+#include "fboss/agent/TxPacket.h"
+
 namespace facebook { namespace fboss {
 
+size_t HwSwitch::sendPacketsSwitched(
+    std::vector<std::unique_ptr<TxPacket>> pkts) noexcept {
+  size_t numSent = 0;
+  for (auto& pkt : pkts) {
+    if (sendPacketSwitched(std::move(pkt))) {
+      ++numSent;
+    }
+  }
+  return numSent;
+}
+
+size_t HwSwitch::sendPacketsOutOfPort(
+    std::vector<std::pair<std::unique_ptr<TxPacket>, PortID>> pkts) noexcept {
+  size_t numSent = 0;
+  for (auto& pkt : pkts) {
+    if (sendPacketOutOfPort(std::move(pkt.first), pkt.second)) {
+      ++numSent;
+    }
+  }
+  return numSent;
+}
+
 }} // facebook::fboss
@@ -9,11 +9,15 @@
  */
 #pragma once
 
+#include "fboss/agent/PortRateTracker.h"
 #include "fboss/agent/types.h"
 #include "fboss/agent/if/gen-cpp2/FbossCtrl.h"
 
+#include <folly/IPAddress.h>
+#include <folly/MacAddress.h>
 #include <memory>
 #include <utility>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
@@ -49,6 +53,16 @@ class TxPacket;
  * SwSwitch implementation would be able to handle all packets in software
  * (albeit more slowly).
  */
+/*
+ * What happened to an entry of the HW L2 table.
+ */
+enum class L2EntryUpdateType : uint8_t {
+  // Learned, or moved to another port
+  LEARNED,
+  // Aged out, or deleted
+  AGED,
+};
+
 class HwSwitch {
  public:
   class Callback {
@@ -67,6 +81,15 @@ class HwSwitch {
      */
     virtual void linkStateChanged(PortID port, bool up) noexcept = 0;
 
+    /*
+     * l2LearningUpdateReceived() is invoked by the HwSwitch, from an SDK
+     * thread, when the HW learns or ages a MAC address.  It must return
+     * quickly, since the SDK does not report further events until then.
+     */
+    virtual void l2LearningUpdateReceived(
+        VlanID vlan, folly::MacAddress mac, PortID port,
+        L2EntryUpdateType type) noexcept = 0;
+
     /*
      * Used to notify the SwSwitch of a fatal error so the implementation can
      * provide special behavior when a crash occurs.
@@ -100,6 +123,10 @@ class HwSwitch {
    *
    * stateChanged() is called whenever the switch state changes.
    * This is called immediately after updating the state variable in SwSwitch.
+   *
+   * If the change cannot be applied, and the hardware was returned to
+   * delta.oldState(), this throws FbossHwRolledBackError.  Any other
+   * exception leaves the hardware somewhere in between.
    */
   virtual void stateChanged(const StateDelta& delta) = 0;
 
@@ -125,6 +152,31 @@ class HwSwitch {
   virtual bool sendPacketOutOfPort(std::unique_ptr<TxPacket> pkt,
                                    PortID portID) noexcept = 0;
 
+  /*
+   * Send a batch of packets using switching logic, as if
+   * sendPacketSwitched() were called on each of them in order.
+   *
+   * Implementations may hand the whole batch to the hardware at once.  The
+   * default implementation sends the packets one at a time.
+   *
+   * @return The number of packets successfully sent to HW.
+   */
+  virtual size_t sendPacketsSwitched(
+      std::vector<std::unique_ptr<TxPacket>> pkts) noexcept;
+
+  /*
+   * Send a batch of packets, each out of its port, as if
+   * sendPacketOutOfPort() were called on each of them in order.
+   *
+   * Implementations may hand the whole batch to the hardware at once.  The
+   * default implementation sends the packets one at a time.
+   *
+   * @return The number of packets successfully sent to HW.
+   */
+  virtual size_t sendPacketsOutOfPort(
+      std::vector<std::pair<std::unique_ptr<TxPacket>, PortID>> pkts)
+      noexcept;
+
   /*
    * Allows hardware-specific code to record switch statistics.
    */
@@ -158,6 +210,91 @@ class HwSwitch {
    */
   virtual bool isPortUp(PortID port) const = 0;
 
+  typedef std::vector<folly::IPAddress> NeighborHits;
+  /*
+   * Append the addresses of the neighbor (L3 host) entries that forwarded
+   * traffic since the last call to hits, and reset their hit bits.
+   *
+   * Returns false if the hardware does not track hits, or tracking them is
+   * disabled, in which case hits is left untouched.
+   */
+  virtual bool getAndClearNeighborHits(NeighborHits* hits) = 0;
+
+  /*
+   * Fast path for a neighbor that a liveness check, such as BFD, found
+   * unreachable while its entry is still resolved: stop using it as a path
+   * of ECMP groups until it is reachable again, without waiting for the
+   * neighbor entry or the routes through it to change.
+   *
+   * Returns false if the hardware cannot do this.
+   */
+  virtual bool setNeighborReachable(RouterID router,
+                                    const folly::IPAddress& ip,
+                                    bool reachable) = 0;
+
+  struct WarmBootReconciliation {
+    // Entries found in HW at warm boot that the new state reused as they
+    // were, or had to reprogram
+    uint64_t reused{0};
+    uint64_t reprogrammed{0};
+    // Entries the new state does not use, deleted so far or still left
+    uint64_t deleted{0};
+    uint64_t remaining{0};
+    // Whether the initial programming is done, so that the unused entries
+    // are being deleted
+    bool cleanupStarted{false};
+  };
+  /*
+   * Get how far reconciling the HW entries found at warm boot with the new
+   * state got.
+   *
+   * Returns false if the hardware does not keep entries across restarts.
+   */
+  virtual bool getWarmBootReconciliation(WarmBootReconciliation* status) = 0;
+
+  struct HwOperationEstimate {
+    // The number of SDK calls needed for each kind of object
+    uint64_t ports{0};
+    uint64_t vlans{0};
+    uint64_t interfaces{0};
+    uint64_t hosts{0};
+    uint64_t routes{0};
+  };
+  /*
+   * Estimate how many hardware operations stateChanged() would perform to
+   * apply the given delta, without touching the hardware.
+   *
+   * Returns false if the hardware cannot estimate this.
+   */
+  virtual bool estimateStateChange(const StateDelta& delta,
+                                   HwOperationEstimate* estimate) const = 0;
+
+  struct PortCounters {
+    // The counter values as of the last stats update
+    uint64_t inBytes{0};
+    uint64_t inUnicastPkts{0};
+    uint64_t inMulticastPkts{0};
+    uint64_t inBroadcastPkts{0};
+    uint64_t inDiscards{0};
+    uint64_t inErrors{0};
+    uint64_t outBytes{0};
+    uint64_t outUnicastPkts{0};
+    uint64_t outMulticastPkts{0};
+    uint64_t outBroadcastPkts{0};
+    uint64_t outDiscards{0};
+    uint64_t outErrors{0};
+    // The rates of the counters over each window, computed by the same
+    // stats update
+    std::vector<PortRateTracker::WindowRates> rates;
+  };
+  /*
+   * Get the port's counters and rates as of the last updateStats(), without
+   * reading the hardware.
+   *
+   * Returns false if the port's stats have not been collected.
+   */
+  virtual bool getPortCounters(PortID port, PortCounters* counters) const = 0;
+
  private:
   // Forbidden copy constructor and assignment operator
   HwSwitch(HwSwitch const &) = delete;
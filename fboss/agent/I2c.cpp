@@ -9,6 +9,11 @@
  */
 #include "I2c.h"
 
+#include <folly/Conv.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <thread>
+#include "common/stats/ServiceData.h"
 #include "fboss/agent/SysError.h"
 
 extern "C" {
@@ -17,9 +22,44 @@ extern "C" {
 #include <linux/i2c-dev.h>
 }
 
+DEFINE_int32(i2c_read_chunk_size, 128,
+             "The maximum number of bytes read in a single I2C_RDWR "
+             "transaction");
+DEFINE_int32(i2c_retries, 2,
+             "The number of times a failed I2C read is retried");
+DEFINE_int32(i2c_retry_backoff_us, 1000,
+             "The delay before the first retry of a failed I2C read.  It "
+             "doubles with every further retry.");
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+
+namespace {
+
+// Transaction latencies are bucketed in 250us steps, up to 50ms
+const int kLatencyBucketUs = 250;
+const int kLatencyMaxUs = 50000;
+
+seconds wallNow() {
+  return duration_cast<seconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+}
+
+void addStat(const facebook::stats::ExportedStatMap::LockAndStatItem& stat,
+             int64_t value) {
+  auto now = wallNow();
+  facebook::SpinLockHolder guard(stat.first.get());
+  stat.second->addValue(now, value);
+}
+
+}
+
 namespace facebook { namespace fboss {
 
-I2cDevice::I2cDevice(int i2cBus, uint32_t address, bool slaveForce) {
+I2cDevice::I2cDevice(int i2cBus, uint32_t address, bool slaveForce)
+  : address_(address) {
   /* set the i2c bus name */
   i2cBus_ = i2cBus;
   /* Open the i2c Bus file */
@@ -38,6 +78,22 @@ I2cDevice::I2cDevice(int i2cBus, uint32_t address, bool slaveForce) {
     close(file_);
     throw SysError(errno, "Error setting slave address: ", address);
   }
+  /* Use combined transactions if the adapter supports them */
+  unsigned long funcs = 0;
+  if (ioctl(file_, I2C_FUNCS, &funcs) == 0) {
+    useRdwr_ = (funcs & I2C_FUNC_I2C) != 0;
+  }
+
+  /* Devices on the same bus share their stats */
+  auto prefix = folly::to<std::string>("i2c.bus", i2cBus_, ".");
+  stats::ExportedHistogram tmpl(kLatencyBucketUs, 0, kLatencyMaxUs);
+  latency_ = fbData->getHistogramMap()->getOrCreateUnlocked(
+      prefix + "transaction_us", &tmpl);
+  auto statMap = fbData->getStatMap();
+  const auto expType = stats::SUM;
+  errors_ = statMap->getLockAndStatItem(prefix + "errors", &expType);
+  retries_ = statMap->getLockAndStatItem(prefix + "retries", &expType);
+  bytesRead_ = statMap->getLockAndStatItem(prefix + "bytes_read", &expType);
 }
 
 I2cDevice::~I2cDevice() {
@@ -70,19 +126,66 @@ uint8_t I2cDevice::readByte(int offset) {
 }
 
 void I2cDevice::read(int offset, int length, uint8_t fieldValue[]) {
-  int temp_len = length;
+  int chunkSize = useRdwr_ ? std::max(1, FLAGS_i2c_read_chunk_size) :
+                             static_cast<int>(I2C_BLOCK_SIZE);
   int i = 0;
-  int rc = 0;
-  while (temp_len > 0) {
-    rc = i2c_smbus_read_i2c_block_data(file_, offset + i,
-                                       std::min(temp_len, (int) I2C_BLOCK_SIZE),
-                                       (fieldValue + i));
-    if (rc < 0) {
-      throw SysError(-rc, "Error reading data: ", i2cBus_);
+  while (i < length) {
+    i += readChunk(offset + i, std::min(length - i, chunkSize),
+                   fieldValue + i);
+  }
+}
+
+int I2cDevice::readChunk(int offset, int length, uint8_t* buf) {
+  auto backoff = microseconds(FLAGS_i2c_retry_backoff_us);
+  for (int attempt = 0; ; ++attempt) {
+    auto start = steady_clock::now();
+    auto rc = readOnce(offset, length, buf);
+    recordTransaction(steady_clock::now() - start);
+    if (rc > 0) {
+      addStat(bytesRead_, rc);
+      return rc;
+    }
+    addStat(errors_, 1);
+    /* A read that returns nothing would never make progress */
+    auto err = rc < 0 ? -rc : EIO;
+    if (attempt >= FLAGS_i2c_retries) {
+      throw SysError(err, "Error reading data: ", i2cBus_);
     }
-    i = i + rc;
-    temp_len = temp_len - rc;
+    addStat(retries_, 1);
+    std::this_thread::sleep_for(backoff);
+    backoff *= 2;
   }
 }
 
+int I2cDevice::readOnce(int offset, int length, uint8_t* buf) {
+  if (!useRdwr_) {
+    return i2c_smbus_read_i2c_block_data(file_, offset, length, buf);
+  }
+  /* Write the offset, then read back with a repeated start */
+  uint8_t reg = offset;
+  struct i2c_msg msgs[2];
+  msgs[0].addr = address_;
+  msgs[0].flags = 0;
+  msgs[0].len = 1;
+  msgs[0].buf = &reg;
+  msgs[1].addr = address_;
+  msgs[1].flags = I2C_M_RD;
+  msgs[1].len = length;
+  msgs[1].buf = buf;
+  struct i2c_rdwr_ioctl_data data;
+  data.msgs = msgs;
+  data.nmsgs = 2;
+  if (ioctl(file_, I2C_RDWR, &data) < 0) {
+    return -errno;
+  }
+  return length;
+}
+
+void I2cDevice::recordTransaction(steady_clock::duration latency) {
+  auto usecs = duration_cast<microseconds>(latency).count();
+  auto now = wallNow();
+  SpinLockHolder guard(latency_.first.get());
+  latency_.second->addValue(now, usecs, 1);
+}
+
 }}
@@ -9,7 +9,9 @@
  */
 #pragma once
 
+#include <chrono>
 #include <cstdint>
+#include "common/stats/ExportedHistogram.h"
 
 namespace facebook { namespace fboss {
 
@@ -21,13 +23,42 @@ class I2cDevice {
   };
   I2cDevice(int i2cBus, uint32_t address, bool slaveForce);
   ~I2cDevice();
+  /*
+   * Read length bytes starting at offset.
+   *
+   * If the adapter supports plain I2C transfers, each chunk of up to
+   * --i2c_read_chunk_size bytes is read with a single I2C_RDWR ioctl that
+   * combines the offset write and the read.  Otherwise the read is split
+   * into SMBus block reads of I2C_BLOCK_SIZE bytes.  A failed chunk is
+   * retried up to --i2c_retries times, with exponential backoff.
+   */
   void read(int offset, int length, uint8_t fieldValue[]);
   uint8_t readByte(int offset);
   uint16_t readWord(int offset);
   int readBlock(int offset, uint8_t fieldValue[]);
  private:
+  /*
+   * Performs a single read of up to length bytes, returning the number of
+   * bytes read or a negative errno.
+   */
+  int readOnce(int offset, int length, uint8_t* buf);
+  /*
+   * Reads one chunk, retrying on failure.  Returns the number of bytes read.
+   */
+  int readChunk(int offset, int length, uint8_t* buf);
+  void recordTransaction(std::chrono::steady_clock::duration latency);
+
   int file_;
   int i2cBus_;
+  uint32_t address_;
+  // Whether the adapter supports I2C_RDWR
+  bool useRdwr_{false};
+
+  // Per-bus transaction latency and error accounting
+  stats::ExportedHistogramMap::LockAndHistogram latency_;
+  stats::ExportedStatMap::LockAndStatItem errors_;
+  stats::ExportedStatMap::LockAndStatItem retries_;
+  stats::ExportedStatMap::LockAndStatItem bytesRead_;
   // Forbidden copy contructor and assignment operator
   I2cDevice(I2cDevice const &) = delete;
   I2cDevice& operator=(I2cDevice const &) = delete;
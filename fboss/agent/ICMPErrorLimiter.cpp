@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ICMPErrorLimiter.h"
+
+#include "fboss/agent/state/SwitchState.h"
+
+#include <algorithm>
+#include <mutex>
+
+using folly::IPAddress;
+
+namespace {
+
+// How often the idle source buckets may be purged once the table is full.
+// Purging walks the whole table, so it must not happen for every error
+// during a flood from spoofed sources.
+const std::chrono::seconds kPurgeInterval(1);
+
+}
+
+namespace facebook { namespace fboss {
+
+void ICMPErrorLimiter::refill(TokenBucket* bucket, uint32_t rate,
+                              uint32_t burst, TimePoint now) {
+  if (now > bucket->lastUpdate) {
+    std::chrono::duration<double> elapsed = now - bucket->lastUpdate;
+    bucket->tokens += elapsed.count() * rate;
+    bucket->lastUpdate = now;
+  }
+  // This also applies a burst size that was lowered since the last refill
+  bucket->tokens = std::min<double>(bucket->tokens, burst);
+}
+
+ICMPErrorLimiter::TokenBucket* ICMPErrorLimiter::getSourceBucket(
+    const IPAddress& dst, uint32_t rate, uint32_t burst, TimePoint now) {
+  auto it = sourceBuckets_.find(dst);
+  if (it != sourceBuckets_.end()) {
+    return &it->second;
+  }
+  if (sourceBuckets_.size() >= MAX_SOURCES) {
+    purgeIdleSources(rate, burst, now);
+    if (sourceBuckets_.size() >= MAX_SOURCES) {
+      return nullptr;
+    }
+  }
+  // New buckets start out full
+  TokenBucket bucket;
+  bucket.tokens = burst;
+  bucket.lastUpdate = now;
+  return &sourceBuckets_.emplace(dst, bucket).first->second;
+}
+
+void ICMPErrorLimiter::purgeIdleSources(uint32_t rate, uint32_t burst,
+                                        TimePoint now) {
+  if (now < lastPurge_ + kPurgeInterval) {
+    return;
+  }
+  lastPurge_ = now;
+  // A bucket that has filled up again is no different from a new one
+  for (auto it = sourceBuckets_.begin(); it != sourceBuckets_.end(); ) {
+    refill(&it->second, rate, burst, now);
+    if (it->second.tokens >= burst) {
+      it = sourceBuckets_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool ICMPErrorLimiter::admit(const ICMPErrorLimits& limits, VlanID vlan,
+                             const IPAddress& dst, TimePoint now) {
+  if (limits.intfRate == 0 && limits.sourceRate == 0) {
+    return true;
+  }
+
+  std::lock_guard<folly::SpinLock> g(lock_);
+  // Check both buckets before taking a token from either, so that errors
+  // dropped by one limit do not count against the other.
+  TokenBucket* intfBucket = nullptr;
+  if (limits.intfRate > 0) {
+    auto ret = intfBuckets_.emplace(vlan, TokenBucket());
+    intfBucket = &ret.first->second;
+    if (ret.second) {
+      intfBucket->tokens = limits.intfBurst;
+      intfBucket->lastUpdate = now;
+    }
+    refill(intfBucket, limits.intfRate, limits.intfBurst, now);
+    if (intfBucket->tokens < 1) {
+      return false;
+    }
+  }
+  TokenBucket* sourceBucket = nullptr;
+  if (limits.sourceRate > 0) {
+    sourceBucket = getSourceBucket(dst, limits.sourceRate,
+                                   limits.sourceBurst, now);
+    if (sourceBucket) {
+      refill(sourceBucket, limits.sourceRate, limits.sourceBurst, now);
+      if (sourceBucket->tokens < 1) {
+        return false;
+      }
+    }
+  }
+
+  if (intfBucket) {
+    intfBucket->tokens -= 1;
+  }
+  if (sourceBucket) {
+    sourceBucket->tokens -= 1;
+  }
+  return true;
+}
+
+}} // facebook::fboss
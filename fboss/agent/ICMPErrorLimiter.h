@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <chrono>
+#include <unordered_map>
+#include <boost/container/flat_map.hpp>
+#include <folly/IPAddress.h>
+#include <folly/SpinLock.h>
+
+namespace facebook { namespace fboss {
+
+struct ICMPErrorLimits;
+
+/*
+ * ICMPErrorLimiter is a token bucket rate limiter for the ICMP errors we
+ * generate, such as TTL exceeded.
+ *
+ * A traceroute sweep or a routing loop traps a packet to the CPU for every
+ * TTL that expires on us, and without a limit we would send an error for
+ * each of them.  Every source address the errors are sent to, and every VLAN
+ * they are sent from, has its own token bucket, and an error is only sent
+ * if both of its buckets have a token left.
+ *
+ * The limits are passed in with every call, so that they always follow the
+ * current SwitchState.  admit() may be called concurrently from several
+ * threads.
+ */
+class ICMPErrorLimiter {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  /*
+   * The maximum number of source addresses with their own bucket.  Once
+   * this many sources are tracked, new sources are only subject to the
+   * limit of their VLAN until the idle sources are purged.
+   */
+  enum : uint32_t { MAX_SOURCES = 4096 };
+
+  ICMPErrorLimiter() {}
+
+  /*
+   * Returns true if an error may be sent from vlan to dst, or false if it
+   * should be dropped.
+   */
+  bool admit(const ICMPErrorLimits& limits, VlanID vlan,
+             const folly::IPAddress& dst) {
+    return admit(limits, vlan, dst, std::chrono::steady_clock::now());
+  }
+  bool admit(const ICMPErrorLimits& limits, VlanID vlan,
+             const folly::IPAddress& dst, TimePoint now);
+
+ private:
+  struct TokenBucket {
+    double tokens{0};
+    TimePoint lastUpdate;
+  };
+  typedef std::unordered_map<folly::IPAddress, TokenBucket> SourceBuckets;
+
+  // Forbidden copy constructor and assignment operator
+  ICMPErrorLimiter(ICMPErrorLimiter const &) = delete;
+  ICMPErrorLimiter& operator=(ICMPErrorLimiter const &) = delete;
+
+  static void refill(TokenBucket* bucket, uint32_t rate, uint32_t burst,
+                     TimePoint now);
+  TokenBucket* getSourceBucket(const folly::IPAddress& dst,
+                               uint32_t rate, uint32_t burst, TimePoint now);
+  void purgeIdleSources(uint32_t rate, uint32_t burst, TimePoint now);
+
+  folly::SpinLock lock_;
+  boost::container::flat_map<VlanID, TokenBucket> intfBuckets_;
+  SourceBuckets sourceBuckets_;
+  TimePoint lastPurge_;
+};
+
+}} // facebook::fboss
@@ -9,6 +9,9 @@
  */
 #include "IPv4Handler.h"
 
+#include <algorithm>
+#include <mutex>
+
 #include <folly/IPAddress.h>
 #include <folly/IPAddressV4.h>
 #include <folly/MacAddress.h>
@@ -35,7 +38,10 @@
 #include "fboss/agent/state/Route.h"
 #include "fboss/agent/DHCPv4Handler.h"
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/NeighborHoldQueue.h"
 #include "fboss/agent/UDPHeader.h"
+#include "fboss/agent/UnresolvedPuntPolicy.h"
+#include "fboss/agent/packet/HdrView.h"
 #include "fboss/agent/packet/IPv4Hdr.h"
 #include "fboss/agent/packet/ICMPHdr.h"
 #include "fboss/agent/Utils.h"
@@ -49,62 +55,66 @@ using std::unique_ptr;
 
 namespace facebook { namespace fboss {
 
-template<typename BodyFn>
-std::unique_ptr<TxPacket> createICMPv4Pkt(SwSwitch* sw,
-                                          folly::MacAddress dstMac,
-                                          folly::MacAddress srcMac,
-                                          VlanID vlan,
-                                          folly::IPAddressV4& dstIP,
-                                          folly::IPAddressV4& srcIP,
-                                          ICMPv4Type icmpType,
-                                          ICMPv4Code icmpCode,
-                                          uint32_t bodyLength,
-                                          BodyFn serializeBody) {
-  IPv4Hdr ipv4(srcIP, dstIP, IP_PROTO_ICMP,
-               ICMPHdr::SIZE + bodyLength);
-  ipv4.computeChecksum();
-
-  ICMPHdr icmp4(icmpType, icmpCode, 0);
-  uint32_t pktLen = icmp4.computeTotalLengthV4(bodyLength);
-
-  auto pkt = sw->allocatePacket(pktLen);
-  RWPrivateCursor cursor(pkt->buf());
-  icmp4.serializeFullPacket(&cursor, dstMac, srcMac, vlan, ipv4,
-                               bodyLength, serializeBody);
-  return pkt;
-}
-
 IPv4Handler::IPv4Handler(SwSwitch* sw)
   : sw_(sw) {
 }
 
+ICMPv4ErrorTemplate IPv4Handler::getICMPErrorTemplate(
+    VlanID vlan,
+    MacAddress dst,
+    MacAddress src,
+    const IPAddressV4& srcIP,
+    ICMPv4Type type,
+    ICMPv4Code code) {
+  std::lock_guard<folly::SpinLock> g(icmpTemplatesLock_);
+  auto it = icmpTemplates_.find(vlan);
+  if (it != icmpTemplates_.end() &&
+      it->second.matches(dst, src, vlan, srcIP, type, code)) {
+    return it->second;
+  }
+  ICMPv4ErrorTemplate tmpl(dst, src, vlan, srcIP, type, code);
+  icmpTemplates_[vlan] = tmpl;
+  return tmpl;
+}
+
 void IPv4Handler::sendICMPTimeExceeded(VlanID srcVlan,
                                        MacAddress dst,
                                        MacAddress src,
-                                       IPv4Hdr& v4Hdr,
+                                       const IPv4HdrView& v4Hdr,
                                        Cursor cursor) {
   auto state = sw_->getState();
+  IPAddressV4 dstIp = v4Hdr.srcAddr();
+  if (!icmpErrorLimiter_.admit(state->getICMPErrorLimits(), srcVlan,
+                               IPAddress(dstIp))) {
+    VLOG(4) << "not sending ICMP Time Exceeded to " << dstIp
+            << ": rate limited";
+    sw_->stats()->icmpErrorLimited();
+    return;
+  }
 
   // payload serialization function
-  // 4 bytes unused + ipv4 header + 8 bytes payload
-  auto bodyLength = ICMPHdr::ICMPV4_UNUSED_LEN + v4Hdr.size()
+  // 4 bytes unused + ipv4 header, with any options, + 8 bytes payload
+  auto hdrBytes = v4Hdr.bytes();
+  auto bodyLength = ICMPHdr::ICMPV4_UNUSED_LEN + hdrBytes.size()
                     + ICMPHdr::ICMPV4_SENDER_BYTES;
   auto serializeBody = [&](RWPrivateCursor* sendCursor) {
     sendCursor->writeBE<uint32_t>(0); // unused bytes
-    v4Hdr.write(sendCursor);
+    sendCursor->push(hdrBytes.data(), hdrBytes.size());
     sendCursor->push(cursor.data(), ICMPHdr::ICMPV4_SENDER_BYTES);
   };
 
   IPAddressV4 srcIp = getSwitchVlanIP(state, srcVlan);
-  auto icmpPkt = createICMPv4Pkt(sw_, dst, src, srcVlan,
-                             v4Hdr.srcAddr, srcIp,
-                             ICMPV4_TYPE_TIME_EXCEEDED,
-                             ICMPV4_CODE_TIME_EXCEEDED_TTL_EXCEEDED,
-                             bodyLength, serializeBody);
+  auto tmpl = getICMPErrorTemplate(srcVlan, dst, src, srcIp,
+                                   ICMPV4_TYPE_TIME_EXCEEDED,
+                                   ICMPV4_CODE_TIME_EXCEEDED_TTL_EXCEEDED);
+  auto icmpPkt = sw_->allocatePacket(
+      ICMPv4ErrorTemplate::computeTotalLength(bodyLength));
+  RWPrivateCursor sendCursor(icmpPkt->buf());
+  tmpl.serialize(&sendCursor, dstIp, bodyLength, serializeBody);
   VLOG(4) << "sending ICMP Time Exceeded with srcMac " << src
           << " dstMac: " << dst
           << " vlan: " << srcVlan
-          << " dstIp: " << v4Hdr.srcAddr.str()
+          << " dstIp: " << dstIp.str()
           << " srcIp: " << srcIp.str()
           << " bodyLength: " << bodyLength;
   sw_->sendPacketSwitched(std::move(icmpPkt));
@@ -113,28 +123,33 @@ void IPv4Handler::sendICMPTimeExceeded(VlanID srcVlan,
 void IPv4Handler::handlePacket(unique_ptr<RxPacket> pkt,
                                MacAddress dst,
                                MacAddress src,
-                               Cursor cursor) {
-  SwitchStats* stats = sw_->stats();
+                               Cursor cursor,
+                               PortStats* portStats) {
   PortID port = pkt->getSrcPort();
 
   const uint32_t l3Len = pkt->getLength() - (cursor - Cursor(pkt->buf()));
-  stats->port(port)->ipv4Rx();
-  IPv4Hdr v4Hdr(cursor);
-  VLOG(4) << "Rx IPv4 packet (" << l3Len << " bytes) " << v4Hdr.srcAddr.str()
-          << " --> " << v4Hdr.dstAddr.str()
-          << " proto: 0x" << std::hex << static_cast<int>(v4Hdr.protocol);
+  portStats->ipv4Rx();
+  // The whole packet, in case it has to be held for ARP
+  Cursor l3Cursor(cursor);
+  // Parsed once, and passed on to the handlers below rather than parsed
+  // again.  The cursor is left just past any options.
+  IPv4HdrView v4Hdr(&cursor);
+  VLOG(4) << "Rx IPv4 packet (" << l3Len << " bytes) "
+          << v4Hdr.srcAddr().str() << " --> " << v4Hdr.dstAddr().str()
+          << " proto: 0x" << std::hex << static_cast<int>(v4Hdr.protocol());
 
   // retrieve the current switch state
-  auto state = sw_->getState();
+  auto stateReader = sw_->readState();
+  const auto& state = stateReader.get();
   // Need to check if the packet is for self or not. We store our IP
   // in the ARP response table. Use that for now.
   auto vlan = state->getVlans()->getVlanIf(pkt->getSrcVlan());
   if (!vlan) {
-    stats->port(port)->pktDropped();
+    portStats->pktDropped();
     return;
   }
 
-  if (v4Hdr.protocol == IPPROTO_UDP) {
+  if (v4Hdr.protocol() == IPPROTO_UDP) {
     Cursor udpCursor(cursor);
     UDPHeader udpHdr;
     udpHdr.parse(sw_, port, &udpCursor);
@@ -147,31 +162,31 @@ void IPv4Handler::handlePacket(unique_ptr<RxPacket> pkt,
     }
   }
 
-  auto dstIP = v4Hdr.dstAddr;
+  auto dstIP = v4Hdr.dstAddr();
   // Handle packets destined for us
   // TODO: assume vrf 0 now
   if (state->getInterfaces()->getInterfaceIf(RouterID(0), IPAddress(dstIP))) {
     // TODO: Also check to see if this is the broadcast address for one of the
     // interfaces on this VLAN.  We should probably build up a more efficient
     // data structure to look up this information.
-    stats->port(port)->ipv4Mine();
+    portStats->ipv4Mine();
     // Anything not handled by the controller, we will forward it to the host,
     // i.e. ping, ssh, bgp...
     // FixME: will do another diff to set length in RxPacket, so that it
     // can be reused here.
     if (sw_->sendPacketToHost(std::move(pkt))) {
-      stats->port(port)->pktToHost(l3Len);
+      portStats->pktToHost(l3Len);
     } else {
-      stats->port(port)->pktDropped();
+      portStats->pktDropped();
     }
     return;
   }
 
   // if packet is not for us, check the ttl exceed
-  if (v4Hdr.ttl <= 1) {
+  if (v4Hdr.ttl() <= 1) {
     VLOG(4) << "Rx IPv4 Packet with TTL expired";
-    stats->port(port)->pktDropped();
-    stats->port(port)->ipv4TtlExceeded();
+    portStats->pktDropped();
+    portStats->ipv4TtlExceeded();
     // Look up cpu mac from platform
     MacAddress cpuMac = sw_->getPlatform()->getLocalMac();
     sendICMPTimeExceeded(pkt->getSrcVlan(), cpuMac, cpuMac, v4Hdr, cursor);
@@ -183,27 +198,50 @@ void IPv4Handler::handlePacket(unique_ptr<RxPacket> pkt,
   // interfaces on this VLAN. We should probably build up a more efficient
   // data structure to look up this information.
   if (dstIP.isLinkLocalBroadcast()) {
-    stats->port(port)->pktDropped();
+    portStats->pktDropped();
     return;
   }
 
   // TODO: check the reason of punt, for now, assume it is for
-  // resolving the address
-  // We will need to manage the rate somehow. Either from HW
-  // or a SW control here
-  stats->port(port)->ipv4Nexthop();
+  // resolving the address.  The route class of the destination decides
+  // how many of its packets are used for that.
+  portStats->ipv4Nexthop();
+  if (sw_->getUnresolvedPuntPolicy()->admit(IPAddress(dstIP)) !=
+      UnresolvedPuntPolicy::Verdict::RESOLVE) {
+    portStats->pktDropped();
+    return;
+  }
   if (!resolveMac(state.get(), dstIP)) {
-    stats->port(port)->ipv4NoArp();
+    portStats->ipv4NoArp();
     VLOG(3) << "Cannot find the interface to send out ARP request for "
       << dstIP.str();
+  } else if (sw_->getNeighborHoldQueue()->hold(
+                 IPAddress(dstIP), l3Cursor,
+                 std::min<uint32_t>(v4Hdr.length(), l3Len))) {
+    // Sent on once the ARP request is answered
+    return;
   }
-  // TODO: ideally, we need to store this packet until the ARP is done and
-  // then send this pkt out. For now, just drop it.
-  stats->port(port)->pktDropped();
+  portStats->pktDropped();
 }
 
 // Return true if we successfully sent an ARP request, false otherwise
 bool IPv4Handler::resolveMac(SwitchState* state, IPAddressV4 dest) {
+  ResolutionCache::Result result;
+  if (resolutionCache_.lookup(*state, dest, &result)) {
+    VLOG(5) << "using cached resolution of " << dest.str();
+  } else {
+    result = resolveMacUncached(state, dest);
+    resolutionCache_.record(*state, dest, result);
+    if (result == ResolutionCache::Result::REQUESTED) {
+      sw_->getUnresolvedPuntPolicy()->requested(IPAddress(dest));
+    }
+  }
+  return result != ResolutionCache::Result::NO_ROUTE;
+}
+
+IPv4Handler::ResolutionCache::Result IPv4Handler::resolveMacUncached(
+    SwitchState* state,
+    IPAddressV4 dest) {
   // need to find out our own IP and MAC addresses so that we can send the
   // ARP request out. Since the request will be broadcast, there is no need to
   // worry about which port to send the packet out.
@@ -217,9 +255,11 @@ bool IPv4Handler::resolveMac(SwitchState* state, IPAddressV4 dest) {
   auto route = routeTable->getRibV4()->longestMatch(dest);
   if (!route) {
     // No way to reach dest
-    return false;
+    return ResolutionCache::Result::NO_ROUTE;
   }
 
+  auto result = ResolutionCache::Result::RESOLVED;
+
   auto intfs = state->getInterfaces();
   auto nhs = route->getForwardInfo().getNexthops();
   for (auto nh : nhs) {
@@ -241,6 +281,7 @@ bool IPv4Handler::resolveMac(SwitchState* state, IPAddressV4 dest) {
           // No entry in ARP table, send ARP request
           auto* arp = sw_->getArpHandler();
           arp->sendArpRequest(vlan, intf, source, target);
+          result = ResolutionCache::Result::REQUESTED;
         } else {
           VLOG(4) << "not sending arp for " << target.str() << ", "
                   << ((entry->isPending()) ? "pending " : "")
@@ -250,7 +291,7 @@ bool IPv4Handler::resolveMac(SwitchState* state, IPAddressV4 dest) {
     }
   }
 
-  return true;
+  return result;
 }
 
 }}
@@ -13,8 +13,13 @@
 
 #include <memory>
 
+#include <boost/container/flat_map.hpp>
 #include <folly/IPAddressV4.h>
 #include <folly/MacAddress.h>
+#include <folly/SpinLock.h>
+#include "fboss/agent/ICMPErrorLimiter.h"
+#include "fboss/agent/NeighborResolutionCache.h"
+#include "fboss/agent/packet/ICMPErrorTemplate.h"
 #include "fboss/agent/packet/IPv4Hdr.h"
 
 namespace folly { namespace io {
@@ -23,6 +28,8 @@ class Cursor;
 
 namespace facebook { namespace fboss {
 
+class IPv4HdrView;
+class PortStats;
 class RxPacket;
 class SwitchState;
 class SwSwitch;
@@ -37,22 +44,49 @@ class IPv4Handler {
   void handlePacket(std::unique_ptr<RxPacket> pkt,
                     folly::MacAddress dst,
                     folly::MacAddress src,
-                    folly::io::Cursor cursor);
+                    folly::io::Cursor cursor,
+                    PortStats* portStats);
 
  private:
   void sendICMPTimeExceeded(VlanID srcVlan,
                             folly::MacAddress dst,
                             folly::MacAddress src,
-                            IPv4Hdr& v4Hdr,
+                            const IPv4HdrView& v4Hdr,
                             folly::io::Cursor cursor);
 
   // Forbidden copy constructor and assignment operator
   IPv4Handler(IPv4Handler const &) = delete;
   IPv4Handler& operator=(IPv4Handler const &) = delete;
 
+  typedef NeighborResolutionCache<folly::IPAddressV4> ResolutionCache;
+
   bool resolveMac(SwitchState* state, folly::IPAddressV4 dest);
+  ResolutionCache::Result resolveMacUncached(SwitchState* state,
+                                             folly::IPAddressV4 dest);
+
+  ICMPv4ErrorTemplate getICMPErrorTemplate(VlanID vlan,
+                                           folly::MacAddress dst,
+                                           folly::MacAddress src,
+                                           const folly::IPAddressV4& srcIP,
+                                           ICMPv4Type type,
+                                           ICMPv4Code code);
 
   SwSwitch* sw_{nullptr};
+
+  ICMPErrorLimiter icmpErrorLimiter_;
+  /*
+   * The headers of the ICMP errors last sent from each VLAN.  A template is
+   * rebuilt whenever the addresses of its VLAN change.
+   */
+  boost::container::flat_map<VlanID, ICMPv4ErrorTemplate> icmpTemplates_;
+  folly::SpinLock icmpTemplatesLock_;
+
+  /*
+   * How recently punted destinations were resolved, so that a burst of
+   * packets to an unresolved destination does not repeat the route and ARP
+   * table lookups, or the ARP requests, for every packet.
+   */
+  ResolutionCache resolutionCache_;
 };
 
 }} // facebook::fboss
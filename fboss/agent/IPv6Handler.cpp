@@ -12,6 +12,9 @@
 #include <folly/MacAddress.h>
 #include <folly/Format.h>
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/NeighborHoldQueue.h"
+#include "fboss/agent/NeighborLimits.h"
+#include "fboss/agent/NeighborSuppression.h"
 #include "fboss/agent/RxPacket.h"
 #include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/SwSwitch.h"
@@ -27,6 +30,7 @@
 #include "fboss/agent/state/NdpTable.h"
 #include "fboss/agent/state/NdpResponseTable.h"
 #include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/StateUpdateHelpers.h"
 #include "fboss/agent/state/SwitchState.h"
 #include "fboss/agent/state/Vlan.h"
 #include "fboss/agent/state/VlanMap.h"
@@ -36,6 +40,11 @@
 #include "fboss/agent/state/Route.h"
 #include "fboss/agent/Utils.h"
 #include "fboss/agent/UDPHeader.h"
+#include "fboss/agent/UnresolvedPuntPolicy.h"
+
+#include <algorithm>
+#include <mutex>
+#include <set>
 
 using folly::IPAddressV6;
 using folly::MacAddress;
@@ -78,25 +87,130 @@ struct IPv6Handler::ICMPHeaders {
   folly::MacAddress src;
   const IPv6Hdr* ipv6;
   const ICMPHdr* icmp6;
+  PortStats* portStats;
+};
+
+struct IPv6Handler::RouterSolicitations {
+  std::mutex lock;
+  // Cleared when the IPv6Handler is destroyed
+  IPv6Handler* handler{nullptr};
+  std::set<VlanID> pending;
+  // Set while work to answer pending is scheduled
+  bool scheduled{false};
 };
 
 IPv6Handler::IPv6Handler(SwSwitch* sw)
-  : sw_(sw) {
+  : sw_(sw),
+    neighborUpdates_(std::make_shared<NeighborUpdateQueue<NdpTable>>()),
+    routerSolicitations_(std::make_shared<RouterSolicitations>()) {
+  routerSolicitations_->handler = this;
+}
+
+IPv6Handler::~IPv6Handler() {
+  std::lock_guard<std::mutex> guard(routerSolicitations_->lock);
+  routerSolicitations_->handler = nullptr;
 }
 
 void IPv6Handler::stateChanged(const StateDelta& delta) {
+  updateResponseTables(delta);
   for (const auto& entry : delta.getIntfsDelta()) {
     if (!entry.getOld()) {
       intfAdded(delta.newState().get(), entry.getNew().get());
     } else if (!entry.getNew()) {
       intfDeleted(entry.getOld().get());
     } else {
-      // TODO: We could add an intfChanged() method to re-use the existing
-      // IPv6RouteAdvertiser object.
-      intfDeleted(entry.getOld().get());
-      intfAdded(delta.newState().get(), entry.getNew().get());
+      intfChanged(delta.newState().get(), entry.getOld().get(),
+                  entry.getNew().get());
+    }
+  }
+  // The advertisements carry the MTU of the interface's VLAN
+  for (const auto& entry : delta.getVlansDelta()) {
+    auto oldVlan = entry.getOld();
+    auto newVlan = entry.getNew();
+    if (oldVlan && newVlan && oldVlan->getMTU() != newVlan->getMTU()) {
+      vlanMtuChanged(delta.newState().get(), newVlan->getID());
+    }
+  }
+}
+
+void IPv6Handler::updateResponseTables(const StateDelta& delta) {
+  // responseTables_ is only ever replaced here, in the background thread,
+  // so we don't need the lock to read it.
+  if (responseTables_) {
+    bool changed = false;
+    for (const auto& entry : delta.getVlansDelta()) {
+      auto oldVlan = entry.getOld();
+      auto newVlan = entry.getNew();
+      if (!oldVlan || !newVlan ||
+          oldVlan->getNdpResponseTable() != newVlan->getNdpResponseTable()) {
+        changed = true;
+        break;
+      }
+    }
+    if (!changed) {
+      return;
+    }
+  }
+
+  // Only the advertisements of the VLANs whose tables changed are built
+  // again
+  auto tables = std::make_shared<ResponseTables>();
+  for (const auto& vlan : *delta.newState()->getVlans()) {
+    const auto& table = vlan->getNdpResponseTable();
+    if (responseTables_) {
+      auto it = responseTables_->find(vlan->getID());
+      if (it != responseTables_->end() && it->second->table == table) {
+        tables->emplace(vlan->getID(), it->second);
+        continue;
+      }
     }
+    tables->emplace(vlan->getID(), buildVlanResponses(vlan->getID(), table));
   }
+  folly::SpinLockGuard guard(responseTablesLock_);
+  responseTables_ = std::move(tables);
+}
+
+shared_ptr<const IPv6Handler::VlanResponses>
+IPv6Handler::buildVlanResponses(VlanID vlan,
+                                const shared_ptr<NdpResponseTable>& table) {
+  auto responses = std::make_shared<VlanResponses>();
+  responses->table = table;
+  responses->replies.reserve(table->getTable().size());
+  for (const auto& entry : table->getTable()) {
+    responses->replies.emplace(entry.first, NeighborAdvertisementTemplate(
+        entry.second.mac, vlan, entry.first));
+  }
+  return responses;
+}
+
+folly::Optional<NeighborAdvertisementTemplate> IPv6Handler::getResponse(
+    VlanID vlan, const IPAddressV6& ip) const {
+  {
+    folly::SpinLockGuard guard(responseTablesLock_);
+    if (responseTables_) {
+      auto it = responseTables_->find(vlan);
+      if (it == responseTables_->end()) {
+        return folly::none;
+      }
+      const auto& replies = it->second->replies;
+      auto reply = replies.find(ip);
+      if (reply == replies.end()) {
+        return folly::none;
+      }
+      return reply->second;
+    }
+  }
+
+  // No state change has been delivered yet, so look in the SwitchState
+  auto vlanPtr = sw_->getState()->getVlans()->getVlanIf(vlan);
+  if (!vlanPtr) {
+    return folly::none;
+  }
+  auto entry = vlanPtr->getNdpResponseTable()->getEntry(ip);
+  if (!entry) {
+    return folly::none;
+  }
+  return NeighborAdvertisementTemplate(entry->mac, vlan, ip);
 }
 
 bool IPv6Handler::raEnabled(const Interface* intf) const {
@@ -122,11 +236,43 @@ void IPv6Handler::intfDeleted(const Interface* intf) {
   CHECK_EQ(numErased, 1);
 }
 
+void IPv6Handler::intfChanged(const SwitchState* state,
+                              const Interface* oldIntf,
+                              const Interface* newIntf) {
+  if (!raEnabled(oldIntf) || !raEnabled(newIntf)) {
+    intfDeleted(oldIntf);
+    intfAdded(state, newIntf);
+    return;
+  }
+  // Keep the advertiser, and its place in the RA interval, unless something
+  // that goes into the advertisements changed
+  if (oldIntf->getNdpConfig() == newIntf->getNdpConfig() &&
+      oldIntf->getAddresses() == newIntf->getAddresses() &&
+      oldIntf->getMac() == newIntf->getMac() &&
+      oldIntf->getVlanID() == newIntf->getVlanID()) {
+    return;
+  }
+  routeAdvertisers_.at(newIntf->getID()).update(state, newIntf);
+}
+
+void IPv6Handler::vlanMtuChanged(const SwitchState* state, VlanID vlan) {
+  for (const auto& intf :
+         state->getInterfaces()->getInterfacesInVlanIf(vlan)) {
+    auto it = routeAdvertisers_.find(intf->getID());
+    if (it != routeAdvertisers_.end()) {
+      it->second.update(state, intf.get());
+    }
+  }
+}
+
 void IPv6Handler::handlePacket(unique_ptr<RxPacket> pkt,
                                MacAddress dst,
                                MacAddress src,
-                               Cursor cursor) {
+                               Cursor cursor,
+                               PortStats* portStats) {
   const uint32_t l3Len = pkt->getLength() - (cursor - Cursor(pkt->buf()));
+  // The whole packet, in case it has to be held for neighbor discovery
+  Cursor l3Cursor(cursor);
   IPv6Hdr ipv6(cursor);  // note: advances our cursor object
   VLOG(4) << "IPv6 (" << l3Len << " bytes)"
     " port: " << pkt->getSrcPort() <<
@@ -138,7 +284,8 @@ void IPv6Handler::handlePacket(unique_ptr<RxPacket> pkt,
     " nextHeader: " << static_cast<int>(ipv6.nextHeader);
 
   // retrieve the current switch state
-  auto state = sw_->getState();
+  auto stateReader = sw_->readState();
+  const auto& state = stateReader.get();
   PortID port = pkt->getSrcPort();
 
   // NOTE: DHCPv6 solicit pacekt from client has hoplimit set to 1,
@@ -158,8 +305,8 @@ void IPv6Handler::handlePacket(unique_ptr<RxPacket> pkt,
 
   if (ipv6.hopLimit <= 1) {
     VLOG(4) << "Rx IPv6 Packet with hop limit exceeded";
-    sw_->stats()->port(port)->pktDropped();
-    sw_->stats()->port(port)->ipv6HopExceeded();
+    portStats->pktDropped();
+    portStats->ipv6HopExceeded();
     // Look up cpu mac from platform
     MacAddress cpuMac = sw_->getPlatform()->getLocalMac();
     sendICMPv6TimeExceeded(pkt->getSrcVlan(), cpuMac, cpuMac, ipv6, cursor);
@@ -177,7 +324,8 @@ void IPv6Handler::handlePacket(unique_ptr<RxPacket> pkt,
   // forwarding info, then we need to resolve the next hop MAC.
 
   if (ipv6.nextHeader == IP_PROTO_IPV6_ICMP) {
-    pkt = handleICMPv6Packet(std::move(pkt), dst, src, ipv6, cursor);
+    pkt = handleICMPv6Packet(std::move(pkt), dst, src, ipv6, cursor,
+                             portStats);
     if (pkt == nullptr) {
       // packet has been handled
       return;
@@ -195,21 +343,30 @@ void IPv6Handler::handlePacket(unique_ptr<RxPacket> pkt,
     // packets destined for us
     // Anything not handled by the controller, we will forward it to the host,
     // i.e. ping, ssh, bgp...
-    PortID port = pkt->getSrcPort();
     if (sw_->sendPacketToHost(std::move(pkt))) {
-      sw_->stats()->port(port)->pktToHost(l3Len);
+      portStats->pktToHost(l3Len);
     } else {
-      sw_->stats()->port(port)->pktDropped();
+      portStats->pktDropped();
     }
     return;
   }
 
-  // For now, assume we need to resolve the IP for this packet.
-  // TODO: Add rate limiting so we don't generate too many requests for the
-  // same IP.  Following the rules in RFC 4861 should be sufficient.
-  sendNeighborSolicitations(ipv6.dstAddr);
-  // We drop the packet while waiting on a response.
-  sw_->portStats(pkt)->pktDropped();
+  // For now, assume we need to resolve the IP for this packet.  The route
+  // class of the destination decides how many of its packets are used for
+  // that.
+  if (sw_->getUnresolvedPuntPolicy()->admit(folly::IPAddress(ipv6.dstAddr)) !=
+      UnresolvedPuntPolicy::Verdict::RESOLVE) {
+    portStats->pktDropped();
+    return;
+  }
+  if (sendNeighborSolicitations(ipv6.dstAddr) &&
+      sw_->getNeighborHoldQueue()->hold(
+          folly::IPAddress(ipv6.dstAddr), l3Cursor,
+          std::min<uint32_t>(IPv6Hdr::SIZE + ipv6.payloadLength, l3Len))) {
+    // Sent on once the solicitation is answered
+    return;
+  }
+  portStats->pktDropped();
 }
 
 uint32_t IPv6Handler::flushNdpEntryBlocking(IPAddressV6 ip, VlanID vlan) {
@@ -217,7 +374,15 @@ uint32_t IPv6Handler::flushNdpEntryBlocking(IPAddressV6 ip, VlanID vlan) {
   auto updateFn = [&](const shared_ptr<SwitchState>& state) {
     return performNeighborFlush(state, vlan, ip, &count);
   };
-  sw_->updateStateBlocking("flush NDP entry", updateFn);
+  sw_->updateStateBlocking("flush NDP entry", updateFn,
+                           StateUpdatePriority::NEIGHBOR);
+  return count;
+}
+
+uint32_t IPv6Handler::flushNdpEntry(shared_ptr<SwitchState>* state,
+                                    IPAddressV6 ip, VlanID vlan) {
+  uint32_t count{0};
+  *state = performNeighborFlush(*state, vlan, ip, &count);
   return count;
 }
 
@@ -263,17 +428,18 @@ unique_ptr<RxPacket> IPv6Handler::handleICMPv6Packet(
     MacAddress dst,
     MacAddress src,
     const IPv6Hdr& ipv6,
-    Cursor cursor) {
+    Cursor cursor,
+    PortStats* portStats) {
   ICMPHdr icmp6(cursor); // note: advances our cursor object
 
   // Validate the checksum, and drop the packet if it is not valid
   if (!icmp6.validateChecksum(ipv6, cursor)) {
     VLOG(3) << "bad ICMPv6 checksum";
-    sw_->portStats(pkt)->pktDropped();
+    portStats->pktDropped();
     return nullptr;
   }
 
-  ICMPHeaders hdr{dst, src, &ipv6, &icmp6};
+  ICMPHeaders hdr{dst, src, &ipv6, &icmp6, portStats};
   switch (icmp6.type) {
     case ICMPV6_TYPE_NDP_ROUTER_SOLICITATION:
       handleRouterSolicitation(std::move(pkt), hdr, cursor);
@@ -288,9 +454,9 @@ unique_ptr<RxPacket> IPv6Handler::handleICMPv6Packet(
       handleNeighborAdvertisement(std::move(pkt), hdr, cursor);
       return nullptr;
     case ICMPV6_TYPE_NDP_REDIRECT_MESSAGE:
-      sw_->portStats(pkt)->ipv6NdpPkt();
+      portStats->ipv6NdpPkt();
       // TODO: Do we need to bother handling this yet?
-      sw_->portStats(pkt)->pktDropped();
+      portStats->pktDropped();
       return nullptr;
     default:
       break;
@@ -302,19 +468,73 @@ unique_ptr<RxPacket> IPv6Handler::handleICMPv6Packet(
 void IPv6Handler::handleRouterSolicitation(unique_ptr<RxPacket> pkt,
                                            const ICMPHeaders& hdr,
                                            Cursor cursor) {
-  sw_->portStats(pkt)->ipv6NdpPkt();
+  hdr.portStats->ipv6NdpPkt();
   if (!checkNdpPacket(hdr, pkt.get())) {
     return;
   }
 
-  // TODO: process the packet
-  sw_->portStats(pkt)->pktDropped();
+  // Queue the VLAN to be answered by its route advertisers.  A burst of
+  // solicitations on one VLAN only has to queue the first one.
+  auto vlan = pkt->getSrcVlan();
+  auto solicitations = routerSolicitations_;
+  {
+    std::lock_guard<std::mutex> guard(solicitations->lock);
+    if (!solicitations->pending.insert(vlan).second) {
+      sw_->stats()->ipv6NdpRsAggregated();
+      return;
+    }
+    if (solicitations->scheduled) {
+      return;
+    }
+    solicitations->scheduled = true;
+  }
+  bool ret = sw_->getBackgroundEVB()->runInEventBaseThread([solicitations] {
+    answerRouterSolicitations(solicitations.get());
+  });
+  if (!ret) {
+    LOG(ERROR) << "failed to schedule answering router solicitations";
+    std::lock_guard<std::mutex> guard(solicitations->lock);
+    solicitations->scheduled = false;
+  }
+}
+
+void IPv6Handler::answerRouterSolicitations(
+    RouterSolicitations* solicitations) {
+  // Hold the lock throughout, so the IPv6Handler cannot be destroyed while
+  // we use it.  This runs in the background thread, like stateChanged(), so
+  // routeAdvertisers_ is safe to use.
+  std::lock_guard<std::mutex> guard(solicitations->lock);
+  std::set<VlanID> pending;
+  pending.swap(solicitations->pending);
+  solicitations->scheduled = false;
+  auto* handler = solicitations->handler;
+  if (!handler) {
+    return;
+  }
+
+  auto state = handler->sw_->getState();
+  for (auto vlan : pending) {
+    bool answered = false;
+    for (const auto& intf :
+           state->getInterfaces()->getInterfacesInVlanIf(vlan)) {
+      auto it = handler->routeAdvertisers_.find(intf->getID());
+      if (it != handler->routeAdvertisers_.end()) {
+        it->second.solicit();
+        answered = true;
+      }
+    }
+    if (!answered) {
+      VLOG(4) << "ignoring router solicitation on VLAN " << vlan
+              << ", which has no router advertisements enabled";
+      handler->sw_->stats()->ipv6NdpRsDropped();
+    }
+  }
 }
 
 void IPv6Handler::handleRouterAdvertisement(unique_ptr<RxPacket> pkt,
                                             const ICMPHeaders& hdr,
                                             Cursor cursor) {
-  sw_->portStats(pkt)->ipv6NdpPkt();
+  hdr.portStats->ipv6NdpPkt();
   if (!checkNdpPacket(hdr, pkt.get())) {
     return;
   }
@@ -322,18 +542,18 @@ void IPv6Handler::handleRouterAdvertisement(unique_ptr<RxPacket> pkt,
   if (!hdr.ipv6->srcAddr.isLinkLocal()) {
     VLOG(6) << "bad IPv6 router advertisement: source address must be "
       "link-local: " << hdr.ipv6->srcAddr;
-    sw_->portStats(pkt)->ipv6NdpBad();
+    hdr.portStats->ipv6NdpBad();
     return;
   }
 
   VLOG(3) << "dropping IPv6 router advertisement from " << hdr.ipv6->srcAddr;
-  sw_->portStats(pkt)->pktDropped();
+  hdr.portStats->pktDropped();
 }
 
 void IPv6Handler::handleNeighborSolicitation(unique_ptr<RxPacket> pkt,
                                              const ICMPHeaders& hdr,
                                              Cursor cursor) {
-  sw_->portStats(pkt)->ipv6NdpPkt();
+  hdr.portStats->ipv6NdpPkt();
   if (!checkNdpPacket(hdr, pkt.get())) {
     return;
   }
@@ -343,26 +563,23 @@ void IPv6Handler::handleNeighborSolicitation(unique_ptr<RxPacket> pkt,
   if (targetIP.isMulticast()) {
     VLOG(6) << "bad IPv6 neighbor solicitation request: target is "
       "multicast: " << targetIP;
-    sw_->portStats(pkt)->ipv6NdpBad();
+    hdr.portStats->ipv6NdpBad();
     return;
   }
   VLOG(4) << "got neighbor solicitation for " << targetIP.str();
 
-  auto state = sw_->getState();
-  auto vlan = state->getVlans()->getVlanIf(pkt->getSrcVlan());
-  if (!vlan) {
-    // Hmm, we don't actually have this VLAN configured.
-    // Perhaps the state has changed since we received the packet.
-    sw_->portStats(pkt)->pktDropped();
-    return;
-  }
-
-  // Check to see if this IP address is in our NDP response table.
-  auto entry = vlan->getNdpResponseTable()->getEntry(targetIP);
-  if (!entry) {
-    // The target IP does not refer to us.
+  // Check to see if this IP address is in our NDP response table.  This
+  // uses the advertisements cached from the last state change, so answering
+  // never has to touch the SwitchState.
+  auto reply = getResponse(pkt->getSrcVlan(), targetIP);
+  if (!reply) {
+    if (suppressNeighborSolicitation(pkt.get(), hdr, targetIP)) {
+      return;
+    }
+    // The target IP does not refer to us, or we don't actually have this
+    // VLAN configured.
     VLOG(4) << "ignoring neighbor solicitation for " << targetIP.str();
-    sw_->portStats(pkt)->pktDropped();
+    hdr.portStats->pktDropped();
     // Note that ARP updates the forward entry mapping here if necessary.
     // We could potentially do the same here, although the IPv6 NDP RFC
     // doesn't appear to recommend this--it states that we MUST silently
@@ -374,15 +591,15 @@ void IPv6Handler::handleNeighborSolicitation(unique_ptr<RxPacket> pkt,
   // whether our IP is tentative or not.
 
   // Send the response
-  sendNeighborAdvertisement(pkt->getSrcVlan(),
-                            entry.value().mac, targetIP,
-                            hdr.src, hdr.ipv6->srcAddr);
+  VLOG(3) << "sending neighbor advertisement to " << hdr.ipv6->srcAddr
+          << " (" << hdr.src << "): for " << targetIP;
+  sendNeighborAdvertisement(reply.value(), hdr.src, hdr.ipv6->srcAddr);
 }
 
 void IPv6Handler::handleNeighborAdvertisement(unique_ptr<RxPacket> pkt,
                                               const ICMPHeaders& hdr,
                                               Cursor cursor) {
-  sw_->portStats(pkt)->ipv6NdpPkt();
+  hdr.portStats->ipv6NdpPkt();
   if (!checkNdpPacket(hdr, pkt.get())) {
     return;
   }
@@ -402,7 +619,7 @@ void IPv6Handler::handleNeighborAdvertisement(unique_ptr<RxPacket> pkt,
         VLOG(3) << "bad option length " <<
           static_cast<unsigned int>(optionLength) <<
           " for target MAC address in IPv6 neighbor advertisement";
-        sw_->portStats(pkt)->pktDropped();
+        hdr.portStats->pktDropped();
         return;
       }
       targetMac = PktUtil::readMac(&cursor);
@@ -415,7 +632,7 @@ void IPv6Handler::handleNeighborAdvertisement(unique_ptr<RxPacket> pkt,
   if (targetMac.isMulticast() || targetMac.isBroadcast()) {
     VLOG(3) << "ignoring IPv6 neighbor advertisement for " << targetIP <<
       "with multicast MAC " << targetMac;
-    sw_->portStats(pkt)->pktDropped();
+    hdr.portStats->pktDropped();
     return;
   }
 
@@ -426,12 +643,37 @@ void IPv6Handler::handleNeighborAdvertisement(unique_ptr<RxPacket> pkt,
 }
 
 
+ICMPv6ErrorTemplate IPv6Handler::getICMPErrorTemplate(
+    VlanID vlan,
+    MacAddress dst,
+    MacAddress src,
+    const IPAddressV6& srcIP,
+    ICMPv6Type type,
+    ICMPv6Code code) {
+  std::lock_guard<folly::SpinLock> g(icmpTemplatesLock_);
+  auto it = icmpTemplates_.find(vlan);
+  if (it != icmpTemplates_.end() &&
+      it->second.matches(dst, src, vlan, srcIP, type, code)) {
+    return it->second;
+  }
+  ICMPv6ErrorTemplate tmpl(dst, src, vlan, srcIP, type, code);
+  icmpTemplates_[vlan] = tmpl;
+  return tmpl;
+}
+
 void IPv6Handler::sendICMPv6TimeExceeded(VlanID srcVlan,
                               MacAddress dst,
                               MacAddress src,
                               IPv6Hdr& v6Hdr,
                               folly::io::Cursor cursor) {
   auto state = sw_->getState();
+  if (!icmpErrorLimiter_.admit(state->getICMPErrorLimits(), srcVlan,
+                               folly::IPAddress(v6Hdr.srcAddr))) {
+    VLOG(4) << "not sending ICMPv6 Time Exceeded to " << v6Hdr.srcAddr
+            << ": rate limited";
+    sw_->stats()->icmpErrorLimited();
+    return;
+  }
 
   // payload serialization function
   // 4 bytes unused + ipv6 header + as much payload as possible to fit MTU
@@ -450,11 +692,14 @@ void IPv6Handler::sendICMPv6TimeExceeded(VlanID srcVlan,
   };
 
   IPAddressV6 srcIp = getSwitchVlanIPv6(state, srcVlan);
-  auto icmpPkt = createICMPv6Pkt(sw_, dst, src, srcVlan,
-                             v6Hdr.srcAddr, srcIp,
-                             ICMPV6_TYPE_TIME_EXCEEDED,
-                             ICMPV6_CODE_TIME_EXCEEDED_HOPLIMIT_EXCEEDED,
-                             bodyLength, serializeBody);
+  auto tmpl = getICMPErrorTemplate(
+      srcVlan, dst, src, srcIp,
+      ICMPV6_TYPE_TIME_EXCEEDED,
+      ICMPV6_CODE_TIME_EXCEEDED_HOPLIMIT_EXCEEDED);
+  auto icmpPkt = sw_->allocatePacket(
+      ICMPv6ErrorTemplate::computeTotalLength(bodyLength));
+  RWPrivateCursor sendCursor(icmpPkt->buf());
+  tmpl.serialize(&sendCursor, v6Hdr.srcAddr, bodyLength, serializeBody);
   VLOG(4) << "sending ICMPv6 Time Exceeded with srcMac  " << src
           << " dstMac: " << dst
           << " vlan: " << srcVlan
@@ -464,6 +709,47 @@ void IPv6Handler::sendICMPv6TimeExceeded(VlanID srcVlan,
   sw_->sendPacketSwitched(std::move(icmpPkt));
 }
 
+bool IPv6Handler::suppressNeighborSolicitation(
+    const RxPacket* pkt,
+    const ICMPHeaders& hdr,
+    const IPAddressV6& targetIP) {
+  if (!hdr.ipv6->dstAddr.isMulticast()) {
+    return false;
+  }
+  auto stateReader = sw_->readState();
+  const auto& state = stateReader.get();
+  if (!state->getNeighborSuppression()) {
+    return false;
+  }
+  auto vlan = state->getVlans()->getVlanIf(pkt->getSrcVlan());
+  if (!vlan) {
+    return false;
+  }
+
+  // Duplicate address detection, from ::, is for every host to see
+  if (!hdr.ipv6->srcAddr.isZero()) {
+    auto neighbor = vlan->getNdpTable()->getEntryIf(targetIP);
+    if (neighbor && !neighbor->isPending() && neighbor->getMac() != hdr.src) {
+      VLOG(4) << "answering neighbor solicitation on vlan " << vlan->getID()
+              << " from " << hdr.ipv6->srcAddr << " for " << targetIP
+              << " at " << neighbor->getMac();
+      sw_->stats()->neighborRequestSuppressed();
+      // As for ARP, the advertisement goes straight back out of the port
+      // the solicitation came in on.  It is sent for a host, so it does
+      // not have the router flag.
+      NeighborAdvertisementTemplate reply(neighbor->getMac(), vlan->getID(),
+                                          targetIP, false);
+      sw_->sendPacketOutOfPort(
+          createNeighborAdvertisement(reply, hdr.src, hdr.ipv6->srcAddr),
+          pkt->getSrcPort());
+      return true;
+    }
+  }
+  sw_->stats()->neighborRequestFlooded();
+  floodNeighborRequest(sw_, state, pkt);
+  return true;
+}
+
 bool IPv6Handler::checkNdpPacket(const ICMPHeaders& hdr,
                                  const RxPacket* pkt) const {
   // Validation common for all NDP packets
@@ -471,23 +757,24 @@ bool IPv6Handler::checkNdpPacket(const ICMPHeaders& hdr,
     VLOG(3) << "bad IPv6 NDP request (" << hdr.icmp6->type <<
       "): hop limit should be 255, received value is " <<
       static_cast<int>(hdr.ipv6->hopLimit);
-    sw_->portStats(pkt)->ipv6NdpBad();
+    hdr.portStats->ipv6NdpBad();
     return false;
   }
   if (hdr.icmp6->code != 0) {
     VLOG(3) << "bad IPv6 NDP request (" << hdr.icmp6->type <<
       "): code should be 0, received value is " << hdr.icmp6->code;
-    sw_->portStats(pkt)->ipv6NdpBad();
+    hdr.portStats->ipv6NdpBad();
     return false;
   }
 
   return true;
 }
 
-void IPv6Handler::sendNeighborSolicitation(
+unique_ptr<TxPacket> IPv6Handler::createNeighborSolicitation(
     const folly::IPAddressV6& targetIP,
-    const shared_ptr<Interface> intf,
-    const shared_ptr<Vlan> vlan) {
+    MacAddress dstMac,
+    const folly::IPAddressV6& dstIP,
+    const Interface* intf) {
   uint32_t bodyLength = 4 + 16 + 8;
   auto serializeBody = [&](RWPrivateCursor* cursor) {
     cursor->writeBE<uint32_t>(0); // reserved
@@ -497,15 +784,23 @@ void IPv6Handler::sendNeighborSolicitation(
     cursor->push(intf->getMac().bytes(), MacAddress::SIZE);
   };
 
-  IPAddressV6 solicitedNodeAddr = targetIP.getSolicitedNodeAddress();
-  MacAddress dstMac = MacAddress::createMulticast(solicitedNodeAddr);
   // For now, we always use our link local IP as the source.
   IPAddressV6 srcIP(IPAddressV6::LINK_LOCAL, intf->getMac());
-  auto pkt = createICMPv6Pkt(sw_, dstMac, intf->getMac(), intf->getVlanID(),
-                             solicitedNodeAddr, srcIP,
-                             ICMPV6_TYPE_NDP_NEIGHBOR_SOLICITATION,
-                             ICMPV6_CODE_NDP_MESSAGE_CODE,
-                             bodyLength, serializeBody);
+  return createICMPv6Pkt(sw_, dstMac, intf->getMac(), intf->getVlanID(),
+                         dstIP, srcIP,
+                         ICMPV6_TYPE_NDP_NEIGHBOR_SOLICITATION,
+                         ICMPV6_CODE_NDP_MESSAGE_CODE,
+                         bodyLength, serializeBody);
+}
+
+void IPv6Handler::sendNeighborSolicitation(
+    const folly::IPAddressV6& targetIP,
+    const shared_ptr<Interface> intf,
+    const shared_ptr<Vlan> vlan) {
+  IPAddressV6 solicitedNodeAddr = targetIP.getSolicitedNodeAddress();
+  MacAddress dstMac = MacAddress::createMulticast(solicitedNodeAddr);
+  auto pkt = createNeighborSolicitation(targetIP, dstMac, solicitedNodeAddr,
+                                        intf.get());
   VLOG(4) << "adding pending NDP entry for " << targetIP;
   setPendingNdpEntry(intf->getID(), vlan, targetIP);
 
@@ -515,28 +810,58 @@ void IPv6Handler::sendNeighborSolicitation(
   sw_->sendPacketSwitched(std::move(pkt));
 }
 
-void IPv6Handler::sendNeighborSolicitations(
+void IPv6Handler::sendNeighborProbe(const folly::IPAddressV6& targetIP,
+                                    MacAddress targetMac,
+                                    const shared_ptr<Interface>& intf) {
+  // Probes go straight to the cached link layer address, as in RFC 4861
+  // neighbor unreachability detection.
+  auto pkt = createNeighborSolicitation(targetIP, targetMac, targetIP,
+                                        intf.get());
+  VLOG(4) << "sending neighbor probe for " << targetIP << " to "
+          << targetMac << " on interface " << intf->getID();
+  sw_->stats()->neighborProbeTx();
+  sw_->sendPacketSwitched(std::move(pkt));
+}
+
+bool IPv6Handler::sendNeighborSolicitations(
     const folly::IPAddressV6& targetIP) {
   // Don't send solicitations for multicast or broadcast addresses.
   if (targetIP.isMulticast() || targetIP.isLinkLocalBroadcast()) {
-    return;
+    return false;
   }
 
-  auto state = sw_->getState();
+  auto stateReader = sw_->readState();
+  const auto& state = stateReader.get();
+  ResolutionCache::Result result;
+  if (resolutionCache_.lookup(*state, targetIP, &result)) {
+    VLOG(5) << "using cached resolution of " << targetIP.str();
+  } else {
+    result = resolveNeighbors(*state, targetIP);
+    resolutionCache_.record(*state, targetIP, result);
+    if (result == ResolutionCache::Result::REQUESTED) {
+      sw_->getUnresolvedPuntPolicy()->requested(folly::IPAddress(targetIP));
+    }
+  }
+  return result != ResolutionCache::Result::NO_ROUTE;
+}
 
+IPv6Handler::ResolutionCache::Result IPv6Handler::resolveNeighbors(
+    const SwitchState& state,
+    const folly::IPAddressV6& targetIP) {
   // TODO: assume vrf 0 now
-  auto routeTable = state->getRouteTables()->getRouteTableIf(RouterID(0));
+  auto routeTable = state.getRouteTables()->getRouteTableIf(RouterID(0));
   if (!routeTable) {
-    return;
+    return ResolutionCache::Result::NO_ROUTE;
   }
 
   auto route = routeTable->getRibV6()->longestMatch(targetIP);
   if (!route) {
     // No way to reach targetIP
-    return;
+    return ResolutionCache::Result::NO_ROUTE;
   }
 
-  auto intfs = state->getInterfaces();
+  auto result = ResolutionCache::Result::RESOLVED;
+  auto intfs = state.getInterfaces();
   auto nhs = route->getForwardInfo().getNexthops();
   for (auto nh : nhs) {
     auto intf = intfs->getInterfaceIf(nh.intf);
@@ -550,12 +875,13 @@ void IPv6Handler::sendNeighborSolicitations(
       }
 
       auto vlanID = intf->getVlanID();
-      auto vlan = state->getVlans()->getVlanIf(vlanID);
+      auto vlan = state.getVlans()->getVlanIf(vlanID);
       if (vlan) {
         auto entry = vlan->getNdpTable()->getEntryIf(target);
         if (entry == nullptr) {
           // No entry in NDP table, create a neighbor solicitation packet
           sendNeighborSolicitation(target, intf, vlan);
+          result = ResolutionCache::Result::REQUESTED;
         } else {
           VLOG(5) << "not sending neighbor solicitation for " << target.str()
                   << ", " << ((entry->isPending()) ? "pending" : "")
@@ -565,51 +891,52 @@ void IPv6Handler::sendNeighborSolicitations(
       }
     }
   }
+  return result;
 }
 
 void IPv6Handler::floodNeighborAdvertisements() {
+  // Build the advertisements for every interface first, so they can be
+  // handed to the hardware as a single batch.
+  std::vector<unique_ptr<TxPacket>> pkts;
   for (const auto& intf: *sw_->getState()->getInterfaces()) {
     for (const auto& addrEntry: intf->getAddresses()) {
       if (!addrEntry.first.isV6()) {
         continue;
       }
-      sendNeighborAdvertisement(intf->getVlanID(), intf->getMac(),
-          addrEntry.first.asV6(), MacAddress::BROADCAST, IPAddressV6());
+      NeighborAdvertisementTemplate reply(intf->getMac(), intf->getVlanID(),
+                                          addrEntry.first.asV6());
+      pkts.push_back(createNeighborAdvertisement(reply, MacAddress::BROADCAST,
+                                                 IPAddressV6()));
     }
   }
+  sw_->sendPacketsSwitched(std::move(pkts));
 }
 
-void IPv6Handler::sendNeighborAdvertisement(VlanID vlan,
-                                            MacAddress srcMac,
-                                            IPAddressV6 srcIP,
-                                            MacAddress dstMac,
-                                            IPAddressV6 dstIP) {
-  VLOG(3) << "sending neighbor advertisement to " << dstIP.str()
-    << " (" << dstMac << "): for " <<  srcIP << " (" << srcMac << ")";
-
-  uint32_t flags = 0xa0000000; // router, override
-  if (dstIP.isZero()) {
-    // TODO: add a constructor that doesn't require string processing
-    dstIP = IPAddressV6("ff01::1");
-  } else {
-    // Set the solicited flag
-    flags |= 0x40000000;
-  }
+void IPv6Handler::sendUnsolicitedNeighborAdvertisement(
+    const shared_ptr<Interface>& intf,
+    const IPAddressV6& addr) {
+  VLOG(3) << "sending unsolicited neighbor advertisement for " << addr
+          << " (" << intf->getMac() << ")";
+  NeighborAdvertisementTemplate reply(intf->getMac(), intf->getVlanID(),
+                                      addr);
+  sendNeighborAdvertisement(reply, MacAddress::BROADCAST, IPAddressV6());
+}
 
-  uint32_t bodyLength = 4 + 16 + 8;
-  auto serializeBody = [&](RWPrivateCursor* cursor) {
-    cursor->writeBE<uint32_t>(flags);
-    cursor->push(srcIP.bytes(), IPAddressV6::byteCount());
-    cursor->write<uint8_t>(NDPOptionType::TARGET_LL_ADDRESS);
-    cursor->write<uint8_t>(NDPOptionLength::TARGET_LL_ADDRESS_IEEE802);
-    cursor->push(srcMac.bytes(), MacAddress::SIZE);
-  };
+void IPv6Handler::sendNeighborAdvertisement(
+    const NeighborAdvertisementTemplate& reply,
+    MacAddress dstMac,
+    const IPAddressV6& dstIP) {
+  sw_->sendPacketSwitched(createNeighborAdvertisement(reply, dstMac, dstIP));
+}
 
-  auto pkt = createICMPv6Pkt(sw_, dstMac, srcMac, vlan, dstIP, srcIP,
-                             ICMPV6_TYPE_NDP_NEIGHBOR_ADVERTISEMENT,
-                             ICMPV6_CODE_NDP_MESSAGE_CODE,
-                             bodyLength, serializeBody);
-  sw_->sendPacketSwitched(std::move(pkt));
+unique_ptr<TxPacket> IPv6Handler::createNeighborAdvertisement(
+    const NeighborAdvertisementTemplate& reply,
+    MacAddress dstMac,
+    const IPAddressV6& dstIP) {
+  auto pkt = sw_->allocatePacket(NeighborAdvertisementTemplate::SIZE);
+  RWPrivateCursor cursor(pkt->buf());
+  reply.serialize(&cursor, dstMac, dstIP);
+  return pkt;
 }
 
 void IPv6Handler::setPendingNdpEntry(InterfaceID intfID,
@@ -654,6 +981,13 @@ void IPv6Handler::setPendingNdpEntry(InterfaceID intfID,
     auto entry = ndpTable->getNodeIf(ip);
     if (!entry) {
       // only set a pending entry when we have no entry
+      NeighborLimits limits(state.get());
+      if (!limits.tryAdd(vlanID)) {
+        VLOG(4) << "neighbor limit reached, not adding pending ndp entry for "
+                << ip.str();
+        sw_->stats()->neighborLearnRejected(1);
+        return nullptr;
+      }
       ndpTable = ndpTable->modify(&vlan, &newState);
       ndpTable->addPendingEntry(ip, intfID);
     }
@@ -662,7 +996,13 @@ void IPv6Handler::setPendingNdpEntry(InterfaceID intfID,
     return newState;
   };
 
-  sw_->updateState("add pending ndp entry", updateFn);
+  // This only depends on the state it is given, so a run of these for
+  // different addresses can change the NDP table in place
+  auto update = folly::make_unique<FunctionStateUpdate>(
+      "add pending ndp entry", std::move(updateFn),
+      StateUpdatePriority::NEIGHBOR);
+  update->setComposable(true);
+  sw_->updateState(std::move(update));
 }
 
 
@@ -674,7 +1014,8 @@ void IPv6Handler::updateNeighborEntry(const RxPacket* pkt,
   VlanID vlanID = pkt->getSrcVlan();
 
   // Look up the Vlan state
-  auto state = sw_->getState();
+  auto stateReader = sw_->readState();
+  const auto& state = stateReader.get();
   auto vlan = state->getVlans()->getVlanIf(vlanID);
   if (!vlan) {
     // Hmm, we don't actually have this VLAN configured.
@@ -729,49 +1070,23 @@ void IPv6Handler::updateNeighborEntry(const RxPacket* pkt,
     return;
   }
 
-  // We do have to update the entry now.
-  auto updateFn = [vlanID, port, intfID, ip, mac]
-                  (const shared_ptr<SwitchState>& state) {
-    // The state has changed, we need to
-    // Re-validate vlan and entry, in case the state has changed
-    auto* vlan = state->getVlans()->getVlanIf(vlanID).get();
-    if (!vlan) {
-      // This VLAN no longer exists.  Just ignore the entry update.
-      VLOG(3) << "VLAN " << vlanID << " deleted before NDP entry " <<
-        ip << " --> " << mac << " could be updated";
-      return shared_ptr<SwitchState>();
-    }
-
-    // In case the interface subnets have changed, make sure the IP address
-    // is still on a locally attached subnet
-    if (!Interface::isIpAttached(ip, intfID, state)) {
-      VLOG(3) << "interface subnets changed before NDP entry " <<
-        ip << " --> " << mac << " could be updated";
-      return shared_ptr<SwitchState>();
-    }
-
-    shared_ptr<SwitchState> newState{state};
-    auto* ndpTable = vlan->getNdpTable().get();
-    auto entry = ndpTable->getNodeIf(ip);
-
-    if (!entry) {
-      ndpTable = ndpTable->modify(&vlan, &newState);
-      ndpTable->addEntry(ip, mac, port, intfID);
-    } else {
-      if (entry->getMac() == mac &&
-          entry->getPort() == port &&
-          entry->getIntfID() == intfID) {
-        // This entry was already updated while we were waiting on the lock.
-        return shared_ptr<SwitchState>();
-      }
-      ndpTable = ndpTable->modify(&vlan, &newState);
-      ndpTable->updateEntry(ip, mac, port, intfID);
-    }
-    VLOG(3) << "Adding NDP entry for " << ip.str() << " --> " << mac;
-    return newState;
-  };
-
-  sw_->updateState("add IPv6 neighbor", updateFn);
+  // We do have to update the entry now.  Queue the update, and schedule a
+  // state update to apply it unless one is already pending.
+  auto updates = neighborUpdates_;
+  auto* sw = sw_;
+  if (!updates->add(vlanID, ip, {port, intfID, mac, true})) {
+    return;
+  }
+  sw_->updateState("add IPv6 neighbors",
+                   [updates, sw](const shared_ptr<SwitchState>& state) {
+                     uint64_t rejected = 0;
+                     auto newState = updates->applyUpdates(state, &rejected);
+                     if (rejected > 0) {
+                       sw->stats()->neighborLearnRejected(rejected);
+                     }
+                     return newState;
+                   },
+                   StateUpdatePriority::NEIGHBOR);
 }
 
 }} // facebook::fboss
@@ -9,13 +9,21 @@
  */
 #pragma once
 
+#include "fboss/agent/ICMPErrorLimiter.h"
+#include "fboss/agent/NeighborResolutionCache.h"
+#include "fboss/agent/NeighborUpdateQueue.h"
+#include "fboss/agent/StateObserver.h"
 #include "fboss/agent/types.h"
+#include "fboss/agent/packet/ICMPErrorTemplate.h"
+#include "fboss/agent/packet/NeighborReplyTemplate.h"
 #include "fboss/agent/ndp/IPv6RouteAdvertiser.h"
 
 #include <memory>
 #include <boost/container/flat_map.hpp>
 #include <folly/IPAddressV6.h>
 #include <folly/MacAddress.h>
+#include <folly/Optional.h>
+#include <folly/SpinLock.h>
 namespace folly { namespace io {
 class Cursor;
 }}
@@ -24,46 +32,112 @@ namespace facebook { namespace fboss {
 
 class IPv6Hdr;
 class Interface;
+class NdpResponseTable;
+class NdpTable;
+class PortStats;
 class RxPacket;
 class StateDelta;
 class SwSwitch;
 class SwitchState;
+class TxPacket;
 class Vlan;
 
-class IPv6Handler {
+class IPv6Handler : public StateObserver {
  public:
   enum : uint16_t { ETHERTYPE_IPV6 = 0x86dd };
   enum : uint32_t { IPV6_MIN_MTU = 1280 };
 
   explicit IPv6Handler(SwSwitch* sw);
+  ~IPv6Handler() override;
 
-  void stateChanged(const StateDelta& delta);
+  void stateChanged(const StateDelta& delta) override;
 
   void handlePacket(std::unique_ptr<RxPacket> pkt,
                     folly::MacAddress dst,
                     folly::MacAddress src,
-                    folly::io::Cursor cursor);
+                    folly::io::Cursor cursor,
+                    PortStats* portStats);
 
   uint32_t flushNdpEntryBlocking(folly::IPAddressV6, VlanID vlan);
+  /*
+   * Remove the NDP entry for ip on the VLAN, or on every VLAN if it is 0,
+   * from *state, for flushing several neighbors in one state update.
+   * Returns the number of entries removed.
+   */
+  uint32_t flushNdpEntry(std::shared_ptr<SwitchState>* state,
+                         folly::IPAddressV6 ip, VlanID vlan);
   void floodNeighborAdvertisements();
 
+  /*
+   * Send an unsolicited neighbor advertisement to all nodes, announcing one
+   * of the interface's addresses.
+   */
+  void sendUnsolicitedNeighborAdvertisement(
+      const std::shared_ptr<Interface>& intf,
+      const folly::IPAddressV6& addr);
+
+  /*
+   * Send a unicast neighbor solicitation to refresh an existing entry.
+   * Unlike the multicast solicitations we send for unresolved addresses,
+   * this never adds a pending entry.
+   */
+  void sendNeighborProbe(const folly::IPAddressV6& targetIP,
+                         folly::MacAddress targetMac,
+                         const std::shared_ptr<Interface>& intf);
+
+  /*
+   * Send a multicast neighbor solicitation for an unresolved address, and
+   * add a pending entry for it.
+   */
+  void sendNeighborSolicitation(const folly::IPAddressV6& targetIP,
+                                const std::shared_ptr<Interface> intf,
+                                const std::shared_ptr<Vlan> vlan);
+
  private:
   struct ICMPHeaders;
+  struct RouterSolicitations;
   typedef boost::container::flat_map<InterfaceID, IPv6RouteAdvertiser> RAMap;
+  /*
+   * The advertisements for our addresses on one VLAN, built from its NDP
+   * response table.
+   */
+  struct VlanResponses {
+    std::shared_ptr<NdpResponseTable> table;
+    boost::container::flat_map<folly::IPAddressV6,
+                               NeighborAdvertisementTemplate> replies;
+  };
+  typedef boost::container::flat_map<VlanID,
+                                     std::shared_ptr<const VlanResponses>>
+    ResponseTables;
 
   // Forbidden copy constructor and assignment operator
   IPv6Handler(IPv6Handler const &) = delete;
   IPv6Handler& operator=(IPv6Handler const &) = delete;
 
   bool raEnabled(const Interface* intf) const;
+  void updateResponseTables(const StateDelta& delta);
+  static std::shared_ptr<const VlanResponses> buildVlanResponses(
+      VlanID vlan, const std::shared_ptr<NdpResponseTable>& table);
+  folly::Optional<NeighborAdvertisementTemplate> getResponse(
+      VlanID vlan, const folly::IPAddressV6& ip) const;
   void intfAdded(const SwitchState* state, const Interface* intf);
   void intfDeleted(const Interface* intf);
+  static void answerRouterSolicitations(RouterSolicitations* solicitations);
+  void intfChanged(const SwitchState* state, const Interface* oldIntf,
+                   const Interface* newIntf);
+  void vlanMtuChanged(const SwitchState* state, VlanID vlan);
 
   void sendICMPv6TimeExceeded(VlanID srcVlan,
                               folly::MacAddress dst,
                               folly::MacAddress src,
                               IPv6Hdr& v6Hdr,
                               folly::io::Cursor cursor);
+  ICMPv6ErrorTemplate getICMPErrorTemplate(VlanID vlan,
+                                           folly::MacAddress dst,
+                                           folly::MacAddress src,
+                                           const folly::IPAddressV6& srcIP,
+                                           ICMPv6Type type,
+                                           ICMPv6Code code);
   /**
    * Function to handle ICMPv6
    *
@@ -80,7 +154,8 @@ class IPv6Handler {
                                                folly::MacAddress dst,
                                                folly::MacAddress src,
                                                const IPv6Hdr& ipv6,
-                                               folly::io::Cursor cursor);
+                                               folly::io::Cursor cursor,
+                                               PortStats* portStats);
   void handleRouterSolicitation(std::unique_ptr<RxPacket> pkt,
                                 const ICMPHeaders& hdr,
                                 folly::io::Cursor cursor);
@@ -96,16 +171,39 @@ class IPv6Handler {
 
   bool checkNdpPacket(const ICMPHeaders& hdr,
                       const RxPacket* pkt) const;
+  /*
+   * With neighbor suppression, answer a multicast solicitation the hardware
+   * punted for an address that is not ours on behalf of the host, if the
+   * host is in the VLAN's NDP table, or flood it otherwise.  Returns false
+   * if the solicitation was not punted, and is left alone.
+   */
+  bool suppressNeighborSolicitation(const RxPacket* pkt,
+                                    const ICMPHeaders& hdr,
+                                    const folly::IPAddressV6& targetIP);
 
-  void sendNeighborSolicitations(const folly::IPAddressV6& targetIP);
-  void sendNeighborSolicitation(const folly::IPAddressV6& targetIP,
-                                const std::shared_ptr<Interface> intf,
-                                const std::shared_ptr<Vlan> vlan);
-  void sendNeighborAdvertisement(VlanID vlan,
-                                 folly::MacAddress srcMac,
-                                 folly::IPAddressV6 srcIP,
-                                 folly::MacAddress dstMac,
-                                 folly::IPAddressV6 dstIP);
+  typedef NeighborResolutionCache<folly::IPAddressV6> ResolutionCache;
+
+  /*
+   * Solicit the next hops of targetIP that have no NDP entry yet.  Returns
+   * false if there is no route to targetIP.
+   */
+  bool sendNeighborSolicitations(const folly::IPAddressV6& targetIP);
+  ResolutionCache::Result resolveNeighbors(
+      const SwitchState& state,
+      const folly::IPAddressV6& targetIP);
+  std::unique_ptr<TxPacket> createNeighborSolicitation(
+      const folly::IPAddressV6& targetIP,
+      folly::MacAddress dstMac,
+      const folly::IPAddressV6& dstIP,
+      const Interface* intf);
+  void sendNeighborAdvertisement(
+      const NeighborAdvertisementTemplate& reply,
+      folly::MacAddress dstMac,
+      const folly::IPAddressV6& dstIP);
+  std::unique_ptr<TxPacket> createNeighborAdvertisement(
+      const NeighborAdvertisementTemplate& reply,
+      folly::MacAddress dstMac,
+      const folly::IPAddressV6& dstIP);
   void updateNeighborEntry(const RxPacket* pkt,
                            folly::IPAddressV6 ip,
                            folly::MacAddress mac,
@@ -124,6 +222,52 @@ class IPv6Handler {
 
   SwSwitch* sw_{nullptr};
   RAMap routeAdvertisers_;
+
+  ICMPErrorLimiter icmpErrorLimiter_;
+  /*
+   * The headers of the ICMPv6 errors last sent from each VLAN.  A template
+   * is rebuilt whenever the addresses of its VLAN change.
+   */
+  boost::container::flat_map<VlanID, ICMPv6ErrorTemplate> icmpTemplates_;
+  folly::SpinLock icmpTemplatesLock_;
+
+  /*
+   * The advertisements for our addresses on every VLAN, so that neighbor
+   * solicitations for them can be answered without looking up the
+   * SwitchState or serializing the advertisement field by field.  This is
+   * replaced in stateChanged() whenever a response table changes, and is
+   * null until the first state change is delivered.
+   */
+  std::shared_ptr<const ResponseTables> responseTables_;
+  mutable folly::SpinLock responseTablesLock_;
+
+  /*
+   * How recently punted destinations were resolved, so that a burst of
+   * packets to an unresolved destination does not repeat the route and NDP
+   * table lookups, or the solicitations, for every packet.
+   */
+  ResolutionCache resolutionCache_;
+
+  /*
+   * Neighbors learned from advertisements that have not been added to the
+   * SwitchState yet.  All the neighbors queued before the update thread
+   * gets to them are added by a single state update, so a burst of
+   * advertisements does not clone the NDP table once per packet.
+   *
+   * This is shared with the scheduled update, which may run after the
+   * IPv6Handler has been destroyed.
+   */
+  std::shared_ptr<NeighborUpdateQueue<NdpTable>> neighborUpdates_;
+
+  /*
+   * VLANs with router solicitations waiting to be answered.  Solicitations
+   * are answered in the background thread, where the route advertisers
+   * live, and a burst of them on one VLAN is passed on only once.
+   *
+   * Like neighborUpdates_, this is shared with the scheduled work, which
+   * may run after the IPv6Handler has been destroyed.
+   */
+  std::shared_ptr<RouterSolicitations> routerSolicitations_;
 };
 
 }} // facebook::fboss
@@ -0,0 +1,164 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/KernelRouteMirror.h"
+
+#include "fboss/agent/state/DeltaFunctions.h"
+#include "fboss/agent/state/RouteDelta.h"
+#include "fboss/agent/state/RouteTableMap.h"
+
+using std::shared_ptr;
+
+namespace facebook { namespace fboss {
+
+void KernelRouteMirror::applyDelta(const RouteTableMap* oldTables,
+                                   const RouteTableMap* newTables) {
+  for (const auto& tableDelta : RTMapDelta(oldTables, newTables)) {
+    auto rid = tableDelta.getOld() ? tableDelta.getOld()->getID() :
+      tableDelta.getNew()->getID();
+    auto* fib = &fibs_[rid];
+    applyRoutesDelta<RouteV4>(rid, fib, tableDelta.getRoutesV4Delta());
+    applyRoutesDelta<RouteV6>(rid, fib, tableDelta.getRoutesV6Delta());
+    if (!tableDelta.getNew()) {
+      fibs_.erase(rid);
+    }
+  }
+}
+
+template<typename RouteT, typename DeltaT>
+void KernelRouteMirror::applyRoutesDelta(RouterID rid, CompressedFib* fib,
+                                         const DeltaT& delta) {
+  // As in the hardware, only resolved routes are mirrored
+  typename FibCompressor<RouteT>::Changes changes;
+  DeltaFunctions::forEachChanged(
+      delta,
+      [&](const shared_ptr<RouteT>& oldRoute,
+          const shared_ptr<RouteT>& newRoute) {
+        if (newRoute->isResolved()) {
+          fib->get(newRoute.get())->update(newRoute, &changes);
+        } else if (oldRoute->isResolved()) {
+          fib->get(oldRoute.get())->remove(oldRoute->prefix(), &changes);
+        }
+      },
+      [&](const shared_ptr<RouteT>& newRoute) {
+        if (newRoute->isResolved()) {
+          fib->get(newRoute.get())->update(newRoute, &changes);
+        }
+      },
+      [&](const shared_ptr<RouteT>& oldRoute) {
+        if (oldRoute->isResolved()) {
+          fib->get(oldRoute.get())->remove(oldRoute->prefix(), &changes);
+        }
+      });
+  queueChanges<RouteT>(rid, changes);
+}
+
+template<typename RouteT>
+void KernelRouteMirror::queueChanges(
+    RouterID rid, const typename FibCompressor<RouteT>::Changes& changes) {
+  for (const auto& change : changes) {
+    const auto& prefix = change.route->prefix();
+    RouteKey key(rid, folly::CIDRNetwork(prefix.network, prefix.mask));
+    auto type = change.route->isDrop() ? RouteType::BLACKHOLE :
+      RouteType::UNICAST;
+    queue(key, type, change.add);
+  }
+}
+
+void KernelRouteMirror::queue(const RouteKey& key, RouteType type, bool add) {
+  auto ret = pending_.emplace(key, Update(key, type, add));
+  if (ret.second) {
+    order_.push_back(key);
+  } else {
+    // Keep the place of the earlier change, with the latest value
+    ret.first->second = Update(key, type, add);
+  }
+}
+
+std::vector<KernelRouteMirror::Update> KernelRouteMirror::takeUpdates(
+    size_t max) {
+  std::vector<Update> updates;
+  while (updates.size() < max && !order_.empty()) {
+    auto iter = pending_.find(order_.front());
+    order_.pop_front();
+    auto update = iter->second;
+    pending_.erase(iter);
+
+    auto installed = installed_.find(update.key);
+    if (update.add) {
+      if (installed != installed_.end() && installed->second == update.type) {
+        continue;
+      }
+      installed_[update.key] = update.type;
+    } else {
+      if (installed == installed_.end()) {
+        continue;
+      }
+      // Delete the route as it is in the kernel
+      update.type = installed->second;
+      installed_.erase(installed);
+    }
+    updates.push_back(update);
+  }
+  return updates;
+}
+
+uint32_t KernelRouteMirror::reconcile(const Routes& kernelRoutes) {
+  // The kernel is the truth from now on, and whatever it lacks, or has
+  // extra, is queued to be changed back to what the mirror expected.
+  // Routes with a change still queued are left to that change.
+  Routes expected;
+  expected.swap(installed_);
+  installed_ = kernelRoutes;
+  uint32_t mismatches = 0;
+  auto exp = expected.begin();
+  auto found = kernelRoutes.begin();
+  while (exp != expected.end() || found != kernelRoutes.end()) {
+    if (found == kernelRoutes.end() ||
+        (exp != expected.end() && exp->first < found->first)) {
+      if (pending_.count(exp->first) == 0) {
+        queue(exp->first, exp->second, true);
+        ++mismatches;
+      }
+      ++exp;
+    } else if (exp == expected.end() || found->first < exp->first) {
+      if (pending_.count(found->first) == 0) {
+        queue(found->first, found->second, false);
+        ++mismatches;
+      }
+      ++found;
+    } else {
+      if (exp->second != found->second && pending_.count(exp->first) == 0) {
+        queue(exp->first, exp->second, true);
+        ++mismatches;
+      }
+      ++exp;
+      ++found;
+    }
+  }
+  return mismatches;
+}
+
+size_t KernelRouteMirror::getRibSize() const {
+  size_t size = 0;
+  for (const auto& entry : fibs_) {
+    size += entry.second.v4.getRibSize() + entry.second.v6.getRibSize();
+  }
+  return size;
+}
+
+size_t KernelRouteMirror::getFibSize() const {
+  size_t size = 0;
+  for (const auto& entry : fibs_) {
+    size += entry.second.v4.getFibSize() + entry.second.v6.getFibSize();
+  }
+  return size;
+}
+
+}} // facebook::fboss
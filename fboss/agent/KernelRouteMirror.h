@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/FibCompressor.h"
+#include "fboss/agent/types.h"
+#include "fboss/agent/state/Route.h"
+
+#include <folly/IPAddress.h>
+
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class RouteTableMap;
+
+/*
+ * KernelRouteMirror works out the routes to mirror into the kernel, so that
+ * traffic the host originates follows the FIB rather than the management
+ * interface's default route.
+ *
+ * Every route the host needs goes out through the TUN interface of its
+ * router, where the switch routes it again, so the kernel only needs to
+ * know which prefixes to send there and which to drop.  The mirror holds a
+ * compressed copy of each router's resolved routes: routes that forward the
+ * same way as their covering route are left out, as FibCompressor decides
+ * for the hardware.
+ *
+ * The mirror is updated from the route table deltas of state updates, and
+ * queues the kernel changes that follow.  The queue is coalesced by route,
+ * so a route that changes again before its change is sent is only sent
+ * once, with its latest value.  The caller takes changes from the queue as
+ * fast as it is willing to program them.
+ *
+ * This class does not talk to the kernel itself, and is not thread safe.
+ * TunManager drives it from its event base.
+ */
+class KernelRouteMirror {
+ public:
+  enum class RouteType : uint8_t {
+    // Send the traffic to the router's TUN interface
+    UNICAST,
+    // Drop the traffic
+    BLACKHOLE,
+  };
+  typedef std::pair<RouterID, folly::CIDRNetwork> RouteKey;
+  // The routes in the kernel, or that should be there
+  typedef std::map<RouteKey, RouteType> Routes;
+
+  struct Update {
+    Update(const RouteKey& key, RouteType type, bool add)
+      : key(key), type(type), add(add) {}
+    RouteKey key;
+    RouteType type;
+    // Whether to add or replace the route, rather than delete it
+    bool add;
+  };
+
+  KernelRouteMirror() {}
+
+  /*
+   * Queue the kernel changes needed to go from the routes in oldTables to
+   * those in newTables.  oldTables must be the tables passed as newTables
+   * the previous time, and either may be null for no routes.
+   */
+  void applyDelta(const RouteTableMap* oldTables,
+                  const RouteTableMap* newTables);
+
+  /*
+   * Take up to 'max' changes from the queue, oldest first.  The routes
+   * they add or remove are assumed to be in the kernel from now on.
+   * Queued changes that turn out to be no-ops are dropped without counting
+   * against 'max'.
+   */
+  std::vector<Update> takeUpdates(size_t max);
+
+  size_t numPending() const {
+    return pending_.size();
+  }
+
+  /*
+   * The routes the mirror believes to be in the kernel
+   */
+  const Routes& getInstalled() const {
+    return installed_;
+  }
+
+  /*
+   * Check the mirror against the routes actually found in the kernel.
+   * Every route that differs, other than those with changes still queued,
+   * has a change queued to repair it.  Returns the number of such routes.
+   */
+  uint32_t reconcile(const Routes& kernelRoutes);
+
+  /*
+   * The number of resolved routes of all routers, and how many of them the
+   * kernel needs after compression.
+   */
+  size_t getRibSize() const;
+  size_t getFibSize() const;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  KernelRouteMirror(KernelRouteMirror const &) = delete;
+  KernelRouteMirror& operator=(KernelRouteMirror const &) = delete;
+
+  struct CompressedFib {
+    FibCompressor<RouteV4> v4;
+    FibCompressor<RouteV6> v6;
+    FibCompressor<RouteV4>* get(const RouteV4*) {
+      return &v4;
+    }
+    FibCompressor<RouteV6>* get(const RouteV6*) {
+      return &v6;
+    }
+  };
+
+  template<typename RouteT, typename DeltaT>
+  void applyRoutesDelta(RouterID rid, CompressedFib* fib,
+                        const DeltaT& delta);
+  template<typename RouteT>
+  void queueChanges(RouterID rid,
+                    const typename FibCompressor<RouteT>::Changes& changes);
+  void queue(const RouteKey& key, RouteType type, bool add);
+
+  std::map<RouterID, CompressedFib> fibs_;
+  // The latest queued change of each route, and the order they were
+  // first queued in
+  std::map<RouteKey, Update> pending_;
+  std::deque<RouteKey> order_;
+  Routes installed_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,164 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/L2LearningQueue.h"
+
+#include "fboss/agent/state/MacTable.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <algorithm>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DEFINE_int32(l2_learn_rate, 5000,
+             "The L2 learn and age events per second applied to the MAC "
+             "tables.  Events beyond the rate are dropped.  0 disables the "
+             "limit");
+DEFINE_int32(l2_learn_burst, 20000,
+             "The most L2 learn and age events accepted in a single burst");
+DEFINE_int32(l2_learn_max_pending, 50000,
+             "The most MACs with L2 learn or age events waiting to be "
+             "applied to the MAC tables.  0 disables the limit");
+DEFINE_int32(l2_max_macs_per_vlan, 16384,
+             "The most MACs in the MAC table of a VLAN.  0 disables the "
+             "limit");
+
+using std::shared_ptr;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+L2LearningQueue::Config getConfigFromFlags() {
+  L2LearningQueue::Config config;
+  config.rate = std::max(FLAGS_l2_learn_rate, 0);
+  config.burst = std::max(FLAGS_l2_learn_burst, 1);
+  config.maxPending = std::max(FLAGS_l2_learn_max_pending, 0);
+  config.maxMacsPerVlan = std::max(FLAGS_l2_max_macs_per_vlan, 0);
+  return config;
+}
+
+} // unnamed namespace
+
+L2LearningQueue::L2LearningQueue() : L2LearningQueue(getConfigFromFlags()) {
+}
+
+L2LearningQueue::L2LearningQueue(const Config& config)
+  : config_(config),
+    tokens_(config.burst) {
+}
+
+bool L2LearningQueue::takeToken(TimePoint now) {
+  if (config_.rate == 0) {
+    return true;
+  }
+  if (lastRefill_ != TimePoint()) {
+    std::chrono::duration<double> elapsed = now - lastRefill_;
+    tokens_ = std::min<double>(config_.burst,
+                               tokens_ + elapsed.count() * config_.rate);
+  }
+  lastRefill_ = now;
+  if (tokens_ < 1) {
+    return false;
+  }
+  tokens_ -= 1;
+  return true;
+}
+
+bool L2LearningQueue::add(VlanID vlan, folly::MacAddress mac, PortID port,
+                          L2EntryUpdateType type, TimePoint now) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!takeToken(now)) {
+      ++dropped_;
+      return false;
+    }
+    auto key = std::make_pair(vlan, mac);
+    auto it = pending_.find(key);
+    if (it != pending_.end()) {
+      it->second = Update{port, type};
+    } else if (config_.maxPending == 0 ||
+               pending_.size() < config_.maxPending) {
+      pending_.emplace(key, Update{port, type});
+    } else {
+      ++dropped_;
+      return false;
+    }
+  }
+  // The event is queued before this, and applyUpdates() clears the flag
+  // before taking the events, so the event is either picked up by the
+  // scheduled state update or we schedule a new one.
+  return !scheduled_.exchange(true);
+}
+
+shared_ptr<SwitchState> L2LearningQueue::applyUpdates(
+    const shared_ptr<SwitchState>& state, uint64_t* numRejected) {
+  scheduled_.store(false);
+  Pending pending;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    pending.swap(pending_);
+  }
+
+  shared_ptr<SwitchState> newState{state};
+  uint64_t rejected = 0;
+  bool changed = false;
+  // The events are sorted by VLAN, so each VLAN is looked up once, and the
+  // VLAN and table are only cloned by the first event that changes them.
+  VlanID vlanID(0);
+  Vlan* vlan = nullptr;
+  MacTable* table = nullptr;
+  bool first = true;
+  for (const auto& entry : pending) {
+    if (first || entry.first.first != vlanID) {
+      first = false;
+      vlanID = entry.first.first;
+      vlan = newState->getVlans()->getVlanIf(vlanID).get();
+      table = vlan ? vlan->getMacTable().get() : nullptr;
+    }
+    if (!vlan) {
+      VLOG(3) << "VLAN " << vlanID << " deleted before the L2 event for "
+              << entry.first.second << " could be applied";
+      continue;
+    }
+    const auto& mac = entry.first.second;
+    const auto& update = entry.second;
+    auto existing = table->getEntryIf(mac);
+    if (update.type == L2EntryUpdateType::AGED) {
+      if (!existing) {
+        continue;
+      }
+      table = table->modify(&vlan, &newState);
+      table->removeEntry(mac);
+      VLOG(4) << "Aged " << mac << " on VLAN " << vlanID;
+    } else {
+      if (existing && existing->port == update.port) {
+        continue;
+      }
+      if (!existing && config_.maxMacsPerVlan != 0 &&
+          table->size() >= config_.maxMacsPerVlan) {
+        ++rejected;
+        continue;
+      }
+      table = table->modify(&vlan, &newState);
+      table->setEntry(mac, update.port);
+      VLOG(4) << "Learned " << mac << " on port " << update.port
+              << " of VLAN " << vlanID;
+    }
+    changed = true;
+  }
+  if (numRejected) {
+    *numRejected = rejected;
+  }
+  return changed ? newState : nullptr;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/types.h"
+
+#include <folly/MacAddress.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+
+/*
+ * L2LearningQueue holds the L2 learn and age events the HW reported until
+ * the update thread applies them to the MAC tables of the VLANs.
+ *
+ * The SDK reports each event from its own thread, which must not wait for
+ * a state update, so add() only queues the event.  Only the latest event
+ * for each MAC is kept, so a MAC that moves back and forth, or is learned
+ * and aged again, only changes the state once per batch, and a batch clones
+ * each VLAN and MAC table once however many events it has.
+ *
+ * A MAC flood makes the HW report far more events than the state can take,
+ * so the events are limited three ways:
+ *  - events beyond a token bucket rate are dropped as they arrive
+ *  - events for new MACs are dropped while maxPending MACs are queued
+ *  - learned MACs are not added to a VLAN that has maxMacsPerVlan of them
+ * The MAC tables are only a view of the HW, which keeps learning and
+ * forwarding meanwhile, so the cost of a drop is a missing or stale entry
+ * until the MAC is learned or aged again.
+ */
+class L2LearningQueue {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Config {
+    // Events per second.  0 means unlimited.
+    uint32_t rate{0};
+    // The most events accepted in a single burst
+    uint32_t burst{0};
+    // The most MACs with queued events.  0 means unlimited.
+    size_t maxPending{0};
+    // The most MACs in the table of a VLAN.  0 means unlimited.
+    size_t maxMacsPerVlan{0};
+  };
+
+  /*
+   * Create a queue configured by the --l2_learn_* flags.
+   */
+  L2LearningQueue();
+  explicit L2LearningQueue(const Config& config);
+
+  /*
+   * Queue an event.
+   *
+   * Returns true if the caller has to schedule a state update that calls
+   * applyUpdates(), because none is scheduled yet.
+   */
+  bool add(VlanID vlan, folly::MacAddress mac, PortID port,
+           L2EntryUpdateType type) {
+    return add(vlan, mac, port, type, std::chrono::steady_clock::now());
+  }
+  bool add(VlanID vlan, folly::MacAddress mac, PortID port,
+           L2EntryUpdateType type, TimePoint now);
+
+  /*
+   * Apply all of the queued events to the state.  Learned MACs beyond the
+   * VLAN limit are left out, and counted in *numRejected.
+   *
+   * Returns the new state, or null if none of the events changed it.
+   */
+  std::shared_ptr<SwitchState> applyUpdates(
+      const std::shared_ptr<SwitchState>& state,
+      uint64_t* numRejected = nullptr);
+
+  /*
+   * The number of events dropped by add() since the last call.
+   */
+  uint64_t getAndClearDropped() {
+    return dropped_.exchange(0);
+  }
+
+ private:
+  struct Update {
+    PortID port;
+    L2EntryUpdateType type;
+  };
+  typedef std::map<std::pair<VlanID, folly::MacAddress>, Update> Pending;
+
+  // Forbidden copy constructor and assignment operator
+  L2LearningQueue(L2LearningQueue const &) = delete;
+  L2LearningQueue& operator=(L2LearningQueue const &) = delete;
+
+  // Take a token from the bucket, if there is one.  Called with lock_ held.
+  bool takeToken(TimePoint now);
+
+  const Config config_;
+  std::mutex lock_;
+  Pending pending_;
+  double tokens_{0};
+  TimePoint lastRefill_;
+  std::atomic<uint64_t> dropped_{0};
+  // Set while a state update to apply the events is scheduled
+  std::atomic<bool> scheduled_{false};
+};
+
+}} // facebook::fboss
@@ -0,0 +1,331 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/LacpManager.h"
+
+#include "fboss/agent/Platform.h"
+#include "fboss/agent/PortStats.h"
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
+#include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/futures/Future.h>
+#include <glog/logging.h>
+
+using folly::ByteRange;
+using folly::MacAddress;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+using std::chrono::steady_clock;
+using std::shared_ptr;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+enum : uint8_t {
+  kActorInfoTlv = 1,
+  kPartnerInfoTlv = 2,
+  kCollectorInfoTlv = 3,
+  kTerminatorTlv = 0,
+  kInfoTlvLength = 20,
+  kCollectorInfoTlvLength = 16,
+};
+
+void writeInfo(uint8_t type, const LacpManager::Info& info,
+               RWPrivateCursor* cursor) {
+  cursor->write<uint8_t>(type);
+  cursor->write<uint8_t>(kInfoTlvLength);
+  cursor->writeBE<uint16_t>(info.systemPriority);
+  cursor->push(info.system.bytes(), MacAddress::SIZE);
+  cursor->writeBE<uint16_t>(info.key);
+  cursor->writeBE<uint16_t>(info.portPriority);
+  cursor->writeBE<uint16_t>(info.port);
+  cursor->write<uint8_t>(info.state);
+  for (int i = 0; i < 3; ++i) {
+    cursor->write<uint8_t>(0);
+  }
+}
+
+bool readInfo(uint8_t type, Cursor* cursor, LacpManager::Info* info) {
+  if (cursor->read<uint8_t>() != type ||
+      cursor->read<uint8_t>() != kInfoTlvLength) {
+    return false;
+  }
+  info->systemPriority = cursor->readBE<uint16_t>();
+  uint8_t system[MacAddress::SIZE];
+  cursor->pull(system, sizeof(system));
+  info->system = MacAddress::fromBinary(ByteRange(system, sizeof(system)));
+  info->key = cursor->readBE<uint16_t>();
+  info->portPriority = cursor->readBE<uint16_t>();
+  info->port = cursor->readBE<uint16_t>();
+  info->state = cursor->read<uint8_t>();
+  cursor->skip(3);
+  return true;
+}
+
+} // unnamed namespace
+
+constexpr size_t LacpManager::kPduLength;
+const MacAddress LacpManager::LACP_DEST_MAC("01:80:c2:00:00:02");
+
+bool LacpManager::Info::operator==(const Info& other) const {
+  return systemPriority == other.systemPriority &&
+    system == other.system &&
+    key == other.key &&
+    portPriority == other.portPriority &&
+    port == other.port &&
+    state == other.state;
+}
+
+LacpManager::LacpManager(SwSwitch* sw)
+  : folly::AsyncTimeout(sw->getBackgroundEVB()),
+    sw_(sw),
+    interval_(LACP_INTERVAL_MS) {
+}
+
+LacpManager::~LacpManager() {
+}
+
+void LacpManager::start() {
+  sw_->getBackgroundEVB()->runInEventBaseThread([this] {
+    this->timeoutExpired();
+  });
+}
+
+void LacpManager::stop() {
+  auto f = via(sw_->getBackgroundEVB())
+    .then([this] { this->cancelTimeout(); });
+  f.get();
+}
+
+void LacpManager::timeoutExpired() noexcept {
+  auto state = sw_->getState();
+  auto cpuMac = sw_->getPlatform()->getLocalMac();
+  auto now = steady_clock::now();
+  std::map<PortID, bool> changes;
+  try {
+    for (const auto& aggPort : *state->getAggregatePorts()) {
+      if (!aggPort->isLacpEnabled()) {
+        continue;
+      }
+      for (const auto& member : aggPort->getMembers()) {
+        auto port = state->getPorts()->getPortIf(member.first);
+        bool up = port && sw_->isPortUp(member.first);
+        bool forwarding = false;
+        if (up) {
+          std::lock_guard<std::mutex> g(mutex_);
+          forwarding = shouldForward(aggPort.get(), member.first, cpuMac,
+                                     now);
+        }
+        if (forwarding != member.second) {
+          changes[member.first] = forwarding;
+        }
+        if (up) {
+          sendPdu(aggPort.get(), member.first, port->getIngressVlan(),
+                  cpuMac, forwarding);
+        }
+      }
+    }
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "failed to send LACPDUs: " << folly::exceptionStr(ex);
+  }
+
+  {
+    // Forget the partners of ports that are no longer running LACP
+    std::lock_guard<std::mutex> g(mutex_);
+    const auto& aggPorts = state->getAggregatePorts();
+    for (auto it = partners_.begin(); it != partners_.end();) {
+      auto aggPort = aggPorts->getAggregatePortForMember(it->first);
+      if (!aggPort || !aggPort->isLacpEnabled()) {
+        it = partners_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  if (!changes.empty()) {
+    updateForwarding(std::move(changes));
+  }
+  scheduleTimeout(interval_);
+}
+
+void LacpManager::handlePacket(std::unique_ptr<RxPacket> pkt,
+                               MacAddress dst,
+                               MacAddress src,
+                               Cursor cursor,
+                               PortStats* portStats) {
+  auto port = pkt->getSrcPort();
+  Info actor;
+  Info partner;
+  if (!parsePdu(cursor, &actor, &partner)) {
+    // Other slow protocols, such as OAM, are not supported
+    VLOG(4) << "ignoring slow protocols frame on port " << port
+            << " from " << src;
+    portStats->pktUnhandled();
+    return;
+  }
+
+  auto state = sw_->getState();
+  auto aggPort = state->getAggregatePorts()->getAggregatePortForMember(port);
+  if (!aggPort || !aggPort->isLacpEnabled()) {
+    VLOG(4) << "ignoring LACPDU on port " << port
+            << " which is not running LACP";
+    portStats->pktUnhandled();
+    return;
+  }
+
+  auto cpuMac = sw_->getPlatform()->getLocalMac();
+  bool forwarding;
+  {
+    std::lock_guard<std::mutex> g(mutex_);
+    auto& entry = partners_[port];
+    if (entry.info != actor || entry.actor != partner) {
+      VLOG(3) << "LACP partner of port " << port << " is " << actor.system
+              << " port " << actor.port << ", state "
+              << static_cast<int>(actor.state);
+    }
+    entry.info = actor;
+    entry.actor = partner;
+    entry.lastReceived = steady_clock::now();
+    forwarding = shouldForward(aggPort.get(), port, cpuMac,
+                               entry.lastReceived);
+  }
+  if (forwarding != aggPort->isForwarding(port)) {
+    updateForwarding({{port, forwarding}});
+  }
+}
+
+LacpManager::Info LacpManager::getActorInfo(const AggregatePort* aggPort,
+                                            PortID port,
+                                            MacAddress cpuMac) const {
+  Info actor;
+  actor.systemPriority = LACP_SYSTEM_PRIORITY;
+  actor.system = cpuMac;
+  actor.key = static_cast<uint16_t>(aggPort->getID());
+  actor.portPriority = LACP_PORT_PRIORITY;
+  actor.port = static_cast<uint16_t>(port);
+  return actor;
+}
+
+bool LacpManager::shouldForward(const AggregatePort* aggPort, PortID port,
+                                MacAddress cpuMac,
+                                steady_clock::time_point now) const {
+  auto it = partners_.find(port);
+  if (it == partners_.end() ||
+      now - it->second.lastReceived > interval_ * LACP_TIMEOUT_INTERVALS) {
+    return false;
+  }
+  const auto& partner = it->second;
+  // The partner must be aggregating this link with the rest of ours, and
+  // be ready to receive on it.
+  auto actor = getActorInfo(aggPort, port, cpuMac);
+  return (partner.info.state & STATE_AGGREGATION) &&
+    (partner.info.state & STATE_SYNCHRONIZATION) &&
+    partner.actor.system == actor.system &&
+    partner.actor.key == actor.key &&
+    partner.actor.port == actor.port;
+}
+
+void LacpManager::sendPdu(const AggregatePort* aggPort, PortID port,
+                          VlanID vlan, MacAddress cpuMac, bool forwarding) {
+  auto actor = getActorInfo(aggPort, port, cpuMac);
+  actor.state = STATE_ACTIVITY | STATE_SHORT_TIMEOUT | STATE_AGGREGATION;
+  Info partner;
+  {
+    std::lock_guard<std::mutex> g(mutex_);
+    auto it = partners_.find(port);
+    if (it != partners_.end() &&
+        steady_clock::now() - it->second.lastReceived <=
+        interval_ * LACP_TIMEOUT_INTERVALS) {
+      partner = it->second.info;
+      if (partner.state & STATE_AGGREGATION) {
+        actor.state |= STATE_SYNCHRONIZATION;
+      }
+    } else {
+      actor.state |= STATE_DEFAULTED;
+    }
+  }
+  if (forwarding) {
+    actor.state |= STATE_COLLECTING | STATE_DISTRIBUTING;
+  }
+
+  // The ethernet header with a VLAN tag, then the LACPDU
+  auto pkt = sw_->allocatePacket(18 + kPduLength);
+  RWPrivateCursor cursor(pkt->buf());
+  TxPacket::writeEthHeader(&cursor, LACP_DEST_MAC, cpuMac, vlan,
+                           ETHERTYPE_SLOW_PROTOCOLS);
+  writePdu(actor, partner, &cursor);
+  sw_->sendPacketOutOfPort(std::move(pkt), port);
+  VLOG(5) << "sent LACPDU on port " << port << " with state "
+          << static_cast<int>(actor.state);
+}
+
+void LacpManager::updateForwarding(std::map<PortID, bool> changes) {
+  auto updateFn = [=](const shared_ptr<SwitchState>& state) {
+    shared_ptr<SwitchState> newState{state};
+    bool changed = false;
+    for (const auto& change : changes) {
+      auto aggPort = newState->getAggregatePorts()->getAggregatePortForMember(
+          change.first);
+      if (!aggPort || !aggPort->isLacpEnabled() ||
+          aggPort->isForwarding(change.first) == change.second) {
+        continue;
+      }
+      LOG(INFO) << "port " << change.first
+                << (change.second ? " joined" : " left")
+                << " aggregate port " << aggPort->getID();
+      aggPort->modify(&newState)->setForwarding(change.first, change.second);
+      changed = true;
+    }
+    return changed ? newState : nullptr;
+  };
+  sw_->updateState("LACP member changes", std::move(updateFn),
+                   StateUpdatePriority::NEIGHBOR);
+}
+
+void LacpManager::writePdu(const Info& actor, const Info& partner,
+                           RWPrivateCursor* cursor) {
+  cursor->write<uint8_t>(SUBTYPE_LACP);
+  cursor->write<uint8_t>(LACP_VERSION);
+  writeInfo(kActorInfoTlv, actor, cursor);
+  writeInfo(kPartnerInfoTlv, partner, cursor);
+  cursor->write<uint8_t>(kCollectorInfoTlv);
+  cursor->write<uint8_t>(kCollectorInfoTlvLength);
+  // The collector max delay, then reserved bytes
+  for (int i = 0; i < kCollectorInfoTlvLength - 2; ++i) {
+    cursor->write<uint8_t>(0);
+  }
+  cursor->write<uint8_t>(kTerminatorTlv);
+  cursor->write<uint8_t>(0);
+  for (int i = 0; i < 50; ++i) {
+    cursor->write<uint8_t>(0);
+  }
+}
+
+bool LacpManager::parsePdu(Cursor cursor, Info* actor, Info* partner) {
+  try {
+    if (cursor.read<uint8_t>() != SUBTYPE_LACP ||
+        cursor.read<uint8_t>() < LACP_VERSION) {
+      return false;
+    }
+    return readInfo(kActorInfoTlv, &cursor, actor) &&
+      readInfo(kPartnerInfoTlv, &cursor, partner);
+  } catch (const std::out_of_range&) {
+    return false;
+  }
+}
+
+}} // facebook::fboss
@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <folly/MacAddress.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace facebook { namespace fboss {
+
+class AggregatePort;
+class PortStats;
+class RxPacket;
+class SwSwitch;
+
+/*
+ * LacpManager runs LACP on the members of the aggregate ports that have it
+ * enabled, deciding which members forward traffic for their aggregate port.
+ *
+ * This is a minimal active-mode LACP: every member sends an LACPDU each
+ * second, and a member forwards while the switch at the other end of its
+ * link advertises that it is aggregating it with us and is in sync.  A
+ * member whose partner has not been heard from for three intervals stops
+ * forwarding.  Forwarding changes are made in the switch state, where the
+ * HwSwitch picks them up to program the trunk members.
+ */
+class LacpManager : private folly::AsyncTimeout {
+ public:
+  enum : uint16_t {
+    ETHERTYPE_SLOW_PROTOCOLS = 0x8809,
+    LACP_INTERVAL_MS = 1000,
+    LACP_TIMEOUT_INTERVALS = 3,
+    LACP_SYSTEM_PRIORITY = 0x8000,
+    LACP_PORT_PRIORITY = 0x8000,
+  };
+  enum : uint8_t {
+    SUBTYPE_LACP = 1,
+    LACP_VERSION = 1,
+    // The bits of the actor and partner states
+    STATE_ACTIVITY = 0x01,
+    STATE_SHORT_TIMEOUT = 0x02,
+    STATE_AGGREGATION = 0x04,
+    STATE_SYNCHRONIZATION = 0x08,
+    STATE_COLLECTING = 0x10,
+    STATE_DISTRIBUTING = 0x20,
+    STATE_DEFAULTED = 0x40,
+    STATE_EXPIRED = 0x80,
+  };
+  // The length of an LACPDU following the ethertype
+  static constexpr size_t kPduLength = 110;
+  static const folly::MacAddress LACP_DEST_MAC;
+
+  /*
+   * The actor or partner information of an LACPDU.
+   */
+  struct Info {
+    uint16_t systemPriority{0};
+    folly::MacAddress system;
+    uint16_t key{0};
+    uint16_t portPriority{0};
+    uint16_t port{0};
+    uint8_t state{0};
+
+    bool operator==(const Info& other) const;
+    bool operator!=(const Info& other) const {
+      return !(*this == other);
+    }
+  };
+
+  explicit LacpManager(SwSwitch* sw);
+  ~LacpManager();
+
+  /*
+   * Start sending LACPDUs.  This may be called from any thread.
+   */
+  void start();
+
+  /*
+   * Stop sending LACPDUs.  This must be called while the SwSwitch
+   * background thread is still running.
+   */
+  void stop();
+
+  /*
+   * Process a received slow protocols frame.  The cursor should point just
+   * past the ethertype.
+   *
+   * This may be called from any thread.
+   */
+  void handlePacket(std::unique_ptr<RxPacket> pkt,
+                    folly::MacAddress dst,
+                    folly::MacAddress src,
+                    folly::io::Cursor cursor,
+                    PortStats* portStats);
+
+  /*
+   * Encode and decode LACPDUs, following the ethertype.
+   */
+  static void writePdu(const Info& actor, const Info& partner,
+                       folly::io::RWPrivateCursor* cursor);
+  static bool parsePdu(folly::io::Cursor cursor, Info* actor, Info* partner);
+
+ private:
+  struct Partner {
+    // The partner's information, and its view of us
+    Info info;
+    Info actor;
+    std::chrono::steady_clock::time_point lastReceived;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  LacpManager(LacpManager const &) = delete;
+  LacpManager& operator=(LacpManager const &) = delete;
+
+  void timeoutExpired() noexcept override;
+  void sendPdu(const AggregatePort* aggPort, PortID port, VlanID vlan,
+               folly::MacAddress cpuMac, bool forwarding);
+  Info getActorInfo(const AggregatePort* aggPort, PortID port,
+                    folly::MacAddress cpuMac) const;
+  /*
+   * Whether the member should forward, given what we last heard from its
+   * partner.  Must be called with mutex_ held.
+   */
+  bool shouldForward(const AggregatePort* aggPort, PortID port,
+                     folly::MacAddress cpuMac,
+                     std::chrono::steady_clock::time_point now) const;
+  void updateForwarding(std::map<PortID, bool> changes);
+
+  SwSwitch* sw_{nullptr};
+  const std::chrono::milliseconds interval_;
+
+  // Packets are received in other threads than the one that sends the
+  // LACPDUs, so the partners have their own lock.
+  mutable std::mutex mutex_;
+  std::map<PortID, Partner> partners_;
+};
+
+}} // facebook::fboss
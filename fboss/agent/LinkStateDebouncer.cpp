@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/LinkStateDebouncer.h"
+#include "fboss/agent/SwitchStats.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Conv.h>
+#include <folly/io/async/EventBase.h>
+#include <glog/logging.h>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+LinkStateDebouncer::LinkStateDebouncer(folly::EventBase* evb,
+                                       const Config& config,
+                                       LinkChangesFn fn)
+  : AsyncTimeout(evb),
+    evb_(evb),
+    config_(config),
+    fn_(std::move(fn)) {
+}
+
+void LinkStateDebouncer::linkStateChanged(PortID port, bool up) {
+  // Take the time here, so that the hold-down doesn't depend on how busy
+  // the EventBase thread is.
+  auto now = steady_clock::now();
+  evb_->runInEventBaseThread([=]() {
+      handleLinkStateChanged(port, up, now);
+  });
+}
+
+uint64_t LinkStateDebouncer::getFlaps(PortID port) const {
+  DCHECK(evb_->isInEventBaseThread());
+  auto iter = ports_.find(port);
+  return iter == ports_.end() ? 0 : iter->second.flaps;
+}
+
+void LinkStateDebouncer::handleLinkStateChanged(PortID port, bool up,
+                                                TimePoint now) {
+  auto& state = ports_[port];
+  if (state.seen) {
+    if (state.current == up) {
+      // Linkscan may report the same state again
+      return;
+    }
+    ++state.flaps;
+    fbData->setCounter(folly::to<std::string>(SwitchStats::kCounterPrefix,
+                                              "port", port, ".link_flaps"),
+                       state.flaps);
+  }
+  state.seen = true;
+  state.current = up;
+
+  if (state.reported && state.reportedUp == up) {
+    // The port went back to the reported state within the hold-down
+    VLOG(2) << "ignoring link bounce on port " << port;
+    state.pending = false;
+  } else {
+    state.pending = true;
+    state.due = now + (up ? config_.upHoldDown : config_.downHoldDown);
+  }
+  scheduleNext();
+}
+
+void LinkStateDebouncer::scheduleNext() {
+  bool pending = false;
+  TimePoint first;
+  for (const auto& entry : ports_) {
+    if (entry.second.pending && (!pending || entry.second.due < first)) {
+      pending = true;
+      first = entry.second.due;
+    }
+  }
+  if (!pending) {
+    cancelTimeout();
+    return;
+  }
+  // The changes due within the batch window are delivered together
+  auto deadline = first + config_.batchWindow;
+  auto now = steady_clock::now();
+  auto timeout = deadline > now ?
+    duration_cast<milliseconds>(deadline - now) + milliseconds(1) :
+    milliseconds(0);
+  scheduleTimeout(timeout);
+}
+
+void LinkStateDebouncer::timeoutExpired() noexcept {
+  auto now = steady_clock::now();
+  LinkChanges changes;
+  for (auto& entry : ports_) {
+    auto& state = entry.second;
+    if (!state.pending || state.due > now) {
+      continue;
+    }
+    state.pending = false;
+    state.reported = true;
+    state.reportedUp = state.current;
+    changes.emplace_back(entry.first, state.current);
+  }
+  if (!changes.empty()) {
+    fn_(changes);
+  }
+  scheduleNext();
+}
+
+}} // facebook::fboss
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <folly/io/async/AsyncTimeout.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace fboss {
+
+/**
+ * LinkStateDebouncer sits between the linkscan events of the HwSwitch and
+ * the code that acts on link changes.
+ *
+ * A new link state is only reported once it has held for the up or down
+ * hold-down time, so a port that bounces back within the hold-down is not
+ * reported at all.  Ports whose hold-down expires within the same batch
+ * window are reported together in one call, so a line card reset produces
+ * one batch of changes rather than one per port.
+ *
+ * Every transition is counted as a flap of the port, whether it was
+ * reported or not, and exported as the port<N>.link_flaps counter.
+ *
+ * linkStateChanged() may be called from any thread.  Everything else,
+ * including the calls to the LinkChangesFn, happens in the EventBase thread.
+ */
+class LinkStateDebouncer : private folly::AsyncTimeout {
+ public:
+  typedef std::vector<std::pair<PortID, bool>> LinkChanges;
+  typedef std::function<void(const LinkChanges&)> LinkChangesFn;
+
+  struct Config {
+    // How long a port has to stay up, or down, before that is reported
+    std::chrono::milliseconds upHoldDown{0};
+    std::chrono::milliseconds downHoldDown{0};
+    // How long to wait for more changes once the first one is due
+    std::chrono::milliseconds batchWindow{0};
+  };
+
+  LinkStateDebouncer(folly::EventBase* evb, const Config& config,
+                     LinkChangesFn fn);
+
+  /*
+   * Handle a link state event from the hardware.
+   */
+  void linkStateChanged(PortID port, bool up);
+
+  /*
+   * The number of link transitions seen on the port.
+   *
+   * This must be called in the EventBase thread.
+   */
+  uint64_t getFlaps(PortID port) const;
+
+ private:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct PortLinkState {
+    // Whether any event was seen yet, and whether one was ever reported
+    bool seen{false};
+    bool reported{false};
+    // The latest state from the hardware, and the last one reported
+    bool current{false};
+    bool reportedUp{false};
+    // Whether current is waiting for its hold-down to expire, and when
+    bool pending{false};
+    TimePoint due;
+    uint64_t flaps{0};
+  };
+
+  // Forbidden copy constructor and assignment operator
+  LinkStateDebouncer(LinkStateDebouncer const &) = delete;
+  LinkStateDebouncer& operator=(LinkStateDebouncer const &) = delete;
+
+  void handleLinkStateChanged(PortID port, bool up, TimePoint now);
+  void scheduleNext();
+
+  void timeoutExpired() noexcept override;
+
+  folly::EventBase* const evb_{nullptr};
+  const Config config_;
+  const LinkChangesFn fn_;
+  std::map<PortID, PortLinkState> ports_;
+};
+
+}} // facebook::fboss
@@ -11,22 +11,103 @@
 #include "fboss/agent/LldpManager.h"
 
 #include <folly/futures/Future.h>
+#include <folly/Hash.h>
 #include <folly/io/Cursor.h>
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
 #include <folly/MacAddress.h>
 #include <folly/Range.h>
+#include "fboss/agent/PeriodicTransmitter.h"
+#include "fboss/agent/PortStats.h"
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/TxPacket.h"
+#include <algorithm>
+#include <gflags/gflags.h>
 #include <unistd.h>
 
+DEFINE_int32(lldp_jitter_percent, 10,
+             "The most, as a percentage of the interval, to randomly shorten "
+             "each interval between LLDP frames on a port by.  Unless this is "
+             "0, each port also starts sending at a random point in its "
+             "first interval");
+
 using folly::MacAddress;
+using folly::io::Cursor;
 using folly::io::RWPrivateCursor;
 using folly::ByteRange;
 using folly::StringPiece;
+using std::chrono::steady_clock;
 using std::shared_ptr;
 
 
 namespace facebook { namespace fboss {
 
+namespace {
+
+/*
+ * Call fn(type, value) for each TLV before the end of PDU TLV.  Returns the
+ * length of the TLVs up to and including the end of PDU TLV, or 0 if a TLV
+ * runs past the end of the frame.
+ */
+template <typename Fn>
+size_t forEachTlv(ByteRange pdu, Fn fn) {
+  size_t offset = 0;
+  while (pdu.size() - offset >= 2) {
+    uint16_t header = (uint16_t(pdu[offset]) << 8) | pdu[offset + 1];
+    uint16_t type = header >> LldpManager::TLV_TYPE_LEFT_SHIFT_OFFSET;
+    uint16_t length =
+      header & ((1 << LldpManager::TLV_LENGTH_BITS_LENGTH) - 1);
+    offset += 2;
+    if (pdu.size() - offset < length) {
+      return 0;
+    }
+    if (type == LldpManager::PDU_END_TLV_TYPE) {
+      return offset + length;
+    }
+    fn(type, pdu.subpiece(offset, length));
+    offset += length;
+  }
+  return 0;
+}
+
+std::string printableId(uint8_t type, const std::string& id,
+                        uint8_t macType, uint8_t addrType) {
+  auto bytes = ByteRange(StringPiece(id));
+  if (type == macType && bytes.size() == MacAddress::SIZE) {
+    return MacAddress::fromBinary(bytes).toString();
+  }
+  if (type == addrType && !bytes.empty()) {
+    // The first byte is the IANA address family
+    auto addr = bytes.subpiece(1);
+    if (bytes[0] == 1 && addr.size() == 4) {
+      return folly::IPAddressV4::fromBinary(addr).str();
+    }
+    if (bytes[0] == 2 && addr.size() == 16) {
+      return folly::IPAddressV6::fromBinary(addr).str();
+    }
+  }
+  return id;
+}
+
+bool isExpired(const LldpManager::Neighbor& neighbor,
+               steady_clock::time_point now) {
+  return now - neighbor.lastReceived > std::chrono::seconds(neighbor.ttl);
+}
+
+} // unnamed namespace
+
+std::string LldpManager::Neighbor::printableChassisId() const {
+  return printableId(chassisIdType, chassisId, CHASSIS_TLV_SUB_TYPE_MAC,
+                     CHASSIS_TLV_SUB_TYPE_NET_ADDR);
+}
+
+std::string LldpManager::Neighbor::printablePortId() const {
+  return printableId(portIdType, portId, PORT_TLV_SUB_TYPE_MAC,
+                     PORT_TLV_SUB_TYPE_NET_ADDR);
+}
+
 const MacAddress LldpManager::LLDP_DEST_MAC("01:80:c2:00:00:0e");
 
 LldpManager::LldpManager(SwSwitch* sw)
@@ -44,31 +125,232 @@ void LldpManager::start() {
 
 void LldpManager::stop() {
   auto f = via(sw_->getBackgroundEVB())
-    .then([this] { this->cancelTimeout(); });
+    .then([this] {
+      this->cancelTimeout();
+      auto* transmitter = sw_->getPeriodicTransmitter();
+      for (auto port : senders_) {
+        transmitter->removeSender(PeriodicTransmitter::Protocol::LLDP, port);
+      }
+      senders_.clear();
+    });
   f.get();
 }
 
 void LldpManager::timeoutExpired() noexcept {
   try {
-    sendLldpOnAllPorts(true);
+    syncSenders();
   } catch (const std::exception& ex) {
-    LOG(ERROR) << "Failed to send LLDP on all ports. Error:"
+    LOG(ERROR) << "Failed to schedule LLDP on all ports. Error:"
                << folly::exceptionStr(ex);
   }
+  expireNeighbors();
   scheduleTimeout(interval_);
 }
 
+void LldpManager::syncSenders() {
+  auto* transmitter = sw_->getPeriodicTransmitter();
+  auto jitterPct = std::max(FLAGS_lldp_jitter_percent, 0);
+  std::shared_ptr<SwitchState> state = sw_->getState();
+  const auto& ports = state->getPorts();
+  for (const auto& port : *ports) {
+    auto portID = port->getID();
+    // Adding a sender again keeps its place in the interval
+    transmitter->setSender(
+        PeriodicTransmitter::Protocol::LLDP, portID, interval_, jitterPct,
+        [this, portID] () -> PeriodicTransmitter::Packet {
+          PeriodicTransmitter::Packet packet;
+          packet.pkt = buildPeriodicPacket(portID);
+          packet.port = portID;
+          return packet;
+        });
+    senders_.insert(portID);
+  }
+
+  // Forget the senders and frames of ports that no longer exist
+  for (auto it = senders_.begin(); it != senders_.end();) {
+    if (!ports->getPortIf(*it)) {
+      transmitter->removeSender(PeriodicTransmitter::Protocol::LLDP, *it);
+      pdus_.erase(*it);
+      it = senders_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::unique_ptr<TxPacket> LldpManager::buildPeriodicPacket(PortID portID) {
+  auto port = sw_->getState()->getPorts()->getPortIf(portID);
+  if (!port || !sw_->isPortUp(portID)) {
+    VLOG(5) << "Skipping LLDP send as this port is disabled " << portID;
+    return nullptr;
+  }
+  return makeLldpPacket(port, sw_->getPlatform()->getLocalMac(),
+                        getHostname());
+}
+
+std::string LldpManager::getHostname() {
+  const size_t kMaxLen = 64;
+  char hostname[kMaxLen];
+  if (0 == gethostname(hostname, kMaxLen)) {
+    // make sure it is null terminated
+    hostname[kMaxLen - 1] = '\0';
+  } else {
+    hostname[0] = '\0';
+  }
+  return hostname;
+}
+
 void LldpManager::sendLldpOnAllPorts(bool checkPortStatusFlag) {
+  MacAddress cpuMac = sw_->getPlatform()->getLocalMac();
+  auto hostname = getHostname();
+
   // send lldp frames through all the ports here.
   std::shared_ptr<SwitchState> state = sw_->getState();
-  for (const auto& port : *state->getPorts()) {
+  const auto& ports = state->getPorts();
+  for (const auto& port : *ports) {
     if (checkPortStatusFlag == false || sw_->isPortUp(port->getID())) {
-      sendLldpInfo(sw_, state, port);
+      sendLldpInfo(port, cpuMac, hostname);
     } else {
       VLOG(5) << "Skipping LLDP send as this port is disabled " <<
         port->getID();
     }
   }
+
+  // Forget the frames of ports that no longer exist
+  for (auto it = pdus_.begin(); it != pdus_.end();) {
+    if (!ports->getPortIf(it->first)) {
+      it = pdus_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::vector<LldpManager::Neighbor> LldpManager::getNeighbors() const {
+  auto now = steady_clock::now();
+  std::vector<Neighbor> neighbors;
+  std::lock_guard<std::mutex> guard(neighborsLock_);
+  neighbors.reserve(neighbors_.size());
+  for (const auto& entry : neighbors_) {
+    if (!isExpired(entry.second, now)) {
+      neighbors.push_back(entry.second);
+    }
+  }
+  return neighbors;
+}
+
+void LldpManager::expireNeighbors() {
+  auto now = steady_clock::now();
+  std::lock_guard<std::mutex> guard(neighborsLock_);
+  for (auto it = neighbors_.begin(); it != neighbors_.end();) {
+    if (isExpired(it->second, now)) {
+      VLOG(2) << "LLDP neighbor " << it->second.systemName << " on port "
+              << it->first << " expired";
+      it = neighbors_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void LldpManager::handlePacket(std::unique_ptr<RxPacket> pkt,
+                               MacAddress dst,
+                               MacAddress src,
+                               Cursor cursor,
+                               PortStats* portStats) {
+  auto port = pkt->getSrcPort();
+  // The frame is almost always in one buffer, so the TLVs can be checked and
+  // hashed where they are.
+  std::string coalesced;
+  ByteRange pdu(cursor.data(), cursor.length());
+  if (cursor.length() != cursor.totalLength()) {
+    coalesced = cursor.readFixedString(cursor.totalLength());
+    pdu = StringPiece(coalesced);
+  }
+  auto tlvLength = forEachTlv(pdu, [](uint16_t, ByteRange) {});
+  if (tlvLength == 0) {
+    VLOG(3) << "Received truncated LLDP PDU on port " << port
+            << " from " << src;
+    portStats->pktBogus();
+    return;
+  }
+  auto tlvs = pdu.subpiece(0, tlvLength);
+  auto hash = folly::hash::fnv64_buf(tlvs.data(), tlvs.size());
+
+  auto now = steady_clock::now();
+  {
+    std::lock_guard<std::mutex> guard(neighborsLock_);
+    auto it = neighbors_.find(port);
+    if (it != neighbors_.end() && it->second.tlvHash == hash &&
+        it->second.tlvLength == tlvLength && it->second.mac == src) {
+      it->second.lastReceived = now;
+      sw_->stats()->lldpNeighborRefreshed();
+      return;
+    }
+  }
+
+  Neighbor neighbor;
+  if (!parseNeighbor(tlvs, &neighbor)) {
+    VLOG(3) << "Received LLDP PDU without the mandatory TLVs on port "
+            << port << " from " << src;
+    portStats->pktBogus();
+    return;
+  }
+  neighbor.port = port;
+  neighbor.vlan = pkt->getSrcVlan();
+  neighbor.mac = src;
+  neighbor.lastReceived = now;
+  neighbor.lastChanged = now;
+  neighbor.tlvHash = hash;
+  neighbor.tlvLength = tlvLength;
+  VLOG(4) << "Received new LLDP PDU on port " << port << " from " << src
+          << ", system name \"" << neighbor.systemName << "\"";
+
+  std::lock_guard<std::mutex> guard(neighborsLock_);
+  if (neighbor.ttl == 0) {
+    // A neighbor shutting down its LLDP agent sends a TTL of 0
+    neighbors_.erase(port);
+  } else {
+    neighbors_[port] = std::move(neighbor);
+  }
+  sw_->stats()->lldpNeighborChanged();
+}
+
+bool LldpManager::parseNeighbor(ByteRange tlvs, Neighbor* neighbor) {
+  bool hasChassis = false;
+  bool hasPort = false;
+  bool hasTtl = false;
+  forEachTlv(tlvs, [&](uint16_t type, ByteRange value) {
+    switch (type) {
+      case CHASSIS_TLV_TYPE:
+        if (!value.empty()) {
+          neighbor->chassisIdType = value[0];
+          neighbor->chassisId = StringPiece(value.subpiece(1)).str();
+          hasChassis = true;
+        }
+        break;
+      case PORT_TLV_TYPE:
+        if (!value.empty()) {
+          neighbor->portIdType = value[0];
+          neighbor->portId = StringPiece(value.subpiece(1)).str();
+          hasPort = true;
+        }
+        break;
+      case TTL_TLV_TYPE:
+        if (value.size() >= 2) {
+          neighbor->ttl = (uint16_t(value[0]) << 8) | value[1];
+          hasTtl = true;
+        }
+        break;
+      case SYSTEM_NAME_TLV_TYPE:
+        neighbor->systemName = StringPiece(value).str();
+        break;
+      case SYSTEM_DESCRIPTION_TLV_TYPE:
+        neighbor->systemDescription = StringPiece(value).str();
+        break;
+    }
+  });
+  return hasChassis && hasPort && hasTtl;
 }
 
 uint16_t tlvHeader(uint16_t type, uint16_t length) {
@@ -107,28 +389,59 @@ void writeTlv(uint16_t type, const ByteRange& value,
   cursor->push(value.data(), value.size());
 }
 
-void LldpManager::sendLldpInfo(SwSwitch* sw,
-                               const std::shared_ptr<SwitchState>& swState,
-                               const std::shared_ptr<Port>& port) {
-  MacAddress cpuMac = sw->getPlatform()->getLocalMac();
-  const size_t kMaxLen = 64;
-  char hostname[kMaxLen];
+void LldpManager::sendLldpInfo(const std::shared_ptr<Port>& port,
+                               MacAddress cpuMac,
+                               StringPiece hostname) {
+  // this LLDP packet HAS to exit out of the port specified here.
+  sw_->sendPacketOutOfPort(makeLldpPacket(port, cpuMac, hostname),
+                           port->getID());
+}
 
-  if (0 == gethostname(hostname, kMaxLen)) {
-    // make sure it is null terminated
-    hostname[kMaxLen - 1] = '\0';
-  } else {
-    hostname[0] = '\0';
+std::unique_ptr<TxPacket> LldpManager::makeLldpPacket(
+    const std::shared_ptr<Port>& port,
+    MacAddress cpuMac,
+    StringPiece hostname) {
+  // The frame only depends on the port's configuration, our MAC and our
+  // hostname, so it is built once and reused until one of those changes.
+  auto& cached = pdus_[port->getID()];
+  if (!cached.frame || cached.port != port || cached.mac != cpuMac ||
+      StringPiece(cached.hostname) != hostname) {
+    cached.port = port;
+    cached.mac = cpuMac;
+    cached.hostname = hostname.str();
+    cached.frame = buildPdu(port, cpuMac, hostname);
+    VLOG(3) << "Built LLDP PDU for port " << port->getID();
   }
 
+  auto pkt = sw_->allocatePacket(cached.frame->length());
+  memcpy(pkt->buf()->writableData(), cached.frame->data(),
+         cached.frame->length());
+  VLOG(4) << "sending LLDP " << " on port " << port->getID() <<
+    " with CPU MAC " << cpuMac.toString() << " and vlan "
+    << port->getIngressVlan();
+  return pkt;
+}
+
+std::unique_ptr<folly::IOBuf> LldpManager::buildPdu(
+    const std::shared_ptr<Port>& port,
+    MacAddress cpuMac,
+    StringPiece hostname) {
+  StringPiece portName(port->getName());
+  StringPiece description("FBOSS");
+  // Ethernet header, then the chassis ID, port ID, TTL, system name, system
+  // description, system capability and end of PDU TLVs
+  size_t pduLen = 18 + (2 + 1 + MacAddress::SIZE) + (2 + 1 + portName.size()) +
+    (2 + TTL_TLV_LENGTH) + (hostname.empty() ? 0 : 2 + hostname.size()) +
+    (2 + description.size()) + (2 + SYSTEM_CAPABILITY_TLV_LENGTH) + 2;
   // The minimum packet length is 64.We use 68 on the assumption that
-  // the packet will go out untagged, which will remove 4 bytes.
-  uint32_t frameLen = 98;
-  auto pkt = sw->allocatePacket(frameLen);
-  PortID thisPortID = port->getID();
-  RWPrivateCursor cursor(pkt->buf());
-  pkt->writeEthHeader(&cursor, LLDP_DEST_MAC,
-                      cpuMac, port->getIngressVlan(), ETHERTYPE_LLDP);
+  // the packet will go out untagged, which will remove 4 bytes.  Long port
+  // names and hostnames may need more than our usual 98 bytes.
+  uint32_t frameLen = std::max(pduLen, size_t(98));
+  auto buf = folly::IOBuf::create(frameLen);
+  buf->append(frameLen);
+  RWPrivateCursor cursor(buf.get());
+  TxPacket::writeEthHeader(&cursor, LLDP_DEST_MAC,
+                           cpuMac, port->getIngressVlan(), ETHERTYPE_LLDP);
   // now write chassis ID TLV
   writeTlv(CHASSIS_TLV_TYPE, CHASSIS_TLV_SUB_TYPE_MAC,
            ByteRange(cpuMac.bytes(), 6), &cursor);
@@ -137,21 +450,19 @@ void LldpManager::sendLldpInfo(SwSwitch* sw,
   /* using StringPiece here to bridge chars in string to unsigned chars in
    * ByteRange.
    */
-  writeTlv(PORT_TLV_TYPE, PORT_TLV_SUB_TYPE_INTERFACE,
-           StringPiece(port->getName()), &cursor);
+  writeTlv(PORT_TLV_TYPE, PORT_TLV_SUB_TYPE_INTERFACE, portName, &cursor);
 
   // now write TTL TLV
   writeTlv(TTL_TLV_TYPE, (uint16_t) TTL_TLV_VALUE, &cursor);
 
   // now write optional TLVs
   // system name TLV
-  if (strlen(hostname) > 0) {
-    writeTlv(SYSTEM_NAME_TLV_TYPE,
-             StringPiece(hostname), &cursor);
+  if (!hostname.empty()) {
+    writeTlv(SYSTEM_NAME_TLV_TYPE, hostname, &cursor);
   }
 
   // system description TLV
-  writeTlv(SYSTEM_DESCRIPTION_TLV_TYPE, StringPiece("FBOSS"), &cursor);
+  writeTlv(SYSTEM_DESCRIPTION_TLV_TYPE, description, &cursor);
 
   // system capability TLV
   uint16_t capability = SYSTEM_CAPABILITY_ROUTER;
@@ -163,11 +474,7 @@ void LldpManager::sendLldpInfo(SwSwitch* sw,
 
   // Fill the padding with 0s
   memset(cursor.writableData(), 0, cursor.length());
-  // this LLDP packet HAS to exit out of the port specified here.
-  sw->sendPacketOutOfPort(std::move(pkt), thisPortID);
-  VLOG(4) << "sent LLDP " << " on port " << port->getID() <<
-    " with CPU MAC " << cpuMac.toString() << " and vlan "
-    << port->getIngressVlan();
+  return buf;
 }
 
 }} // facebook::fboss
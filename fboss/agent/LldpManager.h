@@ -10,8 +10,16 @@
 // Copyright 2014-present Facebook. All Rights Reserved.
 #pragma once
 #include <folly/io/async/AsyncTimeout.h>
-#include <unordered_map>
+#include <folly/io/IOBuf.h>
+#include <folly/Range.h>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "fboss/agent/state/Port.h"
 #include "fboss/agent/state/PortMap.h"
 #include "fboss/agent/Platform.h"
@@ -22,14 +30,20 @@ class Cursor;
 }}
 
 namespace facebook { namespace fboss {
+class PortStats;
+class RxPacket;
+class TxPacket;
+
 class LldpManager : private folly::AsyncTimeout {
   /*
    * LldpManager is the class that manages Lldp support.
    * Responsible for processing received LLDP frames and maintaining the
    * LLDP neighbors table.
    * Also, responsible for periodically sending LLDP frames on all the ports
-   * to inform of this switch's presence to its neighbors. Hence inheriting
-   * the TAsyncTimeout class for that purpose.
+   * to inform of this switch's presence to its neighbors.  The frames are
+   * sent by the PeriodicTransmitter, which spreads the ports across the
+   * interval; the timer here expires neighbors and keeps the transmitter's
+   * list of ports in sync with the state.
    */
  public:
   enum : uint16_t { ETHERTYPE_LLDP = 0x88CC,
@@ -41,7 +55,10 @@ class LldpManager : private folly::AsyncTimeout {
                     CHASSIS_TLV_TYPE = 0x01,
                     CHASSIS_TLV_LENGTH = 0x07,
                     CHASSIS_TLV_SUB_TYPE_MAC = 0x04,
+                    CHASSIS_TLV_SUB_TYPE_NET_ADDR = 0x05,
                     PORT_TLV_TYPE = 0x02,
+                    PORT_TLV_SUB_TYPE_MAC = 0x3,
+                    PORT_TLV_SUB_TYPE_NET_ADDR = 0x4,
                     PORT_TLV_SUB_TYPE_INTERFACE = 0x5,
                     SYSTEM_NAME_TLV_TYPE = 0x5,
                     SYSTEM_DESCRIPTION_TLV_TYPE = 0x6,
@@ -54,6 +71,40 @@ class LldpManager : private folly::AsyncTimeout {
                     TTL_TLV_VALUE = 120,
                     PDU_END_TLV_TYPE = 0,
                     PDU_END_TLV_LENGTH = 0};
+  /*
+   * What we know about the neighbor on a port, from the last LLDP PDU it
+   * sent us.
+   */
+  struct Neighbor {
+    PortID port{0};
+    VlanID vlan{0};
+    folly::MacAddress mac;
+    uint8_t chassisIdType{0};
+    std::string chassisId;
+    uint8_t portIdType{0};
+    std::string portId;
+    std::string systemName;
+    std::string systemDescription;
+    // How long the neighbor asked us to keep this information, in seconds
+    uint16_t ttl{0};
+    // When the last PDU was received, whether or not it changed anything
+    std::chrono::steady_clock::time_point lastReceived;
+    // When the PDU last differed from the one before
+    std::chrono::steady_clock::time_point lastChanged;
+    // A hash and the length of the TLVs, used to tell whether a PDU differs
+    // from the last one without parsing it again
+    uint64_t tlvHash{0};
+    size_t tlvLength{0};
+
+    /*
+     * The chassis and port IDs in a printable form: MAC addresses and
+     * network addresses are formatted, and anything else is returned as
+     * sent, since it is usually a name.
+     */
+    std::string printableChassisId() const;
+    std::string printablePortId() const;
+  };
+
   explicit LldpManager(SwSwitch* sw);
   ~LldpManager();
   static const folly::MacAddress LLDP_DEST_MAC;
@@ -73,15 +124,84 @@ class LldpManager : private folly::AsyncTimeout {
    */
   void stop();
 
+  /*
+   * Process a received LLDP frame.  The cursor should point just past the
+   * ethertype.
+   *
+   * Neighbors send the same PDU over and over, so the PDU is only parsed
+   * into the neighbor table if its TLVs differ from the last ones received
+   * on the port.  Otherwise only the neighbor's receive time is refreshed.
+   *
+   * This may be called from any thread.
+   */
+  void handlePacket(std::unique_ptr<RxPacket> pkt,
+                    folly::MacAddress dst,
+                    folly::MacAddress src,
+                    folly::io::Cursor cursor,
+                    PortStats* portStats);
+
+  /*
+   * Get the neighbors whose TTL has not expired, ordered by port.
+   *
+   * This may be called from any thread.
+   */
+  std::vector<Neighbor> getNeighbors() const;
+
   // This function is internal.  It is only public for use in unit tests.
   void sendLldpOnAllPorts(bool checkPortStatusFlag);
 
  private:
+  /*
+   * The LLDP frame for a port, and what it was built from.  Port nodes are
+   * replaced whenever the port's configuration changes, so comparing the
+   * node pointers is enough to notice a new name or VLAN.
+   */
+  struct CachedPdu {
+    std::shared_ptr<Port> port;
+    folly::MacAddress mac;
+    std::string hostname;
+    std::unique_ptr<folly::IOBuf> frame;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  LldpManager(LldpManager const &) = delete;
+  LldpManager& operator=(LldpManager const &) = delete;
+
   void timeoutExpired() noexcept;
+  /*
+   * Add a PeriodicTransmitter sender for each port, and remove those of
+   * ports that are gone.
+   */
+  void syncSenders();
+  /*
+   * Build the LLDP packet for the port, or return null if the port is gone
+   * or down.  Called by the PeriodicTransmitter.
+   */
+  std::unique_ptr<TxPacket> buildPeriodicPacket(PortID portID);
+  void sendLldpInfo(const std::shared_ptr<Port>& port,
+                    folly::MacAddress cpuMac,
+                    folly::StringPiece hostname);
+  std::unique_ptr<TxPacket> makeLldpPacket(const std::shared_ptr<Port>& port,
+                                           folly::MacAddress cpuMac,
+                                           folly::StringPiece hostname);
+  static std::string getHostname();
+  static std::unique_ptr<folly::IOBuf> buildPdu(
+      const std::shared_ptr<Port>& port,
+      folly::MacAddress cpuMac,
+      folly::StringPiece hostname);
+  static bool parseNeighbor(folly::ByteRange tlvs, Neighbor* neighbor);
+  void expireNeighbors();
 
   SwSwitch* sw_{nullptr};
   std::chrono::milliseconds interval_;
-  void sendLldpInfo(SwSwitch* sw, const std::shared_ptr<SwitchState>& swState,
-                    const std::shared_ptr<Port>& port);
+  // The frames to send on each port.  Only used in the background thread,
+  // so they need no locking.
+  std::map<PortID, CachedPdu> pdus_;
+  // The ports with a PeriodicTransmitter sender
+  std::set<PortID> senders_;
+  // Packets are received in other threads than the one that sends them and
+  // expires neighbors, so the neighbor table has its own lock.
+  mutable std::mutex neighborsLock_;
+  std::map<PortID, Neighbor> neighbors_;
 };
 }} // facebook::fboss
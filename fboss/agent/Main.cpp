@@ -14,10 +14,16 @@
 #include <folly/ScopeGuard.h>
 #include <folly/String.h>
 #include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/BootTimeline.h"
+#include "fboss/agent/EventTrace.h"
 #include "fboss/agent/HwSwitch.h"
 #include "fboss/agent/Platform.h"
+#include "fboss/agent/RxBufferTracker.h"
 #include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/ThreadArenas.h"
+#include "fboss/agent/ThreadPlacement.h"
 #include "fboss/agent/ThriftHandler.h"
+#include "fboss/agent/ThriftThreadPools.h"
 #include "common/stats/ServiceData.h"
 #include "thrift/lib/cpp/async/TAsyncTimeout.h"
 #include "thrift/lib/cpp/async/TAsyncSignalHandler.h"
@@ -33,6 +39,7 @@
 #include <functional>
 #include <string>
 #include <mutex>
+#include <vector>
 #include <gflags/gflags.h>
 
 using folly::FunctionScheduler;
@@ -59,6 +66,22 @@ DEFINE_bool(tun_intf, true,
             "Create tun interfaces to allow other processes to "
             "send and receive traffic via the switch ports");
 
+DEFINE_string(thread_placement, "",
+              "Pin agent threads to CPUs and set their scheduling priority, "
+              "e.g. \"fbossUpdateThread:cpus=2-3:nice=-5;sdk_rx:cpus=1:"
+              "fifo=10;thrift:cpus=0\".  See ThreadPlacement.h for the "
+              "syntax.");
+
+DEFINE_bool(thread_arenas, false,
+            "Give the update, background, RX and thrift threads each their "
+            "own jemalloc arena, to keep the fragmentation of one kind of "
+            "allocation from growing the RSS of all of them");
+
+DEFINE_string(disabled_counter_sets, "",
+              "Comma separated prefixes of the counter names to leave out of "
+              "the fb303 counter calls, e.g. \"port\" for the per port and "
+              "queue counters.  The counters are still kept up to date.");
+
 using facebook::fboss::SwSwitch;
 
 namespace facebook { namespace fboss {
@@ -69,6 +92,12 @@ namespace facebook { namespace fboss {
  */
 void updateStats(SwSwitch *swSwitch) {
   swSwitch->getHw()->updateStats(swSwitch->stats());
+  swSwitch->publishUpdateQueueStats();
+  swSwitch->publishRouteStats();
+  swSwitch->publishUnresolvedPuntStats();
+  RxBufferTracker::publish();
+  ThreadArenas::publish();
+  EventTrace::recordPacketCounts();
 }
 
 class Initializer {
@@ -117,19 +146,24 @@ class Initializer {
     auto localMac = ret.get();
     LOG(INFO) << "local MAC is " << localMac;
 
-    sw_->updateStateBlocking("apply initial config",
-                             [this](const shared_ptr<SwitchState>& state) {
-                               return this->applyConfig(state, FLAGS_config);
-                             });
-    sw_->initialConfigApplied();
+    {
+      BootTimeline::PhaseTimer timer("config_apply");
+      sw_->updateStateBlocking("apply initial config",
+                               [this](const shared_ptr<SwitchState>& state) {
+                                 return this->applyConfig(state, FLAGS_config);
+                               });
+      sw_->initialConfigApplied();
+    }
 
     // Start the UpdateSwitchStatsThread
     fs_ = new FunctionScheduler();
     fs_->setThreadName("UpdateStatsThread");
+    // The stats collection and SFP polling go through the SDK, so they
+    // wait for the initial routes to be programmed
     std::function<void()> callback(std::bind(updateStats, sw_));
-    auto timeInterval = std::chrono::seconds(1);
-    const string& nameID = "updateStats";
-    fs_->addFunction(callback, timeInterval, nameID);
+    sw_->runAfterFibSync("stats", [=] {
+      fs_->addFunction(callback, std::chrono::seconds(1), "updateStats");
+    });
     // Schedule function to signal to SwSwitch that all
     // initial programming is now complete. We typically
     // do that at the end of syncFib call from BGP but
@@ -149,17 +183,19 @@ class Initializer {
     auto sfpDetectFunc = [=]() {
       sw_->detectSfp();
     };
-    fs_->addFunction(sfpDetectFunc, seconds(1), sfpDetect);
 
     // Sfp Detection Thread
     const string sfpDomCacheUpdate = "SfpDomCacheUpdate";
     auto sfpDomCacheUpdateFunc = [=]() {
       sw_->updateSfpDomFields();
     };
-    // Call sfpDomCacheUpdate 15 seconds to get SFP monitor the
-    // DOM values
-    fs_->addFunction(sfpDomCacheUpdateFunc, seconds(15), sfpDomCacheUpdate,
-        seconds(15));
+    sw_->runAfterFibSync("sfp", [=] {
+      fs_->addFunction(sfpDetectFunc, seconds(1), sfpDetect);
+      // Call sfpDomCacheUpdate 15 seconds to get SFP monitor the
+      // DOM values
+      fs_->addFunction(sfpDomCacheUpdateFunc, seconds(15), sfpDomCacheUpdate,
+          seconds(15));
+    });
 
     fs_->start();
     LOG(INFO) << "Started background thread: UpdateStatsThread";
@@ -187,9 +223,11 @@ class Initializer {
 class StatsPublisher : public TAsyncTimeout {
  public:
   StatsPublisher(TEventBase* eventBase, SwSwitch* sw,
+                 ThriftThreadPools* thriftPools,
                  std::chrono::milliseconds interval)
     : TAsyncTimeout(eventBase),
       sw_(sw),
+      thriftPools_(thriftPools),
       interval_(interval) {}
 
   void start() {
@@ -198,11 +236,13 @@ class StatsPublisher : public TAsyncTimeout {
 
   void timeoutExpired() noexcept override {
     sw_->publishStats();
+    thriftPools_->publishStats();
     scheduleTimeout(interval_);
   }
 
  private:
   SwSwitch* sw_{nullptr};
+  ThriftThreadPools* thriftPools_{nullptr};
   std::chrono::milliseconds interval_;
 };
 
@@ -230,6 +270,12 @@ class SignalHandler : public TAsyncSignalHandler {
 int fbossMain(int argc, char** argv, PlatformInitFn initPlatform) {
 
   fbossInit(argc, argv);
+  // Parse the thread placement before any of the agent's threads start, so
+  // a bad one fails right away
+  ThreadPlacement::configure(FLAGS_thread_placement);
+  ThreadArenas::configure(FLAGS_thread_arenas);
+  // Start the boot timeline
+  BootTimeline::get();
 
   // Internally we use a modified version of gflags that only shows VLOG
   // messages if --minloglevel is set to 0.  We pretty much always want to see
@@ -242,6 +288,11 @@ int fbossMain(int argc, char** argv, PlatformInitFn initPlatform) {
   // settings.  This allows us to change the log levels on the fly using
   // setOption().
   fbData->setUseOptionsAsFlags(true);
+  std::vector<folly::StringPiece> counterSets;
+  folly::split(',', FLAGS_disabled_counter_sets, counterSets, true);
+  for (auto prefix : counterSets) {
+    fbData->setCounterSetEnabled(prefix, false);
+  }
 
   // Redirect stdin to /dev/null. This is really a extra precaution
   // we already disallow access to linux shell as a result of
@@ -252,6 +303,7 @@ int fbossMain(int argc, char** argv, PlatformInitFn initPlatform) {
 
   // Now that we have parsed the command line flags, create the Platform object
   unique_ptr<Platform> platform = initPlatform();
+  EventTrace::dumpOnFailure(platform->getCrashEventTraceFile());
 
   // Create the SwSwitch and thrift handler
   SwSwitch sw(std::move(platform));
@@ -266,9 +318,10 @@ int fbossMain(int argc, char** argv, PlatformInitFn initPlatform) {
   init.start();
 
   TEventBase eventBase;
+  ThriftThreadPools thriftPools;
 
   // Create a timeout to call sw->publishStats() once every second.
-  StatsPublisher statsPublisher(&eventBase, &sw,
+  StatsPublisher statsPublisher(&eventBase, &sw, &thriftPools,
                                 std::chrono::milliseconds(
                                     FLAGS_stat_publish_interval_ms));
   statsPublisher.start();
@@ -279,9 +332,13 @@ int fbossMain(int argc, char** argv, PlatformInitFn initPlatform) {
   };
   SignalHandler signalHandler(&eventBase, &sw, stopServices);
 
-  // Start the thrift server
+  // Start the thrift server.  Its threads inherit the placement of this one.
+  ThreadPlacement::apply("thrift");
+  ThreadArenas::apply("thrift");
+  thriftPools.start();
   ThriftServer server;
   server.getEventBaseManager()->setEventBase(&eventBase, false);
+  server.setThreadManager(thriftPools.getThreadManager());
   server.setInterface(std::move(handler));
   TSocketAddress address;
   address.setFromLocalPort(FLAGS_port);
@@ -0,0 +1,324 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/MetricsExporter.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Conv.h>
+#include <folly/futures/Future.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <cctype>
+#include <cstring>
+#include <vector>
+
+DEFINE_int32(metrics_snapshot_ms, 1000,
+             "How long a rendering of the counters for the metrics endpoint "
+             "is reused for further scrapes");
+
+using folly::StringPiece;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+const char kMetricPrefix[] = "fboss_";
+const char kPortPrefix[] = "port";
+// A request must be complete within this time, and this size
+const milliseconds kRequestTimeout(5000);
+const size_t kMaxRequestSize = 8192;
+
+bool isDigits(StringPiece str) {
+  if (str.empty()) {
+    return false;
+  }
+  for (auto c : str) {
+    if (!isdigit(c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Metric names may only have letters, digits, underscores and colons
+std::string metricName(StringPiece name) {
+  std::string ret(kMetricPrefix);
+  ret.reserve(ret.size() + name.size());
+  for (auto c : name) {
+    ret.push_back(isalnum(c) || c == ':' ? c : '_');
+  }
+  return ret;
+}
+
+struct MetricFamily {
+  const char* type{nullptr};
+  std::vector<std::string> samples;
+};
+
+std::string httpResponse(StringPiece status, StringPiece contentType,
+                         StringPiece body) {
+  return folly::to<std::string>(
+      "HTTP/1.1 ", status, "\r\n",
+      "Content-Type: ", contentType, "\r\n",
+      "Content-Length: ", body.size(), "\r\n",
+      "Connection: close\r\n\r\n",
+      body);
+}
+
+} // unnamed namespace
+
+/*
+ * One HTTP connection.  It reads a single request, writes the response and
+ * is done.
+ */
+class MetricsExporter::Connection
+  : public folly::AsyncSocket::ReadCallback,
+    public folly::AsyncSocket::WriteCallback,
+    private folly::AsyncTimeout {
+ public:
+  Connection(MetricsExporter* exporter, int fd)
+    : AsyncTimeout(exporter->evb_),
+      exporter_(exporter),
+      socket_(new folly::AsyncSocket(exporter->evb_, fd)) {}
+
+  ~Connection() override {
+    // Closing the socket would otherwise call us back
+    socket_->setReadCB(nullptr);
+  }
+
+  void start() {
+    socket_->setReadCB(this);
+    scheduleTimeout(kRequestTimeout);
+  }
+
+ private:
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buf_;
+    *lenReturn = sizeof(buf_);
+  }
+  void readDataAvailable(size_t len) noexcept override {
+    request_.append(buf_, len);
+    if (request_.find("\r\n\r\n") != std::string::npos) {
+      respond();
+    } else if (request_.size() > kMaxRequestSize) {
+      exporter_->connectionDone(this);
+    }
+  }
+  void readEOF() noexcept override {
+    exporter_->connectionDone(this);
+  }
+  void readErr(const folly::AsyncSocketException& ex) noexcept override {
+    VLOG(3) << "metrics connection read error: " << ex.what();
+    exporter_->connectionDone(this);
+  }
+  void writeSuccess() noexcept override {
+    exporter_->connectionDone(this);
+  }
+  void writeErr(size_t /*bytesWritten*/,
+                const folly::AsyncSocketException& ex) noexcept override {
+    VLOG(3) << "metrics connection write error: " << ex.what();
+    exporter_->connectionDone(this);
+  }
+  void timeoutExpired() noexcept override {
+    exporter_->connectionDone(this);
+  }
+
+  void respond() noexcept {
+    cancelTimeout();
+    socket_->setReadCB(nullptr);
+    // The request line is "<method> <path>[?<query>] <version>"
+    StringPiece line(request_);
+    line = line.subpiece(0, line.find("\r\n"));
+    StringPiece method = line.subpiece(0, line.find(' '));
+    line.advance(std::min(line.size(), method.size() + 1));
+    StringPiece path = line.subpiece(0, line.find(' '));
+    path = path.subpiece(0, path.find('?'));
+
+    std::string response;
+    if (method != "GET") {
+      response = httpResponse("405 Method Not Allowed", "text/plain",
+                              "only GET is supported\n");
+    } else if (path != "/metrics") {
+      response = httpResponse("404 Not Found", "text/plain",
+                              "metrics are served on /metrics\n");
+    } else {
+      response = httpResponse(
+          "200 OK",
+          "application/openmetrics-text; version=1.0.0; charset=utf-8",
+          exporter_->getSnapshot());
+    }
+    // This calls writeSuccess() or writeErr() when done, which may be
+    // before it returns.
+    socket_->writeChain(this, folly::IOBuf::copyBuffer(response));
+  }
+
+  MetricsExporter* const exporter_{nullptr};
+  folly::AsyncSocket::UniquePtr socket_;
+  char buf_[1024];
+  std::string request_;
+};
+
+MetricsExporter::MetricsExporter(folly::EventBase* evb, uint16_t port)
+  : evb_(evb),
+    port_(port) {
+}
+
+MetricsExporter::~MetricsExporter() {
+  CHECK(!socket_) << "MetricsExporter destroyed without being stopped";
+  closeAll();
+}
+
+void MetricsExporter::start() {
+  evb_->runInEventBaseThread([this]() {
+    socket_ = folly::AsyncServerSocket::newSocket(evb_);
+    try {
+      socket_->bind(port_);
+      socket_->listen(128);
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "failed to serve metrics on port " << port_ << ": "
+                 << ex.what();
+      socket_.reset();
+      return;
+    }
+    socket_->addAcceptCallback(this, evb_);
+    socket_->startAccepting();
+    LOG(INFO) << "serving metrics on port " << port_;
+  });
+}
+
+void MetricsExporter::stop() {
+  via(evb_)
+    .then([this]() {
+      if (socket_) {
+        socket_->stopAccepting();
+        socket_.reset();
+      }
+      closeAll();
+    })
+    .onError([](const std::exception& e) {
+      LOG(FATAL) << "failed to stop metrics exporter: " << e.what();
+    })
+    .get();
+}
+
+void MetricsExporter::connectionAccepted(
+    int fd, const folly::SocketAddress& /*clientAddr*/) noexcept {
+  auto conn = new Connection(this, fd);
+  connections_.insert(conn);
+  conn->start();
+}
+
+void MetricsExporter::acceptError(const std::exception& ex) noexcept {
+  LOG(ERROR) << "error accepting metrics connection: " << ex.what();
+}
+
+void MetricsExporter::connectionDone(Connection* conn) {
+  if (connections_.erase(conn)) {
+    delete conn;
+  }
+}
+
+void MetricsExporter::closeAll() {
+  // Closing a connection with a write pending calls connectionDone()
+  std::unordered_set<Connection*> connections;
+  connections.swap(connections_);
+  for (auto* conn : connections) {
+    delete conn;
+  }
+}
+
+const std::string& MetricsExporter::getSnapshot() {
+  auto now = steady_clock::now();
+  if (snapshot_.empty() ||
+      now - snapshotTime_ >= milliseconds(FLAGS_metrics_snapshot_ms)) {
+    std::map<std::string, int64_t> counters;
+    fbData->getCounters(counters);
+    snapshot_ = render(counters);
+    snapshotTime_ = now;
+  }
+  return snapshot_;
+}
+
+std::string MetricsExporter::render(
+    const std::map<std::string, int64_t>& counters) {
+  std::map<std::string, MetricFamily> families;
+  for (const auto& counter : counters) {
+    StringPiece name(counter.first);
+    auto dot = name.rfind('.');
+    if (dot != StringPiece::npos && isDigits(name.subpiece(dot + 1))) {
+      // A windowed aggregation
+      continue;
+    }
+
+    std::string labels;
+    auto portEnd = name.find('.');
+    if (name.startsWith(kPortPrefix) && portEnd != StringPiece::npos) {
+      auto port = name.subpiece(strlen(kPortPrefix),
+                                portEnd - strlen(kPortPrefix));
+      if (isDigits(port)) {
+        labels = folly::to<std::string>("port=\"", port, "\"");
+        name.advance(portEnd + 1);
+      }
+    }
+
+    dot = name.rfind('.');
+    StringPiece base = name.subpiece(0, dot);
+    StringPiece aggregate = dot == StringPiece::npos ?
+      StringPiece() : name.subpiece(dot + 1);
+    std::string family;
+    std::string sample;
+    const char* type;
+    if (aggregate == "sum" || aggregate == "count") {
+      family = metricName(aggregate == "sum" ?
+                          base.str() : base.str() + "_count");
+      sample = family + "_total";
+      type = "counter";
+    } else if (aggregate.startsWith("p") && isDigits(aggregate.subpiece(1))) {
+      auto pct = folly::to<int>(aggregate.subpiece(1));
+      family = metricName(base);
+      sample = family;
+      labels += folly::to<std::string>(labels.empty() ? "" : ",",
+                                       "quantile=\"", pct / 100.0, "\"");
+      type = "summary";
+    } else {
+      family = metricName(name);
+      sample = family;
+      type = "gauge";
+    }
+
+    auto& entry = families[family];
+    if (entry.type && strcmp(entry.type, type) != 0) {
+      VLOG(2) << "not exporting " << counter.first << " as a " << type
+              << ", since " << family << " is a " << entry.type;
+      continue;
+    }
+    entry.type = type;
+    entry.samples.push_back(folly::to<std::string>(
+        sample, labels.empty() ? "" : "{", labels, labels.empty() ? "" : "}",
+        " ", counter.second));
+  }
+
+  std::string out;
+  for (const auto& entry : families) {
+    folly::toAppend("# TYPE ", entry.first, " ", entry.second.type, "\n",
+                    &out);
+    for (const auto& sample : entry.second.samples) {
+      folly::toAppend(sample, "\n", &out);
+    }
+  }
+  out.append("# EOF\n");
+  return out;
+}
+
+}} // facebook::fboss
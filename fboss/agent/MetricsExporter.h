@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/io/async/AsyncServerSocket.h>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace fboss {
+
+/**
+ * MetricsExporter serves the fb303 counters over HTTP, as OpenMetrics text
+ * on GET /metrics, so that they can be scraped without thrift tooling.
+ *
+ * The counters are those already published to fbData: the SwitchStats,
+ * the per-port stats and hardware counters that BcmSwitch::updateStats()
+ * collects, and the histograms.  A scrape only reads what was published,
+ * and the rendered text is cached for --metrics_snapshot_ms, so scrapes
+ * never touch the packet path or make SDK calls.
+ *
+ * Everything runs in the given EventBase thread.
+ */
+class MetricsExporter : private folly::AsyncServerSocket::AcceptCallback {
+ public:
+  MetricsExporter(folly::EventBase* evb, uint16_t port);
+  ~MetricsExporter();
+
+  /*
+   * Start or stop serving.  These may be called from any thread; stop()
+   * waits until the socket and all connections are closed.
+   */
+  void start();
+  void stop();
+
+  /*
+   * Render fb303 counters as OpenMetrics text.
+   *
+   * The counters "<name>.sum" and "<name>.count" become counters, and
+   * the "<name>.p<N>" histogram percentiles become summary quantiles.  Any
+   * other counter becomes a gauge.  The windowed aggregations, like
+   * "<name>.sum.60", are left out, since the scraper computes its own
+   * rates.  Per-port counters, named "port<N>.<name>", get a port label.
+   */
+  static std::string render(const std::map<std::string, int64_t>& counters);
+
+ private:
+  class Connection;
+
+  // Forbidden copy constructor and assignment operator
+  MetricsExporter(MetricsExporter const &) = delete;
+  MetricsExporter& operator=(MetricsExporter const &) = delete;
+
+  void connectionAccepted(int fd,
+                          const folly::SocketAddress& clientAddr) noexcept
+    override;
+  void acceptError(const std::exception& ex) noexcept override;
+
+  void connectionDone(Connection* conn);
+  void closeAll();
+  // The rendered counters, refreshed at most once per --metrics_snapshot_ms
+  const std::string& getSnapshot();
+
+  folly::EventBase* const evb_{nullptr};
+  const uint16_t port_{0};
+  std::shared_ptr<folly::AsyncServerSocket> socket_;
+  std::unordered_set<Connection*> connections_;
+  std::string snapshot_;
+  std::chrono::steady_clock::time_point snapshotTime_;
+};
+
+}} // facebook::fboss
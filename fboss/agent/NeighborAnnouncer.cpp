@@ -0,0 +1,268 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborAnnouncer.h"
+#include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+#include <folly/Random.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+
+DEFINE_int32(neighbor_announce_count, 3,
+             "How many gratuitous ARPs or unsolicited neighbor advertisements "
+             "to send for each address added to an interface.  0 disables "
+             "announcements");
+DEFINE_int32(neighbor_announce_interval_ms, 1000,
+             "The time, in milliseconds, between repeated announcements of "
+             "the same address");
+DEFINE_int32(neighbor_announce_jitter_ms, 100,
+             "The maximum random delay, in milliseconds, added to each round "
+             "of announcements");
+DEFINE_int32(neighbor_announce_pps, 100,
+             "The maximum rate, in packets per second, at which announcements "
+             "are sent across all interfaces");
+DEFINE_int32(neighbor_announce_burst, 20,
+             "The maximum number of announcements sent back to back");
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using folly::IPAddress;
+
+namespace facebook { namespace fboss {
+
+class NeighborAnnouncerImpl : private folly::AsyncTimeout {
+ public:
+  explicit NeighborAnnouncerImpl(SwSwitch* sw);
+
+  bool isStarted() const {
+    return started_;
+  }
+
+  void stateChanged(const StateDelta& delta);
+
+ private:
+  typedef std::pair<InterfaceID, IPAddress> AnnouncementKey;
+  struct Announcement {
+    AnnouncementKey key;
+    // Rounds left to send, including this one
+    uint32_t remaining;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  NeighborAnnouncerImpl(NeighborAnnouncerImpl const &) = delete;
+  NeighborAnnouncerImpl& operator=(NeighborAnnouncerImpl const &) = delete;
+
+  bool enabled() const {
+    return count_ > 0 && tokensPerMs_ > 0;
+  }
+
+  void addInterface(const Interface* oldIntf, const Interface* newIntf,
+                    steady_clock::time_point now);
+  void schedule(Announcement announcement, steady_clock::time_point after);
+  bool send(const AnnouncementKey& key);
+  void scheduleNext(steady_clock::time_point now);
+
+  void timeoutExpired() noexcept override;
+
+  SwSwitch* const sw_{nullptr};
+  const uint32_t count_{0};
+  const milliseconds interval_;
+  const uint32_t jitterMs_{0};
+  const double tokensPerMs_{0};
+  const double burst_{0};
+  double tokens_{0};
+  steady_clock::time_point lastRefill_;
+  bool started_{false};
+
+  /*
+   * Announcements are kept in queue_ by the time they are next due.  Due
+   * announcements move to backlog_, in due order, until the token bucket
+   * allows them to be sent.  queued_ holds the addresses in either of them,
+   * so an address that is re-added while it is still being announced is not
+   * announced twice as often.
+   */
+  std::multimap<steady_clock::time_point, Announcement> queue_;
+  std::deque<Announcement> backlog_;
+  std::set<AnnouncementKey> queued_;
+};
+
+NeighborAnnouncerImpl::NeighborAnnouncerImpl(SwSwitch* sw)
+  : AsyncTimeout(sw->getBackgroundEVB()),
+    sw_(sw),
+    count_(std::max(0, FLAGS_neighbor_announce_count)),
+    interval_(std::max(0, FLAGS_neighbor_announce_interval_ms)),
+    jitterMs_(std::max(0, FLAGS_neighbor_announce_jitter_ms)),
+    tokensPerMs_(double(std::max(0, FLAGS_neighbor_announce_pps)) / 1000),
+    burst_(std::max(1, FLAGS_neighbor_announce_burst)),
+    tokens_(burst_),
+    lastRefill_(steady_clock::now()) {
+}
+
+void NeighborAnnouncerImpl::stateChanged(const StateDelta& delta) {
+  started_ = true;
+  if (!enabled()) {
+    return;
+  }
+  if (delta.oldState()->getInterfaces()->size() == 0) {
+    // This is the config applied at boot.  Our MAC doesn't change across
+    // restarts, so any entries neighbors still have for us are correct.
+    return;
+  }
+  auto now = steady_clock::now();
+  for (const auto& entry : delta.getIntfsDelta()) {
+    // Announcements for deleted interfaces and addresses are dropped when
+    // they come due.
+    if (entry.getNew()) {
+      addInterface(entry.getOld().get(), entry.getNew().get(), now);
+    }
+  }
+  scheduleNext(now);
+}
+
+void NeighborAnnouncerImpl::addInterface(const Interface* oldIntf,
+                                         const Interface* newIntf,
+                                         steady_clock::time_point now) {
+  // Neighbors need to hear about every address again if our MAC changed
+  bool macChanged = oldIntf && oldIntf->getMac() != newIntf->getMac();
+  for (const auto& addr : newIntf->getAddresses()) {
+    if (oldIntf && !macChanged && oldIntf->hasAddress(addr.first)) {
+      continue;
+    }
+    AnnouncementKey key(newIntf->getID(), addr.first);
+    if (!queued_.insert(key).second) {
+      continue;
+    }
+    schedule(Announcement{std::move(key), count_}, now);
+  }
+}
+
+void NeighborAnnouncerImpl::schedule(Announcement announcement,
+                                     steady_clock::time_point after) {
+  auto due = after;
+  if (jitterMs_ > 0) {
+    due += milliseconds(folly::Random::rand32(jitterMs_ + 1));
+  }
+  queue_.emplace(due, std::move(announcement));
+}
+
+bool NeighborAnnouncerImpl::send(const AnnouncementKey& key) {
+  // Announce the address only if it is still configured, and with the
+  // interface's current MAC.
+  auto intf = sw_->getState()->getInterfaces()->getInterfaceIf(key.first);
+  if (!intf || !intf->hasAddress(key.second)) {
+    VLOG(4) << "not announcing " << key.second << " on interface "
+            << key.first << ": address was removed";
+    return false;
+  }
+  VLOG(4) << "announcing " << key.second << " on interface " << key.first;
+  if (key.second.isV4()) {
+    sw_->getArpHandler()->sendGratuitousArp(intf, key.second.asV4());
+  } else {
+    sw_->getIPv6Handler()->sendUnsolicitedNeighborAdvertisement(
+        intf, key.second.asV6());
+  }
+  sw_->stats()->neighborAnnounceSent();
+  return true;
+}
+
+void NeighborAnnouncerImpl::scheduleNext(steady_clock::time_point now) {
+  milliseconds timeout;
+  if (!backlog_.empty()) {
+    // Wait for the next token
+    timeout = milliseconds(
+        static_cast<int64_t>((1 - tokens_) / tokensPerMs_) + 1);
+  } else if (!queue_.empty()) {
+    auto due = queue_.begin()->first;
+    // Round up, so we never wake up just before the announcement is due
+    timeout = due > now ?
+      duration_cast<milliseconds>(due - now) + milliseconds(1) :
+      milliseconds(0);
+  } else {
+    cancelTimeout();
+    return;
+  }
+  scheduleTimeout(timeout);
+}
+
+void NeighborAnnouncerImpl::timeoutExpired() noexcept {
+  auto now = steady_clock::now();
+  std::chrono::duration<double, std::milli> elapsed = now - lastRefill_;
+  tokens_ = std::min(burst_, tokens_ + tokensPerMs_ * elapsed.count());
+  lastRefill_ = now;
+
+  size_t newlyDue = 0;
+  while (!queue_.empty() && queue_.begin()->first <= now) {
+    backlog_.push_back(std::move(queue_.begin()->second));
+    queue_.erase(queue_.begin());
+    ++newlyDue;
+  }
+
+  while (tokens_ >= 1 && !backlog_.empty()) {
+    auto announcement = std::move(backlog_.front());
+    backlog_.pop_front();
+    if (send(announcement.key)) {
+      tokens_ -= 1;
+      if (--announcement.remaining > 0) {
+        schedule(std::move(announcement), now + interval_);
+        continue;
+      }
+    }
+    queued_.erase(announcement.key);
+  }
+
+  // Only count announcements the first time they have to wait; the ones
+  // that became due now are at the back of the backlog.
+  auto deferred = std::min(newlyDue, backlog_.size());
+  for (size_t n = 0; n < deferred; ++n) {
+    sw_->stats()->neighborAnnounceDeferred();
+  }
+  scheduleNext(now);
+}
+
+NeighborAnnouncer::NeighborAnnouncer(SwSwitch* sw)
+    : impl_(new NeighborAnnouncerImpl(sw)),
+      sw_(sw) {}
+
+NeighborAnnouncer::~NeighborAnnouncer() {
+  auto* impl = impl_;
+  if (!impl->isStarted()) {
+    // No state change has ever been delivered, so the timeout was never
+    // scheduled and the background thread may not even be running.
+    delete impl;
+    return;
+  }
+
+  // Delete the implementation in the background thread, where its timeout
+  // may be scheduled.
+  via(sw_->getBackgroundEVB())
+    .then([impl]() { delete impl; })
+    .onError([](const std::exception& e) {
+      LOG(FATAL) << "failed to stop neighbor announcer: " << e.what();
+    })
+    .get();
+}
+
+void NeighborAnnouncer::stateChanged(const StateDelta& delta) {
+  CHECK(sw_->getBackgroundEVB()->inRunningEventBaseThread());
+  impl_->stateChanged(delta);
+}
+
+}} // facebook::fboss
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/StateObserver.h"
+
+namespace facebook { namespace fboss {
+
+class NeighborAnnouncerImpl;
+class StateDelta;
+class SwSwitch;
+
+/**
+ * NeighborAnnouncer sends gratuitous ARPs and unsolicited neighbor
+ * advertisements for interface addresses as they are added to the
+ * SwitchState, e.g. when a config is applied or a VIP moves to this switch,
+ * so that neighbors update their caches without waiting for them to expire.
+ * The config applied at boot is not announced.
+ *
+ * Each address is announced --neighbor_announce_count times, with
+ * --neighbor_announce_interval_ms between rounds.  Each round is delayed by
+ * up to --neighbor_announce_jitter_ms, so switches that get the same config
+ * at the same time don't announce in lock step.  The announcements for all
+ * interfaces share a single token bucket (--neighbor_announce_pps), so
+ * announcing hundreds of addresses never bursts the CPU TX queue.
+ *
+ * All of the work is done in the background thread, where state changes
+ * are delivered.
+ */
+class NeighborAnnouncer : public StateObserver {
+ public:
+  explicit NeighborAnnouncer(SwSwitch* sw);
+  ~NeighborAnnouncer();
+
+  void stateChanged(const StateDelta& delta) override;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  NeighborAnnouncer(NeighborAnnouncer const &) = delete;
+  NeighborAnnouncer& operator=(NeighborAnnouncer const &) = delete;
+
+  /**
+   * impl_ should only ever be accessed from the background thread, so we
+   * don't need to lock accesses.
+   */
+  NeighborAnnouncerImpl* impl_{nullptr};
+  SwSwitch* sw_{nullptr};
+};
+
+}} // facebook::fboss
@@ -0,0 +1,314 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborHoldQueue.h"
+
+#include "fboss/agent/IPv4Handler.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/Platform.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/RouteTable.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteTableRib.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/state/VlanMapDelta.h"
+
+#include <folly/io/Cursor.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <cstring>
+
+DEFINE_int32(neighbor_hold_packets, 4,
+             "The number of packets to an unresolved next hop held for each "
+             "destination until the next hop resolves.  0 disables holding, "
+             "so the packets are dropped instead");
+DEFINE_int32(neighbor_hold_destinations, 256,
+             "The number of destinations packets can be held for at once");
+DEFINE_int32(neighbor_hold_timeout_ms, 3000,
+             "Drop the packets held for a destination if none of its next "
+             "hops resolved within this many milliseconds");
+
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::IOBuf;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::unique_ptr;
+
+namespace {
+
+using namespace facebook::fboss;
+
+const RouteTableRib<IPAddressV4>* getRib(const RouteTable* table,
+                                         const IPAddressV4&) {
+  return table->getRibV4().get();
+}
+const RouteTableRib<IPAddressV6>* getRib(const RouteTable* table,
+                                         const IPAddressV6&) {
+  return table->getRibV6().get();
+}
+
+IPAddressV4 toAddr(const IPAddress& ip, const IPAddressV4&) {
+  return ip.asV4();
+}
+IPAddressV6 toAddr(const IPAddress& ip, const IPAddressV6&) {
+  return ip.asV6();
+}
+
+template<typename AddrT>
+bool isNeighborResolved(const Vlan* vlan, const AddrT& ip);
+
+template<>
+bool isNeighborResolved(const Vlan* vlan, const IPAddressV4& ip) {
+  auto entry = vlan->getArpTable()->getEntryIf(ip);
+  return entry && !entry->isPending();
+}
+
+template<>
+bool isNeighborResolved(const Vlan* vlan, const IPAddressV6& ip) {
+  auto entry = vlan->getNdpTable()->getEntryIf(ip);
+  return entry && !entry->isPending();
+}
+
+template<typename DELTA>
+bool resolvesAny(const DELTA& delta) {
+  for (const auto& entry : delta) {
+    const auto& newEntry = entry.getNew();
+    const auto& oldEntry = entry.getOld();
+    if (newEntry && !newEntry->isPending() &&
+        (!oldEntry || oldEntry->isPending())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the delta may have made a next hop reachable
+bool mayResolve(const StateDelta& delta) {
+  if (delta.oldState()->getRouteTables() !=
+      delta.newState()->getRouteTables()) {
+    return true;
+  }
+  for (const auto& vlanDelta : delta.getVlansDelta()) {
+    if (!vlanDelta.getNew()) {
+      continue;
+    }
+    if (!vlanDelta.getOld() ||
+        resolvesAny(vlanDelta.getArpDelta()) ||
+        resolvesAny(vlanDelta.getNdpDelta())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+NeighborHoldQueue::NeighborHoldQueue(SwSwitch* sw)
+  : NeighborHoldQueue(sw,
+                      std::max(FLAGS_neighbor_hold_destinations, 0),
+                      std::max(FLAGS_neighbor_hold_packets, 0),
+                      milliseconds(FLAGS_neighbor_hold_timeout_ms)) {
+}
+
+NeighborHoldQueue::NeighborHoldQueue(SwSwitch* sw, uint32_t maxDestinations,
+                                     uint32_t maxPackets, milliseconds timeout)
+  : sw_(sw),
+    maxDestinations_(maxDestinations),
+    maxPackets_(maxPackets),
+    timeout_(timeout) {
+}
+
+bool NeighborHoldQueue::hold(const IPAddress& dest, Cursor cursor,
+                             uint32_t length) {
+  if (maxPackets_ == 0 || maxDestinations_ == 0) {
+    return false;
+  }
+  auto now = steady_clock::now();
+  uint32_t dropped = 0;
+  bool held = false;
+  {
+    std::lock_guard<std::mutex> g(mutex_);
+    auto iter = destinations_.find(dest);
+    if (iter != destinations_.end() && now >= iter->second.expires) {
+      dropped += erase(iter);
+      iter = destinations_.end();
+    }
+    // Check new destinations against the latest state, rather than the one
+    // the packet was handled with, so that a next hop resolved since then
+    // is not waited for.  Any later state is applied, and checked, after
+    // this.
+    bool wait = iter != destinations_.end() ||
+      resolve(*sw_->getState(), dest) == Resolution::UNRESOLVED;
+    if (wait && iter == destinations_.end()) {
+      if (destinations_.size() >= maxDestinations_) {
+        for (auto it = destinations_.begin(); it != destinations_.end();) {
+          auto next = std::next(it);
+          if (now >= it->second.expires) {
+            dropped += erase(it);
+          }
+          it = next;
+        }
+      }
+      if (destinations_.size() < maxDestinations_) {
+        iter = destinations_.emplace(dest, Destination()).first;
+        iter->second.expires = now + timeout_;
+      }
+    }
+    if (wait) {
+      if (iter != destinations_.end() &&
+          iter->second.packets.size() < maxPackets_) {
+        auto buf = IOBuf::create(length);
+        cursor.pull(buf->writableData(), length);
+        buf->append(length);
+        iter->second.packets.push_back(std::move(buf));
+        ++numHeld_;
+        held = true;
+      } else {
+        ++dropped;
+      }
+    }
+  }
+  auto* stats = sw_->stats();
+  if (dropped) {
+    stats->neighborHoldDropped(dropped);
+  }
+  if (held) {
+    stats->neighborHoldQueued();
+  }
+  return held;
+}
+
+void NeighborHoldQueue::stateApplied(const StateDelta& delta) {
+  if (numHeld() == 0) {
+    return;
+  }
+  bool check = mayResolve(delta);
+  auto now = steady_clock::now();
+  const auto& state = *delta.newState();
+  std::vector<unique_ptr<IOBuf>> ready;
+  uint32_t dropped = 0;
+  {
+    std::lock_guard<std::mutex> g(mutex_);
+    for (auto it = destinations_.begin(); it != destinations_.end();) {
+      auto next = std::next(it);
+      auto resolution = check ? resolve(state, it->first) :
+        Resolution::UNRESOLVED;
+      if (resolution == Resolution::RESOLVED) {
+        numHeld_ -= it->second.packets.size();
+        for (auto& buf : it->second.packets) {
+          ready.push_back(std::move(buf));
+        }
+        destinations_.erase(it);
+      } else if (resolution == Resolution::UNREACHABLE ||
+                 now >= it->second.expires) {
+        dropped += erase(it);
+      }
+      it = next;
+    }
+  }
+  if (dropped) {
+    sw_->stats()->neighborHoldDropped(dropped);
+  }
+  if (!ready.empty()) {
+    sw_->stats()->neighborHoldFlushed(ready.size());
+    send(std::move(ready));
+  }
+}
+
+uint32_t NeighborHoldQueue::erase(DestinationMap::iterator iter) {
+  uint32_t count = iter->second.packets.size();
+  numHeld_ -= count;
+  destinations_.erase(iter);
+  return count;
+}
+
+void NeighborHoldQueue::send(std::vector<unique_ptr<IOBuf>> packets) {
+  // As for packets from the host, the CPU MAC makes the hardware route the
+  // packets, and fill in the real source and destination MACs
+  auto cpuMac = sw_->getPlatform()->getLocalMac();
+  auto cpuVlan = sw_->getCPUVlan();
+  const uint32_t l2Len = EthHdr::SIZE;
+  const uint32_t minLen = 68;
+  std::vector<unique_ptr<TxPacket>> pkts;
+  pkts.reserve(packets.size());
+  for (const auto& buf : packets) {
+    uint32_t l3Len = buf->length();
+    uint32_t len = std::max(l2Len + l3Len, minLen);
+    auto pkt = sw_->allocatePacket(len);
+    RWPrivateCursor cursor(pkt->buf());
+    uint8_t version = l3Len ? buf->data()[0] >> 4 : 0;
+    uint16_t protocol = (version == 6) ? IPv6Handler::ETHERTYPE_IPV6 :
+      IPv4Handler::ETHERTYPE_IPV4;
+    TxPacket::writeEthHeader(&cursor, cpuMac, cpuMac, cpuVlan, protocol);
+    cursor.push(buf->data(), l3Len);
+    auto pad = len - l2Len - l3Len;
+    if (pad) {
+      memset(cursor.writableData(), 0, pad);
+    }
+    pkts.push_back(std::move(pkt));
+  }
+  sw_->sendPacketsSwitched(std::move(pkts));
+}
+
+NeighborHoldQueue::Resolution NeighborHoldQueue::resolve(
+    const SwitchState& state, const IPAddress& dest) {
+  return dest.isV4() ? resolve(state, dest.asV4()) :
+    resolve(state, dest.asV6());
+}
+
+template<typename AddrT>
+NeighborHoldQueue::Resolution NeighborHoldQueue::resolve(
+    const SwitchState& state, const AddrT& dest) {
+  // TODO: assume vrf 0 now, as the IPv4Handler and IPv6Handler do
+  auto routeTable = state.getRouteTables()->getRouteTableIf(RouterID(0));
+  if (!routeTable) {
+    return Resolution::UNREACHABLE;
+  }
+  auto route = getRib(routeTable.get(), dest)->longestMatch(dest);
+  if (!route) {
+    return Resolution::UNREACHABLE;
+  }
+  auto result = Resolution::UNREACHABLE;
+  auto intfs = state.getInterfaces();
+  for (const auto& nh : route->getForwardInfo().getNexthops()) {
+    auto intf = intfs->getInterfaceIf(nh.intf);
+    if (!intf) {
+      continue;
+    }
+    auto vlan = state.getVlans()->getVlanIf(intf->getVlanID());
+    if (!vlan) {
+      continue;
+    }
+    auto target = route->isConnected() ? dest : toAddr(nh.nexthop, dest);
+    if (isNeighborResolved(vlan.get(), target)) {
+      return Resolution::RESOLVED;
+    }
+    result = Resolution::UNRESOLVED;
+  }
+  return result;
+}
+
+}} // facebook::fboss
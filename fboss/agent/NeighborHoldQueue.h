@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/IPAddress.h>
+#include <folly/io/IOBuf.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace folly { namespace io {
+class Cursor;
+}}
+
+namespace facebook { namespace fboss {
+
+class StateDelta;
+class SwSwitch;
+class SwitchState;
+
+/*
+ * NeighborHoldQueue holds the routed packets punted because their next hop
+ * is not resolved yet, and sends them once it is, so that the first packets
+ * of a flow to a new host are not lost while it is resolved.
+ *
+ * Packets are held by destination, up to --neighbor_hold_packets for each
+ * of up to --neighbor_hold_destinations destinations.  Once the hardware
+ * has been programmed with a state in which one of the destination's next
+ * hops is resolved, its packets are sent in order through the switched TX
+ * path, which routes them like any other packet.  Packets whose next hop
+ * does not resolve within --neighbor_hold_timeout_ms are dropped.
+ *
+ * Packets are held from the packet handling threads, and sent from the
+ * state update thread.
+ */
+class NeighborHoldQueue {
+ public:
+  /*
+   * Create a queue sized by the --neighbor_hold_* flags.
+   */
+  explicit NeighborHoldQueue(SwSwitch* sw);
+  NeighborHoldQueue(SwSwitch* sw, uint32_t maxDestinations,
+                    uint32_t maxPackets, std::chrono::milliseconds timeout);
+
+  /*
+   * Hold a copy of the 'length' bytes of the IP packet at the cursor until
+   * the next hop to dest resolves.  Returns false, and holds nothing, if the
+   * destination's queue is full, or dest is resolved or unreachable in the
+   * current state; the caller then drops the packet.
+   */
+  bool hold(const folly::IPAddress& dest, folly::io::Cursor cursor,
+            uint32_t length);
+
+  /*
+   * Called once the hardware has been programmed with the delta's new
+   * state.  Sends the packets of the destinations the delta resolved, and
+   * drops those that have waited too long.
+   */
+  void stateApplied(const StateDelta& delta);
+
+  /*
+   * The number of packets held, for all destinations.
+   */
+  uint32_t numHeld() const {
+    return numHeld_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  NeighborHoldQueue(NeighborHoldQueue const &) = delete;
+  NeighborHoldQueue& operator=(NeighborHoldQueue const &) = delete;
+
+  enum class Resolution {
+    // Still waiting for a next hop
+    UNRESOLVED,
+    // At least one next hop can be forwarded to
+    RESOLVED,
+    // There is no route with next hops to the destination
+    UNREACHABLE,
+  };
+
+  struct Destination {
+    std::chrono::steady_clock::time_point expires;
+    std::vector<std::unique_ptr<folly::IOBuf>> packets;
+  };
+  typedef std::map<folly::IPAddress, Destination> DestinationMap;
+
+  static Resolution resolve(const SwitchState& state,
+                            const folly::IPAddress& dest);
+  template<typename AddrT>
+  static Resolution resolve(const SwitchState& state, const AddrT& dest);
+
+  // Erase the destination, and return the number of packets dropped with it
+  uint32_t erase(DestinationMap::iterator iter);
+  void send(std::vector<std::unique_ptr<folly::IOBuf>> packets);
+
+  SwSwitch* sw_{nullptr};
+  const uint32_t maxDestinations_{0};
+  const uint32_t maxPackets_{0};
+  const std::chrono::milliseconds timeout_;
+
+  std::atomic<uint32_t> numHeld_{0};
+  std::mutex mutex_;
+  DestinationMap destinations_;
+};
+
+}} // facebook::fboss
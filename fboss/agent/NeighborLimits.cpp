@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborLimits.h"
+
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <gflags/gflags.h>
+#include <algorithm>
+
+DEFINE_int32(max_neighbors, 16384,
+             "The maximum number of ARP and NDP entries, pending or "
+             "resolved, across all VLANs.  0 for no limit");
+DEFINE_int32(max_neighbors_per_vlan, 0,
+             "The maximum number of ARP and NDP entries, pending or "
+             "resolved, on each VLAN.  0 for no limit");
+DEFINE_int32(neighbor_evict_headroom_pct, 10,
+             "The percentage of each neighbor limit that the least recently "
+             "used entries are evicted to keep free for new entries");
+
+namespace facebook { namespace fboss {
+
+NeighborLimits::NeighborLimits(const SwitchState* state)
+    : state_(state),
+      maxEntries_(getMaxEntries()),
+      maxEntriesPerVlan_(getMaxEntriesPerVlan()) {
+  if (maxEntries_ == 0) {
+    return;
+  }
+  for (const auto& vlan : *state->getVlans()) {
+    numEntries_ += vlan->getArpTable()->size() + vlan->getNdpTable()->size();
+  }
+}
+
+bool NeighborLimits::tryAdd(VlanID vlan) {
+  if (maxEntries_ > 0 && numEntries_ >= maxEntries_) {
+    return false;
+  }
+  if (maxEntriesPerVlan_ > 0) {
+    auto it = numVlanEntries_.find(vlan);
+    if (it == numVlanEntries_.end()) {
+      it = numVlanEntries_.emplace(vlan, getNumEntries(state_, vlan)).first;
+    }
+    if (it->second >= maxEntriesPerVlan_) {
+      return false;
+    }
+    ++it->second;
+  }
+  ++numEntries_;
+  return true;
+}
+
+bool NeighborLimits::enabled() {
+  return getMaxEntries() > 0 || getMaxEntriesPerVlan() > 0;
+}
+
+uint64_t NeighborLimits::getMaxEntries() {
+  return std::max(FLAGS_max_neighbors, 0);
+}
+
+uint64_t NeighborLimits::getMaxEntriesPerVlan() {
+  return std::max(FLAGS_max_neighbors_per_vlan, 0);
+}
+
+uint64_t NeighborLimits::getEvictionTarget(uint64_t limit) {
+  auto pct = std::min(std::max(FLAGS_neighbor_evict_headroom_pct, 0), 100);
+  return limit - limit * pct / 100;
+}
+
+uint64_t NeighborLimits::getNumEntries(const SwitchState* state,
+                                       VlanID vlan) {
+  auto vlanIf = state->getVlans()->getVlanIf(vlan);
+  if (!vlanIf) {
+    return 0;
+  }
+  return vlanIf->getArpTable()->size() + vlanIf->getNdpTable()->size();
+}
+
+}} // facebook::fboss
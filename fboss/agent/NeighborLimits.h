@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <boost/container/flat_map.hpp>
+#include <cstdint>
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+
+/*
+ * NeighborLimits caps the number of ARP and NDP entries, pending or
+ * resolved, on each VLAN (--max_neighbors_per_vlan) and across all VLANs
+ * (--max_neighbors).
+ *
+ * One is created for each state update that adds neighbor entries.  It
+ * counts the entries of the state it starts from once, and then counts
+ * each entry added through it against the limits.
+ *
+ * The NeighborUpdater evicts the least recently used entries in the
+ * background, to keep the tables a little below the limits, so the limits
+ * only turn new entries away while they are learned faster than they can
+ * be evicted.
+ */
+class NeighborLimits {
+ public:
+  explicit NeighborLimits(const SwitchState* state);
+
+  /*
+   * Whether one more entry can be added on the VLAN.  If so, it is counted
+   * against the limits.
+   */
+  bool tryAdd(VlanID vlan);
+
+  // Whether either limit is set
+  static bool enabled();
+  static uint64_t getMaxEntries();
+  static uint64_t getMaxEntriesPerVlan();
+  /*
+   * The number of entries eviction brings a table with the given limit back
+   * down to, leaving --neighbor_evict_headroom_pct of it free for new
+   * entries.  0 for no limit.
+   */
+  static uint64_t getEvictionTarget(uint64_t limit);
+  // The number of ARP and NDP entries on the VLAN, or 0 if it is gone
+  static uint64_t getNumEntries(const SwitchState* state, VlanID vlan);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  NeighborLimits(NeighborLimits const &) = delete;
+  NeighborLimits& operator=(NeighborLimits const &) = delete;
+
+  const SwitchState* state_{nullptr};
+  const uint64_t maxEntries_{0};
+  const uint64_t maxEntriesPerVlan_{0};
+  uint64_t numEntries_{0};
+  // The VLANs entries were added on so far, and their number of entries
+  boost::container::flat_map<VlanID, uint64_t> numVlanEntries_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborResolutionCache.h"
+
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+DEFINE_int32(neighbor_resolution_cache_size, 1024,
+             "The number of destinations whose neighbor resolution is "
+             "remembered, to avoid resolving the destination again for "
+             "each punted packet.  0 disables the cache");
+DEFINE_int32(neighbor_resolution_retry_ms, 1000,
+             "Resolve a destination again, and so resend any neighbor "
+             "requests for it, after this many milliseconds even if the "
+             "switch state has not changed");
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+template<typename AddrT>
+NeighborResolutionCache<AddrT>::NeighborResolutionCache()
+  : NeighborResolutionCache(
+      std::max(FLAGS_neighbor_resolution_cache_size, 0),
+      milliseconds(FLAGS_neighbor_resolution_retry_ms)) {
+}
+
+template<typename AddrT>
+NeighborResolutionCache<AddrT>::NeighborResolutionCache(size_t numSlots,
+                                                        milliseconds retry)
+  : numSlots_(numSlots),
+    retry_(retry),
+    slots_(numSlots ? new Slot[numSlots] : nullptr) {
+}
+
+template<typename AddrT>
+typename NeighborResolutionCache<AddrT>::Slot*
+NeighborResolutionCache<AddrT>::getSlot(const AddrT& dest) {
+  return &slots_[std::hash<AddrT>()(dest) % numSlots_];
+}
+
+template<typename AddrT>
+bool NeighborResolutionCache<AddrT>::lookup(const SwitchState& state,
+                                            const AddrT& dest,
+                                            Result* result) {
+  if (!numSlots_) {
+    return false;
+  }
+  auto* slot = getSlot(dest);
+  std::lock_guard<folly::SpinLock> guard(slot->lock);
+  if (!slot->valid ||
+      slot->dest != dest ||
+      slot->stateID != state.getNodeID() ||
+      slot->generation != state.getGeneration()) {
+    return false;
+  }
+  if (slot->result == Result::REQUESTED &&
+      steady_clock::now() >= slot->expires) {
+    slot->valid = false;
+    return false;
+  }
+  *result = slot->result;
+  return true;
+}
+
+template<typename AddrT>
+void NeighborResolutionCache<AddrT>::record(const SwitchState& state,
+                                            const AddrT& dest,
+                                            Result result) {
+  if (!numSlots_) {
+    return;
+  }
+  auto* slot = getSlot(dest);
+  std::lock_guard<folly::SpinLock> guard(slot->lock);
+  slot->valid = true;
+  slot->dest = dest;
+  slot->stateID = state.getNodeID();
+  slot->generation = state.getGeneration();
+  slot->result = result;
+  if (result == Result::REQUESTED) {
+    slot->expires = steady_clock::now() + retry_;
+  }
+}
+
+template class NeighborResolutionCache<folly::IPAddressV4>;
+template class NeighborResolutionCache<folly::IPAddressV6>;
+
+}} // facebook::fboss
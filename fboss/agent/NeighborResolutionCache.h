@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <folly/SpinLock.h>
+#include <chrono>
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+
+/*
+ * NeighborResolutionCache remembers how the destinations of packets punted
+ * for a missing neighbor were last resolved.
+ *
+ * Resolving a destination means looking up its route, the interface and
+ * VLAN of each next hop, and then the next hop in the VLAN's neighbor
+ * table.  While a destination is unresolved, every packet sent to it is
+ * punted, so the same destination is resolved over and over.  The cache
+ * lets IPv4Handler and IPv6Handler skip that for all but the first packet.
+ *
+ * Results only hold for the SwitchState they were computed from, so each
+ * one records the state's NodeID and generation, and is ignored for any
+ * other state.  Results that sent neighbor requests also expire after
+ * --neighbor_resolution_retry_ms, so that a lost request is retried even if
+ * the state does not change.
+ *
+ * The cache is direct mapped: each destination hashes to a single slot,
+ * which any other destination hashing to it replaces.  Each slot has its
+ * own lock, since packets are handled from multiple threads.
+ *
+ * AddrT is folly::IPAddressV4 or folly::IPAddressV6.
+ */
+template<typename AddrT>
+class NeighborResolutionCache {
+ public:
+  enum class Result : uint8_t {
+    // There is no route to the destination
+    NO_ROUTE,
+    // Every next hop has a neighbor entry already, possibly a pending one
+    RESOLVED,
+    // Requests were sent for the next hops that have no neighbor entry
+    REQUESTED,
+  };
+
+  /*
+   * Create a cache with --neighbor_resolution_cache_size slots.
+   */
+  NeighborResolutionCache();
+  NeighborResolutionCache(size_t numSlots, std::chrono::milliseconds retry);
+
+  /*
+   * Look up the result recorded for the destination in this state.
+   * Returns false if there is none.
+   */
+  bool lookup(const SwitchState& state, const AddrT& dest, Result* result);
+
+  /*
+   * Record the result of resolving the destination in this state.
+   */
+  void record(const SwitchState& state, const AddrT& dest, Result result);
+
+  /*
+   * Whether the cache has any slots.  A cache with none records nothing.
+   */
+  bool isEnabled() const {
+    return numSlots_ > 0;
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  NeighborResolutionCache(NeighborResolutionCache const &) = delete;
+  NeighborResolutionCache& operator=(NeighborResolutionCache const &) = delete;
+
+  struct Slot {
+    folly::SpinLock lock;
+    bool valid{false};
+    AddrT dest;
+    NodeID stateID{0};
+    uint32_t generation{0};
+    Result result{Result::NO_ROUTE};
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  Slot* getSlot(const AddrT& dest);
+
+  const size_t numSlots_{0};
+  const std::chrono::milliseconds retry_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+}} // facebook::fboss
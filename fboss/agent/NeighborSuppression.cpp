@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborSuppression.h"
+
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <boost/container/flat_set.hpp>
+#include <folly/io/Cursor.h>
+#include <algorithm>
+#include <cstring>
+
+using boost::container::flat_set;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+using std::shared_ptr;
+using std::unique_ptr;
+
+namespace facebook { namespace fboss {
+
+size_t floodNeighborRequest(SwSwitch* sw,
+                            const shared_ptr<SwitchState>& state,
+                            const RxPacket* pkt) {
+  auto vlan = state->getVlans()->getVlanIf(pkt->getSrcVlan());
+  if (!vlan) {
+    return 0;
+  }
+
+  // The request is sent again with a header of our own, since it may have
+  // been received untagged
+  Cursor cursor(pkt->buf());
+  EthHdr eth(cursor);
+  const uint32_t l2Len = EthHdr::SIZE;
+  const uint32_t minLen = 68;
+  uint32_t payloadLen = cursor.totalLength();
+  uint32_t len = std::max(l2Len + payloadLen, minLen);
+
+  const auto& aggPorts = state->getAggregatePorts();
+  auto ingressAgg = aggPorts->getAggregatePortForMember(pkt->getSrcPort());
+  flat_set<AggregatePortID> aggsFlooded;
+  if (ingressAgg) {
+    aggsFlooded.insert(ingressAgg->getID());
+  }
+
+  std::vector<std::pair<unique_ptr<TxPacket>, PortID>> pkts;
+  for (const auto& member : vlan->getPorts()) {
+    auto port = member.first;
+    if (port == pkt->getSrcPort()) {
+      continue;
+    }
+    auto agg = aggPorts->getAggregatePortForMember(port);
+    if (agg) {
+      if (!aggsFlooded.insert(agg->getID()).second) {
+        continue;
+      }
+      auto forwarding = agg->getForwardingMembers();
+      if (forwarding.empty()) {
+        continue;
+      }
+      port = forwarding.front();
+    }
+
+    auto out = sw->allocatePacket(len);
+    RWPrivateCursor outCursor(out->buf());
+    TxPacket::writeEthHeader(&outCursor, eth.getDstMac(), eth.getSrcMac(),
+                             vlan->getID(), eth.getEtherType());
+    Cursor(cursor).pull(outCursor.writableData(), payloadLen);
+    outCursor += payloadLen;
+    auto pad = len - l2Len - payloadLen;
+    if (pad) {
+      memset(outCursor.writableData(), 0, pad);
+    }
+    pkts.emplace_back(std::move(out), port);
+  }
+
+  auto count = pkts.size();
+  sw->sendPacketsOutOfPort(std::move(pkts));
+  return count;
+}
+
+}} // facebook::fboss
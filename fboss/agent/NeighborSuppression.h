@@ -0,0 +1,39 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+class RxPacket;
+class SwSwitch;
+class SwitchState;
+
+/*
+ * With neighborSuppression set, the hardware sends the broadcast ARP
+ * requests and the multicast neighbor solicitations to the CPU instead of
+ * flooding them.  ArpHandler and IPv6Handler answer the ones for the hosts
+ * in their VLAN's neighbor table, and flood the others with
+ * floodNeighborRequest().
+ *
+ * Send the request out of every other port of the VLAN it was received on,
+ * as the hardware would have flooded it.  An aggregate port gets one copy,
+ * out of its first forwarding member, and the one the request was received
+ * on gets none.  The copies are tagged with the VLAN, which the hardware
+ * removes on the untagged ports.
+ *
+ * Returns the number of ports the request was sent out of.
+ */
+size_t floodNeighborRequest(SwSwitch* sw,
+                            const std::shared_ptr<SwitchState>& state,
+                            const RxPacket* pkt);
+
+}} // facebook::fboss
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborUpdateQueue.h"
+
+#include "fboss/agent/NeighborLimits.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <algorithm>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+DEFINE_int32(neighbor_update_shards, 16,
+             "The number of independently locked shards, split by VLAN, "
+             "that learned ARP and NDP entries are queued in until they "
+             "are added to the switch state.  1 queues all of them behind "
+             "a single lock");
+
+using std::shared_ptr;
+
+namespace facebook { namespace fboss {
+
+template<typename NTable>
+NeighborUpdateQueue<NTable>::NeighborUpdateQueue()
+  : NeighborUpdateQueue(std::max(FLAGS_neighbor_update_shards, 1)) {
+}
+
+template<typename NTable>
+NeighborUpdateQueue<NTable>::NeighborUpdateQueue(size_t numShards) {
+  CHECK_GT(numShards, 0);
+  shards_.reserve(numShards);
+  for (size_t i = 0; i < numShards; ++i) {
+    shards_.emplace_back(new Shard());
+  }
+}
+
+template<typename NTable>
+bool NeighborUpdateQueue<NTable>::add(VlanID vlan, AddressType ip,
+                                      Update update) {
+  auto& shard = *shards_[static_cast<uint16_t>(vlan) % shards_.size()];
+  {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto ret = shard.pending[vlan].emplace(ip, update);
+    if (!ret.second) {
+      // An earlier update may still have to add the entry
+      update.addNewEntry |= ret.first->second.addNewEntry;
+      ret.first->second = update;
+    }
+  }
+  // The update is queued before this, and applyUpdates() clears the flag
+  // before draining any shard, so the update is either picked up by the
+  // scheduled state update or we schedule a new one.
+  return !scheduled_.exchange(true);
+}
+
+template<typename NTable>
+shared_ptr<SwitchState> NeighborUpdateQueue<NTable>::applyUpdates(
+    const shared_ptr<SwitchState>& state, uint64_t* numRejected) {
+  scheduled_.store(false);
+
+  shared_ptr<SwitchState> newState{state};
+  NeighborLimits limits(state.get());
+  uint64_t rejected = 0;
+  bool changed = false;
+  for (auto& shard : shards_) {
+    PendingUpdates pending;
+    {
+      std::lock_guard<std::mutex> guard(shard->lock);
+      pending.swap(shard->pending);
+    }
+    for (const auto& vlanUpdates : pending) {
+      if (applyVlanUpdates(vlanUpdates.first, vlanUpdates.second,
+                           &newState, &limits, &rejected)) {
+        changed = true;
+      }
+    }
+  }
+  if (numRejected) {
+    *numRejected = rejected;
+  }
+  return changed ? newState : nullptr;
+}
+
+template<typename NTable>
+bool NeighborUpdateQueue<NTable>::applyVlanUpdates(
+    VlanID vlanID,
+    const VlanUpdates& updates,
+    shared_ptr<SwitchState>* state,
+    NeighborLimits* limits,
+    uint64_t* numRejected) {
+  // The state has changed since the updates were queued, so re-validate
+  // the vlan and entries
+  auto* vlan = (*state)->getVlans()->getVlanIf(vlanID).get();
+  if (!vlan) {
+    // This VLAN no longer exists.  Just ignore its entry updates.
+    VLOG(3) << "VLAN " << vlanID << " deleted before " << updates.size() <<
+      " neighbor entries could be updated";
+    return false;
+  }
+
+  // The VLAN and table are only cloned by the first entry changed in them,
+  // since modify() returns the unpublished copy after that.
+  auto* table = vlan->getNeighborTable<NTable>().get();
+  bool changed = false;
+  for (const auto& entry : updates) {
+    const auto& ip = entry.first;
+    const auto& update = entry.second;
+
+    // In case the interface subnets have changed, make sure the IP address
+    // is still on a locally attached subnet
+    if (!Interface::isIpAttached(ip, update.intfID, *state)) {
+      VLOG(3) << "interface subnets changed before neighbor entry " <<
+        ip << " --> " << update.mac << " could be updated";
+      continue;
+    }
+
+    auto node = table->getNodeIf(ip);
+    if (!node) {
+      if (!update.addNewEntry) {
+        // This entry was deleted while the update was queued, and we
+        // aren't supposed to re-add it.
+        continue;
+      }
+      if (!limits->tryAdd(vlanID)) {
+        VLOG(3) << "neighbor limit reached, not adding entry for " << ip <<
+          " --> " << update.mac << " on VLAN " << vlanID;
+        ++*numRejected;
+        continue;
+      }
+      table = table->modify(&vlan, state);
+      table->addEntry(ip, update.mac, update.port, update.intfID);
+    } else {
+      if (node->getMac() == update.mac &&
+          node->getPort() == update.port &&
+          node->getIntfID() == update.intfID) {
+        // This entry was already updated while the update was queued.
+        continue;
+      }
+      table = table->modify(&vlan, state);
+      table->updateEntry(ip, update.mac, update.port, update.intfID);
+    }
+    changed = true;
+    VLOG(3) << "Adding neighbor entry for " << ip.str() << " --> " <<
+      update.mac << " on VLAN " << vlanID;
+  }
+  return changed;
+}
+
+template class NeighborUpdateQueue<ArpTable>;
+template class NeighborUpdateQueue<NdpTable>;
+
+}} // facebook::fboss
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <folly/MacAddress.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class NeighborLimits;
+class SwitchState;
+
+/*
+ * NeighborUpdateQueue holds the neighbor entries learned from received
+ * packets until the update thread adds them to the SwitchState.
+ *
+ * Packets are handled by several threads, and neighbors are learned on many
+ * VLANs at once, so the queue is split into shards by VLAN, each with its
+ * own lock.  Threads learning on different VLANs only contend when their
+ * VLANs share a shard.
+ *
+ * The update thread drains all of the shards in a single state update, in
+ * which each VLAN and neighbor table is cloned only once, however many
+ * entries were learned on it.
+ *
+ * NTable is ArpTable or NdpTable.
+ */
+template<typename NTable>
+class NeighborUpdateQueue {
+ public:
+  typedef typename NTable::AddressType AddressType;
+
+  struct Update {
+    PortID port;
+    InterfaceID intfID;
+    folly::MacAddress mac;
+    // Whether to add the entry if it is not in the table already
+    bool addNewEntry;
+  };
+
+  /*
+   * Create a queue with --neighbor_update_shards shards.
+   */
+  NeighborUpdateQueue();
+  explicit NeighborUpdateQueue(size_t numShards);
+
+  /*
+   * Queue an update.  Only the latest update for each neighbor is kept.
+   *
+   * Returns true if the caller has to schedule a state update that calls
+   * applyUpdates(), because none is scheduled yet.
+   */
+  bool add(VlanID vlan, AddressType ip, Update update);
+
+  /*
+   * Apply all the queued updates to the state.  New entries beyond the
+   * NeighborLimits are left out, and counted in *numRejected.
+   *
+   * Returns the new state, or null if none of the updates changed it.
+   */
+  std::shared_ptr<SwitchState> applyUpdates(
+      const std::shared_ptr<SwitchState>& state,
+      uint64_t* numRejected = nullptr);
+
+  size_t getNumShards() const {
+    return shards_.size();
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  NeighborUpdateQueue(NeighborUpdateQueue const &) = delete;
+  NeighborUpdateQueue& operator=(NeighborUpdateQueue const &) = delete;
+
+  typedef std::map<AddressType, Update> VlanUpdates;
+  typedef std::map<VlanID, VlanUpdates> PendingUpdates;
+
+  struct Shard {
+    std::mutex lock;
+    PendingUpdates pending;
+  };
+
+  bool applyVlanUpdates(VlanID vlanID, const VlanUpdates& updates,
+                        std::shared_ptr<SwitchState>* state,
+                        NeighborLimits* limits, uint64_t* numRejected);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  // Set while a state update to drain the shards is scheduled
+  std::atomic<bool> scheduled_{false};
+};
+
+}} // facebook::fboss
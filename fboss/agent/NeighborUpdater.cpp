@@ -8,110 +8,658 @@
  *
  */
 #include "NeighborUpdater.h"
+#include "fboss/agent/ArpHandler.h"
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/NeighborLimits.h"
 #include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/TimerWheel.h"
+#include "fboss/agent/Utils.h"
+#include "fboss/agent/state/DeltaFunctions.h"
 #include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/VlanMap.h"
 #include "fboss/agent/state/Vlan.h"
 #include "fboss/agent/state/ArpTable.h"
 #include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteTable.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteDelta.h"
+#include "fboss/agent/state/RouteTableRib.h"
 #include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/StateUpdateHelpers.h"
+#include <folly/Random.h>
 #include <folly/futures/Future.h>
-
+#include <folly/io/async/AsyncTimeout.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <set>
+#include <tuple>
+
+DEFINE_int32(neighbor_ager_tick_ms, 100,
+             "The resolution, in milliseconds, with which pending neighbor "
+             "entries are expired and resolved entries are probed");
+DEFINE_int32(neighbor_probe_interval_s, 300,
+             "How often, in seconds, to send a unicast ARP request or "
+             "neighbor solicitation to each resolved neighbor, so that "
+             "changes are picked up before traffic to it is lost.  0 "
+             "disables probing");
+DEFINE_int32(neighbor_probe_pps, 100,
+             "The maximum rate, in packets per second, at which neighbor "
+             "probes are sent across all VLANs");
+DEFINE_int32(neighbor_probe_burst, 20,
+             "The maximum number of neighbor probes sent back to back");
+DEFINE_bool(neighbor_prefetch, false,
+            "Resolve the directly connected nexthops of new routes as soon "
+            "as the routes are added, instead of waiting for traffic to them "
+            "to be punted.  The requests share the --neighbor_probe_pps "
+            "rate limit with the probes");
+DEFINE_int32(neighbor_hit_poll_s, 10,
+             "How often, at most, to read the hardware hit bits of neighbor "
+             "entries while probes are due.  Due entries that were hit since "
+             "the last read are treated as refreshed instead of being "
+             "probed.  0 disables the use of hit bits");
+DEFINE_int32(neighbor_prefetch_threads, 4,
+             "How many threads look for the unknown nexthops of a large "
+             "batch of new routes to prefetch, each thread handling "
+             "different routes.  1 does it serially.");
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
 using std::chrono::seconds;
+using std::chrono::steady_clock;
 using std::shared_ptr;
 using boost::container::flat_map;
+using facebook::fboss::DeltaFunctions::DeltaChunks;
 using folly::Future;
-using folly::whenAll;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
 
 namespace facebook { namespace fboss {
 
 class NeighborUpdaterImpl : private folly::AsyncTimeout {
  public:
-  NeighborUpdaterImpl(VlanID vlan, SwSwitch *sw, const SwitchState* state);
+  explicit NeighborUpdaterImpl(SwSwitch *sw);
 
-  SwSwitch* getSw() const {
-    return sw_;
+  bool isStarted() const {
+    return started_;
   }
 
-  static void start(void* arg);
-  static void stop(void* arg);
-
   void stateChanged(const StateDelta& delta);
 
  private:
-  typedef std::function<
-    std::shared_ptr<SwitchState>(const std::shared_ptr<SwitchState>&)>
-    StateUpdateFn;
+  typedef std::pair<VlanID, IPAddress> NeighborKey;
+  typedef std::pair<InterfaceID, IPAddress> PrefetchKey;
+  typedef flat_map<VlanID, std::map<IPAddress, uint64_t>> TickMap;
+  struct ExpiredEntries {
+    std::vector<IPAddressV4> arp;
+    std::vector<IPAddressV6> ndp;
+  };
+  typedef flat_map<VlanID, ExpiredEntries> ExpiredMap;
 
   NeighborUpdaterImpl(NeighborUpdaterImpl const &) = delete;
   NeighborUpdaterImpl& operator=(NeighborUpdaterImpl const &) = delete;
 
-  shared_ptr<SwitchState>
-  prunePendingEntries(const shared_ptr<SwitchState>& state);
-
-  bool pendingEntriesExist() const;
-
-  virtual void timeoutExpired() noexcept {
-    if (pendingEntriesExist()) {
-      sw_->updateState("Remove pending Arp entries", prunePendingEntries_);
-    }
-    scheduleTimeout(interval_);
+  bool probingEnabled() const {
+    return probeIntervalTicks_ > 0;
   }
 
-  VlanID const vlan_;
+  uint64_t getTick(steady_clock::time_point time) const;
+  void scheduleOn(TimerWheel<NeighborKey>* wheel, TickMap* ticks,
+                  VlanID vlan, IPAddress ip, uint64_t tick);
+  void scheduleTick();
+
+  template<typename TABLE>
+  void addEntries(VlanID vlan, const TABLE* table, uint64_t expiryTick,
+                  uint64_t nowTick);
+  template<typename DELTA>
+  void processTableDelta(VlanID vlan, const DELTA& delta,
+                         uint64_t expiryTick, uint64_t probeTick);
+
+  static bool isCurrent(const TickMap& ticks, const NeighborKey& key,
+                        uint64_t nowTick);
+  void refreshHitEntries(uint64_t nowTick);
+  void sendProbes(uint64_t nowTick);
+  bool sendProbe(const SwitchState* state, const NeighborKey& key);
+
+  // Queue requests for the unresolved nexthops of the routes the delta
+  // added or changed
+  void prefetchNexthops(const StateDelta& delta);
+  template<typename DELTA>
+  void prefetchRouteNexthops(const SwitchState* state, const DELTA& delta);
+  // The nexthops of the changed routes with no neighbor entry, in order
+  template<typename DELTA>
+  static void findUnknownNexthops(const SwitchState* state,
+                                  const DELTA& delta,
+                                  std::vector<PrefetchKey>* keys);
+  void sendPrefetches(const SwitchState* state);
+  bool sendPrefetch(const SwitchState* state, const PrefetchKey& key);
+
+  static shared_ptr<SwitchState>
+  pruneExpiredEntries(const ExpiredMap& expired,
+                      const shared_ptr<SwitchState>& state);
+
+  /*
+   * Evict the least recently used entries of the VLANs, and of the whole
+   * switch, that are over the eviction targets of the NeighborLimits.
+   * Pending entries go first, oldest first, and then resolved entries,
+   * least recently refreshed first.  Entries that are nexthops of resolved
+   * routes are never evicted.
+   */
+  void evictEntries(const shared_ptr<SwitchState>& state);
+  // The nexthops of the resolved routes in the state
+  const std::set<IPAddress>& getActiveNexthops(const SwitchState* state);
+  template<typename RibT>
+  void addActiveNexthops(const RibT* rib,
+                         std::set<const RouteForwardNexthops*>* seen);
+  static shared_ptr<SwitchState>
+  removeEvictedEntries(const ExpiredMap& evicted,
+                       const shared_ptr<SwitchState>& state,
+                       uint64_t* numRemoved);
+
+  void timeoutExpired() noexcept override;
+
   SwSwitch* const sw_{nullptr};
-  StateUpdateFn prunePendingEntries_;
-  seconds interval_;
+  const steady_clock::time_point start_;
+  const milliseconds tickLength_;
+  bool started_{false};
+  TimerWheel<NeighborKey> wheel_;
+  /*
+   * The expiry tick of every pending entry, for every VLAN we have seen.
+   * Keys in wheel_ whose tick no longer matches are stale, and are ignored
+   * when they expire.
+   */
+  TickMap expiries_;
+
+  /*
+   * Resolved entries are scheduled on probeWheel_ in the same way, at the
+   * tick they are next due to be probed.  Due entries wait in probeQueue_
+   * until the token bucket allows them to be sent.
+   */
+  const uint64_t probeIntervalTicks_{0};
+  const double probesPerTick_{0};
+  const double probeBurst_{0};
+  double probeTokens_{0};
+  uint64_t lastTokenTick_{0};
+  TimerWheel<NeighborKey> probeWheel_;
+  TickMap probeTicks_;
+  std::deque<NeighborKey> probeQueue_;
+
+  /*
+   * Unresolved nexthops of new routes, waiting for the same tokens as the
+   * probes, and the set of them for deduplication.
+   */
+  std::deque<PrefetchKey> prefetchQueue_;
+  std::set<PrefetchKey> prefetching_;
+
+  /*
+   * While the hardware reports hit bits, due entries are held back until
+   * the next read, so entries that are carrying traffic never get probed.
+   */
+  const uint64_t hitPollTicks_{0};
+  bool hitsSupported_{true};
+  uint64_t lastHitPollTick_{0};
+  uint64_t nextHitPollTick_{0};
+
+  /*
+   * Set while a state update evicting entries is scheduled, so the same
+   * entries are not evicted again in the meantime.  It is cleared by the
+   * update once it is done, which may be after this object is gone.
+   */
+  std::shared_ptr<std::atomic<bool>> evicting_{
+    std::make_shared<std::atomic<bool>>(false)};
+  // The route tables activeNexthops_ was last collected from
+  std::weak_ptr<RouteTableMap> nexthopTables_;
+  std::set<IPAddress> activeNexthops_;
 };
 
-NeighborUpdaterImpl::NeighborUpdaterImpl(VlanID vlan, SwSwitch *sw,
-                                         const SwitchState* state)
+NeighborUpdaterImpl::NeighborUpdaterImpl(SwSwitch *sw)
   : AsyncTimeout(sw->getBackgroundEVB()),
-    vlan_(vlan),
     sw_(sw),
-    interval_(state->getArpAgerInterval()) {
-  prunePendingEntries_ = std::bind(&NeighborUpdaterImpl::prunePendingEntries,
-                                   this, std::placeholders::_1);
+    start_(steady_clock::now()),
+    tickLength_(std::max(1, FLAGS_neighbor_ager_tick_ms)),
+    probeIntervalTicks_(FLAGS_neighbor_probe_pps <= 0 ? 0 :
+        duration_cast<milliseconds>(
+          seconds(std::max(0, FLAGS_neighbor_probe_interval_s))).count() /
+        tickLength_.count()),
+    probesPerTick_(double(FLAGS_neighbor_probe_pps) * tickLength_.count() /
+                   1000),
+    probeBurst_(std::max(1, FLAGS_neighbor_probe_burst)),
+    probeTokens_(probeBurst_),
+    hitPollTicks_(duration_cast<milliseconds>(
+          seconds(std::max(0, FLAGS_neighbor_hit_poll_s))).count() /
+        tickLength_.count()),
+    hitsSupported_(hitPollTicks_ > 0) {
 }
 
-void NeighborUpdaterImpl::start(void* arg) {
-  auto* ntu = static_cast<NeighborUpdaterImpl*>(arg);
-  ntu->scheduleTimeout(ntu->interval_);
+uint64_t NeighborUpdaterImpl::getTick(steady_clock::time_point time) const {
+  return duration_cast<milliseconds>(time - start_).count() /
+    tickLength_.count();
 }
 
-void NeighborUpdaterImpl::stop(void* arg) {
-  auto* ntu = static_cast<NeighborUpdaterImpl*>(arg);
-  delete ntu;
+void NeighborUpdaterImpl::scheduleOn(TimerWheel<NeighborKey>* wheel,
+                                     TickMap* ticks, VlanID vlan,
+                                     IPAddress ip, uint64_t tick) {
+  if (wheel->empty()) {
+    // The wheel is not advanced while it is empty, so catch it up first
+    wheel->advance(getTick(steady_clock::now()), [](const NeighborKey&) {});
+  }
+  (*ticks)[vlan][ip] = tick;
+  wheel->schedule(NeighborKey(vlan, std::move(ip)), tick);
+}
+
+void NeighborUpdaterImpl::scheduleTick() {
+  uint64_t nextTick;
+  if (!probeQueue_.empty() || !prefetchQueue_.empty()) {
+    // Probes are waiting for tokens
+    nextTick = getTick(steady_clock::now()) + 1;
+  } else if (wheel_.empty() && probeWheel_.empty()) {
+    cancelTimeout();
+    return;
+  } else {
+    nextTick = std::min(wheel_.getNextEventTick(),
+                        probeWheel_.getNextEventTick());
+  }
+  // Round up, so we never wake up just before the tick
+  auto wakeup = start_ + tickLength_ * nextTick + milliseconds(1);
+  auto now = steady_clock::now();
+  scheduleTimeout(wakeup > now ?
+                  duration_cast<milliseconds>(wakeup - now) : milliseconds(0));
+}
+
+template<typename TABLE>
+void NeighborUpdaterImpl::addEntries(VlanID vlan, const TABLE* table,
+                                     uint64_t expiryTick, uint64_t nowTick) {
+  if (!probingEnabled() && !table->hasPendingEntries()) {
+    return;
+  }
+  for (const auto& entry : *table) {
+    if (entry->isPending()) {
+      scheduleOn(&wheel_, &expiries_, vlan, IPAddress(entry->getIP()),
+                 expiryTick);
+    } else if (probingEnabled()) {
+      // Spread out the first round of probes for entries we did not see
+      // being resolved, such as those restored on warm boot.
+      scheduleOn(&probeWheel_, &probeTicks_, vlan, IPAddress(entry->getIP()),
+                 nowTick + 1 + folly::Random::rand64(probeIntervalTicks_));
+    }
+  }
+}
+
+template<typename DELTA>
+void NeighborUpdaterImpl::processTableDelta(VlanID vlan, const DELTA& delta,
+                                            uint64_t expiryTick,
+                                            uint64_t probeTick) {
+  auto& expiries = expiries_[vlan];
+  auto& probes = probeTicks_[vlan];
+  for (const auto& entry : delta) {
+    auto oldEntry = entry.getOld();
+    auto newEntry = entry.getNew();
+    IPAddress ip(newEntry ? newEntry->getIP() : oldEntry->getIP());
+    if (newEntry && newEntry->isPending()) {
+      // Entries that stay pending keep their original expiry
+      if (!oldEntry || !oldEntry->isPending()) {
+        scheduleOn(&wheel_, &expiries_, vlan, ip, expiryTick);
+      }
+      probes.erase(ip);
+      continue;
+    }
+    // Resolved or removed
+    expiries.erase(ip);
+    if (!newEntry || !probingEnabled()) {
+      probes.erase(ip);
+      continue;
+    }
+    // Newly resolved or updated, so it is fresh until the next interval
+    scheduleOn(&probeWheel_, &probeTicks_, vlan, ip, probeTick);
+  }
 }
 
 void NeighborUpdaterImpl::stateChanged(const StateDelta& delta) {
-  // Does nothing now. We may want to subscribe to changes in the configured
-  // interval/timeouts here if we decide  want to be able to change these
-  // values on the fly
+  started_ = true;
+  auto now = steady_clock::now();
+  auto nowTick = getTick(now);
+  auto expiryTick = getTick(now + delta.newState()->getArpAgerInterval());
+  auto probeTick = nowTick + probeIntervalTicks_;
+  bool vlansChanged = false;
+  for (const auto& entry : delta.getVlansDelta()) {
+    auto oldEntry = entry.getOld();
+    auto newEntry = entry.getNew();
+    vlansChanged = true;
+
+    if (!newEntry) {
+      // Anything left in the wheels for this VLAN is now stale
+      expiries_.erase(oldEntry->getID());
+      probeTicks_.erase(oldEntry->getID());
+      continue;
+    }
+
+    // Second condition needed only for unit tests that create a state and init
+    // a MockSw from that, as stateChanged is not called for the initial state.
+    auto vlanID = newEntry->getID();
+    if (!oldEntry || expiries_.find(vlanID) == expiries_.end()) {
+      expiries_[vlanID];
+      probeTicks_[vlanID];
+      addEntries(vlanID, newEntry->getArpTable().get(), expiryTick, nowTick);
+      addEntries(vlanID, newEntry->getNdpTable().get(), expiryTick, nowTick);
+      continue;
+    }
+    processTableDelta(vlanID, entry.getArpDelta(), expiryTick, probeTick);
+    processTableDelta(vlanID, entry.getNdpDelta(), expiryTick, probeTick);
+  }
+  if (vlansChanged) {
+    evictEntries(delta.newState());
+  }
+  if (FLAGS_neighbor_prefetch) {
+    prefetchNexthops(delta);
+    if (!prefetchQueue_.empty()) {
+      // Send what the rate allows right away, before traffic follows
+      sendProbes(nowTick);
+    }
+  }
+  scheduleTick();
+}
+
+void NeighborUpdaterImpl::prefetchNexthops(const StateDelta& delta) {
+  const auto* state = delta.newState().get();
+  for (const auto& tableDelta : delta.getRouteTablesDelta()) {
+    if (!tableDelta.getNew()) {
+      continue;
+    }
+    prefetchRouteNexthops(state, tableDelta.getRoutesV4Delta());
+    prefetchRouteNexthops(state, tableDelta.getRoutesV6Delta());
+  }
+}
+
+template<typename DELTA>
+void NeighborUpdaterImpl::prefetchRouteNexthops(const SwitchState* state,
+                                                const DELTA& delta) {
+  // Looking for the unknown nexthops only reads the state, so the routes
+  // of a large delta are searched in chunks from several threads, and
+  // what they find is queued in route order afterwards
+  DeltaChunks<DELTA> chunks(delta);
+  std::vector<std::vector<PrefetchKey>> found(chunks.size());
+  runInParallel(chunks.size(), FLAGS_neighbor_prefetch_threads,
+    [&] (size_t i) { findUnknownNexthops(state, chunks[i], &found[i]); });
+  for (auto& keys : found) {
+    for (auto& key : keys) {
+      if (prefetching_.insert(key).second) {
+        prefetchQueue_.push_back(std::move(key));
+      }
+    }
+  }
+}
+
+template<typename DELTA>
+void NeighborUpdaterImpl::findUnknownNexthops(const SwitchState* state,
+                                              const DELTA& delta,
+                                              std::vector<PrefetchKey>* keys) {
+  for (const auto& routeDelta : delta) {
+    const auto& oldRoute = routeDelta.getOld();
+    const auto& newRoute = routeDelta.getNew();
+    if (!newRoute || !newRoute->isResolved() || newRoute->isConnected()) {
+      continue;
+    }
+    if (oldRoute && oldRoute->isResolved() &&
+        oldRoute->getForwardInfo() == newRoute->getForwardInfo()) {
+      continue;
+    }
+    for (const auto& nh : newRoute->getForwardInfo().getNexthops()) {
+      auto intf = state->getInterfaces()->getInterfaceIf(nh.intf);
+      if (!intf) {
+        continue;
+      }
+      auto vlan = state->getVlans()->getVlanIf(intf->getVlanID());
+      if (!vlan) {
+        continue;
+      }
+      bool known = nh.nexthop.isV4() ?
+        vlan->getArpTable()->getNodeIf(nh.nexthop.asV4()) != nullptr :
+        vlan->getNdpTable()->getNodeIf(nh.nexthop.asV6()) != nullptr;
+      if (known) {
+        continue;
+      }
+      keys->emplace_back(nh.intf, nh.nexthop);
+    }
+  }
+}
+
+bool NeighborUpdaterImpl::isCurrent(const TickMap& ticks,
+                                    const NeighborKey& key, uint64_t nowTick) {
+  auto vlanIt = ticks.find(key.first);
+  if (vlanIt == ticks.end()) {
+    return false;
+  }
+  auto it = vlanIt->second.find(key.second);
+  return it != vlanIt->second.end() && it->second <= nowTick;
+}
+
+void NeighborUpdaterImpl::timeoutExpired() noexcept {
+  auto nowTick = getTick(steady_clock::now());
+  ExpiredMap expired;
+  wheel_.advance(nowTick, [&](const NeighborKey& key) {
+    if (!isCurrent(expiries_, key, nowTick)) {
+      return;
+    }
+    expiries_[key.first].erase(key.second);
+    auto& entries = expired[key.first];
+    if (key.second.isV4()) {
+      entries.arp.push_back(key.second.asV4());
+    } else {
+      entries.ndp.push_back(key.second.asV6());
+    }
+  });
+
+  if (!expired.empty()) {
+    // One update for all of the VLANs
+    auto update = folly::make_unique<FunctionStateUpdate>(
+        "Remove pending neighbor entries",
+        [expired](const shared_ptr<SwitchState>& state) {
+          return pruneExpiredEntries(expired, state);
+        },
+        StateUpdatePriority::HOUSEKEEPING);
+    update->setComposable(true);
+    sw_->updateState(std::move(update));
+  }
+
+  probeWheel_.advance(nowTick, [&](const NeighborKey& key) {
+    // Due entries keep their tick until they are actually probed, so an
+    // update in the meantime makes the queued key stale.
+    if (isCurrent(probeTicks_, key, nowTick)) {
+      probeQueue_.push_back(key);
+    }
+  });
+  refreshHitEntries(nowTick);
+  sendProbes(nowTick);
+  scheduleTick();
+}
+
+void NeighborUpdaterImpl::refreshHitEntries(uint64_t nowTick) {
+  if (!hitsSupported_ || probeQueue_.empty() ||
+      nowTick < nextHitPollTick_) {
+    return;
+  }
+  lastHitPollTick_ = nowTick;
+  nextHitPollTick_ = nowTick + hitPollTicks_;
+
+  HwSwitch::NeighborHits hits;
+  try {
+    if (!sw_->getHw()->getAndClearNeighborHits(&hits)) {
+      hitsSupported_ = false;
+      return;
+    }
+  } catch (const std::exception& ex) {
+    // Fall back to probing everything that is due this time around
+    LOG(ERROR) << "failed to read neighbor hit bits: " << ex.what();
+    return;
+  }
+
+  for (const auto& ip : hits) {
+    for (auto& vlan : probeTicks_) {
+      auto it = vlan.second.find(ip);
+      if (it == vlan.second.end() || it->second > nowTick) {
+        continue;
+      }
+      // Traffic has refreshed the entry for us.  This also makes the key
+      // waiting in probeQueue_ stale.
+      sw_->stats()->neighborProbeSkipped();
+      scheduleOn(&probeWheel_, &probeTicks_, vlan.first, ip,
+                 nowTick + probeIntervalTicks_);
+    }
+  }
+}
+
+void NeighborUpdaterImpl::sendProbes(uint64_t nowTick) {
+  probeTokens_ = std::min(probeBurst_, probeTokens_ +
+                          (nowTick - lastTokenTick_) * probesPerTick_);
+  lastTokenTick_ = nowTick;
+  if (probeQueue_.empty() && prefetchQueue_.empty()) {
+    return;
+  }
+
+  auto state = sw_->getState();
+  // Nexthops of new routes go first, as traffic to them may be on its way
+  sendPrefetches(state.get());
+  while (probeTokens_ >= 1 && !probeQueue_.empty()) {
+    const auto& front = probeQueue_.front();
+    if (hitsSupported_ && isCurrent(probeTicks_, front, nowTick) &&
+        !isCurrent(probeTicks_, front, lastHitPollTick_)) {
+      // Came due after the last hit bit read, so wait for the next one
+      break;
+    }
+    auto key = std::move(probeQueue_.front());
+    probeQueue_.pop_front();
+    if (!isCurrent(probeTicks_, key, nowTick)) {
+      continue;
+    }
+    if (!sendProbe(state.get(), key)) {
+      // Removed, or no longer reachable.  The state delta will tell us
+      // if it comes back.
+      probeTicks_[key.first].erase(key.second);
+      continue;
+    }
+    probeTokens_ -= 1;
+    auto vlan = key.first;
+    auto ip = std::move(key.second);
+    scheduleOn(&probeWheel_, &probeTicks_, vlan, std::move(ip),
+               nowTick + probeIntervalTicks_);
+  }
+}
+
+bool NeighborUpdaterImpl::sendProbe(const SwitchState* state,
+                                    const NeighborKey& key) {
+  auto vlan = state->getVlans()->getVlanIf(key.first);
+  if (!vlan) {
+    return false;
+  }
+  if (key.second.isV4()) {
+    auto entry = vlan->getArpTable()->getNodeIf(key.second.asV4());
+    if (!entry || entry->isPending()) {
+      return false;
+    }
+    auto intf = state->getInterfaces()->getInterfaceIf(entry->getIntfID());
+    if (!intf) {
+      return false;
+    }
+    auto addr = intf->getAddressToReach(key.second);
+    if (addr == intf->getAddresses().end()) {
+      return false;
+    }
+    sw_->getArpHandler()->sendArpProbe(intf, addr->first.asV4(),
+                                       entry->getIP(), entry->getMac());
+    return true;
+  }
+
+  auto entry = vlan->getNdpTable()->getNodeIf(key.second.asV6());
+  if (!entry || entry->isPending()) {
+    return false;
+  }
+  auto intf = state->getInterfaces()->getInterfaceIf(entry->getIntfID());
+  if (!intf) {
+    return false;
+  }
+  sw_->getIPv6Handler()->sendNeighborProbe(entry->getIP(), entry->getMac(),
+                                           intf);
+  return true;
+}
+
+void NeighborUpdaterImpl::sendPrefetches(const SwitchState* state) {
+  while (probeTokens_ >= 1 && !prefetchQueue_.empty()) {
+    auto key = std::move(prefetchQueue_.front());
+    prefetchQueue_.pop_front();
+    prefetching_.erase(key);
+    if (sendPrefetch(state, key)) {
+      probeTokens_ -= 1;
+    }
+  }
 }
 
-shared_ptr<SwitchState>
-NeighborUpdaterImpl::prunePendingEntries(const shared_ptr<SwitchState>& state) {
+bool NeighborUpdaterImpl::sendPrefetch(const SwitchState* state,
+                                       const PrefetchKey& key) {
+  auto intf = state->getInterfaces()->getInterfaceIf(key.first);
+  if (!intf) {
+    return false;
+  }
+  auto vlan = state->getVlans()->getVlanIf(intf->getVlanID());
+  if (!vlan) {
+    return false;
+  }
+  const auto& ip = key.second;
+  if (ip.isV4()) {
+    // Traffic may have got to it first
+    if (vlan->getArpTable()->getNodeIf(ip.asV4())) {
+      return false;
+    }
+    auto addr = intf->getAddressToReach(ip);
+    if (addr == intf->getAddresses().end()) {
+      return false;
+    }
+    sw_->getArpHandler()->sendArpRequest(vlan, intf, addr->first.asV4(),
+                                         ip.asV4());
+  } else {
+    if (vlan->getNdpTable()->getNodeIf(ip.asV6())) {
+      return false;
+    }
+    sw_->getIPv6Handler()->sendNeighborSolicitation(ip.asV6(), intf, vlan);
+  }
+  sw_->stats()->neighborPrefetchTx();
+  return true;
+}
+
+shared_ptr<SwitchState> NeighborUpdaterImpl::pruneExpiredEntries(
+    const ExpiredMap& expired, const shared_ptr<SwitchState>& state) {
   shared_ptr<SwitchState> newState{state};
 
   bool modified = false;
-  auto vlanIf = state->getVlans()->getVlanIf(vlan_);
-  if (vlanIf) {
+  for (const auto& vlanEntries : expired) {
+    auto vlanIf = state->getVlans()->getVlanIf(vlanEntries.first);
+    if (!vlanIf) {
+      continue;
+    }
     auto vlan = vlanIf.get();
 
+    const auto& arp = vlanEntries.second.arp;
     auto arpTable = vlan->getArpTable().get();
-    if (arpTable->hasPendingEntries()) {
+    if (!arp.empty() && arpTable->hasPendingEntries()) {
       auto newArpTable = arpTable->modify(&vlan, &newState);
-      if (newArpTable->prunePendingEntries()) {
+      if (newArpTable->prunePendingEntries(arp)) {
         modified = true;
       }
     }
 
+    const auto& ndp = vlanEntries.second.ndp;
     auto ndpTable = vlan->getNdpTable().get();
-    if (ndpTable->hasPendingEntries()) {
+    if (!ndp.empty() && ndpTable->hasPendingEntries()) {
       auto newNdpTable = ndpTable->modify(&vlan, &newState);
-      if (newNdpTable->prunePendingEntries()) {
+      if (newNdpTable->prunePendingEntries(ndp)) {
         modified = true;
       }
     }
@@ -119,93 +667,193 @@ NeighborUpdaterImpl::prunePendingEntries(const shared_ptr<SwitchState>& state) {
   return modified ? newState : nullptr;
 }
 
-bool NeighborUpdaterImpl::pendingEntriesExist() const {
-  auto state = sw_->getState();
-  auto vlan = state->getVlans()->getVlanIf(vlan_);
-  auto arpTable = vlan->getArpTable();
-  auto ndpTable = vlan->getNdpTable();
-  return arpTable->hasPendingEntries() || ndpTable->hasPendingEntries();
-}
+void NeighborUpdaterImpl::evictEntries(const shared_ptr<SwitchState>& state) {
+  if (!NeighborLimits::enabled() || evicting_->load()) {
+    return;
+  }
 
-NeighborUpdater::NeighborUpdater(SwSwitch* sw)
-    : sw_(sw) {}
+  // How many entries to evict from the VLANs over their target, and from
+  // all of them together
+  auto maxEntries = NeighborLimits::getMaxEntries();
+  auto maxPerVlan = NeighborLimits::getMaxEntriesPerVlan();
+  auto target = NeighborLimits::getEvictionTarget(maxEntries);
+  auto vlanTarget = NeighborLimits::getEvictionTarget(maxPerVlan);
+  flat_map<VlanID, uint64_t> vlanExcess;
+  uint64_t total = 0;
+  for (const auto& vlan : *state->getVlans()) {
+    uint64_t numEntries = vlan->getArpTable()->size() +
+      vlan->getNdpTable()->size();
+    total += numEntries;
+    if (maxPerVlan > 0 && numEntries > vlanTarget) {
+      vlanExcess[vlan->getID()] = numEntries - vlanTarget;
+    }
+  }
+  uint64_t excess = (maxEntries > 0 && total > target) ? total - target : 0;
+  if (excess == 0 && vlanExcess.empty()) {
+    return;
+  }
 
-NeighborUpdater::~NeighborUpdater() {
-  std::vector<Future<void>> stopTasks;
+  // Pending entries sort before resolved ones, and then by the tick they
+  // expire, or are next due to be probed, at.  Resolved entries are only
+  // known while probing is enabled.
+  typedef std::tuple<bool, uint64_t, VlanID, IPAddress> Candidate;
+  std::vector<Candidate> candidates;
+  for (const auto& vlan : expiries_) {
+    for (const auto& entry : vlan.second) {
+      candidates.emplace_back(false, entry.second, vlan.first, entry.first);
+    }
+  }
+  for (const auto& vlan : probeTicks_) {
+    for (const auto& entry : vlan.second) {
+      candidates.emplace_back(true, entry.second, vlan.first, entry.first);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
 
-  for (auto entry : updaters_) {
-    auto vlan = entry.first;
-    auto updater = entry.second;
+  const auto& activeNexthops = getActiveNexthops(state.get());
+  ExpiredMap evicted;
+  for (const auto& candidate : candidates) {
+    if (excess == 0 && vlanExcess.empty()) {
+      break;
+    }
+    auto vlan = std::get<2>(candidate);
+    const auto& ip = std::get<3>(candidate);
+    auto vlanIt = vlanExcess.find(vlan);
+    if (excess == 0 && vlanIt == vlanExcess.end()) {
+      continue;
+    }
+    if (activeNexthops.count(ip)) {
+      continue;
+    }
+    auto& entries = evicted[vlan];
+    if (ip.isV4()) {
+      entries.arp.push_back(ip.asV4());
+    } else {
+      entries.ndp.push_back(ip.asV6());
+    }
+    if (excess > 0) {
+      --excess;
+    }
+    if (vlanIt != vlanExcess.end() && --vlanIt->second == 0) {
+      vlanExcess.erase(vlanIt);
+    }
+  }
+  if (evicted.empty()) {
+    LOG(WARNING) << "neighbor tables are over their limits, but all of the "
+                 << "entries are in use";
+    return;
+  }
 
-    std::function<void()> stopUpdater = [updater]() {
-      NeighborUpdaterImpl::stop(updater);
-    };
+  evicting_->store(true);
+  auto* sw = sw_;
+  auto evicting = evicting_;
+  sw_->updateStateAsync(
+      "Evict neighbor entries",
+      [evicted, sw](const shared_ptr<SwitchState>& state) {
+        uint64_t numRemoved = 0;
+        auto newState = removeEvictedEntries(evicted, state, &numRemoved);
+        sw->stats()->neighborsEvicted(numRemoved);
+        return newState;
+      },
+      [evicting](const std::exception_ptr&) {
+        evicting->store(false);
+      },
+      StateUpdatePriority::HOUSEKEEPING);
+}
 
-    // Run the stop function in the background thread to
-    // ensure it can be safely run
-    auto f = via(sw_->getBackgroundEVB())
-      .then(stopUpdater)
-      .onError([=](const std::exception& e) {
-        LOG(FATAL) << "failed to stop neighbor updater w/ vlan " << vlan;
-      });
-    stopTasks.push_back(std::move(f));
+const std::set<IPAddress>& NeighborUpdaterImpl::getActiveNexthops(
+    const SwitchState* state) {
+  const auto& tables = state->getRouteTables();
+  if (nexthopTables_.lock() == tables) {
+    return activeNexthops_;
   }
+  activeNexthops_.clear();
+  nexthopTables_ = tables;
+  // Routes that forward the same way share their nexthops, so each set is
+  // only looked at once
+  std::set<const RouteForwardNexthops*> seen;
+  for (const auto& table : *tables) {
+    addActiveNexthops(table->getRibV4().get(), &seen);
+    addActiveNexthops(table->getRibV6().get(), &seen);
+  }
+  return activeNexthops_;
+}
 
-  // Ensure that all of the updaters have been stopped before we return
-  whenAll(stopTasks.begin(), stopTasks.end()).get();
+template<typename RibT>
+void NeighborUpdaterImpl::addActiveNexthops(
+    const RibT* rib, std::set<const RouteForwardNexthops*>* seen) {
+  for (const auto& item : rib->getAllNodes()) {
+    const auto& route = item.second;
+    if (!route->isResolved()) {
+      continue;
+    }
+    const auto& nexthops = route->getForwardInfo().getNexthops();
+    if (!seen->insert(&nexthops).second) {
+      continue;
+    }
+    for (const auto& nexthop : nexthops) {
+      activeNexthops_.insert(nexthop.nexthop);
+    }
+  }
 }
 
-void NeighborUpdater::stateChanged(const StateDelta& delta) {
-  CHECK(sw_->getUpdateEVB()->inRunningEventBaseThread());
-  for (const auto& entry : delta.getVlansDelta()) {
-    auto oldEntry = entry.getOld();
-    auto newEntry = entry.getNew();
+shared_ptr<SwitchState> NeighborUpdaterImpl::removeEvictedEntries(
+    const ExpiredMap& evicted, const shared_ptr<SwitchState>& state,
+    uint64_t* numRemoved) {
+  shared_ptr<SwitchState> newState{state};
 
-    if (!newEntry) {
-      vlanDeleted(oldEntry.get());
+  for (const auto& vlanEntries : evicted) {
+    auto vlanIf = state->getVlans()->getVlanIf(vlanEntries.first);
+    if (!vlanIf) {
       continue;
     }
+    auto vlan = vlanIf.get();
 
-    // Second condition needed only for unit tests that create a state and init
-    // a MockSw from that, as stateChanged is not called for the initial state.
-    if (!oldEntry || updaters_.find(newEntry->getID()) == updaters_.end()) {
-      vlanAdded(delta.newState().get(), newEntry.get());
+    const auto& arp = vlanEntries.second.arp;
+    if (!arp.empty()) {
+      auto size = vlan->getArpTable()->size();
+      auto arpTable = vlan->getArpTable()->modify(&vlan, &newState);
+      arpTable->removeEntries(arp);
+      *numRemoved += size - arpTable->size();
     }
 
-    auto res = updaters_.find(newEntry->getID());
-    auto updater = res->second;
-    updater->stateChanged(delta);
+    const auto& ndp = vlanEntries.second.ndp;
+    if (!ndp.empty()) {
+      auto size = vlan->getNdpTable()->size();
+      auto ndpTable = vlan->getNdpTable()->modify(&vlan, &newState);
+      ndpTable->removeEntries(ndp);
+      *numRemoved += size - ndpTable->size();
+    }
   }
+  return *numRemoved > 0 ? newState : nullptr;
 }
 
-void NeighborUpdater::vlanAdded(const SwitchState* state, const Vlan* vlan) {
-  CHECK(sw_->getUpdateEVB()->inRunningEventBaseThread());
-  auto updater = new NeighborUpdaterImpl(vlan->getID(), sw_, state);
-  updaters_.emplace(vlan->getID(), updater);
-  bool ret = sw_->getBackgroundEVB()->runInEventBaseThread(
-    NeighborUpdaterImpl::start, updater);
-  if (!ret) {
-    delete updater;
+NeighborUpdater::NeighborUpdater(SwSwitch* sw)
+    : impl_(new NeighborUpdaterImpl(sw)),
+      sw_(sw) {}
 
-    throw FbossError("failed to start neighbor updater");
+NeighborUpdater::~NeighborUpdater() {
+  auto* impl = impl_;
+  if (!impl->isStarted()) {
+    // No state change has ever been delivered, so the timeout was never
+    // scheduled and the background thread may not even be running.
+    delete impl;
+    return;
   }
+
+  // Run the stop function in the background thread to
+  // ensure it can be safely run
+  via(sw_->getBackgroundEVB())
+    .then([impl]() { delete impl; })
+    .onError([](const std::exception& e) {
+      LOG(FATAL) << "failed to stop neighbor updater: " << e.what();
+    })
+    .get();
 }
 
-void NeighborUpdater::vlanDeleted(const Vlan* vlan) {
-  CHECK(sw_->getUpdateEVB()->inRunningEventBaseThread());
-  auto updater = updaters_.find(vlan->getID());
-  if (updater != updaters_.end()) {
-    updaters_.erase(updater);
-    bool ret = sw_->getBackgroundEVB()->runInEventBaseThread(
-      NeighborUpdaterImpl::stop, (*updater).second);
-    if (!ret) {
-      LOG(ERROR) << "failed to stop neighbor updater";
-    }
-  } else {
-    // TODO(aeckert): May want to fatal here when an updater doesn't exist for a
-    // specific vlan. Need to make sure that updaters are correctly created for
-    // the initial SwitchState to avoid false positives
-  }
+void NeighborUpdater::stateChanged(const StateDelta& delta) {
+  CHECK(sw_->getBackgroundEVB()->inRunningEventBaseThread());
+  impl_->stateChanged(delta);
 }
 
 }} // facebook::fboss
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <boost/container/flat_map.hpp>
+#include "fboss/agent/StateObserver.h"
 #include "fboss/agent/state/Vlan.h"
 #include "fboss/agent/state/StateDelta.h"
 
@@ -22,28 +23,53 @@ class StateDelta;
 
 /**
  * This class handles asynchronous updates to neighbor tables that are not
- * in response to handling a specific packet. For now this is only used to
- * remove pending entries from the tables after they timeout.
+ * in response to handling a specific packet: it removes pending entries
+ * from the tables after they timeout, and probes resolved entries.
+ *
+ * Pending entries are tracked in a timer wheel keyed by their expiry time,
+ * as they show up in state deltas, so each tick only touches the entries
+ * that actually expire.  The entries of all VLANs that expire in the same
+ * tick are removed with a single state update.
+ *
+ * Resolved entries are tracked in a second wheel, and are sent a unicast
+ * ARP request or neighbor solicitation every --neighbor_probe_interval_s
+ * after they were last resolved or updated, so that a neighbor that has
+ * moved is picked up by the reply.  Probes are paced by a token bucket
+ * shared by all VLANs (--neighbor_probe_pps), so refreshing thousands of
+ * neighbors never bursts the CPU TX queue.
+ *
+ * With --neighbor_prefetch, the directly connected nexthops of routes that
+ * are added or changed are resolved right away, rather than when traffic
+ * to them is first punted.  Those requests draw from the same token bucket,
+ * ahead of the probes, so a large route update is resolved at a steady
+ * rate.
+ *
+ * When the tables grow past the eviction targets of the NeighborLimits,
+ * the least recently used entries are removed to make room for new ones:
+ * pending entries first, and then the resolved entries that were refreshed
+ * longest ago.  Only probed entries have a refresh time, so resolved
+ * entries are not evicted while probing is disabled.  Entries that are
+ * nexthops of resolved routes are never evicted.
  *
  * This will be used to expire neighbor entries as well once that is
  * implemented.
  */
-class NeighborUpdater {
+class NeighborUpdater : public StateObserver {
  public:
   explicit NeighborUpdater(SwSwitch* sw);
   ~NeighborUpdater();
 
-  void stateChanged(const StateDelta& delta);
+  void stateChanged(const StateDelta& delta) override;
  private:
-  void vlanAdded(const SwitchState* state, const Vlan* vlan);
-  void vlanDeleted(const Vlan* vlan);
-
+  // Forbidden copy constructor and assignment operator
+  NeighborUpdater(NeighborUpdater const &) = delete;
+  NeighborUpdater& operator=(NeighborUpdater const &) = delete;
 
   /**
-   * updaters_ should only ever be accessed from the state update thread,
-   * so we don't need to lock accesses.
+   * impl_ should only ever be accessed from the background thread, where
+   * state changes are delivered, so we don't need to lock accesses.
    */
-  boost::container::flat_map<VlanID, NeighborUpdaterImpl*> updaters_;
+  NeighborUpdaterImpl* impl_{nullptr};
   SwSwitch* sw_{nullptr};
 };
 
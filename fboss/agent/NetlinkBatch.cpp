@@ -0,0 +1,121 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NetlinkBatch.h"
+
+extern "C" {
+#include <linux/netlink.h>
+#include <sys/socket.h>
+}
+
+#include "fboss/agent/SysError.h"
+
+#include <glog/logging.h>
+#include <string.h>
+
+namespace facebook { namespace fboss {
+
+void NetlinkBatch::add(const struct nlmsghdr* n, std::string desc) {
+  Request request;
+  request.msg.assign(reinterpret_cast<const char*>(n),
+                     NLMSG_ALIGN(n->nlmsg_len));
+  request.desc = std::move(desc);
+  requests_.push_back(std::move(request));
+}
+
+void NetlinkBatch::flush() {
+  std::vector<Failure> failures;
+  size_t begin = 0;
+  size_t roundTrips = 0;
+  while (begin < requests_.size()) {
+    size_t end = begin;
+    size_t bytes = 0;
+    while (end < requests_.size() && end - begin < kMaxRequestsInFlight &&
+           (end == begin ||
+            bytes + requests_[end].msg.size() <= kMaxBytesInFlight)) {
+      bytes += requests_[end].msg.size();
+      ++end;
+    }
+    sendRequests(begin, end, &failures);
+    ++roundTrips;
+    begin = end;
+  }
+  if (!requests_.empty()) {
+    LOG(INFO) << "Sent " << requests_.size() << " netlink requests in "
+              << roundTrips << " round trips";
+  }
+  requests_.clear();
+
+  for (const auto& failure : failures) {
+    char buf[256];
+    LOG(ERROR) << "Failed to " << failure.desc << ": "
+               << strerror_r(failure.err, buf, sizeof(buf));
+  }
+  if (!failures.empty()) {
+    throw SysError(failures.front().err, "Failed to ",
+                   failures.front().desc);
+  }
+}
+
+void NetlinkBatch::sendRequests(size_t begin, size_t end,
+                                std::vector<Failure>* failures) {
+  // Number the requests, and ask for each of them to be acknowledged, so
+  // that failures can be matched up with the requests that caused them
+  uint32_t firstSeq = rth_->seq + 1;
+  std::string buf;
+  for (size_t i = begin; i < end; ++i) {
+    auto& msg = requests_[i].msg;
+    auto* n = reinterpret_cast<struct nlmsghdr*>(&msg[0]);
+    n->nlmsg_seq = ++rth_->seq;
+    n->nlmsg_pid = 0;
+    n->nlmsg_flags |= NLM_F_ACK;
+    buf.append(msg);
+  }
+
+  struct sockaddr_nl kernel;
+  memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+  auto ret = sendto(rth_->fd, buf.data(), buf.size(), 0,
+                    reinterpret_cast<struct sockaddr*>(&kernel),
+                    sizeof(kernel));
+  sysCheckError(ret, "Failed to send ", end - begin, " netlink requests");
+
+  size_t pending = end - begin;
+  char rbuf[16384];
+  while (pending > 0) {
+    auto len = recv(rth_->fd, rbuf, sizeof(rbuf), 0);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    sysCheckError(len, "Failed to receive netlink acknowledgements");
+    for (auto* h = reinterpret_cast<struct nlmsghdr*>(rbuf);
+         NLMSG_OK(h, static_cast<uint32_t>(len)); h = NLMSG_NEXT(h, len)) {
+      // Skip anything that is not an answer to this round trip, such as
+      // late replies to earlier requests on the same socket
+      if (h->nlmsg_pid != rth_->local.nl_pid || h->nlmsg_seq < firstSeq ||
+          h->nlmsg_seq >= firstSeq + (end - begin) ||
+          h->nlmsg_type != NLMSG_ERROR) {
+        continue;
+      }
+      auto idx = begin + (h->nlmsg_seq - firstSeq);
+      auto* err = static_cast<struct nlmsgerr*>(NLMSG_DATA(h));
+      if (h->nlmsg_len < NLMSG_LENGTH(sizeof(*err))) {
+        failures->push_back({EINVAL, requests_[idx].desc});
+      } else if (err->error != 0) {
+        failures->push_back({-err->error, requests_[idx].desc});
+      } else {
+        VLOG(2) << "Netlink request to " << requests_[idx].desc
+                << " succeeded";
+      }
+      --pending;
+    }
+  }
+}
+
+}} // facebook::fboss
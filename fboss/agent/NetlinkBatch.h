@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libnetlink.h>
+}
+
+namespace facebook { namespace fboss {
+
+/*
+ * NetlinkBatch sends many rtnetlink requests in a few round trips.
+ *
+ * rtnl_talk() waits for the kernel to acknowledge each request before the
+ * next one is sent, so programming hundreds of addresses and rules costs
+ * hundreds of round trips.  NetlinkBatch instead queues the requests, then
+ * writes them to the socket back to back and collects all of their
+ * acknowledgements afterwards.  The kernel still handles the requests one
+ * at a time, in the order they were queued.
+ *
+ * A request that fails does not stop the ones queued after it.  flush()
+ * logs every failure, and throws a SysError for the first one once all the
+ * requests have been acknowledged.
+ */
+class NetlinkBatch {
+ public:
+  enum : size_t {
+    // How many requests to write before waiting for their acknowledgements.
+    // This keeps the acknowledgements from overflowing the socket's receive
+    // buffer.
+    kMaxRequestsInFlight = 128,
+    // The most bytes of requests to write at once
+    kMaxBytesInFlight = 32 * 1024,
+  };
+
+  explicit NetlinkBatch(rtnl_handle* rth) : rth_(rth) {}
+
+  /*
+   * Queue a request.  The message is copied, so it can be reused as soon as
+   * this returns.  'desc' says what the request does, as in "add address
+   * 10.0.0.1/24", for the logs.
+   */
+  void add(const struct nlmsghdr* n, std::string desc);
+
+  /*
+   * Send all queued requests, and wait for them to be acknowledged.
+   */
+  void flush();
+
+  size_t size() const {
+    return requests_.size();
+  }
+
+ private:
+  struct Request {
+    std::string msg;
+    std::string desc;
+  };
+  struct Failure {
+    int err;
+    std::string desc;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  NetlinkBatch(NetlinkBatch const &) = delete;
+  NetlinkBatch& operator=(NetlinkBatch const &) = delete;
+
+  /*
+   * Send requests_[begin, end) and wait for their acknowledgements, adding
+   * any failures to 'failures'.
+   */
+  void sendRequests(size_t begin, size_t end, std::vector<Failure>* failures);
+
+  rtnl_handle* rth_;
+  std::vector<Request> requests_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PackedRouteDecoder.h"
+
+#include "fboss/agent/AddressUtil.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/state/RouteUpdater.h"
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+
+#include <algorithm>
+
+using facebook::network::toIPAddress;
+using folly::ByteRange;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+
+namespace {
+
+const uint8_t* recordsOf(const folly::fbstring& buf) {
+  return reinterpret_cast<const uint8_t*>(buf.data());
+}
+
+size_t numRecords(const folly::fbstring& buf, size_t recordSize,
+                  const char* family) {
+  if (buf.size() % recordSize != 0) {
+    throw facebook::fboss::FbossError(
+        "packed ", family, " routes are ", buf.size(),
+        " bytes, not a whole number of ", recordSize, " byte records");
+  }
+  return buf.size() / recordSize;
+}
+
+uint8_t checkedLength(uint8_t len, uint8_t bitCount) {
+  if (len > bitCount) {
+    throw facebook::fboss::FbossError("invalid prefix length ",
+                                      static_cast<int>(len));
+  }
+  return len;
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+constexpr size_t PackedRouteDecoder::kV4RecordSize;
+constexpr size_t PackedRouteDecoder::kV6RecordSize;
+
+PackedRouteDecoder::PackedRouteDecoder(PackedRoutes routes,
+                                       AdminDistance distance)
+  : routes_(std::move(routes)) {
+  numV4_ = numRecords(routes_.v4Routes, kV4RecordSize, "IPv4");
+  numV6_ = numRecords(routes_.v6Routes, kV6RecordSize, "IPv6");
+  groups_.reserve(routes_.nexthopGroups.size());
+  for (const auto& group : routes_.nexthopGroups) {
+    RouteNextHops nexthops;
+    nexthops.reserve(group.size());
+    for (const auto& nh : group) {
+      nexthops.emplace(toIPAddress(nh));
+    }
+    groups_.emplace_back(std::move(nexthops), distance);
+  }
+  // Only the decoded groups are needed from here on
+  routes_.nexthopGroups.clear();
+}
+
+void PackedRouteDecoder::addRoutes(RouteUpdater* updater, RouterID id,
+                                   ClientID client, size_t begin,
+                                   size_t end) const {
+  auto v4Records = recordsOf(routes_.v4Routes);
+  for (auto i = begin; i < std::min(end, numV4_); ++i) {
+    const uint8_t* p = v4Records + i * kV4RecordSize;
+    auto len = checkedLength(p[4], IPAddressV4::bitCount());
+    auto network = IPAddressV4::fromBinary(ByteRange(p, 4)).mask(len);
+    updater->addRoute(id, RouteUpdater::PrefixV4{network, len}, client,
+                      getGroup(p + 5));
+  }
+
+  auto v6Records = recordsOf(routes_.v6Routes);
+  for (auto i = std::max(begin, numV4_); i < end; ++i) {
+    const uint8_t* p = v6Records + (i - numV4_) * kV6RecordSize;
+    auto len = checkedLength(p[16], IPAddressV6::bitCount());
+    auto network = IPAddressV6::fromBinary(ByteRange(p, 16)).mask(len);
+    updater->addRoute(id, RouteUpdater::PrefixV6{network, len}, client,
+                      getGroup(p + 17));
+  }
+}
+
+const RouteNextHopEntry& PackedRouteDecoder::getGroup(const uint8_t* p) const {
+  uint32_t index = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+    (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+  if (index >= groups_.size()) {
+    throw FbossError("invalid nexthop group index ", index, " of ",
+                     groups_.size(), " groups");
+  }
+  return groups_[index];
+}
+
+}} // facebook::fboss
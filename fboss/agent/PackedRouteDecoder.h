@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/if/gen-cpp2/ctrl_types.h"
+#include "fboss/agent/state/RouteTypes.h"
+#include "fboss/agent/types.h"
+
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class RouteUpdater;
+
+/*
+ * PackedRouteDecoder adds the routes of a PackedRoutes buffer to a
+ * RouteUpdater, decoding each route straight from its record.
+ *
+ * The nexthop groups are decoded once, up front, into interned nexthop
+ * entries, so each route only costs its prefix and a copy of its group's
+ * entry.  The routes are numbered with the IPv4 routes first, then the IPv6
+ * ones, so that a large update can be applied in chunks by index.
+ */
+class PackedRouteDecoder {
+ public:
+  static constexpr size_t kV4RecordSize = 4 + 1 + 4;
+  static constexpr size_t kV6RecordSize = 16 + 1 + 4;
+
+  /*
+   * Throws FbossError if the buffers are not made of whole records, or a
+   * nexthop address is invalid.
+   */
+  PackedRouteDecoder(PackedRoutes routes, AdminDistance distance);
+
+  size_t size() const {
+    return numV4_ + numV6_;
+  }
+
+  /*
+   * Add the routes [begin, end) for the client.  Throws FbossError if a
+   * route has an invalid prefix length or nexthop group index.
+   */
+  void addRoutes(RouteUpdater* updater, RouterID id, ClientID client,
+                 size_t begin, size_t end) const;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  PackedRouteDecoder(PackedRouteDecoder const &) = delete;
+  PackedRouteDecoder& operator=(PackedRouteDecoder const &) = delete;
+
+  // The entry of the nexthop group whose index is encoded at p
+  const RouteNextHopEntry& getGroup(const uint8_t* p) const;
+
+  PackedRoutes routes_;
+  std::vector<RouteNextHopEntry> groups_;
+  size_t numV4_{0};
+  size_t numV6_{0};
+};
+
+}} // facebook::fboss
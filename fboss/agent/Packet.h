@@ -10,6 +10,7 @@
 #pragma once
 
 #include <folly/io/IOBuf.h>
+#include "fboss/agent/PacketLatency.h"
 
 #include <cstdint>
 
@@ -46,6 +47,16 @@ class Packet {
     return buf_.get();
   }
 
+  /*
+   * The latency trace of the packet.  See PacketLatency.
+   */
+  const PacketTrace& getTrace() const {
+    return trace_;
+  }
+  void setTrace(const PacketTrace& trace) {
+    trace_ = trace;
+  }
+
  protected:
   Packet() {}
 
@@ -63,6 +74,9 @@ class Packet {
   // Subclasses should update the IOBuf to point to their packet data,
   // generally using the TAKE_OWNERSHIP or WRAP_BUFFER IOBuf constructors.
   std::unique_ptr<folly::IOBuf> buf_;
+
+ private:
+  PacketTrace trace_;
 };
 
 }} // facebook::fboss
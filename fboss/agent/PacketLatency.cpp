@@ -0,0 +1,196 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PacketLatency.h"
+
+#include <array>
+#include <folly/Conv.h>
+#include <folly/Portability.h>
+#include <gflags/gflags.h>
+#include "common/stats/ExportedHistogram.h"
+#include "common/stats/ServiceData.h"
+#include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/IPv4Handler.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/LldpManager.h"
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/TxPacket.h"
+
+DEFINE_int32(pkt_latency_sample_rate, 1000,
+             "Trace the latency of one in this many trapped packets, from "
+             "SDK RX to handling and any TX in response.  0 disables "
+             "tracing.");
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::seconds;
+
+namespace {
+
+using namespace facebook;
+using namespace facebook::fboss;
+
+enum EthertypeClass : uint8_t {
+  ETH_ARP,
+  ETH_IPV4,
+  ETH_IPV6,
+  ETH_LLDP,
+  ETH_OTHER,
+  NUM_ETHERTYPE_CLASSES,
+};
+const uint8_t kNumStages = 4;
+
+// Latencies are bucketed in 100us steps, up to 20ms
+const int kBucketWidthUs = 100;
+const int kMaxUs = 20000;
+
+FOLLY_TLS uint32_t sampleCount = 0;
+FOLLY_TLS const PacketTrace* currentTrace = nullptr;
+
+EthertypeClass getEthertypeClass(uint16_t ethertype) {
+  switch (ethertype) {
+  case ArpHandler::ETHERTYPE_ARP:
+    return ETH_ARP;
+  case IPv4Handler::ETHERTYPE_IPV4:
+    return ETH_IPV4;
+  case IPv6Handler::ETHERTYPE_IPV6:
+    return ETH_IPV6;
+  case LldpManager::ETHERTYPE_LLDP:
+    return ETH_LLDP;
+  default:
+    return ETH_OTHER;
+  }
+}
+
+const char* getEthertypeClassName(uint8_t cls) {
+  switch (cls) {
+  case ETH_ARP:
+    return "arp";
+  case ETH_IPV4:
+    return "ipv4";
+  case ETH_IPV6:
+    return "ipv6";
+  case ETH_LLDP:
+    return "lldp";
+  }
+  return "other";
+}
+
+class LatencyHistograms {
+ public:
+  LatencyHistograms() {
+    auto histMap = fbData->getHistogramMap();
+    stats::ExportedHistogram tmpl(kBucketWidthUs, 0, kMaxUs);
+    for (uint8_t cls = 0; cls < NUM_ETHERTYPE_CLASSES; ++cls) {
+      for (uint8_t stage = 0; stage < kNumStages; ++stage) {
+        auto name = folly::to<std::string>(
+            SwitchStats::kCounterPrefix, "trapped.latency_us.",
+            getEthertypeClassName(cls), ".",
+            PacketLatency::getStageName(LatencyStage(stage)));
+        hists_[cls][stage] = histMap->getOrCreateUnlocked(name, &tmpl);
+      }
+    }
+  }
+
+  stats::ExportedHistogramMap::LockAndHistogram* get(EthertypeClass cls,
+                                                     LatencyStage stage) {
+    return &hists_[cls][static_cast<uint8_t>(stage)];
+  }
+
+ private:
+  std::array<std::array<stats::ExportedHistogramMap::LockAndHistogram,
+                        kNumStages>,
+             NUM_ETHERTYPE_CLASSES> hists_;
+};
+
+LatencyHistograms* getHistograms() {
+  static LatencyHistograms histograms;
+  return &histograms;
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+bool PacketLatency::shouldSample() {
+  if (FLAGS_pkt_latency_sample_rate <= 0) {
+    return false;
+  }
+  if (++sampleCount < static_cast<uint32_t>(FLAGS_pkt_latency_sample_rate)) {
+    return false;
+  }
+  sampleCount = 0;
+  return true;
+}
+
+void PacketLatency::startTrace(RxPacket* pkt) {
+  pkt->setTrace(PacketTrace(std::chrono::steady_clock::now()));
+}
+
+void PacketLatency::record(const PacketTrace& trace, LatencyStage stage,
+                           TimePoint now) {
+  if (!trace.isActive()) {
+    return;
+  }
+  auto usecs = duration_cast<microseconds>(now - trace.rxTime).count();
+  auto hist = getHistograms()->get(getEthertypeClass(trace.ethertype),
+                                   stage);
+  auto wallNow = duration_cast<seconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+  SpinLockHolder guard(hist->first.get());
+  hist->second->addValue(wallNow, usecs, 1);
+}
+
+void PacketLatency::recordCurrent(LatencyStage stage) {
+  if (currentTrace) {
+    record(*currentTrace, stage);
+  }
+}
+
+void PacketLatency::tagCurrent(TxPacket* pkt) {
+  if (currentTrace) {
+    pkt->setTrace(*currentTrace);
+  }
+}
+
+const char* PacketLatency::getStageName(LatencyStage stage) {
+  switch (stage) {
+  case LatencyStage::DISPATCH:
+    return "dispatch";
+  case LatencyStage::HANDLED:
+    return "handled";
+  case LatencyStage::STATE_UPDATE:
+    return "state_update";
+  case LatencyStage::TX_DONE:
+    return "tx_done";
+  }
+  return "unknown";
+}
+
+PacketLatency::HandlerScope::HandlerScope(RxPacket* pkt, uint16_t ethertype)
+  : trace_(pkt->getTrace()) {
+  if (!trace_.isActive()) {
+    return;
+  }
+  trace_.ethertype = ethertype;
+  record(trace_, LatencyStage::DISPATCH);
+  prev_ = currentTrace;
+  currentTrace = &trace_;
+}
+
+PacketLatency::HandlerScope::~HandlerScope() {
+  if (!trace_.isActive()) {
+    return;
+  }
+  record(trace_, LatencyStage::HANDLED);
+  currentTrace = prev_;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace facebook { namespace fboss {
+
+class RxPacket;
+class TxPacket;
+
+/*
+ * The points at which a traced packet's latency is recorded.  Each one is
+ * measured from the time the packet was received from the SDK.
+ */
+enum class LatencyStage : uint8_t {
+  // SwSwitch::handlePacket() dispatching it to a protocol handler
+  DISPATCH,
+  // The protocol handler returning
+  HANDLED,
+  // The handler enqueueing a state update
+  STATE_UPDATE,
+  // TX completion of a packet the handler sent in response
+  TX_DONE,
+};
+
+/*
+ * The trace carried by a sampled packet.  Packets that are not sampled carry
+ * an inactive trace.
+ */
+struct PacketTrace {
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  PacketTrace() {}
+  explicit PacketTrace(TimePoint rxTime) : rxTime(rxTime) {}
+
+  bool isActive() const {
+    return rxTime != TimePoint();
+  }
+
+  TimePoint rxTime;
+  uint16_t ethertype{0};
+};
+
+/*
+ * PacketLatency records where time goes between the SDK RX callback and the
+ * handling of a trapped packet, including any reply it causes us to send.
+ *
+ * Only one in --pkt_latency_sample_rate packets is traced, so the cost for
+ * all other packets is a thread-local counter increment at RX time and a
+ * check of their trace later on.  Latencies are exported as histograms per
+ * ethertype and stage, named trapped.latency_us.<ethertype>.<stage>.
+ */
+class PacketLatency {
+ public:
+  typedef PacketTrace::TimePoint TimePoint;
+
+  /*
+   * Returns true if the packet being received by the current thread should
+   * be traced.
+   */
+  static bool shouldSample();
+
+  /*
+   * Start tracing a packet received from the SDK, if it is sampled.
+   */
+  static void maybeTrace(RxPacket* pkt) {
+    if (shouldSample()) {
+      startTrace(pkt);
+    }
+  }
+
+  static void record(const PacketTrace& trace, LatencyStage stage) {
+    if (trace.isActive()) {
+      record(trace, stage, std::chrono::steady_clock::now());
+    }
+  }
+  static void record(const PacketTrace& trace, LatencyStage stage,
+                     TimePoint now);
+
+  /*
+   * Record a stage for the packet being handled by the current thread,
+   * if it is traced.
+   */
+  static void recordCurrent(LatencyStage stage);
+
+  /*
+   * Have a packet sent by the current thread carry the trace of the packet
+   * being handled, so its TX completion can be recorded.
+   */
+  static void tagCurrent(TxPacket* pkt);
+
+  static const char* getStageName(LatencyStage stage);
+
+  /*
+   * HandlerScope marks the current thread as handling a packet, from
+   * dispatch to the handler returning.  It records the DISPATCH stage when
+   * constructed and the HANDLED stage when destroyed.
+   */
+  class HandlerScope {
+   public:
+    HandlerScope(RxPacket* pkt, uint16_t ethertype);
+    ~HandlerScope();
+
+   private:
+    // Forbidden copy constructor and assignment operator
+    HandlerScope(HandlerScope const &) = delete;
+    HandlerScope& operator=(HandlerScope const &) = delete;
+
+    PacketTrace trace_;
+    const PacketTrace* prev_{nullptr};
+  };
+
+ private:
+  static void startTrace(RxPacket* pkt);
+};
+
+}} // facebook::fboss
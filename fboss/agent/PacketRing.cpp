@@ -0,0 +1,169 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PacketRing.h"
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cstring>
+
+#include <folly/ScopeGuard.h>
+#include <folly/io/IOBuf.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include "fboss/agent/SysError.h"
+
+DEFINE_int32(packet_ring_blocks, 16,
+             "Number of blocks in each of the receive and transmit rings of "
+             "a packet ring.  Each block holds 256KB of frames.");
+DEFINE_int32(packet_ring_block_timeout_ms, 2,
+             "How long the kernel waits for a partly filled receive block "
+             "to fill before handing it over anyway.  This bounds the "
+             "latency a packet ring adds to packets from the host.");
+
+namespace {
+
+// Receive blocks hold frames of any size back to back.  Transmit slots are
+// a fixed size, large enough for a jumbo frame and the slot header.
+const uint32_t kBlockSize = 1 << 18;
+const uint32_t kFrameSize = 1 << 14;
+// Where the frame starts in a transmit slot
+const uint32_t kTxDataOffset = TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+
+}
+
+namespace facebook { namespace fboss {
+
+PacketRing::PacketRing(const std::string& ifName, int ifIndex,
+                       uint16_t fanoutGroup)
+    : ifName_(ifName),
+      blockSize_(kBlockSize),
+      numBlocks_(std::max(FLAGS_packet_ring_blocks, 1)),
+      frameSize_(kFrameSize) {
+  // Nothing is received until the socket is bound, after the rings are set
+  // up
+  fd_ = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  sysCheckError(fd_, "Failed to open packet socket for ", ifName_);
+  SCOPE_FAIL {
+    if (map_) {
+      munmap(map_, mapSize_);
+    }
+    close(fd_);
+  };
+
+  int version = TPACKET_V3;
+  auto ret = setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version,
+                        sizeof(version));
+  sysCheckError(ret, "Failed to use TPACKET_V3 on ", ifName_);
+
+  struct tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = blockSize_;
+  req.tp_block_nr = numBlocks_;
+  req.tp_frame_size = frameSize_;
+  req.tp_frame_nr = (blockSize_ / frameSize_) * numBlocks_;
+  req.tp_retire_blk_tov = FLAGS_packet_ring_block_timeout_ms;
+  ret = setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+  sysCheckError(ret, "Failed to set up the receive ring of ", ifName_);
+  req.tp_retire_blk_tov = 0;
+  ret = setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+  sysCheckError(ret, "Failed to set up the transmit ring of ", ifName_);
+  txFrames_ = req.tp_frame_nr;
+
+  // The receive ring comes first in the mapping, then the transmit ring
+  size_t ringSize = static_cast<size_t>(blockSize_) * numBlocks_;
+  mapSize_ = 2 * ringSize;
+  auto map = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd_, 0);
+  if (map == MAP_FAILED) {
+    sysCheckError(-1, "Failed to map the rings of ", ifName_);
+  }
+  map_ = static_cast<uint8_t*>(map);
+  rxRing_ = map_;
+  txRing_ = map_ + ringSize;
+
+  struct sockaddr_ll addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = ifIndex;
+  ret = bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+  sysCheckError(ret, "Failed to bind packet socket to ", ifName_);
+
+  if (fanoutGroup != 0) {
+    int fanout = fanoutGroup | (PACKET_FANOUT_HASH << 16);
+    ret = setsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &fanout,
+                     sizeof(fanout));
+    sysCheckError(ret, "Failed to join fanout group ", fanoutGroup,
+                  " on ", ifName_);
+  }
+  LOG(INFO) << "Opened packet ring on " << ifName_ << " @ fd " << fd_
+            << " with " << numBlocks_ << " blocks each way";
+}
+
+PacketRing::~PacketRing() {
+  munmap(map_, mapSize_);
+  auto ret = close(fd_);
+  sysLogError(ret, "Failed to close packet ring fd ", fd_, " for ",
+              ifName_);
+}
+
+void PacketRing::releaseRxBlock() {
+  __atomic_store_n(&rxBlock(rxBlock_)->hdr.bh1.block_status,
+                   TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+  rxBlock_ = (rxBlock_ + 1) % numBlocks_;
+  rxNext_ = 0;
+  rxOffset_ = 0;
+}
+
+bool PacketRing::queueFrame(const uint8_t* hdr, uint32_t hdrLen,
+                            const folly::IOBuf* payload) {
+  auto len = hdrLen + payload->computeChainDataLength();
+  if (kTxDataOffset + len > frameSize_) {
+    return false;
+  }
+  auto* slot = txRing_ + static_cast<size_t>(txNext_) * frameSize_;
+  auto* pkt = reinterpret_cast<tpacket3_hdr*>(slot);
+  auto status = __atomic_load_n(&pkt->tp_status, __ATOMIC_ACQUIRE);
+  // A slot the kernel rejected is free again, like one it has sent
+  if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+    return false;
+  }
+  auto* data = slot + kTxDataOffset;
+  memcpy(data, hdr, hdrLen);
+  data += hdrLen;
+  for (const auto& range : *payload) {
+    memcpy(data, range.data(), range.size());
+    data += range.size();
+  }
+  pkt->tp_len = len;
+  pkt->tp_next_offset = 0;
+  __atomic_store_n(&pkt->tp_status, TP_STATUS_SEND_REQUEST,
+                   __ATOMIC_RELEASE);
+  txNext_ = (txNext_ + 1) % txFrames_;
+  return true;
+}
+
+bool PacketRing::flush() {
+  int ret = 0;
+  do {
+    ret = send(fd_, nullptr, 0, MSG_DONTWAIT);
+  } while (ret == -1 && errno == EINTR);
+  // The kernel sends what it can, and leaves the rest for the next flush
+  return ret >= 0 || errno == EAGAIN || errno == ENOBUFS;
+}
+
+}} // facebook::fboss
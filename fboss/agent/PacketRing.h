@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+extern "C" {
+#include <linux/if_packet.h>
+}
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook { namespace fboss {
+
+/*
+ * PacketRing is an AF_PACKET socket on one interface, with a receive and a
+ * transmit ring (TPACKET_V3) shared with the kernel.
+ *
+ * Received frames are read straight out of the receive ring, which the
+ * kernel fills in blocks, so reading a burst of frames takes no system
+ * calls at all.  Frames to send are copied into the transmit ring, and the
+ * kernel is told to send all of them with a single send().
+ *
+ * Rings opened on the same interface with the same fanout group share the
+ * received traffic by flow, so each can be served by its own thread.
+ *
+ * This needs a kernel with TPACKET_V3 transmit support (4.11 or later).
+ * A PacketRing is not thread safe.
+ */
+class PacketRing {
+ public:
+  /*
+   * Open a ring on the interface.  A fanoutGroup of 0 means the ring gets
+   * all of the interface's traffic.
+   */
+  PacketRing(const std::string& ifName, int ifIndex, uint16_t fanoutGroup);
+  ~PacketRing();
+
+  int getFD() const {
+    return fd_;
+  }
+
+  /*
+   * Call fn(const uint8_t* frame, uint32_t length) for up to 'max' frames
+   * received on the interface, oldest first.  The frames start with their
+   * Ethernet header, and are only valid during the call.  Frames sent
+   * through the interface, including ours, are skipped, and frames that did
+   * not fit in the ring are counted in *truncated rather than passed to fn.
+   *
+   * Returns the number of frames passed to fn.
+   */
+  template<typename FN>
+  uint32_t receive(uint32_t max, FN fn, uint32_t* truncated);
+
+  /*
+   * Copy a frame, made of the given header followed by the payload, into
+   * the transmit ring.  Returns false, and copies nothing, if the ring is
+   * full or the frame is too large for it.  Queued frames are sent by
+   * flush().
+   */
+  bool queueFrame(const uint8_t* hdr, uint32_t hdrLen,
+                  const folly::IOBuf* payload);
+
+  /*
+   * Have the kernel send all queued frames.  Returns false, with errno set,
+   * if it could not.
+   */
+  bool flush();
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  PacketRing(PacketRing const &) = delete;
+  PacketRing& operator=(PacketRing const &) = delete;
+
+  tpacket_block_desc* rxBlock(uint32_t idx) const {
+    return reinterpret_cast<tpacket_block_desc*>(
+        rxRing_ + static_cast<size_t>(idx) * blockSize_);
+  }
+  // Hand the current receive block back to the kernel
+  void releaseRxBlock();
+
+  std::string ifName_;
+  int fd_{-1};
+  uint8_t* map_{nullptr};
+  size_t mapSize_{0};
+  uint32_t blockSize_{0};
+  uint32_t numBlocks_{0};
+  uint32_t frameSize_{0};
+
+  uint8_t* rxRing_{nullptr};
+  // The block being read, and where in it the next frame is.  rxNext_ is
+  // the number of frames of the block already read.
+  uint32_t rxBlock_{0};
+  uint32_t rxNext_{0};
+  uint32_t rxOffset_{0};
+
+  uint8_t* txRing_{nullptr};
+  uint32_t txFrames_{0};
+  // The next transmit slot to fill
+  uint32_t txNext_{0};
+};
+
+template<typename FN>
+uint32_t PacketRing::receive(uint32_t max, FN fn, uint32_t* truncated) {
+  uint32_t received = 0;
+  while (received < max) {
+    auto* block = rxBlock(rxBlock_);
+    auto& hdr = block->hdr.bh1;
+    if (!(__atomic_load_n(&hdr.block_status, __ATOMIC_ACQUIRE) &
+          TP_STATUS_USER)) {
+      // The kernel is still filling it
+      break;
+    }
+    if (rxNext_ == 0) {
+      rxOffset_ = hdr.offset_to_first_pkt;
+    }
+    while (rxNext_ < hdr.num_pkts && received < max) {
+      auto* base = reinterpret_cast<uint8_t*>(block) + rxOffset_;
+      auto* pkt = reinterpret_cast<tpacket3_hdr*>(base);
+      auto* sll = reinterpret_cast<sockaddr_ll*>(
+          base + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+      rxOffset_ += pkt->tp_next_offset;
+      ++rxNext_;
+      if (sll->sll_pkttype == PACKET_OUTGOING) {
+        continue;
+      }
+      if (pkt->tp_snaplen < pkt->tp_len) {
+        ++*truncated;
+        continue;
+      }
+      fn(base + pkt->tp_mac, pkt->tp_snaplen);
+      ++received;
+    }
+    if (rxNext_ < hdr.num_pkts) {
+      break;
+    }
+    releaseRxBlock();
+  }
+  return received;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PeriodicTransmitter.h"
+
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/TxPacket.h"
+
+#include <folly/ExceptionString.h>
+#include <folly/io/async/EventBase.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+DEFINE_int32(periodic_tx_pps, 1000,
+             "The most periodic control packets, such as LLDP frames and "
+             "router advertisements, sent per second.  Packets beyond the "
+             "rate are held back until the rate allows.  0 disables the "
+             "limit");
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+PeriodicTxScheduler::Config getConfigFromFlags() {
+  PeriodicTxScheduler::Config config;
+  config.maxPps = std::max(FLAGS_periodic_tx_pps, 0);
+  return config;
+}
+
+} // unnamed namespace
+
+PeriodicTransmitter::PeriodicTransmitter(SwSwitch* sw, folly::EventBase* evb)
+  : PeriodicTransmitter(sw, evb, getConfigFromFlags()) {
+}
+
+PeriodicTransmitter::PeriodicTransmitter(
+    SwSwitch* sw, folly::EventBase* evb,
+    const PeriodicTxScheduler::Config& config)
+  : AsyncTimeout(evb),
+    sw_(sw),
+    evb_(evb),
+    scheduler_(config) {
+}
+
+void PeriodicTransmitter::setSender(Protocol protocol, uint32_t id,
+                                    milliseconds interval,
+                                    uint32_t jitterPercent, BuildFn build) {
+  DCHECK(evb_->isInEventBaseThread());
+  auto key = getKey(protocol, id);
+  senders_[key] = std::move(build);
+  scheduler_.add(key, interval, jitterPercent, steady_clock::now());
+  scheduleNext();
+}
+
+void PeriodicTransmitter::removeSender(Protocol protocol, uint32_t id) {
+  DCHECK(evb_->isInEventBaseThread());
+  auto key = getKey(protocol, id);
+  senders_.erase(key);
+  scheduler_.remove(key);
+  scheduleNext();
+}
+
+PeriodicTxScheduler::TimePoint PeriodicTransmitter::getDue(
+    Protocol protocol, uint32_t id) const {
+  DCHECK(evb_->isInEventBaseThread());
+  return scheduler_.getDue(getKey(protocol, id));
+}
+
+void PeriodicTransmitter::setDue(Protocol protocol, uint32_t id,
+                                 PeriodicTxScheduler::TimePoint due) {
+  DCHECK(evb_->isInEventBaseThread());
+  scheduler_.setDue(getKey(protocol, id), due);
+  scheduleNext();
+}
+
+void PeriodicTransmitter::scheduleNext() {
+  auto now = steady_clock::now();
+  auto wakeup = scheduler_.getNextWakeup(now);
+  if (wakeup == PeriodicTxScheduler::TimePoint::max()) {
+    cancelTimeout();
+    return;
+  }
+  // Round up, so that we never wake up just before a sender is due
+  auto delay = milliseconds(0);
+  if (wakeup > now) {
+    delay = duration_cast<milliseconds>(wakeup - now + milliseconds(1) -
+                                        steady_clock::duration(1));
+  }
+  scheduleTimeout(delay);
+}
+
+void PeriodicTransmitter::timeoutExpired() noexcept {
+  std::vector<std::unique_ptr<TxPacket>> switched;
+  std::vector<std::pair<std::unique_ptr<TxPacket>, PortID>> outOfPort;
+  for (auto key : scheduler_.takeDue(steady_clock::now())) {
+    Packet packet;
+    try {
+      packet = senders_[key]();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "failed to build periodic packet " << key << ": "
+                 << folly::exceptionStr(ex);
+      continue;
+    }
+    if (!packet.pkt) {
+      continue;
+    }
+    if (packet.port) {
+      outOfPort.emplace_back(std::move(packet.pkt), *packet.port);
+    } else {
+      switched.push_back(std::move(packet.pkt));
+    }
+  }
+  sw_->sendPacketsSwitched(std::move(switched));
+  sw_->sendPacketsOutOfPort(std::move(outOfPort));
+  scheduleNext();
+}
+
+}} // facebook::fboss
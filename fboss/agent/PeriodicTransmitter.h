@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/PeriodicTxScheduler.h"
+#include "fboss/agent/types.h"
+
+#include <folly/Optional.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace fboss {
+
+class SwSwitch;
+class TxPacket;
+
+/*
+ * PeriodicTransmitter sends the periodic control packets of the switch,
+ * such as LLDP on each port and RAs on each interface, when the
+ * PeriodicTxScheduler says they are due.
+ *
+ * Having one transmitter for all of them, rather than a timer each, spreads
+ * the packets across their intervals and limits them to --periodic_tx_pps
+ * overall, so the CPU sends a steady trickle of them instead of bursts of
+ * hundreds every interval.  The packets that fall due together are sent as
+ * one batch.
+ *
+ * Everything here, including the calls to the BuildFns, happens in the
+ * EventBase thread.
+ */
+class PeriodicTransmitter : private folly::AsyncTimeout {
+ public:
+  enum class Protocol : uint8_t {
+    LLDP,
+    RA,
+  };
+
+  /*
+   * A packet to send, and the port to send it out of.  Packets without a
+   * port are sent switched.
+   */
+  struct Packet {
+    std::unique_ptr<TxPacket> pkt;
+    folly::Optional<PortID> port;
+  };
+  /*
+   * Build the packet of a sender.  Returning a Packet without a pkt skips
+   * this interval.
+   */
+  typedef std::function<Packet()> BuildFn;
+
+  /*
+   * Create a transmitter configured by the --periodic_tx_* flags.
+   */
+  PeriodicTransmitter(SwSwitch* sw, folly::EventBase* evb);
+  PeriodicTransmitter(SwSwitch* sw, folly::EventBase* evb,
+                      const PeriodicTxScheduler::Config& config);
+
+  /*
+   * Add a sender, identified by its protocol and an ID of the protocol's
+   * choosing, or replace the packet and interval of an existing one.  See
+   * PeriodicTxScheduler::add().
+   */
+  void setSender(Protocol protocol, uint32_t id,
+                 std::chrono::milliseconds interval, uint32_t jitterPercent,
+                 BuildFn build);
+  void removeSender(Protocol protocol, uint32_t id);
+  bool hasSender(Protocol protocol, uint32_t id) const {
+    return senders_.count(getKey(protocol, id)) != 0;
+  }
+
+  /*
+   * When the sender is due next, or bring it forward.  See
+   * PeriodicTxScheduler::getDue() and setDue().
+   */
+  PeriodicTxScheduler::TimePoint getDue(Protocol protocol,
+                                        uint32_t id) const;
+  void setDue(Protocol protocol, uint32_t id,
+              PeriodicTxScheduler::TimePoint due);
+
+ private:
+  typedef PeriodicTxScheduler::Key Key;
+
+  // Forbidden copy constructor and assignment operator
+  PeriodicTransmitter(PeriodicTransmitter const &) = delete;
+  PeriodicTransmitter& operator=(PeriodicTransmitter const &) = delete;
+
+  static Key getKey(Protocol protocol, uint32_t id) {
+    return (static_cast<Key>(protocol) << 32) | id;
+  }
+  void scheduleNext();
+
+  void timeoutExpired() noexcept override;
+
+  SwSwitch* const sw_{nullptr};
+  folly::EventBase* const evb_{nullptr};
+  PeriodicTxScheduler scheduler_;
+  std::unordered_map<Key, BuildFn> senders_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PeriodicTxScheduler.h"
+
+#include <folly/Random.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+PeriodicTxScheduler::PeriodicTxScheduler(const Config& config)
+  : config_(config),
+    // A tenth of a second of packets, so a burst of senders that fall due
+    // together is still spread out
+    burst_(std::max<double>(config.maxPps / 10, 1)),
+    tokens_(burst_) {
+}
+
+milliseconds PeriodicTxScheduler::firstDelay(const Entry& entry) {
+  if (entry.jitterPercent == 0) {
+    return entry.interval;
+  }
+  return milliseconds(folly::Random::rand64(entry.interval.count()) + 1);
+}
+
+milliseconds PeriodicTxScheduler::nextDelay(const Entry& entry) {
+  uint64_t maxJitterMs =
+    entry.interval.count() * std::min<uint32_t>(entry.jitterPercent, 100) /
+    100;
+  if (maxJitterMs == 0) {
+    return entry.interval;
+  }
+  return entry.interval - milliseconds(folly::Random::rand64(maxJitterMs + 1));
+}
+
+void PeriodicTxScheduler::add(Key key, milliseconds interval,
+                              uint32_t jitterPercent, TimePoint now) {
+  interval = std::max(interval, milliseconds(1));
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    auto& entry = it->second;
+    entry.jitterPercent = jitterPercent;
+    if (entry.interval != interval) {
+      entry.interval = interval;
+      schedule(key, &entry, now + firstDelay(entry));
+    }
+    return;
+  }
+  Entry entry{interval, jitterPercent, TimePoint()};
+  entry.due = now + firstDelay(entry);
+  queue_.emplace(entry.due, key);
+  entries_.emplace(key, entry);
+}
+
+void PeriodicTxScheduler::remove(Key key) {
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return;
+  }
+  queue_.erase(std::make_pair(it->second.due, key));
+  entries_.erase(it);
+}
+
+PeriodicTxScheduler::TimePoint PeriodicTxScheduler::getDue(Key key) const {
+  auto it = entries_.find(key);
+  CHECK(it != entries_.end()) << "no periodic sender " << key;
+  return it->second.due;
+}
+
+void PeriodicTxScheduler::setDue(Key key, TimePoint due) {
+  auto it = entries_.find(key);
+  CHECK(it != entries_.end()) << "no periodic sender " << key;
+  schedule(key, &it->second, due);
+}
+
+void PeriodicTxScheduler::schedule(Key key, Entry* entry, TimePoint due) {
+  queue_.erase(std::make_pair(entry->due, key));
+  entry->due = due;
+  queue_.emplace(due, key);
+}
+
+void PeriodicTxScheduler::refill(TimePoint now) {
+  if (config_.maxPps == 0) {
+    return;
+  }
+  if (lastRefill_ != TimePoint() && now > lastRefill_) {
+    std::chrono::duration<double> elapsed = now - lastRefill_;
+    tokens_ = std::min(burst_, tokens_ + elapsed.count() * config_.maxPps);
+  }
+  lastRefill_ = std::max(now, lastRefill_);
+}
+
+std::vector<PeriodicTxScheduler::Key> PeriodicTxScheduler::takeDue(
+    TimePoint now) {
+  refill(now);
+  std::vector<Key> due;
+  while (!queue_.empty() && queue_.begin()->first <= now) {
+    if (config_.maxPps != 0) {
+      if (tokens_ < 1) {
+        break;
+      }
+      tokens_ -= 1;
+    }
+    auto key = queue_.begin()->second;
+    auto& entry = entries_.find(key)->second;
+    schedule(key, &entry, now + nextDelay(entry));
+    due.push_back(key);
+  }
+  return due;
+}
+
+PeriodicTxScheduler::TimePoint PeriodicTxScheduler::getNextWakeup(
+    TimePoint now) const {
+  if (queue_.empty()) {
+    return TimePoint::max();
+  }
+  auto first = queue_.begin()->first;
+  if (first > now || config_.maxPps == 0) {
+    return first;
+  }
+  double tokens = tokens_;
+  if (lastRefill_ != TimePoint() && now > lastRefill_) {
+    std::chrono::duration<double> elapsed = now - lastRefill_;
+    tokens = std::min(burst_, tokens + elapsed.count() * config_.maxPps);
+  }
+  if (tokens >= 1) {
+    return now;
+  }
+  std::chrono::duration<double> wait((1 - tokens) / config_.maxPps);
+  return now + duration_cast<steady_clock::duration>(wait) +
+    steady_clock::duration(1);
+}
+
+}} // facebook::fboss
@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * PeriodicTxScheduler decides when each of a set of periodic packets is
+ * sent, such as the LLDP frame of each port or the RA of each interface.
+ *
+ * A sender that is added starts at a random point in its first interval,
+ * and each later interval is randomly shortened by up to its jitter, so
+ * that senders added together, such as all of the ports at startup, are
+ * spread evenly across the interval rather than all sending at once.  On
+ * top of that, the packets of all of the senders are limited to maxPps: a
+ * sender that falls due beyond the rate stays due, and is sent as soon as
+ * the rate allows.
+ *
+ * The caller provides the time, so PeriodicTxScheduler does no I/O of its
+ * own.  It is not thread safe.
+ */
+class PeriodicTxScheduler {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  typedef uint64_t Key;
+
+  struct Config {
+    // Packets per second across all of the senders.  0 means unlimited.
+    uint32_t maxPps{0};
+  };
+
+  explicit PeriodicTxScheduler(const Config& config);
+
+  /*
+   * Send for the key every interval, with each interval randomly shortened
+   * by up to jitterPercent of it.  Unless jitterPercent is 0, a new key is
+   * first due at a random point in its first interval, otherwise one whole
+   * interval from now.
+   *
+   * A key that is added again keeps its next send, unless its interval
+   * changed, in which case it starts over with the new interval.
+   */
+  void add(Key key, std::chrono::milliseconds interval,
+           uint32_t jitterPercent, TimePoint now);
+  void remove(Key key);
+  bool contains(Key key) const {
+    return entries_.count(key) != 0;
+  }
+
+  /*
+   * When the key is due next.  The key must have been added.
+   */
+  TimePoint getDue(Key key) const;
+  /*
+   * Make the key due at the given time instead, after which it carries on
+   * with its interval from when it is sent.
+   */
+  void setDue(Key key, TimePoint due);
+
+  /*
+   * Take the keys that are due by now, in the order they fell due, and
+   * schedule each of them for its next interval.  Keys beyond the rate
+   * limit are left due for a later call.
+   */
+  std::vector<Key> takeDue(TimePoint now);
+
+  /*
+   * When takeDue() next has a key to return: when the first key falls due,
+   * or when the rate limit next allows a send if keys are due already.
+   * Returns TimePoint::max() if there are no keys.
+   */
+  TimePoint getNextWakeup(TimePoint now) const;
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    std::chrono::milliseconds interval;
+    uint32_t jitterPercent;
+    TimePoint due;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  PeriodicTxScheduler(PeriodicTxScheduler const &) = delete;
+  PeriodicTxScheduler& operator=(PeriodicTxScheduler const &) = delete;
+
+  static std::chrono::milliseconds firstDelay(const Entry& entry);
+  static std::chrono::milliseconds nextDelay(const Entry& entry);
+  void refill(TimePoint now);
+  void schedule(Key key, Entry* entry, TimePoint due);
+
+  const Config config_;
+  const double burst_;
+  double tokens_;
+  TimePoint lastRefill_;
+  std::unordered_map<Key, Entry> entries_;
+  // The keys in the order they fall due
+  std::set<std::pair<TimePoint, Key>> queue_;
+};
+
+}} // facebook::fboss
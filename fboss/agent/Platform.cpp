@@ -14,9 +14,15 @@
 #include "fboss/agent/state/SwitchState.h"
 
 DEFINE_string(switch_state_file, "switch_state",
-    "File for dumping switch state JSON in on exit");
+    "File for saving the switch state on exit.  The warm boot copy is a "
+    "binary StateSnapshot, while the crash dump copy is JSON");
 DEFINE_string(hw_state_file, "hw_state",
               "File for dumping HW state on crash");
+DEFINE_string(event_trace_file, "event_trace",
+              "File for dumping the event trace on crash");
+DEFINE_string(state_checkpoint_file, "switch_state_checkpoint",
+              "File for the periodic StateSnapshot checkpoints of the switch "
+              "state, which are used to warm boot after a crash");
 
 namespace facebook { namespace fboss {
 
@@ -24,6 +30,10 @@ std::string Platform::getWarmBootSwitchStateFile() const {
   return getWarmBootDir() + "/" + FLAGS_switch_state_file;
 }
 
+std::string Platform::getStateCheckpointFile() const {
+  return getWarmBootDir() + "/" + FLAGS_state_checkpoint_file;
+}
+
 std::string Platform::getCrashHwStateFile() const {
   return getCrashInfoDir() + "/" + FLAGS_hw_state_file;
 }
@@ -32,4 +42,8 @@ std::string Platform::getCrashSwitchStateFile() const {
   return getCrashInfoDir() + "/" + FLAGS_switch_state_file;
 }
 
+std::string Platform::getCrashEventTraceFile() const {
+  return getCrashInfoDir() + "/" + FLAGS_event_trace_file;
+}
+
 }} //facebook::fboss
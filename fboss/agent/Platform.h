@@ -94,6 +94,11 @@ class Platform {
    * Get filename where switch state JSON maybe stored
    */
   std::string getWarmBootSwitchStateFile() const;
+  /*
+   * Get filename where the periodic checkpoints of the switch state are
+   * stored, so that the agent can warm boot after a crash.
+   */
+  std::string getStateCheckpointFile() const;
   /*
    * Get the directory where we will dump info when there is a crash.
    *
@@ -117,6 +122,10 @@ class Platform {
    * Get filename for where we dump switch state on crash
    */
   std::string getCrashSwitchStateFile() const;
+  /*
+   * Get filename for where we dump the event trace on crash
+   */
+  std::string getCrashEventTraceFile() const;
 
  private:
   // Forbidden copy constructor and assignment operator
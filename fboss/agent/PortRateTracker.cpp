@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PortRateTracker.h"
+
+#include <algorithm>
+
+using std::chrono::seconds;
+
+namespace facebook { namespace fboss {
+
+PortRateTracker::PortRateTracker(const std::vector<seconds>& windows) {
+  for (auto window : windows) {
+    maxWindow_ = std::max(maxWindow_, window);
+    WindowRates rates;
+    rates.window = window;
+    rates.perSec.fill(0);
+    rates_.push_back(rates);
+  }
+}
+
+void PortRateTracker::addSample(TimePoint now, const Values& values) {
+  samples_.emplace_back(now, values);
+  // Drop the samples the longest window no longer needs
+  while (samples_.size() > 1 && samples_[1].first <= now - maxWindow_) {
+    samples_.pop_front();
+  }
+
+  for (auto& rates : rates_) {
+    // The last sample at or before the start of the window, or the oldest
+    // one if the window goes back further than the samples do
+    auto start = std::upper_bound(
+        samples_.begin(), samples_.end(), now - rates.window,
+        [](TimePoint time, const Sample& sample) {
+          return time < sample.first;
+        });
+    const auto& base = start == samples_.begin() ? *start : *(start - 1);
+    std::chrono::duration<double> elapsed = now - base.first;
+    for (size_t idx = 0; idx < NUM_COUNTERS; ++idx) {
+      if (elapsed.count() <= 0 || values[idx] < base.second[idx]) {
+        rates.perSec[idx] = 0;
+      } else {
+        rates.perSec[idx] = (values[idx] - base.second[idx]) / elapsed.count();
+      }
+    }
+  }
+}
+
+}} // facebook::fboss
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * PortRateTracker computes the rates of a port's counters over a set of
+ * windows, such as the last 10 seconds and the last minute, from the
+ * counter values read at each stats update.
+ *
+ * The rates are computed once per update, when the counters are read, so
+ * that everything that wants them can share them instead of each polling
+ * the raw counters and computing its own.  Until a window's worth of
+ * samples has been added, its rates cover as much of it as there are
+ * samples for.
+ *
+ * The caller provides the time, and PortRateTracker is not thread safe.
+ */
+class PortRateTracker {
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  enum Counter : uint8_t {
+    IN_BYTES,
+    IN_PKTS,
+    IN_DISCARDS,
+    OUT_BYTES,
+    OUT_PKTS,
+    OUT_DISCARDS,
+    NUM_COUNTERS,
+  };
+  typedef std::array<uint64_t, NUM_COUNTERS> Values;
+
+  struct WindowRates {
+    std::chrono::seconds window;
+    // The increase of each counter per second, indexed by Counter
+    std::array<double, NUM_COUNTERS> perSec;
+  };
+
+  explicit PortRateTracker(const std::vector<std::chrono::seconds>& windows);
+
+  /*
+   * Add the counter values read at the given time, and compute the rates
+   * over each window up to it.  A counter that went backwards, because it
+   * was cleared, has a rate of 0 until the window no longer spans the
+   * clear.
+   */
+  void addSample(TimePoint now, const Values& values);
+
+  /*
+   * The rates as of the last sample, one per window in the order they
+   * were given.  The rates are all 0 until there are two samples.
+   */
+  const std::vector<WindowRates>& getRates() const {
+    return rates_;
+  }
+
+ private:
+  typedef std::pair<TimePoint, Values> Sample;
+
+  // Forbidden copy constructor and assignment operator
+  PortRateTracker(PortRateTracker const &) = delete;
+  PortRateTracker& operator=(PortRateTracker const &) = delete;
+
+  std::chrono::seconds maxWindow_{0};
+  // The samples covering the longest window, oldest first.  The oldest
+  // sample is the last one at or before the start of the window.
+  std::deque<Sample> samples_;
+  std::vector<WindowRates> rates_;
+};
+
+}} // facebook::fboss
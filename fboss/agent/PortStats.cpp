@@ -35,6 +35,15 @@ void PortStats::pktUnhandled() {
 void PortStats::pktToHost(uint32_t bytes) {
   switchStats_->pktToHost(bytes);
 }
+void PortStats::pktPolicerAccepted(RxPolicerClass cls) {
+  switchStats_->pktPolicerAccepted(cls);
+}
+void PortStats::pktPolicerDropped(RxPolicerClass cls) {
+  switchStats_->pktPolicerDropped(cls);
+}
+void PortStats::trappedPktSize(TrappedProto proto, uint32_t bytes) {
+  switchStats_->trappedPktSize(portID_, proto, bytes);
+}
 
 void PortStats::arpPkt() {
   switchStats_->arpPkt();
@@ -118,4 +127,26 @@ void PortStats::dhcpV6DropPkt() {
   switchStats_->dhcpV6DropPkt();
 }
 
+void PortStats::hwInDiscards(uint64_t pkts) {
+  switchStats_->hwInDiscards(pkts);
+}
+void PortStats::hwInErrors(uint64_t pkts) {
+  switchStats_->hwInErrors(pkts);
+}
+void PortStats::hwOutDiscards(uint64_t pkts) {
+  switchStats_->hwOutDiscards(pkts);
+}
+void PortStats::hwOutErrors(uint64_t pkts) {
+  switchStats_->hwOutErrors(pkts);
+}
+void PortStats::hwIpHeaderDrops(uint64_t pkts) {
+  switchStats_->hwIpHeaderDrops(pkts);
+}
+void PortStats::hwIpDiscards(uint64_t pkts) {
+  switchStats_->hwIpDiscards(pkts);
+}
+void PortStats::hwOversizeDrops(uint64_t pkts) {
+  switchStats_->hwOversizeDrops(pkts);
+}
+
 }} // facebook::fboss
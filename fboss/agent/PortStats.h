@@ -14,6 +14,8 @@
 namespace facebook { namespace fboss {
 
 class SwitchStats;
+enum class RxPolicerClass : uint8_t;
+enum class TrappedProto : uint8_t;
 
 class PortStats {
  public:
@@ -25,6 +27,9 @@ class PortStats {
   void pktError();
   void pktUnhandled();
   void pktToHost(uint32_t bytes); // number of packets forward to host
+  void pktPolicerAccepted(RxPolicerClass cls);
+  void pktPolicerDropped(RxPolicerClass cls);
+  void trappedPktSize(TrappedProto proto, uint32_t bytes);
 
   void arpPkt();
   void arpUnsupported();
@@ -56,6 +61,15 @@ class PortStats {
   void dhcpV6BadPkt();
   void dhcpV6DropPkt();
 
+  // Hardware counters, by how much they increased since the last update
+  void hwInDiscards(uint64_t pkts);
+  void hwInErrors(uint64_t pkts);
+  void hwOutDiscards(uint64_t pkts);
+  void hwOutErrors(uint64_t pkts);
+  void hwIpHeaderDrops(uint64_t pkts);
+  void hwIpDiscards(uint64_t pkts);
+  void hwOversizeDrops(uint64_t pkts);
+
  private:
   // Forbidden copy constructor and assignment operator
   PortStats(PortStats const &) = delete;
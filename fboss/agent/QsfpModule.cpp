@@ -0,0 +1,289 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/QsfpModule.h"
+
+#include "fboss/agent/FbossError.h"
+
+#include <folly/Conv.h>
+#include <glog/logging.h>
+
+#include <cstring>
+#include <map>
+
+namespace facebook { namespace fboss {
+
+using std::lock_guard;
+
+namespace {
+
+const int kQsfpAddress = 0x50;
+
+/* Lower page */
+const int kStatus = 2;
+// Set in the status byte for flat memory modules
+const uint8_t kFlatMem = 1 << 2;
+// RX LOS in the low nibble, one bit per lane
+const int kLos = 3;
+// TX fault in the low nibble, one bit per lane
+const int kTxFault = 4;
+// High alarm, low alarm, high warning and low warning in the high nibble
+const int kTempFlags = 6;
+const int kVccFlags = 7;
+// A nibble per lane, with the same bits, lane 1 in the high nibble
+const int kRxPwrFlags = 9;
+const int kTxBiasFlags = 11;
+const int kTxPwrFlags = 13;
+const int kTemp = 22;
+const int kVcc = 26;
+// Two bytes per lane
+const int kRxPwr = 34;
+const int kTxBias = 42;
+const int kTxPwr = 50;
+const int kMonitorsEnd = 58;
+const int kPageSelect = 127;
+
+/* Upper page 3, the thresholds.  Each is high alarm, low alarm, high
+ * warning, low warning, two bytes each.
+ */
+const int kTempThresh = 128;
+const int kVccThresh = 144;
+const int kRxPwrThresh = 176;
+const int kTxBiasThresh = 184;
+const int kTxPwrThresh = 192;
+
+struct FieldInfo {
+  int offset;
+  int length;
+};
+
+// The offsets of the upper page 0 fields
+const std::map<SfpIdpromFields, FieldInfo> qsfpFields = {
+  {SfpIdpromFields::IDENTIFIER, {128, 1}},
+  {SfpIdpromFields::VENDOR_NAME, {148, 16}},
+  {SfpIdpromFields::VENDOR_OUI, {165, 3}},
+  {SfpIdpromFields::PART_NUMBER, {168, 16}},
+  {SfpIdpromFields::REVISION_NUMBER, {184, 2}},
+  {SfpIdpromFields::VENDOR_SERIAL_NUMBER, {196, 16}},
+  {SfpIdpromFields::MFG_DATE, {212, 8}},
+};
+
+uint16_t getU16(const uint8_t* data, int offset) {
+  return (data[offset] << 8) | data[offset + 1];
+}
+
+double getTemp(const uint8_t* data, int offset) {
+  return static_cast<int16_t>(getU16(data, offset)) / 256.0;
+}
+// In V, from units of 100uV
+double getVcc(const uint8_t* data, int offset) {
+  return getU16(data, offset) / 10000.0;
+}
+// In mW, from units of 0.1uW
+double getPwr(const uint8_t* data, int offset) {
+  return getU16(data, offset) / 10000.0;
+}
+// In mA, from units of 2uA
+double getTxBias(const uint8_t* data, int offset) {
+  return getU16(data, offset) * 2 / 1000.0;
+}
+
+// The high alarm, low alarm, high warning and low warning bits of a lane
+uint8_t getLaneFlags(const uint8_t* data, int offset, int lane) {
+  uint8_t byte = data[offset + lane / 2];
+  return (lane % 2 == 0) ? (byte >> 4) : (byte & 0xf);
+}
+
+std::string getString(const uint8_t* data, SfpIdpromFields field) {
+  const auto& info = qsfpFields.at(field);
+  auto str = reinterpret_cast<const char*>(data + info.offset);
+  int length = info.length;
+  while (length > 0 && (str[length - 1] == ' ' || str[length - 1] == '\0')) {
+    --length;
+  }
+  return std::string(str, length);
+}
+
+template<typename CONVERT>
+void getThresholds(const uint8_t* page3, int offset, CONVERT convert,
+                   double* alarmHigh, double* alarmLow,
+                   double* warnHigh, double* warnLow) {
+  // The page holds offsets 128-255
+  offset -= QsfpModule::PAGE_SIZE;
+  *alarmHigh = convert(page3, offset);
+  *alarmLow = convert(page3, offset + 2);
+  *warnHigh = convert(page3, offset + 4);
+  *warnLow = convert(page3, offset + 6);
+}
+
+} // unnamed namespace
+
+QsfpModule::QsfpModule(std::unique_ptr<SfpImpl>& sfpImpl)
+  : SfpModule(sfpImpl) {
+  memset(lowerPage_, 0, sizeof(lowerPage_));
+}
+
+void QsfpModule::readUpperPage(uint8_t page, uint8_t* data) {
+  if (page != 0 && flatMem_) {
+    throw FbossError("QSFP ", getSfpImpl()->getName(), " has no page ",
+                     static_cast<int>(page));
+  }
+  if (!flatMem_) {
+    getSfpImpl()->writeSfpEeprom(kQsfpAddress, kPageSelect, 1, &page);
+  }
+  getSfpImpl()->readSfpEeprom(kQsfpAddress, PAGE_SIZE, PAGE_SIZE, data);
+}
+
+void QsfpModule::detectSfp() {
+  lock_guard<std::mutex> io(ioMutex_);
+  auto present = getSfpImpl()->detectSfp();
+  if (present == present_) {
+    return;
+  }
+  LOG(INFO) << "Port: " << getSfpImpl()->getName()
+            << " QSFP status changed to " << present;
+
+  /* Read all the pages before changing anything, so a failed read leaves
+   * the module absent and it is retried on the next detection.
+   */
+  uint8_t lowerPage[PAGE_SIZE];
+  uint8_t upperPage0[PAGE_SIZE];
+  uint8_t upperPage3[PAGE_SIZE];
+  if (present) {
+    getSfpImpl()->readSfpEeprom(kQsfpAddress, 0, PAGE_SIZE, lowerPage);
+    flatMem_ = lowerPage[kStatus] & kFlatMem;
+    readUpperPage(0, upperPage0);
+    if (!flatMem_) {
+      readUpperPage(3, upperPage3);
+    }
+    memcpy(lowerPage_, lowerPage, sizeof(lowerPage_));
+  }
+
+  present_ = present;
+  auto generation = nextGeneration();
+  if (present_) {
+    auto idprom = std::make_shared<SfpIdprom>();
+    idprom->generation = generation;
+    memcpy(idprom->data, lowerPage, PAGE_SIZE);
+    memcpy(idprom->data + PAGE_SIZE, upperPage0, PAGE_SIZE);
+    idprom->vendorName = getString(idprom->data, SfpIdpromFields::VENDOR_NAME);
+    idprom->partNumber = getString(idprom->data, SfpIdpromFields::PART_NUMBER);
+    idprom->serialNumber = getString(
+        idprom->data, SfpIdpromFields::VENDOR_SERIAL_NUMBER);
+    idprom->domSupported = !flatMem_;
+    if (idprom->domSupported) {
+      auto& thresh = idprom->threshValue;
+      getThresholds(upperPage3, kTempThresh, getTemp,
+                    &thresh.tempAlarmHigh, &thresh.tempAlarmLow,
+                    &thresh.tempWarnHigh, &thresh.tempWarnLow);
+      getThresholds(upperPage3, kVccThresh, getVcc,
+                    &thresh.vccAlarmHigh, &thresh.vccAlarmLow,
+                    &thresh.vccWarnHigh, &thresh.vccWarnLow);
+      getThresholds(upperPage3, kRxPwrThresh, getPwr,
+                    &thresh.rxPwrAlarmHigh, &thresh.rxPwrAlarmLow,
+                    &thresh.rxPwrWarnHigh, &thresh.rxPwrWarnLow);
+      getThresholds(upperPage3, kTxBiasThresh, getTxBias,
+                    &thresh.txBiasAlarmHigh, &thresh.txBiasAlarmLow,
+                    &thresh.txBiasWarnHigh, &thresh.txBiasWarnLow);
+      getThresholds(upperPage3, kTxPwrThresh, getPwr,
+                    &thresh.txPwrAlarmHigh, &thresh.txPwrAlarmLow,
+                    &thresh.txPwrWarnHigh, &thresh.txPwrWarnLow);
+    }
+    currentIdprom_ = std::move(idprom);
+  } else {
+    currentIdprom_.reset();
+  }
+  publish();
+}
+
+void QsfpModule::updateSfpDomFields() {
+  lock_guard<std::mutex> io(ioMutex_);
+  if (!present_ || flatMem_) {
+    return;
+  }
+  uint8_t monitors[kMonitorsEnd - kLos];
+  getSfpImpl()->readSfpEeprom(kQsfpAddress, kLos, sizeof(monitors),
+                              monitors);
+  memcpy(lowerPage_ + kLos, monitors, sizeof(monitors));
+  publish();
+}
+
+int QsfpModule::getSfpFieldValue(SfpIdpromFields fieldName,
+                                 uint8_t* fieldValue) {
+  auto it = qsfpFields.find(fieldName);
+  if (it == qsfpFields.end()) {
+    return -1;
+  }
+  auto idprom = getSfpIdprom();
+  if (!idprom) {
+    return -1;
+  }
+  memcpy(fieldValue, idprom->data + it->second.offset, it->second.length);
+  return 0;
+}
+
+void QsfpModule::publish() {
+  auto dom = std::make_shared<SfpDom>();
+  dom->name = folly::to<std::string>(getSfpImpl()->getName());
+  dom->sfpPresent = present_;
+  dom->domSupported = present_ && currentIdprom_->domSupported;
+  if (dom->domSupported) {
+    const uint8_t* data = lowerPage_;
+    dom->threshValue = currentIdprom_->threshValue;
+    dom->__isset.threshValue = true;
+
+    auto& flags = dom->flags;
+    flags.tempAlarmHigh = data[kTempFlags] & 0x80;
+    flags.tempAlarmLow = data[kTempFlags] & 0x40;
+    flags.tempWarnHigh = data[kTempFlags] & 0x20;
+    flags.tempWarnLow = data[kTempFlags] & 0x10;
+    flags.vccAlarmHigh = data[kVccFlags] & 0x80;
+    flags.vccAlarmLow = data[kVccFlags] & 0x40;
+    flags.vccWarnHigh = data[kVccFlags] & 0x20;
+    flags.vccWarnLow = data[kVccFlags] & 0x10;
+
+    dom->value.temp = getTemp(data, kTemp);
+    dom->value.vcc = getVcc(data, kVcc);
+    for (int lane = 0; lane < NUM_LANES; ++lane) {
+      SfpLaneDom laneDom;
+      laneDom.lane = lane;
+      laneDom.rxPwr = getPwr(data, kRxPwr + 2 * lane);
+      laneDom.txBias = getTxBias(data, kTxBias + 2 * lane);
+      laneDom.txPwr = getPwr(data, kTxPwr + 2 * lane);
+      laneDom.rxLos = data[kLos] & (1 << lane);
+      laneDom.txFault = data[kTxFault] & (1 << lane);
+      dom->lanes.push_back(laneDom);
+
+      auto rxPwr = getLaneFlags(data, kRxPwrFlags, lane);
+      flags.rxPwrAlarmHigh |= bool(rxPwr & 0x8);
+      flags.rxPwrAlarmLow |= bool(rxPwr & 0x4);
+      flags.rxPwrWarnHigh |= bool(rxPwr & 0x2);
+      flags.rxPwrWarnLow |= bool(rxPwr & 0x1);
+      auto txBias = getLaneFlags(data, kTxBiasFlags, lane);
+      flags.txBiasAlarmHigh |= bool(txBias & 0x8);
+      flags.txBiasAlarmLow |= bool(txBias & 0x4);
+      flags.txBiasWarnHigh |= bool(txBias & 0x2);
+      flags.txBiasWarnLow |= bool(txBias & 0x1);
+      auto txPwr = getLaneFlags(data, kTxPwrFlags, lane);
+      flags.txPwrAlarmHigh |= bool(txPwr & 0x8);
+      flags.txPwrAlarmLow |= bool(txPwr & 0x4);
+      flags.txPwrWarnHigh |= bool(txPwr & 0x2);
+      flags.txPwrWarnLow |= bool(txPwr & 0x1);
+    }
+    dom->value.rxPwr = dom->lanes[0].rxPwr;
+    dom->value.txBias = dom->lanes[0].txBias;
+    dom->value.txPwr = dom->lanes[0].txPwr;
+    dom->__isset.flags = true;
+    dom->__isset.value = true;
+    dom->__isset.lanes = true;
+  }
+  publishSnapshots(currentIdprom_, std::move(dom));
+}
+
+}} // facebook::fboss
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/SfpModule.h"
+
+namespace facebook { namespace fboss {
+
+/*
+ * A QSFP+ module, following the memory map of SFF-8436 and SFF-8636.
+ *
+ * Unlike an SFP, a QSFP has a single I2C address.  The lower page, bytes
+ * 0-127, holds the status, flags and monitoring values, and bytes 128-255
+ * show the upper page selected by writing byte 127: page 0 has the vendor
+ * information and page 3 the thresholds.
+ *
+ * The upper pages never change while the module is plugged in, so they
+ * are only read when it is detected.  A DOM update reads just the lower
+ * page bytes from the LOS flags to the last lane's TX power, without
+ * changing the page.
+ *
+ * SfpIdprom::data holds the lower page, then upper page 0, so its layout
+ * matches the SFF-8636 offsets of the page 0 fields.
+ */
+class QsfpModule : public SfpModule {
+ public:
+  enum : int {
+    NUM_LANES = 4,
+    PAGE_SIZE = 128,
+  };
+
+  explicit QsfpModule(std::unique_ptr<SfpImpl>& sfpImpl);
+
+  void detectSfp() override;
+  void updateSfpDomFields() override;
+  /*
+   * Only the vendor fields are supported, at their QSFP offsets.  Returns
+   * -1 for the others.
+   */
+  int getSfpFieldValue(SfpIdpromFields fieldName,
+                       uint8_t* fieldValue) override;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  QsfpModule(QsfpModule const &) = delete;
+  QsfpModule& operator=(QsfpModule const &) = delete;
+
+  // Reads bytes 128-255 of the page
+  void readUpperPage(uint8_t page, uint8_t* data);
+  // Publishes the snapshots built from the cached pages
+  void publish();
+
+  // Everything below is only accessed with ioMutex_ held
+  bool present_{false};
+  // Flat memory modules, mostly copper cables, only have upper page 0 and
+  // no monitoring
+  bool flatMem_{false};
+  // Null if the module is absent
+  std::shared_ptr<const SfpIdprom> currentIdprom_;
+  uint8_t lowerPage_[PAGE_SIZE];
+};
+
+}} // facebook::fboss
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/SpinLock.h>
+#include <folly/ThreadLocal.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+/*
+ * ReadMostlyPtr holds a shared_ptr that is read far more often than it is
+ * replaced, such as the current SwitchState.
+ *
+ * load() works like reading a shared_ptr under a lock, which it does.  But
+ * each thread also caches its own copy of the pointer, which a Reader uses
+ * until the pointer is replaced.  So in the common case a Reader only reads
+ * a version number shared by all threads, and never writes to memory that
+ * other threads use: it takes no lock, and does not touch the reference
+ * count of the object, which every thread reading it would otherwise
+ * contend on.
+ *
+ * The cost is that each thread that used a Reader keeps the object it last
+ * read alive until it uses a Reader again, or exits.
+ */
+template<typename T>
+class ReadMostlyPtr {
+ private:
+  struct Local {
+    uint64_t version{0};
+    std::shared_ptr<T> ptr;
+    // The number of Readers using ptr on this thread
+    uint32_t numReaders{0};
+  };
+
+ public:
+  /*
+   * A view of the pointer from the current thread.
+   *
+   * The pointer is refreshed when the Reader is created, unless another
+   * Reader on the same thread is still using the old one, in which case
+   * both see the same object.  A Reader must only be used, and destroyed, on
+   * the thread that created it.
+   */
+  class Reader {
+   public:
+    explicit Reader(const ReadMostlyPtr& ptr)
+      : local_(ptr.refresh()) {
+      ++local_->numReaders;
+    }
+    Reader(Reader&& other) noexcept
+      : local_(other.local_) {
+      other.local_ = nullptr;
+    }
+    ~Reader() {
+      if (local_) {
+        --local_->numReaders;
+      }
+    }
+
+    /*
+     * The pointer, which stays valid for the life of the Reader.
+     */
+    const std::shared_ptr<T>& get() const {
+      return local_->ptr;
+    }
+    T* operator->() const {
+      return local_->ptr.get();
+    }
+    T& operator*() const {
+      return *local_->ptr;
+    }
+
+   private:
+    // Forbidden copy constructor and assignment operator
+    Reader(Reader const &) = delete;
+    Reader& operator=(Reader const &) = delete;
+
+    Local* local_{nullptr};
+  };
+
+  ReadMostlyPtr() {}
+
+  /*
+   * Get a copy of the pointer.
+   */
+  std::shared_ptr<T> load() const {
+    folly::SpinLockGuard guard(lock_);
+    return ptr_;
+  }
+
+  /*
+   * Replace the pointer.  Threads see the new one the next time they create
+   * a Reader.
+   */
+  void store(std::shared_ptr<T> ptr) {
+    {
+      folly::SpinLockGuard guard(lock_);
+      ptr_.swap(ptr);
+      version_.fetch_add(1, std::memory_order_release);
+    }
+    // The old object, if this was its last reference, is destroyed here,
+    // outside of the lock.
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  ReadMostlyPtr(ReadMostlyPtr const &) = delete;
+  ReadMostlyPtr& operator=(ReadMostlyPtr const &) = delete;
+
+  Local* refresh() const {
+    auto* local = local_.get();
+    auto version = version_.load(std::memory_order_acquire);
+    if (local->version != version && local->numReaders == 0) {
+      std::shared_ptr<T> old;
+      {
+        folly::SpinLockGuard guard(lock_);
+        old.swap(local->ptr);
+        local->ptr = ptr_;
+        local->version = version_.load(std::memory_order_relaxed);
+      }
+    }
+    return local;
+  }
+
+  mutable folly::SpinLock lock_;
+  std::shared_ptr<T> ptr_;
+  // Incremented each time ptr_ is replaced.  Local caches start at version
+  // 0, so this starts at 1 to make them refresh on first use.
+  std::atomic<uint64_t> version_{1};
+  mutable folly::ThreadLocal<Local> local_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RouteStats.h"
+
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/state/DeltaFunctions.h"
+#include "fboss/agent/state/RouteDelta.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Conv.h>
+
+using std::shared_ptr;
+using std::string;
+
+namespace {
+
+const char* const kEcmpWidthNames[] = {
+  "le_1", "le_2", "le_4", "le_8", "le_16", "le_32", "le_64", "gt_64",
+};
+
+}
+
+namespace facebook { namespace fboss {
+
+static_assert(sizeof(kEcmpWidthNames) / sizeof(kEcmpWidthNames[0]) ==
+              RouteStats::NUM_ECMP_WIDTH_BUCKETS,
+              "an ECMP width bucket has no name");
+
+uint32_t RouteStats::getEcmpWidthBucket(size_t numNexthops) {
+  uint32_t bucket = 0;
+  while (bucket + 1 < NUM_ECMP_WIDTH_BUCKETS &&
+         (size_t(1) << bucket) < numNexthops) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+void RouteStats::applyDelta(const RouteTableMap* oldTables,
+                            const RouteTableMap* newTables) {
+  std::lock_guard<std::mutex> g(lock_);
+  for (const auto& tableDelta : RTMapDelta(oldTables, newTables)) {
+    auto rid = tableDelta.getOld() ? tableDelta.getOld()->getID() :
+      tableDelta.getNew()->getID();
+    auto* vrf = &vrfs_[rid];
+    applyRoutesDelta(&vrf->v4, tableDelta.getRoutesV4Delta());
+    applyRoutesDelta(&vrf->v6, tableDelta.getRoutesV6Delta());
+  }
+}
+
+template<typename DeltaT>
+void RouteStats::applyRoutesDelta(FamilyStats* stats, const DeltaT& delta) {
+  typedef typename DeltaT::Node RouteT;
+  DeltaFunctions::forEachChanged(
+      delta,
+      [&](const shared_ptr<RouteT>& oldRoute,
+          const shared_ptr<RouteT>& newRoute) {
+        count(stats, *oldRoute, -1);
+        count(stats, *newRoute, 1);
+      },
+      [&](const shared_ptr<RouteT>& newRoute) {
+        count(stats, *newRoute, 1);
+      },
+      [&](const shared_ptr<RouteT>& oldRoute) {
+        count(stats, *oldRoute, -1);
+      });
+}
+
+template<typename RouteT>
+void RouteStats::count(FamilyStats* stats, const RouteT& route,
+                       int64_t delta) {
+  auto* counts = &stats->counts;
+  counts->routes += delta;
+  counts->prefixLengths[route.prefix().mask] += delta;
+  if (!route.isResolved()) {
+    return;
+  }
+  counts->resolved += delta;
+  const auto& nexthops = route.getForwardInfo().getNexthops();
+  if (!nexthops.empty()) {
+    counts->ecmpWidths[getEcmpWidthBucket(nexthops.size())] += delta;
+  }
+}
+
+RouteStats::Counts RouteStats::getCounts(RouterID rid, bool v6) const {
+  std::lock_guard<std::mutex> g(lock_);
+  auto iter = vrfs_.find(rid);
+  if (iter == vrfs_.end()) {
+    return v6 ? FamilyStats(128).counts : FamilyStats(32).counts;
+  }
+  return v6 ? iter->second.v6.counts : iter->second.v4.counts;
+}
+
+void RouteStats::publish() {
+  const auto prefix = SwitchStats::kCounterPrefix + "routes.";
+  std::lock_guard<std::mutex> g(lock_);
+  uint64_t v4Routes = 0;
+  uint64_t v6Routes = 0;
+  for (auto& entry : vrfs_) {
+    auto vrfPrefix = folly::to<string>(prefix, "vrf", entry.first, ".");
+    publish(vrfPrefix + "v4.", &entry.second.v4);
+    publish(vrfPrefix + "v6.", &entry.second.v6);
+    v4Routes += entry.second.v4.counts.routes;
+    v6Routes += entry.second.v6.counts.routes;
+  }
+  fbData->setCounter(prefix + "v4.count", v4Routes);
+  fbData->setCounter(prefix + "v6.count", v6Routes);
+}
+
+void RouteStats::publish(const string& prefix, FamilyStats* stats) {
+  const auto& counts = stats->counts;
+  fbData->setCounter(prefix + "count", counts.routes);
+  fbData->setCounter(prefix + "resolved", counts.resolved);
+  fbData->setCounter(prefix + "unresolved", counts.routes - counts.resolved);
+  // Only the prefix lengths in use are published, as most of them never
+  // are
+  for (size_t len = 0; len < counts.prefixLengths.size(); ++len) {
+    auto num = counts.prefixLengths[len];
+    if (num == 0 && !stats->publishedLengths[len]) {
+      continue;
+    }
+    fbData->setCounter(folly::to<string>(prefix, "prefix_len.", len), num);
+    stats->publishedLengths[len] = num != 0;
+  }
+  for (uint32_t bucket = 0; bucket < NUM_ECMP_WIDTH_BUCKETS; ++bucket) {
+    fbData->setCounter(prefix + "ecmp_width." + kEcmpWidthNames[bucket],
+                       counts.ecmpWidths[bucket]);
+  }
+}
+
+}} // facebook::fboss
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class RouteTableMap;
+
+/*
+ * RouteStats counts the routes of each VRF and address family: in all, by
+ * prefix length, resolved or not, and by the number of nexthops of the
+ * resolved ones.
+ *
+ * The counts are kept up to date from the route table deltas of the state
+ * updates, so publishing them takes the same time however many routes
+ * there are.
+ */
+class RouteStats {
+ public:
+  /*
+   * The ECMP width buckets hold the resolved routes with 1, 2, 3-4, 5-8,
+   * ..., 33-64, and more than 64 nexthops.
+   */
+  enum : uint32_t { NUM_ECMP_WIDTH_BUCKETS = 8 };
+
+  struct Counts {
+    uint64_t routes{0};
+    uint64_t resolved{0};
+    // The number of routes with each prefix length
+    std::vector<uint64_t> prefixLengths;
+    std::array<uint64_t, NUM_ECMP_WIDTH_BUCKETS> ecmpWidths{{}};
+  };
+
+  RouteStats() {}
+
+  /*
+   * Count the route changes from oldTables to newTables.  oldTables is null
+   * for the initial routes.
+   */
+  void applyDelta(const RouteTableMap* oldTables,
+                  const RouteTableMap* newTables);
+
+  /*
+   * The counts of one VRF and address family.
+   */
+  Counts getCounts(RouterID rid, bool v6) const;
+
+  /*
+   * Publish the counts as counters.  This can be called from any thread.
+   */
+  void publish();
+
+  // The bucket of a route with the given number of nexthops
+  static uint32_t getEcmpWidthBucket(size_t numNexthops);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  RouteStats(RouteStats const &) = delete;
+  RouteStats& operator=(RouteStats const &) = delete;
+
+  struct FamilyStats {
+    explicit FamilyStats(uint32_t maxPrefixLength)
+      : publishedLengths(maxPrefixLength + 1) {
+      counts.prefixLengths.resize(maxPrefixLength + 1);
+    }
+    Counts counts;
+    // The prefix lengths that had routes when last published, so that
+    // their counters are set to 0 once they have none
+    std::vector<bool> publishedLengths;
+  };
+  struct VrfStats {
+    FamilyStats v4{32};
+    FamilyStats v6{128};
+  };
+
+  template<typename RouteT>
+  static void count(FamilyStats* stats, const RouteT& route, int64_t delta);
+  template<typename DeltaT>
+  static void applyRoutesDelta(FamilyStats* stats, const DeltaT& delta);
+  static void publish(const std::string& prefix, FamilyStats* stats);
+
+  mutable std::mutex lock_;
+  std::map<RouterID, VrfStats> vrfs_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RxBufferTracker.h"
+
+#include "fboss/agent/SwitchStats.h"
+#include "common/stats/ServiceData.h"
+
+#include <array>
+#include <atomic>
+#include <string>
+
+#include <gflags/gflags.h>
+
+DEFINE_int32(rx_buffer_copy_threshold, 256,
+             "Once more than this many RX pool buffers are held by the "
+             "agent, copy queued packets out of them so the buffers go back "
+             "to the pool.  A negative value never copies");
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+struct Counts {
+  Counts() {
+    for (size_t i = 0; i < RxBufferTracker::kNumHolders; ++i) {
+      held[i].store(0, std::memory_order_relaxed);
+      copiedOut[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint64_t> outstanding{0};
+  std::atomic<uint64_t> maxOutstanding{0};
+  std::array<std::atomic<uint64_t>, RxBufferTracker::kNumHolders> held;
+  std::array<std::atomic<uint64_t>, RxBufferTracker::kNumHolders> copiedOut;
+};
+
+// Never destroyed, as packets may be released during static destruction
+Counts& counts() {
+  static Counts* counts = new Counts();
+  return *counts;
+}
+
+size_t index(RxBufferHolder holder) {
+  return static_cast<size_t>(holder);
+}
+
+} // unnamed namespace
+
+constexpr size_t RxBufferTracker::kNumHolders;
+
+void RxBufferTracker::acquired(RxBufferHolder holder) {
+  auto& c = counts();
+  c.held[index(holder)].fetch_add(1, std::memory_order_relaxed);
+  auto outstanding = c.outstanding.fetch_add(1, std::memory_order_relaxed) + 1;
+  auto max = c.maxOutstanding.load(std::memory_order_relaxed);
+  while (outstanding > max &&
+         !c.maxOutstanding.compare_exchange_weak(
+             max, outstanding, std::memory_order_relaxed)) {
+  }
+}
+
+void RxBufferTracker::moved(RxBufferHolder from, RxBufferHolder to) {
+  if (from == to) {
+    return;
+  }
+  auto& c = counts();
+  c.held[index(to)].fetch_add(1, std::memory_order_relaxed);
+  c.held[index(from)].fetch_sub(1, std::memory_order_relaxed);
+}
+
+void RxBufferTracker::released(RxBufferHolder holder) {
+  auto& c = counts();
+  c.held[index(holder)].fetch_sub(1, std::memory_order_relaxed);
+  c.outstanding.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void RxBufferTracker::copiedOut(RxBufferHolder holder) {
+  released(holder);
+  counts().copiedOut[index(holder)].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t RxBufferTracker::getOutstanding() {
+  return counts().outstanding.load(std::memory_order_relaxed);
+}
+
+uint64_t RxBufferTracker::getHeld(RxBufferHolder holder) {
+  return counts().held[index(holder)].load(std::memory_order_relaxed);
+}
+
+uint64_t RxBufferTracker::getMaxOutstanding() {
+  return counts().maxOutstanding.load(std::memory_order_relaxed);
+}
+
+uint64_t RxBufferTracker::getCopiedOut(RxBufferHolder holder) {
+  return counts().copiedOut[index(holder)].load(std::memory_order_relaxed);
+}
+
+bool RxBufferTracker::underPressure() {
+  return FLAGS_rx_buffer_copy_threshold >= 0 &&
+    getOutstanding() > static_cast<uint64_t>(FLAGS_rx_buffer_copy_threshold);
+}
+
+const char* RxBufferTracker::getHolderName(RxBufferHolder holder) {
+  switch (holder) {
+    case RxBufferHolder::HANDLER:
+      return "handler";
+    case RxBufferHolder::DISPATCH_QUEUE:
+      return "dispatch_queue";
+    case RxBufferHolder::TUN_QUEUE:
+      return "tun_queue";
+    case RxBufferHolder::NUM_HOLDERS:
+      break;
+  }
+  return "unknown";
+}
+
+void RxBufferTracker::publish() {
+  auto prefix = SwitchStats::kCounterPrefix + "rx_buffers.";
+  auto outstanding = getOutstanding();
+  fbData->setCounter(prefix + "outstanding", outstanding);
+  fbData->setCounter(prefix + "pressure", underPressure() ? 1 : 0);
+  // Start the next interval's high water mark from what is held now
+  auto max = counts().maxOutstanding.exchange(outstanding,
+                                              std::memory_order_relaxed);
+  fbData->setCounter(prefix + "max_outstanding", max);
+  for (size_t i = 0; i < kNumHolders; ++i) {
+    auto holder = static_cast<RxBufferHolder>(i);
+    std::string name = getHolderName(holder);
+    fbData->setCounter(prefix + "held." + name, getHeld(holder));
+    fbData->setCounter(prefix + "copied_out." + name, getCopiedOut(holder));
+  }
+}
+
+}} // facebook::fboss
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook { namespace fboss {
+
+/*
+ * Where an RxPacket whose data still lives in the hardware's RX pool is
+ * waiting.
+ */
+enum class RxBufferHolder : uint8_t {
+  // Being processed by a packet handler
+  HANDLER,
+  // Waiting in an RxPacketDispatcher queue
+  DISPATCH_QUEUE,
+  // Waiting to be written to a TUN interface
+  TUN_QUEUE,
+  NUM_HOLDERS,
+};
+
+/*
+ * RxBufferTracker counts the RX pool buffers the agent holds on to.
+ *
+ * An RxPacket from the hardware points straight into the SDK's RX buffer,
+ * which goes back to the pool only when the packet is destroyed.  The pool
+ * is small, so packets sitting in queues can starve the RX path of
+ * buffers, and the hardware then drops whatever it traps next.
+ *
+ * RxPackets report the buffers they hold, and which queue holds them, here.
+ * Once more than --rx_buffer_copy_threshold buffers are outstanding, the
+ * queues copy the packets they take into regular memory and free the RX
+ * buffer right away (see RxPacket::copyOutIfPressured()).
+ *
+ * The counts are exported as rx_buffers.* counters.  All methods are safe
+ * to call from any thread.
+ */
+class RxBufferTracker {
+ public:
+  static constexpr size_t kNumHolders =
+    static_cast<size_t>(RxBufferHolder::NUM_HOLDERS);
+
+  static void acquired(RxBufferHolder holder);
+  static void moved(RxBufferHolder from, RxBufferHolder to);
+  static void released(RxBufferHolder holder);
+  // An RX buffer was released by copying its packet out of it
+  static void copiedOut(RxBufferHolder holder);
+
+  /*
+   * The number of RX buffers currently held, in total and by each holder.
+   */
+  static uint64_t getOutstanding();
+  static uint64_t getHeld(RxBufferHolder holder);
+  /*
+   * The most RX buffers held at once since the last publish().
+   */
+  static uint64_t getMaxOutstanding();
+  static uint64_t getCopiedOut(RxBufferHolder holder);
+
+  /*
+   * Whether enough RX buffers are held that packets being queued should be
+   * copied out of them.
+   */
+  static bool underPressure();
+
+  static const char* getHolderName(RxBufferHolder holder);
+
+  /*
+   * Export the counts, and restart the high water mark.
+   */
+  static void publish();
+
+ private:
+  // Not constructible
+  RxBufferTracker() = delete;
+};
+
+}} // facebook::fboss
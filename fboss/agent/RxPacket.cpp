@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RxPacket.h"
+
+#include <folly/io/Cursor.h>
+
+using folly::IOBuf;
+using folly::io::Cursor;
+
+namespace facebook { namespace fboss {
+
+RxPacket::~RxPacket() {
+  // buf_ itself is freed by ~Packet(), just after this
+  if (rxBuffer_) {
+    RxBufferTracker::released(holder_);
+  }
+}
+
+void RxPacket::setRxBuffer() {
+  if (!rxBuffer_) {
+    rxBuffer_ = true;
+    RxBufferTracker::acquired(holder_);
+  }
+}
+
+void RxPacket::setRxBufferHolder(RxBufferHolder holder) {
+  if (rxBuffer_) {
+    RxBufferTracker::moved(holder_, holder);
+  }
+  holder_ = holder;
+}
+
+bool RxPacket::copyOutIfPressured() {
+  if (!rxBuffer_ || !RxBufferTracker::underPressure()) {
+    return false;
+  }
+  // Keep the headroom, in case a handler prepends to the packet
+  auto headroom = buf_->headroom();
+  auto length = buf_->computeChainDataLength();
+  auto copy = IOBuf::create(headroom + length);
+  copy->advance(headroom);
+  Cursor(buf_.get()).pull(copy->writableData(), length);
+  copy->append(length);
+  buf_ = std::move(copy);
+  rxBuffer_ = false;
+  RxBufferTracker::copiedOut(holder_);
+  return true;
+}
+
+}} // facebook::fboss
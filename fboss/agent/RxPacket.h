@@ -10,6 +10,7 @@
 #pragma once
 
 #include "fboss/agent/Packet.h"
+#include "fboss/agent/RxBufferTracker.h"
 #include "fboss/agent/types.h"
 
 namespace facebook { namespace fboss {
@@ -19,6 +20,8 @@ namespace facebook { namespace fboss {
  */
 class RxPacket : public Packet {
  public:
+  virtual ~RxPacket();
+
   /*
    * Get the port on which this packet was received.
    */
@@ -44,10 +47,49 @@ class RxPacket : public Packet {
     // TODO: only vrf 0 now
     return RouterID(0);
   }
+  /**
+   * Whether the packet was only sent to the CPU because it was sampled for
+   * sFlow, rather than trapped for processing.
+   */
+  bool isSampled() const {
+    return sampled_;
+  }
+
+  /*
+   * Whether the packet data still lives in a buffer from the hardware's RX
+   * pool.  See RxBufferTracker.
+   */
+  bool holdsRxBuffer() const {
+    return rxBuffer_;
+  }
+  /*
+   * Record where the packet is waiting, for the RX buffer accounting.
+   */
+  void setRxBufferHolder(RxBufferHolder holder);
+  /*
+   * If the RX pool is under pressure, copy the packet data into regular
+   * memory and free its RX buffer.  Code that holds on to packets for a
+   * while should call this when it takes them.
+   *
+   * Returns true if the data was copied.
+   */
+  bool copyOutIfPressured();
+
  protected:
+  /*
+   * Subclasses call this once buf_ points into an RX pool buffer, which is
+   * freed when buf_ is.
+   */
+  void setRxBuffer();
+
   PortID srcPort_{0};
   VlanID srcVlan_{0};
   uint32_t len_{0};
+  bool sampled_{false};
+
+ private:
+  bool rxBuffer_{false};
+  RxBufferHolder holder_{RxBufferHolder::HANDLER};
 };
 
 }} // facebook::fboss
@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RxPacketDispatcher.h"
+
+#include <folly/Conv.h>
+#include <folly/io/Cursor.h>
+#include <glog/logging.h>
+#include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/IPv4Handler.h"
+#include "fboss/agent/LacpManager.h"
+#include "fboss/agent/LldpManager.h"
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/ThreadSampler.h"
+#include "fboss/agent/packet/ICMPHdr.h"
+#include "fboss/agent/packet/IPProto.h"
+
+using folly::io::Cursor;
+using std::unique_lock;
+using std::unique_ptr;
+
+namespace {
+
+// CDP frames are identified by their length field rather than an ethertype,
+// but SwSwitch::handlePacket() treats this value like one.
+const uint16_t kCdpType = 0x27;
+
+bool isNdpType(uint8_t type) {
+  return type >= facebook::fboss::ICMPV6_TYPE_NDP_ROUTER_SOLICITATION &&
+    type <= facebook::fboss::ICMPV6_TYPE_NDP_REDIRECT_MESSAGE;
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+RxPacketDispatcher::RxPacketDispatcher(Handler handler, uint32_t queueSize,
+                                       const std::vector<uint32_t>& numThreads)
+  : handler_(std::move(handler)),
+    queueSize_(queueSize) {
+  if (numThreads.size() != NUM_CLASSES) {
+    throw FbossError("expected thread counts for ", NUM_CLASSES,
+                     " RX packet classes, got ", numThreads.size());
+  }
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    if (numThreads[i] == 0) {
+      throw FbossError("RX packet class ",
+                       getClassName(RxPacketClass(i)),
+                       " needs at least one worker thread");
+    }
+    queues_[i].numThreads = numThreads[i];
+  }
+}
+
+RxPacketDispatcher::~RxPacketDispatcher() {
+  stop();
+}
+
+void RxPacketDispatcher::start() {
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    auto& queue = queues_[i];
+    CHECK(queue.threads.empty());
+    for (uint32_t n = 0; n < queue.numThreads; ++n) {
+      auto cls = RxPacketClass(i);
+      queue.threads.emplace_back([=] { this->workerLoop(cls); });
+    }
+  }
+}
+
+void RxPacketDispatcher::stop() {
+  stopping_.store(true, std::memory_order_release);
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    auto& queue = queues_[i];
+    {
+      // Hold the lock so a worker cannot miss the wakeup between checking
+      // stopping_ and waiting on the condition variable.
+      std::lock_guard<std::mutex> g(queue.mutex);
+      queue.cv.notify_all();
+    }
+    for (auto& thread : queue.threads) {
+      thread.join();
+    }
+    queue.threads.clear();
+    std::lock_guard<std::mutex> g(queue.mutex);
+    queue.pkts.clear();
+  }
+}
+
+bool RxPacketDispatcher::dispatch(RxPacketClass cls,
+                                  unique_ptr<RxPacket> pkt) noexcept {
+  auto& queue = queues_[static_cast<int>(cls)];
+  pkt->setRxBufferHolder(RxBufferHolder::DISPATCH_QUEUE);
+  pkt->copyOutIfPressured();
+  {
+    std::lock_guard<std::mutex> g(queue.mutex);
+    if (queue.pkts.size() >= queueSize_ ||
+        stopping_.load(std::memory_order_acquire)) {
+      queue.dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    queue.pkts.push_back(std::move(pkt));
+  }
+  queue.dispatched.fetch_add(1, std::memory_order_relaxed);
+  queue.cv.notify_one();
+  return true;
+}
+
+void RxPacketDispatcher::workerLoop(RxPacketClass cls) {
+  // The pthread name can be at most 15 bytes long
+  auto name = folly::to<std::string>("fbossRx", getClassName(cls));
+  pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+  ThreadSampler::registerThread(name);
+
+  auto& queue = queues_[static_cast<int>(cls)];
+  while (true) {
+    unique_ptr<RxPacket> pkt;
+    {
+      unique_lock<std::mutex> lock(queue.mutex);
+      queue.cv.wait(lock, [&] {
+        return !queue.pkts.empty() ||
+          stopping_.load(std::memory_order_acquire);
+      });
+      if (stopping_.load(std::memory_order_acquire)) {
+        return;
+      }
+      pkt = std::move(queue.pkts.front());
+      queue.pkts.pop_front();
+    }
+    pkt->setRxBufferHolder(RxBufferHolder::HANDLER);
+    handler_(std::move(pkt));
+  }
+}
+
+RxPacketClass RxPacketDispatcher::classify(const RxPacket* pkt) {
+  return classify(pkt->buf());
+}
+
+RxPacketClass RxPacketDispatcher::classify(const folly::IOBuf* buf) {
+  try {
+    Cursor c(buf);
+    // Skip over the destination and source MACs
+    c += 12;
+    auto ethertype = c.readBE<uint16_t>();
+    if (ethertype == 0x8100) {
+      // 802.1Q
+      c += 2;
+      ethertype = c.readBE<uint16_t>();
+    }
+
+    switch (ethertype) {
+    case ArpHandler::ETHERTYPE_ARP:
+    case LldpManager::ETHERTYPE_LLDP:
+    case LacpManager::ETHERTYPE_SLOW_PROTOCOLS:
+    case kCdpType:
+      return RxPacketClass::CONTROL;
+    case IPv4Handler::ETHERTYPE_IPV4:
+      return RxPacketClass::HOST;
+    case IPv6Handler::ETHERTYPE_IPV6: {
+      // Version, traffic class and flow label, then the payload length
+      c += 6;
+      auto nextHeader = c.read<uint8_t>();
+      // Hop limit, then the source and destination addresses
+      c += 33;
+      if (nextHeader == IP_PROTO_IPV6_ICMP && isNdpType(c.read<uint8_t>())) {
+        return RxPacketClass::CONTROL;
+      }
+      return RxPacketClass::HOST;
+    }
+    default:
+      return RxPacketClass::OTHER;
+    }
+  } catch (const std::out_of_range& ex) {
+    // Truncated packets are rejected by SwSwitch::handlePacket()
+    return RxPacketClass::OTHER;
+  }
+}
+
+const char* RxPacketDispatcher::getClassName(RxPacketClass cls) {
+  switch (cls) {
+  case RxPacketClass::CONTROL:
+    return "control";
+  case RxPacketClass::HOST:
+    return "host";
+  case RxPacketClass::OTHER:
+    return "other";
+  }
+  return "unknown";
+}
+
+uint64_t RxPacketDispatcher::getNumDispatched(RxPacketClass cls) const {
+  return queues_[static_cast<int>(cls)].dispatched.load(
+      std::memory_order_relaxed);
+}
+
+uint64_t RxPacketDispatcher::getNumDropped(RxPacketClass cls) const {
+  return queues_[static_cast<int>(cls)].dropped.load(
+      std::memory_order_relaxed);
+}
+
+}} // facebook::fboss
@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook { namespace fboss {
+
+class RxPacket;
+
+/*
+ * The classes that trapped packets are sorted into before processing.
+ *
+ * CONTROL holds the link-local control protocols (ARP, NDP, LLDP) that must
+ * keep working even when the switch is flooded with other traffic.  HOST
+ * holds the remaining IPv4 and IPv6 traffic, most of which is forwarded to
+ * the host or relayed (e.g. DHCP).  Everything else is OTHER.
+ */
+enum class RxPacketClass : uint8_t {
+  CONTROL,
+  HOST,
+  OTHER,
+};
+
+/*
+ * RxPacketDispatcher moves trapped packet processing off of the HwSwitch RX
+ * thread.
+ *
+ * Each RxPacketClass has its own bounded queue and its own pool of worker
+ * threads.  A slow handler, or a flood of packets of one class, can only
+ * fill up that class's queue.  Once a queue is full, new packets of that
+ * class are dropped rather than delaying packets of the other classes.
+ *
+ * dispatch() never blocks, and may be called from any thread.
+ */
+class RxPacketDispatcher {
+ public:
+  typedef std::function<void(std::unique_ptr<RxPacket>)> Handler;
+
+  enum : uint8_t { NUM_CLASSES = 3 };
+
+  /*
+   * Create a dispatcher that invokes the handler on its worker threads.
+   *
+   * queueSize is the maximum number of packets waiting in each class queue.
+   * numThreads gives the number of worker threads for each class.
+   */
+  RxPacketDispatcher(Handler handler, uint32_t queueSize,
+                     const std::vector<uint32_t>& numThreads);
+  ~RxPacketDispatcher();
+
+  void start();
+
+  /*
+   * Stop the worker threads, and wait for them to exit.
+   *
+   * Packets still waiting in the queues are freed without being handled.
+   */
+  void stop();
+
+  /*
+   * Queue a packet for processing by the workers for the given class.
+   *
+   * Returns false if the class queue is full, in which case the packet is
+   * dropped.
+   */
+  bool dispatch(RxPacketClass cls, std::unique_ptr<RxPacket> pkt) noexcept;
+
+  /*
+   * Return the class a packet should be processed in, based on its
+   * ethertype (and ICMPv6 type, for NDP).
+   */
+  static RxPacketClass classify(const RxPacket* pkt);
+  static RxPacketClass classify(const folly::IOBuf* buf);
+
+  static const char* getClassName(RxPacketClass cls);
+
+  uint64_t getNumDispatched(RxPacketClass cls) const;
+  uint64_t getNumDropped(RxPacketClass cls) const;
+
+ private:
+  struct ClassQueue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::unique_ptr<RxPacket>> pkts;
+    std::vector<std::thread> threads;
+    uint32_t numThreads{0};
+    std::atomic<uint64_t> dispatched{0};
+    std::atomic<uint64_t> dropped{0};
+  };
+
+  // Forbidden copy constructor and assignment operator
+  RxPacketDispatcher(RxPacketDispatcher const &) = delete;
+  RxPacketDispatcher& operator=(RxPacketDispatcher const &) = delete;
+
+  void workerLoop(RxPacketClass cls);
+
+  const Handler handler_;
+  const uint32_t queueSize_{0};
+  ClassQueue queues_[NUM_CLASSES];
+  std::atomic<bool> stopping_{false};
+};
+
+}} // facebook::fboss
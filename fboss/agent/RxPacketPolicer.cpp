@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RxPacketPolicer.h"
+
+#include <folly/io/Cursor.h>
+#include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/IPv4Handler.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/LldpManager.h"
+#include "fboss/agent/packet/ICMPHdr.h"
+#include "fboss/agent/packet/IPProto.h"
+
+using folly::io::Cursor;
+
+namespace {
+
+// The ARP opcode for replies, see RFC 826
+const uint16_t kArpOpReply = 2;
+
+}
+
+namespace facebook { namespace fboss {
+
+RxPacketPolicer::RxPacketPolicer(const Config& config)
+  : config_(config) {
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    if (config_[i].rate > 0 && config_[i].burst == 0) {
+      throw FbossError("RX policer class ", getClassName(RxPolicerClass(i)),
+                       " has a rate limit but no burst size");
+    }
+  }
+}
+
+RxPolicerClass RxPacketPolicer::classify(uint16_t ethertype, Cursor cursor) {
+  try {
+    switch (ethertype) {
+    case ArpHandler::ETHERTYPE_ARP:
+      // Hardware and protocol types and lengths, then the opcode
+      cursor += 6;
+      if (cursor.readBE<uint16_t>() == kArpOpReply) {
+        return RxPolicerClass::ARP_REPLY;
+      }
+      return RxPolicerClass::ARP_OTHER;
+    case LldpManager::ETHERTYPE_LLDP:
+      return RxPolicerClass::LLDP;
+    case IPv4Handler::ETHERTYPE_IPV4:
+      return RxPolicerClass::IP;
+    case IPv6Handler::ETHERTYPE_IPV6: {
+      // Version, traffic class and flow label, then the payload length
+      cursor += 6;
+      auto nextHeader = cursor.read<uint8_t>();
+      if (nextHeader != IP_PROTO_IPV6_ICMP) {
+        return RxPolicerClass::IP;
+      }
+      // Hop limit, then the source and destination addresses
+      cursor += 33;
+      auto type = cursor.read<uint8_t>();
+      if (type == ICMPV6_TYPE_NDP_NEIGHBOR_ADVERTISEMENT) {
+        return RxPolicerClass::NDP_ADVERTISEMENT;
+      }
+      if (type >= ICMPV6_TYPE_NDP_ROUTER_SOLICITATION &&
+          type <= ICMPV6_TYPE_NDP_REDIRECT_MESSAGE) {
+        return RxPolicerClass::NDP_OTHER;
+      }
+      return RxPolicerClass::IP;
+    }
+    default:
+      return RxPolicerClass::OTHER;
+    }
+  } catch (const std::out_of_range& ex) {
+    // Truncated packets are handled, and counted, by the protocol handlers
+    return RxPolicerClass::OTHER;
+  }
+}
+
+const char* RxPacketPolicer::getClassName(RxPolicerClass cls) {
+  switch (cls) {
+  case RxPolicerClass::ARP_REPLY:
+    return "arp_reply";
+  case RxPolicerClass::ARP_OTHER:
+    return "arp_other";
+  case RxPolicerClass::NDP_ADVERTISEMENT:
+    return "ndp_advertisement";
+  case RxPolicerClass::NDP_OTHER:
+    return "ndp_other";
+  case RxPolicerClass::LLDP:
+    return "lldp";
+  case RxPolicerClass::IP:
+    return "ip";
+  case RxPolicerClass::OTHER:
+    return "other";
+  }
+  return "unknown";
+}
+
+RxPacketPolicer::PortBuckets* RxPacketPolicer::getPortBuckets(
+    PortID port, TimePoint now) {
+  auto it = buckets_.find(port);
+  if (it != buckets_.end()) {
+    return &it->second;
+  }
+  // New buckets start out full
+  PortBuckets buckets;
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    buckets[i].tokens = config_[i].burst;
+    buckets[i].lastUpdate = now;
+  }
+  return &buckets_.emplace(port, buckets).first->second;
+}
+
+bool RxPacketPolicer::admit(PortID port, RxPolicerClass cls, TimePoint now) {
+  auto index = static_cast<int>(cls);
+  const auto& config = config_[index];
+  if (config.rate == 0) {
+    return true;
+  }
+
+  std::lock_guard<folly::SpinLock> g(lock_);
+  auto& bucket = (*getPortBuckets(port, now))[index];
+  if (now > bucket.lastUpdate) {
+    std::chrono::duration<double> elapsed = now - bucket.lastUpdate;
+    bucket.tokens = std::min<double>(
+        bucket.tokens + elapsed.count() * config.rate, config.burst);
+    bucket.lastUpdate = now;
+  }
+  if (bucket.tokens < 1) {
+    return false;
+  }
+  bucket.tokens -= 1;
+  return true;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <array>
+#include <chrono>
+#include <boost/container/flat_map.hpp>
+#include <folly/SpinLock.h>
+
+namespace folly { namespace io {
+class Cursor;
+}}
+
+namespace facebook { namespace fboss {
+
+/*
+ * The classes that RxPacketPolicer rate limits separately.
+ *
+ * ARP_REPLY, NDP_ADVERTISEMENT and LLDP are the priority classes: they are
+ * the packets we need in order to keep our own neighbor and link state
+ * correct, and they are cheap to process.  Requests and solicitations are
+ * what an address scan generates, so they are policed much more tightly.
+ */
+enum class RxPolicerClass : uint8_t {
+  ARP_REPLY,
+  ARP_OTHER,
+  NDP_ADVERTISEMENT,
+  NDP_OTHER,
+  LLDP,
+  IP,
+  OTHER,
+};
+
+/*
+ * RxPacketPolicer is a token bucket policer for trapped packets.
+ *
+ * Every (port, RxPolicerClass) pair has its own token bucket, so a scan on
+ * one port cannot starve trapped packets arriving on other ports, and a flood
+ * of one class cannot starve the others.  Packets that exceed their bucket
+ * are dropped before any protocol processing is done on them.
+ *
+ * admit() may be called concurrently from several threads.
+ */
+class RxPacketPolicer {
+ public:
+  enum : uint8_t { NUM_CLASSES = 7 };
+
+  struct ClassConfig {
+    ClassConfig() {}
+    ClassConfig(uint32_t rate, uint32_t burst) : rate(rate), burst(burst) {}
+
+    // Packets per second allowed on each port.  0 means unlimited.
+    uint32_t rate{0};
+    // Maximum number of packets accepted in a single burst
+    uint32_t burst{0};
+  };
+  typedef std::array<ClassConfig, NUM_CLASSES> Config;
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  explicit RxPacketPolicer(const Config& config);
+
+  /*
+   * Classify a packet.  The cursor should point just past the ethertype.
+   */
+  static RxPolicerClass classify(uint16_t ethertype, folly::io::Cursor cursor);
+
+  static const char* getClassName(RxPolicerClass cls);
+
+  /*
+   * Returns true if the packet should be processed, or false if it should
+   * be dropped.
+   */
+  bool admit(PortID port, RxPolicerClass cls) {
+    return admit(port, cls, std::chrono::steady_clock::now());
+  }
+  bool admit(PortID port, RxPolicerClass cls, TimePoint now);
+
+ private:
+  struct TokenBucket {
+    double tokens{0};
+    TimePoint lastUpdate;
+  };
+  typedef std::array<TokenBucket, NUM_CLASSES> PortBuckets;
+
+  // Forbidden copy constructor and assignment operator
+  RxPacketPolicer(RxPacketPolicer const &) = delete;
+  RxPacketPolicer& operator=(RxPacketPolicer const &) = delete;
+
+  PortBuckets* getPortBuckets(PortID port, TimePoint now);
+
+  const Config config_;
+  folly::SpinLock lock_;
+  boost::container::flat_map<PortID, PortBuckets> buckets_;
+};
+
+}} // facebook::fboss
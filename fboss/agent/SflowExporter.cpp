@@ -0,0 +1,321 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/SflowExporter.h"
+
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/ThreadSampler.h"
+#include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/SocketAddress.h>
+#include <folly/String.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using folly::IOBuf;
+using folly::IPAddress;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+using std::unique_ptr;
+using std::vector;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+// Values from the sFlow v5 specification
+constexpr uint32_t kSflowVersion = 5;
+constexpr uint32_t kAddressIPv4 = 1;
+constexpr uint32_t kAddressIPv6 = 2;
+constexpr uint32_t kFlowSample = 1;
+constexpr uint32_t kRawPacketHeader = 1;
+constexpr uint32_t kHeaderProtocolEthernet = 1;
+
+// The fixed fields of a flow sample holding one raw packet header record
+constexpr size_t kFlowSampleFields = 8 * 4;
+constexpr size_t kRawHeaderFields = 4 * 4;
+
+size_t padded(size_t len) {
+  return (len + 3) & ~size_t(3);
+}
+
+size_t recordSize(const SflowExporter::Sample& sample) {
+  return kRawHeaderFields + padded(sample.header.size());
+}
+
+size_t sampleBodySize(const SflowExporter::Sample& sample) {
+  return kFlowSampleFields + 8 + recordSize(sample);
+}
+
+void incrementCounter(const char* name, uint64_t value) {
+  if (value != 0) {
+    fbData->incrementCounter(SwitchStats::kCounterPrefix + name, value);
+  }
+}
+
+} // unnamed namespace
+
+SflowExporter::SflowExporter(uint32_t queueSize, milliseconds flushInterval)
+  : queueSize_(queueSize),
+    flushInterval_(flushInterval),
+    startTime_(steady_clock::now()) {
+}
+
+SflowExporter::~SflowExporter() {
+  stop();
+}
+
+void SflowExporter::start() {
+  CHECK(!thread_.joinable());
+  thread_ = std::thread([this] { this->exportLoop(); });
+}
+
+void SflowExporter::stop() {
+  {
+    lock_guard<mutex> g(mutex_);
+    stopping_ = true;
+    samples_.clear();
+    queuedBytes_ = 0;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  for (auto* sock : {&sock4_, &sock6_}) {
+    if (*sock >= 0) {
+      ::close(*sock);
+      *sock = -1;
+    }
+  }
+}
+
+void SflowExporter::stateChanged(const StateDelta& delta) {
+  const auto& oldState = delta.oldState();
+  const auto& newState = delta.newState();
+  if (oldState->getPorts() == newState->getPorts() &&
+      oldState->getSflowConfig() == newState->getSflowConfig()) {
+    return;
+  }
+
+  lock_guard<mutex> g(mutex_);
+  config_ = newState->getSflowConfig();
+  for (const auto& port : *newState->getPorts()) {
+    // Keep the sequence numbers and sample pools of existing ports, which
+    // the collectors use to detect lost samples
+    auto& sampling = ports_[port->getID()];
+    sampling.ingressRate = port->getSflowIngressRate();
+    sampling.egressRate = port->getSflowEgressRate();
+  }
+}
+
+void SflowExporter::packetSampled(const RxPacket* pkt) noexcept {
+  lock_guard<mutex> g(mutex_);
+  auto iter = ports_.find(pkt->getSrcPort());
+  if (iter == ports_.end() || config_.collectors.empty() || stopping_) {
+    return;
+  }
+  auto& sampling = iter->second;
+  // The packet does not say which direction it was sampled in.  Ingress
+  // sampling is by far the most common, so report the ingress rate unless
+  // the port only samples egress.
+  auto rate = sampling.ingressRate ? sampling.ingressRate :
+    sampling.egressRate;
+  sampling.samplePool += rate;
+  ++sampling.sequence;
+  if (samples_.size() >= queueSize_) {
+    ++drops_;
+    ++newDrops_;
+    return;
+  }
+
+  Sample sample;
+  sample.port = pkt->getSrcPort();
+  sample.samplingRate = rate;
+  sample.samplePool = sampling.samplePool;
+  sample.sequence = sampling.sequence;
+  sample.drops = drops_;
+  sample.frameLength = pkt->getLength();
+  sample.header.resize(std::min(sample.frameLength, config_.headerSize));
+  folly::io::Cursor cursor(pkt->buf());
+  sample.header.resize(cursor.pullAtMost(sample.header.data(),
+                                         sample.header.size()));
+  queuedBytes_ += encodedSize(sample);
+  samples_.push_back(std::move(sample));
+  ++newSamples_;
+
+  // Wake the exporter early once there is a full datagram to send
+  if (queuedBytes_ + headerSize(config_.agentIp) >= kMaxDatagramSize) {
+    cv_.notify_one();
+  }
+}
+
+void SflowExporter::exportLoop() {
+  // The pthread name can be at most 15 bytes long
+  pthread_setname_np(pthread_self(), "fbossSflow");
+  ThreadSampler::registerThread("fbossSflow");
+
+  vector<Sample> samples;
+  while (true) {
+    {
+      unique_lock<mutex> lock(mutex_);
+      cv_.wait_for(lock, flushInterval_, [&] {
+        return stopping_ ||
+          queuedBytes_ + headerSize(config_.agentIp) >= kMaxDatagramSize;
+      });
+      if (stopping_) {
+        return;
+      }
+      samples.swap(samples_);
+      queuedBytes_ = 0;
+    }
+    exportSamples(&samples);
+    samples.clear();
+  }
+}
+
+void SflowExporter::exportSamples(vector<Sample>* samples) {
+  SflowConfig config;
+  uint64_t newSamples;
+  uint64_t newDrops;
+  {
+    lock_guard<mutex> g(mutex_);
+    config = config_;
+    newSamples = newSamples_;
+    newDrops = newDrops_;
+    newSamples_ = 0;
+    newDrops_ = 0;
+  }
+  incrementCounter("sflow.samples", newSamples);
+  incrementCounter("sflow.dropped", newDrops);
+
+  uint64_t numDatagrams = 0;
+  uint64_t numSendErrors = 0;
+  auto uptimeMs = duration_cast<milliseconds>(
+      steady_clock::now() - startTime_).count();
+  size_t begin = 0;
+  while (begin < samples->size()) {
+    // Pack as many samples into each datagram as fit, but always at least
+    // one, since the header size is capped well below the datagram size
+    auto size = headerSize(config.agentIp) + encodedSize((*samples)[begin]);
+    auto end = begin + 1;
+    while (end < samples->size() &&
+           size + encodedSize((*samples)[end]) <= kMaxDatagramSize) {
+      size += encodedSize((*samples)[end]);
+      ++end;
+    }
+    auto datagram = buildDatagram(config.agentIp, ++datagramSequence_,
+                                  uptimeMs, samples->data() + begin,
+                                  end - begin);
+    ++numDatagrams;
+    if (!send(datagram.get(), config)) {
+      ++numSendErrors;
+    }
+    begin = end;
+  }
+  incrementCounter("sflow.datagrams", numDatagrams);
+  incrementCounter("sflow.send_errors", numSendErrors);
+}
+
+bool SflowExporter::send(const IOBuf* datagram, const SflowConfig& config) {
+  bool ok = true;
+  for (const auto& collector : config.collectors) {
+    auto& sock = collector.first.isV4() ? sock4_ : sock6_;
+    if (sock < 0) {
+      sock = ::socket(collector.first.isV4() ? AF_INET : AF_INET6,
+                      SOCK_DGRAM, 0);
+      if (sock < 0) {
+        LOG(ERROR) << "cannot open sFlow socket: " << folly::errnoStr(errno);
+        ok = false;
+        continue;
+      }
+    }
+    folly::SocketAddress addr(collector.first, collector.second);
+    sockaddr_storage storage;
+    auto len = addr.getAddress(&storage);
+    auto ret = ::sendto(sock, datagram->data(), datagram->length(), 0,
+                        reinterpret_cast<sockaddr*>(&storage), len);
+    if (ret < 0) {
+      VLOG(3) << "cannot send sFlow datagram to " << addr << ": "
+              << folly::errnoStr(errno);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+size_t SflowExporter::encodedSize(const Sample& sample) {
+  // The data format and length precede the sample
+  return 8 + sampleBodySize(sample);
+}
+
+size_t SflowExporter::headerSize(const IPAddress& agentIp) {
+  return 6 * 4 + agentIp.byteCount();
+}
+
+unique_ptr<IOBuf> SflowExporter::buildDatagram(
+    const IPAddress& agentIp, uint32_t sequence, uint32_t uptimeMs,
+    const Sample* samples, size_t numSamples) {
+  size_t size = headerSize(agentIp);
+  for (size_t i = 0; i < numSamples; ++i) {
+    size += encodedSize(samples[i]);
+  }
+  auto buf = IOBuf::create(size);
+  folly::io::Appender out(buf.get(), 0);
+
+  out.writeBE<uint32_t>(kSflowVersion);
+  out.writeBE<uint32_t>(agentIp.isV4() ? kAddressIPv4 : kAddressIPv6);
+  out.push(agentIp.bytes(), agentIp.byteCount());
+  out.writeBE<uint32_t>(0); // sub agent id
+  out.writeBE<uint32_t>(sequence);
+  out.writeBE<uint32_t>(uptimeMs);
+  out.writeBE<uint32_t>(numSamples);
+
+  for (size_t i = 0; i < numSamples; ++i) {
+    const auto& sample = samples[i];
+    out.writeBE<uint32_t>(kFlowSample);
+    out.writeBE<uint32_t>(sampleBodySize(sample));
+    out.writeBE<uint32_t>(sample.sequence);
+    // The source is the port's ifIndex, which we number by port ID
+    out.writeBE<uint32_t>(static_cast<uint32_t>(sample.port));
+    out.writeBE<uint32_t>(sample.samplingRate);
+    out.writeBE<uint32_t>(sample.samplePool);
+    out.writeBE<uint32_t>(sample.drops);
+    out.writeBE<uint32_t>(static_cast<uint32_t>(sample.port)); // input
+    out.writeBE<uint32_t>(0); // output, unknown
+    out.writeBE<uint32_t>(1); // number of flow records
+
+    out.writeBE<uint32_t>(kRawPacketHeader);
+    out.writeBE<uint32_t>(recordSize(sample));
+    out.writeBE<uint32_t>(kHeaderProtocolEthernet);
+    out.writeBE<uint32_t>(sample.frameLength);
+    out.writeBE<uint32_t>(0); // bytes stripped
+    out.writeBE<uint32_t>(sample.header.size());
+    out.push(sample.header.data(), sample.header.size());
+    for (auto n = sample.header.size(); n < padded(sample.header.size());
+         ++n) {
+      out.writeBE<uint8_t>(0);
+    }
+  }
+  DCHECK_EQ(size, buf->length());
+  return buf;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,140 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/StateObserver.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/types.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <folly/IPAddress.h>
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook { namespace fboss {
+
+class RxPacket;
+class StateDelta;
+
+/*
+ * SflowExporter exports the packets the hardware samples on ports with an
+ * sFlow sampling rate to the configured collectors, as sFlow v5 flow
+ * samples holding the first bytes of each packet.
+ *
+ * Sampled packets arrive on their own CPU queue and are diverted here
+ * before the trapped packet handlers see them.  packetSampled() only
+ * copies the packet header into a bounded queue, dropping samples once it
+ * is full, so sampling never delays the RX thread.  The exporter's own
+ * thread batches the queued samples into datagrams and sends them, every
+ * flush interval or as soon as a datagram's worth of samples is waiting.
+ *
+ * The sampling rates and collectors are taken from the state changes
+ * delivered to stateChanged().
+ */
+class SflowExporter : public StateObserver {
+ public:
+  enum : uint32_t {
+    // Keep datagrams below the MTU of any link to the collectors
+    kMaxDatagramSize = 1400,
+  };
+
+  struct Sample {
+    PortID port{0};
+    // The sampling rate of the port, and the number of packets it has
+    // sampled from so far
+    uint32_t samplingRate{0};
+    uint32_t samplePool{0};
+    // Sequence number of the sample for its port
+    uint32_t sequence{0};
+    // Samples dropped so far because the queue was full
+    uint32_t drops{0};
+    uint32_t frameLength{0};
+    std::vector<uint8_t> header;
+  };
+
+  SflowExporter(uint32_t queueSize, std::chrono::milliseconds flushInterval);
+  ~SflowExporter();
+
+  void start();
+  void stop();
+
+  void stateChanged(const StateDelta& delta) override;
+
+  /*
+   * Queue a sampled packet for export.  This is called on the HwSwitch RX
+   * thread, and never blocks on the exporter thread.
+   */
+  void packetSampled(const RxPacket* pkt) noexcept;
+
+  /*
+   * Encode samples as an sFlow v5 datagram.
+   */
+  static std::unique_ptr<folly::IOBuf> buildDatagram(
+      const folly::IPAddress& agentIp, uint32_t sequence, uint32_t uptimeMs,
+      const Sample* samples, size_t numSamples);
+
+  /*
+   * The number of bytes a sample adds to a datagram.
+   */
+  static size_t encodedSize(const Sample& sample);
+  static size_t headerSize(const folly::IPAddress& agentIp);
+
+ private:
+  struct PortSampling {
+    uint32_t ingressRate{0};
+    uint32_t egressRate{0};
+    uint32_t sequence{0};
+    uint32_t samplePool{0};
+  };
+
+  // Forbidden copy constructor and assignment operator
+  SflowExporter(SflowExporter const &) = delete;
+  SflowExporter& operator=(SflowExporter const &) = delete;
+
+  void exportLoop();
+  void exportSamples(std::vector<Sample>* samples);
+  bool send(const folly::IOBuf* datagram, const SflowConfig& config);
+
+  const uint32_t queueSize_{0};
+  const std::chrono::milliseconds flushInterval_;
+  const std::chrono::steady_clock::time_point startTime_;
+
+  /*
+   * mutex_ protects everything below it.  It is held only long enough to
+   * queue or take samples, or to update the configuration.
+   */
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  SflowConfig config_;
+  std::map<PortID, PortSampling> ports_;
+  std::vector<Sample> samples_;
+  size_t queuedBytes_{0};
+  uint32_t drops_{0};
+  // Counts not yet added to the exported counters
+  uint64_t newSamples_{0};
+  uint64_t newDrops_{0};
+  bool stopping_{false};
+
+  // Only accessed by the exporter thread
+  std::thread thread_;
+  uint32_t datagramSequence_{0};
+  int sock4_{-1};
+  int sock6_{-1};
+};
+
+}} // facebook::fboss
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/SfpDomPoller.h"
+
+#include <boost/container/flat_map.hpp>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include "fboss/agent/SfpMap.h"
+#include "fboss/agent/SfpModule.h"
+
+DEFINE_int32(sfp_poll_threads, 8,
+             "The maximum number of I2C buses to poll SFPs on in parallel");
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+SfpDomPoller::SfpDomPoller(const SfpMap* sfpMap)
+  : sfpMap_(sfpMap) {
+}
+
+void SfpDomPoller::detectSfps() {
+  pollAllBuses("detection", [](SfpModule* sfp) { sfp->detectSfp(); });
+}
+
+void SfpDomPoller::updateSfpDomFields() {
+  pollAllBuses("DOM update",
+               [](SfpModule* sfp) { sfp->updateSfpDomFields(); });
+}
+
+void SfpDomPoller::pollAllBuses(const char* opName, const ModuleOp& op) {
+  auto start = steady_clock::now();
+
+  // The SfpMap is only populated during platform initialization, but
+  // grouping the modules on every sweep is cheap enough not to bother
+  // caching it.
+  boost::container::flat_map<int, BusModules> buses;
+  for (const auto& entry : *sfpMap_) {
+    buses[entry.second->getBusId()].emplace_back(entry.first,
+                                                 entry.second.get());
+  }
+  if (buses.empty()) {
+    return;
+  }
+
+  size_t numWorkers = std::min<size_t>(
+      buses.size(), std::max(1, FLAGS_sfp_poll_threads));
+  std::vector<std::vector<const BusModules*>> work(numWorkers);
+  size_t idx = 0;
+  for (const auto& bus : buses) {
+    work[idx++ % numWorkers].push_back(&bus.second);
+  }
+
+  // The calling thread polls the first set of buses itself
+  std::vector<std::future<void>> workers;
+  for (size_t n = 1; n < numWorkers; ++n) {
+    workers.push_back(std::async(std::launch::async,
+                                 &SfpDomPoller::pollBuses,
+                                 std::cref(work[n]), opName, std::cref(op)));
+  }
+  pollBuses(work[0], opName, op);
+  for (auto& worker : workers) {
+    worker.get();
+  }
+
+  VLOG(3) << "SFP " << opName << " of " << buses.size() << " buses took "
+          << duration_cast<milliseconds>(steady_clock::now() - start).count()
+          << "ms";
+}
+
+void SfpDomPoller::pollBuses(const std::vector<const BusModules*>& buses,
+                             const char* opName, const ModuleOp& op) {
+  for (const auto* bus : buses) {
+    for (const auto& entry : *bus) {
+      // A failing module must not hold up the rest of its bus
+      try {
+        op(entry.second);
+      } catch (const std::exception& ex) {
+        LOG(ERROR) << "SFP " << opName << " failed for port "
+                   << entry.first << ": " << ex.what();
+      }
+    }
+  }
+}
+
+}} // facebook::fboss
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class SfpMap;
+class SfpModule;
+
+/*
+ * SfpDomPoller runs SFP detection and DOM updates over every module in an
+ * SfpMap.
+ *
+ * Modules are grouped by SfpModule::getBusId().  The modules on one bus are
+ * polled one at a time, but different buses are polled in parallel, using
+ * up to --sfp_poll_threads threads.  Each sweep returns once every module
+ * has been polled.
+ *
+ * detectSfps() and updateSfpDomFields() must not be called concurrently.
+ */
+class SfpDomPoller {
+ public:
+  explicit SfpDomPoller(const SfpMap* sfpMap);
+
+  void detectSfps();
+  void updateSfpDomFields();
+
+ private:
+  typedef std::vector<std::pair<PortID, SfpModule*>> BusModules;
+  typedef std::function<void(SfpModule*)> ModuleOp;
+
+  // Forbidden copy constructor and assignment operator
+  SfpDomPoller(SfpDomPoller const &) = delete;
+  SfpDomPoller& operator=(SfpDomPoller const &) = delete;
+
+  void pollAllBuses(const char* opName, const ModuleOp& op);
+  static void pollBuses(const std::vector<const BusModules*>& buses,
+                        const char* opName, const ModuleOp& op);
+
+  const SfpMap* sfpMap_{nullptr};
+};
+
+}} // facebook::fboss
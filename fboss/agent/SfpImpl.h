@@ -11,6 +11,7 @@
 
 #include <cstdint>
 #include <folly/String.h>
+#include "fboss/agent/FbossError.h"
 
 namespace facebook { namespace fboss {
 
@@ -27,6 +28,14 @@ class SfpImpl {
    */
   virtual int readSfpEeprom(int dataAddress, int offset,
                                           int len, uint8_t* fieldValue) = 0;
+  /*
+   * Write to the SFP EEPROM.  This is only needed by QSFPs, to select the
+   * upper page.
+   */
+  virtual int writeSfpEeprom(int dataAddress, int offset,
+                             int len, const uint8_t* fieldValue) {
+    throw FbossError("EEPROM writes are not supported for ", getName());
+  }
   /*
    * This function will check if the SFP is present or not
    */
@@ -35,6 +44,18 @@ class SfpImpl {
    * Returns the name of the port
    */
   virtual folly::StringPiece getName() = 0;
+  /*
+   * Returns an identifier for the I2C bus, or the mux channel, that this
+   * SFP is reached through.  SFPs with the same bus ID are never accessed
+   * concurrently, while SFPs on different buses may be.  Modules behind a
+   * shared mux whose channel select is not atomic with the read must report
+   * the same ID.  The default, UNKNOWN_BUS, is treated as one shared bus.
+   */
+  virtual int getBusId() {
+    return UNKNOWN_BUS;
+  }
+
+  enum : int { UNKNOWN_BUS = -1 };
 
  private:
   // Forbidden copy contructor and assignment operator
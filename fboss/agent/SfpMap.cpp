@@ -20,17 +20,20 @@ SfpMap::~SfpMap() {
 }
 
 SfpModule* SfpMap::sfpModule(PortID portID) const{
-  auto it = sfpMap_.find(portID);
-  if (it == sfpMap_.end()) {
+  auto sfp = sfpIndex_.get(portID);
+  if (!sfp) {
     throw FbossError("No sfp entry found for port");
   }
-  return it->second.get();
+  return sfp;
 }
 
 void SfpMap::createSfp(PortID portID, std::unique_ptr<SfpModule>& sfpModule) {
+  auto* sfp = sfpModule.get();
   auto rv = sfpMap_.emplace(std::make_pair(portID, std::move(sfpModule)));
-  const auto& it = rv.first;
   DCHECK(rv.second);
+  if (rv.second) {
+    sfpIndex_.set(portID, sfp);
+  }
 }
 
 PortSfpMap::const_iterator SfpMap::begin() const {
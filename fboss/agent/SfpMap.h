@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include "fboss/agent/DenseIdIndex.h"
 #include "fboss/agent/types.h"
 #include <boost/container/flat_map.hpp>
 #include "fboss/agent/SfpModule.h"
@@ -68,7 +69,8 @@ class SfpMap {
   SfpMap& operator=(SfpMap const &) = delete;
 
   PortSfpMap sfpMap_;
-
+  // The same mapping as an array, for lookups by port
+  DenseIdIndex<PortID, SfpModule> sfpIndex_;
 };
 
 }} // facebook::fboss
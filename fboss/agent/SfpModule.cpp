@@ -105,6 +105,41 @@ void getSfpFieldAddress(SfpIdpromFields field, int &dataAddress,
   length = sfpFieldInfo->second.length;
 }
 
+/*
+ * The DOM bytes that change while the SFP is plugged in: the diagnostics
+ * values, the status and control byte and the alarm and warning flags.
+ * They are contiguous, so they are refreshed with a single short read.
+ */
+static void getSfpDomDynamicRange(int &offset, int &length) {
+  int dataAddress, lastOffset, lastLength;
+  getSfpFieldAddress(SfpIdpromFields::DIAGNOSTICS, dataAddress,
+                     offset, length);
+  getSfpFieldAddress(SfpIdpromFields::ALARM_WARN_FLAGS, dataAddress,
+                     lastOffset, lastLength);
+  length = lastOffset + lastLength - offset;
+}
+
+/* Checks the DOM support bits in raw 0xA0 data */
+static bool getDomSupportIdProm(const uint8_t* idprom) {
+  int offset, dataAddress, length;
+  getSfpFieldAddress(SfpIdpromFields::DIAGNOSTIC_MONITORING_TYPE,
+                     dataAddress, offset, length);
+  /* bit 7 and 6 needs to be checked for DOM */
+  return ((idprom[offset] & (1 << 7)) == 0) && (idprom[offset] & (1 << 6));
+}
+
+/* Returns an ASCII 0xA0 field without its trailing space padding */
+static std::string getSfpStringIdProm(SfpIdpromFields field,
+                                      const uint8_t* idprom) {
+  int offset, dataAddress, length;
+  getSfpFieldAddress(field, dataAddress, offset, length);
+  auto str = reinterpret_cast<const char*>(idprom + offset);
+  while (length > 0 && (str[length - 1] == ' ' || str[length - 1] == '\0')) {
+    --length;
+  }
+  return std::string(str, length);
+}
+
 int getSfpDomBit(const SfpDomFlag flag) {
   auto domFlag = sfpDomFlag.find(flag);
   if (domFlag == sfpDomFlag.end()) {
@@ -236,49 +271,61 @@ float SfpModule::getSfpDomValue(const SfpDomValue field) {
 SfpModule::SfpModule(std::unique_ptr<SfpImpl>& sfpImpl)
   : sfpImpl_(std::move(sfpImpl)) {
   present_ = false;
-  dirty_ = true;
   domSupport_ = false;
+  publishSfpDom();
 }
 
-void SfpModule::setSfpIdprom(const uint8_t* data) {
+void SfpModule::setSfpIdprom(const uint8_t* data, const uint8_t* domData) {
   if (!present_) {
     throw FbossError("Sfp IDProm set failed as SFP is not present");
   }
-  memcpy(sfpIdprom_, data, sizeof(sfpIdprom_));
-  dirty_ = false;
+  auto idprom = std::make_shared<SfpIdprom>();
+  idprom->generation = generation_.load();
+  memcpy(idprom->data, data, sizeof(idprom->data));
+  idprom->vendorName = getSfpStringIdProm(SfpIdpromFields::VENDOR_NAME, data);
+  idprom->partNumber = getSfpStringIdProm(SfpIdpromFields::PART_NUMBER, data);
+  idprom->serialNumber = getSfpStringIdProm(
+      SfpIdpromFields::VENDOR_SERIAL_NUMBER, data);
   /* set the DOM supported flag */
-  setDomSupport();
-}
-
-void SfpModule::setDomSupport() {
-  uint8_t data;
-  int offset, dataAddress, length;
-  getSfpFieldAddress(SfpIdpromFields::DIAGNOSTIC_MONITORING_TYPE,
-                                 dataAddress, offset, length);
-  getSfpValue(dataAddress, offset, length, &data);
-  /* bit 7 and 6 needs to be checked for DOM */
-  if (((data & (1 << 7)) == 0) && (data & (1 << 6))) {
-    domSupport_ = true;
-  } else {
-    domSupport_ = false;
+  idprom->domSupported = getDomSupportIdProm(data);
+  domSupport_ = idprom->domSupported;
+  if (domSupport_) {
+    if (!domData) {
+      throw FbossError("Sfp supports DOM but its DOM data was not read");
+    }
+    /* The thresholds never change, so parse them once here */
+    setSfpDom(domData);
+    getDomThresholdValuesMap(idprom->threshValue);
   }
+  std::atomic_store(&idprom_,
+                    std::shared_ptr<const SfpIdprom>(std::move(idprom)));
 }
 
 bool SfpModule::isDomSupported() const {
-  lock_guard<std::mutex> g(sfpModuleMutex_);
-  return domSupport_;
+  return getSfpDomSnapshot()->domSupported;
+}
+
+std::shared_ptr<const SfpIdprom> SfpModule::getSfpIdprom() const {
+  return std::atomic_load(&idprom_);
+}
+
+uint64_t SfpModule::getGeneration() const {
+  return generation_.load();
 }
 
 void SfpModule::getSfpValue(int dataAddress,
                             int offset, int length, uint8_t* data) const {
   /* if the cached values are not correct */
-  if (dirty_ && (!present_)) {
+  if (!present_) {
     throw FbossError("Sfp is either not present or the data is not read");
   }
   if (dataAddress == 0x50) {
-    CHECK_LE(offset + length, sizeof(sfpIdprom_));
+    if (!idprom_) {
+      throw FbossError("Sfp IDProm has not been read");
+    }
+    CHECK_LE(offset + length, sizeof(idprom_->data));
     /* Copy data from the cache */
-    memcpy(data, (sfpIdprom_ + offset), length);
+    memcpy(data, (idprom_->data + offset), length);
   } else if (dataAddress == 0x51) {
     CHECK_LE(offset + length, sizeof(sfpDom_));
     /* Copy data from the cache */
@@ -289,19 +336,19 @@ void SfpModule::getSfpValue(int dataAddress,
 }
 
 bool SfpModule::isSfpPresent() const {
-  lock_guard<std::mutex> g(sfpModuleMutex_);
-  return present_;
+  return getSfpDomSnapshot()->sfpPresent;
 }
 
 void SfpModule::setSfpPresent(bool present) {
   present_ = present;
-  /* Set the dirty bit as the SFP was removed and
+  ++generation_;
+  /* Drop the IDProm as the SFP was removed and
    * the cached data is no longer valid until next
    * set IDProm is called
    */
   if (present_ == false) {
-    dirty_ = true;
     domSupport_ = false;
+    std::atomic_store(&idprom_, std::shared_ptr<const SfpIdprom>());
   }
 }
 
@@ -322,20 +369,41 @@ bool SfpModule::getSfpFlagIdProm(const SfpDomFlag flag, const uint8_t* data) {
   return false;
 }
 
-void SfpModule::getSfpDom(SfpDom &dom) {
-  lock_guard<std::mutex> g(sfpModuleMutex_);
-  dom.name = folly::to<std::string>(sfpImpl_->getName());
-  dom.sfpPresent = present_;
-  dom.domSupported = domSupport_;
-  if (getDomFlagsMap(dom.flags)) {
-    dom.__isset.flags = true;
+void SfpModule::publishSfpDom() {
+  auto dom = std::make_shared<SfpDom>();
+  dom->name = folly::to<std::string>(sfpImpl_->getName());
+  dom->sfpPresent = present_;
+  dom->domSupported = domSupport_;
+  if (getDomFlagsMap(dom->flags)) {
+    dom->__isset.flags = true;
   }
-  if (getDomThresholdValuesMap(dom.threshValue)) {
-    dom.__isset.threshValue = true;
+  if (present_ && domSupport_) {
+    dom->threshValue = idprom_->threshValue;
+    dom->__isset.threshValue = true;
   }
-  if (getDomValuesMap(dom.value)) {
-    dom.__isset.value = true;
+  if (getDomValuesMap(dom->value)) {
+    dom->__isset.value = true;
   }
+  std::atomic_store(&domSnapshot_,
+                    std::shared_ptr<const SfpDom>(std::move(dom)));
+}
+
+std::shared_ptr<const SfpDom> SfpModule::getSfpDomSnapshot() const {
+  return std::atomic_load(&domSnapshot_);
+}
+
+void SfpModule::publishSnapshots(std::shared_ptr<const SfpIdprom> idprom,
+                                 std::shared_ptr<const SfpDom> dom) {
+  std::atomic_store(&idprom_, std::move(idprom));
+  std::atomic_store(&domSnapshot_, std::move(dom));
+}
+
+void SfpModule::getSfpDom(SfpDom &dom) const {
+  dom = *getSfpDomSnapshot();
+}
+
+int SfpModule::getBusId() const {
+  return sfpImpl_->getBusId();
 }
 
 float SfpModule::getValueFromRaw(const SfpDomFlag key, uint16_t value) {
@@ -397,48 +465,86 @@ float SfpModule::getPwr(const uint16_t temp) {
 }
 
 void SfpModule::detectSfp() {
-  lock_guard<std::mutex> g(sfpModuleMutex_);
-  uint8_t value[MAX_SFP_EEPROM_SIZE];
+  lock_guard<std::mutex> io(ioMutex_);
   auto currentSfpStatus = sfpImpl_->detectSfp();
-  if (currentSfpStatus != present_) {
-    LOG(INFO) << "Port: " << folly::to<std::string>(sfpImpl_->getName()) <<
-                  " SFP status changed to " << currentSfpStatus;
-    setSfpPresent(currentSfpStatus);
-    if (currentSfpStatus) {
-      sfpImpl_->readSfpEeprom(0x50, 0x0, MAX_SFP_EEPROM_SIZE, value);
-      setSfpIdprom(value);
-      if (domSupport_) {
-        sfpImpl_->readSfpEeprom(0x51, 0x0, MAX_SFP_EEPROM_SIZE, value);
-        setSfpDom(value);
-      }
+  {
+    // present_ is only written with ioMutex_ held, but thrift readers may
+    // be looking at it.
+    lock_guard<std::mutex> g(sfpModuleMutex_);
+    if (currentSfpStatus == present_) {
+      return;
+    }
+  }
+  LOG(INFO) << "Port: " << folly::to<std::string>(sfpImpl_->getName()) <<
+                " SFP status changed to " << currentSfpStatus;
+
+  /* Read both pages before touching the cache, so it never mixes the
+   * IDProm of the new SFP with the DOM of the old one.
+   */
+  uint8_t idprom[MAX_SFP_EEPROM_SIZE];
+  uint8_t dom[MAX_SFP_EEPROM_SIZE];
+  bool domSupported = false;
+  if (currentSfpStatus) {
+    sfpImpl_->readSfpEeprom(0x50, 0x0, MAX_SFP_EEPROM_SIZE, idprom);
+    domSupported = getDomSupportIdProm(idprom);
+    if (domSupported) {
+      sfpImpl_->readSfpEeprom(0x51, 0x0, MAX_SFP_EEPROM_SIZE, dom);
     }
   }
+
+  lock_guard<std::mutex> g(sfpModuleMutex_);
+  setSfpPresent(currentSfpStatus);
+  if (currentSfpStatus) {
+    setSfpIdprom(idprom, domSupported ? dom : nullptr);
+  }
+  publishSfpDom();
 }
 
 int SfpModule::getSfpFieldValue(SfpIdpromFields fieldName,
                                                 uint8_t* fieldValue) {
-  lock_guard<std::mutex> g(sfpModuleMutex_);
-  int dataAddress, offset, length, rc;
-  /* Determine if SFP is present */
-  if (present_) {
-    try {
-      getSfpFieldAddress(fieldName, dataAddress, offset, length);
+  int dataAddress, offset, length;
+  try {
+    getSfpFieldAddress(fieldName, dataAddress, offset, length);
+    if (dataAddress == 0x50) {
+      /* The IDProm never changes once read, so no lock is needed */
+      auto idprom = getSfpIdprom();
+      if (!idprom) {
+        return -1;
+      }
+      CHECK_LE(offset + length, sizeof(idprom->data));
+      memcpy(fieldValue, idprom->data + offset, length);
+      return 0;
+    }
+    lock_guard<std::mutex> g(sfpModuleMutex_);
+    /* Determine if SFP is present */
+    if (present_) {
       getSfpValue(dataAddress, offset, length, fieldValue);
-    } catch (const std::exception& ex) {
-      LOG(ERROR) << "Error reading field value for port: " <<
-                folly::to<std::string>(sfpImpl_->getName()) << " " << ex.what();
+      return 0;
     }
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Error reading field value for port: " <<
+              folly::to<std::string>(sfpImpl_->getName()) << " " << ex.what();
   }
   return -1;
 }
 
 void SfpModule::updateSfpDomFields() {
-  lock_guard<std::mutex> g(sfpModuleMutex_);
-  uint8_t value[MAX_SFP_EEPROM_SIZE];
-  if (present_ && domSupport_) {
-    sfpImpl_->readSfpEeprom(0x51, 0x0, MAX_SFP_EEPROM_SIZE, value);
-    setSfpDom(value);
+  lock_guard<std::mutex> io(ioMutex_);
+  {
+    // Presence only changes in detectSfp(), which also holds ioMutex_
+    lock_guard<std::mutex> g(sfpModuleMutex_);
+    if (!present_ || !domSupport_) {
+      return;
+    }
   }
+  int offset, length;
+  getSfpDomDynamicRange(offset, length);
+  uint8_t value[MAX_SFP_EEPROM_SIZE];
+  sfpImpl_->readSfpEeprom(0x51, offset, length, value);
+
+  lock_guard<std::mutex> g(sfpModuleMutex_);
+  memcpy(sfpDom_ + offset, value, length);
+  publishSfpDom();
 }
 
 }} //namespace facebook::fboss
@@ -8,8 +8,11 @@
  *
  */
 #pragma once
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <boost/container/flat_map.hpp>
 #include "fboss/agent/SfpImpl.h"
 #include "fboss/agent/if/gen-cpp2/optic_types.h"
@@ -123,6 +126,26 @@ int getSfpDomBit(const SfpDomFlag flag);
 
 const int MAX_SFP_EEPROM_SIZE = 256;
 
+/*
+ * The static information of an SFP, parsed once when it is detected.
+ *
+ * A new SfpIdprom is built every time an SFP is inserted and is never
+ * modified afterwards, so readers can hold on to it without any locking.
+ */
+struct SfpIdprom {
+  // SfpModule's generation when this SFP was detected
+  uint64_t generation{0};
+  // The raw 0xA0 EEPROM
+  uint8_t data[MAX_SFP_EEPROM_SIZE];
+  // The ASCII fields, without their space padding
+  std::string vendorName;
+  std::string partNumber;
+  std::string serialNumber;
+  bool domSupported{false};
+  // The 0xA2 alarm and warning thresholds.  Only valid if domSupported.
+  SfpDomThreshValue threshValue;
+};
+
 /*
  * This is the SFP class which will be storing the SFP EEPROM
  * data from the address 0xA0 which is static data. The class
@@ -131,10 +154,15 @@ const int MAX_SFP_EEPROM_SIZE = 256;
  *
  * Note: The public functions need to take the lock before calling
  * the private functions.
+ *
+ * The I2C reads are done without holding sfpModuleMutex_, and every update
+ * publishes an immutable SfpDom snapshot, so getSfpDom() never waits for
+ * the hardware.
  */
 class SfpModule {
  public:
   explicit SfpModule(std::unique_ptr<SfpImpl>& sfpImpl);
+  virtual ~SfpModule() {}
   /*
    * Returns if the SFP is present or not
    */
@@ -142,37 +170,82 @@ class SfpModule {
   /*
    * This function will check if the SFP is present or not
    */
-  void detectSfp();
+  virtual void detectSfp();
   /*
    * This function returns if the SFP supports DOM
    */
   bool isDomSupported() const;
   /*
-   * Get the SFP EEPROM Field
+   * Get the SFP EEPROM Field.  Returns 0 on success, or -1 if the SFP is
+   * not present.  0xA0 fields are read from the SfpIdprom without locking.
+   */
+  virtual int getSfpFieldValue(SfpIdpromFields fieldName,
+                               uint8_t* fieldValue);
+  /*
+   * Returns the IDProm of the SFP currently plugged in, or nullptr if there
+   * is none.
+   */
+  std::shared_ptr<const SfpIdprom> getSfpIdprom() const;
+  /*
+   * Incremented every time the SFP is inserted or removed
    */
-  int getSfpFieldValue(SfpIdpromFields fieldName, uint8_t* fieldValue);
+  uint64_t getGeneration() const;
   /*
-   * This function will update the SFP Dom Fields in the cache
+   * This function will update the SFP Dom Fields in the cache.
+   * Only the diagnostics, status and alarm flag bytes are read; the
+   * thresholds and calibration constants are read when the SFP is detected.
    */
-  void updateSfpDomFields();
+  virtual void updateSfpDomFields();
   /*
-   * This function returns the entire SFP Dom information
+   * This function returns the entire SFP Dom information, from the most
+   * recently published snapshot.
    */
-  void getSfpDom(SfpDom &dom);
+  void getSfpDom(SfpDom &dom) const;
+  std::shared_ptr<const SfpDom> getSfpDomSnapshot() const;
+  /*
+   * The I2C bus this SFP is on, see SfpImpl::getBusId()
+   */
+  int getBusId() const;
+
+ protected:
+  /*
+   * For modules with another EEPROM layout, like QsfpModule, which
+   * override detectSfp(), updateSfpDomFields() and getSfpFieldValue() and
+   * publish their own snapshots.
+   */
+  SfpImpl* getSfpImpl() const {
+    return sfpImpl_.get();
+  }
+  // Called when the module is inserted or removed
+  uint64_t nextGeneration() {
+    return ++generation_;
+  }
+  // idprom may be null, if the module is absent
+  void publishSnapshots(std::shared_ptr<const SfpIdprom> idprom,
+                        std::shared_ptr<const SfpDom> dom);
+  /*
+   * ioMutex_ serializes the hardware accesses to this SFP.  It is always
+   * acquired before sfpModuleMutex_, and is held across the I2C reads so
+   * that sfpModuleMutex_ does not have to be.
+   */
+  std::mutex ioMutex_;
 
  private:
   // no copy or assignment
   SfpModule(SfpModule const &) = delete;
   SfpModule& operator=(SfpModule const &) = delete;
 
-  // Cached 0xA0 SFP eeprom value
-  uint8_t sfpIdprom_[256];
+  /*
+   * The IDProm of the current SFP, or nullptr if it is not present.
+   * Written with sfpModuleMutex_ held, using std::atomic_store(), so it may
+   * be read with std::atomic_load() without the lock.
+   */
+  std::shared_ptr<const SfpIdprom> idprom_;
   // Cached 0xA2 SFP DOM value
   uint8_t sfpDom_[256];
   // SFP Presence status
   bool present_;
-  // Denotes if the cache value is valid or stale
-  bool dirty_;
+  std::atomic<uint64_t> generation_{0};
   /* Sfp Internal Implementation */
   std::unique_ptr<SfpImpl> sfpImpl_;
   // Does the Optic support DOM
@@ -186,22 +259,18 @@ class SfpModule {
   void getSfpValue(int dataAddress,
                     int offset, int length, uint8_t* data) const;
   /*
-   * Sets the IDProm cache data for the port
-   * The data should be 256 bytes.
+   * Parses and publishes the IDProm for the port.
+   * The data should be 256 bytes, as should domData if the IDProm says
+   * DOM is supported.  domData may be null otherwise.
    * The thread needs to have the lock before calling the function.
    */
-  void setSfpIdprom(const uint8_t* data);
+  void setSfpIdprom(const uint8_t* data, const uint8_t* domData);
   /*
    * This is used by the detection thread to set the SFP presence
    * status based on the HW read.
    * The thread needs to have the lock before calling the function.
    */
   void setSfpPresent(bool present);
-  /*
-   * Sets the Dom Supported bit as per the IDPROM
-   * The thread needs to have the lock before calling the function.
-   */
-  void setDomSupport();
   /* Get the Temperature value in degree Celcius from the raw value */
   float getTemp(const uint16_t temp);
   /* Get the Vcc value in Volts from the raw value */
@@ -232,6 +301,16 @@ class SfpModule {
    * the information.
    */
   mutable std::mutex sfpModuleMutex_;
+  /*
+   * The SfpDom built from the cache on every update.  It is only accessed
+   * with std::atomic_load() and std::atomic_store().
+   */
+  std::shared_ptr<const SfpDom> domSnapshot_;
+  /*
+   * Rebuild and publish domSnapshot_.
+   * The thread needs to have the lock before calling the function.
+   */
+  void publishSfpDom();
   /*
    * This function returns the status of the SFP alarm/warning flag
    * caller needs to check if DOM is supported or not
@@ -0,0 +1,252 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/StateChangeWatcher.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+#include <folly/futures/Future.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+
+DEFINE_int32(state_change_history, 1024,
+             "How many state changes to remember, so that clients can ask "
+             "what changed since an earlier generation");
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+template<typename DeltaT>
+bool hasChanges(const DeltaT& delta) {
+  return delta.begin() != delta.end();
+}
+
+uint32_t getChangedSubsystems(const StateDelta& delta) {
+  uint32_t changed = 0;
+  if (hasChanges(delta.getPortsDelta())) {
+    changed |= StateChangeWatcher::PORTS;
+  }
+  if (hasChanges(delta.getIntfsDelta())) {
+    changed |= StateChangeWatcher::INTERFACES;
+  }
+  if (hasChanges(delta.getRouteTablesDelta())) {
+    changed |= StateChangeWatcher::ROUTES;
+  }
+  // A VLAN node also changes when its neighbor tables do, so VLANS is a
+  // superset of ARP and NDP.
+  for (const auto& vlanDelta : delta.getVlansDelta()) {
+    changed |= StateChangeWatcher::VLANS;
+    if (hasChanges(vlanDelta.getArpDelta())) {
+      changed |= StateChangeWatcher::ARP;
+    }
+    if (hasChanges(vlanDelta.getNdpDelta())) {
+      changed |= StateChangeWatcher::NDP;
+    }
+  }
+  return changed;
+}
+
+} // unnamed namespace
+
+class StateChangeWatcherImpl : private folly::AsyncTimeout {
+ public:
+  typedef StateChangeWatcher::Changes Changes;
+  typedef StateChangeWatcher::ChangesFn ChangesFn;
+
+  explicit StateChangeWatcherImpl(SwSwitch* sw);
+  ~StateChangeWatcherImpl();
+
+  void stateChanged(const StateDelta& delta);
+  void waitForChanges(int64_t sinceGeneration, milliseconds timeout,
+                      ChangesFn done);
+
+ private:
+  struct StateChange {
+    int64_t oldGeneration;
+    int64_t newGeneration;
+    uint32_t changed;
+  };
+  struct Waiter {
+    int64_t sinceGeneration;
+    ChangesFn done;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  StateChangeWatcherImpl(StateChangeWatcherImpl const &) = delete;
+  StateChangeWatcherImpl& operator=(StateChangeWatcherImpl const &) = delete;
+
+  int64_t currentGeneration() const;
+  Changes getChanges(int64_t sinceGeneration) const;
+  void scheduleNext();
+
+  void timeoutExpired() noexcept override;
+
+  SwSwitch* const sw_{nullptr};
+  const size_t maxHistory_{0};
+  // The most recent state changes, oldest first
+  std::deque<StateChange> history_;
+  // The clients waiting for changes, by when they time out
+  std::multimap<steady_clock::time_point, Waiter> waiters_;
+};
+
+StateChangeWatcherImpl::StateChangeWatcherImpl(SwSwitch* sw)
+  : AsyncTimeout(sw->getBackgroundEVB()),
+    sw_(sw),
+    maxHistory_(std::max(1, FLAGS_state_change_history)) {
+}
+
+StateChangeWatcherImpl::~StateChangeWatcherImpl() {
+  // Don't leave any clients hanging
+  for (auto& entry : waiters_) {
+    entry.second.done(getChanges(entry.second.sinceGeneration));
+  }
+}
+
+int64_t StateChangeWatcherImpl::currentGeneration() const {
+  if (!history_.empty()) {
+    return history_.back().newGeneration;
+  }
+  return sw_->getState()->getGeneration();
+}
+
+StateChangeWatcherImpl::Changes StateChangeWatcherImpl::getChanges(
+    int64_t sinceGeneration) const {
+  Changes changes;
+  changes.generation = currentGeneration();
+  if (sinceGeneration == changes.generation) {
+    return changes;
+  }
+  // A generation newer than ours comes from before the agent restarted
+  if (sinceGeneration > changes.generation || history_.empty() ||
+      sinceGeneration < history_.front().oldGeneration) {
+    changes.changed = StateChangeWatcher::ALL;
+    changes.resync = true;
+    return changes;
+  }
+  for (auto iter = history_.rbegin(); iter != history_.rend(); ++iter) {
+    if (iter->newGeneration <= sinceGeneration) {
+      break;
+    }
+    changes.changed |= iter->changed;
+  }
+  return changes;
+}
+
+void StateChangeWatcherImpl::stateChanged(const StateDelta& delta) {
+  StateChange change;
+  change.oldGeneration = delta.oldState()->getGeneration();
+  change.newGeneration = delta.newState()->getGeneration();
+  change.changed = getChangedSubsystems(delta);
+  history_.push_back(change);
+  while (history_.size() > maxHistory_) {
+    history_.pop_front();
+  }
+  if (!change.changed) {
+    return;
+  }
+
+  auto iter = waiters_.begin();
+  while (iter != waiters_.end()) {
+    auto changes = getChanges(iter->second.sinceGeneration);
+    if (!changes.changed) {
+      ++iter;
+      continue;
+    }
+    iter->second.done(changes);
+    iter = waiters_.erase(iter);
+  }
+  scheduleNext();
+}
+
+void StateChangeWatcherImpl::waitForChanges(int64_t sinceGeneration,
+                                            milliseconds timeout,
+                                            ChangesFn done) {
+  auto changes = getChanges(sinceGeneration);
+  if (changes.changed || timeout.count() <= 0) {
+    done(changes);
+    return;
+  }
+  auto deadline = steady_clock::now() + timeout;
+  waiters_.emplace(deadline, Waiter{sinceGeneration, std::move(done)});
+  scheduleNext();
+}
+
+void StateChangeWatcherImpl::scheduleNext() {
+  if (waiters_.empty()) {
+    cancelTimeout();
+    return;
+  }
+  auto deadline = waiters_.begin()->first;
+  auto now = steady_clock::now();
+  // Round up, so we never wake up just before the first waiter is due
+  auto timeout = deadline > now ?
+    duration_cast<milliseconds>(deadline - now) + milliseconds(1) :
+    milliseconds(0);
+  scheduleTimeout(timeout);
+}
+
+void StateChangeWatcherImpl::timeoutExpired() noexcept {
+  auto now = steady_clock::now();
+  while (!waiters_.empty() && waiters_.begin()->first <= now) {
+    auto& waiter = waiters_.begin()->second;
+    waiter.done(getChanges(waiter.sinceGeneration));
+    waiters_.erase(waiters_.begin());
+  }
+  scheduleNext();
+}
+
+StateChangeWatcher::StateChangeWatcher(SwSwitch* sw)
+    : impl_(new StateChangeWatcherImpl(sw)),
+      sw_(sw) {}
+
+StateChangeWatcher::~StateChangeWatcher() {
+  auto* impl = impl_;
+  if (!started_) {
+    // Nothing was ever delivered to the background thread, which may not
+    // even be running.
+    delete impl;
+    return;
+  }
+
+  // Delete the implementation in the background thread, after any
+  // waitForChanges() calls that are still queued there.
+  via(sw_->getBackgroundEVB())
+    .then([impl]() { delete impl; })
+    .onError([](const std::exception& e) {
+      LOG(FATAL) << "failed to stop state change watcher: " << e.what();
+    })
+    .get();
+}
+
+void StateChangeWatcher::stateChanged(const StateDelta& delta) {
+  CHECK(sw_->getBackgroundEVB()->inRunningEventBaseThread());
+  started_ = true;
+  impl_->stateChanged(delta);
+}
+
+void StateChangeWatcher::waitForChanges(int64_t sinceGeneration,
+                                        milliseconds timeout,
+                                        ChangesFn done) {
+  auto* impl = impl_;
+  started_ = true;
+  sw_->getBackgroundEVB()->runInEventBaseThread(
+      [=]() mutable {
+        impl->waitForChanges(sinceGeneration, timeout, std::move(done));
+      });
+}
+
+}} // facebook::fboss
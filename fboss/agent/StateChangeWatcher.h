@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/StateObserver.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace facebook { namespace fboss {
+
+class StateChangeWatcherImpl;
+class StateDelta;
+class SwSwitch;
+
+/**
+ * StateChangeWatcher remembers which parts of the SwitchState changed in the
+ * last --state_change_history state changes, by SwitchState generation.
+ * This lets clients that poll the switch find out whether anything they
+ * care about changed since their last poll, or wait until it does, instead
+ * of downloading unchanged tables again.
+ *
+ * The generation of a SwitchState increases with each change, so it
+ * identifies a state for as long as the agent runs.
+ *
+ * All of the work is done in the background thread, where state changes
+ * are delivered.
+ */
+class StateChangeWatcher : public StateObserver {
+ public:
+  enum Subsystem : uint32_t {
+    PORTS = 0x01,
+    VLANS = 0x02,
+    INTERFACES = 0x04,
+    ROUTES = 0x08,
+    ARP = 0x10,
+    NDP = 0x20,
+    ALL = 0x3f,
+  };
+
+  struct Changes {
+    // The generation of the latest state
+    int64_t generation{0};
+    // The Subsystems that changed since the requested generation
+    uint32_t changed{0};
+    /*
+     * The requested generation is too old (or unknown), so it is not known
+     * what changed since.  All subsystems are reported as changed, and the
+     * client has to read them all again.
+     */
+    bool resync{false};
+  };
+  typedef std::function<void(const Changes&)> ChangesFn;
+
+  explicit StateChangeWatcher(SwSwitch* sw);
+  ~StateChangeWatcher();
+
+  void stateChanged(const StateDelta& delta) override;
+
+  /*
+   * Call done() with the changes since the given generation, as soon as any
+   * of the Subsystems changes, or after the timeout with no changes.  If
+   * there already are changes, done() is called right away.
+   *
+   * This may be called from any thread.  done() is called in the background
+   * thread, and must not block.
+   */
+  void waitForChanges(int64_t sinceGeneration,
+                      std::chrono::milliseconds timeout, ChangesFn done);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  StateChangeWatcher(StateChangeWatcher const &) = delete;
+  StateChangeWatcher& operator=(StateChangeWatcher const &) = delete;
+
+  /**
+   * impl_ should only ever be accessed from the background thread, so we
+   * don't need to lock accesses.
+   */
+  StateChangeWatcherImpl* impl_{nullptr};
+  SwSwitch* sw_{nullptr};
+  // Whether the background thread may have any work queued for impl_
+  std::atomic<bool> started_{false};
+};
+
+}} // facebook::fboss
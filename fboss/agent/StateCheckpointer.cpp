@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/StateCheckpointer.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/state/IncrementalSnapshot.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+#include <folly/String.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/AsyncTimeout.h>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::shared_ptr;
+using std::string;
+
+namespace facebook { namespace fboss {
+
+class StateCheckpointerImpl : private folly::AsyncTimeout {
+ public:
+  StateCheckpointerImpl(SwSwitch* sw, string filename, milliseconds interval)
+    : AsyncTimeout(sw->getBackgroundEVB()),
+      filename_(std::move(filename)),
+      interval_(interval) {}
+
+  bool isStarted() const {
+    return started_;
+  }
+
+  void stateChanged(const StateDelta& delta) {
+    started_ = true;
+    latest_ = delta.newState();
+    if (!isScheduled()) {
+      scheduleTimeout(interval_);
+    }
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  StateCheckpointerImpl(StateCheckpointerImpl const &) = delete;
+  StateCheckpointerImpl& operator=(StateCheckpointerImpl const &) = delete;
+
+  void timeoutExpired() noexcept override {
+    auto start = steady_clock::now();
+    try {
+      snapshot_.update(latest_);
+      snapshot_.writeFile(filename_);
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "Unable to checkpoint switch state to " << filename_ <<
+        ": " << folly::exceptionStr(ex);
+      return;
+    }
+    VLOG(2) << "checkpointed switch state to " << filename_ << ": " <<
+      snapshot_.size() << " bytes, " << snapshot_.getNumEncoded() <<
+      " nodes encoded in " <<
+      duration_cast<milliseconds>(steady_clock::now() - start).count() <<
+      "ms";
+  }
+
+  const string filename_;
+  const milliseconds interval_;
+  bool started_{false};
+  // The most recent state, which the next checkpoint saves
+  shared_ptr<SwitchState> latest_;
+  IncrementalSnapshot snapshot_;
+};
+
+StateCheckpointer::StateCheckpointer(SwSwitch* sw, string filename,
+                                     milliseconds interval)
+    : impl_(new StateCheckpointerImpl(sw, std::move(filename), interval)),
+      sw_(sw) {}
+
+StateCheckpointer::~StateCheckpointer() {
+  auto* impl = impl_;
+  if (!impl->isStarted()) {
+    // No state change has ever been delivered, so the timeout was never
+    // scheduled and the background thread may not even be running.
+    delete impl;
+    return;
+  }
+
+  // Delete the implementation in the background thread, where its timeout
+  // may be scheduled.
+  via(sw_->getBackgroundEVB())
+    .then([impl]() { delete impl; })
+    .onError([](const std::exception& e) {
+      LOG(FATAL) << "failed to stop state checkpointer: " << e.what();
+    })
+    .get();
+}
+
+void StateCheckpointer::stateChanged(const StateDelta& delta) {
+  CHECK(sw_->getBackgroundEVB()->inRunningEventBaseThread());
+  impl_->stateChanged(delta);
+}
+
+}} // facebook::fboss
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/StateObserver.h"
+
+#include <chrono>
+#include <string>
+
+namespace facebook { namespace fboss {
+
+class StateCheckpointerImpl;
+class StateDelta;
+class SwSwitch;
+
+/**
+ * StateCheckpointer periodically saves the published SwitchState as a
+ * StateSnapshot, so that after a crash the agent can warm boot from a
+ * recent state, and reconcile it with the hardware, instead of having to
+ * cold boot.
+ *
+ * A checkpoint is written at most once per interval, and only if the state
+ * changed since the last one.  Each checkpoint only re-encodes the nodes
+ * that changed since the previous one (see IncrementalSnapshot).
+ *
+ * All of the work is done in the background thread, where state changes
+ * are delivered, so checkpointing never delays state updates.
+ */
+class StateCheckpointer : public StateObserver {
+ public:
+  StateCheckpointer(SwSwitch* sw, std::string filename,
+                    std::chrono::milliseconds interval);
+  ~StateCheckpointer();
+
+  void stateChanged(const StateDelta& delta) override;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  StateCheckpointer(StateCheckpointer const &) = delete;
+  StateCheckpointer& operator=(StateCheckpointer const &) = delete;
+
+  /**
+   * impl_ should only ever be accessed from the background thread, so we
+   * don't need to lock accesses.
+   */
+  StateCheckpointerImpl* impl_{nullptr};
+  SwSwitch* sw_{nullptr};
+};
+
+}} // facebook::fboss
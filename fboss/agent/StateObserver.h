@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+namespace facebook { namespace fboss {
+
+class StateDelta;
+
+/*
+ * StateObserver is the interface for software components that want to be
+ * notified of SwitchState changes.
+ *
+ * Observers are registered with SwSwitch::registerStateObserver(), and are
+ * notified on their own EventBase.  This lets them process a change at the
+ * same time as the HwSwitch is programming it, instead of delaying the
+ * hardware update (and each other) on the state update thread.
+ */
+class StateObserver {
+ public:
+  virtual ~StateObserver() {}
+
+  /*
+   * stateChanged() is called once for each state change, in the order the
+   * changes were applied.
+   *
+   * The SwitchStates referenced by the delta are published, and thus
+   * immutable.  Note that by the time this is called the SwitchState may
+   * have been changed again, and the HwSwitch may or may not have finished
+   * programming this change yet.
+   */
+  virtual void stateChanged(const StateDelta& delta) = 0;
+};
+
+}} // facebook::fboss
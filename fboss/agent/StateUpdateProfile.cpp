@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/StateUpdateProfile.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace facebook { namespace fboss {
+
+const char* getStateUpdateStageName(StateUpdateStage stage) {
+  switch (stage) {
+  case StateUpdateStage::PREPARE:
+    return "prepare";
+  case StateUpdateStage::PUBLISH:
+    return "publish";
+  case StateUpdateStage::DELTA:
+    return "delta";
+  case StateUpdateStage::HW_LOCK:
+    return "hw_lock";
+  case StateUpdateStage::OBSERVERS:
+    return "observers";
+  case StateUpdateStage::TUN_SYNC:
+    return "tun_sync";
+  case StateUpdateStage::HW:
+    return "hw";
+  case StateUpdateStage::NUM_STAGES:
+    break;
+  }
+  LOG(FATAL) << "unknown state update stage " << static_cast<int>(stage);
+  return nullptr;
+}
+
+std::string StateUpdateProfile::getName() const {
+  if (names.size() == 1) {
+    return names.front();
+  }
+  return names.empty() ? "" : "coalesced";
+}
+
+StateUpdateHistory::StateUpdateHistory(size_t capacity)
+  : capacity_(capacity) {
+}
+
+void StateUpdateHistory::record(StateUpdateProfile profile) {
+  if (capacity_ == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> g(lock_);
+  if (profiles_.size() < capacity_) {
+    profiles_.push_back(std::move(profile));
+  } else {
+    profiles_[next_] = std::move(profile);
+  }
+  next_ = (next_ + 1) % capacity_;
+}
+
+std::vector<StateUpdateProfile> StateUpdateHistory::getSlowest(
+    size_t count) const {
+  std::vector<StateUpdateProfile> slowest;
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    slowest = profiles_;
+  }
+  auto slower = [](const StateUpdateProfile& a, const StateUpdateProfile& b) {
+    return a.total > b.total;
+  };
+  count = std::min(count, slowest.size());
+  std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(),
+                    slower);
+  slowest.resize(count);
+  return slowest;
+}
+
+}} // facebook::fboss
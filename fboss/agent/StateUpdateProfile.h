@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * The stages a state update goes through in SwSwitch::handlePendingUpdates()
+ * and SwSwitch::applyUpdate().
+ */
+enum class StateUpdateStage : uint8_t {
+  // Running the StateUpdate functions
+  PREPARE,
+  // Publishing the states they return
+  PUBLISH,
+  // Constructing the StateDelta
+  DELTA,
+  // Waiting for the hardware mutex
+  HW_LOCK,
+  // Scheduling the StateObserver notifications
+  OBSERVERS,
+  // Syncing the interfaces to the host
+  TUN_SYNC,
+  // HwSwitch::stateChanged()
+  HW,
+  NUM_STAGES,
+};
+
+const char* getStateUpdateStageName(StateUpdateStage stage);
+
+/*
+ * Where the time went in one run of handlePendingUpdates(), which applies
+ * all the updates pending at the time as one state change.
+ */
+struct StateUpdateProfile {
+  static constexpr size_t kNumStages =
+    static_cast<size_t>(StateUpdateStage::NUM_STAGES);
+
+  // The name of the update, or "coalesced" if several differently named
+  // updates were applied together
+  std::string getName() const;
+
+  void addStage(StateUpdateStage stage, std::chrono::microseconds us) {
+    stages[static_cast<size_t>(stage)] += us;
+  }
+  std::chrono::microseconds getStage(StateUpdateStage stage) const {
+    return stages[static_cast<size_t>(stage)];
+  }
+
+  // The names of the updates, in the order they were applied, each only
+  // listed once
+  std::vector<std::string> names;
+  uint32_t numUpdates{0};
+  // The generation of the resulting state
+  int64_t generation{0};
+  // When the updates started to be applied
+  time_t startTime{0};
+  std::chrono::microseconds total{0};
+  std::array<std::chrono::microseconds, kNumStages> stages{};
+};
+
+/*
+ * The profiles of the most recent state updates, so that the slowest ones
+ * can be looked at after the fact.
+ *
+ * Profiles are recorded by the update thread, and may be read from any
+ * thread.
+ */
+class StateUpdateHistory {
+ public:
+  explicit StateUpdateHistory(size_t capacity);
+
+  void record(StateUpdateProfile profile);
+
+  // Up to count of the recorded profiles, slowest first
+  std::vector<StateUpdateProfile> getSlowest(size_t count) const;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  StateUpdateHistory(StateUpdateHistory const &) = delete;
+  StateUpdateHistory& operator=(StateUpdateHistory const &) = delete;
+
+  const size_t capacity_{0};
+  mutable std::mutex lock_;
+  // A ring; once full, next_ is the oldest entry
+  std::vector<StateUpdateProfile> profiles_;
+  size_t next_{0};
+};
+
+}} // facebook::fboss
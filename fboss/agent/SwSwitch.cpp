@@ -10,38 +10,68 @@
 #include "fboss/agent/SwSwitch.h"
 
 #include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/BfdManager.h"
+#include "fboss/agent/BootTimeline.h"
+#include "fboss/agent/DHCPRelayCache.h"
+#include "fboss/agent/DeferredInit.h"
+#include "fboss/agent/EventTrace.h"
 #include "fboss/agent/IPv4Handler.h"
 #include "fboss/agent/IPv6Handler.h"
 #include "fboss/agent/FbossError.h"
 #include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/L2LearningQueue.h"
+#include "fboss/agent/PacketLatency.h"
 #include "fboss/agent/Platform.h"
+#include "fboss/agent/LinkStateDebouncer.h"
+#include "fboss/agent/MetricsExporter.h"
+#include "fboss/agent/NeighborHoldQueue.h"
+#include "fboss/agent/PeriodicTransmitter.h"
 #include "fboss/agent/PortStats.h"
+#include "fboss/agent/QsfpModule.h"
+#include "fboss/agent/RouteStats.h"
 #include "fboss/agent/RxPacket.h"
+#include "fboss/agent/RxPacketDispatcher.h"
+#include "fboss/agent/RxPacketPolicer.h"
+#include "fboss/agent/SflowExporter.h"
+#include "fboss/agent/TrappedPacketProfiler.h"
+#include "fboss/agent/StateObserver.h"
 #include "fboss/agent/SysError.h"
+#include "fboss/agent/ThreadSampler.h"
 #include "fboss/agent/TunManager.h"
 #include "fboss/agent/TxPacket.h"
+#include "fboss/agent/UnresolvedPuntPolicy.h"
+#include "fboss/agent/UpdateRecorder.h"
+#include "fboss/agent/UpdateWatchdog.h"
 #include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/Utils.h"
 #include "fboss/agent/capture/PktCaptureManager.h"
 #include "fboss/agent/packet/EthHdr.h"
 #include "fboss/agent/packet/PktUtil.h"
+#include "fboss/agent/state/CloneArena.h"
+#include "fboss/agent/state/JsonStreamWriter.h"
 #include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/StateSnapshot.h"
 #include "fboss/agent/state/StateUpdateHelpers.h"
 #include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/StateCheckpointer.h"
+#include "fboss/agent/SfpDomPoller.h"
 #include "fboss/agent/SfpMap.h"
 #include "fboss/agent/SfpModule.h"
 #include "fboss/agent/SfpImpl.h"
+#include "fboss/agent/LacpManager.h"
 #include "fboss/agent/LldpManager.h"
 #include "common/stats/ServiceData.h"
 #include <folly/FileUtil.h>
 #include <folly/MacAddress.h>
 #include <folly/String.h>
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 
 using folly::EventBase;
 using folly::io::Cursor;
 using folly::io::RWPrivateCursor;
+using folly::MacAddress;
 using folly::make_unique;
 using folly::StringPiece;
 using std::lock_guard;
@@ -51,6 +81,106 @@ using std::shared_ptr;
 using std::string;
 using std::unique_lock;
 using std::unique_ptr;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+DEFINE_int32(state_update_coalesce_ms, 0,
+             "How long to hold back a pending state update so that it can be "
+             "applied together with updates scheduled after it.  0 disables "
+             "coalescing.");
+DEFINE_int32(state_update_coalesce_max, 100,
+             "Apply the pending state updates without waiting for the rest of "
+             "the coalescing window once this many are queued.");
+DEFINE_int32(max_queued_state_updates, 1000,
+             "How many state updates may be queued before the route thrift "
+             "APIs turn new route updates away with a retryable error.  0 "
+             "disables the limit.");
+DEFINE_int32(state_update_history, 256,
+             "How many of the most recent state updates to keep the profiles "
+             "of, for getSlowestStateUpdates()");
+DEFINE_int32(state_memory_stats_interval, 60,
+             "Minimum number of seconds between computing the SwitchState "
+             "memory usage statistics.  0 disables them.");
+DEFINE_bool(state_update_arena, true,
+            "Allocate the nodes cloned while preparing a batch of state "
+            "updates from a per-batch arena, rather than one at a time from "
+            "the heap.");
+DEFINE_int32(state_update_pipeline_depth, 0,
+             "Program state updates into the hardware in a thread of their "
+             "own, while the update thread prepares the next batch, with up "
+             "to this many prepared batches waiting.  0 prepares and "
+             "programs each batch in the update thread.");
+DEFINE_int32(state_checkpoint_interval_ms, 30000,
+             "The minimum time, in milliseconds, between checkpoints of the "
+             "switch state, which let the agent warm boot after a crash.  "
+             "0 disables checkpointing");
+DEFINE_bool(rx_dispatch, false,
+            "Process trapped packets on per-class worker threads, rather than "
+            "inline on the hardware RX thread");
+DEFINE_int32(rx_dispatch_queue_size, 1024,
+             "Maximum number of trapped packets queued for each packet class "
+             "when --rx_dispatch is enabled.  Packets beyond this are dropped.");
+DEFINE_int32(rx_dispatch_host_threads, 2,
+             "Number of worker threads processing IPv4/IPv6 traffic when "
+             "--rx_dispatch is enabled.  Control protocols (ARP, NDP, LLDP) "
+             "and all other packets get one worker thread each.");
+DEFINE_int32(sflow_queue_size, 4096,
+             "Maximum number of sampled packets waiting to be exported to the "
+             "sFlow collectors.  Samples beyond this are dropped.");
+DEFINE_int32(sflow_flush_ms, 100,
+             "The longest time, in milliseconds, a sampled packet waits for "
+             "more samples to batch into the same sFlow datagram");
+DEFINE_bool(rx_policer, false,
+            "Rate limit trapped packets per port and packet class before "
+            "processing them");
+DEFINE_int32(rx_policer_priority_pps, 2000,
+             "Per-port rate limit, in packets/sec, for ARP replies, NDP "
+             "neighbor advertisements and LLDP.  0 means unlimited.");
+DEFINE_int32(rx_policer_neighbor_pps, 100,
+             "Per-port rate limit, in packets/sec, for other ARP and NDP "
+             "packets, and for unrecognized packets.  0 means unlimited.");
+DEFINE_int32(rx_policer_ip_pps, 0,
+             "Per-port rate limit, in packets/sec, for other IPv4 and IPv6 "
+             "packets.  0 means unlimited.");
+DEFINE_int32(rx_policer_burst_ms, 1000,
+             "The burst size of each RX policer class, as the number of "
+             "milliseconds of traffic at its rate limit");
+DEFINE_bool(trap_profile, true,
+            "Count trapped packets and their sizes per port and protocol, and "
+            "sample their sources for getCpuTopTalkers()");
+DEFINE_int32(trap_talker_sample_rate, 16,
+             "Sample the source of one in this many trapped packets for "
+             "getCpuTopTalkers()");
+DEFINE_int32(trap_talker_entries, 1024,
+             "Maximum number of trapped packet sources to keep counts for");
+DEFINE_int32(trap_talker_half_life_s, 10,
+             "How often, in seconds, the trapped packet source counts are "
+             "halved, so that they reflect recent traffic");
+DEFINE_int32(thread_sample_ms, 0,
+             "Sample what the update, background and RX threads are doing "
+             "this often, and export their CPU time per state update and "
+             "packet handler.  0 disables the sampler.");
+DEFINE_int32(update_stall_threshold_ms, 10000,
+             "Log the name, delta size and stack of state updates that run "
+             "for longer than this many milliseconds, and count them as "
+             "stalls.  0 disables the watchdog.");
+DEFINE_int32(metrics_port, 0,
+             "Serve the counters as OpenMetrics text over HTTP on this port, "
+             "on /metrics.  0 disables the endpoint.");
+DEFINE_string(update_record_file, "",
+              "Record the route and neighbor thrift calls, trapped packets "
+              "and state updates to this file, to be replayed offline with "
+              "sim_update_replay");
+DEFINE_int32(link_up_hold_down_ms, 1000,
+             "How long a port has to stay up before the link up is acted on");
+DEFINE_int32(link_down_hold_down_ms, 0,
+             "How long a port has to stay down before the link down is acted "
+             "on");
+DEFINE_int32(link_event_batch_ms, 50,
+             "How long to wait for link changes on other ports, so that "
+             "changes on many ports at once are handled together");
 
 namespace {
   facebook::fboss::PortStatus fillInPortStatus(
@@ -73,12 +203,87 @@ SwSwitch::SwSwitch(std::unique_ptr<Platform> platform)
     ipv4_(new IPv4Handler(this)),
     ipv6_(new IPv6Handler(this)),
     nUpdater_(new NeighborUpdater(this)),
+    nAnnouncer_(new NeighborAnnouncer(this)),
+    holdQueue_(new NeighborHoldQueue(this)),
+    puntPolicy_(new UnresolvedPuntPolicy()),
+    routeStats_(new RouteStats()),
+    changeWatcher_(new StateChangeWatcher(this)),
     pcapMgr_(new PktCaptureManager(this)),
-    sfpMap_(new SfpMap()) {
+    sflow_(new SflowExporter(std::max(FLAGS_sflow_queue_size, 1),
+                             milliseconds(std::max(FLAGS_sflow_flush_ms, 1)))),
+    bfd_(new BfdManager(this)),
+    dhcpRelayCache_(new DHCPRelayCache()),
+    sfpMap_(new SfpMap()),
+    sfpPoller_(new SfpDomPoller(sfpMap_.get())),
+    updateHistory_(std::max(FLAGS_state_update_history, 0)) {
   // Create the platform-specific state directories if they
   // don't exist already.
   utilCreateDir(platform_->getVolatileStateDir());
   utilCreateDir(platform_->getPersistentStateDir());
+
+  deferredInit_ = make_unique<DeferredInit>(&backgroundEventBase_);
+
+  // The IPv6Handler, NeighborUpdater, NeighborAnnouncer and
+  // StateChangeWatcher schedule all of their work in the background thread
+  // anyway, so they can process state changes there too.
+  registerStateObserver(ipv6_.get(), &backgroundEventBase_);
+  registerStateObserver(nUpdater_.get(), &backgroundEventBase_);
+  registerStateObserver(nAnnouncer_.get(), &backgroundEventBase_);
+  registerStateObserver(changeWatcher_.get(), &backgroundEventBase_);
+  registerStateObserver(sflow_.get(), &backgroundEventBase_);
+  registerStateObserver(bfd_.get(), &backgroundEventBase_);
+  registerStateObserver(puntPolicy_.get(), &backgroundEventBase_);
+  if (FLAGS_state_checkpoint_interval_ms > 0) {
+    utilCreateDir(platform_->getWarmBootDir());
+    checkpointer_ = make_unique<StateCheckpointer>(
+        this, platform_->getStateCheckpointFile(),
+        std::chrono::milliseconds(FLAGS_state_checkpoint_interval_ms));
+    registerStateObserver(checkpointer_.get(), &backgroundEventBase_);
+  }
+
+  registerDefaultPacketHandlers();
+
+  if (FLAGS_rx_policer) {
+    RxPacketPolicer::Config config;
+    auto setClass = [&](RxPolicerClass cls, int32_t pps) {
+      uint32_t burst =
+        static_cast<uint64_t>(pps) * FLAGS_rx_policer_burst_ms / 1000;
+      config[static_cast<int>(cls)] =
+        RxPacketPolicer::ClassConfig(pps, std::max<uint32_t>(burst, 1));
+    };
+    setClass(RxPolicerClass::ARP_REPLY, FLAGS_rx_policer_priority_pps);
+    setClass(RxPolicerClass::NDP_ADVERTISEMENT, FLAGS_rx_policer_priority_pps);
+    setClass(RxPolicerClass::LLDP, FLAGS_rx_policer_priority_pps);
+    setClass(RxPolicerClass::ARP_OTHER, FLAGS_rx_policer_neighbor_pps);
+    setClass(RxPolicerClass::NDP_OTHER, FLAGS_rx_policer_neighbor_pps);
+    setClass(RxPolicerClass::OTHER, FLAGS_rx_policer_neighbor_pps);
+    setClass(RxPolicerClass::IP, FLAGS_rx_policer_ip_pps);
+    rxPolicer_ = make_unique<RxPacketPolicer>(config);
+  }
+  if (FLAGS_trap_profile) {
+    trapProfiler_ = make_unique<TrappedPacketProfiler>(
+        std::max(FLAGS_trap_talker_sample_rate, 1),
+        std::max(FLAGS_trap_talker_entries, 1),
+        std::chrono::seconds(std::max(FLAGS_trap_talker_half_life_s, 0)));
+  }
+  if (!FLAGS_update_record_file.empty()) {
+    updateRecorder_ = make_unique<UpdateRecorder>(FLAGS_update_record_file);
+  }
+
+  LinkStateDebouncer::Config linkConfig;
+  linkConfig.upHoldDown =
+    std::chrono::milliseconds(std::max(0, FLAGS_link_up_hold_down_ms));
+  linkConfig.downHoldDown =
+    std::chrono::milliseconds(std::max(0, FLAGS_link_down_hold_down_ms));
+  linkConfig.batchWindow =
+    std::chrono::milliseconds(std::max(0, FLAGS_link_event_batch_ms));
+  linkDebouncer_ = make_unique<LinkStateDebouncer>(
+      &backgroundEventBase_, linkConfig,
+      [=](const LinkStateDebouncer::LinkChanges& changes) {
+        linkStatesChanged(changes);
+      });
+  l2Learning_ = make_unique<L2LearningQueue>();
+  periodicTx_ = make_unique<PeriodicTransmitter>(this, &backgroundEventBase_);
 }
 
 SwSwitch::~SwSwitch() {
@@ -86,6 +291,23 @@ SwSwitch::~SwSwitch() {
 }
 
 void SwSwitch::stop() {
+  // So none of them starts anything while we are stopping it
+  deferredInit_->stop();
+
+  if (threadSampler_) {
+    threadSampler_->stop();
+  }
+  if (updateWatchdog_) {
+    updateWatchdog_->stop();
+  }
+
+  // Stop the RX workers first, so no packets are being processed while the
+  // handlers are torn down.  Packets received from now on will be dropped.
+  if (rxDispatcher_) {
+    rxDispatcher_->stop();
+  }
+  sflow_->stop();
+
   {
     lock_guard<mutex> g(hwMutex_);
 
@@ -93,9 +315,25 @@ void SwSwitch::stop() {
 
     // Several member variables are performing operations in the background
     // thread.  Ask them to stop, before we shut down the background thread.
+    // The NeighborAnnouncer sends through the IPv6Handler, so stop it first.
+    unregisterStateObserver(nAnnouncer_.get());
+    nAnnouncer_.reset();
+    unregisterStateObserver(changeWatcher_.get());
+    changeWatcher_.reset();
+    unregisterStateObserver(sflow_.get());
+    unregisterStateObserver(bfd_.get());
+    bfd_->stop();
+    unregisterStateObserver(puntPolicy_.get());
+    if (checkpointer_) {
+      unregisterStateObserver(checkpointer_.get());
+      checkpointer_.reset();
+    }
+    unregisterStateObserver(ipv6_.get());
+    unregisterStateObserver(nUpdater_.get());
     ipv6_.reset();
     nUpdater_.reset();
     lldpManager_->stop();
+    lacpManager_->stop();
 
     // Stop tunMgr so we don't get any packets to process
     // in software that were sent to the switch ip or were
@@ -103,6 +341,12 @@ void SwSwitch::stop() {
     tunMgr_.reset();
   }
 
+  // The exporter runs in the background thread, so it has to stop first
+  if (metricsExporter_) {
+    metricsExporter_->stop();
+    metricsExporter_.reset();
+  }
+
   // This needs to be run without holding hwMutex_ because the update
   // thread may be waiting on the mutex in applyUpdate
   stopThreads();
@@ -135,7 +379,7 @@ SwSwitch::SwitchRunState SwSwitch::getSwitchRunState() const {
 
 void SwSwitch::gracefulExit() {
   if (isFullyInitialized()) {
-    dumpStateToFile(platform_->getWarmBootSwitchStateFile());
+    saveWarmBootState(platform_->getWarmBootSwitchStateFile());
     ipv6_->floodNeighborAdvertisements();
     arp_->floodGratuituousArp();
     // Stop handlers and threads before uninitializing h/w
@@ -147,11 +391,25 @@ void SwSwitch::gracefulExit() {
 }
 
 void SwSwitch::dumpStateToFile(const string& filename) const {
-  bool success = folly::writeFile(
-    toPrettyJson(getState()->toFollyDynamic()).toStdString(),
-    filename.c_str());
-  if (!success) {
-    LOG(ERROR) << "Unable to dump switch state to " << filename;
+  // Stream the JSON out, rather than building the whole state as one
+  // folly::dynamic, which for a large RIB is several times its size.
+  auto state = getState();
+  try {
+    JsonStreamWriter::writeFile(filename, [&](JsonStreamWriter* writer) {
+      state->writeJson(writer);
+    });
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Unable to dump switch state to " << filename << ": " <<
+      folly::exceptionStr(ex);
+  }
+}
+
+void SwSwitch::saveWarmBootState(const string& filename) const {
+  try {
+    StateSnapshot::writeFile(getState(), filename);
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Unable to save warm boot state to " << filename << ": " <<
+      folly::exceptionStr(ex);
   }
 }
 
@@ -174,11 +432,31 @@ void SwSwitch::clearWarmBootCache() {
 
 void SwSwitch::init(bool enableTunIntf) {
   lock_guard<mutex> g(hwMutex_);
+  // The HwSwitch may start delivering packets as soon as it is initialized,
+  // so everything handlePacket() uses has to be in place before then.
+  lldpManager_ = folly::make_unique<LldpManager>(this);
+  lacpManager_ = folly::make_unique<LacpManager>(this);
+  packetHandlersFrozen_ = true;
+  if (FLAGS_rx_dispatch) {
+    std::vector<uint32_t> numThreads{
+      1,
+      static_cast<uint32_t>(FLAGS_rx_dispatch_host_threads),
+      1,
+    };
+    rxDispatcher_ = make_unique<RxPacketDispatcher>(
+        [=](unique_ptr<RxPacket> pkt) { this->processPacket(std::move(pkt)); },
+        FLAGS_rx_dispatch_queue_size, numThreads);
+    rxDispatcher_->start();
+  }
+  sflow_->start();
+  bfd_->start();
+
   auto start = std::chrono::steady_clock::now();
   auto stateAndBootType = hw_->init(this);
   auto initialState = stateAndBootType.first;
   bootType_ = stateAndBootType.second;
   auto end = std::chrono::steady_clock::now();
+  BootTimeline::get()->recordPhase("hw_init", start, end);
   auto initDuration =
     std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
   VLOG(0) << "hardware initialized in " <<
@@ -187,17 +465,35 @@ void SwSwitch::init(bool enableTunIntf) {
   // Store the initial state
   initialState->publish();
   setStateInternal(initialState);
+  routeStats_->applyDelta(nullptr, initialState->getRouteTables().get());
 
   if (enableTunIntf) {
-    tunMgr_ = folly::make_unique<TunManager>(this, &backgroundEventBase_);
+    tunMgr_ = folly::make_unique<TunManager>(this, &tunEventBase_);
     tunMgr_->startProbe();
   }
 
   startThreads();
 
+  if (FLAGS_thread_sample_ms > 0) {
+    threadSampler_ = make_unique<ThreadSampler>(
+        milliseconds(FLAGS_thread_sample_ms));
+    runAfterFibSync("thread_sampler", [this] { threadSampler_->start(); });
+  }
+
+  if (FLAGS_update_stall_threshold_ms > 0) {
+    updateWatchdog_ = make_unique<UpdateWatchdog>(
+        milliseconds(FLAGS_update_stall_threshold_ms));
+    updateWatchdog_->start();
+  }
+
+  if (FLAGS_metrics_port > 0) {
+    metricsExporter_ = make_unique<MetricsExporter>(
+        &backgroundEventBase_, FLAGS_metrics_port);
+    runAfterFibSync("metrics", [this] { metricsExporter_->start(); });
+  }
+
   publishBootType();
 
-  lldpManager_ = folly::make_unique<LldpManager>(this);
   setSwitchRunState(SwitchRunState::INITIALIZED);
 }
 
@@ -208,86 +504,405 @@ void SwSwitch::initialConfigApplied() {
   }
   setSwitchRunState(SwitchRunState::CONFIGURED);
   syncTunInterfaces();
-  lldpManager_->start();
+  // Aggregate ports only forward once LACP brings their members up
+  lacpManager_->start();
+  runAfterFibSync("lldp", [this] { lldpManager_->start(); });
+  deferredInit_->startTimeout();
 }
 
 void SwSwitch::fibSynced() {
   setSwitchRunState(SwitchRunState::FIB_SYNCED);
+  deferredInit_->release("FIB synced");
+}
+
+void SwSwitch::runAfterFibSync(folly::StringPiece name,
+                               std::function<void()> task) {
+  deferredInit_->add(name, std::move(task));
 }
 
 void SwSwitch::updateState(unique_ptr<StateUpdate> update) {
+  PacketLatency::recordCurrent(LatencyStage::STATE_UPDATE);
+  if (updateRecorder_) {
+    updateRecorder_->recordStateUpdate(update->getName());
+  }
   // Put the update function on the queue.
-  {
-    folly::SpinLockGuard guard(pendingUpdatesLock_);
-    pendingUpdates_.push_back(*update.release());
+  update->enqueueTime_ = steady_clock::now();
+  StateUpdate* ptr = update.release();
+  numQueuedUpdates_.fetch_add(1, std::memory_order_relaxed);
+  ptr->next_ = newUpdates_.load();
+  while (!newUpdates_.compare_exchange_weak(ptr->next_, ptr)) {
+    // ptr->next_ has been updated to the current head; try again.
   }
 
-  // Signal the background thread that updates are pending.
-  // (We're using backgroundEventBase_ for now because it is convenient.
-  // If in the future we find that this is undesirable for some reason we could
-  // re-organize which tasks get performed in which threads.)
+  // Signal the update thread that updates are pending.
+  //
+  // Only the first update scheduled since the update thread last picked up
+  // newUpdates_ needs to wake it up; the updates pushed after that will be
+  // picked up by the same wakeup.
   //
   // We call runInEventBaseThread() with a static function pointer since this
   // is more efficient than having to allocate a new bound function object.
-  updateEventBase_.runInEventBaseThread(handlePendingUpdatesHelper, this);
+  if (!updatesWakeupPending_.exchange(true)) {
+    updateEventBase_.runInEventBaseThread(handlePendingUpdatesHelper, this);
+  }
 }
 
-void SwSwitch::updateState(StringPiece name, StateUpdateFn fn) {
-  auto update = make_unique<FunctionStateUpdate>(name, std::move(fn));
+void SwSwitch::updateState(StringPiece name, StateUpdateFn fn,
+                           StateUpdatePriority priority) {
+  auto update = make_unique<FunctionStateUpdate>(name, std::move(fn),
+                                                 priority);
   updateState(std::move(update));
 }
 
-void SwSwitch::updateStateBlocking(folly::StringPiece name, StateUpdateFn fn) {
+void SwSwitch::updateStateBlocking(folly::StringPiece name, StateUpdateFn fn,
+                                   StateUpdatePriority priority) {
   BlockingUpdateResult result;
-  auto update = make_unique<BlockingStateUpdate>(name, std::move(fn), &result);
+  auto update = make_unique<BlockingStateUpdate>(name, std::move(fn), &result,
+                                                 priority);
   updateState(std::move(update));
   result.wait();
 }
 
+void SwSwitch::updateStateAsync(folly::StringPiece name, StateUpdateFn fn,
+                                StateUpdateDoneFn done,
+                                StateUpdatePriority priority) {
+  auto update = make_unique<CallbackStateUpdate>(name, std::move(fn),
+                                                 std::move(done), priority);
+  updateState(std::move(update));
+}
+
+bool SwSwitch::isUpdateQueueFull() const {
+  return FLAGS_max_queued_state_updates > 0 &&
+    getNumQueuedUpdates() >=
+      static_cast<uint64_t>(FLAGS_max_queued_state_updates);
+}
+
+void SwSwitch::publishUpdateQueueStats() {
+  auto prefix = SwitchStats::kCounterPrefix + "state_update.";
+  fbData->setCounter(prefix + "queue_depth", getNumQueuedUpdates());
+  int64_t ageMs = 0;
+  auto oldest = oldestQueuedUpdate_.load();
+  if (oldest != 0) {
+    auto age = steady_clock::now() -
+      steady_clock::time_point(steady_clock::duration(oldest));
+    ageMs = std::max<int64_t>(duration_cast<milliseconds>(age).count(), 0);
+  }
+  fbData->setCounter(prefix + "queue_age_ms", ageMs);
+  if (FLAGS_state_update_pipeline_depth > 0) {
+    lock_guard<mutex> g(preparedBatchesLock_);
+    fbData->setCounter(prefix + "prepared_batches", preparedBatches_.size());
+  }
+}
+
+void SwSwitch::publishRouteStats() {
+  routeStats_->publish();
+}
+
+void SwSwitch::publishUnresolvedPuntStats() {
+  puntPolicy_->publish();
+}
+
+void SwSwitch::registerStateObserver(StateObserver* observer,
+                                     folly::EventBase* evb) {
+  auto entry = std::make_shared<StateObserverEntry>(observer, evb);
+  lock_guard<mutex> g(stateObserversLock_);
+  stateObservers_.push_back(std::move(entry));
+}
+
+void SwSwitch::unregisterStateObserver(StateObserver* observer) {
+  shared_ptr<StateObserverEntry> entry;
+  {
+    lock_guard<mutex> g(stateObserversLock_);
+    for (auto iter = stateObservers_.begin(); iter != stateObservers_.end();
+         ++iter) {
+      if ((*iter)->observer == observer) {
+        entry = std::move(*iter);
+        stateObservers_.erase(iter);
+        break;
+      }
+    }
+  }
+  if (!entry) {
+    return;
+  }
+  // Wait for a notification that may be running right now, and make sure
+  // the ones still queued will skip the observer.
+  lock_guard<mutex> g(entry->lock);
+  entry->registered = false;
+}
+
+void SwSwitch::notifyStateObservers(
+    const std::shared_ptr<const StateDelta>& delta) {
+  lock_guard<mutex> g(stateObserversLock_);
+  for (const auto& entry : stateObservers_) {
+    // Capture the delta by shared_ptr so that it, and its states, remain
+    // alive until the observer is done with it.  All the observers share
+    // the changes it collects.
+    auto fn = [entry, delta]() {
+      lock_guard<mutex> g(entry->lock);
+      if (!entry->registered) {
+        return;
+      }
+      try {
+        entry->observer->stateChanged(*delta);
+      } catch (const std::exception& ex) {
+        LOG(FATAL) << "error notifying state observer of state change: " <<
+          folly::exceptionStr(ex);
+      }
+    };
+    if (!entry->evb->runInEventBaseThread(std::move(fn))) {
+      LOG(ERROR) << "failed to schedule state observer notification";
+    }
+  }
+}
+
 void SwSwitch::handlePendingUpdatesHelper(SwSwitch* sw) {
   sw->handlePendingUpdates();
 }
 
+void SwSwitch::takeNewUpdates() {
+  // Clear the wakeup flag before taking the stack.  An update pushed after
+  // this point either makes it into the stack we take below, or sees the
+  // flag cleared and schedules another wakeup.
+  updatesWakeupPending_.store(false);
+  StateUpdate* head = newUpdates_.exchange(nullptr);
+
+  // newUpdates_ is in LIFO order.  Reverse it, so each pendingUpdates_ list
+  // stays in the order the updates were scheduled in.
+  StateUpdate* reversed = nullptr;
+  while (head) {
+    StateUpdate* next = head->next_;
+    head->next_ = reversed;
+    reversed = head;
+    head = next;
+  }
+  while (reversed) {
+    StateUpdate* next = reversed->next_;
+    reversed->next_ = nullptr;
+    auto priority = static_cast<size_t>(reversed->getPriority());
+    pendingUpdates_[priority].push_back(*reversed);
+    ++numPendingUpdates_;
+    reversed = next;
+  }
+}
+
+void SwSwitch::takeUpdateBatch(StateUpdateList* updates) {
+  for (auto& pending : pendingUpdates_) {
+    while (!pending.empty()) {
+      StateUpdate* update = &pending.front();
+      pending.pop_front();
+      updates->push_back(*update);
+      --numPendingUpdates_;
+      if (update->getEndsBatch()) {
+        return;
+      }
+    }
+  }
+}
+
+void SwSwitch::setOldestQueuedUpdate(const StateUpdateList& batch) {
+  auto oldest = steady_clock::time_point::max();
+  // The batch may hold updates of several priority classes, so any of them
+  // may be the oldest.  Each pending list is in the order it was scheduled.
+  for (const auto& update : batch) {
+    oldest = std::min(oldest, update.enqueueTime_);
+  }
+  for (const auto& pending : pendingUpdates_) {
+    if (!pending.empty()) {
+      oldest = std::min(oldest, pending.front().enqueueTime_);
+    }
+  }
+  oldestQueuedUpdate_.store(oldest == steady_clock::time_point::max() ?
+                            0 : oldest.time_since_epoch().count());
+}
+
+bool SwSwitch::deferPendingUpdates() {
+  if (FLAGS_state_update_coalesce_ms <= 0) {
+    return false;
+  }
+
+  size_t maxUpdates = std::max(FLAGS_state_update_coalesce_max, 1);
+  if (numPendingUpdates_ == 0 || numPendingUpdates_ >= maxUpdates) {
+    return false;
+  }
+
+  auto oldest = steady_clock::time_point::max();
+  for (const auto& pending : pendingUpdates_) {
+    if (!pending.empty()) {
+      oldest = std::min(oldest, pending.front().enqueueTime_);
+    }
+  }
+  auto deadline = oldest + milliseconds(FLAGS_state_update_coalesce_ms);
+  auto now = steady_clock::now();
+  if (now >= deadline) {
+    return false;
+  }
+  if (!coalesceTimerScheduled_) {
+    // EventBase timeouts have millisecond granularity; round up so that we
+    // don't wake up just before the deadline.
+    auto delay = duration_cast<milliseconds>(deadline - now).count() + 1;
+    coalesceTimerScheduled_ = true;
+    updateEventBase_.runAfterDelay([this] {
+      coalesceTimerScheduled_ = false;
+      handlePendingUpdates();
+    }, delay);
+  }
+  return true;
+}
+
 void SwSwitch::handlePendingUpdates() {
+  // Hold the updates back for a little while if coalescing is enabled, so
+  // that bursts of small updates (e.g. neighbor entries learned during an
+  // ARP storm) result in a single state change.
+  takeNewUpdates();
+  bool pipelined = FLAGS_state_update_pipeline_depth > 0;
+  if (pipelined) {
+    requeueStaleBatches();
+  }
+  setOldestQueuedUpdate(StateUpdateList());
+  if (deferPendingUpdates()) {
+    return;
+  }
+  if (pipelined) {
+    // Wait for the HW update thread to take a batch if it has enough
+    // prepared ones already.  It wakes us up again when it does.
+    lock_guard<mutex> g(preparedBatchesLock_);
+    if (preparedBatches_.size() >=
+        static_cast<size_t>(FLAGS_state_update_pipeline_depth)) {
+      prepareStalled_ = true;
+      return;
+    }
+  }
+
   // Get the list of updates to run.
   //
-  // We might pull multiple updates off the list at once if several updates
+  // We might pull multiple updates off the lists at once if several updates
   // were scheduled before we had a chance to process them.  In some cases we
   // might also end up finding 0 updates to process if a previous
   // handlePendingUpdates() call processed multiple updates.
-  StateUpdateList updates;
-  {
-    folly::SpinLockGuard guard(pendingUpdatesLock_);
-    pendingUpdates_.swap(updates);
-  }
+  auto batch = make_unique<PreparedBatch>();
+  takeUpdateBatch(&batch->updates);
 
-  // handlePendingUpdates() is invoked once for each update, but a previous
-  // call might have already processed everything.  If we don't have anything
-  // to do just return early.
-  if (updates.empty()) {
+  // A coalescing timer or a redundant wakeup may find that a previous call
+  // already processed everything.  If we don't have anything to do just
+  // return early.
+  if (batch->updates.empty()) {
     return;
   }
 
-  // Call all of the update functions to prepare the new SwitchState
-  auto origState = getState();
-  auto state = origState;
+  // When pipelined, the HW update thread may not have programmed the last
+  // prepared state yet, so the batch goes on top of that instead.
+  batch->origState = (pipelined && lastPreparedState_) ?
+    lastPreparedState_ : getState();
+  prepareBatch(batch.get());
+
+  if (pipelined) {
+    lastPreparedState_ = batch->state;
+    bool stale = false;
+    {
+      lock_guard<mutex> g(preparedBatchesLock_);
+      if (batch->epoch == pipelineEpoch_) {
+        preparedBatches_.push_back(std::move(batch));
+      } else {
+        // A batch it was prepared on top of was rolled back meanwhile
+        staleBatches_.push_back(std::move(batch));
+        stale = true;
+      }
+    }
+    if (stale) {
+      requeueStaleBatches();
+    } else {
+      hwUpdateEventBase_.runInEventBaseThread(programPreparedBatchesHelper,
+                                              this);
+    }
+  } else {
+    programBatch(batch.get());
+  }
+
+  // The batch ended early.  Schedule the rest behind whatever else is
+  // waiting in the event base, rather than applying it right away, so that
+  // new higher priority updates get picked up first.
+  if (numPendingUpdates_ > 0) {
+    updateEventBase_.runInEventBaseThread(handlePendingUpdatesHelper, this);
+  }
+}
+
+void SwSwitch::prepareBatch(PreparedBatch* batch) {
+  // Call all of the update functions to prepare the new SwitchState.  The
+  // nodes they clone come from an arena for this batch; the ones that make
+  // it into the final state keep their slabs alive after the arena is gone.
+  CloneArena arena;
+  CloneArena* batchArena = FLAGS_state_update_arena ? &arena : nullptr;
+  auto& updates = batch->updates;
+  auto& profile = batch->profile;
+  auto state = batch->origState;
+  auto start = steady_clock::now();
+  batch->start = start;
+  batch->epoch = lastPreparedEpoch_;
+  profile.startTime = time(nullptr);
+  uint64_t numUpdates = 0;
+  // The composable updates applied to state since it was last published
+  std::vector<StateUpdate*> composed;
+  auto checkpoint = state;
   auto iter = updates.begin();
   while (iter != updates.end()) {
     StateUpdate* update = &(*iter);
     ++iter;
-
+    ++numUpdates;
+    stats()->stateUpdateQueued(
+        update->getPriority(),
+        duration_cast<microseconds>(start - update->enqueueTime_));
+    // The update may be deleted below, so keep its name
+    std::string name = update->getName();
+
+    bool composable = update->isComposable();
     shared_ptr<SwitchState> newState;
-    VLOG(3) << "preparing state update " << update->getName();
+    VLOG(3) << "preparing state update " << name;
+    auto traceName = EventTrace::isEnabled() ?
+      EventTrace::intern(name) : nullptr;
+    EventTrace::record(EventTrace::Type::UPDATE_START, 0, 0, traceName);
+    bool succeeded = true;
+    auto prepareStart = steady_clock::now();
     try {
+      ThreadSampler::Scope sampleScope(ThreadSampler::intern("update." + name));
+      UpdateWatchdog::Scope watchdogScope(updateWatchdog_.get(), name,
+                                          "prepare", 1);
+      CloneArena::Scope arenaScope(batchArena);
       newState = update->applyUpdate(state);
     } catch (const std::exception& ex) {
+      if (!composed.empty()) {
+        // The update may have changed the unpublished state part way, so
+        // go back to the last published one and redo the updates since
+        state = replayComposedUpdates(checkpoint, composed, batchArena);
+        checkpoint = state;
+        composed.clear();
+      }
       // Call the update's onError() function, and then immediately delete
       // it (therefore removing it from the intrusive list).  This way we won't
       // call it's onSuccess() function later.
       update->onError(ex);
       delete update;
+      numQueuedUpdates_.fetch_sub(1, std::memory_order_relaxed);
+      succeeded = false;
     }
-    if (newState) {
+    auto prepareEnd = steady_clock::now();
+    EventTrace::record(EventTrace::Type::UPDATE_END, succeeded, 0, traceName);
+    if (composable) {
+      if (newState) {
+        // Leave the state unpublished while the next update is composable
+        // too, so that it changes the state in place
+        if (!newState->isPublished()) {
+          composed.push_back(update);
+        }
+        state = newState;
+      }
+      if (!composed.empty() &&
+          (iter == updates.end() || !iter->isComposable())) {
+        state->publish();
+        checkpoint = state;
+        composed.clear();
+      }
+    } else if (newState) {
       // Call publish after applying each StateUpdate.  This guarantees that
       // the next StateUpdate function will have clone the SwitchState before
       // making any changes.  This ensures that if a StateUpdate function ever
@@ -295,19 +910,151 @@ void SwSwitch::handlePendingUpdates() {
       // state, leaving it in an invalid state.
       newState->publish();
       state = newState;
+      checkpoint = state;
+    }
+    auto publishEnd = steady_clock::now();
+
+    recordStage(&profile, name, StateUpdateStage::PREPARE,
+                prepareStart, prepareEnd);
+    recordStage(&profile, name, StateUpdateStage::PUBLISH,
+                prepareEnd, publishEnd);
+    if (std::find(profile.names.begin(), profile.names.end(), name) ==
+        profile.names.end()) {
+      profile.names.push_back(std::move(name));
+    }
+  }
+  stats()->stateUpdateBatch(numUpdates);
+  profile.numUpdates = numUpdates;
+  profile.generation = state->getGeneration();
+  batch->state = std::move(state);
+}
+
+shared_ptr<SwitchState> SwSwitch::replayComposedUpdates(
+    shared_ptr<SwitchState> state, const std::vector<StateUpdate*>& updates,
+    CloneArena* arena) {
+  stats()->stateUpdateReplayed(updates.size());
+  for (auto* update : updates) {
+    VLOG(3) << "reapplying state update " << update->getName();
+    shared_ptr<SwitchState> newState;
+    try {
+      CloneArena::Scope arenaScope(arena);
+      newState = update->applyUpdate(state);
+    } catch (const std::exception& ex) {
+      // It did not fail the first time, but fail it now rather than leave
+      // its onSuccess() to be called with its changes missing
+      update->onError(ex);
+      delete update;
+      numQueuedUpdates_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (newState) {
+      newState->publish();
+      state = std::move(newState);
     }
   }
+  return state;
+}
+
+void SwSwitch::programBatch(PreparedBatch* batch) {
+  auto& updates = batch->updates;
+  auto& profile = batch->profile;
 
   // Now apply the update and notify subscribers
-  if (state != origState) {
-    applyUpdate(origState, state);
+  if (batch->state != batch->origState) {
+    try {
+      applyUpdate(batch->origState, batch->state, &profile);
+    } catch (const FbossHwRolledBackError& ex) {
+      // None of the updates took effect, so they all fail
+      while (!updates.empty()) {
+        unique_ptr<StateUpdate> update(&updates.front());
+        updates.pop_front();
+        update->onError(ex);
+        numQueuedUpdates_.fetch_sub(1, std::memory_order_relaxed);
+      }
+      if (FLAGS_state_update_pipeline_depth > 0) {
+        // The batches prepared after this one started from its state, so
+        // they have to be prepared again
+        {
+          lock_guard<mutex> g(preparedBatchesLock_);
+          ++pipelineEpoch_;
+          for (auto& stale : preparedBatches_) {
+            staleBatches_.push_back(std::move(stale));
+          }
+          preparedBatches_.clear();
+          prepareStalled_ = false;
+        }
+        updateEventBase_.runInEventBaseThread(handlePendingUpdatesHelper,
+                                              this);
+      }
+    }
   }
+  profile.total = duration_cast<microseconds>(
+      steady_clock::now() - batch->start);
+  updateHistory_.record(std::move(profile));
 
   // Notify all of the updates of success, and delete them
   while (!updates.empty()) {
     unique_ptr<StateUpdate> update(&updates.front());
     updates.pop_front();
     update->onSuccess();
+    numQueuedUpdates_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  if (FLAGS_state_update_pipeline_depth == 0) {
+    setOldestQueuedUpdate(StateUpdateList());
+  }
+}
+
+void SwSwitch::programPreparedBatchesHelper(SwSwitch* sw) {
+  sw->programPreparedBatches();
+}
+
+void SwSwitch::programPreparedBatches() {
+  while (true) {
+    unique_ptr<PreparedBatch> batch;
+    bool wakeup = false;
+    {
+      lock_guard<mutex> g(preparedBatchesLock_);
+      if (preparedBatches_.empty()) {
+        return;
+      }
+      batch = std::move(preparedBatches_.front());
+      preparedBatches_.pop_front();
+      wakeup = prepareStalled_;
+      prepareStalled_ = false;
+    }
+    if (wakeup) {
+      updateEventBase_.runInEventBaseThread(handlePendingUpdatesHelper,
+                                            this);
+    }
+    programBatch(batch.get());
+  }
+}
+
+void SwSwitch::requeueStaleBatches() {
+  std::deque<unique_ptr<PreparedBatch>> stale;
+  {
+    lock_guard<mutex> g(preparedBatchesLock_);
+    if (lastPreparedEpoch_ == pipelineEpoch_) {
+      return;
+    }
+    stale.swap(staleBatches_);
+    lastPreparedEpoch_ = pipelineEpoch_;
+  }
+  lastPreparedState_.reset();
+
+  // The stale batches are older than the pending updates, so they go back
+  // in front of them, each in the order it was scheduled in
+  for (auto batch = stale.rbegin(); batch != stale.rend(); ++batch) {
+    auto& updates = (*batch)->updates;
+    while (!updates.empty()) {
+      StateUpdate* update = &updates.back();
+      updates.pop_back();
+      auto priority = static_cast<size_t>(update->getPriority());
+      pendingUpdates_[priority].push_front(*update);
+      ++numPendingUpdates_;
+    }
+  }
+  if (!stale.empty()) {
+    stats()->stateUpdateBatchesRequeued(stale.size());
   }
 }
 
@@ -319,6 +1066,7 @@ void SwSwitch::syncTunInterfaces() {
 
   try {
     tunMgr_->startSync(getState()->getInterfaces());
+    tunMgr_->startRouteSync(getState()->getRouteTables());
   } catch (const std::exception& ex) {
     // TODO: Figure out the best way to handle errors here.
     LOG(FATAL) << "error applying interfaces change to system: " <<
@@ -327,22 +1075,84 @@ void SwSwitch::syncTunInterfaces() {
 }
 
 void SwSwitch::setStateInternal(std::shared_ptr<SwitchState> newState) {
-  // This is one of the only two places that should ever directly access
-  // stateDontUseDirectly_.  (getState() being the other one.)
+  // This is one of the only places that should ever directly access
+  // stateDontUseDirectly_.  (getState() and readState() being the others.)
   CHECK(newState->isPublished());
-  folly::SpinLockGuard guard(stateLock_);
-  stateDontUseDirectly_.swap(newState);
+  stateDontUseDirectly_.store(std::move(newState));
+}
+
+namespace {
+
+uint64_t traceAddress(const folly::IPAddressV4& ip) {
+  return ip.toLongHBO();
+}
+uint64_t traceAddress(const folly::IPAddressV6& ip) {
+  // Only the interface ID fits
+  const auto bytes = ip.toByteArray();
+  uint64_t ret = 0;
+  for (size_t i = 8; i < bytes.size(); ++i) {
+    ret = (ret << 8) | bytes[i];
+  }
+  return ret;
+}
+
+template<typename NeighborDelta>
+void traceNeighbors(const NeighborDelta& delta, VlanID vlan,
+                    EventTrace::Type added, EventTrace::Type removed) {
+  for (const auto& entry : delta) {
+    const auto& newEntry = entry.getNew();
+    if (newEntry && !newEntry->isPending()) {
+      EventTrace::record(added, vlan, traceAddress(newEntry->getIP()));
+    } else if (!newEntry) {
+      EventTrace::record(removed, vlan,
+                         traceAddress(entry.getOld()->getIP()));
+    }
+  }
 }
 
+// The delta's neighbor changes were collected for the HwSwitch already,
+// so walking them again is cheap
+void traceNeighborChanges(const StateDelta& delta) {
+  for (const auto& vlanDelta : delta.getVlansDelta()) {
+    auto vlan = vlanDelta.getOld() ? vlanDelta.getOld()->getID() :
+      vlanDelta.getNew()->getID();
+    traceNeighbors(vlanDelta.getArpDelta(), vlan,
+                   EventTrace::Type::ARP_ADD, EventTrace::Type::ARP_REMOVE);
+    traceNeighbors(vlanDelta.getNdpDelta(), vlan,
+                   EventTrace::Type::NDP_ADD, EventTrace::Type::NDP_REMOVE);
+  }
+}
+
+} // unnamed namespace
+
 void SwSwitch::applyUpdate(const shared_ptr<SwitchState>& oldState,
-                           const shared_ptr<SwitchState>& newState) {
-  DCHECK_EQ(oldState, getState());
+                           const shared_ptr<SwitchState>& newState,
+                           StateUpdateProfile* profile) {
+  // Once exiting, the updates of the batches before this one may have been
+  // dropped
+  DCHECK(oldState == getState() || isExiting());
   auto start = std::chrono::steady_clock::now();
   LOG(INFO) << "Updating state: old_gen=" << oldState->getGeneration() <<
     " new_gen=" << newState->getGeneration();
   DCHECK_GT(newState->getGeneration(), oldState->getGeneration());
-
-  StateDelta delta(oldState, newState);
+  static const auto kApplyActivity = ThreadSampler::intern("update.apply");
+  ThreadSampler::Scope sampleScope(kApplyActivity);
+  // The stages below are for all the updates applied together
+  auto name = profile->getName();
+  auto stageStart = steady_clock::now();
+
+  // The HwSwitch and the StateObservers share the delta, so the changes
+  // are collected only once
+  auto sharedDelta = std::make_shared<const StateDelta>(oldState, newState);
+  const auto& delta = *sharedDelta;
+  UpdateWatchdog::Scope watchdogScope(updateWatchdog_.get(), name, "program",
+                                      profile->numUpdates, sharedDelta);
+  auto traceName = EventTrace::isEnabled() ?
+    EventTrace::intern(name) : nullptr;
+  EventTrace::record(EventTrace::Type::PROGRAM_START, profile->numUpdates,
+                     newState->getGeneration(), traceName);
+  stageStart = recordStage(profile, name, StateUpdateStage::DELTA,
+                           stageStart, steady_clock::now());
 
   // Hold the hwMutex_ wihle applying the updates.
   // We are currently holding this for a bit longer than necessary, just to
@@ -350,6 +1160,8 @@ void SwSwitch::applyUpdate(const shared_ptr<SwitchState>& oldState,
   // HwSwitch::stateChanged()  (or eventually just make
   // HwSwitch::stateChanged() responsible for providing its own locking).
   lock_guard<mutex> hwGuard(hwMutex_);
+  stageStart = recordStage(profile, name, StateUpdateStage::HW_LOCK,
+                           stageStart, steady_clock::now());
 
   // If we are already exiting, abort the update
   if (isExiting()) {
@@ -359,13 +1171,11 @@ void SwSwitch::applyUpdate(const shared_ptr<SwitchState>& oldState,
   // Publish the configuration as our active state.
   setStateInternal(newState);
 
-  // Inform the IPv6Handler of the change.
-  // TODO: We need a more generic mechanism for listeners to register to
-  // receive state change events.
-  ipv6_->stateChanged(delta);
-
-  // Inform the NeighborUpdater of the change.
-  nUpdater_->stateChanged(delta);
+  // Inform the StateObservers of the change.  They process it in their own
+  // threads while we program the hardware below.
+  notifyStateObservers(sharedDelta);
+  stageStart = recordStage(profile, name, StateUpdateStage::OBSERVERS,
+                           stageStart, steady_clock::now());
 
   // sync the new interface info to the host
   if (isConfigured()) {
@@ -384,12 +1194,13 @@ void SwSwitch::applyUpdate(const shared_ptr<SwitchState>& oldState,
     // secondaries as well leading to errors, t4746261 is tracking this.
     syncTunInterfaces();
   }
+  stageStart = recordStage(profile, name, StateUpdateStage::TUN_SYNC,
+                           stageStart, steady_clock::now());
 
   // Inform the HwSwitch of the change.
   //
-  // Note that at this point we have already updated the state pointer and
-  // released stateLock_, so the new state is already published and visible to
-  // other threads.  This does mean that there is a window where the new state
+  // Note that at this point we have already updated the state pointer, so
+  // the new state is already published and visible to other threads.  This does mean that there is a window where the new state
   // is visible but the hardware is not using the new configuration yet.
   //
   // We could avoid this by holding a lock and block anyone from reading the
@@ -399,6 +1210,20 @@ void SwSwitch::applyUpdate(const shared_ptr<SwitchState>& oldState,
   // major issues.
   try {
     hw_->stateChanged(delta);
+  } catch (const FbossHwRolledBackError& ex) {
+    // The hardware is back at the old state, so go back to it as well, and
+    // fail the updates instead of the agent.
+    LOG(ERROR) << "error applying state change to hardware, rolled back to "
+      << "generation " << oldState->getGeneration() << ": "
+      << folly::exceptionStr(ex);
+    setStateInternal(oldState);
+    notifyStateObservers(
+        std::make_shared<const StateDelta>(newState, oldState));
+    if (isConfigured()) {
+      syncTunInterfaces();
+    }
+    stats()->stateUpdateRolledBack();
+    throw;
   } catch (const std::exception& ex) {
     // Notify the hw_ of the crash so it can execute any device specific
     // tasks before we fatal. An example would be to dump the current hw state.
@@ -409,11 +1234,73 @@ void SwSwitch::applyUpdate(const shared_ptr<SwitchState>& oldState,
       folly::exceptionStr(ex);
   }
 
+  if (EventTrace::isEnabled()) {
+    traceNeighborChanges(delta);
+  }
+
+  // Packets held for next hops this update resolved can be routed now
+  holdQueue_->stateApplied(delta);
+
+  if (oldState->getRouteTables() != newState->getRouteTables()) {
+    routeStats_->applyDelta(oldState->getRouteTables().get(),
+                            newState->getRouteTables().get());
+  }
+
   auto end = std::chrono::steady_clock::now();
+  recordStage(profile, name, StateUpdateStage::HW, stageStart, end);
   auto duration =
     std::chrono::duration_cast<std::chrono::microseconds>(end - start);
   stats()->stateUpdate(duration);
+  EventTrace::record(EventTrace::Type::PROGRAM_END, profile->numUpdates,
+                     newState->getGeneration(), traceName);
   VLOG(0) << "Update state took " << duration.count() << "us";
+
+  updateStateMemoryStats(oldState, newState);
+}
+
+steady_clock::time_point SwSwitch::recordStage(
+    StateUpdateProfile* profile, folly::StringPiece name,
+    StateUpdateStage stage, steady_clock::time_point start,
+    steady_clock::time_point end) {
+  auto us = duration_cast<microseconds>(end - start);
+  profile->addStage(stage, us);
+  stats()->stateUpdateStage(name, stage, us);
+  return end;
+}
+
+void SwSwitch::updateStateMemoryStats(const shared_ptr<SwitchState>& oldState,
+                                      const shared_ptr<SwitchState>& newState) {
+  if (FLAGS_state_memory_stats_interval <= 0) {
+    return;
+  }
+  auto now = steady_clock::now();
+  if (stateMemoryStatsTime_ != steady_clock::time_point() &&
+      now - stateMemoryStatsTime_ <
+        std::chrono::seconds(FLAGS_state_memory_stats_interval)) {
+    return;
+  }
+  stateMemoryStatsTime_ = now;
+
+  StateMemoryStats memStats(newState.get(), oldState.get());
+  auto publish = [](const string& name, const StateMemoryStats::Usage& usage) {
+    auto prefix = SwitchStats::kCounterPrefix + "state_memory." + name;
+    fbData->setCounter(prefix + ".nodes", usage.nodes);
+    fbData->setCounter(prefix + ".bytes", usage.bytes);
+    fbData->setCounter(prefix + ".shared_nodes", usage.sharedNodes);
+    fbData->setCounter(prefix + ".shared_bytes", usage.sharedBytes);
+  };
+  publish("total", memStats.getTotal());
+  for (const auto& entry : memStats.getSubtrees()) {
+    publish(entry.first, entry.second);
+  }
+
+  lock_guard<mutex> guard(stateMemoryStatsLock_);
+  stateMemoryStats_ = std::move(memStats);
+}
+
+StateMemoryStats SwSwitch::getStateMemoryStats() const {
+  lock_guard<mutex> guard(stateMemoryStatsLock_);
+  return stateMemoryStats_;
 }
 
 PortStats* SwSwitch::portStats(PortID portID) {
@@ -440,14 +1327,12 @@ SfpModule* SwSwitch::getSfp(PortID portID) const {
   return sfpMap_->sfpModule(portID);
 }
 
-map<int32_t, SfpDom> SwSwitch::getSfpDoms() const {
-  map<int32_t, SfpDom> domInfos;
+void SwSwitch::getSfpDoms(map<int32_t, SfpDom>& domInfos) const {
+  // The SfpMap is sorted by port, so every entry is inserted at the end
   for (const auto& sfp : *sfpMap_) {
-    SfpDom domInfo;
-    sfp.second->getSfpDom(domInfo);
-    domInfos[sfp.first] = domInfo;
+    auto it = domInfos.emplace_hint(domInfos.end(), sfp.first, SfpDom());
+    sfp.second->getSfpDom(it->second);
   }
-  return domInfos;
 }
 
 SfpDom SwSwitch::getSfpDom(PortID port) const {
@@ -462,16 +1347,18 @@ void SwSwitch::createSfp(PortID portID, std::unique_ptr<SfpImpl>& sfpImpl) {
   sfpMap_->createSfp(portID, sfpModule);
 }
 
+void SwSwitch::createQsfp(PortID portID, std::unique_ptr<SfpImpl>& sfpImpl) {
+  std::unique_ptr<SfpModule> sfpModule =
+                            folly::make_unique<QsfpModule>(sfpImpl);
+  sfpMap_->createSfp(portID, sfpModule);
+}
+
 void SwSwitch::detectSfp() {
-  for (auto it = sfpMap_->begin(); it != sfpMap_->end(); ++it) {
-    it->second.get()->detectSfp();
-  }
+  sfpPoller_->detectSfps();
 }
 
 void SwSwitch::updateSfpDomFields() {
-  for (auto it = sfpMap_->begin(); it != sfpMap_->end(); it++) {
-    it->second.get()->updateSfpDomFields();
-  }
+  sfpPoller_->updateSfpDomFields();
 }
 
 SwitchStats* SwSwitch::createSwitchStats() {
@@ -481,6 +1368,28 @@ SwitchStats* SwSwitch::createSwitchStats() {
 }
 
 void SwSwitch::packetReceived(std::unique_ptr<RxPacket> pkt) noexcept{
+  // This is called on the HwSwitch's RX thread, which we did not create
+  ThreadSampler::registerThread("sdk_rx");
+  EventTrace::countRxPacket();
+  // Sampled packets are only exported, never handled
+  if (pkt->isSampled()) {
+    sflow_->packetSampled(pkt.get());
+    return;
+  }
+  if (updateRecorder_) {
+    updateRecorder_->recordPacket(pkt.get());
+  }
+  if (rxDispatcher_) {
+    auto cls = RxPacketDispatcher::classify(pkt.get());
+    if (!rxDispatcher_->dispatch(cls, std::move(pkt))) {
+      stats()->pktDispatchDropped(cls);
+    }
+    return;
+  }
+  processPacket(std::move(pkt));
+}
+
+void SwSwitch::processPacket(std::unique_ptr<RxPacket> pkt) noexcept {
   PortID port = pkt->getSrcPort();
   try {
     handlePacket(std::move(pkt));
@@ -488,6 +1397,7 @@ void SwSwitch::packetReceived(std::unique_ptr<RxPacket> pkt) noexcept{
     stats()->port(port)->pktError();
     LOG(ERROR) << "error processing trapped packet: " <<
       folly::exceptionStr(ex);
+    pcapMgr_->triggerFlightRecorderDump("pkt_error");
     // Return normally, without letting the exception propagate to our caller.
     return;
   }
@@ -500,8 +1410,12 @@ void SwSwitch::handlePacket(std::unique_ptr<RxPacket> pkt) {
   if (isExiting()) {
     return;
   }
+  // Look up this thread's counters once, rather than for every counter
+  // bumped along the way
+  SwitchStats* switchStats = stats();
   PortID port = pkt->getSrcPort();
-  stats()->port(port)->trappedPkt();
+  PortStats* portStats = switchStats->port(port);
+  portStats->trappedPkt();
 
   pcapMgr_->packetReceived(pkt.get());
 
@@ -509,7 +1423,7 @@ void SwSwitch::handlePacket(std::unique_ptr<RxPacket> pkt) {
   // Abort processing early if the packet is too short.
   auto len = pkt->getLength();
   if (len < 64) {
-    stats()->port(port)->pktBogus();
+    portStats->pktBogus();
     return;
   }
 
@@ -523,17 +1437,25 @@ void SwSwitch::handlePacket(std::unique_ptr<RxPacket> pkt) {
     c += 2; // Advance over the VLAN tag.  We ignore it for now
     ethertype = c.readBE<uint16_t>();
   }
+  PacketLatency::HandlerScope traceScope(pkt.get(), ethertype);
+  static const auto kDispatchActivity = ThreadSampler::intern("rx.dispatch");
+  ThreadSampler::Scope sampleScope(kDispatchActivity);
+
+  if (trapProfiler_) {
+    auto proto = TrappedPacketProfiler::classify(ethertype, c);
+    portStats->trappedPktSize(proto, len);
+    trapProfiler_->packetTrapped(port, srcMac, ethertype, proto, c, len);
+  }
 
-  if (ethertype == 0x27 || ethertype == 0x88cc) {
-    // Ignore CDP and LLDP packets for now.
-    // This is mainly to prevent debug logs about them during development.
-    stats()->port(port)->pktUnhandled();
-    if (ethertype == 0x88cc) {
-        // log the LLDP PDU here.
-        VLOG(5) << "Received a LLDP packet with src mac " << srcMac;
+  if (rxPolicer_) {
+    auto cls = RxPacketPolicer::classify(ethertype, c);
+    if (!rxPolicer_->admit(port, cls)) {
+      portStats->pktPolicerDropped(cls);
+      return;
     }
-    return;
+    portStats->pktPolicerAccepted(cls);
   }
+
   VLOG(5) << "trapped packet: src_port=" << pkt->getSrcPort() <<
     " vlan=" << pkt->getSrcVlan() <<
     " length=" << len <<
@@ -541,29 +1463,113 @@ void SwSwitch::handlePacket(std::unique_ptr<RxPacket> pkt) {
     " dst=" << dstMac <<
     " ethertype=0x" << std::hex << ethertype;
 
-  switch (ethertype) {
-  case ArpHandler::ETHERTYPE_ARP:
-    arp_->handlePacket(std::move(pkt), dstMac, srcMac, c);
-    return;
-  case IPv4Handler::ETHERTYPE_IPV4:
-    ipv4_->handlePacket(std::move(pkt), dstMac, srcMac, c);
-    return;
-  case IPv6Handler::ETHERTYPE_IPV6:
-    ipv6_->handlePacket(std::move(pkt), dstMac, srcMac, c);
+  auto it = packetHandlers_.find(ethertype);
+  if (it == packetHandlers_.end()) {
+    // We don't know what to do with this packet.
+    // Increment a counter and just drop the packet on the floor.
+    portStats->pktUnhandled();
     return;
-  default:
-    break;
   }
+  const auto& entry = it->second;
+  switchStats->pktEthertype(entry.index, entry.name);
+  ThreadSampler::Scope handlerScope(entry.activity);
+  entry.handler(std::move(pkt), dstMac, srcMac, c, portStats);
+}
 
-  // TODO: Handle other packet types.
+void SwSwitch::registerPacketHandler(uint16_t ethertype, StringPiece name,
+                                     PacketHandler handler) {
+  if (packetHandlersFrozen_) {
+    throw FbossError("cannot register the ", name, " handler for ethertype ",
+                     ethertype, " after the switch is initialized");
+  }
+  uint32_t index = packetHandlers_.size();
+  auto ret = packetHandlers_.emplace(
+      ethertype, PacketHandlerEntry(index, name, std::move(handler),
+                                    ThreadSampler::intern("rx." + name.str())));
+  if (!ret.second) {
+    throw FbossError("cannot register the ", name, " handler for ethertype ",
+                     ethertype, ", it already has a handler");
+  }
+}
 
-  // If we are still here, we don't know what to do with this packet.
-  // Increment a counter and just drop the packet on the floor.
-  stats()->port(port)->pktUnhandled();
+void SwSwitch::registerDefaultPacketHandlers() {
+  registerPacketHandler(ArpHandler::ETHERTYPE_ARP, "arp",
+      [=](unique_ptr<RxPacket> pkt, MacAddress dst, MacAddress src,
+          Cursor c, PortStats* portStats) {
+        arp_->handlePacket(std::move(pkt), dst, src, c, portStats);
+      });
+  registerPacketHandler(IPv4Handler::ETHERTYPE_IPV4, "ipv4",
+      [=](unique_ptr<RxPacket> pkt, MacAddress dst, MacAddress src,
+          Cursor c, PortStats* portStats) {
+        ipv4_->handlePacket(std::move(pkt), dst, src, c, portStats);
+      });
+  registerPacketHandler(IPv6Handler::ETHERTYPE_IPV6, "ipv6",
+      [=](unique_ptr<RxPacket> pkt, MacAddress dst, MacAddress src,
+          Cursor c, PortStats* portStats) {
+        ipv6_->handlePacket(std::move(pkt), dst, src, c, portStats);
+      });
+  registerPacketHandler(LldpManager::ETHERTYPE_LLDP, "lldp",
+      [=](unique_ptr<RxPacket> pkt, MacAddress dst, MacAddress src,
+          Cursor c, PortStats* portStats) {
+        lldpManager_->handlePacket(std::move(pkt), dst, src, c, portStats);
+      });
+  registerPacketHandler(LacpManager::ETHERTYPE_SLOW_PROTOCOLS, "lacp",
+      [=](unique_ptr<RxPacket> pkt, MacAddress dst, MacAddress src,
+          Cursor c, PortStats* portStats) {
+        lacpManager_->handlePacket(std::move(pkt), dst, src, c, portStats);
+      });
+  // CDP frames are identified by their length field rather than an
+  // ethertype.  We don't process them, but count them separately so they
+  // don't look like unknown traffic.  With dropUnhandledControlFrames set
+  // in the config they are dropped in hardware and never get here.
+  registerPacketHandler(0x27, "cdp",
+      [=](unique_ptr<RxPacket> pkt, MacAddress dst, MacAddress src,
+          Cursor c, PortStats* portStats) {
+        portStats->pktUnhandled();
+      });
 }
 
 void SwSwitch::linkStateChanged(PortID port, bool up) noexcept {
-  LOG(INFO) << "link state changed on port " << port << ": status=" << up;
+  VLOG(2) << "linkscan event on port " << port << ": status=" << up;
+  EventTrace::record(up ? EventTrace::Type::LINK_UP :
+                     EventTrace::Type::LINK_DOWN, port);
+  if (isExiting()) {
+    return;
+  }
+  linkDebouncer_->linkStateChanged(port, up);
+}
+
+void SwSwitch::l2LearningUpdateReceived(VlanID vlan, MacAddress mac,
+                                        PortID port,
+                                        L2EntryUpdateType type) noexcept {
+  if (isExiting()) {
+    return;
+  }
+  if (!l2Learning_->add(vlan, mac, port, type)) {
+    return;
+  }
+  // The events that arrive until the update runs are applied with it
+  auto* queue = l2Learning_.get();
+  auto* sw = this;
+  updateState("apply L2 learning events",
+              [queue, sw](const shared_ptr<SwitchState>& state) {
+                uint64_t rejected = 0;
+                auto newState = queue->applyUpdates(state, &rejected);
+                sw->stats()->l2UpdatesDropped(queue->getAndClearDropped());
+                if (rejected > 0) {
+                  sw->stats()->l2LearnRejected(rejected);
+                }
+                return newState;
+              },
+              StateUpdatePriority::HOUSEKEEPING);
+}
+
+void SwSwitch::linkStatesChanged(
+    const LinkStateDebouncer::LinkChanges& changes) {
+  for (const auto& change : changes) {
+    LOG(INFO) << "link state changed on port " << change.first
+              << ": status=" << change.second;
+  }
 }
 
 void SwSwitch::startThreads() {
@@ -571,6 +1577,12 @@ void SwSwitch::startThreads() {
       this->threadLoop("fbossBgThread", &backgroundEventBase_); }));
   updateThread_.reset(new std::thread([=] {
       this->threadLoop("fbossUpdateThread", &updateEventBase_); }));
+  if (FLAGS_state_update_pipeline_depth > 0) {
+    hwUpdateThread_.reset(new std::thread([=] {
+        this->threadLoop("fbossHwUpdThread", &hwUpdateEventBase_); }));
+  }
+  tunThread_.reset(new std::thread([=] {
+      this->threadLoop("fbossTunThread", &tunEventBase_); }));
 }
 
 void SwSwitch::stopThreads() {
@@ -593,12 +1605,24 @@ void SwSwitch::stopThreads() {
   if (updateThread_) {
     updateEventBase_.runInEventBaseThread(stopThread, &updateEventBase_);
   }
+  if (tunThread_) {
+    tunEventBase_.runInEventBaseThread(stopThread, &tunEventBase_);
+  }
   if (backgroundThread_) {
     backgroundThread_->join();
   }
   if (updateThread_) {
     updateThread_->join();
   }
+  // The update thread hands batches to the HW update thread, so stop it
+  // once the update thread is done
+  if (hwUpdateThread_) {
+    hwUpdateEventBase_.runInEventBaseThread(stopThread, &hwUpdateEventBase_);
+    hwUpdateThread_->join();
+  }
+  if (tunThread_) {
+    tunThread_->join();
+  }
 }
 
 void SwSwitch::threadLoop(StringPiece name, EventBase* eventBase) {
@@ -610,6 +1634,7 @@ void SwSwitch::threadLoop(StringPiece name, EventBase* eventBase) {
   memcpy(pthreadName, name.begin(), pthreadLength);
   pthreadName[pthreadLength] = '\0';
   pthread_setname_np(pthread_self(), pthreadName);
+  ThreadSampler::registerThread(name);
 
 #ifdef FACEBOOK
   // Set the name for glog
@@ -638,7 +1663,9 @@ std::unique_ptr<TxPacket> SwSwitch::allocateL3TxPacket(uint32_t l3Len) {
 
 void SwSwitch::sendPacketOutOfPort(std::unique_ptr<TxPacket> pkt,
                                    PortID portID) noexcept {
+  PacketLatency::tagCurrent(pkt.get());
   pcapMgr_->packetSent(pkt.get());
+  EventTrace::countTxPackets();
   if (!hw_->sendPacketOutOfPort(std::move(pkt), portID)) {
     // Just log an error for now.  There's not much the caller can do about
     // send failures--even on successful return from sendPacket*() the
@@ -649,7 +1676,9 @@ void SwSwitch::sendPacketOutOfPort(std::unique_ptr<TxPacket> pkt,
 }
 
 void SwSwitch::sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept {
+  PacketLatency::tagCurrent(pkt.get());
   pcapMgr_->packetSent(pkt.get());
+  EventTrace::countTxPackets();
   if (!hw_->sendPacketSwitched(std::move(pkt))) {
     // Just log an error for now.  There's not much the caller can do about
     // send failures--even on successful return from sendPacketSwitched() the
@@ -659,8 +1688,74 @@ void SwSwitch::sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept {
   }
 }
 
+void SwSwitch::sendPacketsSwitched(
+    std::vector<std::unique_ptr<TxPacket>> pkts) noexcept {
+  if (pkts.empty()) {
+    return;
+  }
+  for (const auto& pkt : pkts) {
+    PacketLatency::tagCurrent(pkt.get());
+    pcapMgr_->packetSent(pkt.get());
+  }
+  auto numPkts = pkts.size();
+  auto numSent = hw_->sendPacketsSwitched(std::move(pkts));
+  EventTrace::countTxPackets(numSent);
+  if (numSent != numPkts) {
+    LOG(ERROR) << "failed to send " << (numPkts - numSent) << " of "
+               << numPkts << " L2 switched packets";
+  }
+}
+
+void SwSwitch::sendPacketsOutOfPort(
+    std::vector<std::pair<std::unique_ptr<TxPacket>, PortID>> pkts) noexcept {
+  if (pkts.empty()) {
+    return;
+  }
+  for (const auto& pkt : pkts) {
+    PacketLatency::tagCurrent(pkt.first.get());
+    pcapMgr_->packetSent(pkt.first.get());
+  }
+  auto numPkts = pkts.size();
+  auto numSent = hw_->sendPacketsOutOfPort(std::move(pkts));
+  EventTrace::countTxPackets(numSent);
+  if (numSent != numPkts) {
+    LOG(ERROR) << "failed to send " << (numPkts - numSent) << " of "
+               << numPkts << " packets out of their ports";
+  }
+}
+
 void SwSwitch::sendL3Packet(
     RouterID rid, std::unique_ptr<TxPacket> pkt) noexcept {
+  const uint32_t l3Len = pkt->buf()->length();
+  if (!prepareL3Packet(pkt.get())) {
+    return;
+  }
+  pcapMgr_->packetSent(pkt.get());
+  EventTrace::countTxPackets();
+  hw_->sendPacketSwitched(std::move(pkt));
+  stats()->pktFromHost(l3Len);
+}
+
+void SwSwitch::sendL3Packets(
+    RouterID rid, std::vector<std::unique_ptr<TxPacket>> pkts) noexcept {
+  std::vector<std::unique_ptr<TxPacket>> prepared;
+  prepared.reserve(pkts.size());
+  for (auto& pkt : pkts) {
+    const uint32_t l3Len = pkt->buf()->length();
+    if (!prepareL3Packet(pkt.get())) {
+      continue;
+    }
+    pcapMgr_->packetSent(pkt.get());
+    stats()->pktFromHost(l3Len);
+    prepared.push_back(std::move(pkt));
+  }
+  if (!prepared.empty()) {
+    EventTrace::countTxPackets(prepared.size());
+    hw_->sendPacketsSwitched(std::move(prepared));
+  }
+}
+
+bool SwSwitch::prepareL3Packet(TxPacket* pkt) noexcept {
   folly::IOBuf *buf = pkt->buf();
   CHECK(!buf->isShared());
   // make sure the packet has enough headroom for L2 header and large enough
@@ -674,7 +1769,7 @@ void SwSwitch::sendL3Packet(
                << " required=" << l2Len
                << ", tailroom=" << buf->tailroom()
                << " required=" << tailRoom;
-    return;
+    return false;
   }
   uint16_t protocol;
   // we just need to read the first byte so that we know if it is v4 or v6
@@ -712,12 +1807,11 @@ void SwSwitch::sendL3Packet(
     // originated from the host. Because of that, we are just going to send
     // the packet out to the HW. The HW will drop the packet if the vlan is
     // deleted.
-    pcapMgr_->packetSent(pkt.get());
-    hw_->sendPacketSwitched(std::move(pkt));
-    stats()->pktFromHost(l3Len);
+    return true;
   } catch (const std::exception& ex) {
     LOG(ERROR) << "Failed to send out L3 packet :"
                << folly::exceptionStr(ex);
+    return false;
   }
 }
 
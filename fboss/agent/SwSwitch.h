@@ -10,37 +10,74 @@
 #pragma once
 
 #include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/LinkStateDebouncer.h"
+#include "fboss/agent/StateUpdateProfile.h"
+#include "fboss/agent/state/StateMemoryStats.h"
 #include "fboss/agent/state/StateUpdate.h"
 #include "fboss/agent/types.h"
+#include "fboss/agent/NeighborAnnouncer.h"
 #include "fboss/agent/NeighborUpdater.h"
+#include "fboss/agent/ReadMostlyPtr.h"
+#include "fboss/agent/StateChangeWatcher.h"
 #include <folly/SpinLock.h>
 #include <folly/IntrusiveList.h>
 #include <folly/Range.h>
 #include <folly/ThreadLocal.h>
 #include <folly/io/async/EventBase.h>
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace folly { namespace io {
+class Cursor;
+}}
 
 namespace facebook { namespace fboss {
 
 class ArpHandler;
+class BfdManager;
+class CloneArena;
+class DHCPRelayCache;
+class DeferredInit;
 class IPv4Handler;
 class IPv6Handler;
+class L2LearningQueue;
+class PeriodicTransmitter;
 class PktCaptureManager;
 class Platform;
 class Port;
 class PortStats;
 class RxPacket;
+class RxPacketDispatcher;
+class RxPacketPolicer;
+class SflowExporter;
 class SwitchState;
 class SwitchStats;
+class ThreadSampler;
+class TrappedPacketProfiler;
 class TunManager;
+class UpdateRecorder;
+class UpdateWatchdog;
+class SfpDomPoller;
 class SfpModule;
 class SfpMap;
 class SfpImpl;
+class LacpManager;
 class LldpManager;
+class MetricsExporter;
+class NeighborHoldQueue;
+class RouteStats;
+class StateCheckpointer;
+class StateObserver;
+class UnresolvedPuntPolicy;
 
 
 /*
@@ -69,6 +106,20 @@ class SwSwitch : public HwSwitch::Callback {
   typedef std::function<
     std::shared_ptr<SwitchState>(const std::shared_ptr<SwitchState>&)>
     StateUpdateFn;
+  typedef std::function<void(const std::exception_ptr&)> StateUpdateDoneFn;
+  /*
+   * A handler for trapped packets of one ethertype.  The cursor points just
+   * past the ethertype (and past the VLAN tag, if there is one).
+   *
+   * portStats is the calling thread's PortStats for the ingress port, looked
+   * up once by handlePacket(), so handlers can count without looking it up
+   * again for every counter.
+   */
+  typedef std::function<void(std::unique_ptr<RxPacket> pkt,
+                             folly::MacAddress dst,
+                             folly::MacAddress src,
+                             folly::io::Cursor cursor,
+                             PortStats* portStats)> PacketHandler;
 
   explicit SwSwitch(std::unique_ptr<Platform> platform);
   virtual ~SwSwitch();
@@ -127,8 +178,23 @@ class SwSwitch : public HwSwitch::Callback {
    * semantics of SwitchState.
    */
   std::shared_ptr<SwitchState> getState() const {
-    folly::SpinLockGuard guard(stateLock_);
-    return stateDontUseDirectly_;
+    return stateDontUseDirectly_.load();
+  }
+
+  typedef ReadMostlyPtr<SwitchState>::Reader StateReader;
+
+  /*
+   * Get a view of the current switch state for the calling thread.
+   *
+   * This is for hot paths like packet handling, which read the state for
+   * every packet.  Unlike getState(), it takes no lock and does not copy the
+   * shared_ptr, so threads reading the state concurrently don't contend on
+   * its reference count.  The reader must stay on the calling thread, and
+   * should not outlive the work it was created for, since it keeps the
+   * state alive.  See ReadMostlyPtr for details.
+   */
+  StateReader readState() const {
+    return StateReader(stateDontUseDirectly_);
   }
 
   /**
@@ -145,6 +211,8 @@ class SwSwitch : public HwSwitch::Callback {
    * @param name  A name to identify the source of this update.  This is
    *              primarily used for logging and debugging purposes.
    * @param fn    The function that will prepare the new SwitchState.
+   * @param priority  The priority class of the update.  Pending updates of
+   *              a higher class are applied first.
    *
    * The StateUpdateFn takes a single argument -- the current SwitchState
    * object to modify.  It should return a new SwitchState object, or null if
@@ -164,7 +232,10 @@ class SwSwitch : public HwSwitch::Callback {
    * subscribers.  Therefore the StateUpdateFn may be called with an
    * unpublished SwitchState in some cases.
    */
-  void updateState(folly::StringPiece name, StateUpdateFn fn);
+  void updateState(
+      folly::StringPiece name,
+      StateUpdateFn fn,
+      StateUpdatePriority priority = StateUpdatePriority::CONFIG);
 
   /*
    * A version of updateState() that doesn't return until the update has been
@@ -180,7 +251,83 @@ class SwSwitch : public HwSwitch::Callback {
    * thread, and would simply block the calling thread until the operation
    * completes.
    */
-  void updateStateBlocking(folly::StringPiece name, StateUpdateFn fn);
+  void updateStateBlocking(
+      folly::StringPiece name,
+      StateUpdateFn fn,
+      StateUpdatePriority priority = StateUpdatePriority::CONFIG);
+
+  /*
+   * A version of updateState() that calls done() once the update has been
+   * applied, instead of blocking until then.
+   *
+   * done() is called in the update thread, after the HwSwitch has been
+   * programmed, with a null exception_ptr on success or with the exception
+   * thrown by the update function.  Unlike with updateState(), the update
+   * function may throw, and done() must not block.  Updates scheduled
+   * together are still batched into a single state change.
+   */
+  void updateStateAsync(
+      folly::StringPiece name,
+      StateUpdateFn fn,
+      StateUpdateDoneFn done,
+      StateUpdatePriority priority = StateUpdatePriority::CONFIG);
+
+  /*
+   * Register an observer to be notified of every state change.
+   *
+   * The observer's stateChanged() is invoked in the thread running the given
+   * EventBase, concurrently with the HwSwitch programming the change.  Only
+   * the HwSwitch update happens on the state update thread.
+   *
+   * This may be called from any thread.
+   */
+  void registerStateObserver(StateObserver* observer, folly::EventBase* evb);
+
+  /*
+   * The number of state updates scheduled that have not been applied yet.
+   */
+  uint64_t getNumQueuedUpdates() const {
+    return numQueuedUpdates_.load(std::memory_order_relaxed);
+  }
+
+  /*
+   * Whether --max_queued_state_updates updates are queued already.  Callers
+   * that can push back on their clients, like the route thrift APIs, should
+   * turn new updates away until there is room again.
+   */
+  bool isUpdateQueueFull() const;
+
+  /*
+   * Publish the state update queue depth, and how long the oldest queued
+   * update has been waiting, as counters.  This can be called from any
+   * thread.
+   */
+  void publishUpdateQueueStats();
+
+  /*
+   * Publish the route counts of each VRF, which are kept up to date by the
+   * state updates, as counters.  This can be called from any thread.
+   */
+  void publishRouteStats();
+
+  /*
+   * Publish the counters of the UnresolvedPuntPolicy.  This can be called
+   * from any thread.
+   */
+  void publishUnresolvedPuntStats();
+
+  RouteStats* getRouteStats() {
+    return routeStats_.get();
+  }
+
+  /*
+   * Unregister an observer.  This is a no-op if it is not registered.
+   *
+   * Once this returns the observer will not be called again, and may be
+   * destroyed.  This must not be called from the observer's stateChanged(),
+   * since it waits for any notification already in progress to finish.
+   */
+  void unregisterStateObserver(StateObserver* observer);
 
   /*
    * Signal to the switch that initial config is applied.
@@ -195,6 +342,12 @@ class SwSwitch : public HwSwitch::Callback {
    */
   void initialConfigApplied();
   void fibSynced();
+  /*
+   * Run a part of startup that forwarding doesn't depend on once the FIB
+   * is first synced, so it doesn't slow down the programming of the
+   * initial routes.  See DeferredInit.
+   */
+  void runAfterFibSync(folly::StringPiece name, std::function<void()> task);
   /*
    * Publish all thread-local stats to the main fbData singleton,
    * so they will be visible via fb303 thrift calls.
@@ -236,6 +389,24 @@ class SwSwitch : public HwSwitch::Callback {
    */
   PortStatus getPortStatus(PortID port);
 
+  /*
+   * Get the approximate memory used by the SwitchState.
+   *
+   * This is computed on the update thread after a state update is applied,
+   * at most once every --state_memory_stats_interval seconds, so it may lag
+   * behind the current state.  Shared nodes are counted relative to the
+   * state generation that preceded it.
+   */
+  StateMemoryStats getStateMemoryStats() const;
+
+  /*
+   * Get the profiles of up to count of the slowest recent state updates,
+   * slowest first.  The last --state_update_history updates are kept.
+   */
+  std::vector<StateUpdateProfile> getSlowestStateUpdates(size_t count) const {
+    return updateHistory_.getSlowest(count);
+  }
+
   /*
    * Get the Sfp for the specified port.
    */
@@ -243,8 +414,11 @@ class SwSwitch : public HwSwitch::Callback {
 
   /*
    * Get SfpDoms for all the ports.
+   *
+   * The SfpDoms are copied from each SfpModule's published snapshot, so this
+   * never waits for SFP detection or DOM updates in progress.
    */
-  std::map<int32_t, SfpDom> getSfpDoms() const;
+  void getSfpDoms(std::map<int32_t, SfpDom>& domInfos) const;
 
   /*
    * Get SfpDom of the specified port.
@@ -255,9 +429,14 @@ class SwSwitch : public HwSwitch::Callback {
    * Create Sfp mapping for the port in the SFP map.
    */
   void createSfp(PortID portID, std::unique_ptr<SfpImpl>& sfpImpl);
+  /*
+   * The same, for a port with a QSFP cage.  See QsfpModule.
+   */
+  void createQsfp(PortID portID, std::unique_ptr<SfpImpl>& sfpImpl);
 
   /*
-   * This function is used to detect all the SFPs in the SFP Map
+   * This function is used to detect all the SFPs in the SFP Map.
+   * SFPs on different I2C buses are polled in parallel.
    */
   void detectSfp();
 
@@ -290,9 +469,31 @@ class SwSwitch : public HwSwitch::Callback {
 
   // HwSwitch::Callback methods
   void packetReceived(std::unique_ptr<RxPacket> pkt) noexcept override;
+  /*
+   * Link events are debounced and batched by the LinkStateDebouncer, in
+   * the background thread, before they are handled.
+   */
   void linkStateChanged(PortID port, bool up) noexcept override;
+  /*
+   * L2 events are queued in the L2LearningQueue, and applied to the MAC
+   * tables in batches by a housekeeping state update.
+   */
+  void l2LearningUpdateReceived(VlanID vlan, folly::MacAddress mac,
+                                PortID port,
+                                L2EntryUpdateType type) noexcept override;
   void exitFatal() const noexcept override;
 
+  /*
+   * Register the handler for trapped packets with the given ethertype.
+   *
+   * The handlers for ARP, IPv4, IPv6, LLDP and CDP are registered by the
+   * constructor.  Other handlers must be registered before init(), since
+   * the table is read without locking once packets start arriving.  The
+   * name is used for the trapped.ethertype.<name> counter.
+   */
+  void registerPacketHandler(uint16_t ethertype, folly::StringPiece name,
+                             PacketHandler handler);
+
   /*
    * Allocate a new TxPacket.
    */
@@ -323,6 +524,27 @@ class SwSwitch : public HwSwitch::Callback {
    */
   void sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept;
 
+  /*
+   * Send a batch of packets using switching logic.
+   *
+   * This behaves like calling sendPacketSwitched() on each packet in order,
+   * but lets the HwSwitch submit the whole batch at once.  Use this when
+   * generating bursts of packets, such as flooding gratuitous ARPs or
+   * neighbor advertisements on every interface.
+   */
+  void sendPacketsSwitched(
+      std::vector<std::unique_ptr<TxPacket>> pkts) noexcept;
+
+  /*
+   * Send a batch of packets, each out of its port.
+   *
+   * This behaves like calling sendPacketOutOfPort() on each packet in
+   * order, but lets the HwSwitch submit the whole batch at once.
+   */
+  void sendPacketsOutOfPort(
+      std::vector<std::pair<std::unique_ptr<TxPacket>, PortID>> pkts)
+      noexcept;
+
   /**
    * Send out L3 packet through HW
    *
@@ -342,6 +564,15 @@ class SwSwitch : public HwSwitch::Callback {
    */
   void sendL3Packet(RouterID rid, std::unique_ptr<TxPacket> pkt) noexcept;
 
+  /**
+   * Send out a batch of L3 packets through HW.
+   *
+   * Each packet has the same requirements as for sendL3Packet().  Packets that
+   * do not meet them are dropped; the rest are sent as a single batch.
+   */
+  void sendL3Packets(RouterID rid,
+                     std::vector<std::unique_ptr<TxPacket>> pkts) noexcept;
+
   /**
    * method to send out a packet from HW to host.
    *
@@ -380,6 +611,39 @@ class SwSwitch : public HwSwitch::Callback {
     return nUpdater_.get();
   }
 
+  /*
+   * Get the NeighborHoldQueue, which holds routed packets while their next
+   * hop is resolved.
+   */
+  NeighborHoldQueue* getNeighborHoldQueue() {
+    return holdQueue_.get();
+  }
+
+  /*
+   * Get the UnresolvedPuntPolicy, which decides which of the packets
+   * punted for unresolved next hops are used to resolve them.
+   */
+  UnresolvedPuntPolicy* getUnresolvedPuntPolicy() {
+    return puntPolicy_.get();
+  }
+
+  /*
+   * Get the DHCPRelayCache object, which the DHCP relays use to look up the
+   * relay configuration of each VLAN.
+   */
+  DHCPRelayCache* getDHCPRelayCache() {
+    return dhcpRelayCache_.get();
+  }
+
+  /*
+   * Get the StateChangeWatcher object.
+   *
+   * This returns null once the SwSwitch has been stopped.
+   */
+  StateChangeWatcher* getStateChangeWatcher() {
+    return changeWatcher_.get();
+  }
+
   /*
    * Get the PktCaptureManager object.
    */
@@ -387,6 +651,39 @@ class SwSwitch : public HwSwitch::Callback {
     return pcapMgr_.get();
   }
 
+  /*
+   * Get the LldpManager object, which holds the LLDP neighbor table.
+   */
+  const LldpManager* getLldpManager() const {
+    return lldpManager_.get();
+  }
+
+  /*
+   * Get the PeriodicTransmitter, which sends the periodic control packets,
+   * such as LLDP and RAs.  It must only be used in the background thread.
+   */
+  PeriodicTransmitter* getPeriodicTransmitter() {
+    return periodicTx_.get();
+  }
+
+  /*
+   * Get the TrappedPacketProfiler object.
+   *
+   * This returns null if trapped packet profiling is disabled.
+   */
+  const TrappedPacketProfiler* getTrappedPacketProfiler() const {
+    return trapProfiler_.get();
+  }
+
+  /*
+   * Get the UpdateRecorder object.
+   *
+   * This returns null unless recording is enabled with --update_record_file.
+   */
+  UpdateRecorder* getUpdateRecorder() const {
+    return updateRecorder_.get();
+  }
+
   /*
    * Allow hardware to perform any warm boot related cleanup
    * before we exit the application.
@@ -408,6 +705,14 @@ class SwSwitch : public HwSwitch::Callback {
    */
   void dumpStateToFile(const std::string& filename) const;
 
+  /*
+   * Save the switch state to the given file in the binary StateSnapshot
+   * format, which is much faster to write and load than JSON.  This is used
+   * for the warm boot state; crash dumps still use dumpStateToFile(), so
+   * they remain human readable.
+   */
+  void saveWarmBootState(const std::string& filename) const;
+
   /*
    * Get port operational state
    */
@@ -434,18 +739,98 @@ class SwSwitch : public HwSwitch::Callback {
    * on the Monitoring configuration.
    */
   void publishSfpInfo();
-  void publishRouteStats();
+  void updateStateMemoryStats(const std::shared_ptr<SwitchState>& oldState,
+                              const std::shared_ptr<SwitchState>& newState);
   void syncTunInterfaces();
+  /*
+   * Prepend the L2 header and padding to an L3 packet from the host.
+   * Returns false, after logging the reason, if the packet must be dropped.
+   */
+  bool prepareL3Packet(TxPacket* pkt) noexcept;
   void publishBootType();
   SwitchRunState getSwitchRunState() const;
   void setSwitchRunState(SwitchRunState desiredState);
   SwitchStats* createSwitchStats();
+  /*
+   * Process a trapped packet on the calling thread.  This is called either
+   * directly from packetReceived(), or from an RxPacketDispatcher worker.
+   */
+  void processPacket(std::unique_ptr<RxPacket> pkt) noexcept;
   void handlePacket(std::unique_ptr<RxPacket> pkt);
+  void registerDefaultPacketHandlers();
+  // Handle a batch of debounced link changes, in the background thread
+  void linkStatesChanged(const LinkStateDebouncer::LinkChanges& changes);
+
+  /*
+   * A batch of state updates taken off the pending lists, along with the
+   * state they were applied to and the new state they prepared.
+   */
+  struct PreparedBatch {
+    StateUpdateList updates;
+    std::shared_ptr<SwitchState> origState;
+    std::shared_ptr<SwitchState> state;
+    StateUpdateProfile profile;
+    std::chrono::steady_clock::time_point start;
+    // The pipelineEpoch_ the batch was prepared in
+    uint64_t epoch{0};
+  };
 
   static void handlePendingUpdatesHelper(SwSwitch* sw);
   void handlePendingUpdates();
+  // Run the update functions of batch->updates on top of batch->origState
+  void prepareBatch(PreparedBatch* batch);
+  /*
+   * Apply the composable updates to state again, publishing after each,
+   * after a later update of their run failed.  Returns the new state.
+   */
+  std::shared_ptr<SwitchState> replayComposedUpdates(
+      std::shared_ptr<SwitchState> state,
+      const std::vector<StateUpdate*>& updates,
+      CloneArena* arena);
+  /*
+   * Apply the prepared state to the hardware and notify the updates.  This
+   * runs in the update thread, or in the HW update thread when the updates
+   * are pipelined.
+   */
+  void programBatch(PreparedBatch* batch);
+  static void programPreparedBatchesHelper(SwSwitch* sw);
+  // Program the batches in preparedBatches_, in the HW update thread
+  void programPreparedBatches();
+  /*
+   * Put the updates of batches prepared on top of a state that was rolled
+   * back at the front of the pending lists, to be prepared again, and
+   * start preparing from the current state.  Only called in the update
+   * thread.
+   */
+  void requeueStaleBatches();
+  // Move the updates from newUpdates_ to pendingUpdates_
+  void takeNewUpdates();
+  /*
+   * Move the pending updates to apply as the next batch into *updates, in
+   * priority order.  The batch ends early after an update that ends it.
+   */
+  void takeUpdateBatch(StateUpdateList* updates);
+  // Set oldestQueuedUpdate_ from the batch being applied and the pending
+  // updates
+  void setOldestQueuedUpdate(const StateUpdateList& batch);
+  /*
+   * Returns true if the pending updates should be held back so that more
+   * updates can be coalesced with them, and arranges for
+   * handlePendingUpdates() to run again once the coalescing window closes.
+   */
+  bool deferPendingUpdates();
   void applyUpdate(const std::shared_ptr<SwitchState>& oldState,
-                   const std::shared_ptr<SwitchState>& newState);
+                   const std::shared_ptr<SwitchState>& newState,
+                   StateUpdateProfile* profile);
+  void notifyStateObservers(const std::shared_ptr<const StateDelta>& delta);
+  /*
+   * Add the time from start to end to the given stage of the profile and to
+   * the stage stats, and return end.
+   */
+  std::chrono::steady_clock::time_point recordStage(
+      StateUpdateProfile* profile, folly::StringPiece name,
+      StateUpdateStage stage, std::chrono::steady_clock::time_point start,
+      std::chrono::steady_clock::time_point end);
 
   void startThreads();
   void stopThreads();
@@ -469,10 +854,71 @@ class SwSwitch : public HwSwitch::Callback {
   std::unique_ptr<TunManager> tunMgr_;
 
   /*
-   * A list of pending state updates to be applied.
+   * State updates scheduled by updateState() that the update thread has not
+   * picked up yet.
+   *
+   * This is a lock-free stack, linked through StateUpdate::next_.  Any
+   * thread may push onto it; only the update thread takes it, by swapping
+   * the whole stack out.
+   */
+  std::atomic<StateUpdate*> newUpdates_{nullptr};
+  // Set once a call to handlePendingUpdates() has been scheduled for the
+  // updates in newUpdates_.
+  std::atomic<bool> updatesWakeupPending_{false};
+
+  /*
+   * The lists of pending state updates to be applied, indexed by priority
+   * class, each in the order the updates were scheduled.  Only accessed in
+   * the update thread.
+   */
+  std::array<StateUpdateList, StateUpdate::kNumPriorities> pendingUpdates_;
+  // The total length of the pendingUpdates_ lists
+  size_t numPendingUpdates_{0};
+  // Whether a coalescing timer is scheduled.  Only accessed in the update
+  // thread.
+  bool coalesceTimerScheduled_{false};
+
+  /*
+   * With --state_update_pipeline_depth, the update thread prepares the
+   * next batch while the HW update thread programs the previous ones.
+   *
+   * preparedBatches_ hands the prepared batches over to the HW update
+   * thread, in order, and holds at most that many.  When the hardware rolls
+   * a batch back, the batches prepared on top of it are moved to
+   * staleBatches_ and pipelineEpoch_ is bumped, so that the update thread
+   * prepares their updates again.  All three are protected by
+   * preparedBatchesLock_.
+   */
+  std::deque<std::unique_ptr<PreparedBatch>> preparedBatches_;
+  std::deque<std::unique_ptr<PreparedBatch>> staleBatches_;
+  uint64_t pipelineEpoch_{0};
+  // Set when the update thread found preparedBatches_ full, and needs
+  // waking up once the HW update thread takes a batch from it
+  bool prepareStalled_{false};
+  mutable std::mutex preparedBatchesLock_;
+  /*
+   * The last state the update thread prepared, which the next batch is
+   * prepared on top of, and the pipelineEpoch_ it was prepared in.  Only
+   * accessed in the update thread.
+   */
+  std::shared_ptr<SwitchState> lastPreparedState_;
+  uint64_t lastPreparedEpoch_{0};
+  // The number of updates scheduled by updateState() and not yet applied
+  std::atomic<uint64_t> numQueuedUpdates_{0};
+  /*
+   * When the oldest update that the update thread has picked up but not yet
+   * applied was scheduled, as a steady_clock count, or 0 if there is no such
+   * update.  Updates still in newUpdates_ are only taken into account once
+   * the update thread gets to them.
    */
-  folly::SpinLock pendingUpdatesLock_;
-  StateUpdateList pendingUpdates_;
+  std::atomic<std::chrono::steady_clock::rep> oldestQueuedUpdate_{0};
+
+  // The most recently computed SwitchState memory usage
+  StateMemoryStats stateMemoryStats_;
+  mutable std::mutex stateMemoryStatsLock_;
+  // When stateMemoryStats_ was last computed.  Only accessed in the thread
+  // that programs the updates.
+  std::chrono::steady_clock::time_point stateMemoryStatsTime_;
 
   /*
    * hwMutex_ is held around all modifying calls that we make to hw_.
@@ -492,22 +938,118 @@ class SwSwitch : public HwSwitch::Callback {
    *
    * BEWARE: You generally shouldn't access this directly, even internally
    * within SwSwitch private methods.  This should only be accessed while
-   * holding stateLock_.  You almost certainly should call getState() or
+   * You almost certainly should call getState(), readState() or
    * setStateInternal() instead of directly accessing this.
    *
    * This intentionally has an awkward name so people won't forget and try to
    * directly access this pointer.
    */
-  std::shared_ptr<SwitchState> stateDontUseDirectly_;
-  mutable folly::SpinLock stateLock_;
+  ReadMostlyPtr<SwitchState> stateDontUseDirectly_;
 
   std::unique_ptr<ArpHandler> arp_;
   std::unique_ptr<IPv4Handler> ipv4_;
   std::unique_ptr<IPv6Handler> ipv6_;
   std::unique_ptr<NeighborUpdater> nUpdater_;
+  std::unique_ptr<NeighborAnnouncer> nAnnouncer_;
+  std::unique_ptr<NeighborHoldQueue> holdQueue_;
+  std::unique_ptr<UnresolvedPuntPolicy> puntPolicy_;
+  std::unique_ptr<RouteStats> routeStats_;
+  std::unique_ptr<StateChangeWatcher> changeWatcher_;
+  /*
+   * Periodically checkpoints the state for warm boot after a crash, unless
+   * disabled with --state_checkpoint_interval_ms=0.
+   */
+  std::unique_ptr<StateCheckpointer> checkpointer_;
   std::unique_ptr<PktCaptureManager> pcapMgr_;
+  /*
+   * Exports the packets sampled for sFlow, which bypass the trapped packet
+   * handlers entirely.
+   */
+  std::unique_ptr<SflowExporter> sflow_;
+  /*
+   * Runs the BFD sessions on a thread of its own, pruning the ECMP paths
+   * through neighbors whose session goes down.
+   */
+  std::unique_ptr<BfdManager> bfd_;
+  std::unique_ptr<DHCPRelayCache> dhcpRelayCache_;
+  /*
+   * Moves trapped packet processing off of the HwSwitch RX thread, when
+   * enabled with --rx_dispatch.  Otherwise packetReceived() processes
+   * packets inline.
+   */
+  std::unique_ptr<RxPacketDispatcher> rxDispatcher_;
+  /*
+   * Rate limits trapped packets before protocol processing, when enabled
+   * with --rx_policer.
+   */
+  std::unique_ptr<RxPacketPolicer> rxPolicer_;
+  /*
+   * Tracks the sources of trapped packets, unless disabled with
+   * --notrap_profile.
+   */
+  std::unique_ptr<TrappedPacketProfiler> trapProfiler_;
+  /*
+   * Records the control plane updates, when enabled with
+   * --update_record_file.
+   */
+  std::unique_ptr<UpdateRecorder> updateRecorder_;
+  /*
+   * Samples the CPU time of our threads, when enabled with
+   * --thread_sample_ms.
+   */
+  std::unique_ptr<ThreadSampler> threadSampler_;
+  /*
+   * The startup tasks held back until the first FIB sync.
+   */
+  std::unique_ptr<DeferredInit> deferredInit_;
+  /*
+   * Reports state updates that run for too long, unless disabled with
+   * --update_stall_threshold_ms=0.
+   */
+  std::unique_ptr<UpdateWatchdog> updateWatchdog_;
+
+  /*
+   * The trapped packet handlers, by ethertype.  This is only modified
+   * before init(), so handlePacket() reads it without locking.
+   */
+  struct PacketHandlerEntry {
+    PacketHandlerEntry(uint32_t index, folly::StringPiece name,
+                       PacketHandler handler, const std::string* activity)
+      : index(index), name(name.str()), handler(std::move(handler)),
+        activity(activity) {}
+    // The index of the entry's counter in SwitchStats
+    uint32_t index;
+    std::string name;
+    PacketHandler handler;
+    // What the ThreadSampler charges the handler's CPU time to
+    const std::string* activity;
+  };
+  std::unordered_map<uint16_t, PacketHandlerEntry> packetHandlers_;
+  bool packetHandlersFrozen_{false};
 
   std::unique_ptr<SfpMap> sfpMap_;
+  std::unique_ptr<SfpDomPoller> sfpPoller_;
+
+  // The profiles of the recent state updates
+  StateUpdateHistory updateHistory_;
+
+  /*
+   * Registered StateObservers.
+   *
+   * Each pending notification holds a reference to its observer's entry, and
+   * checks under the entry's lock that the observer is still registered
+   * before calling it.
+   */
+  struct StateObserverEntry {
+    StateObserverEntry(StateObserver* observer, folly::EventBase* evb)
+      : observer(observer), evb(evb) {}
+    StateObserver* const observer;
+    folly::EventBase* const evb;
+    std::mutex lock;
+    bool registered{true};
+  };
+  std::vector<std::shared_ptr<StateObserverEntry>> stateObservers_;
+  std::mutex stateObserversLock_;
 
   /*
    * A thread for performing various background tasks.
@@ -520,8 +1062,34 @@ class SwSwitch : public HwSwitch::Callback {
    */
   std::unique_ptr<std::thread> updateThread_;
   folly::EventBase updateEventBase_;
+
+  /*
+   * A thread for programming the prepared SwitchState updates into the
+   * hardware, when they are pipelined.
+   */
+  std::unique_ptr<std::thread> hwUpdateThread_;
+  folly::EventBase hwUpdateEventBase_;
+
+  /*
+   * A thread for syncing the TUN interfaces with the host, and passing
+   * packets between them and the switch.  Programming the host over
+   * netlink can take a while, so it gets a thread of its own rather than
+   * holding up the background thread.
+   */
+  std::unique_ptr<std::thread> tunThread_;
+  folly::EventBase tunEventBase_;
   BootType bootType_{BootType::UNINITIALIZED};
   std::unique_ptr<LldpManager> lldpManager_;
+  std::unique_ptr<LacpManager> lacpManager_;
+  /*
+   * Declared after backgroundEventBase_, so that it is destroyed before the
+   * EventBase it runs in.
+   */
+  std::unique_ptr<LinkStateDebouncer> linkDebouncer_;
+  std::unique_ptr<L2LearningQueue> l2Learning_;
+  std::unique_ptr<PeriodicTransmitter> periodicTx_;
+  // Serves the counters over HTTP, when enabled with --metrics_port
+  std::unique_ptr<MetricsExporter> metricsExporter_;
 };
 
 }} // facebook::fboss
@@ -10,17 +10,47 @@
 #include "fboss/agent/SwitchStats.h"
 
 #include "fboss/agent/PortStats.h"
+#include "fboss/agent/RxPacketDispatcher.h"
+#include "fboss/agent/RxPacketPolicer.h"
+#include "fboss/agent/TrappedPacketProfiler.h"
 #include "common/stats/ExportedTimeseries.h"
+#include <folly/Conv.h>
 #include <folly/Memory.h>
+#include <cctype>
 
+using facebook::stats::AVG;
 using facebook::stats::SUM;
 using facebook::stats::RATE;
+using std::chrono::microseconds;
 
 namespace facebook { namespace fboss {
 
 // set to empty string, we'll prepend prefix when fbagent collects counters
 std::string SwitchStats::kCounterPrefix = "";
 
+namespace {
+
+// Update names are usually string literals, but bound the number of stats
+// in case one isn't.
+const size_t kMaxStateUpdateNames = 32;
+
+// Indexed by StateUpdatePriority
+const char* const kStateUpdatePriorityNames[] = {
+  "neighbor", "route", "config", "housekeeping",
+};
+
+// "add unicast route" is exported as "add_unicast_route"
+std::string statName(folly::StringPiece name) {
+  std::string ret;
+  ret.reserve(name.size());
+  for (auto c : name) {
+    ret.push_back(isalnum(c) ? tolower(c) : '_');
+  }
+  return ret;
+}
+
+} // unnamed namespace
+
 SwitchStats::SwitchStats()
     : SwitchStats(stats::ThreadCachedServiceData::get()->getThreadStats()) {
 }
@@ -31,6 +61,12 @@ SwitchStats::SwitchStats(ThreadLocalStatsMap *map)
       trapPktBogus_(map, kCounterPrefix + "trapped.bogus", SUM, RATE),
       trapPktErrors_(map, kCounterPrefix + "trapped.error", SUM, RATE),
       trapPktUnhandled_(map, kCounterPrefix + "trapped.unhandled", SUM, RATE),
+      trapPktDispatchControlDrops_(map, kCounterPrefix +
+          "trapped.dispatch.control.drops", SUM, RATE),
+      trapPktDispatchHostDrops_(map, kCounterPrefix +
+          "trapped.dispatch.host.drops", SUM, RATE),
+      trapPktDispatchOtherDrops_(map, kCounterPrefix +
+          "trapped.dispatch.other.drops", SUM, RATE),
       trapPktToHost_(map, kCounterPrefix + "host.rx", SUM, RATE),
       trapPktToHostBytes_(map, kCounterPrefix + "host.rx.bytes", SUM, RATE),
       pktFromHost_(map, kCounterPrefix + "host.tx", SUM, RATE),
@@ -41,10 +77,44 @@ SwitchStats::SwitchStats(ThreadLocalStatsMap *map)
       arpRequestsRx_(map, kCounterPrefix + "arp.request.rx", SUM, RATE),
       arpRepliesRx_(map, kCounterPrefix + "arp.reply.rx", SUM, RATE),
       arpRequestsTx_(map, kCounterPrefix + "arp.request.tx", SUM, RATE),
+      arpRequestsSuppressed_(map, kCounterPrefix + "arp.request.suppressed",
+                             SUM, RATE),
       arpRepliesTx_(map, kCounterPrefix + "arp.reply.tx", SUM, RATE),
       arpBadOp_(map, kCounterPrefix + "arp.bad_op", SUM, RATE),
+      neighborProbesTx_(map, kCounterPrefix + "neighbor.probe.tx", SUM, RATE),
+      neighborProbesSkipped_(map, kCounterPrefix + "neighbor.probe.skipped",
+                             SUM, RATE),
+      neighborPrefetchesTx_(map, kCounterPrefix + "neighbor.prefetch.tx",
+          SUM, RATE),
+      neighborAnnouncementsSent_(map, kCounterPrefix +
+          "neighbor.announce.sent", SUM, RATE),
+      neighborAnnouncementsDeferred_(map, kCounterPrefix +
+          "neighbor.announce.deferred", SUM, RATE),
+      neighborsEvicted_(map, kCounterPrefix + "neighbor.evicted", SUM, RATE),
+      neighborLearnsRejected_(map, kCounterPrefix +
+          "neighbor.learn_rejected", SUM, RATE),
+      l2UpdatesDropped_(map, kCounterPrefix + "l2.update_dropped",
+          SUM, RATE),
+      l2LearnsRejected_(map, kCounterPrefix + "l2.learn_rejected",
+          SUM, RATE),
+      neighborHoldQueued_(map, kCounterPrefix + "neighbor.hold.queued",
+          SUM, RATE),
+      neighborHoldFlushed_(map, kCounterPrefix + "neighbor.hold.flushed",
+          SUM, RATE),
+      neighborHoldDropped_(map, kCounterPrefix + "neighbor.hold.dropped",
+          SUM, RATE),
+      neighborRequestsSuppressed_(map, kCounterPrefix +
+          "neighbor.request.suppressed", SUM, RATE),
+      neighborRequestsFlooded_(map, kCounterPrefix +
+          "neighbor.request.flooded", SUM, RATE),
       trapPktNdp_(map, kCounterPrefix + "trapped.ndp", SUM, RATE),
       ipv6NdpBad_(map, kCounterPrefix + "ipv6.ndp.bad", SUM, RATE),
+      ipv6NdpRaSolicited_(map, kCounterPrefix + "ipv6.ndp.ra_solicited",
+                          SUM, RATE),
+      ipv6NdpRsAggregated_(map, kCounterPrefix + "ipv6.ndp.rs_aggregated",
+                           SUM, RATE),
+      ipv6NdpRsDropped_(map, kCounterPrefix + "ipv6.ndp.rs_dropped",
+                        SUM, RATE),
       ipv4Rx_(map, kCounterPrefix + "trapped.ipv4", SUM, RATE),
       ipv4TooSmall_(map, kCounterPrefix + "ipv4.too_small", SUM, RATE),
       ipv4WrongVer_(map, kCounterPrefix + "ipv4.wrong_version", SUM, RATE),
@@ -53,33 +123,229 @@ SwitchStats::SwitchStats(ThreadLocalStatsMap *map)
       ipv4NoArp_(map, kCounterPrefix + "ipv4.no_arp", SUM, RATE),
       ipv4TtlExceeded_(map, kCounterPrefix + "ipv4.ttl_exceeded", SUM, RATE),
       ipv6HopExceeded_(map, kCounterPrefix + "ipv6.hop_exceeded", SUM, RATE),
+      icmpErrorLimited_(map, kCounterPrefix + "icmp.error_limited", SUM, RATE),
       udpTooSmall_(map, kCounterPrefix + "udp.too_small", SUM, RATE),
       dhcpV4Pkt_(map, kCounterPrefix + "dhcpV4.pkt", SUM, RATE),
       dhcpV4BadPkt_(map, kCounterPrefix + "dhcpV4.bad_pkt", SUM, RATE),
       dhcpV4DropPkt_(map, kCounterPrefix + "dhcpV4.drop_pkt", SUM, RATE),
+      dhcpV4FastPath_(map, kCounterPrefix + "dhcpV4.fast_path", SUM, RATE),
+      dhcpV4SlowPath_(map, kCounterPrefix + "dhcpV4.slow_path", SUM, RATE),
       dhcpV6Pkt_(map, kCounterPrefix + "dhcpV6.pkt", SUM, RATE),
       dhcpV6BadPkt_(map, kCounterPrefix + "dhcpV6.bad_pkt", SUM, RATE),
       dhcpV6DropPkt_(map, kCounterPrefix + "dhcpV6.drop_pkt", SUM, RATE),
+      lldpNeighborChanged_(map, kCounterPrefix + "lldp.neighbor_changed",
+                           SUM, RATE),
+      lldpNeighborRefreshed_(map, kCounterPrefix + "lldp.neighbor_refreshed",
+                             SUM, RATE),
       addRouteV4_(map, kCounterPrefix + "route.v4.add", RATE),
       addRouteV6_(map, kCounterPrefix + "route.v6.add", RATE),
       delRouteV4_(map, kCounterPrefix + "route.v4.delete", RATE),
       delRouteV6_(map, kCounterPrefix + "route.v6.delete", RATE),
       updateState_(map, kCounterPrefix + "state_update.us", 50000, 0, 1000000),
-      routeUpdate_(map,  kCounterPrefix + "route_update.us", 50, 0, 500) {
+      updateStateRolledBack_(map, kCounterPrefix +
+                             "state_update.rolled_back", SUM, RATE),
+      updateStateBatchesRequeued_(map, kCounterPrefix +
+                                  "state_update.requeued_batches", SUM, RATE),
+      updateStateReplayed_(map, kCounterPrefix + "state_update.replayed",
+                           SUM, RATE),
+      updateStateQueued_(map, kCounterPrefix + "state_update.queued_us",
+                         1000, 0, 100000),
+      updateStateBatch_(map, kCounterPrefix + "state_update.batch_size",
+                        10, 0, 1000),
+      routeUpdate_(map,  kCounterPrefix + "route_update.us", 50, 0, 500),
+      routesResolved_(map, kCounterPrefix + "route_update.resolved_routes",
+                      1000, 0, 100000),
+      routeChunks_(map, kCounterPrefix + "route_update.chunks", SUM, RATE),
+      routeChunkRoutes_(map, kCounterPrefix + "route_update.chunk_routes",
+                        SUM, RATE),
+      routeUpdateOverloads_(map, kCounterPrefix + "route_update.overloads",
+                            SUM, RATE),
+      tunSync_(map, kCounterPrefix + "tun_sync.us", 10000, 0, 1000000),
+      tunSyncSkipped_(map, kCounterPrefix + "tun_sync.skipped", SUM, RATE),
+      tunSyncCoalesced_(map, kCounterPrefix + "tun_sync.coalesced",
+                        SUM, RATE),
+      kernelRouteUpdates_(map, kCounterPrefix + "kernel_routes.updates",
+                          SUM, RATE),
+      kernelRouteUpdatesDeferred_(map,
+                                  kCounterPrefix + "kernel_routes.deferred",
+                                  SUM, RATE),
+      kernelRouteMismatches_(map, kCounterPrefix + "kernel_routes.mismatches",
+                             SUM, RATE),
+      hwInDiscards_(map, kCounterPrefix + "hw.in_discards", SUM, RATE),
+      hwInErrors_(map, kCounterPrefix + "hw.in_errors", SUM, RATE),
+      hwOutDiscards_(map, kCounterPrefix + "hw.out_discards", SUM, RATE),
+      hwOutErrors_(map, kCounterPrefix + "hw.out_errors", SUM, RATE),
+      hwIpHeaderDrops_(map, kCounterPrefix + "hw.drops.ip_header", SUM, RATE),
+      hwIpDiscards_(map, kCounterPrefix + "hw.drops.ip_discard", SUM, RATE),
+      hwOversizeDrops_(map, kCounterPrefix + "hw.drops.oversize", SUM, RATE),
+      hwCpuQueueDrops_(map, kCounterPrefix + "hw.drops.cpu_queue", SUM, RATE),
+      map_(map) {
+  for (int i = 0; i < RxPacketPolicer::NUM_CLASSES; ++i) {
+    auto prefix = kCounterPrefix + "trapped.policer." +
+      RxPacketPolicer::getClassName(RxPolicerClass(i));
+    trapPktPolicerAccepted_.emplace_back(
+        new TLTimeseries(map, prefix + ".accepted", SUM, RATE));
+    trapPktPolicerDrops_.emplace_back(
+        new TLTimeseries(map, prefix + ".drops", SUM, RATE));
+  }
+  for (size_t i = 0; i < StateUpdateProfile::kNumStages; ++i) {
+    updateStateStages_.emplace_back(new TLHistogram(
+        map, kCounterPrefix + "state_update." +
+          getStateUpdateStageName(StateUpdateStage(i)) + "_us",
+        1000, 0, 100000));
+  }
+  for (size_t i = 0; i < StateUpdate::kNumPriorities; ++i) {
+    updateStateQueuedByPriority_.emplace_back(new TLHistogram(
+        map, kCounterPrefix + "state_update." + kStateUpdatePriorityNames[i] +
+          ".queued_us",
+        1000, 0, 100000));
+  }
 }
 
-PortStats* SwitchStats::port(PortID portID) {
-  auto it = ports_.find(portID);
-  if (it != ports_.end()) {
-    return it->second.get();
+void SwitchStats::stateUpdateQueued(StateUpdatePriority priority,
+                                    microseconds us) {
+  updateStateQueued_.addValue(us.count());
+  updateStateQueuedByPriority_[static_cast<size_t>(priority)]->addValue(
+      us.count());
+}
+
+void SwitchStats::pktDispatchDropped(RxPacketClass cls) {
+  switch (cls) {
+  case RxPacketClass::CONTROL:
+    trapPktDispatchControlDrops_.addValue(1);
+    break;
+  case RxPacketClass::HOST:
+    trapPktDispatchHostDrops_.addValue(1);
+    break;
+  case RxPacketClass::OTHER:
+    trapPktDispatchOtherDrops_.addValue(1);
+    break;
+  }
+  trapPktDrops_.addValue(1);
+}
+
+void SwitchStats::pktPolicerAccepted(RxPolicerClass cls) {
+  trapPktPolicerAccepted_[static_cast<int>(cls)]->addValue(1);
+}
+
+void SwitchStats::pktPolicerDropped(RxPolicerClass cls) {
+  trapPktPolicerDrops_[static_cast<int>(cls)]->addValue(1);
+  trapPktDrops_.addValue(1);
+}
+
+void SwitchStats::pktEthertype(uint32_t index, folly::StringPiece name) {
+  if (index >= trapPktEthertype_.size()) {
+    trapPktEthertype_.resize(index + 1);
   }
-  return createPortStats(portID);
+  auto& stat = trapPktEthertype_[index];
+  if (!stat) {
+    stat.reset(new TLTimeseries(
+          map_, kCounterPrefix + "trapped.ethertype." + name.str(), SUM, RATE));
+  }
+  stat->addValue(1);
+}
+
+struct SwitchStats::TrappedProtoStats {
+  TrappedProtoStats(ThreadLocalStatsMap* map, const std::string& prefix)
+    : pkts(map, prefix, SUM, RATE),
+      bytes(map, prefix + ".bytes", 64, 0, 1536) {}
+  TLTimeseries pkts;
+  TLHistogram bytes;
+};
+
+void SwitchStats::trappedPktSize(PortID port, TrappedProto proto,
+                                 uint32_t bytes) {
+  auto index = static_cast<size_t>(port) * TrappedPacketProfiler::NUM_PROTOS +
+    static_cast<size_t>(proto);
+  if (index >= trapPktProto_.size()) {
+    trapPktProto_.resize(index + 1);
+  }
+  auto& stat = trapPktProto_[index];
+  if (!stat) {
+    stat.reset(new TrappedProtoStats(
+          map_, folly::to<std::string>(
+            kCounterPrefix, "trapped.port", static_cast<uint16_t>(port), ".",
+            TrappedPacketProfiler::getProtoName(proto))));
+  }
+  stat->pkts.addValue(1);
+  stat->bytes.addValue(bytes);
+}
+
+void SwitchStats::stateUpdateStage(folly::StringPiece name,
+                                   StateUpdateStage stage, microseconds us) {
+  auto idx = static_cast<size_t>(stage);
+  updateStateStages_[idx]->addValue(us.count());
+
+  auto key = statName(name);
+  auto it = updateStateStagesByName_.find(key);
+  if (it == updateStateStagesByName_.end()) {
+    if (updateStateStagesByName_.size() >= kMaxStateUpdateNames) {
+      key = "other";
+      it = updateStateStagesByName_.find(key);
+    }
+    if (it == updateStateStagesByName_.end()) {
+      std::vector<std::unique_ptr<TLTimeseries>> stages;
+      for (size_t i = 0; i < StateUpdateProfile::kNumStages; ++i) {
+        stages.emplace_back(new TLTimeseries(
+            map_, kCounterPrefix + "state_update." + key + "." +
+              getStateUpdateStageName(StateUpdateStage(i)) + "_us", AVG));
+      }
+      it = updateStateStagesByName_.emplace(key, std::move(stages)).first;
+    }
+  }
+  it->second[idx]->addValue(us.count());
+}
+
+SwitchStats::ThriftMethodStats::ThriftMethodStats(ThreadLocalStatsMap* map,
+                                                 const std::string& method)
+    : us(map, kCounterPrefix + "thrift." + method + ".us",
+         10000, 0, 1000000),
+      stateUpdateQueuedUs(map, kCounterPrefix + "thrift." + method +
+                            ".state_update.queued_us",
+                          1000, 0, 100000),
+      stateUpdateWaitUs(map, kCounterPrefix + "thrift." + method +
+                          ".state_update.wait_us",
+                        10000, 0, 1000000),
+      errors(map, kCounterPrefix + "thrift." + method + ".errors",
+             SUM, RATE) {
+}
+
+SwitchStats::ThriftMethodStats* SwitchStats::getThriftMethodStats(
+    folly::StringPiece method) {
+  auto key = method.str();
+  auto it = thriftMethods_.find(key);
+  if (it == thriftMethods_.end()) {
+    it = thriftMethods_.emplace(
+        key, folly::make_unique<ThriftMethodStats>(map_, key)).first;
+  }
+  return it->second.get();
+}
+
+void SwitchStats::thriftCall(folly::StringPiece method, microseconds us,
+                             bool failed) {
+  auto* stats = getThriftMethodStats(method);
+  stats->us.addValue(us.count());
+  if (failed) {
+    stats->errors.addValue(1);
+  }
+}
+
+void SwitchStats::thriftStateUpdateWait(folly::StringPiece method,
+                                        microseconds queuedUs,
+                                        microseconds waitUs) {
+  auto* stats = getThriftMethodStats(method);
+  stats->stateUpdateQueuedUs.addValue(queuedUs.count());
+  stats->stateUpdateWaitUs.addValue(waitUs.count());
 }
 
 PortStats* SwitchStats::createPortStats(PortID portID) {
   auto rv = ports_.emplace(portID, folly::make_unique<PortStats>(portID, this));
   const auto& it = rv.first;
   DCHECK(rv.second);
+  if (portID >= portsByID_.size()) {
+    portsByID_.resize(portID + 1, nullptr);
+  }
+  portsByID_[portID] = it->second.get();
   return it->second.get();
 }
 
@@ -10,15 +10,25 @@
 #pragma once
 
 #include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <boost/container/flat_map.hpp>
 #include <boost/noncopyable.hpp>
+#include <folly/Range.h>
 #include "common/stats/ThreadCachedServiceData.h"
 #include "fboss/agent/PortStats.h"
+#include "fboss/agent/StateUpdateProfile.h"
 #include "fboss/agent/types.h"
+#include "fboss/agent/state/StateUpdate.h"
 
 namespace facebook { namespace fboss {
 
 class PortStats;
+enum class RxPacketClass : uint8_t;
+enum class RxPolicerClass : uint8_t;
+enum class TrappedProto : uint8_t;
 
 typedef boost::container::flat_map<PortID,
           std::unique_ptr<PortStats>> PortStatsMap;
@@ -34,8 +44,16 @@ class SwitchStats : public boost::noncopyable {
 
   /*
    * Return the PortStats object for the given PortID.
+   *
+   * This is called several times for every trapped packet, so it indexes a
+   * flat array by PortID rather than searching ports_.
    */
-  PortStats* port(PortID portID);
+  PortStats* port(PortID portID) {
+    if (portID < portsByID_.size() && portsByID_[portID]) {
+      return portsByID_[portID];
+    }
+    return createPortStats(portID);
+  }
 
   /*
    * Getters.
@@ -65,6 +83,28 @@ class SwitchStats : public boost::noncopyable {
     trapPktUnhandled_.addValue(1);
     trapPktDrops_.addValue(1);
   }
+  /*
+   * A trapped packet was dropped because the RxPacketDispatcher queue for its
+   * class was full.
+   */
+  void pktDispatchDropped(RxPacketClass cls);
+  /*
+   * A trapped packet was accepted, or dropped, by the RxPacketPolicer.
+   */
+  void pktPolicerAccepted(RxPolicerClass cls);
+  void pktPolicerDropped(RxPolicerClass cls);
+  /*
+   * A trapped packet was dispatched to the handler registered for its
+   * ethertype.  index and name identify the SwSwitch handler entry; the
+   * counter is created the first time it is used on each thread.
+   */
+  void pktEthertype(uint32_t index, folly::StringPiece name);
+  /*
+   * The size of a trapped packet of the given protocol received on the
+   * port.  The counters for each port and protocol are created the first
+   * time they are used on each thread.
+   */
+  void trappedPktSize(PortID port, TrappedProto proto, uint32_t bytes);
   void pktToHost(uint32_t bytes) {
     trapPktToHost_.addValue(1);
     trapPktToHostBytes_.addValue(bytes);
@@ -91,6 +131,9 @@ class SwitchStats : public boost::noncopyable {
   void arpRequestTx() {
     arpRequestsTx_.addValue(1);
   }
+  void arpRequestSuppressed() {
+    arpRequestsSuppressed_.addValue(1);
+  }
   void arpReplyRx() {
     arpRepliesRx_.addValue(1);
   }
@@ -102,6 +145,55 @@ class SwitchStats : public boost::noncopyable {
     trapPktDrops_.addValue(1);
   }
 
+  void neighborProbeTx() {
+    neighborProbesTx_.addValue(1);
+  }
+  void neighborProbeSkipped() {
+    neighborProbesSkipped_.addValue(1);
+  }
+  void neighborPrefetchTx() {
+    neighborPrefetchesTx_.addValue(1);
+  }
+  void neighborAnnounceSent() {
+    neighborAnnouncementsSent_.addValue(1);
+  }
+  void neighborAnnounceDeferred() {
+    neighborAnnouncementsDeferred_.addValue(1);
+  }
+  // Neighbor entries evicted, or not added, because of the neighbor limits
+  void neighborsEvicted(uint64_t count) {
+    neighborsEvicted_.addValue(count);
+  }
+  void neighborLearnRejected(uint64_t count) {
+    neighborLearnsRejected_.addValue(count);
+  }
+  // HW L2 learn and age events dropped by the L2 learning rate limits, and
+  // learned MACs left out because the VLAN's MAC table was full
+  void l2UpdatesDropped(uint64_t count) {
+    l2UpdatesDropped_.addValue(count);
+  }
+  void l2LearnRejected(uint64_t count) {
+    l2LearnsRejected_.addValue(count);
+  }
+  // Routed packets held while their next hop is resolved
+  void neighborHoldQueued() {
+    neighborHoldQueued_.addValue(1);
+  }
+  void neighborHoldFlushed(uint64_t count) {
+    neighborHoldFlushed_.addValue(count);
+  }
+  void neighborHoldDropped(uint64_t count) {
+    neighborHoldDropped_.addValue(count);
+  }
+  // Flooded neighbor requests answered for a known host, and flooded
+  // because the target was not known
+  void neighborRequestSuppressed() {
+    neighborRequestsSuppressed_.addValue(1);
+  }
+  void neighborRequestFlooded() {
+    neighborRequestsFlooded_.addValue(1);
+  }
+
   void ipv6NdpPkt() {
     trapPktNdp_.addValue(1);
   }
@@ -109,6 +201,16 @@ class SwitchStats : public boost::noncopyable {
     ipv6NdpBad_.addValue(1);
     trapPktDrops_.addValue(1);
   }
+  void ipv6NdpRaSolicited() {
+    ipv6NdpRaSolicited_.addValue(1);
+  }
+  void ipv6NdpRsAggregated() {
+    ipv6NdpRsAggregated_.addValue(1);
+  }
+  void ipv6NdpRsDropped() {
+    ipv6NdpRsDropped_.addValue(1);
+    trapPktDrops_.addValue(1);
+  }
 
   void dhcpV4Pkt() {
     dhcpV4Pkt_.addValue(1);
@@ -118,6 +220,13 @@ class SwitchStats : public boost::noncopyable {
     dhcpV6Pkt_.addValue(1);
   }
 
+  void lldpNeighborChanged() {
+    lldpNeighborChanged_.addValue(1);
+  }
+  void lldpNeighborRefreshed() {
+    lldpNeighborRefreshed_.addValue(1);
+  }
+
   void ipv4Rx() {
     ipv4Rx_.addValue(1);
   }
@@ -144,6 +253,10 @@ class SwitchStats : public boost::noncopyable {
     ipv6HopExceeded_.addValue(1);
   }
 
+  void icmpErrorLimited() {
+    icmpErrorLimited_.addValue(1);
+  }
+
   void udpTooSmall() {
     udpTooSmall_.addValue(1);
   }
@@ -159,6 +272,14 @@ class SwitchStats : public boost::noncopyable {
     trapPktDrops_.addValue(1);
   }
 
+  void dhcpV4FastPath() {
+    dhcpV4FastPath_.addValue(1);
+  }
+
+  void dhcpV4SlowPath() {
+    dhcpV4SlowPath_.addValue(1);
+  }
+
   void dhcpV6BadPkt() {
     dhcpV6BadPkt_.addValue(1);
     dhcpV6DropPkt_.addValue(1);
@@ -187,6 +308,34 @@ class SwitchStats : public boost::noncopyable {
     updateState_.addValue(us.count());
   }
 
+  // A state update the hardware could not apply, and was rolled back
+  void stateUpdateRolledBack() {
+    updateStateRolledBack_.addValue(1);
+  }
+  // Pipelined batches prepared on top of a rolled back state, whose updates
+  // had to be prepared again
+  void stateUpdateBatchesRequeued(uint64_t count) {
+    updateStateBatchesRequeued_.addValue(count);
+  }
+  // Composed updates applied again after a later update of their run failed
+  void stateUpdateReplayed(uint64_t count) {
+    updateStateReplayed_.addValue(count);
+  }
+
+  void stateUpdateQueued(StateUpdatePriority priority,
+                         std::chrono::microseconds us);
+
+  void stateUpdateBatch(uint64_t updates) {
+    updateStateBatch_.addValue(updates);
+  }
+
+  /*
+   * Time spent in one stage of a state update.  This is exported as a
+   * histogram per stage, and as an average per stage and update name.
+   */
+  void stateUpdateStage(folly::StringPiece name, StateUpdateStage stage,
+                        std::chrono::microseconds us);
+
   void routeUpdate(std::chrono::microseconds us, uint64_t routes) {
     // As syncFib() could include no routes.
     if (routes == 0) {
@@ -195,6 +344,97 @@ class SwitchStats : public boost::noncopyable {
     routeUpdate_.addRepeatedValue(us.count() / routes, routes);
   }
 
+  void routesResolved(uint64_t routes) {
+    routesResolved_.addValue(routes);
+  }
+
+  /*
+   * A chunk of a bulk route update split into several state changes has
+   * been applied.
+   */
+  void routeChunkApplied(uint64_t routes) {
+    routeChunks_.addValue(1);
+    routeChunkRoutes_.addValue(routes);
+  }
+
+  // A route update was turned away because too many updates are queued
+  void routeUpdateOverload() {
+    routeUpdateOverloads_.addValue(1);
+  }
+
+  /*
+   * A thrift call completed, in the given time.  Exported per method, as a
+   * histogram of the call time and a count of the calls that failed.
+   */
+  void thriftCall(folly::StringPiece method, std::chrono::microseconds us,
+                  bool failed);
+  /*
+   * The state updates of a thrift call spent queuedUs on the update queue
+   * before being applied, and the call waited waitUs for them in all.
+   */
+  void thriftStateUpdateWait(folly::StringPiece method,
+                             std::chrono::microseconds queuedUs,
+                             std::chrono::microseconds waitUs);
+
+  /*
+   * TUN interface syncs: how long each took, and how many were not needed
+   * because the interfaces had not changed, or because a newer sync
+   * replaced them before they started.
+   */
+  void tunSync(std::chrono::microseconds us) {
+    tunSync_.addValue(us.count());
+  }
+  void tunSyncSkipped() {
+    tunSyncSkipped_.addValue(1);
+  }
+  void tunSyncCoalesced() {
+    tunSyncCoalesced_.addValue(1);
+  }
+
+  /*
+   * Kernel route mirror: route changes sent to the kernel, changes left
+   * queued by the rate limit, and mirrored routes that a consistency check
+   * found to differ in the kernel.
+   */
+  void kernelRouteUpdates(uint64_t routes) {
+    kernelRouteUpdates_.addValue(routes);
+  }
+  void kernelRouteUpdatesDeferred(uint64_t routes) {
+    kernelRouteUpdatesDeferred_.addValue(routes);
+  }
+  void kernelRouteMismatches(uint64_t routes) {
+    kernelRouteMismatches_.addValue(routes);
+  }
+
+  /*
+   * Hardware counters, by how much they increased since the last stats
+   * update.  The port counters are the totals over all ports.
+   */
+  void hwInDiscards(uint64_t pkts) {
+    hwInDiscards_.addValue(pkts);
+  }
+  void hwInErrors(uint64_t pkts) {
+    hwInErrors_.addValue(pkts);
+  }
+  void hwOutDiscards(uint64_t pkts) {
+    hwOutDiscards_.addValue(pkts);
+  }
+  void hwOutErrors(uint64_t pkts) {
+    hwOutErrors_.addValue(pkts);
+  }
+  void hwIpHeaderDrops(uint64_t pkts) {
+    hwIpHeaderDrops_.addValue(pkts);
+  }
+  void hwIpDiscards(uint64_t pkts) {
+    hwIpDiscards_.addValue(pkts);
+  }
+  void hwOversizeDrops(uint64_t pkts) {
+    hwOversizeDrops_.addValue(pkts);
+  }
+  void hwCpuQueueDrops(uint64_t pkts) {
+    hwCpuQueueDrops_.addValue(pkts);
+  }
+
  private:
   // Forbidden copy constructor and assignment operator
   SwitchStats(SwitchStats const &) = delete;
@@ -218,6 +458,22 @@ class SwitchStats : public boost::noncopyable {
   TLTimeseries trapPktErrors_;
   // Trapped packets that the controller didn't know how to handle.
   TLTimeseries trapPktUnhandled_;
+  // Trapped packets dropped because their RxPacketDispatcher queue was full
+  TLTimeseries trapPktDispatchControlDrops_;
+  TLTimeseries trapPktDispatchHostDrops_;
+  TLTimeseries trapPktDispatchOtherDrops_;
+  // Trapped packets accepted and dropped by the RxPacketPolicer, indexed by
+  // RxPolicerClass
+  std::vector<std::unique_ptr<TLTimeseries>> trapPktPolicerAccepted_;
+  std::vector<std::unique_ptr<TLTimeseries>> trapPktPolicerDrops_;
+  // Trapped packets dispatched to each ethertype handler, indexed by the
+  // handler's SwSwitch entry index.
+  std::vector<std::unique_ptr<TLTimeseries>> trapPktEthertype_;
+  // Trapped packets, and a histogram of their sizes, for each port and
+  // protocol, indexed by PortID * TrappedPacketProfiler::NUM_PROTOS +
+  // TrappedProto
+  struct TrappedProtoStats;
+  std::vector<std::unique_ptr<TrappedProtoStats>> trapPktProto_;
   // Trapped packets forwarded to host
   TLTimeseries trapPktToHost_;
   // Trapped packets forwarded to host in bytes
@@ -239,14 +495,55 @@ class SwitchStats : public boost::noncopyable {
   TLTimeseries arpRepliesRx_;
   // ARP requests sent from us
   TLTimeseries arpRequestsTx_;
+  // ARP requests not sent because one was sent for the same address within
+  // the retry window
+  TLTimeseries arpRequestsSuppressed_;
   // ARP replies sent from us
   TLTimeseries arpRepliesTx_;
   // ARP packets with an unknown op field
   TLTimeseries arpBadOp_;
 
+  // Unicast ARP requests and neighbor solicitations sent to refresh
+  // resolved neighbor entries
+  TLTimeseries neighborProbesTx_;
+  // Probes not sent because the hardware saw traffic to the neighbor
+  TLTimeseries neighborProbesSkipped_;
+  // ARP requests and neighbor solicitations sent for the unresolved
+  // nexthops of new routes
+  TLTimeseries neighborPrefetchesTx_;
+  // Gratuitous ARPs and unsolicited neighbor advertisements sent for our
+  // own addresses
+  TLTimeseries neighborAnnouncementsSent_;
+  // Announcements that were due, but had to wait for the rate limit
+  TLTimeseries neighborAnnouncementsDeferred_;
+  // Neighbor entries evicted to stay below the neighbor limits, and new
+  // entries not added because a limit was reached
+  TLTimeseries neighborsEvicted_;
+  TLTimeseries neighborLearnsRejected_;
+  // L2 learn and age events dropped, and learned MACs not added
+  TLTimeseries l2UpdatesDropped_;
+  TLTimeseries l2LearnsRejected_;
+  // Packets to unresolved next hops held until the neighbor resolves, sent
+  // once it did, and dropped because the hold queue was full or the
+  // neighbor did not resolve in time
+  TLTimeseries neighborHoldQueued_;
+  TLTimeseries neighborHoldFlushed_;
+  TLTimeseries neighborHoldDropped_;
+  // Broadcast ARP requests and multicast neighbor solicitations punted by
+  // the neighbor suppression, and answered on behalf of a known host, or
+  // flooded out of the other ports of their VLAN
+  TLTimeseries neighborRequestsSuppressed_;
+  TLTimeseries neighborRequestsFlooded_;
+
   // IPv6 Neighbor Discovery Protocol packets
   TLTimeseries trapPktNdp_;
   TLTimeseries ipv6NdpBad_;
+  // Router advertisements sent early to answer router solicitations
+  TLTimeseries ipv6NdpRaSolicited_;
+  // Router solicitations answered by an advertisement that was already due
+  TLTimeseries ipv6NdpRsAggregated_;
+  // Router solicitations on VLANs where we do not advertise
+  TLTimeseries ipv6NdpRsDropped_;
 
   // IPv4 Packets
   TLTimeseries ipv4Rx_;
@@ -266,6 +563,9 @@ class SwitchStats : public boost::noncopyable {
   // IPv6 hop count exceeded
   TLTimeseries ipv6HopExceeded_;
 
+  // ICMP errors not sent because of the ICMP error rate limits
+  TLTimeseries icmpErrorLimited_;
+
   // UDP packets dropped due to smaller packet size
   TLTimeseries udpTooSmall_;
 
@@ -281,11 +581,20 @@ class SwitchStats : public boost::noncopyable {
   TLTimeseries dhcpV4BadPkt_;
   // DHCPv4 packets dropped
   TLTimeseries dhcpV4DropPkt_;
+  // DHCPv4 packets relayed straight from the received bytes
+  TLTimeseries dhcpV4FastPath_;
+  // DHCPv4 packets that needed a full parse
+  TLTimeseries dhcpV4SlowPath_;
   // stats for dhcpV6
   TLTimeseries dhcpV6Pkt_;
   TLTimeseries dhcpV6BadPkt_;
   TLTimeseries dhcpV6DropPkt_;
 
+  // LLDP PDUs that added a neighbor or changed what we knew about one
+  TLTimeseries lldpNeighborChanged_;
+  // LLDP PDUs identical to the last one from the neighbor
+  TLTimeseries lldpNeighborRefreshed_;
+
   /**
    * Routes add/delete stats
    *
@@ -300,17 +609,111 @@ class SwitchStats : public boost::noncopyable {
    * Histogram for time used for SwSwitch::updateState() (in ms)
    */
   TLHistogram updateState_;
+  // State updates undone after the hardware failed to apply them
+  TLTimeseries updateStateRolledBack_;
+  // Pipelined batches prepared again after a rollback
+  TLTimeseries updateStateBatchesRequeued_;
+  // Composed updates applied again after a failure
+  TLTimeseries updateStateReplayed_;
+
+  /**
+   * Histogram for the time a StateUpdate spent on the pending list before
+   * being applied (in microsecond)
+   */
+  TLHistogram updateStateQueued_;
+  // The same, indexed by StateUpdatePriority
+  std::vector<std::unique_ptr<TLHistogram>> updateStateQueuedByPriority_;
+
+  /**
+   * Histogram for the number of StateUpdates applied together
+   */
+  TLHistogram updateStateBatch_;
+
+  /**
+   * Histograms for the time spent in each stage of the state updates,
+   * indexed by StateUpdateStage (in microsecond)
+   */
+  std::vector<std::unique_ptr<TLHistogram>> updateStateStages_;
+
+  /**
+   * The average time spent in each stage, per update name.  Only the first
+   * kMaxStateUpdateNames names get their own stats; any others are
+   * aggregated under "other".
+   */
+  std::unordered_map<std::string,
+    std::vector<std::unique_ptr<TLTimeseries>>> updateStateStagesByName_;
 
   /**
    * Histogram for time used for route update (in microsecond)
    */
   TLHistogram routeUpdate_;
 
+  /**
+   * Histogram for the number of routes re-resolved by each route update
+   */
+  TLHistogram routesResolved_;
+
+  /**
+   * Chunks of bulk route updates applied, and the routes in them
+   */
+  TLTimeseries routeChunks_;
+  TLTimeseries routeChunkRoutes_;
+
+  /**
+   * Route updates turned away because the state update queue was full
+   */
+  TLTimeseries routeUpdateOverloads_;
+
+  struct ThriftMethodStats {
+    ThriftMethodStats(ThreadLocalStatsMap* map, const std::string& method);
+    TLHistogram us;
+    TLHistogram stateUpdateQueuedUs;
+    TLHistogram stateUpdateWaitUs;
+    TLTimeseries errors;
+  };
+  /**
+   * The stats of each thrift method, created when it is first called
+   */
+  std::unordered_map<std::string, std::unique_ptr<ThriftMethodStats>>
+    thriftMethods_;
+  ThriftMethodStats* getThriftMethodStats(folly::StringPiece method);
+
+  /**
+   * Histogram for time used for TUN interface syncs (in microsecond)
+   */
+  TLHistogram tunSync_;
+  TLTimeseries tunSyncSkipped_;
+  TLTimeseries tunSyncCoalesced_;
+  TLTimeseries kernelRouteUpdates_;
+  TLTimeseries kernelRouteUpdatesDeferred_;
+  TLTimeseries kernelRouteMismatches_;
+
+  /**
+   * Packets dropped in hardware, as reported by HwSwitch::updateStats()
+   */
+  TLTimeseries hwInDiscards_;
+  TLTimeseries hwInErrors_;
+  TLTimeseries hwOutDiscards_;
+  TLTimeseries hwOutErrors_;
+  // IP header errors, which include TTL (or hop limit) expiry
+  TLTimeseries hwIpHeaderDrops_;
+  // IP packets discarded for other reasons, which include L3 lookup misses
+  TLTimeseries hwIpDiscards_;
+  // Frames larger than the MTU
+  TLTimeseries hwOversizeDrops_;
+  // Packets to the CPU dropped because its queues were full
+  TLTimeseries hwCpuQueueDrops_;
+
   // Create a PortStats object for the given PortID
   PortStats* createPortStats(PortID portID);
 
   // Individual port stats objects, indexed by PortID
   PortStatsMap ports_;
+  // The same objects as ports_, in an array indexed by PortID, for port()
+  std::vector<PortStats*> portsByID_;
+
+  // The map that stats created after construction are registered in
+  ThreadLocalStatsMap* map_;
 };
 
 }} // facebook::fboss
@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThreadArenas.h"
+
+#include "fboss/agent/SwitchStats.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Conv.h>
+#include <folly/Malloc.h>
+#include <glog/logging.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+using folly::StringPiece;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+std::atomic<bool> arenasEnabled{false};
+thread_local bool tlApplied{false};
+
+mutex& arenasMutex() {
+  static mutex m;
+  return m;
+}
+// The arena index of each thread name
+std::map<string, unsigned>& arenas() {
+  static std::map<string, unsigned> a;
+  return a;
+}
+
+template<typename T>
+bool readCtl(const string& name, T* value) {
+  size_t len = sizeof(T);
+  return mallctl(name.c_str(), value, &len, nullptr, 0) == 0;
+}
+
+bool createArena(unsigned* arena) {
+  // jemalloc 5 renamed arenas.extend to arenas.create
+  return readCtl("arenas.create", arena) || readCtl("arenas.extend", arena);
+}
+
+uint64_t getAllocated(unsigned arena) {
+  auto prefix = folly::to<string>("stats.arenas.", arena, ".");
+  uint64_t total = 0;
+  // Older versions of jemalloc also have huge allocations
+  for (const char* size : {"small", "large", "huge"}) {
+    size_t allocated;
+    if (readCtl(prefix + size + ".allocated", &allocated)) {
+      total += allocated;
+    }
+  }
+  return total;
+}
+
+uint64_t getResident(unsigned arena, size_t pageSize) {
+  auto prefix = folly::to<string>("stats.arenas.", arena, ".");
+  size_t resident;
+  if (readCtl(prefix + "resident", &resident)) {
+    return resident;
+  }
+  // Older versions only report the pages in active use
+  size_t pages;
+  if (readCtl(prefix + "pactive", &pages)) {
+    return pages * pageSize;
+  }
+  return 0;
+}
+
+} // unnamed namespace
+
+void ThreadArenas::configure(bool enabled) {
+  if (enabled && !folly::usingJEMalloc()) {
+    LOG(WARNING) << "not running on jemalloc, so the agent threads will "
+                 << "share the allocator's arenas";
+    enabled = false;
+  }
+  arenasEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void ThreadArenas::apply(StringPiece name) {
+  if (tlApplied || !arenasEnabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  tlApplied = true;
+
+  unsigned arena;
+  {
+    lock_guard<mutex> g(arenasMutex());
+    auto it = arenas().find(name.str());
+    if (it != arenas().end()) {
+      arena = it->second;
+    } else {
+      if (!createArena(&arena)) {
+        LOG(ERROR) << "cannot create an arena for thread " << name;
+        return;
+      }
+      arenas().emplace(name.str(), arena);
+    }
+  }
+  if (mallctl("thread.arena", nullptr, nullptr, &arena, sizeof(arena)) != 0) {
+    LOG(ERROR) << "cannot move thread " << name << " to arena " << arena;
+    return;
+  }
+  VLOG(2) << "thread " << name << " allocates from arena " << arena;
+}
+
+void ThreadArenas::publish() {
+  std::map<string, unsigned> current;
+  {
+    lock_guard<mutex> g(arenasMutex());
+    current = arenas();
+  }
+  if (current.empty()) {
+    return;
+  }
+
+  // The stats are only refreshed when the epoch is bumped
+  uint64_t epoch = 1;
+  mallctl("epoch", nullptr, nullptr, &epoch, sizeof(epoch));
+  size_t pageSize = 0;
+  readCtl("arenas.page", &pageSize);
+  for (const auto& entry : current) {
+    auto prefix = folly::to<string>(SwitchStats::kCounterPrefix, "arena.",
+                                    entry.first, ".");
+    fbData->setCounter(prefix + "allocated_bytes",
+                       getAllocated(entry.second));
+    fbData->setCounter(prefix + "resident_bytes",
+                       getResident(entry.second, pageSize));
+  }
+}
+
+}} // facebook::fboss
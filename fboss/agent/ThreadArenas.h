@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+
+namespace facebook { namespace fboss {
+
+/*
+ * ThreadArenas gives each named agent thread its own jemalloc arena.
+ *
+ * The update thread clones and frees state nodes, the RX threads churn
+ * through packets, and the thrift workers build responses.  When they all
+ * allocate from the same arenas, the long lived state ends up interleaved
+ * with short lived buffers, and the fragmentation makes the RSS creep up
+ * over weeks.  With an arena each, what a thread frees is reused by the
+ * same kind of allocations.
+ *
+ * Threads move to their arena when they register with the ThreadSampler,
+ * and the thrift workers, which all share the "thrift" arena, when they
+ * start handling a call.  Memory freed by another thread still goes back
+ * to the arena it came from.
+ *
+ * The allocated and resident bytes of each arena are exported as
+ * arena.<thread name>.* counters.  Nothing is done unless the agent runs
+ * on jemalloc.
+ */
+class ThreadArenas {
+ public:
+  /*
+   * Enable the per thread arenas.  This must be called before the threads
+   * are started.
+   */
+  static void configure(bool enabled);
+
+  /*
+   * Move the calling thread to the arena for name, creating the arena the
+   * first time the name is used.  Only the first call on a thread has any
+   * effect, so this is cheap to call on every thrift call.
+   */
+  static void apply(folly::StringPiece name);
+
+  /*
+   * Export the allocated and resident bytes of each arena.
+   */
+  static void publish();
+};
+
+}} // facebook::fboss
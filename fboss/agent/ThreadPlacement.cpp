@@ -0,0 +1,191 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThreadPlacement.h"
+
+#include "fboss/agent/FbossError.h"
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+#include <mutex>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using folly::StringPiece;
+using std::lock_guard;
+using std::mutex;
+using std::vector;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+mutex& placementsMutex() {
+  static mutex m;
+  return m;
+}
+vector<ThreadPlacement::Placement>& placements() {
+  static vector<ThreadPlacement::Placement> p;
+  return p;
+}
+
+int parseInt(StringPiece entry, StringPiece value) {
+  try {
+    return folly::to<int>(value);
+  } catch (const std::exception&) {
+    throw FbossError("invalid thread placement \"", entry, "\": \"", value,
+                     "\" is not a number");
+  }
+}
+
+vector<int> parseCpus(StringPiece entry, StringPiece value) {
+  vector<StringPiece> ranges;
+  folly::split(',', value, ranges, true);
+  vector<int> cpus;
+  for (auto range : ranges) {
+    StringPiece first;
+    StringPiece last;
+    if (!folly::split('-', range, first, last)) {
+      first = range;
+      last = range;
+    }
+    auto begin = parseInt(entry, first);
+    auto end = parseInt(entry, last);
+    if (begin < 0 || end < begin || end >= CPU_SETSIZE) {
+      throw FbossError("invalid thread placement \"", entry,
+                       "\": bad CPU range \"", range, "\"");
+    }
+    for (int cpu = begin; cpu <= end; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty()) {
+    throw FbossError("invalid thread placement \"", entry, "\": no CPUs");
+  }
+  return cpus;
+}
+
+} // unnamed namespace
+
+vector<ThreadPlacement::Placement> ThreadPlacement::parse(
+    StringPiece config) {
+  vector<StringPiece> entries;
+  folly::split(';', config, entries, true);
+  vector<Placement> ret;
+  for (auto entry : entries) {
+    vector<StringPiece> fields;
+    folly::split(':', entry, fields);
+    Placement placement;
+    placement.name = folly::trimWhitespace(fields[0]).str();
+    if (placement.name.empty() || fields.size() < 2) {
+      throw FbossError("invalid thread placement \"", entry,
+                       "\": expected <thread name>:<setting>");
+    }
+    for (size_t i = 1; i < fields.size(); ++i) {
+      StringPiece key;
+      StringPiece value;
+      if (!folly::split('=', fields[i], key, value)) {
+        throw FbossError("invalid thread placement \"", entry,
+                         "\": expected <setting>=<value>");
+      }
+      if (key == "cpus") {
+        placement.cpus = parseCpus(entry, value);
+      } else if (key == "nice") {
+        placement.setNice = true;
+        placement.nice = parseInt(entry, value);
+        if (placement.nice < -20 || placement.nice > 19) {
+          throw FbossError("invalid thread placement \"", entry,
+                           "\": nice must be from -20 to 19");
+        }
+      } else if (key == "fifo" || key == "rr") {
+        placement.policy = key == "fifo" ? SCHED_FIFO : SCHED_RR;
+        placement.priority = parseInt(entry, value);
+        if (placement.priority < sched_get_priority_min(placement.policy) ||
+            placement.priority > sched_get_priority_max(placement.policy)) {
+          throw FbossError("invalid thread placement \"", entry,
+                           "\": real-time priority out of range");
+        }
+      } else {
+        throw FbossError("invalid thread placement \"", entry,
+                         "\": unknown setting \"", key, "\"");
+      }
+    }
+    ret.push_back(std::move(placement));
+  }
+  return ret;
+}
+
+void ThreadPlacement::configure(StringPiece config) {
+  auto parsed = parse(config);
+  lock_guard<mutex> g(placementsMutex());
+  placements() = std::move(parsed);
+}
+
+const ThreadPlacement::Placement* ThreadPlacement::find(
+    const vector<Placement>& placements, StringPiece name) {
+  for (const auto& placement : placements) {
+    StringPiece pattern(placement.name);
+    if (pattern.endsWith('*')) {
+      pattern.pop_back();
+      if (name.startsWith(pattern)) {
+        return &placement;
+      }
+    } else if (name == pattern) {
+      return &placement;
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPlacement::apply(StringPiece name) {
+  Placement placement;
+  {
+    lock_guard<mutex> g(placementsMutex());
+    auto* found = find(placements(), name);
+    if (!found) {
+      return;
+    }
+    placement = *found;
+  }
+
+  if (!placement.cpus.empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (auto cpu : placement.cpus) {
+      CPU_SET(cpu, &cpus);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0) {
+      LOG(ERROR) << "cannot set the CPU affinity of thread " << name << ": "
+                 << folly::errnoStr(err);
+    }
+  }
+  if (placement.policy != SCHED_OTHER) {
+    struct sched_param param;
+    param.sched_priority = placement.priority;
+    int err = pthread_setschedparam(pthread_self(), placement.policy, &param);
+    if (err != 0) {
+      LOG(ERROR) << "cannot set the scheduling policy of thread " << name
+                 << ": " << folly::errnoStr(err);
+    }
+  } else if (placement.setNice) {
+    // On linux, nice values are per thread
+    if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), placement.nice) != 0) {
+      LOG(ERROR) << "cannot set the nice value of thread " << name << ": "
+                 << folly::errnoStr(errno);
+    }
+  }
+  LOG(INFO) << "applied thread placement " << placement.name
+            << " to thread " << name;
+}
+
+}} // facebook::fboss
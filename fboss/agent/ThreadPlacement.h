@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sched.h>
+#include <string>
+#include <vector>
+#include <folly/Range.h>
+
+namespace facebook { namespace fboss {
+
+/*
+ * ThreadPlacement pins the agent's named threads to CPUs and sets their
+ * scheduling priority, so that on switches with few cores the threads that
+ * matter most don't contend with the thrift server or the kernel.
+ *
+ * The configuration, from --thread_placement, is a ';' separated list of
+ *
+ *   <thread name>:<setting>[:<setting>...]
+ *
+ * where a thread name ending in '*' matches any name with that prefix, and
+ * each setting is one of
+ *
+ *   cpus=<cpu list>   the CPUs the thread may run on, e.g. cpus=0-1,3
+ *   nice=<n>          the nice value of a normal thread, from -20 to 19
+ *   fifo=<n>, rr=<n>  a SCHED_FIFO or SCHED_RR real-time priority
+ *
+ * e.g. "fbossUpdateThread:cpus=2-3:nice=-5;sdk_rx:cpus=1:fifo=10".  The
+ * first entry matching a thread is used.
+ *
+ * Threads apply their own placement when they register with the
+ * ThreadSampler, so it follows them wherever they are started.  The name
+ * "thrift" is applied to the main thread before the thrift server starts,
+ * so the server's threads inherit it, just as any thread without a
+ * placement of its own inherits the one of the thread that created it.
+ */
+class ThreadPlacement {
+ public:
+  struct Placement {
+    // The thread name, possibly ending in '*'
+    std::string name;
+    // Empty leaves the CPU affinity alone
+    std::vector<int> cpus;
+    bool setNice{false};
+    int nice{0};
+    // SCHED_FIFO and SCHED_RR use priority, and ignore nice
+    int policy{SCHED_OTHER};
+    int priority{0};
+  };
+
+  /*
+   * Parse a configuration, throwing an FbossError if it is invalid.
+   */
+  static std::vector<Placement> parse(folly::StringPiece config);
+
+  /*
+   * Parse and install the configuration.  This must be called before the
+   * threads it places are started.
+   */
+  static void configure(folly::StringPiece config);
+
+  /*
+   * Apply the placement configured for a name, if any, to the calling
+   * thread.  Failures are logged rather than thrown, since an agent on the
+   * wrong CPU is better than no agent.
+   */
+  static void apply(folly::StringPiece name);
+
+  static const Placement* find(const std::vector<Placement>& placements,
+                               folly::StringPiece name);
+};
+
+}} // facebook::fboss
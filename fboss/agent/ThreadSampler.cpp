@@ -0,0 +1,267 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThreadSampler.h"
+
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/ThreadArenas.h"
+#include "fboss/agent/ThreadPlacement.h"
+#include "common/stats/ExportedTimeseries.h"
+
+#include <folly/Memory.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <cctype>
+#include <pthread.h>
+#include <set>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+
+using facebook::stats::RATE;
+using facebook::stats::SUM;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+using std::lock_guard;
+using std::mutex;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+struct Slot {
+  std::string name;
+  clockid_t cpuClock;
+  std::atomic<ThreadSampler::Activity> current{nullptr};
+  // The thread's CPU time when it was last sampled
+  nanoseconds lastCpu{0};
+};
+
+nanoseconds readClock(clockid_t clock) {
+  struct timespec ts;
+  if (clock_gettime(clock, &ts) != 0) {
+    return nanoseconds(0);
+  }
+  return std::chrono::seconds(ts.tv_sec) + nanoseconds(ts.tv_nsec);
+}
+
+std::string statName(folly::StringPiece name) {
+  std::string ret;
+  ret.reserve(name.size());
+  for (auto c : name) {
+    ret.push_back(isalnum(c) ? tolower(c) : '_');
+  }
+  return ret;
+}
+
+// The registered threads.  Slots are removed when their thread exits, so
+// the sampler only reads the CPU clocks of live threads.
+mutex& registryMutex() {
+  static mutex m;
+  return m;
+}
+std::set<Slot*>& registry() {
+  static std::set<Slot*> slots;
+  return slots;
+}
+
+class SlotHolder {
+ public:
+  ~SlotHolder() {
+    if (slot_) {
+      lock_guard<mutex> g(registryMutex());
+      registry().erase(slot_.get());
+    }
+  }
+  Slot* get() const {
+    return slot_.get();
+  }
+  void reset(std::unique_ptr<Slot> slot) {
+    slot_ = std::move(slot);
+  }
+
+ private:
+  std::unique_ptr<Slot> slot_;
+};
+
+thread_local SlotHolder tlSlot;
+
+ThreadSampler::Activity unattributed() {
+  static ThreadSampler::Activity activity =
+    ThreadSampler::intern("unattributed");
+  return activity;
+}
+
+} // unnamed namespace
+
+ThreadSampler::Activity ThreadSampler::intern(folly::StringPiece name) {
+  static mutex m;
+  static std::unordered_map<std::string, std::unique_ptr<std::string>> names;
+
+  lock_guard<mutex> g(m);
+  auto key = statName(name);
+  auto it = names.find(key);
+  if (it != names.end()) {
+    return it->second.get();
+  }
+  if (names.size() >= kMaxActivities) {
+    key = "other";
+    it = names.find(key);
+    if (it != names.end()) {
+      return it->second.get();
+    }
+  }
+  auto value = folly::make_unique<std::string>(key);
+  return names.emplace(key, std::move(value)).first->second.get();
+}
+
+void ThreadSampler::registerThread(folly::StringPiece name) {
+  if (tlSlot.get()) {
+    return;
+  }
+  auto slot = folly::make_unique<Slot>();
+  slot->name = statName(name);
+  if (pthread_getcpuclockid(pthread_self(), &slot->cpuClock) != 0) {
+    LOG(WARNING) << "cannot sample thread " << name
+                 << ": no CPU clock available";
+    return;
+  }
+  slot->lastCpu = readClock(slot->cpuClock);
+  {
+    lock_guard<mutex> g(registryMutex());
+    registry().insert(slot.get());
+  }
+  tlSlot.reset(std::move(slot));
+  ThreadPlacement::apply(name);
+  ThreadArenas::apply(name);
+}
+
+ThreadSampler::Scope::Scope(Activity activity) {
+  auto* slot = tlSlot.get();
+  if (!slot) {
+    return;
+  }
+  // Only this thread writes its slot, so there is no need for an atomic
+  // exchange
+  current_ = &slot->current;
+  prev_ = current_->load(std::memory_order_relaxed);
+  current_->store(activity, std::memory_order_relaxed);
+}
+
+ThreadSampler::Scope::~Scope() {
+  if (current_) {
+    current_->store(prev_, std::memory_order_relaxed);
+  }
+}
+
+ThreadSampler::ThreadSampler(std::chrono::milliseconds interval)
+  : interval_(interval) {
+}
+
+ThreadSampler::~ThreadSampler() {
+  stop();
+}
+
+void ThreadSampler::start() {
+  CHECK(!thread_.joinable());
+  {
+    lock_guard<mutex> g(stopMutex_);
+    stopping_ = false;
+  }
+  thread_ = std::thread([this] { samplerLoop(); });
+}
+
+void ThreadSampler::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    lock_guard<mutex> g(stopMutex_);
+    stopping_ = true;
+  }
+  stopCV_.notify_one();
+  thread_.join();
+}
+
+void ThreadSampler::samplerLoop() {
+  pthread_setname_np(pthread_self(), "fbossSampler");
+  std::unique_lock<mutex> lock(stopMutex_);
+  while (!stopCV_.wait_for(lock, interval_, [this] { return stopping_; })) {
+    lock.unlock();
+    sample();
+    lock.lock();
+  }
+}
+
+void ThreadSampler::sample() {
+  // Read the clocks first, and update the counters without holding the
+  // registry lock, so threads starting or exiting don't wait on us
+  struct Sample {
+    std::string thread;
+    Activity activity;
+    nanoseconds cpu;
+  };
+  std::vector<Sample> samples;
+  {
+    lock_guard<mutex> g(registryMutex());
+    samples.reserve(registry().size());
+    for (auto* slot : registry()) {
+      auto activity = slot->current.load(std::memory_order_relaxed);
+      auto cpu = readClock(slot->cpuClock);
+      auto used = std::max(cpu - slot->lastCpu, nanoseconds(0));
+      slot->lastCpu = cpu;
+      samples.push_back({slot->name, activity ? activity : unattributed(),
+                         used});
+    }
+  }
+
+  lock_guard<mutex> g(countersMutex_);
+  for (const auto& sample : samples) {
+    auto us = duration_cast<microseconds>(sample.cpu);
+    auto& counter = counters_[std::make_pair(sample.thread, sample.activity)];
+    if (!counter.cpuUs) {
+      counter.cpuUs = folly::make_unique<TLTimeseries>(
+          stats::ThreadCachedServiceData::get()->getThreadStats(),
+          SwitchStats::kCounterPrefix + "thread_cpu." + sample.thread + "." +
+            *sample.activity + ".us",
+          SUM, RATE);
+    }
+    ++counter.totals.samples;
+    counter.totals.cpu += us;
+    counter.cpuUs->addValue(us.count());
+
+    // The thread's total, under a null activity
+    auto& total = counters_[std::make_pair(sample.thread, nullptr)];
+    if (!total.cpuUs) {
+      total.cpuUs = folly::make_unique<TLTimeseries>(
+          stats::ThreadCachedServiceData::get()->getThreadStats(),
+          SwitchStats::kCounterPrefix + "thread_cpu." + sample.thread + ".us",
+          SUM, RATE);
+    }
+    total.cpuUs->addValue(us.count());
+  }
+}
+
+ThreadSampler::TotalsMap ThreadSampler::getTotals() const {
+  TotalsMap totals;
+  lock_guard<mutex> g(countersMutex_);
+  for (const auto& entry : counters_) {
+    if (!entry.first.second) {
+      continue;
+    }
+    auto& total = totals[std::make_pair(entry.first.first,
+                                        *entry.first.second)];
+    total.samples += entry.second.totals.samples;
+    total.cpu += entry.second.totals.cpu;
+  }
+  return totals;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <folly/Range.h>
+#include "common/stats/ThreadCachedServiceData.h"
+
+namespace facebook { namespace fboss {
+
+/*
+ * ThreadSampler shows where the CPU time of the agent's own threads goes,
+ * without attaching an external profiler.
+ *
+ * Threads register themselves with a name, and mark what they are doing
+ * with Scope objects: the StateUpdate being prepared, or the handler of the
+ * packet being processed.  Marking costs a couple of thread-local loads and
+ * stores, so it is always done.
+ *
+ * When a ThreadSampler is running, it wakes up every interval, reads the
+ * CPU time each registered thread used since the last sample, and charges
+ * it to what the thread is doing at that moment.  The totals are exported as
+ * thread_cpu.<thread>.<activity>.us counters, whose rate is the number of
+ * microseconds of CPU per second spent on the activity, along with a
+ * thread_cpu.<thread>.us total per thread.  CPU time used outside of any
+ * Scope is charged to "unattributed".
+ *
+ * Activity names are interned, so that a Scope only has to store a
+ * pointer.  There are at most kMaxActivities of them; names beyond that are
+ * all charged to "other".
+ */
+class ThreadSampler {
+ public:
+  typedef const std::string* Activity;
+  enum : size_t { kMaxActivities = 256 };
+
+  struct Totals {
+    uint64_t samples{0};
+    std::chrono::microseconds cpu{0};
+  };
+  // By thread and activity name
+  typedef std::map<std::pair<std::string, std::string>, Totals> TotalsMap;
+
+  /*
+   * Return the interned activity for a name.  This takes a lock, so callers
+   * on hot paths should intern their names once up front.
+   */
+  static Activity intern(folly::StringPiece name);
+
+  /*
+   * Register the calling thread to be sampled under the given name.  This
+   * does nothing if the thread is already registered, so it can be called
+   * on every entry into code that runs on a thread we did not create, like
+   * the SDK's RX thread.  Threads are unregistered when they exit.
+   *
+   * Registering also applies the thread's ThreadPlacement, if any.
+   */
+  static void registerThread(folly::StringPiece name);
+
+  /*
+   * Scope marks the calling thread as doing something until destroyed.
+   * Scopes can be nested.  They do nothing if the thread is not registered.
+   */
+  class Scope {
+   public:
+    explicit Scope(Activity activity);
+    ~Scope();
+
+   private:
+    // Forbidden copy constructor and assignment operator
+    Scope(Scope const &) = delete;
+    Scope& operator=(Scope const &) = delete;
+
+    std::atomic<Activity>* current_{nullptr};
+    Activity prev_{nullptr};
+  };
+
+  explicit ThreadSampler(std::chrono::milliseconds interval);
+  ~ThreadSampler();
+
+  /*
+   * Start and stop the sampling thread.
+   */
+  void start();
+  void stop();
+
+  /*
+   * Sample every registered thread once.  This is only public for use in
+   * unit tests; the sampling thread calls it every interval.  It must always
+   * be called from the same thread, since the counters it exports are
+   * thread-local.
+   */
+  void sample();
+
+  TotalsMap getTotals() const;
+
+ private:
+  typedef stats::ThreadCachedServiceData::TLTimeseries TLTimeseries;
+
+  struct Counter {
+    Totals totals;
+    std::unique_ptr<TLTimeseries> cpuUs;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  ThreadSampler(ThreadSampler const &) = delete;
+  ThreadSampler& operator=(ThreadSampler const &) = delete;
+
+  void samplerLoop();
+
+  const std::chrono::milliseconds interval_;
+  std::thread thread_;
+  std::mutex stopMutex_;
+  std::condition_variable stopCV_;
+  bool stopping_{false};
+
+  mutable std::mutex countersMutex_;
+  std::map<std::pair<std::string, Activity>, Counter> counters_;
+};
+
+}} // facebook::fboss
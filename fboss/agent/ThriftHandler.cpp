@@ -12,11 +12,21 @@
 #include <folly/IPAddressV4.h>
 #include <folly/IPAddressV6.h>
 #include "fboss/agent/AddressUtil.h"
+#include "fboss/agent/ApplyThriftConfig.h"
 #include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/BootTimeline.h"
+#include "fboss/agent/EventTrace.h"
+#include "fboss/agent/HwSwitch.h"
 #include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/LldpManager.h"
+#include "fboss/agent/PackedRouteDecoder.h"
 #include "fboss/agent/SfpModule.h"
+#include "fboss/agent/StateChangeWatcher.h"
 #include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/ThreadArenas.h"
+#include "fboss/agent/TrappedPacketProfiler.h"
+#include "fboss/agent/UpdateRecorder.h"
 #include "fboss/agent/capture/PktCapture.h"
 #include "fboss/agent/capture/PktCaptureManager.h"
 #include "fboss/agent/hw/mock/MockRxPacket.h"
@@ -24,18 +34,66 @@
 #include "fboss/agent/state/ArpTable.h"
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/MacTable.h"
 #include "fboss/agent/state/NdpTable.h"
 #include "fboss/agent/state/NdpEntry.h"
 #include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/PortMap.h"
 #include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteDelta.h"
 #include "fboss/agent/state/RouteTable.h"
 #include "fboss/agent/state/RouteTableRib.h"
 #include "fboss/agent/state/RouteUpdater.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/StateUpdateHelpers.h"
 #include "fboss/agent/state/SwitchState.h"
 #include "fboss/agent/state/Vlan.h"
 #include "fboss/agent/state/VlanMap.h"
+#include "common/stats/ServiceData.h"
 
+#include <folly/String.h>
 #include <folly/io/IOBuf.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+DEFINE_string(client_admin_distance, "",
+              "The admin distance of the routes of each routing client, as a "
+              "comma separated list of clientId:distance pairs.  When several "
+              "clients add the same prefix, the route with the lowest admin "
+              "distance is used.  Clients not listed get the highest admin "
+              "distance.");
+DEFINE_int32(route_table_generations, 4,
+             "How many generations of the route table handed out to clients "
+             "are kept for getRouteTableDelta()");
+DEFINE_int32(max_state_change_wait_ms, 300000,
+             "The longest time, in milliseconds, waitForStateChanges() waits "
+             "for a change");
+DEFINE_int32(route_update_chunk_size, 10000,
+             "Apply bulk route updates of more routes than this in chunks of "
+             "this many routes, each a separate state change, so that the "
+             "update thread can apply higher priority updates in between and "
+             "no single change holds too many routes.  0 applies each update "
+             "as a single state change.");
+DEFINE_int64(max_queued_routes, 2000000,
+             "How many routes the queued route updates may hold before the "
+             "route thrift APIs turn new route updates away with a retryable "
+             "error.  An update is always let in when no other is queued.  0 "
+             "disables the limit.");
+DEFINE_string(atomic_route_update_clients, "",
+              "The comma separated IDs of the routing clients whose bulk "
+              "route updates are always applied as a single state change, "
+              "so that other readers never see them partially applied.");
+DEFINE_int32(neighbor_page_cache_size, 64,
+             "How many ARP and NDP table pages, each, to keep for answering "
+             "repeated getArpTablePage() and getNdpTablePage() queries of the "
+             "same state generation.  0 disables the cache.");
+DEFINE_bool(cache_thrift_responses, true,
+            "Answer repeated getAllInterfaces(), getInterfaceList() and "
+            "getRouteTable() calls of the same state generation from a "
+            "cache, rather than rebuilding the response each time");
 
 using facebook::fb303::cpp2::fb_status;
 using std::unique_ptr;
@@ -58,15 +116,264 @@ using facebook::network::toIPAddress;
 
 namespace facebook { namespace fboss {
 
+namespace {
+
+IpPrefix toIpPrefix(const folly::IPAddress& network, uint8_t mask) {
+  IpPrefix prefix;
+  prefix.ip = toBinaryAddress(network);
+  prefix.prefixLength = mask;
+  return prefix;
+}
+
+template<typename AddrT>
+UnicastRoute toUnicastRoute(const Route<AddrT>& route) {
+  UnicastRoute tempRoute;
+  tempRoute.dest = toIpPrefix(route.prefix().network, route.prefix().mask);
+  const auto& nexthops = route.getForwardInfo().getNexthops();
+  tempRoute.nextHopAddrs.reserve(nexthops.size());
+  for (const auto& hop : nexthops) {
+    tempRoute.nextHopAddrs.push_back(toBinaryAddress(hop.nexthop));
+  }
+  return tempRoute;
+}
+
+/*
+ * Add the routes of a RIB after the given prefix to the page.  Returns
+ * false, and sets the cursor for the next page, once the page is full.
+ */
+template<typename AddrT>
+bool addRoutePage(RouterID vrf, const RouteTableRib<AddrT>* rib,
+                  const RoutePrefix<AddrT>* after, size_t maxRoutes,
+                  RouteTablePage* page) {
+  const auto& routes = rib->getAllNodes();
+  auto iter = after ? routes.upper_bound(*after) : routes.begin();
+  for (; iter != routes.end(); ++iter) {
+    if (page->routes.size() >= maxRoutes) {
+      page->__isset.next = true;
+      page->next.vrfId = vrf;
+      page->next.__isset.after = true;
+      page->next.after = page->routes.back().dest;
+      return false;
+    }
+    page->routes.push_back(toUnicastRoute(*iter->second));
+  }
+  return true;
+}
+
+const RouteTable& getVrfRouteTable(const RouteTableMap& routeTables,
+                                   int32_t vrfId) {
+  auto routeTable = routeTables.getRouteTableIf(RouterID(vrfId));
+  if (!routeTable) {
+    throw FbossError("No Such VRF ", vrfId);
+  }
+  return *routeTable;
+}
+
+/*
+ * The route the address matches, or a default route without nexthops if
+ * there is none.
+ */
+UnicastRoute lookupRoute(const RouteTable& routeTable,
+                         const folly::IPAddress& addr) {
+  if (addr.isV4()) {
+    auto match = routeTable.getRibV4()->longestMatch(addr.asV4());
+    if (!match) {
+      UnicastRoute route;
+      route.dest = toIpPrefix(IPAddressV4("0.0.0.0"), 0);
+      return route;
+    }
+    return toUnicastRoute(*match);
+  }
+  auto match = routeTable.getRibV6()->longestMatch(addr.asV6());
+  if (!match) {
+    UnicastRoute route;
+    route.dest = toIpPrefix(IPAddressV6("::0"), 0);
+    return route;
+  }
+  return toUnicastRoute(*match);
+}
+
+template<typename DeltaT>
+void addRouteDelta(const DeltaT& ribDelta, RouteTableDelta* delta) {
+  for (const auto& routeDelta : ribDelta) {
+    const auto& newRoute = routeDelta.getNew();
+    if (newRoute) {
+      delta->changed.push_back(toUnicastRoute(*newRoute));
+    } else {
+      const auto& prefix = routeDelta.getOld()->prefix();
+      delta->removed.push_back(toIpPrefix(prefix.network, prefix.mask));
+    }
+  }
+}
+
+template<typename ThriftT, typename EntryT>
+ThriftT toNeighborEntryThrift(const EntryT& entry, const Vlan& vlan) {
+  ThriftT temp;
+  temp.ip = toBinaryAddress(entry.getIP());
+  temp.mac = entry.getMac().toString();
+  temp.port = entry.getPort();
+  temp.vlanName = vlan.getName();
+  temp.vlanID = vlan.getID();
+  return temp;
+}
+
+template<typename EntryT>
+bool matchesQuery(const EntryT& entry, const NeighborQuery& query,
+                  const folly::CIDRNetwork* prefix) {
+  if (query.__isset.port && entry.getPort() != PortID(query.port)) {
+    return false;
+  }
+  if ((query.state == NeighborStateFilter::PENDING && !entry.isPending()) ||
+      (query.state == NeighborStateFilter::REACHABLE && entry.isPending())) {
+    return false;
+  }
+  return !prefix ||
+    IPAddress(entry.getIP()).inSubnet(prefix->first, prefix->second);
+}
+
+/*
+ * Add the entries of a neighbor table after the given address that match
+ * the query to the page.  Returns false, and sets the cursor for the next
+ * page, once the page is full.
+ */
+template<typename PageT, typename TableT>
+bool addNeighborPage(const Vlan& vlan, const TableT& table,
+                     const typename TableT::AddressType* after,
+                     const NeighborQuery& query,
+                     const folly::CIDRNetwork* prefix, size_t maxEntries,
+                     PageT* page) {
+  typedef typename decltype(page->entries)::value_type ThriftT;
+  const auto& entries = table.getAllNodes();
+  auto iter = after ? entries.upper_bound(*after) : entries.begin();
+  for (; iter != entries.end(); ++iter) {
+    const auto& entry = *iter->second;
+    if (!matchesQuery(entry, query, prefix)) {
+      continue;
+    }
+    if (page->entries.size() >= maxEntries) {
+      page->__isset.next = true;
+      page->next.vlanId = page->entries.back().vlanID;
+      page->next.__isset.after = true;
+      page->next.after = page->entries.back().ip;
+      return false;
+    }
+    page->entries.push_back(toNeighborEntryThrift<ThriftT>(entry, vlan));
+  }
+  return true;
+}
+
+// The key of a neighbor table page in the page caches
+string neighborPageKey(const NeighborQuery& query,
+                       const NeighborCursor& cursor, int32_t maxEntries) {
+  string prefix;
+  if (query.__isset.prefix) {
+    prefix = folly::to<string>(toIPAddress(query.prefix.ip).str(), "/",
+                               query.prefix.prefixLength);
+  }
+  string after;
+  if (cursor.__isset.after) {
+    after = toIPAddress(cursor.after).str();
+  }
+  return folly::to<string>(
+      query.__isset.vlanId ? query.vlanId : -1, ",",
+      query.__isset.port ? query.port : -1, ",", prefix, ",",
+      static_cast<int>(query.state), ",", cursor.vlanId, ",", after, ",",
+      maxEntries);
+}
+
+} // unnamed namespace
+
+/*
+ * The stats of a thrift call, exported per method once the call is done:
+ * when a synchronous call returns, or once the last reference to the stats
+ * of an asynchronous call is dropped after it replies.  The call counts as
+ * in flight until then.
+ *
+ * Calls that change the state also report how long they waited for their
+ * state updates, and how much of that the updates spent queued behind
+ * others before the update thread started on them.
+ */
+class ThriftCallStats {
+ public:
+  ThriftCallStats(SwSwitch* sw, const char* method)
+      : sw_(sw),
+        method_(method),
+        start_(std::chrono::steady_clock::now()) {
+    // The thrift workers are not started by the agent, so they move to
+    // their arena on their first call
+    ThreadArenas::apply("thrift");
+    fbData->incrementCounter(inFlightCounter(), 1);
+  }
+  ~ThriftCallStats() {
+    fbData->incrementCounter(inFlightCounter(), -1);
+    // Synchronous calls fail by throwing
+    bool failed = failed_ || std::uncaught_exception();
+    sw_->stats()->thriftCall(method_, usSince(start_), failed);
+  }
+
+  void failed() {
+    failed_ = true;
+  }
+  // Called when the call schedules its state updates
+  void stateUpdateQueued() {
+    queued_ = std::chrono::steady_clock::now();
+  }
+  // Called when the update thread starts on each of the call's updates
+  void stateUpdateStarted() {
+    if (!updateStarted_) {
+      updateStarted_ = true;
+      queuedUs_ = usSince(queued_);
+    }
+  }
+  // Called once the call's state updates have been applied
+  void stateUpdateApplied() {
+    auto waitUs = usSince(queued_);
+    sw_->stats()->thriftStateUpdateWait(
+        method_, updateStarted_ ? queuedUs_ : waitUs, waitUs);
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  ThriftCallStats(ThriftCallStats const &) = delete;
+  ThriftCallStats& operator=(ThriftCallStats const &) = delete;
+
+  typedef std::chrono::time_point<std::chrono::steady_clock> TimePoint;
+
+  static std::chrono::microseconds usSince(TimePoint start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+  }
+  std::string inFlightCounter() const {
+    return folly::to<string>(SwitchStats::kCounterPrefix, "thrift.",
+                             method_, ".in_flight");
+  }
+
+  SwSwitch* sw_;
+  const char* method_;
+  TimePoint start_;
+  TimePoint queued_;
+  bool updateStarted_{false};
+  std::chrono::microseconds queuedUs_{0};
+  bool failed_{false};
+};
+
+/*
+ * The routes are also counted in *queuedRoutes for as long as the stats are
+ * held, which is until the update is applied.
+ */
 class RouteUpdateStats {
  public:
-  RouteUpdateStats(SwSwitch *sw, const std::string& func, uint32_t routes)
+  RouteUpdateStats(SwSwitch *sw, const std::string& func, uint32_t routes,
+                   std::atomic<uint64_t>* queuedRoutes)
       : sw_(sw),
         func_(func),
         routes_(routes),
+        queuedRoutes_(queuedRoutes),
         start_(std::chrono::steady_clock::now()) {
+    queuedRoutes_->fetch_add(routes_);
   }
   ~RouteUpdateStats() {
+    queuedRoutes_->fetch_sub(routes_);
     auto end = std::chrono::steady_clock::now();
     auto duration =
       std::chrono::duration_cast<std::chrono::microseconds>(end - start_);
@@ -78,12 +385,42 @@ class RouteUpdateStats {
   SwSwitch* sw_;
   const std::string func_;
   uint32_t routes_;
+  std::atomic<uint64_t>* queuedRoutes_{nullptr};
   std::chrono::time_point<std::chrono::steady_clock> start_;
 };
 
 ThriftHandler::ThriftHandler(SwSwitch* sw)
   : FacebookBase2("FBOSS"),
-    sw_(sw) {
+    sw_(sw),
+    allInterfacesCache_(FLAGS_cache_thrift_responses ? 1 : 0),
+    interfaceListCache_(FLAGS_cache_thrift_responses ? 1 : 0),
+    routeTableCache_(FLAGS_cache_thrift_responses ? 1 : 0),
+    arpPageCache_(std::max(FLAGS_neighbor_page_cache_size, 0)),
+    ndpPageCache_(std::max(FLAGS_neighbor_page_cache_size, 0)) {
+  std::vector<StringPiece> pairs;
+  folly::split(',', FLAGS_client_admin_distance, pairs, true);
+  for (const auto& pair : pairs) {
+    StringPiece client;
+    StringPiece distance;
+    if (!folly::split(':', pair, client, distance)) {
+      throw FbossError("invalid client admin distance \"", pair, "\"");
+    }
+    adminDistances_[ClientID(folly::to<int16_t>(client))] =
+      folly::to<AdminDistance>(distance);
+  }
+  std::vector<int16_t> atomicClients;
+  folly::split(',', FLAGS_atomic_route_update_clients, atomicClients, true);
+  for (auto client : atomicClients) {
+    atomicClients_.insert(ClientID(client));
+  }
+}
+
+AdminDistance ThriftHandler::getAdminDistance(int16_t client) const {
+  auto iter = adminDistances_.find(ClientID(client));
+  if (iter == adminDistances_.end()) {
+    return kMaxAdminDistance;
+  }
+  return iter->second;
 }
 
 fb_status ThriftHandler::getStatus() {
@@ -109,9 +446,18 @@ void ThriftHandler::flushCountersNow() {
 
 void ThriftHandler::addUnicastRoute(
     int16_t client, std::unique_ptr<UnicastRoute> route) {
+  ThriftCallStats call(sw_, "addUnicastRoute");
   ensureConfigured("addUnicastRoute");
   ensureFibSynced("addUnicastRoute");
-  RouteUpdateStats stats(sw_, "Add", 1);
+  ensureRouteQueueRoom("addUnicastRoute", 1);
+  auto* recorder = sw_->getUpdateRecorder();
+  if (recorder) {
+    recorder->recordAddRoutes(
+        client, getAdminDistance(client),
+        folly::Range<const UnicastRoute*>(route.get(), 1));
+  }
+  EventTrace::record(EventTrace::Type::ROUTE_ADD, client, 1);
+  RouteUpdateStats stats(sw_, "Add", 1, &queuedRoutes_);
   RouterID routerId = RouterID(0); // TODO, default vrf for now
   folly::IPAddress network = toIPAddress(route->dest.ip);
   uint8_t mask = static_cast<uint8_t>(route->dest.prefixLength);
@@ -126,11 +472,16 @@ void ThriftHandler::addUnicastRoute(
     sw_->stats()->addRouteV6();
   }
 
+  RouteNextHopEntry entry(std::move(nexthops), getAdminDistance(client));
+
   // Perform the update
+  auto* callStats = &call;
   auto updateFn = [=](const shared_ptr<SwitchState>& state) {
+    callStats->stateUpdateStarted();
     RouteUpdater updater(state->getRouteTables());
-    updater.addRoute(routerId, network, mask, std::move(nexthops));
+    updater.addRoute(routerId, network, mask, ClientID(client), entry);
     auto newRt = updater.updateDone();
+    sw_->stats()->routesResolved(updater.getNumRoutesResolved());
     if (!newRt) {
       return shared_ptr<SwitchState>();
     }
@@ -138,14 +489,25 @@ void ThriftHandler::addUnicastRoute(
     newState->resetRouteTables(std::move(newRt));
     return newState;
   };
-  sw_->updateStateBlocking("add unicast route", updateFn);
+  call.stateUpdateQueued();
+  sw_->updateStateBlocking("add unicast route", updateFn,
+                           StateUpdatePriority::ROUTE);
+  call.stateUpdateApplied();
 }
 
 void ThriftHandler::deleteUnicastRoute(
     int16_t client, std::unique_ptr<IpPrefix> prefix) {
+  ThriftCallStats call(sw_, "deleteUnicastRoute");
   ensureConfigured("deleteUnicastRoute");
   ensureFibSynced("deleteUnicastRoute");
-  RouteUpdateStats stats(sw_, "Delete", 1);
+  ensureRouteQueueRoom("deleteUnicastRoute", 1);
+  auto* recorder = sw_->getUpdateRecorder();
+  if (recorder) {
+    recorder->recordDeleteRoutes(
+        client, folly::Range<const IpPrefix*>(prefix.get(), 1));
+  }
+  EventTrace::record(EventTrace::Type::ROUTE_DELETE, client, 1);
+  RouteUpdateStats stats(sw_, "Delete", 1, &queuedRoutes_);
   RouterID routerId = RouterID(0); // TODO, default vrf for now
   folly::IPAddress network =  toIPAddress(prefix->ip);
   uint8_t mask = static_cast<uint8_t>(prefix->prefixLength);
@@ -156,10 +518,13 @@ void ThriftHandler::deleteUnicastRoute(
   }
 
   // Perform the update
+  auto* callStats = &call;
   auto updateFn = [=](const shared_ptr<SwitchState>& state) {
+    callStats->stateUpdateStarted();
     RouteUpdater updater(state->getRouteTables());
-    updater.delRoute(routerId, network, mask);
+    updater.delRoute(routerId, network, mask, ClientID(client));
     auto newRt = updater.updateDone();
+    sw_->stats()->routesResolved(updater.getNumRoutesResolved());
     if (!newRt) {
       return shared_ptr<SwitchState>();
     }
@@ -167,18 +532,43 @@ void ThriftHandler::deleteUnicastRoute(
     newState->resetRouteTables(std::move(newRt));
     return newState;
   };
-  sw_->updateStateBlocking("delete unicast route", updateFn);
+  call.stateUpdateQueued();
+  sw_->updateStateBlocking("delete unicast route", updateFn,
+                           StateUpdatePriority::ROUTE);
+  call.stateUpdateApplied();
 }
 
-void ThriftHandler::addUnicastRoutes(
-    int16_t client, std::unique_ptr<std::vector<UnicastRoute>> routes) {
-  ensureConfigured("addUnicastRoutes");
-  ensureFibSynced("addUnicastRoutes");
-  RouteUpdateStats stats(sw_, "Add", routes->size());
-  auto updateFn = [&](const shared_ptr<SwitchState>& state) {
-    RouteUpdater updater(state->getRouteTables());
+void ThriftHandler::async_tm_addUnicastRoutes(
+    VoidCallback callback, int16_t client,
+    std::unique_ptr<std::vector<UnicastRoute>> routes) {
+  auto call = std::make_shared<ThriftCallStats>(sw_, "addUnicastRoutes");
+  try {
+    ensureConfigured("addUnicastRoutes");
+    ensureFibSynced("addUnicastRoutes");
+    ensureRouteQueueRoom("addUnicastRoutes", routes->size());
+  } catch (const std::exception& ex) {
+    call->failed();
+    fail(callback, ex);
+    return;
+  }
+  auto* recorder = sw_->getUpdateRecorder();
+  if (recorder) {
+    recorder->recordAddRoutes(client, getAdminDistance(client),
+                              folly::range(*routes));
+  }
+  EventTrace::record(EventTrace::Type::ROUTE_ADD, client, routes->size());
+  auto stats = std::make_shared<RouteUpdateStats>(sw_, "Add", routes->size(),
+                                                  &queuedRoutes_);
+  auto distance = getAdminDistance(client);
+  // The update runs after this call returns, so it shares ownership of the
+  // routes rather than capturing them by reference.
+  std::shared_ptr<std::vector<UnicastRoute>> toAdd(std::move(routes));
+  auto* sw = sw_;
+  auto addFn = [=](RouteUpdater* updater, size_t begin, size_t end) {
+    call->stateUpdateStarted();
     RouterID routerId = RouterID(0); // TODO, default vrf for now
-    for (const auto& route : *routes) {
+    for (auto i = begin; i < end; ++i) {
+      const auto& route = (*toAdd)[i];
       auto network = toIPAddress(route.dest.ip);
       auto mask = static_cast<uint8_t>(route.dest.prefixLength);
       RouteNextHops nexthops;
@@ -186,14 +576,24 @@ void ThriftHandler::addUnicastRoutes(
       for (const auto& nh : route.nextHopAddrs) {
         nexthops.emplace(toIPAddress(nh));
       }
-      updater.addRoute(routerId, network, mask, std::move(nexthops));
+      updater->addRoute(routerId, network, mask, ClientID(client),
+                        RouteNextHopEntry(std::move(nexthops), distance));
       if (network.isV4()) {
-        sw_->stats()->addRouteV4();
+        sw->stats()->addRouteV4();
       } else {
-        sw_->stats()->addRouteV6();
+        sw->stats()->addRouteV6();
       }
     }
+  };
+  auto chunkError = std::make_shared<std::exception_ptr>();
+  call->stateUpdateQueued();
+  auto lastBegin = scheduleRouteChunks("add unicast route", client,
+                                       toAdd->size(), addFn, chunkError);
+  auto updateFn = [=](const shared_ptr<SwitchState>& state) {
+    RouteUpdater updater(state->getRouteTables());
+    addFn(&updater, lastBegin, toAdd->size());
     auto newRt = updater.updateDone();
+    sw->stats()->routesResolved(updater.getNumRoutesResolved());
     if (!newRt) {
       return shared_ptr<SwitchState>();
     }
@@ -201,29 +601,113 @@ void ThriftHandler::addUnicastRoutes(
     newState->resetRouteTables(std::move(newRt));
     return newState;
   };
-  sw_->updateStateBlocking("add unicast route", updateFn);
+  updateRoutesAsync("add unicast route", std::move(updateFn),
+                    std::move(callback), std::move(stats),
+                    std::move(call), std::move(chunkError));
 }
 
-void ThriftHandler::deleteUnicastRoutes(
-    int16_t client, std::unique_ptr<std::vector<IpPrefix>> prefixes) {
-  ensureConfigured("deleteUnicastRoutes");
-  ensureFibSynced("deleteUnicastRoutes");
-  RouteUpdateStats stats(sw_, "Delete", prefixes->size());
-  // Perform the update
-  auto updateFn = [&](const shared_ptr<SwitchState>& state) {
+void ThriftHandler::async_tm_addUnicastRoutesPacked(
+    VoidCallback callback, int16_t client,
+    std::unique_ptr<PackedRoutes> routes) {
+  auto call = std::make_shared<ThriftCallStats>(sw_,
+                                                "addUnicastRoutesPacked");
+  std::shared_ptr<PackedRouteDecoder> decoder;
+  try {
+    ensureConfigured("addUnicastRoutesPacked");
+    ensureFibSynced("addUnicastRoutesPacked");
+    // Recorded before the decoder takes the routes, so a call then turned
+    // away for lack of queue room is recorded too
+    auto* recorder = sw_->getUpdateRecorder();
+    if (recorder) {
+      recorder->recordAddRoutesPacked(client, getAdminDistance(client),
+                                      *routes);
+    }
+    decoder = std::make_shared<PackedRouteDecoder>(std::move(*routes),
+                                                   getAdminDistance(client));
+    ensureRouteQueueRoom("addUnicastRoutesPacked", decoder->size());
+  } catch (const std::exception& ex) {
+    call->failed();
+    fail(callback, ex);
+    return;
+  }
+  EventTrace::record(EventTrace::Type::ROUTE_ADD, client, decoder->size());
+  auto stats = std::make_shared<RouteUpdateStats>(sw_, "Add", decoder->size(),
+                                                  &queuedRoutes_);
+  auto* sw = sw_;
+  auto addFn = [=](RouteUpdater* updater, size_t begin, size_t end) {
+    call->stateUpdateStarted();
+    RouterID routerId = RouterID(0); // TODO, default vrf for now
+    decoder->addRoutes(updater, routerId, ClientID(client), begin, end);
+  };
+  auto chunkError = std::make_shared<std::exception_ptr>();
+  call->stateUpdateQueued();
+  auto lastBegin = scheduleRouteChunks("add unicast route", client,
+                                       decoder->size(), addFn, chunkError);
+  auto updateFn = [=](const shared_ptr<SwitchState>& state) {
     RouteUpdater updater(state->getRouteTables());
+    addFn(&updater, lastBegin, decoder->size());
+    auto newRt = updater.updateDone();
+    sw->stats()->routesResolved(updater.getNumRoutesResolved());
+    if (!newRt) {
+      return shared_ptr<SwitchState>();
+    }
+    auto newState = state->clone();
+    newState->resetRouteTables(std::move(newRt));
+    return newState;
+  };
+  updateRoutesAsync("add unicast route", std::move(updateFn),
+                    std::move(callback), std::move(stats),
+                    std::move(call), std::move(chunkError));
+}
+
+void ThriftHandler::async_tm_deleteUnicastRoutes(
+    VoidCallback callback, int16_t client,
+    std::unique_ptr<std::vector<IpPrefix>> prefixes) {
+  auto call = std::make_shared<ThriftCallStats>(sw_, "deleteUnicastRoutes");
+  try {
+    ensureConfigured("deleteUnicastRoutes");
+    ensureFibSynced("deleteUnicastRoutes");
+    ensureRouteQueueRoom("deleteUnicastRoutes", prefixes->size());
+  } catch (const std::exception& ex) {
+    call->failed();
+    fail(callback, ex);
+    return;
+  }
+  auto* recorder = sw_->getUpdateRecorder();
+  if (recorder) {
+    recorder->recordDeleteRoutes(client, folly::range(*prefixes));
+  }
+  EventTrace::record(EventTrace::Type::ROUTE_DELETE, client,
+                     prefixes->size());
+  auto stats = std::make_shared<RouteUpdateStats>(sw_, "Delete",
+                                                  prefixes->size(),
+                                                  &queuedRoutes_);
+  std::shared_ptr<std::vector<IpPrefix>> toDelete(std::move(prefixes));
+  auto* sw = sw_;
+  auto deleteFn = [=](RouteUpdater* updater, size_t begin, size_t end) {
+    call->stateUpdateStarted();
     RouterID routerId = RouterID(0); // TODO, default vrf for now
-    for (const auto& prefix : *prefixes) {
+    for (auto i = begin; i < end; ++i) {
+      const auto& prefix = (*toDelete)[i];
       auto network = toIPAddress(prefix.ip);
       auto mask = static_cast<uint8_t>(prefix.prefixLength);
       if (network.isV4()) {
-        sw_->stats()->delRouteV4();
+        sw->stats()->delRouteV4();
       } else {
-        sw_->stats()->delRouteV6();
+        sw->stats()->delRouteV6();
       }
-      updater.delRoute(routerId, network, mask);
+      updater->delRoute(routerId, network, mask, ClientID(client));
     }
+  };
+  auto chunkError = std::make_shared<std::exception_ptr>();
+  call->stateUpdateQueued();
+  auto lastBegin = scheduleRouteChunks("delete unicast route", client,
+                                       toDelete->size(), deleteFn, chunkError);
+  auto updateFn = [=](const shared_ptr<SwitchState>& state) {
+    RouteUpdater updater(state->getRouteTables());
+    deleteFn(&updater, lastBegin, toDelete->size());
     auto newRt = updater.updateDone();
+    sw->stats()->routesResolved(updater.getNumRoutesResolved());
     if (!newRt) {
       return shared_ptr<SwitchState>();
     }
@@ -231,25 +715,68 @@ void ThriftHandler::deleteUnicastRoutes(
     newState->resetRouteTables(std::move(newRt));
     return newState;
   };
-  sw_->updateStateBlocking("delete unicast route", updateFn);
+  updateRoutesAsync("delete unicast route", std::move(updateFn),
+                    std::move(callback), std::move(stats),
+                    std::move(call), std::move(chunkError));
 }
 
-void ThriftHandler::syncFib(
-    int16_t client, std::unique_ptr<std::vector<UnicastRoute>> routes) {
-  ensureConfigured("syncFib");
-  RouteUpdateStats stats(sw_, "Sync", routes->size());
+void ThriftHandler::async_tm_syncFib(
+    VoidCallback callback, int16_t client,
+    std::unique_ptr<std::vector<UnicastRoute>> routes) {
+  auto call = std::make_shared<ThriftCallStats>(sw_, "syncFib");
+  try {
+    ensureConfigured("syncFib");
+    ensureRouteQueueRoom("syncFib", routes->size());
+  } catch (const std::exception& ex) {
+    call->failed();
+    fail(callback, ex);
+    return;
+  }
+  auto* recorder = sw_->getUpdateRecorder();
+  if (recorder) {
+    recorder->recordSyncFib(client, getAdminDistance(client),
+                            folly::range(*routes));
+  }
+  EventTrace::record(EventTrace::Type::ROUTE_SYNC, client, routes->size());
+  auto start = std::chrono::steady_clock::now();
+  auto stats = std::make_shared<RouteUpdateStats>(sw_, "Sync", routes->size(),
+                                                  &queuedRoutes_);
+  auto distance = getAdminDistance(client);
+  std::shared_ptr<std::vector<UnicastRoute>> toSync(std::move(routes));
 
-  // Note that we capture routes by reference here, since it is a unique_ptr.
-  // This is safe since we use updateStateBlocking(), so routes will still
-  // be valid in our scope when updateFn() is called.
-  // We could use folly::MoveWrapper if we did need to capture routes by value.
-  auto updateFn = [&](const shared_ptr<SwitchState>& state) {
-    // create an update object starting from empty
-    RouteUpdater updater(state->getRouteTables(), true);
-    // add all interface routes
-    updater.addInterfaceAndLinkLocalRoutes(state->getInterfaces());
+  // The chunks before the last one only add or change their routes.  The
+  // last one syncs the full set as usual, which leaves only the routes it
+  // removes, and those of the last chunk, to program.
+  auto addFn = [=](RouteUpdater* updater, size_t begin, size_t end) {
+    call->stateUpdateStarted();
+    RouterID routerId = RouterID(0); // TODO, default vrf for now
+    for (auto i = begin; i < end; ++i) {
+      const auto& route = (*toSync)[i];
+      auto network = toIPAddress(route.dest.ip);
+      auto mask = static_cast<uint8_t>(route.dest.prefixLength);
+      RouteNextHops nexthops;
+      nexthops.reserve(route.nextHopAddrs.size());
+      for (const auto& nh : route.nextHopAddrs) {
+        nexthops.emplace(toIPAddress(nh));
+      }
+      updater->addRoute(routerId, network, mask, ClientID(client),
+                        RouteNextHopEntry(std::move(nexthops), distance));
+    }
+  };
+  auto chunkError = std::make_shared<std::exception_ptr>();
+  call->stateUpdateQueued();
+  scheduleRouteChunks("sync fib", client, toSync->size(), addFn, chunkError);
+
+  auto updateFn = [=](const shared_ptr<SwitchState>& state) {
+    call->stateUpdateStarted();
+    // Only this client's routes are replaced.  The routes of other clients
+    // and the interface routes from the config are left alone, and the new
+    // routes are diffed against the existing ones, so only the prefixes
+    // that actually changed are modified and re-resolved.
+    RouteUpdater updater(state->getRouteTables());
     RouterID routerId = RouterID(0); // TODO, default vrf for now
-    for (auto const& route : *routes) {
+    RouteUpdater::ClientRoutes syncRoutes;
+    for (auto const& route : *toSync) {
       folly::IPAddress network = toIPAddress(route.dest.ip);
       uint8_t mask = static_cast<uint8_t>(route.dest.prefixLength);
       RouteNextHops nexthops;
@@ -257,14 +784,18 @@ void ThriftHandler::syncFib(
       for (const auto& nh : route.nextHopAddrs) {
         nexthops.emplace(toIPAddress(nh));
       }
-      updater.addRoute(routerId, network, mask, std::move(nexthops));
+      syncRoutes.add(network, mask,
+                     RouteNextHopEntry(std::move(nexthops), distance));
       if (network.isV4()) {
         sw_->stats()->addRouteV4();
       } else {
         sw_->stats()->addRouteV6();
       }
     }
+    updater.syncClientRoutes(routerId, ClientID(client),
+                             std::move(syncRoutes));
     auto newRt = updater.updateDone();
+    sw_->stats()->routesResolved(updater.getNumRoutesResolved());
     if (!newRt) {
       return shared_ptr<SwitchState>();
     }
@@ -272,16 +803,116 @@ void ThriftHandler::syncFib(
     newState->resetRouteTables(std::move(newRt));
     return newState;
   };
-  sw_->updateStateBlocking("sync fib", updateFn);
+  std::shared_ptr<apache::thrift::HandlerCallback<void>> cb(
+      std::move(callback));
+  auto* sw = sw_;
+  auto done = [sw, cb, stats, call, start, chunkError](
+      const std::exception_ptr& error) {
+    call->stateUpdateApplied();
+    if (*chunkError || error) {
+      call->failed();
+      replyError(cb, *chunkError ? *chunkError : error);
+      return;
+    }
+    // Only the first sync, at boot, makes it into the timeline
+    BootTimeline::get()->recordPhase("fib_sync", start,
+                                     std::chrono::steady_clock::now());
+    // The synced routes are now in hardware, so whatever the warm boot
+    // cache still holds can go.
+    sw->clearWarmBootCache();
+    sw->fibSynced();
+    cb->done();
+  };
+  sw_->updateStateAsync("sync fib", std::move(updateFn), std::move(done),
+                        StateUpdatePriority::ROUTE);
+}
 
-  sw_->clearWarmBootCache();
-  sw_->fibSynced();
+void ThriftHandler::updateRoutesAsync(
+    folly::StringPiece name, StateUpdateFn fn,
+    VoidCallback callback, std::shared_ptr<RouteUpdateStats> stats,
+    std::shared_ptr<ThriftCallStats> call,
+    std::shared_ptr<std::exception_ptr> chunkError) {
+  std::shared_ptr<apache::thrift::HandlerCallback<void>> cb(
+      std::move(callback));
+  // The stats are held until the routes are in hardware, so they measure
+  // the whole update, including the time spent queued behind other updates.
+  auto done = [cb, stats, call, chunkError](
+      const std::exception_ptr& error) {
+    call->stateUpdateApplied();
+    if (*chunkError || error) {
+      call->failed();
+      replyError(cb, *chunkError ? *chunkError : error);
+    } else {
+      cb->done();
+    }
+  };
+  sw_->updateStateAsync(name, std::move(fn), std::move(done),
+                        StateUpdatePriority::ROUTE);
+}
+
+size_t ThriftHandler::scheduleRouteChunks(
+    folly::StringPiece name, int16_t client, size_t numRoutes,
+    RouteChunkFn chunkFn, std::shared_ptr<std::exception_ptr> chunkError) {
+  if (FLAGS_route_update_chunk_size <= 0 ||
+      atomicClients_.count(ClientID(client))) {
+    return 0;
+  }
+  size_t chunkSize = FLAGS_route_update_chunk_size;
+  auto* sw = sw_;
+  auto chunkName = folly::to<string>(name, " chunk");
+  size_t begin = 0;
+  for (; begin + chunkSize < numRoutes; begin += chunkSize) {
+    auto end = begin + chunkSize;
+    auto fn = [sw, chunkFn, begin, end](const shared_ptr<SwitchState>& state) {
+      RouteUpdater updater(state->getRouteTables());
+      chunkFn(&updater, begin, end);
+      auto newRt = updater.updateDone();
+      sw->stats()->routesResolved(updater.getNumRoutesResolved());
+      if (!newRt) {
+        return shared_ptr<SwitchState>();
+      }
+      auto newState = state->clone();
+      newState->resetRouteTables(std::move(newRt));
+      return newState;
+    };
+    // The update fails with the first error, once the last chunk is done
+    auto done = [sw, chunkError, chunkName, begin, end, numRoutes](
+        const std::exception_ptr& error) {
+      if (error && !*chunkError) {
+        *chunkError = error;
+      }
+      sw->stats()->routeChunkApplied(end - begin);
+      VLOG(2) << chunkName << ": " << end << " of " << numRoutes
+              << " routes applied";
+    };
+    auto update = make_unique<CallbackStateUpdate>(
+        chunkName, std::move(fn), std::move(done),
+        StateUpdatePriority::ROUTE);
+    update->setEndsBatch(true);
+    sw_->updateState(std::move(update));
+  }
+  return begin;
+}
+
+void ThriftHandler::replyError(
+    const std::shared_ptr<apache::thrift::HandlerCallback<void>>& cb,
+    const std::exception_ptr& error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception& ex) {
+    fail(cb, ex);
+  }
 }
 
 void ThriftHandler::getAllInterfaces(
     std::map<int32_t, InterfaceDetail>& interfaces) {
+  ThriftCallStats call(sw_, "getAllInterfaces");
   ensureConfigured();
-  for (const auto& intf : (*sw_->getState()->getInterfaces())) {
+  auto state = sw_->getState();
+  if (allInterfacesCache_.get(state->getGeneration(), "", &interfaces)) {
+    return;
+  }
+  for (const auto& intf : (*state->getInterfaces())) {
     auto& interfaceDetail = interfaces[intf->getID()];
 
     interfaceDetail.interfaceName = intf->getName();
@@ -297,17 +928,25 @@ void ThriftHandler::getAllInterfaces(
       interfaceDetail.address.push_back(temp);
     }
   }
+  allInterfacesCache_.put(state->getGeneration(), "", interfaces);
 }
 
 void ThriftHandler::getInterfaceList(std::vector<std::string>& interfaceList) {
+  ThriftCallStats call(sw_, "getInterfaceList");
   ensureConfigured();
-  for (const auto& intf : (*sw_->getState()->getInterfaces())) {
+  auto state = sw_->getState();
+  if (interfaceListCache_.get(state->getGeneration(), "", &interfaceList)) {
+    return;
+  }
+  for (const auto& intf : (*state->getInterfaces())) {
     interfaceList.push_back(intf->getName());
   }
+  interfaceListCache_.put(state->getGeneration(), "", interfaceList);
 }
 
 void ThriftHandler::getInterfaceDetail(InterfaceDetail& interfaceDetail,
                                                         int32_t interfaceId) {
+  ThriftCallStats call(sw_, "getInterfaceDetail");
   ensureConfigured();
   const auto& intf = sw_->getState()->getInterfaces()->getInterfaceIf(
                                                       InterfaceID(interfaceId));
@@ -331,41 +970,237 @@ void ThriftHandler::getInterfaceDetail(InterfaceDetail& interfaceDetail,
 }
 
 void ThriftHandler::getNdpTable(std::vector<NdpEntryThrift>& ndpTable) {
+  ThriftCallStats call(sw_, "getNdpTable");
   ensureConfigured();
   shared_ptr<SwitchState> state = sw_->getState();
   for (const auto& vlan : *state->getVlans()) {
     const auto& ndpTab = vlan->getNdpTable();
     for (const auto& entry : ndpTab->getAllNodes()) {
-      NdpEntryThrift temp;
-      temp.ip = toBinaryAddress(entry.second->getIP());
-      temp.mac = entry.second->getMac().toString();
-      temp.port = entry.second->getPort();
-      temp.vlanName = vlan->getName();
-      temp.vlanID = vlan->getID();
-      ndpTable.push_back(temp);
+      ndpTable.push_back(
+          toNeighborEntryThrift<NdpEntryThrift>(*entry.second, *vlan));
     }
   }
 }
 
 void ThriftHandler::getArpTable(std::vector<ArpEntryThrift>& arpTable) {
+  ThriftCallStats call(sw_, "getArpTable");
   ensureConfigured();
   shared_ptr<SwitchState> state = sw_->getState();
   for (const auto& vlan : *state->getVlans()) {
     const auto& arpTab = vlan->getArpTable();
     for (const auto& entry : arpTab->getAllNodes()) {
-      ArpEntryThrift temp;
-      temp.ip = toBinaryAddress(entry.second->getIP());
-      temp.mac = folly::to<string>(entry.second->getMac());
-      temp.port = entry.second->getPort();
-      temp.vlanName = vlan->getName();
-      temp.vlanID = vlan->getID();
-      arpTable.push_back(temp);
+      arpTable.push_back(
+          toNeighborEntryThrift<ArpEntryThrift>(*entry.second, *vlan));
     }
   }
 }
 
+void ThriftHandler::getL2Table(std::vector<L2EntryThrift>& l2Table) {
+  ThriftCallStats call(sw_, "getL2Table");
+  ensureConfigured();
+  shared_ptr<SwitchState> state = sw_->getState();
+  for (const auto& vlan : *state->getVlans()) {
+    for (const auto& entry : vlan->getMacTable()->getTable()) {
+      L2EntryThrift l2Entry;
+      l2Entry.mac = entry.first.toString();
+      l2Entry.port = entry.second.port;
+      l2Entry.vlanID = vlan->getID();
+      l2Entry.vlanName = vlan->getName();
+      l2Table.push_back(l2Entry);
+    }
+  }
+}
+
+void ThriftHandler::getArpTablePage(ArpTablePage& page,
+                                    std::unique_ptr<NeighborQuery> query,
+                                    std::unique_ptr<NeighborCursor> cursor,
+                                    int32_t maxEntries) {
+  ThriftCallStats call(sw_, "getArpTablePage");
+  getNeighborTablePage(&page, *query, *cursor, maxEntries, &arpPageCache_,
+                       [](const Vlan& vlan) {
+                         return vlan.getArpTable();
+                       });
+}
+
+void ThriftHandler::getNdpTablePage(NdpTablePage& page,
+                                    std::unique_ptr<NeighborQuery> query,
+                                    std::unique_ptr<NeighborCursor> cursor,
+                                    int32_t maxEntries) {
+  ThriftCallStats call(sw_, "getNdpTablePage");
+  getNeighborTablePage(&page, *query, *cursor, maxEntries, &ndpPageCache_,
+                       [](const Vlan& vlan) {
+                         return vlan.getNdpTable();
+                       });
+}
+
+template<typename PageT, typename GetTableFn>
+void ThriftHandler::getNeighborTablePage(
+    PageT* page, const NeighborQuery& query, const NeighborCursor& cursor,
+    int32_t maxEntries, ThriftResponseCache<PageT>* cache,
+    GetTableFn getTable) {
+  typedef typename std::decay<decltype(
+      *getTable(std::declval<const Vlan&>()))>::type TableT;
+  typedef typename TableT::AddressType AddrT;
+  ensureConfigured();
+  if (maxEntries <= 0) {
+    throw FbossError("invalid neighbor table page size ", maxEntries);
+  }
+  auto state = sw_->getState();
+  auto generation = state->getGeneration();
+  auto key = neighborPageKey(query, cursor, maxEntries);
+  if (cache->get(generation, key, page)) {
+    return;
+  }
+
+  folly::CIDRNetwork prefix;
+  if (query.__isset.prefix) {
+    auto mask = static_cast<uint8_t>(query.prefix.prefixLength);
+    prefix = {toIPAddress(query.prefix.ip).mask(mask), mask};
+  }
+  AddrT after;
+  if (cursor.__isset.after) {
+    auto addr = toIPAddress(cursor.after);
+    if (addr.isV4() != std::is_same<AddrT, IPAddressV4>::value) {
+      throw FbossError("cursor address ", addr, " is of the wrong family");
+    }
+    after = AddrT::fromBinary(folly::ByteRange(addr.bytes(),
+                                               addr.byteCount()));
+  }
+
+  page->generation = generation;
+  for (const auto& vlan : *state->getVlans()) {
+    if (vlan->getID() < VlanID(cursor.vlanId) ||
+        (query.__isset.vlanId && vlan->getID() != VlanID(query.vlanId))) {
+      continue;
+    }
+    bool start = vlan->getID() == VlanID(cursor.vlanId);
+    if (!addNeighborPage(*vlan, *getTable(*vlan),
+                         start && cursor.__isset.after ? &after : nullptr,
+                         query, query.__isset.prefix ? &prefix : nullptr,
+                         maxEntries, page)) {
+      break;
+    }
+  }
+  cache->put(generation, key, *page);
+}
+
+void ThriftHandler::getStateMemoryUsage(
+    std::vector<StateMemoryUsageThrift>& memoryUsage) {
+  ThriftCallStats call(sw_, "getStateMemoryUsage");
+  ensureConfigured();
+  auto memStats = sw_->getStateMemoryStats();
+  auto addEntry = [&](const string& name,
+                      const StateMemoryStats::Usage& usage) {
+    StateMemoryUsageThrift temp;
+    temp.subtree = name;
+    temp.nodes = usage.nodes;
+    temp.bytes = usage.bytes;
+    temp.sharedNodes = usage.sharedNodes;
+    temp.sharedBytes = usage.sharedBytes;
+    temp.generation = memStats.getGeneration();
+    memoryUsage.push_back(temp);
+  };
+  addEntry("total", memStats.getTotal());
+  for (const auto& entry : memStats.getSubtrees()) {
+    addEntry(entry.first, entry.second);
+  }
+}
+
+void ThriftHandler::getSlowestStateUpdates(
+    std::vector<StateUpdateProfileThrift>& profiles, int32_t count) {
+  ThriftCallStats call(sw_, "getSlowestStateUpdates");
+  for (const auto& entry : sw_->getSlowestStateUpdates(std::max(count, 0))) {
+    StateUpdateProfileThrift profile;
+    profile.updates = entry.names;
+    profile.numUpdates = entry.numUpdates;
+    profile.generation = entry.generation;
+    profile.startTime = entry.startTime;
+    profile.totalUs = entry.total.count();
+    for (size_t i = 0; i < StateUpdateProfile::kNumStages; ++i) {
+      auto stage = StateUpdateStage(i);
+      profile.stageUs[getStateUpdateStageName(stage)] =
+        entry.getStage(stage).count();
+    }
+    profiles.push_back(std::move(profile));
+  }
+}
+
+void ThriftHandler::getEventTrace(std::vector<EventTraceEntry>& entries) {
+  ThriftCallStats call(sw_, "getEventTrace");
+  for (const auto& event : EventTrace::dump()) {
+    EventTraceEntry entry;
+    entry.timeNs = event.time.count();
+    entry.thread = event.thread;
+    entry.event = EventTrace::getTypeName(event.type);
+    entry.arg1 = event.arg1;
+    entry.arg2 = event.arg2;
+    entry.name = event.name;
+    entry.text = EventTrace::format(event);
+    entries.push_back(std::move(entry));
+  }
+}
+
+void ThriftHandler::getCpuTopTalkers(
+    std::vector<CpuTalkerThrift>& talkers, int32_t count) {
+  ThriftCallStats call(sw_, "getCpuTopTalkers");
+  auto profiler = sw_->getTrappedPacketProfiler();
+  if (!profiler) {
+    return;
+  }
+  for (const auto& entry : profiler->getTopTalkers(std::max(count, 0))) {
+    CpuTalkerThrift talker;
+    talker.mac = folly::to<string>(entry.mac);
+    if (!entry.ip.empty()) {
+      talker.__isset.ip = true;
+      talker.ip = toBinaryAddress(entry.ip);
+    }
+    talker.port = entry.port;
+    talker.proto = TrappedPacketProfiler::getProtoName(entry.proto);
+    talker.packets = entry.packets;
+    talker.bytes = entry.bytes;
+    talkers.push_back(std::move(talker));
+  }
+}
+
+void ThriftHandler::getLldpNeighbors(vector<LinkNeighborThrift>& results) {
+  ThriftCallStats call(sw_, "getLldpNeighbors");
+  ensureConfigured();
+  auto lldpMgr = sw_->getLldpManager();
+  if (!lldpMgr) {
+    throw FbossError("LLDP is not running");
+  }
+  auto now = std::chrono::steady_clock::now();
+  auto secsAgo = [&](std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        now - time).count();
+  };
+  for (const auto& entry : lldpMgr->getNeighbors()) {
+    LinkNeighborThrift neighbor;
+    neighbor.localPort = entry.port;
+    neighbor.localVlan = entry.vlan;
+    neighbor.srcMac = entry.mac.toString();
+    neighbor.chassisIdType = entry.chassisIdType;
+    neighbor.chassisId = entry.printableChassisId();
+    neighbor.portIdType = entry.portIdType;
+    neighbor.portId = entry.printablePortId();
+    if (!entry.systemName.empty()) {
+      neighbor.__isset.systemName = true;
+      neighbor.systemName = entry.systemName;
+    }
+    if (!entry.systemDescription.empty()) {
+      neighbor.__isset.systemDescription = true;
+      neighbor.systemDescription = entry.systemDescription;
+    }
+    neighbor.ttl = entry.ttl;
+    neighbor.receivedSecsAgo = secsAgo(entry.lastReceived);
+    neighbor.changedSecsAgo = secsAgo(entry.lastChanged);
+    results.push_back(std::move(neighbor));
+  }
+}
+
 void ThriftHandler::getPortStatus(map<int32_t, PortStatus>& statusMap,
                                   unique_ptr<vector<int32_t>> ports) {
+  ThriftCallStats call(sw_, "getPortStatus");
   ensureConfigured();
   if (ports->empty()) {
     statusMap = sw_->getPortStatus();
@@ -376,99 +1211,333 @@ void ThriftHandler::getPortStatus(map<int32_t, PortStatus>& statusMap,
   }
 }
 
+void ThriftHandler::getPortStats(map<int32_t, PortStatsThrift>& statsMap,
+                                 unique_ptr<vector<int32_t>> ports) {
+  ThriftCallStats call(sw_, "getPortStats");
+  ensureConfigured();
+  if (ports->empty()) {
+    for (const auto& port : *sw_->getState()->getPorts()) {
+      ports->push_back(port->getID());
+    }
+  }
+  for (auto port : *ports) {
+    HwSwitch::PortCounters counters;
+    if (!sw_->getHw()->getPortCounters(PortID(port), &counters)) {
+      continue;
+    }
+    auto& stats = statsMap[port];
+    stats.inBytes = counters.inBytes;
+    stats.inUnicastPkts = counters.inUnicastPkts;
+    stats.inMulticastPkts = counters.inMulticastPkts;
+    stats.inBroadcastPkts = counters.inBroadcastPkts;
+    stats.inDiscards = counters.inDiscards;
+    stats.inErrors = counters.inErrors;
+    stats.outBytes = counters.outBytes;
+    stats.outUnicastPkts = counters.outUnicastPkts;
+    stats.outMulticastPkts = counters.outMulticastPkts;
+    stats.outBroadcastPkts = counters.outBroadcastPkts;
+    stats.outDiscards = counters.outDiscards;
+    stats.outErrors = counters.outErrors;
+    for (const auto& windowRates : counters.rates) {
+      const auto& perSec = windowRates.perSec;
+      PortRatesThrift rates;
+      rates.windowSecs = windowRates.window.count();
+      rates.inBytes = perSec[PortRateTracker::IN_BYTES];
+      rates.inPkts = perSec[PortRateTracker::IN_PKTS];
+      rates.inDiscards = perSec[PortRateTracker::IN_DISCARDS];
+      rates.outBytes = perSec[PortRateTracker::OUT_BYTES];
+      rates.outPkts = perSec[PortRateTracker::OUT_PKTS];
+      rates.outDiscards = perSec[PortRateTracker::OUT_DISCARDS];
+      stats.rates.push_back(rates);
+    }
+  }
+}
+
 void ThriftHandler::getRouteTable(std::vector<UnicastRoute>& route) {
+  ThriftCallStats call(sw_, "getRouteTable");
   ensureConfigured();
-  for (const auto& routeTable : (*sw_->getState()->getRouteTables())) {
+  auto state = sw_->getState();
+  if (routeTableCache_.get(state->getGeneration(), "", &route)) {
+    return;
+  }
+  for (const auto& routeTable : (*state->getRouteTables())) {
     for (const auto& ipv4Rib : routeTable->getRibV4()->getAllNodes()) {
-      UnicastRoute tempRoute;
-      auto ipv4 = ipv4Rib.second.get();
-      auto fwdInfo = ipv4->getForwardInfo();
-      tempRoute.dest.ip = toBinaryAddress(
-                                                      ipv4->prefix().network);
-      tempRoute.dest.prefixLength = ipv4->prefix().mask;
-      for (const auto& hop : fwdInfo.getNexthops()) {
-        tempRoute.nextHopAddrs.push_back(
-                    toBinaryAddress(hop.nexthop));
-      }
-      route.push_back(tempRoute);
+      route.push_back(toUnicastRoute(*ipv4Rib.second));
     }
     for (const auto& ipv6Rib : routeTable->getRibV6()->getAllNodes()) {
-      UnicastRoute tempRoute;
-      auto ipv6 = ipv6Rib.second.get();
-      auto fwdInfo = ipv6->getForwardInfo();
-      tempRoute.dest.ip = toBinaryAddress(
-                                                     ipv6->prefix().network);
-      tempRoute.dest.prefixLength = ipv6->prefix().mask;
-      for (const auto& hop : fwdInfo.getNexthops()) {
-        tempRoute.nextHopAddrs.push_back(
-                    toBinaryAddress(hop.nexthop));
-      }
-      route.push_back(tempRoute);
+      route.push_back(toUnicastRoute(*ipv6Rib.second));
     }
   }
+  routeTableCache_.put(state->getGeneration(), "", route);
 }
 
-void ThriftHandler::getIpRoute(UnicastRoute& route,
-                                std::unique_ptr<Address> addr, int32_t vrfId) {
+void ThriftHandler::getRouteTablePage(RouteTablePage& page,
+                                      std::unique_ptr<RouteTableCursor> cursor,
+                                      int32_t maxRoutes) {
+  ThriftCallStats call(sw_, "getRouteTablePage");
   ensureConfigured();
-  folly::IPAddress ipAddr = toIPAddress(*addr);
-  auto routeTable = sw_->getState()->getRouteTables()->getRouteTableIf(
-                                                              RouterID(vrfId));
-  if (!routeTable) {
-    throw FbossError("No Such VRF ", vrfId);
+  if (maxRoutes <= 0) {
+    throw FbossError("invalid route table page size ", maxRoutes);
   }
+  auto state = sw_->getState();
+  saveRouteTables(state);
+  page.generation = state->getGeneration();
 
-  if (ipAddr.isV4()) {
-    auto ripV4Rib = routeTable->getRibV4();
-    auto match = ripV4Rib->longestMatch(ipAddr.asV4());
-    if (!match) {
-      route.dest.ip = toBinaryAddress(IPAddressV4("0.0.0.0"));
-      route.dest.prefixLength = 0;
-      return;
+  RouterID startVrf(cursor->vrfId);
+  RoutePrefixV4 afterV4;
+  RoutePrefixV6 afterV6;
+  bool hasAfterV4 = false;
+  bool hasAfterV6 = false;
+  if (cursor->__isset.after) {
+    auto network = toIPAddress(cursor->after.ip);
+    auto mask = static_cast<uint8_t>(cursor->after.prefixLength);
+    if (network.isV4()) {
+      afterV4 = RoutePrefixV4{network.asV4().mask(mask), mask};
+      hasAfterV4 = true;
+    } else {
+      afterV6 = RoutePrefixV6{network.asV6().mask(mask), mask};
+      hasAfterV6 = true;
     }
-    const auto fwdInfo = match->getForwardInfo();
-    route.dest.ip = toBinaryAddress(match->prefix().network);
-    route.dest.prefixLength = match->prefix().mask;
-    for (auto iter = fwdInfo.getNexthops().begin();
-              iter != fwdInfo.getNexthops().end(); ++iter) {
-      route.nextHopAddrs.push_back(toBinaryAddress(iter->nexthop));
+  }
+
+  for (const auto& entry : state->getRouteTables()->getAllNodes()) {
+    auto vrf = entry.first;
+    const auto& table = entry.second;
+    if (vrf < startVrf) {
+      continue;
     }
-  } else {
-    auto ripV6Rib = routeTable->getRibV6();
-    auto match = ripV6Rib->longestMatch(ipAddr.asV6());
-    if (!match) {
-      route.dest.ip = toBinaryAddress(IPAddressV6("::0"));
-      route.dest.prefixLength = 0;
+    bool start = vrf == startVrf;
+    // A cursor in the IPv6 routes is past all of the IPv4 routes
+    if (!(start && hasAfterV6) &&
+        !addRoutePage(vrf, table->getRibV4().get(),
+                      start && hasAfterV4 ? &afterV4 : nullptr,
+                      maxRoutes, &page)) {
+      return;
+    }
+    if (!addRoutePage(vrf, table->getRibV6().get(),
+                      start && hasAfterV6 ? &afterV6 : nullptr,
+                      maxRoutes, &page)) {
       return;
     }
-    const auto fwdInfo = match->getForwardInfo();
-    route.dest.ip = toBinaryAddress(match->prefix().network);
-    route.dest.prefixLength = match->prefix().mask;
-    for (auto iter = fwdInfo.getNexthops().begin();
-              iter != fwdInfo.getNexthops().end(); ++iter) {
-      route.nextHopAddrs.push_back(toBinaryAddress(iter->nexthop));
+  }
+}
+
+void ThriftHandler::getRouteTableDelta(RouteTableDelta& delta,
+                                       int64_t sinceGeneration) {
+  ThriftCallStats call(sw_, "getRouteTableDelta");
+  ensureConfigured();
+  auto oldTables = getSavedRouteTables(sinceGeneration);
+  auto state = sw_->getState();
+  saveRouteTables(state);
+  delta.generation = state->getGeneration();
+
+  // The RIBs share all unchanged routes with the old ones, so walking the
+  // delta only visits what changed.
+  RTMapDelta tablesDelta(oldTables.get(), state->getRouteTables().get());
+  for (const auto& tableDelta : tablesDelta) {
+    addRouteDelta(tableDelta.getRoutesV4Delta(), &delta);
+    addRouteDelta(tableDelta.getRoutesV6Delta(), &delta);
+  }
+}
+
+int64_t ThriftHandler::getStateGeneration() {
+  ThriftCallStats call(sw_, "getStateGeneration");
+  return sw_->getState()->getGeneration();
+}
+
+void ThriftHandler::async_tm_waitForStateChanges(
+    ThriftCallback<StateChanges> callback, int64_t sinceGeneration,
+    int32_t timeoutMs) {
+  auto* watcher = sw_->getStateChangeWatcher();
+  if (!watcher) {
+    fail(callback, FbossError("switch is shutting down"));
+    return;
+  }
+  std::shared_ptr<apache::thrift::HandlerCallback<StateChanges>> cb(
+      std::move(callback));
+  auto done = [cb](const StateChangeWatcher::Changes& changes) {
+    static const std::pair<uint32_t, StateSubsystem> kSubsystems[] = {
+      {StateChangeWatcher::PORTS, StateSubsystem::PORTS},
+      {StateChangeWatcher::VLANS, StateSubsystem::VLANS},
+      {StateChangeWatcher::INTERFACES, StateSubsystem::INTERFACES},
+      {StateChangeWatcher::ROUTES, StateSubsystem::ROUTES},
+      {StateChangeWatcher::ARP, StateSubsystem::ARP},
+      {StateChangeWatcher::NDP, StateSubsystem::NDP},
+    };
+    StateChanges result;
+    result.generation = changes.generation;
+    result.resync = changes.resync;
+    for (const auto& subsystem : kSubsystems) {
+      if (changes.changed & subsystem.first) {
+        result.changed.push_back(subsystem.second);
+      }
     }
+    cb->result(result);
+  };
+  auto timeout = std::min(std::max(timeoutMs, 0),
+                          std::max(FLAGS_max_state_change_wait_ms, 0));
+  watcher->waitForChanges(sinceGeneration, std::chrono::milliseconds(timeout),
+                          std::move(done));
+}
+
+void ThriftHandler::getWarmBootReconciliation(
+    WarmBootReconciliation& status) {
+  ThriftCallStats call(sw_, "getWarmBootReconciliation");
+  HwSwitch::WarmBootReconciliation hwStatus;
+  if (!sw_->getHw()->getWarmBootReconciliation(&hwStatus)) {
+    throw FbossError("warm boot reconciliation is not supported");
+  }
+  status.reused = hwStatus.reused;
+  status.reprogrammed = hwStatus.reprogrammed;
+  status.deleted = hwStatus.deleted;
+  status.remaining = hwStatus.remaining;
+  status.cleanupStarted = hwStatus.cleanupStarted;
+}
+
+void ThriftHandler::dryRunConfig(ConfigDryRun& result,
+                                 std::unique_ptr<std::string> config) {
+  ThriftCallStats call(sw_, "dryRunConfig");
+  ensureConfigured();
+  auto oldState = sw_->getState();
+  auto newState = applyThriftConfigJson(oldState, *config, sw_->getPlatform());
+  if (!newState) {
+    result.changed = false;
+    return;
+  }
+
+  StateDelta delta(oldState, newState);
+  HwSwitch::HwOperationEstimate estimate;
+  if (!sw_->getHw()->estimateStateChange(delta, &estimate)) {
+    throw FbossError("estimating hardware operations is not supported");
+  }
+  result.changed = true;
+  result.portOperations = estimate.ports;
+  result.vlanOperations = estimate.vlans;
+  result.interfaceOperations = estimate.interfaces;
+  result.hostOperations = estimate.hosts;
+  result.routeOperations = estimate.routes;
+}
+
+void ThriftHandler::getBootTimeline(std::vector<BootPhase>& phases) {
+  ThriftCallStats call(sw_, "getBootTimeline");
+  for (const auto& entry : BootTimeline::get()->getPhases()) {
+    BootPhase phase;
+    phase.name = entry.name;
+    phase.startMs = entry.start.count();
+    phase.durationMs = entry.duration.count();
+    phases.push_back(phase);
+  }
+}
+
+void ThriftHandler::saveRouteTables(const shared_ptr<SwitchState>& state) {
+  std::lock_guard<std::mutex> g(savedRouteTablesLock_);
+  savedRouteTables_[state->getGeneration()] = state->getRouteTables();
+  size_t maxSaved = std::max(1, FLAGS_route_table_generations);
+  while (savedRouteTables_.size() > maxSaved) {
+    savedRouteTables_.erase(savedRouteTables_.begin());
+  }
+}
+
+shared_ptr<RouteTableMap> ThriftHandler::getSavedRouteTables(
+    int64_t generation) {
+  std::lock_guard<std::mutex> g(savedRouteTablesLock_);
+  auto iter = savedRouteTables_.find(generation);
+  if (iter == savedRouteTables_.end()) {
+    throw FbossError("route table generation ", generation,
+                     " is no longer available, read the full table with "
+                     "getRouteTablePage() instead");
+  }
+  return iter->second;
+}
+
+void ThriftHandler::getIpRoute(UnicastRoute& route,
+                                std::unique_ptr<Address> addr, int32_t vrfId) {
+  ThriftCallStats call(sw_, "getIpRoute");
+  ensureConfigured();
+  auto routeTables = sw_->getState()->getRouteTables();
+  const auto& routeTable = getVrfRouteTable(*routeTables, vrfId);
+  route = lookupRoute(routeTable, toIPAddress(*addr));
+}
+
+void ThriftHandler::getIpRoutes(std::vector<UnicastRoute>& routes,
+                                std::unique_ptr<std::vector<Address>> addrs,
+                                int32_t vrfId) {
+  ThriftCallStats call(sw_, "getIpRoutes");
+  ensureConfigured();
+  // Hold on to one version of the route tables for all of the lookups
+  auto routeTables = sw_->getState()->getRouteTables();
+  const auto& routeTable = getVrfRouteTable(*routeTables, vrfId);
+  routes.reserve(addrs->size());
+  for (const auto& addr : *addrs) {
+    routes.push_back(lookupRoute(routeTable, toIPAddress(addr)));
   }
 }
 
 void ThriftHandler::startPktCapture(unique_ptr<CaptureInfo> info) {
+  ThriftCallStats call(sw_, "startPktCapture");
   auto* mgr = sw_->getCaptureMgr();
-  auto capture = make_unique<PktCapture>(info->name, info->maxPackets);
+  PktCaptureFilter filter;
+  if (info->__isset.filter) {
+    const auto& thriftFilter = info->filter;
+    if (thriftFilter.__isset.port) {
+      filter.setPort(PortID(thriftFilter.port));
+    }
+    if (thriftFilter.__isset.vlan) {
+      filter.setVlan(VlanID(thriftFilter.vlan));
+    }
+    if (thriftFilter.__isset.ethertype) {
+      if (thriftFilter.ethertype < 0 || thriftFilter.ethertype > 0xffff) {
+        throw FbossError("invalid capture ethertype ", thriftFilter.ethertype);
+      }
+      filter.setEthertype(thriftFilter.ethertype);
+    }
+    if (thriftFilter.__isset.ipProto) {
+      if (thriftFilter.ipProto < 0 || thriftFilter.ipProto > 0xff) {
+        throw FbossError("invalid capture IP protocol ", thriftFilter.ipProto);
+      }
+      filter.setIpProto(thriftFilter.ipProto);
+    }
+    if (thriftFilter.__isset.l4Port) {
+      if (thriftFilter.l4Port < 0 || thriftFilter.l4Port > 0xffff) {
+        throw FbossError("invalid capture L4 port ", thriftFilter.l4Port);
+      }
+      filter.setL4Port(thriftFilter.l4Port);
+    }
+  }
+  if (info->snapLen < 0) {
+    throw FbossError("invalid capture snapLen ", info->snapLen);
+  }
+  if (info->maxFileBytes < 0 || info->maxFileSeconds < 0) {
+    throw FbossError("invalid capture file rotation limits");
+  }
+  auto capture = make_unique<PktCapture>(info->name, info->maxPackets,
+                                         filter, info->snapLen);
+  capture->setFileRotation(info->maxFileBytes,
+                           std::chrono::seconds(info->maxFileSeconds));
   mgr->startCapture(std::move(capture));
 }
 
 void ThriftHandler::stopPktCapture(unique_ptr<std::string> name) {
+  ThriftCallStats call(sw_, "stopPktCapture");
   auto* mgr = sw_->getCaptureMgr();
   mgr->forgetCapture(*name);
 }
 
 void ThriftHandler::stopAllPktCaptures() {
+  ThriftCallStats call(sw_, "stopAllPktCaptures");
   auto* mgr = sw_->getCaptureMgr();
   mgr->forgetAllCaptures();
 }
 
+int32_t ThriftHandler::dumpFlightRecorder(unique_ptr<std::string> name) {
+  ThriftCallStats call(sw_, "dumpFlightRecorder");
+  auto* mgr = sw_->getCaptureMgr();
+  return mgr->dumpFlightRecorder(*name);
+}
+
 void ThriftHandler::sendPkt(int32_t port, int32_t vlan,
                          unique_ptr<folly::fbstring> data) {
+  ThriftCallStats call(sw_, "sendPkt");
   ensureConfigured("sendPkt");
   auto buf = IOBuf::copyBuffer(reinterpret_cast<const uint8_t*>(data->data()),
                                data->size());
@@ -480,6 +1549,7 @@ void ThriftHandler::sendPkt(int32_t port, int32_t vlan,
 
 void ThriftHandler::sendPktHex(int32_t port, int32_t vlan,
                             std::unique_ptr<folly::fbstring> hex) {
+  ThriftCallStats call(sw_, "sendPktHex");
   ensureConfigured("sendPktHex");
   auto pkt = MockRxPacket::fromHex(StringPiece(*hex));
   pkt->setSrcPort(PortID(port));
@@ -487,6 +1557,20 @@ void ThriftHandler::sendPktHex(int32_t port, int32_t vlan,
   sw_->packetReceived(std::move(pkt));
 }
 
+void ThriftHandler::sendPkts(unique_ptr<vector<PacketToSend>> pkts) {
+  ThriftCallStats call(sw_, "sendPkts");
+  ensureConfigured("sendPkts");
+  for (const auto& toSend : *pkts) {
+    auto buf = IOBuf::copyBuffer(
+        reinterpret_cast<const uint8_t*>(toSend.data.data()),
+        toSend.data.size());
+    auto pkt = make_unique<MockRxPacket>(std::move(buf));
+    pkt->setSrcPort(PortID(toSend.port));
+    pkt->setSrcVlan(VlanID(toSend.vlan));
+    sw_->packetReceived(std::move(pkt));
+  }
+}
+
 Vlan* ThriftHandler::getVlan(int32_t vlanId) {
   ensureConfigured();
   return sw_->getState()->getVlans()->getVlan(VlanID(vlanId)).get();
@@ -499,7 +1583,16 @@ Vlan* ThriftHandler::getVlan(const std::string& vlanName) {
 
 int32_t ThriftHandler::flushNeighborEntry(unique_ptr<BinaryAddress> ip,
                                           int32_t vlan) {
+  ThriftCallStats call(sw_, "flushNeighborEntry");
   ensureConfigured("flushNeighborEntry");
+  auto* recorder = sw_->getUpdateRecorder();
+  if (recorder) {
+    NeighborToFlush entry;
+    entry.ip = *ip;
+    entry.vlanId = vlan;
+    recorder->recordFlushNeighbors(
+        folly::Range<const NeighborToFlush*>(&entry, 1));
+  }
 
   auto parsedIP = toIPAddress(*ip);
   VlanID vlanID(vlan);
@@ -510,33 +1603,82 @@ int32_t ThriftHandler::flushNeighborEntry(unique_ptr<BinaryAddress> ip,
   return sw_->getIPv6Handler()->flushNdpEntryBlocking(parsedIP.asV6(), vlanID);
 }
 
+int32_t ThriftHandler::flushNeighborEntries(
+    unique_ptr<vector<NeighborToFlush>> entries) {
+  ThriftCallStats call(sw_, "flushNeighborEntries");
+  ensureConfigured("flushNeighborEntries");
+  auto* recorder = sw_->getUpdateRecorder();
+  if (recorder) {
+    recorder->recordFlushNeighbors(folly::range(*entries));
+  }
+
+  std::vector<std::pair<IPAddress, VlanID>> toFlush;
+  toFlush.reserve(entries->size());
+  for (const auto& entry : *entries) {
+    toFlush.emplace_back(toIPAddress(entry.ip), VlanID(entry.vlanId));
+  }
+  auto* arp = sw_->getArpHandler();
+  auto* ipv6 = sw_->getIPv6Handler();
+  uint32_t count{0};
+  auto updateFn = [&](const shared_ptr<SwitchState>& state) {
+    call.stateUpdateStarted();
+    count = 0;
+    auto newState = state;
+    for (const auto& entry : toFlush) {
+      if (entry.first.isV4()) {
+        count += arp->flushArpEntry(&newState, entry.first.asV4(),
+                                    entry.second);
+      } else {
+        count += ipv6->flushNdpEntry(&newState, entry.first.asV6(),
+                                     entry.second);
+      }
+    }
+    return newState;
+  };
+  call.stateUpdateQueued();
+  sw_->updateStateBlocking("flush neighbor entries", updateFn,
+                           StateUpdatePriority::NEIGHBOR);
+  call.stateUpdateApplied();
+  for (const auto& entry : toFlush) {
+    if (entry.first.isV4()) {
+      arp->forgetArpRequests(entry.first.asV4(), entry.second);
+    }
+  }
+  return count;
+}
+
 void ThriftHandler::getVlanAddresses(Addresses& addrs, int32_t vlan) {
+  ThriftCallStats call(sw_, "getVlanAddresses");
   getVlanAddresses(getVlan(vlan), addrs, toAddress);
 }
 
 void ThriftHandler::getVlanAddressesByName(Addresses& addrs,
     unique_ptr<string> vlan) {
+  ThriftCallStats call(sw_, "getVlanAddressesByName");
   getVlanAddresses(getVlan(*vlan), addrs, toAddress);
 }
 
 void ThriftHandler::getVlanBinaryAddresses(BinaryAddresses& addrs,
     int32_t vlan) {
+  ThriftCallStats call(sw_, "getVlanBinaryAddresses");
   getVlanAddresses(getVlan(vlan), addrs, toBinaryAddress);
 }
 
 void ThriftHandler::getVlanBinaryAddressesByName(BinaryAddresses& addrs,
     const std::unique_ptr<std::string> vlan) {
+  ThriftCallStats call(sw_, "getVlanBinaryAddressesByName");
   getVlanAddresses(getVlan(*vlan), addrs, toBinaryAddress);
 }
 
 void ThriftHandler::getSfpDomInfo(map<int32_t, SfpDom>& domInfos,
                                   unique_ptr<vector<int32_t>> ports) {
+  ThriftCallStats call(sw_, "getSfpDomInfo");
   ensureConfigured();
   if (ports->empty()) {
-    domInfos = sw_->getSfpDoms();
+    sw_->getSfpDoms(domInfos);
   } else {
     for (auto port : *ports) {
-      domInfos[port] = sw_->getSfpDom(PortID(port));
+      sw_->getSfp(PortID(port))->getSfpDom(domInfos[port]);
     }
   }
 }
@@ -556,6 +1698,7 @@ void ThriftHandler::getVlanAddresses(const Vlan* vlan,
 }
 
 BootType ThriftHandler::getBootType() {
+  ThriftCallStats call(sw_, "getBootType");
   return sw_->getBootType();
 }
 
@@ -581,4 +1724,23 @@ void ThriftHandler::ensureFibSynced(StringPiece function) {
   }
   throw FbossError("switch is still initializing, FIB not synced yet");
 }
+
+void ThriftHandler::ensureRouteQueueRoom(StringPiece function,
+                                         size_t numRoutes) {
+  if (sw_->isUpdateQueueFull()) {
+    sw_->stats()->routeUpdateOverload();
+    VLOG(1) << "turning away " << function << ": "
+            << sw_->getNumQueuedUpdates() << " state updates are queued";
+    throw FbossOverloadError("too many state updates queued, retry later");
+  }
+  auto queued = queuedRoutes_.load();
+  if (FLAGS_max_queued_routes > 0 && queued > 0 &&
+      queued + numRoutes > static_cast<uint64_t>(FLAGS_max_queued_routes)) {
+    sw_->stats()->routeUpdateOverload();
+    VLOG(1) << "turning away " << function << " of " << numRoutes
+            << " routes: " << queued << " routes are queued";
+    throw FbossOverloadError("too many routes queued, retry later");
+  }
+}
+
 }} // facebook::fboss
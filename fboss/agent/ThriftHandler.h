@@ -9,16 +9,29 @@
  */
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/ThriftResponseCache.h"
+#include "fboss/agent/state/RouteTypes.h"
 #include "fboss/agent/if/gen-cpp2/FbossCtrl.h"
 #include "common/fb303/cpp/FacebookBase2.h"
 
+#include <boost/container/flat_set.hpp>
+
 namespace facebook { namespace fboss {
 
+class RouteTableMap;
+class RouteUpdateStats;
+class ThriftCallStats;
+class RouteUpdater;
 class SwSwitch;
+class SwitchState;
 class Vlan;
 
 class ThriftHandler : virtual public FbossCtrlSvIf,
@@ -44,12 +57,24 @@ class ThriftHandler : virtual public FbossCtrlSvIf,
       int16_t client, std::unique_ptr<UnicastRoute> route);
   void deleteUnicastRoute(
       int16_t client, std::unique_ptr<IpPrefix> prefix);
-  void addUnicastRoutes(
-      int16_t client, std::unique_ptr<std::vector<UnicastRoute>> routes);
-  void deleteUnicastRoutes(
-      int16_t client, std::unique_ptr<std::vector<IpPrefix>> prefixes);
-  void syncFib(
-      int16_t client, std::unique_ptr<std::vector<UnicastRoute>> routes);
+  /*
+   * The bulk route updates don't tie up a thrift worker thread until the
+   * routes are programmed.  The update is queued to the update thread, where
+   * updates from several calls are batched into one state change, and the
+   * callback completes once the routes are in hardware.
+   */
+  void async_tm_addUnicastRoutes(
+      VoidCallback callback, int16_t client,
+      std::unique_ptr<std::vector<UnicastRoute>> routes) override;
+  void async_tm_deleteUnicastRoutes(
+      VoidCallback callback, int16_t client,
+      std::unique_ptr<std::vector<IpPrefix>> prefixes) override;
+  void async_tm_syncFib(
+      VoidCallback callback, int16_t client,
+      std::unique_ptr<std::vector<UnicastRoute>> routes) override;
+  void async_tm_addUnicastRoutesPacked(
+      VoidCallback callback, int16_t client,
+      std::unique_ptr<PackedRoutes> routes) override;
 
   SwSwitch* getSw() const {
     return sw_;
@@ -59,9 +84,12 @@ class ThriftHandler : virtual public FbossCtrlSvIf,
       std::unique_ptr<folly::fbstring> data);
   void sendPktHex(int32_t port, int32_t vlan,
       std::unique_ptr<folly::fbstring> hex);
+  void sendPkts(std::unique_ptr<std::vector<PacketToSend>> pkts);
 
   int32_t flushNeighborEntry(std::unique_ptr<BinaryAddress> ip,
                              int32_t vlan) override;
+  int32_t flushNeighborEntries(
+      std::unique_ptr<std::vector<NeighborToFlush>> entries) override;
 
   void getVlanAddresses(Addresses& addrs, int32_t vlan) override;
   void getVlanAddressesByName(Addresses& addrs,
@@ -72,16 +100,53 @@ class ThriftHandler : virtual public FbossCtrlSvIf,
   /* Returns the Ip Route for the address */
   void getIpRoute(UnicastRoute& route,
                   std::unique_ptr<Address> addr, int32_t vrfId) override;
+  /* Returns the Ip Route for each address, from the same state */
+  void getIpRoutes(std::vector<UnicastRoute>& routes,
+                   std::unique_ptr<std::vector<Address>> addrs,
+                   int32_t vrfId) override;
   void getAllInterfaces(
       std::map<int32_t, InterfaceDetail>& interfaces) override;
   void getInterfaceList(std::vector<std::string>& interfaceList) override;
   void getRouteTable(std::vector<UnicastRoute>& routeTable) override;
+  void getRouteTablePage(RouteTablePage& page,
+                         std::unique_ptr<RouteTableCursor> cursor,
+                         int32_t maxRoutes) override;
+  void getRouteTableDelta(RouteTableDelta& delta,
+                          int64_t sinceGeneration) override;
+
+  int64_t getStateGeneration() override;
+  void async_tm_waitForStateChanges(ThriftCallback<StateChanges> callback,
+                                    int64_t sinceGeneration,
+                                    int32_t timeoutMs) override;
+  void getWarmBootReconciliation(WarmBootReconciliation& status) override;
+  void dryRunConfig(ConfigDryRun& result,
+                    std::unique_ptr<std::string> config) override;
+  void getBootTimeline(std::vector<BootPhase>& phases) override;
   void getPortStatus(std::map<int32_t, PortStatus>& status,
                      std::unique_ptr<std::vector<int32_t>> ports) override;
+  void getPortStats(std::map<int32_t, PortStatsThrift>& stats,
+                    std::unique_ptr<std::vector<int32_t>> ports) override;
   void getInterfaceDetail(InterfaceDetail& interfaceDetails,
                                           int32_t interfaceId) override;
   void getArpTable(std::vector<ArpEntryThrift>& arpTable) override;
   void getNdpTable(std::vector<NdpEntryThrift>& arpTable) override;
+  void getL2Table(std::vector<L2EntryThrift>& l2Table) override;
+  void getArpTablePage(ArpTablePage& page,
+                       std::unique_ptr<NeighborQuery> query,
+                       std::unique_ptr<NeighborCursor> cursor,
+                       int32_t maxEntries) override;
+  void getNdpTablePage(NdpTablePage& page,
+                       std::unique_ptr<NeighborQuery> query,
+                       std::unique_ptr<NeighborCursor> cursor,
+                       int32_t maxEntries) override;
+  void getStateMemoryUsage(
+      std::vector<StateMemoryUsageThrift>& memoryUsage) override;
+  void getSlowestStateUpdates(
+      std::vector<StateUpdateProfileThrift>& profiles, int32_t count) override;
+  void getCpuTopTalkers(
+      std::vector<CpuTalkerThrift>& talkers, int32_t count) override;
+  void getEventTrace(std::vector<EventTraceEntry>& entries) override;
+  void getLldpNeighbors(std::vector<LinkNeighborThrift>& results) override;
 
   /* Returns the SFP Dom information */
   void getSfpDomInfo(std::map<int32_t, SfpDom>& domInfos,
@@ -92,6 +157,7 @@ class ThriftHandler : virtual public FbossCtrlSvIf,
   void startPktCapture(std::unique_ptr<CaptureInfo> info);
   void stopPktCapture(std::unique_ptr<std::string> name);
   void stopAllPktCaptures();
+  int32_t dumpFlightRecorder(std::unique_ptr<std::string> name);
 
  private:
   Vlan* getVlan(int32_t vlanId);
@@ -123,11 +189,72 @@ class ThriftHandler : virtual public FbossCtrlSvIf,
     // This version of ensureFibSynced() won't log
     ensureFibSynced(folly::StringPiece(nullptr, nullptr));
   }
+  /*
+   * Throws a retryable FbossOverloadError if a route update of numRoutes
+   * routes would go over --max_queued_state_updates or --max_queued_routes.
+   */
+  void ensureRouteQueueRoom(folly::StringPiece function, size_t numRoutes);
+
+  // The admin distance of the routes of the given client
+  AdminDistance getAdminDistance(int16_t client) const;
+
+  /*
+   * Fill in a page of the ARP or NDP tables, using the cache of pages of the
+   * current state generation.  getTable returns the table of a VLAN.
+   */
+  template<typename PageT, typename GetTableFn>
+  void getNeighborTablePage(PageT* page, const NeighborQuery& query,
+                            const NeighborCursor& cursor, int32_t maxEntries,
+                            ThriftResponseCache<PageT>* cache,
+                            GetTableFn getTable);
+
+  typedef std::function<
+    std::shared_ptr<SwitchState>(const std::shared_ptr<SwitchState>&)>
+    StateUpdateFn;
+  /*
+   * Apply a route update, and complete the callback once it is programmed.
+   * The callback fails with *chunkError instead if it is set by then.
+   */
+  void updateRoutesAsync(folly::StringPiece name, StateUpdateFn fn,
+                         VoidCallback callback,
+                         std::shared_ptr<RouteUpdateStats> stats,
+                         std::shared_ptr<ThriftCallStats> call,
+                         std::shared_ptr<std::exception_ptr> chunkError);
+
+  // Make the changes for the routes [begin, end) of a bulk update
+  typedef std::function<void(RouteUpdater* updater, size_t begin, size_t end)>
+    RouteChunkFn;
+  /*
+   * Split a bulk update of numRoutes routes into chunks of
+   * --route_update_chunk_size routes, unless the client's updates are
+   * atomic, and schedule all the chunks but the last as separate state
+   * updates.  Each of them ends its update batch, so higher priority updates
+   * can be applied in between.  The first error of a chunk is saved to
+   * *chunkError.
+   *
+   * Returns the first route of the last chunk, which the caller applies
+   * itself, and is 0 if the update is not split.
+   */
+  size_t scheduleRouteChunks(folly::StringPiece name, int16_t client,
+                             size_t numRoutes, RouteChunkFn chunkFn,
+                             std::shared_ptr<std::exception_ptr> chunkError);
+  /*
+   * Remember the route tables of a state handed out to a client, so that
+   * getRouteTableDelta() can later diff against them.
+   */
+  void saveRouteTables(const std::shared_ptr<SwitchState>& state);
+  std::shared_ptr<RouteTableMap> getSavedRouteTables(int64_t generation);
+  static void replyError(
+      const std::shared_ptr<apache::thrift::HandlerCallback<void>>& cb,
+      const std::exception_ptr& error);
 
-  template<typename Result>
-  void fail(const ThriftCallback<Result>& callback,
-            const std::exception& ex) {
+  template<typename CallbackPtr>
+  static void fail(const CallbackPtr& callback, const std::exception& ex) {
     FbossError error(folly::exceptionStr(ex));
+    auto* fbossError = dynamic_cast<const thrift::FbossBaseError*>(&ex);
+    if (fbossError) {
+      error.retryable = fbossError->retryable;
+    }
     callback->exception(error);
   }
 
@@ -137,6 +264,32 @@ class ThriftHandler : virtual public FbossCtrlSvIf,
    * for the lifetime of the ThriftHandler.
    */
   SwSwitch* sw_;
+  /*
+   * The admin distance of each client that sets one, parsed from
+   * --client_admin_distance.
+   */
+  boost::container::flat_map<ClientID, AdminDistance> adminDistances_;
+  // The clients listed in --atomic_route_update_clients
+  boost::container::flat_set<ClientID> atomicClients_;
+  // The routes of the route updates that have not been applied yet
+  std::atomic<uint64_t> queuedRoutes_{0};
+  /*
+   * The route tables of the last few generations returned to clients, by
+   * generation.  Thanks to the copy-on-write RIBs, keeping them only costs
+   * the routes that changed since.
+   */
+  std::mutex savedRouteTablesLock_;
+  std::map<int64_t, std::shared_ptr<RouteTableMap>> savedRouteTables_;
+  /*
+   * The responses of the read-only calls most often polled by monitoring
+   * clients, for the latest state generation seen.  The neighbor table
+   * pages are kept by query.
+   */
+  ThriftResponseCache<std::map<int32_t, InterfaceDetail>> allInterfacesCache_;
+  ThriftResponseCache<std::vector<std::string>> interfaceListCache_;
+  ThriftResponseCache<std::vector<UnicastRoute>> routeTableCache_;
+  ThriftResponseCache<ArpTablePage> arpPageCache_;
+  ThriftResponseCache<NdpTablePage> ndpPageCache_;
 };
 
 }} // facebook::fboss
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace facebook { namespace fboss {
+
+/*
+ * ThriftResponseCache keeps the responses of a read-only thrift call that
+ * are built from the switch state, by the call's arguments, so that the
+ * many monitoring clients asking the same thing do not each rebuild them.
+ *
+ * Only responses for the latest state generation seen are kept: the cache
+ * empties itself the first time it is used with a newer generation, so no
+ * explicit invalidation is needed when a state is published.  The cache also
+ * empties itself when it holds maxEntries responses, which bounds it for
+ * calls whose arguments vary a lot.
+ */
+template<typename ResponseT>
+class ThriftResponseCache {
+ public:
+  explicit ThriftResponseCache(size_t maxEntries)
+    : maxEntries_(maxEntries) {}
+
+  /*
+   * Copy the response cached for the key into *response, and return true,
+   * if there is one for this state generation.
+   */
+  bool get(int64_t generation, const std::string& key, ResponseT* response) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!setGeneration(generation)) {
+      return false;
+    }
+    auto iter = responses_.find(key);
+    if (iter == responses_.end()) {
+      return false;
+    }
+    *response = iter->second;
+    return true;
+  }
+
+  /*
+   * Cache the response built for the key from this state generation.  It is
+   * dropped if a newer generation has been seen since.
+   */
+  void put(int64_t generation, const std::string& key,
+           const ResponseT& response) {
+    if (maxEntries_ == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!setGeneration(generation)) {
+      return;
+    }
+    if (responses_.size() >= maxEntries_) {
+      responses_.clear();
+    }
+    responses_[key] = response;
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  ThriftResponseCache(ThriftResponseCache const &) = delete;
+  ThriftResponseCache& operator=(ThriftResponseCache const &) = delete;
+
+  // Returns false if the generation is older than the cached responses
+  bool setGeneration(int64_t generation) {
+    if (generation < generation_) {
+      return false;
+    }
+    if (generation > generation_) {
+      responses_.clear();
+      generation_ = generation;
+    }
+    return true;
+  }
+
+  const size_t maxEntries_;
+  std::mutex lock_;
+  int64_t generation_{-1};
+  std::map<std::string, ResponseT> responses_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThriftThreadPools.h"
+
+#include "fboss/agent/SwitchStats.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Conv.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <array>
+
+DEFINE_int32(thrift_update_threads, 4,
+             "The thrift worker threads serving the calls that change routes "
+             "or neighbors");
+DEFINE_int32(thrift_query_threads, 8,
+             "The thrift worker threads serving the other calls, mostly "
+             "queries");
+
+using apache::thrift::concurrency::PRIORITY;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+const PRIORITY kPriorities[] = {
+  apache::thrift::concurrency::HIGH_IMPORTANT,
+  apache::thrift::concurrency::HIGH,
+  apache::thrift::concurrency::IMPORTANT,
+  apache::thrift::concurrency::NORMAL,
+  apache::thrift::concurrency::BEST_EFFORT,
+};
+
+size_t poolSize(PRIORITY priority) {
+  switch (priority) {
+    case apache::thrift::concurrency::HIGH:
+      return std::max(FLAGS_thrift_update_threads, 1);
+    case apache::thrift::concurrency::NORMAL:
+      return std::max(FLAGS_thrift_query_threads, 1);
+    default:
+      return 1;
+  }
+}
+
+} // unnamed namespace
+
+ThriftThreadPools::ThriftThreadPools() {
+  std::array<size_t, apache::thrift::concurrency::N_PRIORITIES> counts;
+  for (auto priority : kPriorities) {
+    counts[priority] = poolSize(priority);
+  }
+  threadManager_ = PriorityThreadManager::newPriorityThreadManager(counts);
+  threadManager_->setNamePrefix("thrift");
+}
+
+void ThriftThreadPools::start() {
+  threadManager_->start();
+}
+
+void ThriftThreadPools::stop() {
+  threadManager_->stop();
+}
+
+void ThriftThreadPools::publishStats() {
+  for (auto priority : kPriorities) {
+    auto prefix = folly::to<std::string>(SwitchStats::kCounterPrefix,
+                                         "thrift_pool.",
+                                         getPoolName(priority), ".");
+    fbData->setCounter(prefix + "workers",
+                       threadManager_->workerCount(priority));
+    fbData->setCounter(prefix + "idle",
+                       threadManager_->idleWorkerCount(priority));
+    fbData->setCounter(prefix + "queued",
+                       threadManager_->pendingTaskCount(priority));
+  }
+}
+
+const char* ThriftThreadPools::getPoolName(Priority priority) {
+  switch (priority) {
+    case apache::thrift::concurrency::HIGH_IMPORTANT:
+      return "high_important";
+    case apache::thrift::concurrency::HIGH:
+      return "update";
+    case apache::thrift::concurrency::IMPORTANT:
+      return "important";
+    case apache::thrift::concurrency::NORMAL:
+      return "query";
+    case apache::thrift::concurrency::BEST_EFFORT:
+      return "best_effort";
+    case apache::thrift::concurrency::N_PRIORITIES:
+      break;
+  }
+  return "unknown";
+}
+
+}} // facebook::fboss
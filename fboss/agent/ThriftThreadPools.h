@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "thrift/lib/cpp/concurrency/ThreadManager.h"
+
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+/*
+ * The worker threads of the thrift server, split into a pool per request
+ * priority so that the routing daemons' updates don't queue behind
+ * monitoring dumping the route or neighbor tables.
+ *
+ * The calls that change routes or neighbors are annotated with HIGH
+ * priority in ctrl.thrift, and run in the update pool of
+ * --thrift_update_threads threads.  Everything else has the default
+ * NORMAL priority, and runs in the query pool of --thrift_query_threads
+ * threads.  The remaining priorities get a single thread each, so a call
+ * annotated with one of them still runs.
+ */
+class ThriftThreadPools {
+ public:
+  typedef apache::thrift::concurrency::PriorityThreadManager
+    PriorityThreadManager;
+  typedef apache::thrift::concurrency::PRIORITY Priority;
+
+  ThriftThreadPools();
+
+  /*
+   * Start the worker threads.  They inherit the placement of the calling
+   * thread.
+   */
+  void start();
+  void stop();
+
+  std::shared_ptr<PriorityThreadManager> getThreadManager() const {
+    return threadManager_;
+  }
+
+  /*
+   * Export the number of workers and queued calls of each pool.  This is
+   * called once a second.
+   */
+  void publishStats();
+
+  /*
+   * The name of the pool serving a priority in the counters.
+   */
+  static const char* getPoolName(Priority priority);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  ThriftThreadPools(ThriftThreadPools const &) = delete;
+  ThriftThreadPools& operator=(ThriftThreadPools const &) = delete;
+
+  std::shared_ptr<PriorityThreadManager> threadManager_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * A hierarchical timer wheel.
+ *
+ * Time is measured in ticks, whose length is up to the caller.  Keys that
+ * expire within the next 64 ticks are kept in slots of the first level; keys
+ * further out are kept in coarser levels, and are cascaded down one level
+ * each time the level below wraps around.  Scheduling is O(1), and advancing
+ * only touches the keys that expire or cascade, never the whole set.
+ *
+ * Keys are never removed early.  Callers that need to cancel or reschedule a
+ * key should check, when it expires, whether it is still current.
+ *
+ * TimerWheel is not thread safe.
+ */
+template<typename Key>
+class TimerWheel {
+ public:
+  enum : uint32_t {
+    SLOT_BITS = 6,
+    NUM_SLOTS = 1 << SLOT_BITS,
+    NUM_LEVELS = 4,
+  };
+
+  explicit TimerWheel(uint64_t currentTick = 0)
+    : currentTick_(currentTick) {}
+
+  uint64_t getCurrentTick() const {
+    return currentTick_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  /*
+   * The next tick at which advance() has any work to do: either a key
+   * expires, or a coarser slot cascades down.  This is a lower bound on the
+   * next expiry, so callers can sleep until then instead of waking up on
+   * every tick.  Returns the maximum uint64_t if the wheel is empty.
+   */
+  uint64_t getNextEventTick() const {
+    auto next = std::numeric_limits<uint64_t>::max();
+    for (uint32_t i = 1; i < NUM_SLOTS; ++i) {
+      if (!levels_[0][(currentTick_ + i) & (NUM_SLOTS - 1)].empty()) {
+        next = currentTick_ + i;
+        break;
+      }
+    }
+    for (uint32_t level = 1; level < NUM_LEVELS; ++level) {
+      auto shift = SLOT_BITS * level;
+      auto base = currentTick_ >> shift;
+      for (uint32_t i = 1; i <= NUM_SLOTS; ++i) {
+        auto boundary = (base + i) << shift;
+        if (boundary >= next) {
+          break;
+        }
+        if (!levels_[level][(base + i) & (NUM_SLOTS - 1)].empty()) {
+          next = boundary;
+          break;
+        }
+      }
+    }
+    return next;
+  }
+
+  /*
+   * Schedule key to expire at the given tick.  Ticks that are already in
+   * the past expire on the next call to advance().
+   */
+  void schedule(Key key, uint64_t expiryTick) {
+    if (expiryTick <= currentTick_) {
+      expiryTick = currentTick_ + 1;
+    }
+    insert(Entry(std::move(key), expiryTick));
+    ++size_;
+  }
+
+  /*
+   * Advance to the given tick, calling expired(key) for every key that
+   * expires along the way, in expiry order.
+   */
+  template<typename Fn>
+  void advance(uint64_t toTick, Fn&& expired) {
+    if (size_ == 0) {
+      // Nothing can expire, so skip straight there
+      if (toTick > currentTick_) {
+        currentTick_ = toTick;
+      }
+      return;
+    }
+    while (currentTick_ < toTick) {
+      ++currentTick_;
+      cascade();
+      auto& slot = levels_[0][currentTick_ & (NUM_SLOTS - 1)];
+      if (slot.empty()) {
+        continue;
+      }
+      std::vector<Entry> entries;
+      entries.swap(slot);
+      size_ -= entries.size();
+      for (auto& entry : entries) {
+        expired(entry.first);
+      }
+      if (size_ == 0) {
+        currentTick_ = toTick;
+        return;
+      }
+    }
+  }
+
+ private:
+  typedef std::pair<Key, uint64_t> Entry;
+  typedef std::array<std::vector<Entry>, NUM_SLOTS> Level;
+
+  void insert(Entry entry) {
+    auto delta = entry.second - currentTick_;
+    uint32_t level = 0;
+    while (level < NUM_LEVELS - 1 &&
+           delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+      ++level;
+    }
+    auto tick = entry.second;
+    if (level == NUM_LEVELS - 1) {
+      // Beyond the range of the wheel: park it in the furthest slot, and
+      // let it cascade back in as time passes.
+      auto maxDelta = (uint64_t(1) << (SLOT_BITS * NUM_LEVELS)) - 1;
+      if (delta > maxDelta) {
+        tick = currentTick_ + maxDelta;
+      }
+    }
+    auto idx = (tick >> (SLOT_BITS * level)) & (NUM_SLOTS - 1);
+    levels_[level][idx].push_back(std::move(entry));
+  }
+
+  /*
+   * When a level wraps around, move the next slot of the level above down.
+   */
+  void cascade() {
+    for (uint32_t level = 1; level < NUM_LEVELS; ++level) {
+      if ((currentTick_ & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0) {
+        return;
+      }
+      auto idx = (currentTick_ >> (SLOT_BITS * level)) & (NUM_SLOTS - 1);
+      std::vector<Entry> entries;
+      entries.swap(levels_[level][idx]);
+      for (auto& entry : entries) {
+        insert(std::move(entry));
+      }
+    }
+  }
+
+  uint64_t currentTick_{0};
+  size_t size_{0};
+  std::array<Level, NUM_LEVELS> levels_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,204 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/TrappedPacketProfiler.h"
+
+#include <folly/io/Cursor.h>
+#include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/IPv4Handler.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/LldpManager.h"
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+#include <algorithm>
+#include <mutex>
+
+using folly::IPAddress;
+using folly::MacAddress;
+using folly::io::Cursor;
+
+namespace facebook { namespace fboss {
+
+TrappedPacketProfiler::TrappedPacketProfiler(uint32_t sampleRate,
+                                             size_t maxEntries,
+                                             std::chrono::seconds halfLife)
+  : sampleRate_(std::max<uint32_t>(sampleRate, 1)),
+    maxEntries_(std::max<size_t>(maxEntries, 1)),
+    halfLife_(halfLife),
+    nextDecay_(std::chrono::steady_clock::now() + halfLife) {
+}
+
+TrappedProto TrappedPacketProfiler::classify(uint16_t ethertype,
+                                             Cursor cursor) {
+  try {
+    switch (ethertype) {
+    case ArpHandler::ETHERTYPE_ARP:
+      return TrappedProto::ARP;
+    case LldpManager::ETHERTYPE_LLDP:
+      return TrappedProto::LLDP;
+    case IPv4Handler::ETHERTYPE_IPV4:
+      // Everything up to and including the TTL
+      cursor += 9;
+      switch (cursor.read<uint8_t>()) {
+      case IP_PROTO_TCP:
+        return TrappedProto::IPV4_TCP;
+      case IP_PROTO_UDP:
+        return TrappedProto::IPV4_UDP;
+      case IP_PROTO_ICMP:
+        return TrappedProto::IPV4_ICMP;
+      default:
+        return TrappedProto::IPV4_OTHER;
+      }
+    case IPv6Handler::ETHERTYPE_IPV6:
+      // Version, traffic class and flow label, then the payload length
+      cursor += 6;
+      switch (cursor.read<uint8_t>()) {
+      case IP_PROTO_TCP:
+        return TrappedProto::IPV6_TCP;
+      case IP_PROTO_UDP:
+        return TrappedProto::IPV6_UDP;
+      case IP_PROTO_IPV6_ICMP:
+        return TrappedProto::IPV6_ICMP;
+      default:
+        return TrappedProto::IPV6_OTHER;
+      }
+    default:
+      return TrappedProto::OTHER;
+    }
+  } catch (const std::out_of_range& ex) {
+    // Truncated packets are handled, and counted, by the protocol handlers
+    return TrappedProto::OTHER;
+  }
+}
+
+const char* TrappedPacketProfiler::getProtoName(TrappedProto proto) {
+  switch (proto) {
+  case TrappedProto::ARP:
+    return "arp";
+  case TrappedProto::LLDP:
+    return "lldp";
+  case TrappedProto::IPV4_TCP:
+    return "ipv4_tcp";
+  case TrappedProto::IPV4_UDP:
+    return "ipv4_udp";
+  case TrappedProto::IPV4_ICMP:
+    return "ipv4_icmp";
+  case TrappedProto::IPV4_OTHER:
+    return "ipv4_other";
+  case TrappedProto::IPV6_TCP:
+    return "ipv6_tcp";
+  case TrappedProto::IPV6_UDP:
+    return "ipv6_udp";
+  case TrappedProto::IPV6_ICMP:
+    return "ipv6_icmp";
+  case TrappedProto::IPV6_OTHER:
+    return "ipv6_other";
+  case TrappedProto::OTHER:
+    return "other";
+  }
+  return "unknown";
+}
+
+IPAddress TrappedPacketProfiler::parseSrcIP(uint16_t ethertype,
+                                            Cursor cursor) {
+  try {
+    switch (ethertype) {
+    case ArpHandler::ETHERTYPE_ARP:
+      // Hardware and protocol types and lengths, the opcode and the sender
+      // MAC
+      cursor += 14;
+      return IPAddress(PktUtil::readIPv4(&cursor));
+    case IPv4Handler::ETHERTYPE_IPV4:
+      cursor += 12;
+      return IPAddress(PktUtil::readIPv4(&cursor));
+    case IPv6Handler::ETHERTYPE_IPV6:
+      cursor += 8;
+      return IPAddress(PktUtil::readIPv6(&cursor));
+    default:
+      return IPAddress();
+    }
+  } catch (const std::out_of_range& ex) {
+    return IPAddress();
+  }
+}
+
+void TrappedPacketProfiler::recordSample(PortID port, MacAddress src,
+                                         uint16_t ethertype,
+                                         TrappedProto proto, Cursor cursor,
+                                         uint32_t length, TimePoint now) {
+  Key key(src, parseSrcIP(ethertype, cursor));
+
+  std::lock_guard<folly::SpinLock> g(lock_);
+  decay(now);
+  auto it = talkers_.find(key);
+  if (it == talkers_.end()) {
+    if (talkers_.size() >= maxEntries_) {
+      evictLowest();
+    }
+    it = talkers_.emplace(key, Talker()).first;
+    it->second.mac = key.first;
+    it->second.ip = key.second;
+  }
+  auto& talker = it->second;
+  talker.port = port;
+  talker.proto = proto;
+  talker.packets += sampleRate_;
+  talker.bytes += static_cast<uint64_t>(length) * sampleRate_;
+}
+
+std::vector<TrappedPacketProfiler::Talker>
+TrappedPacketProfiler::getTopTalkers(size_t count, TimePoint now) const {
+  std::vector<Talker> talkers;
+  {
+    std::lock_guard<folly::SpinLock> g(lock_);
+    decay(now);
+    talkers.reserve(talkers_.size());
+    for (const auto& entry : talkers_) {
+      talkers.push_back(entry.second);
+    }
+  }
+  auto busier = [](const Talker& a, const Talker& b) {
+    return a.packets > b.packets;
+  };
+  count = std::min(count, talkers.size());
+  std::partial_sort(talkers.begin(), talkers.begin() + count, talkers.end(),
+                    busier);
+  talkers.resize(count);
+  return talkers;
+}
+
+void TrappedPacketProfiler::decay(TimePoint now) const {
+  if (halfLife_.count() <= 0 || now < nextDecay_) {
+    return;
+  }
+  auto periods = 1 + (now - nextDecay_) / halfLife_;
+  nextDecay_ += periods * halfLife_;
+  auto shift = std::min<int64_t>(periods, 63);
+  for (auto it = talkers_.begin(); it != talkers_.end();) {
+    it->second.packets >>= shift;
+    it->second.bytes >>= shift;
+    if (it->second.packets == 0) {
+      it = talkers_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void TrappedPacketProfiler::evictLowest() {
+  auto lowest = std::min_element(
+      talkers_.begin(), talkers_.end(),
+      [](const TalkerMap::value_type& a, const TalkerMap::value_type& b) {
+        return a.second.packets < b.second.packets;
+      });
+  talkers_.erase(lowest);
+}
+
+}} // facebook::fboss
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <folly/IPAddress.h>
+#include <folly/MacAddress.h>
+#include <folly/SpinLock.h>
+
+namespace folly { namespace io {
+class Cursor;
+}}
+
+namespace facebook { namespace fboss {
+
+/*
+ * The protocols trapped packets are profiled by.
+ */
+enum class TrappedProto : uint8_t {
+  ARP,
+  LLDP,
+  IPV4_TCP,
+  IPV4_UDP,
+  IPV4_ICMP,
+  IPV4_OTHER,
+  IPV6_TCP,
+  IPV6_UDP,
+  IPV6_ICMP,
+  IPV6_OTHER,
+  OTHER,
+};
+
+/*
+ * TrappedPacketProfiler keeps track of the sources sending the most packets
+ * to the CPU, to find who is behind a storm of trapped packets.
+ *
+ * Sources are identified by their MAC address and, for ARP and IP packets,
+ * their IP address.  Only one in every sampleRate packets is looked at, so
+ * the cost on the packet path is mostly that of an atomic increment.  The
+ * counts are halved every halfLife, so they reflect recent traffic, and at
+ * most maxEntries sources are tracked: a new source replaces the one with
+ * the lowest count once the table is full.
+ *
+ * The packet sizes and rates per port and protocol are counted in
+ * SwitchStats, since they need no locking.
+ */
+class TrappedPacketProfiler {
+ public:
+  enum : uint8_t { NUM_PROTOS = 11 };
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Talker {
+    folly::MacAddress mac;
+    // Empty if the packets were not ARP or IP
+    folly::IPAddress ip;
+    // The port and protocol of the last sampled packet
+    PortID port{0};
+    TrappedProto proto{TrappedProto::OTHER};
+    // Estimates, scaled up by the sample rate
+    uint64_t packets{0};
+    uint64_t bytes{0};
+  };
+
+  TrappedPacketProfiler(uint32_t sampleRate, size_t maxEntries,
+                        std::chrono::seconds halfLife);
+
+  /*
+   * Classify a packet.  The cursor should point just past the ethertype.
+   */
+  static TrappedProto classify(uint16_t ethertype, folly::io::Cursor cursor);
+
+  static const char* getProtoName(TrappedProto proto);
+
+  /*
+   * Record a trapped packet.  The cursor should point just past the
+   * ethertype.
+   */
+  void packetTrapped(PortID port, folly::MacAddress src, uint16_t ethertype,
+                     TrappedProto proto, folly::io::Cursor cursor,
+                     uint32_t length) {
+    if (sampleRate_ > 1 &&
+        sampleCount_.fetch_add(1, std::memory_order_relaxed) % sampleRate_) {
+      return;
+    }
+    recordSample(port, src, ethertype, proto, cursor, length,
+                 std::chrono::steady_clock::now());
+  }
+
+  /*
+   * Return the count sources with the most packets, busiest first.
+   */
+  std::vector<Talker> getTopTalkers(size_t count) const {
+    return getTopTalkers(count, std::chrono::steady_clock::now());
+  }
+
+  // These are only public for use in unit tests.
+  void recordSample(PortID port, folly::MacAddress src, uint16_t ethertype,
+                    TrappedProto proto, folly::io::Cursor cursor,
+                    uint32_t length, TimePoint now);
+  std::vector<Talker> getTopTalkers(size_t count, TimePoint now) const;
+
+ private:
+  typedef std::pair<folly::MacAddress, folly::IPAddress> Key;
+  typedef std::map<Key, Talker> TalkerMap;
+
+  // Forbidden copy constructor and assignment operator
+  TrappedPacketProfiler(TrappedPacketProfiler const &) = delete;
+  TrappedPacketProfiler& operator=(TrappedPacketProfiler const &) = delete;
+
+  static folly::IPAddress parseSrcIP(uint16_t ethertype,
+                                     folly::io::Cursor cursor);
+  void decay(TimePoint now) const;
+  void evictLowest();
+
+  const uint32_t sampleRate_;
+  const size_t maxEntries_;
+  const std::chrono::seconds halfLife_;
+  std::atomic<uint32_t> sampleCount_{0};
+
+  mutable folly::SpinLock lock_;
+  // The counts are decayed by whoever touches them first after each half
+  // life, including readers
+  mutable TalkerMap talkers_;
+  mutable TimePoint nextDecay_;
+};
+
+}} // facebook::fboss
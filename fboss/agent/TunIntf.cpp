@@ -11,109 +11,359 @@
 
 extern "C" {
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+#include <libnetlink.h>
 #include <ll_map.h>
 }
 
+#include <folly/Hash.h>
+#include <folly/String.h>
+#include <folly/io/Cursor.h>
+#include <gflags/gflags.h>
+#include "common/stats/ServiceData.h"
+#include "fboss/agent/NetlinkBatch.h"
+#include "fboss/agent/PacketRing.h"
 #include "fboss/agent/RxPacket.h"
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/SysError.h"
 #include "fboss/agent/TxPacket.h"
 #include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/packet/Ethertype.h"
+#include "fboss/agent/packet/IPProto.h"
 #include "thrift/lib/cpp/async/TEventBase.h"
 #include "thrift/lib/cpp/async/TEventHandler.h"
 
+DEFINE_int32(tun_tx_queue_size, 1024,
+             "Maximum number of packets queued to be written to each tun "
+             "interface.  Packets beyond this are dropped.");
+DEFINE_int32(tun_read_budget_min, 16,
+             "Minimum number of packets read from a tun interface before "
+             "yielding to other handlers on the event base.");
+DEFINE_int32(tun_read_budget_max, 256,
+             "Maximum number of packets read from a tun interface before "
+             "yielding to other handlers on the event base.  The budget "
+             "grows towards this while the host keeps the interface busy.");
+DEFINE_string(host_intf_ring_routers, "",
+              "Comma separated IDs of the routers whose host interfaces are "
+              "veth pairs served through packet rings (AF_PACKET with "
+              "TPACKET_V3), rather than TUN devices.  The rings move bursts "
+              "of packets without a system call per packet.  An existing "
+              "interface has to be deleted for its router to change type.");
+
 namespace facebook { namespace fboss {
 
 static const char *intfPrefix = "front";
 static const int prefixLen = strlen(intfPrefix);
 static const char* tunDev = "/dev/net/tun";
+// The switch end of a veth pair is named after the host end, with this
+// prefix, so that it is not taken for a host interface itself
+static const char* peerPrefix = "pkt";
 
 using folly::IPAddress;
+using folly::MacAddress;
+using folly::io::Cursor;
 using apache::thrift::async::TEventBase;
 using apache::thrift::async::TEventHandler;
 
-TunIntf::TunIntf(SwSwitch *sw, TEventBase *evb,
-                 const std::string& name, RouterID rid, int idx)
-    : TEventHandler(evb), sw_(sw), rid_(rid), name_(name), ifIndex_(idx) {
-  openFD();
-  SCOPE_FAIL {
-    closeFD();
+namespace {
+
+void addStat(const stats::ExportedStatMap::LockAndStatItem& stat,
+             int64_t value) {
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+  SpinLockHolder guard(stat.first.get());
+  stat.second->addValue(now, value);
+}
+
+// The frames on a veth pair carry no VLAN tag
+const uint32_t kUntaggedEthLen = 2 * MacAddress::SIZE + 2;
+
+// Run an interface ioctl on a socket, as ioctls on links need one
+void intfIoctl(const std::string& name, unsigned long request,
+               struct ifreq* ifr, const char* what) {
+  auto sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sysCheckError(sock, "Failed to open socket to ", what, " of ", name);
+  SCOPE_EXIT {
+    close(sock);
   };
-  LOG(INFO) << "Added interface " << name_ << " with fd " << fd_
-            << " from rid " << rid_ << " @ index " << ifIndex_;
+  strncpy(ifr->ifr_name, name.c_str(), sizeof(ifr->ifr_name));
+  auto ret = ioctl(sock, request, (void *) ifr);
+  sysCheckError(ret, "Failed to ", what, " of interface ", name);
+}
+
+int getIntfIndex(const std::string& name) {
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  intfIoctl(name, SIOCGIFINDEX, &ifr, "get index");
+  return ifr.ifr_ifindex;
+}
+
+MacAddress getIntfMac(const std::string& name) {
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  intfIoctl(name, SIOCGIFHWADDR, &ifr, "get MAC");
+  return MacAddress::fromBinary(folly::ByteRange(
+      reinterpret_cast<const uint8_t*>(ifr.ifr_hwaddr.sa_data),
+      MacAddress::SIZE));
+}
+
+void setIntfMtu(const std::string& name, uint32_t mtu) {
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  ifr.ifr_mtu = mtu;
+  intfIoctl(name, SIOCSIFMTU, &ifr, "set MTU");
+}
+
+void setIntfUp(const std::string& name) {
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  intfIoctl(name, SIOCGIFFLAGS, &ifr, "get flags");
+  if (!(ifr.ifr_flags & IFF_UP)) {
+    ifr.ifr_flags |= IFF_UP;
+    intfIoctl(name, SIOCSIFFLAGS, &ifr, "bring up");
+  }
+}
+
+}
+
+TunIntf::TunIntf(SwSwitch *sw, const std::vector<TEventBase*>& evbs,
+                 const std::string& name, RouterID rid, int idx)
+    : sw_(sw), rid_(rid), name_(name), ifIndex_(idx) {
+  packetRing_ = usesPacketRing(rid_);
+  peerName_ = folly::to<std::string>(peerPrefix, name_);
+  initStats();
+  openQueues(evbs);
+  LOG(INFO) << "Added interface " << name_ << " with " << queues_.size()
+            << " queues from rid " << rid_ << " @ index " << ifIndex_;
 }
 
-TunIntf::TunIntf(SwSwitch *sw, TEventBase *evb,
+TunIntf::TunIntf(SwSwitch *sw, const std::vector<TEventBase*>& evbs,
                  RouterID rid, const Interface::Addresses& addr)
-    : TEventHandler(evb), sw_(sw), rid_(rid), addrs_(addr) {
+    : sw_(sw), rid_(rid), addrs_(addr) {
   name_ = folly::to<std::string>(intfPrefix, rid);
-  openFD();
-  SCOPE_FAIL {
-    closeFD();
-  };
-  // make the interface persistent, so that the network sessions
-  // from the application (i.e. BGP)  will not be reset if controller restarts
-  auto ret = ioctl(fd_, TUNSETPERSIST, 1);
-  sysCheckError(ret, "Failed to set persist interface ", name_);
-  // TODO: if needed, we can adjust send buffer size, TUNSETSNDBUF
+  packetRing_ = usesPacketRing(rid_);
+  peerName_ = folly::to<std::string>(peerPrefix, name_);
+  initStats();
+  if (packetRing_) {
+    // A veth pair stays until it is deleted, like a persistent TUN device
+    createVethPair();
+  }
+  openQueues(evbs);
+  if (!packetRing_) {
+    // make the interface persistent, so that the network sessions
+    // from the application (i.e. BGP)  will not be reset if controller
+    // restarts
+    auto ret = ioctl(queues_[0]->getFD(), TUNSETPERSIST, 1);
+    sysCheckError(ret, "Failed to set persist interface ", name_);
+    // TODO: if needed, we can adjust send buffer size, TUNSETSNDBUF
+  }
   ifIndex_ = ll_name_to_index(name_.c_str());
-  LOG(INFO) << "Created interface " << name_ << " with fd " << fd_
-            << " from router " << rid_ << " @ index " << ifIndex_;
+  LOG(INFO) << "Created interface " << name_ << " with " << queues_.size()
+            << " queues from router " << rid_ << " @ index " << ifIndex_;
 }
 
 TunIntf::~TunIntf() {
   stop();
-  CHECK_NE(fd_, -1);
-  if (toDelete_) {
-    auto ret = ioctl(fd_, TUNSETPERSIST, 0);
+  CHECK(!queues_.empty());
+  if (toDelete_ && !packetRing_) {
+    auto ret = ioctl(queues_[0]->getFD(), TUNSETPERSIST, 0);
     sysLogError(ret, "Failed to unset persist interface ", name_);
   }
-  closeFD();
+  queues_.clear();
+  if (toDelete_ && packetRing_) {
+    try {
+      deleteVethPair();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "Failed to delete interface " << name_ << ": "
+                 << folly::exceptionStr(ex);
+    }
+  }
   LOG(INFO) << ((toDelete_) ? "Delete" : "Detach") << " interface " << name_;
 }
 
-void TunIntf::openFD() {
-  fd_ = open(tunDev, O_RDWR);
-  sysCheckError(fd_, "Cannot open ", tunDev);
-  SCOPE_FAIL {
-    closeFD();
+void TunIntf::initStats() {
+  auto statMap = fbData->getStatMap();
+  const auto expType = stats::SUM;
+  auto statName = [&](const char* stat) {
+    return folly::to<std::string>("tun.", name_, ".", stat);
+  };
+  fromHostPkts_ = statMap->getLockAndStatItem(statName("from_host.pkts"),
+                                              &expType);
+  fromHostBytes_ = statMap->getLockAndStatItem(statName("from_host.bytes"),
+                                               &expType);
+  fromHostDrops_ = statMap->getLockAndStatItem(statName("from_host.drops"),
+                                               &expType);
+  toHostPkts_ = statMap->getLockAndStatItem(statName("to_host.pkts"),
+                                            &expType);
+  toHostBytes_ = statMap->getLockAndStatItem(statName("to_host.bytes"),
+                                             &expType);
+  toHostDrops_ = statMap->getLockAndStatItem(statName("to_host.drops"),
+                                             &expType);
+}
+
+void TunIntf::openQueues(const std::vector<TEventBase*>& evbs) {
+  CHECK(!evbs.empty());
+  if (packetRing_) {
+    openRings(evbs);
+    return;
+  }
+  bool multiQueue = evbs.size() > 1;
+  auto fd = openFD(multiQueue);
+  if (fd < 0 && errno == EINVAL) {
+    // A persistent interface keeps the queue mode it was created with, so
+    // one left behind by an earlier run may only accept the other mode.  A
+    // multi-queue interface still works with a single queue.
+    LOG(WARNING) << "Cannot attach to interface " << name_ << " as a "
+                 << (multiQueue ? "multi" : "single")
+                 << "-queue interface, retrying as the other";
+    multiQueue = !multiQueue;
+    fd = openFD(multiQueue);
+  }
+  sysCheckError(fd, "Failed to create/attach interface ", name_);
+  queues_.emplace_back(new Queue(this, evbs[0], fd));
+  if (!multiQueue) {
+    if (evbs.size() > 1) {
+      LOG(WARNING) << "Interface " << name_ << " uses a single queue";
+    }
+    return;
+  }
+  for (size_t i = 1; i < evbs.size(); ++i) {
+    fd = openFD(true);
+    sysCheckError(fd, "Failed to attach queue ", i, " to interface ", name_);
+    queues_.emplace_back(new Queue(this, evbs[i], fd));
+  }
+}
+
+void TunIntf::openRings(const std::vector<TEventBase*>& evbs) {
+  auto peerIndex = getIntfIndex(peerName_);
+  hostMac_ = getIntfMac(name_);
+  peerMac_ = getIntfMac(peerName_);
+  // TunManager only brings up the host end
+  setIntfUp(peerName_);
+  // The rings of several queues share the traffic from the host by flow
+  uint16_t fanoutGroup = evbs.size() > 1 ? (peerIndex & 0xffff) : 0;
+  for (auto* evb : evbs) {
+    auto ring = folly::make_unique<PacketRing>(peerName_, peerIndex,
+                                               fanoutGroup);
+    queues_.emplace_back(new Queue(this, evb, std::move(ring)));
+  }
+}
+
+void TunIntf::createVethPair() {
+  struct {
+    struct nlmsghdr n;
+    struct ifinfomsg ifi;
+    char buf[512];
+  } req;
+  memset(&req, 0, sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.n.nlmsg_type = RTM_NEWLINK;
+  req.n.nlmsg_flags = NLM_F_REQUEST|NLM_F_CREATE|NLM_F_EXCL;
+  req.ifi.ifi_family = AF_UNSPEC;
+  // The host end sends every packet straight to the switch end, with no
+  // neighbor resolution, as it would to a TUN device
+  req.ifi.ifi_flags = IFF_NOARP;
+  req.ifi.ifi_change = IFF_NOARP;
+  addattr_l(&req.n, sizeof(req), IFLA_IFNAME, name_.c_str(),
+            name_.size() + 1);
+  auto* linkInfo = addattr_nest(&req.n, sizeof(req), IFLA_LINKINFO);
+  addattr_l(&req.n, sizeof(req), IFLA_INFO_KIND, "veth", strlen("veth"));
+  auto* data = addattr_nest(&req.n, sizeof(req), IFLA_INFO_DATA);
+  auto* peer = addattr_nest(&req.n, sizeof(req), VETH_INFO_PEER);
+  // The peer's attributes follow an ifinfomsg of its own, left zeroed
+  req.n.nlmsg_len += sizeof(struct ifinfomsg);
+  addattr_l(&req.n, sizeof(req), IFLA_IFNAME, peerName_.c_str(),
+            peerName_.size() + 1);
+  addattr_nest_end(&req.n, peer);
+  addattr_nest_end(&req.n, data);
+  addattr_nest_end(&req.n, linkInfo);
+
+  rtnl_handle rth;
+  auto ret = rtnl_open(&rth, 0);
+  sysCheckError(ret, "Failed to open rtnl");
+  SCOPE_EXIT {
+    rtnl_close(&rth);
+  };
+  NetlinkBatch batch(&rth);
+  batch.add(&req.n, folly::to<std::string>(
+      "create veth pair ", name_, " and ", peerName_));
+  batch.flush();
+}
+
+void TunIntf::deleteVethPair() {
+  struct {
+    struct nlmsghdr n;
+    struct ifinfomsg ifi;
+  } req;
+  memset(&req, 0, sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  req.n.nlmsg_type = RTM_DELLINK;
+  req.n.nlmsg_flags = NLM_F_REQUEST;
+  req.ifi.ifi_family = AF_UNSPEC;
+  req.ifi.ifi_index = ifIndex_;
+
+  rtnl_handle rth;
+  auto ret = rtnl_open(&rth, 0);
+  sysCheckError(ret, "Failed to open rtnl");
+  SCOPE_EXIT {
+    rtnl_close(&rth);
+  };
+  // Deleting either end deletes the pair
+  NetlinkBatch batch(&rth);
+  batch.add(&req.n, folly::to<std::string>(
+      "delete veth pair ", name_, " @ index ", ifIndex_));
+  batch.flush();
+}
+
+int TunIntf::openFD(bool multiQueue) {
+  auto fd = open(tunDev, O_RDWR);
+  sysCheckError(fd, "Cannot open ", tunDev);
+  bool ok = false;
+  SCOPE_EXIT {
+    if (!ok) {
+      // Keep the errno of the failure for the caller
+      auto err = errno;
+      close(fd);
+      errno = err;
+    }
   };
   struct ifreq ifr;
   memset(&ifr, 0, sizeof(ifr));
   // Flags: IFF_TUN   - TUN device (no Ethernet headers)
   //        IFF_NO_PI - Do not provide packet information
+  //        IFF_MULTI_QUEUE - Allow several fds to attach to the device
   ifr.ifr_flags = IFF_TUN|IFF_NO_PI;
+  if (multiQueue) {
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+  }
   strncpy(ifr.ifr_name, name_.c_str(), sizeof(ifr.ifr_name));
-  auto ret = ioctl(fd_, TUNSETIFF, (void *) &ifr);
-  sysCheckError(ret, "Failed to create/attach interface ", name_);
+  auto ret = ioctl(fd, TUNSETIFF, (void *) &ifr);
+  if (ret < 0) {
+    return -1;
+  }
   // make fd non-blocking
-  auto flags = fcntl(fd_, F_GETFL);
-  sysCheckError(flags, "Failed to get flags from fd ", fd_);
+  auto flags = fcntl(fd, F_GETFL);
+  sysCheckError(flags, "Failed to get flags from fd ", fd);
   flags |= O_NONBLOCK;
-  ret = fcntl(fd_, F_SETFL, flags);
+  ret = fcntl(fd, F_SETFL, flags);
   sysCheckError(ret, "Failed to set non-blocking flags ", flags,
-                " to fd ", fd_);
-  flags = fcntl(fd_, F_GETFD);
-  sysCheckError(flags, "Failed to get flags from fd ", fd_);
+                " to fd ", fd);
+  flags = fcntl(fd, F_GETFD);
+  sysCheckError(flags, "Failed to get flags from fd ", fd);
   flags |= FD_CLOEXEC;
-  ret = fcntl(fd_, F_SETFD, flags);
+  ret = fcntl(fd, F_SETFD, flags);
   sysCheckError(ret, "Failed to set close-on-exec flags ", flags,
-                " to fd ", fd_);
-  LOG(INFO) << "Create/attach to tun interface " << name_ << " @ fd " << fd_;
-}
-
-void TunIntf::closeFD() noexcept {
-  auto ret = close(fd_);
-  sysLogError(ret, "Failed to close fd ", fd_, " for interface ", name_);
-  if (ret == 0) {
-    LOG(INFO) << "Closed fd " << fd_ << " for interface " << name_;
-    fd_ = -1;
-  }
+                " to fd ", fd);
+  LOG(INFO) << "Create/attach to tun interface " << name_ << " @ fd " << fd;
+  ok = true;
+  return fd;
 }
 
 void TunIntf::addAddress(const IPAddress& addr, uint8_t mask) {
@@ -128,104 +378,410 @@ void TunIntf::addAddress(const IPAddress& addr, uint8_t mask) {
           << " @ index " << ifIndex_;
 }
 
-void TunIntf::handlerReady(uint16_t events) noexcept {
-  CHECK(fd_ != -1);
-  const int MaxSentOneTime = 16;
-  // TODO: The packet size should be as same as MTU (hard code 1500 for now).
-  // Since this is L3 packet size, we should also reserve some space for L2
-  // header, which is 18 bytes (including one vlan tag)
-  const int l3Len = 1500;
-  int sent = 0;
-  int dropped = 0;
-  uint64_t bytes = 0;
-  bool fdFail = false;
+void TunIntf::setMtu(uint32_t mtu) {
+  // This is always applied, since an interface probed from the host may
+  // still have the MTU set by an earlier configuration.  SIOCSIFMTU has to
+  // be issued on a socket rather than on the tun fd.  Both ends of a veth
+  // pair need it, since each drops frames larger than the other's MTU.
+  setIntfMtu(name_, mtu);
+  if (packetRing_) {
+    setIntfMtu(peerName_, mtu);
+  }
+  if (mtu_.exchange(mtu, std::memory_order_relaxed) != mtu) {
+    // The queues resize their read buffers when they next read
+    LOG(INFO) << "Set MTU of interface " << name_ << " to " << mtu;
+  }
+}
+
+uint64_t TunIntf::flowHash(const folly::IOBuf* buf) {
+  // The addresses, protocol and ports, in the order they are hashed
+  uint8_t key[2 * 16 + 1 + 4];
+  size_t keyLen = 0;
+  Cursor cursor(buf);
   try {
-    while (sent + dropped < MaxSentOneTime) {
-      std::unique_ptr<TxPacket> pkt;
-      pkt = sw_->allocateL3TxPacket(l3Len);
-      auto buf = pkt->buf();
-      int ret = 0;
-      do {
-        ret = read(fd_, buf->writableTail(), buf->tailroom());
-      } while (ret == -1 && errno == EINTR);
-      if (ret < 0) {
-        if (errno != EAGAIN) {
-          sysLogError(ret, "Failed to read on ", fd_);
-          // Cannot continue read on this fd
-          fdFail = true;
-        }
-        break;
-      } else if (ret == 0) {
-        // Nothing to read. It shall not happen as the fd is non-blocking.
-        // Just add this case to be safe.
-        break;
-      } else if (ret > buf->tailroom()) {
-        // The pkt is larger than the buffer. We don't have complete packet.
-        // It shall not happen unless the MTU is mis-match. Drop the packet.
-        LOG(ERROR) << "Too large packet (" << ret << " > " << buf->tailroom()
-                   << ") received from host. Drop the packet.";
-        dropped++;
-      } else {
-        bytes += ret;
-        buf->append(ret);
-        sw_->sendL3Packet(rid_, std::move(pkt));
-        sent++;
-      }
+    auto first = cursor.read<uint8_t>();
+    auto version = first >> 4;
+    uint8_t proto;
+    bool hasPorts;
+    if (version == 4) {
+      int ihl = (first & 0x0f) * 4;
+      cursor.skip(5);
+      // Only the first fragment carries the ports
+      auto frag = cursor.readBE<uint16_t>() & 0x3fff;
+      cursor.skip(1);
+      proto = cursor.read<uint8_t>();
+      cursor.skip(2);
+      cursor.pull(key, 8);
+      keyLen = 8;
+      hasPorts = frag == 0;
+      cursor.skip(std::max(ihl - 20, 0));
+    } else if (version == 6) {
+      cursor.skip(5);
+      proto = cursor.read<uint8_t>();
+      cursor.skip(1);
+      cursor.pull(key, 32);
+      keyLen = 32;
+      hasPorts = true;
+    } else {
+      return 0;
     }
-  } catch (const std::exception& ex) {
-    LOG(ERROR) << "Hit some error when forwarding packets :"
-               << folly::exceptionStr(ex);
+    key[keyLen++] = proto;
+    if (hasPorts && (proto == IP_PROTO_TCP || proto == IP_PROTO_UDP)) {
+      cursor.pull(key + keyLen, 4);
+      keyLen += 4;
+    }
+  } catch (const std::out_of_range& ex) {
+    // Hash whatever we got.  Truncated packets are rare, and still hash
+    // the same way every time.
   }
-  if (fdFail) {
-    unregisterHandler();
+  return folly::hash::fnv64_buf(key, keyLen);
+}
+
+void TunIntf::start() {
+  for (auto& queue : queues_) {
+    queue->start();
+  }
+}
+
+void TunIntf::stop() {
+  for (auto& queue : queues_) {
+    queue->stop();
   }
-  VLOG(4) << "Forwarded " << sent << " packets (" << bytes
-          << " bytes) from host @ fd " << fd_ << " for router " << rid_
-          << " dropped:" << dropped;
 }
 
 bool TunIntf::sendPacketToHost(std::unique_ptr<RxPacket> pkt) {
-  CHECK(fd_ != -1);
   const int l2Len = EthHdr::SIZE;
   auto buf = pkt->buf();
   if (buf->length() <= l2Len) {
     LOG(ERROR) << "Received a too small packet with length " << buf->length();
+    addStat(toHostDrops_, 1);
     return false;
   }
   // skip L2 header
   buf->trimStart(l2Len);
+
+  size_t idx = 0;
+  if (queues_.size() > 1) {
+    idx = flowHash(buf) % queues_.size();
+  }
+  return queues_[idx]->sendPacketToHost(std::move(pkt));
+}
+
+TunIntf::Queue::Queue(TunIntf* intf, TEventBase* evb, int fd)
+    : TEventHandler(evb), intf_(intf), evb_(evb), fd_(fd),
+      txQueue_(std::make_shared<TxQueue>()),
+      readBudget_(FLAGS_tun_read_budget_min) {
+}
+
+TunIntf::Queue::Queue(TunIntf* intf, TEventBase* evb,
+                      std::unique_ptr<PacketRing> ring)
+    : Queue(intf, evb, ring->getFD()) {
+  ring_ = std::move(ring);
+}
+
+TunIntf::Queue::~Queue() {
+  stop();
+  closeTxQueue();
+  if (ring_) {
+    ring_.reset();
+    return;
+  }
+  auto ret = close(fd_);
+  sysLogError(ret, "Failed to close fd ", fd_, " for interface ",
+              intf_->name_);
+  if (ret == 0) {
+    LOG(INFO) << "Closed fd " << fd_ << " for interface " << intf_->name_;
+  }
+}
+
+template<typename FN>
+void TunIntf::Queue::runInQueueThread(FN fn) {
+  // Handlers may only be registered from the thread running their evb.
+  // This is also true before the evb's loop has started.
+  if (evb_->isInEventBaseThread()) {
+    fn();
+  } else {
+    evb_->runInEventBaseThreadAndWait(fn);
+  }
+}
+
+void TunIntf::Queue::start() {
+  runInQueueThread([this] {
+      if (!isHandlerRegistered()) {
+        changeHandlerFD(fd_);
+        registerHandler(TEventHandler::READ|TEventHandler::PERSIST);
+      }
+    });
+}
+
+void TunIntf::Queue::stop() {
+  runInQueueThread([this] {
+      unregisterHandler();
+    });
+}
+
+void TunIntf::Queue::handlerReady(uint16_t events) noexcept {
+  const uint32_t budget = std::max<uint32_t>(readBudget_, 1);
+  uint32_t dropped = 0;
+  uint64_t bytes = 0;
+  bool fdFail = false;
+  // Packets read from the host are sent to HW as a single batch
+  std::vector<std::unique_ptr<TxPacket>> pkts;
+  pkts.reserve(budget);
+  try {
+    if (ring_) {
+      readFromRing(budget, &pkts, &dropped, &bytes);
+    } else {
+      fdFail = !readFromTun(budget, &pkts, &dropped, &bytes);
+    }
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Hit some error when forwarding packets :"
+               << folly::exceptionStr(ex);
+  }
+  uint32_t sent = pkts.size();
+  if (!pkts.empty()) {
+    intf_->sw_->sendL3Packets(intf_->rid_, std::move(pkts));
+  }
+  if (fdFail) {
+    unregisterHandler();
+  }
+
+  // Adapt the budget to the backlog on the host side
+  const uint32_t maxBudget = std::max(FLAGS_tun_read_budget_max,
+                                      FLAGS_tun_read_budget_min);
+  if (sent + dropped >= budget) {
+    readBudget_ = std::min<uint32_t>(budget * 2, maxBudget);
+  } else if (sent + dropped < budget / 4) {
+    readBudget_ = std::max<uint32_t>(budget / 2, FLAGS_tun_read_budget_min);
+  }
+
+  addStat(intf_->fromHostPkts_, sent);
+  addStat(intf_->fromHostBytes_, bytes);
+  addStat(intf_->fromHostDrops_, dropped);
+  VLOG(4) << "Forwarded " << sent << " packets (" << bytes
+          << " bytes) from host @ fd " << fd_ << " for router "
+          << intf_->rid_ << " dropped:" << dropped
+          << " next budget:" << readBudget_;
+}
+
+bool TunIntf::Queue::readFromTun(
+    uint32_t budget, std::vector<std::unique_ptr<TxPacket>>* pkts,
+    uint32_t* dropped, uint64_t* bytes) {
+  const uint32_t mtu = intf_->getMtu();
+  if (readBufSize_ < mtu + 1) {
+    readBuf_.reset(new uint8_t[mtu + 1]);
+    readBufSize_ = mtu + 1;
+  }
+  while (pkts->size() + *dropped < budget) {
+    int ret = 0;
+    do {
+      ret = read(fd_, readBuf_.get(), mtu + 1);
+    } while (ret == -1 && errno == EINTR);
+    if (ret < 0) {
+      if (errno != EAGAIN) {
+        sysLogError(ret, "Failed to read on ", fd_);
+        // Cannot continue read on this fd
+        return false;
+      }
+      break;
+    } else if (ret == 0) {
+      // Nothing to read. It shall not happen as the fd is non-blocking.
+      // Just add this case to be safe.
+      break;
+    } else if (static_cast<uint32_t>(ret) > mtu) {
+      // The pkt is larger than the MTU, and we only have part of it.
+      // It shall not happen unless the host MTU was changed behind our
+      // back. Drop the packet.
+      LOG(ERROR) << "Too large packet (" << ret << " > " << mtu
+                 << ") received from host. Drop the packet.";
+      ++*dropped;
+    } else {
+      auto pkt = intf_->sw_->allocateL3TxPacket(ret);
+      auto buf = pkt->buf();
+      memcpy(buf->writableTail(), readBuf_.get(), ret);
+      buf->append(ret);
+      *bytes += ret;
+      pkts->push_back(std::move(pkt));
+    }
+  }
+  return true;
+}
+
+void TunIntf::Queue::readFromRing(
+    uint32_t budget, std::vector<std::unique_ptr<TxPacket>>* pkts,
+    uint32_t* dropped, uint64_t* bytes) {
+  const uint32_t mtu = intf_->getMtu();
+  uint32_t truncated = 0;
+  ring_->receive(budget, [&](const uint8_t* frame, uint32_t len) {
+    // The host only sends IP through its end of the pair, as it does no
+    // neighbor resolution there.  Anything else is dropped.
+    if (len <= kUntaggedEthLen || len - kUntaggedEthLen > mtu) {
+      ++*dropped;
+      return;
+    }
+    uint16_t ethertype = (frame[kUntaggedEthLen - 2] << 8) |
+      frame[kUntaggedEthLen - 1];
+    if (ethertype != ETHERTYPE_IPV4 && ethertype != ETHERTYPE_IPV6) {
+      ++*dropped;
+      return;
+    }
+    uint32_t l3Len = len - kUntaggedEthLen;
+    auto pkt = intf_->sw_->allocateL3TxPacket(l3Len);
+    auto buf = pkt->buf();
+    memcpy(buf->writableTail(), frame + kUntaggedEthLen, l3Len);
+    buf->append(l3Len);
+    *bytes += l3Len;
+    pkts->push_back(std::move(pkt));
+  }, &truncated);
+  *dropped += truncated;
+}
+
+bool TunIntf::Queue::sendPacketToHost(std::unique_ptr<RxPacket> pkt) {
+  // The packet may wait a while for the kernel to take it
+  pkt->setRxBufferHolder(RxBufferHolder::TUN_QUEUE);
+  pkt->copyOutIfPressured();
+  bool scheduleFlush = false;
+  {
+    std::lock_guard<std::mutex> g(txQueue_->lock);
+    if (txQueue_->closed) {
+      return false;
+    }
+    if (txQueue_->pkts.size() >=
+        static_cast<size_t>(FLAGS_tun_tx_queue_size)) {
+      VLOG(4) << "Dropping packet to host from router " << intf_->rid_
+              << ", tx queue is full";
+      addStat(intf_->toHostDrops_, 1);
+      return false;
+    }
+    txQueue_->pkts.push_back(std::move(pkt));
+    if (!txQueue_->flushScheduled) {
+      txQueue_->flushScheduled = true;
+      scheduleFlush = true;
+    }
+  }
+
+  if (scheduleFlush) {
+    auto txQueue = txQueue_;
+    evb_->runInEventBaseThread([this, txQueue]() {
+        flushTxQueue(this, txQueue);
+      });
+  }
+  return true;
+}
+
+void TunIntf::Queue::flushTxQueue(
+    Queue* queue, const std::shared_ptr<TxQueue>& txQueue) noexcept {
+  std::vector<std::unique_ptr<RxPacket>> pkts;
+  std::lock_guard<std::mutex> writeGuard(txQueue->writeLock);
+  {
+    std::lock_guard<std::mutex> g(txQueue->lock);
+    txQueue->flushScheduled = false;
+    if (txQueue->closed) {
+      // The queue has been destroyed
+      return;
+    }
+    pkts.swap(txQueue->pkts);
+  }
+
+  uint32_t sent = 0;
+  uint64_t bytes = 0;
+  if (queue->ring_) {
+    sent = queue->writeToRing(pkts);
+    for (uint32_t i = 0; i < sent; ++i) {
+      bytes += pkts[i]->buf()->length();
+    }
+  } else {
+    // TUN devices take exactly one packet per write(), so there is no way
+    // to hand the kernel several packets in a single call.
+    for (auto& pkt : pkts) {
+      if (!queue->writeToHost(pkt.get())) {
+        // The kernel queue for the interface is full, or the fd is broken.
+        // Either way the rest of the batch would fail too.
+        break;
+      }
+      bytes += pkt->buf()->length();
+      ++sent;
+    }
+  }
+  auto* intf = queue->intf_;
+  addStat(intf->toHostPkts_, sent);
+  addStat(intf->toHostBytes_, bytes);
+  addStat(intf->toHostDrops_, pkts.size() - sent);
+  VLOG(4) << "Sent " << sent << " of " << pkts.size()
+          << " packets to host from router " << intf->rid_ << " @ fd "
+          << queue->fd_;
+}
+
+bool TunIntf::Queue::writeToHost(RxPacket* pkt) noexcept {
+  auto buf = pkt->buf();
+  auto rid = intf_->rid_;
   int ret = 0;
   do {
     ret = write(fd_, buf->data(), buf->length());
   } while (ret == -1 && errno == EINTR);
   if (ret < 0) {
-    sysLogError(ret, "Failed to send packet to the host from router ", rid_);
+    sysLogError(ret, "Failed to send packet to the host from router ", rid);
     return false;
   } else if (ret < buf->length()) {
-    LOG(ERROR) << "Failed to send full packet to host from router " << rid_
+    LOG(ERROR) << "Failed to send full packet to host from router " << rid
                << ret << " bytes sent instead of " << buf->length();
   } else {
-    VLOG(4) << "Send packet (" << ret << " bytes) to host from router "
-            << rid_;
+    VLOG(5) << "Send packet (" << ret << " bytes) to host from router "
+            << rid;
   }
   return true;
 }
 
-void TunIntf::stop() {
-  unregisterHandler();
+uint32_t TunIntf::Queue::writeToRing(
+    const std::vector<std::unique_ptr<RxPacket>>& pkts) noexcept {
+  // The frames go to the host end, from the switch end
+  uint8_t hdr[kUntaggedEthLen];
+  memcpy(hdr, intf_->hostMac_.bytes(), MacAddress::SIZE);
+  memcpy(hdr + MacAddress::SIZE, intf_->peerMac_.bytes(), MacAddress::SIZE);
+  uint32_t sent = 0;
+  for (const auto& pkt : pkts) {
+    auto buf = pkt->buf();
+    uint16_t ethertype = (buf->data()[0] >> 4) == 6 ? ETHERTYPE_IPV6 :
+      ETHERTYPE_IPV4;
+    hdr[kUntaggedEthLen - 2] = ethertype >> 8;
+    hdr[kUntaggedEthLen - 1] = ethertype & 0xff;
+    if (!ring_->queueFrame(hdr, sizeof(hdr), buf)) {
+      // The ring is full, so the rest of the batch would not fit either
+      break;
+    }
+    ++sent;
+  }
+  // The whole batch goes to the host in a single call
+  if (sent > 0 && !ring_->flush()) {
+    sysLogError(-1, "Failed to send packets to the host from router ",
+                intf_->rid_);
+  }
+  return sent;
 }
 
-void TunIntf::start() {
-  if (fd_ != -1 && !isHandlerRegistered()) {
-    changeHandlerFD(fd_);
-    registerHandler(TEventHandler::READ|TEventHandler::PERSIST);
-  }
+void TunIntf::Queue::closeTxQueue() noexcept {
+  // Wait for any flush in progress, and make sure no later one touches us
+  std::lock_guard<std::mutex> writeGuard(txQueue_->writeLock);
+  std::lock_guard<std::mutex> g(txQueue_->lock);
+  txQueue_->closed = true;
+  txQueue_->pkts.clear();
 }
 
 bool TunIntf::isTunIntf(const char *name) {
   return strstr(name, intfPrefix) == name;
 }
 
+bool TunIntf::usesPacketRing(RouterID rid) {
+  std::vector<folly::StringPiece> ids;
+  folly::split(',', FLAGS_host_intf_ring_routers, ids, true);
+  for (auto id : ids) {
+    if (RouterID(folly::to<int>(id)) == rid) {
+      return true;
+    }
+  }
+  return false;
+}
+
 RouterID TunIntf::getRidFromName(const char *name) {
   if (!isTunIntf(name)) {
     throw FbossError(name, " is not a valid tun interface");
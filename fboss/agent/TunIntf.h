@@ -9,27 +9,68 @@
  */
 #pragma once
 
+#include "common/stats/ExportedTimeseries.h"
 #include "fboss/agent/types.h"
 #include "fboss/agent/state/Interface.h"
 #include "thrift/lib/cpp/async/TEventBase.h"
 #include "thrift/lib/cpp/async/TEventHandler.h"
 
+#include <folly/MacAddress.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace facebook { namespace fboss {
 
+class PacketRing;
 class SwSwitch;
 class RxPacket;
+class TxPacket;
 
-class TunIntf : private apache::thrift::async::TEventHandler {
+/*
+ * TunIntf connects the TUN interface of one router on the host to the
+ * switch.
+ *
+ * The interface has one or more queues, each with its own fd on the host
+ * side, served by its own EventBase.  Packets from the host are read on
+ * whichever queue the kernel put them on, and packets to the host are
+ * spread over the queues by flow, so that the traffic of one flow stays in
+ * order while busy interfaces use several cores.
+ *
+ * The routers listed in --host_intf_ring_routers use a veth pair instead of
+ * a TUN device.  The host end has the interface's name and addresses, and
+ * the switch end is served through PacketRings, one per queue, so that
+ * bursts of packets move in and out of the host without a system call per
+ * packet.  The host end does no ARP or neighbor discovery, so the host
+ * sends every packet to it directly, as it does to a TUN device.
+ */
+class TunIntf {
  public:
-  TunIntf(SwSwitch *sw, apache::thrift::async::TEventBase *evb,
+  /*
+   * The interface gets a queue per EventBase given.  More than one queue
+   * requires a kernel with multi-queue TUN support; if the interface cannot
+   * be attached to with several queues, a single one is used.
+   */
+  TunIntf(SwSwitch *sw,
+          const std::vector<apache::thrift::async::TEventBase*>& evbs,
           const std::string& name, RouterID rid, int idx);
-  TunIntf(SwSwitch *sw, apache::thrift::async::TEventBase *evb,
+  TunIntf(SwSwitch *sw,
+          const std::vector<apache::thrift::async::TEventBase*>& evbs,
           RouterID rid, const Interface::Addresses& addrs);
   virtual ~TunIntf();
 
   // some utility functions
   static bool isTunIntf(const char *name);
   static RouterID getRidFromName(const char *name);
+  /// Whether the router's interface is served through packet rings
+  static bool usesPacketRing(RouterID rid);
+  /*
+   * Hash the flow of an IP packet, from its addresses, protocol and ports.
+   * Packets that are not IPv4 or IPv6, or too short to tell, hash to 0.
+   */
+  static uint64_t flowHash(const folly::IOBuf* buf);
 
   int getIfIndex() const {
     return ifIndex_;
@@ -43,6 +84,9 @@ class TunIntf : private apache::thrift::async::TEventHandler {
   RouterID getRouterId() const {
     return rid_;
   }
+  size_t getNumQueues() const {
+    return queues_.size();
+  }
   /**
    * Mark delete of the interface from the host. The interface on the host
    * will be deleted in destructor after the mark.
@@ -62,36 +106,164 @@ class TunIntf : private apache::thrift::async::TEventHandler {
   void setAddresses(const Interface::Addresses& addrs) {
     addrs_ = addrs;
   }
+  uint32_t getMtu() const {
+    return mtu_.load(std::memory_order_relaxed);
+  }
+  /**
+   * Set the MTU of the interface on the host, and the largest packet that
+   * will be read from it.
+   */
+  void setMtu(uint32_t mtu);
   /// Start packet forwarding.
   void start();
   /// Stop packet forwarding.
   void stop();
-  void handlerReady(uint16_t events) noexcept override;
   /**
    * Send a packet to the interface on host.
    * Unlike other methods, which are called on thread that serves the evb,
    * this function can be called from any thread.
    *
-   * @return true The packet is sent to host
+   * The packet is only queued here, on the queue its flow hashes to.  All
+   * packets queued before the queue's evb thread gets to run are then
+   * written to the host in one pass, directly from the packet buffers they
+   * were received in.
+   *
+   * @return true The packet is queued to be sent to host
    *         false The packet is dropped due to errors
    */
   bool sendPacketToHost(std::unique_ptr<RxPacket> pkt);
  private:
+  /*
+   * Packets waiting to be written to the host.
+   *
+   * This is shared with the pending flush callback, so that it can tell
+   * whether the queue has been destroyed before it ran.  The flush holds
+   * writeLock while it writes to the fd, and the destructor takes it before
+   * marking the queue closed.  lock only protects the other members, so
+   * that queueing packets never waits for writes in progress.
+   */
+  struct TxQueue {
+    std::mutex writeLock;
+    std::mutex lock;
+    std::vector<std::unique_ptr<RxPacket>> pkts;
+    bool flushScheduled{false};
+    bool closed{false};
+  };
+
+  /*
+   * One fd of the interface, and the EventBase serving it.  Everything but
+   * sendPacketToHost() runs on that EventBase's thread.
+   */
+  class Queue : private apache::thrift::async::TEventHandler {
+   public:
+    Queue(TunIntf* intf, apache::thrift::async::TEventBase* evb, int fd);
+    Queue(TunIntf* intf, apache::thrift::async::TEventBase* evb,
+          std::unique_ptr<PacketRing> ring);
+    ~Queue();
+
+    int getFD() const {
+      return fd_;
+    }
+    void start();
+    void stop();
+    bool sendPacketToHost(std::unique_ptr<RxPacket> pkt);
+    void handlerReady(uint16_t events) noexcept override;
+
+   private:
+    // Forbidden copy constructor and assignment operator
+    Queue(Queue const &) = delete;
+    Queue& operator=(Queue const &) = delete;
+
+    // Run fn on the evb thread, and wait for it
+    template<typename FN>
+    void runInQueueThread(FN fn);
+    void closeTxQueue() noexcept;
+    static void flushTxQueue(Queue* queue,
+                             const std::shared_ptr<TxQueue>& txQueue) noexcept;
+    bool writeToHost(RxPacket* pkt) noexcept;
+    /*
+     * Read up to 'budget' packets from the host into pkts, counting the
+     * ones dropped.  Returns false if the fd cannot be read any more.
+     */
+    bool readFromTun(uint32_t budget,
+                     std::vector<std::unique_ptr<TxPacket>>* pkts,
+                     uint32_t* dropped, uint64_t* bytes);
+    void readFromRing(uint32_t budget,
+                      std::vector<std::unique_ptr<TxPacket>>* pkts,
+                      uint32_t* dropped, uint64_t* bytes);
+    /// Write the packets to the ring, and return how many were sent
+    uint32_t writeToRing(
+        const std::vector<std::unique_ptr<RxPacket>>& pkts) noexcept;
+
+    TunIntf* intf_;
+    apache::thrift::async::TEventBase *evb_;
+    /**
+     * File descriptor for this queue through which packets can
+     * be received from or sent to.  For a packet ring, this is the ring's
+     * socket, which the ring owns.
+     */
+    int fd_;
+    std::unique_ptr<PacketRing> ring_;
+    std::shared_ptr<TxQueue> txQueue_;
+    /**
+     * Packets are read from the host into this buffer, and only copied into
+     * a TxPacket once we know there is one and how large it is.  It holds
+     * one byte more than the MTU, so that oversized packets can be detected,
+     * and grows on this queue's thread when the MTU is raised.
+     */
+    std::unique_ptr<uint8_t[]> readBuf_;
+    uint32_t readBufSize_{0};
+    /**
+     * The maximum number of packets read from the host in one handlerReady()
+     * call.  It grows while the host keeps us busy, and shrinks again once
+     * the backlog is gone, so that a busy queue does not starve the other
+     * handlers on the evb.
+     */
+    uint32_t readBudget_;
+  };
+
   SwSwitch *sw_;
   RouterID rid_;         ///< The router ID of the interface belonging to
   std::string name_;    ///< The name in the host
   int ifIndex_{-1};     ///< The ifindex of the interface.
   bool toDelete_{false}; ///< Is the interface to be deleted from system
   Interface::Addresses addrs_; ///< The IP addresses assigned to this intf
-  /**
-   * File descriptor for this interface through which packets can
-   * be received from or sent to.
+  /// The L3 MTU of the interface.  Read by the queues on their threads.
+  std::atomic<uint32_t> mtu_{Interface::DEFAULT_MTU};
+  std::vector<std::unique_ptr<Queue>> queues_;
+  /*
+   * Whether the interface is a veth pair served through packet rings, the
+   * name of its switch end, and the MAC addresses of both ends.
+   */
+  bool packetRing_{false};
+  std::string peerName_;
+  folly::MacAddress hostMac_;
+  folly::MacAddress peerMac_;
+
+  /*
+   * Packets and bytes forwarded from the host to HW, and packets sent to
+   * the host, plus the drops in each direction.
    */
-  int fd_{-1};
+  stats::ExportedStatMap::LockAndStatItem fromHostPkts_;
+  stats::ExportedStatMap::LockAndStatItem fromHostBytes_;
+  stats::ExportedStatMap::LockAndStatItem fromHostDrops_;
+  stats::ExportedStatMap::LockAndStatItem toHostPkts_;
+  stats::ExportedStatMap::LockAndStatItem toHostBytes_;
+  stats::ExportedStatMap::LockAndStatItem toHostDrops_;
 
   std::string makeIntfName(RouterID rid);
-  void openFD();
-  void closeFD() noexcept;
+  void initStats();
+  /// Open a queue on each EventBase, with multi-queue TUN if more than one
+  void openQueues(
+      const std::vector<apache::thrift::async::TEventBase*>& evbs);
+  /// Open an fd attached to the interface, or return -1 and set errno
+  int openFD(bool multiQueue);
+  /// Open a packet ring queue on each EventBase, on the switch end
+  void openRings(
+      const std::vector<apache::thrift::async::TEventBase*>& evbs);
+  /// Create the veth pair on the host, or delete it
+  void createVethPair();
+  void deleteVethPair();
 };
 
 }}
@@ -19,27 +19,132 @@ extern "C" {
 #include <linux/fib_rules.h>
 }
 
+#include "fboss/agent/BootTimeline.h"
+#include "fboss/agent/NetlinkBatch.h"
 #include "fboss/agent/RxPacket.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/SysError.h"
+#include "fboss/agent/ThreadSampler.h"
 #include "fboss/agent/TunIntf.h"
+#include "fboss/agent/state/DeltaFunctions.h"
 #include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/NodeMapDelta.h"
+#include "fboss/agent/state/RouteTableMap.h"
 #include "thrift/lib/cpp/async/TEventBase.h"
 
 #include <boost/container/flat_set.hpp>
+#include <folly/Conv.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <gflags/gflags.h>
+#include <functional>
+#include <limits>
+#include <pthread.h>
+
+DEFINE_int32(tun_queues, 1,
+             "Number of queues for each tun interface.  Each queue has its "
+             "own fd, served by its own thread, and packets to the host are "
+             "spread over them by flow.  More than one requires multi-queue "
+             "tun support in the kernel.");
+DEFINE_int32(kernel_route_table, 0,
+             "Mirror the routes of each router into this kernel routing "
+             "table plus the router ID, so that traffic the host originates "
+             "can follow the FIB.  The tables have to be above the ones "
+             "used for source routing, which are 100 and below.  0 disables "
+             "the mirror.");
+DEFINE_int32(kernel_route_updates_per_sec, 10000,
+             "The most route changes to send to the kernel route mirror per "
+             "second.  Changes beyond that are coalesced and sent later.  0 "
+             "for no limit.");
+DEFINE_int32(kernel_route_check_interval, 300,
+             "Seconds between checks that the kernel has the mirrored routes "
+             "it should, which also repair any it does not.  0 disables the "
+             "checks.");
 
 namespace facebook { namespace fboss {
 
 using folly::IPAddress;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+using std::shared_ptr;
 using apache::thrift::async::TEventBase;
 
+/*
+ * Runs a function of the route mirror in the thread serving evb_.
+ */
+class TunManager::RouteMirrorTimer : public folly::AsyncTimeout {
+ public:
+  RouteMirrorTimer(TEventBase* evb, std::function<void()> fn)
+    : AsyncTimeout(evb), fn_(std::move(fn)) {}
+
+ private:
+  void timeoutExpired() noexcept override {
+    fn_();
+  }
+
+  std::function<void()> fn_;
+};
+
 TunManager::TunManager(SwSwitch *sw, TEventBase *evb) : sw_(sw), evb_(evb) {
+  if (FLAGS_kernel_route_table != 0) {
+    if (FLAGS_kernel_route_table <= 100) {
+      throw FbossError("--kernel_route_table ", FLAGS_kernel_route_table,
+                       " overlaps the source routing tables");
+    }
+    routeMirror_ = folly::make_unique<KernelRouteMirror>();
+    routeFlushTimer_ = folly::make_unique<RouteMirrorTimer>(
+        evb_, [this] { flushRoutes(); });
+    routeCheckTimer_ = folly::make_unique<RouteMirrorTimer>(
+        evb_, [this] {
+          checkRoutes(true);
+          flushRoutes();
+        });
+  }
   auto ret = rtnl_open(&rth_, 0);
   sysCheckError(ret, "Failed to open rtnl");
+  // The first queue of each interface is served by evb_, and each of the
+  // others by a thread of its own
+  queueEvbs_.push_back(evb_);
+  for (int i = 1; i < FLAGS_tun_queues; ++i) {
+    auto queueEvb = folly::make_unique<TEventBase>();
+    auto* ptr = queueEvb.get();
+    queueThreads_.emplace_back([ptr, i] {
+        auto name = folly::to<std::string>("fbossTunQ", i);
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+        ThreadSampler::registerThread(name);
+        ptr->loopForever();
+      });
+    queueEvbs_.push_back(ptr);
+    extraEvbs_.push_back(std::move(queueEvb));
+  }
 }
 
 TunManager::~TunManager() {
+  if (routeMirror_) {
+    // Timeouts may only be cancelled from the thread serving their evb
+    evb_->runInEventBaseThreadAndWait([this] {
+        routeFlushTimer_.reset();
+        routeCheckTimer_.reset();
+      });
+  }
   stop();
+  {
+    // The interfaces unregister from the queue threads as they go away, so
+    // they have to be gone before the threads stop
+    std::lock_guard<std::mutex> lock(mutex_);
+    intfs_.clear();
+  }
+  for (auto& queueEvb : extraEvbs_) {
+    auto* ptr = queueEvb.get();
+    ptr->runInEventBaseThread([ptr] { ptr->terminateLoopSoon(); });
+  }
+  for (auto& thread : queueThreads_) {
+    thread.join();
+  }
   rtnl_close(&rth_);
 }
 
@@ -51,10 +156,11 @@ void TunManager::addIntf(RouterID rid, const std::string& name, int ifIdx) {
   SCOPE_FAIL {
     intfs_.erase(ret.first);
   };
-  ret.first->second.reset(new TunIntf(sw_, evb_, name, rid, ifIdx));
+  ret.first->second.reset(new TunIntf(sw_, queueEvbs_, name, rid, ifIdx));
 }
 
-void TunManager::addIntf(RouterID rid, const Interface::Addresses& addrs) {
+void TunManager::addIntf(NetlinkBatch* batch, RouterID rid,
+                         const Interface::Addresses& addrs) {
   auto ret = intfs_.emplace(rid, nullptr);
   if (!ret.second) {
     throw FbossError("Duplicate interface for router ", rid);
@@ -62,31 +168,33 @@ void TunManager::addIntf(RouterID rid, const Interface::Addresses& addrs) {
   SCOPE_FAIL {
     intfs_.erase(ret.first);
   };
-  auto intf = folly::make_unique<TunIntf>(sw_, evb_, rid, addrs);
+  auto intf = folly::make_unique<TunIntf>(sw_, queueEvbs_, rid, addrs);
   SCOPE_FAIL {
     intf->setDelete();
   };
   const auto& name = intf->getName();
   auto index = intf->getIfIndex();
   // bring up the interface so that we can add the default route next step
-  bringupIntf(name, index);
+  bringupIntf(batch, name, index);
   // create a new route table for this rid
-  addRouteTable(index, rid);
+  addRouteTable(batch, index, rid);
   // add all addresses
   for (const auto& addr : addrs) {
-    addTunAddress(name, rid, index, addr.first, addr.second);
+    addTunAddress(batch, name, rid, index, addr.first, addr.second);
   }
   ret.first->second = std::move(intf);
 }
 
-void TunManager::removeIntf(RouterID rid) {
+void TunManager::removeIntf(NetlinkBatch* batch, RouterID rid) {
   auto iter = intfs_.find(rid);
   if (iter == intfs_.end()) {
     throw FbossError("Cannot find to be delete interface for router ", rid);
   }
   auto& intf = iter->second;
-  // remove the route table
-  removeRouteTable(intf->getIfIndex(), intf->getRouterId());
+  // remove the route table.  The kernel has to handle this before the
+  // interface goes away below, taking the routes with it.
+  removeRouteTable(batch, intf->getIfIndex(), intf->getRouterId());
+  batch->flush();
   intf->setDelete();
   intfs_.erase(iter);
 }
@@ -107,7 +215,8 @@ void TunManager::addProbedAddr(int ifIndex, const IPAddress& addr,
           << static_cast<int>(mask);
 }
 
-void TunManager::bringupIntf(const std::string& name, int ifIndex) {
+void TunManager::bringupIntf(NetlinkBatch* batch, const std::string& name,
+                             int ifIndex) {
   // TODO: We need to change the interface status based on real HW
   // interface status (up/down). Make them up all the time for now.
   struct {
@@ -123,10 +232,8 @@ void TunManager::bringupIntf(const std::string& name, int ifIndex) {
   req.ifi.ifi_change |= IFF_UP;
   req.ifi.ifi_flags |= IFF_UP;
   req.ifi.ifi_index = ifIndex;
-  auto ret = rtnl_talk(&rth_, &req.n, 0, 0, nullptr);
-  sysCheckError(ret, "Failed to bring up interface ", name,
-                " @ index ", ifIndex);
-  LOG(INFO) << "Brought up interface " << name << " @ index " << ifIndex;
+  batch->add(&req.n, folly::to<std::string>(
+      "bring up interface ", name, " @ index ", ifIndex));
 }
 
 inline int TunManager::getTableId(RouterID rid) const {
@@ -137,7 +244,8 @@ inline int TunManager::getTableId(RouterID rid) const {
   return tidBase - rid;
 }
 
-void TunManager::addRemoveTable(int ifIdx, RouterID rid, bool add) {
+void TunManager::addRemoveTable(NetlinkBatch* batch, int ifIdx, RouterID rid,
+                                bool add) {
   // We just store default routes (one for IPv4 and one for IPv6) in each route
   // table.
   struct {
@@ -169,18 +277,14 @@ void TunManager::addRemoveTable(int ifIdx, RouterID rid, bool add) {
     req.r.rtm_dst_len = 0;       // default route, /0
     addattr_l(&req.n, sizeof(req), RTA_DST, addr.bytes(), addr.byteCount());
     addattr32(&req.n, sizeof(req), RTA_OIF, ifIdx);
-    auto ret = rtnl_talk(&rth_, &req.n, 0, 0, nullptr);
-    sysCheckError(ret, "Failed to ", add ? "add" : "remove",
-                  " default route ", addr, " @ index ", ifIdx,
-                  " in table ", getTableId(rid), " for router ", rid);
-    LOG(INFO) << (add ? "Added" : "Removed") << " default route " << addr
-              << " @ index " << ifIdx << " in table " << getTableId(rid)
-              << " for router " << rid;
+    batch->add(&req.n, folly::to<std::string>(
+        add ? "add" : "remove", " default route ", addr, " @ index ", ifIdx,
+        " in table ", getTableId(rid), " for router ", rid));
   }
 }
 
 void TunManager::addRemoveSourceRouteRule(
-    RouterID rid, folly::IPAddress addr, bool add) {
+    NetlinkBatch* batch, RouterID rid, folly::IPAddress addr, bool add) {
   struct {
     struct nlmsghdr n;
     struct rtmsg r;
@@ -206,17 +310,57 @@ void TunManager::addRemoveSourceRouteRule(
   req.r.rtm_src_len = addr.bitCount(); // match the exact address
   // table rid
   req.r.rtm_table = getTableId(rid);
-  auto ret = rtnl_talk(&rth_, &req.n, 0, 0, nullptr);
-  sysCheckError(ret, "Failed to ", add ? "add" : "remove",
-                " rule for address ", addr,
-                " to lookup table ", getTableId(rid),
-                " for router ", rid);
-  LOG(INFO) << (add ? "Added" : "Removed") << " rule for address " << addr
-            << " to lookup table " << getTableId(rid) << " for router " << rid;
+  batch->add(&req.n, folly::to<std::string>(
+      add ? "add" : "remove", " rule for address ", addr,
+      " to lookup table ", getTableId(rid), " for router ", rid));
+}
+
+int TunManager::getMirrorTableId(RouterID rid) const {
+  return FLAGS_kernel_route_table + rid;
+}
+
+void TunManager::addRemoveMirroredRoute(
+    NetlinkBatch* batch, int ifIdx, const KernelRouteMirror::Update& update) {
+  struct {
+    struct nlmsghdr n;
+    struct rtmsg r;
+    char buf[256];
+  } req;
+  auto rid = update.key.first;
+  const auto& addr = update.key.second.first;
+  auto mask = update.key.second.second;
+  auto table = getMirrorTableId(rid);
+  bool blackhole = update.type == KernelRouteMirror::RouteType::BLACKHOLE;
+
+  memset(&req, 0, sizeof(req));
+  req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+  req.n.nlmsg_flags = NLM_F_REQUEST;
+  if (update.add) {
+    req.n.nlmsg_type = RTM_NEWROUTE;
+    req.n.nlmsg_flags |= NLM_F_CREATE|NLM_F_REPLACE;
+  } else {
+    req.n.nlmsg_type = RTM_DELROUTE;
+  }
+  req.r.rtm_family = addr.family();
+  // Tables past 255 only fit in the RTA_TABLE attribute
+  req.r.rtm_table = table < 256 ? table : RT_TABLE_UNSPEC;
+  req.r.rtm_protocol = RTPROT_FBOSS;
+  req.r.rtm_scope = RT_SCOPE_UNIVERSE;
+  req.r.rtm_type = blackhole ? RTN_BLACKHOLE : RTN_UNICAST;
+  req.r.rtm_dst_len = mask;
+  addattr32(&req.n, sizeof(req), RTA_TABLE, table);
+  addattr_l(&req.n, sizeof(req), RTA_DST, addr.bytes(), addr.byteCount());
+  if (update.add && !blackhole) {
+    addattr32(&req.n, sizeof(req), RTA_OIF, ifIdx);
+  }
+  batch->add(&req.n, folly::to<std::string>(
+      update.add ? "add" : "remove", blackhole ? " blackhole" : "",
+      " route ", addr, "/", static_cast<int>(mask), " in table ", table,
+      " for router ", rid));
 }
 
 void TunManager::addRemoveTunAddress(
-    const std::string& name, uint32_t ifIndex,
+    NetlinkBatch* batch, const std::string& name, uint32_t ifIndex,
     folly::IPAddress addr, uint8_t mask, bool add) {
   struct {
     struct nlmsghdr n;
@@ -243,39 +387,23 @@ void TunManager::addRemoveTunAddress(
   }
   req.ifa.ifa_prefixlen = mask;
   req.ifa.ifa_index = ifIndex;
-  auto ret = rtnl_talk(&rth_, &req.n, 0, 0, nullptr);
-  sysCheckError(ret, "Failed to ", add ? "add" : "remove",
-                " address ", addr, "/", static_cast<int>(mask),
-                " to interface ", name, " @ index ", ifIndex);
-  LOG(INFO) << (add ? "Added" : "Removed") << " address " << addr.str() << "/"
-            << static_cast<int>(mask) << " on interface " << name
-            << " @ index " << ifIndex;
+  batch->add(&req.n, folly::to<std::string>(
+      add ? "add" : "remove", " address ", addr, "/", static_cast<int>(mask),
+      " on interface ", name, " @ index ", ifIndex));
 }
 
 void TunManager::addTunAddress(
-    const std::string& name, RouterID rid, uint32_t ifIndex,
-    folly::IPAddress addr, uint8_t mask) {
-  addRemoveSourceRouteRule(rid, addr, true);
-  SCOPE_FAIL {
-    try {
-      addRemoveSourceRouteRule(rid, addr, false);
-    } catch (const std::exception& ex) {
-    }
-  };
-  addRemoveTunAddress(name, ifIndex, addr, mask, true);
+    NetlinkBatch* batch, const std::string& name, RouterID rid,
+    uint32_t ifIndex, folly::IPAddress addr, uint8_t mask) {
+  addRemoveSourceRouteRule(batch, rid, addr, true);
+  addRemoveTunAddress(batch, name, ifIndex, addr, mask, true);
 }
 
 void TunManager::removeTunAddress(
-    const std::string& name, RouterID rid, uint32_t ifIndex,
-    folly::IPAddress addr, uint8_t mask) {
-  addRemoveSourceRouteRule(rid, addr, false);
-  SCOPE_FAIL {
-    try {
-      addRemoveSourceRouteRule(rid, addr, true);
-    } catch (const std::exception& ex) {
-    }
-  };
-  addRemoveTunAddress(name, ifIndex, addr, mask, false);
+    NetlinkBatch* batch, const std::string& name, RouterID rid,
+    uint32_t ifIndex, folly::IPAddress addr, uint8_t mask) {
+  addRemoveSourceRouteRule(batch, rid, addr, false);
+  addRemoveTunAddress(batch, name, ifIndex, addr, mask, false);
 }
 
 int TunManager::getLinkRespParser(const struct sockaddr_nl *who,
@@ -358,6 +486,55 @@ int TunManager::getAddrRespParser(const struct sockaddr_nl *who,
   return 0;
 }
 
+int TunManager::getRouteRespParser(const struct sockaddr_nl *who,
+                                   struct nlmsghdr *n,
+                                   void *arg) {
+  // only cares about RTM_NEWROUTE
+  if (n->nlmsg_type != RTM_NEWROUTE) {
+    return 0;
+  }
+  struct rtmsg *rtm = static_cast<struct rtmsg *>(NLMSG_DATA(n));
+  struct rtattr *tb[RTA_MAX + 1];
+  int len = n->nlmsg_len;
+  len -= NLMSG_LENGTH(sizeof(*rtm));
+  if (len < 0) {
+    throw FbossError("Wrong length for RTM_GETROUTE response ", len, " vs ",
+                     NLMSG_LENGTH(sizeof(*rtm)));
+  }
+  // only care about the v4 and v6 routes we added
+  if (rtm->rtm_protocol != RTPROT_FBOSS ||
+      (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6)) {
+    return 0;
+  }
+  parse_rtattr(tb, RTA_MAX, RTM_RTA(rtm), len);
+  int64_t table = tb[RTA_TABLE] ? rta_getattr_u32(tb[RTA_TABLE]) :
+    rtm->rtm_table;
+  // Router IDs are below 256, as the source routing tables are
+  int64_t rid = table - FLAGS_kernel_route_table;
+  if (rid < 0 || rid > 255) {
+    return 0;
+  }
+  IPAddress addr;
+  if (tb[RTA_DST]) {
+    addr = IPAddress::fromBinary(folly::ByteRange(
+        static_cast<const uint8_t *>(RTA_DATA(tb[RTA_DST])),
+        RTA_PAYLOAD(tb[RTA_DST])));
+  } else if (rtm->rtm_family == AF_INET) {
+    addr = folly::IPAddressV4();
+  } else {
+    addr = folly::IPAddressV6();
+  }
+  auto type = rtm->rtm_type == RTN_UNICAST ?
+    KernelRouteMirror::RouteType::UNICAST :
+    KernelRouteMirror::RouteType::BLACKHOLE;
+
+  auto *routes = static_cast<KernelRouteMirror::Routes *>(arg);
+  KernelRouteMirror::RouteKey key(
+      RouterID(rid), folly::CIDRNetwork(addr, rtm->rtm_dst_len));
+  (*routes)[key] = type;
+  return 0;
+}
+
 void TunManager::start() const {
   for (const auto& intf : intfs_) {
     intf.second->start();
@@ -374,6 +551,7 @@ void TunManager::probe() {
   std::lock_guard<std::mutex> lock(mutex_);
   stop();                       // stop all interfaces
   intfs_.clear();               // clear all interface info
+  synced_.reset();
   auto ret = rtnl_wilddump_request(&rth_, AF_UNSPEC, RTM_GETLINK);
   sysCheckError(ret, "Cannot send RTM_GETLINK request");
   ret = rtnl_dump_filter(&rth_, getLinkRespParser, this);
@@ -383,30 +561,69 @@ void TunManager::probe() {
   ret = rtnl_dump_filter(&rth_, getAddrRespParser, this);
   sysCheckError(ret, "Cannot process RTM_GETADDR response");
   // Bring up all interfaces. Interfaces could be already up.
+  NetlinkBatch batch(&rth_);
   for (const auto& intf : intfs_) {
-    bringupIntf(intf.second->getName(), intf.second->getIfIndex());
+    bringupIntf(&batch, intf.second->getName(), intf.second->getIfIndex());
   }
+  batch.flush();
   start();
 }
 
 void TunManager::sync(std::shared_ptr<InterfaceMap> map) {
+  // Syncs are started on every state update.  Those that change the
+  // interfaces usually only change a few.  Only look at the routers with
+  // changed interfaces, unless the interfaces were probed since the last
+  // sync, in which case the host may differ from any map we have seen.
+  boost::container::flat_set<RouterID> changedRids;
+  bool syncAll = !synced_;
+  if (!syncAll) {
+    NodeMapDelta<InterfaceMap> delta(synced_.get(), map.get());
+    DeltaFunctions::forEachChanged(
+        delta,
+        [&](const shared_ptr<Interface>& oldIntf,
+            const shared_ptr<Interface>& newIntf) {
+          changedRids.insert(oldIntf->getRouterID());
+          changedRids.insert(newIntf->getRouterID());
+        },
+        [&](const shared_ptr<Interface>& newIntf) {
+          changedRids.insert(newIntf->getRouterID());
+        },
+        [&](const shared_ptr<Interface>& oldIntf) {
+          changedRids.insert(oldIntf->getRouterID());
+        });
+  }
+  auto needsSync = [&](RouterID rid) {
+    return syncAll || changedRids.count(rid) > 0;
+  };
+
   // prepare the existing and new addresses
   typedef Interface::Addresses Addresses;
   typedef boost::container::flat_map<RouterID, Addresses> AddrMap;
   AddrMap newAddrs;
+  // The tun interface carries the traffic of all interfaces in its router,
+  // so it needs the largest of their MTUs.
+  boost::container::flat_map<RouterID, uint32_t> newMtus;
   for (const auto& intf : map->getAllNodes()) {
+    auto rid = intf.second->getRouterID();
+    if (!needsSync(rid)) {
+      continue;
+    }
     const auto& addrs = intf.second->getAddresses();
-    newAddrs[intf.second->getRouterID()].insert(addrs.begin(), addrs.end());
+    newAddrs[rid].insert(addrs.begin(), addrs.end());
+    auto& mtu = newMtus[rid];
+    mtu = std::max(mtu, intf.second->getMtu());
   }
   AddrMap oldAddrs;
   for (const auto& intf : intfs_) {
+    if (!needsSync(intf.first)) {
+      continue;
+    }
     const auto& addrs = intf.second->getAddresses();
     oldAddrs[intf.first].insert(addrs.begin(), addrs.end());
   }
-  // now, lock all interfaces and apply changes. Interfaces will be stopped
-  // if there is some change to the interface
-  std::lock_guard<std::mutex> lock(mutex_);
-
+  // Apply the changes.  Only changes to intfs_ itself need the lock, so
+  // packets can still be sent to the host while the host is programmed.
+  NetlinkBatch batch(&rth_);
   auto applyAddrChanges =
     [&](const std::string& name, RouterID rid, int ifIndex,
         const Addresses& oldAddrs, const Addresses& newAddrs) {
@@ -418,14 +635,18 @@ void TunManager::sync(std::shared_ptr<InterfaceMap> map) {
             // addresses and masks are both same
             return;
           }
-          removeTunAddress(name, rid, ifIndex, oldIter->first, oldIter->second);
-          addTunAddress(name, rid, ifIndex, newIter->first, newIter->second);
+          removeTunAddress(&batch, name, rid, ifIndex, oldIter->first,
+                           oldIter->second);
+          addTunAddress(&batch, name, rid, ifIndex, newIter->first,
+                        newIter->second);
         },
         [&](Addresses::const_iterator& newIter) {
-          addTunAddress(name, rid, ifIndex, newIter->first, newIter->second);
+          addTunAddress(&batch, name, rid, ifIndex, newIter->first,
+                        newIter->second);
         },
         [&](Addresses::const_iterator& oldIter) {
-          removeTunAddress(name, rid, ifIndex, oldIter->first, oldIter->second);
+          removeTunAddress(&batch, name, rid, ifIndex, oldIter->first,
+                           oldIter->second);
         });
   };
 
@@ -445,27 +666,178 @@ void TunManager::sync(std::shared_ptr<InterfaceMap> map) {
         iter->second->setAddresses(newAddrs);
       },
       [&](const AddrMap::const_iterator& newIter) {
-        addIntf(newIter->first, newIter->second);
+        std::lock_guard<std::mutex> lock(mutex_);
+        addIntf(&batch, newIter->first, newIter->second);
       },
       [&](const AddrMap::const_iterator& oldIter) {
-        removeIntf(oldIter->first);
+        std::lock_guard<std::mutex> lock(mutex_);
+        removeIntf(&batch, oldIter->first);
       });
+  batch.flush();
 
+  for (const auto& intf : intfs_) {
+    auto iter = newMtus.find(intf.first);
+    if (iter != newMtus.end()) {
+      intf.second->setMtu(iter->second);
+    }
+  }
+
+  synced_ = map;
   start();
 }
 
 void TunManager::startProbe() {
   evb_->runInEventBaseThread([this]() {
+      BootTimeline::PhaseTimer timer("tun_probe");
       this->probe();
     });
 }
 
 void TunManager::startSync(const std::shared_ptr<InterfaceMap>& map) {
-  evb_->runInEventBaseThread([this, map]() {
-      this->sync(map);
+  bool scheduled;
+  {
+    std::lock_guard<std::mutex> g(pendingSyncMutex_);
+    scheduled = (pendingSync_ != nullptr);
+    pendingSync_ = map;
+  }
+  if (scheduled) {
+    // The sync already scheduled will pick up this map
+    sw_->stats()->tunSyncCoalesced();
+    return;
+  }
+  evb_->runInEventBaseThread([this]() {
+      this->syncPending();
+    });
+}
+
+void TunManager::syncPending() {
+  std::shared_ptr<InterfaceMap> map;
+  {
+    std::lock_guard<std::mutex> g(pendingSyncMutex_);
+    map.swap(pendingSync_);
+  }
+  // Most state updates leave the interfaces alone
+  if (!map || map == synced_) {
+    sw_->stats()->tunSyncSkipped();
+    return;
+  }
+  // Only the first sync, at boot, makes it into the timeline
+  BootTimeline::PhaseTimer timer("tun_sync");
+  auto start = steady_clock::now();
+  sync(map);
+  sw_->stats()->tunSync(
+      duration_cast<microseconds>(steady_clock::now() - start));
+}
+
+void TunManager::startRouteSync(
+    const std::shared_ptr<RouteTableMap>& tables) {
+  if (!routeMirror_) {
+    return;
+  }
+  bool scheduled;
+  {
+    std::lock_guard<std::mutex> g(pendingSyncMutex_);
+    scheduled = (pendingRoutes_ != nullptr);
+    pendingRoutes_ = tables;
+  }
+  if (scheduled) {
+    return;
+  }
+  evb_->runInEventBaseThread([this]() {
+      this->syncRoutesPending();
     });
 }
 
+void TunManager::syncRoutesPending() {
+  std::shared_ptr<RouteTableMap> tables;
+  {
+    std::lock_guard<std::mutex> g(pendingSyncMutex_);
+    tables.swap(pendingRoutes_);
+  }
+  if (!tables || tables == syncedRoutes_) {
+    return;
+  }
+  if (!routesChecked_) {
+    // Start from what the kernel has, so routes left by the previous run
+    // are only changed if they are no longer right
+    routesChecked_ = true;
+    checkRoutes(false);
+  }
+  routeMirror_->applyDelta(syncedRoutes_.get(), tables.get());
+  syncedRoutes_ = tables;
+  flushRoutes();
+}
+
+void TunManager::flushRoutes() {
+  auto now = steady_clock::now();
+  if (now - routeWindowStart_ >= seconds(1)) {
+    routeWindowStart_ = now;
+    routesSentInWindow_ = 0;
+  }
+  size_t max = std::numeric_limits<size_t>::max();
+  if (FLAGS_kernel_route_updates_per_sec > 0) {
+    max = FLAGS_kernel_route_updates_per_sec - routesSentInWindow_;
+  }
+  auto updates = routeMirror_->takeUpdates(max);
+  routesSentInWindow_ += updates.size();
+  if (!updates.empty()) {
+    NetlinkBatch batch(&rth_);
+    for (const auto& update : updates) {
+      // intfs_ only changes in this thread, so it can be read without the
+      // lock.  Only unicast routes need the interface.
+      int ifIndex = 0;
+      auto iter = intfs_.find(update.key.first);
+      if (iter != intfs_.end()) {
+        ifIndex = iter->second->getIfIndex();
+      } else if (update.add &&
+                 update.type == KernelRouteMirror::RouteType::UNICAST) {
+        VLOG(2) << "No interface to mirror routes to for router "
+                << update.key.first;
+        continue;
+      }
+      addRemoveMirroredRoute(&batch, ifIndex, update);
+    }
+    try {
+      batch.flush();
+    } catch (const std::exception& ex) {
+      // The mirror assumes every change was made, so the next check
+      // finds the ones that were not and repairs them
+      LOG(ERROR) << "failed to mirror routes to the kernel: "
+                 << folly::exceptionStr(ex);
+    }
+    sw_->stats()->kernelRouteUpdates(updates.size());
+  }
+  auto pending = routeMirror_->numPending();
+  if (pending > 0 && !routeFlushTimer_->isScheduled()) {
+    sw_->stats()->kernelRouteUpdatesDeferred(pending);
+    auto wait = duration_cast<milliseconds>(
+        routeWindowStart_ + seconds(1) - now);
+    routeFlushTimer_->scheduleTimeout(std::max(wait, milliseconds(1)));
+  }
+}
+
+void TunManager::checkRoutes(bool countMismatches) {
+  KernelRouteMirror::Routes routes;
+  try {
+    auto ret = rtnl_wilddump_request(&rth_, AF_UNSPEC, RTM_GETROUTE);
+    sysCheckError(ret, "Cannot send RTM_GETROUTE request");
+    ret = rtnl_dump_filter(&rth_, getRouteRespParser, &routes);
+    sysCheckError(ret, "Cannot process RTM_GETROUTE response");
+    auto mismatches = routeMirror_->reconcile(routes);
+    if (countMismatches && mismatches > 0) {
+      LOG(WARNING) << mismatches << " mirrored routes differ in the kernel";
+      sw_->stats()->kernelRouteMismatches(mismatches);
+    }
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "failed to check the mirrored routes in the kernel: "
+               << folly::exceptionStr(ex);
+  }
+  if (FLAGS_kernel_route_check_interval > 0) {
+    routeCheckTimer_->scheduleTimeout(
+        milliseconds(seconds(FLAGS_kernel_route_check_interval)));
+  }
+}
+
 bool TunManager::sendPacketToHost(std::unique_ptr<RxPacket> pkt) {
   auto rid = pkt->getRouterID();
   std::lock_guard<std::mutex> lock(mutex_);
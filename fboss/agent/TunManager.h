@@ -9,11 +9,15 @@
  */
 #pragma once
 
+#include "fboss/agent/KernelRouteMirror.h"
 #include "fboss/agent/types.h"
 #include "fboss/agent/state/Interface.h"
 #include "thrift/lib/cpp/async/TEventBase.h"
 
 #include <boost/container/flat_map.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include <libnetlink.h>
@@ -22,6 +26,8 @@ extern "C" {
 namespace facebook { namespace fboss {
 
 class InterfaceMap;
+class NetlinkBatch;
+class RouteTableMap;
 class RxPacket;
 class SwSwitch;
 class TunIntf;
@@ -39,9 +45,19 @@ class TunManager : public boost::noncopyable {
   /**
    * Start sync all TUN interfaces with the interfaces defined in the map.
    * This function can be called from any thread.
-   * The probe function will happen in the thread serving 'evb_'
+   * The sync will happen in the thread serving 'evb_'.  Syncs are
+   * coalesced: if one is already waiting to run, it syncs this map instead
+   * of the one it was started with.
    */
   void startSync(const std::shared_ptr<InterfaceMap>& map);
+  /**
+   * Start mirroring the routes in the tables into the kernel, if
+   * --kernel_route_table is set.  Like startSync(), this can be called from
+   * any thread, and syncs are coalesced.  Only the routes that changed
+   * since the last sync are looked at, and the kernel is programmed no
+   * faster than --kernel_route_updates_per_sec allows.
+   */
+  void startRouteSync(const std::shared_ptr<RouteTableMap>& tables);
   /**
    * Send a packet to host.
    * This function can be called from any thread.
@@ -58,16 +74,52 @@ class TunManager : public boost::noncopyable {
 
   SwSwitch *sw_;
   apache::thrift::async::TEventBase *evb_;
+  /**
+   * The EventBases serving each queue of the interfaces: evb_ first, then
+   * one per extra queue, each run by a thread in queueThreads_.
+   */
+  std::vector<apache::thrift::async::TEventBase*> queueEvbs_;
+  std::vector<std::unique_ptr<apache::thrift::async::TEventBase>> extraEvbs_;
+  std::vector<std::thread> queueThreads_;
   boost::container::flat_map<RouterID, std::unique_ptr<TunIntf>> intfs_;
   rtnl_handle rth_;
+  /**
+   * The interface map last synced to the host, or null if the interfaces
+   * have been probed since.  sync() only looks at the routers whose
+   * interfaces changed from this map.
+   */
+  std::shared_ptr<InterfaceMap> synced_;
+  /**
+   * The newest map passed to startSync(), if a sync is scheduled but has
+   * not started yet.  Protected by pendingSyncMutex_.
+   */
+  std::shared_ptr<InterfaceMap> pendingSync_;
+  std::mutex pendingSyncMutex_;
   /**
    * The mutex used to protect intfs_.
    * probe() and sync() could manipulate intfs_. They both run on the same
-   * thread that serves evb_.
+   * thread that serves evb_, so they only hold the lock while changing it.
    * sendPacketToHost() uses intfs_, it can be called from any thread.
    */
   std::mutex mutex_;
-
+  /**
+   * The kernel route mirror, if enabled, and the route tables it was last
+   * synced to.  pendingRoutes_ is the newest table map passed to
+   * startRouteSync() that is not synced yet, and is protected by
+   * pendingSyncMutex_.  Everything else is only used in the thread serving
+   * evb_.
+   */
+  class RouteMirrorTimer;
+  std::unique_ptr<KernelRouteMirror> routeMirror_;
+  std::shared_ptr<RouteTableMap> syncedRoutes_;
+  std::shared_ptr<RouteTableMap> pendingRoutes_;
+  bool routesChecked_{false};
+  // Route changes are sent in one second windows, so that no more than
+  // --kernel_route_updates_per_sec are sent in any window
+  std::chrono::steady_clock::time_point routeWindowStart_;
+  size_t routesSentInWindow_{0};
+  std::unique_ptr<RouteMirrorTimer> routeFlushTimer_;
+  std::unique_ptr<RouteMirrorTimer> routeCheckTimer_;
   enum : uint8_t {
     /**
      * The protocol value used to add the source routing IP rule and the
@@ -78,23 +130,33 @@ class TunManager : public boost::noncopyable {
   };
   /// Add a TUN interface. It is called during probe process.
   void addIntf(RouterID rid, const std::string& name, int IfIdx);
-  /// Add a TUN interface. It is called to create a new TUN interface.
-  void addIntf(RouterID rid, const Interface::Addresses& addrs);
-  /// Remove an existing TUN interface
-  void removeIntf(RouterID rid);
+  /**
+   * Add a TUN interface. It is called to create a new TUN interface.
+   * The host is programmed when the batch is flushed.
+   */
+  void addIntf(NetlinkBatch* batch, RouterID rid,
+               const Interface::Addresses& addrs);
+  /// Remove an existing TUN interface. This flushes the batch.
+  void removeIntf(NetlinkBatch* batch, RouterID rid);
   /// Add an address to a TUN interface during probe process.
   void addProbedAddr(int ifIndex, const folly::IPAddress& addr, uint8_t mask);
+  /*
+   * The functions below that take a NetlinkBatch queue their requests in
+   * it, rather than sending them right away.
+   */
   /// Bring up the interface on the host
-  void bringupIntf(const std::string& name, int ifIndex);
+  void bringupIntf(NetlinkBatch* batch, const std::string& name,
+                   int ifIndex);
   /// Retrieve the route table ID based on the router ID
   int getTableId(RouterID rid) const;
   /// Add/remove a route table
-  void addRemoveTable(int ifIdx, RouterID rid, bool add);
-  void addRouteTable(int ifIdx, RouterID rid) {
-    addRemoveTable(ifIdx, rid, true);
+  void addRemoveTable(NetlinkBatch* batch, int ifIdx, RouterID rid,
+                      bool add);
+  void addRouteTable(NetlinkBatch* batch, int ifIdx, RouterID rid) {
+    addRemoveTable(batch, ifIdx, rid, true);
   }
-  void removeRouteTable(int ifIdx, RouterID rid) {
-    addRemoveTable(ifIdx, rid, false);
+  void removeRouteTable(NetlinkBatch* batch, int ifIdx, RouterID rid) {
+    addRemoveTable(batch, ifIdx, rid, false);
   }
   /**
    * Add/remove an IP rule for source routing based on a given address
@@ -104,21 +166,32 @@ class TunManager : public boost::noncopyable {
    * one the front panel port IP addresses to be sent through the front panel
    * ports instead of the management interface.
    */
-  void addRemoveSourceRouteRule(RouterID rid, folly::IPAddress addr,
-                                bool add);
+  void addRemoveSourceRouteRule(NetlinkBatch* batch, RouterID rid,
+                                folly::IPAddress addr, bool add);
   /// Add/remove an address to/from a TUN interface on the host
-  void addRemoveTunAddress(const std::string& name, uint32_t ifIndex,
-                           folly::IPAddress addr, uint8_t mask, bool add);
-  void addTunAddress(const std::string& name, RouterID rid, uint32_t ifIndex,
-                     folly::IPAddress addr, uint8_t mask);
-  void removeTunAddress(const std::string& name, RouterID rid, uint32_t ifIndex,
-                        folly::IPAddress addr, uint8_t mask);
+  void addRemoveTunAddress(NetlinkBatch* batch, const std::string& name,
+                           uint32_t ifIndex, folly::IPAddress addr,
+                           uint8_t mask, bool add);
+  void addTunAddress(NetlinkBatch* batch, const std::string& name,
+                     RouterID rid, uint32_t ifIndex, folly::IPAddress addr,
+                     uint8_t mask);
+  void removeTunAddress(NetlinkBatch* batch, const std::string& name,
+                        RouterID rid, uint32_t ifIndex, folly::IPAddress addr,
+                        uint8_t mask);
+  /// Retrieve the kernel route table the routes of a router are mirrored to
+  int getMirrorTableId(RouterID rid) const;
+  /// Add/remove a route mirrored from the FIB
+  void addRemoveMirroredRoute(NetlinkBatch* batch, int ifIdx,
+                              const KernelRouteMirror::Update& update);
   /// The callback function to parse the RTM_GETADDRrequest
   static int getAddrRespParser(const struct sockaddr_nl *who,
                                struct nlmsghdr *n, void *arg);
   /// The callback function to parse the RTM_GETLINK request
   static int getLinkRespParser(const struct sockaddr_nl *who,
                                struct nlmsghdr *n, void *arg);
+  /// The callback function to parse the RTM_GETROUTE request
+  static int getRouteRespParser(const struct sockaddr_nl *who,
+                                struct nlmsghdr *n, void *arg);
 
   template<typename MAPNAME,
            typename CHANGEFN, typename ADDFN, typename REMOVEFN>
@@ -126,7 +199,23 @@ class TunManager : public boost::noncopyable {
                     CHANGEFN changeFn, ADDFN addFn, REMOVEFN removeFn);
 
   void probe();
+  /// Sync the map in pendingSync_, unless it is the one already synced
+  void syncPending();
   void sync(std::shared_ptr<InterfaceMap> map);
+  /// Sync the route tables in pendingRoutes_ to the kernel route mirror
+  void syncRoutesPending();
+  /**
+   * Send as many queued route changes to the kernel as the rate limit
+   * allows, and schedule another flush for the rest.
+   */
+  void flushRoutes();
+  /**
+   * Compare the mirrored routes in the kernel with those the mirror expects,
+   * and queue changes to repair any differences.  The differences are only
+   * counted as mismatches if countMismatches is set, since the first check
+   * finds the routes left by the previous run.
+   */
+  void checkRoutes(bool countMismatches);
   /*
    * start/stop packet forwarding on a TUN interface,
    * or all if the parameter is null.
@@ -0,0 +1,187 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/UnresolvedPuntPolicy.h"
+
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "common/stats/ServiceData.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <algorithm>
+
+DEFINE_int32(unresolved_attempt_window_s, 60,
+             "Attempts to resolve a destination further apart than this, in "
+             "seconds, do not count as failing in a row towards the "
+             "unresolvedDropAfter of its route class");
+
+using folly::IPAddress;
+using std::chrono::seconds;
+using std::lock_guard;
+using std::string;
+
+namespace facebook { namespace fboss {
+
+UnresolvedPuntPolicy::UnresolvedPuntPolicy()
+  : UnresolvedPuntPolicy(
+      seconds(std::max(FLAGS_unresolved_attempt_window_s, 1))) {
+}
+
+UnresolvedPuntPolicy::UnresolvedPuntPolicy(seconds attemptWindow)
+  : attemptWindow_(attemptWindow) {
+}
+
+void UnresolvedPuntPolicy::stateChanged(const StateDelta& delta) {
+  if (delta.oldState()->getRouteCounters() !=
+      delta.newState()->getRouteCounters()) {
+    setClasses(delta.newState()->getRouteCounters());
+  }
+}
+
+void UnresolvedPuntPolicy::setClasses(
+    const std::vector<RouteCounterConfig>& classes) {
+  lock_guard<std::mutex> g(lock_);
+  std::vector<Class> newClasses;
+  newClasses.reserve(classes.size());
+  for (const auto& config : classes) {
+    Class cls;
+    cls.config = config;
+    cls.tokens = config.unresolvedPuntRate;
+    for (const auto& old : classes_) {
+      if (old.config.name == config.name) {
+        cls.counters = old.counters;
+        break;
+      }
+    }
+    newClasses.push_back(std::move(cls));
+  }
+  classes_.swap(newClasses);
+  // The destinations given up on may be in another class now
+  attempts_.clear();
+}
+
+UnresolvedPuntPolicy::Class* UnresolvedPuntPolicy::findClass(
+    const IPAddress& dest) {
+  for (auto& cls : classes_) {
+    if (cls.config.router != RouterID(0)) {
+      continue;
+    }
+    for (const auto& network : cls.config.prefixes) {
+      if (network.first.isV4() == dest.isV4() &&
+          dest.inSubnet(network.first, network.second)) {
+        return &cls;
+      }
+    }
+  }
+  return nullptr;
+}
+
+UnresolvedPuntPolicy::Verdict UnresolvedPuntPolicy::admit(
+    const IPAddress& dest, TimePoint now) {
+  lock_guard<std::mutex> g(lock_);
+  auto* cls = findClass(dest);
+  if (!cls) {
+    ++defaultCounters_.punted;
+    return Verdict::RESOLVE;
+  }
+
+  if (cls->config.unresolvedDropAfter > 0) {
+    auto it = attempts_.find(dest);
+    if (it != attempts_.end() && now < it->second.dropUntil) {
+      ++cls->counters.failedDropped;
+      return Verdict::FAILED_DROP;
+    }
+  }
+
+  auto rate = cls->config.unresolvedPuntRate;
+  if (rate > 0) {
+    // A second's worth of packets may be punted in a burst
+    if (now > cls->lastUpdate) {
+      std::chrono::duration<double> elapsed = now - cls->lastUpdate;
+      cls->tokens = std::min<double>(cls->tokens + elapsed.count() * rate,
+                                     rate);
+      cls->lastUpdate = now;
+    }
+    if (cls->tokens < 1) {
+      ++cls->counters.rateDropped;
+      return Verdict::RATE_DROP;
+    }
+    cls->tokens -= 1;
+  }
+  ++cls->counters.punted;
+  return Verdict::RESOLVE;
+}
+
+void UnresolvedPuntPolicy::requested(const IPAddress& dest, TimePoint now) {
+  lock_guard<std::mutex> g(lock_);
+  auto* cls = findClass(dest);
+  if (!cls || cls->config.unresolvedDropAfter == 0) {
+    return;
+  }
+
+  sweepAttempts(now);
+  auto& attempts = attempts_[dest];
+  // Each request after the first means the one before it failed, unless
+  // it was too long ago to count
+  if (attempts.lastRequest == TimePoint() ||
+      now - attempts.lastRequest >= attemptWindow_) {
+    attempts.failures = 0;
+  } else {
+    ++attempts.failures;
+  }
+  attempts.lastRequest = now;
+  if (attempts.failures >= cls->config.unresolvedDropAfter) {
+    VLOG(2) << "dropping the packets to " << dest << " for "
+            << cls->config.unresolvedDropSeconds << "s after "
+            << attempts.failures << " failures to resolve it";
+    attempts.failures = 0;
+    attempts.lastRequest = TimePoint();
+    attempts.dropUntil = now + seconds(cls->config.unresolvedDropSeconds);
+    ++cls->counters.gaveUp;
+  }
+}
+
+void UnresolvedPuntPolicy::sweepAttempts(TimePoint now) {
+  // Forget the destinations neither requested nor dropped within the
+  // window, at most once per window, so only recent ones are kept
+  if (now - lastSweep_ < attemptWindow_) {
+    return;
+  }
+  for (auto it = attempts_.begin(); it != attempts_.end();) {
+    if (now - it->second.lastRequest >= attemptWindow_ &&
+        now >= it->second.dropUntil) {
+      it = attempts_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  lastSweep_ = now;
+}
+
+void UnresolvedPuntPolicy::publish() {
+  std::vector<std::pair<string, Counters>> counters;
+  {
+    lock_guard<std::mutex> g(lock_);
+    counters.emplace_back("default", defaultCounters_);
+    for (const auto& cls : classes_) {
+      counters.emplace_back(cls.config.name, cls.counters);
+    }
+  }
+  for (const auto& entry : counters) {
+    auto prefix = SwitchStats::kCounterPrefix + "unresolved." + entry.first +
+      ".";
+    fbData->setCounter(prefix + "punted", entry.second.punted);
+    fbData->setCounter(prefix + "rate_dropped", entry.second.rateDropped);
+    fbData->setCounter(prefix + "failed_dropped", entry.second.failedDropped);
+    fbData->setCounter(prefix + "gave_up", entry.second.gaveUp);
+  }
+}
+
+}} // facebook::fboss
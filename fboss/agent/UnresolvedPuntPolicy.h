@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/StateObserver.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/IPAddress.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * UnresolvedPuntPolicy decides what to do with the packets punted to the
+ * CPU because the next hops of their destination are unresolved.
+ *
+ * Until a next hop is resolved, the HW sends all of the traffic to it to
+ * the CPU, and IPv4Handler and IPv6Handler try to resolve it for every
+ * packet.  The route classes of the config (see cfg::RouteCounter) each
+ * have a policy for their destinations, which are in the first class with
+ * a prefix covering them:
+ *
+ *  - Only unresolvedPuntRate packets a second of the class are used to
+ *    resolve its next hops, and the rest are dropped before any lookups
+ *    are done for them.  0 uses them all.
+ *  - After unresolvedDropAfter attempts in a row to resolve a destination
+ *    failed, its packets are dropped for unresolvedDropSeconds, before it
+ *    is tried again.  0 never gives up.  Attempts more than
+ *    --unresolved_attempt_window_s apart are not in a row.
+ *
+ * Destinations in no class, or in a class of another VRF than 0, which
+ * the handlers assume, are always resolved.  The packets each class
+ * punted for resolution, and those it dropped by rate and after failures,
+ * are exported as unresolved.<class>.*, with the destinations in no class
+ * as "default".
+ *
+ * The classes change with the state, which the policy observes, while the
+ * packets are handled from several threads, so it has a lock of its own.
+ */
+class UnresolvedPuntPolicy : public StateObserver {
+ public:
+  enum class Verdict : uint8_t {
+    // Resolve the destination
+    RESOLVE,
+    // Drop the packet, since its class is over its punt rate
+    RATE_DROP,
+    // Drop the packet, since resolving its destination keeps failing
+    FAILED_DROP,
+  };
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  UnresolvedPuntPolicy();
+  explicit UnresolvedPuntPolicy(std::chrono::seconds attemptWindow);
+
+  void stateChanged(const StateDelta& delta) override;
+
+  /*
+   * Switch to the given classes.  A class keeps its counters if its name
+   * stays the same.
+   */
+  void setClasses(const std::vector<RouteCounterConfig>& classes);
+
+  /*
+   * Decide what to do with a packet punted for the unresolved destination.
+   */
+  Verdict admit(const folly::IPAddress& dest) {
+    return admit(dest, std::chrono::steady_clock::now());
+  }
+  Verdict admit(const folly::IPAddress& dest, TimePoint now);
+
+  /*
+   * Called when requests were sent to resolve the next hops of the
+   * destination, which means the requests sent before, if any, failed.
+   */
+  void requested(const folly::IPAddress& dest) {
+    requested(dest, std::chrono::steady_clock::now());
+  }
+  void requested(const folly::IPAddress& dest, TimePoint now);
+
+  /*
+   * Export the counters of each class.
+   */
+  void publish();
+
+ private:
+  struct Counters {
+    uint64_t punted{0};
+    uint64_t rateDropped{0};
+    uint64_t failedDropped{0};
+    // The destinations that were given up on
+    uint64_t gaveUp{0};
+  };
+  struct Class {
+    RouteCounterConfig config;
+    double tokens{0};
+    TimePoint lastUpdate;
+    Counters counters;
+  };
+  // The failed attempts to resolve a destination
+  struct Attempts {
+    uint32_t failures{0};
+    TimePoint lastRequest;
+    TimePoint dropUntil;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  UnresolvedPuntPolicy(UnresolvedPuntPolicy const &) = delete;
+  UnresolvedPuntPolicy& operator=(UnresolvedPuntPolicy const &) = delete;
+
+  // The class of the destination, or nullptr if it is in none
+  Class* findClass(const folly::IPAddress& dest);
+  void sweepAttempts(TimePoint now);
+
+  const std::chrono::seconds attemptWindow_;
+  std::mutex lock_;
+  // In the order of the config, since the first covering class wins
+  std::vector<Class> classes_;
+  Counters defaultCounters_;
+  std::unordered_map<folly::IPAddress, Attempts> attempts_;
+  TimePoint lastSweep_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,304 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/UpdateRecorder.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/RxPacket.h"
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fcntl.h>
+
+using apache::thrift::CompactSerializer;
+using folly::ByteRange;
+using folly::StringPiece;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+
+namespace {
+
+const char kMagic[] = "FBUPDLOG";
+const size_t kMagicLen = sizeof(kMagic) - 1;
+const uint32_t kVersion = 1;
+const size_t kHeaderLen = kMagicLen + sizeof(uint32_t);
+const size_t kFlushThreshold = 64 * 1024;
+
+void appendVarint(string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+bool readVarint(ByteRange* in, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (in->empty()) {
+      return false;
+    }
+    uint8_t byte = in->front();
+    in->advance(1);
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A list of thrift structs is its length, then each struct's length and
+// compact encoding
+template<typename T>
+string encodeList(folly::Range<const T*> items) {
+  string out;
+  string item;
+  appendVarint(&out, items.size());
+  for (const auto& obj : items) {
+    item.clear();
+    CompactSerializer::serialize(obj, &item);
+    appendVarint(&out, item.size());
+    out.append(item);
+  }
+  return out;
+}
+
+template<typename T>
+void decodeStruct(ByteRange in, T* obj) {
+  try {
+    CompactSerializer::deserialize(in, *obj);
+  } catch (const std::exception& ex) {
+    throw facebook::fboss::FbossError("corrupt update log record: ",
+                                      folly::exceptionStr(ex));
+  }
+}
+
+template<typename T>
+std::vector<T> decodeList(StringPiece payload) {
+  ByteRange in(payload);
+  uint64_t count;
+  if (!readVarint(&in, &count) || count > in.size()) {
+    throw facebook::fboss::FbossError("corrupt update log list");
+  }
+  std::vector<T> items(count);
+  for (auto& obj : items) {
+    uint64_t len;
+    if (!readVarint(&in, &len) || len > in.size()) {
+      throw facebook::fboss::FbossError("corrupt update log list");
+    }
+    decodeStruct(ByteRange(in.begin(), len), &obj);
+    in.advance(len);
+  }
+  return items;
+}
+
+} // unnamed namespace
+
+namespace facebook { namespace fboss {
+
+const char* UpdateLogRecord::getTypeName(Type type) {
+  switch (type) {
+    case Type::ADD_ROUTES:
+      return "add_routes";
+    case Type::DELETE_ROUTES:
+      return "delete_routes";
+    case Type::SYNC_FIB:
+      return "sync_fib";
+    case Type::ADD_ROUTES_PACKED:
+      return "add_routes_packed";
+    case Type::FLUSH_NEIGHBORS:
+      return "flush_neighbors";
+    case Type::PACKET:
+      return "packet";
+    case Type::STATE_UPDATE:
+      return "state_update";
+  }
+  return "unknown";
+}
+
+std::vector<UnicastRoute> UpdateLogRecord::getRoutes() const {
+  return decodeList<UnicastRoute>(payload);
+}
+
+std::vector<IpPrefix> UpdateLogRecord::getPrefixes() const {
+  return decodeList<IpPrefix>(payload);
+}
+
+PackedRoutes UpdateLogRecord::getPackedRoutes() const {
+  PackedRoutes routes;
+  decodeStruct(ByteRange(StringPiece(payload)), &routes);
+  return routes;
+}
+
+std::vector<NeighborToFlush> UpdateLogRecord::getNeighbors() const {
+  return decodeList<NeighborToFlush>(payload);
+}
+
+UpdateRecorder::UpdateRecorder(StringPiece path)
+  : file_(path.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC),
+    path_(path.str()),
+    start_(steady_clock::now()) {
+  buffer_.append(kMagic, kMagicLen);
+  for (int i = 0; i < 4; ++i) {
+    buffer_.push_back(static_cast<char>((kVersion >> (8 * i)) & 0xff));
+  }
+}
+
+UpdateRecorder::~UpdateRecorder() {
+  flush();
+}
+
+void UpdateRecorder::recordAddRoutes(
+    int16_t client, AdminDistance distance,
+    folly::Range<const UnicastRoute*> routes) {
+  append(UpdateLogRecord::Type::ADD_ROUTES, client, distance,
+         ByteRange(StringPiece(encodeList(routes))));
+}
+
+void UpdateRecorder::recordDeleteRoutes(
+    int16_t client, folly::Range<const IpPrefix*> prefixes) {
+  append(UpdateLogRecord::Type::DELETE_ROUTES, client, 0,
+         ByteRange(StringPiece(encodeList(prefixes))));
+}
+
+void UpdateRecorder::recordSyncFib(
+    int16_t client, AdminDistance distance,
+    folly::Range<const UnicastRoute*> routes) {
+  append(UpdateLogRecord::Type::SYNC_FIB, client, distance,
+         ByteRange(StringPiece(encodeList(routes))));
+}
+
+void UpdateRecorder::recordAddRoutesPacked(
+    int16_t client, AdminDistance distance, const PackedRoutes& routes) {
+  string payload;
+  CompactSerializer::serialize(routes, &payload);
+  append(UpdateLogRecord::Type::ADD_ROUTES_PACKED, client, distance,
+         ByteRange(StringPiece(payload)));
+}
+
+void UpdateRecorder::recordFlushNeighbors(
+    folly::Range<const NeighborToFlush*> entries) {
+  append(UpdateLogRecord::Type::FLUSH_NEIGHBORS, 0, 0,
+         ByteRange(StringPiece(encodeList(entries))));
+}
+
+void UpdateRecorder::recordPacket(const RxPacket* pkt) {
+  auto data = pkt->buf()->cloneCoalescedAsValue();
+  append(UpdateLogRecord::Type::PACKET,
+         static_cast<uint32_t>(pkt->getSrcPort()),
+         static_cast<uint32_t>(pkt->getSrcVlan()),
+         ByteRange(data.data(), data.length()));
+}
+
+void UpdateRecorder::recordStateUpdate(StringPiece name) {
+  append(UpdateLogRecord::Type::STATE_UPDATE, 0, 0, ByteRange(name));
+}
+
+void UpdateRecorder::append(UpdateLogRecord::Type type, uint32_t arg1,
+                            uint32_t arg2, ByteRange payload) {
+  lock_guard<mutex> g(lock_);
+  // The time is taken under the lock, so it never goes backwards
+  auto now = duration_cast<microseconds>(steady_clock::now() - start_);
+  buffer_.push_back(static_cast<char>(type));
+  appendVarint(&buffer_, (now - last_).count());
+  appendVarint(&buffer_, arg1);
+  appendVarint(&buffer_, arg2);
+  appendVarint(&buffer_, payload.size());
+  buffer_.append(reinterpret_cast<const char*>(payload.data()),
+                 payload.size());
+  last_ = now;
+  ++numRecords_;
+  if (buffer_.size() >= kFlushThreshold) {
+    flushLocked();
+  }
+}
+
+void UpdateRecorder::flush() {
+  lock_guard<mutex> g(lock_);
+  flushLocked();
+}
+
+void UpdateRecorder::flushLocked() {
+  // Failing to record must not fail the update being recorded, so errors
+  // are only logged
+  auto ret = folly::writeFull(file_.fd(), buffer_.data(), buffer_.size());
+  if (ret < 0) {
+    PLOG(ERROR) << "error writing update log " << path_;
+  }
+  buffer_.clear();
+}
+
+uint64_t UpdateRecorder::numRecords() const {
+  lock_guard<mutex> g(lock_);
+  return numRecords_;
+}
+
+UpdateLogReader::UpdateLogReader(StringPiece path)
+  : path_(path.str()) {
+  if (!folly::readFile(path_.c_str(), data_)) {
+    folly::throwSystemError("error reading update log ", path_);
+  }
+  remaining_ = ByteRange(StringPiece(data_));
+  if (remaining_.size() < kHeaderLen ||
+      StringPiece(remaining_.subpiece(0, kMagicLen)) !=
+      StringPiece(kMagic, kMagicLen)) {
+    throw FbossError(path_, " is not an update log");
+  }
+  uint32_t version = 0;
+  for (int i = 0; i < 4; ++i) {
+    version |= static_cast<uint32_t>(remaining_[kMagicLen + i]) << (8 * i);
+  }
+  if (version != kVersion) {
+    throw FbossError("update log ", path_, " has unsupported version ",
+                     version);
+  }
+  remaining_.advance(kHeaderLen);
+}
+
+bool UpdateLogReader::readRecord(UpdateLogRecord* record) {
+  if (remaining_.empty()) {
+    return false;
+  }
+  auto type = remaining_.front();
+  remaining_.advance(1);
+  uint64_t delta, arg1, arg2, len;
+  if (!readVarint(&remaining_, &delta) ||
+      !readVarint(&remaining_, &arg1) ||
+      !readVarint(&remaining_, &arg2) ||
+      !readVarint(&remaining_, &len) ||
+      len > remaining_.size()) {
+    throw FbossError("update log ", path_, " is truncated in a record");
+  }
+  if (type < static_cast<uint8_t>(UpdateLogRecord::Type::ADD_ROUTES) ||
+      type > static_cast<uint8_t>(UpdateLogRecord::Type::STATE_UPDATE)) {
+    throw FbossError("update log ", path_, " has a bad record type ",
+                     static_cast<int>(type));
+  }
+  time_ += microseconds(delta);
+  record->type = static_cast<UpdateLogRecord::Type>(type);
+  record->time = time_;
+  record->arg1 = arg1;
+  record->arg2 = arg2;
+  record->payload.assign(reinterpret_cast<const char*>(remaining_.data()),
+                         len);
+  remaining_.advance(len);
+  return true;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/if/gen-cpp2/ctrl_types.h"
+#include "fboss/agent/state/RouteTypes.h"
+
+#include <folly/File.h>
+#include <folly/Range.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class RxPacket;
+
+/*
+ * The control plane updates kept in an update log: the route and neighbor
+ * thrift calls, the trapped packets, and the names of the state updates
+ * scheduled.
+ *
+ * A log starts with an 8 byte magic number and a 4 byte little endian
+ * version, followed by the records.  Each record is its type byte, then as
+ * varints the microseconds since the previous record, the two arguments and
+ * the payload length, then the payload.
+ */
+struct UpdateLogRecord {
+  enum class Type : uint8_t {
+    // arg1 is the client, arg2 the admin distance of its routes, and the
+    // payload the list of routes or prefixes
+    ADD_ROUTES = 1,
+    DELETE_ROUTES = 2,
+    SYNC_FIB = 3,
+    // The payload is the PackedRoutes
+    ADD_ROUTES_PACKED = 4,
+    // The payload is the list of NeighborToFlush
+    FLUSH_NEIGHBORS = 5,
+    // arg1 is the source port, arg2 the source VLAN, and the payload the
+    // packet
+    PACKET = 6,
+    // The payload is the name of the update
+    STATE_UPDATE = 7,
+  };
+
+  Type type{Type::STATE_UPDATE};
+  // Since the recording started
+  std::chrono::microseconds time{0};
+  uint32_t arg1{0};
+  uint32_t arg2{0};
+  std::string payload;
+
+  static const char* getTypeName(Type type);
+
+  /*
+   * Decode the payload of a route, neighbor or packed routes record.  These
+   * throw an FbossError if it doesn't hold what the record type says.
+   */
+  std::vector<UnicastRoute> getRoutes() const;
+  std::vector<IpPrefix> getPrefixes() const;
+  PackedRoutes getPackedRoutes() const;
+  std::vector<NeighborToFlush> getNeighbors() const;
+};
+
+/*
+ * UpdateRecorder writes the control plane updates of the agent to an update
+ * log, enabled with --update_record_file, so that a production incident can
+ * be replayed offline with sim_update_replay.
+ *
+ * The record methods can be called from any thread.  They only append to a
+ * buffer, which is written out with blocking I/O once it grows past 64KB,
+ * and when the recorder is flushed or destroyed.  Write errors are logged
+ * rather than thrown, so recording never fails the update recorded.
+ */
+class UpdateRecorder {
+ public:
+  explicit UpdateRecorder(folly::StringPiece path);
+  ~UpdateRecorder();
+
+  void recordAddRoutes(int16_t client, AdminDistance distance,
+                       folly::Range<const UnicastRoute*> routes);
+  void recordDeleteRoutes(int16_t client,
+                          folly::Range<const IpPrefix*> prefixes);
+  void recordSyncFib(int16_t client, AdminDistance distance,
+                     folly::Range<const UnicastRoute*> routes);
+  void recordAddRoutesPacked(int16_t client, AdminDistance distance,
+                             const PackedRoutes& routes);
+  void recordFlushNeighbors(folly::Range<const NeighborToFlush*> entries);
+  void recordPacket(const RxPacket* pkt);
+  void recordStateUpdate(folly::StringPiece name);
+
+  void flush();
+
+  // The number of records so far
+  uint64_t numRecords() const;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  UpdateRecorder(UpdateRecorder const &) = delete;
+  UpdateRecorder& operator=(UpdateRecorder const &) = delete;
+
+  void append(UpdateLogRecord::Type type, uint32_t arg1, uint32_t arg2,
+              folly::ByteRange payload);
+  void flushLocked();
+
+  mutable std::mutex lock_;
+  folly::File file_;
+  std::string path_;
+  std::string buffer_;
+  std::chrono::steady_clock::time_point start_;
+  // When the last record was appended, since start_
+  std::chrono::microseconds last_{0};
+  uint64_t numRecords_{0};
+};
+
+/*
+ * UpdateLogReader reads the records of an update log back.
+ */
+class UpdateLogReader {
+ public:
+  /*
+   * Read in the whole log.  Throws an FbossError if it is not an update log.
+   */
+  explicit UpdateLogReader(folly::StringPiece path);
+
+  /*
+   * Read the next record into record.
+   *
+   * Returns false at the end of the log, and throws an FbossError if it is
+   * truncated or corrupt.
+   */
+  bool readRecord(UpdateLogRecord* record);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  UpdateLogReader(UpdateLogReader const &) = delete;
+  UpdateLogReader& operator=(UpdateLogReader const &) = delete;
+
+  std::string path_;
+  std::string data_;
+  folly::ByteRange remaining_;
+  std::chrono::microseconds time_{0};
+};
+
+}} // facebook::fboss
@@ -0,0 +1,273 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/UpdateWatchdog.h"
+
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Conv.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <execinfo.h>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+// How long to wait for a stalled thread to take its stack sample
+const milliseconds kSampleTimeout(100);
+// The signal handler and the signal trampoline
+const int kSkipFrames = 2;
+const int kMaxFrames = 64;
+
+// Only one stack is sampled at a time, under sampleMutex
+mutex sampleMutex;
+void* sampleFrames[kMaxFrames];
+std::atomic<int> sampleDepth{-1};
+
+int stackSignal() {
+  return SIGRTMIN + 5;
+}
+
+void stackSampleHandler(int) {
+  auto savedErrno = errno;
+  sampleDepth.store(backtrace(sampleFrames, kMaxFrames),
+                    std::memory_order_release);
+  errno = savedErrno;
+}
+
+void installStackSampleHandler() {
+  static std::once_flag installed;
+  std::call_once(installed, [] {
+    // backtrace() loads libgcc the first time it is called, which must not
+    // happen in the signal handler
+    void* frame;
+    backtrace(&frame, 1);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stackSampleHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(stackSignal(), &action, nullptr) != 0) {
+      PLOG(ERROR) << "failed to install the stack sample handler";
+    }
+  });
+}
+
+// Make the thread record its stack from a signal handler
+std::vector<std::string> sampleStack(pthread_t thread) {
+  std::vector<std::string> stack;
+  lock_guard<mutex> g(sampleMutex);
+  sampleDepth.store(-1, std::memory_order_relaxed);
+  if (pthread_kill(thread, stackSignal()) != 0) {
+    return stack;
+  }
+  auto deadline = steady_clock::now() + kSampleTimeout;
+  int depth;
+  while ((depth = sampleDepth.load(std::memory_order_acquire)) < 0) {
+    if (steady_clock::now() > deadline) {
+      return stack;
+    }
+    std::this_thread::sleep_for(milliseconds(1));
+  }
+  char** symbols = backtrace_symbols(sampleFrames, depth);
+  if (!symbols) {
+    return stack;
+  }
+  for (int i = std::min(kSkipFrames, depth); i < depth; ++i) {
+    stack.push_back(symbols[i]);
+  }
+  free(symbols);
+  return stack;
+}
+
+template<typename Delta>
+size_t numChanges(const Delta& delta) {
+  return delta.collectChanges()->size();
+}
+
+} // unnamed namespace
+
+UpdateWatchdog::Scope::Scope(UpdateWatchdog* watchdog,
+                             folly::StringPiece name,
+                             folly::StringPiece stage,
+                             size_t numUpdates,
+                             std::shared_ptr<const StateDelta> delta)
+  : watchdog_(watchdog),
+    numUpdates_(numUpdates) {
+  if (!watchdog_) {
+    return;
+  }
+  name_ = name.str();
+  stage_ = stage.str();
+  delta_ = std::move(delta);
+  thread_ = pthread_self();
+  start_ = steady_clock::now();
+  lock_guard<mutex> g(watchdog_->scopesMutex_);
+  watchdog_->scopes_.push_back(this);
+}
+
+UpdateWatchdog::Scope::~Scope() {
+  if (!watchdog_) {
+    return;
+  }
+  {
+    lock_guard<mutex> g(watchdog_->scopesMutex_);
+    auto& scopes = watchdog_->scopes_;
+    scopes.erase(std::find(scopes.begin(), scopes.end(), this));
+  }
+  if (reported_) {
+    LOG(WARNING) << "stalled state update " << name_ << " finished its "
+                 << stage_ << " stage after "
+                 << duration_cast<milliseconds>(
+                        steady_clock::now() - start_).count() << "ms";
+  }
+}
+
+UpdateWatchdog::UpdateWatchdog(milliseconds threshold)
+  : threshold_(threshold) {
+}
+
+UpdateWatchdog::~UpdateWatchdog() {
+  stop();
+}
+
+void UpdateWatchdog::start() {
+  CHECK(!thread_.joinable());
+  installStackSampleHandler();
+  {
+    lock_guard<mutex> g(stopMutex_);
+    stopping_ = false;
+  }
+  thread_ = std::thread([this] { watchdogLoop(); });
+}
+
+void UpdateWatchdog::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    lock_guard<mutex> g(stopMutex_);
+    stopping_ = true;
+  }
+  stopCV_.notify_one();
+  thread_.join();
+}
+
+void UpdateWatchdog::watchdogLoop() {
+  pthread_setname_np(pthread_self(), "fbossWatchdog");
+  // Check a few times per threshold, so stalls are caught soon after
+  auto interval = std::max(threshold_ / 4, milliseconds(10));
+  std::unique_lock<mutex> lock(stopMutex_);
+  while (!stopCV_.wait_for(lock, interval, [this] { return stopping_; })) {
+    lock.unlock();
+    check();
+    lock.lock();
+  }
+}
+
+void UpdateWatchdog::check() {
+  auto now = steady_clock::now();
+  milliseconds oldest{0};
+  std::vector<Stall> stalls;
+  std::vector<std::shared_ptr<const StateDelta>> deltas;
+  {
+    lock_guard<mutex> g(scopesMutex_);
+    for (auto* scope : scopes_) {
+      auto age = duration_cast<milliseconds>(now - scope->start_);
+      oldest = std::max(oldest, age);
+      if (age < threshold_ || scope->reported_) {
+        continue;
+      }
+      scope->reported_ = true;
+      Stall stall;
+      stall.name = scope->name_;
+      stall.stage = scope->stage_;
+      stall.numUpdates = scope->numUpdates_;
+      stall.duration = age;
+      // The Scope can't go away while we hold the lock, so neither can
+      // its thread
+      stall.stack = sampleStack(scope->thread_);
+      stalls.push_back(std::move(stall));
+      deltas.push_back(scope->delta_);
+    }
+  }
+  fbData->setCounter(SwitchStats::kCounterPrefix + "state_update.stall_ms",
+                     oldest.count());
+
+  for (size_t i = 0; i < stalls.size(); ++i) {
+    // Sizing the delta may take a while for a large one, so it is done
+    // without blocking the update threads
+    if (deltas[i]) {
+      stalls[i].delta = describeDelta(*deltas[i]);
+    }
+    report(std::move(stalls[i]));
+  }
+}
+
+void UpdateWatchdog::report(Stall stall) {
+  fbData->incrementCounter(
+      SwitchStats::kCounterPrefix + "state_update.stalls", 1);
+  LOG(WARNING) << "state update " << stall.name << " (batch of "
+               << stall.numUpdates << ") stalled in its " << stall.stage
+               << " stage for " << stall.duration.count() << "ms"
+               << (stall.delta.empty() ? "" : ", programming ")
+               << stall.delta;
+  for (const auto& frame : stall.stack) {
+    LOG(WARNING) << "  " << frame;
+  }
+  lock_guard<mutex> g(stallsMutex_);
+  ++numStalls_;
+  lastStall_ = std::move(stall);
+}
+
+uint64_t UpdateWatchdog::getNumStalls() const {
+  lock_guard<mutex> g(stallsMutex_);
+  return numStalls_;
+}
+
+UpdateWatchdog::Stall UpdateWatchdog::getLastStall() const {
+  lock_guard<mutex> g(stallsMutex_);
+  return lastStall_;
+}
+
+std::string UpdateWatchdog::describeDelta(const StateDelta& delta) {
+  size_t neighbors = 0;
+  for (const auto& vlanDelta : delta.getVlansDelta()) {
+    neighbors += numChanges(vlanDelta.getArpDelta()) +
+      numChanges(vlanDelta.getNdpDelta());
+  }
+  size_t routes = 0;
+  for (const auto& rtDelta : delta.getRouteTablesDelta()) {
+    routes += numChanges(rtDelta.getRoutesV4Delta()) +
+      numChanges(rtDelta.getRoutesV6Delta());
+  }
+  return folly::to<std::string>(
+      numChanges(delta.getPortsDelta()), " port, ",
+      numChanges(delta.getVlansDelta()), " vlan, ",
+      numChanges(delta.getIntfsDelta()), " interface, ",
+      neighbors, " neighbor and ", routes, " route changes");
+}
+
+}} // facebook::fboss
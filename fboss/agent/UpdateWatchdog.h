@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class StateDelta;
+
+/*
+ * UpdateWatchdog reports state updates that take too long.
+ *
+ * While the update thread is stuck in a StateUpdate function or an SDK
+ * call, nothing else that needs a state update makes progress: neighbors
+ * aren't learned, route calls queue up and link changes wait.  The update
+ * and HW update threads mark what they are running with Scope objects, and
+ * the watchdog thread checks on them a few times per threshold.
+ *
+ * The first time a Scope is found running for longer than the threshold,
+ * the watchdog logs the update's name, what it was doing, the size of the
+ * delta being programmed and a sample of the stack of the thread running
+ * it, and bumps the state_update.stalls counter.  The
+ * state_update.stall_ms counter is the age of the oldest running Scope, or
+ * 0 when nothing is stalled.
+ */
+class UpdateWatchdog {
+ public:
+  /*
+   * Marks the calling thread as running an update until destroyed.  Scopes
+   * for a null watchdog do nothing.
+   */
+  class Scope {
+   public:
+    Scope(UpdateWatchdog* watchdog, folly::StringPiece name,
+          folly::StringPiece stage, size_t numUpdates,
+          std::shared_ptr<const StateDelta> delta = nullptr);
+    ~Scope();
+
+   private:
+    friend class UpdateWatchdog;
+
+    // Forbidden copy constructor and assignment operator
+    Scope(Scope const &) = delete;
+    Scope& operator=(Scope const &) = delete;
+
+    UpdateWatchdog* watchdog_;
+    std::string name_;
+    std::string stage_;
+    size_t numUpdates_;
+    std::shared_ptr<const StateDelta> delta_;
+    pthread_t thread_;
+    std::chrono::steady_clock::time_point start_;
+    bool reported_{false};
+  };
+
+  struct Stall {
+    std::string name;
+    std::string stage;
+    size_t numUpdates{0};
+    std::chrono::milliseconds duration{0};
+    // The changes in the delta being programmed, if any
+    std::string delta;
+    // The stack of the stalled thread, innermost frame first
+    std::vector<std::string> stack;
+  };
+
+  explicit UpdateWatchdog(std::chrono::milliseconds threshold);
+  ~UpdateWatchdog();
+
+  /*
+   * Start and stop the watchdog thread.
+   */
+  void start();
+  void stop();
+
+  /*
+   * Check the running Scopes once, and report those that just went over
+   * the threshold.  This is only public for use in unit tests; the
+   * watchdog thread calls it periodically.
+   */
+  void check();
+
+  uint64_t getNumStalls() const;
+  /*
+   * The last stall reported, if any.
+   */
+  Stall getLastStall() const;
+
+  /*
+   * A summary of the number of changes in a delta, for the logs.
+   */
+  static std::string describeDelta(const StateDelta& delta);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  UpdateWatchdog(UpdateWatchdog const &) = delete;
+  UpdateWatchdog& operator=(UpdateWatchdog const &) = delete;
+
+  void watchdogLoop();
+  void report(Stall stall);
+
+  const std::chrono::milliseconds threshold_;
+  std::thread thread_;
+  std::mutex stopMutex_;
+  std::condition_variable stopCV_;
+  bool stopping_{false};
+
+  // Held while a stalled thread's stack is sampled, so that its Scope, and
+  // the thread, outlive the sample
+  std::mutex scopesMutex_;
+  std::vector<Scope*> scopes_;
+
+  mutable std::mutex stallsMutex_;
+  uint64_t numStalls_{0};
+  Stall lastStall_;
+};
+
+}} // facebook::fboss
@@ -16,6 +16,12 @@
 #include "fboss/agent/state/InterfaceMap.h"
 
 #include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using folly::IPAddressV4;
 using folly::IPAddressV6;
@@ -30,6 +36,52 @@ void utilCreateDir(folly::StringPiece path) {
   }
 }
 
+void runInParallel(size_t count, size_t maxThreads,
+                   const std::function<void(size_t)>& fn) {
+  auto numThreads = std::min(count, maxThreads);
+  if (numThreads <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::mutex exMutex;
+  std::exception_ptr ex;
+  auto worker = [&] {
+    while (!failed.load(std::memory_order_relaxed)) {
+      auto i = next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= count) {
+        return;
+      }
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> g(exMutex);
+        if (!ex) {
+          ex = std::current_exception();
+        }
+        failed.store(true, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for (size_t i = 1; i < numThreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (ex) {
+    std::rethrow_exception(ex);
+  }
+}
+
 IPAddressV4 getSwitchVlanIP(const std::shared_ptr<SwitchState>& state,
                             VlanID vlan) {
   IPAddressV4 switchIp;
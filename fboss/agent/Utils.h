@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <functional>
 #include <type_traits> // To use 'std::integral_constant'.
 #include <folly/Bits.h>
 #include <folly/IPAddressV4.h>
@@ -36,6 +37,17 @@ inline T readBuffer(const uint8_t* buffer, uint32_t pos, size_t buffSize) {
  */
 void utilCreateDir(folly::StringPiece path);
 
+/*
+ * Call fn(0) through fn(count - 1) from up to maxThreads threads, the
+ * calling thread included, and wait for them all to return.
+ *
+ * If any call throws, no new calls are started, and the first exception is
+ * rethrown once the calls already running have returned.  A maxThreads of
+ * 0 or 1 makes the calls serially, in order.
+ */
+void runInParallel(size_t count, size_t maxThreads,
+                   const std::function<void(size_t)>& fn);
+
 /**
  * Helper function to get an IPv4 address for a particular vlan
  * Used to set src IP address for DHCP and ICMP packets
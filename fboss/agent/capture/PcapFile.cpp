@@ -14,6 +14,7 @@
 #include <folly/Exception.h>
 #include <folly/FileUtil.h>
 
+#include <algorithm>
 #include <chrono>
 
 using folly::IOBuf;
@@ -33,7 +34,7 @@ PcapFile::PktHeader::PktHeader(const PcapPkt& pkt) {
   timeSec = tsSec.count();
   timeUsec = (tsUsec - tsSec).count();
   includedLen = len;
-  origLen = len;
+  origLen = std::max<uint32_t>(len, pkt.origLength());
 }
 
 PcapFile::PcapFile() {
@@ -73,6 +74,7 @@ void PcapFile::writeGlobalHeader() {
 
   int ret = writeFull(file_.fd(), &hdr, sizeof(hdr));
   folly::checkUnixError(ret, "error writing pcap global header");
+  bytesWritten_ += ret;
 }
 
 void PcapFile::writePackets(const std::vector<PcapPkt>& pkts) {
@@ -92,8 +94,9 @@ void PcapFile::writePackets(const std::vector<PcapPkt>& pkts) {
     pkt.buf()->appendToIov(&iov);
   }
 
-  int ret = writevFull(file_.fd(), iov.data(), iov.size());
+  auto ret = writevFull(file_.fd(), iov.data(), iov.size());
   folly::checkUnixError(ret, "error writing pcap data");
+  bytesWritten_ += ret;
 }
 
 int PcapFile::openFlags(bool overwriteExisting) {
@@ -35,6 +35,11 @@ class PcapFile {
   void writeGlobalHeader();
   void writePackets(const std::vector<PcapPkt>& pkt);
 
+  // The number of bytes written to the file so far, headers included
+  uint64_t bytesWritten() const {
+    return bytesWritten_;
+  }
+
   // Move constructor and assignment operator
   PcapFile(PcapFile&&) = default;
   PcapFile& operator=(PcapFile&&) = default;
@@ -56,6 +61,7 @@ class PcapFile {
   static int openFlags(bool overwriteExisting);
 
   folly::File file_;
+  uint64_t bytesWritten_{0};
 };
 
 }} // facebook::fboss
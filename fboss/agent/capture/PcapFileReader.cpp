@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/capture/PcapFileReader.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/capture/PcapPkt.h"
+
+#include <folly/Bits.h>
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+
+#include <fcntl.h>
+#include <algorithm>
+#include <chrono>
+
+using folly::IOBuf;
+using folly::readFull;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+
+namespace {
+
+const uint32_t kMagic = 0xa1b2c3d4;
+const uint32_t kMagicNanosecond = 0xa1b23c4d;
+const uint32_t kLinkTypeEthernet = 1;
+// Larger than any frame we could have captured, so a bogus length in a
+// corrupt file is caught rather than allocated
+const uint32_t kMaxPacketLen = 256 * 1024;
+
+} // unnamed namespace
+
+namespace facebook { namespace fboss {
+
+PcapFileReader::PcapFileReader(folly::StringPiece path)
+  : file_(path.str().c_str(), O_RDONLY),
+    path_(path.str()) {
+  readGlobalHeader();
+}
+
+PcapFileReader::~PcapFileReader() {
+}
+
+void PcapFileReader::readGlobalHeader() {
+  struct GlobalHeader {
+    uint32_t magic;
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    uint32_t tzOffset;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linkType;
+  } hdr;
+  if (read(&hdr, sizeof(hdr)) != sizeof(hdr)) {
+    throw FbossError("pcap file ", path_, " is too short for its header");
+  }
+
+  if (hdr.magic == kMagic || hdr.magic == kMagicNanosecond) {
+    swapped_ = false;
+  } else if (folly::Endian::swap(hdr.magic) == kMagic ||
+             folly::Endian::swap(hdr.magic) == kMagicNanosecond) {
+    swapped_ = true;
+  } else {
+    throw FbossError(path_, " is not a pcap file: bad magic number ",
+                     hdr.magic);
+  }
+  nanosecond_ = toHost(hdr.magic) == kMagicNanosecond;
+  snapLen_ = toHost(hdr.snaplen);
+  auto linkType = toHost(hdr.linkType);
+  if (linkType != kLinkTypeEthernet) {
+    throw FbossError("pcap file ", path_, " has unsupported link type ",
+                     linkType);
+  }
+}
+
+bool PcapFileReader::readPacket(PcapPkt* pkt) {
+  uint32_t hdr[4];
+  auto len = read(hdr, sizeof(hdr));
+  if (len == 0) {
+    return false;
+  } else if (len != sizeof(hdr)) {
+    throw FbossError("pcap file ", path_, " is truncated in a packet header");
+  }
+  auto timeSec = toHost(hdr[0]);
+  auto timeFrac = toHost(hdr[1]);
+  auto includedLen = toHost(hdr[2]);
+  auto origLen = toHost(hdr[3]);
+  if (includedLen > kMaxPacketLen) {
+    throw FbossError("pcap file ", path_, " has a bad packet length ",
+                     includedLen);
+  }
+
+  auto buf = IOBuf::create(includedLen);
+  if (read(buf->writableData(), includedLen) != includedLen) {
+    throw FbossError("pcap file ", path_, " is truncated in packet data");
+  }
+  buf->append(includedLen);
+
+  auto sinceEpoch = duration_cast<PcapPkt::TimePoint::duration>(
+      seconds(timeSec) +
+      (nanosecond_ ? nanoseconds(timeFrac) : microseconds(timeFrac)));
+  *pkt = PcapPkt(true, PortID(0), VlanID(0), PcapPkt::TimePoint(sinceEpoch),
+                 std::move(buf), std::max(origLen, includedLen));
+  return true;
+}
+
+size_t PcapFileReader::read(void* buf, size_t len) {
+  auto ret = readFull(file_.fd(), buf, len);
+  folly::checkUnixError(ret, "error reading pcap file ", path_);
+  return ret;
+}
+
+uint32_t PcapFileReader::toHost(uint32_t value) const {
+  return swapped_ ? folly::Endian::swap(value) : value;
+}
+
+}} // facebook::fboss
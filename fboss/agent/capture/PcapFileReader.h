@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/File.h>
+#include <folly/Range.h>
+#include <string>
+
+namespace facebook { namespace fboss {
+
+class PcapPkt;
+
+/*
+ * PcapFileReader reads packets back from a pcap file, such as one written
+ * by PcapFile.
+ *
+ * Files in either byte order, with microsecond or nanosecond timestamps, can
+ * be read.  Only ethernet captures are supported, since those are the only
+ * ones the switch can do anything with.
+ *
+ * Like PcapFile, PcapFileReader uses blocking I/O.
+ */
+class PcapFileReader {
+ public:
+  /*
+   * Open the file and read its global header.  Throws an FbossError if the
+   * file is not an ethernet pcap file.
+   */
+  explicit PcapFileReader(folly::StringPiece path);
+  ~PcapFileReader();
+
+  /*
+   * Read the next packet into pkt.
+   *
+   * Returns false at the end of the file, and throws an FbossError if the
+   * file is truncated or corrupt.  The packet is marked as received, with
+   * no port or VLAN, since pcap does not record those.
+   */
+  bool readPacket(PcapPkt* pkt);
+
+  uint32_t snapLen() const {
+    return snapLen_;
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  PcapFileReader(PcapFileReader const &) = delete;
+  PcapFileReader& operator=(PcapFileReader const &) = delete;
+
+  void readGlobalHeader();
+  // Returns the number of bytes read, which is only short at end of file
+  size_t read(void* buf, size_t len);
+  uint32_t toHost(uint32_t value) const;
+
+  folly::File file_;
+  std::string path_;
+  // Whether the file was written in the other byte order
+  bool swapped_{false};
+  bool nanosecond_{false};
+  uint32_t snapLen_{0};
+};
+
+}} // facebook::fboss
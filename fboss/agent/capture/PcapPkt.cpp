@@ -27,7 +27,20 @@ PcapPkt::PcapPkt(const RxPacket* pkt, TimePoint timestamp)
     port_(pkt->getSrcPort()),
     vlan_(pkt->getSrcVlan()),
     timestamp_(timestamp),
+    origLength_(pkt->buf()->computeChainDataLength()),
     buf_() {
+  if (pkt->holdsRxBuffer()) {
+    // Captured packets are kept until the capture is written out.  Don't
+    // keep the RX pool buffer from going back to the hardware meanwhile.
+    // (Coalescing only copies a chain; a single buffer would be shared.)
+    if (pkt->buf()->isChained()) {
+      buf_ = pkt->buf()->cloneCoalescedAsValue();
+    } else {
+      buf_ = folly::IOBuf(folly::IOBuf::COPY_BUFFER, pkt->buf()->data(),
+                          pkt->buf()->length());
+    }
+    return;
+  }
   pkt->buf()->cloneInto(buf_);
 }
 
@@ -41,8 +54,21 @@ PcapPkt::PcapPkt(const TxPacket* pkt, TimePoint timestamp)
     port_(0),
     vlan_(0),
     timestamp_(timestamp),
+    origLength_(pkt->buf()->computeChainDataLength()),
     buf_() {
   pkt->buf()->cloneInto(buf_);
 }
 
+PcapPkt::PcapPkt(bool rx, PortID port, VlanID vlan, TimePoint timestamp,
+                 std::unique_ptr<folly::IOBuf> data, uint32_t origLength)
+  : initialized_(true),
+    rx_(rx),
+    port_(port),
+    vlan_(vlan),
+    timestamp_(timestamp),
+    origLength_(origLength),
+    buf_() {
+  data->cloneInto(buf_);
+}
+
 }} // facebook::fboss
@@ -42,6 +42,14 @@ class PcapPkt {
   explicit PcapPkt(const TxPacket* pkt);
   PcapPkt(const TxPacket* pkt, TimePoint timestamp);
 
+  /*
+   * Create a PcapPkt from packet data that has already been copied out of
+   * the packet, possibly truncated.  origLength is the length of the whole
+   * packet on the wire.
+   */
+  PcapPkt(bool rx, PortID port, VlanID vlan, TimePoint timestamp,
+          std::unique_ptr<folly::IOBuf> data, uint32_t origLength);
+
   bool initialized() const {
     return initialized_;
   }
@@ -63,6 +71,13 @@ class PcapPkt {
   const folly::IOBuf* buf() const {
     return &buf_;
   }
+  /*
+   * The length of the packet on the wire.  This is larger than the data in
+   * buf() if the packet was truncated when it was captured.
+   */
+  uint32_t origLength() const {
+    return origLength_;
+  }
 
   // Move assignment
   PcapPkt(PcapPkt&& other) noexcept {
@@ -76,6 +91,7 @@ class PcapPkt {
     port_ = other.port_;
     vlan_ = other.vlan_;
     timestamp_ = other.timestamp_;
+    origLength_ = other.origLength_;
     buf_ = std::move(other.buf_);
     return *this;
   }
@@ -99,6 +115,7 @@ class PcapPkt {
   // The VLAN the packet was sent or received on.
   VlanID vlan_{0};
   TimePoint timestamp_;
+  uint32_t origLength_{0};
   // The packet contents, starting from the ethernet header.
   folly::IOBuf buf_;
 };
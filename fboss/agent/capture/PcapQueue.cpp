@@ -13,18 +13,47 @@
 #include "fboss/agent/TxPacket.h"
 #include "fboss/agent/capture/PcapPkt.h"
 
+#include <folly/Bits.h>
+#include <folly/io/Cursor.h>
+
 DEFINE_int32(fboss_pcap_queue_depth, 10240,
              "When taking packet captures, the maximum number of packets "
              "to buffer in memory while waiting them to be written to the "
              "capture file");
+DEFINE_int32(fboss_pcap_snaplen, 0,
+             "When non-zero, packet captures only keep this many bytes of "
+             "each packet, and buffer them in a preallocated lock-free ring "
+             "so that capturing adds almost no cost to packet processing");
+
+namespace {
+
+// How long the reader sleeps before checking the ring again, in case it
+// missed a wakeup.
+const std::chrono::milliseconds kRingPollInterval(100);
+
+}
 
 namespace facebook { namespace fboss {
 
-PcapQueue::PcapQueue(uint32_t pktCapacity, uint64_t bytesCapacity)
+PcapQueue::PcapQueue(uint32_t pktCapacity, uint64_t bytesCapacity,
+                     uint32_t snapLen)
   : pktCapacity_(pktCapacity == 0 ?
                  FLAGS_fboss_pcap_queue_depth : pktCapacity),
-    bytesCapacity_(bytesCapacity) {
-  queue_.reserve(pktCapacity_);
+    bytesCapacity_(bytesCapacity),
+    snapLen_(snapLen == 0 ? FLAGS_fboss_pcap_snaplen : snapLen) {
+  if (snapLen_ == 0) {
+    queue_.reserve(pktCapacity_);
+    return;
+  }
+
+  auto numSlots = folly::nextPowTwo(static_cast<uint64_t>(pktCapacity_));
+  ringMask_ = numSlots - 1;
+  ring_.reset(new RingSlot[numSlots]);
+  ringData_.reset(new uint8_t[numSlots * snapLen_]);
+  for (uint64_t i = 0; i < numSlots; ++i) {
+    ring_[i].seq.store(i, std::memory_order_relaxed);
+    ring_[i].data = ringData_.get() + i * snapLen_;
+  }
 }
 
 PcapQueue::~PcapQueue() {
@@ -46,7 +75,62 @@ void PcapQueue::addPktInternal(const PktType* pkt) {
   queue_.emplace_back(pkt);
 }
 
+template<typename PktType>
+void PcapQueue::addPktRing(const PktType* pkt, bool rx,
+                           PortID port, VlanID vlan) {
+  // Claim a slot
+  RingSlot* slot;
+  uint64_t pos = ringEnqueuePos_.load(std::memory_order_relaxed);
+  while (true) {
+    slot = &ring_[pos & ringMask_];
+    auto seq = slot->seq.load(std::memory_order_acquire);
+    auto diff = static_cast<int64_t>(seq - pos);
+    if (diff == 0) {
+      if (ringEnqueuePos_.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The reader has not consumed this slot yet, so the ring is full
+      ringDropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = ringEnqueuePos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Fill it in and hand it to the reader
+  const auto* buf = pkt->buf();
+  auto origLen = buf->computeChainDataLength();
+  slot->rx = rx;
+  slot->port = port;
+  slot->vlan = vlan;
+  slot->timestamp = std::chrono::system_clock::now();
+  slot->origLen = origLen;
+  slot->len = std::min<uint64_t>(origLen, snapLen_);
+  folly::io::Cursor cursor(buf);
+  cursor.pull(slot->data, slot->len);
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  if (readerWaiting_.load()) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    cv_.notify_one();
+  }
+}
+
+void PcapQueue::addPktRing(const RxPacket* pkt) {
+  addPktRing(pkt, true, pkt->getSrcPort(), pkt->getSrcVlan());
+}
+
+void PcapQueue::addPktRing(const TxPacket* pkt) {
+  addPktRing(pkt, false, PortID(0), VlanID(0));
+}
+
 void PcapQueue::addPkt(const RxPacket* pkt) {
+  if (snapLen_) {
+    addPktRing(pkt);
+    return;
+  }
   {
     std::lock_guard<std::mutex> guard(mutex_);
     addPktInternal(pkt);
@@ -55,6 +139,10 @@ void PcapQueue::addPkt(const RxPacket* pkt) {
 }
 
 void PcapQueue::addPktLocked(const RxPacket* pkt) {
+  if (snapLen_) {
+    addPktRing(pkt);
+    return;
+  }
   addPktInternal(pkt);
   // It is preferred not to be holding the lock when we signal cv_,
   // but it is okay to call it with the lock held anyway.  (Having the lock
@@ -64,6 +152,10 @@ void PcapQueue::addPktLocked(const RxPacket* pkt) {
 }
 
 void PcapQueue::addPkt(const TxPacket* pkt) {
+  if (snapLen_) {
+    addPktRing(pkt);
+    return;
+  }
   {
     std::lock_guard<std::mutex> guard(mutex_);
     addPktInternal(pkt);
@@ -72,6 +164,10 @@ void PcapQueue::addPkt(const TxPacket* pkt) {
 }
 
 void PcapQueue::addPktLocked(const TxPacket* pkt) {
+  if (snapLen_) {
+    addPktRing(pkt);
+    return;
+  }
   addPktInternal(pkt);
   // It is preferred not to be holding the lock when we signal cv_,
   // but it is okay to call it with the lock held anyway.  (Having the lock
@@ -93,12 +189,15 @@ bool PcapQueue::isFinished() const {
 
 uint64_t PcapQueue::numDropped() const {
   std::lock_guard<std::mutex> guard(mutex_);
-  return pktsDropped_;
+  return pktsDropped_ + ringDropped_.load(std::memory_order_relaxed);
 }
 
 bool PcapQueue::wait(std::vector<PcapPkt>* swapQueue) {
   swapQueue->clear();
   swapQueue->reserve(pktCapacity_);
+  if (snapLen_) {
+    return waitRing(swapQueue);
+  }
 
   std::unique_lock<std::mutex> guard(mutex_);
   while (queue_.empty() && !finished_) {
@@ -115,4 +214,47 @@ bool PcapQueue::wait(std::vector<PcapPkt>* swapQueue) {
   return true;
 }
 
+void PcapQueue::drainRing(std::vector<PcapPkt>* swapQueue) {
+  while (true) {
+    auto* slot = &ring_[ringDequeuePos_ & ringMask_];
+    auto seq = slot->seq.load(std::memory_order_acquire);
+    if (seq != ringDequeuePos_ + 1) {
+      // The next slot has not been filled in yet
+      return;
+    }
+    swapQueue->emplace_back(slot->rx, slot->port, slot->vlan,
+                            slot->timestamp,
+                            folly::IOBuf::copyBuffer(slot->data, slot->len),
+                            slot->origLen);
+    // Make the slot available to producers for the next lap of the ring
+    slot->seq.store(ringDequeuePos_ + ringMask_ + 1,
+                    std::memory_order_release);
+    ++ringDequeuePos_;
+  }
+}
+
+bool PcapQueue::waitRing(std::vector<PcapPkt>* swapQueue) {
+  while (true) {
+    drainRing(swapQueue);
+    if (!swapQueue->empty()) {
+      return true;
+    }
+
+    std::unique_lock<std::mutex> guard(mutex_);
+    if (finished_) {
+      // Pick up anything added before finish() was called
+      drainRing(swapQueue);
+      return !swapQueue->empty();
+    }
+    // Producers check readerWaiting_ after publishing their slot, so after
+    // setting it we must look at the ring once more before sleeping.
+    readerWaiting_.store(true);
+    drainRing(swapQueue);
+    if (swapQueue->empty()) {
+      cv_.wait_for(guard, kRingPollInterval);
+    }
+    readerWaiting_.store(false);
+  }
+}
+
 }} // facebook::fboss
@@ -9,7 +9,11 @@
  */
 #pragma once
 
+#include "fboss/agent/capture/PcapPkt.h"
+
+#include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <vector>
 
@@ -17,7 +21,6 @@ namespace facebook { namespace fboss {
 
 class RxPacket;
 class TxPacket;
-class PcapPkt;
 
 /*
  * PcapQueue stores a queue of PcapPkt objects, for transferring packets
@@ -25,16 +28,35 @@ class PcapPkt;
  * the packets.  (For instance, writing them to disk using blocking I/O.)
  *
  * There can only be a single reader.
+ *
+ * pktCapacity and snapLen default to --fboss_pcap_queue_depth and
+ * --fboss_pcap_snaplen when 0.
+ *
+ * With a non-zero snapLen, the queue is instead a lock-free
+ * ring of pktCapacity preallocated slots (rounded up to a power of two).
+ * Adding a packet then just claims a slot and copies at most snapLen bytes
+ * into it, without taking the mutex or allocating memory, so any number of
+ * RX and TX threads can add packets with very little overhead.  Packets that
+ * find the ring full are dropped and counted.  The reader converts slots into
+ * PcapPkts, so nothing changes for it.
  */
 class PcapQueue {
  public:
-  explicit PcapQueue(uint32_t pktCapacity, uint64_t bytesCapacity = 0);
+  explicit PcapQueue(uint32_t pktCapacity, uint64_t bytesCapacity = 0,
+                     uint32_t snapLen = 0);
   virtual ~PcapQueue();
 
   uint32_t getPktCapacity() const {
     // pktCapacity_ is const, so no need for locking
     return pktCapacity_;
   }
+  /*
+   * The maximum number of bytes captured from each packet, or 0 if packets
+   * are captured in full.
+   */
+  uint32_t getSnapLen() const {
+    return snapLen_;
+  }
 
   /*
    * Get the mutex protecting this PcapQueue.
@@ -42,6 +64,7 @@ class PcapQueue {
    * This is exposed to allow callers to also protect their own data
    * with the same mutex if desired.  Callers should call addPktLocked()
    * instead of addPkt() when they are already holding the PcapQueue mutex.
+   * In ring mode adding packets never takes the mutex.
    */
   std::mutex& mutex() const {
     return mutex_;
@@ -84,8 +107,31 @@ class PcapQueue {
   PcapQueue(PcapQueue const &) = delete;
   PcapQueue& operator=(PcapQueue const &) = delete;
 
+  /*
+   * A preallocated ring slot.  seq implements a bounded MPMC queue, see
+   * http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+   * A slot at position pos is free for a producer when seq == pos, and holds
+   * a packet for the reader when seq == pos + 1.
+   */
+  struct RingSlot {
+    std::atomic<uint64_t> seq{0};
+    bool rx{false};
+    PortID port{0};
+    VlanID vlan{0};
+    PcapPkt::TimePoint timestamp;
+    uint32_t len{0};
+    uint32_t origLen{0};
+    uint8_t* data{nullptr};
+  };
+
   template<typename PktType>
   void addPktInternal(const PktType* pkt);
+  template<typename PktType>
+  void addPktRing(const PktType* pkt, bool rx, PortID port, VlanID vlan);
+  void addPktRing(const RxPacket* pkt);
+  void addPktRing(const TxPacket* pkt);
+  bool waitRing(std::vector<PcapPkt>* swapQueue);
+  void drainRing(std::vector<PcapPkt>* swapQueue);
 
   mutable std::mutex mutex_;
   std::condition_variable cv_;
@@ -96,6 +142,18 @@ class PcapQueue {
   uint64_t bytesInQueue_{0};
   uint64_t pktsDropped_{0};
   std::vector<PcapPkt> queue_;
+
+  // Ring mode only
+  const uint32_t snapLen_{0};
+  uint64_t ringMask_{0};
+  std::unique_ptr<RingSlot[]> ring_;
+  std::unique_ptr<uint8_t[]> ringData_;
+  std::atomic<uint64_t> ringEnqueuePos_{0};
+  uint64_t ringDequeuePos_{0}; // only accessed by the reader
+  std::atomic<uint64_t> ringDropped_{0};
+  // Set while the reader is waiting on cv_, so that producers only touch
+  // the mutex when there is someone to wake up.
+  std::atomic<bool> readerWaiting_{false};
 };
 
 }} // facebook::fboss
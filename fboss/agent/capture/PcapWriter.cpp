@@ -11,20 +11,26 @@
 
 #include "fboss/agent/capture/PcapPkt.h"
 
+#include <folly/Conv.h>
 #include <folly/String.h>
 
 using folly::StringPiece;
+using std::chrono::steady_clock;
 
 namespace facebook { namespace fboss {
 
-PcapWriter::PcapWriter(uint32_t maxBufferedPkts)
-  : queue_(maxBufferedPkts) {
+PcapWriter::PcapWriter(uint32_t maxBufferedPkts, uint32_t snapLen)
+  : queue_(maxBufferedPkts, 0, snapLen) {
 }
 
 PcapWriter::PcapWriter(StringPiece path,
                        bool overwriteExisting,
                        uint32_t maxBufferedPkts)
-  : file_(path, overwriteExisting),
+  : path_(path.str()),
+    overwriteExisting_(overwriteExisting),
+    numFiles_(1),
+    fileOpened_(steady_clock::now()),
+    file_(path, overwriteExisting),
     queue_(maxBufferedPkts),
     thread_(&PcapWriter::threadMain, this) {
 }
@@ -41,8 +47,17 @@ PcapWriter::~PcapWriter() {
   }
 }
 
+void PcapWriter::setFileRotation(uint64_t maxBytes,
+                                 std::chrono::seconds maxAge) {
+  CHECK(!thread_.joinable());
+  maxFileBytes_ = maxBytes;
+  maxFileAge_ = maxAge;
+}
+
 void PcapWriter::start(folly::StringPiece path, bool overwriteExisting) {
-  file_ = PcapFile(path, overwriteExisting);
+  path_ = path.str();
+  overwriteExisting_ = overwriteExisting;
+  openFile();
   thread_ = std::thread(&PcapWriter::threadMain, this);
 }
 
@@ -80,8 +95,38 @@ void PcapWriter::writeLoop() {
     }
 
     DCHECK(!pkts.empty());
+    if (needRotation()) {
+      file_.close();
+      openFile();
+      file_.writeGlobalHeader();
+    }
     file_.writePackets(pkts);
+    pktsInFile_ += pkts.size();
+  }
+}
+
+bool PcapWriter::needRotation() const {
+  if (pktsInFile_ == 0) {
+    // Don't leave files behind with no packets in them
+    return false;
+  }
+  if (maxFileBytes_ != 0 && file_.bytesWritten() >= maxFileBytes_) {
+    return true;
+  }
+  return (maxFileAge_.count() != 0 &&
+          steady_clock::now() - fileOpened_ >= maxFileAge_);
+}
+
+void PcapWriter::openFile() {
+  if (numFiles_ == 0) {
+    file_ = PcapFile(path_, overwriteExisting_);
+  } else {
+    file_ = PcapFile(folly::to<std::string>(path_, ".", numFiles_),
+                     overwriteExisting_);
   }
+  ++numFiles_;
+  fileOpened_ = steady_clock::now();
+  pktsInFile_ = 0;
 }
 
 }} // facebook::fboss
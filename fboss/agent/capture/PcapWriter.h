@@ -12,6 +12,8 @@
 #include "fboss/agent/capture/PcapFile.h"
 #include "fboss/agent/capture/PcapQueue.h"
 
+#include <chrono>
+#include <string>
 #include <thread>
 
 namespace facebook { namespace fboss {
@@ -21,15 +23,30 @@ namespace facebook { namespace fboss {
  * to a pcap file.
  *
  * It performs blocking disk I/O, so it performs the writes in its own thread.
+ * Each batch of packets taken from the queue is written with a single
+ * writev() of the queued IOBufs, without copying the packet data again.
  */
 class PcapWriter {
  public:
-  explicit PcapWriter(uint32_t maxBufferedPkts = 0);
+  /*
+   * A non-zero snapLen truncates each packet to that many bytes; see
+   * PcapQueue.
+   */
+  explicit PcapWriter(uint32_t maxBufferedPkts = 0, uint32_t snapLen = 0);
   explicit PcapWriter(folly::StringPiece path,
                       bool overwriteExisting = false,
                       uint32_t maxBufferedPkts = 0);
   virtual ~PcapWriter();
 
+  /*
+   * Start a new file once the current one holds maxBytes, or has been
+   * written to for maxAge.  A zero value disables that limit.  The files
+   * after the first are named <path>.1, <path>.2, and so on.
+   *
+   * This must be called before start().
+   */
+  void setFileRotation(uint64_t maxBytes, std::chrono::seconds maxAge);
+
   void start(folly::StringPiece path, bool overwriteExisting = false);
 
   /*
@@ -75,6 +92,17 @@ class PcapWriter {
   void threadMain();
   void writeHeader();
   void writeLoop();
+  bool needRotation() const;
+  void openFile();
+
+  std::string path_;
+  bool overwriteExisting_{false};
+  uint64_t maxFileBytes_{0};
+  std::chrono::seconds maxFileAge_{0};
+  // How many files have been opened, and when the current one was
+  uint32_t numFiles_{0};
+  std::chrono::steady_clock::time_point fileOpened_;
+  uint64_t pktsInFile_{0};
 
   PcapFile file_;
   PcapQueue queue_;
@@ -15,8 +15,11 @@ using folly::StringPiece;
 
 namespace facebook { namespace fboss {
 
-PktCapture::PktCapture(folly::StringPiece name, uint64_t maxPackets)
+PktCapture::PktCapture(folly::StringPiece name, uint64_t maxPackets,
+                       const PktCaptureFilter& filter, uint32_t snapLen)
   : name_(name.str()),
+    filter_(filter),
+    writer_(0, snapLen),
     maxPackets_(maxPackets) {
 }
 
@@ -29,17 +32,21 @@ void PktCapture::stop() {
 }
 
 bool PktCapture::packetReceived(const RxPacket* pkt) {
-  std::lock_guard<std::mutex> guard(writer_.mutex());
-  ++numPacketsReceived_;
-  writer_.addPktLocked(pkt);
-  return numPacketsReceived_ < maxPackets_;
+  if (!filter_.matches(pkt)) {
+    return true;
+  }
+  auto numPackets = ++numPacketsReceived_;
+  writer_.addPkt(pkt);
+  return numPackets < maxPackets_;
 }
 
 bool PktCapture::packetSent(const TxPacket* pkt) {
-  std::lock_guard<std::mutex> guard(writer_.mutex());
-  ++numPacketsReceived_;
-  writer_.addPktLocked(pkt);
-  return numPacketsReceived_ < maxPackets_;
+  if (!filter_.matches(pkt)) {
+    return true;
+  }
+  auto numPackets = ++numPacketsReceived_;
+  writer_.addPkt(pkt);
+  return numPackets < maxPackets_;
 }
 
 }} // facebook::fboss
@@ -10,8 +10,10 @@
 #pragma once
 
 #include "fboss/agent/capture/PcapWriter.h"
+#include "fboss/agent/capture/PktCaptureFilter.h"
 
 #include <folly/Range.h>
+#include <atomic>
 #include <string>
 
 namespace facebook { namespace fboss {
@@ -24,12 +26,26 @@ class TxPacket;
  */
 class PktCapture {
  public:
-  PktCapture(folly::StringPiece name, uint64_t maxPackets);
+  /*
+   * Only packets matching the filter are captured or counted towards
+   * maxPackets.  The filter is checked before the packet is copied.
+   */
+  PktCapture(folly::StringPiece name, uint64_t maxPackets,
+             const PktCaptureFilter& filter = PktCaptureFilter(),
+             uint32_t snapLen = 0);
 
   const std::string& name() const {
     return name_;
   }
 
+  /*
+   * Split the capture into several files; see PcapWriter::setFileRotation().
+   * This must be called before start().
+   */
+  void setFileRotation(uint64_t maxBytes, std::chrono::seconds maxAge) {
+    writer_.setFileRotation(maxBytes, maxAge);
+  }
+
   void start(folly::StringPiece path);
   void stop();
 
@@ -42,12 +58,13 @@ class PktCapture {
   PktCapture& operator=(PktCapture const &) = delete;
 
   const std::string name_;
+  const PktCaptureFilter filter_;
 
-  // Note: the rest of the state in this class is protcted by
-  // the PcapWriter's mutex.
   PcapWriter writer_;
   uint64_t maxPackets_{0};
-  uint64_t numPacketsReceived_{0};
+  // This is atomic rather than protected by the PcapWriter's mutex, so that
+  // packets can be captured without locking when the queue is a ring.
+  std::atomic<uint64_t> numPacketsReceived_{0};
 };
 
 }} // facebook::fboss
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/capture/PktCaptureFilter.h"
+
+#include <folly/io/Cursor.h>
+#include "fboss/agent/IPv4Handler.h"
+#include "fboss/agent/IPv6Handler.h"
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/packet/IPProto.h"
+
+using folly::io::Cursor;
+
+namespace {
+
+const uint16_t kEthertypeVlan = 0x8100;
+const uint16_t kIPv4OffsetMask = 0x1fff;
+const int kIPv4MinHeaderLen = 20;
+
+}
+
+namespace facebook { namespace fboss {
+
+bool PktCaptureFilter::matches(const RxPacket* pkt) const {
+  if ((fields_ & PORT) && pkt->getSrcPort() != port_) {
+    return false;
+  }
+  if ((fields_ & VLAN) && pkt->getSrcVlan() != vlan_) {
+    return false;
+  }
+  if ((fields_ & FRAME_FIELDS) == 0) {
+    return true;
+  }
+  return matchesFrame(pkt->buf(), false);
+}
+
+bool PktCaptureFilter::matches(const TxPacket* pkt) const {
+  if (fields_ & PORT) {
+    return false;
+  }
+  if ((fields_ & (VLAN | FRAME_FIELDS)) == 0) {
+    return true;
+  }
+  return matchesFrame(pkt->buf(), fields_ & VLAN);
+}
+
+bool PktCaptureFilter::matchesFrame(const folly::IOBuf* buf,
+                                    bool checkVlanTag) const {
+  try {
+    Cursor c(buf);
+    // Skip over the destination and source MACs
+    c += 12;
+    auto ethertype = c.readBE<uint16_t>();
+    bool tagged = false;
+    if (ethertype == kEthertypeVlan) {
+      tagged = true;
+      auto tci = c.readBE<uint16_t>();
+      if (checkVlanTag && VlanID(tci & 0xfff) != vlan_) {
+        return false;
+      }
+      ethertype = c.readBE<uint16_t>();
+    }
+    if (checkVlanTag && !tagged) {
+      return false;
+    }
+    if ((fields_ & ETHERTYPE) && ethertype != ethertype_) {
+      return false;
+    }
+    if ((fields_ & (IP_PROTO | L4_PORT)) == 0) {
+      return true;
+    }
+
+    uint8_t proto;
+    bool firstFragment = true;
+    if (ethertype == IPv4Handler::ETHERTYPE_IPV4) {
+      auto headerLen = (c.read<uint8_t>() & 0xf) * 4;
+      if (headerLen < kIPv4MinHeaderLen) {
+        return false;
+      }
+      // DSCP and ECN, then the total length and identification
+      c += 5;
+      // Only the first fragment carries the L4 header
+      firstFragment = (c.readBE<uint16_t>() & kIPv4OffsetMask) == 0;
+      // TTL
+      c += 1;
+      proto = c.read<uint8_t>();
+      // The checksum and addresses, plus any options
+      c += headerLen - 10;
+    } else if (ethertype == IPv6Handler::ETHERTYPE_IPV6) {
+      // Version, traffic class and flow label, then the payload length.
+      // Extension headers are not followed, so packets carrying them only
+      // match on their first next header value.
+      c += 6;
+      proto = c.read<uint8_t>();
+      // Hop limit, then the source and destination addresses
+      c += 33;
+    } else {
+      return false;
+    }
+
+    if ((fields_ & IP_PROTO) && proto != ipProto_) {
+      return false;
+    }
+    if ((fields_ & L4_PORT) == 0) {
+      return true;
+    }
+    if (!firstFragment || (proto != IP_PROTO_TCP && proto != IP_PROTO_UDP)) {
+      return false;
+    }
+    auto srcPort = c.readBE<uint16_t>();
+    auto dstPort = c.readBE<uint16_t>();
+    return srcPort == l4Port_ || dstPort == l4Port_;
+  } catch (const std::out_of_range& ex) {
+    // Truncated packets only match a filter that does not need their headers
+    return false;
+  }
+}
+
+}} // facebook::fboss
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook { namespace fboss {
+
+class RxPacket;
+class TxPacket;
+
+/*
+ * PktCaptureFilter decides whether a packet belongs in a capture.
+ *
+ * Every field that has been set must match; a default constructed filter
+ * matches everything.  The set of fields is reduced to a bitmask when the
+ * filter is built, so the common cases of no filter, or only a port or VLAN
+ * filter on received packets, never touch the packet data.  Otherwise the
+ * headers are parsed in place with a Cursor, and nothing is copied.
+ *
+ * Transmitted packets do not know their egress port, so a port filter never
+ * matches them.  Their VLAN is taken from the 802.1Q tag, if any.
+ */
+class PktCaptureFilter {
+ public:
+  PktCaptureFilter() {}
+
+  void setPort(PortID port) {
+    port_ = port;
+    fields_ |= PORT;
+  }
+  void setVlan(VlanID vlan) {
+    vlan_ = vlan;
+    fields_ |= VLAN;
+  }
+  void setEthertype(uint16_t ethertype) {
+    ethertype_ = ethertype;
+    fields_ |= ETHERTYPE;
+  }
+  void setIpProto(uint8_t proto) {
+    ipProto_ = proto;
+    fields_ |= IP_PROTO;
+  }
+  /*
+   * Match TCP or UDP packets with this source or destination port.
+   */
+  void setL4Port(uint16_t port) {
+    l4Port_ = port;
+    fields_ |= L4_PORT;
+  }
+
+  bool matchesAll() const {
+    return fields_ == 0;
+  }
+
+  bool matches(const RxPacket* pkt) const;
+  bool matches(const TxPacket* pkt) const;
+
+ private:
+  enum Field : uint8_t {
+    PORT = 0x01,
+    VLAN = 0x02,
+    ETHERTYPE = 0x04,
+    IP_PROTO = 0x08,
+    L4_PORT = 0x10,
+  };
+  // The fields that can only be checked by parsing the packet
+  enum : uint8_t { FRAME_FIELDS = ETHERTYPE | IP_PROTO | L4_PORT };
+
+  bool matchesFrame(const folly::IOBuf* buf, bool checkVlanTag) const;
+
+  uint8_t fields_{0};
+  uint8_t ipProto_{0};
+  uint16_t ethertype_{0};
+  uint16_t l4Port_{0};
+  PortID port_{0};
+  VlanID vlan_{0};
+};
+
+}} // facebook::fboss
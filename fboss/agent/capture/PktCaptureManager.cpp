@@ -14,8 +14,24 @@
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/Utils.h"
 #include "fboss/agent/capture/PktCapture.h"
+#include "fboss/agent/capture/PktFlightRecorder.h"
 
 #include <folly/String.h>
+#include <folly/io/async/EventBase.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <chrono>
+
+DEFINE_int32(pkt_flight_recorder_pkts, 10000,
+             "How many of the last packets of each class (control, host and "
+             "other) the packet flight recorder keeps in memory.  0 disables "
+             "the flight recorder.");
+DEFINE_int32(pkt_flight_recorder_snaplen, 128,
+             "How many bytes of each packet the flight recorder keeps");
+DEFINE_int32(pkt_flight_recorder_dump_interval_s, 300,
+             "The least time, in seconds, between two dumps of the flight "
+             "recorder triggered by errors.  0 disables these dumps.");
 
 using folly::StringPiece;
 using std::string;
@@ -23,10 +39,15 @@ using std::unique_ptr;
 
 namespace facebook { namespace fboss {
 
-PktCaptureManager::PktCaptureManager(SwSwitch* sw) {
+PktCaptureManager::PktCaptureManager(SwSwitch* sw) : sw_(sw) {
   auto persistDir = sw->getPlatform()->getPersistentStateDir();
   captureDir_ = folly::to<string>(persistDir, "/captures");
   utilCreateDir(captureDir_);
+  if (FLAGS_pkt_flight_recorder_pkts > 0) {
+    flightRecorder_.reset(new PktFlightRecorder(
+        FLAGS_pkt_flight_recorder_pkts,
+        std::max(FLAGS_pkt_flight_recorder_snaplen, 0)));
+  }
 }
 
 PktCaptureManager::~PktCaptureManager() {
@@ -162,6 +183,50 @@ void PktCaptureManager::packetSentToHostImpl(const RxPacket* pkt) {
   });
 }
 
+void PktCaptureManager::flightRecorderReceived(const RxPacket* pkt) {
+  flightRecorder_->packetReceived(pkt);
+}
+
+void PktCaptureManager::flightRecorderSent(const TxPacket* pkt) {
+  flightRecorder_->packetSent(pkt);
+}
+
+size_t PktCaptureManager::dumpFlightRecorder(StringPiece name) {
+  checkCaptureName(name);
+  if (!flightRecorder_) {
+    throw FbossError("the packet flight recorder is disabled");
+  }
+  auto path = folly::to<string>(captureDir_, "/", name, ".pcap");
+  auto numPkts = flightRecorder_->dump(path);
+  LOG(INFO) << "dumped " << numPkts << " packets from the flight recorder to "
+            << path;
+  return numPkts;
+}
+
+void PktCaptureManager::triggerFlightRecorderDump(StringPiece reason) {
+  if (!flightRecorder_ || FLAGS_pkt_flight_recorder_dump_interval_s <= 0) {
+    return;
+  }
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  auto last = lastTriggeredDump_.load(std::memory_order_relaxed);
+  if ((last != 0 && now - last < FLAGS_pkt_flight_recorder_dump_interval_s) ||
+      !lastTriggeredDump_.compare_exchange_strong(last, now)) {
+    return;
+  }
+  auto wallClock = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  auto name = folly::to<string>("flight_recorder.", reason, ".", wallClock);
+  sw_->getBackgroundEVB()->runInEventBaseThread([this, name] {
+    try {
+      dumpFlightRecorder(name);
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "error dumping the packet flight recorder: "
+                 << folly::exceptionStr(ex);
+    }
+  });
+}
+
 void PktCaptureManager::checkCaptureName(folly::StringPiece name) {
   // We use the capture name for the on-disk filename, so don't allow
   // directory separator characters or nul bytes.
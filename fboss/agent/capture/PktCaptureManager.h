@@ -20,6 +20,7 @@
 namespace facebook { namespace fboss {
 
 class PktCapture;
+class PktFlightRecorder;
 class RxPacket;
 class SwSwitch;
 class TxPacket;
@@ -48,6 +49,9 @@ class PktCaptureManager {
    * This method is safe to call from any thread.
    */
   void packetReceived(const RxPacket* pkt) {
+    if (flightRecorder_) {
+      flightRecorderReceived(pkt);
+    }
     // We expect that in the common case there will be no active captures
     // running.  Just do a fast check to handle that case.
     if (!capturesRunning_.load(std::memory_order_acquire)) {
@@ -62,6 +66,9 @@ class PktCaptureManager {
    * This method is safe to call from any thread.
    */
   void packetSent(const TxPacket* pkt) {
+    if (flightRecorder_) {
+      flightRecorderSent(pkt);
+    }
     // We expect that in the common case there will be no active captures
     // running.  Just do a fast check to handle that case.
     if (!capturesRunning_.load(std::memory_order_acquire)) {
@@ -91,6 +98,25 @@ class PktCaptureManager {
     return captureDir_;
   }
 
+  /*
+   * Write the packets in the flight recorder to <capture dir>/<name>.pcap,
+   * and return how many there were.  This does blocking I/O.
+   *
+   * The flight recorder always keeps the last --pkt_flight_recorder_pkts
+   * packets of each RxPacketClass, so that the packets leading up to a
+   * problem can be looked at without a capture running at the time.
+   */
+  size_t dumpFlightRecorder(folly::StringPiece name);
+
+  /*
+   * Dump the flight recorder in the background after something went wrong,
+   * unless it was dumped this way less than
+   * --pkt_flight_recorder_dump_interval_s ago.
+   *
+   * This method is safe to call from any thread.
+   */
+  void triggerFlightRecorderDump(folly::StringPiece reason);
+
   static void checkCaptureName(folly::StringPiece name);
 
  private:
@@ -103,8 +129,15 @@ class PktCaptureManager {
   void packetReceivedImpl(const RxPacket* pkt);
   void packetSentImpl(const TxPacket* pkt);
   void packetSentToHostImpl(const RxPacket* pkt);
+  void flightRecorderReceived(const RxPacket* pkt);
+  void flightRecorderSent(const TxPacket* pkt);
 
+  SwSwitch* sw_{nullptr};
   std::atomic<bool> capturesRunning_{false};
+  // Null if --pkt_flight_recorder_pkts is 0
+  std::unique_ptr<PktFlightRecorder> flightRecorder_;
+  // When the flight recorder was last dumped automatically, in seconds
+  std::atomic<int64_t> lastTriggeredDump_{0};
 
   std::mutex mutex_;
   std::string captureDir_;
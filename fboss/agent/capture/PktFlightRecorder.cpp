@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/capture/PktFlightRecorder.h"
+
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/capture/PcapFile.h"
+
+#include <folly/io/Cursor.h>
+#include <algorithm>
+
+using folly::IOBuf;
+using folly::StringPiece;
+
+namespace facebook { namespace fboss {
+
+PktFlightRecorder::PktFlightRecorder(uint32_t pktsPerClass, uint32_t snapLen)
+  : pktsPerClass_(pktsPerClass),
+    snapLen_(snapLen) {
+  for (auto& ring : rings_) {
+    ring.slots.reset(new Slot[pktsPerClass_]);
+    ring.data.reset(new uint8_t[size_t(pktsPerClass_) * snapLen_]);
+    for (uint32_t i = 0; i < pktsPerClass_; ++i) {
+      ring.slots[i].data = ring.data.get() + size_t(i) * snapLen_;
+    }
+  }
+}
+
+PktFlightRecorder::~PktFlightRecorder() {
+}
+
+void PktFlightRecorder::packetReceived(const RxPacket* pkt) {
+  record(pkt->buf(), true, pkt->getSrcPort(), pkt->getSrcVlan());
+}
+
+void PktFlightRecorder::packetSent(const TxPacket* pkt) {
+  record(pkt->buf(), false, PortID(0), VlanID(0));
+}
+
+void PktFlightRecorder::record(const IOBuf* buf, bool rx,
+                               PortID port, VlanID vlan) {
+  if (pktsPerClass_ == 0) {
+    return;
+  }
+  auto& ring = rings_[static_cast<int>(RxPacketDispatcher::classify(buf))];
+  auto pos = ring.next.fetch_add(1, std::memory_order_relaxed);
+  auto& slot = ring.slots[pos % pktsPerClass_];
+  if (slot.busy.exchange(true, std::memory_order_acquire)) {
+    skipped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto origLen = buf->computeChainDataLength();
+  slot.used = true;
+  slot.rx = rx;
+  slot.port = port;
+  slot.vlan = vlan;
+  slot.timestamp = std::chrono::system_clock::now();
+  slot.origLen = origLen;
+  slot.len = std::min<uint64_t>(origLen, snapLen_);
+  folly::io::Cursor cursor(buf);
+  cursor.pull(slot.data, slot.len);
+  slot.busy.store(false, std::memory_order_release);
+}
+
+void PktFlightRecorder::getPackets(std::vector<PcapPkt>* pkts) {
+  for (auto& ring : rings_) {
+    for (uint32_t i = 0; i < pktsPerClass_; ++i) {
+      auto& slot = ring.slots[i];
+      // Writers never hold a slot for long
+      while (slot.busy.exchange(true, std::memory_order_acquire)) {
+      }
+      if (slot.used) {
+        pkts->emplace_back(slot.rx, slot.port, slot.vlan, slot.timestamp,
+                           IOBuf::copyBuffer(slot.data, slot.len),
+                           slot.origLen);
+      }
+      slot.busy.store(false, std::memory_order_release);
+    }
+  }
+  std::stable_sort(pkts->begin(), pkts->end(),
+                   [](const PcapPkt& p1, const PcapPkt& p2) {
+                     return p1.timestamp() < p2.timestamp();
+                   });
+}
+
+size_t PktFlightRecorder::dump(StringPiece path) {
+  std::vector<PcapPkt> pkts;
+  getPackets(&pkts);
+  PcapFile file(path, true);
+  file.writeGlobalHeader();
+  file.writePackets(pkts);
+  file.close();
+  return pkts.size();
+}
+
+}} // facebook::fboss
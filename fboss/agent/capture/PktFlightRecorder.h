@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/RxPacketDispatcher.h"
+#include "fboss/agent/capture/PcapPkt.h"
+
+#include <folly/Range.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class RxPacket;
+class TxPacket;
+
+/*
+ * PktFlightRecorder keeps the last few packets of each RxPacketClass in
+ * memory, sent and received alike, so that the packets leading up to an
+ * intermittent problem can be dumped after it happens, without a capture
+ * having been started beforehand.
+ *
+ * Each class has a ring of pktsPerClass preallocated slots of snapLen bytes,
+ * overwritten oldest first.  Recording a packet claims the next slot with
+ * one atomic increment, and copies at most snapLen bytes into it, without
+ * taking a lock or allocating memory.  In the rare case the slot is still
+ * being written by a thread that lapped the ring, or is being read by a
+ * dump, the packet is skipped rather than waited for.
+ */
+class PktFlightRecorder {
+ public:
+  PktFlightRecorder(uint32_t pktsPerClass, uint32_t snapLen);
+  ~PktFlightRecorder();
+
+  void packetReceived(const RxPacket* pkt);
+  void packetSent(const TxPacket* pkt);
+
+  /*
+   * Copy the recorded packets of every class into *pkts, oldest first.
+   * Recording carries on meanwhile.
+   */
+  void getPackets(std::vector<PcapPkt>* pkts);
+
+  /*
+   * Write the recorded packets to a pcap file, and return how many there
+   * were.  This does blocking I/O.
+   */
+  size_t dump(folly::StringPiece path);
+
+  // The packets skipped because their slot was busy
+  uint64_t numSkipped() const {
+    return skipped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    std::atomic<bool> busy{false};
+    bool used{false};
+    bool rx{false};
+    PortID port{0};
+    VlanID vlan{0};
+    PcapPkt::TimePoint timestamp;
+    uint32_t len{0};
+    uint32_t origLen{0};
+    uint8_t* data{nullptr};
+  };
+  struct Ring {
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<uint8_t[]> data;
+    std::atomic<uint64_t> next{0};
+  };
+
+  // Forbidden copy constructor and assignment operator
+  PktFlightRecorder(PktFlightRecorder const &) = delete;
+  PktFlightRecorder& operator=(PktFlightRecorder const &) = delete;
+
+  void record(const folly::IOBuf* buf, bool rx, PortID port, VlanID vlan);
+
+  const uint32_t pktsPerClass_{0};
+  const uint32_t snapLen_{0};
+  Ring rings_[RxPacketDispatcher::NUM_CLASSES];
+  std::atomic<uint64_t> skipped_{0};
+};
+
+}} // facebook::fboss
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/capture/PcapFile.h"
+#include "fboss/agent/capture/PcapFileReader.h"
+#include "fboss/agent/capture/PcapPkt.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Memory.h>
+#include <folly/ScopeGuard.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+using std::chrono::microseconds;
+using std::chrono::seconds;
+
+namespace {
+
+PcapPkt makePkt(folly::StringPiece hex, PcapPkt::TimePoint timestamp,
+                uint32_t origLength = 0) {
+  auto buf = folly::make_unique<IOBuf>(PktUtil::parseHexData(hex));
+  auto len = buf->computeChainDataLength();
+  return PcapPkt(true, PortID(1), VlanID(1), timestamp, std::move(buf),
+                 std::max<uint32_t>(len, origLength));
+}
+
+} // unnamed namespace
+
+TEST(PcapFileReaderTest, ReadBack) {
+  char tmpPath[] = "fbossPcapTest.XXXXXX";
+  int tmpFD = mkstemp(tmpPath);
+  folly::checkUnixError(tmpFD, "failed to create temporary file");
+  SCOPE_EXIT {
+    close(tmpFD);
+    unlink(tmpPath);
+  };
+
+  PcapPkt::TimePoint start(seconds(1400000000) + microseconds(123456));
+  std::vector<PcapPkt> written;
+  written.push_back(makePkt(
+    // dst mac, src mac, 802.1q VLAN 1, ARP
+    "ff ff ff ff ff ff  00 02 00 01 02 03  81 00 00 01  08 06",
+    start));
+  // A truncated packet, 1.5ms later
+  written.push_back(makePkt(
+    "02 00 01 00 00 01  02 00 02 01 02 03  81 00 00 05  86 dd",
+    start + microseconds(1500), 1500));
+  {
+    PcapFile file(tmpPath, true);
+    file.writeGlobalHeader();
+    file.writePackets(written);
+  }
+
+  PcapFileReader reader(tmpPath);
+  EXPECT_EQ(0xffff, reader.snapLen());
+  for (const auto& expected : written) {
+    PcapPkt pkt;
+    ASSERT_TRUE(reader.readPacket(&pkt));
+    EXPECT_TRUE(pkt.isRx());
+    EXPECT_EQ(expected.timestamp(), pkt.timestamp());
+    EXPECT_EQ(expected.origLength(), pkt.origLength());
+    EXPECT_EQ(folly::ByteRange(expected.buf()->data(),
+                               expected.buf()->length()),
+              folly::ByteRange(pkt.buf()->data(), pkt.buf()->length()));
+  }
+  PcapPkt pkt;
+  EXPECT_FALSE(reader.readPacket(&pkt));
+}
+
+TEST(PcapFileReaderTest, NotPcap) {
+  char tmpPath[] = "fbossPcapTest.XXXXXX";
+  int tmpFD = mkstemp(tmpPath);
+  folly::checkUnixError(tmpFD, "failed to create temporary file");
+  SCOPE_EXIT {
+    close(tmpFD);
+    unlink(tmpPath);
+  };
+
+  std::string junk(64, 'x');
+  folly::checkUnixError(folly::writeFull(tmpFD, junk.data(), junk.size()),
+                        "failed to write temporary file");
+  EXPECT_THROW(PcapFileReader reader(tmpPath), FbossError);
+}
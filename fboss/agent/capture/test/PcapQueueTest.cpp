@@ -11,6 +11,7 @@
 #include "fboss/agent/capture/PcapQueue.h"
 #include "fboss/agent/hw/mock/MockRxPacket.h"
 
+#include <atomic>
 #include <thread>
 #include <gtest/gtest.h>
 
@@ -72,3 +73,98 @@ TEST(PcapQueueTest, SimpleAdd) {
   ByteRange waitedPktData = waitedPktBufClone->coalesce();
   EXPECT_EQ(expectedPktData, waitedPktData);
 }
+
+namespace {
+
+std::unique_ptr<MockRxPacket> makeRxPacket(uint32_t length) {
+  auto pkt = MockRxPacket::fromHex(
+    // dst mac, src mac
+    "02 00 01 00 00 01  02 00 02 01 02 03"
+    // 802.1q, VLAN 1
+    "81 00 00 01"
+    // IPv4
+    "08 00");
+  pkt->padToLength(length);
+  pkt->setSrcPort(PortID(3));
+  pkt->setSrcVlan(VlanID(1));
+  return pkt;
+}
+
+}
+
+TEST(PcapQueueTest, RingSnapLen) {
+  PcapQueue queue(4, 0, 32);
+  EXPECT_EQ(32, queue.getSnapLen());
+  std::vector<PcapPkt> waitedPkts;
+  std::thread waiter([&]() { pktWaitThread(&queue, &waitedPkts); });
+
+  auto pkt = makeRxPacket(100);
+  queue.addPkt(pkt.get());
+  auto smallPkt = makeRxPacket(20);
+  queue.addPkt(smallPkt.get());
+  queue.finish();
+  waiter.join();
+
+  ASSERT_EQ(2, waitedPkts.size());
+  EXPECT_TRUE(waitedPkts[0].isRx());
+  EXPECT_EQ(PortID(3), waitedPkts[0].port());
+  EXPECT_EQ(VlanID(1), waitedPkts[0].vlan());
+  // Only the first 32 bytes are kept, but the original length is recorded
+  EXPECT_EQ(32, waitedPkts[0].buf()->computeChainDataLength());
+  EXPECT_EQ(100, waitedPkts[0].origLength());
+  ByteRange expected(pkt->buf()->data(), 32);
+  EXPECT_EQ(expected, ByteRange(waitedPkts[0].buf()->data(), 32));
+  // Packets shorter than the snap length are kept whole
+  EXPECT_EQ(20, waitedPkts[1].buf()->computeChainDataLength());
+  EXPECT_EQ(20, waitedPkts[1].origLength());
+}
+
+TEST(PcapQueueTest, RingFull) {
+  // Without a reader, packets beyond the ring size are dropped rather than
+  // blocking the producer.
+  PcapQueue queue(4, 0, 64);
+  auto pkt = makeRxPacket(68);
+  for (int i = 0; i < 6; ++i) {
+    queue.addPkt(pkt.get());
+  }
+  EXPECT_EQ(2, queue.numDropped());
+
+  std::vector<PcapPkt> pkts;
+  ASSERT_TRUE(queue.wait(&pkts));
+  EXPECT_EQ(4, pkts.size());
+
+  // The slots can be reused once they have been read
+  queue.addPkt(pkt.get());
+  queue.finish();
+  ASSERT_TRUE(queue.wait(&pkts));
+  EXPECT_EQ(1, pkts.size());
+  EXPECT_FALSE(queue.wait(&pkts));
+  EXPECT_EQ(2, queue.numDropped());
+}
+
+TEST(PcapQueueTest, RingMultipleProducers) {
+  const int numThreads = 4;
+  const int pktsPerThread = 1000;
+  PcapQueue queue(256, 0, 64);
+  std::vector<PcapPkt> waitedPkts;
+  std::thread waiter([&]() { pktWaitThread(&queue, &waitedPkts); });
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < numThreads; ++t) {
+    producers.emplace_back([&]() {
+      auto pkt = makeRxPacket(68);
+      for (int i = 0; i < pktsPerThread; ++i) {
+        queue.addPkt(pkt.get());
+      }
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  queue.finish();
+  waiter.join();
+
+  // Every packet is either delivered or counted as dropped
+  EXPECT_EQ(numThreads * pktsPerThread,
+            waitedPkts.size() + queue.numDropped());
+}
@@ -11,6 +11,7 @@
 #include "fboss/agent/capture/test/PcapUtil.h"
 #include "fboss/agent/hw/mock/MockRxPacket.h"
 
+#include <folly/Conv.h>
 #include <folly/Exception.h>
 #include <gtest/gtest.h>
 
@@ -101,3 +102,36 @@ TEST(PcapWriterTest, Drop) {
     EXPECT_EQ(68, pktInfo.hdr.caplen);
   }
 }
+
+TEST(PcapWriterTest, Rotate) {
+  char tmpPath[] = "fbossPcapTest.XXXXXX";
+  int tmpFD = mkstemp(tmpPath);
+  folly::checkUnixError(tmpFD, "failed to create temporary file");
+  std::vector<std::string> paths{tmpPath};
+  for (int n = 1; n < 3; ++n) {
+    paths.push_back(folly::to<std::string>(tmpPath, ".", n));
+  }
+  SCOPE_EXIT {
+    close(tmpFD);
+    for (const auto& path : paths) {
+      unlink(path.c_str());
+    }
+  };
+
+  // Each batch of 20 packets is more than 1000 bytes, so each one should
+  // start a new file, as long as the writer thread keeps up.
+  PcapWriter writer;
+  writer.setFileRotation(1000, std::chrono::seconds(0));
+  writer.start(tmpPath, true);
+  for (int n = 0; n < 3; ++n) {
+    addPackets(&writer, 20);
+    usleep(100000);
+  }
+  writer.finish();
+  EXPECT_EQ(0, writer.numDropped());
+
+  for (const auto& path : paths) {
+    auto pcapPkts = readPcapFile(path.c_str());
+    EXPECT_EQ(20, pcapPkts.size());
+  }
+}
@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/capture/PktCaptureFilter.h"
+
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+#include "fboss/agent/hw/mock/MockTxPacket.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+#include <folly/Memory.h>
+#include <gtest/gtest.h>
+#include <string.h>
+
+using namespace facebook::fboss;
+using std::string;
+using std::unique_ptr;
+
+namespace {
+
+const char* kUdpPkt =
+  // dst mac, src mac
+  "02 00 01 00 00 01  02 00 02 01 02 03"
+  // 802.1q, VLAN 5
+  "81 00 00 05"
+  // IPv4
+  "08 00"
+  // Version(4), IHL(5), DSCP(0), ECN(0), Total Length(28)
+  "45  00  00 1c"
+  // Identification(0), Flags(0), Fragment offset(0)
+  "00 00  00 00"
+  // TTL(31), Protocol(17), Checksum (0, fake)
+  "1F  11  00 00"
+  // Source IP (1.2.3.4)
+  "01 02 03 04"
+  // Destination IP (10.0.0.10)
+  "0a 00 00 0a"
+  // UDP source port 67, destination port 68, length, checksum
+  "00 43  00 44  00 08  00 00";
+
+unique_ptr<MockRxPacket> makeRxPacket(const string& hex) {
+  auto pkt = MockRxPacket::fromHex(hex);
+  pkt->setSrcPort(PortID(3));
+  pkt->setSrcVlan(VlanID(5));
+  return pkt;
+}
+
+unique_ptr<MockTxPacket> makeTxPacket(const string& hex) {
+  auto data = PktUtil::parseHexData(hex);
+  auto pkt = folly::make_unique<MockTxPacket>(data.computeChainDataLength());
+  memcpy(pkt->buf()->writableData(), data.data(), data.length());
+  return pkt;
+}
+
+}
+
+TEST(PktCaptureFilter, MatchAll) {
+  PktCaptureFilter filter;
+  EXPECT_TRUE(filter.matchesAll());
+  EXPECT_TRUE(filter.matches(makeRxPacket(kUdpPkt).get()));
+  EXPECT_TRUE(filter.matches(makeTxPacket(kUdpPkt).get()));
+  // A filter without any frame fields never reads the packet
+  EXPECT_TRUE(filter.matches(makeRxPacket("02 00").get()));
+}
+
+TEST(PktCaptureFilter, PortAndVlan) {
+  auto rx = makeRxPacket(kUdpPkt);
+  auto tx = makeTxPacket(kUdpPkt);
+
+  PktCaptureFilter port;
+  port.setPort(PortID(3));
+  EXPECT_FALSE(port.matchesAll());
+  EXPECT_TRUE(port.matches(rx.get()));
+  EXPECT_FALSE(port.matches(tx.get()));
+  rx->setSrcPort(PortID(4));
+  EXPECT_FALSE(port.matches(rx.get()));
+
+  PktCaptureFilter vlan;
+  vlan.setVlan(VlanID(5));
+  EXPECT_TRUE(vlan.matches(rx.get()));
+  EXPECT_TRUE(vlan.matches(tx.get()));
+  vlan.setVlan(VlanID(6));
+  EXPECT_FALSE(vlan.matches(rx.get()));
+  EXPECT_FALSE(vlan.matches(tx.get()));
+}
+
+TEST(PktCaptureFilter, Headers) {
+  auto rx = makeRxPacket(kUdpPkt);
+
+  PktCaptureFilter ethertype;
+  ethertype.setEthertype(0x0800);
+  EXPECT_TRUE(ethertype.matches(rx.get()));
+  ethertype.setEthertype(0x86dd);
+  EXPECT_FALSE(ethertype.matches(rx.get()));
+
+  PktCaptureFilter proto;
+  proto.setIpProto(17);
+  EXPECT_TRUE(proto.matches(rx.get()));
+  proto.setIpProto(6);
+  EXPECT_FALSE(proto.matches(rx.get()));
+
+  // The L4 port matches either the source or destination port
+  PktCaptureFilter l4Port;
+  l4Port.setL4Port(67);
+  EXPECT_TRUE(l4Port.matches(rx.get()));
+  l4Port.setL4Port(68);
+  EXPECT_TRUE(l4Port.matches(rx.get()));
+  l4Port.setL4Port(69);
+  EXPECT_FALSE(l4Port.matches(rx.get()));
+
+  // All fields must match
+  PktCaptureFilter combined;
+  combined.setPort(PortID(3));
+  combined.setEthertype(0x0800);
+  combined.setL4Port(68);
+  EXPECT_TRUE(combined.matches(rx.get()));
+  combined.setIpProto(6);
+  EXPECT_FALSE(combined.matches(rx.get()));
+}
+
+TEST(PktCaptureFilter, Truncated) {
+  PktCaptureFilter filter;
+  filter.setL4Port(67);
+  // The UDP header is cut off
+  string hex(kUdpPkt);
+  hex.resize(hex.find("00 43"));
+  EXPECT_FALSE(filter.matches(makeRxPacket(hex).get()));
+  EXPECT_FALSE(filter.matches(makeRxPacket("02 00 01 00").get()));
+}
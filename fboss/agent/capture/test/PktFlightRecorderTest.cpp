@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/capture/PktFlightRecorder.h"
+
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+#include "fboss/agent/hw/mock/MockTxPacket.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+#include <folly/Memory.h>
+#include <gtest/gtest.h>
+#include <string.h>
+
+using namespace facebook::fboss;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+const char* kUdpPkt =
+  // dst mac, src mac
+  "02 00 01 00 00 01  02 00 02 01 02 03"
+  // 802.1q, VLAN 5
+  "81 00 00 05"
+  // IPv4
+  "08 00"
+  // Version(4), IHL(5), DSCP(0), ECN(0), Total Length(28)
+  "45  00  00 1c"
+  // Identification(0), Flags(0), Fragment offset(0)
+  "00 00  00 00"
+  // TTL(31), Protocol(17), Checksum (0, fake)
+  "1F  11  00 00"
+  // Source IP (1.2.3.4)
+  "01 02 03 04"
+  // Destination IP (10.0.0.10)
+  "0a 00 00 0a"
+  // UDP source port 1000, destination port 2000, length, checksum
+  "03 e8  07 d0  00 08  00 00";
+
+unique_ptr<MockRxPacket> makeRxPacket(PortID port) {
+  auto pkt = MockRxPacket::fromHex(kUdpPkt);
+  pkt->setSrcPort(port);
+  pkt->setSrcVlan(VlanID(5));
+  return pkt;
+}
+
+unique_ptr<MockTxPacket> makeTxPacket() {
+  auto data = PktUtil::parseHexData(kUdpPkt);
+  auto pkt = folly::make_unique<MockTxPacket>(data.computeChainDataLength());
+  memcpy(pkt->buf()->writableData(), data.data(), data.length());
+  return pkt;
+}
+
+}
+
+TEST(PktFlightRecorder, overwritesOldest) {
+  PktFlightRecorder recorder(2, 1500);
+  for (int port = 1; port <= 3; ++port) {
+    auto pkt = makeRxPacket(PortID(port));
+    recorder.packetReceived(pkt.get());
+  }
+
+  vector<PcapPkt> pkts;
+  recorder.getPackets(&pkts);
+  ASSERT_EQ(2, pkts.size());
+  EXPECT_TRUE(pkts[0].isRx());
+  EXPECT_EQ(PortID(2), pkts[0].port());
+  EXPECT_EQ(PortID(3), pkts[1].port());
+  EXPECT_EQ(VlanID(5), pkts[1].vlan());
+  EXPECT_EQ(0, recorder.numSkipped());
+}
+
+TEST(PktFlightRecorder, snapLen) {
+  PktFlightRecorder recorder(10, 20);
+  auto rxPkt = makeRxPacket(PortID(1));
+  recorder.packetReceived(rxPkt.get());
+  auto txPkt = makeTxPacket();
+  recorder.packetSent(txPkt.get());
+
+  vector<PcapPkt> pkts;
+  recorder.getPackets(&pkts);
+  ASSERT_EQ(2, pkts.size());
+  EXPECT_TRUE(pkts[0].isRx());
+  EXPECT_TRUE(pkts[1].isTx());
+  auto length = rxPkt->buf()->computeChainDataLength();
+  for (const auto& pkt : pkts) {
+    EXPECT_EQ(20, pkt.buf()->computeChainDataLength());
+    EXPECT_EQ(length, pkt.origLength());
+    EXPECT_EQ(0, memcmp(rxPkt->buf()->data(), pkt.buf()->data(), 20));
+  }
+}
@@ -64,6 +64,18 @@ std::unique_ptr<BcmUnit> BcmAPI::initOnlyUnit() {
   return initUnit(0);
 }
 
+std::vector<std::unique_ptr<BcmUnit>> BcmAPI::initAllUnits() {
+  auto numDevices = BcmAPI::getNumSwitches();
+  if (numDevices == 0) {
+    throw FbossError("no Broadcom switching ASIC found");
+  }
+  std::vector<std::unique_ptr<BcmUnit>> units;
+  for (size_t i = 0; i < numDevices; ++i) {
+    units.push_back(initUnit(i));
+  }
+  return units;
+}
+
 void BcmAPI::unitDestroyed(BcmUnit* unit) {
   int num = unit->getNumber();
   BcmUnit* expectedUnit{unit};
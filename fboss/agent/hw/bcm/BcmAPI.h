@@ -12,6 +12,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <folly/Range.h>
 
@@ -70,6 +71,14 @@ class BcmAPI {
    */
   static std::unique_ptr<BcmUnit> initOnlyUnit();
 
+  /*
+   * Create a BcmUnit for every BCM switch in the system, in device order.
+   *
+   * As with initUnit(), the units must still be initialized with
+   * BcmUnit::attach(), from the main thread.
+   */
+  static std::vector<std::unique_ptr<BcmUnit>> initAllUnits();
+
   /*
    * Indicate that a BcmUnit object is being destroyed.
    *
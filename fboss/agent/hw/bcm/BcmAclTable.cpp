@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmAclTable.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmSwitch.h"
+#include "fboss/agent/hw/bcm/Utils.h"
+#include "fboss/agent/state/AclEntry.h"
+
+#include <folly/ScopeGuard.h>
+#include <glog/logging.h>
+#include <limits>
+
+using std::shared_ptr;
+
+namespace {
+
+// The field processor gives the entries with higher priorities precedence,
+// while the ACL gives it to the lower IDs
+int getEntryPriority(facebook::fboss::AclEntryID id) {
+  return std::numeric_limits<int>::max() - static_cast<int>(id);
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+BcmAclTable::BcmAclTable(const BcmSwitch* hw)
+  : hw_(hw) {
+}
+
+BcmAclTable::~BcmAclTable() {
+  // The entries are left in place, like the rest of the hardware tables,
+  // so the traps keep working until the switch is initialized again.
+}
+
+void BcmAclTable::createGroup() {
+  CHECK_EQ(-1, group_);
+  opennsl_field_qset_t qset;
+  OPENNSL_FIELD_QSET_INIT(qset);
+  OPENNSL_FIELD_QSET_ADD(qset, opennslFieldQualifyStageIngress);
+  OPENNSL_FIELD_QSET_ADD(qset, opennslFieldQualifyEtherType);
+  OPENNSL_FIELD_QSET_ADD(qset, opennslFieldQualifyDstMac);
+  OPENNSL_FIELD_QSET_ADD(qset, opennslFieldQualifyIpProtocol);
+  OPENNSL_FIELD_QSET_ADD(qset, opennslFieldQualifyL4SrcPort);
+  OPENNSL_FIELD_QSET_ADD(qset, opennslFieldQualifyL4DstPort);
+  OPENNSL_FIELD_QSET_ADD(qset, opennslFieldQualifyIcmpTypeCode);
+  auto rv = opennsl_field_group_create(hw_->getUnit(), qset,
+                                       OPENNSL_FIELD_GROUP_PRIO_ANY, &group_);
+  bcmCheckError(rv, "failed to create the ACL field group");
+}
+
+void BcmAclTable::addEntry(const shared_ptr<AclEntry>& acl) {
+  auto id = acl->getID();
+  if (entries_.count(id)) {
+    throw FbossError("ACL entry ", id, " is already programmed");
+  }
+  entries_.emplace(id, installEntry(acl.get()));
+}
+
+void BcmAclTable::changeEntry(const shared_ptr<AclEntry>& oldAcl,
+                              const shared_ptr<AclEntry>& newAcl) {
+  auto id = newAcl->getID();
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    throw FbossError("ACL entry ", id, " is not programmed");
+  }
+  // The old and the new entry match the same packets for a moment, which
+  // is harmless, since they have the same priority
+  auto entry = installEntry(newAcl.get());
+  destroyEntry(id, it->second);
+  it->second = entry;
+}
+
+void BcmAclTable::deleteEntry(const shared_ptr<AclEntry>& acl) {
+  auto id = acl->getID();
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    throw FbossError("ACL entry ", id, " is not programmed");
+  }
+  destroyEntry(id, it->second);
+  entries_.erase(it);
+}
+
+opennsl_field_entry_t BcmAclTable::installEntry(const AclEntry* acl) {
+  auto unit = hw_->getUnit();
+  auto id = acl->getID();
+  opennsl_field_entry_t entry;
+  auto rv = opennsl_field_entry_create(unit, group_, &entry);
+  bcmCheckError(rv, "failed to create ACL entry ", id);
+  SCOPE_FAIL {
+    opennsl_field_entry_destroy(unit, entry);
+  };
+  rv = opennsl_field_entry_prio_set(unit, entry, getEntryPriority(id));
+  bcmCheckError(rv, "failed to set the priority of ACL entry ", id);
+
+  const auto& match = acl->getMatch();
+  if (match.etherType) {
+    rv = opennsl_field_qualify_EtherType(unit, entry, match.etherType,
+                                         0xffff);
+    bcmCheckError(rv, "failed to match the ethertype of ACL entry ", id);
+  }
+  if (match.dstMac) {
+    opennsl_mac_t mac;
+    opennsl_mac_t mask;
+    macToBcm(*match.dstMac, &mac);
+    macToBcm(match.dstMacMask, &mask);
+    rv = opennsl_field_qualify_DstMac(unit, entry, mac, mask);
+    bcmCheckError(rv, "failed to match the destination MAC of ACL entry ",
+                  id);
+  }
+  if (match.ipProtocol) {
+    rv = opennsl_field_qualify_IpProtocol(unit, entry, match.ipProtocol,
+                                          0xff);
+    bcmCheckError(rv, "failed to match the IP protocol of ACL entry ", id);
+  }
+  if (match.l4SrcPort) {
+    rv = opennsl_field_qualify_L4SrcPort(unit, entry, match.l4SrcPort,
+                                         0xffff);
+    bcmCheckError(rv, "failed to match the L4 source port of ACL entry ",
+                  id);
+  }
+  if (match.l4DstPort) {
+    rv = opennsl_field_qualify_L4DstPort(unit, entry, match.l4DstPort,
+                                         0xffff);
+    bcmCheckError(rv, "failed to match the L4 destination port of ACL "
+                  "entry ", id);
+  }
+  if (match.icmpv6Type) {
+    // The type is the upper byte, and any code matches
+    rv = opennsl_field_qualify_IcmpTypeCode(unit, entry,
+                                            match.icmpv6Type << 8, 0xff00);
+    bcmCheckError(rv, "failed to match the ICMPv6 type of ACL entry ", id);
+  }
+
+  switch (acl->getAction()) {
+    case cfg::AclAction::DROP:
+      rv = opennsl_field_action_add(unit, entry, opennslFieldActionDrop,
+                                    0, 0);
+      bcmCheckError(rv, "failed to add the drop action of ACL entry ", id);
+      break;
+    case cfg::AclAction::PUNT:
+      // The drop only stops the packet from being switched, it is still
+      // copied to the CPU.
+      rv = opennsl_field_action_add(unit, entry, opennslFieldActionDrop,
+                                    0, 0);
+      bcmCheckError(rv, "failed to add the drop action of ACL entry ", id);
+      // Fall through, to copy the packet
+    case cfg::AclAction::TRAP:
+      rv = opennsl_field_action_add(unit, entry, opennslFieldActionCopyToCpu,
+                                    0, 0);
+      bcmCheckError(rv, "failed to add the trap action of ACL entry ", id);
+      // Fall through, to pick the CPU queue
+    case cfg::AclAction::CPU_QUEUE:
+      rv = opennsl_field_action_add(unit, entry, opennslFieldActionCosQCpuNew,
+                                    acl->getCpuQueue(), 0);
+      bcmCheckError(rv, "failed to set CPU queue ", acl->getCpuQueue(),
+                    " for ACL entry ", id);
+      break;
+  }
+
+  rv = opennsl_field_entry_install(unit, entry);
+  bcmCheckError(rv, "failed to install ACL entry ", id);
+  VLOG(3) << "programmed ACL entry " << id << " as field entry " << entry;
+  return entry;
+}
+
+void BcmAclTable::destroyEntry(AclEntryID id, opennsl_field_entry_t entry) {
+  auto unit = hw_->getUnit();
+  auto rv = opennsl_field_entry_remove(unit, entry);
+  bcmCheckError(rv, "failed to remove ACL entry ", id);
+  rv = opennsl_field_entry_destroy(unit, entry);
+  bcmCheckError(rv, "failed to destroy ACL entry ", id);
+}
+
+}} // facebook::fboss
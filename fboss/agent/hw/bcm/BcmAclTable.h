@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+extern "C" {
+#include <opennsl/field.h>
+}
+
+#include "fboss/agent/types.h"
+
+#include <boost/container/flat_map.hpp>
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+class AclEntry;
+class BcmSwitch;
+
+/*
+ * BcmAclTable programs the ACL entries as entries of an ingress field
+ * processor group, which every packet is matched against.
+ *
+ * The field processor gives the entry with the highest priority precedence,
+ * so each entry's priority decreases with its ID.  A changed entry is
+ * programmed as a new entry, which replaces the old one once it is
+ * installed, so its packets are never left unmatched in between.
+ *
+ * All methods must be called with the BcmSwitch lock held.
+ */
+class BcmAclTable {
+ public:
+  explicit BcmAclTable(const BcmSwitch* hw);
+  ~BcmAclTable();
+
+  /*
+   * Create the field group of the entries.  This must be called once, when
+   * the switch is initialized, before any entries are added.
+   */
+  void createGroup();
+
+  void addEntry(const std::shared_ptr<AclEntry>& acl);
+  void changeEntry(const std::shared_ptr<AclEntry>& oldAcl,
+                   const std::shared_ptr<AclEntry>& newAcl);
+  void deleteEntry(const std::shared_ptr<AclEntry>& acl);
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  BcmAclTable(BcmAclTable const &) = delete;
+  BcmAclTable& operator=(BcmAclTable const &) = delete;
+
+  // Create and install the field entry of the ACL entry
+  opennsl_field_entry_t installEntry(const AclEntry* acl);
+  void destroyEntry(AclEntryID id, opennsl_field_entry_t entry);
+
+  const BcmSwitch* hw_{nullptr};
+  opennsl_field_group_t group_{-1};
+  boost::container::flat_map<AclEntryID, opennsl_field_entry_t> entries_;
+};
+
+}} // facebook::fboss
@@ -9,9 +9,24 @@
  */
 #include "BcmEgress.h"
 #include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmSdkCall.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
 #include "fboss/agent/hw/bcm/BcmSwitch.h"
 #include "fboss/agent/hw/bcm/BcmWarmBootCache.h"
 
+#include <folly/Hash.h>
+#include <folly/ScopeGuard.h>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <iterator>
+
+DEFINE_int32(ecmp_resilient_buckets, 0,
+             "Program ECMP groups as a table of this many buckets, so that "
+             "removing a nexthop only moves the flows that were using it.  "
+             "Must not exceed the maximum ECMP group size of the ASIC.  0 "
+             "programs plain ECMP groups, where removing a nexthop rehashes "
+             "most flows.");
+
 namespace facebook { namespace fboss {
 
 using folly::IPAddress;
@@ -22,8 +37,14 @@ bool BcmEgress::alreadyExists(const opennsl_l3_egress_t& newEgress) const {
     return false;
   }
   opennsl_l3_egress_t existingEgress;
-  auto rv = opennsl_l3_egress_get(hw_->getUnit(), id_, &existingEgress);
+  auto rv = bcmSdkCall(BcmSdkApi::L3_EGRESS_GET, opennsl_l3_egress_get,
+                       hw_->getUnit(), id_, &existingEgress);
   bcmCheckError(rv, "Egress object ", id_, " does not exist");
+  return sameEgress(newEgress, existingEgress);
+}
+
+bool BcmEgress::sameEgress(const opennsl_l3_egress_t& newEgress,
+                           const opennsl_l3_egress_t& existingEgress) {
   bool sameMacs = (!newEgress.mac_addr && !existingEgress.mac_addr) ||
     (existingEgress.mac_addr && newEgress.mac_addr &&
      !memcmp(newEgress.mac_addr, existingEgress.mac_addr,
@@ -37,7 +58,8 @@ void BcmEgress::verifyDropEgress(int unit) {
   const auto id = getDropEgressId();
   opennsl_l3_egress_t egress;
   opennsl_l3_egress_t_init(&egress);
-  auto ret = opennsl_l3_egress_get(unit, id, &egress);
+  auto ret = bcmSdkCall(BcmSdkApi::L3_EGRESS_GET, opennsl_l3_egress_get,
+                        unit, id, &egress);
   bcmCheckError(ret, "failed to verify drop egress ", id);
   if (!(egress.flags & OPENNSL_L3_DST_DISCARD)) {
     throw FbossError("Egress ID ", id, " is not programmed as drop");
@@ -60,10 +82,14 @@ void BcmEgress::program(opennsl_if_t intfId, opennsl_vrf_t vrf,
     eObj.port = port;
   }
   eObj.intf = intfId;
-  uint32_t flags;
+  uint32_t flags = 0;
   bool addEgress = false;
   const auto warmBootCache = hw_->getWarmBootCache();
-  auto vrfAndIP2EgressCitr = warmBootCache->findEgress(vrf, ip);
+  // An egress object that was created already keeps its ID.  It may be
+  // shared by several hosts, so the egress cached for ip, if any, may be
+  // another one.
+  auto vrfAndIP2EgressCitr = id_ == INVALID ?
+    warmBootCache->findEgress(vrf, ip) : warmBootCache->vrfAndIP2Egress_end();
   if (vrfAndIP2EgressCitr != warmBootCache->vrfAndIP2Egress_end()) {
     // Lambda to compare with existing egress to know if should reprogram
     auto equivalent = [] (const opennsl_l3_egress_t& newEgress,
@@ -101,6 +127,7 @@ void BcmEgress::program(opennsl_if_t intfId, opennsl_vrf_t vrf,
     if (!equivalent(eObj, existingEgressIdAndEgress.second)) {
       VLOG(1) << "Updating egress object for next hop : " << ip;
       addEgress = true;
+      warmBootCache->reprogrammed();
     } else {
       VLOG(1) << "Egress object for : " << ip << " already exists";
     }
@@ -113,10 +140,15 @@ void BcmEgress::program(opennsl_if_t intfId, opennsl_vrf_t vrf,
     }
     if (id_ != INVALID) {
       flags |= OPENNSL_L3_REPLACE|OPENNSL_L3_WITH_ID;
-    } else {
-      flags = 0;
     }
-    if (!alreadyExists(eObj)) {
+    // An egress found in the warm boot cache was read from the HW when the
+    // cache was populated, so compare with that rather than reading it
+    // back from the HW again.
+    bool identical =
+      vrfAndIP2EgressCitr != warmBootCache->vrfAndIP2Egress_end() ?
+      sameEgress(eObj, vrfAndIP2EgressCitr->second.second) :
+      alreadyExists(eObj);
+    if (!identical) {
       /*
        *  Only program the HW if a identical egress object does not
        *  exist. Per BCM documentation updating entries like so should not
@@ -125,7 +157,9 @@ void BcmEgress::program(opennsl_if_t intfId, opennsl_vrf_t vrf,
        *  the corresponding IP address sometimes broke. BCM issue is being
        *  tracked in t4324084
        */
-      auto rc = opennsl_l3_egress_create(hw_->getUnit(), flags, &eObj, &id_);
+      auto rc = bcmSdkCall(BcmSdkApi::L3_EGRESS_CREATE,
+                           opennsl_l3_egress_create, hw_->getUnit(), flags,
+                           &eObj, &id_);
       bcmCheckError(rc, "failed to program L3 egress object ", id_,
           (mac) ? mac->toString() : "ToCPU",
           " on unit ", hw_->getUnit());
@@ -154,13 +188,12 @@ void BcmEgress::programToCPU() {
   opennsl_l3_egress_t_init(&eObj);
   eObj.flags |= (OPENNSL_L3_L2TOCPU | OPENNSL_L3_COPY_TO_CPU);
   // BCM does not care about interface ID for punt to CPU egress object
-  uint32_t flags;
+  uint32_t flags = 0;
   if (id_ != INVALID) {
     flags |= OPENNSL_L3_REPLACE|OPENNSL_L3_WITH_ID;
-  } else {
-    flags = 0;
   }
-  auto rc = opennsl_l3_egress_create(hw_->getUnit(), flags, &eObj, &id_);
+  auto rc = bcmSdkCall(BcmSdkApi::L3_EGRESS_CREATE, opennsl_l3_egress_create,
+                       hw_->getUnit(), flags, &eObj, &id_);
   bcmCheckError(rc, "failed to program L3 egress object ", id_,
                 " to CPU on unit ", hw_->getUnit());
   VLOG(3) << "programmed L3 egress object " << id_
@@ -171,21 +204,76 @@ BcmEgress::~BcmEgress() {
   if (id_ == INVALID) {
     return;
   }
-  auto rc = opennsl_l3_egress_destroy(hw_->getUnit(), id_);
+  auto rc = bcmSdkCall(BcmSdkApi::L3_EGRESS_DESTROY, opennsl_l3_egress_destroy,
+                       hw_->getUnit(), id_);
   bcmLogFatal(rc, hw_, "failed to destroy L3 egress object ",
       id_, " on unit ", hw_->getUnit());
   VLOG(3) << "destroyed L3 egress object " << id_
           << " on unit " << hw_->getUnit();
 }
 
-void BcmEcmpEgress::program(opennsl_if_t paths[], int n_path) {
-  opennsl_l3_egress_ecmp_t obj;
-  opennsl_l3_egress_ecmp_t_init(&obj);
-  obj.max_paths = ((n_path + 3) >> 2) << 2; // multiple of 4
+BcmEcmpEgress::BcmEcmpEgress(const BcmSwitch* hw, Paths paths)
+    : BcmEgressBase(hw) {
+  program(std::move(paths));
+}
+
+void BcmEcmpEgress::program(Paths paths) {
+  CHECK(!paths.empty());
+  std::sort(paths.begin(), paths.end());
+  if (!pruned_.empty()) {
+    // HW doesn't have all of paths_, so rewrite the whole group
+    pruned_.clear();
+    create(paths);
+  } else if (id_ != INVALID && resilientBuckets(paths) == 0 &&
+      static_cast<int>(paths.size()) <= maxPaths_) {
+    updateMembers(paths);
+  } else {
+    create(paths);
+  }
+  CHECK(paths_ == paths);
+}
+
+uint32_t BcmEcmpEgress::resilientBuckets(const Paths& paths) {
+  if (FLAGS_ecmp_resilient_buckets <= 0 ||
+      paths.size() > static_cast<uint32_t>(FLAGS_ecmp_resilient_buckets)) {
+    return 0;
+  }
+  return FLAGS_ecmp_resilient_buckets;
+}
+
+BcmEcmpEgress::Paths BcmEcmpEgress::assignBuckets(const Paths& paths,
+                                                  uint32_t numBuckets) {
+  CHECK(!paths.empty());
+  Paths buckets;
+  buckets.reserve(numBuckets);
+  for (uint32_t bucket = 0; bucket < numBuckets; ++bucket) {
+    opennsl_if_t best = paths.front();
+    uint64_t bestScore = 0;
+    // Each copy of a path competes separately.  The paths are sorted, so
+    // copies are next to each other.
+    uint32_t copy = 0;
+    for (size_t idx = 0; idx < paths.size(); ++idx) {
+      copy = (idx > 0 && paths[idx] == paths[idx - 1]) ? copy + 1 : 0;
+      uint64_t score = folly::hash::hash_combine(bucket, paths[idx], copy);
+      if (score > bestScore || idx == 0) {
+        best = paths[idx];
+        bestScore = score;
+      }
+    }
+    buckets.push_back(best);
+  }
+  return buckets;
+}
 
+void BcmEcmpEgress::create(const Paths& paths) {
+  auto numBuckets = resilientBuckets(paths);
+  // The members in HW, in the order the ASIC selects them by
+  auto hwPaths = numBuckets > 0 ? assignBuckets(paths, numBuckets) : paths;
   const auto warmBootCache = hw_->getWarmBootCache();
-  const auto egressIds = BcmWarmBootCache::toEgressIds(paths, n_path);
-  auto egressIds2EcmpCItr = warmBootCache->findEcmp(egressIds);
+  const auto egressIds = BcmWarmBootCache::toEgressIds(
+      hwPaths.data(), hwPaths.size());
+  auto egressIds2EcmpCItr = id_ == INVALID ?
+    warmBootCache->findEcmp(egressIds) : warmBootCache->egressIds2Ecmp_end();
   if (egressIds2EcmpCItr != warmBootCache->egressIds2Ecmp_end()) {
     const auto& existing = egressIds2EcmpCItr->second;
     // TODO figure out why the following check fails
@@ -196,6 +284,7 @@ void BcmEcmpEgress::program(opennsl_if_t paths[], int n_path) {
     // the next multiple of 4 as we desired.
     // CHECK(obj.max_paths == existing.max_paths);
     id_ = existing.ecmp_intf;
+    maxPaths_ = existing.max_paths;
     VLOG(1) << "Ecmp egress object for egress : " <<
       BcmWarmBootCache::toEgressIdsStr(egressIds)
       << " already exists ";
@@ -203,21 +292,172 @@ void BcmEcmpEgress::program(opennsl_if_t paths[], int n_path) {
   } else {
     VLOG(1) << "Adding ecmp egress with egress : " <<
       BcmWarmBootCache::toEgressIdsStr(egressIds);
-    if (id_ != INVALID) {
-      obj.flags |= OPENNSL_L3_REPLACE|OPENNSL_L3_WITH_ID;
-      obj.ecmp_intf = id_;
-    }
-    auto ret = opennsl_l3_egress_ecmp_create(hw_->getUnit(), &obj, n_path,
-                                             paths);
-    bcmCheckError(ret, "failed to program L3 ECMP egress object ", id_,
-                " with ", n_path, " paths");
-    id_ = obj.ecmp_intf;
+    writeGroup(hwPaths, numBuckets);
     VLOG(3) << "Programmed L3 ECMP egress object " << id_ << " for "
-          << n_path << " paths";
+          << paths.size() << " paths in " << hwPaths.size() << " buckets";
   }
+  paths_ = paths;
   CHECK_NE(id_, INVALID);
 }
 
+void BcmEcmpEgress::writeGroup(Paths hwPaths, uint32_t numBuckets) {
+  int n_path = hwPaths.size();
+  opennsl_l3_egress_ecmp_t obj;
+  opennsl_l3_egress_ecmp_t_init(&obj);
+  if (numBuckets > 0) {
+    // The ASIC must keep the buckets in our order
+    obj.max_paths = n_path;
+    obj.ecmp_group_flags |= OPENNSL_L3_ECMP_PATH_NO_SORTING;
+  } else {
+    obj.max_paths = ((n_path + 3) >> 2) << 2; // multiple of 4
+  }
+  if (id_ != INVALID) {
+    obj.flags |= OPENNSL_L3_REPLACE|OPENNSL_L3_WITH_ID;
+    obj.ecmp_intf = id_;
+  }
+  auto ret = bcmSdkCall(BcmSdkApi::L3_ECMP_CREATE,
+                        opennsl_l3_egress_ecmp_create, hw_->getUnit(), &obj,
+                        n_path, hwPaths.data());
+  bcmCheckError(ret, "failed to program L3 ECMP egress object ", id_,
+              " with ", n_path, " paths");
+  id_ = obj.ecmp_intf;
+  maxPaths_ = obj.max_paths;
+  BcmStats::get()->ecmpGroupWritten();
+}
+
+void BcmEcmpEgress::addMember(opennsl_if_t path) {
+  opennsl_l3_egress_ecmp_t obj;
+  opennsl_l3_egress_ecmp_t_init(&obj);
+  obj.ecmp_intf = id_;
+  obj.max_paths = maxPaths_;
+  auto ret = bcmSdkCall(BcmSdkApi::L3_ECMP_ADD, opennsl_l3_egress_ecmp_add,
+                        hw_->getUnit(), &obj, path);
+  bcmCheckError(ret, "failed to add egress ", path,
+                " to L3 ECMP egress object ", id_);
+  BcmStats::get()->ecmpMemberUpdated();
+}
+
+void BcmEcmpEgress::deleteMember(opennsl_if_t path) {
+  opennsl_l3_egress_ecmp_t obj;
+  opennsl_l3_egress_ecmp_t_init(&obj);
+  obj.ecmp_intf = id_;
+  obj.max_paths = maxPaths_;
+  auto ret = bcmSdkCall(BcmSdkApi::L3_ECMP_DELETE,
+                        opennsl_l3_egress_ecmp_delete, hw_->getUnit(), &obj,
+                        path);
+  bcmCheckError(ret, "failed to remove egress ", path,
+                " from L3 ECMP egress object ", id_);
+  BcmStats::get()->ecmpMemberUpdated();
+}
+
+void BcmEcmpEgress::updateMembers(const Paths& paths) {
+  Paths removed;
+  Paths added;
+  std::set_difference(paths_.begin(), paths_.end(),
+                      paths.begin(), paths.end(),
+                      std::back_inserter(removed));
+  std::set_difference(paths.begin(), paths.end(),
+                      paths_.begin(), paths_.end(),
+                      std::back_inserter(added));
+  // Remove members first, so the group never needs more than maxPaths_.
+  // paths_ is kept in sync after each change, in case a later one fails.
+  for (auto path : removed) {
+    deleteMember(path);
+    paths_.erase(std::lower_bound(paths_.begin(), paths_.end(), path));
+  }
+  for (auto path : added) {
+    addMember(path);
+    paths_.insert(std::upper_bound(paths_.begin(), paths_.end(), path), path);
+  }
+  VLOG(3) << "Updated L3 ECMP egress object " << id_ << ": removed "
+          << removed.size() << " and added " << added.size() << " paths";
+}
+
+BcmEcmpEgress::Paths BcmEcmpEgress::activePaths() const {
+  Paths active;
+  active.reserve(paths_.size());
+  std::remove_copy_if(paths_.begin(), paths_.end(), std::back_inserter(active),
+      [&](opennsl_if_t path) {
+        return std::binary_search(pruned_.begin(), pruned_.end(), path);
+      });
+  return active;
+}
+
+void BcmEcmpEgress::setActivePaths(const Paths& oldActive,
+                                   const Paths& newActive) {
+  auto numBuckets = resilientBuckets(paths_);
+  if (numBuckets > 0) {
+    // Only the buckets of the pruned paths move
+    writeGroup(assignBuckets(newActive, numBuckets), numBuckets);
+    return;
+  }
+  Paths removed;
+  Paths added;
+  std::set_difference(oldActive.begin(), oldActive.end(),
+                      newActive.begin(), newActive.end(),
+                      std::back_inserter(removed));
+  std::set_difference(newActive.begin(), newActive.end(),
+                      oldActive.begin(), oldActive.end(),
+                      std::back_inserter(added));
+  for (auto path : removed) {
+    deleteMember(path);
+  }
+  for (auto path : added) {
+    addMember(path);
+  }
+}
+
+size_t BcmEcmpEgress::prunePaths(const Paths& egresses) {
+  auto oldActive = activePaths();
+  Paths newActive;
+  std::remove_copy_if(oldActive.begin(), oldActive.end(),
+                      std::back_inserter(newActive),
+      [&](opennsl_if_t path) {
+        return std::binary_search(egresses.begin(), egresses.end(), path);
+      });
+  if (newActive.size() == oldActive.size()) {
+    return 0;
+  }
+  if (newActive.empty()) {
+    VLOG(2) << "Not pruning all paths of L3 ECMP egress object " << id_;
+    return 0;
+  }
+  setActivePaths(oldActive, newActive);
+  Paths pruned;
+  std::set_union(pruned_.begin(), pruned_.end(),
+                 egresses.begin(), egresses.end(),
+                 std::back_inserter(pruned));
+  // Only remember the egress objects that are actually in the group
+  pruned.erase(std::remove_if(pruned.begin(), pruned.end(),
+      [&](opennsl_if_t path) {
+        return !std::binary_search(paths_.begin(), paths_.end(), path);
+      }), pruned.end());
+  pruned_ = std::move(pruned);
+  VLOG(3) << "Pruned L3 ECMP egress object " << id_ << " to "
+          << newActive.size() << " of " << paths_.size() << " paths";
+  return oldActive.size() - newActive.size();
+}
+
+size_t BcmEcmpEgress::restorePaths(const Paths& egresses) {
+  Paths pruned;
+  std::set_difference(pruned_.begin(), pruned_.end(),
+                      egresses.begin(), egresses.end(),
+                      std::back_inserter(pruned));
+  if (pruned.size() == pruned_.size()) {
+    return 0;
+  }
+  auto oldActive = activePaths();
+  pruned_.swap(pruned);
+  auto newActive = activePaths();
+  SCOPE_FAIL {
+    pruned_.swap(pruned);
+  };
+  setActivePaths(oldActive, newActive);
+  VLOG(3) << "Restored L3 ECMP egress object " << id_ << " to "
+          << newActive.size() << " of " << paths_.size() << " paths";
+  return newActive.size() - oldActive.size();
+}
+
 BcmEcmpEgress::~BcmEcmpEgress() {
   if (id_ == INVALID) {
     return;
@@ -225,7 +465,8 @@ BcmEcmpEgress::~BcmEcmpEgress() {
   opennsl_l3_egress_ecmp_t obj;
   opennsl_l3_egress_ecmp_t_init(&obj);
   obj.ecmp_intf = id_;
-  auto ret = opennsl_l3_egress_ecmp_destroy(hw_->getUnit(), &obj);
+  auto ret = bcmSdkCall(BcmSdkApi::L3_ECMP_DESTROY,
+                        opennsl_l3_egress_ecmp_destroy, hw_->getUnit(), &obj);
   bcmLogFatal(ret, hw_, "failed to destroy L3 ECMP egress object ",
       id_, " on unit ", hw_->getUnit());
   VLOG(3) << "Destroyed L3 ECMP egress object " << id_
@@ -20,6 +20,7 @@ extern "C" {
 #include "fboss/agent/state/RouteTypes.h"
 
 #include <boost/noncopyable.hpp>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
@@ -83,6 +84,8 @@ class BcmEgress : public BcmEgressBase {
 
  private:
   bool alreadyExists(const  opennsl_l3_egress_t& newEgress) const;
+  static bool sameEgress(const opennsl_l3_egress_t& newEgress,
+                         const opennsl_l3_egress_t& existingEgress);
   void program(opennsl_if_t intfId, opennsl_vrf_t vrf,
       const folly::IPAddress& ip, const folly::MacAddress* mac,
       opennsl_port_t port, RouteForwardAction action);
@@ -90,9 +93,75 @@ class BcmEgress : public BcmEgressBase {
 
 class BcmEcmpEgress : public BcmEgressBase {
  public:
-  explicit BcmEcmpEgress(const BcmSwitch* hw) : BcmEgressBase(hw) {}
+  /*
+   * The egress IDs of the group members, in sorted order.  A path that is
+   * listed more than once gets a larger share of the traffic.
+   */
+  typedef std::vector<opennsl_if_t> Paths;
+
+  // Create and program an ECMP group with the given members
+  BcmEcmpEgress(const BcmSwitch* hw, Paths paths);
   virtual ~BcmEcmpEgress();
-  void program(opennsl_if_t paths[], int n_path);
+
+  const Paths& getPaths() const {
+    return paths_;
+  }
+
+  /*
+   * Change the members of an existing group.
+   *
+   * Only the members that changed are added to or removed from the group in
+   * HW; the group is re-created only if it has to grow beyond the number of
+   * paths it was created with.
+   *
+   * With --ecmp_resilient_buckets, the group is instead programmed as a
+   * fixed size table of buckets, and is always rewritten as a whole.
+   */
+  void program(Paths paths);
+
+  /*
+   * Assign each of numBuckets buckets to one of the paths, using rendezvous
+   * (highest random weight) hashing.
+   *
+   * The member a bucket is assigned to depends only on the bucket and the
+   * set of paths, so removing a path only reassigns the buckets it had, and
+   * flows hashed to the other buckets keep their member.  A path listed N
+   * times gets about N times as many buckets.
+   */
+  static Paths assignBuckets(const Paths& paths, uint32_t numBuckets);
+
+  /*
+   * Remove the given egress objects from the group in HW, or add back the
+   * ones that were removed, without changing getPaths().  This is the fast
+   * path for a port going down, ahead of the routes being re-resolved.
+   *
+   * egresses must be sorted.  A group is never pruned down to no members,
+   * since it has nowhere better to send the traffic.
+   *
+   * Returns the number of paths removed from, or added back to, the group.
+   */
+  size_t prunePaths(const Paths& egresses);
+  size_t restorePaths(const Paths& egresses);
+
+ private:
+  void create(const Paths& paths);
+  void updateMembers(const Paths& paths);
+  // Write the whole group to HW, as the given members in HW order
+  void writeGroup(Paths hwPaths, uint32_t numBuckets);
+  void addMember(opennsl_if_t path);
+  void deleteMember(opennsl_if_t path);
+  // The paths that are currently in the group in HW
+  Paths activePaths() const;
+  void setActivePaths(const Paths& oldActive, const Paths& newActive);
+  // The number of buckets to program for the given paths, or 0 for a plain
+  // ECMP group
+  static uint32_t resilientBuckets(const Paths& paths);
+
+  Paths paths_;
+  // The egress objects of paths_ that prunePaths() removed from HW, sorted
+  Paths pruned_;
+  // The number of paths the group has room for in HW
+  int maxPaths_{0};
 };
 
 }}
@@ -16,8 +16,16 @@
 #include "fboss/agent/hw/bcm/BcmIntf.h"
 #include "fboss/agent/hw/bcm/BcmPort.h"
 #include "fboss/agent/hw/bcm/BcmPortTable.h"
+#include "fboss/agent/hw/bcm/BcmResourceManager.h"
+#include "fboss/agent/hw/bcm/BcmRoute.h"
+#include "fboss/agent/hw/bcm/BcmSdkCall.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
 #include "fboss/agent/hw/bcm/BcmWarmBootCache.h"
 
+#include <folly/ScopeGuard.h>
+#include <algorithm>
+#include <iterator>
+
 namespace facebook { namespace fboss {
 
 using std::unique_ptr;
@@ -39,23 +47,62 @@ void BcmHost::initHostCommon(opennsl_l3_host_t *host) const {
     host->l3a_flags |= OPENNSL_L3_IP6;
   }
   host->l3a_vrf = vrf_;
-  host->l3a_intf = egress_->getID();
+  host->l3a_intf = getEgressId();
 }
 
 void BcmHost::program(opennsl_if_t intf, const MacAddress* mac,
                       opennsl_port_t port, RouteForwardAction action) {
-  // get the egress object and then update it with the new MAC
-  if (!egress_) {
-    egress_ = unique_ptr<BcmEgress>(new BcmEgress(hw_));
-  }
-  if (mac) {
-    egress_->program(intf, vrf_, addr_, *mac, port);
+  auto* table = hw_->writableHostTable();
+  auto oldEgressId = getEgressId();
+  // The egress objects the host entry may still point at, which are only
+  // released once it has been rewritten
+  unique_ptr<BcmEgress> oldEgress;
+  auto* oldShared = sharedEgress_;
+  auto oldIntf = intf_;
+  auto oldMac = mac_;
+  auto oldPort = port_;
+  if (mac && nexthopRefs_ == 0) {
+    bool sameMac = sharedEgress_ && intf == intf_ && *mac == mac_;
+    if (sameMac && port == port_) {
+      oldShared = nullptr;
+    } else if (sameMac &&
+               table->moveBcmEgress(vrf_, addr_, intf, *mac, port_, port)) {
+      // The MAC moved, and all of the hosts behind it moved with it
+      oldShared = nullptr;
+    } else {
+      sharedEgress_ = table->incRefOrCreateBcmEgress(vrf_, addr_, intf,
+                                                     *mac, port);
+    }
+    oldEgress = std::move(egress_);
   } else {
-    if (action == DROP) {
-      egress_->programToDrop(intf, vrf_, addr_);
+    // get the egress object and then update it with the new MAC
+    if (!egress_) {
+      egress_ = unique_ptr<BcmEgress>(new BcmEgress(hw_));
+    }
+    if (mac) {
+      egress_->program(intf, vrf_, addr_, *mac, port);
     } else {
-      egress_->programToCPU(intf, vrf_, addr_);
+      if (action == DROP) {
+        egress_->programToDrop(intf, vrf_, addr_);
+      } else {
+        egress_->programToCPU(intf, vrf_, addr_);
+      }
     }
+    sharedEgress_ = nullptr;
+  }
+  intf_ = intf;
+  mac_ = mac ? *mac : MacAddress();
+  port_ = mac ? port : 0;
+  SCOPE_EXIT {
+    if (oldShared) {
+      table->derefBcmEgress(oldIntf, oldMac, oldPort);
+    }
+    if (oldEgress) {
+      table->forgetEgress(oldEgress->getID());
+    }
+  };
+  if (added_ && getEgressId() != oldEgressId) {
+    rewriteHwEntry();
   }
   // if no host was added already, add one pointing to the egress object
   if (!added_) {
@@ -72,56 +119,136 @@ void BcmHost::program(opennsl_if_t intf, const MacAddress* mac,
           existingHost.l3a_intf == newHost.l3a_intf;
       };
       if (!equivalent(host, vrfIp2HostCitr->second)) {
-        LOG (FATAL) << "Host entries should never change ";
+        // Host entries never change, but the previous run may have left a
+        // full length route in the host table at this address.
+        VLOG(1) << "Replacing host table route for : " << addr_;
+        host.l3a_flags |= OPENNSL_L3_REPLACE;
+        auto rc = bcmSdkCall(BcmSdkApi::L3_HOST_ADD, opennsl_l3_host_add,
+                             hw_->getUnit(), &host);
+        bcmCheckError(rc, "failed to replace L3 host object for ",
+          addr_.str(), " @egress ", getEgressId());
+        warmBootCache->reprogrammed();
       } else {
         VLOG(1) << "Host entry for : " << addr_ << " already exists";
       }
       warmBootCache->programmed(vrfIp2HostCitr);
     } else {
+      // A route for the address may be in the host table
+      hw_->writableRouteTable()->releaseHostEntry(vrf_, addr_);
       VLOG(1) << "Adding host entry for : " << addr_;
-      auto rc = opennsl_l3_host_add(hw_->getUnit(), &host);
+      auto rc = bcmSdkCall(BcmSdkApi::L3_HOST_ADD, opennsl_l3_host_add,
+                           hw_->getUnit(), &host);
+      if (hw_->getResourceManager()->shouldRejectOnError(rc)) {
+        // Traffic to the host falls through to the interface route until
+        // the next program() finds room.
+        LOG(WARNING) << "No room for the L3 host object for " << addr_.str()
+                     << ": " << opennsl_errmsg(rc);
+        BcmStats::get()->hostEntryRejected();
+        return;
+      }
       bcmCheckError(rc, "failed to program L3 host object for ", addr_.str(),
-        " @egress ", egress_->getID());
+        " @egress ", getEgressId());
       VLOG(3) << "created L3 host object for " << addr_.str()
-      << " @egress " << egress_->getID();
+      << " @egress " << getEgressId();
 
     }
     added_ = true;
   }
 }
 
+void BcmHost::rewriteHwEntry() {
+  CHECK(added_);
+  opennsl_l3_host_t host;
+  initHostCommon(&host);
+  host.l3a_flags |= OPENNSL_L3_REPLACE;
+  auto rc = bcmSdkCall(BcmSdkApi::L3_HOST_ADD, opennsl_l3_host_add,
+                       hw_->getUnit(), &host);
+  bcmCheckError(rc, "failed to rewrite L3 host object for ", addr_.str(),
+    " @egress ", getEgressId());
+  VLOG(1) << "Rewrote the HW entry of host : " << addr_;
+}
+
 opennsl_if_t BcmHost::getEgressId() const {
+  if (sharedEgress_) {
+    return sharedEgress_->getID();
+  }
   return egress_ ? egress_->getID() : -1;
 }
 
-BcmHost::~BcmHost() {
-  if (!added_) {
+void BcmHost::incNexthopRefs() {
+  if (nexthopRefs_++ > 0 || !sharedEgress_) {
     return;
   }
-  opennsl_l3_host_t host;
-  initHostCommon(&host);
-  auto rc = opennsl_l3_host_delete(hw_->getUnit(), &host);
-  bcmLogFatal(rc, hw_, "failed to delete L3 host object for ", addr_.str());
-  VLOG(3) << "deleted L3 host object for " << addr_.str();
+  SCOPE_FAIL {
+    --nexthopRefs_;
+  };
+  // Move the host to an egress object of its own, to the same MAC
+  auto mac = mac_;
+  program(intf_, &mac, port_, NEXTHOPS);
+}
+
+void BcmHost::decNexthopRefs() noexcept {
+  CHECK_GT(nexthopRefs_, 0);
+  // The host keeps its own egress object until it is programmed again
+  --nexthopRefs_;
+}
+
+BcmHost::~BcmHost() {
+  if (added_) {
+    opennsl_l3_host_t host;
+    initHostCommon(&host);
+    auto rc = bcmSdkCall(BcmSdkApi::L3_HOST_DELETE, opennsl_l3_host_delete,
+                         hw_->getUnit(), &host);
+    bcmLogFatal(rc, hw_, "failed to delete L3 host object for ",
+                addr_.str());
+    VLOG(3) << "deleted L3 host object for " << addr_.str();
+  }
+  if (sharedEgress_) {
+    hw_->writableHostTable()->derefBcmEgress(intf_, mac_, port_);
+  }
 }
 
 BcmEcmpHost::BcmEcmpHost(const BcmSwitch *hw, opennsl_vrf_t vrf,
-                         const RouteForwardNexthops& fwd)
+                         const InternedForwardNexthops& fwd)
     : hw_(hw), vrf_(vrf) {
-  CHECK_GT(fwd.size(), 0);
+  CHECK_GT(fwd->size(), 0);
   BcmHostTable *table = hw_->writableHostTable();
-  opennsl_if_t paths[fwd.size()];
+  // allocate a BcmHost object for each path in this ECMP
+  auto paths = refHosts(fwd);
+  SCOPE_FAIL {
+    derefHosts(fwd);
+  };
+  if (paths.size() == 1) {
+    // just one path. No BcmEcmpEgress object this case.
+    egressId_ = paths[0];
+  } else {
+    std::sort(paths.begin(), paths.end());
+    egress_ = table->incRefOrCreateBcmEcmpEgress(paths);
+    egressId_ = egress_->getID();
+  }
+  fwd_ = fwd;
+}
+
+BcmEcmpEgress::Paths BcmEcmpHost::refHosts(
+    const InternedForwardNexthops& fwd) {
+  BcmHostTable *table = hw_->writableHostTable();
+  BcmEcmpEgress::Paths paths;
+  paths.reserve(fwd->size());
   RouteForwardNexthops prog;
-  prog.reserve(fwd.size());
+  prog.reserve(fwd->size());
   SCOPE_FAIL {
     for (const auto& nhop : prog) {
-      table->derefBcmHost(vrf, nhop.nexthop);
+      derefHost(nhop.nexthop);
     }
   };
-  // allocate a BcmHost object for each path in this ECMP
-  int total = 0;
-  for (const auto& nhop : fwd) {
-    auto host = table->incRefOrCreateBcmHost(vrf, nhop.nexthop);
+  for (const auto& nhop : *fwd) {
+    auto host = table->incRefOrCreateBcmHost(vrf_, nhop.nexthop);
+    {
+      SCOPE_FAIL {
+        table->derefBcmHost(vrf_, nhop.nexthop);
+      };
+      host->incNexthopRefs();
+    }
     auto ret = prog.emplace(nhop.intf, nhop.nexthop);
     CHECK(ret.second);
     // TODO:
@@ -130,56 +257,83 @@ BcmEcmpHost::BcmEcmpHost(const BcmSwitch *hw, opennsl_vrf_t vrf,
     // do the HW programming. For now, we program the egress object to punt
     // to CPU. Any traffic going to CPU will trigger the neighbor discovery.
     if (!host->isProgrammed()) {
-      const auto intf = hw->getIntfTable()->getBcmIntf(nhop.intf);
+      const auto intf = hw_->getIntfTable()->getBcmIntf(nhop.intf);
       host->programToCPU(intf->getBcmIfId());
     }
-    paths[total++] = host->getEgressId();
+    paths.push_back(host->getEgressId());
   }
-  if (total == 1) {
-    // just one path. No BcmEcmpEgress object this case.
-    egressId_ = paths[0];
-  } else {
-    auto ecmp = folly::make_unique<BcmEcmpEgress>(hw);
-    ecmp->program(paths, fwd.size());
-    egress_ = std::move(ecmp);
-    egressId_ = egress_->getID();
+  return paths;
+}
+
+void BcmEcmpHost::derefHost(const IPAddress& addr) noexcept {
+  BcmHostTable *table = hw_->writableHostTable();
+  auto host = table->getBcmHostIf(vrf_, addr);
+  CHECK(host);
+  host->decNexthopRefs();
+  table->derefBcmHost(vrf_, addr);
+}
+
+void BcmEcmpHost::derefHosts(const InternedForwardNexthops& fwd) noexcept {
+  for (const auto& nhop : *fwd) {
+    derefHost(nhop.nexthop);
   }
-  fwd_ = std::move(prog);
+}
+
+void BcmEcmpHost::moveNexthops(const InternedForwardNexthops& fwd) {
+  CHECK(egress_);
+  CHECK_GT(fwd->size(), 1);
+  // Take the new hosts before releasing the old ones, so the hosts of the
+  // nexthops in both are kept
+  auto paths = refHosts(fwd);
+  SCOPE_FAIL {
+    derefHosts(fwd);
+  };
+  std::sort(paths.begin(), paths.end());
+  egress_->program(std::move(paths));
+  CHECK_EQ(egressId_, egress_->getID());
+  derefHosts(fwd_);
+  VLOG(3) << "moved L3 ECMP host from " << *fwd_ << " to " << *fwd
+          << " @egress " << egressId_;
+  fwd_ = fwd;
 }
 
 BcmEcmpHost::~BcmEcmpHost() {
-  // delete the ecmp egress object first
-  egress_.reset();
   BcmHostTable *table = hw_->writableHostTable();
-  for (const auto& nhop : fwd_) {
-    table->derefBcmHost(vrf_, nhop.nexthop);
+  // release the ecmp egress object first
+  if (egress_) {
+    table->derefBcmEcmpEgress(egress_->getPaths());
+    egress_ = nullptr;
   }
-  VLOG(3) << "deleted L3 ECMP host object for " << fwd_;
+  derefHosts(fwd_);
+  VLOG(3) << "deleted L3 ECMP host object for " << *fwd_;
 }
 
 BcmHostTable::BcmHostTable(const BcmSwitch *hw) : hw_(hw) {
 }
 
 BcmHostTable::~BcmHostTable() {
+  // The shared egress objects are destroyed along with egresses_, after
+  // the hosts, which must not look up the table while it is destroyed
+  for (const auto& entry : hosts_) {
+    entry.second.first->sharedEgress_ = nullptr;
+  }
 }
 
-template<typename KeyT, typename HostT, typename... Args>
+template<typename KeyT, typename HostT, typename HashT, typename... Args>
 HostT* BcmHostTable::incRefOrCreateBcmHost(
-    HostMap<KeyT, HostT>* map, Args... args) {
+    HostMap<KeyT, HostT, HashT>* map, Args... args) {
   KeyT key{args...};
-  auto ret = map->emplace(key, std::make_pair(nullptr, 1));
-  auto& iter = ret.first;
-  if (!ret.second) {
+  auto* entry = map->getIf(key);
+  if (entry) {
     // there was an entry already there
-    iter->second.second++;  // increase the reference counter
-    return iter->second.first.get();
+    entry->second++;  // increase the reference counter
+    return entry->first.get();
   }
-  SCOPE_FAIL {
-    map->erase(iter);
-  };
+  // Create the host before inserting it, so that a failure to program it
+  // leaves the table untouched.
   auto newHost = folly::make_unique<HostT>(hw_, args...);
   auto hostPtr = newHost.get();
-  iter->second.first = std::move(newHost);
+  map->emplace(std::move(key), std::make_pair(std::move(newHost), 1));
   return hostPtr;
 }
 
@@ -189,12 +343,12 @@ BcmHost* BcmHostTable::incRefOrCreateBcmHost(
 }
 
 BcmEcmpHost* BcmHostTable::incRefOrCreateBcmEcmpHost(
-    opennsl_vrf_t vrf, const RouteForwardNexthops& fwd) {
+    opennsl_vrf_t vrf, const InternedForwardNexthops& fwd) {
   return incRefOrCreateBcmHost(&ecmpHosts_, vrf, fwd);
 }
 
-template<typename KeyT, typename HostT, typename... Args>
-HostT* BcmHostTable::getBcmHostIf(const HostMap<KeyT, HostT>* map,
+template<typename KeyT, typename HostT, typename HashT, typename... Args>
+HostT* BcmHostTable::getBcmHostIf(const HostMap<KeyT, HostT, HashT>* map,
                                   Args... args) const {
   KeyT key{args...};
   auto iter = map->find(key);
@@ -219,44 +373,299 @@ BcmHost* BcmHostTable::getBcmHost(
 }
 
 BcmEcmpHost* BcmHostTable::getBcmEcmpHostIf(
-    opennsl_vrf_t vrf, const RouteForwardNexthops& fwd) const {
+    opennsl_vrf_t vrf, const InternedForwardNexthops& fwd) const {
   return getBcmHostIf(&ecmpHosts_, vrf, fwd);
 }
 
 BcmEcmpHost* BcmHostTable::getBcmEcmpHost(
-    opennsl_vrf_t vrf, const RouteForwardNexthops& fwd) const {
+    opennsl_vrf_t vrf, const InternedForwardNexthops& fwd) const {
   auto host = getBcmEcmpHostIf(vrf, fwd);
   if (!host) {
-    throw FbossError("Cannot find BcmEcmpHost vrf=", vrf, " fwd=", fwd);
+    throw FbossError("Cannot find BcmEcmpHost vrf=", vrf, " fwd=", *fwd);
   }
   return host;
 }
 
-template<typename KeyT, typename HostT, typename... Args>
-HostT* BcmHostTable::derefBcmHost(HostMap<KeyT, HostT>* map,
+template<typename KeyT, typename HostT, typename HashT, typename... Args>
+HostT* BcmHostTable::derefBcmHost(HostMap<KeyT, HostT, HashT>* map,
                                   Args... args) noexcept {
   KeyT key{args...};
-  auto iter = map->find(key);
-  if (iter == map->end()) {
+  auto* entry = map->getIf(key);
+  if (!entry) {
     return nullptr;
   }
-  auto& entry = iter->second;
-  CHECK_GT(entry.second, 0);
-  if (--entry.second == 0) {
-    map->erase(iter);
+  CHECK_GT(entry->second, 0);
+  if (--entry->second == 0) {
+    // Take the host out so it is destroyed after its entry is erased
+    auto host = std::move(entry->first);
+    map->erase(key);
     return nullptr;
   }
-  return entry.first.get();
+  return entry->first.get();
+}
+
+BcmEgress* BcmHostTable::incRefOrCreateBcmEgress(
+    opennsl_vrf_t vrf, const IPAddress& addr, opennsl_if_t intf,
+    MacAddress mac, opennsl_port_t port) {
+  EgressKey key{intf, mac, port};
+  auto* entry = egresses_.getIf(key);
+  if (entry) {
+    entry->second++;
+    BcmStats::get()->egressShared();
+    return entry->first.get();
+  }
+  auto newEgress = folly::make_unique<BcmEgress>(hw_);
+  newEgress->program(intf, vrf, addr, mac, port);
+  auto egressPtr = newEgress.get();
+  egresses_.emplace(std::move(key), std::make_pair(std::move(newEgress), 1));
+  return egressPtr;
+}
+
+void BcmHostTable::derefBcmEgress(opennsl_if_t intf, MacAddress mac,
+                                  opennsl_port_t port) noexcept {
+  derefBcmHost(&egresses_, intf, mac, port);
+}
+
+bool BcmHostTable::moveBcmEgress(opennsl_vrf_t vrf, const IPAddress& addr,
+                                 opennsl_if_t intf, MacAddress mac,
+                                 opennsl_port_t oldPort,
+                                 opennsl_port_t newPort) {
+  EgressKey oldKey{intf, mac, oldPort};
+  EgressKey newKey{intf, mac, newPort};
+  auto* entry = egresses_.getIf(oldKey);
+  if (!entry || egresses_.getIf(newKey)) {
+    return false;
+  }
+  auto* egress = entry->first.get();
+  egress->program(intf, vrf, addr, mac, newPort);
+
+  // Key the egress object, and the hosts sharing it, by the new port.  The
+  // reference counts move along with them.
+  auto egressValue = std::move(*entry);
+  egresses_.erase(oldKey);
+  egresses_.emplace(std::move(newKey), std::move(egressValue));
+  for (const auto& hostEntry : hosts_) {
+    auto* host = hostEntry.second.first.get();
+    if (host->sharedEgress_ == egress) {
+      host->port_ = newPort;
+    }
+  }
+  BcmStats::get()->egressMoved();
+  return true;
+}
+
+void BcmHostTable::forgetEgress(opennsl_if_t egress) noexcept {
+  auto iter = std::lower_bound(neighborPrunedEgresses_.begin(),
+                               neighborPrunedEgresses_.end(), egress);
+  if (iter != neighborPrunedEgresses_.end() && *iter == egress) {
+    neighborPrunedEgresses_.erase(iter);
+  }
+}
+
+BcmEcmpEgress* BcmHostTable::incRefOrCreateBcmEcmpEgress(
+    const BcmEcmpEgress::Paths& paths) {
+  auto numGroups = ecmpEgresses_.size();
+  auto egress = incRefOrCreateBcmHost(&ecmpEgresses_, paths);
+  if (ecmpEgresses_.size() == numGroups) {
+    BcmStats::get()->ecmpGroupShared();
+  } else {
+    BcmStats::ecmpGroups(ecmpEgresses_.size());
+    hw_->writableResourceManager()->setEcmpGroups(ecmpEgresses_.size());
+  }
+  return egress;
 }
 
 BcmHost* BcmHostTable::derefBcmHost(
     opennsl_vrf_t vrf, const IPAddress& addr) noexcept {
-  return derefBcmHost(&hosts_, vrf, addr);
+  if (neighborPrunedEgresses_.empty()) {
+    return derefBcmHost(&hosts_, vrf, addr);
+  }
+  auto* entry = hosts_.getIf(Key{vrf, addr});
+  if (!entry) {
+    return nullptr;
+  }
+  auto egress = entry->first->getEgressId();
+  auto host = derefBcmHost(&hosts_, vrf, addr);
+  if (!host) {
+    // The egress ID may be reused once the host is gone
+    forgetEgress(egress);
+  }
+  return host;
 }
 
 BcmEcmpHost* BcmHostTable::derefBcmEcmpHost(
-    opennsl_vrf_t vrf, const RouteForwardNexthops& fwd) noexcept {
+    opennsl_vrf_t vrf, const InternedForwardNexthops& fwd) noexcept {
   return derefBcmHost(&ecmpHosts_, vrf, fwd);
 }
 
+BcmEcmpEgress* BcmHostTable::derefBcmEcmpEgress(
+    const BcmEcmpEgress::Paths& paths) noexcept {
+  auto egress = derefBcmHost(&ecmpEgresses_, paths);
+  if (!egress) {
+    BcmStats::ecmpGroups(ecmpEgresses_.size());
+    hw_->writableResourceManager()->setEcmpGroups(ecmpEgresses_.size());
+  }
+  return egress;
+}
+
+uint32_t BcmHostTable::getNumRoutes(
+    opennsl_vrf_t vrf, const InternedForwardNexthops& fwd) const {
+  auto iter = ecmpHosts_.find(EcmpKey{vrf, fwd});
+  return iter == ecmpHosts_.end() ? 0 : iter->second.second;
+}
+
+bool BcmHostTable::moveBcmEcmpHost(opennsl_vrf_t vrf,
+                                   const InternedForwardNexthops& oldFwd,
+                                   const InternedForwardNexthops& newFwd) {
+  if (oldFwd->size() < 2 || newFwd->size() < 2 ||
+      getBcmEcmpHostIf(vrf, newFwd)) {
+    return false;
+  }
+  EcmpKey oldKey{vrf, oldFwd};
+  auto* entry = ecmpHosts_.getIf(oldKey);
+  if (!entry) {
+    return false;
+  }
+  auto* egress = entry->first->egress_;
+  CHECK(egress);
+  auto oldPaths = egress->getPaths();
+  auto* egressEntry = ecmpEgresses_.getIf(oldPaths);
+  CHECK(egressEntry);
+  if (egressEntry->second != 1) {
+    // Other ECMP hosts resolve to the same group
+    return false;
+  }
+  // If all of the new hosts exist already, another ECMP host may have the
+  // group the new paths need.  New hosts, and hosts that share their
+  // egress object, get new egress IDs, which no group has yet.
+  BcmEcmpEgress::Paths newPaths;
+  for (const auto& nhop : *newFwd) {
+    auto host = getBcmHostIf(vrf, nhop.nexthop);
+    if (!host || !host->isProgrammed() || host->sharedEgress_) {
+      newPaths.clear();
+      break;
+    }
+    newPaths.push_back(host->getEgressId());
+  }
+  std::sort(newPaths.begin(), newPaths.end());
+  if (!newPaths.empty() && ecmpEgresses_.getIf(newPaths)) {
+    return false;
+  }
+
+  entry->first->moveNexthops(newFwd);
+
+  // Key both entries by their new nexthops and paths.  The reference
+  // counts, one for each route, move along with them.
+  auto egressValue = std::move(*egressEntry);
+  ecmpEgresses_.erase(oldPaths);
+  ecmpEgresses_.emplace(egress->getPaths(), std::move(egressValue));
+  auto hostValue = std::move(*entry);
+  ecmpHosts_.erase(oldKey);
+  ecmpHosts_.emplace(EcmpKey{vrf, newFwd}, std::move(hostValue));
+  return true;
+}
+
+void BcmHostTable::publishNexthopGroupStats() const {
+  uint32_t maxRoutes = 0;
+  for (const auto& entry : ecmpHosts_) {
+    maxRoutes = std::max(maxRoutes, entry.second.second);
+  }
+  BcmStats::nexthopGroups(ecmpHosts_.size(), maxRoutes);
+}
+
+size_t BcmHostTable::linkDown(opennsl_port_t port) {
+  BcmEcmpEgress::Paths egresses;
+  for (const auto& entry : hosts_) {
+    const auto& host = entry.second.first;
+    // Shared egress objects are in no ECMP group
+    if (host->getPort() == port && !host->sharedEgress_ &&
+        host->getEgressId() != BcmEgressBase::INVALID) {
+      egresses.push_back(host->getEgressId());
+    }
+  }
+  if (egresses.empty()) {
+    return 0;
+  }
+  std::sort(egresses.begin(), egresses.end());
+  size_t pruned = 0;
+  for (const auto& entry : ecmpEgresses_) {
+    pruned += entry.second.first->prunePaths(egresses);
+  }
+  auto& portEgresses = prunedEgresses_[port];
+  BcmEcmpEgress::Paths merged;
+  std::set_union(portEgresses.begin(), portEgresses.end(),
+                 egresses.begin(), egresses.end(),
+                 std::back_inserter(merged));
+  portEgresses.swap(merged);
+  return pruned;
+}
+
+size_t BcmHostTable::linkUp(opennsl_port_t port) {
+  auto iter = prunedEgresses_.find(port);
+  if (iter == prunedEgresses_.end()) {
+    return 0;
+  }
+  // The egress objects of neighbors that are still gone stay pruned
+  BcmEcmpEgress::Paths egresses;
+  std::set_difference(iter->second.begin(), iter->second.end(),
+                      neighborPrunedEgresses_.begin(),
+                      neighborPrunedEgresses_.end(),
+                      std::back_inserter(egresses));
+  prunedEgresses_.erase(iter);
+  size_t restored = 0;
+  for (const auto& entry : ecmpEgresses_) {
+    restored += entry.second.first->restorePaths(egresses);
+  }
+  return restored;
+}
+
+bool BcmHostTable::isLinkPruned(opennsl_if_t egress) const {
+  for (const auto& entry : prunedEgresses_) {
+    if (std::binary_search(entry.second.begin(), entry.second.end(),
+                           egress)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t BcmHostTable::neighborDown(const BcmHost* host) {
+  auto egress = host->getEgressId();
+  if (egress == BcmEgressBase::INVALID || host->sharedEgress_) {
+    return 0;
+  }
+  auto iter = std::lower_bound(neighborPrunedEgresses_.begin(),
+                               neighborPrunedEgresses_.end(), egress);
+  if (iter != neighborPrunedEgresses_.end() && *iter == egress) {
+    return 0;
+  }
+  neighborPrunedEgresses_.insert(iter, egress);
+  BcmEcmpEgress::Paths egresses{egress};
+  size_t pruned = 0;
+  for (const auto& entry : ecmpEgresses_) {
+    pruned += entry.second.first->prunePaths(egresses);
+  }
+  return pruned;
+}
+
+size_t BcmHostTable::neighborUp(const BcmHost* host) {
+  auto egress = host->getEgressId();
+  auto iter = std::lower_bound(neighborPrunedEgresses_.begin(),
+                               neighborPrunedEgresses_.end(), egress);
+  if (iter == neighborPrunedEgresses_.end() || *iter != egress) {
+    return 0;
+  }
+  neighborPrunedEgresses_.erase(iter);
+  if (isLinkPruned(egress)) {
+    // linkUp() restores it once the port is back up
+    return 0;
+  }
+  BcmEcmpEgress::Paths egresses{egress};
+  size_t restored = 0;
+  for (const auto& entry : ecmpEgresses_) {
+    restored += entry.second.first->restorePaths(egresses);
+  }
+  return restored;
+}
+
 }}
@@ -20,8 +20,11 @@ extern "C" {
 #include "fboss/agent/hw/bcm/BcmEgress.h"
 #include "fboss/agent/state/RouteForwardInfo.h"
 #include "fboss/agent/state/NeighborEntry.h"
+#include "fboss/agent/state/OpenHashMap.h"
 
-#include <boost/container/flat_map.hpp>
+#include <folly/Hash.h>
+#include <map>
+#include <tuple>
 
 namespace facebook { namespace fboss {
 
@@ -48,17 +51,46 @@ class BcmHost {
     return program(intf, nullptr, 0, DROP);
   }
   opennsl_if_t getEgressId() const;
+  /*
+   * The port the host forwards to, or 0 if it punts to the CPU or drops.
+   */
+  opennsl_port_t getPort() const {
+    return port_;
+  }
+  /*
+   * Write the host's HW entry over what the HW has for it, after it was
+   * found to be different.
+   */
+  void rewriteHwEntry();
+  /*
+   * Count the routes and ECMP groups using the host as a nexthop.  They
+   * point at the host's egress ID, which must not change under them, so
+   * while there are any the host has an egress object of its own, which
+   * is reprogrammed in place.  Otherwise a resolved host shares the egress
+   * object of the other hosts with the same MAC, interface and port.
+   */
+  void incNexthopRefs();
+  void decNexthopRefs() noexcept;
  private:
   // no copy or assignment
   BcmHost(BcmHost const &) = delete;
   BcmHost& operator=(BcmHost const &) = delete;
+
+  friend class BcmHostTable;
   void program(opennsl_if_t intf, const folly::MacAddress *mac,
                opennsl_port_t port, RouteForwardAction action);
   void initHostCommon(opennsl_l3_host_t *host) const;
   const BcmSwitch* hw_;
   opennsl_vrf_t vrf_;
   folly::IPAddress addr_;
+  // The egress object of the host if it punts, drops or is a nexthop
   std::unique_ptr<BcmEgress> egress_;
+  // Otherwise, the egress object it shares in the BcmHostTable
+  BcmEgress* sharedEgress_{nullptr};
+  opennsl_if_t intf_{BcmEgressBase::INVALID};
+  folly::MacAddress mac_;
+  opennsl_port_t port_{0};
+  uint32_t nexthopRefs_{0};
   bool added_{false}; // if added to the HW host(ARP) table or not
 };
 
@@ -66,30 +98,55 @@ class BcmHost {
  * Class to abstract ECMP path
  *
  * Unlike BcmHost, BcmEcmpHost does not have its own HW programming. It is
- * a SW class which refers to one or multiple BcmHost objects, and a unique
- * pointer to BcmEcmpEgress object if there are more than one path.
+ * a SW class which refers to one or multiple BcmHost objects, and to a
+ * BcmEcmpEgress object if there are more than one path.
+ *
+ * BcmEcmpHost is the nexthop group of the routes: all of the routes with
+ * the same nexthops share one, and point to its egress ID.
  */
 class BcmEcmpHost {
  public:
   BcmEcmpHost(const BcmSwitch* hw, opennsl_vrf_t vrf,
-              const RouteForwardNexthops& fwd);
+              const InternedForwardNexthops& fwd);
   virtual ~BcmEcmpHost();
   opennsl_if_t getEgressId() const {
     return egressId_;
   }
+  const InternedForwardNexthops& getNexthops() const {
+    return fwd_;
+  }
  private:
+  // no copy or assignment
+  BcmEcmpHost(BcmEcmpHost const &) = delete;
+  BcmEcmpHost& operator=(BcmEcmpHost const &) = delete;
+
+  friend class BcmHostTable;
+  /*
+   * Change the nexthops in place, by changing the members of the ECMP
+   * egress object, which keeps its ID.  Both the old and new nexthops must
+   * have more than one path.  Only BcmHostTable::moveBcmEcmpHost() may call
+   * this, since the ECMP host and egress are keyed by their nexthops.
+   */
+  void moveNexthops(const InternedForwardNexthops& fwd);
+  // Take a reference on the BcmHost of each nexthop, creating them as
+  // needed, and return their egress IDs
+  BcmEcmpEgress::Paths refHosts(const InternedForwardNexthops& fwd);
+  void derefHost(const folly::IPAddress& addr) noexcept;
+  void derefHosts(const InternedForwardNexthops& fwd) noexcept;
+
   const BcmSwitch* hw_;
   opennsl_vrf_t vrf_;
   /**
-   * Unique pointer to the BcmEcmpEgress object
+   * Pointer to the BcmEcmpEgress object
    *
    * If there is only one entry in 'fwd', there is no need to create a ECMP
    * egress object that just contains one egress object. This pointer
    * is nullptr.
    * If there are more than one entry in 'fwd', 'egress_' points to the
-   * BcmEcmpEgress object created.
+   * BcmEcmpEgress object in the BcmHostTable, which may be shared with other
+   * BcmEcmpHost objects that resolve to the same egress objects.
    */
-  std::unique_ptr<BcmEcmpEgress> egress_;
+  BcmEcmpEgress* egress_{nullptr};
   /**
    * The egress ID for this ECMP host
    *
@@ -99,7 +156,7 @@ class BcmEcmpHost {
    * from this ECMP egress object.
    */
   opennsl_if_t egressId_{BcmEgressBase::INVALID};
-  RouteForwardNexthops fwd_;
+  InternedForwardNexthops fwd_;
 };
 
 class BcmHostTable {
@@ -109,12 +166,12 @@ class BcmHostTable {
   // throw an exception if not found
   BcmHost* getBcmHost(opennsl_vrf_t vrf, const folly::IPAddress& addr) const;
   BcmEcmpHost* getBcmEcmpHost(
-      opennsl_vrf_t vrf, const RouteForwardNexthops& fwd) const;
+      opennsl_vrf_t vrf, const InternedForwardNexthops& fwd) const;
   // return nullptr if not found
   BcmHost* getBcmHostIf(
       opennsl_vrf_t vrf, const folly::IPAddress& addr) const;
   BcmEcmpHost* getBcmEcmpHostIf(
-      opennsl_vrf_t vrf, const RouteForwardNexthops&) const;
+      opennsl_vrf_t vrf, const InternedForwardNexthops&) const;
   /*
    * The following functions will modify the object. They rely on the global
    * HW update lock in BcmSwitch::lock_ for the protection.
@@ -134,7 +191,7 @@ class BcmHostTable {
   BcmHost* incRefOrCreateBcmHost(
       opennsl_vrf_t vrf, const folly::IPAddress& addr);
   BcmEcmpHost* incRefOrCreateBcmEcmpHost(
-      opennsl_vrf_t vrf, const RouteForwardNexthops& fwd);
+      opennsl_vrf_t vrf, const InternedForwardNexthops& fwd);
 
   /**
    * Decrease an existing BcmHost/BcmEcmpHost entry's reference counter by 1.
@@ -149,25 +206,165 @@ class BcmHostTable {
   BcmHost* derefBcmHost(
       opennsl_vrf_t vrf, const folly::IPAddress& addr) noexcept;
   BcmEcmpHost* derefBcmEcmpHost(opennsl_vrf_t vrf,
-                                const RouteForwardNexthops& fwd) noexcept;
+                                const InternedForwardNexthops& fwd) noexcept;
+
+  /**
+   * The ECMP egress objects are reference counted as well, and keyed by
+   * their sorted paths, so ECMP hosts whose nexthops resolve to the same
+   * egress objects share a single group in HW.  The groups must not be
+   * reprogrammed with different paths while they are in the table.
+   */
+  BcmEcmpEgress* incRefOrCreateBcmEcmpEgress(
+      const BcmEcmpEgress::Paths& paths);
+  BcmEcmpEgress* derefBcmEcmpEgress(
+      const BcmEcmpEgress::Paths& paths) noexcept;
+
+  /*
+   * The number of references to the ECMP host for fwd, which is the number
+   * of routes using it as their nexthop group, or 0 if there is none.
+   */
+  uint32_t getNumRoutes(opennsl_vrf_t vrf,
+                        const InternedForwardNexthops& fwd) const;
+
+  /**
+   * Move the ECMP host for oldFwd, along with all of its references, to
+   * newFwd, by changing the members of its ECMP egress object in HW.  The
+   * routes using it keep the same egress ID, so they need no change in HW,
+   * and the time this takes does not depend on how many routes there are.
+   *
+   * This is only possible if both have more than one nexthop, there is no
+   * ECMP host for newFwd yet, and no other ECMP host shares the ECMP egress
+   * object, or would have to share it after the move.  Otherwise this
+   * returns false, without changing anything.
+   */
+  bool moveBcmEcmpHost(opennsl_vrf_t vrf,
+                       const InternedForwardNexthops& oldFwd,
+                       const InternedForwardNexthops& newFwd);
+
+  /*
+   * Publish the number of nexthop groups, and the most routes that any one
+   * of them serves.
+   */
+  void publishNexthopGroupStats() const;
+
+  /*
+   * Fast path for a port going down, ahead of the neighbor entries on it
+   * being removed and the routes re-resolved: remove the egress objects of
+   * the hosts on the port from all ECMP groups in HW.  linkUp() adds back
+   * the ones that were pruned for the port, in the groups that are left.
+   *
+   * Returns the number of ECMP group members removed or added back.
+   */
+  size_t linkDown(opennsl_port_t port);
+  size_t linkUp(opennsl_port_t port);
+
+  /*
+   * Fast path for a neighbor that is gone while ECMP groups still use its
+   * host, which is about to punt to the CPU instead: remove the host's
+   * egress object from all ECMP groups in HW, so the rest of the paths of
+   * each group carry its traffic until the neighbor is resolved again, and
+   * neighborUp() adds it back.  The routes need no change.
+   *
+   * Returns the number of ECMP group members removed or added back.
+   */
+  size_t neighborDown(const BcmHost* host);
+  size_t neighborUp(const BcmHost* host);
  private:
+  friend class BcmHost;
+
+  /*
+   * The egress objects shared by resolved hosts, keyed by the interface,
+   * MAC and port they forward to, and reference counted by host.  The
+   * host's vrf and address are only used to look the egress object up in
+   * the warm boot cache when it is created.
+   */
+  BcmEgress* incRefOrCreateBcmEgress(opennsl_vrf_t vrf,
+                                     const folly::IPAddress& addr,
+                                     opennsl_if_t intf,
+                                     folly::MacAddress mac,
+                                     opennsl_port_t port);
+  void derefBcmEgress(opennsl_if_t intf, folly::MacAddress mac,
+                      opennsl_port_t port) noexcept;
+  /*
+   * Reprogram the shared egress object for a MAC that moved to a new port,
+   * which moves all of the hosts behind the MAC with a single write.  This
+   * is only possible if there is no egress object for the new port yet.
+   * Otherwise this returns false, without changing anything.
+   */
+  bool moveBcmEgress(opennsl_vrf_t vrf, const folly::IPAddress& addr,
+                     opennsl_if_t intf, folly::MacAddress mac,
+                     opennsl_port_t oldPort, opennsl_port_t newPort);
+  // Forget a pruned egress object that is destroyed, as its ID may be reused
+  void forgetEgress(opennsl_if_t egress) noexcept;
+
   const BcmSwitch* hw_;
 
-  template<typename KeyT, typename HostT>
-  using HostMap = boost::container::flat_map<
-    KeyT, std::pair<std::unique_ptr<HostT>, uint32_t>>;
+  // The egress objects that linkDown() pruned from ECMP groups, by port
+  std::map<opennsl_port_t, BcmEcmpEgress::Paths> prunedEgresses_;
+  // The egress objects that neighborDown() pruned from ECMP groups, sorted
+  BcmEcmpEgress::Paths neighborPrunedEgresses_;
+  bool isLinkPruned(opennsl_if_t egress) const;
+
+  /*
+   * The hosts are kept in hash tables, since programming a large FIB
+   * creates thousands of them.  Each host is allocated separately, so
+   * pointers to it stay valid when the table grows.
+   */
+  template<typename KeyT, typename HostT, typename HashT>
+  using HostMap = OpenHashMap<
+    KeyT, std::pair<std::unique_ptr<HostT>, uint32_t>, HashT>;
 
   typedef std::pair<opennsl_vrf_t, folly::IPAddress> Key;
-  HostMap<Key, BcmHost> hosts_;
-  typedef std::pair<opennsl_vrf_t, RouteForwardNexthops> EcmpKey;
-  HostMap<EcmpKey, BcmEcmpHost> ecmpHosts_;
-
-  template<typename KeyT, typename HostT, typename... Args>
-  HostT* incRefOrCreateBcmHost(HostMap<KeyT, HostT>* map, Args... args);
-  template<typename KeyT, typename HostT, typename... Args>
-  HostT* getBcmHostIf(const HostMap<KeyT, HostT> *map, Args... args) const;
-  template<typename KeyT, typename HostT, typename... Args>
-  HostT* derefBcmHost(HostMap<KeyT, HostT>* map, Args... args) noexcept;
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return folly::hash::hash_combine(key.first, key.second.hash());
+    }
+  };
+
+  // The hosts point at the shared egress objects in HW, so egresses_ must
+  // be declared before hosts_, and destroyed after them.
+  typedef std::tuple<opennsl_if_t, folly::MacAddress, opennsl_port_t>
+    EgressKey;
+  struct EgressKeyHash {
+    size_t operator()(const EgressKey& key) const {
+      return folly::hash::hash_combine(std::get<0>(key),
+                                       std::get<1>(key).u64HBO(),
+                                       std::get<2>(key));
+    }
+  };
+  HostMap<EgressKey, BcmEgress, EgressKeyHash> egresses_;
+
+  HostMap<Key, BcmHost, KeyHash> hosts_;
+
+  // ECMP hosts release their hosts and groups when they are destroyed, so
+  // ecmpHosts_ must be declared, and destroyed, after the other maps.
+  typedef BcmEcmpEgress::Paths EcmpEgressKey;
+  struct EcmpEgressKeyHash {
+    size_t operator()(const EcmpEgressKey& key) const {
+      return folly::hash::hash_range(key.begin(), key.end());
+    }
+  };
+  HostMap<EcmpEgressKey, BcmEcmpEgress, EcmpEgressKeyHash> ecmpEgresses_;
+
+  // The nexthops are interned, so looking up an ECMP host only hashes and
+  // compares the pointer to the shared set.
+  typedef std::pair<opennsl_vrf_t, InternedForwardNexthops> EcmpKey;
+  struct EcmpKeyHash {
+    size_t operator()(const EcmpKey& key) const {
+      return folly::hash::hash_combine(key.first, key.second.hash());
+    }
+  };
+  HostMap<EcmpKey, BcmEcmpHost, EcmpKeyHash> ecmpHosts_;
+
+  template<typename KeyT, typename HostT, typename HashT, typename... Args>
+  HostT* incRefOrCreateBcmHost(HostMap<KeyT, HostT, HashT>* map,
+                               Args... args);
+  template<typename KeyT, typename HostT, typename HashT, typename... Args>
+  HostT* getBcmHostIf(const HostMap<KeyT, HostT, HashT>* map,
+                      Args... args) const;
+  template<typename KeyT, typename HostT, typename HashT, typename... Args>
+  HostT* derefBcmHost(HostMap<KeyT, HostT, HashT>* map,
+                      Args... args) noexcept;
 };
 
 }}
@@ -17,6 +17,7 @@ extern "C" {
 #include "fboss/agent/hw/bcm/BcmError.h"
 #include "fboss/agent/hw/bcm/BcmSwitch.h"
 #include "fboss/agent/hw/bcm/BcmHost.h"
+#include "fboss/agent/hw/bcm/BcmSdkCall.h"
 #include "fboss/agent/hw/bcm/BcmWarmBootCache.h"
 #include "fboss/agent/hw/bcm/Utils.h"
 #include "fboss/agent/state/Interface.h"
@@ -36,6 +37,9 @@ class BcmStation {
   explicit BcmStation(const BcmSwitch* hw) : hw_(hw) {}
   ~BcmStation();
   void program(MacAddress mac, int id);
+  int getID() const {
+    return id_;
+  }
  private:
   // no copy or assignment
   BcmStation(BcmStation const &) = delete;
@@ -51,7 +55,8 @@ BcmStation::~BcmStation() {
   if (id_ == INVALID) {
     return;
   }
-  auto rc = opennsl_l2_station_delete(hw_->getUnit(), id_);
+  auto rc = bcmSdkCall(BcmSdkApi::L2_STATION_DELETE, opennsl_l2_station_delete,
+                       hw_->getUnit(), id_);
   bcmLogFatal(rc, hw_, "failed to delete station entry ", id_);
   VLOG(3) << "deleted station entry " << id_;
 }
@@ -84,11 +89,14 @@ void BcmStation::program(MacAddress mac, int id) {
     if (!equivalent(params, existingStation)) {
       // Delete old station end and set addStation to true
       VLOG (1) << "Updating BCM station with Mac : " << mac <<" and " << id;
-      rc = opennsl_l2_station_delete(hw_->getUnit(), id);
+      rc = bcmSdkCall(BcmSdkApi::L2_STATION_DELETE, opennsl_l2_station_delete,
+                      hw_->getUnit(), id);
       bcmCheckError(rc, "failed to delete station entry ", id);
       addStation = true;
+      warmBootCache->reprogrammed();
     } else {
       VLOG(1) << " station entry " << id << " already exists ";
+      id_ = id;
     }
 
   } else {
@@ -99,7 +107,8 @@ void BcmStation::program(MacAddress mac, int id) {
     if (vlanStationItr != warmBootCache->vlan2Station_end()) {
       VLOG (1) << "Adding BCM station with Mac : " << mac <<" and " << id;
     }
-    rc = opennsl_l2_station_add(hw_->getUnit(), &id, &params);
+    rc = bcmSdkCall(BcmSdkApi::L2_STATION_ADD, opennsl_l2_station_add,
+                    hw_->getUnit(), &id, &params);
     bcmCheckError(rc, "failed to program station entry ", id,
         " to ", mac.toString());
     id_ = id;
@@ -127,16 +136,6 @@ void BcmIntf::program(const shared_ptr<Interface>& intf) {
     }
   }
 
-  // create or update a station entry
-  if (station_ == nullptr) {
-    station_ = unique_ptr<BcmStation>(new BcmStation(hw_));
-  }
-  if (oldIntf == nullptr || oldIntf->getMac() != intf->getMac()) {
-    // Program BCM station to have the same ID as interface
-    // so we can look them up during warm boot
-    station_->program(intf->getMac(), intf->getID());
-  }
-
   const auto vrf = BcmSwitch::getBcmVrfId(intf->getRouterID());
   // create the interface if needed
   if (bcmIfId_ == INVALID) {
@@ -178,6 +177,7 @@ void BcmIntf::program(const shared_ptr<Interface>& intf) {
         // but with the above flags set this will cause the entry to be
         // updated.
         addInterface = true;
+        warmBootCache->reprogrammed();
       } else {
         VLOG(1) << "Interface for vlan " << intf->getVlanID()
               << " and mac " << intf->getMac() <<" already exists";
@@ -191,7 +191,8 @@ void BcmIntf::program(const shared_ptr<Interface>& intf) {
         VLOG(1) << "Adding interface for vlan : " << intf->getVlanID()
           << " and mac: " << intf->getMac();
       }
-      auto rc = opennsl_l3_intf_create(hw_->getUnit(), &ifParams);
+      auto rc = bcmSdkCall(BcmSdkApi::L3_INTF_CREATE, opennsl_l3_intf_create,
+                           hw_->getUnit(), &ifParams);
       bcmCheckError(rc, "failed to create L3 interface ", intf->getID());
       bcmIfId_ = ifParams.l3a_intf_id;
     }
@@ -277,7 +278,8 @@ BcmIntf::~BcmIntf() {
   opennsl_l3_intf_t_init(&ifParams);
   ifParams.l3a_intf_id = bcmIfId_;
   ifParams.l3a_flags |= OPENNSL_L3_WITH_ID;
-  auto rc = opennsl_l3_intf_delete(hw_->getUnit(), &ifParams);
+  auto rc = bcmSdkCall(BcmSdkApi::L3_INTF_DELETE, opennsl_l3_intf_delete,
+                       hw_->getUnit(), &ifParams);
   bcmLogFatal(rc, hw_, "failed to delete L3 interface ", bcmIfId_);
   VLOG(3) << "deleted L3 interface " << bcmIfId_;
 }
@@ -327,6 +329,7 @@ void BcmIntfTable::addIntf(const shared_ptr<Interface>& intf) {
   if (!ret.second) {
     throw FbossError("Adding an existing interface ", intf->getID());
   }
+  refStation(intf->getID(), intf->getMac());
   intfPtr->program(intf);
   auto ret2 = bcmIntfs_.insert(make_pair(intfPtr->getBcmIfId(), intfPtr));
   CHECK_EQ(ret2.second, true);
@@ -334,7 +337,14 @@ void BcmIntfTable::addIntf(const shared_ptr<Interface>& intf) {
 
 void BcmIntfTable::programIntf(const shared_ptr<Interface>& intf) {
   auto intfPtr = getBcmIntf(intf->getID());
+  auto oldMac = intfPtr->getInterface()->getMac();
   intfPtr->program(intf);
+  if (oldMac != intf->getMac()) {
+    // Release the old station first, so its ID is free if no other
+    // interface has the old MAC
+    derefStation(intf->getID(), oldMac);
+    refStation(intf->getID(), intf->getMac());
+  }
 }
 
 void BcmIntfTable::deleteIntf(const std::shared_ptr<Interface>& intf) {
@@ -343,9 +353,74 @@ void BcmIntfTable::deleteIntf(const std::shared_ptr<Interface>& intf) {
     throw FbossError("Failed to delete a non-existing interface ",
                      intf->getID());
   }
+  auto mac = iter->second->getInterface()->getMac();
   auto bcmIfId = iter->second->getBcmIfId();
   intfs_.erase(iter);
   bcmIntfs_.erase(bcmIfId);
+  derefStation(intf->getID(), mac);
+}
+
+void BcmIntfTable::refStation(InterfaceID id, MacAddress mac) {
+  auto iter = stations_.find(mac);
+  if (iter == stations_.end()) {
+    auto station = unique_ptr<BcmStation>(new BcmStation(hw_));
+    station->program(mac, getFreeStationId(id, mac));
+    iter = stations_.emplace(mac, Station()).first;
+    iter->second.station = std::move(station);
+  }
+  iter->second.intfs.insert(id);
+}
+
+void BcmIntfTable::derefStation(InterfaceID id, MacAddress mac) {
+  auto iter = stations_.find(mac);
+  CHECK(iter != stations_.end());
+  auto& station = iter->second;
+  station.intfs.erase(id);
+  if (station.intfs.empty()) {
+    stations_.erase(iter);
+    return;
+  }
+  if (station.station->getID() != static_cast<int>(id) ||
+      intfs_.count(id)) {
+    return;
+  }
+  // The station has the ID of an interface that is gone, where the warm
+  // boot cache would not look for it, so move it to the ID of another one.
+  // The new entry is added before the old one is deleted, so the MAC stays
+  // routed.
+  auto newStation = unique_ptr<BcmStation>(new BcmStation(hw_));
+  newStation->program(mac, getFreeStationId(*station.intfs.begin(), mac));
+  station.station = std::move(newStation);
+  VLOG(1) << "moved station entry for " << mac << " from " << id << " to "
+          << station.station->getID();
+}
+
+int BcmIntfTable::getFreeStationId(InterfaceID id, MacAddress mac) const {
+  boost::container::flat_set<int> used;
+  for (const auto& entry : stations_) {
+    used.insert(entry.second.station->getID());
+  }
+  auto isFree = [&](int stationId) {
+    return !used.count(stationId) && intfs_.count(InterfaceID(stationId));
+  };
+  // Reuse a station the previous run left for the MAC, if it has a free ID
+  const auto warmBootCache = hw_->getWarmBootCache();
+  for (auto iter = warmBootCache->vlan2Station_beg();
+       iter != warmBootCache->vlan2Station_end(); ++iter) {
+    if (macFromBcm(iter->second.dst_mac) == mac && isFree(iter->first)) {
+      return iter->first;
+    }
+  }
+  if (isFree(id)) {
+    return id;
+  }
+  // Each station has at least one interface, so there is always a free ID
+  for (const auto& entry : intfs_) {
+    if (isFree(entry.first)) {
+      return entry.first;
+    }
+  }
+  throw FbossError("No free station ID for ", mac);
 }
 
 }} // namespace facebook::fboss
@@ -15,9 +15,11 @@ extern "C" {
 }
 
 #include <folly/IPAddress.h>
+#include <folly/MacAddress.h>
 #include "fboss/agent/types.h"
 
 #include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 #include <set>
 
 namespace facebook { namespace fboss {
@@ -52,11 +54,6 @@ class BcmIntf {
   const BcmSwitch *hw_;
   std::shared_ptr<Interface> intf_;
   opennsl_if_t bcmIfId_{INVALID};
-  // TODO: we now generate one station entry per interface, even if all
-  //       interfaces are sharing the same MAC. We can save some station
-  //       entries by just generate one per different MAC. But with
-  //       the small number of interfaces we have, no gain for that now.
-  std::unique_ptr<BcmStation> station_;
   // The interface addresses that have BcmHost object created
   std::set<folly::IPAddress> hosts_;
 };
@@ -80,12 +77,33 @@ class BcmIntfTable {
   void programIntf(const std::shared_ptr<Interface>& intf);
   void deleteIntf(const std::shared_ptr<Interface>& intf);
  private:
+  /*
+   * The interfaces with the same MAC share one station entry, which enables
+   * L3 processing for the MAC.  All of the entries match the whole MAC, so
+   * they are keyed by the MAC alone.
+   *
+   * Each entry has the ID of one of the interfaces, as the warm boot cache
+   * looks the entries up by the VLAN IDs of the L3 interfaces, which are
+   * the same.
+   */
+  void refStation(InterfaceID id, folly::MacAddress mac);
+  void derefStation(InterfaceID id, folly::MacAddress mac);
+  // An interface ID no station entry has, preferring id
+  int getFreeStationId(InterfaceID id, folly::MacAddress mac) const;
+
+  struct Station {
+    std::unique_ptr<BcmStation> station;
+    // The interfaces using the station entry
+    boost::container::flat_set<InterfaceID> intfs;
+  };
+
   const BcmSwitch* hw_;
   // There are two mapping tables with different index types.
   // Both are mapped to the BcmIntf. The BcmIntf object's life is
   // controlled by table with InterfaceID as the index (intfs_).
   boost::container::flat_map<InterfaceID, std::unique_ptr<BcmIntf>> intfs_;
   boost::container::flat_map<opennsl_if_t, BcmIntf *> bcmIntfs_;
+  boost::container::flat_map<folly::MacAddress, Station> stations_;
 };
 
 }} // namespace facebook::fboss
@@ -0,0 +1,296 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmMultiSwitch.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/Utils.h"
+#include "fboss/agent/hw/bcm/BcmPortTable.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
+#include "fboss/agent/hw/bcm/BcmSwitch.h"
+#include "fboss/agent/hw/bcm/BcmUnit.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+
+#include <folly/Conv.h>
+#include <folly/ExceptionString.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+
+using std::make_shared;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+BcmMultiSwitch::BcmMultiSwitch(BcmPlatform* platform,
+                               std::vector<unique_ptr<BcmUnit>> units) {
+  if (units.empty()) {
+    throw FbossError("BcmMultiSwitch needs at least one BCM unit");
+  }
+  for (auto& unit : units) {
+    units_.push_back(
+        std::unique_ptr<BcmSwitch>(new BcmSwitch(platform, std::move(unit))));
+  }
+}
+
+BcmMultiSwitch::~BcmMultiSwitch() {
+}
+
+template<typename Fn>
+void BcmMultiSwitch::forEachUnit(Fn fn) {
+  runInParallel(units_.size(), units_.size(),
+                [&] (size_t i) { fn(i, units_[i].get()); });
+}
+
+BcmSwitch* BcmMultiSwitch::getPortOwner(PortID port) const {
+  for (const auto& unit : units_) {
+    if (unit->getPortTable()->hasPort(port)) {
+      return unit.get();
+    }
+  }
+  return nullptr;
+}
+
+std::pair<shared_ptr<SwitchState>, BootType>
+BcmMultiSwitch::init(Callback* callback) {
+  // The SDK wants its units attached from the main thread, so the units are
+  // initialized one after the other.  This only happens once.
+  BootType bootType = BootType::UNINITIALIZED;
+  for (auto& unit : units_) {
+    auto unitBoot = unit->init(callback);
+    if (bootType == BootType::UNINITIALIZED) {
+      bootType = unitBoot.second;
+    } else if (unitBoot.second != bootType) {
+      throw FbossError("BCM unit ", unit->getUnit(),
+                       " did not boot the same way as unit ",
+                       units_[0]->getUnit());
+    }
+  }
+
+  // Each unit numbers its BCM ports from the start, so the boot state is
+  // built from the FBOSS port IDs the platform gave each unit instead.
+  auto bootState = make_shared<SwitchState>();
+  auto vlan = make_shared<Vlan>(VlanID(1), "InitVlan");
+  Vlan::MemberPorts memberPorts;
+  for (const auto& unit : units_) {
+    for (auto port : unit->getPortTable()->getPortIds()) {
+      bootState->registerPort(port, folly::to<std::string>("port", port));
+      memberPorts.insert(std::make_pair(port, false));
+    }
+  }
+  vlan->setPorts(memberPorts);
+  bootState->addVlan(vlan);
+  return std::make_pair(bootState, bootType);
+}
+
+void BcmMultiSwitch::stateChanged(const StateDelta& delta) {
+  // Every unit has its own lock and tables, so they can all be programmed
+  // at once.
+  std::vector<std::exception_ptr> errors(units_.size());
+  forEachUnit([&] (size_t i, BcmSwitch* unit) {
+    auto start = steady_clock::now();
+    try {
+      unit->stateChanged(delta);
+    } catch (...) {
+      errors[i] = std::current_exception();
+      return;
+    }
+    auto msec = duration_cast<milliseconds>(steady_clock::now() - start);
+    BcmStats::unitStateUpdateTime(unit->getUnit(), msec.count());
+  });
+
+  std::exception_ptr rolledBack;
+  for (const auto& error : errors) {
+    if (!error) {
+      continue;
+    }
+    try {
+      std::rethrow_exception(error);
+    } catch (const FbossHwRolledBackError&) {
+      rolledBack = error;
+    } catch (...) {
+      // Some unit is left half way, so the update cannot be rolled back
+      throw;
+    }
+  }
+  if (!rolledBack) {
+    return;
+  }
+
+  // The units that failed are back at the old state, so the ones that did
+  // not have to go back to it too.
+  StateDelta reverse(delta.newState(), delta.oldState());
+  try {
+    forEachUnit([&] (size_t i, BcmSwitch* unit) {
+      if (!errors[i]) {
+        unit->stateChanged(reverse);
+      }
+    });
+  } catch (const std::exception& ex) {
+    throw FbossError("failed to roll back the BCM units that applied a "
+                     "state change: ", folly::exceptionStr(ex));
+  }
+  std::rethrow_exception(rolledBack);
+}
+
+unique_ptr<TxPacket> BcmMultiSwitch::allocatePacket(uint32_t size) {
+  return units_[0]->allocatePacket(size);
+}
+
+bool BcmMultiSwitch::sendPacketSwitched(unique_ptr<TxPacket> pkt) noexcept {
+  return units_[0]->sendPacketSwitched(std::move(pkt));
+}
+
+bool BcmMultiSwitch::sendPacketOutOfPort(unique_ptr<TxPacket> pkt,
+                                         PortID portID) noexcept {
+  auto owner = getPortOwner(portID);
+  if (!owner) {
+    LOG(ERROR) << "no BCM unit has port " << portID;
+    return false;
+  }
+  if (owner == units_[0].get()) {
+    return owner->sendPacketOutOfPort(std::move(pkt), portID);
+  }
+  // Packets are allocated from the first unit's buffers, but have to be
+  // sent from the buffers of the unit they leave through.
+  unique_ptr<TxPacket> ownerPkt;
+  try {
+    auto length = pkt->buf()->length();
+    ownerPkt = owner->allocatePacket(length);
+    memcpy(ownerPkt->buf()->writableData(), pkt->buf()->data(), length);
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "failed to copy packet to BCM unit " << owner->getUnit()
+               << ": " << folly::exceptionStr(ex);
+    return false;
+  }
+  return owner->sendPacketOutOfPort(std::move(ownerPkt), portID);
+}
+
+size_t BcmMultiSwitch::sendPacketsSwitched(
+    std::vector<unique_ptr<TxPacket>> pkts) noexcept {
+  return units_[0]->sendPacketsSwitched(std::move(pkts));
+}
+
+void BcmMultiSwitch::updateStats(SwitchStats* switchStats) {
+  // The stats are thread-local, so this stays on the calling thread.
+  for (auto& unit : units_) {
+    unit->updateStats(switchStats);
+  }
+}
+
+void BcmMultiSwitch::gracefulExit() {
+  forEachUnit([] (size_t, BcmSwitch* unit) { unit->gracefulExit(); });
+}
+
+void BcmMultiSwitch::initialConfigApplied() {
+  for (auto& unit : units_) {
+    unit->initialConfigApplied();
+  }
+}
+
+void BcmMultiSwitch::clearWarmBootCache() {
+  for (auto& unit : units_) {
+    unit->clearWarmBootCache();
+  }
+}
+
+void BcmMultiSwitch::exitFatal() const {
+  for (const auto& unit : units_) {
+    unit->exitFatal();
+  }
+}
+
+bool BcmMultiSwitch::isPortUp(PortID port) const {
+  auto owner = getPortOwner(port);
+  return owner && owner->isPortUp(port);
+}
+
+bool BcmMultiSwitch::getPortCounters(PortID port,
+                                     PortCounters* counters) const {
+  auto owner = getPortOwner(port);
+  return owner && owner->getPortCounters(port, counters);
+}
+
+bool BcmMultiSwitch::getAndClearNeighborHits(NeighborHits* hits) {
+  // A neighbor is programmed on every unit, and hit on whichever ones its
+  // traffic came in through.
+  bool tracked = false;
+  NeighborHits allHits;
+  for (auto& unit : units_) {
+    tracked |= unit->getAndClearNeighborHits(&allHits);
+  }
+  std::sort(allHits.begin(), allHits.end());
+  allHits.erase(std::unique(allHits.begin(), allHits.end()), allHits.end());
+  hits->insert(hits->end(), allHits.begin(), allHits.end());
+  return tracked;
+}
+
+bool BcmMultiSwitch::setNeighborReachable(RouterID router,
+                                          const folly::IPAddress& ip,
+                                          bool reachable) {
+  bool changed = false;
+  for (auto& unit : units_) {
+    changed |= unit->setNeighborReachable(router, ip, reachable);
+  }
+  return changed;
+}
+
+bool BcmMultiSwitch::getWarmBootReconciliation(
+    WarmBootReconciliation* status) {
+  bool found = false;
+  WarmBootReconciliation total;
+  total.cleanupStarted = true;
+  for (auto& unit : units_) {
+    WarmBootReconciliation unitStatus;
+    if (!unit->getWarmBootReconciliation(&unitStatus)) {
+      continue;
+    }
+    found = true;
+    total.reused += unitStatus.reused;
+    total.reprogrammed += unitStatus.reprogrammed;
+    total.deleted += unitStatus.deleted;
+    total.remaining += unitStatus.remaining;
+    total.cleanupStarted &= unitStatus.cleanupStarted;
+  }
+  if (found) {
+    *status = total;
+  }
+  return found;
+}
+
+bool BcmMultiSwitch::estimateStateChange(
+    const StateDelta& delta, HwOperationEstimate* estimate) const {
+  // The units are programmed in parallel, so the update takes as long as
+  // the busiest unit.
+  bool known = false;
+  for (const auto& unit : units_) {
+    HwOperationEstimate unitEstimate;
+    if (!unit->estimateStateChange(delta, &unitEstimate)) {
+      continue;
+    }
+    known = true;
+    estimate->ports = std::max(estimate->ports, unitEstimate.ports);
+    estimate->vlans = std::max(estimate->vlans, unitEstimate.vlans);
+    estimate->interfaces = std::max(estimate->interfaces,
+                                    unitEstimate.interfaces);
+    estimate->hosts = std::max(estimate->hosts, unitEstimate.hosts);
+    estimate->routes = std::max(estimate->routes, unitEstimate.routes);
+  }
+  return known;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/types.h"
+
+#include <memory>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class BcmPlatform;
+class BcmSwitch;
+class BcmUnit;
+
+/*
+ * BcmMultiSwitch is a HwSwitch for systems with several Broadcom ASICs.
+ *
+ * Each unit gets a BcmSwitch of its own, with its own lock, tables, warm
+ * boot cache and ports, and every StateDelta is applied to all of the
+ * units at once, one thread per unit.  So applying a change takes as long
+ * as on the slowest unit rather than the sum of them all.
+ *
+ * Each BcmSwitch only programs the ports the platform gave it (see
+ * BcmPlatform::initUnitPorts()), and everything else in the state (VLANs,
+ * interfaces, neighbors and routes) on all of them.  Packets are sent
+ * through the unit that owns their port, or the first unit when the
+ * hardware switches them.
+ */
+class BcmMultiSwitch : public HwSwitch {
+ public:
+  /*
+   * The units should come from BcmAPI::initAllUnits().
+   */
+  BcmMultiSwitch(BcmPlatform* platform,
+                 std::vector<std::unique_ptr<BcmUnit>> units);
+  ~BcmMultiSwitch() override;
+
+  std::pair<std::shared_ptr<SwitchState>, BootType>
+    init(Callback* callback) override;
+  void stateChanged(const StateDelta& delta) override;
+
+  std::unique_ptr<TxPacket> allocatePacket(uint32_t size) override;
+  bool sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept override;
+  bool sendPacketOutOfPort(std::unique_ptr<TxPacket> pkt,
+                           PortID portID) noexcept override;
+  size_t sendPacketsSwitched(
+      std::vector<std::unique_ptr<TxPacket>> pkts) noexcept override;
+
+  void updateStats(SwitchStats* switchStats) override;
+  void gracefulExit() override;
+  void initialConfigApplied() override;
+  void clearWarmBootCache() override;
+  void exitFatal() const override;
+  bool isPortUp(PortID port) const override;
+  bool getAndClearNeighborHits(NeighborHits* hits) override;
+  bool setNeighborReachable(RouterID router, const folly::IPAddress& ip,
+                            bool reachable) override;
+  bool getWarmBootReconciliation(WarmBootReconciliation* status) override;
+  bool estimateStateChange(const StateDelta& delta,
+                           HwOperationEstimate* estimate) const override;
+  bool getPortCounters(PortID port,
+                       PortCounters* counters) const override;
+
+  size_t getNumUnits() const {
+    return units_.size();
+  }
+  BcmSwitch* getUnitSwitch(size_t index) const {
+    return units_[index].get();
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  BcmMultiSwitch(BcmMultiSwitch const &) = delete;
+  BcmMultiSwitch& operator=(BcmMultiSwitch const &) = delete;
+
+  /*
+   * The BcmSwitch of the unit that owns a port, or nullptr if no unit
+   * does.
+   */
+  BcmSwitch* getPortOwner(PortID port) const;
+  /*
+   * Call fn(index, unit) for every unit, each from a thread of its own,
+   * and wait for them all.
+   */
+  template<typename Fn>
+  void forEachUnit(Fn fn);
+
+  std::vector<std::unique_ptr<BcmSwitch>> units_;
+};
+
+}} // facebook::fboss
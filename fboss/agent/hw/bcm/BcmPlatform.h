@@ -46,6 +46,18 @@ class BcmPlatform : public Platform {
    */
   virtual InitPortMap initPorts() = 0;
 
+  /*
+   * initUnitPorts() is initPorts() for platforms with several switch units,
+   * and is called once for each unit.
+   *
+   * Each unit gets only the ports attached to it, and a given PortID must
+   * belong to one unit alone.  The default gives all of the ports to unit
+   * 0, which is all that platforms with a single unit need.
+   */
+  virtual InitPortMap initUnitPorts(int unit) {
+    return unit == 0 ? initPorts() : InitPortMap();
+  }
+
  private:
   // Forbidden copy constructor and assignment operator
   BcmPlatform(BcmPlatform const &) = delete;
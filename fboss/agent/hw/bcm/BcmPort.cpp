@@ -9,30 +9,54 @@
  */
 #include "fboss/agent/hw/bcm/BcmPort.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
 #include "common/stats/MonotonicCounter.h"
 #include "common/stats/ServiceData.h"
 #include <folly/Conv.h>
+#include <folly/String.h>
+#include <gflags/gflags.h>
 
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/PortStats.h"
 #include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/hw/bcm/BcmError.h"
 #include "fboss/agent/hw/bcm/BcmPlatformPort.h"
+#include "fboss/agent/hw/bcm/BcmSdkCall.h"
 #include "fboss/agent/hw/bcm/BcmSwitch.h"
+#include "fboss/agent/state/Port.h"
 
 extern "C" {
+#include <opennsl/cosq.h>
 #include <opennsl/port.h>
 #include <opennsl/stat.h>
+#include <opennsl/switch.h>
 }
 
+DEFINE_int32(port_pkt_length_stats_interval, 10,
+             "How often (in seconds) to read the port packet length "
+             "histograms.  The byte and packet counters are read on every "
+             "stats update.");
+DEFINE_string(port_rate_windows, "10,60,300",
+              "The windows, in seconds and separated by commas, over which "
+              "the byte, packet and discard rates of each port are computed "
+              "at every stats update.  The rates are served by the "
+              "getPortStats thrift call.");
+DECLARE_bool(bcm_buffer_watermarks);
+
 using std::chrono::duration_cast;
 using std::chrono::seconds;
+using std::chrono::steady_clock;
 using std::chrono::system_clock;
 using std::string;
 
 namespace facebook { namespace fboss {
 
+// An upper bound on the queue samples kept between stats updates
+static const size_t kMaxQueueSamples = 10000;
+
 static const std::vector<opennsl_stat_val_t> kInPktLengthStats = {
   snmpOpenNSLReceivedPkts64Octets,
   snmpOpenNSLReceivedPkts65to127Octets,
@@ -58,11 +82,65 @@ static const std::vector<opennsl_stat_val_t> kOutPktLengthStats = {
   snmpOpenNSLTransmittedPkts9217to16383Octets,
 };
 
+// Without PFC, all of a port's traffic is in its last priority group, and
+// the first service pool
+static const int kPriorityGroup = 7;
+static const int kServicePool = 0;
+
+// A buffer limit of the config, and the SDK control that sets it on the
+// port's service pool, priority group or each of its queues
+struct BufferLimit {
+  enum Scope {
+    POOL,
+    PRIORITY_GROUP,
+    QUEUES,
+  };
+  uint32_t Port::BufferConfig::* bytes;
+  opennsl_cosq_control_t control;
+  Scope scope;
+};
+static const BufferLimit kBufferLimits[] = {
+  {&Port::BufferConfig::ingressMinBytes,
+   opennslCosqControlIngressPortPoolMinLimitBytes, BufferLimit::POOL},
+  {&Port::BufferConfig::ingressSharedLimitBytes,
+   opennslCosqControlIngressPortPoolSharedLimitBytes, BufferLimit::POOL},
+  {&Port::BufferConfig::headroomBytes,
+   opennslCosqControlIngressPortPGHeadroomLimitBytes,
+   BufferLimit::PRIORITY_GROUP},
+  {&Port::BufferConfig::egressMinBytes,
+   opennslCosqControlEgressUCQueueMinLimitBytes, BufferLimit::QUEUES},
+  {&Port::BufferConfig::egressSharedLimitBytes,
+   opennslCosqControlEgressUCQueueSharedLimitBytes, BufferLimit::QUEUES},
+};
+
+static std::vector<seconds> getRateWindowsFromFlags() {
+  std::vector<folly::StringPiece> pieces;
+  folly::split(',', FLAGS_port_rate_windows, pieces, true);
+  std::vector<seconds> windows;
+  for (auto piece : pieces) {
+    try {
+      windows.push_back(seconds(folly::to<uint32_t>(piece)));
+    } catch (const std::exception& ex) {
+      throw FbossError("invalid --port_rate_windows \"",
+                       FLAGS_port_rate_windows, "\": ", ex.what());
+    }
+  }
+  return windows;
+}
+
+BcmPort::QueueCounters::QueueCounters(const BcmPort* port, int queue)
+  : outPkts(port->statName(folly::to<string>("queue", queue, ".out_pkts"))),
+    outBytes(port->statName(folly::to<string>("queue", queue, ".out_bytes"))),
+    outDiscards(port->statName(
+          folly::to<string>("queue", queue, ".out_discards"))) {
+}
+
 BcmPort::BcmPort(BcmSwitch* hw, opennsl_port_t port,
                  BcmPlatformPort* platformPort)
     : hw_(hw),
       port_(port),
-      platformPort_(platformPort) {
+      platformPort_(platformPort),
+      rateTracker_(getRateWindowsFromFlags()) {
   // Obtain the gport handle from the port handle.
   int unit = hw_->getUnit();
   int rv = opennsl_port_gport_get(unit, port_, &gport_);
@@ -79,6 +157,9 @@ BcmPort::BcmPort(BcmSwitch* hw, opennsl_port_t port,
                                                &pktLenHist);
   outPktLengths_ = histMap->getOrCreateUnlocked(statName("out_pkt_lengths"),
                                                 &pktLenHist);
+  for (int queue = 0; queue < Port::QosConfig::kNumQueues; ++queue) {
+    queueCounters_.emplace_back(new QueueCounters(this, queue));
+  }
 
   VLOG(2) << "created BCM port:" << port_ << ", gport:" << gport_
           << ", FBOSS PortID:" << platformPort_->getPortID();
@@ -112,7 +193,8 @@ void BcmPort::setPortStatus(int linkstatus) {
   bool up = (linkstatus == OPENNSL_PORT_LINK_STATUS_UP);
 
   int enabled = 1;
-  int rv = opennsl_port_enable_get(hw_->getUnit(), port_, &enabled);
+  int rv = bcmSdkCall(BcmSdkApi::PORT_ENABLE_GET, opennsl_port_enable_get,
+                      hw_->getUnit(), port_, &enabled);
   // We ignore the return value.  If we fail to get the port status
   // we just tell the platformPort_ that it is enabled.
 
@@ -123,59 +205,344 @@ std::string BcmPort::statName(folly::StringPiece name) const {
   return folly::to<string>("port", platformPort_->getPortID(), ".", name);
 }
 
-void BcmPort::updateStats() {
+void BcmPort::updateStats(PortStats* portStats) {
   // TODO: It would be nicer to use a monotonic clock, but unfortunately
   // the ServiceData code currently expects everyone to use system time.
   auto now = duration_cast<seconds>(system_clock::now().time_since_epoch());
 
-  updateStat(now, &inBytes_, opennsl_spl_snmpIfHCInOctets);
-  updateStat(now, &inUnicastPkts_, opennsl_spl_snmpIfHCInUcastPkts);
-  updateStat(now, &inMulticastPkts_, opennsl_spl_snmpIfHCInMulticastPkts);
-  updateStat(now, &inBroadcastPkts_, opennsl_spl_snmpIfHCInBroadcastPkts);
-  updateStat(now, &inDiscards_, opennsl_spl_snmpIfInDiscards);
-  updateStat(now, &inErrors_, opennsl_spl_snmpIfInErrors);
+  // Read all of the counters with a single SDK call
+  const std::pair<MonotonicCounter*, opennsl_stat_val_t> counters[] = {
+    {&inBytes_, opennsl_spl_snmpIfHCInOctets},
+    {&inUnicastPkts_, opennsl_spl_snmpIfHCInUcastPkts},
+    {&inMulticastPkts_, opennsl_spl_snmpIfHCInMulticastPkts},
+    {&inBroadcastPkts_, opennsl_spl_snmpIfHCInBroadcastPkts},
+    {&inDiscards_, opennsl_spl_snmpIfInDiscards},
+    {&inErrors_, opennsl_spl_snmpIfInErrors},
+    {&outBytes_, opennsl_spl_snmpIfHCOutOctets},
+    {&outUnicastPkts_, opennsl_spl_snmpIfHCOutUcastPkts},
+    {&outMulticastPkts_, opennsl_spl_snmpIfHCOutMulticastPkts},
+    {&outBroadcastPkts_, opennsl_spl_snmpIfHCOutBroadcastPckts},
+    {&outDiscards_, opennsl_spl_snmpIfOutDiscards},
+    {&outErrors_, opennsl_spl_snmpIfOutErrors},
+  };
+  // The drop reasons are not exported per port, only added to the PortStats
+  enum : size_t {
+    IP_HEADER_DROPS,
+    IP_DISCARDS,
+    OVERSIZE_DROPS,
+    NUM_DROP_STATS,
+  };
+  const opennsl_stat_val_t dropStats[NUM_DROP_STATS] = {
+    // Includes TTL expiry
+    opennsl_spl_snmpIpInHdrErrors,
+    // Includes L3 lookup misses
+    opennsl_spl_snmpIpInDiscards,
+    opennsl_spl_snmpEtherStatsOversizePkts,
+  };
+  constexpr size_t kNumCounters = sizeof(counters) / sizeof(counters[0]);
+  constexpr size_t kNumStats = kNumCounters + NUM_DROP_STATS;
+  opennsl_stat_val_t types[kNumStats];
+  uint64_t values[kNumStats];
+  for (size_t idx = 0; idx < kNumCounters; ++idx) {
+    types[idx] = counters[idx].second;
+  }
+  std::copy(dropStats, dropStats + NUM_DROP_STATS, types + kNumCounters);
+  // Like opennsl_stat_get(), this just gets the values accumulated in
+  // software.  The Broadom SDK's counter thread syncs the HW counters to
+  // software every 500000us (defined in config.bcm).
+  auto ret = bcmSdkCall(BcmSdkApi::PORT_STAT_GET, opennsl_stat_multi_get,
+                        hw_->getUnit(), port_, kNumStats, types, values);
+  uint64_t newDiscards = 0;
+  if (OPENNSL_FAILURE(ret)) {
+    LOG(ERROR) << "Failed to get stats for port " << port_
+               << " :" << opennsl_errmsg(ret);
+  } else {
+    for (size_t idx = 0; idx < kNumCounters; ++idx) {
+      counters[idx].first->updateValue(now, values[idx]);
+    }
+
+    // How much each counter increased since the last update.  The first
+    // update only establishes the baseline.
+    uint64_t deltas[kNumStats] = {};
+    if (lastValues_.size() == kNumStats) {
+      for (size_t idx = 0; idx < kNumStats; ++idx) {
+        if (values[idx] > lastValues_[idx]) {
+          deltas[idx] = values[idx] - lastValues_[idx];
+        }
+      }
+    }
+    lastValues_.assign(values, values + kNumStats);
+    auto counterDelta = [&](const MonotonicCounter* counter) -> uint64_t {
+      for (size_t idx = 0; idx < kNumCounters; ++idx) {
+        if (counters[idx].first == counter) {
+          return deltas[idx];
+        }
+      }
+      return 0;
+    };
+
+    auto counterValue = [&](const MonotonicCounter* counter) -> uint64_t {
+      for (size_t idx = 0; idx < kNumCounters; ++idx) {
+        if (counters[idx].first == counter) {
+          return values[idx];
+        }
+      }
+      return 0;
+    };
+    HwSwitch::PortCounters cached;
+    cached.inBytes = counterValue(&inBytes_);
+    cached.inUnicastPkts = counterValue(&inUnicastPkts_);
+    cached.inMulticastPkts = counterValue(&inMulticastPkts_);
+    cached.inBroadcastPkts = counterValue(&inBroadcastPkts_);
+    cached.inDiscards = counterValue(&inDiscards_);
+    cached.inErrors = counterValue(&inErrors_);
+    cached.outBytes = counterValue(&outBytes_);
+    cached.outUnicastPkts = counterValue(&outUnicastPkts_);
+    cached.outMulticastPkts = counterValue(&outMulticastPkts_);
+    cached.outBroadcastPkts = counterValue(&outBroadcastPkts_);
+    cached.outDiscards = counterValue(&outDiscards_);
+    cached.outErrors = counterValue(&outErrors_);
+    cacheCounters(std::move(cached));
 
-  updateStat(now, &outBytes_, opennsl_spl_snmpIfHCOutOctets);
-  updateStat(now, &outUnicastPkts_, opennsl_spl_snmpIfHCOutUcastPkts);
-  updateStat(now, &outMulticastPkts_, opennsl_spl_snmpIfHCOutMulticastPkts);
-  updateStat(now, &outBroadcastPkts_, opennsl_spl_snmpIfHCOutBroadcastPckts);
-  updateStat(now, &outDiscards_, opennsl_spl_snmpIfOutDiscards);
-  updateStat(now, &outErrors_, opennsl_spl_snmpIfOutErrors);
+    newDiscards = counterDelta(&outDiscards_);
+    if (portStats) {
+      portStats->hwInDiscards(counterDelta(&inDiscards_));
+      portStats->hwInErrors(counterDelta(&inErrors_));
+      portStats->hwOutDiscards(newDiscards);
+      portStats->hwOutErrors(counterDelta(&outErrors_));
+      const auto* dropDeltas = deltas + kNumCounters;
+      portStats->hwIpHeaderDrops(dropDeltas[IP_HEADER_DROPS]);
+      portStats->hwIpDiscards(dropDeltas[IP_DISCARDS]);
+      portStats->hwOversizeDrops(dropDeltas[OVERSIZE_DROPS]);
+    }
+  }
 
   // Update the queue length stat
   uint32_t qlength;
-  auto ret = opennsl_port_queued_count_get(hw_->getUnit(), port_, &qlength);
+  ret = bcmSdkCall(BcmSdkApi::PORT_QUEUED_COUNT_GET,
+                   opennsl_port_queued_count_get, hw_->getUnit(), port_,
+                   &qlength);
   if (OPENNSL_FAILURE(ret)) {
     LOG(ERROR) << "Failed to get queue length for port " << port_
                << " :" << opennsl_errmsg(ret);
   } else {
     SpinLockHolder guard(outQueueLen_.first.get());
     outQueueLen_.second->addValue(now, qlength);
-    // TODO: outQueueLen_ only exports the average queue length over the last
-    // 60 seconds, 10 minutes, etc.
-    // We should also export the current value.  We could use a simple counter
-    // or a dynamic counter for this.
+    // outQueueLen_ only exports the average queue length over the last
+    // 60 seconds, 10 minutes, etc., so also export the current value.
+    fbData->setCounter(statName("out_queue_length.current"), qlength);
+  }
+  exportQueueSamples(now, newDiscards);
+  updateQueueStats(now);
+  if (FLAGS_bcm_buffer_watermarks) {
+    updateBufferWatermarks();
   }
 
-  // Update the packet length histograms
-  updatePktLenHist(now, &inPktLengths_, kInPktLengthStats);
-  updatePktLenHist(now, &outPktLengths_, kOutPktLengthStats);
+  // The packet length histograms change slowly, and take 20 counters to
+  // read, so they are only updated every --port_pkt_length_stats_interval
+  auto pktLenInterval = seconds(FLAGS_port_pkt_length_stats_interval);
+  if (now - lastPktLenUpdate_ >= pktLenInterval) {
+    lastPktLenUpdate_ = now;
+    updatePktLenHist(now, &inPktLengths_, kInPktLengthStats);
+    updatePktLenHist(now, &outPktLengths_, kOutPktLengthStats);
+  }
 };
 
-void BcmPort::updateStat(std::chrono::seconds now,
-                         stats::MonotonicCounter* stat,
-                         opennsl_stat_val_t type) {
-  // Use the non-sync API to just get the values accumulated in software.
-  // The Broadom SDK's counter thread syncs the HW counters to software every
-  // 500000us (defined in config.bcm).
-  uint64_t value;
-  auto ret = opennsl_stat_get(hw_->getUnit(), port_, type, &value);
+void BcmPort::cacheCounters(HwSwitch::PortCounters counters) {
+  PortRateTracker::Values values;
+  values[PortRateTracker::IN_BYTES] = counters.inBytes;
+  values[PortRateTracker::IN_PKTS] = counters.inUnicastPkts +
+    counters.inMulticastPkts + counters.inBroadcastPkts;
+  values[PortRateTracker::IN_DISCARDS] = counters.inDiscards;
+  values[PortRateTracker::OUT_BYTES] = counters.outBytes;
+  values[PortRateTracker::OUT_PKTS] = counters.outUnicastPkts +
+    counters.outMulticastPkts + counters.outBroadcastPkts;
+  values[PortRateTracker::OUT_DISCARDS] = counters.outDiscards;
+  rateTracker_.addSample(steady_clock::now(), values);
+  counters.rates = rateTracker_.getRates();
+
+  std::lock_guard<std::mutex> g(cachedCountersLock_);
+  cachedCounters_ = std::move(counters);
+  haveCachedCounters_ = true;
+}
+
+bool BcmPort::getCachedCounters(HwSwitch::PortCounters* counters) const {
+  std::lock_guard<std::mutex> g(cachedCountersLock_);
+  if (!haveCachedCounters_) {
+    return false;
+  }
+  *counters = cachedCounters_;
+  return true;
+}
+
+void BcmPort::sampleQueueLength() {
+  uint32_t qlength;
+  auto ret = bcmSdkCall(BcmSdkApi::PORT_QUEUED_COUNT_GET,
+                        opennsl_port_queued_count_get, hw_->getUnit(), port_,
+                        &qlength);
   if (OPENNSL_FAILURE(ret)) {
-    LOG(ERROR) << "Failed to get stat " << type << " for port " << port_
-               << " :" << opennsl_errmsg(ret);
+    VLOG(4) << "Failed to sample queue length for port " << port_
+            << " :" << opennsl_errmsg(ret);
     return;
   }
-  stat->updateValue(now, value);
+  std::lock_guard<std::mutex> g(queueSamplesLock_);
+  if (queueSamples_.size() >= kMaxQueueSamples) {
+    // The stats are not being updated.  Only keep track of the maximum,
+    // which is what matters for finding bursts.
+    auto& last = queueSamples_.back();
+    last = std::max(last, qlength);
+    return;
+  }
+  queueSamples_.push_back(qlength);
+}
+
+void BcmPort::exportQueueSamples(seconds now, uint64_t newDiscards) {
+  std::vector<uint32_t> samples;
+  {
+    std::lock_guard<std::mutex> g(queueSamplesLock_);
+    samples.swap(queueSamples_);
+  }
+  if (samples.empty()) {
+    // The queue length is not being sampled
+    return;
+  }
+
+  auto p99 = samples.begin() + (samples.size() - 1) * 99 / 100;
+  std::nth_element(samples.begin(), p99, samples.end());
+  auto max = *std::max_element(p99, samples.end());
+  fbData->setCounter(statName("out_queue_length.max"), max);
+  fbData->setCounter(statName("out_queue_length.p99"), *p99);
+
+  // Discards usually come from bursts too short to show up in the average
+  // queue length.  Count the updates with discards, and export how deep the
+  // queue got during them.
+  if (newDiscards) {
+    microbursts_.updateValue(now, ++numMicrobursts_);
+    fbData->setCounter(statName("out_queue_length.max_at_discards"), max);
+  }
+}
+
+void BcmPort::updateQueueStats(seconds now) {
+  // There is no multi-get for queue counters, so each takes its own call
+  // into the SDK's software counter cache
+  const std::pair<MonotonicCounter QueueCounters::*, opennsl_cosq_stat_t>
+    stats[] = {
+    {&QueueCounters::outPkts, opennslCosqStatOutPackets},
+    {&QueueCounters::outBytes, opennslCosqStatOutBytes},
+    {&QueueCounters::outDiscards, opennslCosqStatDroppedPackets},
+  };
+  for (int queue = 0; queue < queueCounters_.size(); ++queue) {
+    auto* counters = queueCounters_[queue].get();
+    for (const auto& stat : stats) {
+      uint64_t value;
+      auto ret = bcmSdkCall(BcmSdkApi::COSQ_STAT_GET, opennsl_cosq_stat_get,
+                            hw_->getUnit(), gport_, queue, stat.second,
+                            &value);
+      if (OPENNSL_FAILURE(ret)) {
+        LOG(ERROR) << "Failed to get stats for queue " << queue
+                   << " of port " << port_ << " :" << opennsl_errmsg(ret);
+        return;
+      }
+      (counters->*stat.first).updateValue(now, value);
+    }
+  }
+}
+
+void BcmPort::updateBufferWatermarks() {
+  // BcmSwitch syncs the watermarks from the HW before the ports are
+  // updated.  Reading them with the clear option starts them over, so each
+  // update exports the peak buffer use since the last one, in cells.
+  auto read = [&](int cosq, opennsl_bst_stat_id_t stat,
+                  uint64_t* cells) -> bool {
+    auto ret = bcmSdkCall(BcmSdkApi::COSQ_BST_STAT_GET,
+                          opennsl_cosq_bst_stat_get, hw_->getUnit(), gport_,
+                          cosq, stat, OPENNSL_COSQ_STAT_CLEAR, cells);
+    if (OPENNSL_FAILURE(ret)) {
+      LOG(ERROR) << "Failed to get buffer watermark " << stat << " of port "
+                 << port_ << " :" << opennsl_errmsg(ret);
+      return false;
+    }
+    return true;
+  };
+  uint64_t cells;
+  if (read(kServicePool, opennslBstStatIdPortPool, &cells)) {
+    fbData->setCounter(statName("buffer.ingress_watermark_cells"), cells);
+  }
+  if (read(kPriorityGroup, opennslBstStatIdPriGroupHeadroom, &cells)) {
+    fbData->setCounter(statName("buffer.headroom_watermark_cells"), cells);
+  }
+  for (int queue = 0; queue < Port::QosConfig::kNumQueues; ++queue) {
+    if (read(queue, opennslBstStatIdUcast, &cells)) {
+      fbData->setCounter(
+          statName(folly::to<string>("queue", queue,
+                                     ".buffer_watermark_cells")),
+          cells);
+    }
+  }
+}
+
+void BcmPort::updateBuffer(const Port::BufferConfig& oldBuffer,
+                           const Port::BufferConfig& newBuffer) {
+  auto portID = platformPort_->getPortID();
+  if (oldBuffer.cutThrough != newBuffer.cutThrough) {
+    // The ASIC calls cut through alternate store and forward
+    auto rv = opennsl_switch_control_port_set(
+        hw_->getUnit(), port_, opennslSwitchAlternateStoreForward,
+        newBuffer.cutThrough ? 1 : 0);
+    bcmCheckError(rv, "failed to ", newBuffer.cutThrough ? "en" : "dis",
+                  "able cut through on port ", portID);
+  }
+  for (const auto& limit : kBufferLimits) {
+    auto oldBytes = oldBuffer.*limit.bytes;
+    auto newBytes = newBuffer.*limit.bytes;
+    if (oldBytes == newBytes) {
+      continue;
+    }
+    switch (limit.scope) {
+      case BufferLimit::POOL:
+        setBufferLimit(limit.control, kServicePool, oldBytes, newBytes);
+        break;
+      case BufferLimit::PRIORITY_GROUP:
+        setBufferLimit(limit.control, kPriorityGroup, oldBytes, newBytes);
+        break;
+      case BufferLimit::QUEUES:
+        for (int queue = 0; queue < Port::QosConfig::kNumQueues; ++queue) {
+          setBufferLimit(limit.control, queue, oldBytes, newBytes);
+        }
+        break;
+    }
+  }
+  VLOG(1) << "updated the buffer settings of port " << portID;
+}
+
+void BcmPort::setBufferLimit(opennsl_cosq_control_t control, int cosq,
+                             uint32_t oldBytes, uint32_t newBytes) {
+  auto unit = hw_->getUnit();
+  auto portID = platformPort_->getPortID();
+  auto key = std::make_pair(control, cosq);
+  if (oldBytes == 0) {
+    // The default is still in place, so save it for when the limit is
+    // removed from the config again
+    int current;
+    auto rv = opennsl_cosq_control_get(unit, gport_, cosq, control, &current);
+    bcmCheckError(rv, "failed to get buffer limit ", control, " of port ",
+                  portID);
+    bufferDefaults_[key] = current;
+  }
+  int value = newBytes;
+  if (newBytes == 0) {
+    auto it = bufferDefaults_.find(key);
+    if (it == bufferDefaults_.end()) {
+      // The limit was set before a warm boot
+      LOG(WARNING) << "the default of buffer limit " << control << " of port "
+                   << portID << " is not known, so it stays at " << oldBytes;
+      return;
+    }
+    value = it->second;
+  }
+  auto rv = opennsl_cosq_control_set(unit, gport_, cosq, control, value);
+  bcmCheckError(rv, "failed to set buffer limit ", control, " of port ",
+                portID, " to ", value);
 }
 
 void BcmPort::updatePktLenHist(
@@ -188,8 +555,9 @@ void BcmPort::updatePktLenHist(
   // it's stats arguments right now.
   opennsl_stat_val_t* statsArg =
       const_cast<opennsl_stat_val_t*>(&stats.front());
-  auto ret = opennsl_stat_multi_get(hw_->getUnit(), port_,
-                                stats.size(), statsArg, counters);
+  auto ret = bcmSdkCall(BcmSdkApi::PORT_STAT_GET, opennsl_stat_multi_get,
+                        hw_->getUnit(), port_, stats.size(), statsArg,
+                        counters);
   if (OPENNSL_FAILURE(ret)) {
     LOG(ERROR) << "Failed to get packet length stats for port " << port_
                << " :" << opennsl_errmsg(ret);
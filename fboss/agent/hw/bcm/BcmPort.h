@@ -11,19 +11,28 @@
 
 extern "C" {
 #include <opennsl/types.h>
+#include <opennsl/cosq.h>
 #include <opennsl/stat.h>
 }
 
 #include "common/stats/MonotonicCounter.h"
 #include "common/stats/ExportedHistogram.h"
+#include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/PortRateTracker.h"
+#include "fboss/agent/state/Port.h"
 #include "fboss/agent/types.h"
 
+#include <chrono>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
 class BcmPlatformPort;
 class BcmSwitch;
+class PortStats;
 
 /**
  * BcmPort is the class to abstract the physical port in BcmSwitch.
@@ -63,9 +72,30 @@ class BcmPort {
   void setPortStatus(int status);
 
   /*
-   * Update this port's statistics.
+   * Update this port's statistics, and add its hardware drops to portStats
+   * (if given).
    */
-  void updateStats();
+  void updateStats(PortStats* portStats);
+  /*
+   * Get the counters and rates read by the last updateStats(), without
+   * reading the hardware.  Returns false if the stats have not been
+   * updated yet.
+   */
+  bool getCachedCounters(HwSwitch::PortCounters* counters) const;
+  /*
+   * Sample the current length of the port's output queue.
+   *
+   * This is called much more often than updateStats(), which exports the
+   * maximum and 99th percentile of the samples taken since its last call.
+   */
+  void sampleQueueLength();
+
+  /*
+   * Apply the settings of newBuffer that differ from oldBuffer, which the
+   * port has now.  Limits set back to 0 go back to the ASIC's defaults.
+   */
+  void updateBuffer(const Port::BufferConfig& oldBuffer,
+                    const Port::BufferConfig& newBuffer);
 
  private:
   class MonotonicCounter : public stats::MonotonicCounter {
@@ -78,17 +108,33 @@ class BcmPort {
       : stats::MonotonicCounter(name, stats::SUM, stats::RATE) {}
   };
 
+  // The counters of one of the port's egress queues
+  struct QueueCounters {
+    QueueCounters(const BcmPort* port, int queue);
+
+    MonotonicCounter outPkts;
+    MonotonicCounter outBytes;
+    MonotonicCounter outDiscards;
+  };
+
   // no copy or assignment
   BcmPort(BcmPort const &) = delete;
   BcmPort& operator=(BcmPort const &) = delete;
 
-  void updateStat(std::chrono::seconds now,
-                  stats::MonotonicCounter* stat,
-                  opennsl_stat_val_t type);
   void updatePktLenHist(std::chrono::seconds now,
                         stats::ExportedHistogramMap::LockAndHistogram* hist,
                         const std::vector<opennsl_stat_val_t>& stats);
   std::string statName(folly::StringPiece name) const;
+  void exportQueueSamples(std::chrono::seconds now, uint64_t newDiscards);
+  void updateQueueStats(std::chrono::seconds now);
+  void updateBufferWatermarks();
+  void setBufferLimit(opennsl_cosq_control_t control, int cosq,
+                      uint32_t oldBytes, uint32_t newBytes);
+  /*
+   * Compute the rates of the counters just read, and save both for
+   * getCachedCounters().
+   */
+  void cacheCounters(HwSwitch::PortCounters counters);
 
   BcmSwitch* const hw_{nullptr};
   const opennsl_port_t port_;    // Broadcom physical port number
@@ -108,10 +154,33 @@ class BcmPort {
   MonotonicCounter outBroadcastPkts_{statName("out_broadcast_pkts")};
   MonotonicCounter outDiscards_{statName("out_discards")};
   MonotonicCounter outErrors_{statName("out_errors")};
+  std::vector<std::unique_ptr<QueueCounters>> queueCounters_;
 
   stats::ExportedStatMap::LockAndStatItem outQueueLen_;
   stats::ExportedHistogramMap::LockAndHistogram inPktLengths_;
   stats::ExportedHistogramMap::LockAndHistogram outPktLengths_;
+  // When the packet length histograms were last updated
+  std::chrono::seconds lastPktLenUpdate_{0};
+
+  // The number of stats updates in which the port discarded packets, with
+  // the queue samples showing how full the queue got
+  MonotonicCounter microbursts_{statName("out_queue_microbursts")};
+  uint64_t numMicrobursts_{0};
+  // The raw counter values read by the last stats update
+  std::vector<uint64_t> lastValues_;
+  // The rates of the counters over each of --port_rate_windows
+  PortRateTracker rateTracker_;
+  // The counters and rates of the last stats update, for
+  // getCachedCounters()
+  mutable std::mutex cachedCountersLock_;
+  HwSwitch::PortCounters cachedCounters_;
+  bool haveCachedCounters_{false};
+  // The queue length samples since the last stats update
+  std::mutex queueSamplesLock_;
+  std::vector<uint32_t> queueSamples_;
+  // The ASIC's default of each buffer limit the config overrides, by the
+  // control and the pool, priority group or queue it is set on
+  std::map<std::pair<opennsl_cosq_control_t, int>, int> bufferDefaults_;
 };
 
 }} // namespace facebook::fboss
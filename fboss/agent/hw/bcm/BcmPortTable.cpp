@@ -12,6 +12,8 @@
 #include <boost/foreach.hpp>
 
 #include "common/stats/MonotonicCounter.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/Utils.h"
 #include "fboss/agent/hw/bcm/BcmError.h"
 #include "fboss/agent/hw/bcm/BcmPlatform.h"
 #include "fboss/agent/hw/bcm/BcmPlatformPort.h"
@@ -23,6 +25,8 @@ extern "C" {
 #include <opennsl/port.h>
 }
 
+DECLARE_int32(bcm_port_config_threads);
+
 namespace facebook { namespace fboss {
 
 using folly::make_unique;
@@ -45,7 +49,9 @@ void BcmPortTable::initPorts(const opennsl_port_config_t* portConfig,
   // platform.  For instance, even though the Trident2 chip may support up to
   // 128 ports, if the platform only defines 32 ports we will only create 32
   // BcmPort objects.
-  auto platformPorts = hw_->getPlatform()->initPorts();
+  auto platformPorts = hw_->getPlatform()->initUnitPorts(hw_->getUnit());
+  std::vector<BcmPort*> ports;
+  ports.reserve(platformPorts.size());
   for (const auto& entry : platformPorts) {
     opennsl_port_t bcmPortNum = entry.first;
     BcmPlatformPort* platPort = entry.second;
@@ -63,43 +69,52 @@ void BcmPortTable::initPorts(const opennsl_port_config_t* portConfig,
     PortID fbossPortID = platPort->getPortID();
     auto bcmPort = make_unique<BcmPort>(hw_, bcmPortNum, platPort);
     platPort->setBcmPort(bcmPort.get());
-    bcmPort->init(warmBoot);
+    ports.push_back(bcmPort.get());
 
     fbossPhysicalPorts_.emplace(fbossPortID, bcmPort.get());
+    fbossPortIndex_.set(fbossPortID, bcmPort.get());
+    bcmPortIndex_.set(bcmPortNum, bcmPort.get());
     bcmPhysicalPorts_.emplace(bcmPortNum, std::move(bcmPort));
   }
+
+  // Initializing a port only makes SDK calls for that port, which the SDK
+  // serializes as needed, so on switches with many ports it is worth doing
+  // several at once.
+  runInParallel(ports.size(), FLAGS_bcm_port_config_threads,
+                [&] (size_t i) { ports[i]->init(warmBoot); });
+}
+
+std::vector<PortID> BcmPortTable::getPortIds() const {
+  std::vector<PortID> ids;
+  ids.reserve(fbossPhysicalPorts_.size());
+  for (const auto& entry : fbossPhysicalPorts_) {
+    ids.push_back(entry.first);
+  }
+  return ids;
 }
 
 BcmPort* BcmPortTable::getBcmPort(opennsl_port_t id) const {
-  auto iter = bcmPhysicalPorts_.find(id);
-  if (iter == bcmPhysicalPorts_.end()) {
+  auto port = bcmPortIndex_.get(id);
+  if (!port) {
     throw FbossError("Cannot find the BCM port object for BCM port ", id);
   }
-  return iter->second.get();
+  return port;
 }
 
 BcmPort* BcmPortTable::getBcmPortIf(opennsl_port_t id) const {
-  auto iter = bcmPhysicalPorts_.find(id);
-  if (iter == bcmPhysicalPorts_.end()) {
-    return nullptr;
-  }
-  return iter->second.get();
+  return bcmPortIndex_.get(id);
 }
 
 BcmPort* BcmPortTable::getBcmPort(PortID id) const {
-  auto iter = fbossPhysicalPorts_.find(id);
-  if (iter == fbossPhysicalPorts_.end()) {
+  auto port = fbossPortIndex_.get(id);
+  if (!port) {
     throw FbossError("Cannot find the BCM port object for FBOSS port ID ", id);
   }
-  return iter->second;
+  return port;
 }
 
 BcmPort* BcmPortTable::getBcmPortIf(PortID id) const {
-  auto iter = fbossPhysicalPorts_.find(id);
-  if (iter == fbossPhysicalPorts_.end()) {
-    return nullptr;
-  }
-  return iter->second;
+  return fbossPortIndex_.get(id);
 }
 
 void BcmPortTable::setPortStatus(opennsl_port_t id, int status) {
@@ -107,11 +122,16 @@ void BcmPortTable::setPortStatus(opennsl_port_t id, int status) {
   port->setPortStatus(status);
 }
 
-void BcmPortTable::updatePortStats() {
- for (const auto& entry : bcmPhysicalPorts_) {
-   BcmPort* bcmPort = entry.second.get();
-   bcmPort->updateStats();
- }
+void BcmPortTable::updatePortStats(SwitchStats* switchStats) {
+  for (const auto& entry : fbossPhysicalPorts_) {
+    entry.second->updateStats(switchStats->port(entry.first));
+  }
+}
+
+void BcmPortTable::sampleQueueLengths() {
+  for (const auto& entry : bcmPhysicalPorts_) {
+    entry.second->sampleQueueLength();
+  }
 }
 
 }} // namespace facebook::fboss
@@ -14,15 +14,20 @@ extern "C" {
 #include <opennsl/port.h>
 }
 
+#include "fboss/agent/DenseIdIndex.h"
 #include "fboss/agent/types.h"
+#include "fboss/agent/hw/bcm/BcmPlatformPort.h"
 #include "fboss/agent/hw/bcm/BcmPort.h"
+#include "fboss/agent/state/PortBitmap.h"
 
 #include <mutex>
+#include <vector>
 #include <boost/container/flat_map.hpp>
 
 namespace facebook { namespace fboss {
 
 class BcmSwitch;
+class SwitchStats;
 
 class BcmPortTable {
  public:
@@ -41,10 +46,38 @@ class BcmPortTable {
    * Getters.
    */
   opennsl_port_t getBcmPortId(PortID id) const {
-    return static_cast<opennsl_port_t>(id);
+    auto port = fbossPortIndex_.get(id);
+    return port ? port->getBcmPortId() : static_cast<opennsl_port_t>(id);
   }
   PortID getPortId(opennsl_port_t port) const {
-    return PortID(port);
+    auto bcmPort = bcmPortIndex_.get(port);
+    return bcmPort ? bcmPort->getPlatformPort()->getPortID() : PortID(port);
+  }
+  /*
+   * Whether the port is one of this unit's.  On systems with several units
+   * each one only has some of the ports in the SwitchState.
+   */
+  bool hasPort(PortID id) const {
+    return fbossPortIndex_.get(id) != nullptr;
+  }
+  /*
+   * The IDs of this unit's ports, in order.
+   */
+  std::vector<PortID> getPortIds() const;
+  /*
+   * The BCM port bitmap of this unit's ports in a set.  This only visits the
+   * ports in the set.
+   */
+  opennsl_pbmp_t getBcmPbmp(const PortBitmap& ports) const {
+    opennsl_pbmp_t pbmp;
+    OPENNSL_PBMP_CLEAR(pbmp);
+    ports.forEach([&](PortID id) {
+      auto port = fbossPortIndex_.get(id);
+      if (port) {
+        OPENNSL_PBMP_PORT_ADD(pbmp, port->getBcmPortId());
+      }
+    });
+    return pbmp;
   }
 
   /*
@@ -53,9 +86,14 @@ class BcmPortTable {
   void setPortStatus(opennsl_port_t id, int status);
 
   /*
-   * Update all ports' statistics.
+   * Update all ports' statistics, and add their hardware drops to the
+   * thread-local per-port statistics.
+   */
+  void updatePortStats(SwitchStats* switchStats);
+  /*
+   * Sample all ports' output queue lengths.
    */
-  void updatePortStats();
+  void sampleQueueLengths();
 
  private:
   typedef boost::container::flat_map<opennsl_port_t, std::unique_ptr<BcmPort>>
@@ -83,6 +121,10 @@ class BcmPortTable {
   BcmPortMap bcmPhysicalPorts_;
   // A mapping from FBOSS PortID to BcmPort.
   FbossPortMap fbossPhysicalPorts_;
+  // The same mappings as arrays, for the lookups on the packet, stats and
+  // linkscan paths.  The maps above are for iterating in port order.
+  DenseIdIndex<opennsl_port_t, BcmPort> bcmPortIndex_;
+  DenseIdIndex<PortID, BcmPort> fbossPortIndex_;
 };
 
 }} // namespace facebook::fboss
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmResourceManager.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
+#include "fboss/agent/hw/bcm/BcmSwitch.h"
+
+#include <gflags/gflags.h>
+
+extern "C" {
+#include <opennsl/l3.h>
+}
+
+DEFINE_string(bcm_table_overflow_policy, "fail",
+              "What to do when an L3 host, route or ECMP table is full: "
+              "\"fail\" the HW update, \"reject\" the entries that do not "
+              "fit and retry them later, or \"prefer_shorter\", which "
+              "rejects too but retries the shortest routes first");
+
+namespace {
+
+const char* const kTableNames[] = {"host", "route", "ecmp"};
+
+}
+
+namespace facebook { namespace fboss {
+
+BcmResourceManager::BcmResourceManager(const BcmSwitch* hw) : hw_(hw) {
+  if (FLAGS_bcm_table_overflow_policy == "fail") {
+    policy_ = OverflowPolicy::FAIL;
+  } else if (FLAGS_bcm_table_overflow_policy == "reject") {
+    policy_ = OverflowPolicy::REJECT;
+  } else if (FLAGS_bcm_table_overflow_policy == "prefer_shorter") {
+    policy_ = OverflowPolicy::PREFER_SHORTER;
+  } else {
+    throw FbossError("invalid table overflow policy \"",
+                     FLAGS_bcm_table_overflow_policy, "\"");
+  }
+  for (int table = 0; table < NUM_TABLES; ++table) {
+    used_[table] = 0;
+    max_[table] = 0;
+    watermark_[table] = 0;
+  }
+}
+
+void BcmResourceManager::update() {
+  opennsl_l3_info_t l3Info;
+  opennsl_l3_info_t_init(&l3Info);
+  auto rv = opennsl_l3_info(hw_->getUnit(), &l3Info);
+  if (OPENNSL_FAILURE(rv)) {
+    LOG(ERROR) << "Failed to get the L3 table info: " << opennsl_errmsg(rv);
+    return;
+  }
+  max_[HOST] = l3Info.l3info_max_host;
+  max_[ROUTE] = l3Info.l3info_max_route;
+  max_[ECMP] = l3Info.l3info_max_ecmp_groups;
+  setUsed(HOST, l3Info.l3info_used_host);
+  setUsed(ROUTE, l3Info.l3info_used_route);
+
+  for (int table = 0; table < NUM_TABLES; ++table) {
+    auto usage = getUsage(static_cast<Table>(table));
+    BcmStats::l3TableUsage(kTableNames[table], usage.used, usage.max,
+                           usage.watermark);
+  }
+}
+
+BcmResourceManager::Usage BcmResourceManager::getUsage(Table table) const {
+  Usage usage;
+  usage.used = used_[table];
+  usage.max = max_[table];
+  usage.watermark = watermark_[table];
+  return usage;
+}
+
+void BcmResourceManager::setEcmpGroups(uint64_t count) {
+  setUsed(ECMP, count);
+}
+
+void BcmResourceManager::setUsed(Table table, uint64_t used) {
+  used_[table] = used;
+  // Only one thread sets the usage of each table
+  if (used > watermark_[table]) {
+    watermark_[table] = used;
+  }
+}
+
+bool BcmResourceManager::shouldRejectOnError(int err) const {
+  return policy_ != OverflowPolicy::FAIL &&
+    (err == OPENNSL_E_FULL || err == OPENNSL_E_RESOURCE);
+}
+
+bool BcmResourceManager::shouldRejectOnError(const BcmError& error) const {
+  return shouldRejectOnError(error.getBcmError());
+}
+
+}} // facebook::fboss
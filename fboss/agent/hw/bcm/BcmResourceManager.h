@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace facebook { namespace fboss {
+
+class BcmError;
+class BcmSwitch;
+
+/*
+ * BcmResourceManager tracks how full the L3 host, route (LPM) and ECMP group
+ * tables are, and what to do when an entry does not fit.
+ *
+ * The host and route table usage is read from the SDK on each stats update,
+ * while the ECMP group count is kept up to date by BcmHostTable.  The used
+ * and total entries of each table, and the most entries used since startup,
+ * are published as counters.
+ *
+ * --bcm_table_overflow_policy decides what happens when the SDK reports a
+ * table as full:
+ *   fail            The HW update fails, as any other SDK error does.
+ *   reject          The entry is left out.  A route that does not fit is
+ *                   retried whenever routes are deleted, and until then its
+ *                   traffic falls through to the covering route, usually the
+ *                   default route.  A neighbor's host entry is retried the
+ *                   next time the neighbor changes.
+ *   prefer_shorter  The same as reject, but rejected routes are retried
+ *                   shortest prefix first, since those cover the most
+ *                   addresses.
+ */
+class BcmResourceManager {
+ public:
+  enum Table : uint8_t {
+    HOST,
+    ROUTE,
+    ECMP,
+    NUM_TABLES,
+  };
+  enum class OverflowPolicy {
+    FAIL,
+    REJECT,
+    PREFER_SHORTER,
+  };
+  struct Usage {
+    uint64_t used{0};
+    uint64_t max{0};
+    // The most entries used since startup
+    uint64_t watermark{0};
+  };
+
+  /*
+   * Throws FbossError if --bcm_table_overflow_policy is not valid.
+   */
+  explicit BcmResourceManager(const BcmSwitch* hw);
+
+  /*
+   * Read the host and route table usage from the SDK, and publish the
+   * usage of every table.
+   */
+  void update();
+
+  Usage getUsage(Table table) const;
+
+  /*
+   * Set the number of ECMP groups in use.
+   */
+  void setEcmpGroups(uint64_t count);
+
+  OverflowPolicy getOverflowPolicy() const {
+    return policy_;
+  }
+
+  /*
+   * Whether the error means a table is full, and the overflow policy is to
+   * leave the entry out rather than fail the update.
+   */
+  bool shouldRejectOnError(int err) const;
+  bool shouldRejectOnError(const BcmError& error) const;
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  BcmResourceManager(BcmResourceManager const &) = delete;
+  BcmResourceManager& operator=(BcmResourceManager const &) = delete;
+
+  void setUsed(Table table, uint64_t used);
+
+  const BcmSwitch* hw_{nullptr};
+  OverflowPolicy policy_{OverflowPolicy::FAIL};
+  // Written by the state update and stats threads, and read by either
+  std::array<std::atomic<uint64_t>, NUM_TABLES> used_;
+  std::array<std::atomic<uint64_t>, NUM_TABLES> max_;
+  std::array<std::atomic<uint64_t>, NUM_TABLES> watermark_;
+};
+
+}} // facebook::fboss
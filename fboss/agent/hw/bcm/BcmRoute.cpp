@@ -13,16 +13,29 @@ extern "C" {
 #include <opennsl/l3.h>
 }
 
+#include <folly/ExceptionString.h>
 #include <folly/IPAddress.h>
 #include <folly/IPAddressV4.h>
 #include <folly/IPAddressV6.h>
+#include <folly/ScopeGuard.h>
+#include <algorithm>
+#include <iterator>
 #include "fboss/agent/state/Route.h"
 #include "fboss/agent/hw/bcm/BcmError.h"
 #include "fboss/agent/hw/bcm/BcmSwitch.h"
 #include "fboss/agent/hw/bcm/BcmHost.h"
 #include "fboss/agent/hw/bcm/BcmIntf.h"
+#include "fboss/agent/hw/bcm/BcmResourceManager.h"
+#include "fboss/agent/hw/bcm/BcmRouteCounters.h"
+#include "fboss/agent/hw/bcm/BcmSdkCall.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
 #include "fboss/agent/hw/bcm/BcmWarmBootCache.h"
 
+DEFINE_bool(bcm_host_table_routes, true,
+            "Program /32 and /128 routes into the L3 host table, which is "
+            "much larger than the LPM table, unless the address has a host "
+            "entry of its own");
+
 namespace facebook { namespace fboss {
 
 BcmRoute::BcmRoute(const BcmSwitch* hw, opennsl_vrf_t vrf,
@@ -31,22 +44,48 @@ BcmRoute::BcmRoute(const BcmSwitch* hw, opennsl_vrf_t vrf,
 }
 
 void BcmRoute::initL3RouteT(opennsl_l3_route_t* rt) const {
+  initL3RouteT(rt, vrf_, prefix_, len_);
+}
+
+void BcmRoute::initL3RouteT(opennsl_l3_route_t* rt, opennsl_vrf_t vrf,
+                            const folly::IPAddress& prefix, uint8_t len) {
   opennsl_l3_route_t_init(rt);
-  rt->l3a_vrf = vrf_;
-  if (prefix_.isV4()) {
+  rt->l3a_vrf = vrf;
+  if (prefix.isV4()) {
     // both l3a_subnet and l3a_ip_mask for IPv4 are in host order
-    rt->l3a_subnet = prefix_.asV4().toLongHBO();
+    rt->l3a_subnet = prefix.asV4().toLongHBO();
     rt->l3a_ip_mask = folly::IPAddressV4(
-        folly::IPAddressV4::fetchMask(len_)).toLongHBO();
+        folly::IPAddressV4::fetchMask(len)).toLongHBO();
   } else {
-    memcpy(&rt->l3a_ip6_net, prefix_.asV6().toByteArray().data(),
+    memcpy(&rt->l3a_ip6_net, prefix.asV6().toByteArray().data(),
            sizeof(rt->l3a_ip6_net));
-    memcpy(&rt->l3a_ip6_mask, folly::IPAddressV6::fetchMask(len_).data(),
+    memcpy(&rt->l3a_ip6_mask, folly::IPAddressV6::fetchMask(len).data(),
            sizeof(rt->l3a_ip6_mask));
     rt->l3a_flags |= OPENNSL_L3_IP6;
   }
 }
 
+void BcmRoute::initL3HostT(opennsl_l3_host_t* host) const {
+  opennsl_l3_host_t_init(host);
+  host->l3a_vrf = vrf_;
+  if (prefix_.isV4()) {
+    host->l3a_ip_addr = prefix_.asV4().toLongHBO();
+  } else {
+    memcpy(&host->l3a_ip6_addr, prefix_.asV6().toByteArray().data(),
+           sizeof(host->l3a_ip6_addr));
+    host->l3a_flags |= OPENNSL_L3_IP6;
+  }
+}
+
+bool BcmRoute::canUseHostTable() const {
+  if (!FLAGS_bcm_host_table_routes || len_ != prefix_.bitCount()) {
+    return false;
+  }
+  // The address may already have a host entry of its own, or get one once
+  // a neighbor it was created for resolves.
+  return !hw_->getHostTable()->getBcmHostIf(vrf_, prefix_);
+}
+
 void BcmRoute::program(const RouteForwardInfo& fwd) {
 
   // if the route has been programmed to the HW, check if the forward info is
@@ -55,37 +94,49 @@ void BcmRoute::program(const RouteForwardInfo& fwd) {
     return;
   }
 
-  // function to clean up the host reference
-  auto cleanupHost = [&] (const RouteForwardNexthops& nhopsClean) noexcept {
-    if (nhopsClean.size()) {
-      hw_->writableHostTable()->derefBcmEcmpHost(vrf_, nhopsClean);
-    }
+  uint32_t flags = 0;
+  auto egressId = resolveEgress(fwd, &flags);
+  SCOPE_FAIL {
+    releaseEgress(fwd);
   };
+  // Checked once the egress is resolved, which may create the host for a
+  // route to the nexthop itself.
+  bool inHostTable = added_ ? inHostTable_ : canUseHostTable();
+  if (inHostTable) {
+    try {
+      programHost(fwd, egressId, flags);
+    } catch (const BcmError& error) {
+      // A new route may still fit in LPM when the host table is full
+      if (added_ || error.getBcmError() != OPENNSL_E_FULL) {
+        throw;
+      }
+      VLOG(1) << "Host table full, adding route for : " << prefix_
+        << " in vrf : " << vrf_ << " to LPM";
+      inHostTable = false;
+    }
+  }
+  if (!inHostTable) {
+    programLpm(fwd, egressId, flags);
+  }
+  if (added_) {
+    // the route was added before, need to free the old nexthop
+    releaseEgress(fwd_);
+  }
+  fwd_ = fwd;
+  // new nexthop has been stored in fwd_. From now on, it is up to
+  // ~BcmRoute() to clean up such nexthop.
+  added_ = true;
+  inHostTable_ = inHostTable;
+  egressId_ = egressId;
+  flags_ = flags;
+  updateCounter();
+}
 
-  auto action = fwd.getAction();
+void BcmRoute::programLpm(const RouteForwardInfo& fwd, opennsl_if_t egressId,
+                          uint32_t flags) {
   opennsl_l3_route_t rt;
   initL3RouteT(&rt);
-  // find out the egress object ID
-  opennsl_if_t egressId;
-  if (action == RouteForwardAction::DROP) {
-    egressId = hw_->getDropEgressId();
-  } else if (action == RouteForwardAction::TO_CPU) {
-    egressId = hw_->getToCPUEgressId();
-  } else {
-    CHECK(action == RouteForwardAction::NEXTHOPS);
-    // need to get an entry from the host table for the forward info
-    const RouteForwardNexthops& nhops = fwd.getNexthops();
-    CHECK_GT(nhops.size(), 0);
-    if (nhops.size() > 1) {         // multipath
-      rt.l3a_flags |= OPENNSL_L3_MULTIPATH;
-    }
-    auto host = hw_->writableHostTable()->incRefOrCreateBcmEcmpHost(
-        vrf_, nhops);
-    egressId = host->getEgressId();
-  }
-  SCOPE_FAIL {
-    cleanupHost(fwd.getNexthops());
-  };
+  rt.l3a_flags |= flags;
   rt.l3a_intf = egressId;
 
   bool addRoute = false;
@@ -108,6 +159,7 @@ void BcmRoute::program(const RouteForwardInfo& fwd) {
       // This is a change
       rt.l3a_flags |= OPENNSL_L3_REPLACE;
       addRoute = true;
+      warmBootCache->reprogrammed();
     } else {
       VLOG(1) << " Route for : " << prefix_ << "/" << static_cast<int>(len_)
         << " in vrf : " << vrf_ << " already exists";
@@ -123,7 +175,8 @@ void BcmRoute::program(const RouteForwardInfo& fwd) {
     if (added_) {
       rt.l3a_flags |= OPENNSL_L3_REPLACE;
     }
-    auto rc = opennsl_l3_route_add(hw_->getUnit(), &rt);
+    auto rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_ADD, opennsl_l3_route_add,
+                         hw_->getUnit(), &rt);
     bcmCheckError(rc, "failed to create a route entry for ", prefix_, "/",
         static_cast<int>(len_), " @ ", fwd, " @egress ", egressId);
     VLOG(3) << "created a route entry for " << prefix_.str() << "/"
@@ -133,24 +186,227 @@ void BcmRoute::program(const RouteForwardInfo& fwd) {
   if (vrfAndPfx2RouteCitr != warmBootCache->vrfAndPrefix2Route_end()) {
     warmBootCache->programmed(vrfAndPfx2RouteCitr);
   }
-  if (added_) {
-    // the route was added before, need to free the old nexthop
-    cleanupHost(fwd_.getNexthops());
+}
+
+void BcmRoute::programHost(const RouteForwardInfo& fwd, opennsl_if_t egressId,
+                           uint32_t flags) {
+  opennsl_l3_host_t host;
+  initL3HostT(&host);
+  host.l3a_flags |= flags;
+  host.l3a_intf = egressId;
+
+  bool addHost = true;
+  const auto warmBootCache = hw_->getWarmBootCache();
+  auto vrfIp2HostCitr = warmBootCache->findHost(vrf_, prefix_);
+  if (vrfIp2HostCitr != warmBootCache->vrfAndIP2Host_end()) {
+    // The SDK reports hit bits in the flags of the existing entry, so only
+    // the bits program() sets are compared.
+    const auto& existing = vrfIp2HostCitr->second;
+    if ((existing.l3a_flags & OPENNSL_L3_MULTIPATH) ==
+          (host.l3a_flags & OPENNSL_L3_MULTIPATH) &&
+        existing.l3a_intf == host.l3a_intf) {
+      VLOG(1) << "Host table route for : " << prefix_ << " in vrf : "
+        << vrf_ << " already exists";
+      addHost = false;
+    } else {
+      host.l3a_flags |= OPENNSL_L3_REPLACE;
+      warmBootCache->reprogrammed();
+    }
   }
+  if (addHost) {
+    if (added_) {
+      host.l3a_flags |= OPENNSL_L3_REPLACE;
+    }
+    auto rc = bcmSdkCall(BcmSdkApi::L3_HOST_ADD, opennsl_l3_host_add,
+                         hw_->getUnit(), &host);
+    bcmCheckError(rc, "failed to create a host table route for ", prefix_,
+        " @ ", fwd, " @egress ", egressId);
+    VLOG(3) << "created a host table route for " << prefix_.str()
+      << " @egress " << egressId << " with " << fwd;
+  }
+  if (vrfIp2HostCitr != warmBootCache->vrfAndIP2Host_end()) {
+    warmBootCache->programmed(vrfIp2HostCitr);
+  }
+}
+
+void BcmRoute::deleteHost() noexcept {
+  opennsl_l3_host_t host;
+  initL3HostT(&host);
+  auto rc = bcmSdkCall(BcmSdkApi::L3_HOST_DELETE, opennsl_l3_host_delete,
+                       hw_->getUnit(), &host);
+  if (OPENNSL_FAILURE(rc)) {
+    LOG(ERROR) << "Failed to delete a host table route for " << prefix_
+               << " Error: " << opennsl_errmsg(rc);
+  } else {
+    VLOG(3) << "deleted a host table route for " << prefix_.str();
+  }
+}
+
+void BcmRoute::moveToLpm() {
+  CHECK(added_ && inHostTable_);
+  opennsl_l3_route_t rt;
+  initL3RouteT(&rt);
+  rt.l3a_flags |= flags_;
+  rt.l3a_intf = egressId_;
+  auto rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_ADD, opennsl_l3_route_add,
+                       hw_->getUnit(), &rt);
+  bcmCheckError(rc, "failed to move the route for ", prefix_, "/",
+      static_cast<int>(len_), " from the host table to LPM");
+  deleteHost();
+  inHostTable_ = false;
+  updateCounter();
+  VLOG(1) << "Moved the route for : " << prefix_ << "/"
+    << static_cast<int>(len_) << " in vrf : " << vrf_
+    << " from the host table to LPM";
+}
+
+void BcmRoute::rewriteHwEntry() {
+  CHECK(added_);
+  int rc;
+  if (inHostTable_) {
+    opennsl_l3_host_t host;
+    initL3HostT(&host);
+    host.l3a_flags |= flags_ | OPENNSL_L3_REPLACE;
+    host.l3a_intf = egressId_;
+    rc = bcmSdkCall(BcmSdkApi::L3_HOST_ADD, opennsl_l3_host_add,
+                    hw_->getUnit(), &host);
+  } else {
+    opennsl_l3_route_t rt;
+    initL3RouteT(&rt);
+    rt.l3a_flags |= flags_ | OPENNSL_L3_REPLACE;
+    rt.l3a_intf = egressId_;
+    rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_ADD, opennsl_l3_route_add,
+                    hw_->getUnit(), &rt);
+  }
+  bcmCheckError(rc, "failed to rewrite the route entry for ", prefix_, "/",
+      static_cast<int>(len_), " @egress ", egressId_);
+  VLOG(1) << "Rewrote the HW entry of the route for : " << prefix_ << "/"
+    << static_cast<int>(len_) << " in vrf : " << vrf_;
+}
+
+bool BcmRoute::adopt(const RouteForwardInfo& fwd,
+                     const opennsl_l3_route_t& existing) {
+  CHECK(!added_);
+  // The same flags and egress as program() would set
+  uint32_t flags = prefix_.isV6() ? OPENNSL_L3_IP6 : 0;
+  auto egressId = resolveEgress(fwd, &flags);
+  if (existing.l3a_flags != flags || existing.l3a_intf != egressId) {
+    releaseEgress(fwd);
+    return false;
+  }
+  VLOG(1) << "Adopted route for : " << prefix_ << "/"
+    << static_cast<int>(len_) << " in vrf : " << vrf_;
   fwd_ = fwd;
-  // new nexthop has been stored in fwd_. From now on, it is up to
-  // ~BcmRoute() to clean up such nexthop.
   added_ = true;
+  egressId_ = egressId;
+  flags_ = flags & OPENNSL_L3_MULTIPATH;
+  updateCounter();
+  return true;
+}
+
+void BcmRoute::updateCounter() {
+  if (!added_ || inHostTable_) {
+    return;
+  }
+  auto counters = hw_->writableRouteCounters();
+  uint32_t counterId = 0;
+  bool hasCounter = counters->getCounterId(vrf_, prefix_, len_, &counterId);
+  if (hasCounter == hasCounter_ && counterId == counterId_) {
+    return;
+  }
+  detachCounter();
+  if (!hasCounter) {
+    return;
+  }
+  opennsl_l3_route_t rt;
+  initL3RouteT(&rt);
+  auto rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_STAT_ATTACH,
+                       opennsl_l3_route_stat_attach, hw_->getUnit(), &rt,
+                       counterId);
+  if (rc == OPENNSL_E_EXISTS) {
+    // Attached to a counter of the previous run, before a warm boot
+    rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_STAT_DETACH,
+                    opennsl_l3_route_stat_detach, hw_->getUnit(), &rt);
+    if (OPENNSL_SUCCESS(rc)) {
+      rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_STAT_ATTACH,
+                      opennsl_l3_route_stat_attach, hw_->getUnit(), &rt,
+                      counterId);
+    }
+  }
+  bcmCheckError(rc, "failed to attach the route for ", prefix_, "/",
+      static_cast<int>(len_), " to counter ", counterId);
+  hasCounter_ = true;
+  counterId_ = counterId;
+  counters->routeAttached(counterId, vrf_, prefix_, len_);
+}
+
+void BcmRoute::detachCounter() noexcept {
+  if (!hasCounter_) {
+    return;
+  }
+  opennsl_l3_route_t rt;
+  initL3RouteT(&rt);
+  auto rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_STAT_DETACH,
+                       opennsl_l3_route_stat_detach, hw_->getUnit(), &rt);
+  if (OPENNSL_FAILURE(rc)) {
+    LOG(ERROR) << "Failed to detach the route for " << prefix_ << "/"
+               << static_cast<int>(len_) << " from counter " << counterId_
+               << " Error: " << opennsl_errmsg(rc);
+  }
+  hw_->writableRouteCounters()->routeDetached(counterId_, vrf_, prefix_,
+                                              len_);
+  hasCounter_ = false;
+  counterId_ = 0;
+}
+
+void BcmRoute::moveNexthops(const RouteForwardInfo& fwd) {
+  CHECK(added_);
+  CHECK(fwd.getAction() == RouteForwardAction::NEXTHOPS);
+  fwd_ = fwd;
+}
+
+opennsl_if_t BcmRoute::resolveEgress(const RouteForwardInfo& fwd,
+                                     uint32_t* flags) {
+  auto action = fwd.getAction();
+  if (action == RouteForwardAction::DROP) {
+    return hw_->getDropEgressId();
+  } else if (action == RouteForwardAction::TO_CPU) {
+    return hw_->getToCPUEgressId();
+  }
+  CHECK(action == RouteForwardAction::NEXTHOPS);
+  // need to get an entry from the host table for the forward info
+  const RouteForwardNexthops& nhops = fwd.getNexthops();
+  CHECK_GT(nhops.size(), 0);
+  if (nhops.size() > 1) {         // multipath
+    *flags |= OPENNSL_L3_MULTIPATH;
+  }
+  auto host = hw_->writableHostTable()->incRefOrCreateBcmEcmpHost(
+      vrf_, fwd.getInternedNexthops());
+  return host->getEgressId();
+}
+
+void BcmRoute::releaseEgress(const RouteForwardInfo& fwd) noexcept {
+  const auto& nhops = fwd.getInternedNexthops();
+  if (nhops->size()) {
+    hw_->writableHostTable()->derefBcmEcmpHost(vrf_, nhops);
+  }
 }
 
 BcmRoute::~BcmRoute() {
   if (!added_) {
     return;
   }
+  if (inHostTable_) {
+    deleteHost();
+    releaseEgress(fwd_);
+    return;
+  }
+  detachCounter();
   opennsl_l3_route_t rt;
   opennsl_l3_route_t_init(&rt);
   initL3RouteT(&rt);
-  auto rc = opennsl_l3_route_delete(hw_->getUnit(), &rt);
+  auto rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_DELETE, opennsl_l3_route_delete,
+                       hw_->getUnit(), &rt);
   if (OPENNSL_FAILURE(rc)) {
     LOG(ERROR) << "Failed to delete a route entry for " << prefix_ << "/"
                << static_cast<int>(len_) << " Error: " << opennsl_errmsg(rc);
@@ -159,24 +415,7 @@ BcmRoute::~BcmRoute() {
             << static_cast<int>(len_);
   }
   // decrease reference counter of the host entry
-  const auto& nhops = fwd_.getNexthops();
-  if (nhops.size()) {
-    hw_->writableHostTable()->derefBcmEcmpHost(vrf_, nhops);
-  }
-}
-
-bool BcmRouteTable::Key::operator<(const Key& k2) const {
-  if (vrf < k2.vrf) {
-    return true;
-  } else if (vrf > k2.vrf) {
-    return false;
-  }
-  if (mask < k2.mask) {
-    return true;
-  } else if (mask > k2.mask) {
-    return false;
-  }
-  return network < k2.network;
+  releaseEgress(fwd_);
 }
 
 BcmRouteTable::BcmRouteTable(const BcmSwitch* hw) : hw_(hw) {
@@ -209,32 +448,413 @@ template<typename RouteT>
 void BcmRouteTable::addRoute(opennsl_vrf_t vrf, const RouteT *route) {
   const auto& prefix = route->prefix();
   Key key{folly::IPAddress(prefix.network), prefix.mask, vrf};
-  auto ret = fib_.emplace(key, nullptr);
-  if (ret.second) {
-    SCOPE_FAIL {
-      fib_.erase(ret.first);
-    };
-    ret.first->second.reset(new BcmRoute(hw_, vrf,
-                                        folly::IPAddress(prefix.network),
-                                        prefix.mask));
+  auto* existing = fib_.getIf(key);
+  if (existing) {
+    (*existing)->program(route->getForwardInfo());
+    return;
   }
-  ret.first->second->program(route->getForwardInfo());
+  std::unique_ptr<BcmRoute> newRoute(
+      new BcmRoute(hw_, vrf, key.network, key.mask));
+  newRoute->program(route->getForwardInfo());
+  fib_.emplace(std::move(key), std::move(newRoute));
 }
 
 template<typename RouteT>
 void BcmRouteTable::deleteRoute(opennsl_vrf_t vrf, const RouteT *route) {
   const auto& prefix = route->prefix();
   Key key{folly::IPAddress(prefix.network), prefix.mask, vrf};
-  auto iter = fib_.find(key);
-  if (iter == fib_.end()) {
+  if (fib_.erase(key) == 0) {
     throw FbossError("Failed to delete a non-existing route ", route->str());
   }
-  fib_.erase(iter);
+}
+
+template<typename RouteT>
+void BcmRouteTable::RouteQueue::addRoute(opennsl_vrf_t vrf,
+                                         const RouteT *route) {
+  const auto& prefix = route->prefix();
+  routes_.emplace_back(Key{folly::IPAddress(prefix.network), prefix.mask, vrf},
+                       &route->getForwardInfo());
+}
+
+template<typename RouteT>
+void BcmRouteTable::RouteQueue::deleteRoute(opennsl_vrf_t vrf,
+                                            const RouteT *route) {
+  const auto& prefix = route->prefix();
+  routes_.emplace_back(Key{folly::IPAddress(prefix.network), prefix.mask, vrf},
+                       nullptr);
+}
+
+void BcmRouteTable::queueRoutes(RouteQueue&& queue) {
+  if (queued_.empty()) {
+    queued_.swap(queue.routes_);
+    return;
+  }
+  queued_.insert(queued_.end(),
+                 std::make_move_iterator(queue.routes_.begin()),
+                 std::make_move_iterator(queue.routes_.end()));
+  queue.routes_.clear();
+}
+
+void BcmRouteTable::orderMakeBeforeBreak() {
+  // With FIB compression a route can be queued more than once, and only
+  // its last change must stick once adds and deletes are reordered.
+  OpenHashMap<Key, size_t, KeyHash> lastChange;
+  lastChange.reserve(queued_.size());
+  for (size_t i = 0; i < queued_.size(); ++i) {
+    lastChange[queued_[i].key] = i;
+  }
+  if (lastChange.size() < queued_.size()) {
+    std::vector<QueuedRoute> unique;
+    unique.reserve(lastChange.size());
+    for (size_t i = 0; i < queued_.size(); ++i) {
+      if (*lastChange.getIf(queued_[i].key) == i) {
+        unique.push_back(queued_[i]);
+      }
+    }
+    queued_.swap(unique);
+  }
+  auto firstDelete = std::stable_partition(
+      queued_.begin(), queued_.end(),
+      [](const QueuedRoute& queued) { return queued.fwd != nullptr; });
+  std::stable_sort(queued_.begin(), firstDelete,
+                   [](const QueuedRoute& r1, const QueuedRoute& r2) {
+                     return r1.key.mask > r2.key.mask;
+                   });
+}
+
+size_t BcmRouteTable::programQueuedRoutes(RouteOrder order,
+                                          bool addsFollow,
+                                          Journal* journal) {
+  journal_ = journal;
+  SCOPE_EXIT {
+    queued_.clear();
+    journal_ = nullptr;
+  };
+  if (order == RouteOrder::MAKE_BEFORE_BREAK) {
+    orderMakeBeforeBreak();
+  }
+  size_t numAdded = 0;
+  for (const auto& queued : queued_) {
+    // Nothing has changed yet, so this records every queued route as it
+    // was before the call
+    journalRoute(queued.key);
+    if (queued.fwd) {
+      ++numAdded;
+      // The queued forward info replaces any a rejected route was waiting
+      // with, even if the route is then adopted or moved.
+      if (!rejected_.empty()) {
+        rejected_.erase(queued.key);
+      }
+    }
+  }
+  size_t addsLeft = numAdded;
+  uint64_t deletesBeforeAdds = 0;
+  for (const auto& queued : queued_) {
+    if (queued.fwd) {
+      --addsLeft;
+    } else if (addsLeft > 0 || addsFollow) {
+      ++deletesBeforeAdds;
+    }
+  }
+  BcmStats::get()->routeDeletesOrdered(
+      deletesBeforeAdds, queued_.size() - numAdded - deletesBeforeAdds);
+  // Routes that are only being changed are counted too, which at worst
+  // reserves room for one extra queue's worth of entries.
+  fib_.reserve(fib_.size() + numAdded);
+  adoptQueuedRoutes();
+  moveQueuedNexthopGroups();
+  for (const auto& queued : queued_) {
+    if (!queued.done) {
+      programQueuedRoute(queued);
+    }
+  }
+  if (!rejected_.empty() && numAdded < queued_.size()) {
+    retryRejectedRoutes();
+  }
+  BcmStats::rejectedRoutes(rejected_.size());
+  return queued_.size();
+}
+
+void BcmRouteTable::journalRoute(const Key& key) {
+  if (!journal_) {
+    return;
+  }
+  Journal::Entry entry(key);
+  auto* existing = fib_.getIf(key);
+  if (existing && (*existing)->isProgrammed()) {
+    entry.programmed = true;
+    entry.fwd = (*existing)->getForwardInfo();
+  }
+  auto* rejected = rejected_.getIf(key);
+  if (rejected) {
+    entry.rejected = true;
+    entry.rejectedFwd = *rejected;
+  }
+  journal_->entries_.push_back(std::move(entry));
+}
+
+void BcmRouteTable::rollback(const Journal& journal) {
+  // A route recorded more than once was recorded the same way each time,
+  // so the last change to it is undone last.
+  size_t failed = 0;
+  for (auto iter = journal.entries_.rbegin();
+       iter != journal.entries_.rend(); ++iter) {
+    const auto& entry = *iter;
+    try {
+      rejected_.erase(entry.key);
+      if (entry.programmed) {
+        programRoute(entry.key, entry.fwd);
+      } else {
+        fib_.erase(entry.key);
+      }
+      if (entry.rejected) {
+        rejected_[entry.key] = entry.rejectedFwd;
+      }
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "failed to roll back the route for " << entry.key.network
+                 << "/" << static_cast<int>(entry.key.mask) << " @ vrf "
+                 << entry.key.vrf << ": " << folly::exceptionStr(ex);
+      ++failed;
+    }
+  }
+  if (failed) {
+    throw FbossError("failed to roll back ", failed, " of ",
+                     journal.entries_.size(), " route changes");
+  }
+}
+
+void BcmRouteTable::releaseHostEntry(opennsl_vrf_t vrf,
+                                     const folly::IPAddress& addr) {
+  Key key{addr, static_cast<uint8_t>(addr.bitCount()), vrf};
+  auto* route = fib_.getIf(key);
+  if (route && (*route)->isInHostTable()) {
+    (*route)->moveToLpm();
+  }
+}
+
+void BcmRouteTable::updateCounters() {
+  for (const auto& entry : fib_) {
+    entry.second->updateCounter();
+  }
+}
+
+void BcmRouteTable::adoptQueuedRoutes() {
+  auto* warmBootCache = hw_->getWarmBootCache();
+  if (!warmBootCache->hasRoutes()) {
+    return;
+  }
+  size_t numAdopted = 0;
+  for (auto& queued : queued_) {
+    const auto& key = queued.key;
+    // Only new routes can be adopted.  Anything else, including a route
+    // that is deleted and added again later in the queue, is programmed
+    // in order as usual.
+    if (!queued.fwd || fib_.getIf(key)) {
+      continue;
+    }
+    auto cached = warmBootCache->findRoute(key.vrf, key.network, key.mask);
+    if (cached == warmBootCache->vrfAndPrefix2Route_end()) {
+      continue;
+    }
+    std::unique_ptr<BcmRoute> route(
+        new BcmRoute(hw_, key.vrf, key.network, key.mask));
+    if (!route->adopt(*queued.fwd, cached->second)) {
+      continue;
+    }
+    warmBootCache->programmed(cached);
+    fib_.emplace(key, std::move(route));
+    queued.done = true;
+    ++numAdopted;
+  }
+  VLOG(1) << "Adopted " << numAdopted << " of " << queued_.size()
+    << " queued routes from the warm boot cache";
+}
+
+void BcmRouteTable::moveQueuedNexthopGroups() {
+  auto isMultipath = [](const RouteForwardInfo& fwd) {
+    return fwd.getAction() == RouteForwardAction::NEXTHOPS &&
+      fwd.getNexthops().size() > 1;
+  };
+  typedef std::pair<QueuedRoute*, BcmRoute*> Change;
+  // Only routes that move from one multipath group to another can move
+  // along with their group: anything else needs a new egress ID or flags
+  // in the route entry.
+  std::vector<Change> changes;
+  for (auto& queued : queued_) {
+    if (queued.done || !queued.fwd || !isMultipath(*queued.fwd)) {
+      continue;
+    }
+    auto* existing = fib_.getIf(queued.key);
+    if (!existing || !(*existing)->isProgrammed()) {
+      continue;
+    }
+    const auto& fwd = (*existing)->getForwardInfo();
+    if (isMultipath(fwd) &&
+        fwd.getInternedNexthops() != queued.fwd->getInternedNexthops()) {
+      changes.emplace_back(&queued, existing->get());
+    }
+  }
+  if (changes.empty()) {
+    return;
+  }
+
+  // Routes that are queued more than once are programmed in order as
+  // usual, and so is the rest of their group
+  OpenHashMap<Key, uint32_t, KeyHash> numQueued;
+  numQueued.reserve(changes.size());
+  for (const auto& change : changes) {
+    numQueued.emplace(change.first->key, 0);
+  }
+  for (const auto& queued : queued_) {
+    auto* count = numQueued.getIf(queued.key);
+    if (count) {
+      ++*count;
+    }
+  }
+
+  // Group the changes by the nexthop group the routes use now
+  struct GroupMove {
+    InternedForwardNexthops to;
+    std::vector<Change> routes;
+    bool movable{true};
+  };
+  typedef std::pair<opennsl_vrf_t, InternedForwardNexthops> GroupKey;
+  struct GroupKeyHash {
+    size_t operator()(const GroupKey& key) const {
+      return folly::hash::hash_combine(key.first, key.second.hash());
+    }
+  };
+  OpenHashMap<GroupKey, GroupMove, GroupKeyHash> moves;
+  for (const auto& change : changes) {
+    const auto& to = change.first->fwd->getInternedNexthops();
+    auto& move = moves[GroupKey{
+        change.first->key.vrf,
+        change.second->getForwardInfo().getInternedNexthops()}];
+    if (move.routes.empty()) {
+      move.to = to;
+    } else if (move.to != to) {
+      move.movable = false;
+    }
+    if (*numQueued.getIf(change.first->key) > 1) {
+      move.movable = false;
+    }
+    move.routes.push_back(change);
+  }
+
+  // Move each group whose routes all move to the same new nexthops, and
+  // then the routes along with it
+  auto* hostTable = hw_->writableHostTable();
+  size_t numGroups = 0;
+  size_t numRoutes = 0;
+  for (const auto& entry : moves) {
+    const auto& group = entry.first;
+    const auto& move = entry.second;
+    if (!move.movable ||
+        move.routes.size() != hostTable->getNumRoutes(group.first,
+                                                      group.second) ||
+        !hostTable->moveBcmEcmpHost(group.first, group.second, move.to)) {
+      continue;
+    }
+    for (const auto& change : move.routes) {
+      change.second->moveNexthops(*change.first->fwd);
+      change.first->done = true;
+    }
+    ++numGroups;
+    numRoutes += move.routes.size();
+    BcmStats::get()->nexthopGroupMoved(move.routes.size());
+  }
+  if (numGroups) {
+    VLOG(1) << "Moved " << numGroups << " nexthop groups along with "
+      << numRoutes << " of their routes";
+  }
+}
+
+void BcmRouteTable::programQueuedRoute(const QueuedRoute& queued) {
+  const auto& key = queued.key;
+  if (!queued.fwd) {
+    // ~BcmRoute() removes the route from the HW.  A new route that did not
+    // fit in HW is only in rejected_.
+    if (fib_.erase(key) + rejected_.erase(key) == 0) {
+      throw FbossError("Failed to delete a non-existing route ",
+                       key.network, "/", static_cast<int>(key.mask),
+                       " @ vrf ", key.vrf);
+    }
+    return;
+  }
+  if (!programRoute(key, *queued.fwd)) {
+    LOG(WARNING) << "No room in HW for the route for " << key.network << "/"
+                 << static_cast<int>(key.mask) << " @ vrf " << key.vrf
+                 << ", will retry once routes are deleted";
+    BcmStats::get()->routesRejected(1);
+  }
+}
+
+bool BcmRouteTable::programRoute(const Key& key,
+                                 const RouteForwardInfo& fwd) {
+  try {
+    auto* existing = fib_.getIf(key);
+    if (existing) {
+      (*existing)->program(fwd);
+      return true;
+    }
+    std::unique_ptr<BcmRoute> route(
+        new BcmRoute(hw_, key.vrf, key.network, key.mask));
+    route->program(fwd);
+    fib_.emplace(key, std::move(route));
+  } catch (const BcmError& error) {
+    if (!hw_->getResourceManager()->shouldRejectOnError(error)) {
+      throw;
+    }
+    // BcmRoute::program() leaves an existing route as it was
+    rejected_[key] = fwd;
+    return false;
+  }
+  return true;
+}
+
+void BcmRouteTable::retryRejectedRoutes() {
+  std::vector<std::pair<Key, RouteForwardInfo>> routes;
+  routes.reserve(rejected_.size());
+  for (const auto& entry : rejected_) {
+    journalRoute(entry.first);
+    routes.push_back(entry);
+  }
+  rejected_.clear();
+  if (hw_->getResourceManager()->getOverflowPolicy() ==
+      BcmResourceManager::OverflowPolicy::PREFER_SHORTER) {
+    std::stable_sort(routes.begin(), routes.end(),
+                     [](const std::pair<Key, RouteForwardInfo>& r1,
+                        const std::pair<Key, RouteForwardInfo>& r2) {
+                       return r1.first.mask < r2.first.mask;
+                     });
+  }
+  // Once a route does not fit, the rest wait for the next deletions
+  bool full = false;
+  size_t numProgrammed = 0;
+  for (const auto& route : routes) {
+    if (full) {
+      rejected_[route.first] = route.second;
+    } else if (programRoute(route.first, route.second)) {
+      ++numProgrammed;
+    } else {
+      full = true;
+    }
+  }
+  VLOG(1) << "Programmed " << numProgrammed << " of " << routes.size()
+    << " rejected routes";
 }
 
 template void BcmRouteTable::addRoute(opennsl_vrf_t, const RouteV4 *);
 template void BcmRouteTable::addRoute(opennsl_vrf_t, const RouteV6 *);
 template void BcmRouteTable::deleteRoute(opennsl_vrf_t, const RouteV4 *);
 template void BcmRouteTable::deleteRoute(opennsl_vrf_t, const RouteV6 *);
+template void BcmRouteTable::RouteQueue::addRoute(opennsl_vrf_t,
+                                                  const RouteV4 *);
+template void BcmRouteTable::RouteQueue::addRoute(opennsl_vrf_t,
+                                                  const RouteV6 *);
+template void BcmRouteTable::RouteQueue::deleteRoute(opennsl_vrf_t,
+                                                     const RouteV4 *);
+template void BcmRouteTable::RouteQueue::deleteRoute(opennsl_vrf_t,
+                                                     const RouteV6 *);
 
 }}
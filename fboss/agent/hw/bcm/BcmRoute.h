@@ -16,9 +16,11 @@ extern "C" {
 
 #include <folly/IPAddress.h>
 #include "fboss/agent/types.h"
+#include "fboss/agent/state/OpenHashMap.h"
 #include "fboss/agent/state/RouteForwardInfo.h"
 
-#include <boost/container/flat_map.hpp>
+#include <folly/Hash.h>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
@@ -34,20 +36,127 @@ class BcmRoute {
            const folly::IPAddress& addr, uint8_t len);
   ~BcmRoute();
   void program(const RouteForwardInfo& fwd);
+  /*
+   * Take over the HW entry left by the previous run, as found in the warm
+   * boot cache, if it already forwards the way fwd needs.  This only
+   * resolves the egress and compares it with the entry, without building a
+   * new entry or touching the HW.
+   *
+   * Returns false, leaving the route unprogrammed, if the entry differs.
+   */
+  bool adopt(const RouteForwardInfo& fwd, const opennsl_l3_route_t& existing);
+  /*
+   * Take on fwd, whose nexthops are the ones the route's nexthop group was
+   * just moved to by BcmHostTable::moveBcmEcmpHost().  The route keeps its
+   * HW entry, which points to the same egress, and its reference on the
+   * group.
+   */
+  void moveNexthops(const RouteForwardInfo& fwd);
+  const RouteForwardInfo& getForwardInfo() const {
+    return fwd_;
+  }
+  bool isProgrammed() const {
+    return added_;
+  }
+  /*
+   * Whether the route is in the L3 host table rather than the LPM table.
+   *
+   * With --bcm_host_table_routes, a full length route (/32 or /128) goes in
+   * the host table when it is first programmed, unless there is a host
+   * entry for the address already.  The route stays in the table it was
+   * placed in until moveToLpm() is called.
+   */
+  bool isInHostTable() const {
+    return inHostTable_;
+  }
+  /*
+   * Move the route from the host table to the LPM table, to make room for
+   * a host entry for the same address.  The LPM entry is added before the
+   * host entry is deleted, so the address keeps forwarding.
+   */
+  void moveToLpm();
+  /*
+   * The egress the route's HW entry points to, and whether it is an ECMP
+   * egress, for checking the entry against the HW.
+   */
+  opennsl_if_t getEgressId() const {
+    return egressId_;
+  }
+  bool isMultipath() const {
+    return flags_ & OPENNSL_L3_MULTIPATH;
+  }
+  /*
+   * Write the route's HW entry over what the HW has for it, after it was
+   * found to be different.
+   */
+  void rewriteHwEntry();
+  /*
+   * Attach the route's LPM entry to the counter of its route class, if it
+   * has one, detaching it from the counter it had.  Called whenever the
+   * entry is added, and when the route classes change.
+   */
+  void updateCounter();
+  static void initL3RouteT(opennsl_l3_route_t* rt, opennsl_vrf_t vrf,
+                           const folly::IPAddress& prefix, uint8_t len);
  private:
   // no copy or assign
   BcmRoute(const BcmRoute &) = delete;
   BcmRoute& operator=(const BcmRoute &) = delete;
+  // Get the egress to program for fwd, adding *flags the route needs.  This
+  // takes a reference on the ECMP host, which releaseEgress() drops.
+  opennsl_if_t resolveEgress(const RouteForwardInfo& fwd, uint32_t* flags);
+  void releaseEgress(const RouteForwardInfo& fwd) noexcept;
+  // Whether a route programmed now could go in the host table
+  bool canUseHostTable() const;
+  void programLpm(const RouteForwardInfo& fwd, opennsl_if_t egressId,
+                  uint32_t flags);
+  void programHost(const RouteForwardInfo& fwd, opennsl_if_t egressId,
+                   uint32_t flags);
+  void deleteHost() noexcept;
+  void detachCounter() noexcept;
   const BcmSwitch* hw_;
   opennsl_vrf_t vrf_;
   folly::IPAddress prefix_;
   uint8_t len_;
   RouteForwardInfo fwd_;
   bool added_{false};           // if the route added to HW or not
+  bool inHostTable_{false};
+  // The egress and flags of the HW entry, kept to move it to LPM
+  opennsl_if_t egressId_{-1};
+  uint32_t flags_{0};
+  // The route class counter the LPM entry is attached to, if any
+  bool hasCounter_{false};
+  uint32_t counterId_{0};
   void initL3RouteT(opennsl_l3_route_t* rt) const;
+  void initL3HostT(opennsl_l3_host_t* host) const;
 };
 
 class BcmRouteTable {
+ private:
+  struct Key {
+    folly::IPAddress network;
+    uint8_t mask;
+    opennsl_vrf_t vrf;
+    bool operator==(const Key& k2) const {
+      return vrf == k2.vrf && mask == k2.mask && network == k2.network;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return folly::hash::hash_combine(key.vrf, key.mask, key.network.hash());
+    }
+  };
+  struct QueuedRoute {
+    QueuedRoute(const Key& key, const RouteForwardInfo* fwd)
+      : key(key), fwd(fwd) {}
+    Key key;
+    // The forward info to program, or nullptr to delete the route
+    const RouteForwardInfo* fwd;
+    // Set once the route was taken over from the warm boot cache, or moved
+    // along with its nexthop group
+    bool done{false};
+  };
+
  public:
   explicit BcmRouteTable(const BcmSwitch* hw);
   ~BcmRouteTable();
@@ -66,15 +175,159 @@ class BcmRouteTable {
   void addRoute(opennsl_vrf_t vrf, const RouteT *route);
   template<typename RouteT>
   void deleteRoute(opennsl_vrf_t vrf, const RouteT *route);
- private:
-  struct Key {
-    folly::IPAddress network;
-    uint8_t mask;
-    opennsl_vrf_t vrf;
-    bool operator<(const Key& k2) const;
+
+  /*
+   * Route changes to be applied by programQueuedRoutes(), in the order
+   * they were added.
+   *
+   * A RouteQueue does not touch the route table, so the changes of
+   * different VRFs can be queued from different threads, each in a queue
+   * of its own, and then handed to the table with queueRoutes().
+   *
+   * The route objects must stay alive until programQueuedRoutes() is
+   * called.
+   */
+  class RouteQueue {
+   public:
+    template<typename RouteT>
+    void addRoute(opennsl_vrf_t vrf, const RouteT *route);
+    template<typename RouteT>
+    void deleteRoute(opennsl_vrf_t vrf, const RouteT *route);
+    bool empty() const {
+      return routes_.empty();
+    }
+
+   private:
+    friend class BcmRouteTable;
+    std::vector<QueuedRoute> routes_;
+  };
+  /*
+   * Queue the changes in queue after the ones already queued.
+   */
+  void queueRoutes(RouteQueue&& queue);
+
+  enum class RouteOrder {
+    // In the order the changes were queued
+    QUEUED,
+    /*
+     * Make before break: all of the adds and changes first, more specific
+     * routes before less specific ones, and only then the deletes.
+     *
+     * A route split off a changed one is then in place before the changed
+     * one moves, and the traffic of a deleted route falls through to a
+     * covering route that already forwards the new way.  Each route
+     * creates its new egress or ECMP object before it points at it, and
+     * releases the old one after, so the old objects go last.  The price
+     * is that the new routes need room in HW while the old ones are still
+     * there.
+     */
+    MAKE_BEFORE_BREAK,
   };
+
+  /*
+   * The routes a programQueuedRoutes() call is about to change, as they
+   * were before, for rollback().
+   */
+  class Journal {
+   public:
+    bool empty() const {
+      return entries_.empty();
+    }
+
+   private:
+    friend class BcmRouteTable;
+    struct Entry {
+      explicit Entry(const Key& key) : key(key) {}
+      Key key;
+      // The forward info the route was programmed with, if it was
+      bool programmed{false};
+      RouteForwardInfo fwd;
+      // The forward info the route was rejected with, if it was
+      bool rejected{false};
+      RouteForwardInfo rejectedFwd;
+    };
+    std::vector<Entry> entries_;
+  };
+
+  /*
+   * Apply all queued route changes to the HW, in the given order.
+   *
+   * Room for all of the queued routes is reserved in the FIB map up front,
+   * so the initial sync of a full table rehashes it at most once.
+   *
+   * While the warm boot cache still holds routes, the queued routes are
+   * first joined with it in one pass, and the routes the HW already has
+   * are adopted as they are.  Then, when all of the routes of a nexthop
+   * group move to the same new nexthops, the group itself is moved, so
+   * only the group changes in HW.  Only the rest of the routes go through
+   * BcmRoute::program().
+   *
+   * Routes that do not fit in HW are rejected, if the table overflow policy
+   * says so, instead of failing the update.  They are retried whenever a
+   * later call deletes routes.
+   *
+   * Deletes programmed while adds or changes of the same state update are
+   * still to come, in this call or after it when addsFollow is set, are
+   * counted as bcm.route.deletes_before_adds, since their traffic may be
+   * dropped meanwhile.  The others are counted as
+   * bcm.route.deletes_after_adds.
+   *
+   * The queue is always emptied, even if programming fails part way through.
+   * With a journal, the routes are recorded in it before they change.
+   * Returns the number of route changes applied.
+   */
+  size_t programQueuedRoutes(RouteOrder order, bool addsFollow,
+                             Journal* journal = nullptr);
+
+  /*
+   * Put the routes in journal back the way they were before the
+   * programQueuedRoutes() call that filled it, even if that call failed
+   * part way through.
+   */
+  void rollback(const Journal& journal);
+
+  /*
+   * Move the full length route for addr, if it is in the host table, to
+   * the LPM table, so that a host entry can be added for addr.  This is
+   * called before BcmHost adds its host entry.
+   */
+  void releaseHostEntry(opennsl_vrf_t vrf, const folly::IPAddress& addr);
+
+  /*
+   * Attach every route to the counter of its route class, after the
+   * classes changed.
+   */
+  void updateCounters();
+
+ private:
+  // Put queued_ in make before break order, keeping only the last change
+  // queued for each route
+  void orderMakeBeforeBreak();
+  void adoptQueuedRoutes();
+  void moveQueuedNexthopGroups();
+  void programQueuedRoute(const QueuedRoute& queued);
+  // Program the route with fwd, adding it to rejected_ instead if it does
+  // not fit in HW and the overflow policy is to reject it.  Returns false
+  // if the route was rejected.
+  bool programRoute(const Key& key, const RouteForwardInfo& fwd);
+  void retryRejectedRoutes();
+  // Record the route in journal_, as it is now
+  void journalRoute(const Key& key);
+
   const BcmSwitch *hw_;
-  boost::container::flat_map<Key, std::unique_ptr<BcmRoute>> fib_;
+  /*
+   * Each BcmRoute is allocated separately, so pointers returned by
+   * getBcmRoute() stay valid when the map grows.
+   */
+  OpenHashMap<Key, std::unique_ptr<BcmRoute>, KeyHash> fib_;
+  std::vector<QueuedRoute> queued_;
+  /*
+   * The forward info of each route left out of HW for lack of room.  A
+   * route that was already in HW keeps forwarding as it did meanwhile.
+   */
+  OpenHashMap<Key, RouteForwardInfo, KeyHash> rejected_;
+  // The journal of the programQueuedRoutes() call in progress, if any
+  Journal* journal_{nullptr};
 };
 
 }}
@@ -0,0 +1,223 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmRouteCounters.h"
+
+#include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmRoute.h"
+#include "fboss/agent/hw/bcm/BcmSwitch.h"
+
+#include <folly/Conv.h>
+#include <folly/Memory.h>
+#include <folly/ScopeGuard.h>
+#include <glog/logging.h>
+
+#include <ctime>
+
+extern "C" {
+#include <opennsl/l3.h>
+#include <opennsl/stat.h>
+}
+
+namespace facebook { namespace fboss {
+
+using std::lock_guard;
+
+namespace {
+
+std::string statName(const std::string& className, const char* stat) {
+  return folly::to<std::string>("route_class.", className, ".", stat);
+}
+
+} // unnamed namespace
+
+BcmRouteCounters::RouteClass::RouteClass(const std::string& name)
+  : inPkts(statName(name, "in_pkts"), stats::SUM, stats::RATE),
+    inBytes(statName(name, "in_bytes"), stats::SUM, stats::RATE) {
+}
+
+BcmRouteCounters::BcmRouteCounters(const BcmSwitch* hw) : hw_(hw) {
+}
+
+BcmRouteCounters::~BcmRouteCounters() {
+  // The routes are gone by now, so nothing is attached to the counters
+  for (const auto& routeClass : classes_) {
+    destroyCounter(routeClass->counterId);
+  }
+  for (const auto& routeClass : unused_) {
+    destroyCounter(routeClass->counterId);
+  }
+}
+
+void BcmRouteCounters::setClasses(
+    const std::vector<RouteCounterConfig>& classes) {
+  auto takeClass = [](std::vector<std::unique_ptr<RouteClass>>& from,
+                      const std::string& name)
+      -> std::unique_ptr<RouteClass> {
+    for (auto& routeClass : from) {
+      if (routeClass && routeClass->config.name == name) {
+        return std::move(routeClass);
+      }
+    }
+    return nullptr;
+  };
+
+  // Create the counters of the new classes first, since that may fail
+  std::vector<std::unique_ptr<RouteClass>> created;
+  SCOPE_FAIL {
+    for (const auto& routeClass : created) {
+      destroyCounter(routeClass->counterId);
+    }
+  };
+  for (const auto& config : classes) {
+    bool exists = false;
+    for (const auto& routeClass : classes_) {
+      exists = exists || routeClass->config.name == config.name;
+    }
+    if (exists) {
+      continue;
+    }
+    auto routeClass = folly::make_unique<RouteClass>(config.name);
+    uint32_t numEntries;
+    auto rv = opennsl_stat_group_create(
+        hw_->getUnit(), opennslStatObjectIngL3Route,
+        opennslStatGroupModeSingle, &routeClass->counterId, &numEntries);
+    bcmCheckError(rv, "failed to create the counter of route class ",
+                  config.name);
+    VLOG(1) << "Created counter " << routeClass->counterId
+            << " for route class " << config.name;
+    created.push_back(std::move(routeClass));
+  }
+
+  lock_guard<std::mutex> g(lock_);
+  std::vector<std::unique_ptr<RouteClass>> newClasses;
+  for (const auto& config : classes) {
+    auto routeClass = takeClass(classes_, config.name);
+    if (!routeClass) {
+      routeClass = takeClass(created, config.name);
+    }
+    routeClass->config = config;
+    newClasses.push_back(std::move(routeClass));
+  }
+  for (auto& routeClass : classes_) {
+    if (routeClass) {
+      unused_.push_back(std::move(routeClass));
+    }
+  }
+  classes_.swap(newClasses);
+}
+
+void BcmRouteCounters::destroyUnused() {
+  std::vector<std::unique_ptr<RouteClass>> unused;
+  {
+    lock_guard<std::mutex> g(lock_);
+    unused.swap(unused_);
+  }
+  for (const auto& routeClass : unused) {
+    if (!routeClass->routes.empty()) {
+      LOG(ERROR) << routeClass->routes.size() << " routes are still "
+                 << "attached to the counter of route class "
+                 << routeClass->config.name;
+    }
+    destroyCounter(routeClass->counterId);
+  }
+}
+
+void BcmRouteCounters::destroyCounter(uint32_t counterId) noexcept {
+  auto rv = opennsl_stat_group_destroy(hw_->getUnit(), counterId);
+  if (OPENNSL_FAILURE(rv)) {
+    LOG(ERROR) << "Failed to destroy route counter " << counterId << ": "
+               << opennsl_errmsg(rv);
+  }
+}
+
+bool BcmRouteCounters::getCounterId(opennsl_vrf_t vrf,
+                                    const folly::IPAddress& prefix,
+                                    uint8_t len, uint32_t* counterId) const {
+  lock_guard<std::mutex> g(lock_);
+  for (const auto& routeClass : classes_) {
+    if (BcmSwitch::getBcmVrfId(routeClass->config.router) != vrf) {
+      continue;
+    }
+    for (const auto& network : routeClass->config.prefixes) {
+      if (network.first.isV4() == prefix.isV4() &&
+          network.second <= len &&
+          prefix.inSubnet(network.first, network.second)) {
+        *counterId = routeClass->counterId;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+BcmRouteCounters::RouteClass* BcmRouteCounters::findClass(
+    uint32_t counterId) {
+  for (const auto& routeClass : classes_) {
+    if (routeClass->counterId == counterId) {
+      return routeClass.get();
+    }
+  }
+  for (const auto& routeClass : unused_) {
+    if (routeClass->counterId == counterId) {
+      return routeClass.get();
+    }
+  }
+  return nullptr;
+}
+
+void BcmRouteCounters::routeAttached(uint32_t counterId, opennsl_vrf_t vrf,
+                                     const folly::IPAddress& prefix,
+                                     uint8_t len) {
+  lock_guard<std::mutex> g(lock_);
+  auto routeClass = findClass(counterId);
+  CHECK(routeClass) << "no route class has counter " << counterId;
+  routeClass->routes.emplace(vrf, prefix, len);
+}
+
+void BcmRouteCounters::routeDetached(uint32_t counterId, opennsl_vrf_t vrf,
+                                     const folly::IPAddress& prefix,
+                                     uint8_t len) {
+  lock_guard<std::mutex> g(lock_);
+  auto routeClass = findClass(counterId);
+  if (routeClass) {
+    routeClass->routes.erase(RouteKey(vrf, prefix, len));
+  }
+}
+
+void BcmRouteCounters::updateStats() {
+  auto now = time(nullptr);
+  lock_guard<std::mutex> g(lock_);
+  for (const auto& routeClass : classes_) {
+    if (routeClass->routes.empty()) {
+      continue;
+    }
+    const auto& route = *routeClass->routes.begin();
+    opennsl_l3_route_t rt;
+    BcmRoute::initL3RouteT(&rt, std::get<0>(route), std::get<1>(route),
+                           std::get<2>(route));
+    uint64_t pkts;
+    uint64_t bytes;
+    auto rv = opennsl_l3_route_stat_get(hw_->getUnit(), &rt,
+                                        opennslL3RouteInPackets, &pkts);
+    if (OPENNSL_SUCCESS(rv)) {
+      rv = opennsl_l3_route_stat_get(hw_->getUnit(), &rt,
+                                     opennslL3RouteInBytes, &bytes);
+    }
+    if (OPENNSL_FAILURE(rv)) {
+      LOG(ERROR) << "Failed to read the counter of route class "
+                 << routeClass->config.name << ": " << opennsl_errmsg(rv);
+      continue;
+    }
+    routeClass->inPkts.updateValue(now, pkts);
+    routeClass->inBytes.updateValue(now, bytes);
+  }
+}
+
+}} // facebook::fboss
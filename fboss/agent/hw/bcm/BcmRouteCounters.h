@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+extern "C" {
+#include <opennsl/types.h>
+}
+
+#include "common/stats/MonotonicCounter.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/IPAddress.h>
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class BcmSwitch;
+
+/*
+ * BcmRouteCounters counts the traffic of the route classes in the config
+ * (see cfg::RouteCounter) in HW.
+ *
+ * Each class has one ingress L3 route flex counter, which every route of
+ * the class is attached to, so the number of counters grows with the
+ * classes rather than the routes.  A route belongs to the first class with
+ * a prefix that covers it, in the VRF of the class.  Only LPM routes can
+ * have a counter: routes in the L3 host table are not counted.
+ *
+ * The classes change with the state, under the HW update lock, while the
+ * counters are read by updateStats() from the stats thread, so the object
+ * has a lock of its own.
+ */
+class BcmRouteCounters {
+ public:
+  explicit BcmRouteCounters(const BcmSwitch* hw);
+  ~BcmRouteCounters();
+
+  /*
+   * Switch to the given classes.  A class keeps its HW counter, and its
+   * totals, if its name stays the same.  The counters of the classes that
+   * are gone stay in HW until destroyUnused(), so the routes must be
+   * attached to their new counters before that.
+   */
+  void setClasses(const std::vector<RouteCounterConfig>& classes);
+  /*
+   * Free the HW counters of the classes dropped by setClasses().
+   */
+  void destroyUnused();
+
+  /*
+   * The counter the route should be attached to.  Returns false if the
+   * route is not in any class.
+   */
+  bool getCounterId(opennsl_vrf_t vrf, const folly::IPAddress& prefix,
+                    uint8_t len, uint32_t* counterId) const;
+  /*
+   * Called by BcmRoute after it attached itself to the counter, or
+   * detached itself from it.
+   */
+  void routeAttached(uint32_t counterId, opennsl_vrf_t vrf,
+                     const folly::IPAddress& prefix, uint8_t len);
+  void routeDetached(uint32_t counterId, opennsl_vrf_t vrf,
+                     const folly::IPAddress& prefix, uint8_t len);
+
+  /*
+   * Read the counter of each class, and export it as
+   * route_class.<name>.in_pkts and route_class.<name>.in_bytes.
+   */
+  void updateStats();
+
+ private:
+  typedef std::tuple<opennsl_vrf_t, folly::IPAddress, uint8_t> RouteKey;
+  struct RouteClass {
+    explicit RouteClass(const std::string& name);
+
+    RouteCounterConfig config;
+    uint32_t counterId{0};
+    // The routes attached to the counter.  The SDK reads a counter through
+    // a route attached to it, so the first one is used.
+    std::set<RouteKey> routes;
+    stats::MonotonicCounter inPkts;
+    stats::MonotonicCounter inBytes;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  BcmRouteCounters(BcmRouteCounters const &) = delete;
+  BcmRouteCounters& operator=(BcmRouteCounters const &) = delete;
+
+  RouteClass* findClass(uint32_t counterId);
+  void destroyCounter(uint32_t counterId) noexcept;
+
+  const BcmSwitch* hw_;
+  mutable std::mutex lock_;
+  // In the order of the config, since the first covering class wins
+  std::vector<std::unique_ptr<RouteClass>> classes_;
+  // The classes dropped by setClasses(), until destroyUnused()
+  std::vector<std::unique_ptr<RouteClass>> unused_;
+};
+
+}} // facebook::fboss
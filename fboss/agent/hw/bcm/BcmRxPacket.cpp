@@ -43,14 +43,22 @@ BcmRxPacket::BcmRxPacket(const opennsl_pkt_t* pkt)
       pkt->pkt_len,                    // uint32_t capacity
       freeRxBuf,                       // FreeFunction freeFn
       reinterpret_cast<void*>(unit_)); // void* userData
+  setRxBuffer();
   srcPort_ = PortID(pkt->src_port);
   srcVlan_ = VlanID(pkt->vlan);
   len_ = pkt->pkt_len;
+
+  // Packets that are both sampled and trapped still need to be processed
+  opennsl_rx_reasons_t otherReasons = pkt->rx_reasons;
+  OPENNSL_RX_REASON_CLEAR(otherReasons, opennslRxReasonSampleSource);
+  OPENNSL_RX_REASON_CLEAR(otherReasons, opennslRxReasonSampleDest);
+  sampled_ = OPENNSL_RX_REASON_IS_NULL(otherReasons) &&
+    !OPENNSL_RX_REASON_IS_NULL(pkt->rx_reasons);
 }
 
 BcmRxPacket::~BcmRxPacket() {
   // Nothing to do.  The IOBuf destructor will call freeRxBuf()
-  // to free the packet data
+  // to free the packet data, unless it was copied out already
 }
 
 }} // facebook::fboss
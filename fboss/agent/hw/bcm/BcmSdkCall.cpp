@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmSdkCall.h"
+
+#include <glog/logging.h>
+
+namespace facebook { namespace fboss {
+
+const char* getBcmSdkApiName(BcmSdkApi api) {
+  switch (api) {
+  case BcmSdkApi::L3_ROUTE_ADD:
+    return "l3_route_add";
+  case BcmSdkApi::L3_ROUTE_DELETE:
+    return "l3_route_delete";
+  case BcmSdkApi::L3_ROUTE_STAT_ATTACH:
+    return "l3_route_stat_attach";
+  case BcmSdkApi::L3_ROUTE_STAT_DETACH:
+    return "l3_route_stat_detach";
+  case BcmSdkApi::L3_HOST_ADD:
+    return "l3_host_add";
+  case BcmSdkApi::L3_HOST_DELETE:
+    return "l3_host_delete";
+  case BcmSdkApi::L3_EGRESS_GET:
+    return "l3_egress_get";
+  case BcmSdkApi::L3_EGRESS_CREATE:
+    return "l3_egress_create";
+  case BcmSdkApi::L3_EGRESS_DESTROY:
+    return "l3_egress_destroy";
+  case BcmSdkApi::L3_ECMP_CREATE:
+    return "l3_ecmp_create";
+  case BcmSdkApi::L3_ECMP_ADD:
+    return "l3_ecmp_add";
+  case BcmSdkApi::L3_ECMP_DELETE:
+    return "l3_ecmp_delete";
+  case BcmSdkApi::L3_ECMP_DESTROY:
+    return "l3_ecmp_destroy";
+  case BcmSdkApi::L3_INTF_CREATE:
+    return "l3_intf_create";
+  case BcmSdkApi::L3_INTF_DELETE:
+    return "l3_intf_delete";
+  case BcmSdkApi::L2_STATION_ADD:
+    return "l2_station_add";
+  case BcmSdkApi::L2_STATION_DELETE:
+    return "l2_station_delete";
+  case BcmSdkApi::PORT_ENABLE_GET:
+    return "port_enable_get";
+  case BcmSdkApi::PORT_STAT_GET:
+    return "port_stat_get";
+  case BcmSdkApi::PORT_QUEUED_COUNT_GET:
+    return "port_queued_count_get";
+  case BcmSdkApi::COSQ_STAT_GET:
+    return "cosq_stat_get";
+  case BcmSdkApi::COSQ_BST_STAT_GET:
+    return "cosq_bst_stat_get";
+  case BcmSdkApi::NUM_APIS:
+    break;
+  }
+  LOG(FATAL) << "unknown SDK API " << static_cast<int>(api);
+  return nullptr;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/hw/bcm/BcmStats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+namespace facebook { namespace fboss {
+
+/*
+ * The SDK calls made while programming the L3 tables and reading the port
+ * stats, which are profiled by bcmSdkCall().
+ */
+enum class BcmSdkApi : uint8_t {
+  L3_ROUTE_ADD,
+  L3_ROUTE_DELETE,
+  L3_ROUTE_STAT_ATTACH,
+  L3_ROUTE_STAT_DETACH,
+  L3_HOST_ADD,
+  L3_HOST_DELETE,
+  L3_EGRESS_GET,
+  L3_EGRESS_CREATE,
+  L3_EGRESS_DESTROY,
+  L3_ECMP_CREATE,
+  L3_ECMP_ADD,
+  L3_ECMP_DELETE,
+  L3_ECMP_DESTROY,
+  L3_INTF_CREATE,
+  L3_INTF_DELETE,
+  L2_STATION_ADD,
+  L2_STATION_DELETE,
+  PORT_ENABLE_GET,
+  PORT_STAT_GET,
+  PORT_QUEUED_COUNT_GET,
+  COSQ_STAT_GET,
+  COSQ_BST_STAT_GET,
+  NUM_APIS,
+};
+
+const char* getBcmSdkApiName(BcmSdkApi api);
+
+/*
+ * Make an SDK call, and record it and how long it took in BcmStats, as
+ * bcm.sdk.<api>.calls and bcm.sdk.<api>_us.  The calls and time of each
+ * state update are also added up, see BcmStats::sdkDeltaStarted().
+ *
+ *   auto rc = bcmSdkCall(BcmSdkApi::L3_ROUTE_ADD, opennsl_l3_route_add,
+ *                        hw_->getUnit(), &rt);
+ *
+ * This only costs two clock reads and a few thread-local counter updates,
+ * next to SDK calls that take microseconds at least.
+ */
+template <typename Fn, typename... Args>
+int bcmSdkCall(BcmSdkApi api, Fn fn, Args&&... args) {
+  auto start = std::chrono::steady_clock::now();
+  auto rv = fn(std::forward<Args>(args)...);
+  auto usec = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  BcmStats::get()->sdkCall(api, usec.count());
+  return rv;
+}
+
+}} // facebook::fboss
@@ -10,7 +10,11 @@
 #include "BcmStats.h"
 
 #include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/hw/bcm/BcmSdkCall.h"
 #include "common/stats/ExportedTimeseries.h"
+#include "common/stats/ServiceData.h"
+
+#include <folly/Conv.h>
 
 using facebook::stats::SUM;
 using facebook::stats::RATE;
@@ -30,14 +34,147 @@ BcmStats::BcmStats(ThreadLocalStatsMap *map)
                  SUM, RATE),
       txSent_(map, SwitchStats::kCounterPrefix + "bcm.tx.pkt.sent",
               SUM, RATE),
+      txBatches_(map, SwitchStats::kCounterPrefix + "bcm.tx.pkt.batches",
+                 SUM, RATE),
       txSentDone_(map, SwitchStats::kCounterPrefix + "bcm.tx.pkt.sent.done",
                   SUM, RATE),
       txErrors_(map, SwitchStats::kCounterPrefix + "bcm.tx.errors",
                   SUM, RATE),
       txPktAllocErrors_(map, SwitchStats::kCounterPrefix +
           "bcm.tx.pkt.allocation.errors", SUM, RATE),
+      txPktPoolHits_(map, SwitchStats::kCounterPrefix +
+          "bcm.tx.pkt.pool.hits", SUM, RATE),
+      txPktPoolMisses_(map, SwitchStats::kCounterPrefix +
+          "bcm.tx.pkt.pool.misses", SUM, RATE),
       txQueued_(map, SwitchStats::kCounterPrefix + "bcm.tx.pkt.queued_us",
-                100, 0, 1000) {
+                100, 0, 1000),
+      ecmpGroupWrites_(map, SwitchStats::kCounterPrefix +
+          "bcm.ecmp.group.writes", SUM, RATE),
+      ecmpMemberUpdates_(map, SwitchStats::kCounterPrefix +
+          "bcm.ecmp.member.updates", SUM, RATE),
+      ecmpGroupShares_(map, SwitchStats::kCounterPrefix +
+          "bcm.ecmp.group.shared", SUM, RATE),
+      egressShares_(map, SwitchStats::kCounterPrefix +
+          "bcm.egress.shared", SUM, RATE),
+      egressMoves_(map, SwitchStats::kCounterPrefix +
+          "bcm.egress.moved", SUM, RATE),
+      ecmpPathsPruned_(map, SwitchStats::kCounterPrefix +
+          "bcm.ecmp.paths.pruned", SUM, RATE),
+      ecmpPruneTime_(map, SwitchStats::kCounterPrefix +
+          "bcm.ecmp.prune_us", 100, 0, 10000),
+      ecmpNeighborPathsPruned_(map, SwitchStats::kCounterPrefix +
+          "bcm.ecmp.paths.neighbor_pruned", SUM, RATE),
+      nexthopGroupMoves_(map, SwitchStats::kCounterPrefix +
+          "bcm.nexthop_group.moves", SUM, RATE),
+      nexthopGroupRoutesMoved_(map, SwitchStats::kCounterPrefix +
+          "bcm.nexthop_group.routes_moved", SUM, RATE),
+      auditEntriesChecked_(map, SwitchStats::kCounterPrefix +
+          "bcm.audit.checked", SUM, RATE),
+      auditEntriesStale_(map, SwitchStats::kCounterPrefix +
+          "bcm.audit.stale", SUM, RATE),
+      auditEntriesMismatched_(map, SwitchStats::kCounterPrefix +
+          "bcm.audit.mismatched", SUM, RATE),
+      auditEntriesRepaired_(map, SwitchStats::kCounterPrefix +
+          "bcm.audit.repaired", SUM, RATE),
+      auditPasses_(map, SwitchStats::kCounterPrefix +
+          "bcm.audit.passes", SUM, RATE),
+      routesProgrammed_(map, SwitchStats::kCounterPrefix +
+          "bcm.route.programmed", SUM, RATE),
+      routeProgramTime_(map, SwitchStats::kCounterPrefix +
+          "bcm.route.program_us", 10000, 0, 1000000),
+      routeProgramRate_(map, SwitchStats::kCounterPrefix +
+          "bcm.route.program_per_sec", 1000, 0, 100000),
+      routeDeletesBeforeAdds_(map, SwitchStats::kCounterPrefix +
+          "bcm.route.deletes_before_adds", SUM, RATE),
+      routeDeletesAfterAdds_(map, SwitchStats::kCounterPrefix +
+          "bcm.route.deletes_after_adds", SUM, RATE),
+      routesRejected_(map, SwitchStats::kCounterPrefix +
+          "bcm.route.table_full_rejects", SUM, RATE),
+      hostEntriesRejected_(map, SwitchStats::kCounterPrefix +
+          "bcm.host.table_full_rejects", SUM, RATE),
+      neighborsResolved_(map, SwitchStats::kCounterPrefix +
+          "bcm.neighbor.resolved", SUM, RATE),
+      neighborResolveTime_(map, SwitchStats::kCounterPrefix +
+          "bcm.neighbor.resolve_us", 1000, 0, 100000),
+      switchEventsReceived_(map, SwitchStats::kCounterPrefix +
+          "bcm.switch_event.received", SUM, RATE),
+      switchEventsCoalesced_(map, SwitchStats::kCounterPrefix +
+          "bcm.switch_event.coalesced", SUM, RATE),
+      switchEventsHandled_(map, SwitchStats::kCounterPrefix +
+          "bcm.switch_event.handled", SUM, RATE),
+      changesUndone_(map, SwitchStats::kCounterPrefix +
+          "bcm.rollback.undone", SUM, RATE),
+      undoFailures_(map, SwitchStats::kCounterPrefix +
+          "bcm.rollback.failed", SUM, RATE),
+      sdkDeltaCalls_(map, SwitchStats::kCounterPrefix +
+          "bcm.sdk.delta.calls", 100, 0, 100000),
+      sdkDeltaTime_(map, SwitchStats::kCounterPrefix +
+          "bcm.sdk.delta_us", 10000, 0, 1000000) {
+  const auto numApis = static_cast<size_t>(BcmSdkApi::NUM_APIS);
+  for (size_t i = 0; i < numApis; ++i) {
+    const auto prefix = SwitchStats::kCounterPrefix + "bcm.sdk." +
+      getBcmSdkApiName(BcmSdkApi(i));
+    sdkCalls_.emplace_back(new TLTimeseries(
+        map, prefix + ".calls", SUM, RATE));
+    sdkCallTime_.emplace_back(new TLHistogram(
+        map, prefix + "_us", 50, 0, 10000));
+  }
+}
+
+void BcmStats::txPktPoolHighWatermark(uint64_t count) {
+  fbData->setCounter(SwitchStats::kCounterPrefix +
+                     "bcm.tx.pkt.pool.high_watermark", count);
+}
+
+void BcmStats::ecmpGroups(uint64_t count) {
+  fbData->setCounter(SwitchStats::kCounterPrefix + "bcm.ecmp.groups", count);
+}
+
+void BcmStats::nexthopGroups(uint64_t count, uint64_t maxRoutes) {
+  const auto prefix = SwitchStats::kCounterPrefix + "bcm.nexthop_group.";
+  fbData->setCounter(prefix + "count", count);
+  fbData->setCounter(prefix + "max_routes", maxRoutes);
+}
+
+void BcmStats::fibCompression(uint64_t ribRoutes, uint64_t fibRoutes) {
+  const auto prefix = SwitchStats::kCounterPrefix + "bcm.fib_compression.";
+  fbData->setCounter(prefix + "rib_routes", ribRoutes);
+  fbData->setCounter(prefix + "fib_routes", fibRoutes);
+}
+
+void BcmStats::l3TableUsage(const std::string& table, uint64_t used,
+                            uint64_t max, uint64_t watermark) {
+  const auto prefix = SwitchStats::kCounterPrefix + "bcm.l3." + table +
+    "_table.";
+  fbData->setCounter(prefix + "used", used);
+  fbData->setCounter(prefix + "max", max);
+  fbData->setCounter(prefix + "watermark", watermark);
+}
+
+void BcmStats::rejectedRoutes(uint64_t count) {
+  fbData->setCounter(SwitchStats::kCounterPrefix + "bcm.route.rejected",
+                     count);
+}
+
+void BcmStats::warmBootPopulateTime(const std::string& phase,
+                                    uint64_t msec) {
+  fbData->setCounter(SwitchStats::kCounterPrefix + "bcm.warm_boot.populate." +
+                     phase + "_ms", msec);
+}
+
+void BcmStats::warmBootReconciliation(uint64_t reused,
+                                      uint64_t reprogrammed,
+                                      uint64_t deleted, uint64_t remaining) {
+  const auto prefix = SwitchStats::kCounterPrefix + "bcm.warm_boot.";
+  fbData->setCounter(prefix + "reused", reused);
+  fbData->setCounter(prefix + "reprogrammed", reprogrammed);
+  fbData->setCounter(prefix + "deleted", deleted);
+  fbData->setCounter(prefix + "remaining", remaining);
+}
+
+void BcmStats::unitStateUpdateTime(int unit, uint64_t msec) {
+  fbData->setCounter(SwitchStats::kCounterPrefix + "bcm.unit" +
+                     folly::to<std::string>(unit) + ".state_update_ms", msec);
 }
 
 BcmStats* BcmStats::createThreadStats() {
@@ -11,9 +11,14 @@
 
 #include "common/stats/ThreadCachedServiceData.h"
 #include <folly/ThreadLocal.h>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
+enum class BcmSdkApi : uint8_t;
+
 class BcmStats {
  public:
   BcmStats();
@@ -41,6 +46,10 @@ class BcmStats {
   void txSent() {
     txSent_.addValue(1);
   }
+  void txBatchSent(uint64_t count) {
+    txSent_.addValue(count);
+    txBatches_.addValue(1);
+  }
   void txSentDone(uint64_t q) {
     txSentDone_.addValue(1);
     txQueued_.addValue(q);
@@ -52,6 +61,194 @@ class BcmStats {
     txErrors_.addValue(1);
     txPktAllocErrors_.addValue(1);
   }
+  void txPktPoolHit() {
+    txPktPoolHits_.addValue(1);
+  }
+  void txPktPoolMiss() {
+    txPktPoolMisses_.addValue(1);
+  }
+  /*
+   * Record a new high watermark for the number of TX packet buffers in use.
+   * This is a process-wide counter rather than a thread-local stat.
+   */
+  static void txPktPoolHighWatermark(uint64_t count);
+  void ecmpGroupWritten() {
+    ecmpGroupWrites_.addValue(1);
+  }
+  void ecmpMemberUpdated() {
+    ecmpMemberUpdates_.addValue(1);
+  }
+  void ecmpGroupShared() {
+    ecmpGroupShares_.addValue(1);
+  }
+  void egressShared() {
+    egressShares_.addValue(1);
+  }
+  void egressMoved() {
+    egressMoves_.addValue(1);
+  }
+  /*
+   * Record the number of ECMP groups programmed in HW.
+   * This is a process-wide counter rather than a thread-local stat.
+   */
+  static void ecmpGroups(uint64_t count);
+  /*
+   * Record a nexthop group that was moved to new nexthops in place, along
+   * with the given number of routes, which needed no change in HW.
+   */
+  void nexthopGroupMoved(uint64_t numRoutes) {
+    nexthopGroupMoves_.addValue(1);
+    nexthopGroupRoutesMoved_.addValue(numRoutes);
+  }
+  /*
+   * Record the number of nexthop groups the routes use, and the most routes
+   * using any one of them.
+   * These are process-wide counters rather than thread-local stats.
+   */
+  static void nexthopGroups(uint64_t count, uint64_t maxRoutes);
+  /*
+   * Record the number of resolved routes, and how many of them are
+   * programmed after FIB compression.
+   * These are process-wide counters rather than thread-local stats.
+   */
+  static void fibCompression(uint64_t ribRoutes, uint64_t fibRoutes);
+  /*
+   * Record the used and total entries of an L3 table, and the most entries
+   * used since startup.
+   * These are process-wide counters rather than thread-local stats.
+   */
+  static void l3TableUsage(const std::string& table, uint64_t used,
+                           uint64_t max, uint64_t watermark);
+  /*
+   * Record routes and host entries left out of HW because a table was full.
+   */
+  void routesRejected(uint64_t count) {
+    routesRejected_.addValue(count);
+  }
+  void hostEntryRejected() {
+    hostEntriesRejected_.addValue(1);
+  }
+  /*
+   * Record the number of routes left out of HW, waiting for room.
+   * This is a process-wide counter rather than a thread-local stat.
+   */
+  static void rejectedRoutes(uint64_t count);
+  /*
+   * Record ECMP group members removed by the link down fast path, and the
+   * time from the linkscan event to the groups being pruned in HW.
+   */
+  void ecmpPathsPruned(uint64_t count, uint64_t usec) {
+    ecmpPathsPruned_.addValue(count);
+    ecmpPruneTime_.addValue(usec);
+  }
+  /*
+   * Record ECMP group members removed because their neighbor was gone.
+   */
+  void ecmpNeighborPathsPruned(uint64_t count) {
+    ecmpNeighborPathsPruned_.addValue(count);
+  }
+  /*
+   * Record route deletes programmed before, or after, all of the adds and
+   * changes of their state update were in place.
+   */
+  void routeDeletesOrdered(uint64_t beforeAdds, uint64_t afterAdds) {
+    routeDeletesBeforeAdds_.addValue(beforeAdds);
+    routeDeletesAfterAdds_.addValue(afterAdds);
+  }
+  /*
+   * Record a batch of L3 table entries checked against HW by the table
+   * auditor, how many of them should not have been there or differed from
+   * what was programmed, and how many of those were repaired.
+   */
+  void tableAuditBatch(uint64_t checked, uint64_t stale,
+                       uint64_t mismatched, uint64_t repaired) {
+    auditEntriesChecked_.addValue(checked);
+    auditEntriesStale_.addValue(stale);
+    auditEntriesMismatched_.addValue(mismatched);
+    auditEntriesRepaired_.addValue(repaired);
+  }
+  void tableAuditPassDone() {
+    auditPasses_.addValue(1);
+  }
+  void routesProgrammed(uint64_t count, uint64_t usec) {
+    routesProgrammed_.addValue(count);
+    routeProgramTime_.addValue(usec);
+    if (usec > 0) {
+      routeProgramRate_.addValue(count * 1000000 / usec);
+    }
+  }
+  /*
+   * Record how long a phase of populating the warm boot cache took.
+   * This is a process-wide counter rather than a thread-local stat.
+   */
+  static void warmBootPopulateTime(const std::string& phase, uint64_t msec);
+  /*
+   * Record how many of the entries found in HW at warm boot were reused as
+   * they were, reprogrammed, or deleted as unused, and how many unused
+   * ones are left to delete.
+   * These are process-wide counters rather than thread-local stats.
+   */
+  static void warmBootReconciliation(uint64_t reused, uint64_t reprogrammed,
+                                     uint64_t deleted, uint64_t remaining);
+  /*
+   * Record how long applying the last state update to one unit of a
+   * system with several took.
+   * This is a process-wide counter rather than a thread-local stat.
+   */
+  static void unitStateUpdateTime(int unit, uint64_t msec);
+  void neighborResolved(uint64_t usec) {
+    neighborsResolved_.addValue(1);
+    neighborResolveTime_.addValue(usec);
+  }
+  /*
+   * Record a switch event from the SDK, and whether it was folded into an
+   * identical one still waiting to be handled.
+   */
+  void switchEventReceived(bool coalesced) {
+    switchEventsReceived_.addValue(1);
+    if (coalesced) {
+      switchEventsCoalesced_.addValue(1);
+    }
+  }
+  void switchEventHandled() {
+    switchEventsHandled_.addValue(1);
+  }
+  /*
+   * Record the HW changes of a failed state update that were undone, and
+   * those that could not be.
+   */
+  void changesRolledBack(uint64_t undone, uint64_t failed) {
+    changesUndone_.addValue(undone);
+    undoFailures_.addValue(failed);
+  }
+  /*
+   * Record an SDK call, and how long it took.  See bcmSdkCall().
+   */
+  void sdkCall(BcmSdkApi api, uint64_t usec) {
+    auto idx = static_cast<size_t>(api);
+    sdkCalls_[idx]->addValue(1);
+    sdkCallTime_[idx]->addValue(usec);
+    deltaSdkCalls_ += 1;
+    deltaSdkUsec_ += usec;
+  }
+  /*
+   * Start and finish adding up the SDK calls made by this thread while
+   * applying a state update to HW, and record the totals.
+   */
+  void sdkDeltaStarted() {
+    deltaSdkCalls_ = 0;
+    deltaSdkUsec_ = 0;
+  }
+  void sdkDeltaDone() {
+    sdkDeltaCalls_.addValue(deltaSdkCalls_);
+    sdkDeltaTime_.addValue(deltaSdkUsec_);
+  }
+  uint64_t getDeltaSdkCalls() const {
+    return deltaSdkCalls_;
+  }
+  uint64_t getDeltaSdkUsec() const {
+    return deltaSdkUsec_;
+  }
 
  private:
   // Forbidden copy constructor and assignment operator
@@ -72,14 +269,87 @@ class BcmStats {
   TLTimeseries txPktAlloc_;
   TLTimeseries txPktFree_;
   TLTimeseries txSent_;
+  // Number of packet batches submitted via BcmTxPacket::sendAsyncBatch()
+  TLTimeseries txBatches_;
   TLTimeseries txSentDone_;
   // Errors in sending packets
   TLTimeseries txErrors_;
   TLTimeseries txPktAllocErrors_;
+  // TX packet buffers reused from, or newly allocated for, the pool
+  TLTimeseries txPktPoolHits_;
+  TLTimeseries txPktPoolMisses_;
 
   // Time spent for each Tx packet queued in HW
   TLHistogram txQueued_;
 
+  // ECMP groups created or re-created in HW, members added to or removed
+  // from existing groups, and ECMP hosts that reused an existing group
+  TLTimeseries ecmpGroupWrites_;
+  TLTimeseries ecmpMemberUpdates_;
+  TLTimeseries ecmpGroupShares_;
+  // Hosts that reused the egress object of another host with the same MAC,
+  // and egress objects moved to a new port along with all of their hosts
+  TLTimeseries egressShares_;
+  TLTimeseries egressMoves_;
+  // ECMP group members removed when their port went down, and how long
+  // that took from the linkscan event
+  TLTimeseries ecmpPathsPruned_;
+  TLHistogram ecmpPruneTime_;
+  // ECMP group members removed because their neighbor was gone
+  TLTimeseries ecmpNeighborPathsPruned_;
+  // Nexthop groups moved to new nexthops in place, and the routes that
+  // moved along with them
+  TLTimeseries nexthopGroupMoves_;
+  TLTimeseries nexthopGroupRoutesMoved_;
+
+  // L3 table entries the table auditor checked, found stale or different
+  // from what was programmed, and repaired, and full passes over the tables
+  TLTimeseries auditEntriesChecked_;
+  TLTimeseries auditEntriesStale_;
+  TLTimeseries auditEntriesMismatched_;
+  TLTimeseries auditEntriesRepaired_;
+  TLTimeseries auditPasses_;
+
+  // Number of route changes programmed to HW
+  TLTimeseries routesProgrammed_;
+  // Time spent programming each set of route changes, and the resulting
+  // routes/sec rate
+  TLHistogram routeProgramTime_;
+  TLHistogram routeProgramRate_;
+  // Route deletes programmed before or after all of the adds and changes of
+  // their update were in place
+  TLTimeseries routeDeletesBeforeAdds_;
+  TLTimeseries routeDeletesAfterAdds_;
+  // Routes and host entries left out of HW because a table was full
+  TLTimeseries routesRejected_;
+  TLTimeseries hostEntriesRejected_;
+
+  // Neighbors that became resolved, and the time from the start of the HW
+  // update that resolved each of them to its host forwarding in HW
+  TLTimeseries neighborsResolved_;
+  TLHistogram neighborResolveTime_;
+
+  // Switch events received from the SDK, those that were folded into one
+  // already queued, and those the event handler thread processed
+  TLTimeseries switchEventsReceived_;
+  TLTimeseries switchEventsCoalesced_;
+  TLTimeseries switchEventsHandled_;
+
+  // HW changes undone after a state update failed, and undo actions that
+  // failed in turn
+  TLTimeseries changesUndone_;
+  TLTimeseries undoFailures_;
+
+  // Calls of each SDK API and the time each took, indexed by BcmSdkApi
+  std::vector<std::unique_ptr<TLTimeseries>> sdkCalls_;
+  std::vector<std::unique_ptr<TLHistogram>> sdkCallTime_;
+  // The SDK calls of each state update, and the time spent in them
+  TLHistogram sdkDeltaCalls_;
+  TLHistogram sdkDeltaTime_;
+  // The totals of the state update being applied
+  uint64_t deltaSdkCalls_{0};
+  uint64_t deltaSdkUsec_{0};
+
   static folly::ThreadLocalPtr<BcmStats> stats_;
 };
 
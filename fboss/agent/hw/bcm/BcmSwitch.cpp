@@ -14,34 +14,51 @@
 
 #include <boost/cast.hpp>
 #include <boost/foreach.hpp>
+#include <iterator>
 
 #include <folly/Hash.h>
 #include <folly/Memory.h>
 #include <folly/ScopeGuard.h>
 #include <folly/Conv.h>
 #include <folly/FileUtil.h>
+#include "fboss/agent/BootTimeline.h"
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/PacketLatency.h"
 #include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/Utils.h"
 #include "fboss/agent/hw/bcm/BcmAPI.h"
+#include "fboss/agent/hw/bcm/BcmAclTable.h"
 #include "fboss/agent/hw/bcm/BcmError.h"
 #include "fboss/agent/hw/bcm/BcmIntf.h"
 #include "fboss/agent/hw/bcm/BcmPlatform.h"
 #include "fboss/agent/hw/bcm/BcmPort.h"
 #include "fboss/agent/hw/bcm/BcmPortTable.h"
+#include "fboss/agent/hw/bcm/BcmResourceManager.h"
 #include "fboss/agent/hw/bcm/BcmHost.h"
 #include "fboss/agent/hw/bcm/BcmRoute.h"
+#include "fboss/agent/hw/bcm/BcmRouteCounters.h"
 #include "fboss/agent/hw/bcm/BcmRxPacket.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
 #include "fboss/agent/hw/bcm/BcmSwitchEventManager.h"
 #include "fboss/agent/hw/bcm/BcmSwitchEventCallback.h"
+#include "fboss/agent/hw/bcm/BcmTableAuditor.h"
+#include "fboss/agent/hw/bcm/BcmTrunkTable.h"
 #include "fboss/agent/hw/bcm/BcmTxPacket.h"
+#include "fboss/agent/hw/bcm/BcmUndoLog.h"
 #include "fboss/agent/hw/bcm/BcmUnit.h"
 #include "fboss/agent/hw/bcm/BcmWarmBootCache.h"
+#include "fboss/agent/hw/bcm/Utils.h"
+#include "fboss/agent/state/AclEntry.h"
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
 #include "fboss/agent/state/ArpEntry.h"
+#include "fboss/agent/state/ArpTable.h"
 #include "fboss/agent/state/DeltaFunctions.h"
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/NdpTable.h"
 #include "fboss/agent/state/NodeMapDelta.h"
 #include "fboss/agent/state/Port.h"
 #include "fboss/agent/state/PortMap.h"
@@ -58,6 +75,8 @@
 #include "fboss/agent/SysError.h"
 
 extern "C" {
+#include <opennsl/cosq.h>
+#include <opennsl/l2.h>
 #include <opennsl/link.h>
 #include <opennsl/port.h>
 #include <opennsl/stg.h>
@@ -74,18 +93,83 @@ using std::make_shared;
 using std::shared_ptr;
 using std::string;
 
+using facebook::fboss::DeltaFunctions::DeltaChunks;
 using facebook::fboss::DeltaFunctions::forEachChanged;
 using facebook::fboss::DeltaFunctions::forEachAdded;
 using facebook::fboss::DeltaFunctions::forEachRemoved;
+using folly::ByteRange;
 using folly::IPAddress;
 
 DEFINE_int32(linkscan_interval_us, 250000,
              "The Broadcom linkscan interval");
+DEFINE_bool(bcm_neighbor_hit_bits, false,
+            "Report the L3 host hit bits to the neighbor updater, so that "
+            "neighbors which are forwarding traffic do not need probing");
+DEFINE_int32(warm_boot_cleanup_batch, 1000,
+             "After warm boot, delete the HW entries the new state does not "
+             "use this many at a time, in the background.  0 deletes them "
+             "all at once when the initial programming is done.");
+DEFINE_int32(warm_boot_cleanup_interval_ms, 10,
+             "How long to wait between batches of warm boot entry deletions");
+DEFINE_int32(port_queue_sample_interval_ms, 0,
+             "How often (in milliseconds) to sample the length of each "
+             "port's output queue from a separate thread, to catch bursts "
+             "between stats updates.  0 disables sampling.");
+DEFINE_bool(bcm_rollback_on_error, true,
+            "When a state update fails part way through programming the HW, "
+            "undo the changes it made, so the agent can carry on with the "
+            "old state instead of exiting.  Not done with "
+            "--bcm_fib_compression.");
+DEFINE_int32(bcm_audit_batch, 0,
+             "Check the L3 host and route entries in HW against what was "
+             "programmed, this many table entries at a time, in the "
+             "background.  0 disables the audit.");
+DEFINE_int32(bcm_audit_interval_ms, 100,
+             "How long to wait between batches of the L3 table audit");
+DEFINE_bool(bcm_audit_repair, false,
+            "Rewrite the L3 entries the audit finds different from what was "
+            "programmed, and delete the ones that were never programmed");
+DEFINE_bool(ecmp_link_down_prune, true,
+            "When a port goes down, remove its nexthops from the ECMP groups "
+            "in HW right away, rather than waiting for the routes to be "
+            "re-resolved");
+DEFINE_bool(ecmp_neighbor_down_prune, true,
+            "When a neighbor that ECMP groups use is gone, remove it from "
+            "the groups in HW, so their other paths carry its traffic "
+            "instead of it being punted to the CPU until the neighbor is "
+            "resolved again");
+DEFINE_bool(bcm_fib_compression, false,
+            "Only program the routes that do not forward the same way as the "
+            "longest route covering them, which the addresses they cover "
+            "fall through to anyway");
+DEFINE_int32(bcm_port_config_threads, 8,
+             "How many threads initialize the ports at boot, and apply the "
+             "port speed, ingress VLAN and state changes of a state delta, "
+             "each thread handling different ports.  1 does it serially.");
+DEFINE_int32(bcm_route_prep_threads, 4,
+             "How many threads work out the route changes of a state delta, "
+             "each thread handling different VRFs, or different chunks of "
+             "the added and changed routes when the FIB is not compressed, "
+             "before they are programmed in order.  1 does it serially.");
+DEFINE_bool(bcm_route_make_before_break, false,
+            "Program the added and changed routes of a state update, more "
+            "specific routes first, before deleting any routes, so that "
+            "traffic is never left without a route in between");
+DEFINE_bool(bcm_buffer_watermarks, true,
+            "Export the peak use of the packet buffer by each port and "
+            "queue between stats updates");
+DEFINE_bool(bcm_l2_learn_events, true,
+            "Report the MACs the HW learns and ages to the agent, which "
+            "keeps them in the MAC table of each VLAN");
 
 enum : uint8_t {
   kRxCallbackPriority = 1,
 };
 
+// The CPU port, and the number of queues it has
+const opennsl_port_t kCpuPort = 0;
+const int kNumCpuQueues = 8;
+
 namespace {
 
 /*
@@ -117,6 +201,39 @@ facebook::fboss::cfg::PortSpeed getPortSpeed(int unit, int port) {
   LOG(FATAL) << "Invalid port speed : " << portSpeed << " for port: " << port;
 }
 
+int hitHostTraversalCallback(int unit, int index, opennsl_l3_host_t* host,
+                             void* userData) {
+  if (host->l3a_flags & OPENNSL_L3_HIT) {
+    static_cast<std::vector<opennsl_l3_host_t>*>(userData)->push_back(*host);
+  }
+  return 0;
+}
+
+opennsl_rx_reason_t getRxReason(facebook::fboss::cfg::PacketRxReason reason) {
+  using facebook::fboss::cfg::PacketRxReason;
+  switch (reason) {
+    case PacketRxReason::UNMATCHED: return opennslRxReasonInvalid;
+    case PacketRxReason::ARP: return opennslRxReasonArp;
+    case PacketRxReason::DHCP: return opennslRxReasonDhcp;
+    case PacketRxReason::BPDU: return opennslRxReasonBpdu;
+    case PacketRxReason::L3_SLOW_PATH: return opennslRxReasonL3Slowpath;
+    case PacketRxReason::L3_DEST_MISS: return opennslRxReasonL3DestMiss;
+    case PacketRxReason::TTL_1: return opennslRxReasonTtl1;
+    case PacketRxReason::CPU_IS_NHOP: return opennslRxReasonNhop;
+    case PacketRxReason::SFLOW_INGRESS: return opennslRxReasonSampleSource;
+    case PacketRxReason::SFLOW_EGRESS: return opennslRxReasonSampleDest;
+  }
+  throw facebook::fboss::FbossError("unknown packet rx reason ",
+                                    static_cast<int>(reason));
+}
+
+bool sampleRatesChanged(
+    const std::shared_ptr<facebook::fboss::Port>& oldPort,
+    const std::shared_ptr<facebook::fboss::Port>& newPort) {
+  return oldPort->getSflowIngressRate() != newPort->getSflowIngressRate() ||
+    oldPort->getSflowEgressRate() != newPort->getSflowEgressRate();
+}
+
 }
 
 namespace facebook { namespace fboss {
@@ -124,10 +241,15 @@ namespace facebook { namespace fboss {
 BcmSwitch::BcmSwitch(BcmPlatform *platform)
   : platform_(platform),
     portTable_(new BcmPortTable(this)),
+    trunkTable_(new BcmTrunkTable(this)),
+    aclTable_(new BcmAclTable(this)),
     intfTable_(new BcmIntfTable(this)),
     hostTable_(new BcmHostTable(this)),
+    routeCounters_(new BcmRouteCounters(this)),
     routeTable_(new BcmRouteTable(this)),
-    warmBootCache_(new BcmWarmBootCache(this)) {
+    warmBootCache_(new BcmWarmBootCache(this)),
+    resourceManager_(new BcmResourceManager(this)),
+    compressFib_(FLAGS_bcm_fib_compression) {
 
   // Start switch event manager so critical events will be handled.
   switchEventManager_.reset(new BcmSwitchEventManager(this));
@@ -145,12 +267,18 @@ BcmSwitch::BcmSwitch(BcmPlatform *platform, unique_ptr<BcmUnit> unit)
 }
 
 BcmSwitch::~BcmSwitch() {
+  stopWarmBootCleanup();
+  stopQueueSampler();
+  stopTableAuditor();
   if (unitObject_) {
     unregisterCallbacks();
   }
 }
 
 unique_ptr<BcmUnit> BcmSwitch::releaseUnit() {
+  stopWarmBootCleanup();
+  stopQueueSampler();
+  stopTableAuditor();
   std::lock_guard<std::mutex> g(lock_);
 
   unregisterCallbacks();
@@ -160,9 +288,12 @@ unique_ptr<BcmUnit> BcmSwitch::releaseUnit() {
   switchEventManager_.reset();
   warmBootCache_.reset();
   routeTable_.reset();
+  routeCounters_.reset();
   hostTable_.reset();
   intfTable_.reset();
   toCPUEgress_.reset();
+  aclTable_.reset();
+  trunkTable_.reset();
   portTable_.reset();
 
   unit_ = -1;
@@ -189,6 +320,11 @@ void BcmSwitch::unregisterCallbacks() {
 
     disableLinkscan();
   }
+  if (flags_ & L2_LEARNING_REGISTERED) {
+    auto rv = opennsl_l2_addr_unregister(unit_, l2AddrCallback, this);
+    CHECK(OPENNSL_SUCCESS(rv)) << "failed to unregister BcmSwitch L2 "
+      "callback: " << opennsl_errmsg(rv);
+  }
 }
 
 void BcmSwitch::ecmpHashSetup() {
@@ -203,72 +339,12 @@ void BcmSwitch::ecmpHashSetup() {
       opennslSwitchHashField1PreProcessEnable, 1);
   bcmCheckError(rv, "failed to enable pre-processing B");
 
-  // set the seed
-  // We do not want the traffic flow hashing is changed cross process restart,
-  // therefore We need to generate consistent seeds for this box.
-  // Here, we use the local MAC base (lower 32b as they are mostly NIC ID) to
-  // generate two different hashes to set to seed0 and seed1.
-  auto mac64 = platform_->getLocalMac().u64HBO();
-  uint32_t mac32 = static_cast<uint32_t>(mac64 & 0xFFFFFFFF);
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashSeed0,
-                              folly::hash::jenkins_rev_mix32(mac32));
-  bcmCheckError(rv, "failed to set hash seed 0");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashSeed1,
-                              folly::hash::twang_32from64(mac64));
-  bcmCheckError(rv, "failed to set hash seed 1");
+  const EcmpHashConfig defaultConfig;
+  programEcmpHashSeeds(defaultConfig.seedRotation);
+  programEcmpHashFields(defaultConfig);
+  programEcmpHashAlgorithm(defaultConfig);
 
-  // First, field selection:
-  // For both IPv4 and IPv6, select src IP, dst IP, src port, and dst port as
-  // the keys to hash.
-  arg = OPENNSL_HASH_FIELD_SRCL4 | OPENNSL_HASH_FIELD_DSTL4
-    | OPENNSL_HASH_FIELD_IP4SRC_LO | OPENNSL_HASH_FIELD_IP4SRC_HI
-    | OPENNSL_HASH_FIELD_IP4DST_LO | OPENNSL_HASH_FIELD_IP4DST_HI;
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP4Field0, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP4Field1, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP4TcpUdpField0, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP4TcpUdpField1, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(
-      unit_, opennslSwitchHashIP4TcpUdpPortsEqualField0, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(
-      unit_, opennslSwitchHashIP4TcpUdpPortsEqualField1, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  // v6
-  arg = OPENNSL_HASH_FIELD_SRCL4 | OPENNSL_HASH_FIELD_DSTL4
-    | OPENNSL_HASH_FIELD_IP6SRC_LO | OPENNSL_HASH_FIELD_IP6SRC_HI
-    | OPENNSL_HASH_FIELD_IP6DST_LO | OPENNSL_HASH_FIELD_IP6DST_HI;
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP6Field0, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP6Field1, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP6TcpUdpField0, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashIP6TcpUdpField1, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(
-      unit_, opennslSwitchHashIP6TcpUdpPortsEqualField0, arg);
-  bcmCheckError(rv, "failed to config field selection");
-  rv = opennsl_switch_control_set(
-      unit_, opennslSwitchHashIP6TcpUdpPortsEqualField1, arg);
-  bcmCheckError(rv, "failed to config field selection");
-
-  // Second: hash algorithm.
-  // Always use CRC-16 using CCITT polynomial
-  arg = OPENNSL_HASH_FIELD_CONFIG_CRC16CCITT;
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashField0Config, arg);
-  bcmCheckError(rv, "failed to config CRC16-CCITT to A0");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashField0Config1, arg);
-  bcmCheckError(rv, "failed to config CRC16-CCITT to A1");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashField1Config, arg);
-  bcmCheckError(rv, "failed to config CRC16-CCITT to B0");
-  rv = opennsl_switch_control_set(unit_, opennslSwitchHashField1Config1, arg);
-  bcmCheckError(rv, "failed to config CRC16-CCITT to B1");
-
-  // Third, choose the ECMP set to use.
+  // Then, choose the ECMP set to use.
   // Use the default offset (0), which means HASH_A0 will be selected.
   // (refer: opennsl_esw_switch_control_port_set())
   rv = opennsl_switch_control_set(unit_, opennslSwitchECMPHashSet0Offset, 0);
@@ -295,7 +371,154 @@ void BcmSwitch::ecmpHashSetup() {
   bcmCheckError(rv, "failed to enable RTAG7");
 }
 
+void BcmSwitch::changeEcmpHash(const EcmpHashConfig& oldConfig,
+                               const EcmpHashConfig& newConfig) {
+  // Only reprogram what changed, since each change moves flows to other
+  // paths
+  if (oldConfig.seedRotation != newConfig.seedRotation) {
+    programEcmpHashSeeds(newConfig.seedRotation);
+  }
+  if (oldConfig.ipv4Fields != newConfig.ipv4Fields ||
+      oldConfig.ipv6Fields != newConfig.ipv6Fields) {
+    programEcmpHashFields(newConfig);
+  }
+  if (oldConfig.algorithm != newConfig.algorithm) {
+    programEcmpHashAlgorithm(newConfig);
+  }
+}
+
+void BcmSwitch::programEcmpHashSeeds(uint32_t seedRotation) {
+  // We do not want the traffic flow hashing is changed cross process restart,
+  // therefore We need to generate consistent seeds for this box.
+  // Here, we use the local MAC base (lower 32b as they are mostly NIC ID) to
+  // generate two different hashes to set to seed0 and seed1.  The rotation
+  // from the config is added in, so that all boxes can be re-seeded at once
+  // while still using different seeds.
+  auto mac64 = platform_->getLocalMac().u64HBO() + seedRotation;
+  uint32_t mac32 = static_cast<uint32_t>(mac64 & 0xFFFFFFFF);
+  auto rv = opennsl_switch_control_set(unit_, opennslSwitchHashSeed0,
+                                       folly::hash::jenkins_rev_mix32(mac32));
+  bcmCheckError(rv, "failed to set hash seed 0");
+  rv = opennsl_switch_control_set(unit_, opennslSwitchHashSeed1,
+                                  folly::hash::twang_32from64(mac64));
+  bcmCheckError(rv, "failed to set hash seed 1");
+}
+
+void BcmSwitch::changeRouteCounters(
+    const std::vector<RouteCounterConfig>& classes) {
+  routeCounters_->setClasses(classes);
+  routeTable_->updateCounters();
+  routeCounters_->destroyUnused();
+}
+
+void BcmSwitch::programEcmpHashFields(const EcmpHashConfig& config) {
+  auto toBcmFields = [](const EcmpHashConfig::Fields& fields, bool v6) {
+    int arg = 0;
+    for (auto field : fields) {
+      switch (field) {
+        case cfg::EcmpHashField::SRC_IP:
+          arg |= v6 ?
+            OPENNSL_HASH_FIELD_IP6SRC_LO | OPENNSL_HASH_FIELD_IP6SRC_HI :
+            OPENNSL_HASH_FIELD_IP4SRC_LO | OPENNSL_HASH_FIELD_IP4SRC_HI;
+          break;
+        case cfg::EcmpHashField::DST_IP:
+          arg |= v6 ?
+            OPENNSL_HASH_FIELD_IP6DST_LO | OPENNSL_HASH_FIELD_IP6DST_HI :
+            OPENNSL_HASH_FIELD_IP4DST_LO | OPENNSL_HASH_FIELD_IP4DST_HI;
+          break;
+        case cfg::EcmpHashField::IP_PROTOCOL:
+          arg |= OPENNSL_HASH_FIELD_PROTOCOL;
+          break;
+        case cfg::EcmpHashField::SRC_L4_PORT:
+          arg |= OPENNSL_HASH_FIELD_SRCL4;
+          break;
+        case cfg::EcmpHashField::DST_L4_PORT:
+          arg |= OPENNSL_HASH_FIELD_DSTL4;
+          break;
+        case cfg::EcmpHashField::FLOW_LABEL:
+          arg |= OPENNSL_HASH_FIELD_FLOWLABEL_LO |
+            OPENNSL_HASH_FIELD_FLOWLABEL_HI;
+          break;
+        case cfg::EcmpHashField::INGRESS_PORT:
+          arg |= OPENNSL_HASH_FIELD_SRCMOD | OPENNSL_HASH_FIELD_SRCPORT;
+          break;
+        default:
+          throw FbossError("unsupported ECMP hash field ",
+                           static_cast<int>(field));
+      }
+    }
+    return arg;
+  };
+
+  // The same fields are used for TCP and UDP packets, whether or not their
+  // ports are equal, and for other IP packets, which just have no L4 ports
+  const opennsl_switch_control_t ip4Controls[] = {
+    opennslSwitchHashIP4Field0,
+    opennslSwitchHashIP4Field1,
+    opennslSwitchHashIP4TcpUdpField0,
+    opennslSwitchHashIP4TcpUdpField1,
+    opennslSwitchHashIP4TcpUdpPortsEqualField0,
+    opennslSwitchHashIP4TcpUdpPortsEqualField1,
+  };
+  const opennsl_switch_control_t ip6Controls[] = {
+    opennslSwitchHashIP6Field0,
+    opennslSwitchHashIP6Field1,
+    opennslSwitchHashIP6TcpUdpField0,
+    opennslSwitchHashIP6TcpUdpField1,
+    opennslSwitchHashIP6TcpUdpPortsEqualField0,
+    opennslSwitchHashIP6TcpUdpPortsEqualField1,
+  };
+  auto arg = toBcmFields(config.ipv4Fields, false);
+  for (auto control : ip4Controls) {
+    auto rv = opennsl_switch_control_set(unit_, control, arg);
+    bcmCheckError(rv, "failed to config IPv4 hash field selection");
+  }
+  arg = toBcmFields(config.ipv6Fields, true);
+  for (auto control : ip6Controls) {
+    auto rv = opennsl_switch_control_set(unit_, control, arg);
+    bcmCheckError(rv, "failed to config IPv6 hash field selection");
+  }
+}
+
+void BcmSwitch::programEcmpHashAlgorithm(const EcmpHashConfig& config) {
+  int arg;
+  switch (config.algorithm) {
+    case cfg::EcmpHashAlgorithm::CRC16_CCITT:
+      arg = OPENNSL_HASH_FIELD_CONFIG_CRC16CCITT;
+      break;
+    case cfg::EcmpHashAlgorithm::CRC16:
+      arg = OPENNSL_HASH_FIELD_CONFIG_CRC16;
+      break;
+    case cfg::EcmpHashAlgorithm::CRC32_LO:
+      arg = OPENNSL_HASH_FIELD_CONFIG_CRC32LO;
+      break;
+    case cfg::EcmpHashAlgorithm::CRC32_HI:
+      arg = OPENNSL_HASH_FIELD_CONFIG_CRC32HI;
+      break;
+    case cfg::EcmpHashAlgorithm::XOR16:
+      arg = OPENNSL_HASH_FIELD_CONFIG_XOR16;
+      break;
+    default:
+      throw FbossError("unsupported ECMP hash algorithm ",
+                       static_cast<int>(config.algorithm));
+  }
+  // Hash modules A and B, each with two configs
+  const opennsl_switch_control_t controls[] = {
+    opennslSwitchHashField0Config,
+    opennslSwitchHashField0Config1,
+    opennslSwitchHashField1Config,
+    opennslSwitchHashField1Config1,
+  };
+  for (auto control : controls) {
+    auto rv = opennsl_switch_control_set(unit_, control, arg);
+    bcmCheckError(rv, "failed to config the ECMP hash algorithm");
+  }
+}
+
 void BcmSwitch::gracefulExit() {
+  stopWarmBootCleanup();
+  stopQueueSampler();
+  stopTableAuditor();
   std::lock_guard<std::mutex> g(lock_);
   unregisterCallbacks();
   unitObject_->detach();
@@ -304,7 +527,215 @@ void BcmSwitch::gracefulExit() {
 
 void BcmSwitch::clearWarmBootCache() {
   std::lock_guard<std::mutex> g(lock_);
-  warmBootCache_->clear();
+  if (warmBootCleanupThread_.joinable()) {
+    // The cleanup is already under way
+    return;
+  }
+  if (FLAGS_warm_boot_cleanup_batch <= 0) {
+    warmBootCache_->clear();
+    auto status = warmBootCache_->getReconciliation();
+    BcmStats::warmBootReconciliation(status.reused, status.reprogrammed,
+                                     status.deleted, status.remaining);
+    return;
+  }
+  warmBootCleanupThread_ = std::thread([this] { warmBootCleanupLoop(); });
+}
+
+void BcmSwitch::warmBootCleanupLoop() {
+  auto interval = std::chrono::milliseconds(
+      std::max(0, FLAGS_warm_boot_cleanup_interval_ms));
+  while (!stopWarmBootCleanup_) {
+    size_t remaining;
+    {
+      std::lock_guard<std::mutex> g(lock_);
+      remaining = warmBootCache_->clear(FLAGS_warm_boot_cleanup_batch);
+      auto status = warmBootCache_->getReconciliation();
+      BcmStats::warmBootReconciliation(status.reused, status.reprogrammed,
+                                       status.deleted, status.remaining);
+    }
+    if (remaining == 0) {
+      LOG(INFO) << "Warm boot : done removing unreferenced entries";
+      return;
+    }
+    std::this_thread::sleep_for(interval);
+  }
+}
+
+void BcmSwitch::stopWarmBootCleanup() {
+  if (!warmBootCleanupThread_.joinable()) {
+    return;
+  }
+  stopWarmBootCleanup_ = true;
+  warmBootCleanupThread_.join();
+}
+
+void BcmSwitch::startQueueSampler() {
+  if (FLAGS_port_queue_sample_interval_ms <= 0 ||
+      queueSamplerThread_.joinable()) {
+    return;
+  }
+  queueSamplerThread_ = std::thread([this] { queueSamplerLoop(); });
+}
+
+void BcmSwitch::queueSamplerLoop() {
+  auto interval =
+    std::chrono::milliseconds(FLAGS_port_queue_sample_interval_ms);
+  auto next = std::chrono::steady_clock::now();
+  while (!stopQueueSampler_) {
+    // The ports never change after init(), and only the SDK is called, so
+    // this does not need the HW update lock.
+    portTable_->sampleQueueLengths();
+    next += interval;
+    auto now = std::chrono::steady_clock::now();
+    if (next < now) {
+      // Sampling takes longer than the interval; don't try to catch up
+      next = now;
+    }
+    std::this_thread::sleep_until(next);
+  }
+}
+
+void BcmSwitch::stopQueueSampler() {
+  if (!queueSamplerThread_.joinable()) {
+    return;
+  }
+  stopQueueSampler_ = true;
+  queueSamplerThread_.join();
+}
+
+void BcmSwitch::startTableAuditor() {
+  if (FLAGS_bcm_audit_batch <= 0 || tableAuditThread_.joinable()) {
+    return;
+  }
+  tableAuditor_ = make_unique<BcmTableAuditor>(this);
+  tableAuditThread_ = std::thread([this] { tableAuditLoop(); });
+}
+
+void BcmSwitch::tableAuditLoop() {
+  auto interval = std::chrono::milliseconds(
+      std::max(0, FLAGS_bcm_audit_interval_ms));
+  while (!stopTableAuditor_) {
+    // Reading the entries only calls the SDK, so the lock is only held to
+    // compare them with the tables, and updates wait for one batch at most.
+    tableAuditor_->readBatch(FLAGS_bcm_audit_batch);
+    try {
+      std::lock_guard<std::mutex> g(lock_);
+      tableAuditor_->checkBatch(FLAGS_bcm_audit_repair);
+    } catch (const std::exception& ex) {
+      // A failed repair is tried again on the next pass
+      LOG(ERROR) << "L3 table audit failed: " << folly::exceptionStr(ex);
+    }
+    std::this_thread::sleep_for(interval);
+  }
+}
+
+void BcmSwitch::stopTableAuditor() {
+  if (!tableAuditThread_.joinable()) {
+    return;
+  }
+  stopTableAuditor_ = true;
+  tableAuditThread_.join();
+}
+
+bool BcmSwitch::getWarmBootReconciliation(WarmBootReconciliation* status) {
+  std::lock_guard<std::mutex> g(lock_);
+  if (!warmBootCache_) {
+    return false;
+  }
+  *status = warmBootCache_->getReconciliation();
+  return true;
+}
+
+namespace {
+
+template<typename RoutesDelta>
+uint64_t countRouteOperations(const RoutesDelta& delta) {
+  uint64_t count = 0;
+  for (const auto& entry : delta) {
+    // Unresolved routes are never programmed, so changing a route to
+    // become unresolved deletes it instead.
+    const auto& newRoute = entry.getNew();
+    const auto& oldRoute = entry.getOld();
+    if ((newRoute && newRoute->isResolved()) ||
+        (oldRoute && oldRoute->isResolved())) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+uint64_t countVlanPortOperations(const Vlan* oldVlan, const Vlan* newVlan) {
+  // Ports whose tagging changed are removed and added back
+  auto changed = oldVlan->getPortBitmap() ^ newVlan->getPortBitmap();
+  auto retagged = (oldVlan->getUntaggedPortBitmap() ^
+                   newVlan->getUntaggedPortBitmap()) &
+    oldVlan->getPortBitmap() & newVlan->getPortBitmap();
+  bool added = !retagged.empty() ||
+    !(changed & newVlan->getPortBitmap()).empty();
+  bool removed = !retagged.empty() ||
+    !(changed & oldVlan->getPortBitmap()).empty();
+  return added + removed;
+}
+
+} // unnamed namespace
+
+bool BcmSwitch::estimateStateChange(const StateDelta& delta,
+                                    HwOperationEstimate* estimate) const {
+  for (const auto& portDelta : delta.getPortsDelta()) {
+    const auto& oldPort = portDelta.getOld();
+    const auto& newPort = portDelta.getNew();
+    if (!oldPort || !newPort) {
+      // Ports are never added or removed
+      continue;
+    }
+    if (!portTable_->hasPort(newPort->getID())) {
+      // Another unit's port
+      continue;
+    }
+    estimate->ports += (oldPort->getState() != newPort->getState()) +
+      (oldPort->getIngressVlan() != newPort->getIngressVlan()) +
+      (oldPort->getSpeed() != newPort->getSpeed());
+  }
+
+  for (const auto& vlanDelta : delta.getVlansDelta()) {
+    const auto& oldVlan = vlanDelta.getOld();
+    const auto& newVlan = vlanDelta.getNew();
+    if (!oldVlan || !newVlan) {
+      // Creating a VLAN and adding its ports, or removing all of its ports
+      // and destroying it
+      estimate->vlans += 2;
+    } else {
+      estimate->vlans += countVlanPortOperations(oldVlan.get(),
+                                                 newVlan.get());
+    }
+    // Each neighbor entry programs (or points to the CPU) a single host
+    auto arpDelta = vlanDelta.getArpDelta();
+    estimate->hosts += std::distance(arpDelta.begin(), arpDelta.end());
+    auto ndpDelta = vlanDelta.getNdpDelta();
+    estimate->hosts += std::distance(ndpDelta.begin(), ndpDelta.end());
+  }
+  if (delta.oldState()->getDefaultVlan() !=
+      delta.newState()->getDefaultVlan()) {
+    ++estimate->vlans;
+  }
+
+  // An interface and its station entry are created, updated or deleted
+  // together
+  auto intfsDelta = delta.getIntfsDelta();
+  estimate->interfaces +=
+    2 * std::distance(intfsDelta.begin(), intfsDelta.end());
+
+  for (const auto& rtDelta : delta.getRouteTablesDelta()) {
+    estimate->routes += countRouteOperations(rtDelta.getRoutesV4Delta());
+    estimate->routes += countRouteOperations(rtDelta.getRoutesV6Delta());
+  }
+  return true;
+}
+
+bool BcmSwitch::getPortCounters(PortID port,
+                                PortCounters* counters) const {
+  auto bcmPort = portTable_->getBcmPortIf(port);
+  return bcmPort && bcmPort->getCachedCounters(counters);
 }
 
 bool BcmSwitch::isPortUp(PortID port) const {
@@ -313,6 +744,76 @@ bool BcmSwitch::isPortUp(PortID port) const {
   return linkStatus == OPENNSL_PORT_LINK_STATUS_UP;
 }
 
+bool BcmSwitch::setNeighborReachable(RouterID router, const IPAddress& ip,
+                                     bool reachable) {
+  std::lock_guard<std::mutex> g(lock_);
+  if (!hostTable_) {
+    // The unit is being released
+    return true;
+  }
+  auto vrf = getBcmVrfId(router);
+  auto key = std::make_pair(vrf, ip);
+  if (reachable) {
+    unreachableNeighbors_.erase(key);
+  } else {
+    unreachableNeighbors_.insert(key);
+  }
+  auto* host = hostTable_->getBcmHostIf(vrf, ip);
+  if (!host) {
+    return true;
+  }
+  if (!reachable) {
+    auto pruned = hostTable_->neighborDown(host);
+    if (pruned > 0) {
+      BcmStats::get()->ecmpNeighborPathsPruned(pruned);
+      VLOG(1) << "pruned " << pruned << " ECMP paths to unreachable "
+              << "neighbor " << ip;
+    }
+  } else if (host->getPort() != 0) {
+    // A neighbor that is not resolved stays out of the ECMP groups
+    auto restored = hostTable_->neighborUp(host);
+    VLOG(1) << "restored " << restored << " ECMP paths to neighbor " << ip;
+  }
+  return true;
+}
+
+bool BcmSwitch::getAndClearNeighborHits(NeighborHits* hits) {
+  if (!FLAGS_bcm_neighbor_hit_bits) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> g(lock_);
+  opennsl_l3_info_t l3Info;
+  opennsl_l3_info_t_init(&l3Info);
+  opennsl_l3_info(unit_, &l3Info);
+
+  // Collect the hit entries first, rather than modifying the table while
+  // the SDK is traversing it.
+  std::vector<opennsl_l3_host_t> hitHosts;
+  auto rv = opennsl_l3_host_traverse(unit_, 0, 0, l3Info.l3info_max_host,
+                                     hitHostTraversalCallback, &hitHosts);
+  bcmCheckError(rv, "failed to traverse IPv4 L3 hosts");
+  rv = opennsl_l3_host_traverse(unit_, OPENNSL_L3_IP6, 0,
+                                l3Info.l3info_max_host / 2,
+                                hitHostTraversalCallback, &hitHosts);
+  bcmCheckError(rv, "failed to traverse IPv6 L3 hosts");
+
+  for (auto& host : hitHosts) {
+    bool isV6 = host.l3a_flags & OPENNSL_L3_IP6;
+    auto ip = isV6 ?
+      IPAddress::fromBinary(ByteRange(host.l3a_ip6_addr,
+                                      sizeof(host.l3a_ip6_addr))) :
+      IPAddress::fromLongHBO(host.l3a_ip_addr);
+    // Looking the entry up with HIT_CLEAR resets its hit bit
+    host.l3a_flags = (isV6 ? OPENNSL_L3_IP6 : 0) | OPENNSL_L3_HIT_CLEAR;
+    rv = opennsl_l3_host_find(unit_, &host);
+    bcmLogError(rv, "failed to clear the hit bit of L3 host ", ip);
+    hits->push_back(ip);
+  }
+  VLOG(3) << hitHosts.size() << " L3 hosts hit";
+  return true;
+}
+
 std::shared_ptr<SwitchState> BcmSwitch::getBootSwitchState() const {
   auto bootState = make_shared<SwitchState>();
   opennsl_port_config_t pcfg;
@@ -336,22 +837,25 @@ std::shared_ptr<SwitchState> BcmSwitch::getBootSwitchState() const {
 
 std::pair<std::shared_ptr<SwitchState>, BootType>
 BcmSwitch::init(Callback* callback) {
-  // Create unitObject_ before doing anything else.
-  if (!unitObject_) {
-    unitObject_ = BcmAPI::initOnlyUnit();
-  }
-  unit_ = unitObject_->getNumber();
-  unitObject_->setCookie(this);
-  callback_ = callback;
+  {
+    BootTimeline::PhaseTimer timer("sdk_attach");
+    // Create unitObject_ before doing anything else.
+    if (!unitObject_) {
+      unitObject_ = BcmAPI::initOnlyUnit();
+    }
+    unit_ = unitObject_->getNumber();
+    unitObject_->setCookie(this);
+    callback_ = callback;
 
-  // Initialize the switch.
-  if (!unitObject_->isAttached()) {
-    unitObject_->attach();
-  }
+    // Initialize the switch.
+    if (!unitObject_->isAttached()) {
+      unitObject_->attach();
+    }
 
-  LOG(INFO) << "Initializing BcmSwitch for unit " << unit_;
+    LOG(INFO) << "Initializing BcmSwitch for unit " << unit_;
 
-  platform_->onUnitAttach();
+    platform_->onUnitAttach();
+  }
 
   // Additional switch configuration
   auto state = make_shared<SwitchState>();
@@ -391,7 +895,19 @@ BcmSwitch::init(Callback* callback) {
   rv = opennsl_switch_control_set(unit_, opennslSwitchNdPktToCpu, 1);
   bcmCheckError(rv, "failed to set NDP trapping");
   // Setup hash functions for ECMP
-  ecmpHashSetup();
+  {
+    BootTimeline::PhaseTimer timer("ecmp_hash_setup");
+    ecmpHashSetup();
+  }
+  // Track the buffer use of the ports, which they export as watermarks
+  if (FLAGS_bcm_buffer_watermarks) {
+    rv = opennsl_switch_control_set(unit_, opennslSwitchBstEnable, 1);
+    bcmCheckError(rv, "failed to enable buffer statistics tracking");
+  }
+
+  // The ACL entries, such as the control plane traps, are added to this
+  // group as the config is applied
+  aclTable_->createGroup();
 
   dropDhcpPackets();
   dropIPv6RAs();
@@ -412,7 +928,10 @@ BcmSwitch::init(Callback* callback) {
   toCPUEgress_ = make_unique<BcmEgress>(this);
   toCPUEgress_->programToCPU();
 
-  portTable_->initPorts(&pcfg, false);
+  {
+    BootTimeline::PhaseTimer timer("port_init");
+    portTable_->initPorts(&pcfg, false);
+  }
 
   // Enable linkscan
   //
@@ -420,14 +939,17 @@ BcmSwitch::init(Callback* callback) {
   // on disabled ports.  I'm not sure if the extra complexity of keeping the
   // linkscan state in sync with the port state is worth any possible benefits,
   // though.)
-  rv = opennsl_linkscan_mode_set_pbm(unit_, pcfg.port,
-      OPENNSL_LINKSCAN_MODE_SW);
-  bcmCheckError(rv, "failed to set linkscan ports");
-  rv = opennsl_linkscan_register(unit_, linkscanCallback);
-  bcmCheckError(rv, "failed to register for linkscan events");
-  flags_ |= LINKSCAN_REGISTERED;
-  rv = opennsl_linkscan_enable_set(unit_, FLAGS_linkscan_interval_us);
-  bcmCheckError(rv, "failed to enable linkscan");
+  {
+    BootTimeline::PhaseTimer timer("linkscan_setup");
+    rv = opennsl_linkscan_mode_set_pbm(unit_, pcfg.port,
+        OPENNSL_LINKSCAN_MODE_SW);
+    bcmCheckError(rv, "failed to set linkscan ports");
+    rv = opennsl_linkscan_register(unit_, linkscanCallback);
+    bcmCheckError(rv, "failed to register for linkscan events");
+    flags_ |= LINKSCAN_REGISTERED;
+    rv = opennsl_linkscan_enable_set(unit_, FLAGS_linkscan_interval_us);
+    bcmCheckError(rv, "failed to enable linkscan");
+  }
 
   // Set the spanning tree state of all ports to forwarding.
   // TODO: Eventually the spanning tree state should be part of the Port
@@ -456,12 +978,42 @@ void BcmSwitch::initialConfigApplied() {
       rxFlags);         // uint32 flags
   bcmCheckError(rv, "failed to register packet rx callback");
   flags_ |= RX_REGISTERED;
-  //
-  // TODO: Configure rate limiting for packets sent to the CPU
-  //
+
+  // The CPU queue limits and reason mapping were programmed with the rest
+  // of the initial config.  The receive pool and overall rate limit can only
+  // be set when starting the RX API, so they come from the initial config.
+  uint32_t rxPoolSize, rxRate;
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    rxPoolSize = cpuRxPoolSize_;
+    rxRate = cpuRxRate_;
+  }
+  opennsl_rx_cfg_t rxCfg;
+  opennsl_rx_cfg_t* rxCfgPtr = nullptr;
+  if (rxPoolSize || rxRate) {
+    rv = opennsl_rx_cfg_get(unit_, &rxCfg);
+    bcmCheckError(rv, "failed to get the default packet rx config");
+    if (rxPoolSize) {
+      rxCfg.pkts_per_chain = rxPoolSize;
+    }
+    if (rxRate) {
+      rxCfg.global_pps = rxRate;
+    }
+    rxCfgPtr = &rxCfg;
+  }
   // Start the Broadcom packet RX API.
-  rv = opennsl_rx_start(unit_, nullptr);
+  rv = opennsl_rx_start(unit_, rxCfgPtr);
   bcmCheckError(rv, "failed to start broadcom packet rx API");
+
+  // Report L2 learn and age events, now that the VLANs are configured
+  if (FLAGS_bcm_l2_learn_events) {
+    rv = opennsl_l2_addr_register(unit_, l2AddrCallback, this);
+    bcmCheckError(rv, "failed to register for L2 learn events");
+    flags_ |= L2_LEARNING_REGISTERED;
+  }
+
+  startQueueSampler();
+  startTableAuditor();
 }
 
 void BcmSwitch::stateChanged(const StateDelta& delta) {
@@ -469,28 +1021,87 @@ void BcmSwitch::stateChanged(const StateDelta& delta) {
   // StateDelta, and isn't particularly hardware-specific.  I plan to refactor
   // it, and move it out into a common helper class that can be shared by
   // many different HwSwitch implementations.
+  auto start = std::chrono::steady_clock::now();
 
   // Take the lock before modifying any objects
   std::lock_guard<std::mutex> g(lock_);
+  auto stats = BcmStats::get();
+  stats->sdkDeltaStarted();
+  SCOPE_EXIT {
+    stats->sdkDeltaDone();
+    VLOG(2) << "State update made " << stats->getDeltaSdkCalls()
+            << " SDK calls in " << stats->getDeltaSdkUsec() << "us";
+  };
+  // The FIB compressors cannot be rolled back, so a failed update can only
+  // be undone without them
+  if (!FLAGS_bcm_rollback_on_error || compressFib_) {
+    applyStateDelta(delta, start);
+    return;
+  }
+  BcmUndoLog undoLog;
+  undoLog_ = &undoLog;
+  SCOPE_EXIT {
+    undoLog_ = nullptr;
+  };
+  try {
+    applyStateDelta(delta, start);
+  } catch (const std::exception& ex) {
+    // Nothing done while undoing the changes needs undoing in turn
+    undoLog_ = nullptr;
+    LOG(ERROR) << "failed to apply state change to hardware, undoing "
+               << undoLog.size() << " changes: " << folly::exceptionStr(ex);
+    if (undoLog.rollback()) {
+      throw FbossHwRolledBackError(
+          "failed to apply state change to hardware: ",
+          folly::exceptionStr(ex));
+    }
+    throw;
+  }
+}
+
+void BcmSwitch::recordUndo(std::function<void()> undo) {
+  if (undoLog_) {
+    undoLog_->record(std::move(undo));
+  }
+}
+
+void BcmSwitch::applyStateDelta(const StateDelta& delta,
+                                std::chrono::steady_clock::time_point start) {
+  // Each change is recorded in the undo log as soon as it is applied, with
+  // how to apply the opposite change.  The undo actions may run after this
+  // returns, so they hold on to what they need by value.
+  auto oldState = delta.oldState();
+  auto newState = delta.newState();
+
   // As the first step, disable ports that are now disabled.
   // This ensures that we immediately stop forwarding traffic on these ports.
+  // Ports that belong to other units are left alone.
   forEachChanged(delta.getPortsDelta(),
     [&] (const shared_ptr<Port>& oldPort, const shared_ptr<Port>& newPort) {
-      if (oldPort->getState() == newPort->getState()) {
+      if (oldPort->getState() == newPort->getState() ||
+          !portTable_->hasPort(newPort->getID())) {
         return;
       }
       if (newPort->getState() == cfg::PortState::DOWN ||
           newPort->getState() == cfg::PortState::POWER_DOWN) {
         changePortState(oldPort, newPort);
+        recordUndo([=] { changePortState(newPort, oldPort); });
       }
     });
 
-  // remove all routes to be deleted
-  processRemovedRoutes(delta);
+  // remove all routes to be deleted, unless they are to be deleted only
+  // once the added and changed routes are in place
+  if (!FLAGS_bcm_route_make_before_break) {
+    processRemovedRoutes(delta);
+  }
 
   // delete all interface not existing anymore. that should stop
   // all traffic on that interface now
-  forEachRemoved(delta.getIntfsDelta(), &BcmSwitch::processRemovedIntf, this);
+  forEachRemoved(delta.getIntfsDelta(),
+    [&] (const shared_ptr<Interface>& intf) {
+      processRemovedIntf(intf);
+      recordUndo([=] { processAddedIntf(intf); });
+    });
 
   // Add all new VLANs, and modify VLAN port memberships.
   // We don't actually delete removed VLANs at this point, we simply remove
@@ -498,19 +1109,66 @@ void BcmSwitch::stateChanged(const StateDelta& delta) {
   // VLAN will still switch use this VLAN until we get the new VLAN fully
   // configured.
   forEachChanged(delta.getVlansDelta(),
-                 &BcmSwitch::processChangedVlan,
-                 &BcmSwitch::processAddedVlan,
-                 &BcmSwitch::preprocessRemovedVlan,
-                 this);
+    [&] (const shared_ptr<Vlan>& oldVlan, const shared_ptr<Vlan>& newVlan) {
+      processChangedVlan(oldVlan, newVlan);
+      recordUndo([=] { processChangedVlan(newVlan, oldVlan); });
+    },
+    [&] (const shared_ptr<Vlan>& vlan) {
+      processAddedVlan(vlan);
+      recordUndo([=] { processRemovedVlan(vlan); });
+    },
+    [&] (const shared_ptr<Vlan>& vlan) {
+      preprocessRemovedVlan(vlan);
+      recordUndo([=] {
+        auto emptyVlan = vlan->clone();
+        emptyVlan->setPorts(Vlan::MemberPorts());
+        processChangedVlan(emptyVlan, vlan);
+      });
+    });
 
-  // Edit port ingress VLAN and speed settings
+  // Edit port ingress VLAN, speed, sFlow sampling, QoS and buffer
+  // settings.  Each port only needs SDK calls of its own, so the ports are
+  // done concurrently.
+  std::vector<std::pair<shared_ptr<Port>, shared_ptr<Port>>> changedPorts;
   forEachChanged(delta.getPortsDelta(),
     [&] (const shared_ptr<Port>& oldPort, const shared_ptr<Port>& newPort) {
+      if (!portTable_->hasPort(newPort->getID())) {
+        return;
+      }
+      if (oldPort->getIngressVlan() != newPort->getIngressVlan() ||
+          oldPort->getSpeed() != newPort->getSpeed() ||
+          sampleRatesChanged(oldPort, newPort) ||
+          oldPort->getQos() != newPort->getQos() ||
+          oldPort->getBuffer() != newPort->getBuffer()) {
+        changedPorts.emplace_back(oldPort, newPort);
+      }
+    });
+  runInParallel(changedPorts.size(), FLAGS_bcm_port_config_threads,
+    [&] (size_t i) {
+      auto oldPort = changedPorts[i].first;
+      auto newPort = changedPorts[i].second;
       if (oldPort->getIngressVlan() != newPort->getIngressVlan()) {
         updateIngressVlan(oldPort, newPort);
+        recordUndo([=] { updateIngressVlan(newPort, oldPort); });
       }
       if (oldPort->getSpeed() != newPort->getSpeed()) {
         updatePortSpeed(oldPort, newPort);
+        recordUndo([=] { updatePortSpeed(newPort, oldPort); });
+      }
+      if (sampleRatesChanged(oldPort, newPort)) {
+        updatePortSampleRates(newPort);
+        recordUndo([=] { updatePortSampleRates(oldPort); });
+      }
+      if (oldPort->getQos() != newPort->getQos()) {
+        updatePortQos(newPort);
+        recordUndo([=] { updatePortQos(oldPort); });
+      }
+      if (oldPort->getBuffer() != newPort->getBuffer()) {
+        auto* bcmPort = portTable_->getBcmPort(newPort->getID());
+        bcmPort->updateBuffer(oldPort->getBuffer(), newPort->getBuffer());
+        recordUndo([=] {
+          bcmPort->updateBuffer(newPort->getBuffer(), oldPort->getBuffer());
+        });
       }
     });
 
@@ -520,22 +1178,80 @@ void BcmSwitch::stateChanged(const StateDelta& delta) {
   //
   // We always specify the ingress VLAN for all enabled ports, so this VLAN is
   // never really used for us.  We instead always point the default VLAN.
-  if (delta.oldState()->getDefaultVlan() !=
-      delta.newState()->getDefaultVlan()) {
-    changeDefaultVlan(delta.newState()->getDefaultVlan());
+  if (oldState->getDefaultVlan() != newState->getDefaultVlan()) {
+    changeDefaultVlan(newState->getDefaultVlan());
+    recordUndo([=] { changeDefaultVlan(oldState->getDefaultVlan()); });
+  }
+
+  // The ECMP hash only affects which path new packets take, so it can
+  // change at any point
+  if (delta.oldState()->getEcmpHashConfig() !=
+      delta.newState()->getEcmpHashConfig()) {
+    changeEcmpHash(delta.oldState()->getEcmpHashConfig(),
+                   delta.newState()->getEcmpHashConfig());
+    recordUndo([=] {
+      changeEcmpHash(newState->getEcmpHashConfig(),
+                     oldState->getEcmpHashConfig());
+    });
+  }
+
+  // CPU queue limits and the queue of each packet rx reason
+  if (delta.oldState()->getCpuRxConfig() !=
+      delta.newState()->getCpuRxConfig()) {
+    changeCpuRxConfig(delta.oldState()->getCpuRxConfig(),
+                      delta.newState()->getCpuRxConfig());
+    recordUndo([=] {
+      changeCpuRxConfig(newState->getCpuRxConfig(),
+                        oldState->getCpuRxConfig());
+    });
+  }
+
+  // ACL entries, which may trap packets to the CPU queues set up above
+  processAclChanges(delta);
+
+  // Route classes, before the routes, so that new routes are attached to
+  // the counters of their new classes right away
+  if (delta.oldState()->getRouteCounters() !=
+      delta.newState()->getRouteCounters()) {
+    changeRouteCounters(delta.newState()->getRouteCounters());
+    recordUndo([=] {
+      changeRouteCounters(oldState->getRouteCounters());
+    });
   }
 
   // Update changed interfaces
-  forEachChanged(delta.getIntfsDelta(), &BcmSwitch::processChangedIntf, this);
+  forEachChanged(delta.getIntfsDelta(),
+    [&] (const shared_ptr<Interface>& oldIntf,
+         const shared_ptr<Interface>& newIntf) {
+      processChangedIntf(oldIntf, newIntf);
+      recordUndo([=] { processChangedIntf(newIntf, oldIntf); });
+    });
 
   // Remove deleted VLANs
-  forEachRemoved(delta.getVlansDelta(), &BcmSwitch::processRemovedVlan, this);
+  forEachRemoved(delta.getVlansDelta(), [&] (const shared_ptr<Vlan>& vlan) {
+    processRemovedVlan(vlan);
+    recordUndo([=] { processAddedVlan(vlan); });
+  });
 
   // Add all new interfaces
-  forEachAdded(delta.getIntfsDelta(), &BcmSwitch::processAddedIntf, this);
+  forEachAdded(delta.getIntfsDelta(), [&] (const shared_ptr<Interface>& intf) {
+    processAddedIntf(intf);
+    recordUndo([=] { processRemovedIntf(intf); });
+  });
+
+  // Neighbors moved between trunks are programmed through the old trunks
+  // again once the trunks themselves were undone, so this is recorded
+  // before the trunks change.
+  recordUndo([=] {
+    reprogramAggregatePortNeighbors(StateDelta(newState, oldState));
+  });
+
+  // Program the trunks before the neighbors that are reached through them
+  processAggregatePortChanges(delta);
 
   // Any ARP changes
-  processArpChanges(delta);
+  processArpChanges(delta, start);
+  reprogramAggregatePortNeighbors(delta);
 
   // Process any new routes or route changes
   processAddedChangedRoutes(delta);
@@ -543,16 +1259,25 @@ void BcmSwitch::stateChanged(const StateDelta& delta) {
   // As the last step, enable newly enabled ports.
   // Doing this as the last step ensures that we only start forwarding traffic
   // once the ports are correctly configured.
+  changedPorts.clear();
   forEachChanged(delta.getPortsDelta(),
     [&] (const shared_ptr<Port>& oldPort, const shared_ptr<Port>& newPort) {
-      if (oldPort->getState() == newPort->getState()) {
+      if (oldPort->getState() == newPort->getState() ||
+          !portTable_->hasPort(newPort->getID())) {
         return;
       }
       if (newPort->getState() != cfg::PortState::DOWN &&
           newPort->getState() != cfg::PortState::POWER_DOWN) {
-        changePortState(oldPort, newPort);
+        changedPorts.emplace_back(oldPort, newPort);
       }
     });
+  runInParallel(changedPorts.size(), FLAGS_bcm_port_config_threads,
+    [&] (size_t i) {
+      auto oldPort = changedPorts[i].first;
+      auto newPort = changedPorts[i].second;
+      changePortState(oldPort, newPort);
+      recordUndo([=] { changePortState(newPort, oldPort); });
+    });
 }
 
 unique_ptr<TxPacket> BcmSwitch::allocatePacket(uint32_t size) {
@@ -632,6 +1357,55 @@ void BcmSwitch::updateIngressVlan(const std::shared_ptr<Port>& oldPort,
                 newPort->getID(), " to ", newPort->getIngressVlan());
 }
 
+void BcmSwitch::updatePortSampleRates(const std::shared_ptr<Port>& port) {
+  opennsl_port_t bcmPort = portTable_->getBcmPortId(port->getID());
+  auto ret = opennsl_port_sample_rate_set(unit_, bcmPort,
+                                          port->getSflowIngressRate(),
+                                          port->getSflowEgressRate());
+  bcmCheckError(ret, "failed to set sFlow sampling rates of port ",
+                port->getID());
+}
+
+void BcmSwitch::updatePortQos(const std::shared_ptr<Port>& port) {
+  typedef Port::QosConfig QosConfig;
+  const auto& qos = port->getQos();
+  auto* bcmPort = portTable_->getBcmPort(port->getID());
+  auto portId = bcmPort->getBcmPortId();
+
+  // Packets are given the internal priority of their queue, and each
+  // internal priority is put in the queue with the same number.  The full
+  // tables are written, so values removed from the config go back to
+  // queue 0.
+  auto rv = opennsl_port_dscp_map_mode_set(unit_, portId,
+                                           OPENNSL_PORT_DSCP_MAP_ALL);
+  bcmCheckError(rv, "failed to enable DSCP mapping on port ", port->getID());
+  for (int dscp = 0; dscp < QosConfig::kNumDscps; ++dscp) {
+    rv = opennsl_port_dscp_map_set(unit_, portId, dscp, dscp,
+                                   qos.getQueueForDscp(dscp));
+    bcmCheckError(rv, "failed to map DSCP ", dscp, " on port ",
+                  port->getID());
+  }
+  for (int pcp = 0; pcp < QosConfig::kNumPcps; ++pcp) {
+    rv = opennsl_port_vlan_priority_map_set(unit_, portId, pcp, 0,
+                                            qos.getQueueForPcp(pcp),
+                                            opennslColorGreen);
+    bcmCheckError(rv, "failed to map PCP ", pcp, " on port ", port->getID());
+  }
+  for (int queue = 0; queue < QosConfig::kNumQueues; ++queue) {
+    rv = opennsl_cosq_port_mapping_set(unit_, portId, queue, queue);
+    bcmCheckError(rv, "failed to map priority ", queue, " on port ",
+                  port->getID());
+    auto weight = qos.getQueueWeight(queue);
+    auto mode = weight == 0 ? OPENNSL_COSQ_STRICT :
+      OPENNSL_COSQ_WEIGHTED_ROUND_ROBIN;
+    rv = opennsl_cosq_gport_sched_set(unit_, bcmPort->getBcmGport(), queue,
+                                      mode, weight);
+    bcmCheckError(rv, "failed to set the weight of queue ", queue,
+                  " on port ", port->getID());
+  }
+  VLOG(1) << "updated the QoS settings of port " << port->getID();
+}
+
 void BcmSwitch::updatePortSpeed(const std::shared_ptr<Port>& oldPort,
                                 const std::shared_ptr<Port>& newPort) {
   opennsl_port_t bcmPort = portTable_->getBcmPortId(newPort->getID());
@@ -706,56 +1480,126 @@ void BcmSwitch::changeDefaultVlan(VlanID id) {
   bcmCheckError(rv, "failed to set default VLAN to ", id);
 }
 
+void BcmSwitch::changeCpuRxConfig(const CpuRxConfig& oldConfig,
+                                  const CpuRxConfig& newConfig) {
+  if (oldConfig.queueLimits != newConfig.queueLimits) {
+    changeCpuQueueLimits(oldConfig, newConfig);
+  }
+  if (oldConfig.reasonToQueue != newConfig.reasonToQueue) {
+    programRxReasonToQueue(newConfig);
+  }
+  // Used by initialConfigApplied(); later changes need a restart
+  cpuRxPoolSize_ = newConfig.poolSize;
+  cpuRxRate_ = newConfig.rate;
+}
+
+void BcmSwitch::changeCpuQueueLimits(const CpuRxConfig& oldConfig,
+                                     const CpuRxConfig& newConfig) {
+  for (const auto& entry : newConfig.queueLimits) {
+    if (entry.first >= kNumCpuQueues) {
+      throw FbossError("CPU queue ", entry.first, " does not exist; there "
+                       "are only ", kNumCpuQueues);
+    }
+  }
+  opennsl_gport_t cpuGport;
+  auto rv = opennsl_port_gport_get(unit_, kCpuPort, &cpuGport);
+  bcmCheckError(rv, "failed to get the CPU gport");
+
+  const CpuRxConfig::QueueLimit noLimit;
+  auto getLimit = [&](const CpuRxConfig& config, int cosq) {
+    auto it = config.queueLimits.find(cosq);
+    return it == config.queueLimits.end() ? noLimit : it->second;
+  };
+  for (int cosq = 0; cosq < kNumCpuQueues; ++cosq) {
+    auto oldLimit = getLimit(oldConfig, cosq);
+    auto newLimit = getLimit(newConfig, cosq);
+    if (oldLimit == newLimit) {
+      continue;
+    }
+    // A rate of 0 removes the limit
+    rv = opennsl_cosq_port_pps_set(unit_, cpuGport, cosq, newLimit.rate);
+    bcmCheckError(rv, "failed to set the rate of CPU queue ", cosq, " to ",
+                  newLimit.rate);
+    rv = opennsl_cosq_port_burst_set(unit_, cpuGport, cosq, newLimit.burst);
+    bcmCheckError(rv, "failed to set the burst of CPU queue ", cosq, " to ",
+                  newLimit.burst);
+    VLOG(1) << "CPU queue " << cosq << " limited to " << newLimit.rate
+            << " pps, burst " << newLimit.burst;
+  }
+}
+
+void BcmSwitch::programRxReasonToQueue(const CpuRxConfig& config) {
+  const auto& reasonToQueue = config.reasonToQueue;
+  int numEntries;
+  auto rv = opennsl_rx_cosq_mapping_size_get(unit_, &numEntries);
+  bcmCheckError(rv, "failed to get the size of the CPU queue mapping");
+  if (reasonToQueue.size() > static_cast<size_t>(numEntries)) {
+    throw FbossError("too many packet rx reasons mapped to CPU queues: ",
+                     reasonToQueue.size(), ", only ", numEntries,
+                     " are supported");
+  }
+
+  // Entries with a lower index match first
+  for (size_t index = 0; index < reasonToQueue.size(); ++index) {
+    auto reason = reasonToQueue[index].first;
+    auto cosq = reasonToQueue[index].second;
+    if (cosq >= kNumCpuQueues) {
+      throw FbossError("CPU queue ", cosq, " does not exist; there are only ",
+                       kNumCpuQueues);
+    }
+    // Match on the reason alone.  UNMATCHED matches no reason, so with an
+    // empty mask it matches every packet.
+    opennsl_rx_reasons_t reasons;
+    OPENNSL_RX_REASON_CLEAR_ALL(reasons);
+    if (reason != cfg::PacketRxReason::UNMATCHED) {
+      OPENNSL_RX_REASON_SET(reasons, getRxReason(reason));
+    }
+    rv = opennsl_rx_cosq_mapping_set(unit_, index, reasons, reasons,
+                                     0, 0, 0, 0, cosq);
+    bcmCheckError(rv, "failed to map packet rx reason ",
+                  static_cast<int>(reason), " to CPU queue ", cosq);
+  }
+
+  // Remove any entries after the new ones, including those from before a
+  // warm boot, which the old state does not know about.
+  for (int index = reasonToQueue.size(); index < numEntries; ++index) {
+    rv = opennsl_rx_cosq_mapping_delete(unit_, index);
+    if (rv != OPENNSL_E_NOT_FOUND) {
+      bcmCheckError(rv, "failed to delete CPU queue mapping ", index);
+    }
+  }
+}
+
 void BcmSwitch::processChangedVlan(const shared_ptr<Vlan>& oldVlan,
                                    const shared_ptr<Vlan>& newVlan) {
-  // Update port membership
-  opennsl_pbmp_t addedPorts;
-  OPENNSL_PBMP_CLEAR(addedPorts);
-  opennsl_pbmp_t addedUntaggedPorts;
-  OPENNSL_PBMP_CLEAR(addedUntaggedPorts);
-  opennsl_pbmp_t removedPorts;
-  OPENNSL_PBMP_CLEAR(removedPorts);
-  const auto& oldPorts = oldVlan->getPorts();
-  const auto& newPorts = newVlan->getPorts();
-
-  auto oldIter = oldPorts.begin();
-  auto newIter = newPorts.begin();
-  uint32_t numAdded{0};
-  uint32_t numRemoved{0};
-  while (oldIter != oldPorts.end() || newIter != newPorts.end()) {
-    LoopAction action = LoopAction::CONTINUE;
-    if (oldIter == oldPorts.end() ||
-        (newIter != newPorts.end() && newIter->first < oldIter->first)) {
-      // This port was added
-      ++numAdded;
-      opennsl_port_t bcmPort = portTable_->getBcmPortId(newIter->first);
-      OPENNSL_PBMP_PORT_ADD(addedPorts, bcmPort);
-      if (!newIter->second.tagged) {
-        OPENNSL_PBMP_PORT_ADD(addedUntaggedPorts, bcmPort);
-      }
-      ++newIter;
-    } else if (newIter == newPorts.end() ||
-        (oldIter != oldPorts.end() && oldIter->first < newIter->first)) {
-      // This port was removed
-      ++numRemoved;
-      opennsl_port_t bcmPort = portTable_->getBcmPortId(oldIter->first);
-      OPENNSL_PBMP_PORT_ADD(removedPorts, bcmPort);
-      ++oldIter;
-    } else {
-      ++oldIter;
-      ++newIter;
-    }
+  const auto& oldPorts = oldVlan->getPortBitmap();
+  const auto& newPorts = newVlan->getPortBitmap();
+  const auto& oldUntagged = oldVlan->getUntaggedPortBitmap();
+  const auto& newUntagged = newVlan->getUntaggedPortBitmap();
+  if (oldPorts == newPorts && oldUntagged == newUntagged) {
+    // Most VLAN changes are to the neighbor tables
+    return;
   }
 
+  // Update port membership.  Ports that changed between tagged and untagged
+  // are removed, then added back with their new tagging.
+  auto changed = oldPorts ^ newPorts;
+  auto retagged = (oldUntagged ^ newUntagged) & oldPorts & newPorts;
+  auto removed = (changed & oldPorts) | retagged;
+  auto added = (changed & newPorts) | retagged;
+
   VLOG(2) << "updating VLAN " << newVlan->getID() << ": " <<
-    numAdded << " ports added, " << numRemoved << " ports removed";
-  if (numRemoved) {
-    auto rv = opennsl_vlan_port_remove(unit_, newVlan->getID(), removedPorts);
+    added.count() << " ports added, " << removed.count() <<
+    " ports removed";
+  if (!removed.empty()) {
+    auto rv = opennsl_vlan_port_remove(unit_, newVlan->getID(),
+                                       portTable_->getBcmPbmp(removed));
     bcmCheckError(rv, "failed to remove ports from VLAN ", newVlan->getID());
   }
-  if (numAdded) {
-    auto rv = opennsl_vlan_port_add(unit_, newVlan->getID(),
-                                addedPorts, addedUntaggedPorts);
+  if (!added.empty()) {
+    auto rv = opennsl_vlan_port_add(
+        unit_, newVlan->getID(), portTable_->getBcmPbmp(added),
+        portTable_->getBcmPbmp(added & newUntagged));
     bcmCheckError(rv, "failed to add ports to VLAN ", newVlan->getID());
   }
 }
@@ -764,18 +1608,8 @@ void BcmSwitch::processAddedVlan(const shared_ptr<Vlan>& vlan) {
   VLOG(2) << "creating VLAN " << vlan->getID() << " with " <<
     vlan->getPorts().size() << " ports";
 
-  opennsl_pbmp_t pbmp;
-  opennsl_pbmp_t ubmp;
-  OPENNSL_PBMP_CLEAR(pbmp);
-  OPENNSL_PBMP_CLEAR(ubmp);
-
-  for (const auto& entry : vlan->getPorts()) {
-    opennsl_port_t bcmPort = portTable_->getBcmPortId(entry.first);
-    OPENNSL_PBMP_PORT_ADD(pbmp, bcmPort);
-    if (!entry.second.tagged) {
-      OPENNSL_PBMP_PORT_ADD(ubmp, bcmPort);
-    }
-  }
+  auto pbmp = portTable_->getBcmPbmp(vlan->getPortBitmap());
+  auto ubmp = portTable_->getBcmPbmp(vlan->getUntaggedPortBitmap());
   typedef BcmWarmBootCache::VlanInfo VlanInfo;
   // Since during warm boot all VLAN in the config will show
   // up as added VLANs we only need to consult the warm boot
@@ -794,6 +1628,7 @@ void BcmSwitch::processAddedVlan(const shared_ptr<Vlan>& vlan) {
       auto oldVlan = vlan->clone();
       warmBootCache_->fillVlanPortInfo(oldVlan.get());
       processChangedVlan(oldVlan, vlan);
+      warmBootCache_->reprogrammed();
     } else {
       VLOG (1) <<" Vlan : "<<vlan->getID()<<" already exists ";
     }
@@ -840,7 +1675,8 @@ void BcmSwitch::processRemovedIntf(const shared_ptr<Interface>& intf) {
 }
 
 template<typename DELTA>
-void BcmSwitch::processNeighborEntryDelta(const DELTA& delta) {
+void BcmSwitch::processNeighborEntryDelta(
+    const DELTA& delta, std::chrono::steady_clock::time_point start) {
   const auto* oldEntry = delta.getOld().get();
   const auto* newEntry = delta.getNew().get();
 
@@ -863,13 +1699,27 @@ void BcmSwitch::processNeighborEntryDelta(const DELTA& delta) {
       VLOG(3) << "adding neighbor entry " << newEntry->getIP().str()
               << " to " << newEntry->getMac().toString();
       host->program(intf->getBcmIfId(), newEntry->getMac(),
-                    getPortTable()->getBcmPortId(newEntry->getPort()));
+                    trunkTable_->getEgressPort(newEntry->getPort()));
+      if (!unreachableNeighbors_.count(
+              std::make_pair(vrf, IPAddress(newEntry->getIP())))) {
+        hostTable_->neighborUp(host);
+      }
     }
   } else if (!newEntry) {
     VLOG(3) << "deleting neighbor entry " << oldEntry->getIP().str();
     getIntfAndVrf(oldEntry->getIntfID());
     auto host = hostTable_->derefBcmHost(vrf, IPAddress(oldEntry->getIP()));
     if (host) {
+      // Move the traffic to the other paths of the ECMP groups first, so it
+      // is not punted to the CPU in the meantime
+      if (FLAGS_ecmp_neighbor_down_prune) {
+        auto pruned = hostTable_->neighborDown(host);
+        if (pruned > 0) {
+          BcmStats::get()->ecmpNeighborPathsPruned(pruned);
+          VLOG(2) << "pruned " << pruned << " ECMP paths to neighbor "
+                  << oldEntry->getIP().str();
+        }
+      }
       host->programToCPU(intf->getBcmIfId());
     }
   } else {
@@ -879,23 +1729,130 @@ void BcmSwitch::processNeighborEntryDelta(const DELTA& delta) {
     getIntfAndVrf(newEntry->getIntfID());
     auto host = hostTable_->getBcmHost(vrf, IPAddress(newEntry->getIP()));
     host->program(intf->getBcmIfId(), newEntry->getMac(),
-                  getPortTable()->getBcmPortId(newEntry->getPort()));
+                  trunkTable_->getEgressPort(newEntry->getPort()));
+    if (!unreachableNeighbors_.count(
+            std::make_pair(vrf, IPAddress(newEntry->getIP())))) {
+      hostTable_->neighborUp(host);
+    }
+  }
+
+  typedef typename std::decay<decltype(delta.getOld())>::type::element_type
+    Entry;
+  auto oldPtr = delta.getOld();
+  auto newPtr = delta.getNew();
+  recordUndo([=] {
+    processNeighborEntryDelta(DeltaValue<Entry>(newPtr, oldPtr), start);
+  });
+
+  // Routes and ECMP groups refer to the egress object of the host, which is
+  // replaced in place, so they forward to a newly resolved neighbor as soon
+  // as its host is programmed, without waiting for the routes to be
+  // reprogrammed.  Only the ECMP groups that neighborDown() pruned it from
+  // need it added back.
+  if (newEntry && !newEntry->isPending() &&
+      (!oldEntry || oldEntry->isPending())) {
+    auto usec = duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    BcmStats::get()->neighborResolved(usec);
   }
 }
 
-void BcmSwitch::processArpChanges(const StateDelta& delta) {
+void BcmSwitch::processArpChanges(
+    const StateDelta& delta, std::chrono::steady_clock::time_point start) {
   for (const auto& vlanDelta : delta.getVlansDelta()) {
     for (const auto& arpDelta : vlanDelta.getArpDelta()) {
-      processNeighborEntryDelta(arpDelta);
+      processNeighborEntryDelta(arpDelta, start);
     }
     for (const auto& ndpDelta : vlanDelta.getNdpDelta()) {
-      processNeighborEntryDelta(ndpDelta);
+      processNeighborEntryDelta(ndpDelta, start);
+    }
+  }
+}
+
+void BcmSwitch::processAclChanges(const StateDelta& delta) {
+  forEachRemoved(delta.getAclsDelta(),
+    [&] (const shared_ptr<AclEntry>& acl) {
+      aclTable_->deleteEntry(acl);
+      recordUndo([=] { aclTable_->addEntry(acl); });
+    });
+  forEachChanged(delta.getAclsDelta(),
+    [&] (const shared_ptr<AclEntry>& oldAcl,
+         const shared_ptr<AclEntry>& newAcl) {
+      aclTable_->changeEntry(oldAcl, newAcl);
+      recordUndo([=] { aclTable_->changeEntry(newAcl, oldAcl); });
+    });
+  forEachAdded(delta.getAclsDelta(),
+    [&] (const shared_ptr<AclEntry>& acl) {
+      aclTable_->addEntry(acl);
+      recordUndo([=] { aclTable_->deleteEntry(acl); });
+    });
+}
+
+void BcmSwitch::processAggregatePortChanges(const StateDelta& delta) {
+  // A port can only be in one trunk, so remove the old trunks first
+  forEachRemoved(delta.getAggregatePortsDelta(),
+    [&] (const shared_ptr<AggregatePort>& aggPort) {
+      trunkTable_->deleteTrunk(aggPort);
+      recordUndo([=] { trunkTable_->addTrunk(aggPort); });
+    });
+  forEachChanged(delta.getAggregatePortsDelta(),
+    [&] (const shared_ptr<AggregatePort>& oldAggPort,
+         const shared_ptr<AggregatePort>& newAggPort) {
+      trunkTable_->changeTrunk(oldAggPort, newAggPort);
+      recordUndo([=] { trunkTable_->changeTrunk(newAggPort, oldAggPort); });
+    });
+  forEachAdded(delta.getAggregatePortsDelta(),
+    [&] (const shared_ptr<AggregatePort>& aggPort) {
+      trunkTable_->addTrunk(aggPort);
+      recordUndo([=] { trunkTable_->deleteTrunk(aggPort); });
+    });
+}
+
+void BcmSwitch::reprogramAggregatePortNeighbors(const StateDelta& delta) {
+  const auto& oldAggPorts = delta.oldState()->getAggregatePorts();
+  const auto& newAggPorts = delta.newState()->getAggregatePorts();
+  if (oldAggPorts == newAggPorts) {
+    return;
+  }
+  auto getTrunk = [](const shared_ptr<AggregatePort>& aggPort) {
+    return aggPort ? static_cast<int>(aggPort->getID()) : -1;
+  };
+  boost::container::flat_set<PortID> movedPorts;
+  for (const auto& port : *delta.newState()->getPorts()) {
+    auto id = port->getID();
+    if (getTrunk(oldAggPorts->getAggregatePortForMember(id)) !=
+        getTrunk(newAggPorts->getAggregatePortForMember(id))) {
+      movedPorts.insert(id);
+    }
+  }
+  if (movedPorts.empty()) {
+    return;
+  }
+  for (const auto& vlan : *delta.newState()->getVlans()) {
+    reprogramNeighbors(vlan->getArpTable().get(), movedPorts);
+    reprogramNeighbors(vlan->getNdpTable().get(), movedPorts);
+  }
+}
+
+template<typename NTABLE>
+void BcmSwitch::reprogramNeighbors(
+    const NTABLE* table, const boost::container::flat_set<PortID>& ports) {
+  for (const auto& entry : *table) {
+    if (entry->isPending() || ports.count(entry->getPort()) == 0) {
+      continue;
+    }
+    const auto* intf = intfTable_->getBcmIntf(entry->getIntfID());
+    auto vrf = getBcmVrfId(intf->getInterface()->getRouterID());
+    auto* host = hostTable_->getBcmHostIf(vrf, IPAddress(entry->getIP()));
+    if (host) {
+      host->program(intf->getBcmIfId(), entry->getMac(),
+                    trunkTable_->getEgressPort(entry->getPort()));
     }
   }
 }
 
 template <typename RouteT>
-void BcmSwitch::processChangedRoute(const RouterID id,
+void BcmSwitch::processChangedRoute(const RouterID id, RouteQueue* queue,
                                     const shared_ptr<RouteT>& oldRoute,
                                     const shared_ptr<RouteT>& newRoute) {
   VLOG(3) << "changing to route entry @ vrf " << id << " from old: "
@@ -903,14 +1860,14 @@ void BcmSwitch::processChangedRoute(const RouterID id,
   // if the new route is not resolved, delete it instead of changing it
   if (!newRoute->isResolved()) {
     VLOG(1) << "Non-resolved route HW programming is skipped";
-    processRemovedRoute(id, oldRoute);
+    processRemovedRoute(id, queue, oldRoute);
   } else {
-    routeTable_->addRoute(getBcmVrfId(id), newRoute.get());
+    queueRouteAdd(id, queue, newRoute);
   }
 }
 
 template <typename RouteT>
-void BcmSwitch::processAddedRoute(const RouterID id,
+void BcmSwitch::processAddedRoute(const RouterID id, RouteQueue* queue,
                                   const shared_ptr<RouteT>& route) {
   VLOG(3) << "adding route entry @ vrf " << id << " " << route->str();
   // if the new route is not resolved, ignore it
@@ -918,62 +1875,228 @@ void BcmSwitch::processAddedRoute(const RouterID id,
     VLOG(1) << "Non-resolved route HW programming is skipped";
     return;
   }
-  routeTable_->addRoute(getBcmVrfId(id), route.get());
+  queueRouteAdd(id, queue, route);
 }
 
 template <typename RouteT>
-void BcmSwitch::processRemovedRoute(const RouterID id,
+void BcmSwitch::processRemovedRoute(const RouterID id, RouteQueue* queue,
                                     const shared_ptr<RouteT>& route) {
   VLOG(3) << "removing route entry @ vrf " << id << " " << route->str();
   if (!route->isResolved()) {
     VLOG(1) << "Non-resolved route HW programming is skipped";
     return;
   }
-  routeTable_->deleteRoute(getBcmVrfId(id), route.get());
+  queueRouteDelete(id, queue, route);
+}
+
+template <typename RouteT>
+void BcmSwitch::queueRouteAdd(RouterID id, RouteQueue* queue,
+                              const shared_ptr<RouteT>& route) {
+  if (!compressFib_) {
+    queue->addRoute(getBcmVrfId(id), route.get());
+    return;
+  }
+  typename FibCompressor<RouteT>::Changes changes;
+  compressedFibs_.at(id).get(route.get())->update(route, &changes);
+  queueFibChanges(id, queue, changes);
+}
+
+template <typename RouteT>
+void BcmSwitch::queueRouteDelete(RouterID id, RouteQueue* queue,
+                                 const shared_ptr<RouteT>& route) {
+  if (!compressFib_) {
+    queue->deleteRoute(getBcmVrfId(id), route.get());
+    return;
+  }
+  typename FibCompressor<RouteT>::Changes changes;
+  compressedFibs_.at(id).get(route.get())->remove(route->prefix(), &changes);
+  queueFibChanges(id, queue, changes);
+}
+
+template <typename ChangesT>
+void BcmSwitch::queueFibChanges(RouterID id, RouteQueue* queue,
+                                const ChangesT& changes) {
+  // The queue only keeps pointers to the forward info of added routes.
+  // Those routes are in the RIB of the compressor, or of the old state of
+  // the delta being applied, either of which outlives programQueuedRoutes().
+  auto vrf = getBcmVrfId(id);
+  for (const auto& change : changes) {
+    if (change.add) {
+      queue->addRoute(vrf, change.route.get());
+    } else {
+      queue->deleteRoute(vrf, change.route.get());
+    }
+  }
+}
+
+void BcmSwitch::queueRouteTableChanges(
+    const RouteTableDeltas& tables,
+    const std::function<void(RouterID, const RouteTablesDelta&,
+                             RouteQueue*)>& fn) {
+  // Working out the changes of a VRF only touches its own routes and FIB
+  // compressor, not the HW, so the VRFs are worked out in parallel.  Their
+  // queues are then handed over in table order, so the HW is programmed
+  // in the same order as when the tables are done one by one.
+  if (compressFib_) {
+    // The map itself must not change while the threads use it
+    for (const auto& table : tables) {
+      compressedFibs_[table.first];
+    }
+  }
+  std::vector<RouteQueue> queues(tables.size());
+  runInParallel(tables.size(), FLAGS_bcm_route_prep_threads,
+    [&] (size_t i) { fn(tables[i].first, tables[i].second, &queues[i]); });
+  for (auto& queue : queues) {
+    routeTable_->queueRoutes(std::move(queue));
+  }
+}
+
+void BcmSwitch::programQueuedRoutes(BcmRouteTable::RouteOrder order,
+                                    bool addsFollow) {
+  auto start = std::chrono::steady_clock::now();
+  // The journal is recorded before programming starts, so that the routes
+  // changed before a failure part way through are undone too
+  std::shared_ptr<BcmRouteTable::Journal> journal;
+  if (undoLog_) {
+    journal = std::make_shared<BcmRouteTable::Journal>();
+    recordUndo([=] { routeTable_->rollback(*journal); });
+  }
+  auto count = routeTable_->programQueuedRoutes(order, addsFollow,
+                                                journal.get());
+  if (count == 0) {
+    return;
+  }
+  auto usec = duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  BcmStats::get()->routesProgrammed(count, usec);
+  hostTable_->publishNexthopGroupStats();
+  if (compressFib_) {
+    uint64_t ribRoutes = 0;
+    uint64_t fibRoutes = 0;
+    for (const auto& entry : compressedFibs_) {
+      const auto& fib = entry.second;
+      ribRoutes += fib.v4.getRibSize() + fib.v6.getRibSize();
+      fibRoutes += fib.v4.getFibSize() + fib.v6.getFibSize();
+    }
+    BcmStats::fibCompression(ribRoutes, fibRoutes);
+  }
+  VLOG(1) << "programmed " << count << " route changes in " << usec << "us";
 }
 
 void BcmSwitch::processRemovedRoutes(const StateDelta& delta) {
+  RouteTableDeltas tables;
   for (auto const& rtDelta : delta.getRouteTablesDelta()) {
     if (!rtDelta.getOld()) {
       // no old route table, must not removed route, skip
       continue;
     }
-    RouterID id = rtDelta.getOld()->getID();
-    forEachRemoved(
-        rtDelta.getRoutesV4Delta(),
-        &BcmSwitch::processRemovedRoute<RouteV4>,
-        this,
-        id);
-    forEachRemoved(
-        rtDelta.getRoutesV6Delta(),
-        &BcmSwitch::processRemovedRoute<RouteV6>,
-        this,
-        id);
+    tables.emplace_back(rtDelta.getOld()->getID(), rtDelta);
+  }
+  queueRouteTableChanges(tables,
+    [&] (RouterID id, const RouteTablesDelta& rtDelta, RouteQueue* queue) {
+      forEachRemoved(
+          rtDelta.getRoutesV4Delta(),
+          &BcmSwitch::processRemovedRoute<RouteV4>,
+          this,
+          id,
+          queue);
+      forEachRemoved(
+          rtDelta.getRoutesV6Delta(),
+          &BcmSwitch::processRemovedRoute<RouteV6>,
+          this,
+          id,
+          queue);
+    });
+  // The added and changed routes are programmed later in the update
+  programQueuedRoutes(BcmRouteTable::RouteOrder::QUEUED, true);
+}
+
+template <typename DeltaT>
+void BcmSwitch::queueAddedChangedRoutes(RouterID id, const DeltaT& delta,
+                                        bool makeBeforeBreak,
+                                        RouteQueue* queue) {
+  typedef typename DeltaT::Node RouteT;
+  forEachChanged(
+      delta,
+      &BcmSwitch::processChangedRoute<RouteT>,
+      &BcmSwitch::processAddedRoute<RouteT>,
+      [&](BcmSwitch* sw, RouterID rid, RouteQueue* q,
+          const shared_ptr<RouteT>& route) {
+        if (makeBeforeBreak) {
+          sw->processRemovedRoute(rid, q, route);
+        }
+      },
+      this,
+      id,
+      queue);
+}
+
+void BcmSwitch::queueAddedChangedRouteChunks(const RouteTableDeltas& tables,
+                                             bool makeBeforeBreak) {
+  // Without FIB compression each route is queued on its own, so the routes
+  // of even a single VRF are split into chunks.  Each chunk is queued by
+  // whichever thread is free, in a queue of its own, and the queues are
+  // then handed over in order, as in queueRouteTableChanges().
+  typedef DeltaChunks<RouteTablesDelta::RoutesV4Delta> ChunksV4;
+  typedef DeltaChunks<RouteTablesDelta::RoutesV6Delta> ChunksV6;
+  std::vector<ChunksV4> chunksV4;
+  std::vector<ChunksV6> chunksV6;
+  chunksV4.reserve(tables.size());
+  chunksV6.reserve(tables.size());
+  std::vector<std::function<void(RouteQueue*)>> work;
+  for (const auto& table : tables) {
+    auto id = table.first;
+    chunksV4.emplace_back(table.second.getRoutesV4Delta());
+    chunksV6.emplace_back(table.second.getRoutesV6Delta());
+    const auto* v4 = &chunksV4.back();
+    const auto* v6 = &chunksV6.back();
+    for (size_t i = 0; i < v4->size(); ++i) {
+      work.push_back([=] (RouteQueue* queue) {
+        queueAddedChangedRoutes(id, (*v4)[i], makeBeforeBreak, queue);
+      });
+    }
+    for (size_t i = 0; i < v6->size(); ++i) {
+      work.push_back([=] (RouteQueue* queue) {
+        queueAddedChangedRoutes(id, (*v6)[i], makeBeforeBreak, queue);
+      });
+    }
+  }
+  std::vector<RouteQueue> queues(work.size());
+  runInParallel(work.size(), FLAGS_bcm_route_prep_threads,
+    [&] (size_t i) { work[i](&queues[i]); });
+  for (auto& queue : queues) {
+    routeTable_->queueRoutes(std::move(queue));
   }
 }
 
 void BcmSwitch::processAddedChangedRoutes(const StateDelta& delta) {
+  // With make before break, the removed routes were left for now, and are
+  // deleted once the added and changed routes are in place.
+  bool makeBeforeBreak = FLAGS_bcm_route_make_before_break;
+  RouteTableDeltas tables;
   for (auto const& rtDelta : delta.getRouteTablesDelta()) {
-    if (!rtDelta.getNew()) {
-      // no new route table, must not added or changed route, skip
-      continue;
+    if (rtDelta.getNew()) {
+      tables.emplace_back(rtDelta.getNew()->getID(), rtDelta);
+    } else if (makeBeforeBreak) {
+      tables.emplace_back(rtDelta.getOld()->getID(), rtDelta);
     }
-    RouterID id = rtDelta.getNew()->getID();
-    forEachChanged(
-        rtDelta.getRoutesV4Delta(),
-        &BcmSwitch::processChangedRoute<RouteV4>,
-        &BcmSwitch::processAddedRoute<RouteV4>,
-        [&](BcmSwitch *, RouterID, const shared_ptr<RouteV4>&) {},
-        this,
-        id);
-    forEachChanged(
-        rtDelta.getRoutesV6Delta(),
-        &BcmSwitch::processChangedRoute<RouteV6>,
-        &BcmSwitch::processAddedRoute<RouteV6>,
-        [&](BcmSwitch *, RouterID, const shared_ptr<RouteV6>&) {},
-        this,
-        id);
   }
+  if (compressFib_) {
+    // The FIB compressor of a VRF takes its route changes one at a time
+    queueRouteTableChanges(tables,
+      [&] (RouterID id, const RouteTablesDelta& rtDelta, RouteQueue* queue) {
+        queueAddedChangedRoutes(id, rtDelta.getRoutesV4Delta(),
+                                makeBeforeBreak, queue);
+        queueAddedChangedRoutes(id, rtDelta.getRoutesV6Delta(),
+                                makeBeforeBreak, queue);
+      });
+  } else {
+    queueAddedChangedRouteChunks(tables, makeBeforeBreak);
+  }
+  programQueuedRoutes(makeBeforeBreak ?
+                      BcmRouteTable::RouteOrder::MAKE_BEFORE_BREAK :
+                      BcmRouteTable::RouteOrder::QUEUED,
+                      false);
 }
 
 void BcmSwitch::linkscanCallback(int unit,
@@ -990,6 +2113,33 @@ void BcmSwitch::linkscanCallback(int unit,
   }
 }
 
+void BcmSwitch::l2AddrCallback(int unit, opennsl_l2_addr_t* l2Addr,
+                               int operation, void* cookie) {
+  auto* sw = static_cast<BcmSwitch*>(cookie);
+  sw->l2AddrChanged(l2Addr, operation);
+}
+
+void BcmSwitch::l2AddrChanged(const opennsl_l2_addr_t* l2Addr,
+                              int operation) noexcept {
+  // Only the entries the HW learned on a port.  The static entries are
+  // programmed by us, and the trunk ones have no single port.
+  if (l2Addr->flags & (OPENNSL_L2_STATIC | OPENNSL_L2_L3LOOKUP |
+                       OPENNSL_L2_TRUNK_MEMBER)) {
+    return;
+  }
+  L2EntryUpdateType type;
+  if (operation == OPENNSL_L2_CALLBACK_ADD) {
+    type = L2EntryUpdateType::LEARNED;
+  } else if (operation == OPENNSL_L2_CALLBACK_DELETE) {
+    type = L2EntryUpdateType::AGED;
+  } else {
+    return;
+  }
+  callback_->l2LearningUpdateReceived(
+      getVlanId(l2Addr->vid), macFromBcm(l2Addr->mac),
+      portTable_->getPortId(l2Addr->port), type);
+}
+
 void BcmSwitch::linkStateChanged(opennsl_port_t bcmPortId,
     opennsl_port_info_t* info) {
   portTable_->setPortStatus(bcmPortId, info->linkstatus);
@@ -997,9 +2147,44 @@ void BcmSwitch::linkStateChanged(opennsl_port_t bcmPortId,
   // LinkStatus enum, so we can expose more detailed information to to the
   // callback about why the link is down.
   bool up = info->linkstatus == OPENNSL_PORT_LINK_STATUS_UP;
+  {
+    // Move the traffic of the port to the other members of its trunk
+    std::lock_guard<std::mutex> g(lock_);
+    if (trunkTable_) {
+      trunkTable_->linkStateChanged(portTable_->getPortId(bcmPortId), up);
+    }
+  }
+  if (FLAGS_ecmp_link_down_prune) {
+    updateEcmpPaths(bcmPortId, up);
+  }
   callback_->linkStateChanged(portTable_->getPortId(bcmPortId), up);
 }
 
+void BcmSwitch::updateEcmpPaths(opennsl_port_t bcmPortId, bool up) {
+  auto start = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> g(lock_);
+  if (!hostTable_) {
+    // The unit is being released
+    return;
+  }
+  if (!up) {
+    auto pruned = hostTable_->linkDown(bcmPortId);
+    if (pruned > 0) {
+      auto usec = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start).count();
+      BcmStats::get()->ecmpPathsPruned(pruned, usec);
+      VLOG(1) << "pruned " << pruned << " ECMP paths for port " << bcmPortId
+              << " in " << usec << "us";
+    }
+  } else {
+    auto restored = hostTable_->linkUp(bcmPortId);
+    if (restored > 0) {
+      VLOG(1) << "restored " << restored << " ECMP paths for port "
+              << bcmPortId;
+    }
+  }
+}
+
 opennsl_rx_t BcmSwitch::packetRxCallback(int unit, opennsl_pkt_t* pkt,
     void* cookie) {
   auto* bcmSw = static_cast<BcmSwitch*>(cookie);
@@ -1017,6 +2202,7 @@ opennsl_rx_t BcmSwitch::packetReceived(opennsl_pkt_t* pkt) noexcept {
       folly::exceptionStr(ex);
     return OPENNSL_RX_NOT_HANDLED;
   }
+  PacketLatency::maybeTrace(bcmPkt.get());
   callback_->packetReceived(std::move(bcmPkt));
   return OPENNSL_RX_HANDLED_OWNED;
 }
@@ -1040,31 +2226,86 @@ bool BcmSwitch::sendPacketOutOfPort(unique_ptr<TxPacket> pkt,
   return OPENNSL_SUCCESS(rv);
 }
 
+size_t BcmSwitch::sendPacketsSwitched(
+    std::vector<unique_ptr<TxPacket>> pkts) noexcept {
+  std::vector<unique_ptr<BcmTxPacket>> bcmPkts;
+  bcmPkts.reserve(pkts.size());
+  for (auto& pkt : pkts) {
+    bcmPkts.emplace_back(
+        boost::polymorphic_downcast<BcmTxPacket*>(pkt.release()));
+  }
+  return BcmTxPacket::sendAsyncBatch(std::move(bcmPkts));
+}
+
+size_t BcmSwitch::sendPacketsOutOfPort(
+    std::vector<std::pair<unique_ptr<TxPacket>, PortID>> pkts) noexcept {
+  std::vector<unique_ptr<BcmTxPacket>> bcmPkts;
+  bcmPkts.reserve(pkts.size());
+  for (auto& pkt : pkts) {
+    bcmPkts.emplace_back(
+        boost::polymorphic_downcast<BcmTxPacket*>(pkt.first.release()));
+    bcmPkts.back()->setDestModPort(
+        getPortTable()->getBcmPortId(pkt.second));
+  }
+  return BcmTxPacket::sendAsyncBatch(std::move(bcmPkts));
+}
+
 void BcmSwitch::updateStats(SwitchStats *switchStats) {
   // Update thread-local switch statistics.
   updateThreadLocalSwitchStats(switchStats);
-  // Update thread-local per-port statistics.
-  PortStatsMap* portStatsMap = switchStats->getPortStats();
-  BOOST_FOREACH(auto& it, *portStatsMap) {
-    PortID portID = it.first;
-    PortStats *portStats = it.second.get();
-    updateThreadLocalPortStats(portID, portStats);
+  // Update the per-port statistics, which also adds them to the thread-local
+  // per-port statistics, so that one publishStats() covers all of them.
+  if (FLAGS_bcm_buffer_watermarks) {
+    syncBufferWatermarks();
   }
-  // Update global statistics.
-  updateGlobalStats();
+  portTable_->updatePortStats(switchStats);
+  resourceManager_->update();
+  routeCounters_->updateStats();
 }
 
-void BcmSwitch::updateThreadLocalSwitchStats(SwitchStats *switchStats) {
-  // TODO
-}
-
-void BcmSwitch::updateThreadLocalPortStats(PortID portID,
-    PortStats *portStats) {
-  // TODO
+void BcmSwitch::syncBufferWatermarks() {
+  // The watermarks are kept in the HW, and only copied to the SDK, for the
+  // ports to read, by a sync of each kind
+  const opennsl_bst_stat_id_t stats[] = {
+    opennslBstStatIdPortPool,
+    opennslBstStatIdPriGroupHeadroom,
+    opennslBstStatIdUcast,
+  };
+  for (auto stat : stats) {
+    auto rv = opennsl_cosq_bst_stat_sync(unit_, stat);
+    if (OPENNSL_FAILURE(rv)) {
+      LOG(ERROR) << "Failed to sync buffer watermarks " << stat << ": "
+                 << opennsl_errmsg(rv);
+    }
+  }
 }
 
-void BcmSwitch::updateGlobalStats() {
-  portTable_->updatePortStats();
+void BcmSwitch::updateThreadLocalSwitchStats(SwitchStats *switchStats) {
+  // Packets to the CPU dropped because the CPU queues were full
+  opennsl_gport_t cpuGport;
+  auto rv = opennsl_port_gport_get(unit_, kCpuPort, &cpuGport);
+  if (OPENNSL_FAILURE(rv)) {
+    LOG(ERROR) << "Failed to get the CPU gport: " << opennsl_errmsg(rv);
+    return;
+  }
+  uint64_t drops = 0;
+  for (int cosq = 0; cosq < kNumCpuQueues; ++cosq) {
+    uint64_t value;
+    rv = opennsl_cosq_stat_get(unit_, cpuGport, cosq,
+                               opennslCosqStatDroppedPackets, &value);
+    if (OPENNSL_FAILURE(rv)) {
+      LOG(ERROR) << "Failed to get drops of CPU queue " << cosq << ": "
+                 << opennsl_errmsg(rv);
+      return;
+    }
+    drops += value;
+  }
+  // The first update only establishes the baseline
+  if (lastCpuQueueDrops_ >= 0 &&
+      drops > static_cast<uint64_t>(lastCpuQueueDrops_)) {
+    switchStats->hwCpuQueueDrops(drops - lastCpuQueueDrops_);
+  }
+  lastCpuQueueDrops_ = drops;
 }
 
 opennsl_if_t BcmSwitch::getDropEgressId() const {
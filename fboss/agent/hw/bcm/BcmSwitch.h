@@ -9,14 +9,25 @@
  */
 #pragma once
 
+#include "fboss/agent/FibCompressor.h"
 #include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/hw/bcm/BcmRoute.h"
 #include "fboss/agent/types.h"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 #include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 
 extern "C" {
+#include <opennsl/l2.h>
 #include <opennsl/port.h>
 #include <opennsl/rx.h>
 #include <opennsl/types.h>
@@ -27,18 +38,25 @@ extern "C" {
 namespace facebook { namespace fboss {
 
 class ArpEntry;
+class BcmAclTable;
 class BcmEgress;
 class BcmHostTable;
 class BcmIntfTable;
 class BcmPlatform;
 class BcmPortTable;
-class BcmRouteTable;
+class BcmResourceManager;
+class BcmRouteCounters;
 class BcmSwitchEventManager;
+class BcmTableAuditor;
+class BcmTrunkTable;
+class BcmUndoLog;
 class BcmUnit;
 class BcmWarmBootCache;
+struct CpuRxConfig;
+struct EcmpHashConfig;
 class Interface;
 class Port;
-class PortStats;
+class RouteTablesDelta;
 class Vlan;
 class VlanMap;
 
@@ -92,6 +110,11 @@ class BcmSwitch : public HwSwitch {
   bool sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept override;
   bool sendPacketOutOfPort(std::unique_ptr<TxPacket> pkt,
                            PortID portID) noexcept override;
+  size_t sendPacketsSwitched(
+      std::vector<std::unique_ptr<TxPacket>> pkts) noexcept override;
+  size_t sendPacketsOutOfPort(
+      std::vector<std::pair<std::unique_ptr<TxPacket>, PortID>> pkts)
+      noexcept override;
 
   int getUnit() const {
     return unit_;
@@ -122,8 +145,20 @@ class BcmSwitch : public HwSwitch {
   const BcmHostTable* getHostTable() const {
     return hostTable_.get();
   }
+  const BcmTrunkTable* getTrunkTable() const {
+    return trunkTable_.get();
+  }
   bool isPortUp(PortID port) const;
 
+  /*
+   * Read the hit bits of every L3 host entry, when
+   * --bcm_neighbor_hit_bits is set.
+   */
+  bool getAndClearNeighborHits(NeighborHits* hits) override;
+
+  bool setNeighborReachable(RouterID router, const folly::IPAddress& ip,
+                            bool reachable) override;
+
   opennsl_if_t getDropEgressId() const;
   opennsl_if_t getToCPUEgressId() const;
 
@@ -154,8 +189,23 @@ class BcmSwitch : public HwSwitch {
    * should remove any unclaimed entries that
    * just have owner as their last remaining
    * owner
+   *
+   * Unless --warm_boot_cleanup_batch is 0, the entries are deleted in
+   * batches from a background thread, so that the HW update lock is only
+   * held briefly at a time.
    */
   void clearWarmBootCache() override;
+  bool getWarmBootReconciliation(WarmBootReconciliation* status) override;
+  /*
+   * Count the SDK calls stateChanged() would make for each object in the
+   * delta.  This follows the same decisions as stateChanged(), but ignores
+   * the warm boot cache, and the egress objects that hosts and routes may
+   * also have to create.
+   */
+  bool estimateStateChange(const StateDelta& delta,
+                           HwOperationEstimate* estimate) const override;
+  bool getPortCounters(PortID port,
+                       PortCounters* counters) const override;
   /*
    * Update all statistics.
    */
@@ -164,6 +214,18 @@ class BcmSwitch : public HwSwitch {
   BcmHostTable* writableHostTable() const {
     return hostTable_.get();
   }
+  BcmRouteTable* writableRouteTable() const {
+    return routeTable_.get();
+  }
+  BcmRouteCounters* writableRouteCounters() const {
+    return routeCounters_.get();
+  }
+  const BcmResourceManager* getResourceManager() const {
+    return resourceManager_.get();
+  }
+  BcmResourceManager* writableResourceManager() const {
+    return resourceManager_.get();
+  }
   BcmWarmBootCache* getWarmBootCache() const {
     return warmBootCache_.get();
   }
@@ -182,25 +244,64 @@ class BcmSwitch : public HwSwitch {
   enum Flags : uint32_t {
     RX_REGISTERED = 0x01,
     LINKSCAN_REGISTERED = 0x02,
+    L2_LEARNING_REGISTERED = 0x04,
   };
   // Forbidden copy constructor and assignment operator
   BcmSwitch(BcmSwitch const &) = delete;
   BcmSwitch& operator=(BcmSwitch const &) = delete;
 
   void unregisterCallbacks();
+  // Delete the unclaimed warm boot cache entries one batch at a time
+  void warmBootCleanupLoop();
+  void stopWarmBootCleanup();
+  // Sample the port queue lengths every --port_queue_sample_interval_ms
+  void startQueueSampler();
+  void queueSamplerLoop();
+  void stopQueueSampler();
+  // Audit the L3 tables in HW a batch every --bcm_audit_interval_ms
+  void startTableAuditor();
+  void tableAuditLoop();
+  void stopTableAuditor();
 
   /*
    * Get default state switch is in on a cold boot
    */
   std::shared_ptr<SwitchState> getBootSwitchState() const;
 
+  /*
+   * The body of stateChanged(), which is called with lock_ held.  start is
+   * when stateChanged() was called.
+   */
+  void applyStateDelta(const StateDelta& delta,
+                       std::chrono::steady_clock::time_point start);
+  /*
+   * Record how to undo a HW change that was just applied, when the state
+   * update being applied can be rolled back.
+   */
+  void recordUndo(std::function<void()> undo);
+
   void changePortState(const std::shared_ptr<Port>& oldPort,
                        const std::shared_ptr<Port>& newPort);
   void updateIngressVlan(const std::shared_ptr<Port>& oldPort,
                          const std::shared_ptr<Port>& newPort);
   void updatePortSpeed(const std::shared_ptr<Port>& oldPort,
                        const std::shared_ptr<Port>& newPort);
+  void updatePortSampleRates(const std::shared_ptr<Port>& port);
+  void updatePortQos(const std::shared_ptr<Port>& port);
   void changeDefaultVlan(VlanID id);
+  void changeCpuRxConfig(const CpuRxConfig& oldConfig,
+                         const CpuRxConfig& newConfig);
+  void changeCpuQueueLimits(const CpuRxConfig& oldConfig,
+                            const CpuRxConfig& newConfig);
+  void programRxReasonToQueue(const CpuRxConfig& config);
+  void changeEcmpHash(const EcmpHashConfig& oldConfig,
+                      const EcmpHashConfig& newConfig);
+  // Switch to the given route classes, and attach every route to the
+  // counter of its new class
+  void changeRouteCounters(const std::vector<RouteCounterConfig>& classes);
+  void programEcmpHashSeeds(uint32_t seedRotation);
+  void programEcmpHashFields(const EcmpHashConfig& config);
+  void programEcmpHashAlgorithm(const EcmpHashConfig& config);
 
   void processChangedVlan(const std::shared_ptr<Vlan>& oldVlan,
                           const std::shared_ptr<Vlan>& newVlan);
@@ -213,27 +314,107 @@ class BcmSwitch : public HwSwitch {
   void processAddedIntf(const std::shared_ptr<Interface>& intf);
   void processRemovedIntf(const std::shared_ptr<Interface>& intf);
 
+  /*
+   * Program the host entry of a neighbor.  start is when stateChanged() was
+   * called, to measure how long it takes a newly resolved neighbor to
+   * forward in HW.
+   */
   template<typename DELTA>
-  void processNeighborEntryDelta(const DELTA& delta);
-  void processArpChanges(const StateDelta& delta);
+  void processNeighborEntryDelta(
+      const DELTA& delta, std::chrono::steady_clock::time_point start);
+  void processArpChanges(
+      const StateDelta& delta, std::chrono::steady_clock::time_point start);
+
+  /*
+   * Program the added, changed and removed ACL entries.
+   */
+  void processAclChanges(const StateDelta& delta);
+
+  /*
+   * Program the trunks of added, changed and removed aggregate ports.
+   */
+  void processAggregatePortChanges(const StateDelta& delta);
+  /*
+   * Reprogram the resolved neighbors on ports that joined or left an
+   * aggregate port, so they are reached through the trunk, or no longer
+   * are.
+   */
+  void reprogramAggregatePortNeighbors(const StateDelta& delta);
+  template<typename NTABLE>
+  void reprogramNeighbors(const NTABLE* table,
+                          const boost::container::flat_set<PortID>& ports);
+
+  typedef BcmRouteTable::RouteQueue RouteQueue;
+  typedef std::vector<std::pair<RouterID, RouteTablesDelta>> RouteTableDeltas;
 
   template <typename RouteT>
   void processChangedRoute(
-      const RouterID id, const std::shared_ptr<RouteT>& oldRoute,
+      const RouterID id, RouteQueue* queue,
+      const std::shared_ptr<RouteT>& oldRoute,
       const std::shared_ptr<RouteT>& newRoute);
   template <typename RouteT>
   void processAddedRoute(
-      const RouterID id, const std::shared_ptr<RouteT>& route);
+      const RouterID id, RouteQueue* queue,
+      const std::shared_ptr<RouteT>& route);
   template <typename RouteT>
   void processRemovedRoute(
-      const RouterID id, const std::shared_ptr<RouteT>& route);
+      const RouterID id, RouteQueue* queue,
+      const std::shared_ptr<RouteT>& route);
   void processRemovedRoutes(const StateDelta& delta);
   void processAddedChangedRoutes(const StateDelta& delta);
+  /*
+   * Call fn(id, delta, queue) for each route table, each with a queue of its
+   * own, from up to --bcm_route_prep_threads threads.  Then queue all of
+   * the changes on the route table, in the order of the tables.
+   */
+  void queueRouteTableChanges(
+      const RouteTableDeltas& tables,
+      const std::function<void(RouterID, const RouteTablesDelta&,
+                               RouteQueue*)>& fn);
+  // Queue the added and changed routes of a delta, or of a chunk of one
+  template <typename DeltaT>
+  void queueAddedChangedRoutes(RouterID id, const DeltaT& delta,
+                               bool makeBeforeBreak, RouteQueue* queue);
+  /*
+   * Queue the added and changed routes of the tables in chunks, from up to
+   * --bcm_route_prep_threads threads.  This is only for uncompressed FIBs,
+   * where queueing one route does not depend on the others.
+   */
+  void queueAddedChangedRouteChunks(const RouteTableDeltas& tables,
+                                    bool makeBeforeBreak);
+  /*
+   * Queue a route to be added, changed or deleted.  With FIB compression,
+   * this queues whatever FIB changes follow from the RIB change instead.
+   */
+  template <typename RouteT>
+  void queueRouteAdd(RouterID id, RouteQueue* queue,
+                     const std::shared_ptr<RouteT>& route);
+  template <typename RouteT>
+  void queueRouteDelete(RouterID id, RouteQueue* queue,
+                        const std::shared_ptr<RouteT>& route);
+  template <typename ChangesT>
+  void queueFibChanges(RouterID id, RouteQueue* queue,
+                       const ChangesT& changes);
+  // Program the route changes queued by the functions above
+  void programQueuedRoutes(BcmRouteTable::RouteOrder order, bool addsFollow);
 
   static void linkscanCallback(int unit,
                                opennsl_port_t port,
                                opennsl_port_info_t* info);
   void linkStateChanged(opennsl_port_t port, opennsl_port_info_t* info);
+  /*
+   * Called by the SDK L2 thread when the HW learns, moves or ages a MAC.
+   * Dispatches to callback_->l2LearningUpdateReceived.
+   */
+  static void l2AddrCallback(int unit, opennsl_l2_addr_t* l2Addr,
+                             int operation, void* cookie);
+  void l2AddrChanged(const opennsl_l2_addr_t* l2Addr, int operation) noexcept;
+  /*
+   * The fast path for link changes: remove the nexthops on a port that went
+   * down from the ECMP groups in HW, or add them back when it comes up,
+   * before the software state converges.
+   */
+  void updateEcmpPaths(opennsl_port_t port, bool up);
 
   /*
    * Private callback called by the Broadcom API. Dispatches to
@@ -253,14 +434,9 @@ class BcmSwitch : public HwSwitch {
   void updateThreadLocalSwitchStats(SwitchStats *switchStats);
 
   /*
-   * Update thread-local per-port statistics.
+   * Copy the buffer watermarks from the HW, for the ports to export.
    */
-  void updateThreadLocalPortStats(PortID portID, PortStats *portStats);
-
-  /*
-   * Update global statistics.
-   */
-  void updateGlobalStats();
+  void syncBufferWatermarks();
 
   /*
    * Create warm boot file to signify that its safe to do a warm boot on
@@ -290,7 +466,9 @@ class BcmSwitch : public HwSwitch {
   std::string getWarmBootDataPath() const;
 
   /**
-   * ECMP hash setup
+   * ECMP hash setup.  The fields, algorithm and seeds are programmed with
+   * the EcmpHashConfig defaults here, and changed by changeEcmpHash() when
+   * the config says otherwise.
    */
   void ecmpHashSetup();
 
@@ -329,13 +507,57 @@ class BcmSwitch : public HwSwitch {
   int unit_{-1};
   uint32_t flags_{0};
   std::unique_ptr<BcmPortTable> portTable_;
+  std::unique_ptr<BcmTrunkTable> trunkTable_;
+  std::unique_ptr<BcmAclTable> aclTable_;
   std::unique_ptr<BcmEgress> toCPUEgress_;
   std::unique_ptr<BcmIntfTable> intfTable_;
   std::unique_ptr<BcmHostTable> hostTable_;
+  // Declared before routeTable_, since the routes detach themselves from
+  // the counters when they are destroyed
+  std::unique_ptr<BcmRouteCounters> routeCounters_;
   std::unique_ptr<BcmRouteTable> routeTable_;
   std::unique_ptr<BcmWarmBootCache> warmBootCache_;
+  std::unique_ptr<BcmResourceManager> resourceManager_;
   std::unique_ptr<BcmSwitchEventManager> switchEventManager_;
   std::mutex lock_;
+  // The undo log of the state update being applied, if it can be rolled
+  // back.  Protected by lock_.
+  BcmUndoLog* undoLog_{nullptr};
+  // Neighbors that setNeighborReachable() took out of the ECMP groups,
+  // which stay out when their entries are reprogrammed
+  std::set<std::pair<opennsl_vrf_t, folly::IPAddress>> unreachableNeighbors_;
+  std::thread warmBootCleanupThread_;
+  std::atomic<bool> stopWarmBootCleanup_{false};
+  std::thread queueSamplerThread_;
+  std::atomic<bool> stopQueueSampler_{false};
+  std::unique_ptr<BcmTableAuditor> tableAuditor_;
+  std::thread tableAuditThread_;
+  std::atomic<bool> stopTableAuditor_{false};
+  // The total CPU queue drops at the last stats update, or -1 before it
+  int64_t lastCpuQueueDrops_{-1};
+  // The CPU receive pool size and rate to start the RX API with, from the
+  // config.  0 keeps the SDK default.
+  uint32_t cpuRxPoolSize_{0};
+  uint32_t cpuRxRate_{0};
+
+  /*
+   * The resolved routes of a VRF, and which of them are programmed, when
+   * --bcm_fib_compression is set.
+   */
+  struct CompressedFib {
+    FibCompressor<RouteV4> v4;
+    FibCompressor<RouteV6> v6;
+    FibCompressor<RouteV4>* get(const RouteV4*) {
+      return &v4;
+    }
+    FibCompressor<RouteV6>* get(const RouteV6*) {
+      return &v6;
+    }
+  };
+  // Read from the flag once, since the FIB cannot switch modes while routes
+  // are programmed.
+  bool compressFib_{false};
+  std::map<RouterID, CompressedFib> compressedFibs_;
 };
 
 }} // facebook::fboss
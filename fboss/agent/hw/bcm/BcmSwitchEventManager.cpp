@@ -11,18 +11,32 @@
 #include "BcmSwitch.h"
 #include "BcmSwitchEvent.h"
 #include "BcmSwitchEventCallback.h"
+#include "BcmStats.h"
+#include "fboss/agent/ThreadSampler.h"
+
+#include <glog/logging.h>
+#include <pthread.h>
 
 namespace facebook { namespace fboss {
 
 // constructor registers itself with the Bcm library to start callbacks
 BcmSwitchEventManager::BcmSwitchEventManager(BcmSwitch* hw)
-  :hw_(hw) {
-
-  opennsl_switch_event_register(hw->getUnit(), callbackDispatch, this);
+  :hw_(hw), unit_(hw->getUnit()) {
+
+  thread_ = std::thread([this] {
+    pthread_setname_np(pthread_self(), "fbossBcmEvents");
+    ThreadSampler::registerThread("fbossBcmEvents");
+    eventBase_.loopForever();
+  });
+  opennsl_switch_event_register(unit_, callbackDispatch, this);
 }
 
 // destructor for BcmSwitchEventManager
 BcmSwitchEventManager::~BcmSwitchEventManager() {
+  opennsl_switch_event_unregister(unit_, callbackDispatch, this);
+  // events already queued are still handled before the thread stops
+  eventBase_.runInEventBaseThread([this] { eventBase_.terminateLoopSoon(); });
+  thread_.join();
   std::lock_guard<std::mutex> g(lock_);
   callbacks_.clear();
 }
@@ -66,17 +80,50 @@ void BcmSwitchEventManager::callbackDispatch(int unit,
 
   BcmSwitchEventManager* instance =
     static_cast<BcmSwitchEventManager*>(userdata);
-  BcmSwitchEvent event(instance->hw_, unit, eventID, alarmID, portID,
-    raised > 0);
+  auto key = std::make_tuple(eventID, alarmID, portID, raised > 0);
 
-  std::shared_ptr<BcmSwitchEventCallback> callbackObj;
+  // this runs in an SDK thread, so only queue the event here.  if the same
+  // event is already queued, it just counts as a repeat of that one.
+  bool queued;
   {
     std::lock_guard<std::mutex> g(instance->lock_);
-    auto iterator = instance->callbacks_.find(eventID);
-    if (iterator != instance->callbacks_.end()) {
+    auto ret = instance->pending_.emplace(key, 0);
+    ++ret.first->second;
+    queued = !ret.second;
+  }
+  BcmStats::get()->switchEventReceived(queued);
+  if (!queued) {
+    instance->eventBase_.runInEventBaseThread([instance, unit, key] {
+      instance->handleEvent(unit, key);
+    });
+  }
+}
+
+void BcmSwitchEventManager::handleEvent(int unit, const EventKey& key) {
+  BcmSwitchEvent event(hw_, unit, std::get<0>(key), std::get<1>(key),
+    std::get<2>(key), std::get<3>(key));
+
+  uint32_t count = 0;
+  std::shared_ptr<BcmSwitchEventCallback> callbackObj;
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    auto pendingIter = pending_.find(key);
+    if (pendingIter != pending_.end()) {
+      count = pendingIter->second;
+      pending_.erase(pendingIter);
+    }
+    auto iterator = callbacks_.find(event.getEventID());
+    if (iterator != callbacks_.end()) {
       callbackObj = iterator->second;
     }
   }
+  if (count > 1) {
+    LOG(WARNING) << "switch event " << event.getEventID() << " alarm ID "
+      << event.getAlarmID() << " port ID " << event.getPortID()
+      << (event.eventRaised() ? " triggered " : " cleared ") << count
+      << " times on hw unit " << unit << ", handling it once.";
+  }
+  BcmStats::get()->switchEventHandled();
 
   // perform user-specified callback if it exists
   if (callbackObj) {
@@ -84,7 +131,7 @@ void BcmSwitchEventManager::callbackDispatch(int unit,
 
   // no callback found -- use default callback
   } else {
-    instance->defaultCallback(event);
+    defaultCallback(event);
   }
 }
 
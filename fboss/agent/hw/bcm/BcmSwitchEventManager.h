@@ -9,7 +9,12 @@
  */
 #pragma once
 
+#include <folly/io/async/EventBase.h>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
 #include "fboss/agent/FbossError.h"
 
 extern "C" {
@@ -25,6 +30,12 @@ class BcmSwitchEventCallback;
 /**
  * This class manages the bcm callbacks for critical switch events and
  * invokes the callback on the switch event handler objects.
+ *
+ * The SDK thread that reports an event only queues it; the handler objects
+ * are called from a thread of the manager's own, so a storm of events (eg.
+ * parity errors) does not hold up the SDK while they log.  An event that
+ * is raised or cleared again while the same one is still queued is only
+ * handled once.
  */
 
 class BcmSwitchEventManager {
@@ -43,10 +54,21 @@ class BcmSwitchEventManager {
   void unregisterSwitchEventCallback(opennsl_switch_event_t eventID);
 
  private:
+  // An event ID, alarm ID, port ID, and whether it was raised or cleared
+  typedef std::tuple<opennsl_switch_event_t, uint32_t, uint32_t, bool>
+    EventKey;
+
   BcmSwitch* hw_;
+  // the unit the event callback was registered for
+  int unit_;
   std::mutex lock_;
   std::map<opennsl_switch_event_t,
     std::shared_ptr<BcmSwitchEventCallback>> callbacks_;
+  // The events queued to the handler thread, and how many times each was
+  // reported since.  Protected by lock_.
+  std::map<EventKey, uint32_t> pending_;
+  folly::EventBase eventBase_;
+  std::thread thread_;
 
   // disable copy constructor and assignment operator
   BcmSwitchEventManager(const BcmSwitchEventManager&) = delete;
@@ -57,9 +79,11 @@ class BcmSwitchEventManager {
   static void callbackDispatch(int unit, opennsl_switch_event_t event,
     uint32_t alarmID, uint32_t portID, uint32_t raised, void* instance);
 
+  // runs the callback for a queued event, in the handler thread
+  void handleEvent(int unit, const EventKey& key);
+
   // default callback for non-handled switch events.
   void defaultCallback(const BcmSwitchEvent& event);
-
 };
 
 }} // facebook::fboss
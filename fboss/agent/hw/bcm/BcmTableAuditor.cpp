@@ -0,0 +1,274 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmTableAuditor.h"
+
+#include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmHost.h"
+#include "fboss/agent/hw/bcm/BcmRoute.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
+#include "fboss/agent/hw/bcm/BcmSwitch.h"
+#include "fboss/agent/hw/bcm/BcmWarmBootCache.h"
+
+#include <folly/IPAddress.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+using folly::IPAddress;
+
+namespace facebook { namespace fboss {
+
+BcmTableAuditor::BcmTableAuditor(const BcmSwitch* hw) : hw_(hw) {
+  opennsl_l3_info_t_init(&l3Info_);
+}
+
+int BcmTableAuditor::getTableSize(Table table) const {
+  // The same sizes the warm boot cache traverses the tables with
+  switch (table) {
+    case Table::HOSTS_V4:
+      return l3Info_.l3info_max_host;
+    case Table::HOSTS_V6:
+      return l3Info_.l3info_max_host / 2;
+    case Table::ROUTES_V4:
+      return l3Info_.l3info_max_route;
+    case Table::ROUTES_V6:
+      return l3Info_.l3info_max_route / 2;
+  }
+  return 0;
+}
+
+void BcmTableAuditor::nextTable() {
+  nextIndex_ = 0;
+  switch (table_) {
+    case Table::HOSTS_V4:
+      table_ = Table::HOSTS_V6;
+      break;
+    case Table::HOSTS_V6:
+      table_ = Table::ROUTES_V4;
+      break;
+    case Table::ROUTES_V4:
+      table_ = Table::ROUTES_V6;
+      break;
+    case Table::ROUTES_V6:
+      table_ = Table::HOSTS_V4;
+      BcmStats::get()->tableAuditPassDone();
+      break;
+  }
+}
+
+void BcmTableAuditor::readBatch(int maxEntries) {
+  hosts_.clear();
+  routes_.clear();
+  if (table_ == Table::HOSTS_V4 && nextIndex_ == 0) {
+    // The table sizes are read again at the start of every pass
+    auto rv = opennsl_l3_info(hw_->getUnit(), &l3Info_);
+    if (OPENNSL_FAILURE(rv)) {
+      LOG(ERROR) << "failed to get the L3 table sizes: "
+                 << opennsl_errmsg(rv);
+      return;
+    }
+  }
+
+  auto size = getTableSize(table_);
+  auto end = std::min(nextIndex_ + maxEntries, size);
+  if (nextIndex_ < end) {
+    // The traversal range includes its end
+    int rv;
+    switch (table_) {
+      case Table::HOSTS_V4:
+      case Table::HOSTS_V6:
+        rv = opennsl_l3_host_traverse(hw_->getUnit(),
+            table_ == Table::HOSTS_V6 ? OPENNSL_L3_IP6 : 0,
+            nextIndex_, end - 1, hostCallback, this);
+        break;
+      default:
+        rv = opennsl_l3_route_traverse(hw_->getUnit(),
+            table_ == Table::ROUTES_V6 ? OPENNSL_L3_IP6 : 0,
+            nextIndex_, end - 1, routeCallback, this);
+        break;
+    }
+    if (OPENNSL_FAILURE(rv)) {
+      LOG(ERROR) << "failed to read L3 table entries " << nextIndex_
+                 << " to " << end - 1 << " for the audit: "
+                 << opennsl_errmsg(rv);
+    }
+  }
+  nextIndex_ = end;
+  if (nextIndex_ >= size) {
+    nextTable();
+  }
+}
+
+int BcmTableAuditor::hostCallback(int unit, int index,
+    opennsl_l3_host_t* host, void* userData) {
+  auto auditor = static_cast<BcmTableAuditor*>(userData);
+  auditor->hosts_.push_back(*host);
+  return 0;
+}
+
+int BcmTableAuditor::routeCallback(int unit, int index,
+    opennsl_l3_route_t* route, void* userData) {
+  auto auditor = static_cast<BcmTableAuditor*>(userData);
+  auditor->routes_.push_back(*route);
+  return 0;
+}
+
+BcmTableAuditor::Result BcmTableAuditor::checkHost(
+    const opennsl_l3_host_t& host, bool repair) const {
+  auto ip = BcmWarmBootCache::getHostAddress(host);
+  auto bcmHost = hw_->getHostTable()->getBcmHostIf(host.l3a_vrf, ip);
+  if (bcmHost && bcmHost->isProgrammed()) {
+    if (host.l3a_intf == bcmHost->getEgressId()) {
+      return Result::MATCHES;
+    }
+    if (repair) {
+      bcmHost->rewriteHwEntry();
+    }
+    return Result::MISMATCHED;
+  }
+  // Full length routes can be in the host table too
+  auto route = hw_->writableRouteTable()->getBcmRouteIf(host.l3a_vrf, ip,
+                                                        ip.bitCount());
+  if (route && route->isProgrammed() && route->isInHostTable()) {
+    bool multipath = host.l3a_flags & OPENNSL_L3_MULTIPATH;
+    if (host.l3a_intf == route->getEgressId() &&
+        multipath == route->isMultipath()) {
+      return Result::MATCHES;
+    }
+    if (repair) {
+      route->rewriteHwEntry();
+    }
+    return Result::MISMATCHED;
+  }
+  if (repair) {
+    auto entry = host;
+    auto rv = opennsl_l3_host_delete(hw_->getUnit(), &entry);
+    bcmCheckError(rv, "failed to delete the stale host entry for ", ip,
+                  " in vrf ", host.l3a_vrf);
+  }
+  return Result::STALE;
+}
+
+BcmTableAuditor::Result BcmTableAuditor::checkRoute(
+    const opennsl_l3_route_t& route, bool repair) const {
+  IPAddress ip;
+  uint8_t mask;
+  std::tie(ip, mask) = BcmWarmBootCache::getRoutePrefix(route);
+  auto bcmRoute = hw_->writableRouteTable()->getBcmRouteIf(
+      route.l3a_vrf, ip, mask);
+  if (bcmRoute && bcmRoute->isProgrammed() && !bcmRoute->isInHostTable()) {
+    bool multipath = route.l3a_flags & OPENNSL_L3_MULTIPATH;
+    if (route.l3a_intf == bcmRoute->getEgressId() &&
+        multipath == bcmRoute->isMultipath()) {
+      return Result::MATCHES;
+    }
+    if (repair) {
+      bcmRoute->rewriteHwEntry();
+    }
+    return Result::MISMATCHED;
+  }
+  if (repair) {
+    auto entry = route;
+    auto rv = opennsl_l3_route_delete(hw_->getUnit(), &entry);
+    bcmCheckError(rv, "failed to delete the stale route entry for ", ip, "/",
+                  static_cast<int>(mask), " in vrf ", route.l3a_vrf);
+  }
+  return Result::STALE;
+}
+
+void BcmTableAuditor::checkBatch(bool repair) {
+  auto warmBootCache = hw_->getWarmBootCache();
+  uint64_t stale = 0;
+  uint64_t mismatched = 0;
+  auto count = [&] (Result result) {
+    if (result == Result::STALE) {
+      ++stale;
+    } else if (result == Result::MISMATCHED) {
+      ++mismatched;
+    }
+  };
+
+  for (const auto& host : hosts_) {
+    auto ip = BcmWarmBootCache::getHostAddress(host);
+    if (warmBootCache &&
+        warmBootCache->findHost(host.l3a_vrf, ip) !=
+        warmBootCache->vrfAndIP2Host_end()) {
+      continue;
+    }
+    if (checkHost(host, false) == Result::MATCHES) {
+      continue;
+    }
+    // The entry was read without the lock, so it may have been changed or
+    // deleted since.  Look at what HW has for it now.
+    opennsl_l3_host_t current;
+    opennsl_l3_host_t_init(&current);
+    current.l3a_vrf = host.l3a_vrf;
+    current.l3a_flags = host.l3a_flags & OPENNSL_L3_IP6;
+    current.l3a_ip_addr = host.l3a_ip_addr;
+    memcpy(current.l3a_ip6_addr, host.l3a_ip6_addr,
+           sizeof(current.l3a_ip6_addr));
+    if (OPENNSL_FAILURE(opennsl_l3_host_find(hw_->getUnit(), &current))) {
+      continue;
+    }
+    auto result = checkHost(current, repair);
+    if (result != Result::MATCHES) {
+      LOG(WARNING) << "audit found a " << (result == Result::STALE ?
+                       "stale" : "mismatched") << " host entry for " << ip
+                   << " in vrf " << current.l3a_vrf << " @egress "
+                   << current.l3a_intf << (repair ? ", repaired" : "");
+    }
+    count(result);
+  }
+
+  for (const auto& route : routes_) {
+    IPAddress ip;
+    uint8_t mask;
+    std::tie(ip, mask) = BcmWarmBootCache::getRoutePrefix(route);
+    if (warmBootCache &&
+        warmBootCache->findRoute(route.l3a_vrf, ip, mask) !=
+        warmBootCache->vrfAndPrefix2Route_end()) {
+      continue;
+    }
+    if (checkRoute(route, false) == Result::MATCHES) {
+      continue;
+    }
+    opennsl_l3_route_t current;
+    opennsl_l3_route_t_init(&current);
+    current.l3a_vrf = route.l3a_vrf;
+    current.l3a_flags = route.l3a_flags & OPENNSL_L3_IP6;
+    current.l3a_subnet = route.l3a_subnet;
+    current.l3a_ip_mask = route.l3a_ip_mask;
+    memcpy(current.l3a_ip6_net, route.l3a_ip6_net,
+           sizeof(current.l3a_ip6_net));
+    memcpy(current.l3a_ip6_mask, route.l3a_ip6_mask,
+           sizeof(current.l3a_ip6_mask));
+    if (OPENNSL_FAILURE(opennsl_l3_route_get(hw_->getUnit(), &current))) {
+      continue;
+    }
+    auto result = checkRoute(current, repair);
+    if (result != Result::MATCHES) {
+      LOG(WARNING) << "audit found a " << (result == Result::STALE ?
+                       "stale" : "mismatched") << " route entry for " << ip
+                   << "/" << static_cast<int>(mask) << " in vrf "
+                   << current.l3a_vrf << " @egress " << current.l3a_intf
+                   << (repair ? ", repaired" : "");
+    }
+    count(result);
+  }
+
+  BcmStats::get()->tableAuditBatch(hosts_.size() + routes_.size(), stale,
+                                   mismatched,
+                                   repair ? stale + mismatched : 0);
+  hosts_.clear();
+  routes_.clear();
+}
+
+}} // facebook::fboss
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+extern "C" {
+#include <opennsl/l3.h>
+}
+
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class BcmSwitch;
+
+/*
+ * BcmTableAuditor checks the L3 host and route entries in HW against the
+ * entries BcmHostTable and BcmRouteTable think they programmed, a batch at
+ * a time, and can rewrite or delete the ones that differ.
+ *
+ * Reading a batch from HW only makes SDK calls, so it is done without the
+ * HW update lock, and only the comparison with the tables holds it.  An
+ * entry that seems to differ is read again under the lock before it is
+ * counted, in case an update changed it in between.
+ *
+ * Entries the warm boot cache still holds are left alone, as they are
+ * either about to be claimed or deleted.
+ */
+class BcmTableAuditor {
+ public:
+  explicit BcmTableAuditor(const BcmSwitch* hw);
+
+  /*
+   * Read up to maxEntries entries from HW, carrying on from where the last
+   * batch stopped, and going back to the start of the tables at the end
+   * of them.  This does not need the HW update lock.
+   */
+  void readBatch(int maxEntries);
+
+  /*
+   * Compare the entries of the last batch with the host and route tables,
+   * and with repair, rewrite the entries that differ and delete the ones
+   * that should not be there at all.
+   *
+   * This must be called with the HW update lock held.
+   */
+  void checkBatch(bool repair);
+
+ private:
+  enum class Table {
+    HOSTS_V4,
+    HOSTS_V6,
+    ROUTES_V4,
+    ROUTES_V6,
+  };
+  enum class Result {
+    MATCHES,
+    MISMATCHED,
+    STALE,
+  };
+
+  // Forbidden copy constructor and assignment operator
+  BcmTableAuditor(BcmTableAuditor const &) = delete;
+  BcmTableAuditor& operator=(BcmTableAuditor const &) = delete;
+
+  // The number of entries table can have
+  int getTableSize(Table table) const;
+  // Move on to the next table, and count a pass once all were read
+  void nextTable();
+
+  /*
+   * Whether the entry is what the host or route table programmed, is
+   * different from it, or should not be there at all.  With repair, an
+   * entry that differs is written again, and one that should not be there
+   * is deleted.
+   */
+  Result checkHost(const opennsl_l3_host_t& host, bool repair) const;
+  Result checkRoute(const opennsl_l3_route_t& route, bool repair) const;
+
+  static int hostCallback(int unit, int index, opennsl_l3_host_t* host,
+                          void* userData);
+  static int routeCallback(int unit, int index, opennsl_l3_route_t* route,
+                           void* userData);
+
+  const BcmSwitch* hw_{nullptr};
+  opennsl_l3_info_t l3Info_;
+  Table table_{Table::HOSTS_V4};
+  // The index to start the next batch from, in table_
+  int nextIndex_{0};
+  std::vector<opennsl_l3_host_t> hosts_;
+  std::vector<opennsl_l3_route_t> routes_;
+};
+
+}} // facebook::fboss
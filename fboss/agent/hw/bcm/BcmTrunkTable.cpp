@@ -0,0 +1,193 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmTrunkTable.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmPortTable.h"
+#include "fboss/agent/hw/bcm/BcmSwitch.h"
+#include "fboss/agent/state/AggregatePort.h"
+
+#include <glog/logging.h>
+#include <vector>
+
+extern "C" {
+#include <opennsl/port.h>
+#include <opennsl/trunk.h>
+}
+
+using boost::container::flat_set;
+using std::shared_ptr;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+opennsl_trunk_member_t getMember(const BcmSwitch* hw, PortID port) {
+  opennsl_gport_t gport;
+  auto bcmPort = hw->getPortTable()->getBcmPortId(port);
+  auto rv = opennsl_port_gport_get(hw->getUnit(), bcmPort, &gport);
+  bcmCheckError(rv, "failed to get the gport of port ", port);
+  opennsl_trunk_member_t member;
+  opennsl_trunk_member_t_init(&member);
+  member.gport = gport;
+  return member;
+}
+
+}
+
+BcmTrunkTable::BcmTrunkTable(const BcmSwitch* hw)
+  : hw_(hw) {
+}
+
+BcmTrunkTable::~BcmTrunkTable() {
+  // The trunks are left in place, so traffic keeps flowing through them
+  // across a warm boot.
+}
+
+void BcmTrunkTable::addTrunk(const shared_ptr<AggregatePort>& aggPort) {
+  auto id = aggPort->getID();
+  opennsl_trunk_t tid = static_cast<opennsl_trunk_t>(id);
+  auto rv = opennsl_trunk_create(hw_->getUnit(), OPENNSL_TRUNK_FLAG_WITH_ID,
+                                 &tid);
+  // The trunk is already there after a warm boot, and is reprogrammed in
+  // full below.
+  if (rv != OPENNSL_E_EXISTS) {
+    bcmCheckError(rv, "failed to create trunk ", id);
+  }
+
+  auto active = getActiveMembers(aggPort.get());
+  std::vector<opennsl_trunk_member_t> members;
+  for (auto port : active) {
+    members.push_back(getMember(hw_, port));
+  }
+  opennsl_trunk_info_t info;
+  opennsl_trunk_info_t_init(&info);
+  // Hash flows with the same RTAG7 fields that ECMP uses
+  info.psc = OPENNSL_TRUNK_PSC_PORTFLOW;
+  info.dlf_index = -1;
+  info.mc_index = -1;
+  info.ipmc_index = -1;
+  rv = opennsl_trunk_set(hw_->getUnit(), tid, &info, members.size(),
+                         members.data());
+  bcmCheckError(rv, "failed to program trunk ", id);
+
+  for (const auto& member : aggPort->getMembers()) {
+    memberOf_[member.first] = id;
+  }
+  auto& trunk = trunks_[id];
+  trunk.aggPort = aggPort;
+  trunk.programmed = std::move(active);
+  VLOG(2) << "created trunk " << id << " with " << members.size()
+          << " active members";
+}
+
+void BcmTrunkTable::changeTrunk(const shared_ptr<AggregatePort>& oldAggPort,
+                                const shared_ptr<AggregatePort>& newAggPort) {
+  auto id = newAggPort->getID();
+  auto iter = trunks_.find(id);
+  if (iter == trunks_.end()) {
+    throw FbossError("cannot change non-existent trunk ", id);
+  }
+  for (const auto& member : oldAggPort->getMembers()) {
+    if (!newAggPort->isMember(member.first)) {
+      removeMember(member.first, id);
+    }
+  }
+  for (const auto& member : newAggPort->getMembers()) {
+    memberOf_[member.first] = id;
+  }
+  iter->second.aggPort = newAggPort;
+  updateMembers(id, &iter->second);
+}
+
+void BcmTrunkTable::deleteTrunk(const shared_ptr<AggregatePort>& aggPort) {
+  auto id = aggPort->getID();
+  auto iter = trunks_.find(id);
+  if (iter == trunks_.end()) {
+    throw FbossError("cannot delete non-existent trunk ", id);
+  }
+  auto rv = opennsl_trunk_destroy(hw_->getUnit(),
+                                  static_cast<opennsl_trunk_t>(id));
+  bcmCheckError(rv, "failed to destroy trunk ", id);
+  for (const auto& member : aggPort->getMembers()) {
+    removeMember(member.first, id);
+  }
+  trunks_.erase(iter);
+  VLOG(2) << "destroyed trunk " << id;
+}
+
+void BcmTrunkTable::linkStateChanged(PortID port, bool up) {
+  if (up) {
+    downPorts_.erase(port);
+  } else {
+    downPorts_.insert(port);
+  }
+  auto member = memberOf_.find(port);
+  if (member == memberOf_.end()) {
+    return;
+  }
+  auto iter = trunks_.find(member->second);
+  CHECK(iter != trunks_.end());
+  updateMembers(iter->first, &iter->second);
+}
+
+opennsl_port_t BcmTrunkTable::getEgressPort(PortID port) const {
+  auto member = memberOf_.find(port);
+  if (member == memberOf_.end()) {
+    return hw_->getPortTable()->getBcmPortId(port);
+  }
+  opennsl_gport_t gport;
+  OPENNSL_GPORT_TRUNK_SET(gport, static_cast<opennsl_trunk_t>(member->second));
+  return gport;
+}
+
+void BcmTrunkTable::removeMember(PortID port, AggregatePortID id) {
+  // The port may already have moved to another trunk
+  auto iter = memberOf_.find(port);
+  if (iter != memberOf_.end() && iter->second == id) {
+    memberOf_.erase(iter);
+  }
+}
+
+flat_set<PortID> BcmTrunkTable::getActiveMembers(
+    const AggregatePort* aggPort) const {
+  flat_set<PortID> active;
+  for (auto port : aggPort->getForwardingMembers()) {
+    if (downPorts_.count(port) == 0) {
+      active.insert(port);
+    }
+  }
+  return active;
+}
+
+void BcmTrunkTable::updateMembers(AggregatePortID id, Trunk* trunk) {
+  auto active = getActiveMembers(trunk->aggPort.get());
+  opennsl_trunk_t tid = static_cast<opennsl_trunk_t>(id);
+  for (auto port : trunk->programmed) {
+    if (active.count(port) == 0) {
+      auto member = getMember(hw_, port);
+      auto rv = opennsl_trunk_member_delete(hw_->getUnit(), tid, &member);
+      bcmCheckError(rv, "failed to remove port ", port, " from trunk ", id);
+      VLOG(2) << "removed port " << port << " from trunk " << id;
+    }
+  }
+  for (auto port : active) {
+    if (trunk->programmed.count(port) == 0) {
+      auto member = getMember(hw_, port);
+      auto rv = opennsl_trunk_member_add(hw_->getUnit(), tid, &member);
+      bcmCheckError(rv, "failed to add port ", port, " to trunk ", id);
+      VLOG(2) << "added port " << port << " to trunk " << id;
+    }
+  }
+  trunk->programmed = std::move(active);
+}
+
+}} // facebook::fboss
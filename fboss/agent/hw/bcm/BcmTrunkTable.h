@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+extern "C" {
+#include <opennsl/types.h>
+}
+
+#include "fboss/agent/types.h"
+
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+class AggregatePort;
+class BcmSwitch;
+
+/*
+ * BcmTrunkTable programs each aggregate port as a hardware trunk, which
+ * hashes the traffic sent to it across its members.
+ *
+ * A member is only in the trunk while it is forwarding and its link is up.
+ * Members whose link goes down are removed from the trunk straight from
+ * the linkscan callback, so the other members take over their traffic
+ * without waiting for a state update.
+ *
+ * A port can only be in one trunk at a time, so removed trunks must be
+ * deleted before the trunks their members move to are added.
+ *
+ * All methods must be called with the BcmSwitch lock held.
+ */
+class BcmTrunkTable {
+ public:
+  explicit BcmTrunkTable(const BcmSwitch* hw);
+  ~BcmTrunkTable();
+
+  void addTrunk(const std::shared_ptr<AggregatePort>& aggPort);
+  void changeTrunk(const std::shared_ptr<AggregatePort>& oldAggPort,
+                   const std::shared_ptr<AggregatePort>& newAggPort);
+  void deleteTrunk(const std::shared_ptr<AggregatePort>& aggPort);
+
+  void linkStateChanged(PortID port, bool up);
+
+  /*
+   * The port to send traffic for a neighbor on the given port to: the
+   * trunk, if the port is a member of one, or else the port itself.
+   */
+  opennsl_port_t getEgressPort(PortID port) const;
+
+ private:
+  struct Trunk {
+    std::shared_ptr<AggregatePort> aggPort;
+    // The members currently in the hardware trunk
+    boost::container::flat_set<PortID> programmed;
+  };
+
+  // Forbidden copy constructor and assignment operator
+  BcmTrunkTable(BcmTrunkTable const &) = delete;
+  BcmTrunkTable& operator=(BcmTrunkTable const &) = delete;
+
+  boost::container::flat_set<PortID> getActiveMembers(
+      const AggregatePort* aggPort) const;
+  void updateMembers(AggregatePortID id, Trunk* trunk);
+  void removeMember(PortID port, AggregatePortID id);
+
+  const BcmSwitch* hw_{nullptr};
+  boost::container::flat_map<AggregatePortID, Trunk> trunks_;
+  boost::container::flat_map<PortID, AggregatePortID> memberOf_;
+  boost::container::flat_set<PortID> downPorts_;
+};
+
+}} // facebook::fboss
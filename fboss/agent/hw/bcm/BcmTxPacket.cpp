@@ -9,8 +9,11 @@
  */
 #include "fboss/agent/hw/bcm/BcmTxPacket.h"
 
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/PacketLatency.h"
 #include "fboss/agent/hw/bcm/BcmError.h"
 #include "fboss/agent/hw/bcm/BcmStats.h"
+#include "fboss/agent/hw/bcm/BcmTxPacketPool.h"
 
 extern "C" {
 #include <opennsl/tx.h>
@@ -24,9 +27,8 @@ namespace {
 using namespace facebook::fboss;
 
 void freeTxBuf(void *ptr, void* arg) {
-  opennsl_pkt_t* pkt = reinterpret_cast<opennsl_pkt_t*>(arg);
-  int rv = opennsl_pkt_free(pkt->unit, pkt);
-  bcmLogError(rv, "Failed to free packet");
+  auto buffer = static_cast<BcmTxPacketPool::Buffer*>(arg);
+  buffer->pool->release(buffer);
   BcmStats::get()->txPktFree();
 }
 
@@ -44,6 +46,7 @@ void txCallback(int unit, opennsl_pkt_t* pkt, void* cookie) {
   auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
       end - bcmTxPkt->getQueueTime());
   BcmStats::get()->txSentDone(duration.count());
+  PacketLatency::record(bcmTxPkt->getTrace(), LatencyStage::TX_DONE, end);
 }
 
 }
@@ -53,11 +56,14 @@ namespace facebook { namespace fboss {
 BcmTxPacket::BcmTxPacket(int unit, uint32_t size)
     : unit_(unit),
       queued_(std::chrono::time_point<std::chrono::steady_clock>::min()) {
-  int rv = opennsl_pkt_alloc(unit, size,
-                             OPENNSL_TX_CRC_APPEND | OPENNSL_TX_ETHER, &pkt_);
-  bcmLogError(rv, "Failed to allocate packet.");
-  buf_ = IOBuf::takeOwnership(pkt_->pkt_data->data, size,
-                              freeTxBuf, reinterpret_cast<void*>(pkt_));
+  auto buffer = BcmTxPacketPool::get(unit)->allocate(size);
+  if (!buffer) {
+    BcmStats::get()->txPktAllocErrors();
+    throw FbossError("failed to allocate TX packet of ", size, " bytes");
+  }
+  pkt_ = buffer->pkt;
+  buf_ = IOBuf::takeOwnership(buffer->data, size,
+                              freeTxBuf, reinterpret_cast<void*>(buffer));
   BcmStats::get()->txPktAlloc();
 }
 
@@ -68,26 +74,28 @@ void BcmTxPacket::enableHiGigHeader() {
   pkt_->flags &= ~OPENNSL_TX_ETHER;
 }
 
-int BcmTxPacket::sendAsync(unique_ptr<BcmTxPacket> pkt) noexcept {
-  opennsl_pkt_t* bcmPkt = pkt->pkt_;
-  DCHECK(bcmPkt->call_back == nullptr);
-  bcmPkt->call_back = txCallback;
-  const auto buf = pkt->buf();
+void BcmTxPacket::prepareSend(TimePoint now) noexcept {
+  DCHECK(pkt_->call_back == nullptr);
+  pkt_->call_back = txCallback;
+  const auto buf = this->buf();
 
   // TODO(aeckert): Setting the pkt len manually should be replaced in future
   // releases of opennsl with OPENNSL_PKT_TX_LEN_SET or opennsl_flags_len_setup
-  DCHECK(bcmPkt->pkt_data);
-  bcmPkt->pkt_data->len = buf->length();
+  DCHECK(pkt_->pkt_data);
+  pkt_->pkt_data->len = buf->length();
 
   // Now we also set the buffer that will be sent out to point at
   // buf->writableBuffer in case there is unused header space in the IOBuf
-  bcmPkt->pkt_data->data = buf->writableData();
+  pkt_->pkt_data->data = buf->writableData();
+
+  queued_ = now;
+}
 
-  pkt->queued_ = std::chrono::steady_clock::now();
+int BcmTxPacket::submit(unique_ptr<BcmTxPacket> pkt) noexcept {
+  opennsl_pkt_t* bcmPkt = pkt->pkt_;
   auto rv = opennsl_tx(bcmPkt->unit, bcmPkt, pkt.get());
   if (OPENNSL_SUCCESS(rv)) {
     pkt.release();
-    BcmStats::get()->txSent();
   } else {
     bcmLogError(rv, "failed to send packet");
     if (rv == OPENNSL_E_MEMORY) {
@@ -99,4 +107,32 @@ int BcmTxPacket::sendAsync(unique_ptr<BcmTxPacket> pkt) noexcept {
   return rv;
 }
 
+int BcmTxPacket::sendAsync(unique_ptr<BcmTxPacket> pkt) noexcept {
+  pkt->prepareSend(std::chrono::steady_clock::now());
+  auto rv = submit(std::move(pkt));
+  if (OPENNSL_SUCCESS(rv)) {
+    BcmStats::get()->txSent();
+  }
+  return rv;
+}
+
+size_t BcmTxPacket::sendAsyncBatch(
+    std::vector<unique_ptr<BcmTxPacket>> pkts) noexcept {
+  // Set up every packet first, so the submit loop below only hands
+  // descriptors to the SDK.
+  auto now = std::chrono::steady_clock::now();
+  for (auto& pkt : pkts) {
+    pkt->prepareSend(now);
+  }
+
+  size_t numSent = 0;
+  for (auto& pkt : pkts) {
+    if (OPENNSL_SUCCESS(submit(std::move(pkt)))) {
+      ++numSent;
+    }
+  }
+  BcmStats::get()->txBatchSent(numSent);
+  return numSent;
+}
+
 }} // facebook::fboss
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <chrono>
+#include <vector>
 
 #include "fboss/agent/TxPacket.h"
 
@@ -58,12 +59,27 @@ class BcmTxPacket : public TxPacket {
    */
   static int sendAsync(std::unique_ptr<BcmTxPacket> pkt) noexcept;
 
+  /*
+   * Send a batch of BcmTxPackets asynchronously, in order.
+   *
+   * All packets are prepared and timestamped up front, and then handed to
+   * the SDK back to back, with a single stats update for the batch.  As with
+   * sendAsync(), ownership of the packets is taken; packets that fail to be
+   * queued are freed immediately.
+   *
+   * Returns the number of packets successfully queued to HW.
+   */
+  static size_t sendAsyncBatch(
+      std::vector<std::unique_ptr<BcmTxPacket>> pkts) noexcept;
+
 
  private:
   // Forbidden copy constructor and assignment operator
   BcmTxPacket(BcmTxPacket const &) = delete;
   BcmTxPacket& operator=(BcmTxPacket const &) = delete;
   void enableHiGigHeader();
+  void prepareSend(TimePoint now) noexcept;
+  static int submit(std::unique_ptr<BcmTxPacket> pkt) noexcept;
 
   opennsl_pkt_t* pkt_{nullptr};
   const int unit_;
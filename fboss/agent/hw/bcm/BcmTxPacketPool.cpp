@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmTxPacketPool.h"
+
+#include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
+
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+
+extern "C" {
+#include <opennsl/tx.h>
+}
+
+DEFINE_int32(tx_pkt_pool_size, 512,
+             "Maximum number of TX packet buffers to keep for reuse in each "
+             "size class.  0 disables TX buffer pooling.");
+
+namespace {
+// The flags we allocate every TX packet with
+constexpr uint32_t kTxPktFlags = OPENNSL_TX_CRC_APPEND | OPENNSL_TX_ETHER;
+}
+
+namespace facebook { namespace fboss {
+
+// Small control packets, typical host packets, a full 1500 byte MTU frame
+// with headers, and jumbo frames.
+const std::array<uint32_t, BcmTxPacketPool::kNumSizeClasses>
+BcmTxPacketPool::kSizeClasses{{128, 512, 1600, 9600}};
+
+BcmTxPacketPool* BcmTxPacketPool::get(int unit) {
+  static std::mutex poolsLock;
+  static std::map<int, std::unique_ptr<BcmTxPacketPool>>* pools =
+    new std::map<int, std::unique_ptr<BcmTxPacketPool>>();
+
+  std::lock_guard<std::mutex> guard(poolsLock);
+  auto& pool = (*pools)[unit];
+  if (!pool) {
+    pool.reset(new BcmTxPacketPool(unit));
+  }
+  return pool.get();
+}
+
+BcmTxPacketPool::Buffer* BcmTxPacketPool::allocate(uint32_t size) {
+  uint32_t sizeClass = 0;
+  while (sizeClass < kNumSizeClasses && kSizeClasses[sizeClass] < size) {
+    ++sizeClass;
+  }
+
+  Buffer* buffer = nullptr;
+  uint64_t newHighWatermark = 0;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (sizeClass < kNumSizeClasses && !freeLists_[sizeClass].empty()) {
+      buffer = freeLists_[sizeClass].back();
+      freeLists_[sizeClass].pop_back();
+    }
+    if (++inUse_ > highWatermark_) {
+      highWatermark_ = inUse_;
+      newHighWatermark = highWatermark_;
+    }
+  }
+  if (newHighWatermark) {
+    BcmStats::txPktPoolHighWatermark(newHighWatermark);
+  }
+
+  if (buffer) {
+    BcmStats::get()->txPktPoolHit();
+    return buffer;
+  }
+
+  BcmStats::get()->txPktPoolMiss();
+  auto allocSize = sizeClass < kNumSizeClasses ? kSizeClasses[sizeClass] : size;
+  buffer = allocateBuffer(allocSize, sizeClass);
+  if (!buffer) {
+    std::lock_guard<std::mutex> guard(lock_);
+    --inUse_;
+  }
+  return buffer;
+}
+
+void BcmTxPacketPool::release(Buffer* buffer) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    --inUse_;
+    if (buffer->sizeClass < kNumSizeClasses &&
+        freeLists_[buffer->sizeClass].size() <
+          static_cast<size_t>(std::max(FLAGS_tx_pkt_pool_size, 0))) {
+      resetBuffer(buffer);
+      freeLists_[buffer->sizeClass].push_back(buffer);
+      return;
+    }
+  }
+  freeBuffer(buffer);
+}
+
+BcmTxPacketPool::Buffer* BcmTxPacketPool::allocateBuffer(uint32_t size,
+                                                         uint32_t sizeClass) {
+  opennsl_pkt_t* pkt = nullptr;
+  int rv = opennsl_pkt_alloc(unit_, size, kTxPktFlags, &pkt);
+  bcmLogError(rv, "Failed to allocate packet.");
+  if (OPENNSL_FAILURE(rv) || !pkt) {
+    return nullptr;
+  }
+
+  auto buffer = new Buffer();
+  buffer->pkt = pkt;
+  buffer->data = pkt->pkt_data->data;
+  buffer->size = size;
+  buffer->sizeClass = sizeClass;
+  buffer->pool = this;
+  return buffer;
+}
+
+void BcmTxPacketPool::freeBuffer(Buffer* buffer) {
+  int rv = opennsl_pkt_free(buffer->pkt->unit, buffer->pkt);
+  bcmLogError(rv, "Failed to free packet");
+  delete buffer;
+}
+
+void BcmTxPacketPool::resetBuffer(Buffer* buffer) {
+  // Undo everything BcmTxPacket may have changed, so the packet looks the
+  // same as when it was returned by opennsl_pkt_alloc().
+  auto pkt = buffer->pkt;
+  pkt->flags = kTxPktFlags;
+  pkt->call_back = nullptr;
+  OPENNSL_PBMP_CLEAR(pkt->tx_pbmp);
+  OPENNSL_PBMP_CLEAR(pkt->tx_upbmp);
+  pkt->pkt_data->data = buffer->data;
+  pkt->pkt_data->len = buffer->size;
+}
+
+}} // facebook::fboss
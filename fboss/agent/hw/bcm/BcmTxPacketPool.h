@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <opennsl/pkt.h>
+#include <opennsl/types.h>
+}
+
+namespace facebook { namespace fboss {
+
+/*
+ * BcmTxPacketPool keeps a per-unit cache of TX packet buffers allocated
+ * with opennsl_pkt_alloc().
+ *
+ * Allocating and freeing DMA packet memory through the SDK is expensive, and
+ * the host generates a steady stream of small packets (ARP and NDP replies,
+ * LLDP frames, traffic forwarded from the TUN interfaces).  Rather than
+ * freeing each buffer once its packet has been sent, we keep it on a
+ * freelist and reuse it for the next packet of a similar size.
+ *
+ * Buffers are grouped into a few size classes.  A request is satisfied from
+ * the smallest class that can hold it.  Requests larger than the largest
+ * class are allocated directly from the SDK and are never cached.  At most
+ * --tx_pkt_pool_size buffers are cached per size class; 0 disables caching.
+ *
+ * The pool is thread safe: packets are allocated from many threads, and
+ * released from the SDK TX completion thread.  Pools are never destroyed,
+ * since packets may still complete after the BcmSwitch has been destroyed.
+ */
+class BcmTxPacketPool {
+ public:
+  struct Buffer {
+    opennsl_pkt_t* pkt{nullptr};
+    // The start of the packet data, as returned by opennsl_pkt_alloc()
+    uint8_t* data{nullptr};
+    // The allocated size of the packet data
+    uint32_t size{0};
+    // The index of the size class, or kNumSizeClasses if not pooled
+    uint32_t sizeClass{0};
+    BcmTxPacketPool* pool{nullptr};
+  };
+
+  /*
+   * Get the pool for the specified unit.
+   */
+  static BcmTxPacketPool* get(int unit);
+
+  /*
+   * Get a buffer that holds at least 'size' bytes.
+   *
+   * The buffer is in the same state as a freshly allocated opennsl_pkt_t.
+   * Returns nullptr if the SDK failed to allocate a new buffer.
+   */
+  Buffer* allocate(uint32_t size);
+
+  /*
+   * Return a buffer to the pool, or free it if the pool is full.
+   */
+  void release(Buffer* buffer);
+
+ private:
+  enum : uint32_t { kNumSizeClasses = 4 };
+  static const std::array<uint32_t, kNumSizeClasses> kSizeClasses;
+
+  explicit BcmTxPacketPool(int unit) : unit_(unit) {}
+  // Forbidden copy constructor and assignment operator
+  BcmTxPacketPool(BcmTxPacketPool const &) = delete;
+  BcmTxPacketPool& operator=(BcmTxPacketPool const &) = delete;
+
+  Buffer* allocateBuffer(uint32_t size, uint32_t sizeClass);
+  void freeBuffer(Buffer* buffer);
+  static void resetBuffer(Buffer* buffer);
+
+  const int unit_;
+
+  std::mutex lock_;
+  std::array<std::vector<Buffer*>, kNumSizeClasses> freeLists_;
+  // The number of buffers currently handed out, and the largest it has been
+  uint64_t inUse_{0};
+  uint64_t highWatermark_{0};
+};
+
+}} // facebook::fboss
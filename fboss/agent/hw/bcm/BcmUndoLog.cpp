@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/bcm/BcmUndoLog.h"
+
+#include "fboss/agent/hw/bcm/BcmStats.h"
+
+#include <folly/ExceptionString.h>
+#include <glog/logging.h>
+
+namespace facebook { namespace fboss {
+
+void BcmUndoLog::record(std::function<void()> undo) {
+  std::lock_guard<std::mutex> g(lock_);
+  undos_.push_back(std::move(undo));
+}
+
+bool BcmUndoLog::rollback() {
+  std::vector<std::function<void()>> undos;
+  {
+    std::lock_guard<std::mutex> g(lock_);
+    undos.swap(undos_);
+  }
+  uint64_t failed = 0;
+  for (auto iter = undos.rbegin(); iter != undos.rend(); ++iter) {
+    try {
+      (*iter)();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "failed to undo a HW change: " << folly::exceptionStr(ex);
+      ++failed;
+    }
+  }
+  BcmStats::get()->changesRolledBack(undos.size() - failed, failed);
+  LOG(INFO) << "undid " << undos.size() - failed << " of " << undos.size()
+            << " HW changes";
+  return failed == 0;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * BcmUndoLog records how to undo each change BcmSwitch::stateChanged()
+ * applied to the HW, so that if a later change fails, the HW can be put
+ * back the way it was before the update.
+ *
+ * Each change is undone by applying the opposite change through the same
+ * functions, eg. a removed interface is added back, so the undo actions
+ * are only closures over the SwitchState nodes involved.
+ */
+class BcmUndoLog {
+ public:
+  BcmUndoLog() {}
+
+  /*
+   * Record how to undo a change that was just applied.  Changes applied
+   * from several threads at once can be recorded from each of them.
+   */
+  void record(std::function<void()> undo);
+
+  /*
+   * Undo the recorded changes, the last one first, and forget them.
+   *
+   * An undo action that fails is logged, and the rest still run.  Returns
+   * true if they all succeeded, so that the HW is back where it was.
+   */
+  bool rollback();
+
+  size_t size() const {
+    return undos_.size();
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  BcmUndoLog(BcmUndoLog const &) = delete;
+  BcmUndoLog& operator=(BcmUndoLog const &) = delete;
+
+  std::mutex lock_;
+  std::vector<std::function<void()>> undos_;
+};
+
+}} // facebook::fboss
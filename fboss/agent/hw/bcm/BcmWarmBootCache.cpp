@@ -8,12 +8,19 @@
  *
  */
 #include "BcmWarmBootCache.h"
+#include <chrono>
+#include <future>
+#include <iterator>
 #include <limits>
 #include <string>
+#include <tuple>
 #include <utility>
+#include <gflags/gflags.h>
+#include "fboss/agent/BootTimeline.h"
 #include "fboss/agent/hw/bcm/BcmEgress.h"
 #include "fboss/agent/hw/bcm/BcmSwitch.h"
 #include "fboss/agent/hw/bcm/BcmError.h"
+#include "fboss/agent/hw/bcm/BcmStats.h"
 #include "fboss/agent/hw/bcm/Utils.h"
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/Port.h"
@@ -23,8 +30,14 @@
 #include "fboss/agent/state/Vlan.h"
 #include "fboss/agent/state/VlanMap.h"
 
+DEFINE_bool(warm_boot_parallel_populate, true,
+            "Read the VLAN, host, route and ECMP tables from HW in parallel "
+            "when populating the warm boot cache");
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
 using std::make_pair;
-using std::make_tuple;
 using std::make_shared;
 using std::numeric_limits;
 using std::string;
@@ -45,6 +58,38 @@ struct AddrTables {
   shared_ptr<facebook::fboss::ArpTable> arpTable;
   shared_ptr<facebook::fboss::NdpTable> ndpTable;
 };
+
+// The prefix length of a contiguous netmask
+uint8_t maskLength(const uint8_t* mask, size_t len) {
+  uint8_t bits = 0;
+  for (size_t i = 0; i < len; ++i) {
+    bits += __builtin_popcount(mask[i]);
+  }
+  return bits;
+}
+
+// The entry to delete next.  flat_maps are erased from the back, where
+// that doesn't shift the others.
+template<typename MapT>
+typename MapT::iterator anyEntry(MapT* map) {
+  return std::prev(map->end());
+}
+
+template<typename KeyT, typename ValueT, typename HashT>
+typename std::unordered_map<KeyT, ValueT, HashT>::iterator anyEntry(
+    std::unordered_map<KeyT, ValueT, HashT>* map) {
+  return map->begin();
+}
+
+template<typename Fn>
+void timePhase(const std::string& phase, Fn fn) {
+  auto start = steady_clock::now();
+  fn();
+  auto msec = duration_cast<milliseconds>(steady_clock::now() - start);
+  VLOG(1) << "Warm boot cache: populated " << phase << " in "
+    << msec.count() << "ms";
+  BcmStats::warmBootPopulateTime(phase, msec.count());
+}
 }
 
 namespace facebook { namespace fboss {
@@ -125,6 +170,43 @@ shared_ptr<VlanMap> BcmWarmBootCache::reconstructVlanMap() const {
 }
 
 void BcmWarmBootCache::populate() {
+  BootTimeline::PhaseTimer timer("warm_boot_cache_populate");
+  auto start = steady_clock::now();
+  opennsl_l3_info_t l3Info;
+  opennsl_l3_info_t_init(&l3Info);
+  opennsl_l3_info(hw_->getUnit(), &l3Info);
+
+  // Each phase fills its own containers.  The only dependency is that
+  // egresses are looked up by the hosts that use them, which
+  // populateHosts() takes care of.  Without
+  // --warm_boot_parallel_populate, the phases are deferred and run one
+  // after another in get().
+  auto policy = FLAGS_warm_boot_parallel_populate ?
+    std::launch::async : std::launch::deferred;
+  auto vlans = std::async(policy, [this] {
+    timePhase("vlans", [this] { populateVlans(); });
+  });
+  auto routes = std::async(policy, [this, &l3Info] {
+    timePhase("routes", [this, &l3Info] { populateRoutes(l3Info); });
+  });
+  auto ecmpEgresses = std::async(policy, [this] {
+    timePhase("ecmp", [this] { populateEcmpEgresses(); });
+  });
+  timePhase("hosts", [this, &l3Info] { populateHosts(l3Info); });
+  // Any failure is rethrown here, after the other phases finished
+  vlans.get();
+  routes.get();
+  ecmpEgresses.get();
+
+  auto msec = duration_cast<milliseconds>(steady_clock::now() - start);
+  LOG(INFO) << "Warm boot cache: found " << vlan2VlanInfo_.size()
+    << " vlans, " << vrfIp2Host_.size() << " hosts, "
+    << vrfPrefix2Route_.size() << " routes and " << egressIds2Ecmp_.size()
+    << " ecmp egresses in " << msec.count() << "ms";
+  BcmStats::warmBootPopulateTime("total", msec.count());
+}
+
+void BcmWarmBootCache::populateVlans() {
   opennsl_vlan_data_t* vlanList = nullptr;
   int vlanCount = 0;
   SCOPE_EXIT {
@@ -175,9 +257,9 @@ void BcmWarmBootCache::populate() {
       }
     }
   }
-  opennsl_l3_info_t l3Info;
-  opennsl_l3_info_t_init(&l3Info);
-  opennsl_l3_info(hw_->getUnit(), &l3Info);
+}
+
+void BcmWarmBootCache::populateHosts(const opennsl_l3_info_t& l3Info) {
   // Traverse V4 hosts
   opennsl_l3_host_traverse(hw_->getUnit(), 0, 0, l3Info.l3info_max_host,
       hostTraversalCallback, this);
@@ -188,6 +270,13 @@ void BcmWarmBootCache::populate() {
       hostTraversalCallback, this);
   // Get egress entries
   opennsl_l3_egress_traverse(hw_->getUnit(), egressTraversalCallback, this);
+  // Clear internal egress id table which just gets used while populating
+  // warm boot cache
+  egressId2VrfIp_.clear();
+}
+
+void BcmWarmBootCache::populateRoutes(const opennsl_l3_info_t& l3Info) {
+  vrfPrefix2Route_.reserve(l3Info.l3info_used_route);
   // Traverse V4 routes
   opennsl_l3_route_traverse(hw_->getUnit(), 0, 0, l3Info.l3info_max_route,
       routeTraversalCallback, this);
@@ -196,12 +285,11 @@ void BcmWarmBootCache::populate() {
       // Diag shell uses this for getting # of v6 route entries
       l3Info.l3info_max_route / 2,
       routeTraversalCallback, this);
-  // Traverse ecmp egress entries
+}
+
+void BcmWarmBootCache::populateEcmpEgresses() {
   opennsl_l3_egress_ecmp_traverse(hw_->getUnit(), ecmpEgressTraversalCallback,
       this);
-  // Clear internal egress id table which just gets used while populating
-  // warm boot cache
-  egressId2VrfIp_.clear();
 }
 
 bool BcmWarmBootCache::fillVlanPortInfo(Vlan* vlan) {
@@ -223,13 +311,29 @@ bool BcmWarmBootCache::fillVlanPortInfo(Vlan* vlan) {
   return false;
 }
 
+IPAddress BcmWarmBootCache::getHostAddress(const opennsl_l3_host_t& host) {
+  return host.l3a_flags & OPENNSL_L3_IP6 ?
+    IPAddress::fromBinary(ByteRange(host.l3a_ip6_addr,
+          sizeof(host.l3a_ip6_addr))) :
+    IPAddress::fromLongHBO(host.l3a_ip_addr);
+}
+
+std::pair<IPAddress, uint8_t> BcmWarmBootCache::getRoutePrefix(
+    const opennsl_l3_route_t& route) {
+  auto ip = route.l3a_flags & OPENNSL_L3_IP6 ?
+    IPAddress::fromBinary(ByteRange(route.l3a_ip6_net,
+          sizeof(route.l3a_ip6_net))) :
+    IPAddress::fromLongHBO(route.l3a_subnet);
+  uint8_t mask = route.l3a_flags & OPENNSL_L3_IP6 ?
+    maskLength(route.l3a_ip6_mask, sizeof(route.l3a_ip6_mask)) :
+    __builtin_popcount(route.l3a_ip_mask);
+  return make_pair(ip, mask);
+}
+
 int BcmWarmBootCache::hostTraversalCallback(int unit, int index,
     opennsl_l3_host_t* host, void* userData) {
   BcmWarmBootCache* cache = static_cast<BcmWarmBootCache*>(userData);
-  auto ip = host->l3a_flags & OPENNSL_L3_IP6 ?
-    IPAddress::fromBinary(ByteRange(host->l3a_ip6_addr,
-          sizeof(host->l3a_ip6_addr))) :
-    IPAddress::fromLongHBO(host->l3a_ip_addr);
+  auto ip = getHostAddress(*host);
   cache->vrfIp2Host_[make_pair(host->l3a_vrf, ip)] = *host;
   VLOG(1) << "Adding egress id: " << host->l3a_intf << " to " << ip
     <<" mapping";
@@ -274,17 +378,12 @@ int BcmWarmBootCache::egressTraversalCallback(int unit, EgressId egressId,
 int BcmWarmBootCache::routeTraversalCallback(int unit, int index,
     opennsl_l3_route_t* route, void* userData) {
   BcmWarmBootCache* cache = static_cast<BcmWarmBootCache*>(userData);
-  auto ip = route->l3a_flags & OPENNSL_L3_IP6 ?
-    IPAddress::fromBinary(ByteRange(route->l3a_ip6_net,
-          sizeof(route->l3a_ip6_net))) :
-    IPAddress::fromLongHBO(route->l3a_subnet);
-  auto mask = route->l3a_flags & OPENNSL_L3_IP6 ?
-    IPAddress::fromBinary(ByteRange(route->l3a_ip6_mask,
-          sizeof(route->l3a_ip6_mask))) :
-    IPAddress::fromLongHBO(route->l3a_ip_mask);
+  IPAddress ip;
+  uint8_t mask;
+  std::tie(ip, mask) = getRoutePrefix(*route);
   VLOG (1) << "In vrf : " << route->l3a_vrf << " adding route for : "
-    << ip << " mask: " << mask;
-  cache->vrfPrefix2Route_[make_tuple(route->l3a_vrf, ip, mask)] = *route;
+    << ip << "/" << static_cast<int>(mask);
+  cache->vrfPrefix2Route_[VrfAndPrefix(route->l3a_vrf, ip, mask)] = *route;
   return 0;
 }
 
@@ -315,28 +414,73 @@ std::string BcmWarmBootCache::toEgressIdsStr(const EgressIds& egressIds) {
   return egressStr;
 }
 
-void BcmWarmBootCache::clear() {
+template<typename MapT, typename DeleteFn>
+bool BcmWarmBootCache::deleteOrphans(MapT* map, size_t* budget,
+                                     DeleteFn deleteFn) {
+  while (!map->empty()) {
+    if (*budget == 0) {
+      return false;
+    }
+    auto iter = anyEntry(map);
+    deleteFn(*iter);
+    map->erase(iter);
+    --*budget;
+    ++deleted_;
+  }
+  return true;
+}
+
+size_t BcmWarmBootCache::numOrphans() const {
+  auto vlans = vlan2VlanInfo_.size();
+  if (cleanupStarted_ && vlan2VlanInfo_.count(VlanID(defaultVlan_))) {
+    --vlans; // Can't delete the default vlan
+  }
+  return vrfPrefix2Route_.size() + egressIds2Ecmp_.size() +
+    vrfIp2Host_.size() + vrfIp2Egress_.size() + vlanAndMac2Intf_.size() +
+    vlan2Station_.size() + vlans;
+}
+
+HwSwitch::WarmBootReconciliation BcmWarmBootCache::getReconciliation() const {
+  HwSwitch::WarmBootReconciliation status;
+  status.reused = claimed_ - reprogrammed_;
+  status.reprogrammed = reprogrammed_;
+  status.deleted = deleted_;
+  status.remaining = numOrphans();
+  status.cleanupStarted = cleanupStarted_;
+  return status;
+}
+
+size_t BcmWarmBootCache::clear(size_t maxEntries) {
+  if (!cleanupStarted_) {
+    VLOG(1) << "Warm boot : removing unreferenced entries";
+    auto rv = opennsl_vlan_default_get(hw_->getUnit(), &defaultVlan_);
+    bcmLogFatal(rv, hw_, "failed to get default VLAN");
+    cleanupStarted_ = true;
+  }
   // Get rid of all unclaimed entries. The order is important here
   // since we want to delete entries only after there are no more
-  // references to them.
-  VLOG(1) << "Warm boot : removing unreferenced entries";
+  // references to them.  Each step only starts once the previous one
+  // deleted all of its entries.
+  size_t budget = maxEntries;
+
   // Nothing references routes, but routes reference ecmp egress
   // and egress entries which are deleted later
-  for (auto vrfPfxAndRoute : vrfPrefix2Route_) {
-    VLOG(1) << "Deleting unreferenced route in vrf:" <<
-        std::get<0>(vrfPfxAndRoute.first) << " for prefix : " <<
-        std::get<1>(vrfPfxAndRoute.first) << "/" <<
-        std::get<2>(vrfPfxAndRoute.first);
+  if (!deleteOrphans(&vrfPrefix2Route_, &budget,
+      [&](VrfAndPrefix2Route::value_type& vrfPfxAndRoute) {
+    const auto& key = vrfPfxAndRoute.first;
+    VLOG(1) << "Deleting unreferenced route in vrf:" << key.vrf <<
+        " for prefix : " << key.network << "/" << static_cast<int>(key.mask);
     auto rv = opennsl_l3_route_delete(hw_->getUnit(), &(vrfPfxAndRoute.second));
     bcmLogFatal(rv, hw_, "failed to delete unreferenced route in vrf:",
-        std::get<0>(vrfPfxAndRoute.first) , " for prefix : " ,
-        std::get<1>(vrfPfxAndRoute.first) , "/" ,
-        std::get<2>(vrfPfxAndRoute.first));
+        key.vrf, " for prefix : ", key.network, "/",
+        static_cast<int>(key.mask));
+  })) {
+    return numOrphans();
   }
-  vrfPrefix2Route_.clear();
   // Only routes refer ecmp egress objects. Ecmp egress objects in turn
   // refer to egress objects which we delete later
-  for (auto idsAndEcmp : egressIds2Ecmp_) {
+  if (!deleteOrphans(&egressIds2Ecmp_, &budget,
+      [&](EgressIds2Ecmp::value_type& idsAndEcmp) {
     auto& ecmp = idsAndEcmp.second;
     VLOG(1) << "Deleting ecmp egress object  " << ecmp.ecmp_intf
       << " pointing to : " << toEgressIdsStr(idsAndEcmp.first);
@@ -344,55 +488,60 @@ void BcmWarmBootCache::clear() {
     bcmLogFatal(rv, hw_, "failed to destroy ecmp egress object :",
         ecmp.ecmp_intf, " referring to ",
         toEgressIdsStr(idsAndEcmp.first));
+  })) {
+    return numOrphans();
   }
-  egressIds2Ecmp_.clear();
 
   // Delete bcm host entries. Nobody references bcm hosts, but
   // hosts reference egress objects
-  for (auto vrfIpAndHost : vrfIp2Host_) {
+  if (!deleteOrphans(&vrfIp2Host_, &budget,
+      [&](VrfAndIP2Host::value_type& vrfIpAndHost) {
     VLOG(1)<< "Deleting host entry in vrf: " <<
         vrfIpAndHost.first.first << " for : " << vrfIpAndHost.first.second;
     auto rv = opennsl_l3_host_delete(hw_->getUnit(), &vrfIpAndHost.second);
     bcmLogFatal(rv, hw_, "failed to delete host entry in vrf: ",
         vrfIpAndHost.first.first, " for : ", vrfIpAndHost.first.second);
+  })) {
+    return numOrphans();
   }
-  vrfIp2Host_.clear();
   // Delete bcm egress entries. These are referenced by routes, ecmp egress
   // and host objects all of which we deleted above. Egress objects in turn
   // my point to a interface which we delete later
-  for (auto vrfIpAndEgress : vrfIp2Egress_) {
-
+  if (!deleteOrphans(&vrfIp2Egress_, &budget,
+      [&](VrfAndIP2Egress::value_type& vrfIpAndEgress) {
     VLOG(1) << "Deleting egress object  " << vrfIpAndEgress.second.first;
     auto rv = opennsl_l3_egress_destroy(hw_->getUnit(),
         vrfIpAndEgress.second.first);
     bcmLogFatal(rv, hw_, "failed to destroy egress object ",
         vrfIpAndEgress.second.first);
+  })) {
+    return numOrphans();
   }
-  vrfIp2Egress_.clear();
   // Delete interfaces
-  for (auto vlanMacAndIntf : vlanAndMac2Intf_) {
+  if (!deleteOrphans(&vlanAndMac2Intf_, &budget,
+      [&](VlanAndMac2Intf::value_type& vlanMacAndIntf) {
     VLOG(1) <<"Deletingl3 interface for vlan: " << vlanMacAndIntf.first.first
       <<" and mac : " << vlanMacAndIntf.first.second;
     auto rv = opennsl_l3_intf_delete(hw_->getUnit(), &vlanMacAndIntf.second);
     bcmLogFatal(rv, hw_, "failed to delete l3 interface for vlan: ",
         vlanMacAndIntf.first.first, " and mac : ", vlanMacAndIntf.first.second);
+  })) {
+    return numOrphans();
   }
-  vlanAndMac2Intf_.clear();
   // Delete stations
-  for (auto vlanAndStation : vlan2Station_) {
+  if (!deleteOrphans(&vlan2Station_, &budget,
+      [&](Vlan2Station::value_type& vlanAndStation) {
     VLOG(1) << "Deleting station for vlan : " << vlanAndStation.first;
     auto rv = opennsl_l2_station_delete(hw_->getUnit(), vlanAndStation.first);
     bcmLogFatal(rv, hw_, "failed to delete station for vlan : ",
         vlanAndStation.first);
+  })) {
+    return numOrphans();
   }
-  vlan2Station_.clear();
-  opennsl_vlan_t defaultVlan;
-  auto rv = opennsl_vlan_default_get(hw_->getUnit(), &defaultVlan);
-  bcmLogFatal(rv, hw_, "failed to get default VLAN");
   // Finally delete the vlans
-  for (auto vlanItr = vlan2VlanInfo_.begin();
-      vlanItr != vlan2VlanInfo_.end();) {
-    if (defaultVlan == vlanItr->first) {
+  auto vlanItr = vlan2VlanInfo_.begin();
+  while (vlanItr != vlan2VlanInfo_.end() && budget > 0) {
+    if (defaultVlan_ == vlanItr->first) {
       ++vlanItr;
       continue; // Can't delete the default vlan
     }
@@ -400,6 +549,9 @@ void BcmWarmBootCache::clear() {
     auto rv = opennsl_vlan_destroy(hw_->getUnit(), vlanItr->first);
     bcmLogFatal(rv, hw_, "failed to destroy vlan: ", vlanItr->first);
     vlanItr = vlan2VlanInfo_.erase(vlanItr);
+    --budget;
+    ++deleted_;
   }
+  return numOrphans();
 }
 }}
@@ -15,14 +15,19 @@ extern "C" {
 #include <opennsl/vlan.h>
 }
 #include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <list>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <boost/container/flat_map.hpp>
 #include <boost/container/flat_set.hpp>
+#include <folly/Hash.h>
 #include <folly/IPAddress.h>
 #include <folly/MacAddress.h>
+#include "fboss/agent/HwSwitch.h"
 #include "fboss/agent/types.h"
 #include "fboss/agent/state/RouteTypes.h"
 
@@ -56,6 +61,13 @@ class BcmWarmBootCache {
     return egressIds;
   }
   static std::string toEgressIdsStr(const EgressIds& egressIds);
+  /*
+   * The address of a host entry, and the network and mask length of a route
+   * entry, as read from HW.
+   */
+  static folly::IPAddress getHostAddress(const opennsl_l3_host_t& host);
+  static std::pair<folly::IPAddress, uint8_t> getRoutePrefix(
+      const opennsl_l3_route_t& route);
   /*
    * Reconstruct interface map from contents of warm boot cache
    */
@@ -70,12 +82,23 @@ class BcmWarmBootCache {
       EcmpEgressIdAndEgress;
   typedef std::pair<VlanID, folly::MacAddress> VlanAndMac;
   typedef std::pair<opennsl_if_t, folly::MacAddress> IntfIdAndMac;
-  /*
-   * VRF, IP, Mask
-   * TODO - Convert mask to mask len for efficient storage/lookup
-   */
-  typedef std::tuple<opennsl_vrf_t, folly::IPAddress,
-          folly::IPAddress> VrfAndPrefix;
+  struct VrfAndPrefix {
+    VrfAndPrefix(opennsl_vrf_t _vrf, const folly::IPAddress& _network,
+                 uint8_t _mask)
+        : vrf(_vrf), network(_network), mask(_mask) {}
+    bool operator==(const VrfAndPrefix& other) const {
+      return vrf == other.vrf && mask == other.mask &&
+        network == other.network;
+    }
+    opennsl_vrf_t vrf;
+    folly::IPAddress network;
+    uint8_t mask;
+  };
+  struct VrfAndPrefixHash {
+    size_t operator()(const VrfAndPrefix& key) const {
+      return folly::hash::hash_combine(key.vrf, key.network.hash(), key.mask);
+    }
+  };
   typedef std::pair<opennsl_vrf_t, folly::IPAddress> VrfAndIP;
   /*
    * Cache containers
@@ -89,10 +112,21 @@ class BcmWarmBootCache {
   typedef boost::container::flat_map<VrfAndIP,
           EgressIdAndEgress> VrfAndIP2Egress;
   typedef boost::container::flat_map<EgressId, VrfAndIP> EgressId2VrfAndIP;
-  typedef boost::container::flat_map<VrfAndPrefix, opennsl_l3_route_t>
-    VrfAndPrefix2Route;
+  // A full table has far more routes than anything else, so they are kept
+  // in a hash table rather than a sorted vector that every programmed()
+  // call has to shift.
+  typedef std::unordered_map<VrfAndPrefix, opennsl_l3_route_t,
+          VrfAndPrefixHash> VrfAndPrefix2Route;
   typedef boost::container::flat_map<EgressIds,
           opennsl_l3_egress_ecmp_t> EgressIds2Ecmp;
+  /*
+   * The parts of populate().  Each phase reads different HW tables into
+   * different containers, so they can run in parallel.
+   */
+  void populateVlans();
+  void populateHosts(const opennsl_l3_info_t& l3Info);
+  void populateRoutes(const opennsl_l3_info_t& l3Info);
+  void populateEcmpEgresses();
   /*
    * Callbacks for traversing entries in BCM h/w tables
    */
@@ -120,6 +154,7 @@ class BcmWarmBootCache {
   void programmed(Vlan2VlanInfoCitr vitr) {
     VLOG(1) << "Programmed vlan: " << vitr->first
       << " removing from warm boot cache";
+    ++claimed_;
     vlan2VlanInfo_.erase(vitr);
   }
   /*
@@ -134,6 +169,7 @@ class BcmWarmBootCache {
   void programmed(Vlan2StationCitr vsitr) {
     VLOG(1) << "Programmed station : " << vsitr->first
       << " removing from warm boot cache";
+    ++claimed_;
     vlan2Station_.erase(vsitr);
   }
   /*
@@ -153,6 +189,7 @@ class BcmWarmBootCache {
     VLOG(1) << "Programmed interface in vlan : " << vmitr->first.first
       << " and mac: " << vmitr->first.second
       << " removing from warm boot cache";
+    ++claimed_;
     vlanAndMac2Intf_.erase(vmitr);
   }
   /*
@@ -173,6 +210,7 @@ class BcmWarmBootCache {
     VLOG(1) << "Programmed vrf : " << vrecitr->first.first << " ip : "
       << vrecitr->first.second <<" and egress id : " << vrecitr->second.first
       << " removing from warm boot cache ";
+    ++claimed_;
     vrfIp2Egress_.erase(vrecitr);
   }
   opennsl_if_t getDropEgressId() const {
@@ -194,6 +232,7 @@ class BcmWarmBootCache {
   void programmed(VrfAndIP2HostCitr vrhitr) {
     VLOG(1) << "Programmed host for vrf : " << vrhitr->first.first << " ip : "
       << vrhitr->first.second << " removing from warm boot cache ";
+    ++claimed_;
     vrfIp2Host_.erase(vrhitr);
   }
   /*
@@ -206,22 +245,19 @@ class BcmWarmBootCache {
   VrfAndPfx2RouteCitr vrfAndPrefix2Route_end() const {
     return vrfPrefix2Route_.end();
   }
+  bool hasRoutes() const {
+    return !vrfPrefix2Route_.empty();
+  }
   VrfAndPfx2RouteCitr findRoute(opennsl_vrf_t vrf, const folly::IPAddress& ip,
       uint8_t mask) {
-    using folly::IPAddress;
-    using folly::IPAddressV4;
-    using folly::IPAddressV6;
-    if (ip.isV6()) {
-      return vrfPrefix2Route_.find(VrfAndPrefix(vrf, ip,
-            IPAddress(IPAddressV6(IPAddressV6::fetchMask(mask)))));
-    }
-    return vrfPrefix2Route_.find(VrfAndPrefix(vrf, ip,
-       IPAddress(IPAddressV4(IPAddressV4::fetchMask(mask)))));
+    return vrfPrefix2Route_.find(VrfAndPrefix(vrf, ip, mask));
   }
   void programmed(VrfAndPfx2RouteCitr vrpitr) {
-    VLOG(1) << "Programmed route in vrf : " << std::get<0>(vrpitr->first)
-      << "  prefix: " << std::get<1>(vrpitr->first) << "/"
-      <<  std::get<2>(vrpitr->first) << " removing from warm boot cache ";
+    VLOG(1) << "Programmed route in vrf : " << vrpitr->first.vrf
+      << "  prefix: " << vrpitr->first.network << "/"
+      << static_cast<int>(vrpitr->first.mask)
+      << " removing from warm boot cache ";
+    ++claimed_;
     vrfPrefix2Route_.erase(vrpitr);
   }
   /*
@@ -240,18 +276,41 @@ class BcmWarmBootCache {
   void programmed(EgressIds2EcmpCItr eeitr) {
     VLOG(1) << "Programmed ecmp egress: " << eeitr->second.ecmp_intf
       << " removing from warm boot cache";
+    ++claimed_;
     egressIds2Ecmp_.erase(eeitr);
   }
+  /*
+   * Entries that were claimed by programmed(), but had to be changed in HW
+   * to match the new state.
+   */
+  void reprogrammed() {
+    ++reprogrammed_;
+  }
   /*
    * owner is done programming its entries remove any entries
    * from hw that had owner as their only remaining owner
+   *
+   * At most maxEntries are deleted per call, in an order that deletes
+   * entries only after anything that refers to them, so the cleanup can be
+   * spread over many calls.  Entries that are still in the cache may be
+   * claimed with programmed() in between.
+   *
+   * Returns the number of entries left to delete.
    */
-  void clear();
+  size_t clear(size_t maxEntries = std::numeric_limits<size_t>::max());
+  HwSwitch::WarmBootReconciliation getReconciliation() const;
   bool fillVlanPortInfo(Vlan* vlan);
  private:
   // No copy or assignment.
   BcmWarmBootCache(const BcmWarmBootCache&) = delete;
   BcmWarmBootCache& operator=(const BcmWarmBootCache&) = delete;
+  /*
+   * Delete entries of one cache container with deleteFn, while *budget
+   * allows.  Returns whether the container has no entries left to delete.
+   */
+  template<typename MapT, typename DeleteFn>
+  bool deleteOrphans(MapT* map, size_t* budget, DeleteFn deleteFn);
+  size_t numOrphans() const;
   const BcmSwitch* hw_;
   Vlan2VlanInfo vlan2VlanInfo_;
   Vlan2Station vlan2Station_;
@@ -263,5 +322,13 @@ class BcmWarmBootCache {
   EgressIds2Ecmp egressIds2Ecmp_;
   opennsl_if_t dropEgressId_;
   opennsl_if_t toCPUEgressId_;
+  // VLAN that can't be deleted, once clear() started
+  opennsl_vlan_t defaultVlan_{0};
+  bool cleanupStarted_{false};
+  // Reconciliation counts: entries claimed by programmed(), entries
+  // reported as reprogrammed(), and entries deleted by clear()
+  uint64_t claimed_{0};
+  uint64_t reprogrammed_{0};
+  uint64_t deleted_{0};
 };
 }} // facebook::fboss
@@ -13,11 +13,17 @@
 #include "fboss/agent/hw/mock/MockTxPacket.h"
 
 using folly::make_unique;
+using ::testing::_;
+using ::testing::Invoke;
 
 namespace facebook { namespace fboss {
 
 MockHwSwitch::MockHwSwitch(MockPlatform *platform)
   : platform_(platform) {
+  ON_CALL(*this, stateChanged(_))
+    .WillByDefault(Invoke([this](const StateDelta& delta) {
+      latencyModel_.apply(delta);
+    }));
 }
 
 std::unique_ptr<TxPacket> MockHwSwitch::allocatePacket(uint32_t size) {
@@ -30,6 +36,15 @@ bool MockHwSwitch::sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept {
   return true;
 }
 
+size_t MockHwSwitch::sendPacketsSwitched(
+    std::vector<std::unique_ptr<TxPacket>> pkts) noexcept {
+  for (auto& pkt : pkts) {
+    std::shared_ptr<TxPacket> sp(pkt.release());
+    sendPacketSwitched_(sp);
+  }
+  return pkts.size();
+}
+
 bool MockHwSwitch::sendPacketOutOfPort(
     std::unique_ptr<TxPacket> pkt,
     facebook::fboss::PortID portID) noexcept {
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/hw/sim/SimLatencyModel.h"
 #include "fboss/agent/state/StateDelta.h"
 
 #include <gmock/gmock.h>
@@ -23,14 +24,27 @@ class MockHwSwitch : public HwSwitch {
   explicit MockHwSwitch(MockPlatform* platform);
   typedef std::pair<std::shared_ptr<SwitchState>, BootType> StateAndBootType;
   MOCK_METHOD1(init, StateAndBootType(Callback*));
+  // By default, stateChanged() takes as long as the latency model says
   MOCK_METHOD1(stateChanged, void(const StateDelta&));
 
+  /*
+   * The model of how long the SDK takes to apply each state change.  This
+   * may only be changed while no state changes are being applied.
+   */
+  SimLatencyModel* getLatencyModel() {
+    return &latencyModel_;
+  }
+
   // gmock currently doesn't support move-only types, so we have to
   // use some janky work-arounds.
   std::unique_ptr<TxPacket> allocatePacket(uint32_t) override;
 
   MOCK_METHOD1(sendPacketSwitched_, void(std::shared_ptr<TxPacket>));
   bool sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept override;
+  // Batched sends are reported one packet at a time via sendPacketSwitched_,
+  // so tests can match them just like individual sends.
+  size_t sendPacketsSwitched(
+      std::vector<std::unique_ptr<TxPacket>> pkts) noexcept override;
 
   MOCK_METHOD1(sendPacketOutOfPort_, void(std::shared_ptr<TxPacket>));
   bool sendPacketOutOfPort(std::unique_ptr<TxPacket> pkt,
@@ -61,12 +75,29 @@ class MockHwSwitch : public HwSwitch {
     return true;
   }
 
+  MOCK_METHOD1(getAndClearNeighborHits, bool(NeighborHits*));
+  MOCK_METHOD3(setNeighborReachable,
+               bool(RouterID, const folly::IPAddress&, bool));
+
+  bool getWarmBootReconciliation(WarmBootReconciliation* status) override {
+    return false;
+  }
+  bool estimateStateChange(const StateDelta& delta,
+                           HwOperationEstimate* estimate) const override {
+    return false;
+  }
+  bool getPortCounters(PortID port,
+                       PortCounters* counters) const override {
+    return false;
+  }
+
  private:
   // Forbidden copy constructor and assignment operator
   MockHwSwitch(MockHwSwitch const &) = delete;
   MockHwSwitch& operator=(MockHwSwitch const &) = delete;
 
   MockPlatform* platform_{nullptr};
+  SimLatencyModel latencyModel_;
 };
 
 }} // facebook::fboss
@@ -34,6 +34,9 @@ class MockRxPacket : public RxPacket {
   void setSrcVlan(VlanID id) {
     srcVlan_ = id;
   }
+  void setSampled(bool sampled) {
+    sampled_ = sampled;
+  }
 
  private:
   // Forbidden copy constructor and assignment operator
@@ -0,0 +1,283 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/sim/SimDataplane.h"
+
+#include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/packet/Ethertype.h"
+#include "fboss/agent/packet/HdrParseError.h"
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/packet/IPv4Hdr.h"
+#include "fboss/agent/packet/IPv6Hdr.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteTable.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteTableRib.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <folly/io/Cursor.h>
+
+using folly::IOBuf;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using folly::io::Cursor;
+using std::shared_ptr;
+
+namespace {
+
+using namespace facebook::fboss;
+
+const uint16_t kEthertypeSlowProtocols = 0x8809;
+const uint16_t kDhcpServerPort = 67;
+const uint16_t kDhcpClientPort = 68;
+
+const RouteTableRib<IPAddressV4>* getRib(const RouteTable* table,
+                                         const IPAddressV4&) {
+  return table->getRibV4().get();
+}
+const RouteTableRib<IPAddressV6>* getRib(const RouteTable* table,
+                                         const IPAddressV6&) {
+  return table->getRibV6().get();
+}
+
+IPAddressV4 toAddr(const IPAddress& ip, const IPAddressV4&) {
+  return ip.asV4();
+}
+IPAddressV6 toAddr(const IPAddress& ip, const IPAddressV6&) {
+  return ip.asV6();
+}
+
+shared_ptr<ArpTable> getNeighborTable(const Vlan* vlan,
+                                      const IPAddressV4&) {
+  return vlan->getArpTable();
+}
+shared_ptr<NdpTable> getNeighborTable(const Vlan* vlan,
+                                      const IPAddressV6&) {
+  return vlan->getNdpTable();
+}
+
+// Whether a broadcast IPv4 frame is a DHCP request or reply, which the
+// ASIC traps for the DHCP relay
+bool isDhcp(Cursor cursor) {
+  IPv4Hdr ipv4(cursor);
+  if (ipv4.protocol != IP_PROTO_UDP) {
+    return false;
+  }
+  cursor.skip((ipv4.ihl - 5) * 4);
+  cursor.skip(sizeof(uint16_t));
+  auto dstPort = cursor.readBE<uint16_t>();
+  return dstPort == kDhcpServerPort || dstPort == kDhcpClientPort;
+}
+
+} // unnamed namespace
+
+namespace facebook { namespace fboss {
+
+constexpr size_t SimDataplane::kNumVerdicts;
+
+SimDataplane::SimDataplane() {
+  resetCounts();
+}
+
+void SimDataplane::stateChanged(shared_ptr<SwitchState> state) {
+  state_.store(std::move(state));
+}
+
+const char* SimDataplane::getVerdictName(Verdict verdict) {
+  switch (verdict) {
+    case Verdict::ROUTED:
+      return "routed";
+    case Verdict::SWITCHED:
+      return "switched";
+    case Verdict::PUNT_CONTROL:
+      return "punt_control";
+    case Verdict::PUNT_LOCAL:
+      return "punt_local";
+    case Verdict::PUNT_TTL:
+      return "punt_ttl";
+    case Verdict::PUNT_NO_NEIGHBOR:
+      return "punt_no_neighbor";
+    case Verdict::PUNT_ROUTE:
+      return "punt_route";
+    case Verdict::DROP_NO_ROUTE:
+      return "drop_no_route";
+    case Verdict::DROP_ROUTE:
+      return "drop_route";
+    case Verdict::DROP_BAD:
+      return "drop_bad";
+    case Verdict::NUM_VERDICTS:
+      break;
+  }
+  return "unknown";
+}
+
+void SimDataplane::resetCounts() {
+  for (auto& count : counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+SimDataplane::Result SimDataplane::forward(const IOBuf* frame,
+                                           VlanID vlan) {
+  Result result;
+  {
+    ReadMostlyPtr<SwitchState>::Reader state(state_);
+    if (state.get()) {
+      try {
+        result = forward(*state, frame, vlan);
+      } catch (const HdrParseError&) {
+        result = Result();
+      } catch (const std::out_of_range&) {
+        // Cut short by the end of the frame
+        result = Result();
+      }
+    }
+  }
+  counts_[static_cast<size_t>(result.verdict)].fetch_add(
+      1, std::memory_order_relaxed);
+  return result;
+}
+
+SimDataplane::Result SimDataplane::forward(const SwitchState& state,
+                                           const IOBuf* frame,
+                                           VlanID vlan) const {
+  Cursor cursor(frame);
+  EthHdr eth(cursor);
+  if (!eth.getVlanTags().empty()) {
+    vlan = VlanID(eth.getVlanTags()[0].vid());
+  }
+  if (!state.getVlans()->getVlanIf(vlan)) {
+    return Result();
+  }
+
+  Result result;
+  auto etherType = eth.getEtherType();
+  if (etherType == ETHERTYPE_ARP || etherType == ETHERTYPE_LLDP ||
+      etherType == kEthertypeSlowProtocols) {
+    result.verdict = Verdict::PUNT_CONTROL;
+    return result;
+  }
+  auto dstMac = eth.getDstMac();
+  if (dstMac.isBroadcast()) {
+    result.verdict = etherType == ETHERTYPE_IPV4 && isDhcp(cursor)
+      ? Verdict::PUNT_CONTROL : Verdict::SWITCHED;
+    return result;
+  }
+  if (dstMac.isMulticast()) {
+    // NDP, and the other ICMPv6 link protocols, are to multicast MACs
+    result.verdict = etherType == ETHERTYPE_IPV6
+      ? Verdict::PUNT_CONTROL : Verdict::SWITCHED;
+    return result;
+  }
+
+  // Only frames to the MAC of one of the VLAN's interfaces are routed
+  bool toRouter = false;
+  for (const auto& intf : *state.getInterfaces()) {
+    if (intf->getVlanID() == vlan && intf->getMac() == dstMac) {
+      toRouter = true;
+      break;
+    }
+  }
+  if (!toRouter) {
+    result.verdict = Verdict::SWITCHED;
+    return result;
+  }
+
+  // TODO: assume vrf 0, as the IPv4Handler and IPv6Handler do
+  auto intfs = state.getInterfaces();
+  if (etherType == ETHERTYPE_IPV4) {
+    IPv4Hdr ipv4(cursor);
+    if (intfs->getInterfaceIf(RouterID(0), IPAddress(ipv4.dstAddr))) {
+      result.verdict = Verdict::PUNT_LOCAL;
+    } else if (ipv4.ttl <= 1) {
+      result.verdict = Verdict::PUNT_TTL;
+    } else {
+      result = route(state, ipv4.srcAddr, ipv4.dstAddr);
+    }
+  } else if (etherType == ETHERTYPE_IPV6) {
+    IPv6Hdr ipv6(cursor);
+    if (ipv6.dstAddr.isMulticast()) {
+      result.verdict = Verdict::PUNT_CONTROL;
+    } else if (ipv6.dstAddr.isLinkLocal() ||
+               intfs->getInterfaceIf(RouterID(0), IPAddress(ipv6.dstAddr))) {
+      result.verdict = Verdict::PUNT_LOCAL;
+    } else if (ipv6.hopLimit <= 1) {
+      result.verdict = Verdict::PUNT_TTL;
+    } else {
+      result = route(state, ipv6.srcAddr, ipv6.dstAddr);
+    }
+  }
+  // Anything else to the router MAC is dropped, as it can't be routed
+  return result;
+}
+
+template<typename AddrT>
+SimDataplane::Result SimDataplane::route(const SwitchState& state,
+                                         const AddrT& src,
+                                         const AddrT& dst) const {
+  Result result;
+  auto routeTable = state.getRouteTables()->getRouteTableIf(RouterID(0));
+  auto route = routeTable ?
+    getRib(routeTable.get(), dst)->longestMatch(dst) : nullptr;
+  if (!route || !route->isResolved()) {
+    result.verdict = Verdict::DROP_NO_ROUTE;
+    return result;
+  }
+  if (route->isDrop()) {
+    result.verdict = Verdict::DROP_ROUTE;
+    return result;
+  }
+  if (route->isToCPU()) {
+    result.verdict = Verdict::PUNT_ROUTE;
+    return result;
+  }
+  const auto& nexthops = route->getForwardInfo().getNexthops();
+  if (nexthops.empty()) {
+    result.verdict = Verdict::DROP_NO_ROUTE;
+    return result;
+  }
+  // Spread the flows over the ECMP group by their addresses, as the ASIC's
+  // hash would
+  auto index = (src.hash() ^ dst.hash()) % nexthops.size();
+  const auto& nh = *nexthops.nth(index);
+  auto target = route->isConnected() ? dst : toAddr(nh.nexthop, dst);
+  return resolve(state, nh.intf, target);
+}
+
+template<typename AddrT>
+SimDataplane::Result SimDataplane::resolve(const SwitchState& state,
+                                           InterfaceID intfID,
+                                           const AddrT& host) const {
+  Result result;
+  result.verdict = Verdict::PUNT_NO_NEIGHBOR;
+  auto intf = state.getInterfaces()->getInterfaceIf(intfID);
+  auto vlan = intf ? state.getVlans()->getVlanIf(intf->getVlanID()) :
+    nullptr;
+  if (!vlan) {
+    return result;
+  }
+  auto entry = getNeighborTable(vlan.get(), host)->getEntryIf(host);
+  if (!entry || entry->isPending()) {
+    return result;
+  }
+  result.verdict = Verdict::ROUTED;
+  result.egressPort = entry->getPort();
+  result.dstMac = entry->getMac();
+  return result;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/ReadMostlyPtr.h"
+#include "fboss/agent/types.h"
+
+#include <folly/MacAddress.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+
+/*
+ * SimDataplane forwards the packets injected into a SimSwitch the way the
+ * ASIC would, from the last state applied: it bridges frames that are not
+ * to the router MAC, routes the rest by longest prefix match and the ARP
+ * and NDP tables, and picks what the ASIC would trap to the CPU.
+ *
+ * This lets load tests exercise the agent's side of the data plane: the
+ * punts of packets to unresolved hosts, of expiring TTLs and of the
+ * control protocols, rather than only the packets they craft themselves.
+ *
+ * Nothing is actually transmitted.  Routed and switched packets are only
+ * counted, and the caller hands the punted ones to the agent.
+ *
+ * forward() can be called from any number of threads at once.
+ */
+class SimDataplane {
+ public:
+  enum class Verdict : uint8_t {
+    // Routed to a resolved nexthop
+    ROUTED,
+    // Bridged in its VLAN, as it isn't to the router MAC
+    SWITCHED,
+    // ARP, NDP, LLDP, DHCP and the other protocols the ASIC traps
+    PUNT_CONTROL,
+    // To one of the switch's own addresses
+    PUNT_LOCAL,
+    // The TTL or hop limit expires here
+    PUNT_TTL,
+    // The host, or the nexthop of its route, is not resolved
+    PUNT_NO_NEIGHBOR,
+    // Routed to the CPU
+    PUNT_ROUTE,
+    DROP_NO_ROUTE,
+    // Routed to a drop route
+    DROP_ROUTE,
+    // Malformed, or on a VLAN the switch doesn't have
+    DROP_BAD,
+    NUM_VERDICTS,
+  };
+  static constexpr size_t kNumVerdicts =
+    static_cast<size_t>(Verdict::NUM_VERDICTS);
+
+  struct Result {
+    Verdict verdict{Verdict::DROP_BAD};
+    // Where a routed packet leaves, and the MAC it is rewritten to
+    PortID egressPort{0};
+    folly::MacAddress dstMac;
+  };
+
+  SimDataplane();
+
+  /*
+   * Forward from the new state from now on.
+   */
+  void stateChanged(std::shared_ptr<SwitchState> state);
+
+  /*
+   * Forward a frame received on the given VLAN, and count its verdict.  The
+   * VLAN of a tagged frame is that of its tag.
+   */
+  Result forward(const folly::IOBuf* frame, VlanID vlan);
+
+  static bool isPunt(Verdict verdict) {
+    return verdict >= Verdict::PUNT_CONTROL &&
+      verdict <= Verdict::PUNT_ROUTE;
+  }
+  static const char* getVerdictName(Verdict verdict);
+
+  // The number of packets given each verdict
+  uint64_t getCount(Verdict verdict) const {
+    return counts_[static_cast<size_t>(verdict)].load(
+        std::memory_order_relaxed);
+  }
+  void resetCounts();
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  SimDataplane(SimDataplane const &) = delete;
+  SimDataplane& operator=(SimDataplane const &) = delete;
+
+  Result forward(const SwitchState& state, const folly::IOBuf* frame,
+                 VlanID vlan) const;
+  template<typename AddrT>
+  Result route(const SwitchState& state, const AddrT& src,
+               const AddrT& dst) const;
+  template<typename AddrT>
+  Result resolve(const SwitchState& state, InterfaceID intf,
+                 const AddrT& host) const;
+
+  ReadMostlyPtr<SwitchState> state_;
+  std::array<std::atomic<uint64_t>, kNumVerdicts> counts_;
+};
+
+}} // facebook::fboss
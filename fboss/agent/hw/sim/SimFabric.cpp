@@ -0,0 +1,399 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/sim/SimFabric.h"
+
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+#include "fboss/agent/hw/sim/SimPlatform.h"
+#include "fboss/agent/hw/sim/SimSwitch.h"
+#include "fboss/agent/packet/Ethertype.h"
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/packet/IPv4Hdr.h"
+#include "fboss/agent/packet/IPv6Hdr.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/gen-cpp/switch_config_types.h"
+
+#include <folly/Memory.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+
+using folly::IOBuf;
+using folly::IPAddress;
+using folly::MacAddress;
+using folly::make_unique;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::unique_ptr;
+
+namespace facebook { namespace fboss {
+
+namespace {
+
+// Enough for any path through a fabric, short of a loop
+const uint8_t kProbeTtl = 64;
+const MacAddress kProbeMac("02:00:00:00:00:fe");
+const size_t kUntaggedEthLength = 2 * MacAddress::SIZE + 2;
+
+bool operator==(const SimFabric::Endpoint& a, const SimFabric::Endpoint& b) {
+  return a.sw == b.sw && a.port == b.port;
+}
+
+// The VLAN of a tagged frame, or 0 if it is untagged
+VlanID getFrameVlan(const IOBuf* frame) {
+  folly::io::Cursor cursor(frame);
+  cursor.skip(2 * MacAddress::SIZE);
+  if (cursor.readBE<uint16_t>() != ETHERTYPE_VLAN) {
+    return VlanID(0);
+  }
+  return VlanID(cursor.readBE<uint16_t>() & 0x0fff);
+}
+
+// The MAC the interfaces on a VLAN route the frames to
+MacAddress getRouterMac(const SwitchState& state, VlanID vlan,
+                        MacAddress platformMac) {
+  for (const auto& intf : *state.getInterfaces()) {
+    if (intf->getVlanID() == vlan) {
+      return intf->getMac();
+    }
+  }
+  return platformMac;
+}
+
+// An untagged UDP frame, from port 1000 to port 2000
+unique_ptr<IOBuf> makeUdpFrame(MacAddress dstMac, const IPAddress& src,
+                               const IPAddress& dst, uint8_t ttl) {
+  const uint16_t udpLength = 8;
+  size_t ipLength = src.isV4() ? IPv4Hdr::minSize() : IPv6Hdr::SIZE;
+  size_t length = kUntaggedEthLength + ipLength + udpLength;
+  auto buf = IOBuf::create(length);
+  buf->append(length);
+  folly::io::RWPrivateCursor cursor(buf.get());
+  cursor.push(dstMac.bytes(), MacAddress::SIZE);
+  cursor.push(kProbeMac.bytes(), MacAddress::SIZE);
+  if (src.isV4()) {
+    cursor.writeBE<uint16_t>(ETHERTYPE_IPV4);
+    IPv4Hdr ipv4(src.asV4(), dst.asV4(), IP_PROTO_UDP, udpLength);
+    ipv4.ttl = ttl;
+    ipv4.computeChecksum();
+    ipv4.write(&cursor);
+  } else {
+    cursor.writeBE<uint16_t>(ETHERTYPE_IPV6);
+    IPv6Hdr ipv6(src.asV6(), dst.asV6());
+    ipv6.payloadLength = udpLength;
+    ipv6.nextHeader = IP_PROTO_UDP;
+    ipv6.hopLimit = ttl;
+    ipv6.serialize(&cursor);
+  }
+  cursor.writeBE<uint16_t>(1000);
+  cursor.writeBE<uint16_t>(2000);
+  cursor.writeBE<uint16_t>(udpLength);
+  cursor.writeBE<uint16_t>(0);
+  return buf;
+}
+
+} // unnamed namespace
+
+SimFabric::SimFabric() {
+  thread_ = std::thread([this] {
+    eventBase_.loopForever();
+  });
+}
+
+SimFabric::~SimFabric() {
+  stopping_.store(true);
+  eventBase_.terminateLoopSoon();
+  thread_.join();
+  // The agents may still send while they stop, which transmit() ignores
+  switches_.clear();
+}
+
+SimFabric::SwitchIdx SimFabric::addSwitch(MacAddress mac, uint32_t numPorts) {
+  auto idx = switches_.size();
+  auto sw = make_unique<SwSwitch>(make_unique<SimPlatform>(mac, numPorts));
+  static_cast<SimSwitch*>(sw->getHw())->setTxHandler(
+      [this, idx](unique_ptr<TxPacket> pkt, folly::Optional<PortID> port) {
+        transmit(idx, std::move(pkt), port);
+      });
+  sw->init();
+  switches_.push_back(std::move(sw));
+  configured_.push_back(false);
+  return idx;
+}
+
+void SimFabric::configure(SwitchIdx sw, const cfg::SwitchConfig& config) {
+  auto* agent = getSwitch(sw);
+  agent->updateStateBlocking("apply config",
+                             [&](const shared_ptr<SwitchState>& state) {
+    return applyThriftConfig(state, &config, agent->getPlatform());
+  });
+  if (!configured_[sw]) {
+    configured_[sw] = true;
+    agent->initialConfigApplied();
+    agent->fibSynced();
+  }
+}
+
+SwSwitch* SimFabric::getSwitch(SwitchIdx sw) const {
+  CHECK_LT(sw, switches_.size());
+  return switches_[sw].get();
+}
+
+SimSwitch* SimFabric::getSimSwitch(SwitchIdx sw) const {
+  return static_cast<SimSwitch*>(getSwitch(sw)->getHw());
+}
+
+void SimFabric::connect(Endpoint a, Endpoint b, milliseconds delay) {
+  {
+    lock_guard<mutex> g(linksLock_);
+    CHECK(!getLink(a)) << "port " << a.port << " of switch " << a.sw
+                       << " is already linked";
+    CHECK(!getLink(b)) << "port " << b.port << " of switch " << b.sw
+                       << " is already linked";
+    links_.emplace_back(a, b, delay);
+  }
+  getSimSwitch(a.sw)->linkStateChanged(a.port, true);
+  getSimSwitch(b.sw)->linkStateChanged(b.port, true);
+}
+
+void SimFabric::setLinkUp(Endpoint end, bool up) {
+  Endpoint a = end;
+  Endpoint b = end;
+  {
+    lock_guard<mutex> g(linksLock_);
+    auto* link = getLink(end);
+    CHECK(link) << "port " << end.port << " of switch " << end.sw
+                << " is not linked";
+    if (link->up == up) {
+      return;
+    }
+    link->up = up;
+    a = link->a;
+    b = link->b;
+  }
+  getSimSwitch(a.sw)->linkStateChanged(a.port, up);
+  getSimSwitch(b.sw)->linkStateChanged(b.port, up);
+}
+
+void SimFabric::setLinkBlackholed(Endpoint end, bool blackholed) {
+  lock_guard<mutex> g(linksLock_);
+  auto* link = getLink(end);
+  CHECK(link) << "port " << end.port << " of switch " << end.sw
+              << " is not linked";
+  link->blackholed = blackholed;
+}
+
+std::vector<SimFabric::Hop> SimFabric::trace(Endpoint from,
+                                             const IPAddress& src,
+                                             const IPAddress& dst,
+                                             bool punt) {
+  std::vector<Hop> hops;
+  Endpoint at = from;
+  for (uint8_t ttl = kProbeTtl; ttl > 0; --ttl) {
+    auto* agent = getSwitch(at.sw);
+    auto vlan = getPortVlan(at);
+    auto dstMac = getRouterMac(*agent->getState(), vlan,
+                               agent->getPlatform()->getLocalMac());
+    auto frame = makeUdpFrame(dstMac, src, dst, ttl);
+
+    Hop hop{at.sw, at.port, SimDataplane::Result()};
+    auto* sim = getSimSwitch(at.sw);
+    hop.result = sim->getDataplane()->forward(frame.get(), vlan);
+    hops.push_back(hop);
+    if (hop.result.verdict != SimDataplane::Verdict::ROUTED) {
+      if (punt && SimDataplane::isPunt(hop.result.verdict)) {
+        auto pkt = make_unique<MockRxPacket>(std::move(frame));
+        pkt->setSrcPort(at.port);
+        pkt->setSrcVlan(vlan);
+        sim->injectPacket(std::move(pkt));
+      }
+      break;
+    }
+    milliseconds delay;
+    if (!getPeer(Endpoint(at.sw, hop.result.egressPort), &at, &delay)) {
+      break;
+    }
+  }
+  return hops;
+}
+
+folly::Optional<microseconds> SimFabric::waitFor(
+    const std::function<bool()>& converged, milliseconds timeout,
+    milliseconds interval) {
+  auto start = steady_clock::now();
+  while (true) {
+    if (converged()) {
+      return duration_cast<microseconds>(steady_clock::now() - start);
+    }
+    if (steady_clock::now() - start > timeout) {
+      return folly::none;
+    }
+    std::this_thread::sleep_for(interval);
+  }
+}
+
+folly::Optional<microseconds> SimFabric::waitForQuiet(milliseconds quiet,
+                                                      milliseconds timeout) {
+  auto start = steady_clock::now();
+  auto lastChange = start;
+  auto generations = getGenerations();
+  auto carried = getDelivered() + getDropped();
+  while (true) {
+    std::this_thread::sleep_for(milliseconds(1));
+    auto now = steady_clock::now();
+    auto newGenerations = getGenerations();
+    auto newCarried = getDelivered() + getDropped();
+    if (newGenerations != generations || newCarried != carried) {
+      generations = newGenerations;
+      carried = newCarried;
+      lastChange = now;
+    } else if (now - lastChange >= quiet) {
+      return duration_cast<microseconds>(lastChange - start);
+    }
+    if (now - start > timeout) {
+      return folly::none;
+    }
+  }
+}
+
+const SimFabric::Link* SimFabric::getLink(Endpoint end) const {
+  for (const auto& link : links_) {
+    if (link.a == end || link.b == end) {
+      return &link;
+    }
+  }
+  return nullptr;
+}
+
+SimFabric::Link* SimFabric::getLink(Endpoint end) {
+  return const_cast<Link*>(
+      static_cast<const SimFabric*>(this)->getLink(end));
+}
+
+bool SimFabric::getPeer(Endpoint end, Endpoint* peer,
+                        milliseconds* delay) const {
+  lock_guard<mutex> g(linksLock_);
+  auto* link = getLink(end);
+  if (!link || !link->up || link->blackholed) {
+    return false;
+  }
+  *peer = link->a == end ? link->b : link->a;
+  *delay = link->delay;
+  return true;
+}
+
+void SimFabric::transmit(SwitchIdx sw, unique_ptr<TxPacket> pkt,
+                         folly::Optional<PortID> port) {
+  if (stopping_.load()) {
+    return;
+  }
+  shared_ptr<IOBuf> frame(pkt->buf()->clone());
+  if (port) {
+    send(Endpoint(sw, *port), frame);
+    return;
+  }
+
+  // Flood a switched packet out of the linked ports of its VLAN
+  std::vector<Endpoint> ends;
+  {
+    lock_guard<mutex> g(linksLock_);
+    for (const auto& link : links_) {
+      if (link.a.sw == sw) {
+        ends.push_back(link.a);
+      }
+      if (link.b.sw == sw) {
+        ends.push_back(link.b);
+      }
+    }
+  }
+  auto vlan = getFrameVlan(frame.get());
+  for (auto end : ends) {
+    if (vlan == VlanID(0) || getPortVlan(end) == vlan) {
+      send(end, frame);
+    }
+  }
+}
+
+void SimFabric::send(Endpoint from, shared_ptr<IOBuf> frame) {
+  Endpoint peer = from;
+  milliseconds delay;
+  if (!getPeer(from, &peer, &delay)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  eventBase_.runInEventBaseThread([=] {
+    if (delay.count() == 0) {
+      deliver(peer, frame);
+      return;
+    }
+    eventBase_.tryRunAfterDelay([=] { deliver(peer, frame); },
+                                delay.count());
+  });
+}
+
+void SimFabric::deliver(Endpoint to, shared_ptr<IOBuf> frame) {
+  if (stopping_.load()) {
+    return;
+  }
+  // The link may have gone down while the packet crossed it
+  Endpoint from = to;
+  milliseconds delay;
+  if (!getPeer(to, &from, &delay)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Each port is untagged in its VLAN, so the frame arrives tagged with the
+  // VLAN of this end
+  auto vlan = getPortVlan(to);
+  auto buf = frame->clone();
+  buf->unshare();
+  buf->coalesce();
+  if (getFrameVlan(buf.get()) != VlanID(0)) {
+    folly::io::Cursor reader(buf.get());
+    reader.skip(kUntaggedEthLength);
+    uint16_t tci = reader.readBE<uint16_t>();
+    folly::io::RWPrivateCursor cursor(buf.get());
+    cursor.skip(kUntaggedEthLength);
+    cursor.writeBE<uint16_t>((tci & 0xf000) | (vlan & 0x0fff));
+  }
+
+  auto pkt = make_unique<MockRxPacket>(std::move(buf));
+  pkt->setSrcPort(to.port);
+  pkt->setSrcVlan(vlan);
+  delivered_.fetch_add(1, std::memory_order_relaxed);
+  getSimSwitch(to.sw)->forwardPacket(std::move(pkt));
+}
+
+VlanID SimFabric::getPortVlan(Endpoint end) const {
+  auto port = getSwitch(end.sw)->getState()->getPorts()->getPortIf(end.port);
+  return port ? port->getIngressVlan() : VlanID(0);
+}
+
+uint64_t SimFabric::getGenerations() const {
+  uint64_t total = 0;
+  for (const auto& sw : switches_) {
+    total += sw->getState()->getGeneration();
+  }
+  return total;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,204 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/hw/sim/SimDataplane.h"
+#include "fboss/agent/types.h"
+
+#include <folly/IPAddress.h>
+#include <folly/MacAddress.h>
+#include <folly/Optional.h>
+#include <folly/io/async/EventBase.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook { namespace fboss {
+
+namespace cfg {
+class SwitchConfig;
+}
+class SimSwitch;
+class SwSwitch;
+class TxPacket;
+
+/*
+ * SimFabric runs several agents on SimPlatforms in one process, and wires
+ * their ports together with virtual links, so that how the fabric as a
+ * whole converges after a failure can be measured end to end.
+ *
+ * The packets an agent sends out of a port are received on the port at
+ * the other end of its link, after the link's delay, and go through that
+ * switch's SimDataplane like any packet from the wire: the ARP, NDP and
+ * other control packets are punted to its agent.  Packets sent switched
+ * are flooded out of the linked ports of their VLAN, as the ASIC would for
+ * an unknown destination.  Each port is untagged in the VLAN it is
+ * configured with, so the two ends of a link may use different VLANs.
+ *
+ * The dataplanes only forward the packets that trace() follows, one hop at
+ * a time, to see where traffic would go; the data traffic isn't carried.
+ *
+ * Links can be brought down, which the agents at both ends are told of,
+ * or blackholed, which silently drops everything on them as when the
+ * neighbor's control plane dies.  Packets cross the links on a thread of
+ * the fabric's own.
+ */
+class SimFabric {
+ public:
+  typedef size_t SwitchIdx;
+
+  struct Endpoint {
+    Endpoint(SwitchIdx sw, PortID port) : sw(sw), port(port) {}
+    SwitchIdx sw;
+    PortID port;
+  };
+
+  // One hop of a packet followed through the fabric
+  struct Hop {
+    SwitchIdx sw;
+    PortID inPort;
+    SimDataplane::Result result;
+  };
+
+  SimFabric();
+  ~SimFabric();
+
+  /*
+   * Start an agent on a SimPlatform with the given MAC and number of ports,
+   * and return its index.  It has no config until configure() is called.
+   * All of the switches must be added before any are linked.
+   */
+  SwitchIdx addSwitch(folly::MacAddress mac, uint32_t numPorts);
+
+  /*
+   * Apply a config to a switch.  The first config also tells the agent
+   * that its initial config was applied and its FIB synced.
+   */
+  void configure(SwitchIdx sw, const cfg::SwitchConfig& config);
+
+  SwSwitch* getSwitch(SwitchIdx sw) const;
+  SimSwitch* getSimSwitch(SwitchIdx sw) const;
+  size_t numSwitches() const {
+    return switches_.size();
+  }
+
+  /*
+   * Link two ports, which must not be linked already, and tell both agents
+   * that the link is up.  Packets take delay to cross the link.
+   */
+  void connect(Endpoint a, Endpoint b,
+               std::chrono::milliseconds delay = std::chrono::milliseconds(0));
+
+  /*
+   * Bring the link of a port down or back up.  Both agents are told, and
+   * nothing crosses the link while it is down.
+   */
+  void setLinkUp(Endpoint end, bool up);
+
+  /*
+   * Drop everything that crosses the link of a port, while it stays up.
+   */
+  void setLinkBlackholed(Endpoint end, bool blackholed);
+
+  /*
+   * Follow a UDP packet from src to dst, received on the given port, from
+   * switch to switch through the dataplanes and the links, and return each
+   * hop.  The last hop is where the packet stopped: where it was punted or
+   * dropped, or, if it was routed, where it was sent out of a port without
+   * a working link.
+   *
+   * With punt set, a packet punted on its last hop is handed to that agent,
+   * as real traffic would be, so that it resolves the neighbors the packet
+   * needed.
+   */
+  std::vector<Hop> trace(Endpoint from, const folly::IPAddress& src,
+                         const folly::IPAddress& dst, bool punt = false);
+
+  /*
+   * Check converged() every interval until it returns true, and return how
+   * long that took, or folly::none after timeout.
+   */
+  folly::Optional<std::chrono::microseconds> waitFor(
+      const std::function<bool()>& converged,
+      std::chrono::milliseconds timeout,
+      std::chrono::milliseconds interval = std::chrono::milliseconds(10));
+
+  /*
+   * Wait until neither the state of any agent has changed, nor any packet
+   * crossed a link, for quiet, and return how long it took until the last
+   * change, or folly::none after timeout.
+   */
+  folly::Optional<std::chrono::microseconds> waitForQuiet(
+      std::chrono::milliseconds quiet, std::chrono::milliseconds timeout);
+
+  /*
+   * The number of packets delivered across links, and of those dropped
+   * because their link was down or blackholed.
+   */
+  uint64_t getDelivered() const {
+    return delivered_.load(std::memory_order_relaxed);
+  }
+  uint64_t getDropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Link {
+    Link(Endpoint a, Endpoint b, std::chrono::milliseconds delay)
+      : a(a), b(b), delay(delay) {}
+
+    Endpoint a;
+    Endpoint b;
+    std::chrono::milliseconds delay;
+    bool up{true};
+    bool blackholed{false};
+  };
+
+  // Forbidden copy constructor and assignment operator
+  SimFabric(SimFabric const &) = delete;
+  SimFabric& operator=(SimFabric const &) = delete;
+
+  // Where a port's link leads, if it is working, and its delay
+  bool getPeer(Endpoint end, Endpoint* peer,
+               std::chrono::milliseconds* delay) const;
+  // The link of a port, which linksLock_ must be held to look up
+  const Link* getLink(Endpoint end) const;
+  Link* getLink(Endpoint end);
+  void transmit(SwitchIdx sw, std::unique_ptr<TxPacket> pkt,
+                folly::Optional<PortID> port);
+  void send(Endpoint from, std::shared_ptr<folly::IOBuf> frame);
+  void deliver(Endpoint to, std::shared_ptr<folly::IOBuf> frame);
+  VlanID getPortVlan(Endpoint end) const;
+  uint64_t getGenerations() const;
+
+  std::vector<std::unique_ptr<SwSwitch>> switches_;
+  std::vector<bool> configured_;
+
+  // Protects the links, which change while the agents send
+  mutable std::mutex linksLock_;
+  std::vector<Link> links_;
+
+  std::atomic<bool> stopping_{false};
+  std::atomic<uint64_t> delivered_{0};
+  std::atomic<uint64_t> dropped_{0};
+  folly::EventBase eventBase_;
+  std::thread thread_;
+};
+
+}} // facebook::fboss
@@ -13,10 +13,15 @@
 #include "fboss/agent/hw/mock/MockRxPacket.h"
 #include "fboss/agent/hw/sim/SimSwitch.h"
 
+#include <chrono>
+#include <thread>
+
 using folly::ByteRange;
 using folly::IOBuf;
 using folly::make_unique;
 using folly::StringPiece;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
 using std::unique_ptr;
 
 namespace facebook { namespace fboss {
@@ -25,4 +30,36 @@ SimHandler::SimHandler(SwSwitch* sw, SimSwitch* hw)
   : ThriftHandler(sw),
     hw_(hw) {
 }
+
+void SimHandler::sendTraffic(
+    unique_ptr<std::vector<TrafficStream>> streams) {
+  for (const auto& stream : *streams) {
+    auto start = steady_clock::now();
+    for (int64_t n = 0; n < stream.count; ++n) {
+      if (stream.ratePps > 0) {
+        std::this_thread::sleep_until(start + nanoseconds(
+            static_cast<int64_t>(n * 1e9 / stream.ratePps)));
+      }
+      auto pkt = make_unique<MockRxPacket>(
+          IOBuf::copyBuffer(stream.frame.data(), stream.frame.size()));
+      pkt->setSrcPort(PortID(stream.port));
+      pkt->setSrcVlan(VlanID(stream.vlan));
+      hw_->forwardPacket(std::move(pkt));
+    }
+  }
+}
+
+void SimHandler::getDataplaneCounters(
+    std::map<std::string, int64_t>& counters) {
+  auto* dataplane = hw_->getDataplane();
+  for (size_t i = 0; i < SimDataplane::kNumVerdicts; ++i) {
+    auto verdict = static_cast<SimDataplane::Verdict>(i);
+    counters[SimDataplane::getVerdictName(verdict)] =
+      dataplane->getCount(verdict);
+  }
+}
+
+void SimHandler::clearDataplaneCounters() {
+  hw_->getDataplane()->resetCounts();
+}
 }} // facebook::fboss
@@ -22,6 +22,12 @@ class SimHandler : virtual public SimCtrlSvIf,
  public:
   SimHandler(SwSwitch* sw, SimSwitch* hw);
 
+  void sendTraffic(
+      std::unique_ptr<std::vector<TrafficStream>> streams) override;
+  void getDataplaneCounters(std::map<std::string, int64_t>& counters)
+    override;
+  void clearDataplaneCounters() override;
+
  private:
   // Forbidden copy constructor and assignment operator
   SimHandler(SimHandler const &) = delete;
@@ -0,0 +1,211 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/sim/SimLatencyModel.h"
+
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/NodeMapDelta.h"
+#include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteDelta.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMapDelta.h"
+
+#include <gflags/gflags.h>
+#include <thread>
+
+DEFINE_int32(sim_sdk_state_change_us, 0,
+             "The fixed cost, in microseconds, of every state change applied "
+             "by the simulated hardware");
+DEFINE_int32(sim_sdk_port_us, 0,
+             "The simulated SDK cost, in microseconds, of updating a port");
+DEFINE_int32(sim_sdk_vlan_us, 0,
+             "The simulated SDK cost, in microseconds, of creating, updating "
+             "or destroying a VLAN");
+DEFINE_int32(sim_sdk_intf_us, 0,
+             "The simulated SDK cost, in microseconds, of programming an L3 "
+             "interface");
+DEFINE_int32(sim_sdk_host_add_us, 0,
+             "The simulated SDK cost, in microseconds, of adding or updating "
+             "a host entry");
+DEFINE_int32(sim_sdk_host_delete_us, 0,
+             "The simulated SDK cost, in microseconds, of deleting a host "
+             "entry");
+DEFINE_int32(sim_sdk_route_add_us, 0,
+             "The simulated SDK cost, in microseconds, of adding or updating "
+             "a route");
+DEFINE_int32(sim_sdk_route_delete_us, 0,
+             "The simulated SDK cost, in microseconds, of deleting a route");
+DEFINE_int32(sim_sdk_ecmp_create_us, 0,
+             "The simulated SDK cost, in microseconds, of creating an ECMP "
+             "group");
+DEFINE_int32(sim_sdk_ecmp_destroy_us, 0,
+             "The simulated SDK cost, in microseconds, of destroying an ECMP "
+             "group");
+DEFINE_bool(sim_sdk_busy_wait, false,
+            "Spin rather than sleep for the simulated SDK costs, to model an "
+            "SDK that keeps the CPU busy");
+
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+namespace facebook { namespace fboss {
+
+SimLatencyModel::Costs SimLatencyModel::costsFromFlags() {
+  Costs costs;
+  costs.stateChange = microseconds(FLAGS_sim_sdk_state_change_us);
+  costs.port = microseconds(FLAGS_sim_sdk_port_us);
+  costs.vlan = microseconds(FLAGS_sim_sdk_vlan_us);
+  costs.intf = microseconds(FLAGS_sim_sdk_intf_us);
+  costs.hostAdd = microseconds(FLAGS_sim_sdk_host_add_us);
+  costs.hostDelete = microseconds(FLAGS_sim_sdk_host_delete_us);
+  costs.routeAdd = microseconds(FLAGS_sim_sdk_route_add_us);
+  costs.routeDelete = microseconds(FLAGS_sim_sdk_route_delete_us);
+  costs.ecmpCreate = microseconds(FLAGS_sim_sdk_ecmp_create_us);
+  costs.ecmpDestroy = microseconds(FLAGS_sim_sdk_ecmp_destroy_us);
+  return costs;
+}
+
+SimLatencyModel::SimLatencyModel()
+  : SimLatencyModel(costsFromFlags()) {
+}
+
+SimLatencyModel::SimLatencyModel(const Costs& costs) {
+  setCosts(costs);
+}
+
+void SimLatencyModel::setCosts(const Costs& costs) {
+  costs_ = costs;
+  enabled_ = costs.stateChange.count() || costs.port.count() ||
+    costs.vlan.count() || costs.intf.count() || costs.hostAdd.count() ||
+    costs.hostDelete.count() || costs.routeAdd.count() ||
+    costs.routeDelete.count() || costs.ecmpCreate.count() ||
+    costs.ecmpDestroy.count();
+}
+
+namespace {
+
+template<typename NeighborDelta>
+void countHosts(const NeighborDelta& delta,
+                SimLatencyModel::Operations* ops) {
+  for (const auto& entry : delta) {
+    if (entry.getNew()) {
+      ++ops->hostAdds;
+    } else {
+      ++ops->hostDeletes;
+    }
+  }
+}
+
+} // unnamed namespace
+
+SimLatencyModel::Operations SimLatencyModel::count(const StateDelta& delta) {
+  Operations ops;
+  for (const auto& portDelta : delta.getPortsDelta()) {
+    (void)portDelta;
+    ++ops.ports;
+  }
+  for (const auto& vlanDelta : delta.getVlansDelta()) {
+    const auto& oldVlan = vlanDelta.getOld();
+    const auto& newVlan = vlanDelta.getNew();
+    if (!oldVlan || !newVlan || oldVlan->getPorts() != newVlan->getPorts()) {
+      ++ops.vlans;
+    }
+    countHosts(vlanDelta.getArpDelta(), &ops);
+    countHosts(vlanDelta.getNdpDelta(), &ops);
+  }
+  for (const auto& intfDelta : delta.getIntfsDelta()) {
+    (void)intfDelta;
+    ++ops.intfs;
+  }
+  for (const auto& rtDelta : delta.getRouteTablesDelta()) {
+    countRoutes(rtDelta.getRoutesV4Delta(), &ops);
+    countRoutes(rtDelta.getRoutesV6Delta(), &ops);
+  }
+  return ops;
+}
+
+template<typename RoutesDelta>
+void SimLatencyModel::countRoutes(const RoutesDelta& delta,
+                                  Operations* ops) {
+  for (const auto& entry : delta) {
+    const auto& oldRoute = entry.getOld();
+    const auto& newRoute = entry.getNew();
+    bool oldProgrammed = oldRoute && oldRoute->isResolved();
+    bool newProgrammed = newRoute && newRoute->isResolved();
+    if (newProgrammed) {
+      ++ops->routeAdds;
+      refEcmp(newRoute->getForwardInfo().getNexthops(), ops);
+    } else if (oldProgrammed) {
+      ++ops->routeDeletes;
+    }
+    // The old group is released after the route moves off of it
+    if (oldProgrammed) {
+      unrefEcmp(oldRoute->getForwardInfo().getNexthops(), ops);
+    }
+  }
+}
+
+void SimLatencyModel::refEcmp(const RouteForwardNexthops& nexthops,
+                              Operations* ops) {
+  if (nexthops.size() < 2) {
+    return;
+  }
+  if (++ecmpGroups_[nexthops] == 1) {
+    ++ops->ecmpCreates;
+  }
+}
+
+void SimLatencyModel::unrefEcmp(const RouteForwardNexthops& nexthops,
+                                Operations* ops) {
+  auto it = ecmpGroups_.find(nexthops);
+  if (it == ecmpGroups_.end()) {
+    return;
+  }
+  if (--it->second == 0) {
+    ecmpGroups_.erase(it);
+    ++ops->ecmpDestroys;
+  }
+}
+
+microseconds SimLatencyModel::cost(const Operations& ops) const {
+  return costs_.stateChange +
+    ops.ports * costs_.port +
+    ops.vlans * costs_.vlan +
+    ops.intfs * costs_.intf +
+    ops.hostAdds * costs_.hostAdd +
+    ops.hostDeletes * costs_.hostDelete +
+    ops.routeAdds * costs_.routeAdd +
+    ops.routeDeletes * costs_.routeDelete +
+    ops.ecmpCreates * costs_.ecmpCreate +
+    ops.ecmpDestroys * costs_.ecmpDestroy;
+}
+
+microseconds SimLatencyModel::apply(const StateDelta& delta) {
+  if (!enabled_) {
+    return microseconds(0);
+  }
+  auto total = cost(count(delta));
+  if (FLAGS_sim_sdk_busy_wait) {
+    auto end = steady_clock::now() + total;
+    while (steady_clock::now() < end) {
+      // Spin
+    }
+  } else {
+    std::this_thread::sleep_for(total);
+  }
+  return total;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/state/RouteForwardInfo.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+
+namespace facebook { namespace fboss {
+
+class StateDelta;
+
+/*
+ * SimLatencyModel makes SimSwitch and MockHwSwitch take as long to apply a
+ * state change as the SDK of a real switch would, so that benchmarks of
+ * update batching and pipelining see realistic hardware costs.
+ *
+ * A change costs a fixed amount per call, plus an amount for each hardware
+ * object it creates, updates or removes, counted the way BcmSwitch programs
+ * them.  Routes that are not resolved are not programmed.  ECMP groups are
+ * reference counted by their set of nexthops across changes, so only the
+ * first route to use a set pays for creating its group.
+ *
+ * All costs default to zero, in which case nothing is counted.
+ */
+class SimLatencyModel {
+ public:
+  struct Costs {
+    std::chrono::microseconds stateChange{0};
+    std::chrono::microseconds port{0};
+    std::chrono::microseconds vlan{0};
+    std::chrono::microseconds intf{0};
+    std::chrono::microseconds hostAdd{0};
+    std::chrono::microseconds hostDelete{0};
+    std::chrono::microseconds routeAdd{0};
+    std::chrono::microseconds routeDelete{0};
+    std::chrono::microseconds ecmpCreate{0};
+    std::chrono::microseconds ecmpDestroy{0};
+  };
+
+  // The hardware operations needed to apply a change.  Updating an object
+  // counts as adding it.
+  struct Operations {
+    uint64_t ports{0};
+    uint64_t vlans{0};
+    uint64_t intfs{0};
+    uint64_t hostAdds{0};
+    uint64_t hostDeletes{0};
+    uint64_t routeAdds{0};
+    uint64_t routeDeletes{0};
+    uint64_t ecmpCreates{0};
+    uint64_t ecmpDestroys{0};
+  };
+
+  /*
+   * The costs given by the --sim_sdk_*_us flags.
+   */
+  static Costs costsFromFlags();
+
+  SimLatencyModel();
+  explicit SimLatencyModel(const Costs& costs);
+
+  const Costs& getCosts() const {
+    return costs_;
+  }
+  void setCosts(const Costs& costs);
+
+  bool enabled() const {
+    return enabled_;
+  }
+
+  /*
+   * Count the operations needed to apply the delta.  This must be called
+   * for every change, in order, since it tracks the ECMP groups in use.
+   */
+  Operations count(const StateDelta& delta);
+
+  std::chrono::microseconds cost(const Operations& ops) const;
+
+  /*
+   * Spend as long as the SDK would take to apply the delta, either sleeping
+   * or spinning, as --sim_sdk_busy_wait says.  Returns the time charged.
+   */
+  std::chrono::microseconds apply(const StateDelta& delta);
+
+ private:
+  template<typename RoutesDelta>
+  void countRoutes(const RoutesDelta& delta, Operations* ops);
+  void refEcmp(const RouteForwardNexthops& nexthops, Operations* ops);
+  void unrefEcmp(const RouteForwardNexthops& nexthops, Operations* ops);
+
+  Costs costs_;
+  bool enabled_{false};
+  // The number of routes using each ECMP group
+  std::map<RouteForwardNexthops, uint32_t> ecmpGroups_;
+};
+
+}} // facebook::fboss
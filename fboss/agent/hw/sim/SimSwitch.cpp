@@ -9,6 +9,7 @@
  */
 #include "fboss/agent/hw/sim/SimSwitch.h"
 
+#include "fboss/agent/state/StateDelta.h"
 #include "fboss/agent/state/SwitchState.h"
 #include "fboss/agent/hw/mock/MockRxPacket.h"
 #include "fboss/agent/hw/mock/MockTxPacket.h"
@@ -41,7 +42,9 @@ SimSwitch::init(HwSwitch::Callback* callback) {
 }
 
 void SimSwitch::stateChanged(const StateDelta& delta) {
-  // TODO
+  // Nothing is programmed, but it takes as long as the SDK would
+  latencyModel_.apply(delta);
+  dataplane_.stateChanged(delta.newState());
 }
 
 std::unique_ptr<TxPacket> SimSwitch::allocatePacket(uint32_t size) {
@@ -49,20 +52,47 @@ std::unique_ptr<TxPacket> SimSwitch::allocatePacket(uint32_t size) {
 }
 
 bool SimSwitch::sendPacketSwitched(std::unique_ptr<TxPacket> pkt) noexcept {
-  // TODO
   ++txCount_;
+  if (txHandler_) {
+    txHandler_(std::move(pkt), folly::none);
+  }
   return true;
 }
 
+size_t SimSwitch::sendPacketsSwitched(
+    std::vector<std::unique_ptr<TxPacket>> pkts) noexcept {
+  txCount_ += pkts.size();
+  if (txHandler_) {
+    for (auto& pkt : pkts) {
+      txHandler_(std::move(pkt), folly::none);
+    }
+  }
+  return pkts.size();
+}
+
 bool SimSwitch::sendPacketOutOfPort(
     std::unique_ptr<TxPacket> pkt,
     PortID portID) noexcept {
-  // TODO
   ++txCount_;
+  if (txHandler_) {
+    txHandler_(std::move(pkt), portID);
+  }
   return true;
 }
+
+void SimSwitch::linkStateChanged(PortID port, bool up) {
+  callback_->linkStateChanged(port, up);
+}
 void SimSwitch::injectPacket(std::unique_ptr<RxPacket> pkt) {
   callback_->packetReceived(std::move(pkt));
 }
 
+SimDataplane::Result SimSwitch::forwardPacket(std::unique_ptr<RxPacket> pkt) {
+  auto result = dataplane_.forward(pkt->buf(), pkt->getSrcVlan());
+  if (SimDataplane::isPunt(result.verdict)) {
+    callback_->packetReceived(std::move(pkt));
+  }
+  return result;
+}
+
 }} // facebook::fboss
@@ -10,6 +10,11 @@
 #pragma once
 
 #include "fboss/agent/HwSwitch.h"
+#include "fboss/agent/hw/sim/SimDataplane.h"
+#include "fboss/agent/hw/sim/SimLatencyModel.h"
+
+#include <folly/Optional.h>
+#include <functional>
 
 namespace facebook { namespace fboss {
 
@@ -27,12 +32,38 @@ class SimSwitch : public HwSwitch {
   bool sendPacketOutOfPort(
       std::unique_ptr<TxPacket> pkt,
       PortID portID) noexcept override;
+  size_t sendPacketsSwitched(
+      std::vector<std::unique_ptr<TxPacket>> pkts) noexcept override;
 
   void gracefulExit() override {}
   void clearWarmBootCache() override {}
   void injectPacket(std::unique_ptr<RxPacket> pkt);
+  /*
+   * Forward a packet received on a port through the software dataplane, and
+   * hand it to the agent, like injectPacket() does, if the dataplane punts
+   * it.
+   */
+  SimDataplane::Result forwardPacket(std::unique_ptr<RxPacket> pkt);
   void initialConfigApplied() override {}
 
+  /*
+   * Called with each packet the agent sends, along with the port it is sent
+   * out of, or with no port for a packet sent switched.  Without a handler
+   * the packets are only counted.  The handler is called from the agent's
+   * threads, and must be set before the agent starts sending.
+   */
+  typedef std::function<void(std::unique_ptr<TxPacket> pkt,
+                             folly::Optional<PortID> port)> TxHandler;
+  void setTxHandler(TxHandler handler) {
+    txHandler_ = std::move(handler);
+  }
+
+  /*
+   * Tell the agent that a port's link went up or down, as the SDK's link
+   * scan would.
+   */
+  void linkStateChanged(PortID port, bool up);
+
   // TODO
   void updateStats(SwitchStats *switchStats) override {}
 
@@ -46,11 +77,45 @@ class SimSwitch : public HwSwitch {
     //TODO
   }
 
+  /*
+   * The model of how long the SDK takes to apply each state change.  This
+   * may only be changed while no state changes are being applied.
+   */
+  SimLatencyModel* getLatencyModel() {
+    return &latencyModel_;
+  }
+
+  /*
+   * The software dataplane, which forwards by the last state applied.
+   */
+  SimDataplane* getDataplane() {
+    return &dataplane_;
+  }
+
   bool isPortUp(PortID port) const override {
     // Should be called only from SwSwitch which knows whether
     // the port is enabled or not
     return true;
   }
+
+  bool getAndClearNeighborHits(NeighborHits* hits) override {
+    return false;
+  }
+  bool setNeighborReachable(RouterID router, const folly::IPAddress& ip,
+                            bool reachable) override {
+    return false;
+  }
+  bool getWarmBootReconciliation(WarmBootReconciliation* status) override {
+    return false;
+  }
+  bool estimateStateChange(const StateDelta& delta,
+                           HwOperationEstimate* estimate) const override {
+    return false;
+  }
+  bool getPortCounters(PortID port,
+                       PortCounters* counters) const override {
+    return false;
+  }
  private:
   // Forbidden copy constructor and assignment operator
   SimSwitch(SimSwitch const &) = delete;
@@ -60,6 +125,9 @@ class SimSwitch : public HwSwitch {
   HwSwitch::Callback* callback_{nullptr};
   uint32_t numPorts_{0};
   uint64_t txCount_{0};
+  SimLatencyModel latencyModel_;
+  SimDataplane dataplane_;
+  TxHandler txHandler_;
 };
 
 }} // facebook::fboss
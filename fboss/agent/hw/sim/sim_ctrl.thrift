@@ -5,5 +5,31 @@ namespace py neteng.fboss.sim_ctrl
 include "fboss/agent/if/fboss.thrift"
 include "fboss/agent/if/ctrl.thrift"
 
+/*
+ * Frames for sendTraffic() to send, as if received on a port
+ */
+struct TrafficStream {
+  1: i32 port,
+  2: i32 vlan,
+  3: ctrl.fbbinary frame,
+  4: i64 count = 1,
+  // How many frames to send per second.  0 sends them back to back.
+  5: i64 ratePps = 0,
+}
+
 service SimCtrl extends ctrl.FbossCtrl {
+  /*
+   * Forward the frames of each stream through the software dataplane, which
+   * punts them to the agent the way the ASIC would.  The streams are sent
+   * one after another, and this returns once all of their frames are sent.
+   */
+  void sendTraffic(1: list<TrafficStream> streams)
+    throws (1: fboss.FbossBaseError error)
+
+  /*
+   * The number of frames given each dataplane verdict, such as "routed" or
+   * "punt_no_neighbor"
+   */
+  map<string, i64> getDataplaneCounters()
+  void clearDataplaneCounters()
 }
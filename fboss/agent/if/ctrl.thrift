@@ -23,6 +23,99 @@ struct UnicastRoute {
   2: required list<Address.BinaryAddress> nextHopAddrs,
 }
 
+/*
+ * Routes packed into flat buffers, for loading large route tables with
+ * addUnicastRoutesPacked() without a thrift struct per route.
+ *
+ * v4Routes is a sequence of 9 byte records: the 4 network bytes, the prefix
+ * length, and the index of the route's nexthop group in nexthopGroups, as a
+ * 4 byte big endian integer.  v6Routes holds 21 byte records in the same
+ * format, with 16 network bytes.  Network bits past the prefix length are
+ * ignored.
+ */
+struct PackedRoutes {
+  1: list<list<Address.BinaryAddress>> nexthopGroups,
+  2: fbbinary v4Routes,
+  3: fbbinary v6Routes,
+}
+
+/*
+ * The position to resume reading the route table from.  Routes are ordered
+ * by VRF, then IPv4 before IPv6, then by prefix length and address.
+ */
+struct RouteTableCursor {
+  1: i32 vrfId = 0,
+  // Start after this prefix, or at the start of the VRF if unset
+  2: optional IpPrefix after,
+}
+
+struct RouteTablePage {
+  1: list<UnicastRoute> routes,
+  // The cursor for the next page; unset if this is the last page
+  2: optional RouteTableCursor next,
+  // The generation of the switch state the page was read from
+  3: i64 generation,
+}
+
+struct RouteTableDelta {
+  // The routes that were added or changed
+  1: list<UnicastRoute> changed,
+  2: list<IpPrefix> removed,
+  // The generation of the switch state the delta leads to
+  3: i64 generation,
+}
+
+enum StateSubsystem {
+  PORTS = 1,
+  VLANS = 2,
+  INTERFACES = 3,
+  ROUTES = 4,
+  ARP = 5,
+  NDP = 6,
+}
+
+struct StateChanges {
+  // The generation of the latest switch state
+  1: i64 generation,
+  // The subsystems that changed since the requested generation
+  2: list<StateSubsystem> changed,
+  // The requested generation is too old to tell what changed since, so
+  // everything is reported as changed and should be read again.
+  3: bool resync,
+}
+
+struct ConfigDryRun {
+  // Whether the config changes anything at all
+  1: bool changed,
+  // The estimated number of SDK operations needed to apply the config to the
+  // hardware, by the kind of object they program
+  2: i64 portOperations,
+  3: i64 vlanOperations,
+  4: i64 interfaceOperations,
+  5: i64 hostOperations,
+  6: i64 routeOperations,
+}
+
+struct WarmBootReconciliation {
+  // HW entries found at warm boot that the new state reused as they were,
+  // or had to reprogram
+  1: i64 reused,
+  2: i64 reprogrammed,
+  // HW entries the new state does not use, deleted so far or still left
+  3: i64 deleted,
+  4: i64 remaining,
+  // Whether the initial programming is done, so that the unused entries are
+  // being deleted
+  5: bool cleanupStarted,
+}
+
+struct BootPhase {
+  1: string name,
+  // When the phase started, in milliseconds since the agent started
+  2: i64 startMs,
+  3: i64 durationMs,
+}
+
 struct ArpEntryThrift {
   1: string mac,
   2: i32 port,
@@ -31,6 +124,16 @@ struct ArpEntryThrift {
   5: i32 vlanID,
 }
 
+/*
+ * A MAC address the HW learned
+ */
+struct L2EntryThrift {
+  1: string mac,
+  2: i32 port,
+  3: i32 vlanID,
+  4: string vlanName,
+}
+
 struct InterfaceDetail {
   1: string interfaceName,
   2: i32 interfaceId,
@@ -48,6 +151,63 @@ struct NdpEntryThrift {
   5: i32 vlanID,
 }
 
+struct NeighborToFlush {
+  1: Address.BinaryAddress ip,
+  // 0 flushes the address from every VLAN
+  2: i32 vlanId = 0,
+}
+
+struct PacketToSend {
+  1: i32 port,
+  2: i32 vlan,
+  3: fbbinary data,
+}
+
+enum NeighborStateFilter {
+  ANY = 0,
+  // Entries still waiting for a reply to the ARP or NDP request
+  PENDING = 1,
+  // Entries with a resolved MAC address
+  REACHABLE = 2,
+}
+
+/*
+ * Which neighbor entries getArpTablePage() and getNdpTablePage() return.
+ * Unset fields match every entry.
+ */
+struct NeighborQuery {
+  1: optional i32 vlanId,
+  2: optional i32 port,
+  3: optional IpPrefix prefix,
+  4: NeighborStateFilter state = ANY,
+}
+
+/*
+ * The position to resume reading a neighbor table from.  Entries are
+ * ordered by VLAN, then by IP address.
+ */
+struct NeighborCursor {
+  1: i32 vlanId = 0,
+  // Start after this address, or at the start of the VLAN if unset
+  2: optional Address.BinaryAddress after,
+}
+
+struct ArpTablePage {
+  1: list<ArpEntryThrift> entries,
+  // The cursor for the next page; unset if this is the last page
+  2: optional NeighborCursor next,
+  // The generation of the switch state the page was read from
+  3: i64 generation,
+}
+
+struct NdpTablePage {
+  1: list<NdpEntryThrift> entries,
+  // The cursor for the next page; unset if this is the last page
+  2: optional NeighborCursor next,
+  // The generation of the switch state the page was read from
+  3: i64 generation,
+}
+
 enum BootType {
   UNINITIALIZED = 0,
   COLD_BOOT = 1,
@@ -59,6 +219,140 @@ struct PortStatus {
   2: bool up
 }
 
+/*
+ * The increase per second of a port's counters over one window.  The
+ * packets are of all types: unicast, multicast and broadcast.
+ */
+struct PortRatesThrift {
+  1: i32 windowSecs,
+  2: double inBytes,
+  3: double inPkts,
+  4: double inDiscards,
+  5: double outBytes,
+  6: double outPkts,
+  7: double outDiscards,
+}
+
+/*
+ * A port's counters as of the last stats update, and their rates over each
+ * of the agent's --port_rate_windows.
+ */
+struct PortStatsThrift {
+  1: i64 inBytes,
+  2: i64 inUnicastPkts,
+  3: i64 inMulticastPkts,
+  4: i64 inBroadcastPkts,
+  5: i64 inDiscards,
+  6: i64 inErrors,
+  7: i64 outBytes,
+  8: i64 outUnicastPkts,
+  9: i64 outMulticastPkts,
+  10: i64 outBroadcastPkts,
+  11: i64 outDiscards,
+  12: i64 outErrors,
+  13: list<PortRatesThrift> rates,
+}
+
+/*
+ * Approximate memory used by one subtree of the SwitchState.
+ *
+ * sharedNodes and sharedBytes count the nodes which are also referenced by
+ * the previous state generation.
+ */
+struct StateMemoryUsageThrift {
+  1: string subtree,
+  2: i64 nodes,
+  3: i64 bytes,
+  4: i64 sharedNodes,
+  5: i64 sharedBytes,
+  6: i32 generation,
+}
+
+/*
+ * Where the time went in one state change, which may apply several
+ * StateUpdates together.  stageUs is keyed by stage name: prepare, publish,
+ * delta, hw_lock, observers, tun_sync and hw.
+ */
+struct StateUpdateProfileThrift {
+  // The names of the updates applied, each only listed once
+  1: list<string> updates,
+  2: i32 numUpdates,
+  3: i64 generation,
+  // When the updates started to be applied, in seconds since the epoch
+  4: i64 startTime,
+  5: i64 totalUs,
+  6: map<string, i64> stageUs,
+}
+
+/*
+ * An event from the agent's event trace.  The meaning of arg1 and arg2
+ * depends on the event; text has the entry formatted for reading.
+ */
+struct EventTraceEntry {
+  // Since the epoch
+  1: i64 timeNs,
+  2: string thread,
+  3: string event,
+  4: i64 arg1,
+  5: i64 arg2,
+  // The state update, for update and program events
+  6: string name,
+  7: string text,
+}
+
+/*
+ * A source of packets trapped to the CPU.  The counts are estimated from a
+ * sample of the packets, and decay over time, so they reflect recent
+ * traffic.
+ */
+struct CpuTalkerThrift {
+  1: string mac,
+  // Not set for packets other than ARP and IP
+  2: optional Address.BinaryAddress ip,
+  // The ingress port and protocol of the last packet sampled
+  3: i32 port,
+  4: string proto,
+  5: i64 packets,
+  6: i64 bytes,
+}
+
+/*
+ * A neighbor learned from the LLDP PDUs received on a port.  The chassis and
+ * port IDs are formatted when they are MAC or network addresses.
+ */
+struct LinkNeighborThrift {
+  1: i32 localPort,
+  2: i32 localVlan,
+  3: string srcMac,
+  4: i32 chassisIdType,
+  5: string chassisId,
+  6: i32 portIdType,
+  7: string portId,
+  8: optional string systemName,
+  9: optional string systemDescription,
+  10: i32 ttl,
+  // Seconds since the neighbor's last PDU, and since its PDU last changed
+  11: i32 receivedSecsAgo,
+  12: i32 changedSecsAgo,
+}
+
+/*
+ * Restricts a packet capture to matching packets.  Every field that is set
+ * must match.
+ */
+struct CaptureFilter {
+  // The ingress port.  Transmitted packets never match a port filter.
+  1: optional i32 port
+  // The ingress VLAN, or the 802.1Q tag of transmitted packets
+  2: optional i32 vlan
+  // The ethertype after any 802.1Q tag
+  3: optional i32 ethertype
+  // The IPv4 protocol or IPv6 next header
+  4: optional i32 ipProto
+  // The TCP or UDP source or destination port
+  5: optional i32 l4Port
+}
+
 struct CaptureInfo {
   // A name identifying the packet capture
   1: string name
@@ -71,6 +365,19 @@ struct CaptureInfo {
    * large number of packets.
    */
   2: i32 maxPackets
+  3: optional CaptureFilter filter
+  /*
+   * Only capture the first snapLen bytes of each packet.  0 uses the
+   * --fboss_pcap_snaplen default.
+   */
+  4: i32 snapLen = 0
+  /*
+   * Start a new file once the current one reaches maxFileBytes, or every
+   * maxFileSeconds.  The files after the first are named <name>.pcap.1,
+   * <name>.pcap.2, and so on.  0 disables the limit.
+   */
+  5: i64 maxFileBytes = 0
+  6: i32 maxFileSeconds = 0
 }
 
 service FbossCtrl extends fb303.FacebookService {
@@ -91,17 +398,32 @@ service FbossCtrl extends fb303.FacebookService {
    * Add/Delete IPv4/IPV6 routes
    * - decide if it is v4 or v6 from destination ip address
    * - using clientID to identify who is adding routes, BGP or static
+   *
+   * The calls that change routes or neighbors have HIGH priority, so they
+   * are served by their own thread pool rather than waiting behind the
+   * queries.  See ThriftThreadPools.h.
    */
   void addUnicastRoute(1: i16 clientId, 2: UnicastRoute r)
     throws (1: fboss.FbossBaseError error)
+    (priority = 'HIGH')
   void deleteUnicastRoute(1: i16 clientId, 2: IpPrefix r)
     throws (1: fboss.FbossBaseError error)
+    (priority = 'HIGH')
   void addUnicastRoutes(1: i16 clientId, 2: list<UnicastRoute> r)
     throws (1: fboss.FbossBaseError error)
+    (priority = 'HIGH')
   void deleteUnicastRoutes(1: i16 clientId, 2: list<IpPrefix> r)
     throws (1: fboss.FbossBaseError error)
+    (priority = 'HIGH')
   void syncFib(1: i16 clientId, 2: list<UnicastRoute> routes)
     throws (1: fboss.FbossBaseError error)
+    (priority = 'HIGH')
+  /*
+   * The same as addUnicastRoutes(), for routes in the packed encoding
+   */
+  void addUnicastRoutesPacked(1: i16 clientId, 2: PackedRoutes routes)
+    throws (1: fboss.FbossBaseError error)
+    (priority = 'HIGH')
 
   /*
    * Send packets in binary or hex format to controller
@@ -110,6 +432,11 @@ service FbossCtrl extends fb303.FacebookService {
     throws (1: fboss.FbossBaseError error)
   void sendPktHex(1: i32 port, 2: i32 vlan, 3: fbstring hex)
     throws (1: fboss.FbossBaseError error)
+  /*
+   * Send several packets to the controller, as sendPkt() does, in order
+   */
+  void sendPkts(1: list<PacketToSend> pkts)
+    throws (1: fboss.FbossBaseError error)
 
   /*
    * Flush the ARP/NDP entry with the specified IP address.
@@ -120,6 +447,16 @@ service FbossCtrl extends fb303.FacebookService {
    * Returns the number of entries flushed.
    */
   i32 flushNeighborEntry(1: Address.BinaryAddress ip, 2: i32 vlanId)
+    (priority = 'HIGH')
+  /*
+   * Flush several ARP/NDP entries, as flushNeighborEntry() does, in a
+   * single state update.
+   *
+   * Returns the total number of entries flushed.
+   */
+  i32 flushNeighborEntries(1: list<NeighborToFlush> entries)
+    throws (1: fboss.FbossBaseError error)
+    (priority = 'HIGH')
 
   /*
    * Inband addresses
@@ -138,20 +475,128 @@ service FbossCtrl extends fb303.FacebookService {
    */
   UnicastRoute getIpRoute(1: Address.Address addr 2: i32 vrfId)
     throws (1: fboss.FbossBaseError error)
+  /*
+   * The same as getIpRoute() for each of the addresses, in order.  All of
+   * them are looked up in the same version of the route table.
+   */
+  list<UnicastRoute> getIpRoutes(1: list<Address.Address> addrs, 2: i32 vrfId)
+    throws (1: fboss.FbossBaseError error)
   map<i32, InterfaceDetail> getAllInterfaces()
     throws (1: fboss.FbossBaseError error)
   list<string> getInterfaceList()
     throws (1: fboss.FbossBaseError error)
   list<UnicastRoute> getRouteTable()
     throws (1: fboss.FbossBaseError error)
+  /*
+   * Returns at most maxRoutes routes, starting at the given cursor.  Use the
+   * returned cursor to read the next page.  The pages of one walk may come
+   * from different generations if routes change in between.
+   */
+  RouteTablePage getRouteTablePage(1: RouteTableCursor cursor,
+                                   2: i32 maxRoutes)
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Returns the routes that changed between a generation returned by an
+   * earlier getRouteTablePage() or getRouteTableDelta() call and now.  Only
+   * the last few generations handed out are remembered; for older ones the
+   * call fails and the full table has to be read again.
+   */
+  RouteTableDelta getRouteTableDelta(1: i64 sinceGeneration)
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Returns the generation of the current switch state.  The generation
+   * increases with every state change.
+   */
+  i64 getStateGeneration()
+  /*
+   * Waits until any part of the switch state changes after sinceGeneration,
+   * or until timeoutMs expires, and returns what changed.  Returns at once
+   * if something already changed.  A VLAN change is also reported for ARP
+   * and NDP changes, since the neighbor tables are part of the VLANs.
+   */
+  StateChanges waitForStateChanges(1: i64 sinceGeneration, 2: i32 timeoutMs)
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Returns how far reconciling the HW entries found at warm boot with the
+   * new switch state got.  Fails if the hardware does not keep its entries
+   * across restarts.
+   */
+  WarmBootReconciliation getWarmBootReconciliation()
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Compute what applying the given config (in JSON) would change, and how
+   * many hardware operations that would take, without applying it.
+   */
+  ConfigDryRun dryRunConfig(1: string config)
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Returns how long each stage of bringing up the agent took, in the order
+   * the stages finished.  Stages that haven't finished yet are left out.
+   */
+  list<BootPhase> getBootTimeline()
   map<i32, PortStatus> getPortStatus(1: list<i32> ports)
     throws (1: fboss.FbossBaseError error)
+  /*
+   * Return the counters and rates of the given ports, or of all ports if
+   * the list is empty.  They are computed when the stats are collected, so
+   * this does not read the hardware.  Ports whose stats have not been
+   * collected are left out.
+   */
+  map<i32, PortStatsThrift> getPortStats(1: list<i32> ports)
+    throws (1: fboss.FbossBaseError error)
   InterfaceDetail getInterfaceDetail(1: i32 interfaceId)
     throws (1: fboss.FbossBaseError error)
   list<ArpEntryThrift> getArpTable()
     throws (1: fboss.FbossBaseError error)
   list<NdpEntryThrift> getNdpTable()
     throws (1: fboss.FbossBaseError error)
+  /*
+   * The MAC addresses learned on each VLAN.  Learn and age events are
+   * applied in batches, and may be dropped during a MAC flood, so this
+   * can lag behind or miss some of the HW L2 table.
+   */
+  list<L2EntryThrift> getL2Table()
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Return the neighbor entries matching the query, at most maxEntries at a
+   * time, starting at the cursor.  Pass the returned cursor to get the next
+   * page.  Identical queries of the same state generation are answered from
+   * a cache.
+   */
+  ArpTablePage getArpTablePage(1: NeighborQuery query,
+                               2: NeighborCursor cursor,
+                               3: i32 maxEntries)
+    throws (1: fboss.FbossBaseError error)
+  NdpTablePage getNdpTablePage(1: NeighborQuery query,
+                               2: NeighborCursor cursor,
+                               3: i32 maxEntries)
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Returns the approximate memory used by the SwitchState, per subtree.
+   * The entry with subtree "total" covers the whole state.
+   */
+  list<StateMemoryUsageThrift> getStateMemoryUsage()
+    throws (1: fboss.FbossBaseError error)
+  /*
+   * Returns the profiles of up to count of the slowest of the recent state
+   * updates, slowest first.
+   */
+  list<StateUpdateProfileThrift> getSlowestStateUpdates(1: i32 count)
+  /*
+   * Returns up to count of the sources sending the most packets to the CPU,
+   * busiest first.  This is empty if the agent runs with --notrap_profile.
+   */
+  list<CpuTalkerThrift> getCpuTopTalkers(1: i32 count)
+  /*
+   * Returns the events recorded in the per-thread event traces, oldest
+   * first.  This is empty if the agent runs with --event_trace_size=0.
+   */
+  list<EventTraceEntry> getEventTrace()
+  /*
+   * Returns the neighbors learned from LLDP whose TTL has not expired,
+   * ordered by port.
+   */
+  list<LinkNeighborThrift> getLldpNeighbors()
   /*
    * Returns all the DOM information
    */
@@ -172,4 +617,11 @@ service FbossCtrl extends fb303.FacebookService {
     throws (1: fboss.FbossBaseError error)
   void stopAllPktCaptures()
     throws (1: fboss.FbossBaseError error)
+
+  /*
+   * Write the packets in the always-on packet flight recorder to
+   * <name>.pcap in the capture directory.  Returns the number of packets.
+   */
+  i32 dumpFlightRecorder(1: string name)
+    throws (1: fboss.FbossBaseError error)
 }
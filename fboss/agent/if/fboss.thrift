@@ -5,4 +5,7 @@ namespace d neteng.fboss
 
 exception FbossBaseError {
   1: string message
+  // Set when the agent is too busy to take on the request.  The same request
+  // can be retried as is after backing off.
+  2: bool retryable = false
 } ( message = "message" )
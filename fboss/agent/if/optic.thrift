@@ -58,11 +58,27 @@ struct SfpDomReadValue {
   5: double rxPwr,
 }
 
+/*
+ * The monitoring values of one lane of a QSFP
+ */
+struct SfpLaneDom {
+  1: i32 lane,
+  2: double txBias,
+  3: double txPwr,
+  4: double rxPwr,
+  5: bool rxLos,
+  6: bool txFault,
+}
+
 struct SfpDom {
   1: string name,
   2: bool sfpPresent,
   3: bool domSupported,
   6: optional SfpDomThreshFlags flags,
   7: optional SfpDomThreshValue threshValue,
+  // For QSFPs, txBias, txPwr and rxPwr are those of the first lane, and the
+  // flags are set if they are for any lane
   8: optional SfpDomReadValue value,
+  // Only set for QSFPs
+  9: optional list<SfpLaneDom> lanes,
 }
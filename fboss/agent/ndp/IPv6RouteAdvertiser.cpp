@@ -9,11 +9,16 @@
  */
 #include "fboss/agent/ndp/IPv6RouteAdvertiser.h"
 
+#include <algorithm>
 #include <netinet/icmp6.h>
 #include <folly/IPAddressV6.h>
 #include <folly/MacAddress.h>
+#include <folly/Random.h>
+#include <gflags/gflags.h>
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/PeriodicTransmitter.h"
 #include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/TxPacket.h"
 #include "fboss/agent/packet/Ethertype.h"
 #include "fboss/agent/packet/IPv6Hdr.h"
@@ -29,16 +34,31 @@ using folly::MacAddress;
 using folly::io::Cursor;
 using folly::IOBuf;
 using folly::io::RWPrivateCursor;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+DEFINE_int32(ra_jitter_percent, 10,
+             "The most, as a percentage of the interval, to randomly shorten "
+             "each interval between router advertisements by.  Unless this is "
+             "0, each interface also starts advertising at a random point in "
+             "its first interval");
 
 namespace facebook { namespace fboss {
 
+namespace {
+// The router constants from RFC 4861 section 10
+const milliseconds kMaxRaDelayTime(500);
+const milliseconds kMinDelayBetweenRas(3000);
+}
+
 /*
  * IPv6RAImpl is the class that actually handles sending out the RA packets.
  *
- * This uses TAsyncTimeout to receive timeout notifications in the SwSwitch's
- * background event thread, and send out RA packets every time the timer fires.
+ * The RAs are sent by the SwSwitch's PeriodicTransmitter, along with the
+ * other periodic packets, so everything here happens in the background
+ * thread.
  */
-class IPv6RAImpl : private apache::thrift::async::TAsyncTimeout {
+class IPv6RAImpl {
  public:
   IPv6RAImpl(SwSwitch* sw,
              const SwitchState* state,
@@ -51,52 +71,128 @@ class IPv6RAImpl : private apache::thrift::async::TAsyncTimeout {
   static void start(void* arg);
   static void stop(void* arg);
 
+  /*
+   * Serialize the RA packet for an interface.
+   */
+  static IOBuf buildPacket(const SwitchState* state, const Interface* intf);
+  static milliseconds getInterval(const Interface* intf);
+
+  /*
+   * Replace the RA packet and interval.  This must be called in the
+   * background thread.
+   */
+  void update(milliseconds interval, IOBuf buf);
+
+  /*
+   * Answer a router solicitation.  This must be called in the background
+   * thread.
+   */
+  void solicit();
+
  private:
   // Forbidden copy constructor and assignment operator
   IPv6RAImpl(IPv6RAImpl const &) = delete;
   IPv6RAImpl& operator=(IPv6RAImpl const &) = delete;
 
-  virtual void timeoutExpired() noexcept {
-    sendRouteAdvertisement();
-    scheduleTimeout(interval_);
-  }
-
-  void initPacket(const SwitchState* state, const Interface* intf);
-  void sendRouteAdvertisement();
+  /*
+   * Add our sender to the PeriodicTransmitter, or replace its interval.
+   * The sender starts at a random point in its first interval, and each
+   * interval is randomly shortened by up to --ra_jitter_percent, so that
+   * interfaces added together spread their advertisements across the
+   * interval.
+   */
+  void setSender();
+  std::unique_ptr<TxPacket> makeRouteAdvertisement();
 
-  std::chrono::milliseconds interval_;
+  const InterfaceID intfID_;
+  milliseconds interval_;
   folly::IOBuf buf_;
+  // When the last RA was sent
+  steady_clock::time_point lastSent_;
+  // Set while the next RA has been brought forward to answer a solicitation
+  bool solicited_{false};
   SwSwitch* const sw_{nullptr};
 };
 
 IPv6RAImpl::IPv6RAImpl(SwSwitch* sw,
                        const SwitchState* state,
                        const Interface* intf)
-  : AsyncTimeout(sw->getBackgroundEVB()),
+  : intfID_(intf->getID()),
+    interval_(getInterval(intf)),
+    buf_(buildPacket(state, intf)),
     sw_(sw) {
-  std::chrono::seconds raInterval(
-      intf->getNdpConfig().routerAdvertisementSeconds);
-  interval_ = raInterval;
-  initPacket(state, intf);
 }
 
 void IPv6RAImpl::start(void* arg) {
-  auto* ra = static_cast<IPv6RAImpl*>(arg);
-  ra->scheduleTimeout(ra->interval_);
+  static_cast<IPv6RAImpl*>(arg)->setSender();
 }
 
 void IPv6RAImpl::stop(void* arg) {
   auto* ra = static_cast<IPv6RAImpl*>(arg);
+  ra->sw_->getPeriodicTransmitter()->removeSender(
+      PeriodicTransmitter::Protocol::RA, ra->intfID_);
   /*
    * Just before going down we send one last route
    * advertisement to avoid RA's timing out while
    * controller is restarted
    */
-  ra->sendRouteAdvertisement();
+  ra->sw_->sendPacketSwitched(ra->makeRouteAdvertisement());
   delete ra;
 }
 
-void IPv6RAImpl::initPacket(const SwitchState* state, const Interface* intf) {
+void IPv6RAImpl::setSender() {
+  auto jitterPct = std::min(std::max(FLAGS_ra_jitter_percent, 0), 100);
+  sw_->getPeriodicTransmitter()->setSender(
+      PeriodicTransmitter::Protocol::RA, intfID_, interval_, jitterPct,
+      [this] () -> PeriodicTransmitter::Packet {
+        PeriodicTransmitter::Packet packet;
+        packet.pkt = makeRouteAdvertisement();
+        return packet;
+      });
+}
+
+milliseconds IPv6RAImpl::getInterval(const Interface* intf) {
+  return std::chrono::seconds(intf->getNdpConfig().routerAdvertisementSeconds);
+}
+
+void IPv6RAImpl::update(milliseconds interval, IOBuf buf) {
+  buf_ = std::move(buf);
+  if (interval == interval_) {
+    return;
+  }
+  interval_ = interval;
+  // A pending answer to a solicitation picks up the new interval when it
+  // is sent
+  auto* transmitter = sw_->getPeriodicTransmitter();
+  auto due = transmitter->getDue(PeriodicTransmitter::Protocol::RA, intfID_);
+  setSender();
+  if (solicited_) {
+    transmitter->setDue(PeriodicTransmitter::Protocol::RA, intfID_, due);
+  }
+}
+
+void IPv6RAImpl::solicit() {
+  if (solicited_) {
+    sw_->stats()->ipv6NdpRsAggregated();
+    return;
+  }
+  auto* transmitter = sw_->getPeriodicTransmitter();
+  auto now = steady_clock::now();
+  auto due = std::max(
+      now + milliseconds(folly::Random::rand64(kMaxRaDelayTime.count() + 1)),
+      lastSent_ + kMinDelayBetweenRas);
+  if (due >= transmitter->getDue(PeriodicTransmitter::Protocol::RA,
+                                 intfID_)) {
+    // The next periodic RA will do
+    sw_->stats()->ipv6NdpRsAggregated();
+    return;
+  }
+  solicited_ = true;
+  transmitter->setDue(PeriodicTransmitter::Protocol::RA, intfID_, due);
+}
+
+IOBuf IPv6RAImpl::buildPacket(const SwitchState* state,
+                              const Interface* intf) {
   const auto* ndpConfig = &intf->getNdpConfig();
   const Vlan* vlan = state->getVlans()->getVlan(intf->getVlanID()).get();
 
@@ -180,15 +276,16 @@ void IPv6RAImpl::initPacket(const SwitchState* state, const Interface* intf) {
   ICMPHdr icmp6(ICMPV6_TYPE_NDP_ROUTER_ADVERTISEMENT, 0, 0);
 
   auto totalLength = icmp6.computeTotalLengthV6(bodyLength);
-  buf_ = IOBuf(IOBuf::CREATE, totalLength);
-  buf_.append(totalLength);
-  RWPrivateCursor cursor(&buf_);
+  IOBuf buf(IOBuf::CREATE, totalLength);
+  buf.append(totalLength);
+  RWPrivateCursor cursor(&buf);
   icmp6.serializeFullPacket(&cursor, MacAddress("33:33:00:00:00:01"),
                             intf->getMac(), intf->getVlanID(),
                             ipv6, bodyLength, serializeBody);
+  return buf;
 }
 
-void IPv6RAImpl::sendRouteAdvertisement() {
+std::unique_ptr<TxPacket> IPv6RAImpl::makeRouteAdvertisement() {
   VLOG(5) << "sending route advertisement:\n" <<
     PktUtil::hexDump(Cursor(&buf_));
 
@@ -201,12 +298,17 @@ void IPv6RAImpl::sendRouteAdvertisement() {
   // TODO: In the future it would be nice to support allocating buf_ in a DMA
   // buffer so that we really can just clone a reference to it here, rather
   // than doing a copy.
+  lastSent_ = steady_clock::now();
+  if (solicited_) {
+    sw_->stats()->ipv6NdpRaSolicited();
+    solicited_ = false;
+  }
+
   uint32_t pktLen = buf_.length();
   auto pkt = sw_->allocatePacket(pktLen);
   RWPrivateCursor cursor(pkt->buf());
   cursor.push(buf_.data(), buf_.length());
-
-  sw_->sendPacketSwitched(std::move(pkt));
+  return pkt;
 }
 
 IPv6RouteAdvertiser::IPv6RouteAdvertiser(SwSwitch* sw,
@@ -240,6 +342,37 @@ IPv6RouteAdvertiser::~IPv6RouteAdvertiser() {
   }
 }
 
+void IPv6RouteAdvertiser::update(const SwitchState* state,
+                                 const Interface* intf) {
+  if (!adv_) {
+    return;
+  }
+  // Serialize here, so the background thread only has to swap the packet in.
+  // Work queued on the background thread runs in order, so adv_ cannot be
+  // deleted before this runs.
+  auto* adv = adv_;
+  auto interval = IPv6RAImpl::getInterval(intf);
+  auto buf = std::make_shared<IOBuf>(IPv6RAImpl::buildPacket(state, intf));
+  bool ret = adv->getSw()->getBackgroundEVB()->runInEventBaseThread(
+      [adv, interval, buf] { adv->update(interval, std::move(*buf)); });
+  if (!ret) {
+    LOG(ERROR) << "failed to update IPv6 route advertiser for interface "
+               << intf->getID();
+  }
+}
+
+void IPv6RouteAdvertiser::solicit() {
+  if (!adv_) {
+    return;
+  }
+  auto* adv = adv_;
+  bool ret = adv->getSw()->getBackgroundEVB()->runInEventBaseThread(
+      [adv] { adv->solicit(); });
+  if (!ret) {
+    LOG(ERROR) << "failed to answer router solicitation";
+  }
+}
+
 IPv6RouteAdvertiser& IPv6RouteAdvertiser::operator=(
     IPv6RouteAdvertiser&& other) noexcept {
   adv_ = other.adv_;
@@ -10,7 +10,6 @@
 #pragma once
 
 #include <folly/io/IOBuf.h>
-#include "thrift/lib/cpp/async/TAsyncTimeout.h"
 
 namespace facebook { namespace fboss {
 
@@ -26,6 +25,12 @@ class SwSwitch;
  * When you create an IPv6RouteAdvertiser object, it will begin sending out RA
  * packets at the interval specified in the interface's NdpConfig.  When you
  * destroy the IPv6RouteAdvertiser it will stop sending out RA packets.
+ *
+ * The RA packet is serialized once, and only serialized again when update()
+ * is called.  Each advertiser starts at a random point in its first
+ * interval, and the intervals are randomly shortened by up to
+ * --ra_jitter_percent, so that interfaces configured at the same time do not
+ * all advertise at once.
  */
 class IPv6RouteAdvertiser {
  public:
@@ -37,6 +42,24 @@ class IPv6RouteAdvertiser {
   IPv6RouteAdvertiser(IPv6RouteAdvertiser&& other) noexcept;
   IPv6RouteAdvertiser& operator=(IPv6RouteAdvertiser&& other) noexcept;
 
+  /*
+   * Rebuild the RA packet after the interface, or the MTU of its VLAN,
+   * changed.  Advertising carries on from the same point in the interval,
+   * unless the interval itself changed.
+   */
+  void update(const SwitchState* state, const Interface* intf);
+
+  /*
+   * Answer a router solicitation.
+   *
+   * As RFC 4861 section 6.2.6 describes, the answer is the usual multicast
+   * RA, sent after a random delay of up to half a second, and no sooner
+   * than 3 seconds after the previous RA.  Solicitations that arrive while
+   * an answer is pending, or that the next periodic RA will answer in time,
+   * do not send anything more.
+   */
+  void solicit();
+
  private:
   /*
    * All of the work is actually done by an IPv6RAImpl object.
@@ -8,10 +8,13 @@
  *
  */
 #include "fboss/agent/SwSwitch.h"
+#include "common/stats/ThreadCachedServiceData.h"
 
 namespace facebook { namespace fboss {
 
-void SwSwitch::publishStats() {}
+void SwSwitch::publishStats() {
+  stats::ThreadCachedServiceData::get()->publishStats();
+}
 
 void SwSwitch::publishBootType() {}
 
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/packet/HdrView.h"
+
+#include <folly/io/Cursor.h>
+#include "fboss/agent/packet/HdrParseError.h"
+#include "fboss/agent/packet/IPv4Hdr.h"
+
+#include <glog/logging.h>
+
+using folly::io::Cursor;
+
+namespace facebook { namespace fboss {
+
+template <size_t kMaxSize>
+void HdrView<kMaxSize>::init(Cursor* cursor, size_t len) {
+  DCHECK_LE(len, kMaxSize);
+  if (cursor->length() >= len) {
+    data_ = cursor->data();
+    cursor->skip(len);
+  } else {
+    cursor->pull(copy_, len);
+    data_ = copy_;
+  }
+  size_ = len;
+}
+
+template class HdrView<60>;
+template class HdrView<28>;
+
+IPv4HdrView::IPv4HdrView(Cursor* cursor) {
+  try {
+    auto first = Cursor(*cursor).read<uint8_t>();
+    if ((first >> 4) != IPV4_VERSION) {
+      throw HdrParseError("IPv4: version != 4");
+    }
+    if ((first & 0x0f) < 5) {
+      throw HdrParseError("IPv4: IHL < 5");
+    }
+    init(cursor, (first & 0x0f) * 4);
+  } catch (const std::out_of_range& e) {
+    throw HdrParseError("IPv4 header too small");
+  }
+  if (length() < 20) {
+    throw HdrParseError("IPv4: total length < 20");
+  }
+  if (ttl() == 0) {
+    throw HdrParseError("IPv4: TTL == 0");
+  }
+}
+
+ArpHdrView::ArpHdrView(Cursor* cursor) {
+  try {
+    init(cursor, 28);
+  } catch (const std::out_of_range& e) {
+    throw HdrParseError("ARP packet too small");
+  }
+}
+
+}} // facebook::fboss
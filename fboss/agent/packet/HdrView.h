@@ -0,0 +1,167 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/IPAddressV4.h>
+#include <folly/MacAddress.h>
+#include <folly/Range.h>
+
+namespace folly { namespace io {
+class Cursor;
+}}
+
+namespace facebook { namespace fboss {
+
+/*
+ * Header views read the fields of a received header straight out of the
+ * packet buffer, instead of copying every field into a struct the way
+ * IPv4Hdr and the other header classes do.  A view is validated once, when
+ * it is constructed, and the handlers further down the chain are passed the
+ * view rather than parsing the header again.
+ *
+ * A view points into the packet, so it must not outlive it.  In the rare
+ * case that the header spans two buffers of a chain, it is copied into the
+ * view instead, so constructing a view never allocates.  Since a view may
+ * point into itself, views cannot be copied.
+ */
+template <size_t kMaxSize>
+class HdrView {
+ public:
+  /*
+   * The raw bytes of the header.
+   */
+  folly::ByteRange bytes() const {
+    return folly::ByteRange(data_, size_);
+  }
+
+ protected:
+  HdrView() {}
+
+  /*
+   * Point the view at the len bytes at the cursor, and advance the cursor
+   * past them.  Throws std::out_of_range if the packet is too short.
+   */
+  void init(folly::io::Cursor* cursor, size_t len);
+
+  uint8_t readU8(size_t offset) const {
+    return data_[offset];
+  }
+  uint16_t readU16(size_t offset) const {
+    return (static_cast<uint16_t>(data_[offset]) << 8) | data_[offset + 1];
+  }
+  folly::IPAddressV4 readIPv4(size_t offset) const {
+    return folly::IPAddressV4::fromBinary(
+        folly::ByteRange(data_ + offset, folly::IPAddressV4::byteCount()));
+  }
+  folly::MacAddress readMac(size_t offset) const {
+    return folly::MacAddress::fromBinary(
+        folly::ByteRange(data_ + offset, folly::MacAddress::SIZE));
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  HdrView(HdrView const &) = delete;
+  HdrView& operator=(HdrView const &) = delete;
+
+  const uint8_t* data_{nullptr};
+  size_t size_{0};
+  // Only used if the header is not contiguous
+  uint8_t copy_[kMaxSize];
+};
+
+/*
+ * A view of a received IPv4 header, including any options.
+ */
+class IPv4HdrView : public HdrView<60> {
+ public:
+  /*
+   * Validate the header at the cursor, and advance the cursor past it and
+   * its options.  Throws HdrParseError for the same headers IPv4Hdr does.
+   */
+  explicit IPv4HdrView(folly::io::Cursor* cursor);
+
+  uint8_t version() const {
+    return readU8(0) >> 4;
+  }
+  uint8_t ihl() const {
+    return readU8(0) & 0x0f;
+  }
+  size_t headerLength() const {
+    return ihl() * 4;
+  }
+  uint8_t dscp() const {
+    return readU8(1) >> 2;
+  }
+  uint16_t length() const {
+    return readU16(2);
+  }
+  uint16_t id() const {
+    return readU16(4);
+  }
+  uint8_t ttl() const {
+    return readU8(8);
+  }
+  uint8_t protocol() const {
+    return readU8(9);
+  }
+  uint16_t csum() const {
+    return readU16(10);
+  }
+  folly::IPAddressV4 srcAddr() const {
+    return readIPv4(12);
+  }
+  folly::IPAddressV4 dstAddr() const {
+    return readIPv4(16);
+  }
+};
+
+/*
+ * A view of a received ARP packet.  The hardware and protocol types and
+ * sizes are not checked, so that callers can count unsupported packets;
+ * the addresses are only meaningful for Ethernet and IPv4.
+ */
+class ArpHdrView : public HdrView<28> {
+ public:
+  /*
+   * Advance the cursor past the ARP packet.  Throws HdrParseError if the
+   * packet is too short.
+   */
+  explicit ArpHdrView(folly::io::Cursor* cursor);
+
+  uint16_t htype() const {
+    return readU16(0);
+  }
+  uint16_t ptype() const {
+    return readU16(2);
+  }
+  uint8_t hlen() const {
+    return readU8(4);
+  }
+  uint8_t plen() const {
+    return readU8(5);
+  }
+  uint16_t op() const {
+    return readU16(6);
+  }
+  folly::MacAddress senderMac() const {
+    return readMac(8);
+  }
+  folly::IPAddressV4 senderIP() const {
+    return readIPv4(14);
+  }
+  folly::MacAddress targetMac() const {
+    return readMac(18);
+  }
+  folly::IPAddressV4 targetIP() const {
+    return readIPv4(24);
+  }
+};
+
+}} // facebook::fboss
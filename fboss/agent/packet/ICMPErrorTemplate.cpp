@@ -0,0 +1,189 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/packet/ICMPErrorTemplate.h"
+
+#include <folly/io/IOBuf.h>
+#include "fboss/agent/packet/Ethertype.h"
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/packet/IPv4Hdr.h"
+#include "fboss/agent/packet/IPv6Hdr.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+using folly::IOBuf;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+
+namespace {
+
+// The IPv4 total length the template is built with, that of an error with
+// an empty body
+const uint16_t kIPv4TemplateLength = 20 + facebook::fboss::ICMPHdr::SIZE;
+
+uint32_t addrPartialCsum(const IPAddressV6& addr) {
+  const uint8_t* bytes = addr.bytes();
+  uint32_t sum = 0;
+  for (int n = 0; n < 16; n += 2) {
+    sum += (static_cast<uint32_t>(bytes[n]) << 8) | bytes[n + 1];
+  }
+  return sum;
+}
+
+void writeEthHdr(RWPrivateCursor* cursor,
+                 MacAddress dstMac,
+                 MacAddress srcMac,
+                 facebook::fboss::VlanID vlan,
+                 uint16_t ethertype) {
+  cursor->push(dstMac.bytes(), MacAddress::SIZE);
+  cursor->push(srcMac.bytes(), MacAddress::SIZE);
+  cursor->writeBE<uint16_t>(facebook::fboss::ETHERTYPE_VLAN);
+  cursor->writeBE<uint16_t>(vlan);
+  cursor->writeBE<uint16_t>(ethertype);
+}
+
+} // unnamed namespace
+
+namespace facebook { namespace fboss {
+
+ICMPv4ErrorTemplate::ICMPv4ErrorTemplate(MacAddress dstMac,
+                                         MacAddress srcMac,
+                                         VlanID vlan,
+                                         const IPAddressV4& srcIP,
+                                         ICMPv4Type type,
+                                         ICMPv4Code code)
+  : dstMac_(dstMac),
+    srcMac_(srcMac),
+    vlan_(vlan),
+    srcIP_(srcIP),
+    type_(type),
+    code_(code) {
+  // The template is addressed to 0.0.0.0, and has an empty body
+  IPv4Hdr ipv4(srcIP, IPAddressV4(), IP_PROTO_ICMP, ICMPHdr::SIZE);
+  ipv4.computeChecksum();
+  ipCsum_ = ipv4.csum;
+
+  IOBuf buf(IOBuf::WRAP_BUFFER, hdr_.data(), hdr_.size());
+  RWPrivateCursor cursor(&buf);
+  writeEthHdr(&cursor, dstMac, srcMac, vlan, ETHERTYPE_IPV4);
+  ipv4.write(&cursor);
+  cursor.write<uint8_t>(type);
+  cursor.write<uint8_t>(code);
+  cursor.writeBE<uint16_t>(0);
+  DCHECK(cursor.isAtEnd());
+}
+
+bool ICMPv4ErrorTemplate::matches(MacAddress dstMac,
+                                  MacAddress srcMac,
+                                  VlanID vlan,
+                                  const IPAddressV4& srcIP,
+                                  ICMPv4Type type,
+                                  ICMPv4Code code) const {
+  return dstMac == dstMac_ && srcMac == srcMac_ && vlan == vlan_ &&
+    srcIP == srcIP_ && type == type_ && code == code_;
+}
+
+void ICMPv4ErrorTemplate::writeHeaders(RWPrivateCursor* cursor,
+                                       const IPAddressV4& dstIP,
+                                       uint32_t bodyLength) const {
+  uint16_t length = 20 + ICMPHdr::SIZE + bodyLength;
+  auto csum = PktUtil::updateChecksum(ipCsum_, kIPv4TemplateLength, length);
+  csum = PktUtil::updateChecksum(csum, IPAddressV4(), dstIP);
+
+  RWPrivateCursor ipv4(*cursor);
+  cursor->push(hdr_.data(), hdr_.size());
+  // Total length, then the checksum after the id, fragment, TTL and
+  // protocol fields, then the destination after the source address
+  ipv4 += EthHdr::SIZE + 2;
+  ipv4.writeBE<uint16_t>(length);
+  ipv4 += 6;
+  ipv4.writeBE<uint16_t>(csum);
+  ipv4 += 4;
+  ipv4.push(dstIP.bytes(), IPAddressV4::byteCount());
+}
+
+void ICMPv4ErrorTemplate::writeChecksum(RWPrivateCursor hdrStart,
+                                        Cursor bodyStart,
+                                        uint32_t bodyLength) const {
+  // The ICMPv4 checksum covers only the ICMP header and body
+  uint32_t sum = (type_ << 8) + code_;
+  auto csum = PktUtil::finalizeChecksum(bodyStart, bodyLength, sum);
+  hdrStart += SIZE - 2;
+  hdrStart.writeBE<uint16_t>(csum);
+}
+
+ICMPv6ErrorTemplate::ICMPv6ErrorTemplate(MacAddress dstMac,
+                                         MacAddress srcMac,
+                                         VlanID vlan,
+                                         const IPAddressV6& srcIP,
+                                         ICMPv6Type type,
+                                         ICMPv6Code code)
+  : dstMac_(dstMac),
+    srcMac_(srcMac),
+    vlan_(vlan),
+    srcIP_(srcIP),
+    type_(type),
+    code_(code) {
+  // The template is addressed to ::, and has an empty body
+  IPv6Hdr ipv6(srcIP, IPAddressV6());
+  ipv6.trafficClass = 0xe0; // CS7 precedence (network control)
+  ipv6.payloadLength = ICMPHdr::SIZE;
+  ipv6.nextHeader = IP_PROTO_IPV6_ICMP;
+  ipv6.hopLimit = 255;
+  partialCsum_ = ipv6.pseudoHdrPartialCsum(0) + (type << 8) + code;
+
+  IOBuf buf(IOBuf::WRAP_BUFFER, hdr_.data(), hdr_.size());
+  RWPrivateCursor cursor(&buf);
+  writeEthHdr(&cursor, dstMac, srcMac, vlan, ETHERTYPE_IPV6);
+  ipv6.serialize(&cursor);
+  cursor.write<uint8_t>(type);
+  cursor.write<uint8_t>(code);
+  cursor.writeBE<uint16_t>(0);
+  DCHECK(cursor.isAtEnd());
+}
+
+bool ICMPv6ErrorTemplate::matches(MacAddress dstMac,
+                                  MacAddress srcMac,
+                                  VlanID vlan,
+                                  const IPAddressV6& srcIP,
+                                  ICMPv6Type type,
+                                  ICMPv6Code code) const {
+  return dstMac == dstMac_ && srcMac == srcMac_ && vlan == vlan_ &&
+    srcIP == srcIP_ && type == type_ && code == code_;
+}
+
+void ICMPv6ErrorTemplate::writeHeaders(RWPrivateCursor* cursor,
+                                       const IPAddressV6& dstIP,
+                                       uint32_t bodyLength) const {
+  RWPrivateCursor ipv6(*cursor);
+  cursor->push(hdr_.data(), hdr_.size());
+  // Payload length, then the destination after the next header, hop limit
+  // and source address
+  ipv6 += EthHdr::SIZE + 4;
+  ipv6.writeBE<uint16_t>(ICMPHdr::SIZE + bodyLength);
+  ipv6 += 18;
+  ipv6.push(dstIP.bytes(), IPAddressV6::byteCount());
+}
+
+void ICMPv6ErrorTemplate::writeChecksum(RWPrivateCursor hdrStart,
+                                        const IPAddressV6& dstIP,
+                                        Cursor bodyStart,
+                                        uint32_t bodyLength) const {
+  // Add the parts of the pseudo header that differ between errors
+  uint32_t payloadLength = ICMPHdr::SIZE + bodyLength;
+  uint32_t sum = partialCsum_ + addrPartialCsum(dstIP) +
+    (payloadLength >> 16) + (payloadLength & 0xffff);
+  auto csum = PktUtil::finalizeChecksum(bodyStart, bodyLength, sum);
+  hdrStart += SIZE - 2;
+  hdrStart.writeBE<uint16_t>(csum);
+}
+
+}} // facebook::fboss
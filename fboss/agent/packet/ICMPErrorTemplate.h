@@ -0,0 +1,164 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <folly/MacAddress.h>
+#include <folly/io/Cursor.h>
+#include <glog/logging.h>
+#include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/packet/ICMPHdr.h"
+#include "fboss/agent/types.h"
+
+namespace facebook { namespace fboss {
+
+/*
+ * ICMP error templates hold the preformatted Ethernet, IP and ICMP headers
+ * of the errors we send from one VLAN.  Only the destination address, the
+ * lengths and the checksums differ between two errors of the same type sent
+ * from the same VLAN, so serializing an error is a copy of the template, a
+ * patch of those fields, and a checksum over the body.  The IPv4 header
+ * checksum is updated incrementally rather than computed again.
+ *
+ * The packets are identical to the ones ICMPHdr::serializeFullPacket()
+ * builds.  Templates are small values, so they are cheap to copy.
+ */
+class ICMPv4ErrorTemplate {
+ public:
+  // Ethernet header with a VLAN tag, IPv4 header and ICMP header
+  enum : uint32_t { SIZE = EthHdr::SIZE + 20 + ICMPHdr::SIZE };
+
+  ICMPv4ErrorTemplate() {}
+  ICMPv4ErrorTemplate(folly::MacAddress dstMac,
+                      folly::MacAddress srcMac,
+                      VlanID vlan,
+                      const folly::IPAddressV4& srcIP,
+                      ICMPv4Type type,
+                      ICMPv4Code code);
+
+  /*
+   * Returns true if this template was built with these arguments.
+   */
+  bool matches(folly::MacAddress dstMac,
+               folly::MacAddress srcMac,
+               VlanID vlan,
+               const folly::IPAddressV4& srcIP,
+               ICMPv4Type type,
+               ICMPv4Code code) const;
+
+  static uint32_t computeTotalLength(uint32_t bodyLength) {
+    return SIZE + bodyLength;
+  }
+
+  /*
+   * Serialize an error to dstIP.  bodyFn must write exactly bodyLength
+   * bytes.
+   */
+  template<typename BodyFn>
+  void serialize(folly::io::RWPrivateCursor* cursor,
+                 const folly::IPAddressV4& dstIP,
+                 uint32_t bodyLength,
+                 BodyFn bodyFn) const {
+    folly::io::RWPrivateCursor hdrStart(*cursor);
+    writeHeaders(cursor, dstIP, bodyLength);
+    folly::io::RWPrivateCursor bodyStart(*cursor);
+    bodyFn(cursor);
+    DCHECK((bodyStart + bodyLength) == *cursor);
+    writeChecksum(hdrStart, folly::io::Cursor(bodyStart), bodyLength);
+  }
+
+ private:
+  void writeHeaders(folly::io::RWPrivateCursor* cursor,
+                    const folly::IPAddressV4& dstIP,
+                    uint32_t bodyLength) const;
+  void writeChecksum(folly::io::RWPrivateCursor hdrStart,
+                     folly::io::Cursor bodyStart,
+                     uint32_t bodyLength) const;
+
+  std::array<uint8_t, SIZE> hdr_{{}};
+  // The IPv4 header checksum, for the template's length and address
+  uint16_t ipCsum_{0};
+  folly::MacAddress dstMac_;
+  folly::MacAddress srcMac_;
+  VlanID vlan_{0};
+  folly::IPAddressV4 srcIP_;
+  ICMPv4Type type_{ICMPV4_TYPE_TIME_EXCEEDED};
+  ICMPv4Code code_{ICMPV4_CODE_TIME_EXCEEDED_TTL_EXCEEDED};
+};
+
+class ICMPv6ErrorTemplate {
+ public:
+  // Ethernet header with a VLAN tag, IPv6 header and ICMP header
+  enum : uint32_t { SIZE = EthHdr::SIZE + IPv6Hdr::SIZE + ICMPHdr::SIZE };
+
+  ICMPv6ErrorTemplate() {}
+  ICMPv6ErrorTemplate(folly::MacAddress dstMac,
+                      folly::MacAddress srcMac,
+                      VlanID vlan,
+                      const folly::IPAddressV6& srcIP,
+                      ICMPv6Type type,
+                      ICMPv6Code code);
+
+  /*
+   * Returns true if this template was built with these arguments.
+   */
+  bool matches(folly::MacAddress dstMac,
+               folly::MacAddress srcMac,
+               VlanID vlan,
+               const folly::IPAddressV6& srcIP,
+               ICMPv6Type type,
+               ICMPv6Code code) const;
+
+  static uint32_t computeTotalLength(uint32_t bodyLength) {
+    return SIZE + bodyLength;
+  }
+
+  /*
+   * Serialize an error to dstIP.  bodyFn must write exactly bodyLength
+   * bytes.
+   */
+  template<typename BodyFn>
+  void serialize(folly::io::RWPrivateCursor* cursor,
+                 const folly::IPAddressV6& dstIP,
+                 uint32_t bodyLength,
+                 BodyFn bodyFn) const {
+    folly::io::RWPrivateCursor hdrStart(*cursor);
+    writeHeaders(cursor, dstIP, bodyLength);
+    folly::io::RWPrivateCursor bodyStart(*cursor);
+    bodyFn(cursor);
+    DCHECK((bodyStart + bodyLength) == *cursor);
+    writeChecksum(hdrStart, dstIP, folly::io::Cursor(bodyStart), bodyLength);
+  }
+
+ private:
+  void writeHeaders(folly::io::RWPrivateCursor* cursor,
+                    const folly::IPAddressV6& dstIP,
+                    uint32_t bodyLength) const;
+  void writeChecksum(folly::io::RWPrivateCursor hdrStart,
+                     const folly::IPAddressV6& dstIP,
+                     folly::io::Cursor bodyStart,
+                     uint32_t bodyLength) const;
+
+  std::array<uint8_t, SIZE> hdr_{{}};
+  // The partial ICMPv6 checksum over the source address, the next header
+  // field of the pseudo header, and the ICMP type and code
+  uint32_t partialCsum_{0};
+  folly::MacAddress dstMac_;
+  folly::MacAddress srcMac_;
+  VlanID vlan_{0};
+  folly::IPAddressV6 srcIP_;
+  ICMPv6Type type_{ICMPV6_TYPE_TIME_EXCEEDED};
+  ICMPv6Code code_{ICMPV6_CODE_TIME_EXCEEDED_HOPLIMIT_EXCEEDED};
+};
+
+}} // facebook::fboss
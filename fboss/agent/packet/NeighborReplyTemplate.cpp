@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/packet/NeighborReplyTemplate.h"
+
+#include <folly/io/IOBuf.h>
+#include <glog/logging.h>
+#include "fboss/agent/packet/ArpHdr.h"
+#include "fboss/agent/packet/Ethertype.h"
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/packet/NDP.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+using folly::IOBuf;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+
+namespace {
+
+// The offsets of the fields patched for each reply
+const uint32_t kArpTargetMacOffset =
+  facebook::fboss::EthHdr::SIZE + 8 + MacAddress::SIZE + 4;
+const uint32_t kIPv6DstOffset = facebook::fboss::EthHdr::SIZE + 24;
+const uint32_t kICMPv6CsumOffset = facebook::fboss::EthHdr::SIZE +
+  facebook::fboss::IPv6Hdr::SIZE + 2;
+
+// Router and override, and solicited for replies to a solicitation
+const uint32_t kNARouterFlag = 0x80000000;
+const uint32_t kNAOverrideFlag = 0x20000000;
+const uint32_t kNASolicitedFlag = 0x40000000;
+
+uint32_t addrPartialCsum(const IPAddressV6& addr) {
+  const uint8_t* bytes = addr.bytes();
+  uint32_t sum = 0;
+  for (int n = 0; n < 16; n += 2) {
+    sum += (static_cast<uint32_t>(bytes[n]) << 8) | bytes[n + 1];
+  }
+  return sum;
+}
+
+void writeEthHdr(RWPrivateCursor* cursor,
+                 MacAddress srcMac,
+                 facebook::fboss::VlanID vlan,
+                 uint16_t ethertype) {
+  // The destination is patched in for each reply
+  cursor->push(MacAddress::ZERO.bytes(), MacAddress::SIZE);
+  cursor->push(srcMac.bytes(), MacAddress::SIZE);
+  cursor->writeBE<uint16_t>(facebook::fboss::ETHERTYPE_VLAN);
+  cursor->writeBE<uint16_t>(vlan);
+  cursor->writeBE<uint16_t>(ethertype);
+}
+
+} // unnamed namespace
+
+namespace facebook { namespace fboss {
+
+ArpReplyTemplate::ArpReplyTemplate(MacAddress srcMac,
+                                   VlanID vlan,
+                                   const IPAddressV4& srcIP) {
+  IOBuf buf(IOBuf::WRAP_BUFFER, pkt_.data(), pkt_.size());
+  RWPrivateCursor cursor(&buf);
+  writeEthHdr(&cursor, srcMac, vlan, ETHERTYPE_ARP);
+  cursor.writeBE<uint16_t>(ARP_HTYPE_ETHERNET);
+  cursor.writeBE<uint16_t>(ARP_PTYPE_IPV4);
+  cursor.writeBE<uint8_t>(ARP_HLEN_ETHERNET);
+  cursor.writeBE<uint8_t>(ARP_PLEN_IPV4);
+  cursor.writeBE<uint16_t>(ARP_OPER_REPLY);
+  cursor.push(srcMac.bytes(), MacAddress::SIZE);
+  cursor.push(srcIP.bytes(), IPAddressV4::byteCount());
+  // The target and the padding are left as 0s
+  DCHECK_EQ(kArpTargetMacOffset, SIZE - cursor.length());
+}
+
+void ArpReplyTemplate::serialize(RWPrivateCursor* cursor,
+                                 MacAddress dstMac,
+                                 const IPAddressV4& dstIP) const {
+  RWPrivateCursor patch(*cursor);
+  cursor->push(pkt_.data(), pkt_.size());
+  patch.push(dstMac.bytes(), MacAddress::SIZE);
+  patch += kArpTargetMacOffset - MacAddress::SIZE;
+  patch.push(dstMac.bytes(), MacAddress::SIZE);
+  patch.push(dstIP.bytes(), IPAddressV4::byteCount());
+}
+
+NeighborAdvertisementTemplate::NeighborAdvertisementTemplate(
+    MacAddress srcMac,
+    VlanID vlan,
+    const IPAddressV6& srcIP,
+    bool router)
+  : flags_(kNAOverrideFlag | (router ? kNARouterFlag : 0)) {
+  // The template is addressed to ::, with no flags set
+  IPv6Hdr ipv6(srcIP, IPAddressV6());
+  ipv6.trafficClass = 0xe0; // CS7 precedence (network control)
+  ipv6.payloadLength = ICMPHdr::SIZE + BODY_LENGTH;
+  ipv6.nextHeader = IP_PROTO_IPV6_ICMP;
+  ipv6.hopLimit = 255;
+
+  IOBuf buf(IOBuf::WRAP_BUFFER, pkt_.data(), pkt_.size());
+  RWPrivateCursor cursor(&buf);
+  writeEthHdr(&cursor, srcMac, vlan, ETHERTYPE_IPV6);
+  ipv6.serialize(&cursor);
+  cursor.write<uint8_t>(ICMPV6_TYPE_NDP_NEIGHBOR_ADVERTISEMENT);
+  cursor.write<uint8_t>(ICMPV6_CODE_NDP_MESSAGE_CODE);
+  cursor.writeBE<uint16_t>(0);
+  cursor.writeBE<uint32_t>(0);
+  Cursor body(cursor);
+  cursor.push(srcIP.bytes(), IPAddressV6::byteCount());
+  cursor.write<uint8_t>(NDPOptionType::TARGET_LL_ADDRESS);
+  cursor.write<uint8_t>(NDPOptionLength::TARGET_LL_ADDRESS_IEEE802);
+  cursor.push(srcMac.bytes(), MacAddress::SIZE);
+  DCHECK(cursor.isAtEnd());
+
+  partialCsum_ = ipv6.pseudoHdrPartialCsum() +
+    (ICMPV6_TYPE_NDP_NEIGHBOR_ADVERTISEMENT << 8) +
+    ICMPV6_CODE_NDP_MESSAGE_CODE +
+    PktUtil::partialChecksum(body, BODY_LENGTH - 4);
+}
+
+void NeighborAdvertisementTemplate::serialize(RWPrivateCursor* cursor,
+                                              MacAddress dstMac,
+                                              const IPAddressV6& dstIP) const {
+  static const IPAddressV6 kAllNodes("ff01::1");
+  uint32_t flags = flags_;
+  const IPAddressV6* dst = &kAllNodes;
+  if (!dstIP.isZero()) {
+    flags |= kNASolicitedFlag;
+    dst = &dstIP;
+  }
+  uint32_t sum = partialCsum_ + addrPartialCsum(*dst) + (flags >> 16) +
+    (flags & 0xffff);
+
+  RWPrivateCursor patch(*cursor);
+  cursor->push(pkt_.data(), pkt_.size());
+  patch.push(dstMac.bytes(), MacAddress::SIZE);
+  patch += kIPv6DstOffset - MacAddress::SIZE;
+  patch.push(dst->bytes(), IPAddressV6::byteCount());
+  patch += kICMPv6CsumOffset - kIPv6DstOffset - IPAddressV6::byteCount();
+  patch.writeBE<uint16_t>(PktUtil::finalizeChecksum(sum));
+  patch.writeBE<uint32_t>(flags);
+}
+
+}} // facebook::fboss
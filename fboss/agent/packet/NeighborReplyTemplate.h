@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <folly/MacAddress.h>
+#include <folly/io/Cursor.h>
+#include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/packet/ICMPHdr.h"
+#include "fboss/agent/packet/IPv6Hdr.h"
+#include "fboss/agent/types.h"
+
+namespace facebook { namespace fboss {
+
+/*
+ * Neighbor reply templates hold the preformatted ARP reply, or neighbor
+ * advertisement, for one of our addresses on one VLAN.  Only the neighbor
+ * being answered differs between two replies for the same address, so
+ * serializing a reply is a copy of the template and a patch of the
+ * destination fields.  The ICMPv6 checksum is finished from a partial sum
+ * over the fields that never change.
+ *
+ * The packets are identical to the ones ArpHandler and IPv6Handler build
+ * field by field.  Templates are small values, so they are cheap to copy.
+ */
+class ArpReplyTemplate {
+ public:
+  /*
+   * Ethernet header with a VLAN tag and the ARP message, padded to the
+   * minimum frame length plus the tag, which is removed if the reply goes
+   * out untagged.
+   */
+  enum : uint32_t { SIZE = 68 };
+
+  ArpReplyTemplate() {}
+  ArpReplyTemplate(folly::MacAddress srcMac,
+                   VlanID vlan,
+                   const folly::IPAddressV4& srcIP);
+
+  /*
+   * Serialize a reply telling dstIP, at dstMac, that srcIP is at srcMac.
+   */
+  void serialize(folly::io::RWPrivateCursor* cursor,
+                 folly::MacAddress dstMac,
+                 const folly::IPAddressV4& dstIP) const;
+
+ private:
+  std::array<uint8_t, SIZE> pkt_{{}};
+};
+
+class NeighborAdvertisementTemplate {
+ public:
+  // The flags, the target address and the target link-layer address option
+  enum : uint32_t { BODY_LENGTH = 4 + 16 + 8 };
+  // Ethernet header with a VLAN tag, IPv6 header, ICMPv6 header and body
+  enum : uint32_t {
+    SIZE = EthHdr::SIZE + IPv6Hdr::SIZE + ICMPHdr::SIZE + BODY_LENGTH
+  };
+
+  NeighborAdvertisementTemplate() {}
+  /*
+   * The advertisements have the router flag set, unless they are sent on
+   * behalf of a host with router false.
+   */
+  NeighborAdvertisementTemplate(folly::MacAddress srcMac,
+                                VlanID vlan,
+                                const folly::IPAddressV6& srcIP,
+                                bool router = true);
+
+  /*
+   * Serialize an advertisement of srcIP at srcMac to dstIP, at dstMac.
+   *
+   * An advertisement to :: is unsolicited, and goes to ff01::1 instead.
+   */
+  void serialize(folly::io::RWPrivateCursor* cursor,
+                 folly::MacAddress dstMac,
+                 const folly::IPAddressV6& dstIP) const;
+
+ private:
+  std::array<uint8_t, SIZE> pkt_{{}};
+  // The partial ICMPv6 checksum over everything but the destination address
+  // and the flags
+  uint32_t partialCsum_{0};
+  // The flags of an unsolicited advertisement
+  uint32_t flags_{0};
+};
+
+}} // facebook::fboss
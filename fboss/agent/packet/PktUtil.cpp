@@ -9,12 +9,22 @@
  */
 #include "fboss/agent/packet/PktUtil.h"
 
+#include <folly/Bits.h>
 #include <folly/IPAddressV4.h>
 #include <folly/IPAddressV6.h>
 #include <folly/MacAddress.h>
 #include <folly/io/Cursor.h>
 #include "fboss/agent/FbossError.h"
 
+#include <algorithm>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using folly::IPAddressV4;
 using folly::IPAddressV6;
 using folly::MacAddress;
@@ -27,6 +37,98 @@ using std::string;
 
 namespace facebook { namespace fboss {
 
+namespace {
+
+/*
+ * The vector loops add two 16-bit words to each 32-bit lane per block, so
+ * the lanes are folded into the 64-bit sum before they can overflow.
+ */
+const size_t kMaxVectorBlocks = 32768;
+
+uint16_t swapBytes(uint16_t value) {
+  return (value >> 8) | (value << 8);
+}
+
+/*
+ * Return the ones' complement sum of a contiguous range of bytes, folded to
+ * 16 bits, as if the range started at an even offset.
+ *
+ * The words are added in host byte order, which gives the same folded sum
+ * up to a byte swap (RFC 1071 section 2(B)), so no per-word byte swapping is
+ * needed.  The bulk of the range is summed 32 or 16 bytes at a time with
+ * AVX2 or SSE2, when the build targets them, and 8 bytes at a time
+ * otherwise.
+ */
+uint16_t sumBytes(const uint8_t* data, size_t len) {
+  uint64_t sum = 0;
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+  while (len >= 32) {
+    __m256i acc = zero;
+    size_t blocks = std::min(len / 32, kMaxVectorBlocks);
+    for (size_t i = 0; i < blocks; ++i) {
+      auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+      acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+      acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+      data += 32;
+    }
+    uint32_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    for (auto lane : lanes) {
+      sum += lane;
+    }
+    len -= blocks * 32;
+  }
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  while (len >= 16) {
+    __m128i acc = zero;
+    size_t blocks = std::min(len / 16, kMaxVectorBlocks);
+    for (size_t i = 0; i < blocks; ++i) {
+      auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+      acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+      acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+      data += 16;
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    for (auto lane : lanes) {
+      sum += lane;
+    }
+    len -= blocks * 16;
+  }
+#endif
+  // Each 32-bit half is two host order words, and adding the halves to a
+  // 64-bit sum cannot overflow for any packet size
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    sum += (word & 0xffffffff) + (word >> 32);
+    data += 8;
+    len -= 8;
+  }
+  while (len >= 2) {
+    uint16_t word;
+    memcpy(&word, data, sizeof(word));
+    sum += word;
+    data += 2;
+    len -= 2;
+  }
+  if (len) {
+    // The last byte is the first byte of a word padded with zero
+    uint16_t word = 0;
+    memcpy(&word, data, 1);
+    sum += word;
+  }
+
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return folly::Endian::big(static_cast<uint16_t>(sum));
+}
+
+} // unnamed namespace
+
 MacAddress PktUtil::readMac(Cursor* cursor) {
   // Common case is that the MAC data is contiguous
   if (cursor->length() >= MacAddress::SIZE) {
@@ -67,8 +169,7 @@ uint16_t PktUtil::internetChecksum(folly::io::Cursor start, uint64_t length) {
 }
 
 uint16_t PktUtil::internetChecksum(const uint8_t* buffer, uint32_t size) {
-  auto buf = IOBuf(IOBuf::WRAP_BUFFER, buffer, size);
-  return finalizeChecksum(Cursor(&buf), size, 0);
+  return finalizeChecksum(sumBytes(buffer, size));
 }
 
 uint16_t PktUtil::internetChecksum(const IOBuf* buf) {
@@ -78,18 +179,26 @@ uint16_t PktUtil::internetChecksum(const IOBuf* buf) {
 uint32_t PktUtil::partialChecksumImpl(folly::io::Cursor cursor,
                                       uint64_t length,
                                       uint32_t value) {
-  // Checksum all the pairs of bytes first
-  while  (length > 1) {
-    value += cursor.readBE<uint16_t>();
-    length -= 2;
-  }
-  if (length) {
-    // Bytes are interpreted in n/w byte order
-    // so this last octet represents the 8 MSbits
-    // of the last 16 bit number in this buffer.
-    uint16_t last = cursor.read<uint8_t>();
-    value += (last << 8);
-    --length;
+  // Sum each contiguous piece of the buffer chain in one go.  A piece that
+  // starts at an odd offset pairs its bytes the other way around, which
+  // byte swaps its sum.
+  bool odd = false;
+  while (length > 0) {
+    size_t n = std::min<uint64_t>(cursor.length(), length);
+    uint16_t piece;
+    if (n > 0) {
+      piece = sumBytes(cursor.data(), n);
+      cursor.skip(n);
+    } else {
+      // The cursor is at the end of one buffer in the chain.  read() moves
+      // on to the next one, or throws std::out_of_range at the end of the
+      // chain.
+      n = 1;
+      piece = cursor.read<uint8_t>() << 8;
+    }
+    value += odd ? swapBytes(piece) : piece;
+    odd ^= (n & 1);
+    length -= n;
   }
   return value;
 }
@@ -117,6 +226,23 @@ uint16_t PktUtil::finalizeChecksum(uint32_t sum) {
   return static_cast<uint16_t>(sum);
 }
 
+uint16_t PktUtil::updateChecksum(uint16_t csum, uint16_t oldWord,
+                                 uint16_t newWord) {
+  // HC' = ~(~HC + ~m + m'), from RFC 1624 section 3
+  uint32_t sum = static_cast<uint16_t>(~csum);
+  sum += static_cast<uint16_t>(~oldWord);
+  sum += newWord;
+  return finalizeChecksum(sum);
+}
+
+uint16_t PktUtil::updateChecksum(uint16_t csum, IPAddressV4 oldAddr,
+                                 IPAddressV4 newAddr) {
+  auto oldLong = oldAddr.toLongHBO();
+  auto newLong = newAddr.toLongHBO();
+  csum = updateChecksum(csum, oldLong >> 16, newLong >> 16);
+  return updateChecksum(csum, oldLong & 0xffff, newLong & 0xffff);
+}
+
 string PktUtil::hexDump(Cursor cursor) {
   return hexDump(cursor, cursor.totalLength());
 }
@@ -85,6 +85,21 @@ class PktUtil {
                                    uint32_t value);
   static uint16_t finalizeChecksum(uint32_t value);
 
+  /*
+   * Update a checksum for a header rewrite without summing the whole header
+   * again, as described in RFC 1624.
+   *
+   * csum is the current checksum, and oldWord and newWord are the old and
+   * new values of the rewritten 16-bit word, all in host byte order.  For
+   * example, decrementing the IPv4 TTL rewrites the word holding the TTL and
+   * the protocol.  The IPAddressV4 version updates for a rewritten address,
+   * such as the giaddr of a relayed DHCP packet, which a UDP checksum covers.
+   */
+  static uint16_t updateChecksum(uint16_t csum, uint16_t oldWord,
+                                 uint16_t newWord);
+  static uint16_t updateChecksum(uint16_t csum, folly::IPAddressV4 oldAddr,
+                                 folly::IPAddressV4 newAddr);
+
   /**
    * Return a string containing a human readable hex dump of the binary data.
    */
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/packet/PktUtil.h"
+
+#include <folly/Benchmark.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Random.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <memory>
+
+/*
+ * Compares PktUtil::internetChecksum() with the loop it replaced, which read
+ * the packet two bytes at a time through a Cursor, for packet sizes from an
+ * NDP solicitation to a jumbo frame.  The chained version splits the packet
+ * into odd sized buffers, as a packet built from several pieces would be.
+ */
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+using folly::io::Cursor;
+
+namespace {
+
+std::unique_ptr<IOBuf> makeBuf(size_t size, size_t pieceLen) {
+  std::unique_ptr<IOBuf> head;
+  for (size_t offset = 0; offset < size; offset += pieceLen) {
+    auto len = std::min(pieceLen, size - offset);
+    auto piece = IOBuf::create(len);
+    piece->append(len);
+    for (size_t i = 0; i < len; ++i) {
+      piece->writableData()[i] = folly::Random::rand32(256);
+    }
+    if (head) {
+      head->prependChain(std::move(piece));
+    } else {
+      head = std::move(piece);
+    }
+  }
+  return head;
+}
+
+uint16_t cursorChecksum(Cursor cursor, uint64_t length) {
+  uint32_t value = 0;
+  while (length > 1) {
+    value += cursor.readBE<uint16_t>();
+    length -= 2;
+  }
+  if (length) {
+    uint16_t last = cursor.read<uint8_t>();
+    value += (last << 8);
+  }
+  return PktUtil::finalizeChecksum(value);
+}
+
+void cursorLoop(size_t numIters, size_t size, size_t pieceLen) {
+  std::unique_ptr<IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = makeBuf(size, pieceLen);
+  }
+  for (size_t i = 0; i < numIters; ++i) {
+    folly::doNotOptimizeAway(cursorChecksum(Cursor(buf.get()), size));
+  }
+}
+
+void pktUtil(size_t numIters, size_t size, size_t pieceLen) {
+  std::unique_ptr<IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = makeBuf(size, pieceLen);
+  }
+  for (size_t i = 0; i < numIters; ++i) {
+    folly::doNotOptimizeAway(
+        PktUtil::internetChecksum(Cursor(buf.get()), size));
+  }
+}
+
+} // unnamed namespace
+
+BENCHMARK_NAMED_PARAM(cursorLoop, 86, 86, 86)
+BENCHMARK_RELATIVE_NAMED_PARAM(pktUtil, 86, 86, 86)
+BENCHMARK_NAMED_PARAM(cursorLoop, 576, 576, 576)
+BENCHMARK_RELATIVE_NAMED_PARAM(pktUtil, 576, 576, 576)
+BENCHMARK_NAMED_PARAM(cursorLoop, 1500, 1500, 1500)
+BENCHMARK_RELATIVE_NAMED_PARAM(pktUtil, 1500, 1500, 1500)
+BENCHMARK_NAMED_PARAM(cursorLoop, 1500_chained, 1500, 333)
+BENCHMARK_RELATIVE_NAMED_PARAM(pktUtil, 1500_chained, 1500, 333)
+BENCHMARK_NAMED_PARAM(cursorLoop, 9000, 9000, 9000)
+BENCHMARK_RELATIVE_NAMED_PARAM(pktUtil, 9000, 9000, 9000)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/packet/HdrView.h"
+
+#include <gtest/gtest.h>
+
+#include <folly/IPAddressV4.h>
+#include <folly/MacAddress.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+
+#include "fboss/agent/packet/HdrParseError.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+using namespace facebook::fboss;
+using folly::IPAddressV4;
+using folly::MacAddress;
+using folly::io::Cursor;
+using folly::IOBuf;
+
+namespace {
+
+// An IPv4 header with a 4 byte option, followed by 4 bytes of payload
+const char* kIPv4Hex =
+  "46 00 00 1c  12 34 00 00  40 11 00 00  0a 00 00 01  0a 00 00 02"
+  "01 01 01 00"
+  "aa bb cc dd";
+
+// The same bytes, split into two buffers in the middle of the addresses
+std::unique_ptr<IOBuf> splitBuf(const char* hex, size_t at) {
+  auto buf = PktUtil::parseHexData(hex);
+  auto head = IOBuf::copyBuffer(buf.data(), at);
+  head->prependChain(IOBuf::copyBuffer(buf.data() + at, buf.length() - at));
+  return head;
+}
+
+void checkIPv4(const IOBuf* buf) {
+  Cursor cursor(buf);
+  IPv4HdrView ipv4(&cursor);
+  EXPECT_EQ(4, ipv4.version());
+  EXPECT_EQ(6, ipv4.ihl());
+  EXPECT_EQ(24, ipv4.headerLength());
+  EXPECT_EQ(24, ipv4.bytes().size());
+  EXPECT_EQ(28, ipv4.length());
+  EXPECT_EQ(0x1234, ipv4.id());
+  EXPECT_EQ(64, ipv4.ttl());
+  EXPECT_EQ(17, ipv4.protocol());
+  EXPECT_EQ(IPAddressV4("10.0.0.1"), ipv4.srcAddr());
+  EXPECT_EQ(IPAddressV4("10.0.0.2"), ipv4.dstAddr());
+  // The cursor is left past the options
+  EXPECT_EQ(0xaabbccdd, cursor.readBE<uint32_t>());
+}
+
+} // unnamed namespace
+
+TEST(HdrViewTest, IPv4) {
+  auto buf = PktUtil::parseHexData(kIPv4Hex);
+  checkIPv4(&buf);
+  checkIPv4(splitBuf(kIPv4Hex, 14).get());
+}
+
+TEST(HdrViewTest, IPv4Errors) {
+  auto parse = [](const std::string& hex) {
+    auto buf = PktUtil::parseHexData(hex);
+    Cursor cursor(&buf);
+    IPv4HdrView ipv4(&cursor);
+  };
+  const std::string addrs = "0a 00 00 01  0a 00 00 02";
+  // Version 6
+  EXPECT_THROW(parse("65 00 00 14  00 00 00 00  40 11 00 00" + addrs),
+               HdrParseError);
+  // IHL of 4
+  EXPECT_THROW(parse("44 00 00 14  00 00 00 00  40 11 00 00" + addrs),
+               HdrParseError);
+  // Total length of 19
+  EXPECT_THROW(parse("45 00 00 13  00 00 00 00  40 11 00 00" + addrs),
+               HdrParseError);
+  // TTL of 0
+  EXPECT_THROW(parse("45 00 00 14  00 00 00 00  00 11 00 00" + addrs),
+               HdrParseError);
+  // Options missing
+  EXPECT_THROW(parse("46 00 00 18  00 00 00 00  40 11 00 00" + addrs),
+               HdrParseError);
+  EXPECT_NO_THROW(parse("45 00 00 14  00 00 00 00  40 11 00 00" + addrs));
+}
+
+TEST(HdrViewTest, Arp) {
+  const char* hex =
+    // htype, ptype, hlen, plen, op
+    "00 01  08 00  06  04  00 01"
+    // Sender MAC and IP
+    "00 02 00 01 02 03  0a 00 00 0f"
+    // Target MAC and IP
+    "00 00 00 00 00 00  0a 00 00 01";
+  auto check = [](const IOBuf* buf) {
+    Cursor cursor(buf);
+    ArpHdrView arp(&cursor);
+    EXPECT_EQ(1, arp.htype());
+    EXPECT_EQ(0x0800, arp.ptype());
+    EXPECT_EQ(6, arp.hlen());
+    EXPECT_EQ(4, arp.plen());
+    EXPECT_EQ(1, arp.op());
+    EXPECT_EQ(MacAddress("00:02:00:01:02:03"), arp.senderMac());
+    EXPECT_EQ(IPAddressV4("10.0.0.15"), arp.senderIP());
+    EXPECT_EQ(MacAddress("00:00:00:00:00:00"), arp.targetMac());
+    EXPECT_EQ(IPAddressV4("10.0.0.1"), arp.targetIP());
+    EXPECT_EQ(0, cursor.totalLength());
+  };
+  auto buf = PktUtil::parseHexData(hex);
+  check(&buf);
+  check(splitBuf(hex, 11).get());
+
+  auto shortBuf = PktUtil::parseHexData("00 01  08 00  06  04  00 01");
+  Cursor cursor(&shortBuf);
+  EXPECT_THROW(ArpHdrView arp(&cursor), HdrParseError);
+}
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/packet/ICMPErrorTemplate.h"
+
+#include <gtest/gtest.h>
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <folly/MacAddress.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+
+#include "fboss/agent/packet/PktUtil.h"
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+
+namespace {
+
+const MacAddress kDstMac("02:00:00:00:00:01");
+const MacAddress kSrcMac("02:01:02:03:04:05");
+const VlanID kVlan(55);
+
+// A body of the given length, which differs for every length
+std::function<void(RWPrivateCursor*)> bodyFn(uint32_t bodyLength) {
+  return [=](RWPrivateCursor* cursor) {
+    for (uint32_t n = 0; n < bodyLength; ++n) {
+      cursor->write<uint8_t>(n * 7 + bodyLength);
+    }
+  };
+}
+
+std::unique_ptr<IOBuf> createBuf(uint32_t length) {
+  auto buf = IOBuf::create(length);
+  buf->append(length);
+  return buf;
+}
+
+void checkSame(const IOBuf* expected, const IOBuf* actual) {
+  EXPECT_EQ(PktUtil::hexDump(Cursor(expected)),
+            PktUtil::hexDump(Cursor(actual)));
+}
+
+} // unnamed namespace
+
+TEST(ICMPErrorTemplateTest, V4) {
+  IPAddressV4 srcIP("10.0.55.1");
+  ICMPv4ErrorTemplate tmpl(kDstMac, kSrcMac, kVlan, srcIP,
+                           ICMPV4_TYPE_TIME_EXCEEDED,
+                           ICMPV4_CODE_TIME_EXCEEDED_TTL_EXCEEDED);
+  EXPECT_TRUE(tmpl.matches(kDstMac, kSrcMac, kVlan, srcIP,
+                           ICMPV4_TYPE_TIME_EXCEEDED,
+                           ICMPV4_CODE_TIME_EXCEEDED_TTL_EXCEEDED));
+  EXPECT_FALSE(tmpl.matches(kDstMac, kSrcMac, kVlan,
+                            IPAddressV4("10.0.55.2"),
+                            ICMPV4_TYPE_TIME_EXCEEDED,
+                            ICMPV4_CODE_TIME_EXCEEDED_TTL_EXCEEDED));
+
+  // Odd and even body lengths, to several destinations
+  for (uint32_t bodyLength : {0, 7, 32, 36, 1001}) {
+    for (auto dst : {"1.2.3.4", "255.255.255.255", "0.0.0.1"}) {
+      IPAddressV4 dstIP(dst);
+      IPv4Hdr ipv4(srcIP, dstIP, IP_PROTO_ICMP, ICMPHdr::SIZE + bodyLength);
+      ipv4.computeChecksum();
+      ICMPHdr icmp(ICMPV4_TYPE_TIME_EXCEEDED,
+                   ICMPV4_CODE_TIME_EXCEEDED_TTL_EXCEEDED, 0);
+      auto expected = createBuf(ICMPHdr::computeTotalLengthV4(bodyLength));
+      RWPrivateCursor expectedCursor(expected.get());
+      icmp.serializeFullPacket(&expectedCursor, kDstMac, kSrcMac, kVlan,
+                               ipv4, bodyLength, bodyFn(bodyLength));
+
+      EXPECT_EQ(expected->length(),
+                ICMPv4ErrorTemplate::computeTotalLength(bodyLength));
+      auto actual = createBuf(
+          ICMPv4ErrorTemplate::computeTotalLength(bodyLength));
+      RWPrivateCursor actualCursor(actual.get());
+      tmpl.serialize(&actualCursor, dstIP, bodyLength, bodyFn(bodyLength));
+      EXPECT_TRUE(actualCursor.isAtEnd());
+      checkSame(expected.get(), actual.get());
+    }
+  }
+}
+
+TEST(ICMPErrorTemplateTest, V6) {
+  IPAddressV6 srcIP("2401:db00:2110:3055::1");
+  ICMPv6ErrorTemplate tmpl(kDstMac, kSrcMac, kVlan, srcIP,
+                           ICMPV6_TYPE_TIME_EXCEEDED,
+                           ICMPV6_CODE_TIME_EXCEEDED_HOPLIMIT_EXCEEDED);
+  EXPECT_TRUE(tmpl.matches(kDstMac, kSrcMac, kVlan, srcIP,
+                           ICMPV6_TYPE_TIME_EXCEEDED,
+                           ICMPV6_CODE_TIME_EXCEEDED_HOPLIMIT_EXCEEDED));
+  EXPECT_FALSE(tmpl.matches(kDstMac, kSrcMac, VlanID(1), srcIP,
+                            ICMPV6_TYPE_TIME_EXCEEDED,
+                            ICMPV6_CODE_TIME_EXCEEDED_HOPLIMIT_EXCEEDED));
+
+  for (uint32_t bodyLength : {0, 7, 72, 1001, 1232}) {
+    for (auto dst : {"2401:db00:2110:3004::a", "fe80::1", "ffff::ffff"}) {
+      IPAddressV6 dstIP(dst);
+      IPv6Hdr ipv6(srcIP, dstIP);
+      ipv6.trafficClass = 0xe0;
+      ipv6.payloadLength = ICMPHdr::SIZE + bodyLength;
+      ipv6.nextHeader = IP_PROTO_IPV6_ICMP;
+      ipv6.hopLimit = 255;
+      ICMPHdr icmp(ICMPV6_TYPE_TIME_EXCEEDED,
+                   ICMPV6_CODE_TIME_EXCEEDED_HOPLIMIT_EXCEEDED, 0);
+      auto expected = createBuf(ICMPHdr::computeTotalLengthV6(bodyLength));
+      RWPrivateCursor expectedCursor(expected.get());
+      icmp.serializeFullPacket(&expectedCursor, kDstMac, kSrcMac, kVlan,
+                               ipv6, bodyLength, bodyFn(bodyLength));
+
+      EXPECT_EQ(expected->length(),
+                ICMPv6ErrorTemplate::computeTotalLength(bodyLength));
+      auto actual = createBuf(
+          ICMPv6ErrorTemplate::computeTotalLength(bodyLength));
+      RWPrivateCursor actualCursor(actual.get());
+      tmpl.serialize(&actualCursor, dstIP, bodyLength, bodyFn(bodyLength));
+      EXPECT_TRUE(actualCursor.isAtEnd());
+      checkSame(expected.get(), actual.get());
+    }
+  }
+}
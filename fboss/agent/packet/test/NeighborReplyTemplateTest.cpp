@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/packet/NeighborReplyTemplate.h"
+
+#include <gtest/gtest.h>
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <folly/MacAddress.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/packet/NDP.h"
+#include "fboss/agent/packet/PktUtil.h"
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+
+namespace {
+
+const MacAddress kSrcMac("02:01:02:03:04:05");
+const VlanID kVlan(55);
+
+std::unique_ptr<IOBuf> createBuf(uint32_t length) {
+  auto buf = IOBuf::create(length);
+  buf->append(length);
+  memset(buf->writableData(), 0, length);
+  return buf;
+}
+
+void checkSame(const IOBuf* expected, const IOBuf* actual) {
+  EXPECT_EQ(PktUtil::hexDump(Cursor(expected)),
+            PktUtil::hexDump(Cursor(actual)));
+}
+
+} // unnamed namespace
+
+TEST(NeighborReplyTemplateTest, Arp) {
+  IPAddressV4 srcIP("10.0.55.1");
+  ArpReplyTemplate tmpl(kSrcMac, kVlan, srcIP);
+
+  for (auto dst : {"10.0.55.10", "255.255.255.255", "0.0.0.1"}) {
+    IPAddressV4 dstIP(dst);
+    MacAddress dstMac("02:00:00:00:00:01");
+
+    // The reply as ArpHandler used to write it field by field
+    auto expected = createBuf(ArpReplyTemplate::SIZE);
+    RWPrivateCursor cursor(expected.get());
+    cursor.push(dstMac.bytes(), MacAddress::SIZE);
+    cursor.push(kSrcMac.bytes(), MacAddress::SIZE);
+    cursor.writeBE<uint16_t>(0x8100);
+    cursor.writeBE<uint16_t>(kVlan);
+    cursor.writeBE<uint16_t>(0x0806);
+    cursor.writeBE<uint16_t>(1);
+    cursor.writeBE<uint16_t>(0x0800);
+    cursor.writeBE<uint8_t>(6);
+    cursor.writeBE<uint8_t>(4);
+    cursor.writeBE<uint16_t>(2);
+    cursor.push(kSrcMac.bytes(), MacAddress::SIZE);
+    cursor.write<uint32_t>(srcIP.toLong());
+    cursor.push(dstMac.bytes(), MacAddress::SIZE);
+    cursor.write<uint32_t>(dstIP.toLong());
+
+    auto actual = createBuf(ArpReplyTemplate::SIZE);
+    RWPrivateCursor actualCursor(actual.get());
+    tmpl.serialize(&actualCursor, dstMac, dstIP);
+    EXPECT_TRUE(actualCursor.isAtEnd());
+    checkSame(expected.get(), actual.get());
+  }
+}
+
+TEST(NeighborReplyTemplateTest, NeighborAdvertisement) {
+  IPAddressV6 srcIP("2401:db00:2110:3055::1");
+  // Advertisements on behalf of a host leave out the router flag
+  for (bool router : {true, false}) {
+    NeighborAdvertisementTemplate tmpl(kSrcMac, kVlan, srcIP, router);
+
+    for (auto dst : {"2401:db00:2110:3055::a", "fe80::1", "ffff::ffff",
+                     "::"}) {
+      IPAddressV6 dstIP(dst);
+      auto dstMac = dstIP.isZero() ? MacAddress::BROADCAST :
+        MacAddress("02:00:00:00:00:01");
+
+      // Unsolicited advertisements go to all nodes, without the solicited
+      // flag
+      uint32_t flags = router ? 0xa0000000 : 0x20000000;
+      IPAddressV6 ipDst("ff01::1");
+      if (!dstIP.isZero()) {
+        flags |= 0x40000000;
+        ipDst = dstIP;
+      }
+      uint32_t bodyLength = NeighborAdvertisementTemplate::BODY_LENGTH;
+      IPv6Hdr ipv6(srcIP, ipDst);
+      ipv6.trafficClass = 0xe0;
+      ipv6.payloadLength = ICMPHdr::SIZE + bodyLength;
+      ipv6.nextHeader = IP_PROTO_IPV6_ICMP;
+      ipv6.hopLimit = 255;
+      ICMPHdr icmp(ICMPV6_TYPE_NDP_NEIGHBOR_ADVERTISEMENT,
+                   ICMPV6_CODE_NDP_MESSAGE_CODE, 0);
+      auto expected = createBuf(ICMPHdr::computeTotalLengthV6(bodyLength));
+      RWPrivateCursor expectedCursor(expected.get());
+      icmp.serializeFullPacket(&expectedCursor, dstMac, kSrcMac, kVlan,
+                               ipv6, bodyLength,
+                               [&](RWPrivateCursor* cursor) {
+        cursor->writeBE<uint32_t>(flags);
+        cursor->push(srcIP.bytes(), IPAddressV6::byteCount());
+        cursor->write<uint8_t>(NDPOptionType::TARGET_LL_ADDRESS);
+        cursor->write<uint8_t>(NDPOptionLength::TARGET_LL_ADDRESS_IEEE802);
+        cursor->push(kSrcMac.bytes(), MacAddress::SIZE);
+      });
+
+      EXPECT_EQ(expected->length(), NeighborAdvertisementTemplate::SIZE);
+      auto actual = createBuf(NeighborAdvertisementTemplate::SIZE);
+      RWPrivateCursor actualCursor(actual.get());
+      tmpl.serialize(&actualCursor, dstMac, dstIP);
+      EXPECT_TRUE(actualCursor.isAtEnd());
+      checkSame(expected.get(), actual.get());
+    }
+  }
+}
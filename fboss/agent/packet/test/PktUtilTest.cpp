@@ -17,6 +17,8 @@
 #include <folly/Random.h>
 #include <gtest/gtest.h>
 
+#include <vector>
+
 using namespace facebook::fboss;
 using folly::MacAddress;
 using folly::IPAddressV4;
@@ -212,3 +214,66 @@ TEST(Checksum, TestKnownOdd) {
   expected = ~expected;
   EXPECT_EQ(expected, PktUtil::internetChecksum(bytes, 9));
 }
+
+TEST(Checksum, TestChained) {
+  // The same bytes split into buffers of odd and even lengths, so that some
+  // buffers start at odd offsets, checksum the same as in one buffer
+  const size_t size = 3000;
+  std::vector<uint8_t> bytes(size);
+  for (auto& byte : bytes) {
+    byte = Random::rand32(std::numeric_limits<uint8_t>::max());
+  }
+  auto expected = PktUtil::internetChecksum(bytes.data(), size);
+  for (size_t pieceLen : {1, 3, 16, 33, 1499}) {
+    auto buf = IOBuf::copyBuffer(bytes.data(), std::min(pieceLen, size));
+    for (size_t offset = pieceLen; offset < size; offset += pieceLen) {
+      buf->prependChain(IOBuf::copyBuffer(
+          bytes.data() + offset, std::min(pieceLen, size - offset)));
+    }
+    EXPECT_EQ(expected, PktUtil::internetChecksum(buf.get()));
+    EXPECT_EQ(expected, PktUtil::internetChecksum(Cursor(buf.get()), size));
+  }
+
+  // Running past the end of the chain throws, as any cursor read does
+  auto buf = IOBuf::copyBuffer(bytes.data(), 11);
+  buf->prependChain(IOBuf::copyBuffer(bytes.data(), 11));
+  EXPECT_THROW(PktUtil::internetChecksum(Cursor(buf.get()), 23),
+               std::out_of_range);
+}
+
+TEST(Checksum, TestLarge) {
+  // Larger than a vector loop can sum without folding its lanes
+  std::vector<uint8_t> bytes(1 << 20, 0xff);
+  EXPECT_EQ(0, PktUtil::internetChecksum(bytes.data(), bytes.size()));
+  bytes[0] = 0xfe;
+  EXPECT_EQ(0x0100, PktUtil::internetChecksum(bytes.data(), bytes.size()));
+}
+
+TEST(Checksum, TestUpdate) {
+  // An IPv4 header, with its checksum
+  uint8_t hdr[] = {
+    0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11, 0xb8, 0x61,
+    0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7,
+  };
+  EXPECT_EQ(0, PktUtil::internetChecksum(hdr, sizeof(hdr)));
+  auto csum = (uint16_t(hdr[10]) << 8) | hdr[11];
+  auto setCsum = [&](uint16_t value) {
+    hdr[10] = value >> 8;
+    hdr[11] = value & 0xff;
+  };
+
+  // Decrement the TTL
+  uint16_t oldWord = (uint16_t(hdr[8]) << 8) | hdr[9];
+  --hdr[8];
+  uint16_t newWord = (uint16_t(hdr[8]) << 8) | hdr[9];
+  setCsum(PktUtil::updateChecksum(csum, oldWord, newWord));
+  EXPECT_EQ(0, PktUtil::internetChecksum(hdr, sizeof(hdr)));
+
+  // Rewrite the source address
+  csum = (uint16_t(hdr[10]) << 8) | hdr[11];
+  IPAddressV4 oldAddr = IPAddressV4::fromBinary(folly::ByteRange(hdr + 12, 4));
+  IPAddressV4 newAddr("10.11.12.13");
+  memcpy(hdr + 12, newAddr.bytes(), 4);
+  setCsum(PktUtil::updateChecksum(csum, oldAddr, newAddr));
+  EXPECT_EQ(0, PktUtil::internetChecksum(hdr, sizeof(hdr)));
+}
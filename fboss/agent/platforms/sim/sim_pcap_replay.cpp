@@ -0,0 +1,227 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/capture/PcapFileReader.h"
+#include "fboss/agent/capture/PcapPkt.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+#include "fboss/agent/hw/sim/SimPlatform.h"
+#include "fboss/agent/hw/sim/SimSwitch.h"
+#include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/packet/Ethertype.h"
+#include "fboss/agent/packet/HdrParseError.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/Memory.h>
+#include <folly/io/Cursor.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <thread>
+#include <time.h>
+
+/*
+ * Replay the packets of a pcap file into a SimSwitch, as if they had been
+ * received from the hardware, to reproduce ARP/NDP/DHCP storms seen in
+ * production offline and to measure how the agent copes with them.
+ *
+ * The packets are injected at the rate they were captured at, scaled by
+ * --replay_speed, or as fast as possible.  Afterwards, the CPU time spent
+ * handling them is printed per ethertype, along with the number of state
+ * changes they caused and the slowest of those.
+ *
+ * Packets are handled on the injecting thread unless --rx_dispatch is set,
+ * in which case the CPU time measured is only that of queueing them.
+ */
+
+DEFINE_string(replay_pcap, "", "The pcap file to replay");
+DEFINE_string(replay_config, "",
+              "The JSON config to apply to the switch before replaying");
+DEFINE_double(replay_speed, 1.0,
+              "How much faster than captured to replay the packets.  0 "
+              "replays them back to back, as fast as possible");
+DEFINE_int32(replay_loops, 1, "How many times to replay the file");
+DEFINE_int32(replay_port, 1,
+             "The port to inject the packets on, since pcap does not record "
+             "it");
+DEFINE_int32(replay_vlan, 1,
+             "The VLAN to inject untagged packets on.  Tagged packets are "
+             "injected on the VLAN of their tag");
+DEFINE_int32(num_ports, 64, "The number of ports in the simulated switch");
+DEFINE_string(local_mac, "02:00:00:00:00:01",
+              "The local MAC address to use for the switch");
+
+using namespace facebook::fboss;
+using folly::MacAddress;
+using folly::make_unique;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::shared_ptr;
+using std::unique_ptr;
+
+namespace {
+
+struct TypeStats {
+  uint64_t packets{0};
+  nanoseconds cpu{0};
+  nanoseconds maxCpu{0};
+};
+
+nanoseconds cpuTime(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return std::chrono::seconds(ts.tv_sec) + nanoseconds(ts.tv_nsec);
+}
+
+// The VLAN of the packet, and the ethertype of its payload
+std::pair<VlanID, uint16_t> parseEthHdr(const folly::IOBuf* buf) {
+  folly::io::Cursor cursor(buf);
+  try {
+    EthHdr hdr(cursor);
+    auto vlan = hdr.getVlanTags().empty()
+      ? VlanID(FLAGS_replay_vlan)
+      : VlanID(hdr.getVlanTags()[0].vid());
+    return std::make_pair(vlan, hdr.getEtherType());
+  } catch (const HdrParseError&) {
+    return std::make_pair(VlanID(FLAGS_replay_vlan), uint16_t(0));
+  }
+}
+
+const char* etherTypeName(uint16_t etherType) {
+  switch (etherType) {
+    case ETHERTYPE_ARP:
+      return "arp";
+    case ETHERTYPE_IPV4:
+      return "ipv4";
+    case ETHERTYPE_IPV6:
+      return "ipv6";
+    case ETHERTYPE_LLDP:
+      return "lldp";
+    default:
+      return "other";
+  }
+}
+
+unique_ptr<SwSwitch> setupSwitch() {
+  auto platform = make_unique<SimPlatform>(MacAddress(FLAGS_local_mac),
+                                           FLAGS_num_ports);
+  auto sw = make_unique<SwSwitch>(std::move(platform));
+  sw->init();
+  sw->updateStateBlocking("apply replay config",
+                          [&](const shared_ptr<SwitchState>& state) {
+    return applyThriftConfigFile(state, FLAGS_replay_config,
+                                 sw->getPlatform());
+  });
+  sw->initialConfigApplied();
+  sw->fibSynced();
+  return sw;
+}
+
+std::vector<PcapPkt> readPackets() {
+  PcapFileReader reader(FLAGS_replay_pcap);
+  std::vector<PcapPkt> pkts;
+  PcapPkt pkt;
+  while (reader.readPacket(&pkt)) {
+    pkts.push_back(std::move(pkt));
+  }
+  return pkts;
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  if (FLAGS_replay_pcap.empty() || FLAGS_replay_config.empty()) {
+    LOG(ERROR) << "--replay_pcap and --replay_config must be specified";
+    return 1;
+  }
+
+  // Read everything up front, so disk I/O doesn't skew the replay
+  auto pkts = readPackets();
+  if (pkts.empty()) {
+    LOG(ERROR) << FLAGS_replay_pcap << " has no packets";
+    return 1;
+  }
+  auto sw = setupSwitch();
+  auto* sim = static_cast<SimSwitch*>(sw->getHw());
+  sim->resetTxCount();
+
+  std::map<std::string, TypeStats> stats;
+  auto startGeneration = sw->getState()->getGeneration();
+  auto startProcessCpu = cpuTime(CLOCK_PROCESS_CPUTIME_ID);
+  auto start = steady_clock::now();
+  auto captureStart = pkts.front().timestamp();
+  auto captureLength = pkts.back().timestamp() - captureStart;
+  for (int loop = 0; loop < FLAGS_replay_loops; ++loop) {
+    for (const auto& pkt : pkts) {
+      if (FLAGS_replay_speed > 0) {
+        auto offset = (pkt.timestamp() - captureStart) +
+          loop * captureLength;
+        std::this_thread::sleep_until(
+            start + duration_cast<nanoseconds>(offset / FLAGS_replay_speed));
+      }
+
+      auto vlanAndType = parseEthHdr(pkt.buf());
+      auto rxPkt = make_unique<MockRxPacket>(pkt.buf()->clone());
+      rxPkt->setSrcPort(PortID(FLAGS_replay_port));
+      rxPkt->setSrcVlan(vlanAndType.first);
+
+      auto cpuStart = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+      sim->injectPacket(std::move(rxPkt));
+      auto cpu = cpuTime(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+
+      auto& typeStats = stats[etherTypeName(vlanAndType.second)];
+      ++typeStats.packets;
+      typeStats.cpu += cpu;
+      typeStats.maxCpu = std::max(typeStats.maxCpu, cpu);
+    }
+  }
+  auto injected = steady_clock::now();
+
+  // Wait for the state updates the packets scheduled to be applied
+  sw->updateStateBlocking("replay done", [](const shared_ptr<SwitchState>&) {
+    return shared_ptr<SwitchState>();
+  });
+  auto done = steady_clock::now();
+  auto processCpu = cpuTime(CLOCK_PROCESS_CPUTIME_ID) - startProcessCpu;
+
+  auto us = [](nanoseconds ns) {
+    return duration_cast<microseconds>(ns).count();
+  };
+  printf("replayed %zu packets %d times in %ld us, plus %ld us for the "
+         "state updates to drain\n",
+         pkts.size(), FLAGS_replay_loops,
+         us(injected - start), us(done - injected));
+  printf("process cpu: %ld us; packets sent: %lu\n",
+         us(processCpu), sim->getTxCount());
+  printf("%-8s %10s %14s %12s %12s\n",
+         "type", "packets", "handler_us", "avg_ns", "max_ns");
+  for (const auto& entry : stats) {
+    const auto& typeStats = entry.second;
+    printf("%-8s %10lu %14ld %12ld %12ld\n",
+           entry.first.c_str(), typeStats.packets, us(typeStats.cpu),
+           typeStats.cpu.count() / typeStats.packets,
+           typeStats.maxCpu.count());
+  }
+
+  printf("state changes: %u\n",
+         sw->getState()->getGeneration() - startGeneration);
+  for (const auto& profile : sw->getSlowestStateUpdates(5)) {
+    printf("  %-40s %4u updates %10ld us\n", profile.getName().c_str(),
+           profile.numUpdates, profile.total.count());
+  }
+  return 0;
+}
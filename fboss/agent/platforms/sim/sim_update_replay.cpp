@@ -0,0 +1,290 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/AddressUtil.h"
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/PackedRouteDecoder.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/ThriftHandler.h"
+#include "fboss/agent/UpdateRecorder.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+#include "fboss/agent/hw/sim/SimPlatform.h"
+#include "fboss/agent/hw/sim/SimSwitch.h"
+#include "fboss/agent/state/RouteUpdater.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/Memory.h>
+#include <folly/String.h>
+#include <folly/io/IOBuf.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <thread>
+
+/*
+ * Replay an update log recorded with --update_record_file into a SimSwitch,
+ * to reproduce a production incident offline and to measure how long the
+ * agent takes to apply its updates.
+ *
+ * The route calls are applied in blocking state updates, the way the
+ * thrift handler applies them, the neighbor flushes go through the thrift
+ * handler, and the packets are injected as if received from the hardware.
+ * The state update records are not replayed, since their update functions
+ * can't be recorded; the packets and calls that caused them cause them
+ * again, and the recorded counts are printed to compare against.
+ *
+ * The records are replayed at the rate they were recorded at, scaled by
+ * --replay_speed, or back to back.  Afterwards, the latency of each kind of
+ * record is printed, along with the throughput and the slowest state
+ * updates.
+ */
+
+DEFINE_string(replay_log, "", "The update log to replay");
+DEFINE_string(replay_config, "",
+              "The JSON config to apply to the switch before replaying");
+DEFINE_double(replay_speed, 1.0,
+              "How much faster than recorded to replay the updates.  0 "
+              "replays them back to back, as fast as possible");
+DEFINE_int32(num_ports, 64, "The number of ports in the simulated switch");
+DEFINE_string(local_mac, "02:00:00:00:00:01",
+              "The local MAC address to use for the switch");
+
+using namespace facebook::fboss;
+using facebook::network::toIPAddress;
+using folly::MacAddress;
+using folly::make_unique;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::shared_ptr;
+using std::unique_ptr;
+
+namespace {
+
+typedef UpdateLogRecord::Type RecordType;
+
+const RouterID kRouter(0); // The thrift calls only use the default VRF
+
+struct TypeStats {
+  uint64_t routes{0};
+  std::vector<nanoseconds> latencies;
+};
+
+unique_ptr<SwSwitch> setupSwitch() {
+  auto platform = make_unique<SimPlatform>(MacAddress(FLAGS_local_mac),
+                                           FLAGS_num_ports);
+  auto sw = make_unique<SwSwitch>(std::move(platform));
+  sw->init();
+  sw->updateStateBlocking("apply replay config",
+                          [&](const shared_ptr<SwitchState>& state) {
+    return applyThriftConfigFile(state, FLAGS_replay_config,
+                                 sw->getPlatform());
+  });
+  sw->initialConfigApplied();
+  sw->fibSynced();
+  return sw;
+}
+
+std::vector<UpdateLogRecord> readRecords() {
+  UpdateLogReader reader(FLAGS_replay_log);
+  std::vector<UpdateLogRecord> records;
+  UpdateLogRecord record;
+  while (reader.readRecord(&record)) {
+    records.push_back(std::move(record));
+  }
+  return records;
+}
+
+RouteNextHopEntry toNextHopEntry(const UnicastRoute& route,
+                                 AdminDistance distance) {
+  RouteNextHops nexthops;
+  nexthops.reserve(route.nextHopAddrs.size());
+  for (const auto& nh : route.nextHopAddrs) {
+    nexthops.emplace(toIPAddress(nh));
+  }
+  return RouteNextHopEntry(std::move(nexthops), distance);
+}
+
+// Apply a route change in a blocking state update, like the thrift handler
+template<typename UpdateFn>
+void updateRoutes(SwSwitch* sw, folly::StringPiece name, UpdateFn fn) {
+  sw->updateStateBlocking(name, [&](const shared_ptr<SwitchState>& state) {
+    RouteUpdater updater(state->getRouteTables());
+    fn(&updater);
+    auto newRt = updater.updateDone();
+    if (!newRt) {
+      return shared_ptr<SwitchState>();
+    }
+    auto newState = state->clone();
+    newState->resetRouteTables(std::move(newRt));
+    return newState;
+  }, StateUpdatePriority::ROUTE);
+}
+
+// Replay one record, returning the number of routes it held
+uint64_t replay(SwSwitch* sw, ThriftHandler* handler,
+                const UpdateLogRecord& record) {
+  ClientID client(record.arg1);
+  AdminDistance distance = record.arg2;
+  switch (record.type) {
+    case RecordType::ADD_ROUTES: {
+      auto routes = record.getRoutes();
+      updateRoutes(sw, "add unicast route", [&](RouteUpdater* updater) {
+        for (const auto& route : routes) {
+          updater->addRoute(kRouter, toIPAddress(route.dest.ip),
+                            route.dest.prefixLength, client,
+                            toNextHopEntry(route, distance));
+        }
+      });
+      return routes.size();
+    }
+    case RecordType::DELETE_ROUTES: {
+      auto prefixes = record.getPrefixes();
+      updateRoutes(sw, "delete unicast route", [&](RouteUpdater* updater) {
+        for (const auto& prefix : prefixes) {
+          updater->delRoute(kRouter, toIPAddress(prefix.ip),
+                            prefix.prefixLength, client);
+        }
+      });
+      return prefixes.size();
+    }
+    case RecordType::SYNC_FIB: {
+      RouteUpdater::ClientRoutes routes;
+      auto toSync = record.getRoutes();
+      for (const auto& route : toSync) {
+        routes.add(toIPAddress(route.dest.ip), route.dest.prefixLength,
+                   toNextHopEntry(route, distance));
+      }
+      updateRoutes(sw, "sync fib", [&](RouteUpdater* updater) {
+        updater->syncClientRoutes(kRouter, client, std::move(routes));
+      });
+      return toSync.size();
+    }
+    case RecordType::ADD_ROUTES_PACKED: {
+      PackedRouteDecoder decoder(record.getPackedRoutes(), distance);
+      updateRoutes(sw, "add unicast route", [&](RouteUpdater* updater) {
+        decoder.addRoutes(updater, kRouter, client, 0, decoder.size());
+      });
+      return decoder.size();
+    }
+    case RecordType::FLUSH_NEIGHBORS:
+      handler->flushNeighborEntries(
+          make_unique<std::vector<NeighborToFlush>>(record.getNeighbors()));
+      return 0;
+    case RecordType::PACKET: {
+      auto pkt = make_unique<MockRxPacket>(
+          folly::IOBuf::copyBuffer(record.payload));
+      pkt->setSrcPort(PortID(record.arg1));
+      pkt->setSrcVlan(VlanID(record.arg2));
+      static_cast<SimSwitch*>(sw->getHw())->injectPacket(std::move(pkt));
+      return 0;
+    }
+    case RecordType::STATE_UPDATE:
+      return 0;
+  }
+  return 0;
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  if (FLAGS_replay_log.empty() || FLAGS_replay_config.empty()) {
+    LOG(ERROR) << "--replay_log and --replay_config must be specified";
+    return 1;
+  }
+
+  // Read everything up front, so disk I/O doesn't skew the replay
+  auto records = readRecords();
+  if (records.empty()) {
+    LOG(ERROR) << FLAGS_replay_log << " has no records";
+    return 1;
+  }
+  auto sw = setupSwitch();
+  ThriftHandler handler(sw.get());
+
+  std::map<RecordType, TypeStats> stats;
+  std::map<std::string, uint64_t> recordedUpdates;
+  nanoseconds maxBehind{0};
+  auto startGeneration = sw->getState()->getGeneration();
+  auto start = steady_clock::now();
+  for (const auto& record : records) {
+    if (record.type == RecordType::STATE_UPDATE) {
+      ++recordedUpdates[record.payload];
+      continue;
+    }
+    if (FLAGS_replay_speed > 0) {
+      auto due = start + duration_cast<nanoseconds>(
+          record.time / FLAGS_replay_speed);
+      std::this_thread::sleep_until(due);
+      maxBehind = std::max(maxBehind, steady_clock::now() - due);
+    }
+
+    auto& typeStats = stats[record.type];
+    auto recordStart = steady_clock::now();
+    try {
+      typeStats.routes += replay(sw.get(), &handler, record);
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "error replaying " <<
+        UpdateLogRecord::getTypeName(record.type) << " record at " <<
+        record.time.count() << "us: " << folly::exceptionStr(ex);
+    }
+    typeStats.latencies.push_back(steady_clock::now() - recordStart);
+  }
+  auto injected = steady_clock::now();
+
+  // Wait for the state updates the packets scheduled to be applied
+  sw->updateStateBlocking("replay done", [](const shared_ptr<SwitchState>&) {
+    return shared_ptr<SwitchState>();
+  });
+  auto done = steady_clock::now();
+
+  auto us = [](nanoseconds ns) {
+    return duration_cast<microseconds>(ns).count();
+  };
+  auto elapsed = done - start;
+  auto seconds = std::max(elapsed.count(), nanoseconds::rep(1)) / 1e9;
+  printf("replayed %zu records recorded over %ld us in %ld us, plus %ld us "
+         "for the state updates to drain; at most %ld us behind\n",
+         records.size(), records.back().time.count(),
+         us(injected - start), us(done - injected), us(maxBehind));
+  printf("%-18s %8s %10s %10s %10s %10s %12s\n", "type", "records",
+         "routes", "avg_us", "p99_us", "max_us", "routes/s");
+  for (auto& entry : stats) {
+    auto& latencies = entry.second.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    nanoseconds total{0};
+    for (auto latency : latencies) {
+      total += latency;
+    }
+    auto p99 = latencies[(latencies.size() - 1) * 99 / 100];
+    printf("%-18s %8zu %10lu %10ld %10ld %10ld %12.0f\n",
+           UpdateLogRecord::getTypeName(entry.first), latencies.size(),
+           entry.second.routes, us(total) / (long)latencies.size(),
+           us(p99), us(latencies.back()), entry.second.routes / seconds);
+  }
+
+  printf("state changes: %u; recorded state updates:\n",
+         sw->getState()->getGeneration() - startGeneration);
+  for (const auto& entry : recordedUpdates) {
+    printf("  %-40s %8lu\n", entry.first.c_str(), entry.second);
+  }
+  printf("slowest replayed state updates:\n");
+  for (const auto& profile : sw->getSlowestStateUpdates(5)) {
+    printf("  %-40s %4u updates %10ld us\n", profile.getName().c_str(),
+           profile.numUpdates, profile.total.count());
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/AclEntry.h"
+
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/NodeBase-defs.h"
+#include "fboss/agent/state/SwitchState.h"
+
+using folly::MacAddress;
+
+namespace {
+constexpr auto kAclEntryId = "aclEntryId";
+constexpr auto kAction = "action";
+constexpr auto kEtherType = "etherType";
+constexpr auto kDstMac = "dstMac";
+constexpr auto kDstMacMask = "dstMacMask";
+constexpr auto kIpProtocol = "ipProtocol";
+constexpr auto kL4SrcPort = "l4SrcPort";
+constexpr auto kL4DstPort = "l4DstPort";
+constexpr auto kIcmpv6Type = "icmpv6Type";
+constexpr auto kCpuQueue = "cpuQueue";
+}
+
+namespace facebook { namespace fboss {
+
+bool AclEntryFields::Match::operator==(const Match& other) const {
+  return etherType == other.etherType &&
+    dstMac == other.dstMac &&
+    dstMacMask == other.dstMacMask &&
+    ipProtocol == other.ipProtocol &&
+    l4SrcPort == other.l4SrcPort &&
+    l4DstPort == other.l4DstPort &&
+    icmpv6Type == other.icmpv6Type;
+}
+
+folly::dynamic AclEntryFields::toFollyDynamic() const {
+  folly::dynamic entry = folly::dynamic::object;
+  entry[kAclEntryId] = static_cast<uint32_t>(id);
+  auto itr = cfg::_AclAction_VALUES_TO_NAMES.find(action);
+  CHECK(itr != cfg::_AclAction_VALUES_TO_NAMES.end());
+  entry[kAction] = itr->second;
+  entry[kEtherType] = match.etherType;
+  if (match.dstMac) {
+    entry[kDstMac] = match.dstMac->toString();
+    entry[kDstMacMask] = match.dstMacMask.toString();
+  }
+  entry[kIpProtocol] = match.ipProtocol;
+  entry[kL4SrcPort] = match.l4SrcPort;
+  entry[kL4DstPort] = match.l4DstPort;
+  entry[kIcmpv6Type] = match.icmpv6Type;
+  entry[kCpuQueue] = cpuQueue;
+  return entry;
+}
+
+AclEntryFields AclEntryFields::fromFollyDynamic(const folly::dynamic& json) {
+  auto itr = cfg::_AclAction_NAMES_TO_VALUES.find(
+      json[kAction].asString().c_str());
+  CHECK(itr != cfg::_AclAction_NAMES_TO_VALUES.end());
+  AclEntryFields entry(AclEntryID(json[kAclEntryId].asInt()),
+                       cfg::AclAction(itr->second));
+  entry.match.etherType = json[kEtherType].asInt();
+  if (json.count(kDstMac)) {
+    entry.match.dstMac = MacAddress(json[kDstMac].asString());
+  }
+  if (json.count(kDstMacMask)) {
+    entry.match.dstMacMask = MacAddress(json[kDstMacMask].asString());
+  }
+  entry.match.ipProtocol = json[kIpProtocol].asInt();
+  entry.match.l4SrcPort = json[kL4SrcPort].asInt();
+  entry.match.l4DstPort = json[kL4DstPort].asInt();
+  entry.match.icmpv6Type = json[kIcmpv6Type].asInt();
+  entry.cpuQueue = json[kCpuQueue].asInt();
+  return entry;
+}
+
+AclEntry::AclEntry(AclEntryID id, cfg::AclAction action)
+  : NodeBaseT(id, action) {
+}
+
+AclEntry* AclEntry::modify(std::shared_ptr<SwitchState>* state) {
+  if (!isPublished()) {
+    CHECK(!(*state)->isPublished());
+    return this;
+  }
+
+  auto* acls = (*state)->getAcls()->modify(state);
+  auto newEntry = clone();
+  auto* ptr = newEntry.get();
+  acls->updateEntry(std::move(newEntry));
+  return ptr;
+}
+
+template class NodeBaseT<AclEntry, AclEntryFields>;
+
+}} // facebook::fboss
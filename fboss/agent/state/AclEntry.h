@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/gen-cpp/switch_config_types.h"
+#include "fboss/agent/types.h"
+#include "fboss/agent/state/NodeBase.h"
+
+#include <folly/MacAddress.h>
+#include <folly/Optional.h>
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+
+struct AclEntryFields {
+  /*
+   * The fields a packet is matched on.  Each field that is 0, or unset,
+   * matches any packet.
+   */
+  struct Match {
+    uint16_t etherType{0};
+    folly::Optional<folly::MacAddress> dstMac;
+    // The bits of the dstMac that are matched
+    folly::MacAddress dstMacMask{folly::MacAddress::BROADCAST};
+    uint8_t ipProtocol{0};
+    uint16_t l4SrcPort{0};
+    uint16_t l4DstPort{0};
+    uint8_t icmpv6Type{0};
+
+    bool operator==(const Match& other) const;
+    bool operator!=(const Match& other) const {
+      return !operator==(other);
+    }
+  };
+
+  AclEntryFields(AclEntryID id, cfg::AclAction action)
+    : id(id),
+      action(action) {}
+
+  template<typename Fn>
+  void forEachChild(Fn fn) {}
+
+  folly::dynamic toFollyDynamic() const;
+  static AclEntryFields fromFollyDynamic(const folly::dynamic& json);
+
+  const AclEntryID id{0};
+  cfg::AclAction action{cfg::AclAction::DROP};
+  Match match;
+  // The CPU queue of the TRAP, CPU_QUEUE and PUNT actions
+  uint16_t cpuQueue{0};
+};
+
+/*
+ * AclEntry is an entry of the hardware ACL: the action to take on the
+ * packets that match its fields, if no entry with a lower ID matches them
+ * too.
+ */
+class AclEntry : public NodeBaseT<AclEntry, AclEntryFields> {
+ public:
+  typedef AclEntryFields::Match Match;
+
+  AclEntry(AclEntryID id, cfg::AclAction action);
+
+  AclEntryID getID() const {
+    return getFields()->id;
+  }
+
+  cfg::AclAction getAction() const {
+    return getFields()->action;
+  }
+  void setAction(cfg::AclAction action) {
+    writableFields()->action = action;
+  }
+
+  const Match& getMatch() const {
+    return getFields()->match;
+  }
+  void setMatch(const Match& match) {
+    writableFields()->match = match;
+  }
+
+  uint16_t getCpuQueue() const {
+    return getFields()->cpuQueue;
+  }
+  void setCpuQueue(uint16_t queue) {
+    writableFields()->cpuQueue = queue;
+  }
+
+  /*
+   * Whether the entry matches and acts on packets the same way as the
+   * other.
+   */
+  bool isSame(const AclEntry& other) const {
+    return getAction() == other.getAction() &&
+      getMatch() == other.getMatch() &&
+      getCpuQueue() == other.getCpuQueue();
+  }
+
+  AclEntry* modify(std::shared_ptr<SwitchState>* state);
+
+ private:
+  // Inherit the constructors required for clone()
+  using NodeBaseT::NodeBaseT;
+  friend class CloneAllocator;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+#include "fboss/agent/state/NodeMap.h"
+
+namespace facebook { namespace fboss {
+
+class AclEntry;
+class SwitchState;
+typedef NodeMapTraits<AclEntryID, AclEntry> AclMapTraits;
+
+/*
+ * A container for the ACL entries, in order of precedence.
+ */
+class AclMap : public NodeMapT<AclMap, AclMapTraits> {
+ public:
+  AclMap();
+  virtual ~AclMap();
+
+  const std::shared_ptr<AclEntry>& getEntry(AclEntryID id) const {
+    return getNode(id);
+  }
+  std::shared_ptr<AclEntry> getEntryIf(AclEntryID id) const {
+    return getNodeIf(id);
+  }
+
+  AclMap* modify(std::shared_ptr<SwitchState>* state);
+
+  /*
+   * The following functions modify the static state.
+   * These should only be called on unpublished objects which are only visible
+   * to a single thread.
+   */
+
+  void addEntry(const std::shared_ptr<AclEntry>& entry) {
+    addNode(entry);
+  }
+  void updateEntry(const std::shared_ptr<AclEntry>& entry) {
+    updateNode(entry);
+  }
+
+ private:
+  // Inherit the constructors required for clone()
+  using NodeMapT::NodeMapT;
+  friend class CloneAllocator;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/AggregatePort.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/state/AggregatePortMap.h"
+#include "fboss/agent/state/NodeBase-defs.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/Conv.h>
+
+using folly::to;
+using std::string;
+
+namespace {
+constexpr auto kAggregatePortId = "aggregatePortId";
+constexpr auto kName = "name";
+constexpr auto kLacp = "lacp";
+constexpr auto kMembers = "members";
+}
+
+namespace facebook { namespace fboss {
+
+folly::dynamic AggregatePortFields::toFollyDynamic() const {
+  folly::dynamic aggPort = folly::dynamic::object;
+  aggPort[kAggregatePortId] = static_cast<uint16_t>(id);
+  aggPort[kName] = name;
+  aggPort[kLacp] = lacp;
+  aggPort[kMembers] = folly::dynamic::object;
+  for (const auto& member : members) {
+    aggPort[kMembers][to<string>(member.first)] = member.second;
+  }
+  return aggPort;
+}
+
+AggregatePortFields AggregatePortFields::fromFollyDynamic(
+    const folly::dynamic& json) {
+  AggregatePortFields aggPort(AggregatePortID(json[kAggregatePortId].asInt()),
+                              json[kName].asString().toStdString());
+  aggPort.lacp = json[kLacp].asBool();
+  for (const auto& member : json[kMembers].items()) {
+    aggPort.members.emplace(PortID(to<uint16_t>(member.first.asString())),
+                            member.second.asBool());
+  }
+  return aggPort;
+}
+
+AggregatePort::AggregatePort(AggregatePortID id, const std::string& name)
+  : NodeBaseT(id, name) {
+}
+
+bool AggregatePort::isForwarding(PortID port) const {
+  const auto& members = getFields()->members;
+  auto it = members.find(port);
+  return it != members.end() && it->second;
+}
+
+void AggregatePort::setForwarding(PortID port, bool forwarding) {
+  auto& members = writableFields()->members;
+  auto it = members.find(port);
+  if (it == members.end()) {
+    throw FbossError("port ", port, " is not a member of aggregate port ",
+                     getID());
+  }
+  it->second = forwarding;
+}
+
+std::vector<PortID> AggregatePort::getForwardingMembers() const {
+  std::vector<PortID> ports;
+  for (const auto& member : getFields()->members) {
+    if (member.second) {
+      ports.push_back(member.first);
+    }
+  }
+  return ports;
+}
+
+AggregatePort* AggregatePort::modify(std::shared_ptr<SwitchState>* state) {
+  if (!isPublished()) {
+    CHECK(!(*state)->isPublished());
+    return this;
+  }
+
+  auto* aggPorts = (*state)->getAggregatePorts()->modify(state);
+  auto newAggPort = clone();
+  auto* ptr = newAggPort.get();
+  aggPorts->updateAggregatePort(std::move(newAggPort));
+  return ptr;
+}
+
+template class NodeBaseT<AggregatePort, AggregatePortFields>;
+
+}} // facebook::fboss
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+#include "fboss/agent/state/NodeBase.h"
+
+#include <boost/container/flat_map.hpp>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+
+struct AggregatePortFields {
+  /*
+   * The member ports, and whether each of them is forwarding, that is
+   * collecting and distributing traffic for the aggregate port.
+   */
+  typedef boost::container::flat_map<PortID, bool> Members;
+
+  AggregatePortFields(AggregatePortID id, std::string name)
+    : id(id),
+      name(std::move(name)) {}
+
+  template<typename Fn>
+  void forEachChild(Fn fn) {}
+
+  folly::dynamic toFollyDynamic() const;
+  static AggregatePortFields fromFollyDynamic(const folly::dynamic& json);
+
+  const AggregatePortID id{0};
+  std::string name;
+  // Whether members only forward once LACP agrees with the partner.
+  // Otherwise all members forward, as a static LAG.
+  bool lacp{true};
+  Members members;
+};
+
+/*
+ * AggregatePort is a link aggregation group (LAG): a set of ports that
+ * traffic is hashed across as if they were one port.
+ */
+class AggregatePort : public NodeBaseT<AggregatePort, AggregatePortFields> {
+ public:
+  typedef AggregatePortFields::Members Members;
+
+  AggregatePort(AggregatePortID id, const std::string& name);
+
+  AggregatePortID getID() const {
+    return getFields()->id;
+  }
+
+  const std::string& getName() const {
+    return getFields()->name;
+  }
+  void setName(const std::string& name) {
+    writableFields()->name = name;
+  }
+
+  bool isLacpEnabled() const {
+    return getFields()->lacp;
+  }
+  void setLacpEnabled(bool lacp) {
+    writableFields()->lacp = lacp;
+  }
+
+  const Members& getMembers() const {
+    return getFields()->members;
+  }
+  void setMembers(Members members) {
+    writableFields()->members.swap(members);
+  }
+
+  bool isMember(PortID port) const {
+    return getFields()->members.count(port) != 0;
+  }
+  bool isForwarding(PortID port) const;
+  void setForwarding(PortID port, bool forwarding);
+
+  /*
+   * The members that are forwarding, in port order.
+   */
+  std::vector<PortID> getForwardingMembers() const;
+
+  AggregatePort* modify(std::shared_ptr<SwitchState>* state);
+
+ private:
+  // Inherit the constructors required for clone()
+  using NodeBaseT::NodeBaseT;
+  friend class CloneAllocator;
+};
+
+}} // facebook::fboss
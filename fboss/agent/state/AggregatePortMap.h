@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+#include "fboss/agent/state/NodeMap.h"
+
+namespace facebook { namespace fboss {
+
+class AggregatePort;
+class SwitchState;
+typedef NodeMapTraits<AggregatePortID, AggregatePort> AggregatePortMapTraits;
+
+/*
+ * A container for the set of aggregate ports.
+ */
+class AggregatePortMap
+  : public NodeMapT<AggregatePortMap, AggregatePortMapTraits> {
+ public:
+  AggregatePortMap();
+  virtual ~AggregatePortMap();
+
+  const std::shared_ptr<AggregatePort>& getAggregatePort(
+      AggregatePortID id) const {
+    return getNode(id);
+  }
+  std::shared_ptr<AggregatePort> getAggregatePortIf(
+      AggregatePortID id) const {
+    return getNodeIf(id);
+  }
+
+  /*
+   * Get the aggregate port the port is a member of, or null if it is not a
+   * member of any.  There are only ever a few aggregate ports, so this
+   * checks all of them.
+   */
+  std::shared_ptr<AggregatePort> getAggregatePortForMember(
+      PortID port) const;
+
+  AggregatePortMap* modify(std::shared_ptr<SwitchState>* state);
+
+  /*
+   * The following functions modify the static state.
+   * These should only be called on unpublished objects which are only visible
+   * to a single thread.
+   */
+
+  void addAggregatePort(const std::shared_ptr<AggregatePort>& aggPort) {
+    addNode(aggPort);
+  }
+  void updateAggregatePort(const std::shared_ptr<AggregatePort>& aggPort) {
+    updateNode(aggPort);
+  }
+
+ private:
+  // Inherit the constructors required for clone()
+  using NodeMapT::NodeMapT;
+  friend class CloneAllocator;
+};
+
+}} // facebook::fboss
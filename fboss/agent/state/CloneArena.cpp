@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/CloneArena.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <new>
+
+namespace {
+
+// Allocations are aligned for any type, like the memory malloc returns
+const size_t kAlign = 16;
+
+size_t roundUp(size_t size) {
+  return (size + kAlign - 1) & ~(kAlign - 1);
+}
+
+// Every allocation is preceded by a pointer to its slab
+const size_t kAllocHeaderSize = roundUp(sizeof(void*));
+
+thread_local facebook::fboss::CloneArena* tlCurrentArena{nullptr};
+
+}
+
+namespace facebook { namespace fboss {
+
+struct CloneArena::Slab {
+  explicit Slab(size_t size) : size(size) {}
+
+  static size_t headerSize() {
+    return roundUp(sizeof(Slab));
+  }
+  char* data() {
+    return reinterpret_cast<char*>(this) + headerSize();
+  }
+
+  // One reference for each allocation still living in the slab, plus one
+  // for the arena while it is still allocating from the slab
+  std::atomic<size_t> refs{1};
+  const size_t size;
+  size_t used{0};
+};
+
+CloneArena::~CloneArena() {
+  DCHECK_NE(this, tlCurrentArena);
+  if (slab_) {
+    release(slab_);
+  }
+}
+
+CloneArena::Scope::Scope(CloneArena* arena)
+  : prev_(tlCurrentArena) {
+  tlCurrentArena = arena;
+}
+
+CloneArena::Scope::~Scope() {
+  tlCurrentArena = prev_;
+}
+
+CloneArena* CloneArena::current() {
+  return tlCurrentArena;
+}
+
+CloneArena::Slab* CloneArena::newSlab(size_t size) {
+  void* mem = ::operator new(Slab::headerSize() + size);
+  return new(mem) Slab(size);
+}
+
+void CloneArena::release(Slab* slab) {
+  if (slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    slab->~Slab();
+    ::operator delete(slab);
+  }
+}
+
+void* CloneArena::allocate(size_t size) {
+  size_t needed = kAllocHeaderSize + roundUp(size);
+  Slab* slab;
+  if (needed > SLAB_SIZE / 4) {
+    // Large allocations get a slab of their own, rather than wasting what
+    // is left of the current one
+    slab = newSlab(needed);
+    ++numSlabs_;
+  } else {
+    if (!slab_ || slab_->used + needed > slab_->size) {
+      if (slab_) {
+        release(slab_);
+      }
+      slab_ = newSlab(SLAB_SIZE);
+      ++numSlabs_;
+    }
+    slab = slab_;
+  }
+
+  char* p = slab->data() + slab->used;
+  slab->used += needed;
+  slab->refs.fetch_add(1, std::memory_order_relaxed);
+  *reinterpret_cast<Slab**>(p) = slab;
+  if (slab != slab_) {
+    // Drop the arena's reference to a slab it will not allocate from again
+    release(slab);
+  }
+  return p + kAllocHeaderSize;
+}
+
+void CloneArena::deallocate(void* p) {
+  char* header = static_cast<char*>(p) - kAllocHeaderSize;
+  release(*reinterpret_cast<Slab**>(header));
+}
+
+}} // facebook::fboss
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+/*
+ * CloneArena is a slab allocator for the nodes cloned while a batch of
+ * state updates is prepared.
+ *
+ * Preparing a batch clones every node along each modified path, and many of
+ * those clones are discarded again as soon as the next update in the batch
+ * clones them once more.  While a CloneArena::Scope is active on a thread,
+ * NodeBaseT::clone() on that thread allocates nodes (and their shared_ptr
+ * control blocks) by bumping a pointer in the arena's current slab, instead
+ * of a separate malloc for each of them.
+ *
+ * Nodes may outlive the arena, and may be freed from any thread.  Each slab
+ * counts the allocations still living in it, and is freed as soon as the
+ * last of them is freed and the arena has moved on to another slab, so a
+ * long-lived node only ever pins the slab it was allocated from.
+ *
+ * A CloneArena itself may only be used by one thread at a time.
+ */
+class CloneArena {
+ public:
+  enum : size_t { SLAB_SIZE = 16 * 1024 };
+
+  CloneArena() {}
+  ~CloneArena();
+
+  /*
+   * Make an arena the current arena of the calling thread until the Scope
+   * is destroyed.  Scopes can be nested.
+   */
+  class Scope {
+   public:
+    explicit Scope(CloneArena* arena);
+    ~Scope();
+
+   private:
+    // Forbidden copy constructor and assignment operator
+    Scope(Scope const &) = delete;
+    Scope& operator=(Scope const &) = delete;
+
+    CloneArena* prev_{nullptr};
+  };
+
+  /*
+   * The current arena of the calling thread, or null.
+   */
+  static CloneArena* current();
+
+  /*
+   * Allocate size bytes, aligned for any type.
+   */
+  void* allocate(size_t size);
+
+  /*
+   * Free memory returned by allocate().  This does not need the arena that
+   * allocated it, and may be called from any thread.
+   */
+  static void deallocate(void* p);
+
+  /*
+   * The number of slabs this arena has allocated so far.
+   */
+  size_t getNumSlabs() const {
+    return numSlabs_;
+  }
+
+ private:
+  struct Slab;
+
+  // Forbidden copy constructor and assignment operator
+  CloneArena(CloneArena const &) = delete;
+  CloneArena& operator=(CloneArena const &) = delete;
+
+  static Slab* newSlab(size_t size);
+  static void release(Slab* slab);
+
+  Slab* slab_{nullptr};
+  size_t numSlabs_{0};
+};
+
+/*
+ * An allocator that allocates from the current CloneArena of the thread it
+ * was created on, if there is one, and from the heap otherwise.
+ */
+template<typename T>
+class CloneArenaAllocator {
+ public:
+  typedef T value_type;
+
+  template<typename U>
+  struct rebind {
+    typedef CloneArenaAllocator<U> other;
+  };
+
+  CloneArenaAllocator() : arena_(CloneArena::current()) {}
+  template<typename U>
+  CloneArenaAllocator(const CloneArenaAllocator<U>& other)
+    : arena_(other.getArena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_) {
+      return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+    }
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    // The arena may be gone by now, so it is only used to tell where the
+    // memory came from.
+    if (arena_) {
+      CloneArena::deallocate(p);
+      return;
+    }
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  CloneArena* getArena() const {
+    return arena_;
+  }
+
+ private:
+  CloneArena* arena_{nullptr};
+};
+
+template<typename T, typename U>
+bool operator==(const CloneArenaAllocator<T>& lhs,
+                const CloneArenaAllocator<U>& rhs) {
+  return lhs.getArena() == rhs.getArena();
+}
+
+template<typename T, typename U>
+bool operator!=(const CloneArenaAllocator<T>& lhs,
+                const CloneArenaAllocator<U>& rhs) {
+  return !operator==(lhs, rhs);
+}
+
+}} // facebook::fboss
@@ -9,10 +9,13 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <type_traits>
 
+#include "fboss/agent/Utils.h"
+
 namespace facebook { namespace fboss {
 /*
  * A return type so that user-supplied functions can specify if they want to
@@ -31,7 +34,7 @@ enum class LoopAction : uint32_t {
  * caller-supplied functions on each change in a NodeMapDelta.
  *
  * Notably, these are the forEachChanged(), forEachAdded(), and
- * forEachRemoved() functions.
+ * forEachRemoved() functions, and parallelForEachChanged() for large deltas.
  */
 namespace facebook { namespace fboss { namespace DeltaFunctions {
 
@@ -125,4 +128,82 @@ forEachRemoved(const Delta& delta, RemovedFn removedFn, const Args&... args) {
   return LoopAction::CONTINUE;
 }
 
+/*
+ * The changes of a delta, split into chunks of consecutive changes that can
+ * be walked from different threads.  Each chunk can be passed to the
+ * functions above in place of a delta.
+ *
+ * Chunks are handed out to threads as they become idle, by runInParallel(),
+ * so a chunk of expensive changes does not hold up the others.  Callers
+ * that need the results in order keep one result per chunk, and combine
+ * them in chunk order afterwards.
+ */
+template<typename Delta>
+class DeltaChunks {
+ public:
+  typedef typename Delta::Changes Changes;
+  typedef typename Changes::value_type Value;
+  enum : size_t { DEFAULT_CHUNK_SIZE = 256 };
+
+  class Chunk {
+   public:
+    typedef typename Delta::Node Node;
+    Chunk(const Value* begin, const Value* end) : begin_(begin), end_(end) {}
+    const Value* begin() const {
+      return begin_;
+    }
+    const Value* end() const {
+      return end_;
+    }
+
+   private:
+    const Value* begin_;
+    const Value* end_;
+  };
+
+  explicit DeltaChunks(const Delta& delta,
+                       size_t chunkSize = DEFAULT_CHUNK_SIZE)
+    : changes_(delta.collectChanges()),
+      chunkSize_(std::max(chunkSize, size_t(1))) {}
+
+  // The number of chunks
+  size_t size() const {
+    return (changes_->size() + chunkSize_ - 1) / chunkSize_;
+  }
+  Chunk operator[](size_t index) const {
+    const auto* begin = changes_->data() + index * chunkSize_;
+    const auto* end = changes_->data() +
+      std::min(changes_->size(), (index + 1) * chunkSize_);
+    return Chunk(begin, end);
+  }
+
+ private:
+  std::shared_ptr<const Changes> changes_;
+  size_t chunkSize_;
+};
+
+/*
+ * Invoke the specified functions for each modified, added, and removed node,
+ * like forEachChanged(), but from up to maxThreads threads at once.
+ *
+ * The functions must be safe to call concurrently, and are called in no
+ * particular order.  Returning LoopAction::BREAK only stops the chunk it
+ * was returned for.  This is meant for work that only computes software
+ * objects; anything touching shared state has to be done afterwards.
+ */
+template<typename Delta,
+         typename ChangedFn, typename AddFn, typename RemoveFn,
+         typename... Args>
+void parallelForEachChanged(const Delta& delta,
+                            size_t maxThreads,
+                            ChangedFn changedFn,
+                            AddFn addedFn,
+                            RemoveFn removedFn,
+                            const Args&... args) {
+  DeltaChunks<Delta> chunks(delta);
+  runInParallel(chunks.size(), maxThreads, [&] (size_t i) {
+    forEachChanged(chunks[i], changedFn, addedFn, removedFn, args...);
+  });
+}
+
 }}} // facebook::fboss::DeltaFunctions
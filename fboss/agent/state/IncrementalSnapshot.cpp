@@ -0,0 +1,264 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/IncrementalSnapshot.h"
+
+#include "fboss/agent/SysError.h"
+#include "fboss/agent/state/AclEntry.h"
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteTable.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteTableRib.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/StateSnapshot.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <folly/File.h>
+#include <folly/MemoryMapping.h>
+#include <glog/logging.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+
+using folly::ByteRange;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::StringPiece;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+
+namespace {
+
+// The keys of the objects laid out by IncrementalSnapshot.  These have to
+// match SwitchStateFields, RouteTableFields and NodeMapT::toFollyDynamic().
+constexpr auto kInterfaces = "interfaces";
+constexpr auto kPorts = "ports";
+constexpr auto kAggregatePorts = "aggregatePorts";
+constexpr auto kVlans = "vlans";
+constexpr auto kRouteTables = "routeTables";
+constexpr auto kAcls = "acls";
+constexpr auto kDefaultVlan = "defaultVlan";
+constexpr auto kRouterId = "routerId";
+constexpr auto kRibV4 = "ribV4";
+constexpr auto kRibV6 = "ribV6";
+constexpr auto kEntries = "entries";
+constexpr auto kExtraFields = "extraFields";
+
+}
+
+namespace facebook { namespace fboss {
+
+/*
+ * The encodings of the nodes of one NodeMapT, by key.
+ */
+template<typename MapT>
+class IncrementalSnapshot::EncodedNodes {
+ public:
+  typedef typename MapT::KeyType KeyType;
+
+  /*
+   * Re-encode the nodes added or changed by the delta, and drop the ones it
+   * removed.  Returns the number of nodes encoded.
+   */
+  template<typename DeltaT>
+  size_t update(const DeltaT& delta) {
+    size_t numEncoded = 0;
+    for (const auto& entry : delta) {
+      const auto& node = entry.getNew();
+      if (!node) {
+        nodes_.erase(MapT::Traits::getKey(entry.getOld()));
+        continue;
+      }
+      auto& data = nodes_[MapT::Traits::getKey(node)];
+      data.clear();
+      StateSnapshot::encodeValue(node->toFollyDynamic(), &data);
+      ++numEncoded;
+    }
+    return numEncoded;
+  }
+
+  const string& get(const shared_ptr<typename MapT::Node>& node) const {
+    auto it = nodes_.find(MapT::Traits::getKey(node));
+    CHECK(it != nodes_.end()) << "node missing from incremental snapshot";
+    return it->second;
+  }
+
+ private:
+  std::map<KeyType, string> nodes_;
+};
+
+struct IncrementalSnapshot::EncodedRouteTable {
+  EncodedNodes<RouteTableRib<IPAddressV4>> ribV4;
+  EncodedNodes<RouteTableRib<IPAddressV6>> ribV6;
+};
+
+IncrementalSnapshot::IncrementalSnapshot()
+  : state_(make_shared<SwitchState>()),
+    interfaces_(new EncodedNodes<InterfaceMap>()),
+    ports_(new EncodedNodes<PortMap>()),
+    aggregatePorts_(new EncodedNodes<AggregatePortMap>()),
+    vlans_(new EncodedNodes<VlanMap>()),
+    acls_(new EncodedNodes<AclMap>()) {
+  layout();
+}
+
+IncrementalSnapshot::~IncrementalSnapshot() {
+}
+
+void IncrementalSnapshot::update(const shared_ptr<SwitchState>& state) {
+  StateDelta delta(state_, state);
+  numEncoded_ = 0;
+  numEncoded_ += interfaces_->update(delta.getIntfsDelta());
+  numEncoded_ += ports_->update(delta.getPortsDelta());
+  numEncoded_ += aggregatePorts_->update(delta.getAggregatePortsDelta());
+  numEncoded_ += vlans_->update(delta.getVlansDelta());
+  for (const auto& entry : delta.getRouteTablesDelta()) {
+    const auto& table = entry.getNew();
+    if (!table) {
+      routeTables_.erase(entry.getOld()->getID());
+      continue;
+    }
+    auto& encoded = routeTables_[table->getID()];
+    if (!encoded) {
+      encoded.reset(new EncodedRouteTable());
+    }
+    numEncoded_ += encoded->ribV4.update(entry.getRoutesV4Delta());
+    numEncoded_ += encoded->ribV6.update(entry.getRoutesV6Delta());
+  }
+  numEncoded_ += acls_->update(delta.getAclsDelta());
+  state_ = state;
+  layout();
+}
+
+void IncrementalSnapshot::layout() {
+  pieces_.clear();
+  scratch_.clear();
+  size_ = 0;
+  // The header needs the length of the rest, so it is filled in last
+  pieces_.emplace_back();
+
+  // The same layout as SwitchStateFields::toFollyDynamic()
+  addObjectStart(7);
+  addValue(kInterfaces);
+  addArray(*state_->getInterfaces(), *interfaces_);
+  addValue(kPorts);
+  addNodeMap(*state_->getPorts(), *ports_);
+  addValue(kAggregatePorts);
+  addNodeMap(*state_->getAggregatePorts(), *aggregatePorts_);
+  addValue(kVlans);
+  addNodeMap(*state_->getVlans(), *vlans_);
+
+  const auto& routeTables = state_->getRouteTables();
+  addValue(kRouteTables);
+  addObjectStart(2);
+  addValue(kEntries);
+  addArrayStart(routeTables->size());
+  for (const auto& table : *routeTables) {
+    const auto& encoded = routeTables_.at(table->getID());
+    addObjectStart(3);
+    addValue(kRouterId);
+    addValue(static_cast<uint32_t>(table->getID()));
+    addValue(kRibV4);
+    addNodeMap(*table->getRibV4(), encoded->ribV4);
+    addValue(kRibV6);
+    addNodeMap(*table->getRibV6(), encoded->ribV6);
+  }
+  addValue(kExtraFields);
+  addValue(routeTables->getExtraFields().toFollyDynamic());
+
+  addValue(kAcls);
+  addNodeMap(*state_->getAcls(), *acls_);
+
+  addValue(kDefaultVlan);
+  addValue(static_cast<uint32_t>(state_->getDefaultVlan()));
+
+  header_ = StateSnapshot::encodeHeader(size_);
+  pieces_[0] = ByteRange(StringPiece(header_));
+  size_ += header_.size();
+}
+
+void IncrementalSnapshot::addPiece(const string& data) {
+  pieces_.push_back(ByteRange(StringPiece(data)));
+  size_ += data.size();
+}
+
+void IncrementalSnapshot::addValue(const folly::dynamic& value) {
+  scratch_.emplace_back();
+  StateSnapshot::encodeValue(value, &scratch_.back());
+  addPiece(scratch_.back());
+}
+
+void IncrementalSnapshot::addArrayStart(size_t count) {
+  scratch_.emplace_back();
+  StateSnapshot::encodeArrayStart(count, &scratch_.back());
+  addPiece(scratch_.back());
+}
+
+void IncrementalSnapshot::addObjectStart(size_t count) {
+  scratch_.emplace_back();
+  StateSnapshot::encodeObjectStart(count, &scratch_.back());
+  addPiece(scratch_.back());
+}
+
+template<typename MapT>
+void IncrementalSnapshot::addArray(const MapT& map,
+                                   const EncodedNodes<MapT>& nodes) {
+  addArrayStart(map.size());
+  for (const auto& node : map) {
+    addPiece(nodes.get(node));
+  }
+}
+
+template<typename MapT>
+void IncrementalSnapshot::addNodeMap(const MapT& map,
+                                     const EncodedNodes<MapT>& nodes) {
+  addObjectStart(2);
+  addValue(kEntries);
+  addArray(map, nodes);
+  addValue(kExtraFields);
+  addValue(map.getExtraFields().toFollyDynamic());
+}
+
+void IncrementalSnapshot::writeFile(const string& filename) const {
+  auto tmpFilename = filename + ".tmp";
+  {
+    folly::MemoryMapping mapping(
+        folly::File(tmpFilename, O_RDWR | O_CREAT | O_TRUNC),
+        0, size_, folly::MemoryMapping::writable());
+    auto out = mapping.writableRange();
+    for (const auto& piece : pieces_) {
+      memcpy(out.data(), piece.data(), piece.size());
+      out.advance(piece.size());
+    }
+    // Once written to the mapping the data is in the page cache, and
+    // survives a crash of this process.
+  }
+  if (rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+    throw SysError(errno, "error renaming ", tmpFilename, " to ", filename);
+  }
+}
+
+string IncrementalSnapshot::toString() const {
+  string out;
+  out.reserve(size_);
+  for (const auto& piece : pieces_) {
+    out.append(reinterpret_cast<const char*>(piece.data()), piece.size());
+  }
+  return out;
+}
+
+}} // facebook::fboss
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+class AclMap;
+class AggregatePortMap;
+class InterfaceMap;
+class PortMap;
+class SwitchState;
+class VlanMap;
+
+/*
+ * IncrementalSnapshot keeps a StateSnapshot encoding of the SwitchState up
+ * to date as the state changes, without re-encoding the whole state each
+ * time.
+ *
+ * The encoding of each port, aggregate port, VLAN, interface, route and ACL
+ * entry is kept separately.
+ * update() uses a StateDelta against the state it last saw to re-encode
+ * only the nodes that changed since, and then lays out the snapshot as a
+ * list of pieces pointing at those encodings.  So a checkpoint of a large
+ * RIB with a few changed routes costs a few route encodings and a copy,
+ * rather than a conversion of every route to folly::dynamic.
+ *
+ * The snapshot is a regular StateSnapshot, and is read back with
+ * StateSnapshot::readFile().
+ *
+ * This class is not thread safe.
+ */
+class IncrementalSnapshot {
+ public:
+  IncrementalSnapshot();
+  ~IncrementalSnapshot();
+
+  /*
+   * Bring the snapshot up to date with the specified published state.
+   */
+  void update(const std::shared_ptr<SwitchState>& state);
+
+  /*
+   * Write the snapshot to the specified file.  The snapshot is copied into
+   * a memory mapped temporary file, which is then renamed over the old one,
+   * so a crash never leaves a partially written snapshot behind.
+   *
+   * Throws an exception on error.
+   */
+  void writeFile(const std::string& filename) const;
+
+  /*
+   * Return the snapshot.  This copies all of it, so it is mostly useful for
+   * testing.
+   */
+  std::string toString() const;
+
+  /*
+   * The size of the snapshot, in bytes.
+   */
+  size_t size() const {
+    return size_;
+  }
+
+  /*
+   * The number of nodes that the last update() had to encode.
+   */
+  size_t getNumEncoded() const {
+    return numEncoded_;
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  IncrementalSnapshot(IncrementalSnapshot const &) = delete;
+  IncrementalSnapshot& operator=(IncrementalSnapshot const &) = delete;
+
+  template<typename MapT> class EncodedNodes;
+  struct EncodedRouteTable;
+
+  void layout();
+  void addPiece(const std::string& data);
+  void addValue(const folly::dynamic& value);
+  void addArrayStart(size_t count);
+  void addObjectStart(size_t count);
+  template<typename MapT>
+  void addArray(const MapT& map, const EncodedNodes<MapT>& nodes);
+  template<typename MapT>
+  void addNodeMap(const MapT& map, const EncodedNodes<MapT>& nodes);
+
+  std::shared_ptr<SwitchState> state_;
+
+  std::unique_ptr<EncodedNodes<InterfaceMap>> interfaces_;
+  std::unique_ptr<EncodedNodes<PortMap>> ports_;
+  std::unique_ptr<EncodedNodes<AggregatePortMap>> aggregatePorts_;
+  std::unique_ptr<EncodedNodes<VlanMap>> vlans_;
+  std::map<RouterID, std::unique_ptr<EncodedRouteTable>> routeTables_;
+  std::unique_ptr<EncodedNodes<AclMap>> acls_;
+
+  /*
+   * The snapshot, as the pieces to concatenate.  They point into the node
+   * encodings above, or into scratch_ for the small pieces in between.
+   */
+  std::vector<folly::ByteRange> pieces_;
+  std::deque<std::string> scratch_;
+  std::string header_;
+  size_t size_{0};
+  size_t numEncoded_{0};
+};
+
+}} // facebook::fboss
@@ -14,6 +14,10 @@
 #include "fboss/agent/state/NodeBase-defs.h"
 #include "fboss/agent/state/SwitchState.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 using folly::IPAddress;
 using folly::MacAddress;
 using folly::to;
@@ -28,6 +32,7 @@ constexpr auto kName = "name";
 constexpr auto kMac = "mac";
 constexpr auto kAddresses = "addresses";
 constexpr auto kNdpConfig = "ndpConfig";
+constexpr auto kMtu = "mtu";
 }
 
 namespace facebook { namespace fboss {
@@ -46,6 +51,10 @@ InterfaceFields InterfaceFields::fromFollyDynamic(const folly::dynamic& json) {
   }
   serializer.deserialize(toJson(json[kNdpConfig]),
       &intfFields.ndp);
+  // State saved by older versions does not have an MTU
+  if (json.count(kMtu)) {
+    intfFields.mtu = json[kMtu].asInt();
+  }
   return intfFields;
 }
 
@@ -66,11 +75,87 @@ folly::dynamic InterfaceFields::toFollyDynamic() const {
   string ndpCfgJson;
   serializer.serialize(ndp, &ndpCfgJson);
   intf[kNdpConfig] = folly::parseJson(ndpCfgJson);
+  intf[kMtu] = mtu;
   return intf;
 }
 
+/*
+ * The subnets of the addresses, grouped by prefix length.  A destination is
+ * masked once per distinct prefix length of its address family, which is
+ * usually only one or two, rather than checked against every address.
+ */
+struct Interface::SubnetIndex {
+  // The first address in each subnet of one prefix length
+  struct Subnets {
+    uint8_t length;
+    std::unordered_map<IPAddress, size_t> firstAddr;
+  };
+
+  explicit SubnetIndex(const Addresses& addrs);
+
+  /*
+   * Return the position of the first address whose subnet contains dest,
+   * or the number of addresses if there is none.
+   */
+  size_t find(const IPAddress& dest) const;
+
+  std::vector<Subnets> subnetsV4;
+  std::vector<Subnets> subnetsV6;
+  size_t numAddrs;
+};
+
+Interface::SubnetIndex::SubnetIndex(const Addresses& addrs)
+  : numAddrs(addrs.size()) {
+  size_t pos = 0;
+  for (const auto& addr : addrs) {
+    auto& subnets = addr.first.isV4() ? subnetsV4 : subnetsV6;
+    auto it = std::find_if(subnets.begin(), subnets.end(),
+                           [&](const Subnets& s) {
+                             return s.length == addr.second;
+                           });
+    if (it == subnets.end()) {
+      subnets.push_back(Subnets{addr.second, {}});
+      it = subnets.end() - 1;
+    }
+    // Keep the first address of each subnet, like a linear search would
+    it->firstAddr.emplace(addr.first.mask(addr.second), pos);
+    ++pos;
+  }
+}
+
+size_t Interface::SubnetIndex::find(const IPAddress& dest) const {
+  const auto& subnets = dest.isV4() ? subnetsV4 : subnetsV6;
+  size_t found = numAddrs;
+  for (const auto& s : subnets) {
+    auto it = s.firstAddr.find(dest.mask(s.length));
+    if (it != s.firstAddr.end() && it->second < found) {
+      found = it->second;
+    }
+  }
+  return found;
+}
+
+void Interface::publish() {
+  if (isPublished()) {
+    return;
+  }
+  // IPv4-mapped addresses match subnets of the other address family, which
+  // the index doesn't handle, so they are left to the linear search.
+  const auto& addrs = getAddresses();
+  if (std::none_of(addrs.begin(), addrs.end(),
+                   [](const Addresses::value_type& addr) {
+                     return addr.first.isIPv4Mapped();
+                   })) {
+    subnetIndex_ = std::make_shared<SubnetIndex>(addrs);
+  }
+  NodeBaseT::publish();
+}
+
 Interface::Addresses::const_iterator Interface::getAddressToReach(
     const folly::IPAddress& dest) const {
+  if (subnetIndex_ && !dest.isIPv4Mapped()) {
+    return getAddresses().begin() + subnetIndex_->find(dest);
+  }
   for (auto iter = getAddresses().begin();
        iter != getAddresses().end();
        iter ++) {
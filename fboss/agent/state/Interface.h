@@ -25,6 +25,7 @@ class SwitchState;
 
 struct InterfaceFields {
   typedef boost::container::flat_map<folly::IPAddress, uint8_t> Addresses;
+  enum : uint32_t { DEFAULT_MTU = 1500 };
 
   InterfaceFields(InterfaceID id, RouterID router, VlanID vlan,
                   folly::StringPiece name, folly::MacAddress mac)
@@ -53,6 +54,7 @@ struct InterfaceFields {
   folly::MacAddress mac;
   Addresses addrs;
   cfg::NdpConfig ndp;
+  uint32_t mtu{DEFAULT_MTU};
 };
 
 /*
@@ -110,7 +112,10 @@ class Interface : public NodeBaseT<Interface, InterfaceFields> {
   }
 
   /**
-   * Find the interface IP address to reach the given destination
+   * Find the interface IP address to reach the given destination.
+   *
+   * Published interfaces look the destination up in an index of their
+   * subnets, rather than checking every address.
    */
   Addresses::const_iterator getAddressToReach(
       const folly::IPAddress& dest) const;
@@ -127,6 +132,13 @@ class Interface : public NodeBaseT<Interface, InterfaceFields> {
     writableFields()->ndp = ndp;
   }
 
+  uint32_t getMtu() const {
+    return getFields()->mtu;
+  }
+  void setMtu(uint32_t mtu) {
+    writableFields()->mtu = mtu;
+  }
+
   /*
    * A utility function to check if an IP address is in a locally attached
    * subnet on the given interface.
@@ -138,10 +150,24 @@ class Interface : public NodeBaseT<Interface, InterfaceFields> {
                            InterfaceID intfID,
                            const std::shared_ptr<SwitchState>& state);
 
+  /*
+   * Build the subnet index, and publish the interface.
+   */
+  void publish() override;
+
  private:
+  struct SubnetIndex;
+
   // Inherit the constructors required for clone()
   using NodeBaseT::NodeBaseT;
   friend class CloneAllocator;
+
+  /*
+   * The position in the addresses of the first address in each subnet.
+   * This is built by publish(), and so is null while the interface can
+   * still be modified.  Clones start without one.
+   */
+  std::shared_ptr<const SubnetIndex> subnetIndex_;
 };
 
 }} // facebook::fboss
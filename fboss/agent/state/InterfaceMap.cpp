@@ -24,24 +24,40 @@ InterfaceMap::InterfaceMap() {
 InterfaceMap::~InterfaceMap() {
 }
 
-std::shared_ptr<Interface>
-InterfaceMap::getInterfaceIf(RouterID router, const IPAddress& ip) const {
+const std::shared_ptr<Interface>* InterfaceMap::findInterface(
+    RouterID router, const IPAddress& ip) const {
+  if (addrIndex_) {
+    auto it = addrIndex_->find(ip);
+    if (it != addrIndex_->end()) {
+      for (const auto& intf : it->second) {
+        if (intf->getRouterID() == router) {
+          return &intf;
+        }
+      }
+    }
+    return nullptr;
+  }
   for (auto itr = begin(); itr != end(); ++itr) {
     if ((*itr)->getRouterID() == router && (*itr)->hasAddress(ip)) {
-      return *itr;
+      return &(*itr);
     }
   }
   return nullptr;
 }
 
+std::shared_ptr<Interface>
+InterfaceMap::getInterfaceIf(RouterID router, const IPAddress& ip) const {
+  auto* intf = findInterface(router, ip);
+  return intf ? *intf : nullptr;
+}
+
 const std::shared_ptr<Interface>&
 InterfaceMap::getInterface(RouterID router, const IPAddress& ip) const {
-  for (auto itr = begin(); itr != end(); ++itr) {
-    if ((*itr)->getRouterID() == router && (*itr)->hasAddress(ip)) {
-      return *itr;
-    }
+  auto* intf = findInterface(router, ip);
+  if (!intf) {
+    throw FbossError("No interface with ip : ", ip);
   }
-  throw FbossError("No interface with ip : ", ip);
+  return *intf;
 }
 
 InterfaceMap::Interfaces
@@ -86,6 +102,28 @@ folly::dynamic InterfaceMap::toFollyDynamic() const {
   return intfs;
 }
 
+void InterfaceMap::writeJson(JsonStreamWriter* writer) const {
+  writer->beginArray();
+  for (const auto& intf: *this) {
+    intf->writeJson(writer);
+  }
+  writer->endArray();
+}
+
+void InterfaceMap::publish() {
+  if (isPublished()) {
+    return;
+  }
+  auto index = std::make_shared<AddressIndex>();
+  for (const auto& intf : *this) {
+    for (const auto& addr : intf->getAddresses()) {
+      (*index)[addr.first].push_back(intf);
+    }
+  }
+  addrIndex_ = std::move(index);
+  NodeMapT::publish();
+}
+
 std::shared_ptr<InterfaceMap>
 InterfaceMap::fromFollyDynamic(const folly::dynamic& intfMapJson) {
   auto intfMap = std::make_shared<InterfaceMap>();
@@ -8,6 +8,7 @@
  *
  */
 #pragma once
+#include <unordered_map>
 #include <vector>
 #include <folly/IPAddress.h>
 #include "fboss/agent/types.h"
@@ -47,6 +48,9 @@ class InterfaceMap : public NodeMapT<InterfaceMap, InterfaceMapTraits> {
    *  interfaces have the same address (unlikely) we return the
    *  first one. If no interface is found that has the given IP,
    *  we return null.
+   *
+   *  Published maps look the address up in an index of the addresses of
+   *  all their interfaces, rather than checking every interface.
    */
   std::shared_ptr<Interface> getInterfaceIf(
       RouterID router, const folly::IPAddress& ip) const;
@@ -96,15 +100,37 @@ class InterfaceMap : public NodeMapT<InterfaceMap, InterfaceMapTraits> {
    * Serialize to a folly::dynamic object
    */
   folly::dynamic toFollyDynamic() const;
+  /*
+   * Write the same JSON as toFollyDynamic(), one interface at a time
+   */
+  void writeJson(JsonStreamWriter* writer) const;
   /*
    * Deserialize from a folly::dynamic object
    */
   static std::shared_ptr<InterfaceMap>
     fromFollyDynamic(const folly::dynamic& intfMapJson);
+
+  /*
+   * Build the address index, and publish the map.
+   */
+  void publish() override;
+
  private:
+  typedef std::unordered_map<folly::IPAddress, Interfaces> AddressIndex;
+
   // Inherit the constructors required for clone()
   using NodeMapT::NodeMapT;
   friend class CloneAllocator;
+
+  const std::shared_ptr<Interface>* findInterface(
+      RouterID router, const folly::IPAddress& ip) const;
+
+  /*
+   * The interfaces with each address, in map order.  This is built by
+   * publish(), and so is null while the map can still be modified.
+   * Clones start without one.
+   */
+  std::shared_ptr<const AddressIndex> addrIndex_;
 };
 
 }} // facebook::fboss
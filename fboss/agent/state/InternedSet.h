@@ -0,0 +1,185 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace facebook { namespace fboss {
+
+/*
+ * InternedSet is a handle to an immutable, shared copy of a set.
+ *
+ * Equal sets are only ever stored once: creating an InternedSet looks the
+ * set up in a process-wide table, and shares the copy already there if
+ * there is one.  So handles to equal sets point to the same copy, and
+ * comparing two handles is a pointer compare.
+ *
+ * This is meant for the nexthop sets of routes.  A large FIB has hundreds
+ * of thousands of routes, but only a handful of distinct ECMP groups, so
+ * each route holds a pointer rather than its own copy of the set.
+ *
+ * The copies are reference counted, and removed from the table once the
+ * last handle to them is destroyed.  A handle is a single pointer, the
+ * same size as a raw pointer.  Handles may be created, copied and
+ * destroyed from any thread.
+ */
+template<typename SetT, typename HashT>
+class InternedSet {
+ public:
+  typedef SetT Set;
+
+  /*
+   * A handle to the empty set.
+   */
+  InternedSet() : node_(emptyNode()) {
+    addRef(node_);
+  }
+  explicit InternedSet(SetT set) : node_(intern(std::move(set))) {}
+
+  InternedSet(const InternedSet& other) : node_(other.node_) {
+    addRef(node_);
+  }
+  InternedSet(InternedSet&& other) noexcept : node_(other.node_) {
+    other.node_ = nullptr;
+  }
+  InternedSet& operator=(InternedSet other) noexcept {
+    std::swap(node_, other.node_);
+    return *this;
+  }
+  ~InternedSet() {
+    if (node_) {
+      release(node_);
+    }
+  }
+
+  const SetT& get() const {
+    return node_->set;
+  }
+  const SetT& operator*() const {
+    return node_->set;
+  }
+  const SetT* operator->() const {
+    return &node_->set;
+  }
+
+  bool operator==(const InternedSet& other) const {
+    return node_ == other.node_;
+  }
+  bool operator!=(const InternedSet& other) const {
+    return !operator==(other);
+  }
+
+  /*
+   * A hash of the handle.  This is cheap, since it only hashes the pointer,
+   * but it is not stable across processes.
+   */
+  size_t hash() const {
+    return std::hash<const Node*>()(node_);
+  }
+
+  /*
+   * The number of distinct sets currently interned.
+   */
+  static size_t numInterned() {
+    auto* table = getTable();
+    std::lock_guard<std::mutex> g(table->lock);
+    return table->nodes.size();
+  }
+
+ private:
+  /*
+   * The reference count is kept with the set, rather than in a separate
+   * shared_ptr control block, so a handle is a single pointer.
+   */
+  struct Node {
+    Node(SetT set, size_t hash) : set(std::move(set)), hash(hash) {}
+
+    std::atomic<uint32_t> refs{1};
+    const SetT set;
+    const size_t hash;
+  };
+  struct Table {
+    std::mutex lock;
+    std::unordered_multimap<size_t, Node*> nodes;
+  };
+
+  static Table* getTable() {
+    // Never destroyed, since handles in other static objects may outlive it
+    static Table* table = new Table();
+    return table;
+  }
+
+  static Node* emptyNode() {
+    // Holds a reference for good, so the empty set is never freed
+    static InternedSet* empty = new InternedSet(SetT());
+    return empty->node_;
+  }
+
+  static void addRef(Node* node) {
+    node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Takes a reference unless the last one is already gone, and the node is
+  // about to be removed
+  static bool tryAddRef(Node* node) {
+    auto refs = node->refs.load(std::memory_order_relaxed);
+    while (refs != 0) {
+      if (node->refs.compare_exchange_weak(refs, refs + 1,
+                                           std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void release(Node* node) {
+    if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    auto* table = getTable();
+    {
+      std::lock_guard<std::mutex> g(table->lock);
+      auto range = table->nodes.equal_range(node->hash);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == node) {
+          table->nodes.erase(it);
+          break;
+        }
+      }
+    }
+    delete node;
+  }
+
+  static Node* intern(SetT set) {
+    size_t hash = HashT()(set);
+    auto* table = getTable();
+    std::lock_guard<std::mutex> g(table->lock);
+    auto range = table->nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      // A node whose last reference is gone is skipped; release() removes
+      // it from the table as soon as it gets the lock.
+      if (it->second->set == set && tryAddRef(it->second)) {
+        return it->second;
+      }
+    }
+    auto* node = new Node(std::move(set), hash);
+    table->nodes.emplace(hash, node);
+    return node;
+  }
+
+  Node* node_{nullptr};
+};
+
+}} // facebook::fboss
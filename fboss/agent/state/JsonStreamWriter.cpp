@@ -0,0 +1,181 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/JsonStreamWriter.h"
+
+#include "fboss/agent/SysError.h"
+
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/json.h>
+#include <glog/logging.h>
+
+#include <fcntl.h>
+
+using folly::IOBuf;
+using folly::StringPiece;
+using std::string;
+using std::unique_ptr;
+
+namespace {
+
+// The same indentation as toPrettyJson()
+const size_t kIndent = 2;
+
+folly::json::serialization_opts prettyOpts() {
+  folly::json::serialization_opts opts;
+  opts.pretty_formatting = true;
+  return opts;
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+JsonStreamWriter::JsonStreamWriter(FlushFn flushFn, size_t flushSize)
+  : flushFn_(std::move(flushFn)),
+    flushSize_(flushSize) {
+}
+
+void JsonStreamWriter::writeFile(
+    const string& filename,
+    const std::function<void(JsonStreamWriter*)>& fn) {
+  folly::File file(filename, O_WRONLY | O_CREAT | O_TRUNC);
+  JsonStreamWriter writer([&](unique_ptr<IOBuf> buf) {
+    for (const auto& range : *buf) {
+      auto ret = folly::writeFull(file.fd(), range.data(), range.size());
+      if (ret < 0) {
+        throw SysError(errno, "error writing JSON to ", filename);
+      }
+    }
+  });
+  fn(&writer);
+  writer.flush();
+}
+
+string JsonStreamWriter::toString(
+    const std::function<void(JsonStreamWriter*)>& fn) {
+  string result;
+  JsonStreamWriter writer([&](unique_ptr<IOBuf> buf) {
+    for (const auto& range : *buf) {
+      result.append(reinterpret_cast<const char*>(range.data()),
+                    range.size());
+    }
+  });
+  fn(&writer);
+  writer.flush();
+  return result;
+}
+
+void JsonStreamWriter::beginObject() {
+  beginContainer(true, '{');
+}
+
+void JsonStreamWriter::endObject() {
+  endContainer(true, '}');
+}
+
+void JsonStreamWriter::beginArray() {
+  beginContainer(false, '[');
+}
+
+void JsonStreamWriter::endArray() {
+  endContainer(false, ']');
+}
+
+void JsonStreamWriter::key(StringPiece key) {
+  CHECK(!levels_.empty() && levels_.back().isObject && !afterKey_)
+    << "a key can only be written in an object, before the member's value";
+  auto& level = levels_.back();
+  if (!level.empty) {
+    append(",");
+  }
+  level.empty = false;
+  newline();
+  append(folly::json::serialize(folly::dynamic(key), prettyOpts()));
+  append(": ");
+  afterKey_ = true;
+}
+
+void JsonStreamWriter::value(const folly::dynamic& value) {
+  beginValue();
+  auto json = folly::json::serialize(value, prettyOpts());
+  // Indent the value to the current level.  Newlines in strings are
+  // escaped, so all newlines in the output are formatting.
+  StringPiece rest(json);
+  while (true) {
+    auto pos = rest.find('\n');
+    if (pos == StringPiece::npos) {
+      append(rest);
+      break;
+    }
+    append(rest.subpiece(0, pos));
+    newline();
+    rest.advance(pos + 1);
+  }
+  maybeFlush();
+}
+
+void JsonStreamWriter::flush() {
+  if (queue_.chainLength() > 0) {
+    flushFn_(queue_.move());
+  }
+}
+
+void JsonStreamWriter::beginValue() {
+  if (levels_.empty()) {
+    return;
+  }
+  auto& level = levels_.back();
+  if (level.isObject) {
+    CHECK(afterKey_) << "object members need a key";
+    afterKey_ = false;
+    return;
+  }
+  if (!level.empty) {
+    append(",");
+  }
+  level.empty = false;
+  newline();
+}
+
+void JsonStreamWriter::beginContainer(bool isObject, char open) {
+  beginValue();
+  append(StringPiece(&open, 1));
+  levels_.emplace_back(isObject);
+}
+
+void JsonStreamWriter::endContainer(bool isObject, char close) {
+  CHECK(!levels_.empty() && levels_.back().isObject == isObject &&
+        !afterKey_) << "mismatched end of container";
+  bool empty = levels_.back().empty;
+  levels_.pop_back();
+  if (!empty) {
+    newline();
+  }
+  append(StringPiece(&close, 1));
+  maybeFlush();
+}
+
+void JsonStreamWriter::newline() {
+  append("\n");
+  append(string(levels_.size() * kIndent, ' '));
+}
+
+void JsonStreamWriter::append(StringPiece str) {
+  queue_.append(str.data(), str.size());
+}
+
+void JsonStreamWriter::maybeFlush() {
+  if (queue_.chainLength() >= flushSize_) {
+    flush();
+  }
+}
+
+}} // facebook::fboss
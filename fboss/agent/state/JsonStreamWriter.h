@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * JsonStreamWriter writes pretty printed JSON a piece at a time, so that a
+ * large document, such as a dump of the whole SwitchState, never needs to
+ * be built as a single folly::dynamic first.
+ *
+ * Containers are opened and closed explicitly, and leaf values are passed
+ * in as (small) folly::dynamic objects.  The output is buffered, and handed
+ * to the flush function in chunks of about flushSize bytes, and once more
+ * when flush() is called at the end.
+ *
+ * The output parses to the same value as toPrettyJson() of the equivalent
+ * folly::dynamic.
+ */
+class JsonStreamWriter {
+ public:
+  typedef std::function<void(std::unique_ptr<folly::IOBuf>)> FlushFn;
+
+  enum : size_t { DEFAULT_FLUSH_SIZE = 64 * 1024 };
+
+  explicit JsonStreamWriter(FlushFn flushFn,
+                            size_t flushSize = DEFAULT_FLUSH_SIZE);
+
+  /*
+   * Write a JSON file, calling fn to write the document.
+   *
+   * Throws an exception on error.
+   */
+  static void writeFile(const std::string& filename,
+                        const std::function<void(JsonStreamWriter*)>& fn);
+
+  /*
+   * Return the document written by fn as a string.
+   */
+  static std::string toString(
+      const std::function<void(JsonStreamWriter*)>& fn);
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  /*
+   * Write the key of the next member of the current object.  Every member
+   * needs a key, followed by its value or container.
+   */
+  void key(folly::StringPiece key);
+
+  /*
+   * Write a complete value, as an array element or object member.
+   */
+  void value(const folly::dynamic& value);
+
+  /*
+   * Hand everything written so far to the flush function.  This must be
+   * called once the document is complete.
+   */
+  void flush();
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  JsonStreamWriter(JsonStreamWriter const &) = delete;
+  JsonStreamWriter& operator=(JsonStreamWriter const &) = delete;
+
+  struct Level {
+    explicit Level(bool isObject) : isObject(isObject) {}
+
+    const bool isObject;
+    bool empty{true};
+  };
+
+  void beginValue();
+  void beginContainer(bool isObject, char open);
+  void endContainer(bool isObject, char close);
+  void newline();
+  void append(folly::StringPiece str);
+  void maybeFlush();
+
+  FlushFn flushFn_;
+  const size_t flushSize_;
+  folly::IOBufQueue queue_{folly::IOBufQueue::cacheChainLength()};
+  std::vector<Level> levels_;
+  bool afterKey_{false};
+};
+
+}} // facebook::fboss
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/MacTable.h"
+
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+
+#include "fboss/agent/state/NodeBase-defs.h"
+
+namespace {
+constexpr auto kPort = "port";
+}
+
+namespace facebook { namespace fboss {
+
+folly::dynamic MacEntry::toFollyDynamic() const {
+  folly::dynamic entry = folly::dynamic::object;
+  entry[kPort] = static_cast<uint16_t>(port);
+  return entry;
+}
+
+MacEntry MacEntry::fromFollyDynamic(const folly::dynamic& entry) {
+  return MacEntry(PortID(entry[kPort].asInt()));
+}
+
+folly::dynamic MacTableFields::toFollyDynamic() const {
+  folly::dynamic entries = folly::dynamic::object;
+  for (const auto& macAndEntry : table) {
+    entries[macAndEntry.first.toString()] =
+      macAndEntry.second.toFollyDynamic();
+  }
+  return entries;
+}
+
+MacTableFields MacTableFields::fromFollyDynamic(
+    const folly::dynamic& entries) {
+  MacTableFields fields;
+  for (const auto& entry : entries.items()) {
+    fields.table.emplace(
+        folly::MacAddress(entry.first.asString().toStdString()),
+        MacEntry::fromFollyDynamic(entry.second));
+  }
+  return fields;
+}
+
+MacTable::MacTable(Table table) : NodeBaseT(std::move(table)) {
+}
+
+MacTable* MacTable::modify(Vlan** vlan, std::shared_ptr<SwitchState>* state) {
+  if (!isPublished()) {
+    CHECK(!(*state)->isPublished());
+    return this;
+  }
+
+  *vlan = (*vlan)->modify(state);
+  auto newTable = clone();
+  auto* ptr = newTable.get();
+  (*vlan)->setMacTable(std::move(newTable));
+  return ptr;
+}
+
+template class NodeBaseT<MacTable, MacTableFields>;
+
+}} // facebook::fboss
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/MacAddress.h>
+#include "fboss/agent/types.h"
+#include "fboss/agent/state/NodeBase.h"
+
+#include <boost/container/flat_map.hpp>
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+class Vlan;
+
+struct MacEntry {
+  MacEntry() {}
+  explicit MacEntry(PortID port) : port(port) {}
+
+  bool operator==(const MacEntry& other) const {
+    return port == other.port;
+  }
+  bool operator!=(const MacEntry& other) const {
+    return !operator==(other);
+  }
+
+  folly::dynamic toFollyDynamic() const;
+  static MacEntry fromFollyDynamic(const folly::dynamic& entry);
+
+  PortID port{0};
+};
+
+struct MacTableFields {
+  typedef boost::container::flat_map<folly::MacAddress, MacEntry> Table;
+
+  MacTableFields() {}
+  explicit MacTableFields(Table&& t) : table(std::move(t)) {}
+  MacTableFields(const MacTableFields& other, Table t)
+    : table(std::move(t)) {}
+
+  folly::dynamic toFollyDynamic() const;
+  static MacTableFields fromFollyDynamic(const folly::dynamic& entries);
+
+  template<typename Fn>
+  void forEachChild(Fn fn) {}
+
+  size_t memoryUsage() const {
+    return table.capacity() * sizeof(Table::value_type);
+  }
+
+  Table table;
+};
+
+/*
+ * The MAC addresses the HW has learned on a VLAN, and the port each was
+ * learned on.
+ *
+ * The HW learns and ages the entries by itself.  The table is only a view
+ * of the HW table for queries, which L2LearningQueue keeps up to date from
+ * the learn and age events the HwSwitch reports, and nothing is programmed
+ * from it.
+ */
+class MacTable : public NodeBaseT<MacTable, MacTableFields> {
+ public:
+  typedef MacTableFields::Table Table;
+
+  MacTable() {}
+  explicit MacTable(Table table);
+
+  const Table& getTable() const {
+    return getFields()->table;
+  }
+  const MacEntry* getEntryIf(folly::MacAddress mac) const {
+    const auto& table = getTable();
+    auto it = table.find(mac);
+    return it == table.end() ? nullptr : &it->second;
+  }
+  size_t size() const {
+    return getTable().size();
+  }
+
+  /*
+   * Get a modifiable version of the table, cloning the VLAN, and the state,
+   * if they are published.
+   */
+  MacTable* modify(Vlan** vlan, std::shared_ptr<SwitchState>* state);
+
+  void setEntry(folly::MacAddress mac, PortID port) {
+    writableFields()->table[mac] = MacEntry(port);
+  }
+  void removeEntry(folly::MacAddress mac) {
+    writableFields()->table.erase(mac);
+  }
+
+ private:
+  // Inherit the constructors required for clone()
+  using NodeBaseT::NodeBaseT;
+  friend class CloneAllocator;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Bits.h>
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace facebook { namespace fboss {
+
+/*
+ * NeighborAddress is the compact form of a neighbor's address that the
+ * neighbor entries store, and that the neighbor tables are keyed by.
+ *
+ * An IPv4 address is held as one host byte order integer and an IPv6
+ * address as two, so ordering the entries of a table is a plain integer
+ * comparison rather than a byte swap or a memcmp() per comparison.  They
+ * sort in the same order as the folly addresses they are built from.
+ *
+ * An IPv6 address takes 16 bytes rather than the 20 of IPAddressV6, which
+ * also holds a scope ID.  Neighbors are always looked up in the table of
+ * their own VLAN, so the scope is not kept.
+ */
+template<typename IPADDR>
+class NeighborAddress;
+
+template<>
+class NeighborAddress<folly::IPAddressV4> {
+ public:
+  NeighborAddress() {}
+  /* implicit */ NeighborAddress(const folly::IPAddressV4& ip)
+    : addr_(ip.toLongHBO()) {}
+
+  folly::IPAddressV4 toIP() const {
+    return folly::IPAddressV4::fromLongHBO(addr_);
+  }
+
+  bool operator<(const NeighborAddress& other) const {
+    return addr_ < other.addr_;
+  }
+  bool operator>(const NeighborAddress& other) const {
+    return other < *this;
+  }
+  bool operator==(const NeighborAddress& other) const {
+    return addr_ == other.addr_;
+  }
+  bool operator!=(const NeighborAddress& other) const {
+    return !operator==(other);
+  }
+
+ private:
+  uint32_t addr_{0};
+};
+
+template<>
+class NeighborAddress<folly::IPAddressV6> {
+ public:
+  NeighborAddress() {}
+  /* implicit */ NeighborAddress(const folly::IPAddressV6& ip)
+    : hi_(folly::Endian::big(folly::loadUnaligned<uint64_t>(ip.bytes()))),
+      lo_(folly::Endian::big(
+            folly::loadUnaligned<uint64_t>(ip.bytes() + 8))) {}
+
+  folly::IPAddressV6 toIP() const {
+    folly::ByteArray16 bytes;
+    folly::storeUnaligned(bytes.data(), folly::Endian::big(hi_));
+    folly::storeUnaligned(bytes.data() + 8, folly::Endian::big(lo_));
+    return folly::IPAddressV6(bytes);
+  }
+
+  bool operator<(const NeighborAddress& other) const {
+    return hi_ < other.hi_ || (hi_ == other.hi_ && lo_ < other.lo_);
+  }
+  bool operator>(const NeighborAddress& other) const {
+    return other < *this;
+  }
+  bool operator==(const NeighborAddress& other) const {
+    return hi_ == other.hi_ && lo_ == other.lo_;
+  }
+  bool operator!=(const NeighborAddress& other) const {
+    return !operator==(other);
+  }
+
+ private:
+  uint64_t hi_{0};
+  uint64_t lo_{0};
+};
+
+template<typename IPADDR>
+void toAppend(const NeighborAddress<IPADDR>& addr, std::string* result) {
+  result->append(addr.toIP().str());
+}
+
+template<typename IPADDR>
+std::ostream& operator<<(std::ostream& os,
+                         const NeighborAddress<IPADDR>& addr) {
+  return os << addr.toIP();
+}
+
+}} // facebook::fboss
@@ -16,8 +16,8 @@ namespace facebook { namespace fboss {
 template<typename IPADDR>
 folly::dynamic NeighborEntryFields<IPADDR>::toFollyDynamic() const {
   folly::dynamic entry = folly::dynamic::object;
-  entry[kIpAddr] = ip.str();
-  entry[kMac] = mac.toString();
+  entry[kIpAddr] = ip.toIP().str();
+  entry[kMac] = getMac().toString();
   entry[kPort] = static_cast<uint16_t>(port);
   entry[kInterface] = static_cast<uint32_t>(interfaceID);
   return entry;
@@ -10,39 +10,64 @@
 #pragma once
 
 #include <folly/MacAddress.h>
+#include <folly/Range.h>
+#include "fboss/agent/state/NeighborAddress.h"
 #include "fboss/agent/state/NodeBase.h"
 
+#include <array>
+#include <cstring>
+
 namespace facebook { namespace fboss {
 
 using folly::MacAddress;
 
 enum PendingEntry { PENDING };
 
+/*
+ * The fields of a neighbor entry.  The MAC address is kept as its 6 bytes,
+ * and the fields are ordered so that they pack without padding: 20 bytes
+ * for an ARP entry and 32 for an NDP entry.
+ */
 template<typename IPADDR>
 struct NeighborEntryFields {
   typedef IPADDR AddressType;
+  typedef std::array<uint8_t, folly::MacAddress::SIZE> MacBytes;
 
   NeighborEntryFields(AddressType ip,
                       folly::MacAddress mac,
                       PortID port,
                       InterfaceID interfaceID)
     : ip(ip),
-      mac(mac),
-      port(port),
       interfaceID(interfaceID),
+      mac(toMacBytes(mac)),
+      port(port),
       pending(false) {}
 
   NeighborEntryFields(AddressType ip,
                       InterfaceID interfaceID,
                       PendingEntry ignored)
     : ip(ip),
-      mac(MacAddress::BROADCAST),
-      port(PortID(0)),
       interfaceID(InterfaceID(interfaceID)),
+      mac(toMacBytes(MacAddress::BROADCAST)),
+      port(PortID(0)),
       pending(true) {}
 
   template<typename Fn>
   void forEachChild(Fn fn) {}
+
+  folly::MacAddress getMac() const {
+    return folly::MacAddress::fromBinary(
+        folly::ByteRange(mac.data(), mac.size()));
+  }
+  void setMac(folly::MacAddress newMac) {
+    mac = toMacBytes(newMac);
+  }
+  static MacBytes toMacBytes(folly::MacAddress mac) {
+    MacBytes bytes;
+    memcpy(bytes.data(), mac.bytes(), bytes.size());
+    return bytes;
+  }
+
   /*
    * Serialize to folly::dynamic
    */
@@ -57,10 +82,10 @@ struct NeighborEntryFields {
   static constexpr auto kMac = "mac";
   static constexpr auto kPort = "portId";
   static constexpr auto kInterface = "interfaceId";
-  AddressType ip;
-  folly::MacAddress mac;
-  PortID port;
+  NeighborAddress<AddressType> ip;
   InterfaceID interfaceID;
+  MacBytes mac;
+  PortID port;
   bool pending;
 };
 
@@ -75,14 +100,18 @@ class NeighborEntry : public NodeBaseT<SUBCLASS, NeighborEntryFields<IPADDR>> {
   NeighborEntry(AddressType ip, InterfaceID intfID, PendingEntry ignored);
 
   AddressType getIP() const {
+    return this->getFields()->ip.toIP();
+  }
+  // The compact form of the address, that the neighbor tables are keyed by
+  const NeighborAddress<AddressType>& getKey() const {
     return this->getFields()->ip;
   }
 
   folly::MacAddress getMac() const {
-    return this->getFields()->mac;
+    return this->getFields()->getMac();
   }
   void setMAC(folly::MacAddress mac) {
-    this->writableFields()->mac = mac;
+    this->writableFields()->setMac(mac);
   }
 
   PortID getPort() const {
@@ -13,8 +13,9 @@
 
 namespace facebook { namespace fboss {
 
-template<typename IPADDR>
-folly::dynamic NeighborResponseTableFields<IPADDR>::toFollyDynamic() const {
+template<typename IPADDR, typename TABLE>
+folly::dynamic
+NeighborResponseTableFields<IPADDR, TABLE>::toFollyDynamic() const {
   folly::dynamic entries = folly::dynamic::object;
   for (const auto& ipAndEntry: table) {
     folly::dynamic entry = folly::dynamic::object;
@@ -23,9 +24,9 @@ folly::dynamic NeighborResponseTableFields<IPADDR>::toFollyDynamic() const {
   return entries;
 }
 
-template<typename IPADDR>
-NeighborResponseTableFields<IPADDR>
-NeighborResponseTableFields<IPADDR>::fromFollyDynamic(
+template<typename IPADDR, typename TABLE>
+NeighborResponseTableFields<IPADDR, TABLE>
+NeighborResponseTableFields<IPADDR, TABLE>::fromFollyDynamic(
     const folly::dynamic& entries) {
   NeighborResponseTableFields nbrTable;
   for (const auto& entry: entries.items()) {
@@ -35,8 +36,9 @@ NeighborResponseTableFields<IPADDR>::fromFollyDynamic(
   return nbrTable;
 }
 
-template<typename IPADDR, typename SUBCLASS>
-NeighborResponseTable<IPADDR, SUBCLASS>::NeighborResponseTable(Table table)
+template<typename IPADDR, typename SUBCLASS, typename TABLE>
+NeighborResponseTable<IPADDR, SUBCLASS, TABLE>::NeighborResponseTable(
+    Table table)
   : Parent(std::move(table)) {
 }
 
@@ -12,6 +12,7 @@
 #include <folly/MacAddress.h>
 #include <folly/Optional.h>
 #include "fboss/agent/state/NodeBase.h"
+#include "fboss/agent/state/OpenHashMap.h"
 
 #include <boost/container/flat_map.hpp>
 
@@ -45,10 +46,24 @@ struct NeighborResponseEntry {
   InterfaceID interfaceID{0};
 };
 
+/*
+ * The containers a NeighborResponseTable can be stored in.
+ *
+ * The hashed table is the default, as lookups happen for every ARP request
+ * and neighbor solicitation we receive, and VLANs can carry hundreds of
+ * addresses.  The sorted table is smaller and cheaper to copy for VLANs with
+ * only a handful of addresses.
+ */
 template<typename IPADDR>
+using HashedNeighborResponseMap = OpenHashMap<IPADDR, NeighborResponseEntry>;
+template<typename IPADDR>
+using SortedNeighborResponseMap =
+  boost::container::flat_map<IPADDR, NeighborResponseEntry>;
+
+template<typename IPADDR, typename TABLE = HashedNeighborResponseMap<IPADDR>>
 struct NeighborResponseTableFields {
   typedef IPADDR AddressType;
-  typedef boost::container::flat_map<AddressType, NeighborResponseEntry> Table;
+  typedef TABLE Table;
 
   NeighborResponseTableFields() {}
   explicit NeighborResponseTableFields(Table&& t) : table(std::move(t)) {}
@@ -78,12 +93,13 @@ struct NeighborResponseTableFields {
  * This information is computed from the interface configuration, but is stored
  * with each VLAN so that we can efficiently respond to ARP requests.
  */
-template<typename IPADDR, typename SUBCLASS>
+template<typename IPADDR, typename SUBCLASS,
+         typename TABLE = HashedNeighborResponseMap<IPADDR>>
 class NeighborResponseTable
-  : public NodeBaseT<SUBCLASS, NeighborResponseTableFields<IPADDR>> {
+  : public NodeBaseT<SUBCLASS, NeighborResponseTableFields<IPADDR, TABLE>> {
  public:
   typedef IPADDR AddressType;
-  typedef typename NeighborResponseTableFields<AddressType>::Table Table;
+  typedef TABLE Table;
 
   NeighborResponseTable() {}
   explicit NeighborResponseTable(Table table);
@@ -118,7 +134,8 @@ class NeighborResponseTable
   }
 
  private:
-  typedef NodeBaseT<SUBCLASS, NeighborResponseTableFields<IPADDR>> Parent;
+  typedef NodeBaseT<SUBCLASS, NeighborResponseTableFields<IPADDR, TABLE>>
+    Parent;
 
   // Inherit the constructors required for clone()
   using Parent::NodeBaseT;
@@ -59,7 +59,8 @@ void NeighborTable<IPADDR, ENTRY, SUBCLASS>::updateEntry(
     InterfaceID intfID) {
   CHECK(!this->isPublished());
   auto& nodes = this->writableNodes();
-  auto it = nodes.find(ip);
+  NeighborAddress<AddressType> key(ip);
+  auto it = nodes.find(key);
   if (it == nodes.end()) {
     throw FbossError("ARP entry for ", ip, " does not exist");
   }
@@ -68,7 +69,7 @@ void NeighborTable<IPADDR, ENTRY, SUBCLASS>::updateEntry(
   entry->setPort(port);
   entry->setIntfID(intfID);
   entry->setPending(false);
-  it->second = entry;
+  nodes[key] = entry;
 }
 
 template<typename IPADDR, typename ENTRY, typename SUBCLASS>
@@ -85,19 +86,76 @@ template<typename IPADDR, typename ENTRY, typename SUBCLASS>
 bool NeighborTable<IPADDR, ENTRY, SUBCLASS>::prunePendingEntries() {
   CHECK(!this->isPublished());
 
-  // Need a reverse iterator because removing an element from a flat_map
-  // invalidates all iterators after the element removed
-  bool modified = false;
-  auto entryIt = this->rbegin();
-  while (entryIt != this->rend()) {
-    auto entry = *entryIt++;
+  // Removing an entry invalidates all iterators, so find the pending entries
+  // first and remove them afterwards.
+  std::vector<std::shared_ptr<Entry>> pending;
+  for (const auto& entry : *this) {
     if (entry->isPending()) {
-      VLOG(4) << "Removing pending neighbor entry for " << entry->getIP().str();
+      pending.push_back(entry);
+    }
+  }
+  bool modified = false;
+  for (const auto& entry : pending) {
+    VLOG(4) << "Removing pending neighbor entry for " << entry->getIP().str();
+    this->removeNode(entry);
+    modified = true;
+  }
+  this->setPendingEntries(false);
+  return modified;
+}
+
+template<typename IPADDR, typename ENTRY, typename SUBCLASS>
+bool NeighborTable<IPADDR, ENTRY, SUBCLASS>::prunePendingEntries(
+    const std::vector<AddressType>& ips) {
+  CHECK(!this->isPublished());
+
+  bool modified = false;
+  for (const auto& ip : ips) {
+    auto entry = this->getNodeIf(ip);
+    if (entry && entry->isPending()) {
+      VLOG(4) << "Removing pending neighbor entry for " << ip.str();
       this->removeNode(entry);
       modified = true;
     }
   }
-  this->setPendingEntries(false);
+  if (modified) {
+    bool stillPending = false;
+    for (const auto& entry : *this) {
+      if (entry->isPending()) {
+        stillPending = true;
+        break;
+      }
+    }
+    this->setPendingEntries(stillPending);
+  }
+  return modified;
+}
+
+template<typename IPADDR, typename ENTRY, typename SUBCLASS>
+bool NeighborTable<IPADDR, ENTRY, SUBCLASS>::removeEntries(
+    const std::vector<AddressType>& ips) {
+  CHECK(!this->isPublished());
+
+  bool modified = false;
+  bool removedPending = false;
+  for (const auto& ip : ips) {
+    auto entry = this->removeNodeIf(ip);
+    if (entry) {
+      VLOG(4) << "Removing neighbor entry for " << ip.str();
+      removedPending |= entry->isPending();
+      modified = true;
+    }
+  }
+  if (removedPending) {
+    bool stillPending = false;
+    for (const auto& entry : *this) {
+      if (entry->isPending()) {
+        stillPending = true;
+        break;
+      }
+    }
+    this->setPendingEntries(stillPending);
+  }
   return modified;
 }
 
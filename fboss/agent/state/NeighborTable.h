@@ -12,8 +12,10 @@
 #include <folly/MacAddress.h>
 #include "fboss/agent/state/NeighborEntry.h"
 #include "fboss/agent/state/NodeMap.h"
+#include "fboss/agent/state/PersistentMap.h"
 #include <folly/dynamic.h>
 #include <folly/json.h>
+#include <vector>
 
 namespace {
 constexpr auto kPendingEntries = "hasPendingEntries";
@@ -48,24 +50,24 @@ struct NeighborTableFields {
 
 template<typename IPADDR, typename ENTRY>
 struct NeighborTableTraits {
-  typedef IPADDR KeyType;
+  typedef NeighborAddress<IPADDR> KeyType;
   typedef ENTRY Node;
   typedef NeighborTableFields ExtraFields;
+  typedef PersistentMap<KeyType, std::shared_ptr<Node>> NodeContainer;
 
-  static KeyType getKey(const std::shared_ptr<Node>& entry) {
-    return entry->getIP();
+  static const KeyType& getKey(const std::shared_ptr<Node>& entry) {
+    return entry->getKey();
   }
 };
 
 /*
  * A map of IP --> MAC for the IP addresses of other nodes on a VLAN.
  *
- * TODO: We should switch from NodeMap to PrefixMap when the new PrefixMap
- * implementation is ready.
- *
- * Any change to a NodeMap is O(N), so it is really only suitable for small
- * maps that do not change frequently.  Our new PrefixMap implementation will
- * allow us to perform cheaper copy-on-write updates.
+ * The entries are stored in a PersistentMap, so that cloning the table to
+ * add or update a single entry is O(log N) rather than O(N).  The map is
+ * keyed by the compact NeighborAddress of each entry, which keeps the tree
+ * nodes copied by each clone small, and makes each comparison of a lookup
+ * an integer comparison.
  */
 template<typename IPADDR, typename ENTRY, typename SUBCLASS>
 class NeighborTable
@@ -97,6 +99,16 @@ class NeighborTable
                        InterfaceID intfID);
 
   bool prunePendingEntries();
+  /*
+   * Remove the given entries, if they are still pending.
+   * Returns true if any entry was removed.
+   */
+  bool prunePendingEntries(const std::vector<AddressType>& ips);
+  /*
+   * Remove the given entries, pending or not.
+   * Returns true if any entry was removed.
+   */
+  bool removeEntries(const std::vector<AddressType>& ips);
 
   bool hasPendingEntries() {
     return this->getExtraFields().pendingEntries;
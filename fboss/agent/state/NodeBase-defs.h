@@ -27,4 +27,14 @@ void NodeBaseT<NodeT, FieldsT>::publish() {
   NodeBase::publish();
 }
 
+template<typename NodeT, typename FieldsT>
+void NodeBaseT<NodeT, FieldsT>::forEachChildNode(
+    const std::function<void(const NodeBase*)>& fn) const {
+  // Fields::forEachChild() is not const, but neither it nor our callback
+  // modifies the fields.
+  const_cast<Fields&>(fields_).forEachChild([&](NodeBase* child) {
+    fn(child);
+  });
+}
+
 }} // facebook::fboss
@@ -11,10 +11,12 @@
 
 #include "fboss/agent/types.h"
 #include "fboss/agent/Utils.h"
+#include "fboss/agent/state/CloneArena.h"
 
 #include <boost/cast.hpp>
 #include <boost/container/flat_map.hpp>
 #include <glog/logging.h>
+#include <functional>
 #include <memory>
 #include <type_traits>
 
@@ -62,6 +64,24 @@ class NodeBase {
     published_ = true;
   }
 
+  /*
+   * Call the specified function on each child node of this node.
+   *
+   * This allows generic code, such as memory accounting, to walk the state
+   * tree without knowing the concrete node types.
+   */
+  virtual void forEachChildNode(
+      const std::function<void(const NodeBase*)>& fn) const {}
+
+  /*
+   * Get the approximate number of bytes used by this node.
+   *
+   * This does not include memory used by the node's children.
+   */
+  virtual size_t getMemoryUsage() const {
+    return sizeof(NodeBase);
+  }
+
   /*
    * Get the generation number for this state object.
    *
@@ -156,6 +176,7 @@ template<typename NodeT, typename FieldsT>
 class NodeBaseT : public NodeBase {
   GENERATE_HAS_MEMBER(toFollyDynamic);
   GENERATE_HAS_MEMBER(fromFollyDynamic);
+  GENERATE_HAS_MEMBER(memoryUsage);
  public:
   typedef NodeT Node;
   typedef FieldsT Fields;
@@ -177,6 +198,9 @@ class NodeBaseT : public NodeBase {
    * make_shared (since published node objects must eventually be stored in a
    * shared_ptr).  However, the caller is the sole owner of the new object when
    * it is returned.
+   *
+   * If a CloneArena::Scope is active on the calling thread, the new node is
+   * allocated from its arena.
    */
   std::shared_ptr<Node> clone() const;
 
@@ -202,6 +226,19 @@ class NodeBaseT : public NodeBase {
 
   virtual void publish() override;
 
+  virtual void forEachChildNode(
+      const std::function<void(const NodeBase*)>& fn) const override;
+
+  /*
+   * The memory usage is the size of the node object, plus the result of
+   * Fields::memoryUsage() if the fields structure provides it.  Fields which
+   * hold containers should implement memoryUsage() to account for the
+   * storage allocated outside of the node object.
+   */
+  virtual size_t getMemoryUsage() const override {
+    return sizeof(NodeT) + fieldsMemoryUsage();
+  }
+
   const Fields* getFields() const {
     return &fields_;
   }
@@ -279,9 +316,27 @@ class NodeBaseT : public NodeBase {
       static_assert(sizeof ...(Args) == 0, "Args must be empty");
       return folly::toJson(self()->toFollyDynamic());
   }
+  /*
+   * Write this node to a JsonStreamWriter.
+   *
+   * By default the node is written as a single value, from
+   * toFollyDynamic().  Nodes that hold large subtrees, such as NodeMapT,
+   * hide this with a version that writes one child at a time.
+   */
+  template<typename WriterT>
+  void writeJson(WriterT* writer) const {
+    writer->value(self()->toFollyDynamic());
+  }
  protected:
-  class CloneAllocator : public std::allocator<NodeT> {
+  class CloneAllocator : public CloneArenaAllocator<NodeT> {
    public:
+    // The shared_ptr control block is allocated with a rebound copy, which
+    // needs to allocate from the same arena but does not construct nodes
+    template<typename U>
+    struct rebind {
+      typedef CloneArenaAllocator<U> other;
+    };
+
     template<typename... Args>
     void construct(void* p, Args&&... args) {
       new(p) NodeT(std::forward<Args>(args)...);
@@ -309,6 +364,17 @@ class NodeBaseT : public NodeBase {
     return boost::polymorphic_downcast<const Node*>(this);
   }
 
+  template<typename F = Fields>
+  typename std::enable_if<has_member_memoryUsage<F>::value, size_t>::type
+  fieldsMemoryUsage() const {
+    return fields_.memoryUsage();
+  }
+  template<typename F = Fields>
+  typename std::enable_if<!has_member_memoryUsage<F>::value, size_t>::type
+  fieldsMemoryUsage() const {
+    return 0;
+  }
+
   Fields fields_;
 };
 
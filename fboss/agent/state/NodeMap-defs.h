@@ -12,6 +12,7 @@
 #include <vector>
 #include "fboss/agent/FbossError.h"
 
+#include "fboss/agent/state/JsonStreamWriter.h"
 #include "fboss/agent/state/NodeBase-defs.h"
 #include <folly/dynamic.h>
 #include <folly/json.h>
@@ -64,11 +65,11 @@ template <typename MapTypeT, typename TraitsT>
 void
 NodeMapT<MapTypeT, TraitsT>::updateNode(const std::shared_ptr<Node>& node) {
   auto& nodes = writableNodes();
-  auto it = nodes.find(TraitsT::getKey(node));
-  if (it == nodes.end()) {
-    throw FbossError("node ID ", TraitsT::getKey(node), " does not exist");
+  auto key = TraitsT::getKey(node);
+  if (nodes.find(key) == nodes.end()) {
+    throw FbossError("node ID ", key, " does not exist");
   }
-  it->second = node;
+  nodes[key] = node;
 }
 
 template <typename MapTypeT, typename TraitsT>
@@ -117,11 +118,25 @@ folly::dynamic NodeMapT<MapTypeT, TraitsT>::toFollyDynamic() const {
   return json;
 }
 
+template <typename MapTypeT, typename TraitsT>
+void NodeMapT<MapTypeT, TraitsT>::writeJson(JsonStreamWriter* writer) const {
+  writer->beginObject();
+  writer->key(kEntries);
+  writer->beginArray();
+  for (const auto& node: *this) {
+    node->writeJson(writer);
+  }
+  writer->endArray();
+  writer->key(kExtraFields);
+  writer->value(getExtraFields().toFollyDynamic());
+  writer->endObject();
+}
+
 template <typename MapTypeT, typename TraitsT>
 std::shared_ptr<MapTypeT>
 NodeMapT<MapTypeT, TraitsT>::fromFollyDynamic(const folly::dynamic& nodesJson) {
   auto nodeMap = std::make_shared<MapTypeT>();
-  auto entries = nodesJson[kEntries];
+  const auto& entries = nodesJson[kEntries];
   for (const auto& entry: entries) {
     nodeMap->addNode(Node::fromFollyDynamic(entry));
   }
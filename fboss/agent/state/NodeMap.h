@@ -16,6 +16,8 @@
 
 namespace facebook { namespace fboss {
 
+class JsonStreamWriter;
+
 /*
  * NodeMapFields defines the fields contained inside a NodeMapT instantiation
  */
@@ -24,8 +26,7 @@ struct NodeMapFields {
   typedef typename TraitsT::KeyType KeyType;
   typedef typename TraitsT::Node Node;
   typedef typename TraitsT::ExtraFields ExtraFields;
-  typedef boost::container::flat_map<KeyType, std::shared_ptr<Node>>
-    NodeContainer;
+  typedef typename TraitsT::NodeContainer NodeContainer;
 
   NodeMapFields() {}
   NodeMapFields(const NodeMapFields& other, NodeContainer nodes)
@@ -40,6 +41,14 @@ struct NodeMapFields {
     extra.forEachChild(fn);
   }
 
+  /*
+   * The approximate storage used by the container entries.  The nodes
+   * themselves are accounted for separately.
+   */
+  size_t memoryUsage() const {
+    return nodes.size() * sizeof(typename NodeContainer::value_type);
+  }
+
   NodeContainer nodes;
   typename TraitsT::ExtraFields extra;
 };
@@ -57,11 +66,22 @@ struct NodeMapNoExtraFields {
   }
 };
 
-template<typename KeyT, typename NodeT, typename ExtraT = NodeMapNoExtraFields>
+/*
+ * The NodeContainer holds the children of a NodeMapT.
+ *
+ * The default flat_map has the fastest lookups and iteration, but cloning the
+ * NodeMapT copies the whole map.  Large maps that are modified frequently
+ * should use a PersistentMap instead, which shares its storage between
+ * clones.
+ */
+template<typename KeyT, typename NodeT, typename ExtraT = NodeMapNoExtraFields,
+         typename ContainerT =
+           boost::container::flat_map<KeyT, std::shared_ptr<NodeT>>>
 struct NodeMapTraits {
   typedef KeyT KeyType;
   typedef NodeT Node;
   typedef ExtraT ExtraFields;
+  typedef ContainerT NodeContainer;
 
   static KeyType getKey(const std::shared_ptr<Node>& node) {
     return node->getID();
@@ -144,6 +164,10 @@ class NodeMapT : public NodeBaseT<MapTypeT,
    * Deserialize to folly::dynamic
    */
   static std::shared_ptr<MapTypeT> fromFollyDynamic(const folly::dynamic& json);
+  /*
+   * Write the same JSON as toFollyDynamic(), one node at a time
+   */
+  void writeJson(JsonStreamWriter* writer) const;
 
   static constexpr char kExtraFields[] = "extraFields";
   static constexpr char kEntries[] = "entries";
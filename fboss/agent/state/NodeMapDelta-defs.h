@@ -28,15 +28,20 @@ NodeMapDelta<MAP, VALUE>::Iterator::Iterator(const MapType* oldMap,
     newMap_(newMap),
     value_(nullNode_, nullNode_) {
   // Advance to the first difference
-  while (oldIt_ != oldMap_->end() &&
-         newIt_ != newMap_->end() &&
-         *oldIt_ == *newIt_) {
-    ++oldIt_;
-    ++newIt_;
-  }
+  InnerIter::skipEqual(&oldIt_, oldMap_->end(), &newIt_, newMap_->end());
   updateValue();
 }
 
+template<typename MAP, typename VALUE>
+NodeMapDelta<MAP, VALUE>::Iterator::Iterator(const VALUE* change)
+  : oldIt_(),
+    newIt_(),
+    oldMap_(nullptr),
+    newMap_(nullptr),
+    value_(nullNode_, nullNode_),
+    change_(change) {
+}
+
 template<typename MAP, typename VALUE>
 NodeMapDelta<MAP, VALUE>::Iterator::Iterator()
   : oldIt_(),
@@ -73,6 +78,10 @@ void NodeMapDelta<MAP, VALUE>::Iterator::updateValue() {
 
 template<typename MAP, typename VALUE>
 void NodeMapDelta<MAP, VALUE>::Iterator::advance() {
+  if (change_) {
+    ++change_;
+    return;
+  }
   // If we have already hit the end of one side, advance the other.
   // We are immediately done after this.
   if (oldIt_ == oldMap_->end()) {
@@ -101,12 +110,7 @@ void NodeMapDelta<MAP, VALUE>::Iterator::advance() {
   }
 
   // Advance past any unchanged nodes.
-  while (oldIt_ != oldMap_->end() &&
-         newIt_ != newMap_->end() &&
-         *oldIt_ == *newIt_) {
-    ++oldIt_;
-    ++newIt_;
-  }
+  InnerIter::skipEqual(&oldIt_, oldMap_->end(), &newIt_, newMap_->end());
   updateValue();
 }
 
@@ -12,6 +12,7 @@
 #include <functional>
 #include <memory>
 #include <type_traits>
+#include <vector>
 #include <cstddef>
 
 #include <folly/ApplyTuple.h>
@@ -27,17 +28,27 @@ class DeltaValue;
  *
  * The main function of this class is the Iterator that it provides.  This
  * allows caller to walk over the changed, added, and removed nodes.
+ *
+ * Walking a delta compares the two maps.  A delta that is walked more than
+ * once can instead be given the list of its changes, from collectChanges(),
+ * which its Iterator then walks without looking at the maps.
  */
 template<typename MAP, typename VALUE = DeltaValue<typename MAP::Node>>
 class NodeMapDelta {
  public:
   typedef MAP MapType;
   typedef typename MAP::Node Node;
+  typedef std::vector<VALUE> Changes;
   class Iterator;
 
   NodeMapDelta(const MapType* oldMap, const MapType* newMap)
     : old_(oldMap),
       new_(newMap) {}
+  NodeMapDelta(const MapType* oldMap, const MapType* newMap,
+               std::shared_ptr<const Changes> changes)
+    : old_(oldMap),
+      new_(newMap),
+      changes_(std::move(changes)) {}
 
   const MapType* getOld() const {
     return old_;
@@ -56,6 +67,20 @@ class NodeMapDelta {
    */
   Iterator end() const;
 
+  /*
+   * Return the list of changes, in the order the Iterator visits them.
+   */
+  std::shared_ptr<const Changes> collectChanges() const {
+    if (changes_) {
+      return changes_;
+    }
+    auto changes = std::make_shared<Changes>();
+    for (const auto& entry : *this) {
+      changes->push_back(entry);
+    }
+    return changes;
+  }
+
  private:
   /*
    * Note that we assume NodeMapDelta is always used by StateDelta.  StateDelta
@@ -64,6 +89,8 @@ class NodeMapDelta {
    */
   const MapType* old_;
   const MapType* new_;
+  // The changes between old_ and new_, if they were collected already
+  std::shared_ptr<const Changes> changes_;
 };
 
 template<typename NODE>
@@ -119,13 +146,14 @@ class NodeMapDelta<MAP, VALUE>::Iterator {
            typename MapType::Iterator oldIt,
            const MapType* newMap,
            typename MapType::Iterator newIt);
+  explicit Iterator(const VALUE* change);
   Iterator();
 
   const value_type& operator*() const {
-    return value_;
+    return change_ ? *change_ : value_;
   }
   const value_type* operator->() const {
-    return &value_;
+    return change_ ? change_ : &value_;
   }
 
   Iterator& operator++() {
@@ -139,7 +167,8 @@ class NodeMapDelta<MAP, VALUE>::Iterator {
   }
 
   bool operator==(const Iterator& other) const {
-    return oldIt_ == other.oldIt_ && newIt_ == other.newIt_;
+    return oldIt_ == other.oldIt_ && newIt_ == other.newIt_ &&
+      change_ == other.change_;
   }
   bool operator!=(const Iterator& other) const {
     return !operator==(other);
@@ -157,6 +186,8 @@ class NodeMapDelta<MAP, VALUE>::Iterator {
   const MapType* oldMap_;
   const MapType* newMap_;
   VALUE value_;
+  // The current change, when walking a collected list of changes
+  const VALUE* change_{nullptr};
 
   static std::shared_ptr<Node> nullNode_;
 };
@@ -164,6 +195,9 @@ class NodeMapDelta<MAP, VALUE>::Iterator {
 template<typename MAP, typename VALUE>
 typename NodeMapDelta<MAP, VALUE>::Iterator
 NodeMapDelta<MAP, VALUE>::begin() const {
+  if (changes_) {
+    return Iterator(changes_->data());
+  }
   if (old_ == new_) {
     return end();
   }
@@ -183,6 +217,9 @@ NodeMapDelta<MAP, VALUE>::begin() const {
 template<typename MAP, typename VALUE>
 typename NodeMapDelta<MAP, VALUE>::Iterator
 NodeMapDelta<MAP, VALUE>::end() const {
+  if (changes_) {
+    return Iterator(changes_->data() + changes_->size());
+  }
   if (!old_) {
     return Iterator(new_, new_->end(), new_, new_->end());
   }
@@ -9,10 +9,85 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <boost/container/flat_map.hpp>
 
+#include "fboss/agent/state/PersistentMap.h"
+
+namespace facebook { namespace fboss {
+
+/*
+ * NodeContainerSkip::skipEqual() advances two iterators, over two instances
+ * of the same NodeContainer type, past their leading entries that point to
+ * the same nodes.  This is the inner loop of NodeMapDelta, which spends most
+ * of its time skipping over unchanged nodes.
+ *
+ * The generic version compares the entries one at a time.
+ */
+template <typename Container>
+struct NodeContainerSkip {
+  typedef typename Container::const_iterator Iter;
+  static void skipEqual(Iter* a, const Iter& aEnd,
+                        Iter* b, const Iter& bEnd) {
+    while (*a != aEnd && *b != bEnd && (*a)->second == (*b)->second) {
+      ++*a;
+      ++*b;
+    }
+  }
+};
+
+/*
+ * flat_map entries are stored contiguously, so compare the node pointers of
+ * both maps in fixed size blocks.  The block comparison has no per-entry
+ * branch, which lets the compiler unroll and vectorize it.
+ */
+template <typename K, typename V, typename C, typename A>
+struct NodeContainerSkip<boost::container::flat_map<K, V, C, A>> {
+  typedef typename boost::container::flat_map<K, V, C, A>::const_iterator Iter;
+  enum : size_t { kBlockSize = 8 };
+
+  static void skipEqual(Iter* a, const Iter& aEnd,
+                        Iter* b, const Iter& bEnd) {
+    size_t count = std::min(aEnd - *a, bEnd - *b);
+    if (count == 0) {
+      return;
+    }
+    const auto* entriesA = &**a;
+    const auto* entriesB = &**b;
+    size_t n = 0;
+    for (; n + kBlockSize <= count; n += kBlockSize) {
+      uintptr_t diff = 0;
+      for (size_t i = n; i < n + kBlockSize; ++i) {
+        diff |= reinterpret_cast<uintptr_t>(entriesA[i].second.get()) ^
+                reinterpret_cast<uintptr_t>(entriesB[i].second.get());
+      }
+      if (diff) {
+        break;
+      }
+    }
+    while (n < count && entriesA[n].second == entriesB[n].second) {
+      ++n;
+    }
+    *a += n;
+    *b += n;
+  }
+};
+
+template <typename K, typename V>
+struct NodeContainerSkip<PersistentMap<K, V>> {
+  typedef typename PersistentMap<K, V>::const_iterator Iter;
+  static void skipEqual(Iter* a, const Iter& aEnd,
+                        Iter* b, const Iter& bEnd) {
+    PersistentMap<K, V>::skipEqual(a, aEnd, b, bEnd);
+  }
+};
+
+}} // facebook::fboss
+
 /*
- * NodeMapIterator is a very small wrapper around flat_map::const_iterator.
+ * NodeMapIterator is a very small wrapper around the const_iterator of the
+ * NodeContainer (a flat_map or PersistentMap).
  *
  * The main difference is that dereferencing it returns only the Node,
  * and not a pair of (_Id, _Node)
@@ -53,13 +128,23 @@ class NodeMapIterator : public std::iterator<std::forward_iterator_tag,
     return it_ != other.it_;
   }
 
+  /*
+   * Advance a and b past their leading entries that point to the same
+   * nodes, stopping at aEnd and bEnd respectively.
+   */
+  static void skipEqual(NodeMapIterator* a, const NodeMapIterator& aEnd,
+                        NodeMapIterator* b, const NodeMapIterator& bEnd) {
+    facebook::fboss::NodeContainerSkip<NodeContainer>::skipEqual(
+        &a->it_, aEnd.it_, &b->it_, bEnd.it_);
+  }
+
  private:
   typename NodeContainer::const_iterator it_;
 };
 
 /*
- * ReverseNodeMapIterator is a very small wrapper around
- * flat_map::const_reverse_iterator.
+ * ReverseNodeMapIterator is a very small wrapper around the
+ * const_reverse_iterator of the NodeContainer.
  *
  * The main difference is that dereferencing it returns only the Node,
  * and not a pair of (_Id, _Node)
@@ -0,0 +1,279 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Hash.h>
+
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * OpenHashMap is an unordered map implemented as an open addressing hash
+ * table with linear probing.
+ *
+ * It provides the subset of the boost::container::flat_map API used for
+ * NeighborResponseTable, so it can be selected as the Table of a
+ * NeighborResponseTable.  Unlike flat_map, lookups and insertions are O(1)
+ * rather than O(log N) and O(N), which matters for VLANs with hundreds of
+ * addresses.  Like flat_map, all entries live in a single array, so copying
+ * the map when a node is cloned is a single allocation.
+ *
+ * The table is kept at most half full.  Both keys and values must be default
+ * constructible.  Iteration order is unspecified, and equality does not
+ * depend on it.
+ *
+ * Only const iterators are provided.  Use operator[] or getIf() to modify
+ * the value of an existing entry.  Any modification to the map invalidates
+ * all iterators.
+ */
+template<typename KeyT, typename ValueT, typename HashT = std::hash<KeyT>>
+class OpenHashMap {
+ private:
+  struct Slot;
+
+ public:
+  typedef KeyT key_type;
+  typedef ValueT mapped_type;
+  typedef std::pair<KeyT, ValueT> value_type;
+  typedef size_t size_type;
+
+  class const_iterator
+    : public std::iterator<std::forward_iterator_tag, const value_type> {
+   public:
+    const_iterator() {}
+
+    const value_type& operator*() const {
+      return pos_->value;
+    }
+    const value_type* operator->() const {
+      return &pos_->value;
+    }
+    const_iterator& operator++() {
+      ++pos_;
+      skipUnused();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator tmp(*this);
+      ++*this;
+      return tmp;
+    }
+    bool operator==(const const_iterator& other) const {
+      return pos_ == other.pos_;
+    }
+    bool operator!=(const const_iterator& other) const {
+      return pos_ != other.pos_;
+    }
+
+   private:
+    friend class OpenHashMap;
+    const_iterator(const Slot* pos, const Slot* end) : pos_(pos), end_(end) {
+      skipUnused();
+    }
+    void skipUnused() {
+      while (pos_ != end_ && !pos_->used) {
+        ++pos_;
+      }
+    }
+
+    const Slot* pos_{nullptr};
+    const Slot* end_{nullptr};
+  };
+  typedef const_iterator iterator;
+
+  OpenHashMap() {}
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  void clear() {
+    slots_.clear();
+    size_ = 0;
+  }
+  /*
+   * Make room for at least the given number of entries, so that inserting
+   * them does not rehash the table again.
+   */
+  void reserve(size_t numEntries) {
+    auto capacity = slots_.empty() ? size_t(MIN_CAPACITY) : slots_.size();
+    while (capacity < numEntries * 2) {
+      capacity *= 2;
+    }
+    if (capacity > slots_.size()) {
+      rehash(capacity);
+    }
+  }
+  void swap(OpenHashMap& other) {
+    slots_.swap(other.slots_);
+    std::swap(size_, other.size_);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(slots_.data(), slots_.data() + slots_.size());
+  }
+  const_iterator end() const {
+    auto end = slots_.data() + slots_.size();
+    return const_iterator(end, end);
+  }
+
+  const_iterator find(const KeyT& key) const {
+    auto idx = findSlot(key);
+    if (idx == NOT_FOUND) {
+      return end();
+    }
+    return const_iterator(&slots_[idx], slots_.data() + slots_.size());
+  }
+  size_t count(const KeyT& key) const {
+    return findSlot(key) == NOT_FOUND ? 0 : 1;
+  }
+
+  /*
+   * Return a pointer to the value for the given key, or nullptr if there is
+   * none.  Unlike find(), this allows modifying the value in place.  The
+   * pointer is invalidated by any modification to the map.
+   */
+  ValueT* getIf(const KeyT& key) {
+    auto idx = findSlot(key);
+    return idx == NOT_FOUND ? nullptr : &slots_[idx].value.second;
+  }
+
+  std::pair<const_iterator, bool> insert(value_type value) {
+    auto idx = findSlot(value.first);
+    bool inserted = false;
+    if (idx == NOT_FOUND) {
+      idx = insertNew(std::move(value));
+      inserted = true;
+    }
+    return std::make_pair(
+        const_iterator(&slots_[idx], slots_.data() + slots_.size()),
+        inserted);
+  }
+  template<typename... Args>
+  std::pair<const_iterator, bool> emplace(Args&&... args) {
+    return insert(value_type(std::forward<Args>(args)...));
+  }
+
+  ValueT& operator[](const KeyT& key) {
+    auto idx = findSlot(key);
+    if (idx == NOT_FOUND) {
+      idx = insertNew(value_type(key, ValueT()));
+    }
+    return slots_[idx].value.second;
+  }
+
+  size_t erase(const KeyT& key) {
+    auto idx = findSlot(key);
+    if (idx == NOT_FOUND) {
+      return 0;
+    }
+    // Backward shift deletion: move later entries of the probe sequence
+    // into the hole, so lookups never need tombstones.
+    auto mask = slots_.size() - 1;
+    auto hole = idx;
+    for (auto next = (hole + 1) & mask; slots_[next].used;
+         next = (next + 1) & mask) {
+      auto home = getBucket(slots_[next].value.first);
+      bool canMove = (next > hole) ? (home <= hole || home > next)
+                                   : (home <= hole && home > next);
+      if (canMove) {
+        slots_[hole].value = std::move(slots_[next].value);
+        hole = next;
+      }
+    }
+    slots_[hole].used = false;
+    slots_[hole].value = value_type();
+    --size_;
+    return 1;
+  }
+
+  bool operator==(const OpenHashMap& other) const {
+    if (size_ != other.size_) {
+      return false;
+    }
+    for (const auto& entry : *this) {
+      auto it = other.find(entry.first);
+      if (it == other.end() || !(it->second == entry.second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool operator!=(const OpenHashMap& other) const {
+    return !operator==(other);
+  }
+
+ private:
+  enum : size_t {
+    MIN_CAPACITY = 8,
+    NOT_FOUND = ~size_t(0),
+  };
+
+  struct Slot {
+    bool used{false};
+    value_type value;
+  };
+
+  size_t getBucket(const KeyT& key) const {
+    // Mix the hash, since many std::hash implementations are the identity
+    // and the table size is a power of two.
+    return folly::hash::twang_mix64(HashT()(key)) & (slots_.size() - 1);
+  }
+
+  size_t findSlot(const KeyT& key) const {
+    if (slots_.empty()) {
+      return NOT_FOUND;
+    }
+    auto mask = slots_.size() - 1;
+    for (auto idx = getBucket(key); slots_[idx].used; idx = (idx + 1) & mask) {
+      if (slots_[idx].value.first == key) {
+        return idx;
+      }
+    }
+    return NOT_FOUND;
+  }
+
+  size_t insertNew(value_type value) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+      rehash(slots_.empty() ? size_t(MIN_CAPACITY) : slots_.size() * 2);
+    }
+    auto mask = slots_.size() - 1;
+    auto idx = getBucket(value.first);
+    while (slots_[idx].used) {
+      idx = (idx + 1) & mask;
+    }
+    slots_[idx].used = true;
+    slots_[idx].value = std::move(value);
+    ++size_;
+    return idx;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<Slot> old(capacity);
+    old.swap(slots_);
+    size_ = 0;
+    for (auto& slot : old) {
+      if (slot.used) {
+        insertNew(std::move(slot.value));
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_{0};
+};
+
+}} // facebook::fboss
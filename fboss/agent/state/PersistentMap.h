@@ -0,0 +1,572 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace facebook { namespace fboss {
+
+/*
+ * PersistentMap is a sorted map implemented as a copy-on-write B+ tree.
+ *
+ * It provides the subset of the boost::container::flat_map API used by
+ * NodeMapT, so it can be selected as the NodeContainer of a NodeMapTraits for
+ * maps that are large and modified often, such as route tables and neighbor
+ * tables.
+ *
+ * Copying a PersistentMap only copies the root pointer.  The tree nodes are
+ * shared between the copies until one of them is modified: a modification
+ * copies the nodes on the path from the root to the modified entry, and
+ * shares every other node.  A tree node which is not shared with any other
+ * map is modified in place.  Both copying a map and modifying a copy are
+ * therefore O(log N), rather than O(N) for flat_map.
+ *
+ * Only const iterators are provided.  Use operator[] to replace the value of
+ * an existing entry.  Like flat_map, any modification to the map invalidates
+ * all iterators.
+ *
+ * As with the rest of the SwitchState, a PersistentMap may be read from
+ * multiple threads, but must only be modified by a single thread, and only
+ * while no other thread is accessing that particular copy.
+ */
+template<typename KeyT, typename ValueT>
+class PersistentMap {
+ private:
+  struct TreeNode;
+  typedef std::shared_ptr<TreeNode> NodePtr;
+
+ public:
+  typedef KeyT key_type;
+  typedef ValueT mapped_type;
+  typedef std::pair<KeyT, ValueT> value_type;
+  typedef size_t size_type;
+
+  class const_iterator;
+  typedef const_iterator iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+  typedef const_reverse_iterator reverse_iterator;
+
+  PersistentMap() {}
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  void clear() {
+    root_.reset();
+    size_ = 0;
+  }
+
+  const_iterator begin() const {
+    const_iterator it(root_.get());
+    if (size_ > 0) {
+      it.descendLeft(root_.get());
+    }
+    return it;
+  }
+  const_iterator end() const {
+    return const_iterator(root_.get());
+  }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  const_iterator find(const KeyT& key) const;
+  // Return an iterator to the first entry with a key greater than key
+  const_iterator upper_bound(const KeyT& key) const;
+  size_t count(const KeyT& key) const {
+    return find(key) == end() ? 0 : 1;
+  }
+
+  /*
+   * Insert the entry if there is no entry with the same key yet.
+   *
+   * Returns an iterator pointing to the entry with the key, and whether the
+   * entry was inserted.
+   */
+  std::pair<const_iterator, bool> insert(value_type value);
+  std::pair<const_iterator, bool> emplace(const KeyT& key, ValueT value) {
+    return insert(value_type(key, std::move(value)));
+  }
+
+  /*
+   * Return a modifiable reference to the value for the given key, inserting a
+   * default-constructed value if the key is not present yet.
+   *
+   * The reference is only valid until the next modification of the map.
+   */
+  ValueT& operator[](const KeyT& key);
+
+  size_t erase(const KeyT& key);
+  void erase(const_iterator pos) {
+    // Copy the key, since pos is invalidated during the removal
+    KeyT key = pos->first;
+    erase(key);
+  }
+
+  /*
+   * Returns true if both maps share the same root node.  This is a cheap
+   * check that the two maps have identical contents.
+   */
+  bool sharesRoot(const PersistentMap& other) const {
+    return root_ == other.root_;
+  }
+
+  /*
+   * Advance a and b past their leading entries with identical values,
+   * stopping at aEnd and bEnd respectively.  a and b may iterate over
+   * different maps.
+   *
+   * When both iterators are positioned at the same entry of a tree node that
+   * is shared by both maps, the rest of that node is skipped at once rather
+   * than one entry at a time.  Comparing two versions of a map derived from
+   * each other is therefore proportional to the number of modified tree
+   * nodes, not to the size of the map.
+   */
+  static void skipEqual(const_iterator* a, const const_iterator& aEnd,
+                        const_iterator* b, const const_iterator& bEnd);
+
+ private:
+  enum : size_t {
+    // The maximum number of entries in a leaf, or of children of an internal
+    // node.  A node that grows larger than this is split in half.
+    kMaxEntries = 64,
+    // A non-root node that shrinks below this is merged with a neighbour.
+    kMinEntries = kMaxEntries / 4,
+    // With these limits a tree of this depth holds several hundred million
+    // entries.
+    kMaxDepth = 8,
+  };
+
+  struct TreeNode {
+    explicit TreeNode(bool leaf) : leaf(leaf) {}
+
+    size_t count() const {
+      return leaf ? values.size() : children.size();
+    }
+    const KeyT& firstKey() const {
+      return leaf ? values.front().first : keys.front();
+    }
+
+    bool leaf;
+    // The entries of a leaf node, sorted by key
+    std::vector<value_type> values;
+    // The children of an internal node, and the first key of each child
+    std::vector<KeyT> keys;
+    std::vector<NodePtr> children;
+  };
+
+  static bool keyLess(const value_type& value, const KeyT& key) {
+    return value.first < key;
+  }
+
+  // Return the index of the child of an internal node that may contain key
+  static size_t childIndex(const TreeNode* node, const KeyT& key) {
+    auto it = std::upper_bound(node->keys.begin(), node->keys.end(), key);
+    return it == node->keys.begin() ? 0 : it - node->keys.begin() - 1;
+  }
+
+  // Copy the node if it is shared with another tree
+  static void makeUnique(NodePtr* node) {
+    if (node->use_count() != 1) {
+      *node = std::make_shared<TreeNode>(**node);
+    }
+  }
+
+  static NodePtr split(TreeNode* node);
+  static NodePtr insertImpl(TreeNode* node, value_type value);
+  static void eraseImpl(TreeNode* node, const KeyT& key);
+  static void rebalance(TreeNode* node, size_t index);
+
+  NodePtr root_;
+  size_t size_{0};
+
+ public:
+  class const_iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                              const value_type> {
+   public:
+    const_iterator() {}
+
+    const value_type& operator*() const {
+      const auto& frame = frames_[depth_ - 1];
+      return frame.node->values[frame.index];
+    }
+    const value_type* operator->() const {
+      return &**this;
+    }
+
+    const_iterator& operator++() {
+      increment();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator tmp(*this);
+      increment();
+      return tmp;
+    }
+    const_iterator& operator--() {
+      decrement();
+      return *this;
+    }
+    const_iterator operator--(int) {
+      const_iterator tmp(*this);
+      decrement();
+      return tmp;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      if (depth_ != other.depth_) {
+        return false;
+      }
+      if (depth_ == 0) {
+        return true;
+      }
+      const auto& a = frames_[depth_ - 1];
+      const auto& b = other.frames_[depth_ - 1];
+      return a.node == b.node && a.index == b.index;
+    }
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class PersistentMap;
+
+    struct Frame {
+      const TreeNode* node;
+      size_t index;
+    };
+
+    explicit const_iterator(const TreeNode* root) : root_(root) {}
+
+    void push(const TreeNode* node, size_t index) {
+      CHECK_LT(depth_, kMaxDepth);
+      frames_[depth_].node = node;
+      frames_[depth_].index = index;
+      ++depth_;
+    }
+    void descendLeft(const TreeNode* node) {
+      while (true) {
+        push(node, 0);
+        if (node->leaf) {
+          return;
+        }
+        node = node->children.front().get();
+      }
+    }
+    void descendRight(const TreeNode* node) {
+      while (true) {
+        push(node, node->count() - 1);
+        if (node->leaf) {
+          return;
+        }
+        node = node->children.back().get();
+      }
+    }
+
+    void increment() {
+      while (depth_ > 0) {
+        auto& frame = frames_[depth_ - 1];
+        if (++frame.index < frame.node->count()) {
+          if (!frame.node->leaf) {
+            descendLeft(frame.node->children[frame.index].get());
+          }
+          return;
+        }
+        --depth_;
+      }
+    }
+    // Move past the remaining entries below the node at the given depth
+    void skipNode(size_t level) {
+      depth_ = level + 1;
+      frames_[level].index = frames_[level].node->count() - 1;
+      increment();
+    }
+    void decrement() {
+      if (depth_ == 0) {
+        descendRight(root_);
+        return;
+      }
+      while (depth_ > 0) {
+        auto& frame = frames_[depth_ - 1];
+        if (frame.index > 0) {
+          --frame.index;
+          if (!frame.node->leaf) {
+            descendRight(frame.node->children[frame.index].get());
+          }
+          return;
+        }
+        --depth_;
+      }
+    }
+
+    // The root is needed to step back from end()
+    const TreeNode* root_{nullptr};
+    // The path from the root to the current entry.  depth_ is 0 at end().
+    size_t depth_{0};
+    Frame frames_[kMaxDepth];
+  };
+};
+
+template<typename KeyT, typename ValueT>
+typename PersistentMap<KeyT, ValueT>::const_iterator
+PersistentMap<KeyT, ValueT>::find(const KeyT& key) const {
+  const_iterator it(root_.get());
+  if (size_ == 0) {
+    return it;
+  }
+  const TreeNode* node = root_.get();
+  while (!node->leaf) {
+    auto index = childIndex(node, key);
+    it.push(node, index);
+    node = node->children[index].get();
+  }
+  auto valueIt = std::lower_bound(node->values.begin(), node->values.end(),
+                                  key, keyLess);
+  if (valueIt == node->values.end() || key < valueIt->first) {
+    return end();
+  }
+  it.push(node, valueIt - node->values.begin());
+  return it;
+}
+
+template<typename KeyT, typename ValueT>
+typename PersistentMap<KeyT, ValueT>::const_iterator
+PersistentMap<KeyT, ValueT>::upper_bound(const KeyT& key) const {
+  const_iterator it(root_.get());
+  if (size_ == 0) {
+    return it;
+  }
+  const TreeNode* node = root_.get();
+  while (!node->leaf) {
+    auto index = childIndex(node, key);
+    it.push(node, index);
+    node = node->children[index].get();
+  }
+  auto valueIt = std::upper_bound(
+      node->values.begin(), node->values.end(), key,
+      [](const KeyT& k, const value_type& value) { return k < value.first; });
+  size_t index = valueIt - node->values.begin();
+  if (index == node->values.size()) {
+    // The entry we want is the first one of the next leaf, if any
+    it.push(node, index - 1);
+    it.increment();
+  } else {
+    it.push(node, index);
+  }
+  return it;
+}
+
+template<typename KeyT, typename ValueT>
+void PersistentMap<KeyT, ValueT>::skipEqual(
+    const_iterator* a, const const_iterator& aEnd,
+    const_iterator* b, const const_iterator& bEnd) {
+  while (*a != aEnd && *b != bEnd) {
+    // Count the levels, starting from the leaves, where both iterators are
+    // at the same position of the same tree node.
+    size_t shared = 0;
+    while (shared < a->depth_ && shared < b->depth_) {
+      const auto& frameA = a->frames_[a->depth_ - shared - 1];
+      const auto& frameB = b->frames_[b->depth_ - shared - 1];
+      if (frameA.node != frameB.node || frameA.index != frameB.index) {
+        break;
+      }
+      ++shared;
+    }
+    if (shared > 0) {
+      // Everything up to the end of the highest shared node is identical
+      a->skipNode(a->depth_ - shared);
+      b->skipNode(b->depth_ - shared);
+      continue;
+    }
+
+    if ((*a)->second != (*b)->second) {
+      return;
+    }
+    ++*a;
+    ++*b;
+  }
+}
+
+template<typename KeyT, typename ValueT>
+std::pair<typename PersistentMap<KeyT, ValueT>::const_iterator, bool>
+PersistentMap<KeyT, ValueT>::insert(value_type value) {
+  auto it = find(value.first);
+  if (it != end()) {
+    return std::make_pair(it, false);
+  }
+
+  KeyT key = value.first;
+  if (!root_) {
+    root_ = std::make_shared<TreeNode>(true);
+  }
+  makeUnique(&root_);
+  auto sibling = insertImpl(root_.get(), std::move(value));
+  if (sibling) {
+    // The root was split, so the tree grows by one level
+    auto newRoot = std::make_shared<TreeNode>(false);
+    newRoot->keys.push_back(root_->firstKey());
+    newRoot->keys.push_back(sibling->firstKey());
+    newRoot->children.push_back(std::move(root_));
+    newRoot->children.push_back(std::move(sibling));
+    root_ = std::move(newRoot);
+  }
+  ++size_;
+  return std::make_pair(find(key), true);
+}
+
+template<typename KeyT, typename ValueT>
+ValueT& PersistentMap<KeyT, ValueT>::operator[](const KeyT& key) {
+  if (find(key) == end()) {
+    insert(value_type(key, ValueT()));
+  }
+  makeUnique(&root_);
+  TreeNode* node = root_.get();
+  while (!node->leaf) {
+    auto& child = node->children[childIndex(node, key)];
+    makeUnique(&child);
+    node = child.get();
+  }
+  auto valueIt = std::lower_bound(node->values.begin(), node->values.end(),
+                                  key, keyLess);
+  return valueIt->second;
+}
+
+template<typename KeyT, typename ValueT>
+size_t PersistentMap<KeyT, ValueT>::erase(const KeyT& key) {
+  if (find(key) == end()) {
+    return 0;
+  }
+  makeUnique(&root_);
+  eraseImpl(root_.get(), key);
+  --size_;
+  if (size_ == 0) {
+    root_.reset();
+    return 1;
+  }
+  // Remove the levels that only have a single child left
+  while (!root_->leaf && root_->children.size() == 1) {
+    NodePtr child = root_->children.front();
+    root_ = std::move(child);
+  }
+  return 1;
+}
+
+template<typename KeyT, typename ValueT>
+typename PersistentMap<KeyT, ValueT>::NodePtr
+PersistentMap<KeyT, ValueT>::split(TreeNode* node) {
+  auto right = std::make_shared<TreeNode>(node->leaf);
+  size_t half = node->count() / 2;
+  if (node->leaf) {
+    right->values.assign(std::make_move_iterator(node->values.begin() + half),
+                         std::make_move_iterator(node->values.end()));
+    node->values.erase(node->values.begin() + half, node->values.end());
+  } else {
+    right->keys.assign(node->keys.begin() + half, node->keys.end());
+    right->children.assign(
+        std::make_move_iterator(node->children.begin() + half),
+        std::make_move_iterator(node->children.end()));
+    node->keys.erase(node->keys.begin() + half, node->keys.end());
+    node->children.erase(node->children.begin() + half, node->children.end());
+  }
+  return right;
+}
+
+template<typename KeyT, typename ValueT>
+typename PersistentMap<KeyT, ValueT>::NodePtr
+PersistentMap<KeyT, ValueT>::insertImpl(TreeNode* node, value_type value) {
+  if (node->leaf) {
+    auto valueIt = std::lower_bound(node->values.begin(), node->values.end(),
+                                    value.first, keyLess);
+    node->values.insert(valueIt, std::move(value));
+  } else {
+    auto index = childIndex(node, value.first);
+    auto* child = &node->children[index];
+    makeUnique(child);
+    auto sibling = insertImpl(child->get(), std::move(value));
+    node->keys[index] = (*child)->firstKey();
+    if (sibling) {
+      node->keys.insert(node->keys.begin() + index + 1, sibling->firstKey());
+      node->children.insert(node->children.begin() + index + 1,
+                            std::move(sibling));
+    }
+  }
+  if (node->count() <= kMaxEntries) {
+    return nullptr;
+  }
+  return split(node);
+}
+
+template<typename KeyT, typename ValueT>
+void PersistentMap<KeyT, ValueT>::eraseImpl(TreeNode* node, const KeyT& key) {
+  if (node->leaf) {
+    auto valueIt = std::lower_bound(node->values.begin(), node->values.end(),
+                                    key, keyLess);
+    DCHECK(valueIt != node->values.end() && !(key < valueIt->first));
+    node->values.erase(valueIt);
+    return;
+  }
+
+  auto index = childIndex(node, key);
+  auto* child = &node->children[index];
+  makeUnique(child);
+  eraseImpl(child->get(), key);
+  if ((*child)->count() == 0) {
+    node->keys.erase(node->keys.begin() + index);
+    node->children.erase(node->children.begin() + index);
+    return;
+  }
+  node->keys[index] = (*child)->firstKey();
+  if ((*child)->count() < kMinEntries && node->children.size() > 1) {
+    rebalance(node, index);
+  }
+}
+
+template<typename KeyT, typename ValueT>
+void PersistentMap<KeyT, ValueT>::rebalance(TreeNode* node, size_t index) {
+  // Merge the child with a neighbour, and split the result in half again if
+  // it is too large.
+  size_t leftIndex = index > 0 ? index - 1 : index;
+  size_t rightIndex = leftIndex + 1;
+  makeUnique(&node->children[leftIndex]);
+  auto* left = node->children[leftIndex].get();
+  const auto* right = node->children[rightIndex].get();
+  if (left->leaf) {
+    left->values.insert(left->values.end(), right->values.begin(),
+                        right->values.end());
+  } else {
+    left->keys.insert(left->keys.end(), right->keys.begin(),
+                      right->keys.end());
+    left->children.insert(left->children.end(), right->children.begin(),
+                          right->children.end());
+  }
+  node->keys.erase(node->keys.begin() + rightIndex);
+  node->children.erase(node->children.begin() + rightIndex);
+
+  if (left->count() > kMaxEntries) {
+    auto sibling = split(left);
+    node->keys.insert(node->keys.begin() + rightIndex, sibling->firstKey());
+    node->children.insert(node->children.begin() + rightIndex,
+                          std::move(sibling));
+  }
+}
+
+}} // facebook::fboss
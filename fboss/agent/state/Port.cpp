@@ -25,6 +25,38 @@ constexpr auto kVlanMemberships = "vlanMemberShips";
 constexpr auto kVlanId = "vlanId";
 constexpr auto kVlanInfo = "vlanInfo";
 constexpr auto kTagged = "tagged";
+constexpr auto kSflowIngressRate = "sFlowIngressRate";
+constexpr auto kSflowEgressRate = "sFlowEgressRate";
+constexpr auto kQos = "qos";
+constexpr auto kDscpToQueue = "dscpToQueue";
+constexpr auto kPcpToQueue = "pcpToQueue";
+constexpr auto kQueueWeights = "queueWeights";
+constexpr auto kBuffer = "buffer";
+constexpr auto kCutThrough = "cutThrough";
+constexpr auto kIngressMinBytes = "ingressMinBytes";
+constexpr auto kIngressSharedLimitBytes = "ingressSharedLimitBytes";
+constexpr auto kHeadroomBytes = "headroomBytes";
+constexpr auto kEgressMinBytes = "egressMinBytes";
+constexpr auto kEgressSharedLimitBytes = "egressSharedLimitBytes";
+
+template<typename Map>
+folly::dynamic mapToFollyDynamic(const Map& map) {
+  folly::dynamic json = folly::dynamic::object;
+  for (const auto& entry : map) {
+    json[to<string>(entry.first)] = entry.second;
+  }
+  return json;
+}
+
+template<typename Map>
+Map mapFromFollyDynamic(const folly::dynamic& json) {
+  Map map;
+  for (const auto& entry : json.items()) {
+    map.emplace(to<typename Map::key_type>(entry.first.asString()),
+                entry.second.asInt());
+  }
+  return map;
+}
 }
 namespace facebook { namespace fboss {
 
@@ -40,6 +72,62 @@ PortFields::VlanInfo::fromFollyDynamic(const folly::dynamic& json) {
   return VlanInfo(json[kTagged].asBool());
 }
 
+folly::dynamic PortFields::QosConfig::toFollyDynamic() const {
+  folly::dynamic qos = folly::dynamic::object;
+  qos[kDscpToQueue] = mapToFollyDynamic(dscpToQueue);
+  qos[kPcpToQueue] = mapToFollyDynamic(pcpToQueue);
+  qos[kQueueWeights] = mapToFollyDynamic(queueWeights);
+  return qos;
+}
+
+PortFields::QosConfig
+PortFields::QosConfig::fromFollyDynamic(const folly::dynamic& json) {
+  QosConfig qos;
+  qos.dscpToQueue = mapFromFollyDynamic<QueueMap>(json[kDscpToQueue]);
+  qos.pcpToQueue = mapFromFollyDynamic<QueueMap>(json[kPcpToQueue]);
+  qos.queueWeights = mapFromFollyDynamic<decltype(qos.queueWeights)>(
+      json[kQueueWeights]);
+  return qos;
+}
+
+folly::dynamic PortFields::BufferConfig::toFollyDynamic() const {
+  folly::dynamic buffer = folly::dynamic::object;
+  buffer[kCutThrough] = cutThrough;
+  buffer[kIngressMinBytes] = ingressMinBytes;
+  buffer[kIngressSharedLimitBytes] = ingressSharedLimitBytes;
+  buffer[kHeadroomBytes] = headroomBytes;
+  buffer[kEgressMinBytes] = egressMinBytes;
+  buffer[kEgressSharedLimitBytes] = egressSharedLimitBytes;
+  return buffer;
+}
+
+PortFields::BufferConfig
+PortFields::BufferConfig::fromFollyDynamic(const folly::dynamic& json) {
+  BufferConfig buffer;
+  buffer.cutThrough = json[kCutThrough].asBool();
+  buffer.ingressMinBytes = json[kIngressMinBytes].asInt();
+  buffer.ingressSharedLimitBytes = json[kIngressSharedLimitBytes].asInt();
+  buffer.headroomBytes = json[kHeadroomBytes].asInt();
+  buffer.egressMinBytes = json[kEgressMinBytes].asInt();
+  buffer.egressSharedLimitBytes = json[kEgressSharedLimitBytes].asInt();
+  return buffer;
+}
+
+uint8_t PortFields::QosConfig::getQueueForDscp(uint8_t dscp) const {
+  auto it = dscpToQueue.find(dscp);
+  return it == dscpToQueue.end() ? 0 : it->second;
+}
+
+uint8_t PortFields::QosConfig::getQueueForPcp(uint8_t pcp) const {
+  auto it = pcpToQueue.find(pcp);
+  return it == pcpToQueue.end() ? 0 : it->second;
+}
+
+uint32_t PortFields::QosConfig::getQueueWeight(uint8_t queue) const {
+  auto it = queueWeights.find(queue);
+  return it == queueWeights.end() ? 1 : it->second;
+}
+
 folly::dynamic PortFields::toFollyDynamic() const {
   folly::dynamic port = folly::dynamic::object;
   port[kPortId] = static_cast<uint16_t>(id);
@@ -56,6 +144,10 @@ folly::dynamic PortFields::toFollyDynamic() const {
     port[kVlanMemberships][to<string>(vlan.first)] =
       vlan.second.toFollyDynamic();
   }
+  port[kSflowIngressRate] = sFlowIngressRate;
+  port[kSflowEgressRate] = sFlowEgressRate;
+  port[kQos] = qos.toFollyDynamic();
+  port[kBuffer] = buffer.toFollyDynamic();
   return port;
 }
 
@@ -75,6 +167,15 @@ PortFields PortFields::fromFollyDynamic(const folly::dynamic& portJson) {
     port.vlans.emplace(VlanID(to<uint32_t>(vlanInfo.first.asString())),
       VlanInfo::fromFollyDynamic(vlanInfo.second));
   }
+  // States saved before sFlow was supported have no sampling rates
+  port.sFlowIngressRate = portJson.getDefault(kSflowIngressRate, 0).asInt();
+  port.sFlowEgressRate = portJson.getDefault(kSflowEgressRate, 0).asInt();
+  if (portJson.count(kQos)) {
+    port.qos = QosConfig::fromFollyDynamic(portJson[kQos]);
+  }
+  if (portJson.count(kBuffer)) {
+    port.buffer = BufferConfig::fromFollyDynamic(portJson[kBuffer]);
+  }
   return port;
 }
 
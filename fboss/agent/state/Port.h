@@ -33,6 +33,67 @@ struct PortFields {
   };
   typedef boost::container::flat_map<VlanID, VlanInfo> VlanMembership;
 
+  /*
+   * Which egress queue packets are put in, by their DSCP or 802.1p priority
+   * (PCP), and how the queues share the port.  Values missing from the maps
+   * go to queue 0, and queues without a weight have weight 1.  A weight of
+   * 0 gives the queue strict priority over the weighted queues.
+   */
+  struct QosConfig {
+    enum : uint8_t {
+      kNumQueues = 8,
+      kNumDscps = 64,
+      kNumPcps = 8,
+    };
+    typedef boost::container::flat_map<uint8_t, uint8_t> QueueMap;
+
+    bool operator==(const QosConfig& other) const {
+      return dscpToQueue == other.dscpToQueue &&
+        pcpToQueue == other.pcpToQueue &&
+        queueWeights == other.queueWeights;
+    }
+    bool operator!=(const QosConfig& other) const {
+      return !(*this == other);
+    }
+    folly::dynamic toFollyDynamic() const;
+    static QosConfig fromFollyDynamic(const folly::dynamic& json);
+
+    uint8_t getQueueForDscp(uint8_t dscp) const;
+    uint8_t getQueueForPcp(uint8_t pcp) const;
+    uint32_t getQueueWeight(uint8_t queue) const;
+
+    QueueMap dscpToQueue;
+    QueueMap pcpToQueue;
+    boost::container::flat_map<uint8_t, uint32_t> queueWeights;
+  };
+
+  /*
+   * The port's share of the packet buffer, in bytes, with 0 leaving the
+   * ASIC's default, and whether it forwards packets cut through.
+   */
+  struct BufferConfig {
+    bool operator==(const BufferConfig& other) const {
+      return cutThrough == other.cutThrough &&
+        ingressMinBytes == other.ingressMinBytes &&
+        ingressSharedLimitBytes == other.ingressSharedLimitBytes &&
+        headroomBytes == other.headroomBytes &&
+        egressMinBytes == other.egressMinBytes &&
+        egressSharedLimitBytes == other.egressSharedLimitBytes;
+    }
+    bool operator!=(const BufferConfig& other) const {
+      return !(*this == other);
+    }
+    folly::dynamic toFollyDynamic() const;
+    static BufferConfig fromFollyDynamic(const folly::dynamic& json);
+
+    bool cutThrough{false};
+    uint32_t ingressMinBytes{0};
+    uint32_t ingressSharedLimitBytes{0};
+    uint32_t headroomBytes{0};
+    uint32_t egressMinBytes{0};
+    uint32_t egressSharedLimitBytes{0};
+  };
+
   PortFields(PortID id, std::string name)
     : id(id),
       name(name) {}
@@ -49,6 +110,11 @@ struct PortFields {
   VlanID ingressVlan{0};
   cfg::PortSpeed speed{cfg::PortSpeed::DEFAULT};
   VlanMembership vlans;
+  // Sample one in this many packets for sFlow; 0 disables sampling
+  uint32_t sFlowIngressRate{0};
+  uint32_t sFlowEgressRate{0};
+  QosConfig qos;
+  BufferConfig buffer;
 };
 
 /*
@@ -58,6 +124,8 @@ class Port : public NodeBaseT<Port, PortFields> {
  public:
   typedef PortFields::VlanInfo VlanInfo;
   typedef PortFields::VlanMembership VlanMembership;
+  typedef PortFields::QosConfig QosConfig;
+  typedef PortFields::BufferConfig BufferConfig;
 
   Port(PortID id, const std::string& name);
 
@@ -107,6 +175,34 @@ class Port : public NodeBaseT<Port, PortFields> {
     writableFields()->speed = speed;
   }
 
+  uint32_t getSflowIngressRate() const {
+    return getFields()->sFlowIngressRate;
+  }
+  void setSflowIngressRate(uint32_t rate) {
+    writableFields()->sFlowIngressRate = rate;
+  }
+
+  uint32_t getSflowEgressRate() const {
+    return getFields()->sFlowEgressRate;
+  }
+  void setSflowEgressRate(uint32_t rate) {
+    writableFields()->sFlowEgressRate = rate;
+  }
+
+  const QosConfig& getQos() const {
+    return getFields()->qos;
+  }
+  void setQos(const QosConfig& qos) {
+    writableFields()->qos = qos;
+  }
+
+  const BufferConfig& getBuffer() const {
+    return getFields()->buffer;
+  }
+  void setBuffer(const BufferConfig& buffer) {
+    writableFields()->buffer = buffer;
+  }
+
  private:
   // Inherit the constructors required for clone()
   using NodeBaseT::NodeBaseT;
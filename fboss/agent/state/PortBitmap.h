@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/types.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace facebook { namespace fboss {
+
+/*
+ * PortBitmap is a set of ports, stored as one bit per PortID.
+ *
+ * Comparing two bitmaps, or finding the ports that differ between them,
+ * is a word at a time rather than a port at a time, so finding the
+ * membership changes of VLANs spanning most of the ports of a switch is
+ * cheap.  Iterating over the members only visits the words that have
+ * any.
+ *
+ * The bitmap grows to hold the largest PortID it has held, so PortIDs
+ * should be dense.  Trailing empty words are trimmed, so equal sets always
+ * compare equal.
+ */
+class PortBitmap {
+ public:
+  PortBitmap() {}
+
+  bool test(PortID port) const {
+    auto word = static_cast<size_t>(port) / kBitsPerWord;
+    return word < words_.size() &&
+      (words_[word] & bit(port)) != 0;
+  }
+
+  void set(PortID port) {
+    auto word = static_cast<size_t>(port) / kBitsPerWord;
+    if (word >= words_.size()) {
+      words_.resize(word + 1, 0);
+    }
+    words_[word] |= bit(port);
+  }
+
+  void reset(PortID port) {
+    auto word = static_cast<size_t>(port) / kBitsPerWord;
+    if (word < words_.size()) {
+      words_[word] &= ~bit(port);
+      trim();
+    }
+  }
+
+  void clear() {
+    words_.clear();
+  }
+
+  bool empty() const {
+    return words_.empty();
+  }
+
+  size_t count() const {
+    size_t n = 0;
+    for (auto word : words_) {
+      n += __builtin_popcountll(word);
+    }
+    return n;
+  }
+
+  /*
+   * Call fn(PortID) for each port in the bitmap, in order.
+   */
+  template<typename Fn>
+  void forEach(Fn fn) const {
+    for (size_t i = 0; i < words_.size(); ++i) {
+      auto word = words_[i];
+      while (word) {
+        auto bitIndex = __builtin_ctzll(word);
+        fn(PortID(i * kBitsPerWord + bitIndex));
+        word &= word - 1;
+      }
+    }
+  }
+
+  PortBitmap& operator&=(const PortBitmap& other) {
+    words_.resize(std::min(words_.size(), other.words_.size()));
+    for (size_t i = 0; i < words_.size(); ++i) {
+      words_[i] &= other.words_[i];
+    }
+    trim();
+    return *this;
+  }
+
+  PortBitmap& operator|=(const PortBitmap& other) {
+    if (other.words_.size() > words_.size()) {
+      words_.resize(other.words_.size(), 0);
+    }
+    for (size_t i = 0; i < other.words_.size(); ++i) {
+      words_[i] |= other.words_[i];
+    }
+    return *this;
+  }
+
+  PortBitmap& operator^=(const PortBitmap& other) {
+    if (other.words_.size() > words_.size()) {
+      words_.resize(other.words_.size(), 0);
+    }
+    for (size_t i = 0; i < other.words_.size(); ++i) {
+      words_[i] ^= other.words_[i];
+    }
+    trim();
+    return *this;
+  }
+
+  bool operator==(const PortBitmap& other) const {
+    return words_ == other.words_;
+  }
+  bool operator!=(const PortBitmap& other) const {
+    return words_ != other.words_;
+  }
+
+ private:
+  typedef uint64_t Word;
+  enum : size_t { kBitsPerWord = 64 };
+
+  static Word bit(PortID port) {
+    return Word(1) << (static_cast<size_t>(port) % kBitsPerWord);
+  }
+
+  void trim() {
+    while (!words_.empty() && words_.back() == 0) {
+      words_.pop_back();
+    }
+  }
+
+  std::vector<Word> words_;
+};
+
+inline PortBitmap operator&(PortBitmap lhs, const PortBitmap& rhs) {
+  lhs &= rhs;
+  return lhs;
+}
+
+inline PortBitmap operator|(PortBitmap lhs, const PortBitmap& rhs) {
+  lhs |= rhs;
+  return lhs;
+}
+
+inline PortBitmap operator^(PortBitmap lhs, const PortBitmap& rhs) {
+  lhs ^= rhs;
+  return lhs;
+}
+
+}} // facebook::fboss
@@ -18,6 +18,8 @@ constexpr auto kPrefix = "prefix";
 constexpr auto kNextHops = "nexthops";
 constexpr auto kFwdInfo = "forwardingInfo";
 constexpr auto kFlags = "flags";
+constexpr auto kClients = "clients";
+constexpr auto kClientId = "clientId";
 }
 namespace facebook { namespace fboss {
 
@@ -31,12 +33,12 @@ RouteFields<AddrT>::RouteFields(const Prefix& prefix) : prefix(prefix) {
 
 template<typename AddrT>
 RouteFields<AddrT>::RouteFields(const RouteFields& rf,
-    CopyBehavior copyBehavior) : prefix(rf.prefix) {
+    CopyBehavior copyBehavior) : prefix(rf.prefix), clients(rf.clients) {
   switch(copyBehavior) {
   case COPY_ALL_MEMBERS:
     nexthops = rf.nexthops;
-    fwd = fwd;
-    flags = flags;
+    fwd = rf.fwd;
+    flags = rf.flags;
     break;
   case COPY_ONLY_PREFIX:
     break;
@@ -47,6 +49,7 @@ template<typename AddrT>
 bool RouteFields<AddrT>::operator==(const RouteFields& rf) const {
   return (flags == rf.flags
           && prefix == rf.prefix
+          && clients == rf.clients
           && nexthops == rf.nexthops
           && fwd == rf.fwd);
 }
@@ -56,12 +59,19 @@ folly::dynamic RouteFields<AddrT>::toFollyDynamic() const {
   folly::dynamic routeFields = folly::dynamic::object;
   routeFields[kPrefix] = prefix.toFollyDynamic();
   std::vector<folly::dynamic> nhopsList;
-  for (const auto& nhop: nexthops) {
+  for (const auto& nhop: *nexthops) {
     nhopsList.emplace_back(nhop.str());
   }
   routeFields[kNextHops] = nhopsList;
   routeFields[kFwdInfo] = fwd.toFollyDynamic();
   routeFields[kFlags] = flags;
+  std::vector<folly::dynamic> clientsList;
+  for (const auto& client : clients) {
+    auto entry = client.second.toFollyDynamic();
+    entry[kClientId] = static_cast<int16_t>(client.first);
+    clientsList.push_back(std::move(entry));
+  }
+  routeFields[kClients] = clientsList;
   return routeFields;
 }
 
@@ -69,11 +79,20 @@ template<typename AddrT>
 RouteFields<AddrT>
 RouteFields<AddrT>::fromFollyDynamic(const folly::dynamic& routeJson) {
   RouteFields rt(Prefix::fromFollyDynamic(routeJson[kPrefix]));
+  RouteNextHops nhops;
   for (const auto& nhop: routeJson[kNextHops]) {
-    rt.nexthops.emplace(nhop.stringPiece());
+    nhops.emplace(nhop.stringPiece());
   }
+  rt.nexthops = InternedRouteNextHops(std::move(nhops));
   rt.fwd = RouteForwardInfo::fromFollyDynamic(routeJson[kFwdInfo]);
   rt.flags = routeJson[kFlags].asInt();
+  // Routes saved before clients were tracked have no clients
+  if (routeJson.count(kClients)) {
+    for (const auto& entry : routeJson[kClients]) {
+      rt.clients.emplace(ClientID(entry[kClientId].asInt()),
+                         RouteNextHopEntry::fromFollyDynamic(entry));
+    }
+  }
   return rt;
 }
 
@@ -106,6 +125,13 @@ Route<AddrT>::Route(const Prefix& prefix, Action action)
   update(action);
 }
 
+template<typename AddrT>
+Route<AddrT>::Route(const Prefix& prefix, ClientID client,
+                    RouteNextHopEntry entry)
+    : RouteBase(prefix) {
+  update(client, std::move(entry));
+}
+
 template<typename AddrT>
 Route<AddrT>::~Route() {
 }
@@ -114,7 +140,7 @@ template<typename AddrT>
 std::string Route<AddrT>::str() const {
   std::string ret;
   ret = folly::to<string>(prefix(), '@');
-  for (const auto& nh : RouteBase::getFields()->nexthops) {
+  for (const auto& nh : nexthops()) {
     ret.append(folly::to<string>(nh, "."));
   }
   ret.append(" State:");
@@ -149,7 +175,7 @@ bool Route<AddrT>::isSame(InterfaceID intf, const IPAddress& addr) const {
 
 template<typename AddrT>
 bool Route<AddrT>::isSame(const RouteNextHops& nhs) const {
-  return RouteBase::getFields()->nexthops == nhs;
+  return nexthops() == nhs;
 }
 
 template<typename AddrT>
@@ -162,6 +188,23 @@ bool Route<AddrT>::isSame(Action action) const {
   }
 }
 
+template<typename AddrT>
+bool Route<AddrT>::isSame(ClientID client,
+                          const RouteNextHopEntry& entry) const {
+  const auto& clients = getClients();
+  auto iter = clients.find(client);
+  return iter != clients.end() && iter->second == entry;
+}
+
+template<typename AddrT>
+bool Route<AddrT>::hasClient(ClientID client) const {
+  const auto& clients = getClients();
+  if (clients.empty()) {
+    return isWithNexthops();
+  }
+  return clients.find(client) != clients.end();
+}
+
 template<typename AddrT>
 bool Route<AddrT>::isSame(const Route<AddrT>* rt) const {
   return *this->getFields() == *rt->getFields();
@@ -170,7 +213,7 @@ bool Route<AddrT>::isSame(const Route<AddrT>* rt) const {
 template<typename AddrT>
 void Route<AddrT>::update(InterfaceID intf, const IPAddress& addr) {
   // clear all existing nexthop info
-  RouteBase::writableFields()->nexthops.clear();
+  RouteBase::writableFields()->nexthops = InternedRouteNextHops();
   // replace the forwarding info for this route with just one nexthop
   RouteBase::writableFields()->fwd.setNexthops(intf, addr);
   setFlagsConnected();
@@ -188,12 +231,19 @@ void Route<AddrT>::updateNexthopCommon(const RouteNextHops& nhs) {
 template<typename AddrT>
 void Route<AddrT>::update(const RouteNextHops& nhs) {
   updateNexthopCommon(nhs);
-  RouteBase::writableFields()->nexthops = nhs;
+  RouteBase::writableFields()->nexthops = InternedRouteNextHops(nhs);
 }
 
 template<typename AddrT>
 void Route<AddrT>::update(RouteNextHops&& nhs) {
   updateNexthopCommon(nhs);
+  RouteBase::writableFields()->nexthops =
+    InternedRouteNextHops(std::move(nhs));
+}
+
+template<typename AddrT>
+void Route<AddrT>::update(InternedRouteNextHops nhs) {
+  updateNexthopCommon(*nhs);
   RouteBase::writableFields()->nexthops = std::move(nhs);
 }
 
@@ -201,7 +251,7 @@ template<typename AddrT>
 void Route<AddrT>::update(Action action) {
   CHECK(action == Action::DROP || action == Action::TO_CPU);
   // clear all existing nexthop info
-  RouteBase::writableFields()->nexthops.clear();
+  RouteBase::writableFields()->nexthops = InternedRouteNextHops();
   if (action == Action::DROP) {
     this->writableFields()->fwd.setDrop();
     setFlagsResolved();
@@ -211,6 +261,45 @@ void Route<AddrT>::update(Action action) {
   }
 }
 
+template<typename AddrT>
+bool Route<AddrT>::update(ClientID client, RouteNextHopEntry entry) {
+  if (entry.nexthops->empty()) {
+    throw FbossError("Update with an empty set of nexthops for route ", str(),
+                     " from client ", client);
+  }
+  RouteBase::writableFields()->clients[client] = std::move(entry);
+  return updateFromClients();
+}
+
+template<typename AddrT>
+bool Route<AddrT>::delClient(ClientID client) {
+  if (RouteBase::writableFields()->clients.erase(client) == 0) {
+    return false;
+  }
+  return updateFromClients();
+}
+
+template<typename AddrT>
+bool Route<AddrT>::updateFromClients() {
+  if (isConfigRoute()) {
+    return false;
+  }
+  const auto* best = bestNextHopEntry(getClients());
+  if (!best || best->nexthops == getInternedNexthops()) {
+    return false;
+  }
+  update(best->nexthops);
+  return true;
+}
+
+template<typename AddrT>
+void Route<AddrT>::useClientNexthops() {
+  const auto* best = bestNextHopEntry(getClients());
+  CHECK(best);
+  // update() also clears the flags, so this is no longer a config route
+  update(best->nexthops);
+}
+
 template<typename AddrT>
 void Route<AddrT>::setUnresolvable() {
   RouteBase::writableFields()->fwd.reset();
@@ -47,15 +47,31 @@ struct RouteFields {
    */
   static RouteFields fromFollyDynamic(const folly::dynamic& routeJson);
 
+  /*
+   * Get the bytes allocated for this route outside of the node.  The
+   * nexthop sets are shared with other routes, and are not included.
+   */
+  size_t memoryUsage() const {
+    return clients.capacity() * sizeof(RouteNextHopsMulti::value_type);
+  }
+
+  // The fields are ordered to keep padding out of the node, since a large
+  // RIB has hundreds of thousands of routes.
   Prefix prefix;
+  // flags is not copied during clone(), unless all members are copied
+  uint32_t flags{0};
+  /*
+   * The nexthops each client added for this route.  Unlike the fields below,
+   * these are always copied during clone().
+   */
+  RouteNextHopsMulti clients;
   // The following fields will not be copied during clone()
   /*
    * All next hops of the routes. This set could be empty if and only if
    * the route is directly connected
    */
-  RouteNextHops nexthops;
+  InternedRouteNextHops nexthops;
   RouteForwardInfo fwd;
-  uint32_t flags{0};
 };
 
 /// Route<> Class
@@ -72,6 +88,8 @@ class Route : public NodeBaseT<Route<AddrT>, RouteFields<AddrT>> {
   Route(const Prefix& prefix, RouteNextHops&& nhs);
   // Constructor for a route with special forwarding action
   Route(const Prefix& prefix, Action action);
+  // Constructor for a route added by a client
+  Route(const Prefix& prefix, ClientID client, RouteNextHopEntry entry);
 
   virtual ~Route();
 
@@ -114,11 +132,32 @@ class Route : public NodeBaseT<Route<AddrT>, RouteFields<AddrT>> {
     return RouteBase::getFields()->fwd;
   }
   const RouteNextHops& nexthops() const {
+    return *RouteBase::getFields()->nexthops;
+  }
+  const InternedRouteNextHops& getInternedNexthops() const {
     return RouteBase::getFields()->nexthops;
   }
+  const RouteNextHopsMulti& getClients() const {
+    return RouteBase::getFields()->clients;
+  }
+  /*
+   * Whether this route comes from the config, i.e. it is an interface route
+   * or has a special action.  Config routes take precedence over the
+   * nexthops of all clients.
+   */
+  bool isConfigRoute() const {
+    return nexthops().empty() && (isConnected() || isDrop() || isToCPU());
+  }
+  /*
+   * Whether the client added nexthops for this route.  A route with
+   * nexthops but no clients was added without a client, e.g. before clients
+   * were tracked, and is treated as belonging to every client.
+   */
+  bool hasClient(ClientID client) const;
   bool isSame(InterfaceID intf, const folly::IPAddress& addr) const;
   bool isSame(const RouteNextHops& nhs) const;
   bool isSame(Action action) const;
+  bool isSame(ClientID client, const RouteNextHopEntry& entry) const;
   bool isSame(const Route* rt) const;
   /*
    * The following functions modify the route object.
@@ -149,12 +188,29 @@ class Route : public NodeBaseT<Route<AddrT>, RouteFields<AddrT>> {
   void update(InterfaceID intf, const folly::IPAddress& addr);
   void update(const RouteNextHops& nhs);
   void update(RouteNextHops&& nhs);
+  void update(InternedRouteNextHops nhs);
   void update(Action action);
+  /*
+   * Add or replace the nexthops of a client, or remove them.
+   *
+   * Unless this is a config route, the route then forwards using the
+   * nexthops of the best client.  Returns true if those nexthops changed,
+   * which also resets the forwarding info, so the route needs to be resolved
+   * again.
+   */
+  bool update(ClientID client, RouteNextHopEntry entry);
+  bool delClient(ClientID client);
+  /*
+   * Forward using the nexthops of the best client, e.g. after the config
+   * route for this prefix was removed.  There must be at least one client.
+   */
+  void useClientNexthops();
  private:
   // no copy or assign operator
   Route(const Route &) = delete;
   Route& operator&(const Route &) = delete;
   void updateNexthopCommon(const RouteNextHops& nhs);
+  bool updateFromClients();
   /**
    * Bit definition for RouteFields<>::flags
    *
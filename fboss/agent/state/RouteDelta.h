@@ -21,14 +21,30 @@ class RouteTablesDelta : public DeltaValue<RouteTable> {
   typedef NodeMapDelta<RouteTableRib<folly::IPAddressV4>> RoutesV4Delta;
   typedef NodeMapDelta<RouteTableRib<folly::IPAddressV6>> RoutesV6Delta;
   using DeltaValue<RouteTable>::DeltaValue;
+  void reset(const std::shared_ptr<RouteTable>& o,
+             const std::shared_ptr<RouteTable>& n) {
+    DeltaValue<RouteTable>::reset(o, n);
+    v4Changes_.reset();
+    v6Changes_.reset();
+  }
   RoutesV4Delta getRoutesV4Delta() const {
     return RoutesV4Delta(getOld() ? getOld()->getRibV4().get() : nullptr,
-                         getNew() ? getNew()->getRibV4().get() : nullptr);
+                         getNew() ? getNew()->getRibV4().get() : nullptr,
+                         v4Changes_);
   }
   RoutesV6Delta getRoutesV6Delta() const {
     return RoutesV6Delta(getOld() ? getOld()->getRibV6().get() : nullptr,
-                         getNew() ? getNew()->getRibV6().get() : nullptr);
+                         getNew() ? getNew()->getRibV6().get() : nullptr,
+                         v6Changes_);
+  }
+  // Collect the route changes, as VlanDelta::collectChanges() does
+  void collectChanges() {
+    v4Changes_ = getRoutesV4Delta().collectChanges();
+    v6Changes_ = getRoutesV6Delta().collectChanges();
   }
+ private:
+  std::shared_ptr<const RoutesV4Delta::Changes> v4Changes_;
+  std::shared_ptr<const RoutesV6Delta::Changes> v6Changes_;
 };
 
 typedef NodeMapDelta<RouteTableMap, RouteTablesDelta> RTMapDelta;
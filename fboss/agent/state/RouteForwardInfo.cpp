@@ -8,6 +8,7 @@
  *
  */
 #include "RouteForwardInfo.h"
+#include <folly/Hash.h>
 #include <vector>
 
 namespace {
@@ -42,6 +43,22 @@ bool RouteForwardInfo::Nexthop::operator==(const Nexthop& fwd) const {
 }
 
 // RouteForwardInfo class
+size_t RouteForwardInfo::NexthopsHash::operator()(
+    const Nexthops& nhops) const {
+  return hashNexthops(nhops);
+}
+
+void RouteForwardInfo::setNexthops(InterfaceID intf,
+                                   const folly::IPAddress& nhop) {
+  Nexthops nexthops;
+  nexthops.emplace(intf, nhop);
+  setNexthops(InternedNexthops(std::move(nexthops)));
+}
+
+void RouteForwardInfo::setNexthops(Nexthops nexthops) {
+  setNexthops(InternedNexthops(std::move(nexthops)));
+}
+
 std::string RouteForwardInfo::str() const {
   std::string result;
   switch (action_) {
@@ -65,7 +82,7 @@ folly::dynamic RouteForwardInfo::toFollyDynamic() const {
   folly::dynamic fwdInfo = folly::dynamic::object;
   fwdInfo[kAction] = forwardActionStr(action_);
   vector<folly::dynamic> nhops;
-  for (const auto& nhop: nexthops_) {
+  for (const auto& nhop: *nexthops_) {
     nhops.push_back(nhop.toFollyDynamic());
   }
   fwdInfo[kNexthops] = std::move(nhops);
@@ -75,9 +92,11 @@ folly::dynamic RouteForwardInfo::toFollyDynamic() const {
 RouteForwardInfo
 RouteForwardInfo::fromFollyDynamic(const folly::dynamic& fwdInfoJson) {
   RouteForwardInfo fwdInfo;
+  Nexthops nexthops;
   for (const auto& nhop: fwdInfoJson[kNexthops]) {
-    fwdInfo.nexthops_.insert(Nexthop::fromFollyDynamic(nhop));
+    nexthops.insert(Nexthop::fromFollyDynamic(nhop));
   }
+  fwdInfo.nexthops_ = InternedNexthops(std::move(nexthops));
   fwdInfo.action_ = str2ForwardAction(fwdInfoJson[kAction].asString());
   return fwdInfo;
 }
@@ -116,4 +135,14 @@ std::ostream& operator<<(std::ostream& os, const RouteForwardNexthops& nhops) {
   return os;
 }
 
+size_t hashNexthops(const RouteForwardNexthops& nhops) {
+  uint64_t hash = nhops.size();
+  for (const auto& nhop : nhops) {
+    hash = folly::hash::hash_128_to_64(
+        hash, folly::hash::hash_combine(static_cast<uint32_t>(nhop.intf),
+                                        nhop.nexthop.hash()));
+  }
+  return hash;
+}
+
 }}
@@ -13,6 +13,7 @@
 #include <folly/dynamic.h>
 #include <folly/IPAddress.h>
 #include "fboss/agent/types.h"
+#include "fboss/agent/state/InternedSet.h"
 #include "fboss/agent/state/RouteTypes.h"
 
 #include <boost/container/flat_set.hpp>
@@ -40,6 +41,14 @@ class RouteForwardInfo {
    */
   struct Nexthop;
   typedef boost::container::flat_set<Nexthop> Nexthops;
+  struct NexthopsHash {
+    size_t operator()(const Nexthops& nhops) const;
+  };
+  /**
+   * The nexthops shared by all the routes that forward to them.  Routes
+   * with the same nexthops have the same InternedNexthops.
+   */
+  typedef InternedSet<Nexthops, NexthopsHash> InternedNexthops;
 
   explicit RouteForwardInfo(Action action = Action::DROP)
       : action_(action) {
@@ -52,6 +61,9 @@ class RouteForwardInfo {
   }
 
   const Nexthops& getNexthops() const {
+    return *nexthops_;
+  }
+  const InternedNexthops& getInternedNexthops() const {
     return nexthops_;
   }
 
@@ -77,7 +89,7 @@ class RouteForwardInfo {
     return action_ == Action::DROP;
   }
   void setDrop() {
-    nexthops_.clear();
+    nexthops_ = InternedNexthops();
     action_ = Action::DROP;
   }
 
@@ -85,38 +97,32 @@ class RouteForwardInfo {
     return action_ == Action::TO_CPU;
   }
   void setToCPU() {
-    nexthops_.clear();
+    nexthops_ = InternedNexthops();
     action_ = Action::TO_CPU;
   }
 
   // Set one nexthop, a simple version for non-ECMP case
-  void setNexthops(InterfaceID intf, const folly::IPAddress& nhop) {
-    nexthops_.clear();
-    nexthops_.emplace(intf, nhop);
-    action_ = Action::NEXTHOPS;
-  }
+  void setNexthops(InterfaceID intf, const folly::IPAddress& nhop);
   // Set one or multiple nexthops
-  void setNexthops(const Nexthops& nexthops) {
-    nexthops_ = nexthops;
-    action_ = Action::NEXTHOPS;
-  }
-  void setNexthops(Nexthops&& nexthops) {
+  void setNexthops(Nexthops nexthops);
+  void setNexthops(InternedNexthops nexthops) {
     nexthops_ = std::move(nexthops);
     action_ = Action::NEXTHOPS;
   }
 
   // Reset the forwarding info
   void reset() {
-    nexthops_.clear();
+    nexthops_ = InternedNexthops();
     action_ = Action::DROP;
   }
 
  private:
-  Nexthops nexthops_;
+  InternedNexthops nexthops_;
   Action action_;
 };
 
 typedef RouteForwardInfo::Nexthops RouteForwardNexthops;
+typedef RouteForwardInfo::InternedNexthops InternedForwardNexthops;
 
 void toAppend(const RouteForwardInfo& fwd, std::string *result);
 std::ostream& operator<<(std::ostream& os, const RouteForwardInfo& fwd);
@@ -155,4 +161,44 @@ struct RouteForwardInfo::Nexthop {
 void toAppend(const RouteForwardNexthops& fwd, std::string *result);
 std::ostream& operator<<(std::ostream& os, const RouteForwardNexthops& fwd);
 
+/*
+ * Hash a set of nexthops.  The set is sorted, so equal sets always have the
+ * same hash.
+ */
+size_t hashNexthops(const RouteForwardNexthops& fwd);
+
+/**
+ * A set of nexthops together with its hash, for use as a hash table key.
+ *
+ * The hash is computed once, when the key is created, and equality checks
+ * compare the hashes before comparing the nexthops themselves.  This keeps
+ * lookups cheap for large ECMP groups.
+ */
+class HashedNexthops {
+ public:
+  HashedNexthops() {}
+  /* implicit */ HashedNexthops(RouteForwardNexthops nexthops)
+    : nexthops_(std::move(nexthops)),
+      hash_(hashNexthops(nexthops_)) {}
+
+  const RouteForwardNexthops& getNexthops() const {
+    return nexthops_;
+  }
+  size_t hash() const {
+    return hash_;
+  }
+
+  bool operator==(const HashedNexthops& other) const {
+    return hash_ == other.hash_ && nexthops_ == other.nexthops_;
+  }
+  bool operator!=(const HashedNexthops& other) const {
+    return !operator==(other);
+  }
+
+ private:
+  RouteForwardNexthops nexthops_;
+  // The hash of an empty set
+  size_t hash_{0};
+};
+
 }}
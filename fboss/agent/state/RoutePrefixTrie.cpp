@@ -0,0 +1,195 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RoutePrefixTrie.h"
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+
+namespace {
+
+// Return bit 'index' of the address, counting from the most significant bit
+template<typename AddrT>
+bool getBit(const AddrT& addr, uint8_t index) {
+  const uint8_t* bytes = addr.bytes();
+  return (bytes[index / 8] >> (7 - (index % 8))) & 0x1;
+}
+
+// Return the number of leading bits shared by 'a' and 'b', up to maxLen
+template<typename AddrT>
+uint8_t commonPrefixLen(const AddrT& a, const AddrT& b, uint8_t maxLen) {
+  const uint8_t* aBytes = a.bytes();
+  const uint8_t* bBytes = b.bytes();
+  for (size_t i = 0; i * 8 < maxLen; ++i) {
+    uint8_t diff = aBytes[i] ^ bBytes[i];
+    if (diff) {
+      // __builtin_clz() operates on a 32-bit unsigned int
+      size_t len = i * 8 + __builtin_clz(diff) - 24;
+      return std::min(len, static_cast<size_t>(maxLen));
+    }
+  }
+  return maxLen;
+}
+
+}
+
+namespace facebook { namespace fboss {
+
+using std::make_shared;
+
+template<typename AddrT>
+void RoutePrefixTrie<AddrT>::insert(const Prefix& prefix) {
+  bool added = false;
+  root_ = insertImpl(root_, prefix, &added);
+  if (added) {
+    ++size_;
+  }
+}
+
+template<typename AddrT>
+bool RoutePrefixTrie<AddrT>::remove(const Prefix& prefix) {
+  bool removed = false;
+  root_ = removeImpl(root_, prefix, &removed);
+  if (removed) {
+    --size_;
+  }
+  return removed;
+}
+
+template<typename AddrT>
+typename RoutePrefixTrie<AddrT>::NodePtr RoutePrefixTrie<AddrT>::insertImpl(
+    const NodePtr& node, const Prefix& prefix, bool* added) {
+  if (!node) {
+    *added = true;
+    return make_shared<TrieNode>(prefix.network, prefix.mask, true);
+  }
+
+  auto common = commonPrefixLen(node->network, prefix.network,
+                                std::min(node->len, prefix.mask));
+  if (common == node->len) {
+    if (node->len == prefix.mask) {
+      if (node->isPrefix) {
+        return node;
+      }
+      auto newNode = make_shared<TrieNode>(*node);
+      newNode->isPrefix = true;
+      *added = true;
+      return newNode;
+    }
+    // The new prefix belongs somewhere below this node
+    auto bit = getBit(prefix.network, node->len);
+    auto newChild = insertImpl(node->child[bit], prefix, added);
+    if (newChild == node->child[bit]) {
+      return node;
+    }
+    auto newNode = make_shared<TrieNode>(*node);
+    newNode->child[bit] = std::move(newChild);
+    return newNode;
+  }
+
+  *added = true;
+  if (common == prefix.mask) {
+    // The new prefix covers the existing node
+    auto newNode = make_shared<TrieNode>(prefix.network, prefix.mask, true);
+    newNode->child[getBit(node->network, prefix.mask)] = node;
+    return newNode;
+  }
+
+  // The new prefix and the existing node diverge at bit 'common'.
+  // Create a branching node holding both of them.
+  auto branch = make_shared<TrieNode>(prefix.network.mask(common),
+                                      common, false);
+  auto bit = getBit(prefix.network, common);
+  branch->child[bit] =
+    make_shared<TrieNode>(prefix.network, prefix.mask, true);
+  branch->child[!bit] = node;
+  return branch;
+}
+
+template<typename AddrT>
+typename RoutePrefixTrie<AddrT>::NodePtr RoutePrefixTrie<AddrT>::removeImpl(
+    const NodePtr& node, const Prefix& prefix, bool* removed) {
+  if (!node || prefix.mask < node->len ||
+      commonPrefixLen(node->network, prefix.network, node->len) != node->len) {
+    return node;
+  }
+
+  if (prefix.mask == node->len) {
+    if (!node->isPrefix) {
+      return node;
+    }
+    *removed = true;
+    if (node->child[0] && node->child[1]) {
+      // Still needed as a branching point
+      auto newNode = make_shared<TrieNode>(*node);
+      newNode->isPrefix = false;
+      return newNode;
+    }
+    return node->child[0] ? node->child[0] : node->child[1];
+  }
+
+  auto bit = getBit(prefix.network, node->len);
+  auto newChild = removeImpl(node->child[bit], prefix, removed);
+  if (newChild == node->child[bit]) {
+    return node;
+  }
+  if (!newChild && !node->isPrefix) {
+    // A branching node with only one child left is no longer needed
+    return node->child[!bit];
+  }
+  auto newNode = make_shared<TrieNode>(*node);
+  newNode->child[bit] = std::move(newChild);
+  return newNode;
+}
+
+template<typename AddrT>
+bool RoutePrefixTrie<AddrT>::longestMatch(const AddrT& addr,
+                                          Prefix* match) const {
+  const TrieNode* best = nullptr;
+  const TrieNode* node = root_.get();
+  while (node) {
+    if (commonPrefixLen(node->network, addr, node->len) != node->len) {
+      break;
+    }
+    if (node->isPrefix) {
+      best = node;
+    }
+    if (node->len >= AddrT::bitCount()) {
+      break;
+    }
+    node = node->child[getBit(addr, node->len)].get();
+  }
+  if (!best) {
+    return false;
+  }
+  match->network = best->network;
+  match->mask = best->len;
+  return true;
+}
+
+template<typename AddrT>
+bool RoutePrefixTrie<AddrT>::exists(const Prefix& prefix) const {
+  const TrieNode* node = root_.get();
+  while (node && node->len <= prefix.mask) {
+    if (commonPrefixLen(node->network, prefix.network, node->len) !=
+        node->len) {
+      return false;
+    }
+    if (node->len == prefix.mask) {
+      return node->isPrefix;
+    }
+    node = node->child[getBit(prefix.network, node->len)].get();
+  }
+  return false;
+}
+
+template class RoutePrefixTrie<folly::IPAddressV4>;
+template class RoutePrefixTrie<folly::IPAddressV6>;
+
+}} // facebook::fboss
@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include "fboss/agent/state/RouteTypes.h"
+
+#include <folly/dynamic.h>
+#include <memory>
+
+namespace facebook { namespace fboss {
+
+/*
+ * RoutePrefixTrie is a persistent, path-compressed binary (Patricia) trie of
+ * route prefixes.
+ *
+ * It only answers the question "which stored prefix is the longest match for
+ * this address", in O(address length) time.  The Route objects themselves
+ * are still stored in the RouteTableRib flat_map; the trie is just an index
+ * over its keys.
+ *
+ * Trie nodes are immutable once created.  insert() and remove() copy only the
+ * nodes on the path from the root to the modified prefix, and share every
+ * other subtree with the previous version.  Copying a RoutePrefixTrie
+ * therefore only copies the root pointer, which makes it cheap to carry
+ * along when a RouteTableRib is cloned for a new SwitchState generation.
+ */
+template<typename AddrT>
+class RoutePrefixTrie {
+ public:
+  typedef RoutePrefix<AddrT> Prefix;
+
+  RoutePrefixTrie() {}
+
+  /*
+   * Add the prefix to the trie.  Adding an existing prefix is a no-op.
+   */
+  void insert(const Prefix& prefix);
+
+  /*
+   * Remove the prefix from the trie.  Returns false if the prefix was not
+   * present.
+   */
+  bool remove(const Prefix& prefix);
+
+  /*
+   * Find the longest prefix that contains the given address.
+   *
+   * Returns false if no stored prefix matches.  On success, the matching
+   * prefix is stored in *match.
+   */
+  bool longestMatch(const AddrT& addr, Prefix* match) const;
+
+  bool exists(const Prefix& prefix) const;
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  void clear() {
+    root_.reset();
+    size_ = 0;
+  }
+
+  /*
+   * Returns true if both tries share the same root node.  This is a cheap
+   * check that the two tries have identical contents, but it may return
+   * false for tries which have the same contents but were built separately.
+   */
+  bool sharesRoot(const RoutePrefixTrie& other) const {
+    return root_ == other.root_;
+  }
+
+ private:
+  struct TrieNode {
+    TrieNode(const AddrT& network, uint8_t len, bool isPrefix)
+      : network(network), len(len), isPrefix(isPrefix) {}
+
+    // The first 'len' bits common to every prefix below this node
+    AddrT network;
+    uint8_t len{0};
+    // Whether this node is a stored prefix, or only a branching point
+    bool isPrefix{false};
+    std::shared_ptr<const TrieNode> child[2];
+  };
+  typedef std::shared_ptr<const TrieNode> NodePtr;
+
+  static NodePtr insertImpl(const NodePtr& node, const Prefix& prefix,
+                            bool* added);
+  static NodePtr removeImpl(const NodePtr& node, const Prefix& prefix,
+                            bool* removed);
+
+  NodePtr root_;
+  size_t size_{0};
+};
+
+/*
+ * The extra fields of a RouteTableRib.
+ *
+ * This holds the LPM index over the prefixes stored in the RIB.  The index is
+ * derived entirely from the RIB entries, so it is not serialized.
+ */
+template<typename AddrT>
+struct RouteTableRibExtraFields {
+  template<typename Fn> void forEachChild(Fn fn) {}
+
+  folly::dynamic toFollyDynamic() const {
+    return folly::dynamic::object;
+  }
+
+  static RouteTableRibExtraFields
+  fromFollyDynamic(const folly::dynamic& json) {
+    return RouteTableRibExtraFields();
+  }
+
+  RoutePrefixTrie<AddrT> prefixes;
+};
+
+}} // facebook::fboss
@@ -10,6 +10,7 @@
 // Copyright 2004-present Facebook.  All rights reserved.
 #include "RouteTable.h"
 
+#include "fboss/agent/state/JsonStreamWriter.h"
 #include "fboss/agent/state/RouteTableRib.h"
 #include "fboss/agent/state/NodeBase-defs.h"
 #include "fboss/agent/FbossError.h"
@@ -36,6 +37,17 @@ folly::dynamic RouteTableFields::toFollyDynamic() const {
   return rtable;
 }
 
+void RouteTableFields::writeJson(JsonStreamWriter* writer) const {
+  writer->beginObject();
+  writer->key(kRouterId);
+  writer->value(static_cast<uint32_t>(id));
+  writer->key(kRibV4);
+  ribV4->writeJson(writer);
+  writer->key(kRibV6);
+  ribV6->writeJson(writer);
+  writer->endObject();
+}
+
 RouteTableFields
 RouteTableFields::fromFollyDynamic(const folly::dynamic& rtableJson) {
   RouteTableFields rtable(RouterID(rtableJson[kRouterId].asInt()));
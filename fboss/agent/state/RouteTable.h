@@ -17,6 +17,7 @@
 
 namespace facebook { namespace fboss {
 
+class JsonStreamWriter;
 template<typename AddrT> class RouteTableRib;
 
 struct RouteTableFields {
@@ -30,6 +31,10 @@ struct RouteTableFields {
    * Serialize to folly::dynamic
    */
   folly::dynamic toFollyDynamic() const;
+  /*
+   * Write the same JSON as toFollyDynamic(), one route at a time
+   */
+  void writeJson(JsonStreamWriter* writer) const;
   /*
    * Deserialize from folly::dynamic
    */
@@ -61,6 +66,10 @@ class RouteTable : public NodeBaseT<RouteTable, RouteTableFields> {
   }
   bool empty() const;
 
+  void writeJson(JsonStreamWriter* writer) const {
+    getFields()->writeJson(writer);
+  }
+
   std::shared_ptr<RibTypeV4>& writableRibV4() {
     return writableFields()->ribV4;
   }
@@ -25,17 +25,23 @@ RouteTableRib<AddrT>::~RouteTableRib() {
 template<typename AddrT>
 std::shared_ptr<Route<AddrT>> RouteTableRib<AddrT>::longestMatch(
     const AddrT& nexthop) const {
-  std::shared_ptr<Route<AddrT>> bestMatch;
-  int bestMatchMask = -1;
-  for (const auto& rt : Base::getAllNodes()) {
-    const auto& prefix = rt.first;
-    if (prefix.mask > bestMatchMask
-        && nexthop.inSubnet(prefix.network, prefix.mask)) {
-      bestMatch = rt.second;
-      bestMatchMask = prefix.mask;
-    }
+  Prefix match;
+  if (!this->getExtraFields().prefixes.longestMatch(nexthop, &match)) {
+    return nullptr;
   }
-  return bestMatch;
+  return Base::getNodeIf(match);
+}
+
+template<typename AddrT>
+std::shared_ptr<RouteTableRib<AddrT>> RouteTableRib<AddrT>::fromFollyDynamic(
+    const folly::dynamic& json) {
+  auto rib = Base::fromFollyDynamic(json);
+  auto& prefixes = rib->writableExtraFields().prefixes;
+  prefixes.clear();
+  for (const auto& rt : rib->getAllNodes()) {
+    prefixes.insert(rt.first);
+  }
+  return rib;
 }
 
 FBOSS_INSTANTIATE_NODE_MAP(RouteTableRib<folly::IPAddressV4>,
@@ -12,6 +12,8 @@
 
 #include "fboss/agent/types.h"
 #include "fboss/agent/state/NodeMap.h"
+#include "fboss/agent/state/PersistentMap.h"
+#include "fboss/agent/state/RoutePrefixTrie.h"
 #include "fboss/agent/state/RouteTypes.h"
 
 namespace facebook { namespace fboss {
@@ -19,10 +21,19 @@ namespace facebook { namespace fboss {
 template<typename AddrT>
 class Route;
 
-// FIXME: temporary solution before RadixTree
-// use NodeMap to store all routes.
+/*
+ * Routes are stored in a NodeMap, keyed by prefix.  The NodeMap uses a
+ * PersistentMap, so that cloning a large RIB to change a few routes does not
+ * copy the whole table.  Alongside the NodeMap we keep a RoutePrefixTrie over
+ * the same prefixes in the extra fields, which provides O(prefix length)
+ * longest prefix match lookups and is shared structurally between cloned
+ * RIBs.
+ */
 template<typename AddrT> using RouteTableRibTraits
-  = NodeMapTraits<RoutePrefix<AddrT>, Route<AddrT>>;
+  = NodeMapTraits<RoutePrefix<AddrT>, Route<AddrT>,
+                  RouteTableRibExtraFields<AddrT>,
+                  PersistentMap<RoutePrefix<AddrT>,
+                                std::shared_ptr<Route<AddrT>>>>;
 
 template<typename AddrT>
 class RouteTableRib
@@ -48,6 +59,14 @@ class RouteTableRib
   }
   std::shared_ptr<Route<AddrT>> longestMatch(const AddrT& nexthop) const;
 
+  /*
+   * Deserialize from folly::dynamic.
+   *
+   * The prefix index is not serialized, so rebuild it from the routes.
+   */
+  static std::shared_ptr<RouteTableRib>
+  fromFollyDynamic(const folly::dynamic& json);
+
   /*
    * The following functions modify the static state.
    * These should only be called on unpublished objects which are only visible
@@ -55,6 +74,7 @@ class RouteTableRib
    */
   void addRoute(const std::shared_ptr<Route<AddrT>>& rt) {
     Base::addNode(rt);
+    this->writableExtraFields().prefixes.insert(rt->prefix());
   }
   void updateRoute(const std::shared_ptr<Route<AddrT>>& rt) {
     /*
@@ -65,6 +85,7 @@ class RouteTableRib
   }
   void removeRoute(const std::shared_ptr<Route<AddrT>>& rt) {
     Base::removeNode(rt);
+    this->writableExtraFields().prefixes.remove(rt->prefix());
   }
 
  private:
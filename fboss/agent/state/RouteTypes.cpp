@@ -9,12 +9,16 @@
  */
 #include "RouteTypes.h"
 
+#include <folly/Hash.h>
+
 namespace {
 constexpr auto kAddress = "address";
 constexpr auto kMask = "mask";
 constexpr auto kDrop = "Drop";
 constexpr auto kToCpu = "ToCPU";
 constexpr auto kNexthops = "Nexthops";
+constexpr auto kEntryNexthops = "nexthops";
+constexpr auto kAdminDistance = "adminDistance";
 }
 
 namespace facebook { namespace fboss {
@@ -41,6 +45,47 @@ RouteForwardAction str2ForwardAction(const folly::fbstring& action) {
   }
 }
 
+folly::dynamic RouteNextHopEntry::toFollyDynamic() const {
+  folly::dynamic entry = folly::dynamic::object;
+  std::vector<folly::dynamic> nhopsList;
+  for (const auto& nhop : *nexthops) {
+    nhopsList.emplace_back(nhop.str());
+  }
+  entry[kEntryNexthops] = nhopsList;
+  entry[kAdminDistance] = adminDistance;
+  return entry;
+}
+
+RouteNextHopEntry RouteNextHopEntry::fromFollyDynamic(
+    const folly::dynamic& entryJson) {
+  RouteNextHops nhops;
+  for (const auto& nhop : entryJson[kEntryNexthops]) {
+    nhops.emplace(nhop.stringPiece());
+  }
+  return RouteNextHopEntry(std::move(nhops),
+                           entryJson[kAdminDistance].asInt());
+}
+
+size_t hashNexthops(const RouteNextHops& nhops) {
+  uint64_t hash = nhops.size();
+  for (const auto& nhop : nhops) {
+    hash = folly::hash::hash_128_to_64(hash, nhop.hash());
+  }
+  return hash;
+}
+
+const RouteNextHopEntry* bestNextHopEntry(const RouteNextHopsMulti& entries) {
+  const RouteNextHopEntry* best{nullptr};
+  // The entries are sorted by client ID, so the first entry with the lowest
+  // distance wins ties.
+  for (const auto& entry : entries) {
+    if (!best || entry.second.adminDistance < best->adminDistance) {
+      best = &entry.second;
+    }
+  }
+  return best;
+}
+
 // RoutePrefix<> Class
 template<typename AddrT>
 std::string RoutePrefix<AddrT>::str() const {
@@ -13,8 +13,10 @@
 #include <folly/dynamic.h>
 #include <folly/FBString.h>
 #include "fboss/agent/types.h"
+#include "fboss/agent/state/InternedSet.h"
 #include <folly/IPAddress.h>
 
+#include <boost/container/flat_map.hpp>
 #include <boost/container/flat_set.hpp>
 
 namespace facebook { namespace fboss {
@@ -24,6 +26,77 @@ namespace facebook { namespace fboss {
  */
 typedef boost::container::flat_set<folly::IPAddress> RouteNextHops;
 
+/*
+ * Hash a set of nexthops.  The set is sorted, so equal sets always have the
+ * same hash.
+ */
+size_t hashNexthops(const RouteNextHops& nhops);
+
+struct RouteNextHopsHash {
+  size_t operator()(const RouteNextHops& nhops) const {
+    return hashNexthops(nhops);
+  }
+};
+
+/**
+ * A set of nexthops shared by all the routes and clients that use it
+ */
+typedef InternedSet<RouteNextHops, RouteNextHopsHash> InternedRouteNextHops;
+
+/**
+ * The admin distance of a client's routes.  When several clients add a
+ * route for the same prefix, the nexthops of the client with the lowest
+ * admin distance are used.
+ */
+typedef uint8_t AdminDistance;
+constexpr AdminDistance kMaxAdminDistance = 255;
+
+/**
+ * The nexthops one client added for a route
+ */
+struct RouteNextHopEntry {
+  RouteNextHopEntry() {}
+  RouteNextHopEntry(RouteNextHops nhs, AdminDistance distance)
+    : nexthops(std::move(nhs)),
+      adminDistance(distance) {}
+  RouteNextHopEntry(InternedRouteNextHops nhs, AdminDistance distance)
+    : nexthops(std::move(nhs)),
+      adminDistance(distance) {}
+
+  bool operator==(const RouteNextHopEntry& other) const {
+    return adminDistance == other.adminDistance && nexthops == other.nexthops;
+  }
+  bool operator!=(const RouteNextHopEntry& other) const {
+    return !operator==(other);
+  }
+
+  /*
+   * Serialize to folly::dynamic
+   */
+  folly::dynamic toFollyDynamic() const;
+
+  /*
+   * Deserialize from folly::dynamic
+   */
+  static RouteNextHopEntry fromFollyDynamic(const folly::dynamic& entryJson);
+
+  InternedRouteNextHops nexthops;
+  AdminDistance adminDistance{kMaxAdminDistance};
+};
+
+/**
+ * The nexthops each client added for a route
+ */
+typedef boost::container::flat_map<ClientID, RouteNextHopEntry>
+  RouteNextHopsMulti;
+
+/**
+ * Return the entry a route forwards with: the one with the lowest admin
+ * distance, with ties going to the lowest client ID.  Returns nullptr if
+ * there are no entries.
+ */
+const RouteNextHopEntry* bestNextHopEntry(const RouteNextHopsMulti& entries);
+
 /**
  * Route forward actions
  */
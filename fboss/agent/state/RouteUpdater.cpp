@@ -20,6 +20,10 @@
 #include "fboss/agent/state/RouteTableRib.h"
 #include "fboss/agent/FbossError.h"
 
+#include <algorithm>
+#include <mutex>
+#include <set>
+
 namespace facebook { namespace fboss {
 
 using std::make_shared;
@@ -114,6 +118,7 @@ void RouteUpdater::addRoute(const PrefixT& prefix, RibT *ribCloned,
     rib->addRoute(newRoute);
     VLOG(3) << "Added route " << newRoute->str();
   }
+  ribCloned->changed.insert(prefix);
   CHECK(ribCloned->cloned);
 }
 
@@ -174,18 +179,20 @@ void RouteUpdater::addRoute(RouterID id, const folly::IPAddress& network,
   }
 }
 
-void RouteUpdater::addLinkLocalRoutes(RouterID id) {
+namespace {
+const RoutePrefixV6& linkLocalPrefix() {
   // only one v6 link local route
-  const auto linkLocal = folly::IPAddress("fe80::");
-  const uint8_t mask = 64;
-  addRoute(id, linkLocal, mask, RouteForwardAction::TO_CPU);
+  static const RoutePrefixV6 prefix{folly::IPAddressV6("fe80::"), 64};
+  return prefix;
+}
+}
+
+void RouteUpdater::addLinkLocalRoutes(RouterID id) {
+  addRoute(linkLocalPrefix(), getRibV6(id), RouteForwardAction::TO_CPU);
 }
 
 void RouteUpdater::delLinkLocalRoutes(RouterID id) {
-  // only one v6 link local route
-  const auto linkLocal = folly::IPAddress("fe80::");
-  const uint8_t mask = 64;
-  delRoute(id, linkLocal, mask);
+  delRoute(linkLocalPrefix(), getRibV6(id, false));
 }
 
 template<typename PrefixT, typename RibT>
@@ -201,8 +208,15 @@ void RouteUpdater::delRoute(const PrefixT& prefix, RibT *ribCloned) {
     return;
   }
   rib = makeClone(ribCloned);
-  rib->removeRoute(old);
-  VLOG(3) << "Deleted route " << prefix.str();
+  if (old->isConfigRoute() && !old->getClients().empty()) {
+    auto route = writableRoute(old, rib);
+    route->useClientNexthops();
+    VLOG(3) << "Replaced config route with client route " << route->str();
+  } else {
+    rib->removeRoute(old);
+    VLOG(3) << "Deleted route " << prefix.str();
+  }
+  ribCloned->changed.insert(prefix);
   CHECK(ribCloned->cloned);
 }
 void RouteUpdater::delRoute(RouterID id, const folly::IPAddress& network,
@@ -216,6 +230,200 @@ void RouteUpdater::delRoute(RouterID id, const folly::IPAddress& network,
   }
 }
 
+template<typename RouteT, typename RtRibT>
+std::shared_ptr<RouteT> RouteUpdater::writableRoute(
+    const std::shared_ptr<RouteT>& route, RtRibT* rib) {
+  if (!route->isPublished()) {
+    return route;
+  }
+  // Keep the forwarding info, so that the route only needs to be resolved
+  // again if its nexthops change.
+  auto newRoute = route->clone(RouteT::Fields::COPY_ALL_MEMBERS);
+  rib->updateRoute(newRoute);
+  return newRoute;
+}
+
+template<typename PrefixT, typename RibT>
+void RouteUpdater::addClientRoute(const PrefixT& prefix, RibT *ribCloned,
+                                  ClientID client, RouteNextHopEntry entry) {
+  typedef Route<typename PrefixT::AddressT> RouteT;
+  auto rib = ribCloned->rib.get();
+  auto old = rib->exactMatch(prefix);
+  if (old && old->isSame(client, entry)) {
+    return;
+  }
+  rib = makeClone(ribCloned);
+  if (!old) {
+    auto newRoute = make_shared<RouteT>(prefix, client, std::move(entry));
+    rib->addRoute(newRoute);
+    ribCloned->changed.insert(prefix);
+    VLOG(3) << "Added route " << newRoute->str() << " for client " << client;
+    return;
+  }
+  auto route = writableRoute(old, rib);
+  if (route->update(client, std::move(entry))) {
+    ribCloned->changed.insert(prefix);
+  }
+  VLOG(3) << "Updated route " << route->str() << " for client " << client;
+}
+
+template<typename PrefixT, typename RibT>
+void RouteUpdater::delClientRoute(const PrefixT& prefix, RibT *ribCloned,
+                                  ClientID client) {
+  if (!ribCloned) {
+    VLOG(3) << "Failed to delete non-existing route " << prefix.str();
+    return;
+  }
+  auto rib = ribCloned->rib.get();
+  auto old = rib->exactMatch(prefix);
+  if (!old || !old->hasClient(client)) {
+    VLOG(3) << "Failed to delete non-existing route " << prefix.str()
+            << " for client " << client;
+    return;
+  }
+  rib = makeClone(ribCloned);
+  const auto& clients = old->getClients();
+  bool lastClient = clients.empty() ||
+    (clients.size() == 1 && clients.begin()->first == client);
+  if (lastClient && !old->isConfigRoute()) {
+    rib->removeRoute(old);
+    ribCloned->changed.insert(prefix);
+    VLOG(3) << "Deleted route " << prefix.str() << " for client " << client;
+    return;
+  }
+  auto route = writableRoute(old, rib);
+  if (route->delClient(client)) {
+    ribCloned->changed.insert(prefix);
+  }
+  VLOG(3) << "Deleted client " << client << " from route " << route->str();
+}
+
+template<typename PrefixT, typename RibT>
+void RouteUpdater::syncClientRoutes(
+    RibT *ribCloned, ClientID client,
+    std::vector<std::pair<PrefixT, RouteNextHopEntry>>* routes) {
+  if (!ribCloned) {
+    // No routes to add, and no RIB to delete routes from
+    return;
+  }
+  // Sort the routes the same way as the RIB.  The sort is stable, so the
+  // last entry of each prefix is the one that was added last.
+  auto prefixLess = [](const std::pair<PrefixT, RouteNextHopEntry>& r1,
+                       const std::pair<PrefixT, RouteNextHopEntry>& r2) {
+    return r1.first < r2.first;
+  };
+  std::stable_sort(routes->begin(), routes->end(), prefixLess);
+
+  // Walk both in order, and remember what to change.  The RIB can't be
+  // modified during the walk, since it may not be published yet.
+  std::vector<PrefixT> toDelete;
+  std::vector<size_t> toAdd;
+  const auto& nodes = ribCloned->rib->getAllNodes();
+  auto rt = nodes.begin();
+  size_t idx = 0;
+  while (idx < routes->size()) {
+    auto next = idx + 1;
+    if (next < routes->size() &&
+        (*routes)[next].first == (*routes)[idx].first) {
+      // Only the last entry of a prefix counts
+      idx = next;
+      continue;
+    }
+    const auto& route = (*routes)[idx];
+    if (rt != nodes.end() && rt->first < route.first) {
+      if (rt->second->hasClient(client)) {
+        toDelete.push_back(rt->first);
+      }
+      ++rt;
+      continue;
+    }
+    if (rt != nodes.end() && rt->first == route.first) {
+      if (!rt->second->isSame(client, route.second)) {
+        toAdd.push_back(idx);
+      }
+      ++rt;
+    } else {
+      toAdd.push_back(idx);
+    }
+    ++idx;
+  }
+  for (; rt != nodes.end(); ++rt) {
+    if (rt->second->hasClient(client)) {
+      toDelete.push_back(rt->first);
+    }
+  }
+
+  for (const auto& prefix : toDelete) {
+    delClientRoute(prefix, ribCloned, client);
+  }
+  for (auto i : toAdd) {
+    auto& route = (*routes)[i];
+    addClientRoute(route.first, ribCloned, client, std::move(route.second));
+  }
+  VLOG(2) << "Synced routes of client " << client << ": "
+          << toAdd.size() << " added or changed, "
+          << toDelete.size() << " deleted";
+}
+
+void RouteUpdater::addRoute(RouterID id, const folly::IPAddress& network,
+                            uint8_t mask, ClientID client,
+                            RouteNextHopEntry entry) {
+  if (network.isV4()) {
+    PrefixV4 prefix{network.asV4().mask(mask), mask};
+    return addRoute(id, prefix, client, std::move(entry));
+  } else {
+    PrefixV6 prefix{network.asV6().mask(mask), mask};
+    return addRoute(id, prefix, client, std::move(entry));
+  }
+}
+
+void RouteUpdater::addRoute(RouterID id, const PrefixV4& prefix,
+                            ClientID client, RouteNextHopEntry entry) {
+  addClientRoute(prefix, getRibV4(id), client, std::move(entry));
+}
+
+void RouteUpdater::addRoute(RouterID id, const PrefixV6& prefix,
+                            ClientID client, RouteNextHopEntry entry) {
+  if (prefix.network.isLinkLocal()) {
+    throw FbossError("Unexpected v6 routable route for link local address ",
+                     prefix);
+  }
+  addClientRoute(prefix, getRibV6(id), client, std::move(entry));
+}
+
+void RouteUpdater::delRoute(RouterID id, const folly::IPAddress& network,
+                            uint8_t mask, ClientID client) {
+  if (network.isV4()) {
+    PrefixV4 prefix{network.asV4().mask(mask), mask};
+    return delClientRoute(prefix, getRibV4(id, false), client);
+  } else {
+    PrefixV6 prefix{network.asV6().mask(mask), mask};
+    return delClientRoute(prefix, getRibV6(id, false), client);
+  }
+}
+
+void RouteUpdater::ClientRoutes::add(const folly::IPAddress& network,
+                                     uint8_t mask, RouteNextHopEntry entry) {
+  if (network.isV4()) {
+    v4.emplace_back(PrefixV4{network.asV4().mask(mask), mask},
+                    std::move(entry));
+  } else {
+    PrefixV6 prefix{network.asV6().mask(mask), mask};
+    if (prefix.network.isLinkLocal()) {
+      throw FbossError("Unexpected v6 routable route for link local address ",
+                       prefix);
+    }
+    v6.emplace_back(prefix, std::move(entry));
+  }
+}
+
+void RouteUpdater::syncClientRoutes(RouterID id, ClientID client,
+                                    ClientRoutes routes) {
+  // Only create the RIBs if there are routes to add to them
+  syncClientRoutes(getRibV4(id, !routes.v4.empty()), client, &routes.v4);
+  syncClientRoutes(getRibV6(id, !routes.v6.empty()), client, &routes.v6);
+}
+
 template<typename RouteT, typename RtRibT>
 void RouteUpdater::resolve(RouteT* route, RtRibT* rib, ClonedRib* ribCloned) {
   CHECK(!route->isConnected());
@@ -224,7 +432,7 @@ void RouteUpdater::resolve(RouteT* route, RtRibT* rib, ClonedRib* ribCloned) {
   if (route->isPublished()) {
     auto newRoute = route->clone(RouteT::Fields::COPY_ONLY_PREFIX);
     // copy the nexthop
-    newRoute->update(route->nexthops());
+    newRoute->update(route->getInternedNexthops());
     // insert the cloned route back to the RIB
     // Note: resolve() is called in a loop over 'rib'. But we are modifying
     // the rib here. Fortunately, updateRoute() here does not actually
@@ -245,6 +453,7 @@ void RouteUpdater::resolve(RouteT* route, RtRibT* rib, ClonedRib* ribCloned) {
   // mark this route is in processing. This processing bit shall be cleared
   // in setUnresolvable() or setResolved()
   route->setFlagsProcessing();
+  ++numRoutesResolved_;
   // loop through all nexthops to find out the forward info
   for (const auto& nh : route->nexthops()) {
     if (nh.isV4()) {
@@ -300,18 +509,113 @@ void RouteUpdater::resolve(RouteT* route, RtRibT* rib, ClonedRib* ribCloned) {
 }
 
 
+template<typename PrefixT, typename RibT>
+void RouteUpdater::setRouteForResolution(const PrefixT& prefix,
+                                         RibT* ribCloned) {
+  typedef Route<typename PrefixT::AddressT> RouteT;
+  auto rib = makeClone(ribCloned);
+  auto route = rib->exactMatch(prefix);
+  CHECK(route);
+  if (route->isPublished()) {
+    auto newRoute = route->clone(RouteT::Fields::COPY_ONLY_PREFIX);
+    // update() also clears the flags and the forwarding info
+    newRoute->update(route->getInternedNexthops());
+    rib->updateRoute(newRoute);
+  } else {
+    route->clearFlags();
+  }
+}
+
+template<typename AddrT, typename RibT, typename DepsT>
+bool RouteUpdater::addDependency(const AddrT& nexthop,
+                                 const folly::CIDRNetwork& dependent,
+                                 RibT* nhRib, DepsT* deps) {
+  auto rt = nhRib->rib->longestMatch(nexthop);
+  if (rt) {
+    (*deps)[rt->prefix()].push_back(dependent);
+  }
+  // If any changed prefix covers the nexthop, either the route used to reach
+  // the nexthop or its forwarding info may have changed.
+  RoutePrefix<AddrT> changed;
+  return nhRib->changed.longestMatch(nexthop, &changed);
+}
+
 template<typename RibT>
-void RouteUpdater::setRoutesWithNhopsForResolution(RibT* rib) {
-  for (auto& rt : rib->getAllNodes()) {
-    auto route = rt.second.get();
-    if (route->isWithNexthops()) {
-      if (route->isPublished()) {
-        auto newRoute = route->clone(RibT::RouteType::Fields::COPY_ONLY_PREFIX);
-        newRoute->update(route->nexthops());
-        rib->updateRoute(newRoute);
-        route = newRoute.get();
+void RouteUpdater::collectDependencies(
+    RibT* rib, ClonedRib* clonedRib, DependencyIndex* deps,
+    std::vector<folly::CIDRNetwork>* toResolve) {
+  for (const auto& rt : rib->rib->getAllNodes()) {
+    const auto& route = rt.second;
+    if (!route->isWithNexthops()) {
+      continue;
+    }
+    folly::CIDRNetwork cidr(folly::IPAddress(rt.first.network), rt.first.mask);
+    // Routes added or modified by this updater are not resolved yet
+    bool needResolve = route->needResolve();
+    for (const auto& nh : route->nexthops()) {
+      if (nh.isV4()) {
+        needResolve |= addDependency(nh.asV4(), cidr, &clonedRib->v4,
+                                     &deps->v4);
+      } else {
+        needResolve |= addDependency(nh.asV6(), cidr, &clonedRib->v6,
+                                     &deps->v6);
       }
-      route->clearFlags();
+    }
+    if (needResolve) {
+      toResolve->push_back(cidr);
+    }
+  }
+}
+
+void RouteUpdater::setRoutesForResolution(ClonedRib* clonedRib) {
+  if (clonedRib->v4.changed.empty() && clonedRib->v6.changed.empty()) {
+    return;
+  }
+
+  // Find the routes depending directly on a changed prefix, and build the
+  // reverse index of which routes resolve their nexthops through which
+  // route.  A nexthop of a v4 route can be a v6 address and vice versa, so
+  // both RIBs of the VRF need to be looked at.
+  DependencyIndex deps;
+  std::vector<folly::CIDRNetwork> worklist;
+  collectDependencies(&clonedRib->v4, clonedRib, &deps, &worklist);
+  collectDependencies(&clonedRib->v6, clonedRib, &deps, &worklist);
+
+  // Re-resolving a route may change its forwarding info, which in turn
+  // affects all the routes resolved through it.
+  std::set<folly::CIDRNetwork> toResolve(worklist.begin(), worklist.end());
+  while (!worklist.empty()) {
+    auto cidr = worklist.back();
+    worklist.pop_back();
+    const std::vector<folly::CIDRNetwork>* dependents{nullptr};
+    if (cidr.first.isV4()) {
+      auto iter = deps.v4.find(PrefixV4{cidr.first.asV4(), cidr.second});
+      if (iter != deps.v4.end()) {
+        dependents = &iter->second;
+      }
+    } else {
+      auto iter = deps.v6.find(PrefixV6{cidr.first.asV6(), cidr.second});
+      if (iter != deps.v6.end()) {
+        dependents = &iter->second;
+      }
+    }
+    if (!dependents) {
+      continue;
+    }
+    for (const auto& dependent : *dependents) {
+      if (toResolve.insert(dependent).second) {
+        worklist.push_back(dependent);
+      }
+    }
+  }
+
+  for (const auto& cidr : toResolve) {
+    if (cidr.first.isV4()) {
+      setRouteForResolution(PrefixV4{cidr.first.asV4(), cidr.second},
+                            &clonedRib->v4);
+    } else {
+      setRouteForResolution(PrefixV6{cidr.first.asV6(), cidr.second},
+                            &clonedRib->v6);
     }
   }
 }
@@ -330,23 +634,22 @@ bool allRouteFlagsCleared(const RibT* rib) {
 }
 
 void RouteUpdater::resolve() {
-  // Ideally, just need to resolve the routes that is changed or impacted by
-  // the changed routes.
-  // However, Without copy-on-write RadixTree, it is O(n) to find out the
-  // routes that are changed. In this case, we just simply loop through all
-  // routes and resolve those that are not resolved yet.
+  // Only the routes that were changed, or whose nexthops are resolved through
+  // a changed prefix, need to be resolved again.  All other routes keep their
+  // existing forwarding info.
 
   for (auto& ribCloned : clonedRibs_) {
+    if (!sync_) {
+      setRoutesForResolution(&ribCloned.second);
+    } else {
+      // While synching FIB all routes are new and
+      // already have their flags not set, so no need
+      // to clear flags
+      DCHECK(allRouteFlagsCleared(ribCloned.second.v4.rib.get()));
+      DCHECK(allRouteFlagsCleared(ribCloned.second.v6.rib.get()));
+    }
     if (ribCloned.second.v4.cloned) {
       auto rib = ribCloned.second.v4.rib.get();
-      if (!sync_) {
-        // While synching FIB all routes are new and
-        // already have their flags not set, so no need
-        // to clear flags
-        setRoutesWithNhopsForResolution(rib);
-      } else {
-        DCHECK(allRouteFlagsCleared(rib));
-      }
       for (auto& rt : rib->getAllNodes()) {
         if (rt.second->needResolve()) {
           resolve(rt.second.get(), rib, &ribCloned.second);
@@ -355,14 +658,6 @@ void RouteUpdater::resolve() {
     }
     if (ribCloned.second.v6.cloned) {
       auto rib = ribCloned.second.v6.rib.get();
-      if (!sync_) {
-        // While synching FIB all routes are new and
-        // already have their flags not set, so no need
-        // to clear flags
-        setRoutesWithNhopsForResolution(rib);
-      } else {
-        DCHECK(allRouteFlagsCleared(rib));
-      }
       for (auto& rt : rib->getAllNodes()) {
         if (rt.second->needResolve()) {
           resolve(rt.second.get(), rib, &ribCloned.second);
@@ -419,18 +714,63 @@ std::shared_ptr<RouteTableMap> RouteUpdater::updateDone() {
   return orig_->clone(map);
 }
 
-void RouteUpdater::addInterfaceAndLinkLocalRoutes(
-    const std::shared_ptr<InterfaceMap>& intfs) {
-  boost::container::flat_set<RouterID> routers;
+std::shared_ptr<const RouteUpdater::InterfaceRoutes>
+RouteUpdater::getInterfaceRoutes(const std::shared_ptr<InterfaceMap>& intfs) {
+  // The interfaces rarely change, so the routes built for the last
+  // published InterfaceMap are kept for the next update to reuse.
+  static std::mutex cacheLock;
+  static std::weak_ptr<InterfaceMap> cachedIntfs;
+  static uint32_t cachedGeneration{0};
+  static std::shared_ptr<const InterfaceRoutes> cachedRoutes;
+  if (intfs->isPublished()) {
+    std::lock_guard<std::mutex> g(cacheLock);
+    if (cachedRoutes && cachedIntfs.lock() == intfs &&
+        cachedGeneration == intfs->getGeneration()) {
+      return cachedRoutes;
+    }
+  }
+
+  auto routes = make_shared<InterfaceRoutes>();
   for (auto const& item: intfs->getAllNodes()) {
     const auto& intf = item.second;
     auto routerId = intf->getRouterID();
-    routers.insert(routerId);
+    routes->routers.insert(routerId);
     for (auto const& addr : intf->getAddresses()) {
-      addRoute(routerId, intf->getID(), addr.first, addr.second);
+      const auto& intfAddr = addr.first;
+      auto len = addr.second;
+      if (intfAddr.isV4()) {
+        PrefixV4 prefix{intfAddr.asV4().mask(len), len};
+        routes->v4.push_back({routerId, prefix, intf->getID(), intfAddr});
+      } else {
+        PrefixV6 prefix{intfAddr.asV6().mask(len), len};
+        if (prefix.network.isLinkLocal()) {
+          throw FbossError("Unexpected v6 interface route for link local "
+                           "address ", prefix);
+        }
+        routes->v6.push_back({routerId, prefix, intf->getID(), intfAddr});
+      }
     }
   }
-  for (auto id : routers) {
+
+  if (intfs->isPublished()) {
+    std::lock_guard<std::mutex> g(cacheLock);
+    cachedIntfs = intfs;
+    cachedGeneration = intfs->getGeneration();
+    cachedRoutes = routes;
+  }
+  return routes;
+}
+
+void RouteUpdater::addInterfaceAndLinkLocalRoutes(
+    const std::shared_ptr<InterfaceMap>& intfs) {
+  auto routes = getInterfaceRoutes(intfs);
+  for (const auto& entry : routes->v4) {
+    addRoute(entry.prefix, getRibV4(entry.router), entry.intf, entry.addr);
+  }
+  for (const auto& entry : routes->v6) {
+    addRoute(entry.prefix, getRibV6(entry.router), entry.intf, entry.addr);
+  }
+  for (auto id : routes->routers) {
     addLinkLocalRoutes(id);
   }
 }
@@ -443,6 +783,9 @@ bool RouteUpdater::dedupRoutes(const RibT* oldRib, RibT* newRib) {
   }
   const auto& oldRoutes = oldRib->getAllNodes();
   auto& newRoutes = newRib->writableNodes();
+  // Modifying newRoutes invalidates its iterators, so collect the routes to
+  // re-use first and replace them after the walk.
+  std::vector<std::shared_ptr<typename RibT::Node>> reused;
   auto oldIter = oldRoutes.begin();
   auto newIter = newRoutes.begin();
   while (oldIter != oldRoutes.end() && newIter != newRoutes.end()) {
@@ -459,11 +802,13 @@ bool RouteUpdater::dedupRoutes(const RibT* oldRib, RibT* newRib) {
       continue;
     }
     const auto& oldRt = oldIter->second;
-    auto& newRt = newIter->second;
+    const auto& newRt = newIter->second;
     if (oldRt->isSame(newRt.get())) {
       // both routes are complete same, instead of using the new route,
       // we re-use the old route.
-      newIter->second = oldRt;
+      if (oldRt != newRt) {
+        reused.push_back(oldRt);
+      }
     } else {
       isSame = false;
       newRt->inheritGeneration(*oldRt);
@@ -474,6 +819,9 @@ bool RouteUpdater::dedupRoutes(const RibT* oldRib, RibT* newRib) {
   if (oldIter != oldRoutes.end() || newIter != newRoutes.end()) {
     isSame = false;
   }
+  for (const auto& rt : reused) {
+    newRoutes[rt->prefix()] = rt;
+  }
   return isSame;
 }
 
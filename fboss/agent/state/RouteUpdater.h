@@ -12,11 +12,14 @@
 
 #include "fboss/agent/types.h"
 #include <folly/IPAddress.h>
+#include "fboss/agent/state/RoutePrefixTrie.h"
 #include "fboss/agent/state/RouteTypes.h"
 #include "fboss/agent/state/RouteTableMap.h"
 
 #include <boost/container/flat_map.hpp>
 #include <boost/container/flat_set.hpp>
+#include <map>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
@@ -67,16 +70,104 @@ class RouteUpdater {
   // methods to delete a route
   void delRoute(RouterID id, const folly::IPAddress& network, uint8_t mask);
 
+  /*
+   * Methods to add, update or delete the nexthops a client added for a
+   * route.
+   *
+   * The nexthops of each client are kept separately, and the route forwards
+   * using the nexthops of the client with the lowest admin distance.
+   * Interface routes and routes with a special action come from the config
+   * and take precedence over all clients; deleting them falls back to the
+   * clients' nexthops, if any.  A route is deleted along with the nexthops
+   * of its last client.
+   *
+   * Only routes whose forwarding nexthops change are resolved again.
+   */
+  void addRoute(RouterID id, const folly::IPAddress& network, uint8_t mask,
+                ClientID client, RouteNextHopEntry entry);
+  void delRoute(RouterID id, const folly::IPAddress& network, uint8_t mask,
+                ClientID client);
+  // Versions of addRoute() for a prefix of a known address family, whose
+  // network is already masked to its length
+  void addRoute(RouterID id, const PrefixV4& prefix, ClientID client,
+                RouteNextHopEntry entry);
+  void addRoute(RouterID id, const PrefixV6& prefix, ClientID client,
+                RouteNextHopEntry entry);
+  /*
+   * The full set of routes of one client, e.g. from a FIB sync, split by
+   * address family.
+   */
+  struct ClientRoutes {
+    // Add the nexthops of one prefix.  If a prefix is added more than once,
+    // the last entry is used.
+    void add(const folly::IPAddress& network, uint8_t mask,
+             RouteNextHopEntry entry);
+
+    std::vector<std::pair<PrefixV4, RouteNextHopEntry>> v4;
+    std::vector<std::pair<PrefixV6, RouteNextHopEntry>> v6;
+  };
+  /*
+   * Replace all routes of a client in the VRF with the given ones, without
+   * touching the routes of other clients.
+   *
+   * The routes are sorted and walked along with the existing RIB, which is
+   * sorted the same way, so only the routes the client added, changed or
+   * no longer has are modified.  Re-syncing an unchanged set of routes
+   * allocates nothing but the sorted copy.
+   */
+  void syncClientRoutes(RouterID id, ClientID client, ClientRoutes routes);
+
   std::shared_ptr<RouteTableMap> updateDone();
 
-  // Add all interface routes (directly connected routes) and link local routes
+  /*
+   * Add all interface routes (directly connected routes) and link local
+   * routes.
+   *
+   * The routes are built once for a published InterfaceMap and reused until
+   * the interfaces change, and each one that is already in the RIB as it is
+   * leaves the RIB untouched.
+   */
   void addInterfaceAndLinkLocalRoutes(
       const std::shared_ptr<InterfaceMap>& intfs);
 
-  // Helper functions to add or delete link local routes
+  // Helper functions to add or delete link local routes.  Neither modifies
+  // the RIB if the route is already there, or already gone.
   void addLinkLocalRoutes(RouterID id);
   void delLinkLocalRoutes(RouterID id);
 
+  /*
+   * The interface routes of a set of interfaces, with their prefixes
+   * already masked, and the routers that need link local routes.
+   */
+  struct InterfaceRoutes {
+    template<typename PrefixT>
+    struct Entry {
+      RouterID router;
+      PrefixT prefix;
+      InterfaceID intf;
+      folly::IPAddress addr;
+    };
+    std::vector<Entry<PrefixV4>> v4;
+    std::vector<Entry<PrefixV6>> v6;
+    boost::container::flat_set<RouterID> routers;
+  };
+  /*
+   * Get the interface routes of intfs, reusing the ones last built if intfs
+   * is the same published InterfaceMap at the same generation.
+   */
+  static std::shared_ptr<const InterfaceRoutes> getInterfaceRoutes(
+      const std::shared_ptr<InterfaceMap>& intfs);
+
+  /*
+   * The number of routes whose nexthops were (re-)resolved by updateDone().
+   *
+   * Outside of sync mode, only routes that were modified, or whose recursive
+   * resolution depends on a modified prefix, are re-resolved.
+   */
+  uint64_t getNumRoutesResolved() const {
+    return numRoutesResolved_;
+  }
+
  private:
   // Forbidden copy constructor and assignment operator
   RouteUpdater(RouteUpdater const &) = delete;
@@ -89,15 +180,28 @@ class RouteUpdater {
     struct RibV4 {
       std::shared_ptr<RouteTableRibV4> rib;
       bool cloned{false};
+      // Prefixes added, modified or deleted by this updater
+      RoutePrefixTrie<folly::IPAddressV4> changed;
     } v4;
     struct RibV6 {
       std::shared_ptr<RouteTableRibV6> rib;
       bool cloned{false};
+      // Prefixes added, modified or deleted by this updater
+      RoutePrefixTrie<folly::IPAddressV6> changed;
     } v6;
   };
+  /*
+   * Reverse index from a route prefix to the routes that have a nexthop
+   * resolved through it.  Dependent routes can be of either address family.
+   */
+  struct DependencyIndex {
+    std::map<PrefixV4, std::vector<folly::CIDRNetwork>> v4;
+    std::map<PrefixV6, std::vector<folly::CIDRNetwork>> v6;
+  };
   boost::container::flat_map<RouterID, ClonedRib> clonedRibs_;
   const std::shared_ptr<RouteTableMap>& orig_;
   bool sync_{false};
+  uint64_t numRoutesResolved_{0};
 
   // Helper functions to get/allocate the cloned RIB
   ClonedRib* createNewRib(RouterID id);
@@ -106,13 +210,37 @@ class RouteUpdater {
   template<typename RibT>
   auto makeClone(RibT* rib) -> decltype(rib->rib.get());
 
+  // Functions to find the routes that need to be re-resolved
+  void setRoutesForResolution(ClonedRib* clonedRib);
   template<typename RibT>
-  void setRoutesWithNhopsForResolution(RibT* rib);
+  void collectDependencies(RibT* rib, ClonedRib* clonedRib,
+                           DependencyIndex* deps,
+                           std::vector<folly::CIDRNetwork>* toResolve);
+  template<typename AddrT, typename RibT, typename DepsT>
+  bool addDependency(const AddrT& nexthop,
+                     const folly::CIDRNetwork& dependent,
+                     RibT* nhRib, DepsT* deps);
+  template<typename PrefixT, typename RibT>
+  void setRouteForResolution(const PrefixT& prefix, RibT* ribCloned);
   // Helper functions to add or delete a route
   template<typename PrefixT, typename RibT, typename... Args>
   void addRoute(const PrefixT& prefix, RibT *rib, Args&&... args);
   template<typename PrefixT, typename RibT>
   void delRoute(const PrefixT& prefix, RibT *rib);
+  template<typename PrefixT, typename RibT>
+  void addClientRoute(const PrefixT& prefix, RibT *ribCloned,
+                      ClientID client, RouteNextHopEntry entry);
+  template<typename PrefixT, typename RibT>
+  void delClientRoute(const PrefixT& prefix, RibT *ribCloned,
+                      ClientID client);
+  template<typename PrefixT, typename RibT>
+  void syncClientRoutes(
+      RibT *ribCloned, ClientID client,
+      std::vector<std::pair<PrefixT, RouteNextHopEntry>>* routes);
+  // Return an unpublished version of the route, replacing it in the RIB
+  template<typename RouteT, typename RtRibT>
+  std::shared_ptr<RouteT> writableRoute(const std::shared_ptr<RouteT>& route,
+                                       RtRibT* rib);
 
   // resolve all routes that are not resolved yet
   void resolve();
@@ -9,6 +9,10 @@
  */
 #include "fboss/agent/state/StateDelta.h"
 
+#include "fboss/agent/state/AclEntry.h"
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
 #include "fboss/agent/state/NodeMapDelta.h"
 #include "fboss/agent/state/Port.h"
 #include "fboss/agent/state/PortMap.h"
@@ -28,33 +32,77 @@
 
 using std::shared_ptr;
 
+namespace {
+
+using namespace facebook::fboss;
+
+// Collect the changes nested in a changed node
+template<typename NODE>
+void collectNestedChanges(DeltaValue<NODE>* /*entry*/) {
+}
+
+void collectNestedChanges(VlanDelta* entry) {
+  entry->collectChanges();
+}
+
+void collectNestedChanges(RouteTablesDelta* entry) {
+  entry->collectChanges();
+}
+
+}
+
 namespace facebook { namespace fboss {
 
 StateDelta::~StateDelta() {
 }
 
+template<typename DeltaT>
+DeltaT StateDelta::getDelta(CollectedChanges<DeltaT>* changes,
+                            const typename DeltaT::MapType* oldMap,
+                            const typename DeltaT::MapType* newMap) {
+  std::call_once(changes->collected, [&]() {
+    auto collected = std::make_shared<typename DeltaT::Changes>();
+    for (const auto& entry : DeltaT(oldMap, newMap)) {
+      collected->push_back(entry);
+      collectNestedChanges(&collected->back());
+    }
+    changes->changes = std::move(collected);
+  });
+  return DeltaT(oldMap, newMap, changes->changes);
+}
+
 NodeMapDelta<PortMap> StateDelta::getPortsDelta() const {
-  return NodeMapDelta<PortMap>(old_->getPorts().get(),
-                               new_->getPorts().get());
+  return getDelta(&ports_, old_->getPorts().get(), new_->getPorts().get());
+}
+
+NodeMapDelta<AggregatePortMap> StateDelta::getAggregatePortsDelta() const {
+  return getDelta(&aggregatePorts_, old_->getAggregatePorts().get(),
+                  new_->getAggregatePorts().get());
 }
 
 VlanMapDelta StateDelta::getVlansDelta() const {
-  return VlanMapDelta(old_->getVlans().get(), new_->getVlans().get());
+  return getDelta(&vlans_, old_->getVlans().get(), new_->getVlans().get());
 }
 
 NodeMapDelta<InterfaceMap> StateDelta::getIntfsDelta() const {
-  return NodeMapDelta<InterfaceMap>(old_->getInterfaces().get(),
-                                    new_->getInterfaces().get());
+  return getDelta(&intfs_, old_->getInterfaces().get(),
+                  new_->getInterfaces().get());
 }
 
 RTMapDelta StateDelta::getRouteTablesDelta() const {
-  return RTMapDelta(old_->getRouteTables().get(),
-                    new_->getRouteTables().get());
+  return getDelta(&routeTables_, old_->getRouteTables().get(),
+                  new_->getRouteTables().get());
+}
+
+NodeMapDelta<AclMap> StateDelta::getAclsDelta() const {
+  return getDelta(&acls_, old_->getAcls().get(), new_->getAcls().get());
 }
 
 // Explicit instantiations of NodeMapDelta that are used by StateDelta.
 // This prevents users of StateDelta from needing to include
 // NodeMapDelta-defs.h
+template class NodeMapDelta<AclMap>;
+template class NodeMapDelta<AggregatePortMap>;
 template class NodeMapDelta<InterfaceMap>;
 template class NodeMapDelta<PortMap>;
 template class NodeMapDelta<RouteTableMap>;
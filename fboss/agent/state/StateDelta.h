@@ -11,7 +11,10 @@
 
 #include <functional>
 #include <memory>
+#include <mutex>
 
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/AggregatePortMap.h"
 #include "fboss/agent/state/DeltaFunctions.h"
 #include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/PortMap.h"
@@ -26,6 +29,12 @@ class SwitchState;
 /*
  * StateDelta contains code for examining the differences between two
  * SwitchStates.
+ *
+ * The changes of each map are collected the first time they are asked for,
+ * along with the ARP, NDP and route changes within them, and the deltas
+ * returned after that walk the collected changes.  The HwSwitch and the
+ * StateObservers can share one StateDelta, so only the first of them to
+ * walk a map compares it.  This is safe from several threads at once.
  */
 class StateDelta {
  public:
@@ -44,17 +53,37 @@ class StateDelta {
   }
 
   NodeMapDelta<PortMap> getPortsDelta() const;
+  NodeMapDelta<AggregatePortMap> getAggregatePortsDelta() const;
   VlanMapDelta getVlansDelta() const;
   NodeMapDelta<InterfaceMap> getIntfsDelta() const;
   RTMapDelta getRouteTablesDelta() const;
+  NodeMapDelta<AclMap> getAclsDelta() const;
 
  private:
   // Forbidden copy constructor and assignment operator
   StateDelta(StateDelta const &) = delete;
   StateDelta& operator=(StateDelta const &) = delete;
 
+  template<typename DeltaT>
+  struct CollectedChanges {
+    std::once_flag collected;
+    std::shared_ptr<const typename DeltaT::Changes> changes;
+  };
+
+  template<typename DeltaT>
+  static DeltaT getDelta(CollectedChanges<DeltaT>* changes,
+                         const typename DeltaT::MapType* oldMap,
+                         const typename DeltaT::MapType* newMap);
+
   std::shared_ptr<SwitchState> old_;
   std::shared_ptr<SwitchState> new_;
+
+  mutable CollectedChanges<NodeMapDelta<PortMap>> ports_;
+  mutable CollectedChanges<NodeMapDelta<AggregatePortMap>> aggregatePorts_;
+  mutable CollectedChanges<VlanMapDelta> vlans_;
+  mutable CollectedChanges<NodeMapDelta<InterfaceMap>> intfs_;
+  mutable CollectedChanges<RTMapDelta> routeTables_;
+  mutable CollectedChanges<NodeMapDelta<AclMap>> acls_;
 };
 
 }} // facebook::fboss
@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/StateMemoryStats.h"
+
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/AggregatePortMap.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/MacTable.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/RouteTable.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteTableRib.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <unordered_set>
+
+namespace {
+
+using facebook::fboss::NodeBase;
+using facebook::fboss::StateMemoryStats;
+
+typedef std::unordered_set<const NodeBase*> NodeSet;
+
+/*
+ * Returns the subtree name if 'node' is the root of one of the subtrees we
+ * report on, or nullptr if it belongs to the same subtree as its parent.
+ */
+const char* getSubtreeName(const NodeBase* node) {
+  using namespace facebook::fboss;
+  if (dynamic_cast<const PortMap*>(node)) {
+    return "ports";
+  } else if (dynamic_cast<const AggregatePortMap*>(node)) {
+    return "aggregate_ports";
+  } else if (dynamic_cast<const VlanMap*>(node)) {
+    return "vlans";
+  } else if (dynamic_cast<const ArpTable*>(node)) {
+    return "arp";
+  } else if (dynamic_cast<const NdpTable*>(node)) {
+    return "ndp";
+  } else if (dynamic_cast<const MacTable*>(node)) {
+    return "mac";
+  } else if (dynamic_cast<const InterfaceMap*>(node)) {
+    return "interfaces";
+  } else if (dynamic_cast<const RouteTableMap*>(node)) {
+    return "route_tables";
+  } else if (dynamic_cast<const AclMap*>(node)) {
+    return "acls";
+  } else if (dynamic_cast<const RouteTable::RibTypeV4*>(node)) {
+    return "rib_v4";
+  } else if (dynamic_cast<const RouteTable::RibTypeV6*>(node)) {
+    return "rib_v6";
+  }
+  return nullptr;
+}
+
+void collectNodes(const NodeBase* node, NodeSet* nodes) {
+  nodes->insert(node);
+  node->forEachChildNode([&](const NodeBase* child) {
+    collectNodes(child, nodes);
+  });
+}
+
+class StateMemoryWalker {
+ public:
+  StateMemoryWalker(const NodeSet* prevNodes,
+                    StateMemoryStats::SubtreeMap* subtrees)
+    : prevNodes_(prevNodes),
+      subtrees_(subtrees) {}
+
+  void walk(const NodeBase* node, StateMemoryStats::Usage* usage,
+            bool shared) {
+    auto name = getSubtreeName(node);
+    if (name) {
+      usage = &(*subtrees_)[name];
+    }
+
+    // Published nodes are never modified, so once a node is shared with the
+    // previous state its entire subtree is shared too.
+    shared = shared || prevNodes_->count(node) > 0;
+    auto bytes = node->getMemoryUsage();
+    ++usage->nodes;
+    usage->bytes += bytes;
+    if (shared) {
+      ++usage->sharedNodes;
+      usage->sharedBytes += bytes;
+    }
+
+    node->forEachChildNode([&](const NodeBase* child) {
+      walk(child, usage, shared);
+    });
+  }
+
+ private:
+  const NodeSet* prevNodes_;
+  StateMemoryStats::SubtreeMap* subtrees_;
+};
+
+}
+
+namespace facebook { namespace fboss {
+
+void StateMemoryStats::Usage::add(const Usage& other) {
+  nodes += other.nodes;
+  bytes += other.bytes;
+  sharedNodes += other.sharedNodes;
+  sharedBytes += other.sharedBytes;
+}
+
+StateMemoryStats::StateMemoryStats(const SwitchState* state,
+                                   const SwitchState* prevState)
+  : generation_(state->getGeneration()) {
+  NodeSet prevNodes;
+  if (prevState) {
+    collectNodes(prevState, &prevNodes);
+  }
+
+  // The SwitchState node itself is accounted for in the total only
+  Usage root;
+  StateMemoryWalker(&prevNodes, &subtrees_).walk(state, &root, false);
+  total_ = root;
+  for (const auto& entry : subtrees_) {
+    total_.add(entry.second);
+  }
+}
+
+}} // facebook::fboss
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace facebook { namespace fboss {
+
+class NodeBase;
+class SwitchState;
+
+/*
+ * StateMemoryStats reports the approximate memory used by a SwitchState.
+ *
+ * The state tree is walked once, accumulating the node count and the bytes
+ * reported by NodeBase::getMemoryUsage() for each node.  Nodes are grouped by
+ * the subtree they belong to: "ports", "vlans", "arp", "ndp", "mac",
+ * "interfaces", "route_tables", "rib_v4" and "rib_v6".  ARP, NDP and MAC
+ * tables and the RIBs are reported separately from the VLAN and route table
+ * nodes that contain them.
+ *
+ * When a previous SwitchState is supplied, each node is also classified as
+ * shared (the same node object is referenced by the previous state) or
+ * unique to the new state.  This shows how much memory a new generation
+ * actually added, and how much an old generation keeps alive while it is
+ * still referenced.
+ */
+class StateMemoryStats {
+ public:
+  struct Usage {
+    uint64_t nodes{0};
+    uint64_t bytes{0};
+    uint64_t sharedNodes{0};
+    uint64_t sharedBytes{0};
+
+    void add(const Usage& other);
+  };
+  typedef std::map<std::string, Usage> SubtreeMap;
+
+  StateMemoryStats() {}
+
+  /*
+   * Compute the memory used by 'state'.
+   *
+   * 'prevState' may be null, in which case all nodes are reported as unique.
+   */
+  StateMemoryStats(const SwitchState* state, const SwitchState* prevState);
+
+  uint32_t getGeneration() const {
+    return generation_;
+  }
+  const Usage& getTotal() const {
+    return total_;
+  }
+  const SubtreeMap& getSubtrees() const {
+    return subtrees_;
+  }
+
+ private:
+  uint32_t generation_{0};
+  Usage total_;
+  SubtreeMap subtrees_;
+};
+
+}} // facebook::fboss
@@ -0,0 +1,297 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/StateSnapshot.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/SysError.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/FileUtil.h>
+#include <folly/MemoryMapping.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using folly::ByteRange;
+using folly::dynamic;
+using std::shared_ptr;
+using std::string;
+
+namespace {
+
+// The tag byte preceding each encoded value
+enum Tag : uint8_t {
+  TAG_NULL = 0,
+  TAG_FALSE = 1,
+  TAG_TRUE = 2,
+  TAG_INT = 3,
+  TAG_DOUBLE = 4,
+  TAG_STRING = 5,
+  TAG_ARRAY = 6,
+  TAG_OBJECT = 7,
+};
+
+// The header is the magic number, the version, and the encoded data length
+constexpr size_t kHeaderSize = 4 + 4 + 8;
+
+void appendVarint(uint64_t value, string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void appendFixed(uint64_t value, size_t length, string* out) {
+  for (size_t n = 0; n < length; ++n) {
+    out->push_back(static_cast<char>(value >> (8 * n)));
+  }
+}
+
+void appendString(folly::StringPiece str, string* out) {
+  appendVarint(str.size(), out);
+  out->append(str.data(), str.size());
+}
+
+void encodeContainerStart(Tag tag, size_t count, string* out) {
+  out->push_back(tag);
+  appendVarint(count, out);
+}
+
+void encodeValue(const dynamic& value, string* out) {
+  switch (value.type()) {
+    case dynamic::NULLT:
+      out->push_back(TAG_NULL);
+      return;
+    case dynamic::BOOL:
+      out->push_back(value.asBool() ? TAG_TRUE : TAG_FALSE);
+      return;
+    case dynamic::INT64: {
+      // Zigzag encode, so that small negative numbers stay small
+      int64_t n = value.asInt();
+      out->push_back(TAG_INT);
+      appendVarint((static_cast<uint64_t>(n) << 1) ^ (n >> 63), out);
+      return;
+    }
+    case dynamic::DOUBLE: {
+      double d = value.asDouble();
+      uint64_t bits;
+      memcpy(&bits, &d, sizeof(bits));
+      out->push_back(TAG_DOUBLE);
+      appendFixed(bits, sizeof(bits), out);
+      return;
+    }
+    case dynamic::STRING:
+      out->push_back(TAG_STRING);
+      appendString(value.getString(), out);
+      return;
+    case dynamic::ARRAY:
+      encodeContainerStart(TAG_ARRAY, value.size(), out);
+      for (const auto& item : value) {
+        encodeValue(item, out);
+      }
+      return;
+    case dynamic::OBJECT:
+      encodeContainerStart(TAG_OBJECT, value.size(), out);
+      for (const auto& item : value.items()) {
+        encodeValue(item.first, out);
+        encodeValue(item.second, out);
+      }
+      return;
+  }
+  throw facebook::fboss::FbossError("cannot encode dynamic of type ",
+                                    value.typeName());
+}
+
+/*
+ * Decodes values from a snapshot, checking that every read stays within
+ * the data.
+ */
+class Decoder {
+ public:
+  explicit Decoder(ByteRange data) : data_(data) {}
+
+  bool empty() const {
+    return data_.empty();
+  }
+
+  uint8_t readByte() {
+    need(1);
+    uint8_t byte = data_[0];
+    data_.advance(1);
+    return byte;
+  }
+
+  uint64_t readFixed(size_t length) {
+    need(length);
+    uint64_t value = 0;
+    for (size_t n = 0; n < length; ++n) {
+      value |= static_cast<uint64_t>(data_[n]) << (8 * n);
+    }
+    data_.advance(length);
+    return value;
+  }
+
+  uint64_t readVarint() {
+    uint64_t value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+      uint8_t byte = readByte();
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    throw facebook::fboss::FbossError("invalid varint in state snapshot");
+  }
+
+  // Read a length, which can never exceed the remaining data since each
+  // string byte or container item takes at least one byte.
+  size_t readLength() {
+    auto length = readVarint();
+    need(length);
+    return length;
+  }
+
+  dynamic readValue(size_t depth) {
+    // The state tree is only a few levels deep; anything deeper is corrupt
+    if (depth > kMaxDepth) {
+      throw facebook::fboss::FbossError("state snapshot nested too deeply");
+    }
+    auto tag = readByte();
+    switch (tag) {
+      case TAG_NULL:
+        return nullptr;
+      case TAG_FALSE:
+        return false;
+      case TAG_TRUE:
+        return true;
+      case TAG_INT: {
+        auto n = readVarint();
+        return static_cast<int64_t>((n >> 1) ^ -(n & 1));
+      }
+      case TAG_DOUBLE: {
+        auto bits = readFixed(sizeof(uint64_t));
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return d;
+      }
+      case TAG_STRING: {
+        auto length = readLength();
+        string str(reinterpret_cast<const char*>(data_.data()), length);
+        data_.advance(length);
+        return str;
+      }
+      case TAG_ARRAY: {
+        auto count = readLength();
+        std::vector<dynamic> items;
+        items.reserve(count);
+        for (size_t n = 0; n < count; ++n) {
+          items.push_back(readValue(depth + 1));
+        }
+        return dynamic(items.begin(), items.end());
+      }
+      case TAG_OBJECT: {
+        auto count = readLength();
+        dynamic obj = dynamic::object;
+        for (size_t n = 0; n < count; ++n) {
+          auto key = readValue(depth + 1);
+          obj.insert(std::move(key), readValue(depth + 1));
+        }
+        return obj;
+      }
+    }
+    throw facebook::fboss::FbossError("invalid tag ", tag,
+                                      " in state snapshot");
+  }
+
+ private:
+  enum : size_t { kMaxDepth = 64 };
+
+  void need(size_t length) const {
+    if (data_.size() < length) {
+      throw facebook::fboss::FbossError("truncated state snapshot");
+    }
+  }
+
+  ByteRange data_;
+};
+
+}
+
+namespace facebook { namespace fboss {
+
+string StateSnapshot::encode(const dynamic& json) {
+  // Reserve space for the header, and fill it in once the length is known
+  string out(kHeaderSize, '\0');
+  ::encodeValue(json, &out);
+  auto header = encodeHeader(out.size() - kHeaderSize);
+  std::copy(header.begin(), header.end(), out.begin());
+  return out;
+}
+
+void StateSnapshot::encodeValue(const dynamic& value, string* out) {
+  ::encodeValue(value, out);
+}
+
+void StateSnapshot::encodeArrayStart(size_t count, string* out) {
+  encodeContainerStart(TAG_ARRAY, count, out);
+}
+
+void StateSnapshot::encodeObjectStart(size_t count, string* out) {
+  encodeContainerStart(TAG_OBJECT, count, out);
+}
+
+string StateSnapshot::encodeHeader(uint64_t length) {
+  string header;
+  appendFixed(kMagic, 4, &header);
+  appendFixed(kVersion, 4, &header);
+  appendFixed(length, 8, &header);
+  return header;
+}
+
+dynamic StateSnapshot::decode(ByteRange data) {
+  Decoder header(data);
+  auto magic = header.readFixed(4);
+  if (magic != kMagic) {
+    throw FbossError("not a state snapshot: bad magic number ", magic);
+  }
+  auto version = header.readFixed(4);
+  if (version != kVersion) {
+    throw FbossError("unsupported state snapshot version ", version,
+                     ", expected ", kVersion);
+  }
+  auto length = header.readFixed(8);
+  if (length != data.size() - kHeaderSize) {
+    throw FbossError("state snapshot length mismatch: header says ", length,
+                     " bytes, found ", data.size() - kHeaderSize);
+  }
+
+  Decoder decoder(data.subpiece(kHeaderSize));
+  auto json = decoder.readValue(0);
+  if (!decoder.empty()) {
+    throw FbossError("trailing data after state snapshot");
+  }
+  return json;
+}
+
+void StateSnapshot::writeFile(const shared_ptr<SwitchState>& state,
+                              const string& filename) {
+  auto data = encode(state->toFollyDynamic());
+  if (!folly::writeFile(data, filename.c_str())) {
+    throw SysError(errno, "error writing state snapshot to ", filename);
+  }
+}
+
+shared_ptr<SwitchState> StateSnapshot::readFile(const string& filename) {
+  folly::MemoryMapping mapping(filename.c_str());
+  return SwitchState::fromFollyDynamic(decode(mapping.range()));
+}
+
+}} // facebook::fboss
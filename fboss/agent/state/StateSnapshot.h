@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/dynamic.h>
+#include <memory>
+#include <string>
+
+namespace facebook { namespace fboss {
+
+class SwitchState;
+
+/*
+ * A compact binary encoding of the SwitchState, used to save the state
+ * across a warm boot.
+ *
+ * The snapshot contains the same data as SwitchState::toFollyDynamic(), but
+ * encodes it as a tagged binary tree rather than JSON text.  This avoids
+ * printing and re-parsing JSON for large route and neighbor tables, which
+ * dominated the time taken to exit and restart.  Integers are encoded as
+ * varints, and strings and containers are prefixed with their length.
+ *
+ * Every snapshot starts with a header holding a magic number, the format
+ * version and the length of the encoded data.  Readers reject snapshots with
+ * an unknown version rather than trying to interpret them.
+ *
+ * Snapshots are only meant to be read back on the same machine, and record
+ * doubles in host byte order.
+ */
+class StateSnapshot {
+ public:
+  enum : uint32_t {
+    kMagic = 0x53534246, // "FBSS"
+    kVersion = 1,
+  };
+
+  /*
+   * Encode the state and write it to the specified file.
+   *
+   * Throws an exception on error.
+   */
+  static void writeFile(const std::shared_ptr<SwitchState>& state,
+                        const std::string& filename);
+
+  /*
+   * Load a state from a snapshot file.  The file is memory mapped and
+   * decoded in place, without copying it into a separate buffer first.
+   *
+   * Throws an exception if the file cannot be read, or is not a valid
+   * snapshot.
+   */
+  static std::shared_ptr<SwitchState> readFile(const std::string& filename);
+
+  /*
+   * Encode or decode a snapshot, including its header.
+   */
+  static std::string encode(const folly::dynamic& json);
+  static folly::dynamic decode(folly::ByteRange data);
+
+  /*
+   * The pieces of an encoding, for building a snapshot from values that
+   * were encoded separately.  A snapshot is the header, followed by a
+   * single encoded value.
+   *
+   * An encoded array is the array start, followed by exactly count encoded
+   * items.  An encoded object is the object start, followed by count pairs
+   * of encoded keys and values.
+   */
+  static void encodeValue(const folly::dynamic& value, std::string* out);
+  static void encodeArrayStart(size_t count, std::string* out);
+  static void encodeObjectStart(size_t count, std::string* out);
+  static std::string encodeHeader(uint64_t length);
+};
+
+}} // facebook::fboss
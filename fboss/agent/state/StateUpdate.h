@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
 
 #include <folly/IntrusiveList.h>
@@ -19,6 +21,24 @@ namespace facebook { namespace fboss {
 class SwitchState;
 
 /*
+ * The priority class of a state update.
+ *
+ * The update thread applies pending updates of a higher priority class
+ * before those of a lower one, and updates of the same class in the order
+ * they were scheduled.
+ */
+enum class StateUpdatePriority : uint8_t {
+  // Link state and neighbor changes, which traffic is waiting on
+  NEIGHBOR,
+  // Route changes from routing protocols
+  ROUTE,
+  // Config changes, and updates that don't say otherwise
+  CONFIG,
+  // Periodic cleanup and other background work
+  HOUSEKEEPING,
+  NUM_PRIORITIES,
+};
+
  * StateUpdate objects are used to make changes to the SwitchState.
  *
  * All updates are applied in a single thread.  StateUpdate objects allow other
@@ -32,14 +52,58 @@ class SwitchState;
  */
 class StateUpdate {
  public:
-  explicit StateUpdate(folly::StringPiece name)
-    : name_(name.str()) {}
+  static constexpr size_t kNumPriorities =
+    static_cast<size_t>(StateUpdatePriority::NUM_PRIORITIES);
+
+  explicit StateUpdate(
+      folly::StringPiece name,
+      StateUpdatePriority priority = StateUpdatePriority::CONFIG)
+    : name_(name.str()),
+      priority_(priority) {}
   virtual ~StateUpdate() {}
 
   const std::string& getName() const {
     return name_;
   }
 
+  StateUpdatePriority getPriority() const {
+    return priority_;
+  }
+
+  /*
+   * Whether the update thread should stop batching updates after this one.
+   *
+   * The update thread then programs the updates batched so far, and checks
+   * for new higher priority updates, before it applies the next one.  A
+   * large update split into chunks sets this on each chunk, so that it
+   * doesn't hold up link state and neighbor changes until it is all done.
+   */
+  bool getEndsBatch() const {
+    return endsBatch_;
+  }
+  void setEndsBatch(bool endsBatch) {
+    endsBatch_ = endsBatch;
+  }
+
+  /*
+   * Whether the update can be applied to the unpublished state left by the
+   * composable updates before it in the batch.  A run of composable updates
+   * then works on one copy of the state, and clones each node it changes
+   * only once, rather than once per update.
+   *
+   * If a composable update fails, the state it was given may be partly
+   * changed, so it is thrown away.  The batch goes back to the last state
+   * published before the run, and applies the updates of the run that had
+   * succeeded again, one by one.  applyUpdate() must therefore only depend
+   * on the state it is given, and be safe to call more than once.
+   */
+  bool isComposable() const {
+    return composable_;
+  }
+  void setComposable(bool composable) {
+    composable_ = composable;
+  }
+
   /*
    * Apply the update, and return a new SwitchState.
    *
@@ -73,9 +137,16 @@ class StateUpdate {
   StateUpdate& operator=(StateUpdate const &) = delete;
 
   std::string name_;
+  StateUpdatePriority priority_{StateUpdatePriority::CONFIG};
+  bool endsBatch_{false};
+  bool composable_{false};
 
   // An intrusive list hook for maintaining the list of pending updates.
   folly::IntrusiveListHook listHook_;
+  // The next update in SwSwitch's lock-free stack of new updates.
+  StateUpdate* next_{nullptr};
+  // When the update was put on the pending list.
+  std::chrono::steady_clock::time_point enqueueTime_;
   // The SwSwitch code needs access to our listHook_ member so it can maintain
   // the update list.
   friend class SwSwitch;
@@ -28,8 +28,11 @@ class FunctionStateUpdate : public StateUpdate {
     std::shared_ptr<SwitchState>(const std::shared_ptr<SwitchState>&)>
     StateUpdateFn;
 
-  FunctionStateUpdate(folly::StringPiece name, StateUpdateFn fn)
-    : StateUpdate(name),
+  FunctionStateUpdate(
+      folly::StringPiece name,
+      StateUpdateFn fn,
+      StateUpdatePriority priority = StateUpdatePriority::CONFIG)
+    : StateUpdate(name, priority),
       function_(fn) {}
 
   std::shared_ptr<SwitchState> applyUpdate(
@@ -97,10 +100,12 @@ class BlockingStateUpdate : public StateUpdate {
     std::shared_ptr<SwitchState>(const std::shared_ptr<SwitchState>&)>
     StateUpdateFn;
 
-  BlockingStateUpdate(folly::StringPiece name,
-                      StateUpdateFn fn,
-                      BlockingUpdateResult* result)
-    : StateUpdate(name),
+  BlockingStateUpdate(
+      folly::StringPiece name,
+      StateUpdateFn fn,
+      BlockingUpdateResult* result,
+      StateUpdatePriority priority = StateUpdatePriority::CONFIG)
+    : StateUpdate(name, priority),
       function_(fn),
       result_(result) {}
 
@@ -127,4 +132,48 @@ class BlockingStateUpdate : public StateUpdate {
   BlockingUpdateResult* result_{nullptr};
 };
 
+/*
+ * A state update that reports its result to a callback, rather than
+ * blocking the thread that scheduled it until it is applied.
+ *
+ * The callback is invoked in the update thread once the new state has been
+ * applied to the HwSwitch, with a null exception_ptr, or with the error that
+ * prevented the update from being applied.  It must not block.
+ */
+class CallbackStateUpdate : public StateUpdate {
+ public:
+  typedef std::function<
+    std::shared_ptr<SwitchState>(const std::shared_ptr<SwitchState>&)>
+    StateUpdateFn;
+  typedef std::function<void(const std::exception_ptr&)> StateUpdateDoneFn;
+
+  CallbackStateUpdate(
+      folly::StringPiece name,
+      StateUpdateFn fn,
+      StateUpdateDoneFn done,
+      StateUpdatePriority priority = StateUpdatePriority::CONFIG)
+    : StateUpdate(name, priority),
+      function_(std::move(fn)),
+      done_(std::move(done)) {}
+
+  std::shared_ptr<SwitchState> applyUpdate(
+      const std::shared_ptr<SwitchState>& origState) override {
+    return function_(origState);
+  }
+
+  void onError(const std::exception& ex) noexcept override {
+    // As in BlockingStateUpdate, std::current_exception() keeps the original
+    // exception type.
+    done_(std::current_exception());
+  }
+
+  void onSuccess() override {
+    done_(std::exception_ptr());
+  }
+
+ private:
+  StateUpdateFn function_;
+  StateUpdateDoneFn done_;
+};
+
 }} // facebook::fboss
@@ -10,7 +10,12 @@
 #include "fboss/agent/state/SwitchState.h"
 
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/state/AclEntry.h"
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
 #include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/JsonStreamWriter.h"
 #include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/PortMap.h"
 #include "fboss/agent/state/Vlan.h"
@@ -25,8 +30,10 @@ using std::shared_ptr;
 namespace {
 constexpr auto kInterfaces = "interfaces";
 constexpr auto kPorts = "ports";
+constexpr auto kAggregatePorts = "aggregatePorts";
 constexpr auto kVlans = "vlans";
 constexpr auto kRouteTables = "routeTables";
+constexpr auto kAcls = "acls";
 constexpr auto kDefaultVlan = "defaultVlan";
 }
 
@@ -34,30 +41,62 @@ namespace facebook { namespace fboss {
 
 SwitchStateFields::SwitchStateFields()
   : ports(make_shared<PortMap>()),
+    aggregatePorts(make_shared<AggregatePortMap>()),
     vlans(make_shared<VlanMap>()),
     interfaces(make_shared<InterfaceMap>()),
-    routeTables(make_shared<RouteTableMap>()) {
+    routeTables(make_shared<RouteTableMap>()),
+    acls(make_shared<AclMap>()) {
 }
 
 folly::dynamic SwitchStateFields::toFollyDynamic() const {
   folly::dynamic switchState = folly::dynamic::object;
   switchState[kInterfaces] = interfaces->toFollyDynamic();
   switchState[kPorts] = ports->toFollyDynamic();
+  switchState[kAggregatePorts] = aggregatePorts->toFollyDynamic();
   switchState[kVlans] = vlans->toFollyDynamic();
   switchState[kRouteTables] = routeTables->toFollyDynamic();
+  switchState[kAcls] = acls->toFollyDynamic();
   switchState[kDefaultVlan] = static_cast<uint32_t>(defaultVlan);
   return switchState;
 }
 
+void SwitchStateFields::writeJson(JsonStreamWriter* writer) const {
+  writer->beginObject();
+  writer->key(kInterfaces);
+  interfaces->writeJson(writer);
+  writer->key(kPorts);
+  ports->writeJson(writer);
+  writer->key(kAggregatePorts);
+  aggregatePorts->writeJson(writer);
+  writer->key(kVlans);
+  vlans->writeJson(writer);
+  writer->key(kRouteTables);
+  routeTables->writeJson(writer);
+  writer->key(kAcls);
+  acls->writeJson(writer);
+  writer->key(kDefaultVlan);
+  writer->value(static_cast<uint32_t>(defaultVlan));
+  writer->endObject();
+}
+
 SwitchStateFields
 SwitchStateFields::fromFollyDynamic(const folly::dynamic& swJson) {
   SwitchStateFields switchState;
   switchState.interfaces = InterfaceMap::fromFollyDynamic(
         swJson[kInterfaces]);
   switchState.ports = PortMap::fromFollyDynamic(swJson[kPorts]);
+  // States saved before LAG support have no aggregate ports
+  if (swJson.count(kAggregatePorts)) {
+    switchState.aggregatePorts = AggregatePortMap::fromFollyDynamic(
+        swJson[kAggregatePorts]);
+  }
   switchState.vlans = VlanMap::fromFollyDynamic(swJson[kVlans]);
   switchState.routeTables = RouteTableMap::fromFollyDynamic(
       swJson[kRouteTables]);
+  // States saved before ACL support have no ACL entries
+  if (swJson.count(kAcls)) {
+    switchState.acls = AclMap::fromFollyDynamic(swJson[kAcls]);
+  }
   switchState.defaultVlan = VlanID(swJson[kDefaultVlan].asInt());
   //TODO verify that created state here is internally consistent t4155406
   return switchState;
@@ -69,6 +108,13 @@ SwitchState::SwitchState() {
 SwitchState::~SwitchState() {
 }
 
+shared_ptr<SwitchState>
+SwitchState::fromFollyDynamic(const folly::dynamic& json) {
+  auto state = make_shared<SwitchState>();
+  *state->writableFields() = SwitchStateFields::fromFollyDynamic(json);
+  return state;
+}
+
 void SwitchState::modify(std::shared_ptr<SwitchState>* state) {
   if (!(*state)->isPublished()) {
     return;
@@ -88,6 +134,11 @@ void SwitchState::resetPorts(std::shared_ptr<PortMap> ports) {
   writableFields()->ports.swap(ports);
 }
 
+void SwitchState::resetAggregatePorts(
+    std::shared_ptr<AggregatePortMap> aggPorts) {
+  writableFields()->aggregatePorts.swap(aggPorts);
+}
+
 void SwitchState::resetVlans(std::shared_ptr<VlanMap> vlans) {
   writableFields()->vlans.swap(vlans);
 }
@@ -114,6 +165,34 @@ void SwitchState::setArpAgerInterval(std::chrono::seconds interval) {
   writableFields()->arpAgerInterval = interval;
 }
 
+void SwitchState::setICMPErrorLimits(const ICMPErrorLimits& limits) {
+  writableFields()->icmpErrorLimits = limits;
+}
+
+void SwitchState::setCpuRxConfig(const CpuRxConfig& config) {
+  writableFields()->cpuRxConfig = config;
+}
+
+void SwitchState::setEcmpHashConfig(const EcmpHashConfig& config) {
+  writableFields()->ecmpHashConfig = config;
+}
+
+void SwitchState::setSflowConfig(const SflowConfig& config) {
+  writableFields()->sFlowConfig = config;
+}
+
+void SwitchState::setBfdSessions(std::vector<BfdSessionConfig> sessions) {
+  writableFields()->bfdSessions.swap(sessions);
+}
+
+void SwitchState::setRouteCounters(std::vector<RouteCounterConfig> counters) {
+  writableFields()->routeCounters.swap(counters);
+}
+
+void SwitchState::setNeighborSuppression(bool enabled) {
+  writableFields()->neighborSuppression = enabled;
+}
+
 void SwitchState::addIntf(const std::shared_ptr<Interface>& intf) {
   auto* fields = writableFields();
   // For ease-of-use, automatically clone the InterfaceMap if we are still
@@ -136,6 +215,10 @@ void SwitchState::resetRouteTables(std::shared_ptr<RouteTableMap> rts) {
   writableFields()->routeTables.swap(rts);
 }
 
+void SwitchState::resetAcls(std::shared_ptr<AclMap> acls) {
+  writableFields()->acls.swap(acls);
+}
+
 template class NodeBaseT<SwitchState, SwitchStateFields>;
 
 }} // facebook::fboss
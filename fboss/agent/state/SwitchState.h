@@ -10,43 +10,228 @@
 #pragma once
 
 #include "fboss/agent/types.h"
+#include "fboss/agent/gen-cpp/switch_config_types.h"
 #include "fboss/agent/state/NodeBase.h"
 #include <chrono>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
+class AclMap;
+class AggregatePortMap;
 class Port;
 class PortMap;
 class Vlan;
 class VlanMap;
 class Interface;
 class InterfaceMap;
+class JsonStreamWriter;
 class RouteTable;
 class RouteTableMap;
 
+/*
+ * Rate limits for the ICMP errors, such as TTL exceeded, that we generate
+ * for trapped packets.  Rates are in packets per second, and a rate of 0
+ * disables that limit.
+ */
+struct ICMPErrorLimits {
+  // Errors sent to any one source address
+  uint32_t sourceRate{10};
+  uint32_t sourceBurst{10};
+  // Errors sent from any one VLAN interface
+  uint32_t intfRate{100};
+  uint32_t intfBurst{100};
+};
+
+inline bool operator==(const ICMPErrorLimits& lhs,
+                       const ICMPErrorLimits& rhs) {
+  return lhs.sourceRate == rhs.sourceRate &&
+    lhs.sourceBurst == rhs.sourceBurst &&
+    lhs.intfRate == rhs.intfRate &&
+    lhs.intfBurst == rhs.intfBurst;
+}
+
+inline bool operator!=(const ICMPErrorLimits& lhs,
+                       const ICMPErrorLimits& rhs) {
+  return !operator==(lhs, rhs);
+}
+
+/*
+ * How the hardware queues and rate limits the packets it sends to the CPU.
+ * Rates are in packets per second, and a rate of 0 means unlimited.
+ */
+struct CpuRxConfig {
+  struct QueueLimit {
+    uint32_t rate{0};
+    uint32_t burst{0};
+  };
+  typedef std::pair<cfg::PacketRxReason, uint16_t> ReasonToQueue;
+
+  // The limits of the CPU queues that have any, by queue ID
+  std::map<uint16_t, QueueLimit> queueLimits;
+  // The queue of each reason, in the order they are matched
+  std::vector<ReasonToQueue> reasonToQueue;
+  // The receive pool and overall rate are only applied at startup.
+  // 0 keeps the hardware default.
+  uint32_t poolSize{0};
+  uint32_t rate{0};
+};
+
+inline bool operator==(const CpuRxConfig::QueueLimit& lhs,
+                       const CpuRxConfig::QueueLimit& rhs) {
+  return lhs.rate == rhs.rate && lhs.burst == rhs.burst;
+}
+
+inline bool operator==(const CpuRxConfig& lhs, const CpuRxConfig& rhs) {
+  return lhs.queueLimits == rhs.queueLimits &&
+    lhs.reasonToQueue == rhs.reasonToQueue &&
+    lhs.poolSize == rhs.poolSize &&
+    lhs.rate == rhs.rate;
+}
+
+inline bool operator!=(const CpuRxConfig& lhs, const CpuRxConfig& rhs) {
+  return !operator==(lhs, rhs);
+}
+
+/*
+ * How the hardware hashes packets to pick one of the paths of an ECMP
+ * route.  The defaults match those of cfg::EcmpHash.
+ */
+struct EcmpHashConfig {
+  typedef std::set<cfg::EcmpHashField> Fields;
+
+  Fields ipv4Fields{cfg::EcmpHashField::SRC_IP, cfg::EcmpHashField::DST_IP,
+                    cfg::EcmpHashField::SRC_L4_PORT,
+                    cfg::EcmpHashField::DST_L4_PORT};
+  Fields ipv6Fields{cfg::EcmpHashField::SRC_IP, cfg::EcmpHashField::DST_IP,
+                    cfg::EcmpHashField::SRC_L4_PORT,
+                    cfg::EcmpHashField::DST_L4_PORT};
+  cfg::EcmpHashAlgorithm algorithm{cfg::EcmpHashAlgorithm::CRC16_CCITT};
+  uint32_t seedRotation{0};
+};
+
+inline bool operator==(const EcmpHashConfig& lhs, const EcmpHashConfig& rhs) {
+  return lhs.ipv4Fields == rhs.ipv4Fields &&
+    lhs.ipv6Fields == rhs.ipv6Fields &&
+    lhs.algorithm == rhs.algorithm &&
+    lhs.seedRotation == rhs.seedRotation;
+}
+
+inline bool operator!=(const EcmpHashConfig& lhs, const EcmpHashConfig& rhs) {
+  return !operator==(lhs, rhs);
+}
+
+/*
+ * Where the agent exports the packets the hardware samples for sFlow.
+ */
+struct SflowConfig {
+  enum : uint32_t { kMaxHeaderSize = 256 };
+  typedef std::pair<folly::IPAddress, uint16_t> Collector;
+
+  std::vector<Collector> collectors;
+  // The address the sFlow datagrams identify the switch by
+  folly::IPAddress agentIp{"0.0.0.0"};
+  // The most bytes of each sampled packet exported
+  uint32_t headerSize{128};
+};
+
+inline bool operator==(const SflowConfig& lhs, const SflowConfig& rhs) {
+  return lhs.collectors == rhs.collectors &&
+    lhs.agentIp == rhs.agentIp &&
+    lhs.headerSize == rhs.headerSize;
+}
+
+inline bool operator!=(const SflowConfig& lhs, const SflowConfig& rhs) {
+  return !operator==(lhs, rhs);
+}
+
+/*
+ * A BFD session with a neighbor.
+ */
+struct BfdSessionConfig {
+  folly::IPAddress peer;
+  RouterID router{0};
+  std::chrono::milliseconds minTxInterval{100};
+  std::chrono::milliseconds minRxInterval{100};
+  uint8_t multiplier{3};
+};
+
+inline bool operator==(const BfdSessionConfig& lhs,
+                       const BfdSessionConfig& rhs) {
+  return lhs.peer == rhs.peer &&
+    lhs.router == rhs.router &&
+    lhs.minTxInterval == rhs.minTxInterval &&
+    lhs.minRxInterval == rhs.minRxInterval &&
+    lhs.multiplier == rhs.multiplier;
+}
+
+inline bool operator!=(const BfdSessionConfig& lhs,
+                       const BfdSessionConfig& rhs) {
+  return !operator==(lhs, rhs);
+}
+
+/*
+ * A class of routes counted in hardware, and its policy for the packets
+ * punted while their next hops are unresolved.  See cfg::RouteCounter.
+ */
+struct RouteCounterConfig {
+  std::string name;
+  RouterID router{0};
+  std::vector<folly::CIDRNetwork> prefixes;
+  uint32_t unresolvedPuntRate{0};
+  uint32_t unresolvedDropAfter{0};
+  uint32_t unresolvedDropSeconds{0};
+};
+
+inline bool operator==(const RouteCounterConfig& lhs,
+                       const RouteCounterConfig& rhs) {
+  return lhs.name == rhs.name &&
+    lhs.router == rhs.router &&
+    lhs.prefixes == rhs.prefixes &&
+    lhs.unresolvedPuntRate == rhs.unresolvedPuntRate &&
+    lhs.unresolvedDropAfter == rhs.unresolvedDropAfter &&
+    lhs.unresolvedDropSeconds == rhs.unresolvedDropSeconds;
+}
+
+inline bool operator!=(const RouteCounterConfig& lhs,
+                       const RouteCounterConfig& rhs) {
+  return !operator==(lhs, rhs);
+}
+
 struct SwitchStateFields {
   SwitchStateFields();
 
   template<typename Fn>
   void forEachChild(Fn fn) {
     fn(ports.get());
+    fn(aggregatePorts.get());
     fn(vlans.get());
     fn(interfaces.get());
     fn(routeTables.get());
+    fn(acls.get());
   }
   /*
    * Serialize to folly::dynamic
    */
   folly::dynamic toFollyDynamic() const;
+  /*
+   * Write the same JSON as toFollyDynamic(), without building it in memory
+   */
+  void writeJson(JsonStreamWriter* writer) const;
   /*
    * Reconstruct object from folly::dynamic
    */
   static SwitchStateFields fromFollyDynamic(const folly::dynamic& json);
   // Static state, which can be accessed without locking.
   std::shared_ptr<PortMap> ports;
+  std::shared_ptr<AggregatePortMap> aggregatePorts;
   std::shared_ptr<VlanMap> vlans;
   std::shared_ptr<InterfaceMap> interfaces;
   std::shared_ptr<RouteTableMap> routeTables;
+  std::shared_ptr<AclMap> acls;
   VlanID defaultVlan{0};
 
   // Timeout settings
@@ -54,6 +239,15 @@ struct SwitchStateFields {
   // in an accessible way
   std::chrono::seconds arpTimeout{60};
   std::chrono::seconds arpAgerInterval{5};
+
+  ICMPErrorLimits icmpErrorLimits;
+  CpuRxConfig cpuRxConfig;
+  EcmpHashConfig ecmpHashConfig;
+  SflowConfig sFlowConfig;
+  std::vector<BfdSessionConfig> bfdSessions;
+  std::vector<RouteCounterConfig> routeCounters;
+  // Whether the agent answers the flooded neighbor requests for known hosts
+  bool neighborSuppression{false};
 };
 
 /*
@@ -98,11 +292,31 @@ class SwitchState : public NodeBaseT<SwitchState, SwitchStateFields> {
 
   static void modify(std::shared_ptr<SwitchState>* state);
 
+  /*
+   * Reconstruct a SwitchState from the output of toFollyDynamic()
+   */
+  static std::shared_ptr<SwitchState>
+  fromFollyDynamic(const folly::dynamic& json);
+
+  /*
+   * Write the state as JSON, in the same format as toFollyDynamic().  Only
+   * one node of a large table is converted to folly::dynamic at a time, so
+   * this is preferred for dumping big states.  It only reads the state, so
+   * it may run on any thread once the state is published.
+   */
+  void writeJson(JsonStreamWriter* writer) const {
+    getFields()->writeJson(writer);
+  }
+
   const std::shared_ptr<PortMap>& getPorts() const {
     return getFields()->ports;
   }
   std::shared_ptr<Port> getPort(PortID id) const;
 
+  const std::shared_ptr<AggregatePortMap>& getAggregatePorts() const {
+    return getFields()->aggregatePorts;
+  }
+
   const std::shared_ptr<VlanMap>& getVlans() const {
     return getFields()->vlans;
   }
@@ -118,6 +332,9 @@ class SwitchState : public NodeBaseT<SwitchState, SwitchStateFields> {
   const std::shared_ptr<RouteTableMap>& getRouteTables() const {
     return getFields()->routeTables;
   }
+  const std::shared_ptr<AclMap>& getAcls() const {
+    return getFields()->acls;
+  }
 
   std::chrono::seconds getArpTimeout() const {
     return getFields()->arpTimeout;
@@ -131,6 +348,46 @@ class SwitchState : public NodeBaseT<SwitchState, SwitchStateFields> {
 
   void setArpAgerInterval(std::chrono::seconds interval);
 
+  const ICMPErrorLimits& getICMPErrorLimits() const {
+    return getFields()->icmpErrorLimits;
+  }
+
+  void setICMPErrorLimits(const ICMPErrorLimits& limits);
+
+  const CpuRxConfig& getCpuRxConfig() const {
+    return getFields()->cpuRxConfig;
+  }
+
+  void setCpuRxConfig(const CpuRxConfig& config);
+
+  const EcmpHashConfig& getEcmpHashConfig() const {
+    return getFields()->ecmpHashConfig;
+  }
+
+  void setEcmpHashConfig(const EcmpHashConfig& config);
+
+  const SflowConfig& getSflowConfig() const {
+    return getFields()->sFlowConfig;
+  }
+
+  void setSflowConfig(const SflowConfig& config);
+
+  const std::vector<BfdSessionConfig>& getBfdSessions() const {
+    return getFields()->bfdSessions;
+  }
+
+  void setBfdSessions(std::vector<BfdSessionConfig> sessions);
+
+  const std::vector<RouteCounterConfig>& getRouteCounters() const {
+    return getFields()->routeCounters;
+  }
+  void setRouteCounters(std::vector<RouteCounterConfig> counters);
+
+  bool getNeighborSuppression() const {
+    return getFields()->neighborSuppression;
+  }
+  void setNeighborSuppression(bool enabled);
+
   /*
    * The following functions modify the static state.
    * The should only be called on newly created SwitchState objects that are
@@ -140,12 +397,14 @@ class SwitchState : public NodeBaseT<SwitchState, SwitchStateFields> {
 
   void registerPort(PortID id, const std::string& name);
   void resetPorts(std::shared_ptr<PortMap> ports);
+  void resetAggregatePorts(std::shared_ptr<AggregatePortMap> aggPorts);
   void resetVlans(std::shared_ptr<VlanMap> vlans);
   void addVlan(const std::shared_ptr<Vlan>& vlan);
   void addIntf(const std::shared_ptr<Interface>& intf);
   void resetIntfs(std::shared_ptr<InterfaceMap> intfs);
   void addRouteTable(const std::shared_ptr<RouteTable>& rt);
   void resetRouteTables(std::shared_ptr<RouteTableMap> rts);
+  void resetAcls(std::shared_ptr<AclMap> acls);
 
  private:
   // Inherit the constructor required for clone()
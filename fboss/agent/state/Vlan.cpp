@@ -13,6 +13,7 @@
 #include "fboss/agent/gen-cpp/switch_config_types.h"
 #include "fboss/agent/state/ArpResponseTable.h"
 #include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/MacTable.h"
 #include "fboss/agent/state/NdpResponseTable.h"
 #include "fboss/agent/state/NdpTable.h"
 #include "fboss/agent/state/SwitchState.h"
@@ -40,12 +41,14 @@ constexpr auto kDhcpV4Relay = "dhcpV4Relay";
 constexpr auto kDhcpV4RelayOverrides = "dhcpRelayOverridesV4";
 constexpr auto kDhcpV6Relay = "dhcpV6Relay";
 constexpr auto kDhcpV6RelayOverrides = "dhcpRelayOverridesV6";
+constexpr auto kDhcpV6ExtraRelays = "dhcpV6ExtraRelays";
 constexpr auto kMemberPorts = "memberPorts";
 constexpr auto kTagged = "tagged";
 constexpr auto kArpTable = "arpTable";
 constexpr auto kArpResponseTable = "arpResponseTable";
 constexpr auto kNdpTable = "ndpTable";
 constexpr auto kNdpResponseTable = "ndpResponseTable";
+constexpr auto kMacTable = "macTable";
 }
 
 namespace facebook { namespace fboss {
@@ -67,7 +70,8 @@ VlanFields::VlanFields(VlanID _id, string _name)
     arpTable(new ArpTable),
     arpResponseTable(new ArpResponseTable),
     ndpTable(new NdpTable),
-    ndpResponseTable(new NdpResponseTable) {
+    ndpResponseTable(new NdpResponseTable),
+    macTable(new MacTable) {
 }
 
 VlanFields::VlanFields(VlanID _id,
@@ -85,7 +89,20 @@ VlanFields::VlanFields(VlanID _id,
     arpTable(new ArpTable),
     arpResponseTable(new ArpResponseTable),
     ndpTable(new NdpTable),
-    ndpResponseTable(new NdpResponseTable) {
+    ndpResponseTable(new NdpResponseTable),
+    macTable(new MacTable) {
+  updatePortBitmaps();
+}
+
+void VlanFields::updatePortBitmaps() {
+  portBitmap.clear();
+  untaggedPortBitmap.clear();
+  for (const auto& port : ports) {
+    portBitmap.set(port.first);
+    if (!port.second.tagged) {
+      untaggedPortBitmap.set(port.first);
+    }
+  }
 }
 
 folly::dynamic VlanFields::toFollyDynamic() const {
@@ -103,6 +120,11 @@ folly::dynamic VlanFields::toFollyDynamic() const {
   for (const auto& o: dhcpRelayOverridesV6) {
     vlan[kDhcpV6RelayOverrides][o.first.toString()] = o.second.str();
   }
+  std::vector<folly::dynamic> extraRelays;
+  for (const auto& relay : dhcpV6ExtraRelays) {
+    extraRelays.push_back(relay.str());
+  }
+  vlan[kDhcpV6ExtraRelays] = std::move(extraRelays);
   folly::dynamic memberPorts = folly::dynamic::object;
   for (const auto& port: ports) {
     folly::dynamic portInfo = folly::dynamic::object;
@@ -114,6 +136,7 @@ folly::dynamic VlanFields::toFollyDynamic() const {
   vlan[kNdpTable] = ndpTable->toFollyDynamic();
   vlan[kArpResponseTable] = arpResponseTable->toFollyDynamic();
   vlan[kNdpResponseTable] = ndpResponseTable->toFollyDynamic();
+  vlan[kMacTable] = macTable->toFollyDynamic();
   return vlan;
 }
 
@@ -133,16 +156,27 @@ VlanFields VlanFields::fromFollyDynamic(const folly::dynamic& vlanJson) {
     vlan.dhcpRelayOverridesV6[MacAddress(o.first.asString().toStdString())] =
         folly::IPAddressV6(o.second.stringPiece());
   }
+  // Older versions only had the one DHCPv6 relay
+  if (vlanJson.count(kDhcpV6ExtraRelays)) {
+    for (const auto& relay : vlanJson[kDhcpV6ExtraRelays]) {
+      vlan.dhcpV6ExtraRelays.emplace_back(relay.stringPiece());
+    }
+  }
   for (const auto& portInfo: vlanJson[kMemberPorts].items()) {
     vlan.ports.emplace(PortID(to<uint16_t>(portInfo.first.asString())),
           PortInfo::fromFollyDynamic(portInfo.second));
   }
+  vlan.updatePortBitmaps();
   vlan.arpTable = ArpTable::fromFollyDynamic(vlanJson[kArpTable]);
   vlan.ndpTable = NdpTable::fromFollyDynamic(vlanJson[kNdpTable]);
   vlan.arpResponseTable = ArpResponseTable::fromFollyDynamic(
       vlanJson[kArpResponseTable]);
   vlan.ndpResponseTable = NdpResponseTable::fromFollyDynamic(
       vlanJson[kNdpResponseTable]);
+  // Older versions did not save the MAC table
+  if (vlanJson.count(kMacTable)) {
+    vlan.macTable = MacTable::fromFollyDynamic(vlanJson[kMacTable]);
+  }
   return vlan;
 }
 
@@ -187,7 +221,13 @@ Vlan* Vlan::modify(std::shared_ptr<SwitchState>* state) {
 }
 
 void Vlan::addPort(PortID id, bool tagged) {
-  writableFields()->ports.insert(make_pair(id, PortID(tagged)));
+  auto* fields = writableFields();
+  if (fields->ports.insert(make_pair(id, PortInfo(tagged))).second) {
+    fields->portBitmap.set(id);
+    if (!tagged) {
+      fields->untaggedPortBitmap.set(id);
+    }
+  }
 }
 
 template class NodeBaseT<Vlan, VlanFields>;
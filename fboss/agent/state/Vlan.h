@@ -14,16 +14,19 @@
 #include <folly/MacAddress.h>
 #include "fboss/agent/types.h"
 #include "fboss/agent/state/NodeBase.h"
+#include "fboss/agent/state/PortBitmap.h"
 
 #include <boost/container/flat_map.hpp>
 #include <set>
 #include <string>
 #include <map>
+#include <vector>
 
 namespace facebook { namespace fboss {
 
 class ArpResponseTable;
 class ArpTable;
+class MacTable;
 class NdpResponseTable;
 class NdpTable;
 class SwitchState;
@@ -36,6 +39,7 @@ typedef boost::container::flat_map<folly::MacAddress, folly::IPAddressV4>
     DhcpV4OverrideMap;
 typedef boost::container::flat_map<folly::MacAddress, folly::IPAddressV6>
     DhcpV6OverrideMap;
+typedef std::vector<folly::IPAddressV6> DhcpV6RelayList;
 
 struct VlanFields {
   struct PortInfo {
@@ -66,11 +70,17 @@ struct VlanFields {
     fn(arpResponseTable.get());
     fn(ndpTable.get());
     fn(ndpResponseTable.get());
+    fn(macTable.get());
   }
 
   folly::dynamic toFollyDynamic() const;
   static VlanFields fromFollyDynamic(const folly::dynamic& vlanJson);
 
+  /*
+   * Rebuild the bitmaps from the ports, after they change.
+   */
+  void updatePortBitmaps();
+
   const VlanID id{0};
   std::string name;
   uint32_t mtu{1500};
@@ -78,6 +88,8 @@ struct VlanFields {
   folly::IPAddressV6 dhcpV6Relay;
   DhcpV4OverrideMap dhcpRelayOverridesV4;
   DhcpV6OverrideMap dhcpRelayOverridesV6;
+  // DHCPv6 servers to relay to as well as dhcpV6Relay
+  DhcpV6RelayList dhcpV6ExtraRelays;
   // The list of ports in the VLAN.
   // We only store PortIDs, and not pointers to the actual Port objects.
   // This way VLAN objects don't need to change when a Port object is modified.
@@ -87,10 +99,15 @@ struct VlanFields {
   // have to modify the Vlan object.  By storing only the PortID the Vlan does
   // not need to be modified.)
   MemberPorts ports;
+  // All of the ports, and the untagged ones, as bitmaps.  These are derived
+  // from ports and are not serialized.
+  PortBitmap portBitmap;
+  PortBitmap untaggedPortBitmap;
   std::shared_ptr<ArpTable> arpTable;
   std::shared_ptr<ArpResponseTable> arpResponseTable;
   std::shared_ptr<NdpTable> ndpTable;
   std::shared_ptr<NdpResponseTable> ndpResponseTable;
+  std::shared_ptr<MacTable> macTable;
 };
 
 class Vlan : public NodeBaseT<Vlan, VlanFields> {
@@ -125,6 +142,18 @@ class Vlan : public NodeBaseT<Vlan, VlanFields> {
   }
   void setPorts(MemberPorts ports) {
     writableFields()->ports.swap(ports);
+    writableFields()->updatePortBitmaps();
+  }
+
+  /*
+   * The member ports, and the untagged ones, as bitmaps.  Comparing these
+   * is much cheaper than comparing the port maps of large VLANs.
+   */
+  const PortBitmap& getPortBitmap() const {
+    return getFields()->portBitmap;
+  }
+  const PortBitmap& getUntaggedPortBitmap() const {
+    return getFields()->untaggedPortBitmap;
   }
 
   Vlan* modify(std::shared_ptr<SwitchState>* state);
@@ -158,6 +187,12 @@ class Vlan : public NodeBaseT<Vlan, VlanFields> {
     return writableFields()->ndpTable.swap(table);
   }
 
+  /*
+   * The ArpTable or NdpTable, for code that handles both of them.
+   */
+  template<typename NTable>
+  std::shared_ptr<NTable> getNeighborTable() const;
+
   const std::shared_ptr<NdpResponseTable> getNdpResponseTable() const {
     return getFields()->ndpResponseTable;
   }
@@ -165,6 +200,16 @@ class Vlan : public NodeBaseT<Vlan, VlanFields> {
     writableFields()->ndpResponseTable.swap(table);
   }
 
+  /*
+   * The MAC addresses the HW learned on the VLAN.
+   */
+  const std::shared_ptr<MacTable> getMacTable() const {
+    return getFields()->macTable;
+  }
+  void setMacTable(std::shared_ptr<MacTable> table) {
+    writableFields()->macTable.swap(table);
+  }
+
   // dhcp relay
 
   folly::IPAddressV4 getDhcpV4Relay() const {
@@ -181,6 +226,13 @@ class Vlan : public NodeBaseT<Vlan, VlanFields> {
      writableFields()->dhcpV6Relay = v6Relay;
   }
 
+  const DhcpV6RelayList& getDhcpV6ExtraRelays() const {
+    return getFields()->dhcpV6ExtraRelays;
+  }
+  void setDhcpV6ExtraRelays(DhcpV6RelayList relays) {
+    writableFields()->dhcpV6ExtraRelays = std::move(relays);
+  }
+
   // dhcp overrides
 
   DhcpV4OverrideMap getDhcpV4RelayOverrides() const {
@@ -203,4 +255,14 @@ class Vlan : public NodeBaseT<Vlan, VlanFields> {
   friend class CloneAllocator;
 };
 
+template<>
+inline std::shared_ptr<ArpTable> Vlan::getNeighborTable() const {
+  return getArpTable();
+}
+
+template<>
+inline std::shared_ptr<NdpTable> Vlan::getNeighborTable() const {
+  return getNdpTable();
+}
+
 }} // facebook::fboss
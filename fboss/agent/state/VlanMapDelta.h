@@ -30,14 +30,35 @@ class VlanDelta : public DeltaValue<Vlan> {
 
   using DeltaValue<Vlan>::DeltaValue;
 
+  void reset(const std::shared_ptr<Vlan>& o, const std::shared_ptr<Vlan>& n) {
+    DeltaValue<Vlan>::reset(o, n);
+    arpChanges_.reset();
+    ndpChanges_.reset();
+  }
+
   ArpTableDelta getArpDelta() const {
     return ArpTableDelta(getOld() ? getOld()->getArpTable().get() : nullptr,
-                         getNew() ? getNew()->getArpTable().get() : nullptr);
+                         getNew() ? getNew()->getArpTable().get() : nullptr,
+                         arpChanges_);
   }
   NdpTableDelta getNdpDelta() const {
     return NdpTableDelta(getOld() ? getOld()->getNdpTable().get() : nullptr,
-                         getNew() ? getNew()->getNdpTable().get() : nullptr);
+                         getNew() ? getNew()->getNdpTable().get() : nullptr,
+                         ndpChanges_);
   }
+
+  /*
+   * Collect the ARP and NDP changes, so that the deltas returned from now
+   * on walk them instead of comparing the tables again.
+   */
+  void collectChanges() {
+    arpChanges_ = getArpDelta().collectChanges();
+    ndpChanges_ = getNdpDelta().collectChanges();
+  }
+
+ private:
+  std::shared_ptr<const ArpTableDelta::Changes> arpChanges_;
+  std::shared_ptr<const NdpTableDelta::Changes> ndpChanges_;
 };
 
 typedef NodeMapDelta<VlanMap, VlanDelta> VlanMapDelta;
@@ -0,0 +1,271 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/test/TestUtils.h"
+#include "fboss/agent/hw/mock/MockPlatform.h"
+#include "fboss/agent/state/AclEntry.h"
+#include "fboss/agent/state/AclMap.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::MacAddress;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+
+cfg::AclEntry makeAcl(int32_t id, cfg::AclAction action, int32_t etherType,
+                      int32_t queue) {
+  cfg::AclEntry acl;
+  acl.id = id;
+  acl.action = action;
+  acl.etherType = etherType;
+  acl.cpuQueue = queue;
+  return acl;
+}
+
+cfg::ControlPlaneTrap makeTrap(cfg::ControlProtocol protocol, int32_t queue) {
+  cfg::ControlPlaneTrap trap;
+  trap.protocol = protocol;
+  trap.queueId = queue;
+  return trap;
+}
+
+}
+
+TEST(Acl, applyConfig) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.acls.push_back(makeAcl(10, cfg::AclAction::TRAP, 0x88b5, 2));
+  config.acls.push_back(makeAcl(20, cfg::AclAction::DROP, 0x88b6, 2));
+  config.acls.back().dstMac = "01:80:c2:00:00:0e";
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  auto acls = stateV1->getAcls();
+  EXPECT_EQ(2, acls->size());
+  auto acl10 = acls->getEntry(AclEntryID(10));
+  EXPECT_EQ(cfg::AclAction::TRAP, acl10->getAction());
+  EXPECT_EQ(0x88b5, acl10->getMatch().etherType);
+  EXPECT_FALSE(acl10->getMatch().dstMac);
+  EXPECT_EQ(2, acl10->getCpuQueue());
+  // Drops have no CPU queue
+  auto acl20 = acls->getEntry(AclEntryID(20));
+  EXPECT_EQ(MacAddress("01:80:c2:00:00:0e"), *acl20->getMatch().dstMac);
+  EXPECT_EQ(0, acl20->getCpuQueue());
+
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  // Only the changed entry is replaced
+  config.acls[0].cpuQueue = 3;
+  config.acls.push_back(makeAcl(5, cfg::AclAction::DROP, 0x88b7, 0));
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  StateDelta delta(stateV1, stateV2);
+  int added = 0;
+  int changed = 0;
+  for (const auto& entry : delta.getAclsDelta()) {
+    if (!entry.getOld()) {
+      EXPECT_EQ(AclEntryID(5), entry.getNew()->getID());
+      ++added;
+    } else {
+      EXPECT_EQ(AclEntryID(10), entry.getNew()->getID());
+      ++changed;
+    }
+  }
+  EXPECT_EQ(1, added);
+  EXPECT_EQ(1, changed);
+  EXPECT_EQ(acl20, stateV2->getAcls()->getEntry(AclEntryID(20)));
+
+  config.acls.clear();
+  auto stateV3 = publishAndApplyConfig(stateV2, &config, &platform);
+  ASSERT_NE(nullptr, stateV3);
+  EXPECT_EQ(0, stateV3->getAcls()->size());
+}
+
+TEST(Acl, invalidConfig) {
+  MockPlatform platform;
+  auto state = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.acls.push_back(makeAcl(1, cfg::AclAction::DROP, 0x88b5, 0));
+  config.acls.push_back(makeAcl(1, cfg::AclAction::DROP, 0x88b6, 0));
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+
+  // The ids of the control plane traps are reserved
+  config.acls.clear();
+  config.acls.push_back(makeAcl(100000, cfg::AclAction::DROP, 0x88b5, 0));
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+
+  // L4 ports are only matched for TCP and UDP
+  config.acls.clear();
+  config.acls.push_back(makeAcl(1, cfg::AclAction::DROP, 0, 0));
+  config.acls.back().l4DstPort = 179;
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+  config.acls.back().ipProtocol = 6;
+  EXPECT_NE(nullptr, publishAndApplyConfig(state, &config, &platform));
+
+  // A mask needs a MAC to mask
+  config.acls.clear();
+  config.acls.push_back(makeAcl(1, cfg::AclAction::DROP, 0, 0));
+  config.acls.back().dstMacMask = "ff:ff:ff:00:00:00";
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+
+  config.acls.clear();
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::BGP, 1));
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::BGP, 2));
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+}
+
+TEST(Acl, controlPlaneTraps) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::ARP, 9));
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::LLDP, 8));
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::BGP, 7));
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+
+  // Each protocol's entries use its queue
+  int arp = 0;
+  int lldp = 0;
+  int bgp = 0;
+  for (const auto& acl : *stateV1->getAcls()) {
+    EXPECT_LE(AclEntryID(100000), acl->getID());
+    const auto& match = acl->getMatch();
+    if (match.etherType == 0x0806) {
+      EXPECT_EQ(cfg::AclAction::TRAP, acl->getAction());
+      EXPECT_EQ(9, acl->getCpuQueue());
+      ++arp;
+    } else if (match.etherType == 0x88cc) {
+      EXPECT_EQ(cfg::AclAction::TRAP, acl->getAction());
+      EXPECT_EQ(8, acl->getCpuQueue());
+      ++lldp;
+    } else {
+      // Only the BGP sessions to the switch use the queue, the ones
+      // through it are not copied
+      EXPECT_EQ(6, match.ipProtocol);
+      EXPECT_TRUE(match.l4SrcPort == 179 || match.l4DstPort == 179);
+      EXPECT_EQ(cfg::AclAction::CPU_QUEUE, acl->getAction());
+      EXPECT_EQ(7, acl->getCpuQueue());
+      ++bgp;
+    }
+  }
+  EXPECT_EQ(1, arp);
+  EXPECT_EQ(1, lldp);
+  EXPECT_EQ(2, bgp);
+
+  // Moving a protocol to another queue only changes its own entries, and
+  // the configured entries take precedence over the traps
+  config.controlPlaneTraps[0].queueId = 5;
+  config.dropUnhandledControlFrames = true;
+  config.acls.push_back(makeAcl(1, cfg::AclAction::DROP, 0x0806, 0));
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  EXPECT_EQ(AclEntryID(1), (*stateV2->getAcls()->begin())->getID());
+  int changed = 0;
+  int drops = 0;
+  for (const auto& entry : StateDelta(stateV1, stateV2).getAclsDelta()) {
+    if (entry.getOld()) {
+      EXPECT_EQ(5, entry.getNew()->getCpuQueue());
+      ++changed;
+    } else if (entry.getNew()->getAction() == cfg::AclAction::DROP) {
+      ++drops;
+    }
+  }
+  EXPECT_EQ(1, changed);
+  // The configured drop and the unhandled control frames
+  EXPECT_EQ(5, drops);
+
+  // The CDP frames are dropped
+  bool cdp = false;
+  for (const auto& acl : *stateV2->getAcls()) {
+    const auto& dstMac = acl->getMatch().dstMac;
+    if (dstMac && *dstMac == MacAddress("01:00:0c:cc:cc:cc")) {
+      EXPECT_EQ(cfg::AclAction::DROP, acl->getAction());
+      cdp = true;
+    }
+  }
+  EXPECT_TRUE(cdp);
+}
+
+TEST(Acl, neighborSuppression) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::ARP, 9));
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::NDP, 8));
+  config.neighborSuppression = true;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  EXPECT_TRUE(stateV1->getNeighborSuppression());
+
+  // The flooded requests are punted, in the queues of their traps, which
+  // the punts win over
+  auto acls = stateV1->getAcls();
+  auto arp = *acls->begin();
+  EXPECT_EQ(cfg::AclAction::PUNT, arp->getAction());
+  EXPECT_EQ(0x0806, arp->getMatch().etherType);
+  EXPECT_EQ(MacAddress::BROADCAST, *arp->getMatch().dstMac);
+  EXPECT_EQ(9, arp->getCpuQueue());
+  auto ndp = *std::next(acls->begin());
+  EXPECT_EQ(cfg::AclAction::PUNT, ndp->getAction());
+  EXPECT_EQ(MacAddress("33:33:ff:00:00:00"), *ndp->getMatch().dstMac);
+  EXPECT_EQ(MacAddress("ff:ff:ff:00:00:00"), ndp->getMatch().dstMacMask);
+  EXPECT_EQ(58, ndp->getMatch().ipProtocol);
+  EXPECT_EQ(135, ndp->getMatch().icmpv6Type);
+  EXPECT_EQ(8, ndp->getCpuQueue());
+  for (const auto& acl : *acls) {
+    if (acl != arp && acl != ndp) {
+      EXPECT_EQ(cfg::AclAction::TRAP, acl->getAction());
+      EXPECT_LT(ndp->getID(), acl->getID());
+    }
+  }
+
+  // Turning it off removes only the punts
+  config.neighborSuppression = false;
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  EXPECT_FALSE(stateV2->getNeighborSuppression());
+  EXPECT_EQ(acls->size() - 2, stateV2->getAcls()->size());
+  for (const auto& entry : StateDelta(stateV1, stateV2).getAclsDelta()) {
+    EXPECT_FALSE(entry.getNew());
+  }
+}
+
+TEST(Acl, serialization) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::NDP, 3));
+  config.controlPlaneTraps.push_back(makeTrap(cfg::ControlProtocol::DHCP, 4));
+  config.dropUnhandledControlFrames = true;
+  config.neighborSuppression = true;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+
+  auto restored = SwitchState::fromFollyDynamic(stateV1->toFollyDynamic());
+  const auto& acls = stateV1->getAcls();
+  const auto& restoredAcls = restored->getAcls();
+  ASSERT_EQ(acls->size(), restoredAcls->size());
+  for (const auto& acl : *acls) {
+    auto restoredAcl = restoredAcls->getEntry(acl->getID());
+    EXPECT_TRUE(acl->isSame(*restoredAcl));
+  }
+}
@@ -0,0 +1,140 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/test/TestUtils.h"
+#include "fboss/agent/hw/mock/MockPlatform.h"
+#include "fboss/agent/state/AggregatePort.h"
+#include "fboss/agent/state/AggregatePortMap.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::make_shared;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+shared_ptr<SwitchState> makeState() {
+  auto state = make_shared<SwitchState>();
+  for (int i = 1; i <= 4; ++i) {
+    state->registerPort(PortID(i), folly::to<std::string>("port", i));
+  }
+  return state;
+}
+
+cfg::AggregatePort makeAggPort(int16_t key, vector<int32_t> members,
+                               bool lacp) {
+  cfg::AggregatePort aggPort;
+  aggPort.key = key;
+  aggPort.name = folly::to<std::string>("lag", key);
+  aggPort.memberPorts = std::move(members);
+  aggPort.lacp = lacp;
+  return aggPort;
+}
+
+}
+
+TEST(AggregatePort, applyConfig) {
+  MockPlatform platform;
+  auto stateV0 = makeState();
+
+  cfg::SwitchConfig config;
+  config.aggregatePorts.push_back(makeAggPort(10, {1, 2}, true));
+  config.aggregatePorts.push_back(makeAggPort(20, {3}, false));
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  auto aggPorts = stateV1->getAggregatePorts();
+  EXPECT_EQ(2, aggPorts->size());
+
+  // LACP members only forward once the partner agrees, static ones always
+  auto lag10 = aggPorts->getAggregatePort(AggregatePortID(10));
+  EXPECT_EQ("lag10", lag10->getName());
+  EXPECT_TRUE(lag10->isLacpEnabled());
+  EXPECT_TRUE(lag10->isMember(PortID(1)));
+  EXPECT_TRUE(lag10->isMember(PortID(2)));
+  EXPECT_FALSE(lag10->isMember(PortID(3)));
+  EXPECT_TRUE(lag10->getForwardingMembers().empty());
+  auto lag20 = aggPorts->getAggregatePort(AggregatePortID(20));
+  EXPECT_FALSE(lag20->isLacpEnabled());
+  EXPECT_EQ(vector<PortID>{PortID(3)}, lag20->getForwardingMembers());
+  EXPECT_EQ(lag20, aggPorts->getAggregatePortForMember(PortID(3)));
+  EXPECT_EQ(nullptr, aggPorts->getAggregatePortForMember(PortID(4)));
+
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  // LACP brings up a member, which a config change keeps
+  auto stateV2 = stateV1;
+  stateV2->getAggregatePorts()->getAggregatePort(AggregatePortID(10))
+    ->modify(&stateV2)->setForwarding(PortID(1), true);
+  EXPECT_NE(stateV1, stateV2);
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV2, &config, &platform));
+
+  config.aggregatePorts[0].memberPorts.push_back(4);
+  auto stateV3 = publishAndApplyConfig(stateV2, &config, &platform);
+  ASSERT_NE(nullptr, stateV3);
+  lag10 = stateV3->getAggregatePorts()->getAggregatePort(AggregatePortID(10));
+  EXPECT_TRUE(lag10->isForwarding(PortID(1)));
+  EXPECT_FALSE(lag10->isForwarding(PortID(2)));
+  EXPECT_FALSE(lag10->isForwarding(PortID(4)));
+  EXPECT_EQ(stateV2->getAggregatePorts()->getAggregatePort(
+                AggregatePortID(20)),
+            stateV3->getAggregatePorts()->getAggregatePort(
+                AggregatePortID(20)));
+
+  // Removing an aggregate port
+  config.aggregatePorts.pop_back();
+  auto stateV4 = publishAndApplyConfig(stateV3, &config, &platform);
+  ASSERT_NE(nullptr, stateV4);
+  EXPECT_EQ(1, stateV4->getAggregatePorts()->size());
+  EXPECT_EQ(nullptr, stateV4->getAggregatePorts()->getAggregatePortIf(
+                AggregatePortID(20)));
+}
+
+TEST(AggregatePort, invalidConfig) {
+  MockPlatform platform;
+  auto state = makeState();
+
+  cfg::SwitchConfig config;
+  config.aggregatePorts.push_back(makeAggPort(10, {1, 2}, true));
+  config.aggregatePorts.push_back(makeAggPort(20, {2, 3}, true));
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+
+  config.aggregatePorts.pop_back();
+  config.aggregatePorts.push_back(makeAggPort(20, {5}, true));
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+
+  config.aggregatePorts.back().memberPorts.clear();
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+
+  config.aggregatePorts.back() = makeAggPort(10, {3}, true);
+  EXPECT_THROW(publishAndApplyConfig(state, &config, &platform), FbossError);
+}
+
+TEST(AggregatePort, serialization) {
+  auto aggPort = make_shared<AggregatePort>(AggregatePortID(7), "lag7");
+  aggPort->setLacpEnabled(false);
+  AggregatePort::Members members;
+  members.emplace(PortID(1), true);
+  members.emplace(PortID(9), false);
+  aggPort->setMembers(members);
+
+  auto serialized = aggPort->toFollyDynamic();
+  auto aggPortBack = AggregatePort::fromFollyDynamic(serialized);
+  EXPECT_EQ(AggregatePortID(7), aggPortBack->getID());
+  EXPECT_EQ("lag7", aggPortBack->getName());
+  EXPECT_FALSE(aggPortBack->isLacpEnabled());
+  EXPECT_EQ(members, aggPortBack->getMembers());
+
+  EXPECT_THROW(aggPort->setForwarding(PortID(2), true), FbossError);
+}
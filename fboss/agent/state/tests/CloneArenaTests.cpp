@@ -0,0 +1,124 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/CloneArena.h"
+#include "fboss/agent/state/Port.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace facebook::fboss;
+using std::make_shared;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+shared_ptr<Port> publishedPort() {
+  auto port = make_shared<Port>(PortID(1), "port1");
+  port->publish();
+  return port;
+}
+
+}
+
+TEST(CloneArena, clone) {
+  auto port = publishedPort();
+  EXPECT_EQ(nullptr, CloneArena::current());
+
+  vector<shared_ptr<Port>> clones;
+  {
+    CloneArena arena;
+    {
+      CloneArena::Scope scope(&arena);
+      EXPECT_EQ(&arena, CloneArena::current());
+      for (int i = 0; i < 1000; ++i) {
+        auto clone = port->clone();
+        if (i % 100 == 0) {
+          clones.push_back(clone);
+        }
+      }
+    }
+    EXPECT_EQ(nullptr, CloneArena::current());
+    // Many nodes share each slab
+    EXPECT_GT(arena.getNumSlabs(), 0);
+    EXPECT_LT(arena.getNumSlabs(), 1000 / 10);
+  }
+
+  // The clones outlive the arena
+  for (const auto& clone : clones) {
+    EXPECT_EQ(PortID(1), clone->getID());
+    EXPECT_EQ("port1", clone->getName());
+    EXPECT_EQ(1, clone->getGeneration());
+    EXPECT_FALSE(clone->isPublished());
+  }
+}
+
+TEST(CloneArena, noScope) {
+  auto port = publishedPort();
+  CloneArena arena;
+  auto clone = port->clone();
+  EXPECT_EQ(0, arena.getNumSlabs());
+  EXPECT_EQ("port1", clone->getName());
+}
+
+TEST(CloneArena, nestedScopes) {
+  CloneArena outer;
+  CloneArena inner;
+  {
+    CloneArena::Scope outerScope(&outer);
+    {
+      CloneArena::Scope innerScope(&inner);
+      EXPECT_EQ(&inner, CloneArena::current());
+      {
+        // A null scope turns the arena off
+        CloneArena::Scope nullScope(nullptr);
+        EXPECT_EQ(nullptr, CloneArena::current());
+      }
+      EXPECT_EQ(&inner, CloneArena::current());
+    }
+    EXPECT_EQ(&outer, CloneArena::current());
+  }
+  EXPECT_EQ(nullptr, CloneArena::current());
+}
+
+TEST(CloneArena, largeAllocations) {
+  CloneArena arena;
+  void* small = arena.allocate(64);
+  EXPECT_EQ(1, arena.getNumSlabs());
+  // A large allocation gets a slab of its own, and does not use up the
+  // current one
+  void* large = arena.allocate(CloneArena::SLAB_SIZE);
+  EXPECT_EQ(2, arena.getNumSlabs());
+  memset(large, 0xff, CloneArena::SLAB_SIZE);
+  void* small2 = arena.allocate(64);
+  EXPECT_EQ(2, arena.getNumSlabs());
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(small2) % 16);
+
+  CloneArena::deallocate(large);
+  CloneArena::deallocate(small);
+  CloneArena::deallocate(small2);
+}
+
+TEST(CloneArena, freeOnOtherThread) {
+  auto port = publishedPort();
+  vector<shared_ptr<Port>> clones;
+  {
+    CloneArena arena;
+    CloneArena::Scope scope(&arena);
+    for (int i = 0; i < 1000; ++i) {
+      clones.push_back(port->clone());
+    }
+  }
+  std::thread([&] { clones.clear(); }).join();
+  EXPECT_TRUE(clones.empty());
+}
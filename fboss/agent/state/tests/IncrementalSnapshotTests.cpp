@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/IncrementalSnapshot.h"
+#include "fboss/agent/test/TestUtils.h"
+#include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteUpdater.h"
+#include "fboss/agent/state/StateSnapshot.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/experimental/TestUtil.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::ByteRange;
+using folly::IPAddress;
+using folly::StringPiece;
+using std::shared_ptr;
+
+namespace {
+
+folly::dynamic decode(const IncrementalSnapshot& snapshot) {
+  auto data = snapshot.toString();
+  EXPECT_EQ(snapshot.size(), data.size());
+  return StateSnapshot::decode(ByteRange(StringPiece(data)));
+}
+
+shared_ptr<SwitchState> setPortState(const shared_ptr<SwitchState>& state,
+                                     PortID id, cfg::PortState portState) {
+  auto newState = state->clone();
+  auto ports = state->getPorts()->clone();
+  auto port = ports->getPort(id)->clone();
+  port->setState(portState);
+  ports->updateNode(port);
+  newState->resetPorts(ports);
+  newState->publish();
+  return newState;
+}
+
+}
+
+TEST(IncrementalSnapshot, empty) {
+  IncrementalSnapshot snapshot;
+  auto state = std::make_shared<SwitchState>();
+  EXPECT_EQ(state->toFollyDynamic(), decode(snapshot));
+  snapshot.update(state);
+  EXPECT_EQ(0, snapshot.getNumEncoded());
+  EXPECT_EQ(state->toFollyDynamic(), decode(snapshot));
+}
+
+TEST(IncrementalSnapshot, changes) {
+  auto state = testStateA();
+  state->publish();
+  IncrementalSnapshot snapshot;
+  snapshot.update(state);
+  auto numNodes = snapshot.getNumEncoded();
+  EXPECT_GE(numNodes, 24);
+  EXPECT_EQ(state->toFollyDynamic(), decode(snapshot));
+
+  // Nothing is re-encoded if nothing changed
+  snapshot.update(state);
+  EXPECT_EQ(0, snapshot.getNumEncoded());
+  EXPECT_EQ(state->toFollyDynamic(), decode(snapshot));
+
+  // Only changed nodes are re-encoded
+  state = setPortState(state, PortID(3), cfg::PortState::DOWN);
+  snapshot.update(state);
+  EXPECT_EQ(1, snapshot.getNumEncoded());
+  EXPECT_EQ(state->toFollyDynamic(), decode(snapshot));
+
+  RouteNextHops nhops;
+  nhops.emplace(IPAddress("10.0.0.10"));
+  RouteUpdater updater(state->getRouteTables());
+  updater.addRoute(RouterID(0), IPAddress("20.0.0.0"), 16, nhops);
+  updater.addRoute(RouterID(0), IPAddress("2001::"), 48, nhops);
+  auto tables = updater.updateDone();
+  ASSERT_NE(nullptr, tables);
+  auto newState = state->clone();
+  newState->resetRouteTables(tables);
+  newState->publish();
+  state = newState;
+  snapshot.update(state);
+  EXPECT_GE(snapshot.getNumEncoded(), 2);
+  EXPECT_LT(snapshot.getNumEncoded(), numNodes);
+  EXPECT_EQ(state->toFollyDynamic(), decode(snapshot));
+
+  // Removed route tables are dropped
+  newState = state->clone();
+  newState->resetRouteTables(std::make_shared<RouteTableMap>());
+  newState->publish();
+  state = newState;
+  snapshot.update(state);
+  EXPECT_EQ(0, snapshot.getNumEncoded());
+  EXPECT_EQ(state->toFollyDynamic(), decode(snapshot));
+}
+
+TEST(IncrementalSnapshot, writeFile) {
+  folly::test::TemporaryDirectory tmpDir;
+  auto filename = tmpDir.path().string() + "/checkpoint";
+  auto state = testStateA();
+  state->publish();
+  IncrementalSnapshot snapshot;
+  snapshot.update(state);
+  snapshot.writeFile(filename);
+  EXPECT_EQ(state->toFollyDynamic(),
+            StateSnapshot::readFile(filename)->toFollyDynamic());
+
+  // Later checkpoints replace the file
+  state = setPortState(state, PortID(3), cfg::PortState::DOWN);
+  snapshot.update(state);
+  snapshot.writeFile(filename);
+  EXPECT_EQ(state->toFollyDynamic(),
+            StateSnapshot::readFile(filename)->toFollyDynamic());
+}
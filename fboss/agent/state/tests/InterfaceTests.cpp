@@ -15,10 +15,14 @@
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/NodeMapDelta.h"
+#include "fboss/agent/state/PortMap.h"
 #include "fboss/agent/state/StateDelta.h"
 #include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
 #include "fboss/agent/gen-cpp/switch_config_types.h"
 
+#include <folly/Conv.h>
 #include <gtest/gtest.h>
 
 using namespace facebook::fboss;
@@ -88,6 +92,57 @@ TEST(Interface, addrToReach) {
   EXPECT_EQ(0, ret.mask);
 }
 
+TEST(Interface, addrToReachIndex) {
+  auto intf = make_shared<Interface>(InterfaceID(1), RouterID(0), VlanID(1),
+                                     "intf1", MacAddress("00:02:00:11:22:33"));
+  Interface::Addresses addrs;
+  for (int i = 0; i < 32; ++i) {
+    addrs.emplace(IPAddress(folly::to<std::string>("10.", i, ".0.1")), 24);
+    addrs.emplace(IPAddress(folly::to<std::string>("2401:db00:", i, "::1")),
+                  64);
+  }
+  // Overlapping subnets of different lengths, and two addresses in one
+  // subnet
+  addrs.emplace(IPAddress("10.0.0.0"), 8);
+  addrs.emplace(IPAddress("10.5.0.2"), 24);
+  addrs.emplace(IPAddress("2401:db00::2"), 32);
+  intf->setAddresses(addrs);
+
+  std::vector<IPAddress> dests{
+    IPAddress("10.3.0.100"), IPAddress("10.5.0.3"), IPAddress("10.99.0.1"),
+    IPAddress("11.0.0.1"), IPAddress("2401:db00:7::5"),
+    IPAddress("2401:db00:ffff::1"), IPAddress("2401:db01::1"),
+    IPAddress("::ffff:10.3.0.100"),
+  };
+  // The index finds the same address as a search of every address
+  std::vector<Interface::Addresses::const_iterator> unindexed;
+  for (const auto& dest : dests) {
+    unindexed.push_back(intf->getAddressToReach(dest));
+  }
+  intf->publish();
+  for (size_t i = 0; i < dests.size(); ++i) {
+    EXPECT_EQ(unindexed[i], intf->getAddressToReach(dests[i])) << dests[i];
+  }
+  EXPECT_TRUE(intf->canReachAddress(IPAddress("10.31.0.7")));
+  EXPECT_FALSE(intf->canReachAddress(IPAddress("12.0.0.1")));
+  EXPECT_EQ(IPAddress("10.5.0.1"),
+            intf->getAddressToReach(IPAddress("10.5.0.3"))->first);
+
+  // The map finds interfaces by address the same way once published
+  auto intfs = make_shared<InterfaceMap>();
+  intfs->addInterface(intf);
+  EXPECT_EQ(intf, intfs->getInterfaceIf(RouterID(0), IPAddress("10.5.0.2")));
+  intfs->publish();
+  EXPECT_EQ(intf, intfs->getInterfaceIf(RouterID(0), IPAddress("10.5.0.2")));
+  EXPECT_EQ(intf, intfs->getInterface(RouterID(0), IPAddress("2401:db00::2")));
+  EXPECT_EQ(nullptr,
+            intfs->getInterfaceIf(RouterID(1), IPAddress("10.5.0.2")));
+  EXPECT_EQ(nullptr,
+            intfs->getInterfaceIf(RouterID(0), IPAddress("10.5.0.3")));
+  EXPECT_THROW(intfs->getInterface(RouterID(0), IPAddress("10.5.0.3")),
+               FbossError);
+}
+
 TEST(Interface, applyConfig) {
   MockPlatform platform;
   cfg::SwitchConfig config;
@@ -128,6 +183,7 @@ TEST(Interface, applyConfig) {
   EXPECT_EQ(MacAddress("00:02:00:11:22:33"), interface->getMac());
   EXPECT_EQ(Interface::Addresses{}, interface->getAddresses());
   EXPECT_EQ(0, interface->getNdpConfig().routerAdvertisementSeconds);
+  EXPECT_EQ(Interface::DEFAULT_MTU, interface->getMtu());
 
   // same configuration cause nothing changed
   EXPECT_EQ(nullptr, publishAndApplyConfig(state, &config, &platform));
@@ -258,6 +314,14 @@ TEST(Interface, applyConfig) {
   EXPECT_NE(oldInterface->getNdpConfig(), interface->getNdpConfig());
   EXPECT_EQ(0, interface->getNdpConfig().routerAdvertisementSeconds);
 
+  // Change the MTU
+  intfConfig->mtu = 9000;
+  updateState();
+  EXPECT_EQ(nodeID, interface->getNodeID());
+  EXPECT_EQ(oldInterface->getGeneration() + 1, interface->getGeneration());
+  EXPECT_EQ(oldInterface->getNdpConfig(), interface->getNdpConfig());
+  EXPECT_EQ(9000, interface->getMtu());
+
   // Changing the ID creates a new interface
   intfConfig->intfID = 2;
   id = InterfaceID(2);
@@ -391,3 +455,59 @@ TEST(InterfaceMap, applyConfig) {
 
   checkChangedIntfs(intfsV2, intfsV3, {}, {3}, {1});
 }
+
+TEST(Interface, applyConfigSkipsUnchangedSections) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+  stateV0->registerPort(PortID(1), "port1");
+  cfg::SwitchConfig config;
+  config.ports.resize(1);
+  config.ports[0].logicalID = 1;
+  config.ports[0].state = cfg::PortState::UP;
+  config.vlans.resize(1);
+  config.vlans[0].id = 1;
+  config.vlans[0].name = "vlan1";
+  config.vlanPorts.resize(1);
+  config.vlanPorts[0].vlanID = 1;
+  config.vlanPorts[0].logicalPort = 1;
+  config.interfaces.resize(1);
+  config.interfaces[0].intfID = 1;
+  config.interfaces[0].vlanID = 1;
+  config.interfaces[0].routerID = 0;
+  config.interfaces[0].mac = "00:02:00:11:22:33";
+  config.interfaces[0].__isset.mac = true;
+  config.interfaces[0].ipAddresses.push_back("10.1.1.1/24");
+
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  stateV1->publish();
+  EXPECT_EQ(nullptr, applyThriftConfig(stateV1, &config, &platform));
+
+  // Only the interface changes, so the ports are reused as they are
+  config.interfaces[0].ipAddresses.push_back("10.1.2.1/24");
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  EXPECT_EQ(stateV1->getPorts(), stateV2->getPorts());
+  auto intf = stateV2->getInterfaces()->getInterface(InterfaceID(1));
+  EXPECT_TRUE(intf->hasAddress(IPAddress("10.1.2.1")));
+  auto vlan = stateV2->getVlans()->getVlan(VlanID(1));
+  EXPECT_TRUE(vlan->getArpResponseTable()->getEntry(
+      IPAddress("10.1.2.1").asV4()).hasValue());
+  EXPECT_EQ(nullptr, applyThriftConfig(stateV2, &config, &platform));
+
+  // Applying the same config to an older state still updates it fully
+  auto stateV2b = applyThriftConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2b);
+  intf = stateV2b->getInterfaces()->getInterface(InterfaceID(1));
+  EXPECT_TRUE(intf->hasAddress(IPAddress("10.1.2.1")));
+
+  // even if only a VLAN field changed in between
+  config.vlans[0].name = "renamed";
+  auto stateV3 = publishAndApplyConfig(stateV2, &config, &platform);
+  ASSERT_NE(nullptr, stateV3);
+  EXPECT_EQ(stateV2->getInterfaces(), stateV3->getInterfaces());
+  EXPECT_EQ("renamed", stateV3->getVlans()->getVlan(VlanID(1))->getName());
+  auto stateV3b = applyThriftConfig(stateV2, &config, &platform);
+  ASSERT_NE(nullptr, stateV3b);
+  EXPECT_EQ("renamed", stateV3b->getVlans()->getVlan(VlanID(1))->getName());
+}
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/InternedSet.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteForwardInfo.h"
+#include "fboss/agent/state/RouteTypes.h"
+
+#include <folly/Memory.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using std::make_shared;
+
+namespace {
+
+RouteNextHops makeNextHops(std::vector<std::string> ips) {
+  RouteNextHops nhops;
+  for (const auto& ip : ips) {
+    nhops.emplace(ip);
+  }
+  return nhops;
+}
+
+// Every set hashes the same, to check sets that only share a hash
+struct CollidingHash {
+  size_t operator()(const RouteNextHops&) const {
+    return 0;
+  }
+};
+
+}
+
+TEST(InternedSet, sharedCopies) {
+  // The empty set is interned for good the first time it is used
+  InternedRouteNextHops empty;
+  EXPECT_TRUE(empty->empty());
+  EXPECT_EQ(empty, InternedRouteNextHops(RouteNextHops()));
+
+  auto numInterned = InternedRouteNextHops::numInterned();
+  {
+    InternedRouteNextHops a(makeNextHops({"10.0.0.1", "10.0.0.2"}));
+    InternedRouteNextHops b(makeNextHops({"10.0.0.2", "10.0.0.1"}));
+    InternedRouteNextHops c(makeNextHops({"10.0.0.1", "10.0.0.3"}));
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(&a.get(), &b.get());
+    EXPECT_EQ(a.hash(), b.hash());
+    EXPECT_NE(a, c);
+    EXPECT_EQ(2, a->size());
+    EXPECT_EQ(numInterned + 2, InternedRouteNextHops::numInterned());
+
+    // Copies and moves share the set too
+    auto d = a;
+    auto e = std::move(d);
+    EXPECT_EQ(a, e);
+    d = c;
+    EXPECT_EQ(c, d);
+  }
+  // The sets are removed once the last handle is gone
+  EXPECT_EQ(numInterned, InternedRouteNextHops::numInterned());
+}
+
+TEST(InternedSet, hashCollisions) {
+  typedef InternedSet<RouteNextHops, CollidingHash> Interned;
+  Interned a(makeNextHops({"10.0.0.1"}));
+  auto b = folly::make_unique<Interned>(makeNextHops({"10.0.0.2"}));
+  Interned c(makeNextHops({"10.0.0.3"}));
+  EXPECT_NE(a, *b);
+  EXPECT_NE(a, c);
+  EXPECT_EQ(a, Interned(makeNextHops({"10.0.0.1"})));
+  EXPECT_EQ(c, Interned(makeNextHops({"10.0.0.3"})));
+  EXPECT_EQ(3, Interned::numInterned());
+
+  b.reset();
+  EXPECT_EQ(2, Interned::numInterned());
+  EXPECT_EQ(a, Interned(makeNextHops({"10.0.0.1"})));
+  EXPECT_EQ(c, Interned(makeNextHops({"10.0.0.3"})));
+}
+
+TEST(InternedSet, threads) {
+  auto numInterned = InternedRouteNextHops::numInterned();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([] {
+      for (int i = 0; i < 1000; ++i) {
+        InternedRouteNextHops a(makeNextHops({"10.0.0.1", "10.0.0.2"}));
+        InternedRouteNextHops b(makeNextHops({"10.0.0.2", "10.0.0.1"}));
+        EXPECT_EQ(a, b);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(numInterned, InternedRouteNextHops::numInterned());
+}
+
+TEST(InternedSet, routes) {
+  RouteV4::Prefix prefix1{IPAddressV4("10.1.0.0"), 16};
+  RouteV4::Prefix prefix2{IPAddressV4("10.2.0.0"), 16};
+  auto nhops = makeNextHops({"1.1.1.1", "2.2.2.2"});
+  auto r1 = make_shared<RouteV4>(prefix1, nhops);
+  auto r2 = make_shared<RouteV4>(prefix2, nhops);
+  EXPECT_EQ(r1->getInternedNexthops(), r2->getInternedNexthops());
+  EXPECT_EQ(&r1->nexthops(), &r2->nexthops());
+  EXPECT_TRUE(r1->isSame(nhops));
+
+  // Client entries share the same sets as the routes
+  RouteNextHopEntry entry(nhops, 20);
+  EXPECT_EQ(r1->getInternedNexthops(), entry.nexthops);
+
+  RouteForwardNexthops fwdNhops;
+  fwdNhops.emplace(InterfaceID(1), IPAddress("1.1.1.1"));
+  fwdNhops.emplace(InterfaceID(2), IPAddress("2.2.2.2"));
+  r1->setResolved(fwdNhops);
+  r2->setResolved(fwdNhops);
+  EXPECT_EQ(r1->getForwardInfo(), r2->getForwardInfo());
+  EXPECT_EQ(r1->getForwardInfo().getInternedNexthops(),
+            r2->getForwardInfo().getInternedNexthops());
+  EXPECT_EQ(&r1->getForwardInfo().getNexthops(),
+            &r2->getForwardInfo().getNexthops());
+
+  RouteForwardInfo drop;
+  drop.setDrop();
+  EXPECT_TRUE(drop.getNexthops().empty());
+  EXPECT_EQ(InternedForwardNexthops(), drop.getInternedNexthops());
+}
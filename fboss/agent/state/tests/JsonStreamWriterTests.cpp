@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/JsonStreamWriter.h"
+#include "fboss/agent/test/TestUtils.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/json.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+using folly::dynamic;
+using folly::parseJson;
+using std::string;
+using std::unique_ptr;
+
+namespace {
+
+void writeDocument(JsonStreamWriter* writer) {
+  writer->beginObject();
+  writer->key("empty object");
+  writer->beginObject();
+  writer->endObject();
+  writer->key("empty array");
+  writer->beginArray();
+  writer->endArray();
+  writer->key("escaped \"key\"\n");
+  writer->value("a \"string\"\nwith newlines\n");
+  writer->key("nested");
+  writer->beginArray();
+  for (int i = 0; i < 10; ++i) {
+    writer->beginObject();
+    writer->key("index");
+    writer->value(i);
+    writer->key("value");
+    writer->value(dynamic::object("list", {1, 2.5, true, nullptr}));
+    writer->endObject();
+  }
+  writer->endArray();
+  writer->endObject();
+}
+
+dynamic expectedDocument() {
+  dynamic nested = {};
+  for (int i = 0; i < 10; ++i) {
+    nested.push_back(dynamic::object
+        ("index", i)
+        ("value", dynamic::object("list", {1, 2.5, true, nullptr})));
+  }
+  return dynamic::object
+    ("empty object", dynamic::object)
+    ("empty array", {})
+    ("escaped \"key\"\n", "a \"string\"\nwith newlines\n")
+    ("nested", nested);
+}
+
+}
+
+TEST(JsonStreamWriter, document) {
+  auto json = JsonStreamWriter::toString(writeDocument);
+  EXPECT_EQ(expectedDocument(), parseJson(json));
+
+  // Values on their own are valid documents too
+  EXPECT_EQ("3", JsonStreamWriter::toString([](JsonStreamWriter* writer) {
+    writer->value(3);
+  }));
+  EXPECT_EQ("[]", JsonStreamWriter::toString([](JsonStreamWriter* writer) {
+    writer->beginArray();
+    writer->endArray();
+  }));
+}
+
+TEST(JsonStreamWriter, flushChunks) {
+  string json;
+  size_t numFlushes = 0;
+  JsonStreamWriter writer([&](unique_ptr<IOBuf> buf) {
+    ++numFlushes;
+    auto chunk = buf->moveToFbString();
+    json.append(chunk.data(), chunk.size());
+  }, 16);
+  writeDocument(&writer);
+  writer.flush();
+  EXPECT_GT(numFlushes, 1);
+  EXPECT_EQ(JsonStreamWriter::toString(writeDocument), json);
+}
+
+TEST(JsonStreamWriter, switchState) {
+  auto state = testStateA();
+  auto json = JsonStreamWriter::toString([&](JsonStreamWriter* writer) {
+    state->writeJson(writer);
+  });
+  EXPECT_EQ(state->toFollyDynamic(), parseJson(json));
+}
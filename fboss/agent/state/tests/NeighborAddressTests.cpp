@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/ArpEntry.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/NdpEntry.h"
+#include "fboss/agent/state/NeighborAddress.h"
+
+#include <folly/Conv.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace facebook::fboss;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+
+namespace {
+
+template<typename AddrT>
+void checkOrder(const std::vector<std::string>& ips) {
+  for (const auto& a : ips) {
+    AddrT ipA(a);
+    NeighborAddress<AddrT> addrA(ipA);
+    EXPECT_EQ(ipA, addrA.toIP());
+    EXPECT_EQ(a, folly::to<std::string>(addrA));
+    for (const auto& b : ips) {
+      AddrT ipB(b);
+      NeighborAddress<AddrT> addrB(ipB);
+      EXPECT_EQ(ipA < ipB, addrA < addrB) << a << " " << b;
+      EXPECT_EQ(ipA > ipB, addrA > addrB) << a << " " << b;
+      EXPECT_EQ(ipA == ipB, addrA == addrB) << a << " " << b;
+    }
+  }
+}
+
+} // unnamed namespace
+
+TEST(NeighborAddress, V4) {
+  checkOrder<IPAddressV4>({"0.0.0.0", "10.0.0.1", "10.0.0.255", "10.0.1.0",
+                           "127.0.0.1", "128.0.0.0", "255.255.255.255"});
+}
+
+TEST(NeighborAddress, V6) {
+  checkOrder<IPAddressV6>({"::", "::1", "::ffff:ffff:ffff:ffff",
+                           "0:0:0:1::", "2401:db00::1", "2401:db00::2",
+                           "fe80::1", "fe80::202:ff:fe00:1",
+                           "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"});
+}
+
+TEST(NeighborAddress, EntryFields) {
+  // The fields pack without padding
+  EXPECT_EQ(20, sizeof(NeighborEntryFields<IPAddressV4>));
+  EXPECT_EQ(32, sizeof(NeighborEntryFields<IPAddressV6>));
+
+  auto entry = std::make_shared<ArpEntry>(IPAddressV4("10.0.0.10"),
+                                          MacAddress("02:00:00:00:00:0a"),
+                                          PortID(5), InterfaceID(55));
+  EXPECT_EQ(IPAddressV4("10.0.0.10"), entry->getIP());
+  EXPECT_EQ(MacAddress("02:00:00:00:00:0a"), entry->getMac());
+  EXPECT_EQ(PortID(5), entry->getPort());
+  EXPECT_EQ(InterfaceID(55), entry->getIntfID());
+  EXPECT_FALSE(entry->isPending());
+
+  auto ndpEntry = std::make_shared<NdpEntry>(IPAddressV6("fe80::1"),
+                                             InterfaceID(1), PENDING);
+  EXPECT_EQ(IPAddressV6("fe80::1"), ndpEntry->getIP());
+  EXPECT_TRUE(ndpEntry->isPending());
+
+  // Tables are looked up by the folly addresses
+  auto table = std::make_shared<ArpTable>();
+  table->addEntry(IPAddressV4("10.0.0.10"), MacAddress("02:00:00:00:00:0a"),
+                  PortID(5), InterfaceID(55));
+  table->addPendingEntry(IPAddressV4("10.0.0.9"), InterfaceID(55));
+  ASSERT_NE(nullptr, table->getEntryIf(IPAddressV4("10.0.0.10")));
+  EXPECT_EQ(nullptr, table->getEntryIf(IPAddressV4("10.0.0.11")));
+  std::vector<IPAddressV4> ips;
+  for (const auto& e : *table) {
+    ips.push_back(e->getIP());
+  }
+  EXPECT_EQ((std::vector<IPAddressV4>{IPAddressV4("10.0.0.9"),
+                                      IPAddressV4("10.0.0.10")}), ips);
+}
@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/OpenHashMap.h"
+#include "fboss/agent/state/ArpResponseTable.h"
+#include "fboss/agent/state/NdpResponseTable.h"
+
+#include <folly/Random.h>
+#include <gtest/gtest.h>
+#include <map>
+
+using namespace facebook::fboss;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+
+namespace {
+
+typedef OpenHashMap<int, int> IntMap;
+
+void checkContents(const IntMap& map, const std::map<int, int>& expected) {
+  ASSERT_EQ(expected.size(), map.size());
+  size_t count = 0;
+  for (const auto& entry : map) {
+    auto it = expected.find(entry.first);
+    ASSERT_NE(expected.end(), it) << entry.first;
+    EXPECT_EQ(it->second, entry.second);
+    ++count;
+  }
+  EXPECT_EQ(expected.size(), count);
+  for (const auto& entry : expected) {
+    auto it = map.find(entry.first);
+    ASSERT_NE(map.end(), it) << entry.first;
+    EXPECT_EQ(entry.second, it->second);
+  }
+}
+
+}
+
+TEST(OpenHashMap, InsertFind) {
+  IntMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.end(), map.find(1));
+
+  EXPECT_TRUE(map.insert(std::make_pair(1, 10)).second);
+  EXPECT_TRUE(map.emplace(2, 20).second);
+  // Existing entries are not replaced by insert()
+  auto ret = map.insert(std::make_pair(1, 11));
+  EXPECT_FALSE(ret.second);
+  EXPECT_EQ(10, ret.first->second);
+  // but they are by operator[]
+  map[1] = 12;
+  map[3] = 30;
+  checkContents(map, {{1, 12}, {2, 20}, {3, 30}});
+  EXPECT_EQ(1, map.count(3));
+  EXPECT_EQ(0, map.count(4));
+
+  ASSERT_NE(nullptr, map.getIf(2));
+  *map.getIf(2) = 21;
+  EXPECT_EQ(21, map.find(2)->second);
+  EXPECT_EQ(nullptr, map.getIf(4));
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+}
+
+TEST(OpenHashMap, Random) {
+  // Grow, shrink and probe the map, checking against std::map
+  IntMap map;
+  std::map<int, int> expected;
+  for (int n = 0; n < 20000; ++n) {
+    int key = folly::Random::rand32(1000);
+    switch (folly::Random::rand32(3)) {
+      case 0:
+        map[key] = n;
+        expected[key] = n;
+        break;
+      case 1:
+        EXPECT_EQ(expected.erase(key), map.erase(key));
+        break;
+      default:
+        EXPECT_EQ(expected.count(key), map.count(key));
+        break;
+    }
+    if (n % 1000 == 0) {
+      checkContents(map, expected);
+    }
+  }
+  checkContents(map, expected);
+}
+
+TEST(OpenHashMap, Reserve) {
+  IntMap map;
+  map.reserve(0);
+  EXPECT_TRUE(map.empty());
+  map[1] = 10;
+  map[2] = 20;
+  // Existing entries survive reserving room for more
+  map.reserve(1000);
+  checkContents(map, {{1, 10}, {2, 20}});
+  std::map<int, int> expected;
+  for (int n = 0; n < 1000; ++n) {
+    map[n] = n;
+    expected[n] = n;
+  }
+  // Reserving less than the current size does nothing
+  map.reserve(10);
+  checkContents(map, expected);
+}
+
+TEST(OpenHashMap, Equality) {
+  IntMap map1;
+  IntMap map2;
+  // Insertion order does not matter
+  for (int n = 0; n < 100; ++n) {
+    map1[n] = n;
+    map2[99 - n] = 99 - n;
+  }
+  EXPECT_EQ(map1, map2);
+
+  auto copy = map1;
+  EXPECT_EQ(map1, copy);
+  copy[5] = 6;
+  EXPECT_NE(map1, copy);
+  EXPECT_EQ(5, map1.find(5)->second);
+  copy.erase(5);
+  EXPECT_NE(map1, copy);
+  copy[5] = 5;
+  EXPECT_EQ(map1, copy);
+}
+
+TEST(OpenHashMap, ResponseTables) {
+  ArpResponseTable arp;
+  MacAddress mac("02:00:00:00:00:01");
+  for (uint32_t n = 0; n < 500; ++n) {
+    arp.setEntry(IPAddressV4::fromLongHBO(0x0a000000 + n), mac,
+                 InterfaceID(n % 4));
+  }
+  auto entry = arp.getEntry(IPAddressV4("10.0.1.3"));
+  ASSERT_TRUE(entry.hasValue());
+  EXPECT_EQ(mac, entry->mac);
+  EXPECT_EQ(InterfaceID(3), entry->interfaceID);
+  EXPECT_FALSE(arp.getEntry(IPAddressV4("10.1.0.0")).hasValue());
+
+  // Serialization round trips regardless of the iteration order
+  auto arp2 = ArpResponseTable::fromFollyDynamic(arp.toFollyDynamic());
+  EXPECT_EQ(arp.getTable(), arp2->getTable());
+
+  NdpResponseTable ndp;
+  ndp.setEntry(IPAddressV6("2401:db00::1"), mac, InterfaceID(1));
+  ndp.setEntry(IPAddressV6("fe80::1"), mac, InterfaceID(1));
+  EXPECT_TRUE(ndp.getEntry(IPAddressV6("fe80::1")).hasValue());
+  EXPECT_FALSE(ndp.getEntry(IPAddressV6("fe80::2")).hasValue());
+}
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/PersistentMap.h"
+
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+using namespace facebook::fboss;
+using std::make_pair;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+
+typedef PersistentMap<int, shared_ptr<int>> IntMap;
+
+void checkContents(const IntMap& map, const std::map<int, int>& expected) {
+  ASSERT_EQ(expected.size(), map.size());
+  auto expectedIter = expected.begin();
+  for (const auto& entry : map) {
+    EXPECT_EQ(expectedIter->first, entry.first);
+    EXPECT_EQ(expectedIter->second, *entry.second);
+    ++expectedIter;
+  }
+  auto expectedRIter = expected.rbegin();
+  for (auto iter = map.rbegin(); iter != map.rend(); ++iter) {
+    EXPECT_EQ(expectedRIter->first, iter->first);
+    ++expectedRIter;
+  }
+  for (const auto& entry : expected) {
+    auto iter = map.find(entry.first);
+    ASSERT_TRUE(iter != map.end());
+    EXPECT_EQ(entry.second, *iter->second);
+  }
+}
+
+}
+
+TEST(PersistentMap, modify) {
+  IntMap map;
+  std::map<int, int> expected;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.begin() == map.end());
+
+  // Insert enough entries to build a multi-level tree
+  for (int i = 0; i < 10000; ++i) {
+    int key = (i * 7919) % 10000;
+    EXPECT_TRUE(map.insert(make_pair(key, make_shared<int>(key))).second);
+    expected[key] = key;
+  }
+  EXPECT_FALSE(map.insert(make_pair(5, make_shared<int>(0))).second);
+  checkContents(map, expected);
+
+  for (int i = 0; i < 10000; i += 3) {
+    map[i] = make_shared<int>(-i);
+    expected[i] = -i;
+  }
+  checkContents(map, expected);
+
+  for (int i = 0; i < 10000; i += 2) {
+    EXPECT_EQ(1, map.erase(i));
+    expected.erase(i);
+  }
+  EXPECT_EQ(0, map.erase(0));
+  EXPECT_TRUE(map.find(0) == map.end());
+  checkContents(map, expected);
+
+  while (!map.empty()) {
+    map.erase(map.begin());
+  }
+  EXPECT_TRUE(map.begin() == map.end());
+}
+
+TEST(PersistentMap, copyOnWrite) {
+  IntMap map;
+  std::map<int, int> expected;
+  for (int i = 0; i < 5000; ++i) {
+    map.insert(make_pair(i, make_shared<int>(i)));
+    expected[i] = i;
+  }
+
+  // A copy shares the whole tree
+  IntMap copy(map);
+  EXPECT_TRUE(copy.sharesRoot(map));
+
+  // Modifying the copy does not affect the original
+  std::map<int, int> copyExpected(expected);
+  copy.erase(10);
+  copyExpected.erase(10);
+  copy[20] = make_shared<int>(-20);
+  copyExpected[20] = -20;
+  copy.insert(make_pair(100000, make_shared<int>(100000)));
+  copyExpected[100000] = 100000;
+  EXPECT_FALSE(copy.sharesRoot(map));
+  checkContents(map, expected);
+  checkContents(copy, copyExpected);
+
+  // Entries which were not modified are still the same objects
+  EXPECT_EQ(map.find(30)->second, copy.find(30)->second);
+}
+
+TEST(PersistentMap, upperBound) {
+  IntMap map;
+  EXPECT_TRUE(map.upper_bound(0) == map.end());
+  // Enough entries for several leaves, keyed by even numbers
+  for (int i = 0; i < 5000; ++i) {
+    map.insert(make_pair(i * 2, make_shared<int>(i)));
+  }
+  EXPECT_EQ(0, map.upper_bound(-1)->first);
+  for (int key = 0; key < 9998; ++key) {
+    auto iter = map.upper_bound(key);
+    ASSERT_TRUE(iter != map.end()) << key;
+    EXPECT_EQ(key % 2 ? key + 1 : key + 2, iter->first);
+  }
+  EXPECT_TRUE(map.upper_bound(9998) == map.end());
+  EXPECT_TRUE(map.upper_bound(20000) == map.end());
+
+  // Walking from upper_bound() visits the rest of the map
+  size_t count = 0;
+  for (auto iter = map.upper_bound(5000); iter != map.end(); ++iter) {
+    ++count;
+  }
+  EXPECT_EQ(2499, count);
+}
+
+TEST(PersistentMap, skipEqual) {
+  IntMap map;
+  for (int i = 0; i < 5000; ++i) {
+    map.insert(make_pair(i, make_shared<int>(i)));
+  }
+  IntMap copy(map);
+  copy[1000] = make_shared<int>(-1000);
+  copy.erase(3000);
+
+  // Walk both maps, and record each position where they differ
+  std::vector<int> changed;
+  auto iterA = map.begin();
+  auto iterB = copy.begin();
+  IntMap::skipEqual(&iterA, map.end(), &iterB, copy.end());
+  while (iterA != map.end() && iterB != copy.end()) {
+    changed.push_back(iterA->first);
+    if (iterA->first == iterB->first) {
+      ++iterB;
+    }
+    ++iterA;
+    IntMap::skipEqual(&iterA, map.end(), &iterB, copy.end());
+  }
+  EXPECT_TRUE(iterA == map.end());
+  EXPECT_TRUE(iterB == copy.end());
+  EXPECT_EQ((std::vector<int>{1000, 3000}), changed);
+
+  // Maps built separately share no tree nodes, but entries with the same
+  // values are still skipped.
+  IntMap other;
+  for (const auto& entry : map) {
+    other.insert(entry);
+  }
+  iterA = map.begin();
+  auto iterC = other.begin();
+  IntMap::skipEqual(&iterA, map.end(), &iterC, other.end());
+  EXPECT_TRUE(iterA == map.end());
+  EXPECT_TRUE(iterC == other.end());
+}
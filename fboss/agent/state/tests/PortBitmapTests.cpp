@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/PortBitmap.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace facebook::fboss;
+using std::vector;
+
+namespace {
+
+PortBitmap makeBitmap(vector<int> ports) {
+  PortBitmap bitmap;
+  for (auto port : ports) {
+    bitmap.set(PortID(port));
+  }
+  return bitmap;
+}
+
+vector<PortID> toVector(const PortBitmap& bitmap) {
+  vector<PortID> ports;
+  bitmap.forEach([&](PortID port) { ports.push_back(port); });
+  return ports;
+}
+
+}
+
+TEST(PortBitmap, setAndTest) {
+  PortBitmap bitmap;
+  EXPECT_TRUE(bitmap.empty());
+  EXPECT_FALSE(bitmap.test(PortID(1000)));
+
+  bitmap = makeBitmap({130, 1, 64, 63});
+  EXPECT_FALSE(bitmap.empty());
+  EXPECT_EQ(4, bitmap.count());
+  EXPECT_TRUE(bitmap.test(PortID(63)));
+  EXPECT_TRUE(bitmap.test(PortID(64)));
+  EXPECT_FALSE(bitmap.test(PortID(65)));
+  EXPECT_EQ((vector<PortID>{PortID(1), PortID(63), PortID(64), PortID(130)}),
+            toVector(bitmap));
+
+  // Removing the highest port trims the bitmap, so it still compares equal
+  // to one that never had it
+  bitmap.reset(PortID(130));
+  EXPECT_EQ(makeBitmap({1, 63, 64}), bitmap);
+  bitmap.reset(PortID(1000));
+  EXPECT_EQ(3, bitmap.count());
+}
+
+TEST(PortBitmap, setOperations) {
+  auto a = makeBitmap({1, 2, 3, 200});
+  auto b = makeBitmap({2, 3, 4});
+  EXPECT_EQ(makeBitmap({1, 4, 200}), a ^ b);
+  EXPECT_EQ(makeBitmap({2, 3}), a & b);
+  EXPECT_EQ(makeBitmap({1, 2, 3, 4, 200}), a | b);
+  EXPECT_EQ(makeBitmap({1, 200}), (a ^ b) & a);
+  EXPECT_TRUE((a ^ a).empty());
+  EXPECT_EQ(PortBitmap(), a ^ a);
+  EXPECT_NE(a, b);
+}
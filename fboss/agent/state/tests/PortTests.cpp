@@ -125,6 +125,94 @@ TEST(Port, initDefaultConfig) {
   EXPECT_EQ(nullptr, publishAndApplyConfig(state, &config, &platform));
 }
 
+TEST(Port, applyQosConfig) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+  stateV0->registerPort(PortID(1), "port1");
+
+  cfg::SwitchConfig config;
+  config.ports.resize(1);
+  config.ports[0].logicalID = 1;
+  config.ports[0].qos.dscpToQueue[46] = 5;
+  config.ports[0].qos.dscpToQueue[10] = 1;
+  config.ports[0].qos.pcpToQueue[5] = 5;
+  config.ports[0].qos.queueWeights[5] = 0;
+  config.ports[0].qos.queueWeights[1] = 4;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  auto port = stateV1->getPort(PortID(1));
+  const auto& qos = port->getQos();
+  EXPECT_EQ(5, qos.getQueueForDscp(46));
+  EXPECT_EQ(1, qos.getQueueForDscp(10));
+  EXPECT_EQ(0, qos.getQueueForDscp(0));
+  EXPECT_EQ(5, qos.getQueueForPcp(5));
+  EXPECT_EQ(0, qos.getQueueForPcp(1));
+  EXPECT_EQ(0, qos.getQueueWeight(5));
+  EXPECT_EQ(4, qos.getQueueWeight(1));
+  EXPECT_EQ(1, qos.getQueueWeight(0));
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  // The QoS settings survive a warm boot
+  auto restored = Port::fromFollyDynamic(port->toFollyDynamic());
+  EXPECT_EQ(qos, restored->getQos());
+
+  // Removing the mapping of a DSCP value changes the port
+  config.ports[0].qos.dscpToQueue.erase(10);
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  EXPECT_EQ(0, stateV2->getPort(PortID(1))->getQos().getQueueForDscp(10));
+
+  auto badConfig = config;
+  badConfig.ports[0].qos.dscpToQueue[64] = 1;
+  EXPECT_THROW(publishAndApplyConfig(stateV2, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.ports[0].qos.pcpToQueue[1] = 8;
+  EXPECT_THROW(publishAndApplyConfig(stateV2, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.ports[0].qos.queueWeights[2] = -1;
+  EXPECT_THROW(publishAndApplyConfig(stateV2, &badConfig, &platform),
+               FbossError);
+}
+
+TEST(Port, applyBufferConfig) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+  stateV0->registerPort(PortID(1), "port1");
+
+  cfg::SwitchConfig config;
+  config.ports.resize(1);
+  config.ports[0].logicalID = 1;
+  config.ports[0].buffer.cutThrough = true;
+  config.ports[0].buffer.headroomBytes = 40000;
+  config.ports[0].buffer.egressSharedLimitBytes = 200000;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  auto port = stateV1->getPort(PortID(1));
+  const auto& buffer = port->getBuffer();
+  EXPECT_TRUE(buffer.cutThrough);
+  EXPECT_EQ(40000, buffer.headroomBytes);
+  EXPECT_EQ(200000, buffer.egressSharedLimitBytes);
+  EXPECT_EQ(0, buffer.ingressMinBytes);
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  // The buffer settings survive a warm boot
+  auto restored = Port::fromFollyDynamic(port->toFollyDynamic());
+  EXPECT_EQ(buffer, restored->getBuffer());
+
+  // Going back to store and forward changes the port
+  config.ports[0].buffer.cutThrough = false;
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  EXPECT_FALSE(stateV2->getPort(PortID(1))->getBuffer().cutThrough);
+
+  auto badConfig = config;
+  badConfig.ports[0].buffer.ingressMinBytes = -1;
+  EXPECT_THROW(publishAndApplyConfig(stateV2, &badConfig, &platform),
+               FbossError);
+}
+
 TEST(PortMap, registerPorts) {
   auto ports = make_shared<PortMap>();
   EXPECT_EQ(0, ports->getGeneration());
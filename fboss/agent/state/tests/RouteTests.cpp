@@ -15,6 +15,7 @@
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/InterfaceMap.h"
 #include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RoutePrefixTrie.h"
 #include "fboss/agent/state/RouteTableRib.h"
 #include "fboss/agent/state/RouteTable.h"
 #include "fboss/agent/state/RouteUpdater.h"
@@ -997,3 +998,473 @@ TEST(Route, changedRoutesPostUpdate) {
                     {});
   stateV3->publish();
 }
+
+// Only routes depending on a changed prefix should be re-resolved
+TEST(Route, incrementalResolve) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.vlans.resize(1);
+  config.vlans[0].id = 1;
+  config.interfaces.resize(1);
+  config.interfaces[0].intfID = 1;
+  config.interfaces[0].vlanID = 1;
+  config.interfaces[0].routerID = 0;
+  config.interfaces[0].__isset.mac = true;
+  config.interfaces[0].mac = "00:00:00:00:00:11";
+  config.interfaces[0].ipAddresses.resize(1);
+  config.interfaces[0].ipAddresses[0] = "1.1.1.1/24";
+
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  stateV1->publish();
+  auto rid = RouterID(0);
+
+  auto nhops = [](const char* addr) {
+    RouteNextHops nexthops;
+    nexthops.emplace(IPAddress(addr));
+    return nexthops;
+  };
+  RouteV4::Prefix pA{IPAddressV4("10.1.1.0"), 24};
+  RouteV4::Prefix pB{IPAddressV4("20.1.1.0"), 24};
+  RouteV4::Prefix pC{IPAddressV4("30.1.1.0"), 24};
+
+  RouteUpdater u1(stateV1->getRouteTables());
+  u1.addRoute(rid, IPAddress("10.1.1.0"), 24, nhops("1.1.1.10"));
+  // B is resolved recursively through A
+  u1.addRoute(rid, IPAddress("20.1.1.0"), 24, nhops("10.1.1.5"));
+  u1.addRoute(rid, IPAddress("30.1.1.0"), 24, nhops("1.1.1.20"));
+  auto tables1 = u1.updateDone();
+  ASSERT_NE(nullptr, tables1);
+  EXPECT_EQ(3, u1.getNumRoutesResolved());
+  tables1->publish();
+  auto rib1 = tables1->getRouteTable(rid)->getRibV4();
+
+  // Changing A re-resolves A and B, but not C
+  RouteUpdater u2(tables1);
+  u2.addRoute(rid, IPAddress("10.1.1.0"), 24, nhops("1.1.1.11"));
+  auto tables2 = u2.updateDone();
+  ASSERT_NE(nullptr, tables2);
+  EXPECT_EQ(2, u2.getNumRoutesResolved());
+  tables2->publish();
+  auto rib2 = tables2->getRouteTable(rid)->getRibV4();
+  EXPECT_EQ(rib1->exactMatch(pC), rib2->exactMatch(pC));
+  auto rB = rib2->exactMatch(pB);
+  ASSERT_NE(nullptr, rB);
+  ASSERT_TRUE(rB->isResolved());
+  const auto& fwdB = rB->getForwardInfo().getNexthops();
+  ASSERT_EQ(1, fwdB.size());
+  EXPECT_EQ(IPAddress("1.1.1.11"), fwdB.begin()->nexthop);
+
+  // A more specific route covering B's nexthop re-resolves B only
+  RouteUpdater u3(tables2);
+  u3.addRoute(rid, IPAddress("10.1.1.5"), 32, nhops("1.1.1.30"));
+  auto tables3 = u3.updateDone();
+  ASSERT_NE(nullptr, tables3);
+  EXPECT_EQ(2, u3.getNumRoutesResolved());
+  tables3->publish();
+  auto rib3 = tables3->getRouteTable(rid)->getRibV4();
+  EXPECT_EQ(rib2->exactMatch(pA), rib3->exactMatch(pA));
+  EXPECT_EQ(rib2->exactMatch(pC), rib3->exactMatch(pC));
+  rB = rib3->exactMatch(pB);
+  ASSERT_NE(nullptr, rB);
+  ASSERT_TRUE(rB->isResolved());
+  EXPECT_EQ(IPAddress("1.1.1.30"),
+            rB->getForwardInfo().getNexthops().begin()->nexthop);
+
+  // Deleting it again falls back to resolving B through A
+  RouteUpdater u4(tables3);
+  u4.delRoute(rid, IPAddress("10.1.1.5"), 32);
+  auto tables4 = u4.updateDone();
+  ASSERT_NE(nullptr, tables4);
+  EXPECT_EQ(1, u4.getNumRoutesResolved());
+  rB = tables4->getRouteTable(rid)->getRibV4()->exactMatch(pB);
+  ASSERT_NE(nullptr, rB);
+  ASSERT_TRUE(rB->isResolved());
+  EXPECT_EQ(IPAddress("1.1.1.11"),
+            rB->getForwardInfo().getNexthops().begin()->nexthop);
+}
+
+TEST(Route, multipleClients) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.vlans.resize(1);
+  config.vlans[0].id = 1;
+  config.interfaces.resize(1);
+  config.interfaces[0].intfID = 1;
+  config.interfaces[0].vlanID = 1;
+  config.interfaces[0].routerID = 0;
+  config.interfaces[0].__isset.mac = true;
+  config.interfaces[0].mac = "00:00:00:00:00:11";
+  config.interfaces[0].ipAddresses.resize(1);
+  config.interfaces[0].ipAddresses[0] = "1.1.1.1/24";
+
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  stateV1->publish();
+  auto rid = RouterID(0);
+  ClientID bgp(1);
+  ClientID ospf(2);
+
+  auto entry = [](const char* addr, AdminDistance distance) {
+    RouteNextHops nexthops;
+    nexthops.emplace(IPAddress(addr));
+    return RouteNextHopEntry(std::move(nexthops), distance);
+  };
+  auto nexthopOf = [](const std::shared_ptr<RouteTableMap>& tables,
+                      RouterID id, const RouteV4::Prefix& prefix) {
+    auto rt = tables->getRouteTable(id)->getRibV4()->exactMatch(prefix);
+    EXPECT_NE(nullptr, rt);
+    EXPECT_EQ(1, rt->nexthops().size());
+    return *rt->nexthops().begin();
+  };
+  RouteV4::Prefix pA{IPAddressV4("10.1.1.0"), 24};
+  RouteV4::Prefix pB{IPAddressV4("20.1.1.0"), 24};
+  RouteV4::Prefix pIntf{IPAddressV4("1.1.1.0"), 24};
+
+  // The client with the lower admin distance wins, whatever the order
+  RouteUpdater u1(stateV1->getRouteTables());
+  u1.addRoute(rid, IPAddress("10.1.1.0"), 24, ospf, entry("1.1.1.20", 110));
+  u1.addRoute(rid, IPAddress("10.1.1.0"), 24, bgp, entry("1.1.1.10", 20));
+  u1.addRoute(rid, IPAddress("20.1.1.0"), 24, ospf, entry("1.1.1.20", 110));
+  u1.addRoute(rid, IPAddress("1.1.1.0"), 24, bgp, entry("1.1.1.30", 20));
+  auto tables1 = u1.updateDone();
+  ASSERT_NE(nullptr, tables1);
+  tables1->publish();
+  EXPECT_EQ(IPAddress("1.1.1.10"), nexthopOf(tables1, rid, pA));
+  auto rA = tables1->getRouteTable(rid)->getRibV4()->exactMatch(pA);
+  EXPECT_EQ(2, rA->getClients().size());
+  EXPECT_TRUE(rA->hasClient(bgp));
+  EXPECT_TRUE(rA->hasClient(ospf));
+  EXPECT_TRUE(rA->isResolved());
+
+  // The interface route from the config takes precedence over the client
+  auto rIntf = tables1->getRouteTable(rid)->getRibV4()->exactMatch(pIntf);
+  ASSERT_NE(nullptr, rIntf);
+  EXPECT_TRUE(rIntf->isConnected());
+  EXPECT_TRUE(rIntf->isConfigRoute());
+  EXPECT_TRUE(rIntf->hasClient(bgp));
+
+  // Re-adding the same nexthops changes nothing
+  RouteUpdater u2(tables1);
+  u2.addRoute(rid, IPAddress("10.1.1.0"), 24, bgp, entry("1.1.1.10", 20));
+  EXPECT_EQ(nullptr, u2.updateDone());
+
+  // Deleting the best client falls back to the other one
+  RouteUpdater u3(tables1);
+  u3.delRoute(rid, IPAddress("10.1.1.0"), 24, bgp);
+  auto tables3 = u3.updateDone();
+  ASSERT_NE(nullptr, tables3);
+  EXPECT_EQ(1, u3.getNumRoutesResolved());
+  tables3->publish();
+  EXPECT_EQ(IPAddress("1.1.1.20"), nexthopOf(tables3, rid, pA));
+  EXPECT_FALSE(tables3->getRouteTable(rid)->getRibV4()->exactMatch(pA)
+               ->hasClient(bgp));
+
+  // Deleting the last client deletes the route
+  RouteUpdater u4(tables3);
+  u4.delRoute(rid, IPAddress("10.1.1.0"), 24, ospf);
+  // Deleting a client that never added the route does nothing
+  u4.delRoute(rid, IPAddress("20.1.1.0"), 24, bgp);
+  auto tables4 = u4.updateDone();
+  ASSERT_NE(nullptr, tables4);
+  tables4->publish();
+  EXPECT_EQ(nullptr, tables4->getRouteTable(rid)->getRibV4()->exactMatch(pA));
+  EXPECT_EQ(IPAddress("1.1.1.20"), nexthopOf(tables4, rid, pB));
+
+  // Removing the interface falls back to the client's nexthops
+  cfg::SwitchConfig config2;
+  config2.vlans.resize(1);
+  config2.vlans[0].id = 1;
+  config2.interfaces.resize(1);
+  config2.interfaces[0] = config.interfaces[0];
+  config2.interfaces[0].ipAddresses[0] = "2.2.2.2/24";
+  auto stateV2 = stateV1->clone();
+  stateV2->resetRouteTables(tables4);
+  stateV2->publish();
+  auto stateV3 = publishAndApplyConfig(stateV2, &config2, &platform);
+  ASSERT_NE(nullptr, stateV3);
+  auto tables5 = stateV3->getRouteTables();
+  rIntf = tables5->getRouteTable(rid)->getRibV4()->exactMatch(pIntf);
+  ASSERT_NE(nullptr, rIntf);
+  EXPECT_FALSE(rIntf->isConnected());
+  EXPECT_FALSE(rIntf->isConfigRoute());
+  EXPECT_EQ(IPAddress("1.1.1.30"), nexthopOf(tables5, rid, pIntf));
+}
+
+TEST(Route, syncClientRoutes) {
+  auto stateV0 = make_shared<SwitchState>();
+  auto tablesV0 = stateV0->getRouteTables();
+  auto rid = RouterID(0);
+  ClientID bgp(1);
+  ClientID ospf(2);
+
+  auto entry = [](const char* addr) {
+    RouteNextHops nexthops;
+    nexthops.emplace(IPAddress(addr));
+    return RouteNextHopEntry(std::move(nexthops), 20);
+  };
+  RouteUpdater u1(tablesV0);
+  u1.addRoute(rid, IPAddress("10.1.1.0"), 24, bgp, entry("1.1.1.10"));
+  u1.addRoute(rid, IPAddress("20.1.1.0"), 24, bgp, entry("1.1.1.10"));
+  u1.addRoute(rid, IPAddress("20.1.1.0"), 24, ospf, entry("1.1.1.20"));
+  u1.addRoute(rid, IPAddress("30.1.1.0"), 24, ospf, entry("1.1.1.20"));
+  u1.addRoute(rid, IPAddress("1::"), 64, bgp, entry("1::10"));
+  u1.addRoute(rid, IPAddress("2::"), 64, bgp, entry("1::10"));
+  auto tables1 = u1.updateDone();
+  ASSERT_NE(nullptr, tables1);
+  tables1->publish();
+
+  // Re-syncing the same routes, in any order, changes nothing
+  RouteUpdater::ClientRoutes same;
+  same.add(IPAddress("2::"), 64, entry("1::10"));
+  same.add(IPAddress("20.1.1.0"), 24, entry("1.1.1.10"));
+  same.add(IPAddress("1::1"), 64, entry("1::10"));
+  same.add(IPAddress("10.1.1.0"), 24, entry("1.1.1.10"));
+  RouteUpdater u2(tables1);
+  u2.syncClientRoutes(rid, bgp, std::move(same));
+  EXPECT_EQ(nullptr, u2.updateDone());
+
+  // Keep 10.1.1.0/24 and 1::/64, change 10.1.1.0/24 and add 40.1.1.0/24
+  RouteUpdater::ClientRoutes changed;
+  changed.add(IPAddress("10.1.1.0"), 24, entry("1.1.1.10"));
+  changed.add(IPAddress("1::"), 64, entry("1::10"));
+  changed.add(IPAddress("40.1.1.0"), 24, entry("1.1.1.10"));
+  // The last entry of a prefix wins
+  changed.add(IPAddress("10.1.1.0"), 24, entry("1.1.1.11"));
+  RouteUpdater u3(tables1);
+  u3.syncClientRoutes(rid, bgp, std::move(changed));
+  auto tables3 = u3.updateDone();
+  ASSERT_NE(nullptr, tables3);
+
+  auto ribV4 = tables3->getRouteTable(rid)->getRibV4();
+  auto ribV6 = tables3->getRouteTable(rid)->getRibV6();
+  EXPECT_EQ(4, ribV4->size());
+  EXPECT_EQ(1, ribV6->size());
+  auto rA = ribV4->exactMatch({IPAddressV4("10.1.1.0"), 24});
+  ASSERT_NE(nullptr, rA);
+  EXPECT_EQ(IPAddress("1.1.1.11"), *rA->nexthops().begin());
+  EXPECT_NE(nullptr, ribV4->exactMatch({IPAddressV4("40.1.1.0"), 24}));
+  // The route bgp shared with ospf is now ospf's alone
+  auto rB = ribV4->exactMatch({IPAddressV4("20.1.1.0"), 24});
+  ASSERT_NE(nullptr, rB);
+  EXPECT_FALSE(rB->hasClient(bgp));
+  EXPECT_TRUE(rB->hasClient(ospf));
+  EXPECT_EQ(IPAddress("1.1.1.20"), *rB->nexthops().begin());
+  // Unchanged routes are the same nodes
+  auto rib1V4 = tables1->getRouteTable(rid)->getRibV4();
+  auto rib1V6 = tables1->getRouteTable(rid)->getRibV6();
+  EXPECT_EQ(rib1V4->exactMatch({IPAddressV4("30.1.1.0"), 24}),
+            ribV4->exactMatch({IPAddressV4("30.1.1.0"), 24}));
+  EXPECT_EQ(rib1V6->exactMatch({IPAddressV6("1::"), 64}),
+            ribV6->exactMatch({IPAddressV6("1::"), 64}));
+  EXPECT_EQ(nullptr, ribV6->exactMatch({IPAddressV6("2::"), 64}));
+
+  // Syncing no routes deletes all of the client's routes
+  RouteUpdater u4(tables1);
+  u4.syncClientRoutes(rid, ospf, RouteUpdater::ClientRoutes());
+  auto tables4 = u4.updateDone();
+  ASSERT_NE(nullptr, tables4);
+  ribV4 = tables4->getRouteTable(rid)->getRibV4();
+  EXPECT_EQ(2, ribV4->size());
+  EXPECT_EQ(nullptr, ribV4->exactMatch({IPAddressV4("30.1.1.0"), 24}));
+  EXPECT_EQ(IPAddress("1.1.1.10"),
+            *ribV4->exactMatch({IPAddressV4("20.1.1.0"), 24})
+              ->nexthops().begin());
+}
+
+TEST(RouteUpdater, cachedInterfaceRoutes) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.vlans.resize(1);
+  config.vlans[0].id = 1;
+  config.interfaces.resize(1);
+  config.interfaces[0].intfID = 1;
+  config.interfaces[0].vlanID = 1;
+  config.interfaces[0].routerID = 0;
+  config.interfaces[0].__isset.mac = true;
+  config.interfaces[0].mac = "00:00:00:00:00:11";
+  config.interfaces[0].ipAddresses.resize(2);
+  config.interfaces[0].ipAddresses[0] = "1.1.1.1/24";
+  config.interfaces[0].ipAddresses[1] = "1::1/48";
+
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  stateV1->publish();
+  auto rid = RouterID(0);
+
+  // The routes are built once for the same published interfaces
+  auto routes = RouteUpdater::getInterfaceRoutes(stateV1->getInterfaces());
+  EXPECT_EQ(routes,
+            RouteUpdater::getInterfaceRoutes(stateV1->getInterfaces()));
+  ASSERT_EQ(1, routes->v4.size());
+  EXPECT_EQ((RoutePrefixV4{IPAddressV4("1.1.1.0"), 24}),
+            routes->v4[0].prefix);
+  ASSERT_EQ(1, routes->v6.size());
+  EXPECT_EQ((RoutePrefixV6{IPAddressV6("1::"), 48}), routes->v6[0].prefix);
+  EXPECT_EQ(1, routes->routers.size());
+
+  // Adding them again changes nothing
+  const auto& tables1 = stateV1->getRouteTables();
+  RouteUpdater u1(tables1);
+  u1.addInterfaceAndLinkLocalRoutes(stateV1->getInterfaces());
+  EXPECT_EQ(nullptr, u1.updateDone());
+
+  // Deleting the link local route twice only deletes it once
+  RouteUpdater u2(tables1);
+  u2.delLinkLocalRoutes(rid);
+  u2.delLinkLocalRoutes(rid);
+  auto tables2 = u2.updateDone();
+  ASSERT_NE(nullptr, tables2);
+  auto ribV6 = tables2->getRouteTable(rid)->getRibV6();
+  EXPECT_EQ(nullptr, ribV6->exactMatch({IPAddressV6("fe80::"), 64}));
+  EXPECT_NE(nullptr, ribV6->exactMatch({IPAddressV6("1::"), 48}));
+
+  // Other interfaces get their own routes
+  config.interfaces[0].ipAddresses[0] = "1.1.2.1/24";
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  stateV2->publish();
+  auto routes2 = RouteUpdater::getInterfaceRoutes(stateV2->getInterfaces());
+  EXPECT_NE(routes, routes2);
+  ASSERT_EQ(1, routes2->v4.size());
+  EXPECT_EQ((RoutePrefixV4{IPAddressV4("1.1.2.0"), 24}),
+            routes2->v4[0].prefix);
+}
+
+TEST(Route, serializeClients) {
+  RouteV4::Prefix prefix{IPAddressV4("10.1.1.0"), 24};
+  RouteNextHops nexthops;
+  nexthops.emplace(IPAddress("1.1.1.10"));
+  auto rt = make_shared<RouteV4>(prefix, ClientID(1),
+                                 RouteNextHopEntry(nexthops, 20));
+  nexthops.emplace(IPAddress("1.1.1.20"));
+  rt->update(ClientID(2), RouteNextHopEntry(nexthops, 110));
+
+  auto rt2 = RouteV4::fromFollyDynamic(rt->toFollyDynamic());
+  EXPECT_TRUE(rt->isSame(rt2.get()));
+  EXPECT_EQ(2, rt2->getClients().size());
+  EXPECT_EQ(1, rt2->nexthops().size());
+
+  // Routes saved before clients were tracked can still be loaded
+  auto json = rt->toFollyDynamic();
+  json.erase("clients");
+  auto rt3 = RouteV4::fromFollyDynamic(json);
+  EXPECT_TRUE(rt3->getClients().empty());
+  EXPECT_TRUE(rt3->hasClient(ClientID(3)));
+  EXPECT_EQ(rt->nexthops(), rt3->nexthops());
+}
+
+TEST(RoutePrefixTrie, longestMatch) {
+  RoutePrefixTrie<IPAddressV4> trie;
+  RoutePrefixV4 def{IPAddressV4("0.0.0.0"), 0};
+  RoutePrefixV4 p8{IPAddressV4("10.0.0.0"), 8};
+  RoutePrefixV4 p16{IPAddressV4("10.1.0.0"), 16};
+  RoutePrefixV4 p24{IPAddressV4("10.1.1.0"), 24};
+  RoutePrefixV4 p24b{IPAddressV4("10.1.2.0"), 24};
+  RoutePrefixV4 p32{IPAddressV4("10.1.1.1"), 32};
+
+  RoutePrefixV4 match;
+  EXPECT_FALSE(trie.longestMatch(IPAddressV4("10.1.1.1"), &match));
+
+  // Insert out of order, so we exercise both splitting and covering nodes
+  trie.insert(p24);
+  trie.insert(p8);
+  trie.insert(p24b);
+  trie.insert(p32);
+  trie.insert(p16);
+  trie.insert(p16);
+  EXPECT_EQ(5, trie.size());
+  EXPECT_TRUE(trie.exists(p16));
+  EXPECT_FALSE(trie.exists(def));
+
+  ASSERT_TRUE(trie.longestMatch(IPAddressV4("10.1.1.1"), &match));
+  EXPECT_EQ(p32, match);
+  ASSERT_TRUE(trie.longestMatch(IPAddressV4("10.1.1.2"), &match));
+  EXPECT_EQ(p24, match);
+  ASSERT_TRUE(trie.longestMatch(IPAddressV4("10.1.2.200"), &match));
+  EXPECT_EQ(p24b, match);
+  ASSERT_TRUE(trie.longestMatch(IPAddressV4("10.1.3.1"), &match));
+  EXPECT_EQ(p16, match);
+  ASSERT_TRUE(trie.longestMatch(IPAddressV4("10.2.3.1"), &match));
+  EXPECT_EQ(p8, match);
+  EXPECT_FALSE(trie.longestMatch(IPAddressV4("11.1.1.1"), &match));
+
+  // Copies share structure, and modifying one never affects the other
+  auto copy = trie;
+  EXPECT_TRUE(copy.sharesRoot(trie));
+  copy.insert(def);
+  EXPECT_TRUE(copy.remove(p24));
+  EXPECT_FALSE(copy.remove(p24));
+  EXPECT_FALSE(copy.sharesRoot(trie));
+  ASSERT_TRUE(copy.longestMatch(IPAddressV4("11.1.1.1"), &match));
+  EXPECT_EQ(def, match);
+  ASSERT_TRUE(copy.longestMatch(IPAddressV4("10.1.1.2"), &match));
+  EXPECT_EQ(p16, match);
+  EXPECT_FALSE(trie.longestMatch(IPAddressV4("11.1.1.1"), &match));
+  ASSERT_TRUE(trie.longestMatch(IPAddressV4("10.1.1.2"), &match));
+  EXPECT_EQ(p24, match);
+
+  // Removing a covering prefix keeps the more specific ones reachable
+  EXPECT_TRUE(copy.remove(p8));
+  EXPECT_TRUE(copy.remove(p16));
+  ASSERT_TRUE(copy.longestMatch(IPAddressV4("10.1.1.1"), &match));
+  EXPECT_EQ(p32, match);
+  ASSERT_TRUE(copy.longestMatch(IPAddressV4("10.1.2.1"), &match));
+  EXPECT_EQ(p24b, match);
+  ASSERT_TRUE(copy.longestMatch(IPAddressV4("10.1.1.2"), &match));
+  EXPECT_EQ(def, match);
+  EXPECT_EQ(3, copy.size());
+  EXPECT_EQ(5, trie.size());
+}
+
+TEST(RoutePrefixTrie, longestMatchV6) {
+  RoutePrefixTrie<IPAddressV6> trie;
+  RoutePrefixV6 p48{IPAddressV6("2001:db8::"), 48};
+  RoutePrefixV6 p64{IPAddressV6("2001:db8:0:1::"), 64};
+  RoutePrefixV6 p128{IPAddressV6("2001:db8:0:1::1"), 128};
+  trie.insert(p128);
+  trie.insert(p48);
+  trie.insert(p64);
+
+  RoutePrefixV6 match;
+  ASSERT_TRUE(trie.longestMatch(IPAddressV6("2001:db8:0:1::1"), &match));
+  EXPECT_EQ(p128, match);
+  ASSERT_TRUE(trie.longestMatch(IPAddressV6("2001:db8:0:1::2"), &match));
+  EXPECT_EQ(p64, match);
+  ASSERT_TRUE(trie.longestMatch(IPAddressV6("2001:db8:0:2::1"), &match));
+  EXPECT_EQ(p48, match);
+  EXPECT_FALSE(trie.longestMatch(IPAddressV6("2001:db9::1"), &match));
+}
+
+TEST(RouteTableRib, longestMatchAfterClone) {
+  auto rib = make_shared<RouteTableRib<IPAddressV4>>();
+  RouteV4::Prefix p8{IPAddressV4("10.0.0.0"), 8};
+  RouteV4::Prefix p24{IPAddressV4("10.1.1.0"), 24};
+  rib->addRoute(make_shared<RouteV4>(p8, RouteForwardAction::DROP));
+  rib->addRoute(make_shared<RouteV4>(p24, RouteForwardAction::TO_CPU));
+  rib->publish();
+
+  auto rib2 = rib->clone();
+  rib2->removeRoute(rib2->exactMatch(p24));
+
+  auto match = rib->longestMatch(IPAddressV4("10.1.1.1"));
+  ASSERT_NE(nullptr, match);
+  EXPECT_EQ(p24, match->prefix());
+  match = rib2->longestMatch(IPAddressV4("10.1.1.1"));
+  ASSERT_NE(nullptr, match);
+  EXPECT_EQ(p8, match->prefix());
+  EXPECT_EQ(nullptr, rib2->longestMatch(IPAddressV4("11.1.1.1")));
+
+  // The index is rebuilt when deserializing
+  auto rib3 = RouteTableRib<IPAddressV4>::fromFollyDynamic(
+      rib->toFollyDynamic());
+  match = rib3->longestMatch(IPAddressV4("10.1.1.1"));
+  ASSERT_NE(nullptr, match);
+  EXPECT_EQ(p24, match->prefix());
+}
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/StateMemoryStats.h"
+#include "fboss/agent/test/TestUtils.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+
+TEST(StateMemoryStats, subtrees) {
+  auto stateV0 = testStateA();
+  stateV0->publish();
+
+  StateMemoryStats stats(stateV0.get(), nullptr);
+  EXPECT_EQ(stateV0->getGeneration(), stats.getGeneration());
+  const auto& subtrees = stats.getSubtrees();
+  // The PortMap and 19 ports
+  EXPECT_EQ(20, subtrees.at("ports").nodes);
+  // The VlanMap, 2 VLANs and their ARP and NDP response tables
+  EXPECT_EQ(7, subtrees.at("vlans").nodes);
+  EXPECT_EQ(2, subtrees.at("arp").nodes);
+  EXPECT_EQ(2, subtrees.at("ndp").nodes);
+  // The InterfaceMap and 2 interfaces
+  EXPECT_EQ(3, subtrees.at("interfaces").nodes);
+  EXPECT_GT(subtrees.at("rib_v4").nodes, 1);
+  EXPECT_GT(subtrees.at("rib_v6").nodes, 1);
+
+  uint64_t nodes = 1;
+  uint64_t bytes = stateV0->getMemoryUsage();
+  for (const auto& entry : subtrees) {
+    EXPECT_GT(entry.second.bytes, 0);
+    EXPECT_EQ(0, entry.second.sharedNodes);
+    nodes += entry.second.nodes;
+    bytes += entry.second.bytes;
+  }
+  EXPECT_EQ(nodes, stats.getTotal().nodes);
+  EXPECT_EQ(bytes, stats.getTotal().bytes);
+  EXPECT_EQ(0, stats.getTotal().sharedNodes);
+}
+
+TEST(StateMemoryStats, sharedNodes) {
+  auto stateV0 = testStateA();
+  stateV0->publish();
+
+  // Comparing a state against itself shares everything
+  StateMemoryStats statsV0(stateV0.get(), stateV0.get());
+  EXPECT_EQ(statsV0.getTotal().nodes, statsV0.getTotal().sharedNodes);
+  EXPECT_EQ(statsV0.getTotal().bytes, statsV0.getTotal().sharedBytes);
+
+  // Modifying VLAN 1 copies the SwitchState, the VlanMap and the VLAN;
+  // everything else is shared with the previous generation.
+  auto stateV1 = stateV0;
+  auto vlan1 = stateV0->getVlans()->getVlan(VlanID(1));
+  vlan1->modify(&stateV1)->setName("newVlan1");
+  stateV1->publish();
+
+  StateMemoryStats statsV1(stateV1.get(), stateV0.get());
+  const auto& total = statsV1.getTotal();
+  EXPECT_EQ(statsV0.getTotal().nodes, total.nodes);
+  EXPECT_EQ(total.nodes - 3, total.sharedNodes);
+  EXPECT_LT(total.sharedBytes, total.bytes);
+
+  const auto& subtrees = statsV1.getSubtrees();
+  EXPECT_EQ(5, subtrees.at("vlans").sharedNodes);
+  EXPECT_EQ(2, subtrees.at("arp").sharedNodes);
+  EXPECT_EQ(20, subtrees.at("ports").sharedNodes);
+  EXPECT_EQ(subtrees.at("rib_v4").nodes, subtrees.at("rib_v4").sharedNodes);
+}
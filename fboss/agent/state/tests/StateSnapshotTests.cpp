@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/StateSnapshot.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/test/TestUtils.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/Range.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::ByteRange;
+using folly::StringPiece;
+
+namespace {
+
+ByteRange toRange(const std::string& data) {
+  return ByteRange(StringPiece(data));
+}
+
+}
+
+TEST(StateSnapshot, encodeDynamic) {
+  folly::dynamic json = folly::dynamic::object;
+  json["null"] = nullptr;
+  json["true"] = true;
+  json["false"] = false;
+  json["small"] = 3;
+  json["negative"] = -123456789;
+  json["large"] = INT64_MAX;
+  json["min"] = INT64_MIN;
+  json["double"] = 2.5;
+  json["string"] = "abc";
+  json["empty"] = "";
+  std::vector<folly::dynamic> items{1, "two", folly::dynamic::object};
+  json["array"] = folly::dynamic(items.begin(), items.end());
+
+  auto data = StateSnapshot::encode(json);
+  EXPECT_EQ(json, StateSnapshot::decode(toRange(data)));
+}
+
+TEST(StateSnapshot, switchState) {
+  auto state = testStateA();
+  auto json = state->toFollyDynamic();
+  auto data = StateSnapshot::encode(json);
+  auto decoded = SwitchState::fromFollyDynamic(
+      StateSnapshot::decode(toRange(data)));
+  EXPECT_EQ(json, decoded->toFollyDynamic());
+}
+
+TEST(StateSnapshot, invalid) {
+  auto data = StateSnapshot::encode(testStateA()->toFollyDynamic());
+
+  // Truncated data
+  EXPECT_THROW(StateSnapshot::decode(toRange(data.substr(0, 10))),
+               FbossError);
+  EXPECT_THROW(StateSnapshot::decode(toRange(data.substr(0, data.size() - 1))),
+               FbossError);
+
+  // Bad magic number
+  auto badMagic = data;
+  badMagic[0] ^= 0xff;
+  EXPECT_THROW(StateSnapshot::decode(toRange(badMagic)), FbossError);
+
+  // Unsupported version
+  auto badVersion = data;
+  badVersion[4] = StateSnapshot::kVersion + 1;
+  EXPECT_THROW(StateSnapshot::decode(toRange(badVersion)), FbossError);
+
+  // Invalid tag for the top-level value
+  auto badTag = data;
+  badTag[16] = 0x7f;
+  EXPECT_THROW(StateSnapshot::decode(toRange(badTag)), FbossError);
+}
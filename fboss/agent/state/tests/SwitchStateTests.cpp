@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/test/TestUtils.h"
+#include "fboss/agent/hw/mock/MockPlatform.h"
+#include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/gen-cpp/switch_config_types.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::make_shared;
+
+namespace {
+
+cfg::CpuQueue cpuQueue(int32_t id, int32_t rate, int32_t burst) {
+  cfg::CpuQueue queue;
+  queue.id = id;
+  queue.rate = rate;
+  queue.burst = burst;
+  return queue;
+}
+
+cfg::PacketRxReasonToQueue reasonToQueue(cfg::PacketRxReason reason,
+                                         int32_t queueId) {
+  cfg::PacketRxReasonToQueue entry;
+  entry.reason = reason;
+  entry.queueId = queueId;
+  return entry;
+}
+
+}
+
+TEST(SwitchState, applyCpuRxConfig) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+  cfg::SwitchConfig config;
+  config.cpuQueues.push_back(cpuQueue(0, 1000, 100));
+  config.cpuQueues.push_back(cpuQueue(7, 5000, 500));
+  config.cpuRxReasonToQueue.push_back(
+      reasonToQueue(cfg::PacketRxReason::ARP, 7));
+  config.cpuRxReasonToQueue.push_back(
+      reasonToQueue(cfg::PacketRxReason::CPU_IS_NHOP, 7));
+  config.cpuRxReasonToQueue.push_back(
+      reasonToQueue(cfg::PacketRxReason::UNMATCHED, 0));
+  config.cpuRxPoolSize = 256;
+
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  const auto& rxConfig = stateV1->getCpuRxConfig();
+  ASSERT_EQ(2, rxConfig.queueLimits.size());
+  EXPECT_EQ(1000, rxConfig.queueLimits.at(0).rate);
+  EXPECT_EQ(100, rxConfig.queueLimits.at(0).burst);
+  EXPECT_EQ(5000, rxConfig.queueLimits.at(7).rate);
+  EXPECT_EQ(500, rxConfig.queueLimits.at(7).burst);
+  std::vector<CpuRxConfig::ReasonToQueue> expectedReasons = {
+    {cfg::PacketRxReason::ARP, 7},
+    {cfg::PacketRxReason::CPU_IS_NHOP, 7},
+    {cfg::PacketRxReason::UNMATCHED, 0},
+  };
+  EXPECT_EQ(expectedReasons, rxConfig.reasonToQueue);
+  EXPECT_EQ(256, rxConfig.poolSize);
+  EXPECT_EQ(0, rxConfig.rate);
+
+  // Applying the same config again is a no-op
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  // Entries after UNMATCHED would never match
+  auto badConfig = config;
+  badConfig.cpuRxReasonToQueue.push_back(
+      reasonToQueue(cfg::PacketRxReason::DHCP, 1));
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+  // Each reason may only be mapped once
+  badConfig = config;
+  badConfig.cpuRxReasonToQueue.insert(
+      badConfig.cpuRxReasonToQueue.begin(),
+      reasonToQueue(cfg::PacketRxReason::ARP, 1));
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+  // A queue with a rate needs a burst size
+  badConfig = config;
+  badConfig.cpuQueues.push_back(cpuQueue(2, 100, 0));
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.cpuQueues.push_back(cpuQueue(7, 100, 10));
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+}
+
+TEST(SwitchState, applyEcmpHashConfig) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+  cfg::SwitchConfig config;
+  // The config defaults match the state defaults
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV0, &config, &platform));
+
+  config.ecmpHash.ipv6Fields.push_back(cfg::EcmpHashField::FLOW_LABEL);
+  config.ecmpHash.algorithm = cfg::EcmpHashAlgorithm::CRC32_LO;
+  config.ecmpHash.seedRotation = 3;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  const auto& hash = stateV1->getEcmpHashConfig();
+  EXPECT_EQ(EcmpHashConfig().ipv4Fields, hash.ipv4Fields);
+  EXPECT_EQ(5, hash.ipv6Fields.size());
+  EXPECT_EQ(1, hash.ipv6Fields.count(cfg::EcmpHashField::FLOW_LABEL));
+  EXPECT_EQ(cfg::EcmpHashAlgorithm::CRC32_LO, hash.algorithm);
+  EXPECT_EQ(3, hash.seedRotation);
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  // IPv4 has no flow label
+  auto badConfig = config;
+  badConfig.ecmpHash.ipv4Fields.push_back(cfg::EcmpHashField::FLOW_LABEL);
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.ecmpHash.ipv4Fields.clear();
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.ecmpHash.seedRotation = -1;
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+}
+
+TEST(SwitchState, applySflowConfig) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+  stateV0->registerPort(PortID(1), "port1");
+  cfg::SwitchConfig config;
+  config.ports.resize(1);
+  config.ports[0].logicalID = 1;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  EXPECT_EQ(SflowConfig(), stateV1->getSflowConfig());
+  EXPECT_EQ(0, stateV1->getPort(PortID(1))->getSflowIngressRate());
+
+  config.ports[0].sFlowIngressRate = 4096;
+  config.sFlowCollectors.resize(1);
+  config.sFlowCollectors[0].ip = "2401:db00::1";
+  config.sFlowAgentIp = "10.0.0.1";
+  config.sFlowHeaderSize = 64;
+  auto stateV2 = publishAndApplyConfig(stateV1, &config, &platform);
+  ASSERT_NE(nullptr, stateV2);
+  auto port = stateV2->getPort(PortID(1));
+  EXPECT_EQ(4096, port->getSflowIngressRate());
+  EXPECT_EQ(0, port->getSflowEgressRate());
+  const auto& sFlow = stateV2->getSflowConfig();
+  ASSERT_EQ(1, sFlow.collectors.size());
+  EXPECT_EQ(IPAddress("2401:db00::1"), sFlow.collectors[0].first);
+  EXPECT_EQ(6343, sFlow.collectors[0].second);
+  EXPECT_EQ(IPAddress("10.0.0.1"), sFlow.agentIp);
+  EXPECT_EQ(64, sFlow.headerSize);
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV2, &config, &platform));
+
+  // The rates survive a warm boot
+  auto portJson = port->toFollyDynamic();
+  EXPECT_EQ(4096, Port::fromFollyDynamic(portJson)->getSflowIngressRate());
+
+  auto badConfig = config;
+  badConfig.ports[0].sFlowEgressRate = -1;
+  EXPECT_THROW(publishAndApplyConfig(stateV2, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.sFlowHeaderSize = 0;
+  EXPECT_THROW(publishAndApplyConfig(stateV2, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.sFlowCollectors[0].port = 70000;
+  EXPECT_THROW(publishAndApplyConfig(stateV2, &badConfig, &platform),
+               FbossError);
+}
+
+TEST(SwitchState, applyRouteCounters) {
+  MockPlatform platform;
+  auto stateV0 = make_shared<SwitchState>();
+  cfg::SwitchConfig config;
+  config.routeCounters.resize(2);
+  config.routeCounters[0].name = "tenant1";
+  config.routeCounters[0].prefixes = {"10.1.2.3/16", "2401:db00:1::/48"};
+  config.routeCounters[1].name = "vips";
+  config.routeCounters[1].prefixes = {"10.2.0.0/24"};
+  config.routeCounters[1].routerID = 1;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  const auto& counters = stateV1->getRouteCounters();
+  ASSERT_EQ(2, counters.size());
+  EXPECT_EQ("tenant1", counters[0].name);
+  EXPECT_EQ(RouterID(0), counters[0].router);
+  ASSERT_EQ(2, counters[0].prefixes.size());
+  EXPECT_EQ(IPAddress::createNetwork("10.1.0.0/16"), counters[0].prefixes[0]);
+  EXPECT_EQ(RouterID(1), counters[1].router);
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  auto badConfig = config;
+  badConfig.routeCounters[1].name = "tenant1";
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+  badConfig = config;
+  badConfig.routeCounters[0].name = "";
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &badConfig, &platform),
+               FbossError);
+}
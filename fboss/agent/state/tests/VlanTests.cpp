@@ -22,6 +22,7 @@
 #include "fboss/agent/gen-cpp/switch_config_types.h"
 
 #include <gtest/gtest.h>
+#include <atomic>
 #include <string>
 
 using namespace facebook::fboss;
@@ -69,6 +70,7 @@ TEST(Vlan, applyConfig) {
   config.vlans[0].dhcpRelayOverridesV4["02:00:00:00:00:02"] = "1.2.3.4";
   config.vlans[0].dhcpRelayOverridesV6["02:00:00:00:00:02"] =
     "2a03:2880:10:1f07:face:b00c:0:0";
+  config.vlans[0].dhcpRelayAddressesV6.push_back("2a03:2880:10:1f07::1");
   config.vlanPorts.resize(2);
   config.vlanPorts[0].logicalPort = 1;
   config.vlanPorts[0].vlanID = 1234;
@@ -100,6 +102,8 @@ TEST(Vlan, applyConfig) {
   auto map6 = vlanV1->getDhcpV6RelayOverrides();
   EXPECT_EQ(IPAddressV6("2a03:2880:10:1f07:face:b00c:0:0"),
             IPAddressV6(map6[MacAddress("02:00:00:00:00:02")]));
+  DhcpV6RelayList relays6{IPAddressV6("2a03:2880:10:1f07::1")};
+  EXPECT_EQ(relays6, vlanV1->getDhcpV6ExtraRelays());
 
   // Applying the same config again should return null
   EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
@@ -244,30 +248,33 @@ void checkChangedVlans(const shared_ptr<VlanMap>& oldVlans,
   auto newState = make_shared<SwitchState>();
   newState->resetVlans(newVlans);
 
-  std::set<uint16_t> foundChanged;
-  std::set<uint16_t> foundAdded;
-  std::set<uint16_t> foundRemoved;
   StateDelta delta(oldState, newState);
-  DeltaFunctions::forEachChanged(delta.getVlansDelta(),
-    [&] (const shared_ptr<Vlan>& oldVlan, const shared_ptr<Vlan>& newVlan) {
-      EXPECT_EQ(oldVlan->getID(), newVlan->getID());
-      EXPECT_NE(oldVlan, newVlan);
-
-      auto ret = foundChanged.insert(oldVlan->getID());
-      EXPECT_TRUE(ret.second);
-    },
-    [&] (const shared_ptr<Vlan>& vlan) {
-      auto ret = foundAdded.insert(vlan->getID());
-      EXPECT_TRUE(ret.second);
-    },
-    [&] (const shared_ptr<Vlan>& vlan) {
-      auto ret = foundRemoved.insert(vlan->getID());
-      EXPECT_TRUE(ret.second);
-    });
-
-  EXPECT_EQ(changedIDs, foundChanged);
-  EXPECT_EQ(addedIDs, foundAdded);
-  EXPECT_EQ(removedIDs, foundRemoved);
+  // The second walk goes over the changes collected by the first
+  for (int walk = 0; walk < 2; ++walk) {
+    std::set<uint16_t> foundChanged;
+    std::set<uint16_t> foundAdded;
+    std::set<uint16_t> foundRemoved;
+    DeltaFunctions::forEachChanged(delta.getVlansDelta(),
+      [&] (const shared_ptr<Vlan>& oldVlan, const shared_ptr<Vlan>& newVlan) {
+        EXPECT_EQ(oldVlan->getID(), newVlan->getID());
+        EXPECT_NE(oldVlan, newVlan);
+
+        auto ret = foundChanged.insert(oldVlan->getID());
+        EXPECT_TRUE(ret.second);
+      },
+      [&] (const shared_ptr<Vlan>& vlan) {
+        auto ret = foundAdded.insert(vlan->getID());
+        EXPECT_TRUE(ret.second);
+      },
+      [&] (const shared_ptr<Vlan>& vlan) {
+        auto ret = foundRemoved.insert(vlan->getID());
+        EXPECT_TRUE(ret.second);
+      });
+
+    EXPECT_EQ(changedIDs, foundChanged);
+    EXPECT_EQ(addedIDs, foundAdded);
+    EXPECT_EQ(removedIDs, foundRemoved);
+  }
 }
 
 TEST(VlanMap, applyConfig) {
@@ -404,3 +411,110 @@ TEST(VlanMap, applyConfig) {
 
   checkChangedVlans(vlansV2, vlansV3, {}, {}, {99});
 }
+
+TEST(VlanMap, collectedArpChanges) {
+  auto oldState = make_shared<SwitchState>();
+  oldState->addVlan(make_shared<Vlan>(VlanID(1), "vlan1"));
+  oldState->addVlan(make_shared<Vlan>(VlanID(2), "vlan2"));
+  oldState->publish();
+
+  auto newState = oldState;
+  auto vlan = newState->getVlans()->getVlan(VlanID(2)).get();
+  auto arpTable = vlan->getArpTable()->modify(&vlan, &newState);
+  arpTable->addEntry(IPAddressV4("10.0.0.1"), MacAddress("00:02:00:00:00:01"),
+                     PortID(1), InterfaceID(1));
+  arpTable->addEntry(IPAddressV4("10.0.0.2"), MacAddress("00:02:00:00:00:02"),
+                     PortID(1), InterfaceID(1));
+
+  StateDelta delta(oldState, newState);
+  // Both walks see the same changes, although only the first compares the
+  // tables
+  for (int walk = 0; walk < 2; ++walk) {
+    std::vector<IPAddressV4> added;
+    uint32_t numVlans = 0;
+    for (const auto& vlanDelta : delta.getVlansDelta()) {
+      ++numVlans;
+      EXPECT_EQ(VlanID(2), vlanDelta.getNew()->getID());
+      DeltaFunctions::forEachAdded(vlanDelta.getArpDelta(),
+        [&] (const shared_ptr<ArpEntry>& entry) {
+          added.push_back(entry->getIP());
+        });
+      auto ndpDelta = vlanDelta.getNdpDelta();
+      EXPECT_TRUE(ndpDelta.begin() == ndpDelta.end());
+    }
+    EXPECT_EQ(1, numVlans);
+    std::vector<IPAddressV4> expected{IPAddressV4("10.0.0.1"),
+                                      IPAddressV4("10.0.0.2")};
+    EXPECT_EQ(expected, added);
+  }
+}
+
+TEST(VlanMap, parallelDelta) {
+  auto oldState = make_shared<SwitchState>();
+  for (uint16_t id = 1; id <= 10; ++id) {
+    oldState->addVlan(make_shared<Vlan>(VlanID(id), "vlan"));
+  }
+  auto newState = make_shared<SwitchState>();
+  for (uint16_t id = 6; id <= 15; ++id) {
+    newState->addVlan(make_shared<Vlan>(VlanID(id), "vlan"));
+  }
+  StateDelta delta(oldState, newState);
+
+  // The chunks hold the changes in order
+  DeltaFunctions::DeltaChunks<VlanMapDelta> chunks(delta.getVlansDelta(), 4);
+  EXPECT_EQ(4, chunks.size());
+  std::vector<uint16_t> ids;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    for (const auto& entry : chunks[i]) {
+      auto vlan = entry.getNew() ? entry.getNew() : entry.getOld();
+      ids.push_back(vlan->getID());
+    }
+  }
+  std::vector<uint16_t> expected;
+  for (uint16_t id = 1; id <= 15; ++id) {
+    expected.push_back(id);
+  }
+  EXPECT_EQ(expected, ids);
+
+  // Each change is visited once, whichever thread it is visited from
+  std::vector<std::atomic<int>> changed(16);
+  std::vector<std::atomic<int>> added(16);
+  std::vector<std::atomic<int>> removed(16);
+  DeltaFunctions::parallelForEachChanged(delta.getVlansDelta(), 4,
+    [&] (const shared_ptr<Vlan>& oldVlan, const shared_ptr<Vlan>& newVlan) {
+      ++changed[newVlan->getID()];
+    },
+    [&] (const shared_ptr<Vlan>& vlan) {
+      ++added[vlan->getID()];
+    },
+    [&] (const shared_ptr<Vlan>& vlan) {
+      ++removed[vlan->getID()];
+    });
+  for (uint16_t id = 1; id <= 15; ++id) {
+    EXPECT_EQ(id >= 6 && id <= 10 ? 1 : 0, changed[id].load());
+    EXPECT_EQ(id > 10 ? 1 : 0, added[id].load());
+    EXPECT_EQ(id < 6 ? 1 : 0, removed[id].load());
+  }
+}
+
+TEST(Vlan, portBitmaps) {
+  Vlan::MemberPorts ports;
+  ports.emplace(PortID(1), Vlan::PortInfo(false));
+  ports.emplace(PortID(70), Vlan::PortInfo(true));
+  auto vlan = make_shared<Vlan>(VlanID(10), "vlan10");
+  vlan->setPorts(ports);
+  EXPECT_EQ(2, vlan->getPortBitmap().count());
+  EXPECT_TRUE(vlan->getPortBitmap().test(PortID(70)));
+  EXPECT_TRUE(vlan->getUntaggedPortBitmap().test(PortID(1)));
+  EXPECT_FALSE(vlan->getUntaggedPortBitmap().test(PortID(70)));
+
+  vlan->addPort(PortID(5), false);
+  EXPECT_EQ(3, vlan->getPortBitmap().count());
+  EXPECT_TRUE(vlan->getUntaggedPortBitmap().test(PortID(5)));
+
+  // The bitmaps are rebuilt rather than serialized
+  auto vlanBack = Vlan::fromFollyDynamic(vlan->toFollyDynamic());
+  EXPECT_EQ(vlan->getPortBitmap(), vlanBack->getPortBitmap());
+  EXPECT_EQ(vlan->getUntaggedPortBitmap(),
+            vlanBack->getUntaggedPortBitmap());
+}
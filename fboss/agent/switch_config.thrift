@@ -51,6 +51,46 @@ enum PortSpeed {
 /**
  * Configuration for a single logical port
  */
+/**
+ * The egress queueing of a port.  The port has 8 queues, numbered 0-7.
+ *
+ * IP packets are put in the queue for their DSCP, and other packets in the
+ * queue for their 802.1p priority (PCP).  Values not listed use queue 0.
+ *
+ * Queues share the port by weighted round robin, in proportion to their
+ * weights.  Queues not listed have weight 1, and queues with weight 0 are
+ * served with strict priority before all weighted queues, higher numbered
+ * queues first.
+ */
+struct PortQos {
+  1: map<i16, i16> dscpToQueue = {}
+  2: map<i16, i16> pcpToQueue = {}
+  3: map<i16, i32> queueWeights = {}
+}
+
+/**
+ * How a port uses the switch's packet buffer.  The limits are in bytes, and
+ * 0 leaves the ASIC's default in place.
+ *
+ * Each port is guaranteed ingressMinBytes of the buffer, and may use up to
+ * ingressSharedLimitBytes of the shared buffer on top, after which it uses
+ * its headroomBytes while pause frames take effect.  Each egress queue of
+ * the port is guaranteed egressMinBytes, and may use up to
+ * egressSharedLimitBytes of the shared buffer.
+ *
+ * With cutThrough set, packets start being sent out of an idle port of the
+ * same speed before they are fully received, rather than being stored and
+ * forwarded, which takes the serialization delay off each hop.
+ */
+struct PortBuffer {
+  1: bool cutThrough = 0
+  2: i32 ingressMinBytes = 0
+  3: i32 ingressSharedLimitBytes = 0
+  4: i32 headroomBytes = 0
+  5: i32 egressMinBytes = 0
+  6: i32 egressSharedLimitBytes = 0
+}
+
 struct Port {
   1: i32 logicalID
   /*
@@ -90,6 +130,21 @@ struct Port {
    * Value 0 means default setting based on the HW and port type.
    */
   8: PortSpeed speed = DEFAULT;
+  /**
+   * Sample one in this many packets received or sent on this port, and
+   * export their headers to the sFlow collectors.  0 disables sampling.
+   */
+  9: i32 sFlowIngressRate = 0
+  10: i32 sFlowEgressRate = 0
+  /**
+   * Which of the port's egress queues packets are put in, and how the
+   * queues share the port.
+   */
+  11: PortQos qos
+  /**
+   * The port's share of the packet buffer, and whether it cuts through.
+   */
+  12: PortBuffer buffer
 }
 
 /**
@@ -137,6 +192,14 @@ struct Vlan {
   /* Override DHCPv4/6 relayer on a per host basis */
   9: optional map<string, string> dhcpRelayOverridesV4
   10: optional map<string, string> dhcpRelayOverridesV6
+
+  /*
+   * Further V6 DHCP relay addresses.  Requests are relayed to
+   * dhcpRelayAddressV6 and to each of these, so the VLAN can be served by
+   * redundant DHCP servers.  Clients with an override are only relayed to
+   * their override.
+   */
+  11: optional list<string> dhcpRelayAddressesV6
 }
 
 /**
@@ -235,6 +298,221 @@ struct Interface {
    * IPv6 NDP configuration
    */
   7: optional NdpConfig ndp
+  /**
+   * The MTU of the interface, in bytes of L3 packet.
+   * The tun interface on the host uses the largest MTU of the interfaces in
+   * its router.
+   */
+  8: i32 mtu = 1500
+}
+
+/**
+ * The reasons for which the switch hardware sends packets to its CPU that
+ * can be assigned a CPU queue.
+ */
+enum PacketRxReason {
+  UNMATCHED = 0,     // Any packet not matched by another reason
+  ARP = 1,           // ARP requests and replies
+  DHCP = 2,          // DHCP requests and replies
+  BPDU = 3,          // Link-local control protocols, such as LLDP
+  L3_SLOW_PATH = 4,  // IP packets that need processing the hardware lacks
+  L3_DEST_MISS = 5,  // IP packets with no route to their destination
+  TTL_1 = 6,         // IP packets with a TTL or hop limit of 1
+  CPU_IS_NHOP = 7,   // IP packets to our own addresses, such as BGP and NDP
+  SFLOW_INGRESS = 8, // Packets sampled as they were received, for sFlow
+  SFLOW_EGRESS = 9,  // Packets sampled as they were sent, for sFlow
+}
+
+/**
+ * Hardware rate limits for one of the CPU queues.
+ */
+struct CpuQueue {
+  1: i32 id
+  // Packets per second.  0 means unlimited.
+  2: i32 rate = 0
+  // The largest burst allowed above the rate, in packets
+  3: i32 burst = 0
+}
+
+/**
+ * The CPU queue for packets sent to the CPU for a given reason.
+ */
+struct PacketRxReasonToQueue {
+  1: PacketRxReason reason
+  2: i32 queueId
+}
+
+/**
+ * A collector sFlow datagrams are sent to.
+ */
+struct SflowCollector {
+  1: string ip
+  2: i32 port = 6343
+}
+
+/**
+ * A BFD session (RFC 5880 and 5881) with a directly connected neighbor,
+ * normally a BGP peer.  While the session is down, the paths through the
+ * neighbor are removed from the ECMP groups in hardware, without waiting
+ * for the routing protocol or the neighbor tables to notice.
+ *
+ * The intervals are in milliseconds.  The session goes down after
+ * multiplier receive intervals without a packet from the neighbor.
+ */
+struct BfdSession {
+  1: string peer
+  2: i32 routerID = 0
+  3: i32 minTxIntervalMs = 100
+  4: i32 minRxIntervalMs = 100
+  5: i32 multiplier = 3
+}
+
+/**
+ * A link aggregation group: ports that traffic is hashed across as if they
+ * were one port, using the ECMP hash fields.
+ *
+ * With lacp set, each member only forwards once LACP has agreed with the
+ * switch at the other end of its link to aggregate it.  Otherwise all
+ * members with their link up forward, as a static LAG.  All members must
+ * have the same VLAN configuration.
+ */
+struct AggregatePort {
+  1: i16 key
+  2: string name
+  3: list<i32> memberPorts
+  4: bool lacp = 1
+}
+
+/**
+ * A class of routes whose traffic is counted in hardware, such as the
+ * routes of a tenant or the VIPs of a service.
+ *
+ * A route in the VRF routerID belongs to the first class with a prefix
+ * that covers it.  The routes of a class share one counter of the packets
+ * and bytes they forward, exported as route_class.<name>.in_pkts and
+ * route_class.<name>.in_bytes.  Routes the hardware holds in its host
+ * table rather than LPM are not counted.
+ *
+ * While the next hops of the class's routes are unresolved, their packets
+ * are punted to the CPU.  Only unresolvedPuntRate of them a second are
+ * used to resolve the next hops, and the rest are dropped; 0 uses them
+ * all.  After unresolvedDropAfter attempts in a row to resolve a
+ * destination fail, its packets are dropped for unresolvedDropSeconds
+ * before it is tried again; 0 never gives up.  The punted and dropped
+ * packets are counted as unresolved.<name>.*.
+ */
+struct RouteCounter {
+  1: string name
+  // In CIDR notation, such as "10.1.0.0/16"
+  2: list<string> prefixes
+  3: i32 routerID = 0
+  4: i32 unresolvedPuntRate = 0
+  5: i32 unresolvedDropAfter = 0
+  6: i32 unresolvedDropSeconds = 60
+}
+
+/**
+ * What an ACL entry does with the packets it matches.
+ */
+enum AclAction {
+  // Drop the packets
+  DROP = 1,
+  // Copy the packets to the CPU, in the entry's CPU queue.  They are still
+  // forwarded as they would be otherwise.
+  TRAP = 2,
+  // Put the packets the switch sends to its CPU anyway, because they are
+  // addressed to it, in the entry's CPU queue.  The packets it forwards
+  // are not copied.
+  CPU_QUEUE = 3,
+  // Send the packets to the CPU, in the entry's CPU queue, instead of
+  // forwarding them.
+  PUNT = 4,
+}
+
+/**
+ * An ACL entry, which the hardware matches every packet against.  A packet
+ * matches the entry if it matches all of the fields the entry sets; 0, or
+ * an empty dstMac, matches any packet.  Where several entries match a
+ * packet, the one with the lowest id wins.  The ids from 100000 up are
+ * used by the neighborSuppression, controlPlaneTraps and
+ * dropUnhandledControlFrames.
+ */
+struct AclEntry {
+  1: i32 id
+  2: AclAction action
+  3: i32 etherType = 0
+  4: string dstMac = ""
+  5: i32 ipProtocol = 0
+  6: i32 l4SrcPort = 0
+  7: i32 l4DstPort = 0
+  // With ipProtocol 58 (ICMPv6) only
+  8: i32 icmpv6Type = 0
+  // For the TRAP, CPU_QUEUE and PUNT actions
+  9: i32 cpuQueue = 0
+  // The bits of the dstMac that are matched; empty matches all of them
+  10: string dstMacMask = ""
+}
+
+/**
+ * The control protocols the agent handles.
+ */
+enum ControlProtocol {
+  ARP = 1,
+  NDP = 2,          // Router and neighbor solicitations and advertisements
+  DHCP = 3,         // DHCPv4 and DHCPv6, which the agent relays
+  LLDP = 4,
+  BGP = 5,          // Only the sessions to the switch's addresses
+  BFD = 6,          // Single and multi hop, to the switch's addresses
+}
+
+/**
+ * An explicit trap of a control protocol's packets to a CPU queue, so
+ * that each protocol can have a queue, and limits, of its own.
+ */
+struct ControlPlaneTrap {
+  1: ControlProtocol protocol
+  2: i32 queueId
+}
+
+/**
+ * The packet fields the ECMP hash can use.
+ */
+enum EcmpHashField {
+  SRC_IP = 1,
+  DST_IP = 2,
+  IP_PROTOCOL = 3,
+  SRC_L4_PORT = 4,     // TCP and UDP packets only
+  DST_L4_PORT = 5,     // TCP and UDP packets only
+  FLOW_LABEL = 6,      // IPv6 only
+  INGRESS_PORT = 7,
+}
+
+enum EcmpHashAlgorithm {
+  CRC16_CCITT = 1,
+  CRC16 = 2,
+  CRC32_LO = 3,
+  CRC32_HI = 4,
+  XOR16 = 5,
+}
+
+/**
+ * How the switch hashes packets to pick one of the paths of an ECMP route.
+ */
+struct EcmpHash {
+  1: list<EcmpHashField> ipv4Fields = [
+    EcmpHashField.SRC_IP, EcmpHashField.DST_IP,
+    EcmpHashField.SRC_L4_PORT, EcmpHashField.DST_L4_PORT]
+  2: list<EcmpHashField> ipv6Fields = [
+    EcmpHashField.SRC_IP, EcmpHashField.DST_IP,
+    EcmpHashField.SRC_L4_PORT, EcmpHashField.DST_L4_PORT]
+  3: EcmpHashAlgorithm algorithm = EcmpHashAlgorithm.CRC16_CCITT
+  /**
+   * The hash seeds are derived from the switch's MAC address, so that
+   * switches at different tiers don't all make the same choices.  Changing
+   * seedRotation changes every switch's seeds, to move flows that have
+   * ended up polarized onto the same paths.
+   */
+  4: i32 seedRotation = 0
 }
 
 /**
@@ -268,4 +546,70 @@ struct SwitchConfig {
    * The switch hardware only supports a limited number of distinct MTUs.
    */
   12: list<i32> supportedMTUs
+  /**
+   * Rate limits for the ICMP errors, such as TTL exceeded, that the switch
+   * CPU generates for trapped packets.  Errors are limited separately for
+   * each source address they are sent to and for each VLAN interface they
+   * are sent from.  Rates are in packets per second, and a rate of 0
+   * disables that limit.
+   */
+  13: i32 icmpErrorSourceRate = 10
+  14: i32 icmpErrorSourceBurst = 10
+  15: i32 icmpErrorIntfRate = 100
+  16: i32 icmpErrorIntfBurst = 100
+  /**
+   * Packets the switch sends to its CPU are placed in one of several CPU
+   * queues, each of which can be rate limited in hardware, so that a flood
+   * of one kind of packet is dropped before it can crowd out the rest.
+   *
+   * cpuQueues sets the limits of the queues that have any.  Each packet is
+   * placed in the queue of the first entry of cpuRxReasonToQueue that
+   * matches it.  The UNMATCHED entry, if any, must be the last one; without
+   * it unmatched packets use the hardware's default queue.
+   */
+  17: list<CpuQueue> cpuQueues = []
+  18: list<PacketRxReasonToQueue> cpuRxReasonToQueue = []
+  /**
+   * The number of packet buffers in each chain of the CPU's receive pool,
+   * and the rate limit of all packets to the CPU together, in packets per
+   * second.  0 keeps the hardware default.  These are only applied when the
+   * switch starts.
+   */
+  19: i32 cpuRxPoolSize = 0
+  20: i32 cpuRxRate = 0
+  21: EcmpHash ecmpHash
+  /**
+   * Where to send the headers of the packets sampled on ports with an
+   * sFlowIngressRate or sFlowEgressRate, in sFlow v5 datagrams.  Samples
+   * are dropped when there are no collectors.
+   *
+   * sFlowAgentIp is the address the datagrams identify the switch by, and
+   * sFlowHeaderSize is the most bytes of each sampled packet exported.
+   */
+  22: list<SflowCollector> sFlowCollectors = []
+  23: string sFlowAgentIp = "0.0.0.0"
+  24: i32 sFlowHeaderSize = 128
+  25: list<AggregatePort> aggregatePorts = []
+  26: list<BfdSession> bfdSessions = []
+  27: list<RouteCounter> routeCounters = []
+  28: list<AclEntry> acls = []
+  /**
+   * Without an explicit trap, the packets of a control protocol reach the
+   * CPU however the hardware traps them by default, in the queues of the
+   * cpuRxReasonToQueue.  A protocol may only have one trap.
+   *
+   * With dropUnhandledControlFrames set, the link local control frames the
+   * agent does not handle, such as CDP, spanning tree BPDUs and EAPOL, are
+   * dropped in hardware rather than sent to the CPU.
+   */
+  29: list<ControlPlaneTrap> controlPlaneTraps = []
+  30: bool dropUnhandledControlFrames = 0
+  /**
+   * With neighborSuppression set, the broadcast ARP requests and the
+   * multicast neighbor solicitations are sent to the CPU rather than
+   * flooded.  The agent answers those for the hosts in its ARP and NDP
+   * tables itself, and only floods the others, out of the ports of their
+   * VLAN.  They use the queues of the ARP and NDP controlPlaneTraps.
+   */
+  31: bool neighborSuppression = 0
 }
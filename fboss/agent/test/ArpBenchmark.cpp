@@ -11,12 +11,16 @@
 
 #include <folly/Benchmark.h>
 #include <folly/Memory.h>
+#include "fboss/agent/ArpHandler.h"
 #include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/TxPacket.h"
 #include "fboss/agent/hw/mock/MockRxPacket.h"
 #include "fboss/agent/hw/sim/SimPlatform.h"
 #include "fboss/agent/hw/sim/SimSwitch.h"
+#include "fboss/agent/packet/NeighborReplyTemplate.h"
 #include "fboss/agent/state/ArpResponseTable.h"
 #include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/NeighborResponseTable-defs.h"
 #include "fboss/agent/state/SwitchState.h"
 #include "fboss/agent/state/Vlan.h"
 #include "fboss/agent/state/VlanMap.h"
@@ -26,10 +30,23 @@ using folly::IPAddress;
 using folly::IPAddressV4;
 using folly::MacAddress;
 using folly::make_unique;
+using folly::io::RWPrivateCursor;
 using std::make_shared;
 using std::shared_ptr;
 using std::unique_ptr;
 
+namespace facebook { namespace fboss {
+
+// An ArpResponseTable stored in the sorted container, to compare against
+class SortedArpResponseTable
+  : public NeighborResponseTable<IPAddressV4, SortedArpResponseTable,
+                                 SortedNeighborResponseMap<IPAddressV4>> {
+ public:
+  using NeighborResponseTable::NeighborResponseTable;
+};
+
+}} // facebook::fboss
+
 namespace {
 
 // Global state used by the benchmarks
@@ -129,6 +146,99 @@ void init() {
   arpRequest_10_0_0_5->setSrcVlan(VlanID(1));
 }
 
+std::vector<IPAddressV4> makeAddresses(size_t numAddrs) {
+  std::vector<IPAddressV4> addrs;
+  for (uint32_t n = 0; n < numAddrs; ++n) {
+    // Spread over several subnets, like VIPs and secondary addresses
+    addrs.push_back(IPAddressV4::fromLongHBO(0x0a000001 + (n % 7) * 0x10000 +
+                                             n * 3));
+  }
+  return addrs;
+}
+
+template<typename TABLE>
+shared_ptr<TABLE> makeResponseTable(const std::vector<IPAddressV4>& addrs) {
+  auto table = make_shared<TABLE>();
+  for (const auto& addr : addrs) {
+    table->setEntry(addr, MacAddress("02:00:01:00:00:01"), InterfaceID(1));
+  }
+  return table;
+}
+
+template<typename TABLE>
+void responseTableLookup(size_t numIters, size_t numAddrs) {
+  shared_ptr<TABLE> table;
+  std::vector<IPAddressV4> addrs;
+  BENCHMARK_SUSPEND {
+    addrs = makeAddresses(numAddrs);
+    table = makeResponseTable<TABLE>(addrs);
+    // Half of the lookups are for addresses that are not ours
+    auto misses = makeAddresses(numAddrs * 2);
+    addrs.insert(addrs.end(), misses.begin() + numAddrs, misses.end());
+  }
+  for (size_t n = 0; n < numIters; ++n) {
+    folly::doNotOptimizeAway(table->getEntry(addrs[n % addrs.size()]));
+  }
+}
+
+template<typename TABLE>
+void responseTableBuild(size_t numIters, size_t numAddrs) {
+  std::vector<IPAddressV4> addrs;
+  BENCHMARK_SUSPEND {
+    addrs = makeAddresses(numAddrs);
+  }
+  for (size_t n = 0; n < numIters; ++n) {
+    folly::doNotOptimizeAway(makeResponseTable<TABLE>(addrs));
+  }
+}
+
+template<typename TABLE>
+void responseTableClone(size_t numIters, size_t numAddrs) {
+  shared_ptr<TABLE> table;
+  BENCHMARK_SUSPEND {
+    table = makeResponseTable<TABLE>(makeAddresses(numAddrs));
+    table->publish();
+  }
+  // A copy-on-write modification of one entry
+  for (size_t n = 0; n < numIters; ++n) {
+    auto newTable = table->clone();
+    newTable->setEntry(IPAddressV4("10.0.0.1"),
+                       MacAddress("02:00:01:00:00:02"), InterfaceID(1));
+    folly::doNotOptimizeAway(newTable);
+  }
+}
+
+void sortedLookup(size_t numIters, size_t numAddrs) {
+  responseTableLookup<SortedArpResponseTable>(numIters, numAddrs);
+}
+void hashedLookup(size_t numIters, size_t numAddrs) {
+  responseTableLookup<ArpResponseTable>(numIters, numAddrs);
+}
+void sortedBuild(size_t numIters, size_t numAddrs) {
+  responseTableBuild<SortedArpResponseTable>(numIters, numAddrs);
+}
+void hashedBuild(size_t numIters, size_t numAddrs) {
+  responseTableBuild<ArpResponseTable>(numIters, numAddrs);
+}
+void sortedClone(size_t numIters, size_t numAddrs) {
+  responseTableClone<SortedArpResponseTable>(numIters, numAddrs);
+}
+void hashedClone(size_t numIters, size_t numAddrs) {
+  responseTableClone<ArpResponseTable>(numIters, numAddrs);
+}
+
+// The ARP reply for 10.0.0.1 to the requester of arpRequest_10_0_0_1
+const MacAddress kReplySrcMac("00:02:00:00:00:01");
+const IPAddressV4 kReplySrcIP("10.0.0.1");
+const MacAddress kReplyDstMac("00:02:00:01:02:03");
+const IPAddressV4 kReplyDstIP("10.0.0.15");
+
+unique_ptr<folly::IOBuf> createReplyBuf() {
+  auto buf = folly::IOBuf::create(ArpReplyTemplate::SIZE);
+  buf->append(ArpReplyTemplate::SIZE);
+  return buf;
+}
+
 } // unnamed namespace
 
 BENCHMARK(ArpRequest, numIters) {
@@ -169,6 +279,74 @@ BENCHMARK(ArpRequestNotMine, numIters) {
   }
 }
 
+BENCHMARK_DRAW_LINE();
+
+// Writing an ARP reply field by field, as ArpHandler did for every request
+BENCHMARK(ArpReplySerialize, numIters) {
+  unique_ptr<folly::IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = createReplyBuf();
+  }
+  for (size_t n = 0; n < numIters; ++n) {
+    RWPrivateCursor cursor(buf.get());
+    TxPacket::writeEthHeader(&cursor, kReplyDstMac, kReplySrcMac, VlanID(1),
+                             ArpHandler::ETHERTYPE_ARP);
+    cursor.writeBE<uint16_t>(1);
+    cursor.writeBE<uint16_t>(0x0800);
+    cursor.writeBE<uint8_t>(6);
+    cursor.writeBE<uint8_t>(4);
+    cursor.writeBE<uint16_t>(2);
+    cursor.push(kReplySrcMac.bytes(), MacAddress::SIZE);
+    cursor.write<uint32_t>(kReplySrcIP.toLong());
+    cursor.push(kReplyDstMac.bytes(), MacAddress::SIZE);
+    cursor.write<uint32_t>(kReplyDstIP.toLong());
+    memset(cursor.writableData(), 0, cursor.length());
+    folly::doNotOptimizeAway(buf->data());
+  }
+}
+
+// Copying the reply from the template built with the response table
+BENCHMARK_RELATIVE(ArpReplyTemplate, numIters) {
+  unique_ptr<folly::IOBuf> buf;
+  ArpReplyTemplate reply;
+  BENCHMARK_SUSPEND {
+    buf = createReplyBuf();
+    reply = ArpReplyTemplate(kReplySrcMac, VlanID(1), kReplySrcIP);
+  }
+  for (size_t n = 0; n < numIters; ++n) {
+    RWPrivateCursor cursor(buf.get());
+    reply.serialize(&cursor, kReplyDstMac, kReplyDstIP);
+    folly::doNotOptimizeAway(buf->data());
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(sortedLookup, 4)
+BENCHMARK_RELATIVE_PARAM(hashedLookup, 4)
+BENCHMARK_PARAM(sortedLookup, 64)
+BENCHMARK_RELATIVE_PARAM(hashedLookup, 64)
+BENCHMARK_PARAM(sortedLookup, 1024)
+BENCHMARK_RELATIVE_PARAM(hashedLookup, 1024)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(sortedBuild, 4)
+BENCHMARK_RELATIVE_PARAM(hashedBuild, 4)
+BENCHMARK_PARAM(sortedBuild, 64)
+BENCHMARK_RELATIVE_PARAM(hashedBuild, 64)
+BENCHMARK_PARAM(sortedBuild, 1024)
+BENCHMARK_RELATIVE_PARAM(hashedBuild, 1024)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(sortedClone, 4)
+BENCHMARK_RELATIVE_PARAM(hashedClone, 4)
+BENCHMARK_PARAM(sortedClone, 64)
+BENCHMARK_RELATIVE_PARAM(hashedClone, 64)
+BENCHMARK_PARAM(sortedClone, 1024)
+BENCHMARK_RELATIVE_PARAM(hashedClone, 1024)
+
 int main(int argc, char** argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
 
@@ -13,6 +13,7 @@
 #include <folly/io/IOBuf.h>
 #include "fboss/agent/AddressUtil.h"
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/NeighborHoldQueue.h"
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/TxPacket.h"
 #include "fboss/agent/ArpHandler.h"
@@ -29,19 +30,25 @@
 #include "fboss/agent/state/Vlan.h"
 #include "fboss/agent/state/VlanMap.h"
 #include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/RouteUpdater.h"
 #include "fboss/agent/test/CounterCache.h"
 #include "fboss/agent/test/TestUtils.h"
 
 #include <boost/cast.hpp>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include <future>
 
+DECLARE_bool(neighbor_prefetch);
+DECLARE_int32(neighbor_probe_interval_s);
+
 using namespace facebook::fboss;
 using facebook::network::toBinaryAddress;
 using facebook::network::toIPAddress;
 using facebook::network::thrift::BinaryAddress;
 using folly::io::Cursor;
 using folly::IOBuf;
+using folly::IPAddress;
 using folly::IPAddressV4;
 using folly::make_unique;
 using folly::StringPiece;
@@ -880,6 +887,48 @@ TEST(ArpTest, FlushEntry) {
                FbossError);
 }
 
+TEST(ArpTest, FlushEntries) {
+  auto sw = setupSwitch();
+
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(testing::AtLeast(1));
+  sendArpReply(sw.get(), "10.0.0.11", "02:10:20:30:40:11", 2);
+  sendArpReply(sw.get(), "10.0.0.15", "02:10:20:30:40:15", 3);
+  sendArpReply(sw.get(), "10.0.0.7", "02:10:20:30:40:07", 1);
+  waitForStateUpdates(sw.get());
+
+  ThriftHandler thriftHandler(sw.get());
+  auto toFlush = [](StringPiece ip, int32_t vlan) {
+    NeighborToFlush entry;
+    entry.ip = toBinaryAddress(IPAddress(ip));
+    entry.vlanId = vlan;
+    return entry;
+  };
+
+  // All the entries are flushed in a single state change.  Addresses that
+  // are not in the table are skipped.
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  auto entries = make_unique<std::vector<NeighborToFlush>>();
+  entries->push_back(toFlush("10.0.0.11", 1));
+  entries->push_back(toFlush("10.0.0.7", 0));
+  entries->push_back(toFlush("10.0.0.254", 1));
+  EXPECT_EQ(2, thriftHandler.flushNeighborEntries(std::move(entries)));
+
+  std::vector<ArpEntryThrift> arpTable;
+  thriftHandler.getArpTable(arpTable);
+  ASSERT_EQ(1, arpTable.size());
+  EXPECT_EQ("10.0.0.15", toIPAddress(arpTable[0].ip).str());
+
+  // A bogus VLAN fails the whole batch
+  entries = make_unique<std::vector<NeighborToFlush>>();
+  entries->push_back(toFlush("10.0.0.15", 1));
+  entries->push_back(toFlush("10.0.0.15", 123));
+  EXPECT_THROW(thriftHandler.flushNeighborEntries(std::move(entries)),
+               FbossError);
+  arpTable.clear();
+  thriftHandler.getArpTable(arpTable);
+  EXPECT_EQ(1, arpTable.size());
+}
+
 TEST(ArpTest, PendingArp) {
   auto sw = setupSwitch();
 
@@ -945,11 +994,14 @@ TEST(ArpTest, PendingArp) {
   counters.checkDelta(SwitchStats::kCounterPrefix + "arp.request.rx.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "arp.reply.tx.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "arp.reply.rx.sum", 0);
-  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.drops.sum", 1);
+  // The packet is held until the ARP reply comes back, rather than dropped
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.drops.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.error.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.ipv4.sum", 1);
   counters.checkDelta(SwitchStats::kCounterPrefix + "ipv4.nexthop.sum", 1);
   counters.checkDelta(SwitchStats::kCounterPrefix + "ipv4.no_arp.sum", 0);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "neighbor.hold.queued.sum",
+                      1);
 
   // Receiving this duplicate packet should NOT trigger an ARP request out,
   // and no state update for now.
@@ -971,14 +1023,19 @@ TEST(ArpTest, PendingArp) {
   counters.checkDelta(SwitchStats::kCounterPrefix + "arp.request.rx.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "arp.reply.tx.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "arp.reply.rx.sum", 0);
-  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.drops.sum", 1);
+  // The packet is held until the ARP reply comes back, rather than dropped
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.drops.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.error.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.ipv4.sum", 1);
   counters.checkDelta(SwitchStats::kCounterPrefix + "ipv4.nexthop.sum", 1);
   counters.checkDelta(SwitchStats::kCounterPrefix + "ipv4.no_arp.sum", 0);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "neighbor.hold.queued.sum",
+                      1);
 
+  // Receive an arp reply for our pending entry.  Once the hardware has the
+  // entry, both held packets are sent to be routed.
   EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
-  // Receive an arp reply for our pending entry
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(2);
   sendArpReply(sw.get(), "10.0.0.10", "02:10:20:30:40:22", 1);
 
   // The entry should now be valid instead of pending
@@ -990,8 +1047,9 @@ TEST(ArpTest, PendingArp) {
 
   // Verify that we don't ever overwrite a valid entry with a pending one.
   // Receive the same packet again, no state update and the entry should still
-  // be valid
+  // be valid.  The packet is not held for a resolved entry either.
   EXPECT_HW_CALL(sw, stateChanged(_)).Times(0);
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(0);
 
   sw->packetReceived(pkt->clone());
   waitForStateUpdates(sw.get());
@@ -999,6 +1057,11 @@ TEST(ArpTest, PendingArp) {
     ->getEntryIf(IPAddressV4("10.0.0.10"));
   EXPECT_NE(entry, nullptr);
   EXPECT_EQ(entry->isPending(), false);
+  EXPECT_EQ(0, sw->getNeighborHoldQueue()->numHeld());
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "neighbor.hold.flushed.sum",
+                      2);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.drops.sum", 1);
 };
 
 TEST(ArpTest, PendingArpCleanup) {
@@ -1066,6 +1129,138 @@ TEST(ArpTest, PendingArpCleanup) {
   EXPECT_EQ(entry2, nullptr);
 }
 
+TEST(ArpTest, CoalescePendingRequests) {
+  auto sw = setupSwitch();
+
+  VlanID vlanID(1);
+  IPAddressV4 senderIP = IPAddressV4("10.0.0.1");
+  auto state = sw->getState();
+  auto vlan = state->getVlans()->getVlanIf(vlanID);
+  auto intf = state->getInterfaces()->getInterfaceIf(RouterID(0), senderIP);
+  ASSERT_NE(intf, nullptr);
+
+  CounterCache counters(sw.get());
+
+  // Hold up the update thread, so all the requests below are queued before
+  // the pending entries are added
+  std::promise<bool> unblock;
+  auto unblocked = unblock.get_future().share();
+  sw->updateState("block updates", [=](const shared_ptr<SwitchState>&) {
+      unblocked.wait();
+      return shared_ptr<SwitchState>();
+    });
+
+  // Only one request per address is sent, and a single state update adds
+  // all the pending entries
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  const std::vector<IPAddressV4> targets = {
+    IPAddressV4("10.0.0.2"), IPAddressV4("10.0.0.3"), IPAddressV4("10.0.0.4"),
+  };
+  for (const auto& target : targets) {
+    EXPECT_PKT(sw, "ARP request",
+               checkArpRequest(senderIP, intf->getMac(), target, vlanID));
+  }
+  for (int n = 0; n < 3; ++n) {
+    for (const auto& target : targets) {
+      sw->getArpHandler()->sendArpRequest(vlan, intf, senderIP, target);
+    }
+  }
+  unblock.set_value(true);
+
+  waitForStateUpdates(sw.get());
+  auto arpTable = sw->getState()->getVlans()->getVlanIf(vlanID)->getArpTable();
+  for (const auto& target : targets) {
+    auto entry = arpTable->getEntryIf(target);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_TRUE(entry->isPending());
+  }
+
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "arp.request.tx.sum", 3);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "arp.request.suppressed.sum", 6);
+}
+
+namespace {
+
+unique_ptr<SwSwitch> setupProbingSwitch() {
+  // Probe settings are read when the switch is created
+  auto origInterval = FLAGS_neighbor_probe_interval_s;
+  FLAGS_neighbor_probe_interval_s = 1;
+  auto sw = setupSwitch();
+  FLAGS_neighbor_probe_interval_s = origInterval;
+
+  // Resolve 10.0.0.2
+  VlanID vlanID(1);
+  IPAddressV4 targetIP("10.0.0.2");
+  testSendArpRequest(sw, vlanID, IPAddressV4("10.0.0.1"), targetIP);
+  waitForStateUpdates(sw.get());
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  sendArpReply(sw.get(), "10.0.0.2", "02:10:20:30:40:22", 1);
+  waitForStateUpdates(sw.get());
+  auto entry = sw->getState()->getVlans()->getVlanIf(vlanID)->getArpTable()
+    ->getEntryIf(targetIP);
+  EXPECT_NE(entry, nullptr);
+  EXPECT_FALSE(entry->isPending());
+  return sw;
+}
+
+void waitForProbes(SwSwitch* sw, uint32_t ms) {
+  std::promise<bool> done;
+  auto* evb = sw->getBackgroundEVB();
+  evb->runInEventBaseThread([&]() {
+      evb->tryRunAfterDelay([&]() {
+        done.set_value(true);
+      }, ms);
+    });
+  done.get_future().wait();
+}
+
+} // unnamed namespace
+
+TEST(ArpTest, ProbeResolvedEntry) {
+  auto sw = setupProbingSwitch();
+  VlanID vlanID(1);
+  IPAddressV4 senderIP("10.0.0.1");
+  IPAddressV4 targetIP("10.0.0.2");
+
+  // Once the probe interval passes, a unicast ARP request goes straight to
+  // the neighbor's MAC, without touching the state.
+  CounterCache counters(sw.get());
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(0);
+  EXPECT_PKT(sw, "ARP probe",
+             checkArpPkt(true, senderIP, MacAddress("00:02:00:00:00:01"),
+                         targetIP, MacAddress("02:10:20:30:40:22"), vlanID));
+  waitForProbes(sw.get(), 1500);
+
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "neighbor.probe.tx.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "arp.request.tx.sum", 1);
+  auto entry = sw->getState()->getVlans()->getVlanIf(vlanID)->getArpTable()
+    ->getEntryIf(targetIP);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_FALSE(entry->isPending());
+}
+
+TEST(ArpTest, ProbeSkippedOnHit) {
+  auto sw = setupProbingSwitch();
+
+  // The hardware reports traffic to the neighbor, so it is not probed
+  CounterCache counters(sw.get());
+  EXPECT_HW_CALL(sw, getAndClearNeighborHits(_))
+    .WillRepeatedly(testing::Invoke([](HwSwitch::NeighborHits* hits) {
+        hits->push_back(folly::IPAddress("10.0.0.2"));
+        return true;
+      }));
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(0);
+  waitForProbes(sw.get(), 1500);
+
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "neighbor.probe.tx.sum", 0);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.probe.skipped.sum", 1);
+}
+
 TEST(ArpTest, ArpTableSerialization) {
   auto sw = setupSwitch();
 
@@ -1113,3 +1308,143 @@ TEST(ArpTest, ArpTableSerialization) {
 
   EXPECT_NE(sw, nullptr);
 }
+
+TEST(ArpTest, FloodGratuitousArp) {
+  auto sw = setupSwitch();
+
+  // One gratuitous ARP is expected for every IPv4 interface address.  The
+  // ARPs are sent as a single batch, but the mock HwSwitch still reports
+  // each packet individually.
+  int numAddrs = 0;
+  for (const auto& intf : *sw->getState()->getInterfaces()) {
+    for (const auto& addr : intf->getAddresses()) {
+      if (addr.first.isV4()) {
+        ++numAddrs;
+      }
+    }
+  }
+  EXPECT_GT(numAddrs, 0);
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(numAddrs);
+
+  sw->getArpHandler()->floodGratuituousArp();
+}
+
+TEST(ArpTest, PrefetchRouteNexthops) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_neighbor_prefetch = true;
+  auto sw = setupSwitch();
+  VlanID vlanID(1);
+  CounterCache counters(sw.get());
+
+  // The new route's nexthop is in the attached 10.0.0.0/24, so it is
+  // resolved as soon as the route is added, before any traffic is punted
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(2);
+  EXPECT_PKT(sw, "ARP request",
+             checkArpRequest(IPAddressV4("10.0.0.1"),
+                             MacAddress("00:02:00:00:00:01"),
+                             IPAddressV4("10.0.0.22"), vlanID));
+  auto addRoute = [](const shared_ptr<SwitchState>& state) {
+    RouteNextHops nexthops;
+    nexthops.emplace(IPAddress("10.0.0.22"));
+    RouteUpdater updater(state->getRouteTables());
+    updater.addRoute(RouterID(0), IPAddress("20.0.0.0"), 8, nexthops);
+    auto newState = state->clone();
+    newState->resetRouteTables(updater.updateDone());
+    return newState;
+  };
+  sw->updateStateBlocking("add route", addRoute);
+  waitForProbes(sw.get(), 0);
+  waitForStateUpdates(sw.get());
+
+  auto entry = sw->getState()->getVlans()->getVlanIf(vlanID)->getArpTable()
+    ->getEntryIf(IPAddressV4("10.0.0.22"));
+  ASSERT_NE(entry, nullptr);
+  EXPECT_TRUE(entry->isPending());
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "neighbor.prefetch.tx.sum",
+                      1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "arp.request.tx.sum", 1);
+}
+
+namespace {
+
+void sendBroadcastArpRequest(SwSwitch* sw, StringPiece senderIPStr,
+                             StringPiece senderMacStr, StringPiece targetIPStr,
+                             int port) {
+  IPAddressV4 senderIP(senderIPStr);
+  MacAddress senderMac(senderMacStr);
+  IPAddressV4 targetIP(targetIPStr);
+  VlanID vlan(1);
+
+  auto buf = IOBuf::create(68);
+  folly::io::Appender cursor(buf.get(), 0);
+  cursor.push(MacAddress::BROADCAST.bytes(), MacAddress::SIZE);
+  cursor.push(senderMac.bytes(), MacAddress::SIZE);
+  cursor.writeBE<uint16_t>(0x8100); // 802.1Q
+  cursor.writeBE<uint16_t>(static_cast<uint16_t>(vlan));
+  cursor.writeBE<uint16_t>(0x0806); // ARP
+  cursor.writeBE<uint16_t>(1); // htype: ethernet
+  cursor.writeBE<uint16_t>(0x0800); // ptype: IPv4
+  cursor.writeBE<uint8_t>(6); // hlen: 6
+  cursor.writeBE<uint8_t>(4); // plen: 4
+  cursor.writeBE<uint16_t>(1); // ARP request
+  cursor.push(senderMac.bytes(), MacAddress::SIZE); // sender MAC
+  cursor.write<uint32_t>(senderIP.toLong()); // sender IP
+  cursor.push(MacAddress::ZERO.bytes(), MacAddress::SIZE); // target MAC
+  cursor.write<uint32_t>(targetIP.toLong()); // target IP
+
+  auto pkt = make_unique<MockRxPacket>(std::move(buf));
+  pkt->padToLength(68);
+  pkt->setSrcPort(PortID(port));
+  pkt->setSrcVlan(vlan);
+  sw->packetReceived(std::move(pkt));
+}
+
+} // unnamed namespace
+
+TEST(ArpTest, NeighborSuppression) {
+  auto sw = setupSwitch();
+
+  // Turn on the suppression, with 10.0.0.2 known on port 2
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  auto enable = [](const shared_ptr<SwitchState>& state) {
+    shared_ptr<SwitchState> newState{state};
+    auto* vlan = state->getVlans()->getVlan(VlanID(1)).get();
+    auto* arpTable = vlan->getArpTable()->modify(&vlan, &newState);
+    arpTable->addEntry(IPAddressV4("10.0.0.2"),
+                       MacAddress("02:10:20:30:40:22"), PortID(2),
+                       InterfaceID(1));
+    newState->setNeighborSuppression(true);
+    return newState;
+  };
+  sw->updateStateBlocking("neighbor suppression", enable);
+  CounterCache counters(sw.get());
+
+  // The request for the known host is answered with its MAC, back out of
+  // the port it came in on
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(0);
+  EXPECT_HW_CALL(sw, sendPacketOutOfPort_(TxPacketMatcher::createMatcher(
+      "ARP reply", checkArpReply("10.0.0.2", "02:10:20:30:40:22",
+                                 "10.0.0.15", "02:10:20:30:40:15",
+                                 VlanID(1))))).Times(1);
+  sendBroadcastArpRequest(sw.get(), "10.0.0.15", "02:10:20:30:40:15",
+                          "10.0.0.2", 3);
+  counters.update();
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.suppressed.sum", 1);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.flooded.sum", 0);
+
+  // The requests for unknown hosts, and the probes of hosts checking that
+  // an address is free, are flooded out of the other 8 ports of the VLAN
+  EXPECT_HW_CALL(sw, sendPacketOutOfPort_(_)).Times(16);
+  sendBroadcastArpRequest(sw.get(), "10.0.0.15", "02:10:20:30:40:15",
+                          "10.0.0.3", 3);
+  sendBroadcastArpRequest(sw.get(), "0.0.0.0", "02:10:20:30:40:15",
+                          "10.0.0.2", 3);
+  counters.update();
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.suppressed.sum", 0);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.flooded.sum", 2);
+}
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/BfdManager.h"
+
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/hw/mock/MockPlatform.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::ByteRange;
+using folly::IPAddress;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+typedef BfdManager::State State;
+
+namespace {
+
+BfdSessionConfig makeConfig(const char* peer) {
+  BfdSessionConfig config;
+  config.peer = IPAddress(peer);
+  config.minTxInterval = milliseconds(50);
+  config.minRxInterval = milliseconds(50);
+  config.multiplier = 3;
+  return config;
+}
+
+}
+
+TEST(BfdManager, packetRoundTrip) {
+  BfdManager::ControlPacket pkt;
+  pkt.diag = BfdManager::DIAG_DETECT_TIMEOUT;
+  pkt.state = State::INIT;
+  pkt.poll = true;
+  pkt.detectMult = 3;
+  pkt.myDiscriminator = 0x01020304;
+  pkt.yourDiscriminator = 0xa0b0c0d0;
+  pkt.desiredMinTx = 50000;
+  pkt.requiredMinRx = 1000000;
+
+  uint8_t buf[BfdManager::kPacketLength];
+  BfdManager::writePacket(pkt, buf);
+  EXPECT_EQ(0x21, buf[0]);
+  EXPECT_EQ(0xa0, buf[1]);
+  EXPECT_EQ(3, buf[2]);
+  EXPECT_EQ(24, buf[3]);
+  EXPECT_EQ(0x01, buf[4]);
+  EXPECT_EQ(0x04, buf[7]);
+
+  BfdManager::ControlPacket pktBack;
+  ASSERT_TRUE(BfdManager::parsePacket(ByteRange(buf, sizeof(buf)),
+                                      &pktBack));
+  EXPECT_EQ(pkt.diag, pktBack.diag);
+  EXPECT_EQ(pkt.state, pktBack.state);
+  EXPECT_TRUE(pktBack.poll);
+  EXPECT_FALSE(pktBack.final);
+  EXPECT_EQ(pkt.detectMult, pktBack.detectMult);
+  EXPECT_EQ(pkt.myDiscriminator, pktBack.myDiscriminator);
+  EXPECT_EQ(pkt.yourDiscriminator, pktBack.yourDiscriminator);
+  EXPECT_EQ(pkt.desiredMinTx, pktBack.desiredMinTx);
+  EXPECT_EQ(pkt.requiredMinRx, pktBack.requiredMinRx);
+}
+
+TEST(BfdManager, parseInvalid) {
+  BfdManager::ControlPacket pkt;
+  pkt.detectMult = 3;
+  pkt.myDiscriminator = 1;
+  uint8_t buf[BfdManager::kPacketLength];
+  BfdManager::writePacket(pkt, buf);
+  ASSERT_TRUE(BfdManager::parsePacket(ByteRange(buf, sizeof(buf)), &pkt));
+
+  // Truncated
+  EXPECT_FALSE(BfdManager::parsePacket(ByteRange(buf, 20), &pkt));
+  // Another version
+  buf[0] = 0x40;
+  EXPECT_FALSE(BfdManager::parsePacket(ByteRange(buf, sizeof(buf)), &pkt));
+  buf[0] = 0x20;
+  // Authenticated
+  buf[1] |= 0x04;
+  EXPECT_FALSE(BfdManager::parsePacket(ByteRange(buf, sizeof(buf)), &pkt));
+  buf[1] &= ~0x04;
+  // A zero detect multiplier
+  buf[2] = 0;
+  EXPECT_FALSE(BfdManager::parsePacket(ByteRange(buf, sizeof(buf)), &pkt));
+  buf[2] = 3;
+  // No discriminator of its own
+  buf[7] = 0;
+  EXPECT_FALSE(BfdManager::parsePacket(ByteRange(buf, sizeof(buf)), &pkt));
+}
+
+TEST(BfdManager, sessionStateMachine) {
+  BfdManager::Session a(makeConfig("10.0.0.2"), 100);
+  BfdManager::Session b(makeConfig("10.0.0.1"), 200);
+  auto now = steady_clock::now();
+
+  // The three way handshake
+  EXPECT_FALSE(b.receive(a.makePacket(false), now));
+  EXPECT_EQ(State::INIT, b.getState());
+  EXPECT_EQ(100, b.getRemoteDiscriminator());
+  a.receive(b.makePacket(false), now);
+  EXPECT_EQ(State::UP, a.getState());
+  b.receive(a.makePacket(false), now);
+  EXPECT_EQ(State::UP, b.getState());
+  a.receive(b.makePacket(false), now);
+
+  // Once up, packets are sent at the configured rate
+  auto pkt = a.makePacket(false);
+  EXPECT_EQ(50000, pkt.desiredMinTx);
+  EXPECT_EQ(200, pkt.yourDiscriminator);
+  a.scheduleTx(now);
+  EXPECT_LE(a.getNextTx(), now + milliseconds(50));
+  EXPECT_GE(a.getNextTx(), now + milliseconds(37));
+
+  // Nothing heard for three intervals
+  a.checkTimeout(now + milliseconds(149));
+  EXPECT_EQ(State::UP, a.getState());
+  a.checkTimeout(now + milliseconds(150));
+  EXPECT_EQ(State::DOWN, a.getState());
+  EXPECT_EQ(0, a.getRemoteDiscriminator());
+  pkt = a.makePacket(false);
+  EXPECT_EQ(BfdManager::DIAG_DETECT_TIMEOUT, pkt.diag);
+  EXPECT_EQ(1000000, pkt.desiredMinTx);
+  EXPECT_EQ(now + milliseconds(150), a.getNextTx());
+
+  // The peer hears that we went down
+  b.receive(pkt, now + milliseconds(150));
+  EXPECT_EQ(State::DOWN, b.getState());
+  EXPECT_EQ(BfdManager::DIAG_NEIGHBOR_DOWN, b.makePacket(false).diag);
+}
+
+TEST(BfdManager, pollIsAnswered) {
+  BfdManager::Session a(makeConfig("10.0.0.2"), 100);
+  BfdManager::ControlPacket pkt;
+  pkt.state = State::DOWN;
+  pkt.poll = true;
+  pkt.detectMult = 3;
+  pkt.myDiscriminator = 7;
+  pkt.desiredMinTx = 1000000;
+  pkt.requiredMinRx = 1000000;
+  EXPECT_TRUE(a.receive(pkt, steady_clock::now()));
+  EXPECT_TRUE(a.makePacket(true).final);
+}
+
+TEST(BfdManager, applyConfig) {
+  MockPlatform platform;
+  auto stateV0 = std::make_shared<SwitchState>();
+
+  cfg::SwitchConfig config;
+  config.bfdSessions.resize(2);
+  config.bfdSessions[0].peer = "10.0.0.2";
+  config.bfdSessions[1].peer = "2401:db00::2";
+  config.bfdSessions[1].minRxIntervalMs = 300;
+  auto stateV1 = publishAndApplyConfig(stateV0, &config, &platform);
+  ASSERT_NE(nullptr, stateV1);
+  const auto& sessions = stateV1->getBfdSessions();
+  ASSERT_EQ(2, sessions.size());
+  EXPECT_EQ(IPAddress("10.0.0.2"), sessions[0].peer);
+  EXPECT_EQ(milliseconds(100), sessions[0].minTxInterval);
+  EXPECT_EQ(3, sessions[0].multiplier);
+  EXPECT_EQ(milliseconds(300), sessions[1].minRxInterval);
+  EXPECT_EQ(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+
+  config.bfdSessions[1].peer = "10.0.0.2";
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &config, &platform),
+               FbossError);
+  config.bfdSessions[1].routerID = 1;
+  EXPECT_NE(nullptr, publishAndApplyConfig(stateV1, &config, &platform));
+  config.bfdSessions[1].multiplier = 0;
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &config, &platform),
+               FbossError);
+  config.bfdSessions[1].multiplier = 3;
+  config.bfdSessions[1].minTxIntervalMs = 0;
+  EXPECT_THROW(publishAndApplyConfig(stateV1, &config, &platform),
+               FbossError);
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/BootTimeline.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace {
+
+const BootTimeline::Phase* findPhase(
+    const std::vector<BootTimeline::Phase>& phases, const std::string& name) {
+  for (const auto& phase : phases) {
+    if (phase.name == name) {
+      return &phase;
+    }
+  }
+  return nullptr;
+}
+
+} // unnamed namespace
+
+TEST(BootTimeline, RecordsPhases) {
+  auto* timeline = BootTimeline::get();
+  auto start = steady_clock::now();
+  timeline->recordPhase("test_phase", start, start + milliseconds(25));
+  {
+    BootTimeline::PhaseTimer timer("test_timer");
+  }
+
+  auto phases = timeline->getPhases();
+  auto* phase = findPhase(phases, "test_phase");
+  ASSERT_NE(nullptr, phase);
+  EXPECT_EQ(milliseconds(25), phase->duration);
+  EXPECT_LE(milliseconds(0), phase->start);
+  auto* timed = findPhase(phases, "test_timer");
+  ASSERT_NE(nullptr, timed);
+  EXPECT_LE(phase->start, timed->start);
+  // Phases are listed in the order they finished
+  EXPECT_LT(phase, timed);
+}
+
+TEST(BootTimeline, KeepsFirstTiming) {
+  auto* timeline = BootTimeline::get();
+  auto start = steady_clock::now();
+  timeline->recordPhase("test_once", start, start + milliseconds(10));
+  timeline->recordPhase("test_once", start, start + milliseconds(500));
+
+  auto phases = timeline->getPhases();
+  size_t count = 0;
+  for (const auto& phase : phases) {
+    if (phase.name == "test_once") {
+      EXPECT_EQ(milliseconds(10), phase.duration);
+      ++count;
+    }
+  }
+  EXPECT_EQ(1, count);
+}
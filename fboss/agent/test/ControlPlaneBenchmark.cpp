@@ -0,0 +1,470 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/AddressUtil.h"
+#include "fboss/agent/ApplyThriftConfig.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/ThriftHandler.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+#include "fboss/agent/hw/sim/SimPlatform.h"
+#include "fboss/agent/packet/EthHdr.h"
+#include "fboss/agent/packet/ICMPHdr.h"
+#include "fboss/agent/packet/IPv6Hdr.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/RouteUpdater.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/gen-cpp/switch_config_types.h"
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <folly/Memory.h>
+#include <folly/io/Cursor.h>
+#include <gflags/gflags.h>
+
+/*
+ * End-to-end benchmarks of the control plane, run against a SwSwitch on a
+ * SimPlatform.  SimSwitch programs nothing, so these measure the SwSwitch
+ * side of each operation: building the new state, applying it on the update
+ * thread, and notifying the HwSwitch and the state observers.  The
+ * --sim_sdk_*_us flags make SimSwitch take as long as a real SDK would.
+ *
+ * Route updates go through the same code as the thrift calls.  The
+ * asynchronous bulk calls need a thrift request context to reply to, so
+ * syncFib is driven through RouteUpdater::syncClientRoutes() in a blocking
+ * state update, exactly as ThriftHandler::async_tm_syncFib() applies it.
+ *
+ * Run with --json to print the results as a JSON object mapping each
+ * benchmark to its time per iteration in nanoseconds, which can be compared
+ * between builds to catch regressions.
+ */
+
+DEFINE_int32(bench_ports, 64, "The number of ports on the simulated switch");
+
+using namespace facebook::fboss;
+using facebook::network::toBinaryAddress;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using folly::make_unique;
+using std::make_shared;
+using std::shared_ptr;
+using std::unique_ptr;
+
+namespace {
+
+const MacAddress kPlatformMac("02:01:02:03:04:05");
+const VlanID kVlan(1);
+const InterfaceID kIntf(1);
+const RouterID kRouter(0);
+const int16_t kClient = 1;
+const IPAddressV4 kIntfV4("10.0.0.1");
+const IPAddressV6 kIntfV6("2401:db00:2110:3001::1");
+
+// A config with one VLAN and interface per numVlans, spread over all ports.
+// Interface 1 is on VLAN 1, with kIntfV4/16 and kIntfV6/64.
+cfg::SwitchConfig makeConfig(uint32_t numVlans) {
+  cfg::SwitchConfig config;
+  config.arpAgerInterval = 3600;
+  config.vlans.resize(numVlans);
+  config.interfaces.resize(numVlans);
+  for (uint32_t n = 0; n < numVlans; ++n) {
+    auto& vlan = config.vlans[n];
+    vlan.id = n + 1;
+    vlan.name = folly::to<std::string>("Vlan", n + 1);
+    vlan.routable = true;
+
+    auto& intf = config.interfaces[n];
+    intf.intfID = n + 1;
+    intf.vlanID = n + 1;
+    intf.name = folly::to<std::string>("Interface", n + 1);
+    intf.ipAddresses.resize(2);
+    if (n == 0) {
+      intf.ipAddresses[0] = kIntfV4.str() + "/16";
+      intf.ipAddresses[1] = kIntfV6.str() + "/64";
+    } else {
+      // Out of the way of VLAN 1 and of the routes below
+      intf.ipAddresses[0] = IPAddressV4::fromLongHBO(
+          0xac100001 + (n << 8)).str() + "/24";
+      intf.ipAddresses[1] = folly::to<std::string>(
+          "2401:db00:2111:", folly::format("{:x}", n).str(), "::1/64");
+    }
+  }
+
+  auto numPorts = std::max(1, FLAGS_bench_ports);
+  config.ports.resize(numPorts);
+  config.vlanPorts.resize(numPorts);
+  for (int n = 0; n < numPorts; ++n) {
+    uint32_t vlanID = n % numVlans + 1;
+    auto& port = config.ports[n];
+    port.logicalID = n + 1;
+    port.state = cfg::PortState::UP;
+    port.routable = true;
+    port.ingressVlan = vlanID;
+
+    auto& vlanPort = config.vlanPorts[n];
+    vlanPort.vlanID = vlanID;
+    vlanPort.logicalPort = n + 1;
+    vlanPort.spanningTreeState = cfg::SpanningTreeState::FORWARDING;
+    vlanPort.emitTags = false;
+  }
+  return config;
+}
+
+void applyConfig(SwSwitch* sw, const cfg::SwitchConfig& config) {
+  sw->updateStateBlocking("apply config",
+                          [&](const shared_ptr<SwitchState>& state) {
+    return applyThriftConfig(state, &config, sw->getPlatform());
+  });
+}
+
+// A configured and FIB synced switch, with a single VLAN and interface
+unique_ptr<SwSwitch> setupSwitch() {
+  auto sw = make_unique<SwSwitch>(
+      make_unique<SimPlatform>(kPlatformMac, std::max(1, FLAGS_bench_ports)));
+  sw->init();
+  applyConfig(sw.get(), makeConfig(1));
+  sw->initialConfigApplied();
+  sw->fibSynced();
+  return sw;
+}
+
+void resetSwitch(unique_ptr<SwSwitch>* sw) {
+  // Keep the teardown out of the measurement
+  BENCHMARK_SUSPEND {
+    sw->reset();
+  }
+}
+
+IPAddress networkOf(uint32_t n) {
+  // /24 prefixes from 11.0.0.0 up, outside of all interface subnets
+  return IPAddress(IPAddressV4::fromLongHBO(0x0b000000 + (n << 8)));
+}
+
+RouteNextHops nexthopsOf(uint32_t n) {
+  RouteNextHops nexthops;
+  nexthops.emplace(IPAddressV4::fromLongHBO(kIntfV4.toLongHBO() + 1 + n % 2));
+  return nexthops;
+}
+
+RouteUpdater::ClientRoutes makeClientRoutes(uint32_t begin, uint32_t end) {
+  RouteUpdater::ClientRoutes routes;
+  for (uint32_t n = begin; n < end; ++n) {
+    routes.add(networkOf(n), 24, RouteNextHopEntry(nexthopsOf(n), 20));
+  }
+  return routes;
+}
+
+void syncRoutes(SwSwitch* sw, RouteUpdater::ClientRoutes routes) {
+  // Moved in rather than captured, since the update may outlive the call
+  auto toSync = std::make_shared<RouteUpdater::ClientRoutes>(
+      std::move(routes));
+  sw->updateStateBlocking("sync fib",
+                          [=](const shared_ptr<SwitchState>& state) {
+    RouteUpdater updater(state->getRouteTables());
+    updater.syncClientRoutes(kRouter, ClientID(kClient), std::move(*toSync));
+    auto newRt = updater.updateDone();
+    if (!newRt) {
+      return shared_ptr<SwitchState>();
+    }
+    auto newState = state->clone();
+    newState->resetRouteTables(std::move(newRt));
+    return newState;
+  });
+}
+
+// An ARP reply to kIntfV4 from the n-th host on VLAN 1
+unique_ptr<MockRxPacket> makeArpReply(uint32_t n) {
+  auto senderIP = IPAddressV4::fromLongHBO(kIntfV4.toLongHBO() + 1 + n);
+  auto senderMac = MacAddress::fromHBO(0x020000000000 + n);
+  const size_t len = 46;
+  auto buf = folly::IOBuf::create(len);
+  buf->append(len);
+  folly::io::RWPrivateCursor cursor(buf.get());
+  cursor.push(kPlatformMac.bytes(), MacAddress::SIZE);
+  cursor.push(senderMac.bytes(), MacAddress::SIZE);
+  cursor.writeBE<uint16_t>(0x8100);
+  cursor.writeBE<uint16_t>(static_cast<uint16_t>(kVlan));
+  cursor.writeBE<uint16_t>(0x0806);
+  // htype: ethernet, ptype: IPv4, hlen: 6, plen: 4, op: reply
+  cursor.writeBE<uint16_t>(1);
+  cursor.writeBE<uint16_t>(0x0800);
+  cursor.writeBE<uint8_t>(6);
+  cursor.writeBE<uint8_t>(4);
+  cursor.writeBE<uint16_t>(2);
+  cursor.push(senderMac.bytes(), MacAddress::SIZE);
+  cursor.push(senderIP.bytes(), IPAddressV4::byteCount());
+  cursor.push(kPlatformMac.bytes(), MacAddress::SIZE);
+  cursor.push(kIntfV4.bytes(), IPAddressV4::byteCount());
+
+  auto pkt = make_unique<MockRxPacket>(std::move(buf));
+  pkt->padToLength(68);
+  pkt->setSrcPort(PortID(1));
+  pkt->setSrcVlan(kVlan);
+  return pkt;
+}
+
+// A neighbor advertisement to kIntfV6 from the n-th host on VLAN 1
+unique_ptr<MockRxPacket> makeNeighborAdvert(uint32_t n) {
+  auto bytes = kIntfV6.toByteArray();
+  uint32_t host = n + 2;
+  for (int i = 0; i < 4; ++i) {
+    bytes[15 - i] = (host >> (8 * i)) & 0xff;
+  }
+  IPAddressV6 srcIP(bytes);
+  auto srcMac = MacAddress::fromHBO(0x020100000000 + n);
+  const size_t plen = 20;
+
+  IPv6Hdr ipv6(srcIP, kIntfV6);
+  ipv6.trafficClass = 0xe0;
+  ipv6.payloadLength = ICMPHdr::SIZE + plen;
+  ipv6.nextHeader = IP_PROTO_IPV6_ICMP;
+  ipv6.hopLimit = 255;
+
+  size_t totalLen = EthHdr::SIZE + IPv6Hdr::SIZE + ipv6.payloadLength;
+  auto buf = folly::IOBuf::create(totalLen);
+  buf->append(totalLen);
+  folly::io::RWPrivateCursor cursor(buf.get());
+  auto bodyFn = [&](folly::io::RWPrivateCursor* c) {
+    c->writeBE<uint32_t>(0);
+    c->push(srcIP.bytes(), IPAddressV6::byteCount());
+  };
+  ICMPHdr icmp6(ICMPV6_TYPE_NDP_NEIGHBOR_ADVERTISEMENT, 0, 0);
+  icmp6.serializeFullPacket(&cursor, kPlatformMac, srcMac, kVlan, ipv6,
+                            plen, bodyFn);
+
+  auto pkt = make_unique<MockRxPacket>(std::move(buf));
+  pkt->padToLength(totalLen);
+  pkt->setSrcPort(PortID(1));
+  pkt->setSrcVlan(kVlan);
+  return pkt;
+}
+
+void learnNeighbors(size_t numIters, uint32_t numNeighbors,
+                    unique_ptr<MockRxPacket> (*makePacket)(uint32_t)) {
+  unique_ptr<SwSwitch> sw;
+  std::vector<unique_ptr<MockRxPacket>> pkts;
+  BENCHMARK_SUSPEND {
+    sw = setupSwitch();
+    for (uint32_t n = 0; n < numNeighbors; ++n) {
+      pkts.push_back(makePacket(n));
+    }
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    BENCHMARK_SUSPEND {
+      // Forget the neighbors learned by the previous iteration
+      sw->updateStateBlocking("clear neighbors",
+                              [](const shared_ptr<SwitchState>& state) {
+        shared_ptr<SwitchState> newState{state};
+        auto vlan = state->getVlans()->getVlan(kVlan)->modify(&newState);
+        vlan->setArpTable(make_shared<ArpTable>());
+        vlan->setNdpTable(make_shared<NdpTable>());
+        return newState;
+      });
+    }
+    for (const auto& pkt : pkts) {
+      sw->packetReceived(pkt->clone());
+    }
+    // Learning is done once the updates it scheduled have been applied
+    sw->updateStateBlocking("wait", [](const shared_ptr<SwitchState>&) {
+      return shared_ptr<SwitchState>();
+    });
+  }
+  BENCHMARK_SUSPEND {
+    CHECK_EQ(numNeighbors,
+             sw->getState()->getVlans()->getVlan(kVlan)->getArpTable()->size() +
+             sw->getState()->getVlans()->getVlan(kVlan)->getNdpTable()->size());
+  }
+  resetSwitch(&sw);
+}
+
+void arpLearning(size_t numIters, uint32_t numNeighbors) {
+  learnNeighbors(numIters, numNeighbors, makeArpReply);
+}
+
+void ndpLearning(size_t numIters, uint32_t numNeighbors) {
+  learnNeighbors(numIters, numNeighbors, makeNeighborAdvert);
+}
+
+// Install numRoutes routes into an empty FIB, as the first sync at boot does
+void syncFib(size_t numIters, uint32_t numRoutes) {
+  unique_ptr<SwSwitch> sw;
+  BENCHMARK_SUSPEND {
+    sw = setupSwitch();
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    RouteUpdater::ClientRoutes routes;
+    BENCHMARK_SUSPEND {
+      syncRoutes(sw.get(), RouteUpdater::ClientRoutes());
+      routes = makeClientRoutes(0, numRoutes);
+    }
+    syncRoutes(sw.get(), std::move(routes));
+  }
+  resetSwitch(&sw);
+}
+
+// Add and then delete one route at a time, with numRoutes routes in the FIB
+void routeChurn(size_t numIters, uint32_t numRoutes) {
+  unique_ptr<SwSwitch> sw;
+  unique_ptr<ThriftHandler> handler;
+  BENCHMARK_SUSPEND {
+    sw = setupSwitch();
+    handler = make_unique<ThriftHandler>(sw.get());
+    syncRoutes(sw.get(), makeClientRoutes(0, numRoutes));
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    auto network = networkOf(numRoutes + iter % 1024);
+    auto route = make_unique<UnicastRoute>();
+    route->dest.ip = toBinaryAddress(network);
+    route->dest.prefixLength = 24;
+    for (const auto& nexthop : nexthopsOf(iter)) {
+      route->nextHopAddrs.push_back(toBinaryAddress(nexthop));
+    }
+    handler->addUnicastRoute(kClient, std::move(route));
+
+    auto prefix = make_unique<IpPrefix>();
+    prefix->ip = toBinaryAddress(network);
+    prefix->prefixLength = 24;
+    handler->deleteUnicastRoute(kClient, std::move(prefix));
+  }
+  BENCHMARK_SUSPEND {
+    handler.reset();
+  }
+  resetSwitch(&sw);
+}
+
+// Fetch the full route table, with numRoutes routes in the FIB
+void getRouteTable(size_t numIters, uint32_t numRoutes) {
+  unique_ptr<SwSwitch> sw;
+  unique_ptr<ThriftHandler> handler;
+  BENCHMARK_SUSPEND {
+    sw = setupSwitch();
+    handler = make_unique<ThriftHandler>(sw.get());
+    syncRoutes(sw.get(), makeClientRoutes(0, numRoutes));
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    std::vector<UnicastRoute> routes;
+    handler->getRouteTable(routes);
+    folly::doNotOptimizeAway(routes);
+  }
+  BENCHMARK_SUSPEND {
+    handler.reset();
+  }
+  resetSwitch(&sw);
+}
+
+/*
+ * Expire numEntries pending ARP entries at once.  This is the state update
+ * the neighbor ager schedules for all entries that expire in the same tick;
+ * the ager itself is kept out of the way by the long arpAgerInterval.
+ */
+void neighborAging(size_t numIters, uint32_t numEntries) {
+  unique_ptr<SwSwitch> sw;
+  std::vector<IPAddressV4> ips;
+  BENCHMARK_SUSPEND {
+    sw = setupSwitch();
+    for (uint32_t n = 0; n < numEntries; ++n) {
+      ips.push_back(IPAddressV4::fromLongHBO(kIntfV4.toLongHBO() + 1 + n));
+    }
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    BENCHMARK_SUSPEND {
+      sw->updateStateBlocking("add pending entries",
+                              [&](const shared_ptr<SwitchState>& state) {
+        shared_ptr<SwitchState> newState{state};
+        auto vlan = state->getVlans()->getVlan(kVlan).get();
+        auto arpTable = vlan->getArpTable()->modify(&vlan, &newState);
+        for (const auto& ip : ips) {
+          arpTable->addPendingEntry(ip, kIntf);
+        }
+        return newState;
+      });
+    }
+    sw->updateStateBlocking("prune pending entries",
+                            [&](const shared_ptr<SwitchState>& state) {
+      shared_ptr<SwitchState> newState{state};
+      auto vlan = state->getVlans()->getVlan(kVlan).get();
+      auto arpTable = vlan->getArpTable()->modify(&vlan, &newState);
+      arpTable->prunePendingEntries(ips);
+      return newState;
+    });
+  }
+  BENCHMARK_SUSPEND {
+    CHECK_EQ(0,
+             sw->getState()->getVlans()->getVlan(kVlan)->getArpTable()->size());
+  }
+  resetSwitch(&sw);
+}
+
+// Apply a config with numVlans VLANs and interfaces to a fresh switch
+void applyConfigAtScale(size_t numIters, uint32_t numVlans) {
+  unique_ptr<SwSwitch> sw;
+  cfg::SwitchConfig config;
+  cfg::SwitchConfig minimal;
+  BENCHMARK_SUSPEND {
+    sw = setupSwitch();
+    config = makeConfig(numVlans);
+    minimal = makeConfig(1);
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    applyConfig(sw.get(), config);
+    BENCHMARK_SUSPEND {
+      applyConfig(sw.get(), minimal);
+    }
+  }
+  resetSwitch(&sw);
+}
+
+} // unnamed namespace
+
+BENCHMARK_PARAM(syncFib, 10000)
+BENCHMARK_PARAM(syncFib, 100000)
+BENCHMARK_PARAM(syncFib, 500000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(routeChurn, 10000)
+BENCHMARK_PARAM(routeChurn, 100000)
+BENCHMARK_PARAM(routeChurn, 500000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(getRouteTable, 10000)
+BENCHMARK_PARAM(getRouteTable, 100000)
+BENCHMARK_PARAM(getRouteTable, 500000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(arpLearning, 1000)
+BENCHMARK_PARAM(arpLearning, 10000)
+BENCHMARK_PARAM(ndpLearning, 1000)
+BENCHMARK_PARAM(ndpLearning, 10000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(neighborAging, 1000)
+BENCHMARK_PARAM(neighborAging, 10000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(applyConfigAtScale, 16)
+BENCHMARK_PARAM(applyConfigAtScale, 256)
+BENCHMARK_PARAM(applyConfigAtScale, 1024)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
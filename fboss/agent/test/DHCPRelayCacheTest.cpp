@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/DHCPRelayCache.h"
+
+#include "fboss/agent/packet/IPProto.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <folly/io/Cursor.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+
+TEST(DHCPRelayCache, Lookups) {
+  auto state = testStateA();
+  auto vlan1 = state->getVlans()->getVlan(VlanID(1));
+  vlan1->setDhcpV4Relay(IPAddressV4("20.20.20.20"));
+  vlan1->setDhcpV6Relay(IPAddressV6("2401:db00::20"));
+  DhcpV4OverrideMap overrides;
+  overrides[MacAddress("02:00:00:00:00:03")] = IPAddressV4("30.30.30.30");
+  vlan1->setDhcpV4RelayOverrides(overrides);
+  state->publish();
+
+  DHCPRelayCache cache;
+  auto relays = cache.get(state);
+  auto relay = relays->getVlan(VlanID(1));
+  ASSERT_NE(nullptr, relay);
+  EXPECT_EQ(IPAddressV4("20.20.20.20"),
+            relay->getServerV4(MacAddress("02:00:00:00:00:02")));
+  EXPECT_EQ(IPAddressV4("30.30.30.30"),
+            relay->getServerV4(MacAddress("02:00:00:00:00:03")));
+  EXPECT_EQ(IPAddressV6("2401:db00::20"),
+            relay->getServerV6(MacAddress("02:00:00:00:00:03")));
+  EXPECT_EQ(IPAddressV4("10.0.0.1"), relay->switchIpV4);
+  EXPECT_EQ(IPAddressV6("2401:db00:2110:3001::0001"), relay->switchIpV6);
+  EXPECT_EQ(nullptr, relays->getVlan(VlanID(2)));
+  EXPECT_EQ(nullptr, relays->getVlan(VlanID(4000)));
+
+  VlanID vlan;
+  EXPECT_TRUE(relays->getReplyVlan(IPAddress("10.0.55.1"), &vlan));
+  EXPECT_EQ(VlanID(55), vlan);
+  EXPECT_FALSE(relays->getReplyVlan(IPAddress("10.0.55.2"), &vlan));
+
+  // The same state gets the same snapshot
+  EXPECT_EQ(relays, cache.get(state));
+}
+
+TEST(DHCPRelayCache, UpdatesChangedVlans) {
+  auto state = testStateA();
+  state->publish();
+  DHCPRelayCache cache;
+  auto relays = cache.get(state);
+
+  // A state without VLAN or interface changes reuses the snapshot
+  auto newState = state->clone();
+  newState->publish();
+  EXPECT_EQ(relays, cache.get(newState));
+
+  // Changing one VLAN only rebuilds its entry
+  newState = state;
+  auto vlan55 = newState->getVlans()->getVlan(VlanID(55))->modify(&newState);
+  vlan55->setDhcpV4Relay(IPAddressV4("20.20.20.20"));
+  newState->publish();
+  auto newRelays = cache.get(newState);
+  EXPECT_NE(relays, newRelays);
+  EXPECT_EQ(relays->getVlan(VlanID(1)), newRelays->getVlan(VlanID(1)));
+  EXPECT_TRUE(relays->getVlan(VlanID(55))->serverV4.isZero());
+  EXPECT_EQ(IPAddressV4("20.20.20.20"),
+            newRelays->getVlan(VlanID(55))->serverV4);
+}
+
+TEST(DHCPRelayCache, RelaysToAllServersV6) {
+  auto state = testStateA();
+  auto vlan1 = state->getVlans()->getVlan(VlanID(1));
+  vlan1->setDhcpV6Relay(IPAddressV6("2401:db00::20"));
+  vlan1->setDhcpV6ExtraRelays({IPAddressV6("2401:db00::21"),
+                               IPAddressV6("2401:db00::20"),
+                               IPAddressV6("2401:db00::22")});
+  DhcpV6OverrideMap overrides;
+  overrides[MacAddress("02:00:00:00:00:03")] = IPAddressV6("2401:db00::30");
+  vlan1->setDhcpV6RelayOverrides(overrides);
+  state->publish();
+
+  DHCPRelayCache cache;
+  auto relay = cache.get(state)->getVlan(VlanID(1));
+  ASSERT_NE(nullptr, relay);
+
+  // The servers are relayed to in order, without duplicates
+  auto servers = relay->getServersV6(MacAddress("02:00:00:00:00:02"));
+  ASSERT_EQ(3, servers.size());
+  EXPECT_EQ(IPAddressV6("2401:db00::20"), servers[0]);
+  EXPECT_EQ(IPAddressV6("2401:db00::21"), servers[1]);
+  EXPECT_EQ(IPAddressV6("2401:db00::22"), servers[2]);
+  // Clients with an override are only relayed to it
+  servers = relay->getServersV6(MacAddress("02:00:00:00:00:03"));
+  ASSERT_EQ(1, servers.size());
+  EXPECT_EQ(IPAddressV6("2401:db00::30"), servers[0]);
+
+  // The prebuilt headers come from the switch address
+  folly::IOBuf buf(folly::IOBuf::WRAP_BUFFER, relay->relayHeaderV6.data(),
+                   relay->relayHeaderV6.size());
+  folly::io::Cursor cursor(&buf);
+  IPv6Hdr ipHdr(cursor);
+  EXPECT_EQ(relay->switchIpV6, ipHdr.srcAddr);
+  EXPECT_TRUE(ipHdr.dstAddr.isZero());
+  EXPECT_EQ(IP_PROTO_UDP, ipHdr.nextHeader);
+  EXPECT_EQ(255, ipHdr.hopLimit);
+  EXPECT_EQ(547, cursor.readBE<uint16_t>());
+  EXPECT_EQ(547, cursor.readBE<uint16_t>());
+  EXPECT_EQ(ipHdr.pseudoHdrPartialCsum(0) + 547 + 547,
+            relay->relayHeaderV6Csum);
+}
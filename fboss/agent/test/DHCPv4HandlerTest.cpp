@@ -38,6 +38,7 @@
 #include "fboss/agent/test/TestUtils.h"
 
 #include <boost/cast.hpp>
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 
 using namespace facebook::fboss;
@@ -55,6 +56,8 @@ using std::replace;
 using ::testing::_;
 using testing::Return;
 
+DECLARE_bool(dhcp_relay_fast_path);
+
 
 namespace {
 const IPAddressV4 kVlanInterfaceIP("10.0.0.1");
@@ -338,9 +341,78 @@ TEST(DHCPv4HandlerTest, DHCPRequest) {
 
   counters.update();
   counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.pkt.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.fast_path.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.slow_path.sum", 0);
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.pkts.sum", 1);
 }
 
+TEST(DHCPv4HandlerTest, DHCPRequestMaxMessageSize) {
+  auto sw = setupSwitch();
+  const char* senderIP = "00 00 00 00";
+  auto senderMac = kClientMac.toString();
+  std::replace(senderMac.begin(), senderMac.end(), ':', ' ');
+  const string targetMac = "ff ff ff ff ff ff";
+  const string targetIP = "ff ff ff ff";
+  const string bootpOp = "01";
+  const string vlan = "00 01";
+  const string srcPort = "00 43";
+  const string dstPort = "00 44";
+  const string dhcpMsgTypeOpt = "35  01  01";
+  // Requests with a maximum message size are relayed by the full parse
+  const string maxMsgSizeOpt = "39  02  05  dc";
+  CounterCache counters(sw.get());
+
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(0);
+  EXPECT_PLATFORM_CALL(sw, getLocalMac()).
+    WillRepeatedly(Return(kPlatformMac));
+
+  EXPECT_PKT(sw, "DHCP request", checkDHCPReq());
+
+  auto dhcpPkt = makeDHCPPacket(senderMac, targetMac, vlan,
+      senderIP, targetIP, srcPort, dstPort, bootpOp, dhcpMsgTypeOpt,
+      maxMsgSizeOpt);
+  sw->packetReceived(dhcpPkt->clone());
+
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.pkt.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.fast_path.sum", 0);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.slow_path.sum", 1);
+}
+
+TEST(DHCPv4HandlerTest, FastPathMatchesSlowPath) {
+  auto sw = setupSwitch();
+  auto clientMac = kClientMac.toString();
+  std::replace(clientMac.begin(), clientMac.end(), ':', ' ');
+  auto serverMac = kPlatformMac.toString();
+  std::replace(serverMac.begin(), serverMac.end(), ':', ' ');
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(0);
+  EXPECT_PLATFORM_CALL(sw, getLocalMac()).
+    WillRepeatedly(Return(kPlatformMac));
+
+  // Relay the packet through each path, and return the bytes sent
+  vector<string> sent;
+  auto relay = [&](const MockRxPacket& pkt, bool fastPath) {
+    FLAGS_dhcp_relay_fast_path = fastPath;
+    EXPECT_PKT(sw, "DHCP packet", [&](const TxPacket* txPacket) {
+      Cursor c(txPacket->buf());
+      sent.push_back(c.readFixedString(c.totalLength()));
+    });
+    sw->packetReceived(pkt.clone());
+    FLAGS_dhcp_relay_fast_path = true;
+    return sent.empty() ? string() : sent.back();
+  };
+
+  auto request = makeDHCPPacket(clientMac, "ff ff ff ff ff ff", "00 01",
+      "00 00 00 00", "ff ff ff ff", "00 43", "00 44", "01", "35  01  01",
+      "0c  03  61  62  63");
+  EXPECT_EQ(relay(*request, false), relay(*request, true));
+
+  auto reply = makeDHCPPacket(serverMac, clientMac, "00 01",
+      "14 14 14 14", "0a 00 00 01", "00 44", "00 43", "02", "35  01  02",
+      "52  02  00  00  0c  03  61  62  63", "0a 00 00 0a");
+  EXPECT_EQ(relay(*reply, false), relay(*reply, true));
+}
+
 TEST(DHCPv4HandlerOverrideTest, DHCPRequest) {
   auto sw = setupSwitch();
   VlanID vlanID(1);
@@ -409,6 +481,7 @@ TEST(DHCPv4HandlerTest, DHCPReply) {
 
   counters.update();
   counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.pkt.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "dhcpV4.fast_path.sum", 1);
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.pkts.sum", 1);
 }
 
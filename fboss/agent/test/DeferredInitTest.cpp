@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/DeferredInit.h"
+
+#include <folly/io/async/EventBase.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+DECLARE_string(deferred_init_order);
+DECLARE_int32(deferred_init_spacing_ms);
+
+using namespace facebook::fboss;
+using std::string;
+using std::vector;
+
+namespace {
+
+class DeferredInitTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    oldOrder_ = FLAGS_deferred_init_order;
+    oldSpacing_ = FLAGS_deferred_init_spacing_ms;
+    FLAGS_deferred_init_order = "stats, lldp,sfp";
+    FLAGS_deferred_init_spacing_ms = 0;
+    thread_ = std::thread([this] { evb_.loopForever(); });
+    evb_.waitUntilRunning();
+  }
+
+  void TearDown() override {
+    evb_.terminateLoopSoon();
+    thread_.join();
+    FLAGS_deferred_init_order = oldOrder_;
+    FLAGS_deferred_init_spacing_ms = oldSpacing_;
+  }
+
+  // Wait for the tasks queued so far to run
+  void sync() {
+    // The tasks are spaced by a timeout each, even if it is 0
+    for (int i = 0; i < 10; ++i) {
+      evb_.runInEventBaseThreadAndWait([] {});
+    }
+  }
+
+  DeferredInit::Task record(const string& name) {
+    return [this, name] { ran_.push_back(name); };
+  }
+
+  folly::EventBase evb_;
+  std::thread thread_;
+  // Only accessed in the event base thread, or after sync()
+  vector<string> ran_;
+
+ private:
+  string oldOrder_;
+  int32_t oldSpacing_;
+};
+
+} // unnamed namespace
+
+TEST_F(DeferredInitTest, RunsInOrderAfterRelease) {
+  DeferredInit init(&evb_);
+  init.add("metrics", record("metrics"));
+  init.add("sfp", record("sfp"));
+  init.add("other", record("other"));
+  init.add("stats", record("stats"));
+  init.add("sfp", record("sfp2"));
+  EXPECT_EQ((vector<string>{"stats", "sfp", "sfp", "metrics", "other"}),
+            init.getPendingOrder());
+
+  sync();
+  EXPECT_TRUE(ran_.empty());
+  EXPECT_FALSE(init.isReleased());
+
+  init.release("test");
+  sync();
+  EXPECT_TRUE(init.isReleased());
+  EXPECT_EQ((vector<string>{"stats", "sfp", "sfp2", "metrics", "other"}),
+            ran_);
+
+  // Added after the release, so run right away
+  init.add("lldp", record("lldp"));
+  sync();
+  EXPECT_EQ("lldp", ran_.back());
+  init.stop();
+}
+
+TEST_F(DeferredInitTest, FailedTaskDoesNotStopOthers) {
+  DeferredInit init(&evb_);
+  init.add("stats", [] { throw std::runtime_error("no stats"); });
+  init.add("lldp", record("lldp"));
+  init.release("test");
+  sync();
+  EXPECT_EQ(vector<string>{"lldp"}, ran_);
+  init.stop();
+}
+
+TEST_F(DeferredInitTest, StopDropsPending) {
+  DeferredInit init(&evb_);
+  init.add("stats", record("stats"));
+  init.stop();
+  EXPECT_TRUE(init.getPendingOrder().empty());
+  init.release("test");
+  init.add("lldp", record("lldp"));
+  sync();
+  EXPECT_TRUE(ran_.empty());
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/DenseIdIndex.h"
+#include "fboss/agent/types.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+
+TEST(DenseIdIndex, lookups) {
+  int a = 1;
+  int b = 2;
+  DenseIdIndex<PortID, int> index;
+  EXPECT_EQ(nullptr, index.get(PortID(0)));
+
+  index.set(PortID(5), &a);
+  index.set(PortID(130), &b);
+  EXPECT_EQ(&a, index.get(PortID(5)));
+  EXPECT_EQ(&b, index.get(PortID(130)));
+  EXPECT_EQ(nullptr, index.get(PortID(6)));
+  EXPECT_EQ(nullptr, index.get(PortID(131)));
+  EXPECT_EQ(nullptr, index.get(PortID(65535)));
+
+  index.set(PortID(5), nullptr);
+  EXPECT_EQ(nullptr, index.get(PortID(5)));
+}
+
+TEST(DenseIdIndex, negativeIds) {
+  int a = 1;
+  DenseIdIndex<int, int> index;
+  index.set(3, &a);
+  EXPECT_EQ(&a, index.get(3));
+  EXPECT_EQ(nullptr, index.get(-1));
+}
@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/EventTrace.h"
+
+#include <folly/IPAddressV4.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <thread>
+
+DECLARE_int32(event_trace_size);
+
+using namespace facebook::fboss;
+typedef EventTrace::Type Type;
+
+namespace {
+
+// The events recorded by the named thread, which only exist once the
+// thread is done recording
+std::vector<EventTrace::Entry> threadEvents(const std::string& thread) {
+  std::vector<EventTrace::Entry> events;
+  for (auto& entry : EventTrace::dump()) {
+    if (entry.thread == thread) {
+      events.push_back(std::move(entry));
+    }
+  }
+  return events;
+}
+
+// Run fn in a new thread, which gets a new ring
+template<typename Fn>
+void runInThread(const char* name, Fn fn) {
+  std::thread thread([&] {
+    pthread_setname_np(pthread_self(), name);
+    fn();
+  });
+  thread.join();
+}
+
+} // unnamed namespace
+
+TEST(EventTrace, RecordAndFormat) {
+  runInThread("traceRecord", [] {
+    auto name = EventTrace::intern("add neighbor");
+    EXPECT_EQ(name, EventTrace::intern("add neighbor"));
+    EventTrace::record(Type::UPDATE_START, 0, 0, name);
+    EventTrace::record(Type::UPDATE_END, 1, 0, name);
+    EventTrace::record(Type::LINK_DOWN, 7);
+    EventTrace::record(Type::ARP_ADD, 5,
+                       folly::IPAddressV4("10.0.0.22").toLongHBO());
+    EventTrace::record(Type::NDP_REMOVE, 5, 0x0200000000000022);
+  });
+
+  auto events = threadEvents("traceRecord");
+  ASSERT_EQ(5, events.size());
+  EXPECT_EQ(Type::UPDATE_START, events[0].type);
+  EXPECT_EQ("add neighbor", events[0].name);
+  EXPECT_EQ(Type::UPDATE_END, events[1].type);
+  EXPECT_EQ(1, events[1].arg1);
+  EXPECT_LE(events[0].time, events[1].time);
+  EXPECT_EQ(7, events[2].arg1);
+
+  auto text = EventTrace::format(events[1]);
+  EXPECT_NE(std::string::npos, text.find(" update_end add neighbor ok=1"))
+    << text;
+  text = EventTrace::format(events[3]);
+  EXPECT_NE(std::string::npos, text.find(" arp_add vlan=5 ip=10.0.0.22"))
+    << text;
+  text = EventTrace::format(events[4]);
+  EXPECT_NE(std::string::npos, text.find(" ip=::200:0:0:22")) << text;
+}
+
+TEST(EventTrace, Wraps) {
+  auto oldSize = FLAGS_event_trace_size;
+  FLAGS_event_trace_size = 5;
+  runInThread("traceWrap", [] {
+    for (uint32_t i = 0; i < 20; ++i) {
+      EventTrace::record(Type::LINK_UP, i);
+    }
+  });
+  FLAGS_event_trace_size = oldSize;
+
+  // Rounded up to 8, and only the newest are kept
+  auto events = threadEvents("traceWrap");
+  ASSERT_EQ(8, events.size());
+  for (uint32_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(12 + i, events[i].arg1);
+  }
+}
+
+TEST(EventTrace, PacketCounts) {
+  EventTrace::recordPacketCounts();
+  runInThread("tracePackets", [] {
+    EventTrace::countRxPacket();
+    EventTrace::countRxPacket();
+    EventTrace::countTxPackets(3);
+  });
+  runInThread("traceCounts", [] {
+    EventTrace::recordPacketCounts();
+  });
+
+  auto events = threadEvents("traceCounts");
+  ASSERT_EQ(2, events.size());
+  EXPECT_EQ(Type::RX_PACKETS, events[0].type);
+  EXPECT_EQ(2, events[0].arg2);
+  EXPECT_EQ(Type::TX_PACKETS, events[1].type);
+  EXPECT_EQ(3, events[1].arg2);
+}
+
+TEST(EventTrace, Disabled) {
+  auto oldSize = FLAGS_event_trace_size;
+  FLAGS_event_trace_size = 0;
+  runInThread("traceOff", [] {
+    EXPECT_FALSE(EventTrace::isEnabled());
+    EventTrace::record(Type::LINK_UP, 1);
+  });
+  FLAGS_event_trace_size = oldSize;
+  EXPECT_TRUE(threadEvents("traceOff").empty());
+}
@@ -0,0 +1,423 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/hw/sim/SimFabric.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/RouteUpdater.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/gen-cpp/switch_config_types.h"
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Measure how long a leaf and spine fabric of simulated agents takes to
+ * converge, end to end, after each of a series of events:
+ *
+ *   bringup             the fabric starts with no neighbors resolved
+ *   neighbor_loss       the first spine silently stops answering
+ *   neighbor_recovery   and starts answering again
+ *   link_loss           the link between the first leaf and spine goes down
+ *   link_recovery       and comes back up
+ *   route_churn         every switch syncs a new set of routes
+ *
+ * Each leaf has a host subnet on a port of its own, and routes to the host
+ * subnets of the other leaves through all of the spines.  The routes are
+ * static, as no routing protocol runs, so a path is only converged once
+ * the neighbors along it are resolved.
+ *
+ * Paths are checked by tracing flows between every pair of leaves through
+ * the dataplanes, and a flow punted on its way is handed to the agent that
+ * punted it, as real traffic would be, which makes it resolve the neighbor
+ * the flow needed.  The losses are converged once the agents at both ends
+ * no longer have a resolved entry for the neighbor they lost.
+ */
+
+DEFINE_int32(fabric_spines, 2, "The number of spine switches");
+DEFINE_int32(fabric_leaves, 4, "The number of leaf switches");
+DEFINE_int32(fabric_flows, 4,
+             "The number of flows traced between each pair of leaves");
+DEFINE_int32(fabric_routes, 1000,
+             "The number of routes to each leaf synced by route_churn");
+DEFINE_int32(fabric_link_delay_ms, 0,
+             "How long packets take to cross each link");
+DEFINE_int32(fabric_arp_timeout_s, 5,
+             "The ARP and NDP timeout of the agents, which bounds how long "
+             "they take to notice a lost neighbor");
+DEFINE_int32(fabric_timeout_s, 60,
+             "How long to wait for each event to converge");
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using std::chrono::milliseconds;
+using std::shared_ptr;
+
+namespace {
+
+typedef SimFabric::SwitchIdx SwitchIdx;
+
+const int16_t kClient = 1;
+const uint8_t kSpineEnd = 1;
+const uint8_t kLeafEnd = 2;
+
+uint32_t numSpines() {
+  return std::min(std::max(FLAGS_fabric_spines, 1), 255);
+}
+uint32_t numLeaves() {
+  return std::min(std::max(FLAGS_fabric_leaves, 2), 255);
+}
+SwitchIdx spineIdx(uint32_t spine) {
+  return spine;
+}
+SwitchIdx leafIdx(uint32_t leaf) {
+  return numSpines() + leaf;
+}
+// Spine ports lead to the leaves, and leaf ports to the spines, with the
+// host port last
+PortID spinePort(uint32_t leaf) {
+  return PortID(leaf + 1);
+}
+PortID leafPort(uint32_t spine) {
+  return PortID(spine + 1);
+}
+PortID hostPort() {
+  return PortID(numSpines() + 1);
+}
+// Each port is in a VLAN, and has an interface, of its own
+VlanID vlanOf(PortID port) {
+  return VlanID(100 + port);
+}
+
+// The address of one end of the link between a spine and a leaf
+IPAddressV4 linkV4(uint32_t spine, uint32_t leaf, uint8_t end) {
+  return IPAddressV4::fromLongHBO(0x0a000000 | spine << 16 | leaf << 8 | end);
+}
+IPAddressV6 linkV6(uint32_t spine, uint32_t leaf, uint8_t end) {
+  return IPAddressV6(folly::format("2401:db00:{:x}:{:x}::{:x}",
+                                   spine, leaf, end).str());
+}
+// The n-th address in the host subnet of a leaf, which has the first
+IPAddressV4 hostV4(uint32_t leaf, uint32_t n) {
+  return IPAddressV4::fromLongHBO(0x0b000000 | leaf << 16 | (n + 1));
+}
+IPAddressV6 hostV6(uint32_t leaf, uint32_t n) {
+  return IPAddressV6(folly::format("2401:db01:{:x}::{:x}", leaf, n + 1).str());
+}
+// The n-th of the route_churn prefixes, /24s, of a leaf
+IPAddress churnNetwork(uint32_t leaf, uint32_t n) {
+  uint32_t index = leaf * std::max(FLAGS_fabric_routes, 1) + n;
+  return IPAddress(IPAddressV4::fromLongHBO(0x0c000000 + (index << 8)));
+}
+
+cfg::SwitchConfig makeConfig(
+    uint32_t numPorts,
+    const std::function<std::vector<std::string>(PortID)>& addressesOf) {
+  cfg::SwitchConfig config;
+  config.arpTimeoutSeconds = std::max(FLAGS_fabric_arp_timeout_s, 1);
+  config.arpAgerInterval = 1;
+  config.ports.resize(numPorts);
+  config.vlanPorts.resize(numPorts);
+  config.vlans.resize(numPorts);
+  config.interfaces.resize(numPorts);
+  for (uint32_t n = 0; n < numPorts; ++n) {
+    PortID portID(n + 1);
+    auto vlanID = vlanOf(portID);
+    auto& port = config.ports[n];
+    port.logicalID = portID;
+    port.state = cfg::PortState::UP;
+    port.routable = true;
+    port.ingressVlan = vlanID;
+
+    auto& vlanPort = config.vlanPorts[n];
+    vlanPort.vlanID = vlanID;
+    vlanPort.logicalPort = portID;
+    vlanPort.spanningTreeState = cfg::SpanningTreeState::FORWARDING;
+    vlanPort.emitTags = false;
+
+    auto& vlan = config.vlans[n];
+    vlan.id = vlanID;
+    vlan.name = folly::to<std::string>("Vlan", vlanID);
+    vlan.routable = true;
+
+    auto& intf = config.interfaces[n];
+    intf.intfID = vlanID;
+    intf.vlanID = vlanID;
+    intf.name = folly::to<std::string>("Interface", vlanID);
+    intf.ipAddresses = addressesOf(portID);
+  }
+  return config;
+}
+
+cfg::SwitchConfig makeSpineConfig(uint32_t spine) {
+  return makeConfig(numLeaves(), [=](PortID port) {
+    uint32_t leaf = port - 1;
+    return std::vector<std::string>{
+      linkV4(spine, leaf, kSpineEnd).str() + "/24",
+      linkV6(spine, leaf, kSpineEnd).str() + "/64",
+    };
+  });
+}
+
+cfg::SwitchConfig makeLeafConfig(uint32_t leaf) {
+  return makeConfig(numSpines() + 1, [=](PortID port) {
+    if (port == hostPort()) {
+      return std::vector<std::string>{
+        hostV4(leaf, 0).str() + "/16",
+        hostV6(leaf, 0).str() + "/64",
+      };
+    }
+    uint32_t spine = port - 1;
+    return std::vector<std::string>{
+      linkV4(spine, leaf, kLeafEnd).str() + "/24",
+      linkV6(spine, leaf, kLeafEnd).str() + "/64",
+    };
+  });
+}
+
+void syncRoutes(SwSwitch* sw, RouteUpdater::ClientRoutes routes) {
+  // Moved in rather than captured, since the update may outlive the call
+  auto toSync = std::make_shared<RouteUpdater::ClientRoutes>(
+      std::move(routes));
+  sw->updateStateBlocking("sync fib",
+                          [=](const shared_ptr<SwitchState>& state) {
+    RouteUpdater updater(state->getRouteTables());
+    updater.syncClientRoutes(RouterID(0), ClientID(kClient),
+                             std::move(*toSync));
+    auto newRt = updater.updateDone();
+    if (!newRt) {
+      return shared_ptr<SwitchState>();
+    }
+    auto newState = state->clone();
+    newState->resetRouteTables(std::move(newRt));
+    return newState;
+  });
+}
+
+// The routes to the host subnets, and to the first numChurn of the
+// route_churn prefixes, of each leaf
+void syncFabricRoutes(SimFabric* fabric, uint32_t numChurn) {
+  for (uint32_t spine = 0; spine < numSpines(); ++spine) {
+    RouteUpdater::ClientRoutes routes;
+    for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+      RouteNextHops v4{IPAddress(linkV4(spine, leaf, kLeafEnd))};
+      RouteNextHops v6{IPAddress(linkV6(spine, leaf, kLeafEnd))};
+      routes.add(IPAddress(hostV4(leaf, 0)).mask(16), 16,
+                 RouteNextHopEntry(v4, 20));
+      routes.add(IPAddress(hostV6(leaf, 0)).mask(64), 64,
+                 RouteNextHopEntry(v6, 20));
+      for (uint32_t n = 0; n < numChurn; ++n) {
+        routes.add(churnNetwork(leaf, n), 24, RouteNextHopEntry(v4, 20));
+      }
+    }
+    syncRoutes(fabric->getSwitch(spineIdx(spine)), std::move(routes));
+  }
+
+  for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+    RouteNextHops v4;
+    RouteNextHops v6;
+    for (uint32_t spine = 0; spine < numSpines(); ++spine) {
+      v4.insert(IPAddress(linkV4(spine, leaf, kSpineEnd)));
+      v6.insert(IPAddress(linkV6(spine, leaf, kSpineEnd)));
+    }
+    RouteUpdater::ClientRoutes routes;
+    for (uint32_t other = 0; other < numLeaves(); ++other) {
+      if (other == leaf) {
+        continue;
+      }
+      routes.add(IPAddress(hostV4(other, 0)).mask(16), 16,
+                 RouteNextHopEntry(v4, 20));
+      routes.add(IPAddress(hostV6(other, 0)).mask(64), 64,
+                 RouteNextHopEntry(v6, 20));
+      for (uint32_t n = 0; n < numChurn; ++n) {
+        routes.add(churnNetwork(other, n), 24, RouteNextHopEntry(v4, 20));
+      }
+    }
+    syncRoutes(fabric->getSwitch(leafIdx(leaf)), std::move(routes));
+  }
+}
+
+// Whether the flow reached the leaf, rather than stopping on the way
+bool reaches(const std::vector<SimFabric::Hop>& hops, uint32_t leaf) {
+  return !hops.empty() && hops.back().sw == leafIdx(leaf) &&
+    hops.back().result.verdict != SimDataplane::Verdict::ROUTED;
+}
+
+// Whether every flow between two leaves, to dstOf() the destination leaf,
+// reaches it
+bool allFlowsReach(SimFabric* fabric,
+                   const std::function<IPAddress(uint32_t)>& dstOf) {
+  bool converged = true;
+  for (uint32_t from = 0; from < numLeaves(); ++from) {
+    for (uint32_t to = 0; to < numLeaves(); ++to) {
+      if (from == to) {
+        continue;
+      }
+      auto dst = dstOf(to);
+      for (int32_t flow = 0; flow < std::max(FLAGS_fabric_flows, 1);
+           ++flow) {
+        IPAddress src = dst.isV4() ? IPAddress(hostV4(from, 1 + flow)) :
+          IPAddress(hostV6(from, 1 + flow));
+        // Keep going, so that every flow gets its neighbors resolved
+        auto hops = fabric->trace(
+            SimFabric::Endpoint(leafIdx(from), hostPort()), src, dst, true);
+        converged = reaches(hops, to) && converged;
+      }
+    }
+  }
+  return converged;
+}
+
+bool hostsReachable(SimFabric* fabric) {
+  return allFlowsReach(fabric, [](uint32_t leaf) {
+           return IPAddress(hostV4(leaf, 0));
+         }) &&
+    allFlowsReach(fabric, [](uint32_t leaf) {
+      return IPAddress(hostV6(leaf, 0));
+    });
+}
+
+// Whether a switch has a resolved ARP or NDP entry for ip on the port's VLAN
+bool isResolved(SimFabric* fabric, SwitchIdx sw, PortID port,
+                const IPAddress& ip) {
+  auto vlan = fabric->getSwitch(sw)->getState()->getVlans()->getVlanIf(
+      vlanOf(port));
+  if (!vlan) {
+    return false;
+  }
+  if (ip.isV4()) {
+    auto entry = vlan->getArpTable()->getEntryIf(ip.asV4());
+    return entry && !entry->isPending();
+  }
+  auto entry = vlan->getNdpTable()->getEntryIf(ip.asV6());
+  return entry && !entry->isPending();
+}
+
+// Whether the ends of the link between a spine and a leaf both lost their
+// neighbor across it
+bool linkNeighborsLost(SimFabric* fabric, uint32_t spine, uint32_t leaf) {
+  auto spineSw = spineIdx(spine);
+  auto leafSw = leafIdx(leaf);
+  return
+    !isResolved(fabric, spineSw, spinePort(leaf),
+                linkV4(spine, leaf, kLeafEnd)) &&
+    !isResolved(fabric, spineSw, spinePort(leaf),
+                linkV6(spine, leaf, kLeafEnd)) &&
+    !isResolved(fabric, leafSw, leafPort(spine),
+                linkV4(spine, leaf, kSpineEnd)) &&
+    !isResolved(fabric, leafSw, leafPort(spine),
+                linkV6(spine, leaf, kSpineEnd));
+}
+
+void report(const char* event,
+            folly::Optional<std::chrono::microseconds> took) {
+  if (!took) {
+    printf("%-20s did not converge in %d s\n", event, FLAGS_fabric_timeout_s);
+    return;
+  }
+  printf("%-20s %10.1f ms\n", event, took->count() / 1000.0);
+}
+
+} // unnamed namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  milliseconds timeout(1000 * std::max(FLAGS_fabric_timeout_s, 1));
+  milliseconds delay(std::max(FLAGS_fabric_link_delay_ms, 0));
+
+  SimFabric fabric;
+  for (uint32_t spine = 0; spine < numSpines(); ++spine) {
+    fabric.addSwitch(folly::MacAddress::fromHBO(0x020100000000 + spine),
+                     numLeaves());
+  }
+  for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+    fabric.addSwitch(folly::MacAddress::fromHBO(0x020200000000 + leaf),
+                     numSpines() + 1);
+  }
+  for (uint32_t spine = 0; spine < numSpines(); ++spine) {
+    fabric.configure(spineIdx(spine), makeSpineConfig(spine));
+  }
+  for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+    fabric.configure(leafIdx(leaf), makeLeafConfig(leaf));
+  }
+  for (uint32_t spine = 0; spine < numSpines(); ++spine) {
+    for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+      fabric.connect(SimFabric::Endpoint(spineIdx(spine), spinePort(leaf)),
+                     SimFabric::Endpoint(leafIdx(leaf), leafPort(spine)),
+                     delay);
+    }
+  }
+  syncFabricRoutes(&fabric, 0);
+  printf("%u spines, %u leaves, %d flows per pair of leaves\n",
+         numSpines(), numLeaves(), std::max(FLAGS_fabric_flows, 1));
+
+  auto converged = [&] { return hostsReachable(&fabric); };
+  report("bringup", fabric.waitFor(converged, timeout));
+  report("bringup_settled", fabric.waitForQuiet(milliseconds(200), timeout));
+
+  // Every leaf loses its neighbor on the first spine
+  for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+    fabric.setLinkBlackholed(
+        SimFabric::Endpoint(spineIdx(0), spinePort(leaf)), true);
+  }
+  report("neighbor_loss", fabric.waitFor([&] {
+    for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+      if (!linkNeighborsLost(&fabric, 0, leaf)) {
+        return false;
+      }
+    }
+    return true;
+  }, timeout));
+  for (uint32_t leaf = 0; leaf < numLeaves(); ++leaf) {
+    fabric.setLinkBlackholed(
+        SimFabric::Endpoint(spineIdx(0), spinePort(leaf)), false);
+  }
+  report("neighbor_recovery", fabric.waitFor(converged, timeout));
+
+  SimFabric::Endpoint link(spineIdx(0), spinePort(0));
+  fabric.setLinkUp(link, false);
+  report("link_loss", fabric.waitFor([&] {
+    return linkNeighborsLost(&fabric, 0, 0);
+  }, timeout));
+  fabric.setLinkUp(link, true);
+  report("link_recovery", fabric.waitFor(converged, timeout));
+
+  // Time the sync along with the convergence
+  auto start = std::chrono::steady_clock::now();
+  uint32_t numChurn = std::max(FLAGS_fabric_routes, 1);
+  syncFabricRoutes(&fabric, numChurn);
+  auto churned = fabric.waitFor([&] {
+    return allFlowsReach(&fabric, [=](uint32_t leaf) {
+      return churnNetwork(leaf, numChurn - 1);
+    });
+  }, timeout);
+  if (churned) {
+    churned = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+  }
+  report("route_churn", churned);
+
+  printf("%lu packets carried, %lu dropped\n",
+         fabric.getDelivered(), fabric.getDropped());
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/FibCompressor.h"
+
+#include <folly/IPAddressV4.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddressV4;
+using std::make_shared;
+
+namespace {
+
+typedef FibCompressor<RouteV4> Compressor;
+
+RouteV4::Prefix prefix(const char* network, uint8_t len) {
+  return RouteV4::Prefix{IPAddressV4(network), len};
+}
+
+std::shared_ptr<RouteV4> route(const RouteV4::Prefix& prefix,
+                               RouteForwardAction action) {
+  return make_shared<RouteV4>(prefix, action);
+}
+
+void expectChange(const Compressor::Change& change,
+                  const RouteV4::Prefix& prefix, bool add) {
+  EXPECT_EQ(prefix, change.route->prefix());
+  EXPECT_EQ(add, change.add);
+}
+
+}
+
+TEST(FibCompressor, suppressRedundantRoutes) {
+  Compressor compressor;
+  auto p8 = prefix("10.0.0.0", 8);
+  auto p16 = prefix("10.1.0.0", 16);
+  auto p24 = prefix("10.1.1.0", 24);
+  auto p32 = prefix("10.1.1.1", 32);
+  auto other = prefix("10.2.0.0", 16);
+
+  Compressor::Changes changes;
+  compressor.update(route(p8, RouteForwardAction::DROP), &changes);
+  ASSERT_EQ(1, changes.size());
+  expectChange(changes[0], p8, true);
+
+  // Forwards the same as its cover
+  changes.clear();
+  compressor.update(route(p16, RouteForwardAction::DROP), &changes);
+  EXPECT_TRUE(changes.empty());
+  EXPECT_FALSE(compressor.isInFib(p16));
+
+  changes.clear();
+  compressor.update(route(p24, RouteForwardAction::TO_CPU), &changes);
+  compressor.update(route(p32, RouteForwardAction::DROP), &changes);
+  compressor.update(route(other, RouteForwardAction::TO_CPU), &changes);
+  ASSERT_EQ(3, changes.size());
+  expectChange(changes[0], p24, true);
+  expectChange(changes[1], p32, true);
+  expectChange(changes[2], other, true);
+  EXPECT_EQ(5, compressor.getRibSize());
+  EXPECT_EQ(4, compressor.getFibSize());
+
+  // The /16 no longer forwards as its cover, so it is added before the /8
+  // changes, and the other /16 now does, so it is removed after.  The /24
+  // still falls through to the /16.
+  changes.clear();
+  compressor.update(route(p8, RouteForwardAction::TO_CPU), &changes);
+  ASSERT_EQ(3, changes.size());
+  expectChange(changes[0], p16, true);
+  expectChange(changes[1], p8, true);
+  expectChange(changes[2], other, false);
+  EXPECT_TRUE(compressor.isInFib(p24));
+  EXPECT_EQ(4, compressor.getFibSize());
+
+  // The /24 falls through to the /8 without the /16, and forwards the same
+  changes.clear();
+  compressor.remove(p16, &changes);
+  ASSERT_EQ(2, changes.size());
+  expectChange(changes[0], p16, false);
+  expectChange(changes[1], p24, false);
+  // The /32 still falls through to the /24, which it does not forward as
+  EXPECT_TRUE(compressor.isInFib(p32));
+
+  // Without the /8, the routes it covered need to be in the FIB
+  changes.clear();
+  compressor.remove(p8, &changes);
+  ASSERT_EQ(3, changes.size());
+  expectChange(changes[0], p24, true);
+  expectChange(changes[1], other, true);
+  expectChange(changes[2], p8, false);
+  EXPECT_EQ(3, compressor.getRibSize());
+  EXPECT_EQ(3, compressor.getFibSize());
+
+  // Removing a route that is not in the RIB does nothing
+  changes.clear();
+  compressor.remove(p8, &changes);
+  EXPECT_TRUE(changes.empty());
+}
+
+TEST(FibCompressor, sameForwarding) {
+  Compressor compressor;
+  auto p8 = prefix("10.0.0.0", 8);
+  Compressor::Changes changes;
+  compressor.update(route(p8, RouteForwardAction::DROP), &changes);
+  ASSERT_EQ(1, changes.size());
+
+  // A new route object forwarding the same way changes nothing
+  changes.clear();
+  compressor.update(route(p8, RouteForwardAction::DROP), &changes);
+  EXPECT_TRUE(changes.empty());
+  EXPECT_TRUE(compressor.isInFib(p8));
+
+  // A default route forwarding the same way makes the /8 redundant
+  compressor.update(route(prefix("0.0.0.0", 0), RouteForwardAction::DROP),
+                    &changes);
+  ASSERT_EQ(2, changes.size());
+  expectChange(changes[0], prefix("0.0.0.0", 0), true);
+  expectChange(changes[1], p8, false);
+  EXPECT_EQ(2, compressor.getRibSize());
+  EXPECT_EQ(1, compressor.getFibSize());
+}
@@ -0,0 +1,157 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/OpenHashMap.h"
+#include "fboss/agent/state/RouteForwardInfo.h"
+
+#include <boost/container/flat_map.hpp>
+#include <folly/Benchmark.h>
+#include <folly/Hash.h>
+#include <gflags/gflags.h>
+
+/*
+ * The host and ECMP group tables of BcmHostTable need an ASIC to program
+ * the hosts, so these benchmarks measure the tables themselves: a
+ * synthetic FIB is programmed by taking a reference on the ECMP group and
+ * the hosts of each route, as BcmHostTable does, and then withdrawn.
+ */
+
+DEFINE_int32(host_benchmark_routes, 50000,
+             "The number of routes in the synthetic FIB");
+DEFINE_int32(host_benchmark_ecmp_width, 8,
+             "The number of nexthops in each ECMP group");
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::IPAddressV6;
+
+namespace {
+
+typedef int Vrf;
+
+// The keys and storage BcmHostTable used before hashing
+typedef std::pair<Vrf, IPAddress> HostKey;
+typedef std::pair<Vrf, RouteForwardNexthops> SortedEcmpKey;
+template<typename KeyT>
+using SortedMap = boost::container::flat_map<KeyT, uint32_t>;
+
+// The keys and storage BcmHostTable uses now
+typedef std::pair<Vrf, HashedNexthops> HashedEcmpKey;
+struct HostKeyHash {
+  size_t operator()(const HostKey& key) const {
+    return folly::hash::hash_combine(key.first, key.second.hash());
+  }
+};
+struct EcmpKeyHash {
+  size_t operator()(const HashedEcmpKey& key) const {
+    return folly::hash::hash_combine(key.first, key.second.hash());
+  }
+};
+template<typename KeyT, typename HashT>
+using HashedMap = OpenHashMap<KeyT, uint32_t, HashT>;
+
+// Each route points to one of numGroups ECMP groups, built from a pool of
+// twice as many nexthops as a group has, so the groups share hosts.
+std::vector<RouteForwardNexthops> makeGroups(size_t numGroups) {
+  size_t width = FLAGS_host_benchmark_ecmp_width;
+  std::vector<RouteForwardNexthops> groups;
+  for (size_t g = 0; g < numGroups; ++g) {
+    RouteForwardNexthops nhops;
+    for (size_t n = 0; n < width; ++n) {
+      auto idx = (g * width + n * 7) % (numGroups * width * 2);
+      auto bytes = IPAddressV6("2401:db00::").toByteArray();
+      bytes[12] = idx >> 24;
+      bytes[13] = idx >> 16;
+      bytes[14] = idx >> 8;
+      bytes[15] = idx;
+      nhops.emplace(InterfaceID(1 + idx % 4),
+                    IPAddress(IPAddressV6::fromBinary(
+                        folly::ByteRange(bytes.data(), bytes.size()))));
+    }
+    groups.push_back(std::move(nhops));
+  }
+  return groups;
+}
+
+template<typename MapT, typename KeyT>
+void incRef(MapT* map, KeyT key) {
+  auto ret = map->emplace(std::move(key), 1);
+  if (!ret.second) {
+    ++(*map)[ret.first->first];
+  }
+}
+
+template<typename MapT, typename KeyT>
+void decRef(MapT* map, const KeyT& key) {
+  auto& count = (*map)[key];
+  if (--count == 0) {
+    map->erase(key);
+  }
+}
+
+template<typename HostMapT, typename EcmpMapT, typename EcmpKeyT>
+void programFib(size_t numIters, size_t numGroups) {
+  std::vector<RouteForwardNexthops> groups;
+  BENCHMARK_SUSPEND {
+    groups = makeGroups(numGroups);
+  }
+  size_t numRoutes = FLAGS_host_benchmark_routes;
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    HostMapT hosts;
+    EcmpMapT ecmpHosts;
+    for (size_t n = 0; n < numRoutes; ++n) {
+      const auto& fwd = groups[n % groups.size()];
+      // Like BcmHostTable, new groups take a reference on their hosts
+      EcmpKeyT key(Vrf(0), fwd);
+      if (ecmpHosts.count(key) == 0) {
+        for (const auto& nhop : fwd) {
+          incRef(&hosts, HostKey(Vrf(0), nhop.nexthop));
+        }
+      }
+      incRef(&ecmpHosts, std::move(key));
+    }
+    for (size_t n = 0; n < numRoutes; ++n) {
+      const auto& fwd = groups[n % groups.size()];
+      EcmpKeyT key(Vrf(0), fwd);
+      decRef(&ecmpHosts, key);
+      if (ecmpHosts.count(key) == 0) {
+        for (const auto& nhop : fwd) {
+          decRef(&hosts, HostKey(Vrf(0), nhop.nexthop));
+        }
+      }
+    }
+    CHECK(hosts.empty());
+    CHECK(ecmpHosts.empty());
+  }
+}
+
+void sortedProgramFib(size_t numIters, size_t numGroups) {
+  programFib<SortedMap<HostKey>, SortedMap<SortedEcmpKey>, SortedEcmpKey>(
+      numIters, numGroups);
+}
+void hashedProgramFib(size_t numIters, size_t numGroups) {
+  programFib<HashedMap<HostKey, HostKeyHash>,
+             HashedMap<HashedEcmpKey, EcmpKeyHash>,
+             HashedEcmpKey>(numIters, numGroups);
+}
+
+} // unnamed namespace
+
+BENCHMARK_PARAM(sortedProgramFib, 16)
+BENCHMARK_RELATIVE_PARAM(hashedProgramFib, 16)
+BENCHMARK_PARAM(sortedProgramFib, 1024)
+BENCHMARK_RELATIVE_PARAM(hashedProgramFib, 1024)
+BENCHMARK_PARAM(sortedProgramFib, 16384)
+BENCHMARK_RELATIVE_PARAM(hashedProgramFib, 16384)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
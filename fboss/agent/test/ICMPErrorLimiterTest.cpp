@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ICMPErrorLimiter.h"
+
+#include "fboss/agent/state/SwitchState.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::chrono::milliseconds;
+
+namespace {
+
+ICMPErrorLimits makeLimits(uint32_t sourceRate, uint32_t sourceBurst,
+                           uint32_t intfRate, uint32_t intfBurst) {
+  ICMPErrorLimits limits;
+  limits.sourceRate = sourceRate;
+  limits.sourceBurst = sourceBurst;
+  limits.intfRate = intfRate;
+  limits.intfBurst = intfBurst;
+  return limits;
+}
+
+}
+
+TEST(ICMPErrorLimiter, perSource) {
+  ICMPErrorLimiter limiter;
+  auto limits = makeLimits(10, 5, 0, 0);
+  auto now = std::chrono::steady_clock::now();
+  VlanID vlan(1);
+  IPAddress src1("10.0.0.10");
+  IPAddress src2("2401:db00::10");
+
+  // The whole burst is accepted at once, and nothing more
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.admit(limits, vlan, src1, now));
+  }
+  EXPECT_FALSE(limiter.admit(limits, vlan, src1, now));
+
+  // Other sources have their own buckets, even on the same VLAN
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.admit(limits, vlan, src2, now));
+  }
+  EXPECT_FALSE(limiter.admit(limits, vlan, src2, now));
+
+  // At 10 pps, one token is added every 100ms
+  now += milliseconds(200);
+  EXPECT_TRUE(limiter.admit(limits, vlan, src1, now));
+  EXPECT_TRUE(limiter.admit(limits, vlan, src1, now));
+  EXPECT_FALSE(limiter.admit(limits, vlan, src1, now));
+
+  // The bucket never holds more than the burst size
+  now += milliseconds(10000);
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.admit(limits, vlan, src1, now));
+  }
+  EXPECT_FALSE(limiter.admit(limits, vlan, src1, now));
+}
+
+TEST(ICMPErrorLimiter, perInterface) {
+  ICMPErrorLimiter limiter;
+  auto limits = makeLimits(10, 5, 100, 20);
+  auto now = std::chrono::steady_clock::now();
+  VlanID vlan1(1);
+  VlanID vlan2(2);
+
+  // A sweep from many sources is limited by the interface bucket
+  int admitted = 0;
+  for (int i = 0; i < 100; ++i) {
+    IPAddress src(folly::IPAddressV4::fromLongHBO(0x0a000100 + i));
+    admitted += limiter.admit(limits, vlan1, src, now);
+  }
+  EXPECT_EQ(20, admitted);
+
+  // Other VLANs have their own buckets.  Errors dropped by the source limit
+  // do not use up the tokens of the interface.
+  IPAddress src("10.0.2.1");
+  for (int i = 0; i < 10; ++i) {
+    admitted = limiter.admit(limits, vlan2, src, now);
+    EXPECT_EQ(i < 5, admitted);
+  }
+  admitted = 0;
+  for (int i = 0; i < 100; ++i) {
+    IPAddress other(folly::IPAddressV4::fromLongHBO(0x0a000300 + i));
+    admitted += limiter.admit(limits, vlan2, other, now);
+  }
+  EXPECT_EQ(15, admitted);
+}
+
+TEST(ICMPErrorLimiter, unlimited) {
+  ICMPErrorLimiter limiter;
+  auto limits = makeLimits(0, 0, 0, 0);
+  auto now = std::chrono::steady_clock::now();
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(limiter.admit(limits, VlanID(1), IPAddress("10.0.0.10"),
+                              now));
+  }
+}
+
+TEST(ICMPErrorLimiter, maxSources) {
+  ICMPErrorLimiter limiter;
+  auto limits = makeLimits(1, 1, 0, 0);
+  auto now = std::chrono::steady_clock::now();
+  VlanID vlan(1);
+  auto source = [](uint32_t n) {
+    return IPAddress(folly::IPAddressV4::fromLongHBO(0x0a000000 + n));
+  };
+
+  for (uint32_t n = 0; n < ICMPErrorLimiter::MAX_SOURCES; ++n) {
+    EXPECT_TRUE(limiter.admit(limits, vlan, source(n), now));
+  }
+  // Once the table is full, new sources are not tracked, so they are not
+  // limited per source.
+  auto untracked = source(ICMPErrorLimiter::MAX_SOURCES);
+  EXPECT_TRUE(limiter.admit(limits, vlan, untracked, now));
+  EXPECT_TRUE(limiter.admit(limits, vlan, untracked, now));
+  EXPECT_FALSE(limiter.admit(limits, vlan, source(0), now));
+
+  // Once the tracked sources have been idle long enough to refill their
+  // buckets, they are purged to make room for new sources
+  now += milliseconds(2000);
+  EXPECT_TRUE(limiter.admit(limits, vlan, untracked, now));
+  EXPECT_FALSE(limiter.admit(limits, vlan, untracked, now));
+}
@@ -59,9 +59,11 @@ const IPAddressV4 kVlanInterfaceIP("10.0.0.1");
 
 namespace {
 
-unique_ptr<SwSwitch> setupSwitch() {
+unique_ptr<SwSwitch> setupSwitch(
+    const ICMPErrorLimits& limits = ICMPErrorLimits()) {
   // Setup a default state object
   auto state = testStateA();
+  state->setICMPErrorLimits(limits);
   const auto& vlans = state->getVlans();
   // Set up an arp response entry for VLAN 1, 10.0.0.1,
   // so that we can detect the packet to 10.0.0.1 is for myself
@@ -95,6 +97,8 @@ TxMatchFn checkICMPv4Pkt(MacAddress srcMac, IPAddressV4 srcIP,
 
     Cursor ipv4HdrStart(c);
     IPv4Hdr ipv4(c);
+    checkField(0, PktUtil::internetChecksum(ipv4HdrStart, ipv4.size()),
+               "IPv4 header checksum");
     checkField(IP_PROTO_ICMP, ipv4.protocol, "IPv4 protocol");
     checkField(srcIP, ipv4.srcAddr, "src IP");
     checkField(dstIP, ipv4.dstAddr, "dst IP");
@@ -367,5 +371,56 @@ TEST(ICMPTest, TTLExceededV6) {
   counters.checkDelta(SwitchStats::kCounterPrefix + "ipv6.hop_exceeded.sum", 1);
 }
 
+TEST(ICMPTest, TTLExceededRateLimited) {
+  // At 1 pps, no token is added before the test finishes
+  ICMPErrorLimits limits;
+  limits.sourceRate = 1;
+  limits.sourceBurst = 3;
+  auto sw = setupSwitch(limits);
+
+  auto pktFromSource = [](const char* srcIPHex) {
+    auto pkt = MockRxPacket::fromHex(std::string(
+      // dst mac, src mac
+      "00 02 00 00 00 01  02 00 02 01 02 03"
+      // 802.1q, VLAN 1
+      "81 00 00 01"
+      // IPv4
+      "08 00"
+      // Version(4), IHL(5), DSCP(7), ECN(1), Total Length(28)
+      "45 1d 00 1c"
+      // Identification(0x3456), Flags(0x1), Fragment offset(0x1345)
+      "34 56 53 45"
+      // TTL(1), Protocol(11), Checksum (0x1234, fake)
+      "01 11 12 34") +
+      // Source IP
+      srcIPHex +
+      // Destination IP (10.1.0.10)
+      "0a 01 00 0a"
+      // Source port (69), destination port (70)
+      "00 45 00 46"
+      // Length (8), checksum (0x1234, faked)
+      "00 08 12 34");
+    pkt->padToLength(68);
+    pkt->setSrcPort(PortID(1));
+    pkt->setSrcVlan(VlanID(1));
+    return pkt;
+  };
+
+  CounterCache counters(sw.get());
+  EXPECT_PLATFORM_CALL(sw, getLocalMac()).
+    WillRepeatedly(Return(kPlatformMac));
+
+  // Only the burst is answered for each source
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(4);
+  for (int i = 0; i < 5; ++i) {
+    sw->packetReceived(pktFromSource("01 02 03 04"));
+  }
+  sw->packetReceived(pktFromSource("01 02 03 05"));
+
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "ipv4.ttl_exceeded.sum", 6);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "icmp.error_limited.sum",
+                      2);
+}
 
 } // namespace
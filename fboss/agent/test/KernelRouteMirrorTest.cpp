@@ -0,0 +1,149 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/KernelRouteMirror.h"
+
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteUpdater.h"
+
+#include <folly/IPAddress.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+
+typedef KernelRouteMirror::RouteType RouteType;
+
+const RouterID kRid(0);
+
+KernelRouteMirror::RouteKey key(const char* network, uint8_t len) {
+  return KernelRouteMirror::RouteKey(
+      kRid, folly::CIDRNetwork(IPAddress(network), len));
+}
+
+void expectUpdate(const KernelRouteMirror::Update& update,
+                  const KernelRouteMirror::RouteKey& key,
+                  RouteType type, bool add) {
+  EXPECT_EQ(key, update.key);
+  EXPECT_EQ(type, update.type);
+  EXPECT_EQ(add, update.add);
+}
+
+}
+
+TEST(KernelRouteMirror, compressesAndCoalesces) {
+  KernelRouteMirror mirror;
+  RouteUpdater u1(make_shared<RouteTableMap>());
+  u1.addRoute(kRid, InterfaceID(1), IPAddress("10.0.0.1"), 24);
+  u1.addRoute(kRid, IPAddress("10.1.0.0"), 16, RouteForwardAction::DROP);
+  // Drops like its cover, so the kernel does not need it
+  u1.addRoute(kRid, IPAddress("10.1.1.0"), 24, RouteForwardAction::DROP);
+  u1.addRoute(kRid, IPAddress("2401:db00::"), 32, RouteForwardAction::TO_CPU);
+  auto tables1 = u1.updateDone();
+  ASSERT_NE(nullptr, tables1);
+
+  mirror.applyDelta(nullptr, tables1.get());
+  EXPECT_EQ(mirror.getRibSize(), mirror.getFibSize() + 1);
+  auto pending = mirror.numPending();
+  EXPECT_EQ(mirror.getFibSize(), pending);
+
+  // The rate limit lets one change through at a time
+  auto updates = mirror.takeUpdates(1);
+  ASSERT_EQ(1, updates.size());
+  expectUpdate(updates[0], key("10.1.0.0", 16), RouteType::BLACKHOLE, true);
+  EXPECT_EQ(pending - 1, mirror.numPending());
+
+  // Without the /16, the /24 no longer drops like its cover, so it is
+  // mirrored before the /16 is removed
+  RouteUpdater u2(tables1);
+  u2.delRoute(kRid, IPAddress("10.1.0.0"), 16);
+  auto tables2 = u2.updateDone();
+  ASSERT_NE(nullptr, tables2);
+  mirror.applyDelta(tables1.get(), tables2.get());
+
+  updates = mirror.takeUpdates(100);
+  EXPECT_EQ(0, mirror.numPending());
+  ASSERT_EQ(4, updates.size());
+  EXPECT_TRUE(updates[0].add);
+  EXPECT_TRUE(updates[1].add);
+  expectUpdate(updates[2], key("10.1.1.0", 24), RouteType::BLACKHOLE, true);
+  expectUpdate(updates[3], key("10.1.0.0", 16), RouteType::BLACKHOLE, false);
+  auto installed = mirror.getInstalled();
+  EXPECT_EQ(RouteType::BLACKHOLE, installed.at(key("10.1.1.0", 24)));
+  EXPECT_EQ(0, installed.count(key("10.1.0.0", 16)));
+  EXPECT_EQ(RouteType::UNICAST, installed.at(key("2401:db00::", 32)));
+  EXPECT_EQ(mirror.getFibSize(), installed.size());
+
+  // Removing the router removes all of its routes
+  mirror.applyDelta(tables2.get(), nullptr);
+  updates = mirror.takeUpdates(100);
+  EXPECT_EQ(installed.size(), updates.size());
+  for (const auto& update : updates) {
+    EXPECT_FALSE(update.add);
+    EXPECT_EQ(installed.at(update.key), update.type);
+  }
+  EXPECT_TRUE(mirror.getInstalled().empty());
+  EXPECT_EQ(0, mirror.getRibSize());
+}
+
+TEST(KernelRouteMirror, reconcile) {
+  KernelRouteMirror mirror;
+  RouteUpdater u1(make_shared<RouteTableMap>());
+  u1.addRoute(kRid, IPAddress("10.1.0.0"), 16, RouteForwardAction::DROP);
+  u1.addRoute(kRid, IPAddress("10.2.0.0"), 16, RouteForwardAction::TO_CPU);
+  u1.addRoute(kRid, IPAddress("10.3.0.0"), 16, RouteForwardAction::DROP);
+  auto tables1 = u1.updateDone();
+  ASSERT_NE(nullptr, tables1);
+
+  // The kernel starts with routes left by an earlier run: one the mirror
+  // wants too, one it wants differently and one it does not want.  Before
+  // the first sync the mirror expects none of them, but once the routes
+  // are known only the last two are changed.
+  KernelRouteMirror::Routes kernel;
+  kernel[key("10.1.0.0", 16)] = RouteType::BLACKHOLE;
+  kernel[key("10.2.0.0", 16)] = RouteType::BLACKHOLE;
+  kernel[key("10.4.0.0", 16)] = RouteType::UNICAST;
+  EXPECT_EQ(3, mirror.reconcile(kernel));
+  mirror.applyDelta(nullptr, tables1.get());
+  auto updates = mirror.takeUpdates(100);
+  ASSERT_EQ(3, updates.size());
+  expectUpdate(updates[0], key("10.4.0.0", 16), RouteType::UNICAST, false);
+  expectUpdate(updates[1], key("10.2.0.0", 16), RouteType::UNICAST, true);
+  expectUpdate(updates[2], key("10.3.0.0", 16), RouteType::BLACKHOLE, true);
+
+  // A check that finds the kernel as expected changes nothing
+  auto expected = mirror.getInstalled();
+  EXPECT_EQ(0, mirror.reconcile(expected));
+  EXPECT_EQ(0, mirror.numPending());
+
+  // Routes lost, changed or added behind the mirror's back are repaired,
+  // except for those with a change already queued
+  kernel = expected;
+  kernel.erase(key("10.1.0.0", 16));
+  kernel[key("10.2.0.0", 16)] = RouteType::BLACKHOLE;
+  kernel[key("10.5.0.0", 16)] = RouteType::UNICAST;
+  kernel.erase(key("10.3.0.0", 16));
+  RouteUpdater u2(tables1);
+  u2.delRoute(kRid, IPAddress("10.3.0.0"), 16);
+  auto tables2 = u2.updateDone();
+  ASSERT_NE(nullptr, tables2);
+  mirror.applyDelta(tables1.get(), tables2.get());
+  EXPECT_EQ(3, mirror.reconcile(kernel));
+  updates = mirror.takeUpdates(100);
+  ASSERT_EQ(3, updates.size());
+  expectUpdate(updates[0], key("10.1.0.0", 16), RouteType::BLACKHOLE, true);
+  expectUpdate(updates[1], key("10.2.0.0", 16), RouteType::UNICAST, true);
+  expectUpdate(updates[2], key("10.5.0.0", 16), RouteType::UNICAST, false);
+  EXPECT_EQ(0, mirror.getInstalled().count(key("10.3.0.0", 16)));
+  EXPECT_EQ(2, mirror.getInstalled().size());
+}
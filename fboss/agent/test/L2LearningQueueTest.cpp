@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/L2LearningQueue.h"
+#include "fboss/agent/state/MacTable.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::MacAddress;
+using std::chrono::milliseconds;
+using std::shared_ptr;
+
+namespace {
+
+const auto kLearned = L2EntryUpdateType::LEARNED;
+const auto kAged = L2EntryUpdateType::AGED;
+
+shared_ptr<SwitchState> initialState() {
+  auto state = testStateA();
+  state->publish();
+  return state;
+}
+
+shared_ptr<MacTable> macTable(const shared_ptr<SwitchState>& state,
+                              int vlan) {
+  return state->getVlans()->getVlan(VlanID(vlan))->getMacTable();
+}
+
+}
+
+TEST(L2LearningQueue, batchesUpdates) {
+  auto state = initialState();
+  L2LearningQueue queue(L2LearningQueue::Config{});
+  MacAddress mac1("02:00:00:00:00:01");
+  MacAddress mac2("02:00:00:00:00:02");
+
+  // Only the first event schedules a state update
+  EXPECT_TRUE(queue.add(VlanID(1), mac1, PortID(1), kLearned));
+  EXPECT_FALSE(queue.add(VlanID(55), mac2, PortID(5), kLearned));
+  // The MAC moved, and only its latest port is applied
+  EXPECT_FALSE(queue.add(VlanID(1), mac1, PortID(2), kLearned));
+  // Unknown VLANs are ignored
+  EXPECT_FALSE(queue.add(VlanID(2), mac1, PortID(1), kLearned));
+
+  auto newState = queue.applyUpdates(state);
+  ASSERT_NE(nullptr, newState);
+  auto entry = macTable(newState, 1)->getEntryIf(mac1);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(PortID(2), entry->port);
+  EXPECT_EQ(1, macTable(newState, 1)->size());
+  EXPECT_EQ(1, macTable(newState, 55)->size());
+  newState->publish();
+
+  // Nothing changes if the table is up to date already
+  EXPECT_TRUE(queue.add(VlanID(1), mac1, PortID(2), kLearned));
+  EXPECT_EQ(nullptr, queue.applyUpdates(newState));
+
+  // Learned and aged again in the same batch is a no-op
+  queue.add(VlanID(1), mac2, PortID(3), kLearned);
+  queue.add(VlanID(1), mac2, PortID(3), kAged);
+  EXPECT_EQ(nullptr, queue.applyUpdates(newState));
+
+  queue.add(VlanID(1), mac1, PortID(2), kAged);
+  auto agedState = queue.applyUpdates(newState);
+  ASSERT_NE(nullptr, agedState);
+  EXPECT_EQ(nullptr, macTable(agedState, 1)->getEntryIf(mac1));
+  // The other VLAN's table is shared with the previous state
+  EXPECT_EQ(macTable(newState, 55), macTable(agedState, 55));
+}
+
+TEST(L2LearningQueue, rateLimits) {
+  auto state = initialState();
+  L2LearningQueue::Config config;
+  config.rate = 10;
+  config.burst = 2;
+  L2LearningQueue queue(config);
+  auto now = std::chrono::steady_clock::now();
+
+  // The burst is accepted, and the rest of it is dropped
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:01"), PortID(1),
+            kLearned, now);
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:02"), PortID(1),
+            kLearned, now);
+  EXPECT_FALSE(queue.add(VlanID(1), MacAddress("02:00:00:00:00:03"),
+                         PortID(1), kLearned, now));
+  EXPECT_EQ(1, queue.getAndClearDropped());
+  EXPECT_EQ(0, queue.getAndClearDropped());
+
+  // The bucket refills at the rate
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:04"), PortID(1),
+            kLearned, now + milliseconds(100));
+  EXPECT_EQ(0, queue.getAndClearDropped());
+  auto newState = queue.applyUpdates(state);
+  ASSERT_NE(nullptr, newState);
+  EXPECT_EQ(3, macTable(newState, 1)->size());
+}
+
+TEST(L2LearningQueue, limitsEntries) {
+  auto state = initialState();
+  L2LearningQueue::Config config;
+  config.maxPending = 3;
+  config.maxMacsPerVlan = 2;
+  L2LearningQueue queue(config);
+
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:01"), PortID(1), kLearned);
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:02"), PortID(1), kLearned);
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:03"), PortID(1), kLearned);
+  // No room for another MAC in the queue, but a queued MAC can still change
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:04"), PortID(1), kLearned);
+  queue.add(VlanID(1), MacAddress("02:00:00:00:00:01"), PortID(2), kLearned);
+  EXPECT_EQ(1, queue.getAndClearDropped());
+
+  // Only two of them fit in the VLAN
+  uint64_t rejected = 0;
+  auto newState = queue.applyUpdates(state, &rejected);
+  ASSERT_NE(nullptr, newState);
+  EXPECT_EQ(1, rejected);
+  auto table = macTable(newState, 1);
+  EXPECT_EQ(2, table->size());
+  ASSERT_NE(nullptr, table->getEntryIf(MacAddress("02:00:00:00:00:01")));
+  EXPECT_EQ(PortID(2),
+            table->getEntryIf(MacAddress("02:00:00:00:00:01"))->port);
+
+  // The MAC table survives a warm boot
+  auto vlan = newState->getVlans()->getVlan(VlanID(1));
+  auto restored = Vlan::fromFollyDynamic(vlan->toFollyDynamic());
+  EXPECT_EQ(table->getTable(), restored->getMacTable()->getTable());
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/LacpManager.h"
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+using folly::MacAddress;
+using folly::io::Cursor;
+using folly::io::RWPrivateCursor;
+
+TEST(LacpManager, pduRoundTrip) {
+  LacpManager::Info actor;
+  actor.systemPriority = 0x8000;
+  actor.system = MacAddress("02:00:00:00:00:01");
+  actor.key = 10;
+  actor.portPriority = 0x8000;
+  actor.port = 3;
+  actor.state = LacpManager::STATE_ACTIVITY |
+    LacpManager::STATE_AGGREGATION | LacpManager::STATE_SYNCHRONIZATION;
+  LacpManager::Info partner;
+  partner.systemPriority = 100;
+  partner.system = MacAddress("02:00:00:00:00:02");
+  partner.key = 7;
+  partner.port = 40;
+  partner.state = LacpManager::STATE_DEFAULTED;
+
+  auto buf = IOBuf::create(LacpManager::kPduLength);
+  buf->append(LacpManager::kPduLength);
+  RWPrivateCursor out(buf.get());
+  LacpManager::writePdu(actor, partner, &out);
+  EXPECT_EQ(0, out.totalLength());
+
+  Cursor c(buf.get());
+  EXPECT_EQ(LacpManager::SUBTYPE_LACP, c.read<uint8_t>());
+  EXPECT_EQ(LacpManager::LACP_VERSION, c.read<uint8_t>());
+  EXPECT_EQ(1, c.read<uint8_t>());   // actor information
+  EXPECT_EQ(20, c.read<uint8_t>());
+  EXPECT_EQ(0x8000, c.readBE<uint16_t>());
+
+  LacpManager::Info actorBack;
+  LacpManager::Info partnerBack;
+  ASSERT_TRUE(LacpManager::parsePdu(Cursor(buf.get()), &actorBack,
+                                    &partnerBack));
+  EXPECT_EQ(actor, actorBack);
+  EXPECT_EQ(partner, partnerBack);
+}
+
+TEST(LacpManager, parseInvalid) {
+  LacpManager::Info actor;
+  LacpManager::Info partner;
+  auto buf = IOBuf::create(LacpManager::kPduLength);
+  buf->append(LacpManager::kPduLength);
+  RWPrivateCursor out(buf.get());
+  LacpManager::writePdu(actor, partner, &out);
+
+  // Truncated
+  auto truncated = buf->clone();
+  truncated->trimEnd(LacpManager::kPduLength - 30);
+  EXPECT_FALSE(LacpManager::parsePdu(Cursor(truncated.get()), &actor,
+                                     &partner));
+
+  // Another slow protocol, such as marker or OAM
+  buf->writableData()[0] = 3;
+  EXPECT_FALSE(LacpManager::parsePdu(Cursor(buf.get()), &actor, &partner));
+
+  // A bad TLV length
+  buf->writableData()[0] = LacpManager::SUBTYPE_LACP;
+  buf->writableData()[3] = 19;
+  EXPECT_FALSE(LacpManager::parsePdu(Cursor(buf.get()), &actor, &partner));
+}
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/LinkStateDebouncer.h"
+
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::chrono::milliseconds;
+
+namespace {
+
+typedef LinkStateDebouncer::LinkChanges LinkChanges;
+
+class LinkStateDebouncerTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    config_.upHoldDown = milliseconds(100);
+    config_.downHoldDown = milliseconds(0);
+    config_.batchWindow = milliseconds(20);
+  }
+
+  std::unique_ptr<LinkStateDebouncer> createDebouncer() {
+    return std::unique_ptr<LinkStateDebouncer>(new LinkStateDebouncer(
+        &evb_, config_,
+        [=](const LinkChanges& changes) { batches_.push_back(changes); }));
+  }
+
+  // Run the EventBase for the given time
+  void runFor(milliseconds time) {
+    evb_.runAfterDelay([=]() { evb_.terminateLoopSoon(); }, time.count());
+    evb_.loopForever();
+  }
+
+ protected:
+  folly::EventBase evb_;
+  LinkStateDebouncer::Config config_;
+  std::vector<LinkChanges> batches_;
+};
+
+} // unnamed namespace
+
+TEST_F(LinkStateDebouncerTest, HoldsDownLinkUp) {
+  auto debouncer = createDebouncer();
+  debouncer->linkStateChanged(PortID(1), true);
+  runFor(milliseconds(50));
+  EXPECT_TRUE(batches_.empty());
+  runFor(milliseconds(200));
+  ASSERT_EQ(1, batches_.size());
+  EXPECT_EQ(LinkChanges({{PortID(1), true}}), batches_[0]);
+  EXPECT_EQ(0, debouncer->getFlaps(PortID(1)));
+}
+
+TEST_F(LinkStateDebouncerTest, IgnoresBounces) {
+  auto debouncer = createDebouncer();
+  debouncer->linkStateChanged(PortID(1), false);
+  runFor(milliseconds(50));
+  ASSERT_EQ(1, batches_.size());
+
+  // The port comes back up and goes down again within the hold-down
+  debouncer->linkStateChanged(PortID(1), true);
+  debouncer->linkStateChanged(PortID(1), false);
+  runFor(milliseconds(200));
+  EXPECT_EQ(1, batches_.size());
+  EXPECT_EQ(2, debouncer->getFlaps(PortID(1)));
+
+  // Repeated events are not flaps
+  debouncer->linkStateChanged(PortID(1), false);
+  runFor(milliseconds(10));
+  EXPECT_EQ(2, debouncer->getFlaps(PortID(1)));
+}
+
+TEST_F(LinkStateDebouncerTest, BatchesChanges) {
+  auto debouncer = createDebouncer();
+  debouncer->linkStateChanged(PortID(1), false);
+  debouncer->linkStateChanged(PortID(2), false);
+  debouncer->linkStateChanged(PortID(3), true);
+  runFor(milliseconds(50));
+  ASSERT_EQ(1, batches_.size());
+  EXPECT_EQ(LinkChanges({{PortID(1), false}, {PortID(2), false}}),
+            batches_[0]);
+
+  runFor(milliseconds(200));
+  ASSERT_EQ(2, batches_.size());
+  EXPECT_EQ(LinkChanges({{PortID(3), true}}), batches_[1]);
+}
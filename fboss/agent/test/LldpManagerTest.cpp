@@ -108,4 +108,167 @@ TEST(LldpManagerTest, LldpSend) {
   LldpManager lldpManager(swPtr);
   lldpManager.sendLldpOnAllPorts(false);
 }
+
+unique_ptr<MockRxPacket> makeLldpPacket(const std::string& tlvs) {
+  auto pkt = MockRxPacket::fromHex(
+    // dst mac, src mac
+    "01 80 c2 00 00 0e  02 00 02 01 02 03"
+    // 802.1q, VLAN 1
+    "81 00 00 01"
+    // LLDP
+    "88 cc" + tlvs);
+  pkt->padToLength(68);
+  pkt->setSrcPort(PortID(1));
+  pkt->setSrcVlan(VlanID(1));
+  return pkt;
+}
+
+TEST(LldpManagerTest, LldpReceive) {
+  auto sw = setupSwitch();
+  CounterCache counters(sw.get());
+
+  sw->packetReceived(makeLldpPacket(
+    // Chassis ID, MAC 02:00:02:01:02:03
+    "02 07  04 02 00 02 01 02 03"
+    // Port ID, interface name "10"
+    "04 03  05 31 30"
+    // TTL 120
+    "06 02  00 78"
+    // System name "rsw"
+    "0a 03  72 73 77"
+    // End of PDU
+    "00 00"));
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.pkts.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix +
+                      "trapped.ethertype.lldp.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.unhandled.sum", 0);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.bogus.sum", 0);
+
+  // A TLV running past the end of the packet
+  sw->packetReceived(makeLldpPacket("0b ff  72 73 77"));
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix +
+                      "trapped.ethertype.lldp.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.bogus.sum", 1);
+}
+
+TEST(LldpManagerTest, RegisterAfterInit) {
+  auto sw = setupSwitch();
+  auto handler = [](unique_ptr<RxPacket> pkt, MacAddress dst, MacAddress src,
+                    Cursor c, PortStats* portStats) {};
+  EXPECT_THROW(sw->registerPacketHandler(0x88b5, "test", handler),
+               FbossError);
+}
+
+TEST(LldpManagerTest, LldpNeighbors) {
+  auto sw = setupSwitch();
+  CounterCache counters(sw.get());
+  auto lldpMgr = sw->getLldpManager();
+  auto pdu = [](const std::string& ttl, const std::string& name) {
+    return makeLldpPacket(
+      // Chassis ID, MAC 02:00:02:01:02:03
+      "02 07  04 02 00 02 01 02 03"
+      // Port ID, interface name "10"
+      "04 03  05 31 30"
+      // TTL
+      "06 02" + ttl +
+      // System name
+      "0a 03" + name +
+      // End of PDU
+      "00 00");
+  };
+
+  sw->packetReceived(pdu("00 78", "72 73 77"));
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix +
+                      "lldp.neighbor_changed.sum", 1);
+  counters.checkDelta(SwitchStats::kCounterPrefix +
+                      "lldp.neighbor_refreshed.sum", 0);
+  auto neighbors = lldpMgr->getNeighbors();
+  ASSERT_EQ(1, neighbors.size());
+  EXPECT_EQ(PortID(1), neighbors[0].port);
+  EXPECT_EQ(VlanID(1), neighbors[0].vlan);
+  EXPECT_EQ(MacAddress("02:00:02:01:02:03"), neighbors[0].mac);
+  EXPECT_EQ(LldpManager::CHASSIS_TLV_SUB_TYPE_MAC,
+            neighbors[0].chassisIdType);
+  EXPECT_EQ("02:00:02:01:02:03", neighbors[0].printableChassisId());
+  EXPECT_EQ(LldpManager::PORT_TLV_SUB_TYPE_INTERFACE,
+            neighbors[0].portIdType);
+  EXPECT_EQ("10", neighbors[0].printablePortId());
+  EXPECT_EQ("rsw", neighbors[0].systemName);
+  EXPECT_EQ(120, neighbors[0].ttl);
+  auto hash = neighbors[0].tlvHash;
+
+  // The same PDU again only refreshes the neighbor
+  sw->packetReceived(pdu("00 78", "72 73 77"));
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix +
+                      "lldp.neighbor_changed.sum", 0);
+  counters.checkDelta(SwitchStats::kCounterPrefix +
+                      "lldp.neighbor_refreshed.sum", 1);
+  neighbors = lldpMgr->getNeighbors();
+  ASSERT_EQ(1, neighbors.size());
+  EXPECT_EQ(hash, neighbors[0].tlvHash);
+  EXPECT_TRUE(neighbors[0].lastChanged <= neighbors[0].lastReceived);
+
+  // A new system name replaces the entry
+  sw->packetReceived(pdu("00 78", "72 73 78"));
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix +
+                      "lldp.neighbor_changed.sum", 1);
+  neighbors = lldpMgr->getNeighbors();
+  ASSERT_EQ(1, neighbors.size());
+  EXPECT_EQ("rsx", neighbors[0].systemName);
+  EXPECT_NE(hash, neighbors[0].tlvHash);
+
+  // A PDU without the mandatory TLVs is bogus, and leaves the entry alone
+  sw->packetReceived(makeLldpPacket("0a 03  72 73 77  00 00"));
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.bogus.sum", 1);
+  EXPECT_EQ(1, lldpMgr->getNeighbors().size());
+
+  // A TTL of 0 removes the neighbor
+  sw->packetReceived(pdu("00 00", "72 73 78"));
+  EXPECT_TRUE(lldpMgr->getNeighbors().empty());
+}
+
+TEST(LldpManagerTest, LldpPduCache) {
+  auto sw = setupSwitch();
+  std::vector<std::string> sent;
+  EXPECT_HW_CALL(sw, sendPacketOutOfPort_(TxPacketMatcher::createMatcher(
+      "Lldp PDU", [&](const TxPacket* pkt) {
+        Cursor c(pkt->buf());
+        sent.push_back(c.readFixedString(c.totalLength()));
+      }))).Times(AtLeast(1));
+  LldpManager lldpManager(sw.get());
+
+  // The cached frames are sent unchanged
+  lldpManager.sendLldpOnAllPorts(false);
+  auto first = sent;
+  sent.clear();
+  lldpManager.sendLldpOnAllPorts(false);
+  ASSERT_FALSE(first.empty());
+  EXPECT_EQ(first, sent);
+
+  // Changing a port's ingress VLAN rebuilds its frame
+  sw->updateStateBlocking("change VLAN", [](const shared_ptr<SwitchState>& s) {
+    auto newState = s->clone();
+    auto ports = newState->getPorts()->clone();
+    auto port = ports->getPort(PortID(1))->clone();
+    port->setIngressVlan(VlanID(55));
+    ports->updateNode(port);
+    newState->resetPorts(ports);
+    return newState;
+  });
+  sent.clear();
+  lldpManager.sendLldpOnAllPorts(false);
+  ASSERT_EQ(first.size(), sent.size());
+  EXPECT_NE(first[0], sent[0]);
+  // The VLAN ID follows the 802.1Q ethertype
+  EXPECT_EQ(55, (uint8_t(sent[0][14]) << 8) | uint8_t(sent[0][15]));
+  for (size_t i = 1; i < sent.size(); ++i) {
+    EXPECT_EQ(first[i], sent[i]);
+  }
+}
 } // unnamed namespace
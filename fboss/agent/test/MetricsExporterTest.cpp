@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/MetricsExporter.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+
+TEST(MetricsExporter, RendersCounters) {
+  std::map<std::string, int64_t> counters = {
+    {"trapped.pkts.sum", 10},
+    {"trapped.pkts.sum.60", 2},
+    {"trapped.pkts.rate.60", 1},
+    {"port1.in_bytes.sum", 100},
+    {"port2.in_bytes.sum", 200},
+    {"port1.out_queue_length.avg", 3},
+    {"route.update.us.p50", 20},
+    {"route.update.us.p99", 90},
+    {"boot.total_ms", 1234},
+  };
+  EXPECT_EQ(
+      "# TYPE fboss_boot_total_ms gauge\n"
+      "fboss_boot_total_ms 1234\n"
+      "# TYPE fboss_in_bytes counter\n"
+      "fboss_in_bytes_total{port=\"1\"} 100\n"
+      "fboss_in_bytes_total{port=\"2\"} 200\n"
+      "# TYPE fboss_out_queue_length_avg gauge\n"
+      "fboss_out_queue_length_avg{port=\"1\"} 3\n"
+      "# TYPE fboss_route_update_us summary\n"
+      "fboss_route_update_us{quantile=\"0.5\"} 20\n"
+      "fboss_route_update_us{quantile=\"0.99\"} 90\n"
+      "# TYPE fboss_trapped_pkts counter\n"
+      "fboss_trapped_pkts_total 10\n"
+      "# EOF\n",
+      MetricsExporter::render(counters));
+}
+
+TEST(MetricsExporter, SkipsConflictingTypes) {
+  std::map<std::string, int64_t> counters = {
+    {"foo.sum", 1},
+    {"foo.p50", 2},
+  };
+  // The first one in name order wins
+  EXPECT_EQ(
+      "# TYPE fboss_foo summary\n"
+      "fboss_foo{quantile=\"0.5\"} 2\n"
+      "# EOF\n",
+      MetricsExporter::render(counters));
+}
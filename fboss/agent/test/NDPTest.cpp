@@ -10,12 +10,14 @@
 #include <gtest/gtest.h>
 
 #include <future>
+#include <gflags/gflags.h>
 
 #include <folly/IPAddressV6.h>
 #include <folly/MacAddress.h>
 #include <folly/io/Cursor.h>
 #include "fboss/agent/AddressUtil.h"
 #include "fboss/agent/FbossError.h"
+#include "fboss/agent/NeighborHoldQueue.h"
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/SwitchStats.h"
 #include "fboss/agent/TxPacket.h"
@@ -28,7 +30,10 @@
 #include "fboss/agent/packet/PktUtil.h"
 #include "fboss/agent/state/Interface.h"
 #include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/NdpTable.h"
 #include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
 #include "fboss/agent/state/RouteUpdater.h"
 #include "fboss/agent/test/CounterCache.h"
 #include "fboss/agent/test/TestUtils.h"
@@ -48,6 +53,8 @@ using std::chrono::seconds;
 
 using ::testing::_;
 
+DECLARE_int32(ra_jitter_percent);
+
 namespace {
 
 const MacAddress kPlatformMac("02:01:02:03:04:05");
@@ -518,7 +525,60 @@ TEST(NDP, TriggerSolicitation) {
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.pkts.sum", 1);
 }
 
+// Wait until after the first RA interval has expired
+void waitForRA(SwSwitch* sw, uint32_t delayMs = 1010) {
+  // The RA packet will be sent in the background even thread after the RA
+  // interval.  Schedule a timeout to wake us up after the interval has
+  // expired.  Using the background TEventBase to run the timeout ensures that
+  // it will always run after the RA timeout has fired.
+  std::promise<bool> done;
+  auto* evb = sw->getBackgroundEVB();
+  evb->runInEventBaseThread([&]() {
+      evb->tryRunAfterDelay([&]() {
+        done.set_value(true);
+      }, delayMs);
+    });
+  done.get_future().wait();
+}
+
+void sendRouterSolicitation(SwSwitch* sw) {
+  auto pkt = MockRxPacket::fromHex(
+      // dst mac, src mac
+      "33 33 00 00 00 02  02 05 73 f9 46 fc"
+      // 802.1q, VLAN 5
+      "81 00 00 05"
+      // IPv6
+      "86 dd"
+      // Version 6, traffic class, flow label
+      "6e 00 00 00"
+      // Payload length: 16
+      "00 10"
+      // Next Header: 58 (ICMPv6), Hop Limit (255)
+      "3a ff"
+      // src addr (fe80::5:73ff:fef9:46fc)
+      "fe 80 00 00 00 00 00 00 00 05 73 ff fe f9 46 fc"
+      // dst addr (ff02::2)
+      "ff 02 00 00 00 00 00 00 00 00 00 00 00 00 00 02"
+      // type: router solicitation
+      "85"
+      // code
+      "00"
+      // checksum
+      "05 39"
+      // reserved
+      "00 00 00 00"
+      // source link-layer address option
+      "01 01 02 05 73 f9 46 fc");
+  pkt->padToLength(68);
+  pkt->setSrcPort(PortID(1));
+  pkt->setSrcVlan(VlanID(5));
+  sw->packetReceived(std::move(pkt));
+}
+
 TEST(NDP, RouterAdvertisement) {
+  // Send the first RA exactly one interval after startup
+  auto origJitter = FLAGS_ra_jitter_percent;
+  FLAGS_ra_jitter_percent = 0;
   seconds raInterval(1);
   auto sw = setupSwitchWithRAInterval(raInterval);
 
@@ -533,18 +593,7 @@ TEST(NDP, RouterAdvertisement) {
                                VlanID(5), intfConfig->getNdpConfig(),
                                9000, expectedPrefixes));
 
-  // The RA packet will be sent in the background even thread after the RA
-  // interval.  Schedule a timeout to wake us up after the interval has
-  // expired.  Using the background TEventBase to run the timeout ensures that
-  // it will always run after the RA timeout has fired.
-  std::promise<bool> done;
-  auto* evb = sw->getBackgroundEVB();
-  evb->runInEventBaseThread([&]() {
-      evb->tryRunAfterDelay([&]() {
-        done.set_value(true);
-      }, 1010);
-    });
-  done.get_future().wait();
+  waitForRA(sw.get());
   // We send RA packets just before switch controller shutdown,
   // so expect RA packet.
   EXPECT_PKT(sw, "router advertisement",
@@ -552,6 +601,96 @@ TEST(NDP, RouterAdvertisement) {
                                IPAddressV6("fe80::1:02ff:fe03:0405"),
                                VlanID(5), intfConfig->getNdpConfig(),
                                9000, expectedPrefixes));
+  sw.reset();
+  FLAGS_ra_jitter_percent = origJitter;
+}
+
+TEST(NDP, RouterAdvertisementMtuChange) {
+  auto origJitter = FLAGS_ra_jitter_percent;
+  FLAGS_ra_jitter_percent = 0;
+  seconds raInterval(1);
+  auto sw = setupSwitchWithRAInterval(raInterval);
+
+  // Changing the VLAN's MTU updates the RA packet in place, without
+  // restarting the advertiser or sending an extra advertisement
+  sw->updateStateBlocking("change MTU", [](const shared_ptr<SwitchState>& s) {
+    auto newState = s;
+    auto vlan = s->getVlans()->getVlan(VlanID(5))->modify(&newState);
+    vlan->setMTU(1500);
+    return newState;
+  });
+
+  auto intfConfig =
+    sw->getState()->getInterfaces()->getInterface(InterfaceID(1234));
+  PrefixVector expectedPrefixes{
+    { IPAddressV6("2401:db00:2110:3004::"), 64 },
+  };
+  EXPECT_PKT(sw, "router advertisement",
+             checkRouterAdvert(kPlatformMac,
+                               IPAddressV6("fe80::1:02ff:fe03:0405"),
+                               VlanID(5), intfConfig->getNdpConfig(),
+                               1500, expectedPrefixes));
+  waitForRA(sw.get());
+  EXPECT_PKT(sw, "router advertisement",
+             checkRouterAdvert(kPlatformMac,
+                               IPAddressV6("fe80::1:02ff:fe03:0405"),
+                               VlanID(5), intfConfig->getNdpConfig(),
+                               1500, expectedPrefixes));
+  sw.reset();
+  FLAGS_ra_jitter_percent = origJitter;
+}
+
+TEST(NDP, RouterSolicitation) {
+  auto origJitter = FLAGS_ra_jitter_percent;
+  FLAGS_ra_jitter_percent = 0;
+  seconds raInterval(4);
+  auto sw = setupSwitchWithRAInterval(raInterval);
+  CounterCache counters(sw.get());
+
+  auto intfConfig =
+    sw->getState()->getInterfaces()->getInterface(InterfaceID(1234));
+  PrefixVector expectedPrefixes{
+    { IPAddressV6("2401:db00:2110:3004::"), 64 },
+  };
+  // A burst of solicitations is answered by a single multicast RA, well
+  // before the periodic one is due
+  EXPECT_PKT(sw, "router advertisement",
+             checkRouterAdvert(kPlatformMac,
+                               IPAddressV6("fe80::1:02ff:fe03:0405"),
+                               VlanID(5), intfConfig->getNdpConfig(),
+                               9000, expectedPrefixes));
+  for (int i = 0; i < 3; ++i) {
+    sendRouterSolicitation(sw.get());
+  }
+  waitForRA(sw.get(), 600);
+
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.ndp.sum", 3);
+  counters.checkDelta(SwitchStats::kCounterPrefix + "ipv6.ndp.ra_solicited.sum",
+                      1);
+
+  // We send RA packets just before switch controller shutdown
+  EXPECT_PKT(sw, "router advertisement",
+             checkRouterAdvert(kPlatformMac,
+                               IPAddressV6("fe80::1:02ff:fe03:0405"),
+                               VlanID(5), intfConfig->getNdpConfig(),
+                               9000, expectedPrefixes));
+  sw.reset();
+  FLAGS_ra_jitter_percent = origJitter;
+}
+
+TEST(NDP, RouterSolicitationWithoutRA) {
+  auto sw = setupSwitch();
+  CounterCache counters(sw.get());
+
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(0);
+  sendRouterSolicitation(sw.get());
+  // Let the background thread get to the solicitation
+  waitForRA(sw.get(), 10);
+
+  counters.update();
+  counters.checkDelta(SwitchStats::kCounterPrefix + "ipv6.ndp.rs_dropped.sum",
+                      1);
 }
 
 TEST(NDP, FlushEntry) {
@@ -626,6 +765,41 @@ TEST(NDP, FlushEntry) {
   ASSERT_EQ(ndpTable.size(), 0);
 }
 
+TEST(NDP, BatchedNeighborUpdates) {
+  auto sw = setupSwitch();
+  VlanID vlanID(5);
+
+  // Hold up the update thread, so all the advertisements below are queued
+  // before any of them are applied
+  std::promise<bool> unblock;
+  auto unblocked = unblock.get_future().share();
+  sw->updateState("block updates", [=](const shared_ptr<SwitchState>&) {
+      unblocked.wait();
+      return shared_ptr<SwitchState>();
+    });
+
+  // A single state update learns all of the neighbors, and only the latest
+  // advertisement for each neighbor is applied
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  sendNeighborAdvertisement(sw.get(), "2401:db00:2110:3004::b",
+                            "02:05:73:f9:46:fb", 1, vlanID);
+  sendNeighborAdvertisement(sw.get(), "2401:db00:2110:3004::c",
+                            "02:05:73:f9:46:fc", 1, vlanID);
+  sendNeighborAdvertisement(sw.get(), "2401:db00:2110:3004::b",
+                            "02:05:73:f9:46:fd", 2, vlanID);
+  unblock.set_value(true);
+  waitForStateUpdates(sw.get());
+
+  auto ndpTable = sw->getState()->getVlans()->getVlanIf(vlanID)->getNdpTable();
+  auto entry = ndpTable->getEntryIf(IPAddressV6("2401:db00:2110:3004::b"));
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(MacAddress("02:05:73:f9:46:fd"), entry->getMac());
+  EXPECT_EQ(PortID(2), entry->getPort());
+  entry = ndpTable->getEntryIf(IPAddressV6("2401:db00:2110:3004::c"));
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(MacAddress("02:05:73:f9:46:fc"), entry->getMac());
+}
+
 TEST(NDP, PendingNdp) {
   auto sw = setupSwitch();
 
@@ -706,8 +880,13 @@ TEST(NDP, PendingNdp) {
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.pkts.sum", 1);
   counters.checkDelta(SwitchStats::kCounterPrefix + "trapped.ndp.sum", 0);
 
+  // Both packets are held until the neighbor resolves
+  EXPECT_EQ(2, sw->getNeighborHoldQueue()->numHeld());
+
+  // Receive an ndp advertisement for our pending entry.  Once the hardware
+  // has the entry, the held packets are sent to be routed.
   EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
-  // Receive an ndp advertisement for our pending entry
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(2);
   sendNeighborAdvertisement(sw.get(), "2401:db00:2110:3004::1:0",
                             "02:10:20:30:40:22", 1, vlanID);
 
@@ -717,11 +896,13 @@ TEST(NDP, PendingNdp) {
     ->getEntryIf(IPAddressV6("2401:db00:2110:3004::1:0"));
   EXPECT_NE(entry, nullptr);
   EXPECT_EQ(entry->isPending(), false);
+  EXPECT_EQ(0, sw->getNeighborHoldQueue()->numHeld());
 
   // Verify that we don't ever overwrite a valid entry with a pending one.
   // Receive the same packet again, no state update and the entry should still
   // be valid
   EXPECT_HW_CALL(sw, stateChanged(_)).Times(0);
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(0);
 
   sw->packetReceived(pkt->clone());
   waitForStateUpdates(sw.get());
@@ -884,3 +1065,104 @@ TEST(NDP, PendingNdpCleanup) {
   EXPECT_EQ(entry3, nullptr);
   EXPECT_NE(sw, nullptr);
 };
+
+namespace {
+
+void sendNeighborSolicitation(SwSwitch* sw, StringPiece srcIPStr,
+                              StringPiece srcMacStr, StringPiece targetIPStr,
+                              int port) {
+  IPAddressV6 srcIP(srcIPStr);
+  MacAddress srcMac(srcMacStr);
+  IPAddressV6 targetIP(targetIPStr);
+  VlanID vlan(5);
+
+  // Sent to the solicited-node multicast address of the target
+  const uint8_t* target = targetIP.bytes();
+  IPAddressV6::ByteArray16 dstBytes{{0xff, 0x02, 0, 0, 0, 0, 0, 0,
+                                     0, 0, 0, 0x01, 0xff, target[13],
+                                     target[14], target[15]}};
+  IPAddressV6 dstIP(dstBytes);
+  uint8_t dstMacBytes[] = {0x33, 0x33, 0xff, target[13], target[14],
+                           target[15]};
+  auto dstMac = MacAddress::fromBinary(
+      folly::ByteRange(dstMacBytes, sizeof(dstMacBytes)));
+  size_t plen = 4 + 16 + 8;
+
+  IPv6Hdr ipv6(srcIP, dstIP);
+  ipv6.payloadLength = ICMPHdr::SIZE + plen;
+  ipv6.nextHeader = IP_PROTO_IPV6_ICMP;
+  ipv6.hopLimit = 255;
+
+  size_t totalLen = EthHdr::SIZE + IPv6Hdr::SIZE + ipv6.payloadLength;
+  auto buf = folly::IOBuf::create(totalLen);
+  buf->append(totalLen);
+  folly::io::RWPrivateCursor cursor(buf.get());
+
+  auto bodyFn = [&] (folly::io::RWPrivateCursor *c) {
+    c->writeBE<uint32_t>(0);
+    c->push(targetIP.bytes(), IPAddressV6::byteCount());
+    c->write<uint8_t>(1); // source MAC option
+    c->write<uint8_t>(1);
+    c->push(srcMac.bytes(), MacAddress::SIZE);
+  };
+
+  ICMPHdr icmp6(ICMPV6_TYPE_NDP_NEIGHBOR_SOLICITATION, 0, 0);
+  icmp6.serializeFullPacket(&cursor, dstMac, srcMac, vlan, ipv6, plen, bodyFn);
+
+  auto pkt = folly::make_unique<MockRxPacket>(std::move(buf));
+  pkt->padToLength(totalLen);
+  pkt->setSrcPort(PortID(port));
+  pkt->setSrcVlan(vlan);
+  sw->packetReceived(std::move(pkt));
+}
+
+} // unnamed namespace
+
+TEST(NDP, NeighborSuppression) {
+  auto sw = setupSwitch();
+  IPAddressV6 hostIP("2401:db00:2110:3004::b");
+  MacAddress hostMac("02:00:00:00:00:0b");
+
+  // Turn on the suppression, with the host known on port 2
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  auto enable = [=](const shared_ptr<SwitchState>& state) {
+    shared_ptr<SwitchState> newState{state};
+    auto* vlan = state->getVlans()->getVlan(VlanID(5)).get();
+    auto* ndpTable = vlan->getNdpTable()->modify(&vlan, &newState);
+    ndpTable->addEntry(hostIP, hostMac, PortID(2), InterfaceID(1234));
+    newState->setNeighborSuppression(true);
+    return newState;
+  };
+  sw->updateStateBlocking("neighbor suppression", enable);
+  CounterCache counters(sw.get());
+
+  // The solicitation for the host is answered for it, back out of the port
+  // it came in on, with the solicited and override flags but not the
+  // router flag
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(0);
+  EXPECT_HW_CALL(sw, sendPacketOutOfPort_(TxPacketMatcher::createMatcher(
+      "neighbor advertisement",
+      checkNeighborAdvert(hostMac, hostIP, MacAddress("02:05:73:f9:46:fc"),
+                          IPAddressV6("2401:db00:2110:3004::c"), VlanID(5),
+                          0x60)))).Times(1);
+  sendNeighborSolicitation(sw.get(), "2401:db00:2110:3004::c",
+                           "02:05:73:f9:46:fc", "2401:db00:2110:3004::b", 1);
+  counters.update();
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.suppressed.sum", 1);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.flooded.sum", 0);
+
+  // Duplicate address detection, and the solicitations for unknown hosts,
+  // are flooded out of the other 9 ports of the VLAN
+  EXPECT_HW_CALL(sw, sendPacketOutOfPort_(_)).Times(18);
+  sendNeighborSolicitation(sw.get(), "::", "02:05:73:f9:46:fc",
+                           "2401:db00:2110:3004::b", 1);
+  sendNeighborSolicitation(sw.get(), "2401:db00:2110:3004::c",
+                           "02:05:73:f9:46:fc", "2401:db00:2110:3004::d", 1);
+  counters.update();
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.suppressed.sum", 0);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.request.flooded.sum", 2);
+}
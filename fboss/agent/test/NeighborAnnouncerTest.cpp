@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborAnnouncer.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/TxPacket.h"
+#include "fboss/agent/hw/mock/MockHwSwitch.h"
+#include "fboss/agent/hw/mock/MockPlatform.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/test/CounterCache.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <future>
+
+DECLARE_int32(neighbor_announce_count);
+DECLARE_int32(neighbor_announce_interval_ms);
+DECLARE_int32(neighbor_announce_jitter_ms);
+DECLARE_int32(neighbor_announce_pps);
+DECLARE_int32(neighbor_announce_burst);
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::shared_ptr;
+using std::unique_ptr;
+
+using ::testing::_;
+
+namespace {
+
+// Announcement settings are read when the switch is created
+unique_ptr<SwSwitch> setupSwitch(int32_t count, int32_t intervalMs,
+                                 int32_t pps, int32_t burst) {
+  auto origCount = FLAGS_neighbor_announce_count;
+  auto origInterval = FLAGS_neighbor_announce_interval_ms;
+  auto origJitter = FLAGS_neighbor_announce_jitter_ms;
+  auto origPps = FLAGS_neighbor_announce_pps;
+  auto origBurst = FLAGS_neighbor_announce_burst;
+  FLAGS_neighbor_announce_count = count;
+  FLAGS_neighbor_announce_interval_ms = intervalMs;
+  FLAGS_neighbor_announce_jitter_ms = 0;
+  FLAGS_neighbor_announce_pps = pps;
+  FLAGS_neighbor_announce_burst = burst;
+  auto sw = createMockSw(testStateA());
+  FLAGS_neighbor_announce_count = origCount;
+  FLAGS_neighbor_announce_interval_ms = origInterval;
+  FLAGS_neighbor_announce_jitter_ms = origJitter;
+  FLAGS_neighbor_announce_pps = origPps;
+  FLAGS_neighbor_announce_burst = origBurst;
+  return sw;
+}
+
+void addAddresses(SwSwitch* sw, const std::vector<IPAddress>& addrs) {
+  auto updateFn = [&](const shared_ptr<SwitchState>& state) {
+    auto newState = state->clone();
+    auto intfs = state->getInterfaces()->clone();
+    auto intf = intfs->getInterface(InterfaceID(1))->clone();
+    auto newAddrs = intf->getAddresses();
+    for (const auto& addr : addrs) {
+      newAddrs.emplace(addr, addr.isV4() ? 24 : 64);
+    }
+    intf->setAddresses(newAddrs);
+    intfs->updateNode(intf);
+    newState->resetIntfs(intfs);
+    return newState;
+  };
+  sw->updateStateBlocking("add addresses", updateFn);
+}
+
+void waitForBackground(SwSwitch* sw, uint32_t ms) {
+  std::promise<bool> done;
+  auto* evb = sw->getBackgroundEVB();
+  evb->runInEventBaseThread([&]() {
+      evb->tryRunAfterDelay([&]() {
+        done.set_value(true);
+      }, ms);
+    });
+  done.get_future().wait();
+}
+
+} // unnamed namespace
+
+TEST(NeighborAnnouncer, RepeatAnnouncements) {
+  auto sw = setupSwitch(2, 50, 100, 20);
+  CounterCache counters(sw.get());
+
+  // One gratuitous ARP and one neighbor advertisement each round
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(4);
+  addAddresses(sw.get(), {IPAddress("10.0.0.100"),
+                          IPAddress("2401:db00:2110:3001::100")});
+  waitForBackground(sw.get(), 300);
+
+  counters.update();
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.announce.sent.sum", 4);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.announce.deferred.sum", 0);
+}
+
+TEST(NeighborAnnouncer, RateLimited) {
+  // One token every 100ms, and no bursts
+  auto sw = setupSwitch(1, 1000, 10, 1);
+  CounterCache counters(sw.get());
+
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(3);
+  addAddresses(sw.get(), {IPAddress("10.0.0.100"), IPAddress("10.0.0.101"),
+                          IPAddress("10.0.0.102")});
+  waitForBackground(sw.get(), 50);
+
+  // Only the first announcement could be sent right away
+  counters.update();
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.announce.sent.sum", 1);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.announce.deferred.sum", 2);
+
+  waitForBackground(sw.get(), 300);
+  counters.update();
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.announce.sent.sum", 2);
+  counters.checkDelta(
+      SwitchStats::kCounterPrefix + "neighbor.announce.deferred.sum", 0);
+}
+
+TEST(NeighborAnnouncer, ExistingAddressesNotAnnounced) {
+  auto sw = setupSwitch(1, 50, 100, 20);
+
+  // Changes that don't add addresses don't announce anything
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(testing::AtMost(1));
+  EXPECT_HW_CALL(sw, sendPacketSwitched_(_)).Times(0);
+  addAddresses(sw.get(), {IPAddress("10.0.0.1")});
+  waitForBackground(sw.get(), 100);
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborResolutionCache.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace facebook::fboss;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using std::chrono::milliseconds;
+using std::make_shared;
+
+typedef NeighborResolutionCache<IPAddressV4> CacheV4;
+
+TEST(NeighborResolutionCache, lookup) {
+  auto state = make_shared<SwitchState>();
+  state->publish();
+  CacheV4 cache(16, milliseconds(60000));
+  IPAddressV4 dest("10.0.0.10");
+  IPAddressV4 other("10.0.0.11");
+
+  CacheV4::Result result;
+  EXPECT_FALSE(cache.lookup(*state, dest, &result));
+  cache.record(*state, dest, CacheV4::Result::REQUESTED);
+  ASSERT_TRUE(cache.lookup(*state, dest, &result));
+  EXPECT_EQ(CacheV4::Result::REQUESTED, result);
+  EXPECT_FALSE(cache.lookup(*state, other, &result));
+
+  // A single slot only holds the latest destination
+  CacheV4 small(1, milliseconds(60000));
+  small.record(*state, dest, CacheV4::Result::RESOLVED);
+  small.record(*state, other, CacheV4::Result::NO_ROUTE);
+  EXPECT_FALSE(small.lookup(*state, dest, &result));
+  ASSERT_TRUE(small.lookup(*state, other, &result));
+  EXPECT_EQ(CacheV4::Result::NO_ROUTE, result);
+}
+
+TEST(NeighborResolutionCache, stateChanges) {
+  auto state = make_shared<SwitchState>();
+  state->publish();
+  NeighborResolutionCache<IPAddressV6> cache(16, milliseconds(60000));
+  IPAddressV6 dest("2401:db00:2110:3004::1");
+  cache.record(*state, dest,
+               NeighborResolutionCache<IPAddressV6>::Result::RESOLVED);
+
+  // Results are ignored once the state changes
+  NeighborResolutionCache<IPAddressV6>::Result result;
+  auto newState = state->clone();
+  newState->publish();
+  EXPECT_TRUE(cache.lookup(*state, dest, &result));
+  EXPECT_FALSE(cache.lookup(*newState, dest, &result));
+
+  // Or for an unrelated state of the same generation
+  auto otherState = make_shared<SwitchState>();
+  otherState->publish();
+  EXPECT_EQ(state->getGeneration(), otherState->getGeneration());
+  EXPECT_FALSE(cache.lookup(*otherState, dest, &result));
+}
+
+TEST(NeighborResolutionCache, retry) {
+  auto state = make_shared<SwitchState>();
+  state->publish();
+  CacheV4 cache(16, milliseconds(10));
+  IPAddressV4 requested("10.0.0.10");
+  IPAddressV4 resolved("10.0.0.11");
+  cache.record(*state, requested, CacheV4::Result::REQUESTED);
+  cache.record(*state, resolved, CacheV4::Result::RESOLVED);
+
+  // Requests are retried after a while, even in the same state
+  std::this_thread::sleep_for(milliseconds(20));
+  CacheV4::Result result;
+  EXPECT_FALSE(cache.lookup(*state, requested, &result));
+  EXPECT_TRUE(cache.lookup(*state, resolved, &result));
+}
+
+TEST(NeighborResolutionCache, disabled) {
+  auto state = make_shared<SwitchState>();
+  state->publish();
+  CacheV4 cache(0, milliseconds(60000));
+  EXPECT_FALSE(cache.isEnabled());
+  IPAddressV4 dest("10.0.0.10");
+  cache.record(*state, dest, CacheV4::Result::RESOLVED);
+  CacheV4::Result result;
+  EXPECT_FALSE(cache.lookup(*state, dest, &result));
+}
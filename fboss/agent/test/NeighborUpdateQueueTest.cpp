@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/NeighborUpdateQueue.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <folly/Conv.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+using namespace facebook::fboss;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using std::shared_ptr;
+
+DECLARE_int32(max_neighbors_per_vlan);
+
+namespace {
+
+typedef NeighborUpdateQueue<ArpTable> ArpQueue;
+
+shared_ptr<SwitchState> initialState() {
+  auto state = testStateA();
+  state->publish();
+  return state;
+}
+
+ArpQueue::Update arpUpdate(const char* mac, int port, int intf,
+                           bool addNewEntry = true) {
+  return ArpQueue::Update{PortID(port), InterfaceID(intf), MacAddress(mac),
+                          addNewEntry};
+}
+
+}
+
+TEST(NeighborUpdateQueue, batchesUpdates) {
+  auto state = initialState();
+  ArpQueue queue(4);
+
+  // Only the first update schedules a state update
+  EXPECT_TRUE(queue.add(VlanID(1), IPAddressV4("10.0.0.10"),
+                        arpUpdate("02:00:00:00:00:0a", 1, 1)));
+  EXPECT_FALSE(queue.add(VlanID(55), IPAddressV4("10.0.55.10"),
+                         arpUpdate("02:00:00:00:00:0b", 5, 55)));
+  EXPECT_FALSE(queue.add(VlanID(1), IPAddressV4("10.0.0.10"),
+                         arpUpdate("02:00:00:00:00:0c", 2, 1)));
+
+  auto newState = queue.applyUpdates(state);
+  ASSERT_NE(nullptr, newState);
+  auto entry = newState->getVlans()->getVlan(VlanID(1))->getArpTable()->
+    getEntryIf(IPAddressV4("10.0.0.10"));
+  ASSERT_NE(nullptr, entry);
+  // Only the latest update for each neighbor is applied
+  EXPECT_EQ(MacAddress("02:00:00:00:00:0c"), entry->getMac());
+  EXPECT_EQ(PortID(2), entry->getPort());
+  entry = newState->getVlans()->getVlan(VlanID(55))->getArpTable()->
+    getEntryIf(IPAddressV4("10.0.55.10"));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(MacAddress("02:00:00:00:00:0b"), entry->getMac());
+
+  // The queue is empty now, and the next update schedules a new one
+  EXPECT_EQ(nullptr, queue.applyUpdates(newState));
+  EXPECT_TRUE(queue.add(VlanID(1), IPAddressV4("10.0.0.10"),
+                        arpUpdate("02:00:00:00:00:0c", 2, 1)));
+  // The entry is up to date already
+  EXPECT_EQ(nullptr, queue.applyUpdates(newState));
+}
+
+TEST(NeighborUpdateQueue, validatesUpdates) {
+  auto state = initialState();
+  ArpQueue queue(1);
+
+  // Entries that are not already present are only added if requested
+  queue.add(VlanID(1), IPAddressV4("10.0.0.10"),
+            arpUpdate("02:00:00:00:00:0a", 1, 1, false));
+  // Unknown VLANs and unattached addresses are dropped
+  queue.add(VlanID(2), IPAddressV4("10.0.0.11"),
+            arpUpdate("02:00:00:00:00:0b", 1, 1));
+  queue.add(VlanID(1), IPAddressV4("10.1.0.12"),
+            arpUpdate("02:00:00:00:00:0c", 1, 1));
+  EXPECT_EQ(nullptr, queue.applyUpdates(state));
+
+  // A later update that may not add the entry does not cancel an earlier
+  // one that may
+  queue.add(VlanID(1), IPAddressV4("10.0.0.10"),
+            arpUpdate("02:00:00:00:00:0a", 1, 1));
+  queue.add(VlanID(1), IPAddressV4("10.0.0.10"),
+            arpUpdate("02:00:00:00:00:0d", 3, 1, false));
+  auto newState = queue.applyUpdates(state);
+  ASSERT_NE(nullptr, newState);
+  auto entry = newState->getVlans()->getVlan(VlanID(1))->getArpTable()->
+    getEntryIf(IPAddressV4("10.0.0.10"));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(MacAddress("02:00:00:00:00:0d"), entry->getMac());
+  EXPECT_EQ(PortID(3), entry->getPort());
+}
+
+TEST(NeighborUpdateQueue, concurrentUpdates) {
+  auto state = initialState();
+  NeighborUpdateQueue<NdpTable> queue(16);
+
+  // Learn neighbors on both VLANs from several threads at once
+  constexpr int kNumThreads = 4;
+  constexpr int kNumEntries = 100;
+  std::atomic<int> numScheduled{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t] {
+      auto vlan = (t % 2) ? VlanID(55) : VlanID(1);
+      auto intf = (t % 2) ? InterfaceID(55) : InterfaceID(1);
+      auto prefix = (t % 2) ? "2401:db00:2110:3055::" :
+        "2401:db00:2110:3001::";
+      for (int i = 0; i < kNumEntries; ++i) {
+        IPAddressV6 ip(folly::to<std::string>(prefix, t, ":", i + 10));
+        if (queue.add(vlan, ip, {PortID(t + 1), intf,
+                                 MacAddress::fromHBO(i + 10), true})) {
+          ++numScheduled;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(1, numScheduled.load());
+
+  auto newState = queue.applyUpdates(state);
+  ASSERT_NE(nullptr, newState);
+  auto vlans = newState->getVlans();
+  EXPECT_EQ(kNumThreads * kNumEntries / 2,
+            vlans->getVlan(VlanID(1))->getNdpTable()->size());
+  EXPECT_EQ(kNumThreads * kNumEntries / 2,
+            vlans->getVlan(VlanID(55))->getNdpTable()->size());
+}
+
+TEST(NeighborUpdateQueue, limitsEntries) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_max_neighbors_per_vlan = 2;
+  auto state = initialState();
+  ArpQueue queue(4);
+
+  // Only the first two new entries on VLAN 1 fit
+  for (int i = 0; i < 4; ++i) {
+    queue.add(VlanID(1), IPAddressV4::fromHBO(0x0a00000a + i),
+              arpUpdate("02:00:00:00:00:0a", 1, 1));
+  }
+  queue.add(VlanID(55), IPAddressV4("10.0.55.10"),
+            arpUpdate("02:00:00:00:00:0b", 5, 55));
+  uint64_t numRejected = 0;
+  auto newState = queue.applyUpdates(state, &numRejected);
+  ASSERT_NE(nullptr, newState);
+  EXPECT_EQ(2, numRejected);
+  auto vlans = newState->getVlans();
+  EXPECT_EQ(2, vlans->getVlan(VlanID(1))->getArpTable()->size());
+  EXPECT_EQ(1, vlans->getVlan(VlanID(55))->getArpTable()->size());
+
+  // Entries already in the full table are still updated
+  numRejected = 0;
+  queue.add(VlanID(1), IPAddressV4("10.0.0.10"),
+            arpUpdate("02:00:00:00:00:0c", 2, 1));
+  queue.add(VlanID(1), IPAddressV4("10.0.0.20"),
+            arpUpdate("02:00:00:00:00:0d", 2, 1));
+  newState = queue.applyUpdates(newState, &numRejected);
+  ASSERT_NE(nullptr, newState);
+  EXPECT_EQ(1, numRejected);
+  auto entry = newState->getVlans()->getVlan(VlanID(1))->getArpTable()->
+    getEntryIf(IPAddressV4("10.0.0.10"));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(MacAddress("02:00:00:00:00:0c"), entry->getMac());
+}
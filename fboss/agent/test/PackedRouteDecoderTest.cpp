@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PackedRouteDecoder.h"
+
+#include "fboss/agent/AddressUtil.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteTable.h"
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteTableRib.h"
+#include "fboss/agent/state/RouteUpdater.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using facebook::network::toBinaryAddress;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using std::make_shared;
+
+namespace {
+
+const RouterID kRid(0);
+const ClientID kClient(1);
+
+void appendRecord(folly::fbstring* buf, const IPAddress& network,
+                  uint8_t len, uint32_t group) {
+  buf->append(reinterpret_cast<const char*>(network.bytes()),
+              network.byteCount());
+  buf->push_back(static_cast<char>(len));
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    buf->push_back(static_cast<char>((group >> shift) & 0xff));
+  }
+}
+
+PackedRoutes makeRoutes() {
+  PackedRoutes routes;
+  routes.nexthopGroups.resize(2);
+  routes.nexthopGroups[0].push_back(toBinaryAddress(IPAddress("1.1.1.1")));
+  routes.nexthopGroups[1].push_back(toBinaryAddress(IPAddress("1.1.1.2")));
+  routes.nexthopGroups[1].push_back(toBinaryAddress(IPAddress("1.1.1.3")));
+  appendRecord(&routes.v4Routes, IPAddress("10.0.0.0"), 8, 0);
+  // The host bits are masked off
+  appendRecord(&routes.v4Routes, IPAddress("20.1.1.1"), 24, 1);
+  appendRecord(&routes.v6Routes, IPAddress("2401:db00::"), 32, 1);
+  return routes;
+}
+
+} // unnamed namespace
+
+TEST(PackedRouteDecoder, addRoutes) {
+  PackedRouteDecoder decoder(makeRoutes(), 20);
+  ASSERT_EQ(3, decoder.size());
+
+  // Added in two chunks, the second spanning both address families
+  RouteUpdater updater(make_shared<RouteTableMap>());
+  decoder.addRoutes(&updater, kRid, kClient, 0, 1);
+  decoder.addRoutes(&updater, kRid, kClient, 1, 3);
+  auto tables = updater.updateDone();
+  ASSERT_NE(nullptr, tables);
+  auto table = tables->getRouteTable(kRid);
+
+  auto r8 = table->getRibV4()->exactMatch({IPAddressV4("10.0.0.0"), 8});
+  ASSERT_NE(nullptr, r8);
+  EXPECT_TRUE(r8->hasClient(kClient));
+  auto r24 = table->getRibV4()->exactMatch({IPAddressV4("20.1.1.0"), 24});
+  ASSERT_NE(nullptr, r24);
+  const auto& entry = r24->getClients().at(kClient);
+  EXPECT_EQ(20, entry.adminDistance);
+  EXPECT_EQ(2, entry.nexthops->size());
+  auto r32 = table->getRibV6()->exactMatch({IPAddressV6("2401:db00::"), 32});
+  ASSERT_NE(nullptr, r32);
+  EXPECT_EQ(entry, r32->getClients().at(kClient));
+}
+
+TEST(PackedRouteDecoder, invalidRoutes) {
+  // A partial record
+  auto routes = makeRoutes();
+  routes.v6Routes.pop_back();
+  EXPECT_THROW(PackedRouteDecoder(std::move(routes), 20), FbossError);
+
+  // A bad nexthop group index is only found when the route is added
+  routes = makeRoutes();
+  appendRecord(&routes.v4Routes, IPAddress("30.0.0.0"), 8, 2);
+  PackedRouteDecoder badGroup(std::move(routes), 20);
+  RouteUpdater u1(make_shared<RouteTableMap>());
+  EXPECT_THROW(badGroup.addRoutes(&u1, kRid, kClient, 0, badGroup.size()),
+               FbossError);
+
+  routes = makeRoutes();
+  appendRecord(&routes.v4Routes, IPAddress("30.0.0.0"), 33, 0);
+  PackedRouteDecoder badLength(std::move(routes), 20);
+  RouteUpdater u2(make_shared<RouteTableMap>());
+  EXPECT_THROW(badLength.addRoutes(&u2, kRid, kClient, 0, badLength.size()),
+               FbossError);
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PacketLatency.h"
+
+#include "fboss/agent/ArpHandler.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+#include "fboss/agent/hw/mock/MockTxPacket.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+DECLARE_int32(pkt_latency_sample_rate);
+
+using namespace facebook::fboss;
+
+namespace {
+
+std::unique_ptr<MockRxPacket> makeArpPacket() {
+  return MockRxPacket::fromHex(
+      // dst mac, src mac, ethertype
+      "ff ff ff ff ff ff  02 00 02 01 02 03  08 06");
+}
+
+}
+
+TEST(PacketLatency, sampling) {
+  FLAGS_pkt_latency_sample_rate = 0;
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_FALSE(PacketLatency::shouldSample());
+  }
+
+  FLAGS_pkt_latency_sample_rate = 4;
+  int sampled = 0;
+  for (int i = 0; i < 40; ++i) {
+    if (PacketLatency::shouldSample()) {
+      ++sampled;
+    }
+  }
+  EXPECT_EQ(10, sampled);
+
+  FLAGS_pkt_latency_sample_rate = 1;
+  auto pkt = makeArpPacket();
+  PacketLatency::maybeTrace(pkt.get());
+  EXPECT_TRUE(pkt->getTrace().isActive());
+}
+
+TEST(PacketLatency, tagReplies) {
+  auto rxPkt = makeArpPacket();
+  MockTxPacket reply(64);
+  MockTxPacket unrelated(64);
+
+  // Nothing is tagged while no traced packet is being handled
+  PacketLatency::tagCurrent(&unrelated);
+  EXPECT_FALSE(unrelated.getTrace().isActive());
+  {
+    // Untraced packets do not tag anything either
+    PacketLatency::HandlerScope scope(rxPkt.get(), ArpHandler::ETHERTYPE_ARP);
+    PacketLatency::tagCurrent(&unrelated);
+    EXPECT_FALSE(unrelated.getTrace().isActive());
+  }
+
+  rxPkt->setTrace(PacketTrace(std::chrono::steady_clock::now()));
+  {
+    PacketLatency::HandlerScope scope(rxPkt.get(), ArpHandler::ETHERTYPE_ARP);
+    PacketLatency::tagCurrent(&reply);
+  }
+  EXPECT_TRUE(reply.getTrace().isActive());
+  EXPECT_EQ(rxPkt->getTrace().rxTime, reply.getTrace().rxTime);
+  EXPECT_EQ(ArpHandler::ETHERTYPE_ARP, reply.getTrace().ethertype);
+
+  // The scope is gone, so later packets are not tagged
+  PacketLatency::tagCurrent(&unrelated);
+  EXPECT_FALSE(unrelated.getTrace().isActive());
+}
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Memory.h>
+#include <gflags/gflags.h>
+#include "fboss/agent/PortStats.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/SwitchStats.h"
+#include "fboss/agent/hw/sim/SimPlatform.h"
+
+/*
+ * Measure the cost of finding the counters to bump for a trapped packet.
+ *
+ * Every counter bumped for a packet used to look up the thread's
+ * SwitchStats, and then search it for the ingress port's PortStats.
+ * SwSwitch::handlePacket() now looks both up once, from a flat array
+ * indexed by PortID, and passes the PortStats to the packet handlers.
+ */
+
+using namespace facebook::fboss;
+using folly::MacAddress;
+using folly::make_unique;
+using std::unique_ptr;
+
+namespace {
+
+// Global state used by the benchmarks
+unique_ptr<SwSwitch> sw;
+constexpr uint32_t kNumPorts = 128;
+
+void init() {
+  MacAddress localMac("02:00:01:00:00:01");
+  sw = make_unique<SwSwitch>(make_unique<SimPlatform>(localMac, kNumPorts));
+  sw->init();
+  // Create this thread's PortStats up front, so the benchmarks only measure
+  // finding them
+  for (uint32_t n = 1; n <= kNumPorts; ++n) {
+    sw->stats()->port(PortID(n));
+  }
+}
+
+PortID portForIteration(size_t n, size_t numPorts) {
+  return PortID(1 + (n % numPorts));
+}
+
+// Finding a port's stats by searching the sorted map, as port() used to
+void mapLookup(size_t numIters, size_t numPorts) {
+  auto* stats = sw->stats();
+  for (size_t n = 0; n < numIters; ++n) {
+    auto it = stats->getPortStats()->find(portForIteration(n, numPorts));
+    folly::doNotOptimizeAway(it->second.get());
+  }
+}
+
+void arrayLookup(size_t numIters, size_t numPorts) {
+  auto* stats = sw->stats();
+  for (size_t n = 0; n < numIters; ++n) {
+    folly::doNotOptimizeAway(stats->port(portForIteration(n, numPorts)));
+  }
+}
+
+/*
+ * Bump the port counters an ARP request addressed to us bumps on its way
+ * through handlePacket() and ArpHandler, looking up the counters for each
+ * one as the handlers used to.
+ */
+void countPerLookup(size_t numIters, size_t numPorts) {
+  for (size_t n = 0; n < numIters; ++n) {
+    auto port = portForIteration(n, numPorts);
+    sw->stats()->getPortStats()->find(port)->second->trappedPkt();
+    sw->stats()->getPortStats()->find(port)->second->arpPkt();
+    sw->stats()->getPortStats()->find(port)->second->arpRequestRx();
+    sw->stats()->getPortStats()->find(port)->second->arpReplyTx();
+  }
+}
+
+// The same counters, with the PortStats looked up once per packet
+void countOnce(size_t numIters, size_t numPorts) {
+  for (size_t n = 0; n < numIters; ++n) {
+    PortStats* portStats = sw->stats()->port(portForIteration(n, numPorts));
+    portStats->trappedPkt();
+    portStats->arpPkt();
+    portStats->arpRequestRx();
+    portStats->arpReplyTx();
+  }
+}
+
+} // unnamed namespace
+
+BENCHMARK_PARAM(mapLookup, 4)
+BENCHMARK_RELATIVE_PARAM(arrayLookup, 4)
+BENCHMARK_PARAM(mapLookup, 32)
+BENCHMARK_RELATIVE_PARAM(arrayLookup, 32)
+BENCHMARK_PARAM(mapLookup, 128)
+BENCHMARK_RELATIVE_PARAM(arrayLookup, 128)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(countPerLookup, 4)
+BENCHMARK_RELATIVE_PARAM(countOnce, 4)
+BENCHMARK_PARAM(countPerLookup, 128)
+BENCHMARK_RELATIVE_PARAM(countOnce, 128)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  init();
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PeriodicTxScheduler.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::chrono::milliseconds;
+
+namespace {
+
+typedef PeriodicTxScheduler::TimePoint TimePoint;
+
+const auto kInterval = milliseconds(1000);
+
+}
+
+TEST(PeriodicTxScheduler, spreadsSenders) {
+  PeriodicTxScheduler scheduler(PeriodicTxScheduler::Config{});
+  auto now = std::chrono::steady_clock::now();
+  for (PeriodicTxScheduler::Key key = 0; key < 100; ++key) {
+    scheduler.add(key, kInterval, 10, now);
+  }
+
+  // The first sends are spread across the first interval
+  size_t firstHalf = 0;
+  for (PeriodicTxScheduler::Key key = 0; key < 100; ++key) {
+    auto due = scheduler.getDue(key);
+    EXPECT_GT(due, now);
+    EXPECT_LE(due, now + kInterval);
+    if (due <= now + kInterval / 2) {
+      ++firstHalf;
+    }
+  }
+  EXPECT_GT(firstHalf, 0);
+  EXPECT_LT(firstHalf, 100);
+  EXPECT_EQ(firstHalf, scheduler.takeDue(now + kInterval / 2).size());
+  EXPECT_EQ(100 - firstHalf, scheduler.takeDue(now + kInterval).size());
+
+  // Each later interval is shortened by up to the jitter
+  auto sent = now + kInterval;
+  EXPECT_TRUE(scheduler.takeDue(sent).empty());
+  for (PeriodicTxScheduler::Key key = 0; key < 100; ++key) {
+    auto due = scheduler.getDue(key);
+    EXPECT_GE(due, sent - kInterval / 2 + kInterval * 9 / 10);
+    EXPECT_LE(due, sent + kInterval);
+  }
+}
+
+TEST(PeriodicTxScheduler, withoutJitter) {
+  PeriodicTxScheduler scheduler(PeriodicTxScheduler::Config{});
+  auto now = std::chrono::steady_clock::now();
+  scheduler.add(1, kInterval, 0, now);
+  EXPECT_EQ(now + kInterval, scheduler.getDue(1));
+  EXPECT_EQ(now + kInterval, scheduler.getNextWakeup(now));
+  EXPECT_TRUE(scheduler.takeDue(now + kInterval / 2).empty());
+
+  auto keys = scheduler.takeDue(now + kInterval);
+  ASSERT_EQ(1, keys.size());
+  EXPECT_EQ(1, keys[0]);
+  EXPECT_EQ(now + kInterval * 2, scheduler.getDue(1));
+
+  // Adding the key again keeps its place, unless the interval changes
+  scheduler.add(1, kInterval, 0, now + kInterval / 2);
+  EXPECT_EQ(now + kInterval * 2, scheduler.getDue(1));
+  scheduler.add(1, kInterval * 2, 0, now + kInterval);
+  EXPECT_EQ(now + kInterval * 3, scheduler.getDue(1));
+
+  // A key brought forward carries on from when it is sent
+  scheduler.setDue(1, now + kInterval + milliseconds(100));
+  EXPECT_EQ(1, scheduler.takeDue(now + kInterval + milliseconds(100)).size());
+  EXPECT_EQ(now + kInterval * 3 + milliseconds(100), scheduler.getDue(1));
+
+  scheduler.remove(1);
+  EXPECT_FALSE(scheduler.contains(1));
+  EXPECT_EQ(TimePoint::max(), scheduler.getNextWakeup(now));
+}
+
+TEST(PeriodicTxScheduler, limitsRate) {
+  PeriodicTxScheduler::Config config;
+  config.maxPps = 10;
+  PeriodicTxScheduler scheduler(config);
+  auto now = std::chrono::steady_clock::now();
+  for (PeriodicTxScheduler::Key key = 0; key < 3; ++key) {
+    scheduler.add(key, kInterval, 0, now);
+  }
+
+  // The burst is a tenth of a second of packets, so one at a time here
+  auto due = now + kInterval;
+  EXPECT_EQ(1, scheduler.takeDue(due).size());
+  auto wakeup = scheduler.getNextWakeup(due);
+  EXPECT_GT(wakeup, due + milliseconds(99));
+  EXPECT_LE(wakeup, due + milliseconds(101));
+  EXPECT_TRUE(scheduler.takeDue(due + milliseconds(50)).empty());
+  EXPECT_EQ(1, scheduler.takeDue(wakeup).size());
+  EXPECT_EQ(1, scheduler.takeDue(wakeup + milliseconds(100)).size());
+  EXPECT_EQ(3, scheduler.size());
+}
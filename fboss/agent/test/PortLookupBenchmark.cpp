@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/DenseIdIndex.h"
+#include "fboss/agent/types.h"
+
+#include <boost/container/flat_map.hpp>
+#include <folly/Benchmark.h>
+#include <folly/Random.h>
+#include <gflags/gflags.h>
+
+/*
+ * BcmPortTable and SfpMap need an ASIC and SFPs, so these benchmarks
+ * measure their lookups on their own: the sorted maps they used to search,
+ * against the arrays they index now.  The ports are looked up in a random
+ * order, as packets and link events arrive.
+ */
+
+DEFINE_int32(port_benchmark_lookups, 4096,
+             "The number of port lookups in each iteration");
+
+using namespace facebook::fboss;
+
+namespace {
+
+struct FakePort {
+  uint64_t counter{0};
+};
+
+std::vector<PortID> makeLookups(size_t numPorts) {
+  std::vector<PortID> lookups;
+  for (int32_t i = 0; i < FLAGS_port_benchmark_lookups; ++i) {
+    lookups.push_back(PortID(1 + folly::Random::rand32(numPorts)));
+  }
+  return lookups;
+}
+
+void flatMapLookup(size_t numIters, size_t numPorts) {
+  std::vector<FakePort> ports(numPorts + 1);
+  boost::container::flat_map<PortID, FakePort*> map;
+  std::vector<PortID> lookups;
+  BENCHMARK_SUSPEND {
+    for (size_t i = 1; i <= numPorts; ++i) {
+      map.emplace(PortID(i), &ports[i]);
+    }
+    lookups = makeLookups(numPorts);
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    for (auto port : lookups) {
+      auto it = map.find(port);
+      if (it != map.end()) {
+        ++it->second->counter;
+      }
+    }
+  }
+  folly::doNotOptimizeAway(ports);
+}
+
+void indexLookup(size_t numIters, size_t numPorts) {
+  std::vector<FakePort> ports(numPorts + 1);
+  DenseIdIndex<PortID, FakePort> index;
+  std::vector<PortID> lookups;
+  BENCHMARK_SUSPEND {
+    for (size_t i = 1; i <= numPorts; ++i) {
+      index.set(PortID(i), &ports[i]);
+    }
+    lookups = makeLookups(numPorts);
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    for (auto port : lookups) {
+      auto* p = index.get(port);
+      if (p) {
+        ++p->counter;
+      }
+    }
+  }
+  folly::doNotOptimizeAway(ports);
+}
+
+} // unnamed namespace
+
+BENCHMARK_PARAM(flatMapLookup, 32)
+BENCHMARK_RELATIVE_PARAM(indexLookup, 32)
+BENCHMARK_PARAM(flatMapLookup, 128)
+BENCHMARK_RELATIVE_PARAM(indexLookup, 128)
+BENCHMARK_PARAM(flatMapLookup, 256)
+BENCHMARK_RELATIVE_PARAM(indexLookup, 256)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/PortRateTracker.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::chrono::seconds;
+
+namespace {
+
+PortRateTracker::Values makeValues(uint64_t inBytes, uint64_t outPkts) {
+  PortRateTracker::Values values;
+  values.fill(0);
+  values[PortRateTracker::IN_BYTES] = inBytes;
+  values[PortRateTracker::OUT_PKTS] = outPkts;
+  return values;
+}
+
+}
+
+TEST(PortRateTracker, ratesPerWindow) {
+  PortRateTracker tracker({seconds(10), seconds(60)});
+  auto start = std::chrono::steady_clock::now();
+  tracker.addSample(start, makeValues(0, 0));
+  ASSERT_EQ(2, tracker.getRates().size());
+  EXPECT_EQ(0, tracker.getRates()[0].perSec[PortRateTracker::IN_BYTES]);
+
+  // 1000 bytes/s for the first 60 seconds, then 2000 bytes/s
+  uint64_t inBytes = 0;
+  for (int sec = 1; sec <= 70; ++sec) {
+    inBytes += sec <= 60 ? 1000 : 2000;
+    tracker.addSample(start + seconds(sec), makeValues(inBytes, sec));
+    if (sec == 5) {
+      // Windows that go back further than the samples use all of them
+      for (const auto& rates : tracker.getRates()) {
+        EXPECT_DOUBLE_EQ(1000, rates.perSec[PortRateTracker::IN_BYTES]);
+        EXPECT_DOUBLE_EQ(1, rates.perSec[PortRateTracker::OUT_PKTS]);
+      }
+    }
+  }
+
+  const auto& rates = tracker.getRates();
+  EXPECT_EQ(seconds(10), rates[0].window);
+  EXPECT_DOUBLE_EQ(2000, rates[0].perSec[PortRateTracker::IN_BYTES]);
+  EXPECT_EQ(seconds(60), rates[1].window);
+  EXPECT_DOUBLE_EQ((50 * 1000 + 10 * 2000) / 60.0,
+                   rates[1].perSec[PortRateTracker::IN_BYTES]);
+  EXPECT_DOUBLE_EQ(1, rates[1].perSec[PortRateTracker::OUT_PKTS]);
+  EXPECT_EQ(0, rates[1].perSec[PortRateTracker::OUT_DISCARDS]);
+}
+
+TEST(PortRateTracker, clearedCounters) {
+  PortRateTracker tracker({seconds(10)});
+  auto start = std::chrono::steady_clock::now();
+  tracker.addSample(start, makeValues(5000, 0));
+  tracker.addSample(start + seconds(1), makeValues(100, 0));
+  EXPECT_EQ(0, tracker.getRates()[0].perSec[PortRateTracker::IN_BYTES]);
+
+  // Once the window no longer spans the clear, the rate is back
+  for (int sec = 2; sec <= 11; ++sec) {
+    tracker.addSample(start + seconds(sec), makeValues(100 * sec, 0));
+  }
+  EXPECT_DOUBLE_EQ(100,
+                   tracker.getRates()[0].perSec[PortRateTracker::IN_BYTES]);
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/QsfpModule.h"
+
+#include "fboss/agent/SfpDomPoller.h"
+#include "fboss/agent/SfpImpl.h"
+#include "fboss/agent/SfpMap.h"
+
+#include <folly/Memory.h>
+#include <gtest/gtest.h>
+#include <string.h>
+
+using namespace facebook::fboss;
+using folly::make_unique;
+using std::unique_ptr;
+
+namespace {
+
+// A QSFP with paged memory, which counts the bytes read from each page
+class FakeQsfpImpl : public SfpImpl {
+ public:
+  FakeQsfpImpl() {
+    memset(lower_, 0, sizeof(lower_));
+    memset(pages_, 0, sizeof(pages_));
+    // VENDOR_NAME, padded with spaces
+    memcpy(pages_[0] + 148 - 128, "ACME            ", 16);
+    // Temperature high alarm threshold: 75C
+    pages_[3][0] = 75;
+    // Temperature: 25C
+    lower_[22] = 25;
+    // Lane 2 RX power: 0.5mW, in units of 0.1uW
+    lower_[36] = 5000 >> 8;
+    lower_[37] = 5000 & 0xff;
+    // Lane 3 TX bias: 6mA, in units of 2uA
+    lower_[46] = 3000 >> 8;
+    lower_[47] = 3000 & 0xff;
+    // RX LOS on lane 4
+    lower_[3] = 0x08;
+    // RX power low alarm on lane 2
+    lower_[9] = 0x04;
+  }
+
+  int readSfpEeprom(int dataAddress, int offset, int len,
+                    uint8_t* fieldValue) override {
+    EXPECT_EQ(0x50, dataAddress);
+    EXPECT_LE(offset + len, 256);
+    if (offset >= 128) {
+      upperBytesRead[page_] += len;
+      memcpy(fieldValue, pages_[page_] + offset - 128, len);
+    } else {
+      lowerBytesRead += len;
+      memcpy(fieldValue, lower_ + offset, len);
+    }
+    return 0;
+  }
+  int writeSfpEeprom(int dataAddress, int offset, int len,
+                     const uint8_t* fieldValue) override {
+    EXPECT_EQ(127, offset);
+    EXPECT_EQ(1, len);
+    page_ = fieldValue[0];
+    EXPECT_LT(page_, 4);
+    return 0;
+  }
+  bool detectSfp() override {
+    return present;
+  }
+  folly::StringPiece getName() override {
+    return "qsfp1";
+  }
+
+  bool present{true};
+  int lowerBytesRead{0};
+  int upperBytesRead[4]{0, 0, 0, 0};
+  uint8_t lower_[128];
+
+ private:
+  int page_{0};
+  uint8_t pages_[4][128];
+};
+
+} // unnamed namespace
+
+TEST(QsfpModule, SelectiveReads) {
+  auto impl = make_unique<FakeQsfpImpl>();
+  auto* fake = impl.get();
+  unique_ptr<SfpImpl> sfpImpl(std::move(impl));
+  QsfpModule qsfp(sfpImpl);
+
+  // Detection reads the lower page, and upper pages 0 and 3
+  qsfp.detectSfp();
+  EXPECT_EQ(128, fake->lowerBytesRead);
+  EXPECT_EQ(128, fake->upperBytesRead[0]);
+  EXPECT_EQ(0, fake->upperBytesRead[1]);
+  EXPECT_EQ(128, fake->upperBytesRead[3]);
+
+  auto idprom = qsfp.getSfpIdprom();
+  ASSERT_NE(nullptr, idprom);
+  EXPECT_EQ("ACME", idprom->vendorName);
+  uint8_t vendor[16];
+  EXPECT_EQ(0, qsfp.getSfpFieldValue(SfpIdpromFields::VENDOR_NAME, vendor));
+  EXPECT_EQ(0, memcmp(vendor, "ACME", 4));
+
+  SfpDom dom;
+  qsfp.getSfpDom(dom);
+  EXPECT_TRUE(dom.sfpPresent);
+  EXPECT_TRUE(dom.domSupported);
+  EXPECT_EQ(25, dom.value.temp);
+  EXPECT_EQ(75, dom.threshValue.tempAlarmHigh);
+  ASSERT_EQ(QsfpModule::NUM_LANES, dom.lanes.size());
+  EXPECT_DOUBLE_EQ(0.5, dom.lanes[1].rxPwr);
+  EXPECT_DOUBLE_EQ(6, dom.lanes[2].txBias);
+  EXPECT_TRUE(dom.lanes[3].rxLos);
+  EXPECT_FALSE(dom.lanes[0].rxLos);
+  EXPECT_TRUE(dom.flags.rxPwrAlarmLow);
+  EXPECT_FALSE(dom.flags.rxPwrAlarmHigh);
+
+  // DOM updates only read the monitoring bytes of the lower page
+  fake->lower_[22] = 30;
+  qsfp.updateSfpDomFields();
+  EXPECT_EQ(128 + 58 - 3, fake->lowerBytesRead);
+  EXPECT_EQ(128, fake->upperBytesRead[0]);
+  EXPECT_EQ(128, fake->upperBytesRead[3]);
+  qsfp.getSfpDom(dom);
+  EXPECT_EQ(30, dom.value.temp);
+  EXPECT_EQ(75, dom.threshValue.tempAlarmHigh);
+
+  // Removal drops the cached pages
+  fake->present = false;
+  qsfp.detectSfp();
+  EXPECT_EQ(nullptr, qsfp.getSfpIdprom());
+  qsfp.getSfpDom(dom);
+  EXPECT_FALSE(dom.sfpPresent);
+  EXPECT_FALSE(dom.__isset.lanes);
+}
+
+TEST(QsfpModule, FlatMemory) {
+  auto impl = make_unique<FakeQsfpImpl>();
+  auto* fake = impl.get();
+  // Flat memory, as copper cables have
+  fake->lower_[2] = 0x04;
+  unique_ptr<SfpImpl> sfpImpl(std::move(impl));
+  QsfpModule qsfp(sfpImpl);
+
+  qsfp.detectSfp();
+  EXPECT_EQ(0, fake->upperBytesRead[3]);
+  SfpDom dom;
+  qsfp.getSfpDom(dom);
+  EXPECT_TRUE(dom.sfpPresent);
+  EXPECT_FALSE(dom.domSupported);
+
+  qsfp.updateSfpDomFields();
+  EXPECT_EQ(128, fake->lowerBytesRead);
+}
+
+TEST(QsfpModule, PolledWithSfps) {
+  SfpMap map;
+  unique_ptr<SfpImpl> sfpImpl(make_unique<FakeQsfpImpl>());
+  unique_ptr<SfpModule> qsfp(make_unique<QsfpModule>(sfpImpl));
+  map.createSfp(PortID(1), qsfp);
+
+  SfpDomPoller poller(&map);
+  poller.detectSfps();
+  poller.updateSfpDomFields();
+  SfpDom dom;
+  map.sfpModule(PortID(1))->getSfpDom(dom);
+  EXPECT_TRUE(dom.sfpPresent);
+  EXPECT_EQ(25, dom.value.temp);
+}
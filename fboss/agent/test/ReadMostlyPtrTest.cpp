@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ReadMostlyPtr.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace facebook::fboss;
+using std::make_shared;
+using std::shared_ptr;
+
+TEST(ReadMostlyPtr, readers) {
+  ReadMostlyPtr<int> ptr;
+  EXPECT_EQ(nullptr, ptr.load());
+  {
+    ReadMostlyPtr<int>::Reader reader(ptr);
+    EXPECT_EQ(nullptr, reader.get());
+  }
+
+  auto one = make_shared<int>(1);
+  ptr.store(one);
+  EXPECT_EQ(one, ptr.load());
+  {
+    ReadMostlyPtr<int>::Reader reader(ptr);
+    EXPECT_EQ(one, reader.get());
+    EXPECT_EQ(1, *reader);
+
+    // A nested reader on the same thread sees the same object, even once
+    // the pointer is replaced, so the outer one stays valid
+    auto two = make_shared<int>(2);
+    ptr.store(two);
+    ReadMostlyPtr<int>::Reader nested(ptr);
+    EXPECT_EQ(one, nested.get());
+    EXPECT_EQ(two, ptr.load());
+  }
+  {
+    // Once they are gone the new object is read
+    ReadMostlyPtr<int>::Reader reader(ptr);
+    EXPECT_EQ(2, *reader);
+  }
+}
+
+TEST(ReadMostlyPtr, releasesOldObjects) {
+  ReadMostlyPtr<int> ptr;
+  auto one = make_shared<int>(1);
+  ptr.store(one);
+  {
+    ReadMostlyPtr<int>::Reader reader(ptr);
+  }
+  // The pointer and this thread's cache refer to the object
+  EXPECT_EQ(3, one.use_count());
+  ptr.store(make_shared<int>(2));
+  EXPECT_EQ(2, one.use_count());
+  {
+    ReadMostlyPtr<int>::Reader reader(ptr);
+  }
+  EXPECT_EQ(1, one.use_count());
+}
+
+TEST(ReadMostlyPtr, threads) {
+  ReadMostlyPtr<int> ptr;
+  ptr.store(make_shared<int>(0));
+
+  // Readers on other threads always see a whole object, and eventually the
+  // latest one
+  constexpr int kNumStores = 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      int last = 0;
+      while (last < kNumStores) {
+        ReadMostlyPtr<int>::Reader reader(ptr);
+        ASSERT_GE(*reader, last);
+        last = *reader;
+      }
+    });
+  }
+  for (int n = 1; n <= kNumStores; ++n) {
+    ptr.store(make_shared<int>(n));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
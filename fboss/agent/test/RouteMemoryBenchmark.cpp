@@ -0,0 +1,209 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/Route.h"
+
+#include <folly/Benchmark.h>
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/*
+ * Compares the memory and build time of a large RIB of Route nodes against
+ * the layout routes used before their nexthop sets were interned, where
+ * every route had its own copy of its nexthops, of the nexthops of each of
+ * its clients, and of its forwarding nexthops.
+ *
+ * The memory report is printed before the benchmarks run.  It counts the
+ * route objects and the containers they allocate, but not the shared_ptr
+ * control block, which is the same for both layouts.
+ */
+
+DEFINE_int32(route_memory_routes, 500000,
+             "The number of routes in the synthetic RIB");
+DEFINE_int32(route_memory_groups, 16,
+             "The number of distinct ECMP groups the routes use");
+DEFINE_int32(route_memory_ecmp_width, 8,
+             "The number of nexthops in each ECMP group");
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+
+const ClientID kClient(1);
+const AdminDistance kDistance(20);
+
+// The route fields before the nexthop sets were interned
+struct LegacyNextHopEntry {
+  RouteNextHops nexthops;
+  AdminDistance adminDistance{kMaxAdminDistance};
+};
+struct LegacyForwardInfo {
+  RouteForwardNexthops nexthops;
+  RouteForwardAction action{RouteForwardAction::DROP};
+};
+template<typename AddrT>
+struct LegacyRouteFields {
+  RoutePrefix<AddrT> prefix;
+  boost::container::flat_map<ClientID, LegacyNextHopEntry> clients;
+  RouteNextHops nexthops;
+  LegacyForwardInfo fwd;
+  uint32_t flags{0};
+
+  size_t memoryUsage() const {
+    size_t bytes = sizeof(*this);
+    bytes += clients.capacity() * sizeof(*clients.begin());
+    for (const auto& client : clients) {
+      bytes += client.second.nexthops.capacity() * sizeof(IPAddress);
+    }
+    bytes += nexthops.capacity() * sizeof(IPAddress);
+    bytes += fwd.nexthops.capacity() * sizeof(RouteForwardInfo::Nexthop);
+    return bytes;
+  }
+};
+
+// The size of everything in a Route node but its fields
+template<typename AddrT>
+size_t nodeOverhead() {
+  return sizeof(Route<AddrT>) - sizeof(RouteFields<AddrT>);
+}
+
+struct Group {
+  RouteNextHops nexthops;
+  RouteForwardNexthops fwd;
+};
+
+std::vector<Group> makeGroups() {
+  std::vector<Group> groups(std::max(1, FLAGS_route_memory_groups));
+  for (size_t g = 0; g < groups.size(); ++g) {
+    for (int n = 0; n < FLAGS_route_memory_ecmp_width; ++n) {
+      auto bytes = IPAddressV6("2401:db00::").toByteArray();
+      bytes[14] = g;
+      bytes[15] = n;
+      IPAddress nhop(IPAddressV6::fromBinary(
+          folly::ByteRange(bytes.data(), bytes.size())));
+      groups[g].nexthops.insert(nhop);
+      groups[g].fwd.emplace(InterfaceID(1 + n % 4), nhop);
+    }
+  }
+  return groups;
+}
+
+uint32_t numRoutes() {
+  return std::max(0, FLAGS_route_memory_routes);
+}
+
+RoutePrefixV4 prefixOf(uint32_t n) {
+  return RoutePrefixV4{IPAddressV4::fromLongHBO(n << 8), 24};
+}
+
+shared_ptr<RouteV4> makeRoute(uint32_t n, const Group& group) {
+  auto route = make_shared<RouteV4>(
+      prefixOf(n), kClient, RouteNextHopEntry(group.nexthops, kDistance));
+  route->setResolved(group.fwd);
+  return route;
+}
+
+shared_ptr<LegacyRouteFields<IPAddressV4>> makeLegacyRoute(
+    uint32_t n, const Group& group) {
+  auto route = make_shared<LegacyRouteFields<IPAddressV4>>();
+  route->prefix = prefixOf(n);
+  auto& entry = route->clients[kClient];
+  entry.nexthops = group.nexthops;
+  entry.adminDistance = kDistance;
+  route->nexthops = group.nexthops;
+  route->fwd.nexthops = group.fwd;
+  route->fwd.action = RouteForwardAction::NEXTHOPS;
+  return route;
+}
+
+void printMemory() {
+  auto groups = makeGroups();
+  size_t numInterned = InternedRouteNextHops::numInterned() +
+    InternedForwardNexthops::numInterned();
+
+  std::vector<shared_ptr<RouteV4>> routes;
+  size_t bytes = 0;
+  for (uint32_t n = 0; n < numRoutes(); ++n) {
+    routes.push_back(makeRoute(n, groups[n % groups.size()]));
+    bytes += routes.back()->getMemoryUsage();
+  }
+  // The interned sets are stored once, for all routes
+  size_t setBytes = 0;
+  for (const auto& group : groups) {
+    setBytes += group.nexthops.capacity() * sizeof(IPAddress);
+    setBytes += group.fwd.capacity() * sizeof(RouteForwardInfo::Nexthop);
+  }
+  numInterned = InternedRouteNextHops::numInterned() +
+    InternedForwardNexthops::numInterned() - numInterned;
+  routes.clear();
+
+  std::vector<shared_ptr<LegacyRouteFields<IPAddressV4>>> legacyRoutes;
+  size_t legacyBytes = 0;
+  for (uint32_t n = 0; n < numRoutes(); ++n) {
+    legacyRoutes.push_back(makeLegacyRoute(n, groups[n % groups.size()]));
+    legacyBytes += nodeOverhead<IPAddressV4>() +
+      legacyRoutes.back()->memoryUsage();
+  }
+  legacyRoutes.clear();
+
+  auto perRoute = [](size_t total) {
+    return numRoutes() ? total / numRoutes() : 0;
+  };
+  printf("%u routes, %zu ECMP groups of %d nexthops\n",
+         numRoutes(), groups.size(), FLAGS_route_memory_ecmp_width);
+  printf("  legacy layout: %zu bytes, %zu per route\n",
+         legacyBytes, perRoute(legacyBytes));
+  printf("  route nodes:   %zu bytes, %zu per route, "
+         "plus %zu bytes in %zu interned sets\n",
+         bytes, perRoute(bytes), setBytes, numInterned);
+}
+
+template<typename MakeFn>
+void buildRoutes(size_t numIters, MakeFn makeFn) {
+  std::vector<Group> groups;
+  BENCHMARK_SUSPEND {
+    groups = makeGroups();
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    std::vector<decltype(makeFn(0, groups[0]))> routes;
+    routes.reserve(numRoutes());
+    for (uint32_t n = 0; n < numRoutes(); ++n) {
+      routes.push_back(makeFn(n, groups[n % groups.size()]));
+    }
+    // Destroying the routes is part of the cost of each layout
+  }
+}
+
+} // unnamed namespace
+
+BENCHMARK(legacyBuildRib, numIters) {
+  buildRoutes(numIters, makeLegacyRoute);
+}
+
+BENCHMARK_RELATIVE(buildRib, numIters) {
+  buildRoutes(numIters, makeRoute);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  printMemory();
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RouteStats.h"
+
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteUpdater.h"
+
+#include <folly/IPAddress.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::make_shared;
+
+namespace {
+
+const RouterID kRid(0);
+
+}
+
+TEST(RouteStats, ecmpWidthBuckets) {
+  EXPECT_EQ(0, RouteStats::getEcmpWidthBucket(1));
+  EXPECT_EQ(1, RouteStats::getEcmpWidthBucket(2));
+  EXPECT_EQ(2, RouteStats::getEcmpWidthBucket(3));
+  EXPECT_EQ(2, RouteStats::getEcmpWidthBucket(4));
+  EXPECT_EQ(3, RouteStats::getEcmpWidthBucket(5));
+  EXPECT_EQ(6, RouteStats::getEcmpWidthBucket(64));
+  EXPECT_EQ(7, RouteStats::getEcmpWidthBucket(65));
+  EXPECT_EQ(7, RouteStats::getEcmpWidthBucket(1000));
+}
+
+TEST(RouteStats, countsDeltas) {
+  RouteStats stats;
+  RouteUpdater u1(make_shared<RouteTableMap>());
+  u1.addRoute(kRid, InterfaceID(1), IPAddress("10.0.0.1"), 24);
+  u1.addRoute(kRid, InterfaceID(2), IPAddress("20.0.0.1"), 24);
+  RouteNextHops nhops;
+  nhops.emplace(IPAddress("10.0.0.2"));
+  nhops.emplace(IPAddress("20.0.0.2"));
+  u1.addRoute(kRid, IPAddress("30.0.0.0"), 16, nhops);
+  // No route to the nexthop, so this stays unresolved
+  RouteNextHops unreachable;
+  unreachable.emplace(IPAddress("40.0.0.1"));
+  u1.addRoute(kRid, IPAddress("50.0.0.0"), 16, unreachable);
+  u1.addRoute(kRid, IPAddress("2401:db00::"), 32, RouteForwardAction::DROP);
+  auto tables1 = u1.updateDone();
+  ASSERT_NE(nullptr, tables1);
+  stats.applyDelta(nullptr, tables1.get());
+
+  auto v4 = stats.getCounts(kRid, false);
+  EXPECT_EQ(4, v4.routes);
+  EXPECT_EQ(3, v4.resolved);
+  EXPECT_EQ(2, v4.prefixLengths[24]);
+  EXPECT_EQ(2, v4.prefixLengths[16]);
+  EXPECT_EQ(2, v4.ecmpWidths[0]);
+  EXPECT_EQ(1, v4.ecmpWidths[1]);
+  auto v6 = stats.getCounts(kRid, true);
+  EXPECT_EQ(1, v6.routes);
+  EXPECT_EQ(1, v6.resolved);
+  EXPECT_EQ(1, v6.prefixLengths[32]);
+
+  // Removing the second interface route leaves the ECMP route one nexthop
+  RouteUpdater u2(tables1);
+  u2.delRoute(kRid, IPAddress("20.0.0.0"), 24);
+  u2.delRoute(kRid, IPAddress("2401:db00::"), 32);
+  auto tables2 = u2.updateDone();
+  ASSERT_NE(nullptr, tables2);
+  stats.applyDelta(tables1.get(), tables2.get());
+
+  v4 = stats.getCounts(kRid, false);
+  EXPECT_EQ(3, v4.routes);
+  EXPECT_EQ(2, v4.resolved);
+  EXPECT_EQ(1, v4.prefixLengths[24]);
+  EXPECT_EQ(2, v4.ecmpWidths[0]);
+  EXPECT_EQ(0, v4.ecmpWidths[1]);
+  v6 = stats.getCounts(kRid, true);
+  EXPECT_EQ(0, v6.routes);
+  EXPECT_EQ(0, v6.prefixLengths[32]);
+
+  // Counting from scratch gives the same counts
+  RouteStats fresh;
+  fresh.applyDelta(nullptr, tables2.get());
+  auto freshV4 = fresh.getCounts(kRid, false);
+  EXPECT_EQ(v4.routes, freshV4.routes);
+  EXPECT_EQ(v4.resolved, freshV4.resolved);
+  EXPECT_EQ(v4.prefixLengths, freshV4.prefixLengths);
+  EXPECT_EQ(v4.ecmpWidths, freshV4.ecmpWidths);
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/state/RouteTableMap.h"
+#include "fboss/agent/state/RouteUpdater.h"
+
+#include <folly/Benchmark.h>
+#include <folly/IPAddressV4.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+
+/*
+ * Benchmarks for re-syncing the full set of routes of a client, as
+ * ThriftHandler::syncFib() does, when none or a few of the routes changed.
+ *
+ * rebuildSync builds new tables from empty and deduplicates them against
+ * the old ones, which is how syncFib() used to work.  diffSync diffs the
+ * routes against the existing RIB with RouteUpdater::syncClientRoutes().
+ */
+
+DEFINE_int32(sync_benchmark_routes, 100000,
+             "The number of routes in each sync");
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using std::shared_ptr;
+
+namespace {
+
+const ClientID kClient(1);
+const RouterID kRouter(0);
+
+// The nexthops of route n, of which every changeStep-th one is changed
+RouteNextHops nexthopsOf(uint32_t n, uint32_t changeStep) {
+  RouteNextHops nexthops;
+  bool changed = changeStep && n % changeStep == 0;
+  nexthops.emplace(IPAddressV4::fromLongHBO(0x01010100 + (changed ? 2 : 1)));
+  return nexthops;
+}
+
+uint32_t numRoutes() {
+  return std::max(0, FLAGS_sync_benchmark_routes);
+}
+
+IPAddress networkOf(uint32_t n) {
+  // Spread the /24 prefixes over 10.0.0.0/8 and beyond
+  return IPAddress(IPAddressV4::fromLongHBO(0x0a000000 + (n << 8)));
+}
+
+// The tables to sync against.  The rebuilt tables have no clients, so
+// their routes are only deduplicated against routes without clients.
+const shared_ptr<RouteTableMap>& getTables(bool withClient) {
+  static shared_ptr<RouteTableMap> tables[2];
+  auto& ret = tables[withClient];
+  if (ret) {
+    return ret;
+  }
+  RouteUpdater updater(std::make_shared<RouteTableMap>());
+  for (uint32_t n = 0; n < numRoutes(); ++n) {
+    if (withClient) {
+      updater.addRoute(kRouter, networkOf(n), 24, kClient,
+                       RouteNextHopEntry(nexthopsOf(n, 0), 20));
+    } else {
+      updater.addRoute(kRouter, networkOf(n), 24, nexthopsOf(n, 0));
+    }
+  }
+  ret = updater.updateDone();
+  ret->publish();
+  return ret;
+}
+
+void rebuildSync(size_t numIters, uint32_t changePercent) {
+  uint32_t changeStep = changePercent ? 100 / changePercent : 0;
+  shared_ptr<RouteTableMap> tables;
+  BENCHMARK_SUSPEND {
+    tables = getTables(false);
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    RouteUpdater updater(tables, true);
+    for (uint32_t n = 0; n < numRoutes(); ++n) {
+      updater.addRoute(kRouter, networkOf(n), 24, nexthopsOf(n, changeStep));
+    }
+    folly::doNotOptimizeAway(updater.updateDone());
+  }
+}
+
+void diffSync(size_t numIters, uint32_t changePercent) {
+  uint32_t changeStep = changePercent ? 100 / changePercent : 0;
+  shared_ptr<RouteTableMap> tables;
+  BENCHMARK_SUSPEND {
+    tables = getTables(true);
+  }
+  for (size_t iter = 0; iter < numIters; ++iter) {
+    RouteUpdater updater(tables);
+    RouteUpdater::ClientRoutes routes;
+    for (uint32_t n = 0; n < numRoutes(); ++n) {
+      routes.add(networkOf(n), 24,
+                 RouteNextHopEntry(nexthopsOf(n, changeStep), 20));
+    }
+    updater.syncClientRoutes(kRouter, kClient, std::move(routes));
+    folly::doNotOptimizeAway(updater.updateDone());
+  }
+}
+
+} // unnamed namespace
+
+BENCHMARK_PARAM(rebuildSync, 0)
+BENCHMARK_RELATIVE_PARAM(diffSync, 0)
+BENCHMARK_PARAM(rebuildSync, 1)
+BENCHMARK_RELATIVE_PARAM(diffSync, 1)
+BENCHMARK_PARAM(rebuildSync, 10)
+BENCHMARK_RELATIVE_PARAM(diffSync, 10)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RxBufferTracker.h"
+#include "fboss/agent/RxPacket.h"
+
+#include <folly/io/IOBuf.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+DECLARE_int32(rx_buffer_copy_threshold);
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+
+namespace {
+
+// An RxPacket whose data stands in for an RX pool buffer
+class PoolRxPacket : public RxPacket {
+ public:
+  explicit PoolRxPacket(folly::StringPiece data) {
+    buf_ = IOBuf::copyBuffer(data.data(), data.size(), 16);
+    setRxBuffer();
+  }
+};
+
+} // unnamed namespace
+
+TEST(RxBufferTracker, Holders) {
+  auto outstanding = RxBufferTracker::getOutstanding();
+  {
+    PoolRxPacket pkt("packet");
+    EXPECT_TRUE(pkt.holdsRxBuffer());
+    EXPECT_EQ(outstanding + 1, RxBufferTracker::getOutstanding());
+    auto queued = RxBufferTracker::getHeld(RxBufferHolder::TUN_QUEUE);
+    pkt.setRxBufferHolder(RxBufferHolder::TUN_QUEUE);
+    EXPECT_EQ(queued + 1, RxBufferTracker::getHeld(RxBufferHolder::TUN_QUEUE));
+    EXPECT_EQ(outstanding + 1, RxBufferTracker::getOutstanding());
+    EXPECT_LE(outstanding + 1, RxBufferTracker::getMaxOutstanding());
+  }
+  EXPECT_EQ(outstanding, RxBufferTracker::getOutstanding());
+}
+
+TEST(RxBufferTracker, CopyOut) {
+  auto oldThreshold = FLAGS_rx_buffer_copy_threshold;
+  auto copied = RxBufferTracker::getCopiedOut(RxBufferHolder::DISPATCH_QUEUE);
+  PoolRxPacket pkt1("first packet");
+  PoolRxPacket pkt2("second packet");
+  pkt2.setRxBufferHolder(RxBufferHolder::DISPATCH_QUEUE);
+
+  FLAGS_rx_buffer_copy_threshold = -1;
+  EXPECT_FALSE(RxBufferTracker::underPressure());
+  EXPECT_FALSE(pkt2.copyOutIfPressured());
+
+  FLAGS_rx_buffer_copy_threshold = RxBufferTracker::getOutstanding() - 1;
+  EXPECT_TRUE(RxBufferTracker::underPressure());
+  auto oldData = pkt2.buf()->data();
+  EXPECT_TRUE(pkt2.copyOutIfPressured());
+  EXPECT_FALSE(pkt2.holdsRxBuffer());
+  EXPECT_NE(oldData, pkt2.buf()->data());
+  EXPECT_EQ(16, pkt2.buf()->headroom());
+  EXPECT_EQ("second packet", pkt2.buf()->moveToFbString().toStdString());
+  EXPECT_EQ(copied + 1,
+            RxBufferTracker::getCopiedOut(RxBufferHolder::DISPATCH_QUEUE));
+  // Releasing a buffer lifts the pressure
+  EXPECT_FALSE(RxBufferTracker::underPressure());
+  EXPECT_FALSE(pkt2.copyOutIfPressured());
+  FLAGS_rx_buffer_copy_threshold = oldThreshold;
+}
@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RxPacketDispatcher.h"
+
+#include "fboss/agent/RxPacket.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+
+#include <folly/Baton.h>
+#include <gtest/gtest.h>
+#include <atomic>
+
+using namespace facebook::fboss;
+using std::unique_ptr;
+
+namespace {
+
+unique_ptr<MockRxPacket> makePacket(const char* ethertype,
+                                    const char* payload = "") {
+  auto pkt = MockRxPacket::fromHex(
+      std::string(
+        // dst mac, src mac
+        "02 00 01 00 00 01  02 00 02 01 02 03"
+        // 802.1q, VLAN 1
+        "81 00 00 01") +
+      ethertype + payload);
+  pkt->padToLength(68);
+  return pkt;
+}
+
+unique_ptr<MockRxPacket> makeIPv6Packet(const char* nextHeader,
+                                        const char* icmpType) {
+  return makePacket("86 dd",
+      (std::string(
+        // Version, traffic class, flow label, payload length
+        "60 00 00 00  00 20") +
+       nextHeader +
+       // Hop limit
+       "ff"
+       // Source and destination addresses
+       "fe 80 00 00 00 00 00 00  00 00 00 00 00 00 00 01"
+       "ff 02 00 00 00 00 00 00  00 00 00 00 00 00 00 01" +
+       icmpType).c_str());
+}
+
+const std::vector<uint32_t> kOneThreadEach{1, 1, 1};
+
+}
+
+TEST(RxPacketDispatcher, classify) {
+  EXPECT_EQ(RxPacketClass::CONTROL,
+            RxPacketDispatcher::classify(makePacket("08 06").get()));
+  EXPECT_EQ(RxPacketClass::CONTROL,
+            RxPacketDispatcher::classify(makePacket("88 cc").get()));
+  EXPECT_EQ(RxPacketClass::HOST,
+            RxPacketDispatcher::classify(makePacket("08 00").get()));
+  EXPECT_EQ(RxPacketClass::OTHER,
+            RxPacketDispatcher::classify(makePacket("88 47").get()));
+
+  // NDP neighbor solicitation is a control packet, while other ICMPv6 and
+  // IPv6 traffic goes to the host class.
+  EXPECT_EQ(RxPacketClass::CONTROL,
+            RxPacketDispatcher::classify(makeIPv6Packet("3a", "87").get()));
+  EXPECT_EQ(RxPacketClass::HOST,
+            RxPacketDispatcher::classify(makeIPv6Packet("3a", "80").get()));
+  EXPECT_EQ(RxPacketClass::HOST,
+            RxPacketDispatcher::classify(makeIPv6Packet("11", "87").get()));
+
+  // Truncated packets must not throw
+  auto pkt = MockRxPacket::fromHex("02 00 01 00 00 01  02 00");
+  EXPECT_EQ(RxPacketClass::OTHER, RxPacketDispatcher::classify(pkt.get()));
+}
+
+TEST(RxPacketDispatcher, dispatch) {
+  std::atomic<int> handled{0};
+  folly::Baton<> done;
+  const int numPkts = 100;
+  RxPacketDispatcher dispatcher([&](unique_ptr<RxPacket> pkt) {
+      if (++handled == numPkts) {
+        done.post();
+      }
+    }, numPkts, kOneThreadEach);
+  dispatcher.start();
+
+  for (int i = 0; i < numPkts; ++i) {
+    EXPECT_TRUE(dispatcher.dispatch(RxPacketClass::HOST, makePacket("08 00")));
+  }
+  done.wait();
+  dispatcher.stop();
+
+  EXPECT_EQ(numPkts, handled.load());
+  EXPECT_EQ(numPkts, dispatcher.getNumDispatched(RxPacketClass::HOST));
+  EXPECT_EQ(0, dispatcher.getNumDropped(RxPacketClass::HOST));
+  EXPECT_EQ(0, dispatcher.getNumDispatched(RxPacketClass::CONTROL));
+}
+
+TEST(RxPacketDispatcher, classIsolation) {
+  // Block the HOST worker, and verify that its queue overflowing does not
+  // prevent CONTROL packets from being handled.
+  std::atomic<int> hostHandled{0};
+  folly::Baton<> hostBlocked;
+  folly::Baton<> unblockHost;
+  folly::Baton<> controlHandled;
+  RxPacketDispatcher dispatcher([&](unique_ptr<RxPacket> pkt) {
+      if (RxPacketDispatcher::classify(pkt.get()) == RxPacketClass::HOST) {
+        if (++hostHandled == 1) {
+          hostBlocked.post();
+        }
+        unblockHost.wait();
+      } else {
+        controlHandled.post();
+      }
+    }, 2, kOneThreadEach);
+  dispatcher.start();
+
+  EXPECT_TRUE(dispatcher.dispatch(RxPacketClass::HOST, makePacket("08 00")));
+  hostBlocked.wait();
+  // The worker holds the first packet; two more fill the queue.
+  EXPECT_TRUE(dispatcher.dispatch(RxPacketClass::HOST, makePacket("08 00")));
+  EXPECT_TRUE(dispatcher.dispatch(RxPacketClass::HOST, makePacket("08 00")));
+  EXPECT_FALSE(dispatcher.dispatch(RxPacketClass::HOST, makePacket("08 00")));
+  EXPECT_EQ(1, dispatcher.getNumDropped(RxPacketClass::HOST));
+
+  EXPECT_TRUE(dispatcher.dispatch(RxPacketClass::CONTROL,
+                                  makePacket("08 06")));
+  controlHandled.wait();
+
+  unblockHost.post();
+  dispatcher.stop();
+  EXPECT_EQ(0, dispatcher.getNumDropped(RxPacketClass::CONTROL));
+
+  // Packets dispatched after stop() are dropped
+  EXPECT_FALSE(dispatcher.dispatch(RxPacketClass::CONTROL,
+                                   makePacket("08 06")));
+}
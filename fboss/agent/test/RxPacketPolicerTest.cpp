@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/RxPacketPolicer.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+
+#include <folly/io/Cursor.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::io::Cursor;
+using std::chrono::milliseconds;
+
+namespace {
+
+RxPolicerClass classifyHex(const std::string& hex) {
+  auto pkt = MockRxPacket::fromHex(
+      // dst mac, src mac
+      "02 00 01 00 00 01  02 00 02 01 02 03" + hex);
+  Cursor c(pkt->buf());
+  c += 12;
+  auto ethertype = c.readBE<uint16_t>();
+  return RxPacketPolicer::classify(ethertype, c);
+}
+
+std::string ipv6Hex(const char* nextHeader, const char* icmpType) {
+  return std::string(
+      "86 dd"
+      // Version, traffic class, flow label, payload length
+      "60 00 00 00  00 20") +
+    nextHeader +
+    // Hop limit
+    "ff"
+    // Source and destination addresses
+    "fe 80 00 00 00 00 00 00  00 00 00 00 00 00 00 01"
+    "ff 02 00 00 00 00 00 00  00 00 00 00 00 00 00 01" +
+    icmpType;
+}
+
+RxPacketPolicer::Config makeConfig(uint32_t rate, uint32_t burst) {
+  RxPacketPolicer::Config config;
+  config[static_cast<int>(RxPolicerClass::ARP_OTHER)] =
+    RxPacketPolicer::ClassConfig(rate, burst);
+  return config;
+}
+
+}
+
+TEST(RxPacketPolicer, classify) {
+  // ARP request and reply
+  EXPECT_EQ(RxPolicerClass::ARP_OTHER,
+            classifyHex("08 06  00 01 08 00 06 04 00 01"));
+  EXPECT_EQ(RxPolicerClass::ARP_REPLY,
+            classifyHex("08 06  00 01 08 00 06 04 00 02"));
+  EXPECT_EQ(RxPolicerClass::LLDP, classifyHex("88 cc"));
+  EXPECT_EQ(RxPolicerClass::IP, classifyHex("08 00"));
+  EXPECT_EQ(RxPolicerClass::OTHER, classifyHex("88 47"));
+
+  // NDP neighbor advertisement and solicitation, ICMPv6 echo, and UDP
+  EXPECT_EQ(RxPolicerClass::NDP_ADVERTISEMENT,
+            classifyHex(ipv6Hex("3a", "88")));
+  EXPECT_EQ(RxPolicerClass::NDP_OTHER, classifyHex(ipv6Hex("3a", "87")));
+  EXPECT_EQ(RxPolicerClass::IP, classifyHex(ipv6Hex("3a", "80")));
+  EXPECT_EQ(RxPolicerClass::IP, classifyHex(ipv6Hex("11", "87")));
+
+  // A truncated ARP packet
+  EXPECT_EQ(RxPolicerClass::OTHER, classifyHex("08 06  00 01"));
+}
+
+TEST(RxPacketPolicer, tokenBucket) {
+  RxPacketPolicer policer(makeConfig(100, 10));
+  auto now = std::chrono::steady_clock::now();
+  PortID port1(1);
+  PortID port2(2);
+
+  // The whole burst is accepted at once, and nothing more
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(policer.admit(port1, RxPolicerClass::ARP_OTHER, now));
+  }
+  EXPECT_FALSE(policer.admit(port1, RxPolicerClass::ARP_OTHER, now));
+
+  // Other ports and classes have their own buckets.  Classes without a
+  // rate limit are never dropped.
+  EXPECT_TRUE(policer.admit(port2, RxPolicerClass::ARP_OTHER, now));
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(policer.admit(port1, RxPolicerClass::ARP_REPLY, now));
+  }
+
+  // At 100 pps, one token is added every 10ms
+  now += milliseconds(20);
+  EXPECT_TRUE(policer.admit(port1, RxPolicerClass::ARP_OTHER, now));
+  EXPECT_TRUE(policer.admit(port1, RxPolicerClass::ARP_OTHER, now));
+  EXPECT_FALSE(policer.admit(port1, RxPolicerClass::ARP_OTHER, now));
+
+  // The bucket never holds more than the burst size
+  now += milliseconds(10000);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(policer.admit(port1, RxPolicerClass::ARP_OTHER, now));
+  }
+  EXPECT_FALSE(policer.admit(port1, RxPolicerClass::ARP_OTHER, now));
+}
+
+TEST(RxPacketPolicer, badConfig) {
+  EXPECT_THROW(RxPacketPolicer(makeConfig(100, 0)), FbossError);
+}
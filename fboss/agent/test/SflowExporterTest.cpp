@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/SflowExporter.h"
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::io::Cursor;
+using std::vector;
+
+namespace {
+
+SflowExporter::Sample makeSample(PortID port, uint32_t headerLen) {
+  SflowExporter::Sample sample;
+  sample.port = port;
+  sample.samplingRate = 1000;
+  sample.samplePool = 5000;
+  sample.sequence = 5;
+  sample.drops = 2;
+  sample.frameLength = 1500;
+  for (uint32_t i = 0; i < headerLen; ++i) {
+    sample.header.push_back(i);
+  }
+  return sample;
+}
+
+}
+
+TEST(SflowExporter, buildDatagram) {
+  vector<SflowExporter::Sample> samples{
+    makeSample(PortID(3), 14),
+    makeSample(PortID(7), 64),
+  };
+  IPAddress agentIp("10.1.2.3");
+  auto buf = SflowExporter::buildDatagram(agentIp, 42, 123456,
+                                          samples.data(), samples.size());
+  EXPECT_EQ(SflowExporter::headerSize(agentIp) +
+            SflowExporter::encodedSize(samples[0]) +
+            SflowExporter::encodedSize(samples[1]),
+            buf->length());
+
+  Cursor c(buf.get());
+  EXPECT_EQ(5, c.readBE<uint32_t>());  // version
+  EXPECT_EQ(1, c.readBE<uint32_t>());  // IPv4 agent address
+  EXPECT_EQ(0x0a010203, c.readBE<uint32_t>());
+  EXPECT_EQ(0, c.readBE<uint32_t>());  // sub agent id
+  EXPECT_EQ(42, c.readBE<uint32_t>());
+  EXPECT_EQ(123456, c.readBE<uint32_t>());
+  EXPECT_EQ(2, c.readBE<uint32_t>());
+
+  // The first flow sample
+  EXPECT_EQ(1, c.readBE<uint32_t>());
+  // 8 fields, plus a record of 2 + 4 fields and a 14 byte header padded
+  // to 16 bytes
+  EXPECT_EQ(32 + 24 + 16, c.readBE<uint32_t>());
+  EXPECT_EQ(5, c.readBE<uint32_t>());     // sequence
+  EXPECT_EQ(3, c.readBE<uint32_t>());     // source id
+  EXPECT_EQ(1000, c.readBE<uint32_t>());  // sampling rate
+  EXPECT_EQ(5000, c.readBE<uint32_t>());  // sample pool
+  EXPECT_EQ(2, c.readBE<uint32_t>());     // drops
+  EXPECT_EQ(3, c.readBE<uint32_t>());     // input
+  EXPECT_EQ(0, c.readBE<uint32_t>());     // output
+  EXPECT_EQ(1, c.readBE<uint32_t>());     // flow records
+  EXPECT_EQ(1, c.readBE<uint32_t>());     // raw packet header
+  EXPECT_EQ(16 + 16, c.readBE<uint32_t>());
+  EXPECT_EQ(1, c.readBE<uint32_t>());     // ethernet
+  EXPECT_EQ(1500, c.readBE<uint32_t>());  // frame length
+  EXPECT_EQ(0, c.readBE<uint32_t>());     // stripped
+  EXPECT_EQ(14, c.readBE<uint32_t>());
+  for (uint32_t i = 0; i < 14; ++i) {
+    EXPECT_EQ(i, c.read<uint8_t>());
+  }
+  EXPECT_EQ(0, c.readBE<uint16_t>());     // padding
+
+  // The second sample needs no padding
+  EXPECT_EQ(1, c.readBE<uint32_t>());
+  EXPECT_EQ(32 + 24 + 64, c.readBE<uint32_t>());
+  c.skip(5 * 4);
+  EXPECT_EQ(7, c.readBE<uint32_t>());
+  c.skip(7 * 4);
+  EXPECT_EQ(64, c.readBE<uint32_t>());
+  c.skip(64);
+  EXPECT_TRUE(c.isAtEnd());
+}
+
+TEST(SflowExporter, ipv6Agent) {
+  IPAddress agentIp("2401:db00::1");
+  auto buf = SflowExporter::buildDatagram(agentIp, 1, 0, nullptr, 0);
+  EXPECT_EQ(SflowExporter::headerSize(agentIp), buf->length());
+  EXPECT_EQ(6 * 4 + 16, buf->length());
+
+  Cursor c(buf.get());
+  c.skip(4);
+  EXPECT_EQ(2, c.readBE<uint32_t>());
+  EXPECT_EQ(0x24010db0, c.readBE<uint32_t>());
+}
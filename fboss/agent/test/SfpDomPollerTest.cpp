@@ -0,0 +1,203 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/SfpDomPoller.h"
+
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/SfpImpl.h"
+#include "fboss/agent/SfpMap.h"
+#include "fboss/agent/SfpModule.h"
+
+#include <folly/Memory.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string.h>
+#include <thread>
+
+using namespace facebook::fboss;
+using folly::make_unique;
+using std::unique_ptr;
+
+namespace {
+
+// The number of reads in progress on each bus, and the most seen at once
+struct BusState {
+  std::atomic<int> active{0};
+  std::atomic<int> maxActive{0};
+};
+
+class FakeSfpImpl : public SfpImpl {
+ public:
+  FakeSfpImpl(int busId, BusState* bus) : busId_(busId), bus_(bus) {
+    name_ = folly::to<std::string>("fake", busId);
+    memset(idprom_, 0, sizeof(idprom_));
+    memset(dom_, 0, sizeof(dom_));
+    // VENDOR_NAME, padded with spaces
+    memcpy(idprom_ + 0x14, "ACME            ", 16);
+    // DIAGNOSTIC_MONITORING_TYPE: DOM implemented
+    idprom_[0x5C] = 0x40;
+    // Temperature: 25C
+    dom_[0x60] = 0x19;
+  }
+
+  int readSfpEeprom(int dataAddress, int offset, int len,
+                    uint8_t* fieldValue) override {
+    auto active = ++bus_->active;
+    auto prev = bus_->maxActive.load();
+    while (active > prev &&
+           !bus_->maxActive.compare_exchange_weak(prev, active)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    --bus_->active;
+
+    if (fail) {
+      throw FbossError("I2C read failed");
+    }
+    lastReadLength = len;
+    memcpy(fieldValue, (dataAddress == 0x50 ? idprom_ : dom_) + offset, len);
+    return 0;
+  }
+  bool detectSfp() override {
+    return present;
+  }
+  folly::StringPiece getName() override {
+    return name_;
+  }
+  int getBusId() override {
+    return busId_;
+  }
+
+  bool present{true};
+  bool fail{false};
+  int lastReadLength{0};
+  uint8_t dom_[MAX_SFP_EEPROM_SIZE];
+
+ private:
+  int busId_;
+  BusState* bus_;
+  std::string name_;
+  uint8_t idprom_[MAX_SFP_EEPROM_SIZE];
+};
+
+FakeSfpImpl* addSfp(SfpMap* map, PortID port, int busId, BusState* bus) {
+  auto impl = make_unique<FakeSfpImpl>(busId, bus);
+  auto* rawImpl = impl.get();
+  unique_ptr<SfpImpl> sfpImpl(std::move(impl));
+  auto sfp = make_unique<SfpModule>(sfpImpl);
+  map->createSfp(port, sfp);
+  return rawImpl;
+}
+
+}
+
+TEST(SfpDomPoller, DomUpdate) {
+  SfpMap map;
+  BusState bus;
+  auto* impl = addSfp(&map, PortID(1), 0, &bus);
+  SfpDomPoller poller(&map);
+
+  SfpDom dom;
+  map.sfpModule(PortID(1))->getSfpDom(dom);
+  EXPECT_FALSE(dom.sfpPresent);
+
+  // Detection reads the full pages
+  poller.detectSfps();
+  EXPECT_EQ(MAX_SFP_EEPROM_SIZE, impl->lastReadLength);
+  map.sfpModule(PortID(1))->getSfpDom(dom);
+  EXPECT_TRUE(dom.sfpPresent);
+  EXPECT_TRUE(dom.domSupported);
+  EXPECT_EQ(25, dom.value.temp);
+
+  // DOM updates only read the diagnostics through the alarm flags
+  impl->dom_[0x60] = 0x1e;
+  poller.updateSfpDomFields();
+  EXPECT_EQ(0x76 - 0x60, impl->lastReadLength);
+  map.sfpModule(PortID(1))->getSfpDom(dom);
+  EXPECT_EQ(30, dom.value.temp);
+
+  // Removal is published as well
+  impl->present = false;
+  poller.detectSfps();
+  map.sfpModule(PortID(1))->getSfpDom(dom);
+  EXPECT_FALSE(dom.sfpPresent);
+  EXPECT_FALSE(dom.__isset.value);
+}
+
+TEST(SfpDomPoller, IdpromSnapshot) {
+  SfpMap map;
+  BusState bus;
+  auto* impl = addSfp(&map, PortID(1), 0, &bus);
+  auto* sfp = map.sfpModule(PortID(1));
+  SfpDomPoller poller(&map);
+  EXPECT_EQ(nullptr, sfp->getSfpIdprom());
+
+  poller.detectSfps();
+  auto idprom = sfp->getSfpIdprom();
+  ASSERT_NE(nullptr, idprom);
+  EXPECT_EQ("ACME", idprom->vendorName);
+  EXPECT_TRUE(idprom->domSupported);
+  EXPECT_EQ(sfp->getGeneration(), idprom->generation);
+  uint8_t diagType;
+  EXPECT_EQ(0, sfp->getSfpFieldValue(
+        SfpIdpromFields::DIAGNOSTIC_MONITORING_TYPE, &diagType));
+  EXPECT_EQ(0x40, diagType);
+
+  // Readers keep their snapshot after the SFP is removed
+  impl->present = false;
+  poller.detectSfps();
+  EXPECT_EQ(nullptr, sfp->getSfpIdprom());
+  EXPECT_EQ("ACME", idprom->vendorName);
+  EXPECT_EQ(-1, sfp->getSfpFieldValue(
+        SfpIdpromFields::DIAGNOSTIC_MONITORING_TYPE, &diagType));
+
+  // A new insertion gets a new generation
+  impl->present = true;
+  poller.detectSfps();
+  ASSERT_NE(nullptr, sfp->getSfpIdprom());
+  EXPECT_GT(sfp->getSfpIdprom()->generation, idprom->generation);
+}
+
+TEST(SfpDomPoller, BusSerialization) {
+  SfpMap map;
+  BusState buses[4];
+  for (int i = 0; i < 16; ++i) {
+    addSfp(&map, PortID(i + 1), i % 4, &buses[i % 4]);
+  }
+  // Modules without a bus ID share a single bus
+  BusState unknown;
+  for (int i = 16; i < 20; ++i) {
+    addSfp(&map, PortID(i + 1), SfpImpl::UNKNOWN_BUS, &unknown);
+  }
+
+  SfpDomPoller poller(&map);
+  poller.detectSfps();
+  poller.updateSfpDomFields();
+  for (const auto& bus : buses) {
+    EXPECT_EQ(1, bus.maxActive.load());
+  }
+  EXPECT_EQ(1, unknown.maxActive.load());
+}
+
+TEST(SfpDomPoller, FailedModule) {
+  SfpMap map;
+  BusState bus;
+  auto* bad = addSfp(&map, PortID(1), 0, &bus);
+  addSfp(&map, PortID(2), 0, &bus);
+  bad->fail = true;
+
+  SfpDomPoller poller(&map);
+  poller.detectSfps();
+
+  // The failing module stays absent, while the rest of its bus is detected
+  SfpDom dom;
+  map.sfpModule(PortID(1))->getSfpDom(dom);
+  EXPECT_FALSE(dom.sfpPresent);
+  map.sfpModule(PortID(2))->getSfpDom(dom);
+  EXPECT_TRUE(dom.sfpPresent);
+}
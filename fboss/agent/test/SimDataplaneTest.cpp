@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/sim/SimDataplane.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <folly/IPAddressV4.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IOBuf;
+using folly::IPAddressV4;
+using folly::MacAddress;
+using std::make_shared;
+using std::unique_ptr;
+typedef SimDataplane::Verdict Verdict;
+
+namespace {
+
+const MacAddress kRouterMac("00:02:00:00:00:01");
+const MacAddress kHostMac("02:00:00:00:00:22");
+
+// testStateA(), with 10.0.0.22 and 10.0.0.23, the nexthops of 10.1.1.0/24,
+// resolved on ports 2 and 3
+std::shared_ptr<SwitchState> makeState() {
+  auto state = testStateA();
+  auto arp = make_shared<ArpTable>();
+  arp->addEntry(IPAddressV4("10.0.0.22"), kHostMac, PortID(2),
+                InterfaceID(1));
+  arp->addEntry(IPAddressV4("10.0.0.23"), kHostMac, PortID(3),
+                InterfaceID(1));
+  state->getVlans()->getVlan(VlanID(1))->setArpTable(arp);
+  state->publish();
+  return state;
+}
+
+// An untagged UDP over IPv4 frame
+unique_ptr<IOBuf> makeIPv4(MacAddress dstMac, const char* dstIP,
+                           uint8_t ttl = 64) {
+  const size_t len = 14 + 20 + 8;
+  auto buf = IOBuf::create(len);
+  buf->append(len);
+  folly::io::RWPrivateCursor cursor(buf.get());
+  cursor.push(dstMac.bytes(), MacAddress::SIZE);
+  cursor.push(kHostMac.bytes(), MacAddress::SIZE);
+  cursor.writeBE<uint16_t>(0x0800);
+  cursor.writeBE<uint8_t>(0x45);
+  cursor.writeBE<uint8_t>(0);
+  cursor.writeBE<uint16_t>(20 + 8);
+  cursor.writeBE<uint32_t>(0);
+  cursor.writeBE<uint8_t>(ttl);
+  cursor.writeBE<uint8_t>(17);
+  cursor.writeBE<uint16_t>(0);
+  cursor.writeBE<uint32_t>(IPAddressV4("10.0.0.22").toLongHBO());
+  cursor.writeBE<uint32_t>(IPAddressV4(dstIP).toLongHBO());
+  cursor.writeBE<uint16_t>(1000);
+  cursor.writeBE<uint16_t>(2000);
+  cursor.writeBE<uint16_t>(8);
+  cursor.writeBE<uint16_t>(0);
+  return buf;
+}
+
+} // unnamed namespace
+
+TEST(SimDataplane, NoState) {
+  SimDataplane dataplane;
+  auto frame = makeIPv4(kRouterMac, "10.1.1.5");
+  EXPECT_EQ(Verdict::DROP_BAD, dataplane.forward(frame.get(),
+                                                 VlanID(1)).verdict);
+  EXPECT_EQ(1, dataplane.getCount(Verdict::DROP_BAD));
+}
+
+TEST(SimDataplane, Verdicts) {
+  SimDataplane dataplane;
+  dataplane.stateChanged(makeState());
+  auto forward = [&](unique_ptr<IOBuf> frame, VlanID vlan) {
+    return dataplane.forward(frame.get(), vlan);
+  };
+
+  auto result = forward(makeIPv4(kRouterMac, "10.1.1.5"), VlanID(1));
+  EXPECT_EQ(Verdict::ROUTED, result.verdict);
+  EXPECT_TRUE(result.egressPort == PortID(2) ||
+              result.egressPort == PortID(3));
+  EXPECT_EQ(kHostMac, result.dstMac);
+
+  // Connected, but not resolved
+  EXPECT_EQ(Verdict::PUNT_NO_NEIGHBOR,
+            forward(makeIPv4(kRouterMac, "10.0.0.50"), VlanID(1)).verdict);
+  EXPECT_EQ(Verdict::PUNT_LOCAL,
+            forward(makeIPv4(kRouterMac, "10.0.0.1"), VlanID(1)).verdict);
+  EXPECT_EQ(Verdict::PUNT_TTL,
+            forward(makeIPv4(kRouterMac, "10.1.1.5", 1), VlanID(1)).verdict);
+  EXPECT_EQ(Verdict::DROP_NO_ROUTE,
+            forward(makeIPv4(kRouterMac, "8.8.8.8"), VlanID(1)).verdict);
+  // Not to the router MAC of the VLAN
+  EXPECT_EQ(Verdict::SWITCHED,
+            forward(makeIPv4(MacAddress("02:00:00:00:00:99"), "10.1.1.5"),
+                    VlanID(1)).verdict);
+  EXPECT_EQ(Verdict::SWITCHED,
+            forward(makeIPv4(kRouterMac, "10.1.1.5"), VlanID(55)).verdict);
+  EXPECT_EQ(Verdict::DROP_BAD,
+            forward(makeIPv4(kRouterMac, "10.1.1.5"), VlanID(99)).verdict);
+
+  EXPECT_EQ(1, dataplane.getCount(Verdict::ROUTED));
+  EXPECT_EQ(2, dataplane.getCount(Verdict::SWITCHED));
+  EXPECT_TRUE(SimDataplane::isPunt(Verdict::PUNT_TTL));
+  EXPECT_FALSE(SimDataplane::isPunt(Verdict::SWITCHED));
+  dataplane.resetCounts();
+  EXPECT_EQ(0, dataplane.getCount(Verdict::ROUTED));
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/hw/sim/SimLatencyModel.h"
+#include "fboss/agent/state/RouteUpdater.h"
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::chrono::microseconds;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+
+// Add a route via the two nexthops testStateA() resolves on interface 1
+shared_ptr<SwitchState> addEcmpRoute(const shared_ptr<SwitchState>& state,
+                                     const char* network) {
+  RouteNextHops nexthops;
+  nexthops.emplace(IPAddress("10.0.0.22"));
+  nexthops.emplace(IPAddress("10.0.0.23"));
+  RouteUpdater updater(state->getRouteTables());
+  updater.addRoute(RouterID(0), IPAddress(network), 24, nexthops);
+  auto newState = state->clone();
+  newState->resetRouteTables(updater.updateDone());
+  return newState;
+}
+
+shared_ptr<SwitchState> delRoute(const shared_ptr<SwitchState>& state,
+                                 const char* network) {
+  RouteUpdater updater(state->getRouteTables());
+  updater.delRoute(RouterID(0), IPAddress(network), 24);
+  auto newState = state->clone();
+  newState->resetRouteTables(updater.updateDone());
+  return newState;
+}
+
+} // unnamed namespace
+
+TEST(SimLatencyModel, Disabled) {
+  SimLatencyModel model{SimLatencyModel::Costs()};
+  EXPECT_FALSE(model.enabled());
+  auto empty = make_shared<SwitchState>();
+  EXPECT_EQ(microseconds(0),
+            model.apply(StateDelta(empty, testStateA())));
+}
+
+TEST(SimLatencyModel, Cost) {
+  SimLatencyModel::Costs costs;
+  costs.stateChange = microseconds(100);
+  costs.hostAdd = microseconds(5);
+  costs.routeAdd = microseconds(10);
+  costs.ecmpCreate = microseconds(1000);
+  SimLatencyModel model(costs);
+  EXPECT_TRUE(model.enabled());
+
+  SimLatencyModel::Operations ops;
+  EXPECT_EQ(microseconds(100), model.cost(ops));
+  ops.hostAdds = 3;
+  ops.routeAdds = 20;
+  ops.routeDeletes = 7;
+  ops.ecmpCreates = 2;
+  EXPECT_EQ(microseconds(100 + 15 + 200 + 2000), model.cost(ops));
+}
+
+TEST(SimLatencyModel, EcmpGroupsAreShared) {
+  SimLatencyModel::Costs costs;
+  costs.stateChange = microseconds(1);
+  SimLatencyModel model(costs);
+
+  // testStateA() has one route over two resolved nexthops
+  auto empty = make_shared<SwitchState>();
+  auto stateA = testStateA();
+  auto ops = model.count(StateDelta(empty, stateA));
+  EXPECT_EQ(2, ops.vlans);
+  EXPECT_EQ(2, ops.intfs);
+  EXPECT_EQ(1, ops.ecmpCreates);
+
+  // A second route over the same nexthops reuses the group
+  auto state1 = addEcmpRoute(stateA, "10.2.2.0");
+  ops = model.count(StateDelta(stateA, state1));
+  EXPECT_EQ(1, ops.routeAdds);
+  EXPECT_EQ(0, ops.routeDeletes);
+  EXPECT_EQ(0, ops.ecmpCreates);
+
+  // The group is only destroyed along with the last route using it
+  auto state2 = delRoute(state1, "10.1.1.0");
+  ops = model.count(StateDelta(state1, state2));
+  EXPECT_EQ(1, ops.routeDeletes);
+  EXPECT_EQ(0, ops.ecmpDestroys);
+  auto state3 = delRoute(state2, "10.2.2.0");
+  ops = model.count(StateDelta(state2, state3));
+  EXPECT_EQ(1, ops.routeDeletes);
+  EXPECT_EQ(1, ops.ecmpDestroys);
+
+  // And created again for the next one
+  auto state4 = addEcmpRoute(state3, "10.3.3.0");
+  ops = model.count(StateDelta(state3, state4));
+  EXPECT_EQ(1, ops.routeAdds);
+  EXPECT_EQ(1, ops.ecmpCreates);
+}
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/StateChangeWatcher.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/hw/mock/MockHwSwitch.h"
+#include "fboss/agent/hw/mock/MockPlatform.h"
+#include "fboss/agent/state/Interface.h"
+#include "fboss/agent/state/InterfaceMap.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <gtest/gtest.h>
+#include <future>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::chrono::milliseconds;
+using std::shared_ptr;
+
+using ::testing::_;
+
+namespace {
+
+typedef StateChangeWatcher::Changes Changes;
+
+void addAddress(SwSwitch* sw, const IPAddress& addr) {
+  auto updateFn = [&](const shared_ptr<SwitchState>& state) {
+    auto newState = state->clone();
+    auto intfs = state->getInterfaces()->clone();
+    auto intf = intfs->getInterface(InterfaceID(1))->clone();
+    auto newAddrs = intf->getAddresses();
+    newAddrs.emplace(addr, 24);
+    intf->setAddresses(newAddrs);
+    intfs->updateNode(intf);
+    newState->resetIntfs(intfs);
+    return newState;
+  };
+  sw->updateStateBlocking("add address", updateFn);
+}
+
+std::future<Changes> waitForChanges(SwSwitch* sw, int64_t since,
+                                    uint32_t timeoutMs) {
+  auto result = std::make_shared<std::promise<Changes>>();
+  sw->getStateChangeWatcher()->waitForChanges(
+      since, milliseconds(timeoutMs),
+      [result](const Changes& changes) { result->set_value(changes); });
+  return result->get_future();
+}
+
+} // unnamed namespace
+
+TEST(StateChangeWatcher, ReportsChanges) {
+  auto sw = createMockSw(testStateA());
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(2);
+  int64_t gen0 = sw->getState()->getGeneration();
+
+  // Nothing changed yet, so the wait times out
+  auto changes = waitForChanges(sw.get(), gen0, 0).get();
+  EXPECT_EQ(gen0, changes.generation);
+  EXPECT_EQ(0, changes.changed);
+  EXPECT_FALSE(changes.resync);
+
+  addAddress(sw.get(), IPAddress("10.0.0.100"));
+  changes = waitForChanges(sw.get(), gen0, 1000).get();
+  int64_t gen1 = changes.generation;
+  EXPECT_LT(gen0, gen1);
+  EXPECT_EQ(StateChangeWatcher::INTERFACES, changes.changed);
+  EXPECT_FALSE(changes.resync);
+
+  // A client waiting for changes is woken up by the next one
+  auto pending = waitForChanges(sw.get(), gen1, 10000);
+  EXPECT_EQ(std::future_status::timeout, pending.wait_for(milliseconds(50)));
+  addAddress(sw.get(), IPAddress("10.0.1.100"));
+  ASSERT_EQ(std::future_status::ready, pending.wait_for(milliseconds(5000)));
+  changes = pending.get();
+  EXPECT_LT(gen1, changes.generation);
+  EXPECT_EQ(StateChangeWatcher::INTERFACES, changes.changed);
+
+  // Changes accumulate for clients that are further behind
+  changes = waitForChanges(sw.get(), gen0, 1000).get();
+  EXPECT_EQ(StateChangeWatcher::INTERFACES, changes.changed);
+  EXPECT_FALSE(changes.resync);
+}
+
+TEST(StateChangeWatcher, TimesOut) {
+  auto sw = createMockSw(testStateA());
+  int64_t gen = sw->getState()->getGeneration();
+  auto pending = waitForChanges(sw.get(), gen, 50);
+  ASSERT_EQ(std::future_status::ready, pending.wait_for(milliseconds(5000)));
+  auto changes = pending.get();
+  EXPECT_EQ(gen, changes.generation);
+  EXPECT_EQ(0, changes.changed);
+}
+
+TEST(StateChangeWatcher, UnknownGeneration) {
+  auto sw = createMockSw(testStateA());
+  // e.g. a generation from before the agent restarted
+  int64_t gen = sw->getState()->getGeneration();
+  auto changes = waitForChanges(sw.get(), gen + 100, 1000).get();
+  EXPECT_EQ(gen, changes.generation);
+  EXPECT_EQ(StateChangeWatcher::ALL, changes.changed);
+  EXPECT_TRUE(changes.resync);
+}
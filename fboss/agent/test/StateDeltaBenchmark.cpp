@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/IPAddressV4.h>
+#include "fboss/agent/state/NodeMapDelta.h"
+#include "fboss/agent/state/NodeMapDelta-defs.h"
+#include "fboss/agent/state/Port.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteTableRib.h"
+
+#include <map>
+#include <tuple>
+
+using namespace facebook::fboss;
+using folly::IPAddressV4;
+using std::make_shared;
+using std::shared_ptr;
+
+/*
+ * Benchmarks for walking the changes between two versions of a NodeMap.
+ *
+ * Each benchmark compares a map with a copy in which a percentage of the
+ * entries were replaced, so the results show how the cost of a delta scales
+ * with the size of the map and the number of changed entries.  The RIB
+ * benchmarks use a PersistentMap container and the port benchmarks use a
+ * flat_map.
+ */
+
+namespace {
+
+typedef RouteTableRib<IPAddressV4> RibV4;
+
+template<typename MapT>
+struct MapPair {
+  shared_ptr<MapT> oldMap;
+  shared_ptr<MapT> newMap;
+  size_t numChanged{0};
+};
+
+shared_ptr<Route<IPAddressV4>> makeRoute(uint32_t index,
+                                         RouteForwardAction action) {
+  // Spread the /24 prefixes over 10.0.0.0/8 and beyond
+  RoutePrefixV4 prefix{IPAddressV4::fromLongHBO(0x0a000000 + (index << 8)),
+                       24};
+  return make_shared<Route<IPAddressV4>>(prefix, action);
+}
+
+const MapPair<RibV4>& getRibs(uint32_t numRoutes, uint32_t changePercent) {
+  static std::map<std::tuple<uint32_t, uint32_t>, MapPair<RibV4>> cache;
+  auto key = std::make_tuple(numRoutes, changePercent);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+
+  MapPair<RibV4> ribs;
+  ribs.oldMap = make_shared<RibV4>();
+  for (uint32_t n = 0; n < numRoutes; ++n) {
+    ribs.oldMap->addRoute(makeRoute(n, RouteForwardAction::DROP));
+  }
+  ribs.oldMap->publish();
+
+  ribs.newMap = ribs.oldMap->clone();
+  uint32_t step = changePercent ? 100 / changePercent : numRoutes + 1;
+  for (uint32_t n = 0; n < numRoutes; n += step) {
+    ribs.newMap->updateRoute(makeRoute(n, RouteForwardAction::TO_CPU));
+    ++ribs.numChanged;
+  }
+  ribs.newMap->publish();
+  return cache.emplace(key, std::move(ribs)).first->second;
+}
+
+const MapPair<PortMap>& getPorts(uint32_t numPorts, uint32_t changePercent) {
+  static std::map<std::tuple<uint32_t, uint32_t>, MapPair<PortMap>> cache;
+  auto key = std::make_tuple(numPorts, changePercent);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    return it->second;
+  }
+
+  MapPair<PortMap> ports;
+  ports.oldMap = make_shared<PortMap>();
+  for (uint32_t n = 1; n <= numPorts; ++n) {
+    ports.oldMap->registerPort(PortID(n), folly::to<std::string>("port", n));
+  }
+  ports.oldMap->publish();
+
+  ports.newMap = ports.oldMap->clone();
+  uint32_t step = changePercent ? 100 / changePercent : numPorts + 1;
+  for (uint32_t n = 1; n <= numPorts; n += step) {
+    ports.newMap->updateNode(ports.oldMap->getPort(PortID(n))->clone());
+    ++ports.numChanged;
+  }
+  ports.newMap->publish();
+  return cache.emplace(key, std::move(ports)).first->second;
+}
+
+template<typename MapT>
+void walkDelta(uint32_t numIters, const MapPair<MapT>& maps) {
+  size_t numChanged = 0;
+  for (uint32_t n = 0; n < numIters; ++n) {
+    NodeMapDelta<MapT> delta(maps.oldMap.get(), maps.newMap.get());
+    for (const auto& entry : delta) {
+      folly::doNotOptimizeAway(entry.getNew());
+      ++numChanged;
+    }
+  }
+  CHECK_EQ(numChanged, maps.numChanged * numIters);
+}
+
+void ribDelta(uint32_t numIters, uint32_t numRoutes, uint32_t changePercent) {
+  const MapPair<RibV4>* ribs;
+  BENCHMARK_SUSPEND {
+    ribs = &getRibs(numRoutes, changePercent);
+  }
+  walkDelta(numIters, *ribs);
+}
+
+void portDelta(uint32_t numIters, uint32_t numPorts, uint32_t changePercent) {
+  const MapPair<PortMap>* ports;
+  BENCHMARK_SUSPEND {
+    ports = &getPorts(numPorts, changePercent);
+  }
+  walkDelta(numIters, *ports);
+}
+
+} // unnamed namespace
+
+BENCHMARK_NAMED_PARAM(ribDelta, 1k_routes_0pct, 1000, 0)
+BENCHMARK_NAMED_PARAM(ribDelta, 1k_routes_1pct, 1000, 1)
+BENCHMARK_NAMED_PARAM(ribDelta, 1k_routes_10pct, 1000, 10)
+BENCHMARK_NAMED_PARAM(ribDelta, 1k_routes_100pct, 1000, 100)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(ribDelta, 100k_routes_0pct, 100000, 0)
+BENCHMARK_NAMED_PARAM(ribDelta, 100k_routes_1pct, 100000, 1)
+BENCHMARK_NAMED_PARAM(ribDelta, 100k_routes_10pct, 100000, 10)
+BENCHMARK_NAMED_PARAM(ribDelta, 100k_routes_100pct, 100000, 100)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(ribDelta, 1m_routes_1pct, 1000000, 1)
+BENCHMARK_NAMED_PARAM(ribDelta, 1m_routes_10pct, 1000000, 10)
+BENCHMARK_DRAW_LINE();
+BENCHMARK_NAMED_PARAM(portDelta, 64_ports_0pct, 64, 0)
+BENCHMARK_NAMED_PARAM(portDelta, 64_ports_10pct, 64, 10)
+BENCHMARK_NAMED_PARAM(portDelta, 4k_ports_0pct, 4000, 0)
+BENCHMARK_NAMED_PARAM(portDelta, 4k_ports_1pct, 4000, 1)
+BENCHMARK_NAMED_PARAM(portDelta, 4k_ports_10pct, 4000, 10)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
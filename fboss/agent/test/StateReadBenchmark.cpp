@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <gflags/gflags.h>
+#include "fboss/agent/ReadMostlyPtr.h"
+#include "fboss/agent/state/SwitchState.h"
+
+#include <thread>
+#include <vector>
+
+/*
+ * Measure how reading the current SwitchState scales with the number of
+ * threads reading it.
+ *
+ * SwSwitch::getState() copies the shared_ptr under a lock, so every reader
+ * writes to the lock and to the state's reference count, and the readers
+ * contend on them.  SwSwitch::readState() reads each thread's own copy of
+ * the pointer, and only a version number that all threads share.  Each
+ * iteration reads the state once, and the iterations are split between the
+ * threads.
+ */
+
+using namespace facebook::fboss;
+
+namespace {
+
+ReadMostlyPtr<SwitchState>& getStatePtr() {
+  static auto* ptr = [] {
+    auto* p = new ReadMostlyPtr<SwitchState>();
+    auto state = std::make_shared<SwitchState>();
+    state->publish();
+    p->store(state);
+    return p;
+  }();
+  return *ptr;
+}
+
+template<typename ReadFn>
+void runThreads(size_t numIters, size_t numThreads, ReadFn read) {
+  std::vector<std::thread> threads;
+  {
+    folly::BenchmarkSuspender suspender;
+    getStatePtr();
+    threads.reserve(numThreads);
+  }
+  for (size_t t = 0; t < numThreads; ++t) {
+    threads.emplace_back([=] {
+      for (size_t n = t; n < numIters; n += numThreads) {
+        read();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Copy the pointer under a lock, as getState() does
+void lockedCopy(size_t numIters, size_t numThreads) {
+  runThreads(numIters, numThreads, [] {
+    auto state = getStatePtr().load();
+    folly::doNotOptimizeAway(state->getGeneration());
+  });
+}
+
+// Read the thread's cached pointer, as readState() does
+void threadCached(size_t numIters, size_t numThreads) {
+  runThreads(numIters, numThreads, [] {
+    ReadMostlyPtr<SwitchState>::Reader state(getStatePtr());
+    folly::doNotOptimizeAway(state->getGeneration());
+  });
+}
+
+} // unnamed namespace
+
+BENCHMARK_PARAM(lockedCopy, 1)
+BENCHMARK_RELATIVE_PARAM(threadCached, 1)
+BENCHMARK_PARAM(lockedCopy, 2)
+BENCHMARK_RELATIVE_PARAM(threadCached, 2)
+BENCHMARK_PARAM(lockedCopy, 4)
+BENCHMARK_RELATIVE_PARAM(threadCached, 4)
+BENCHMARK_PARAM(lockedCopy, 8)
+BENCHMARK_RELATIVE_PARAM(threadCached, 8)
+BENCHMARK_PARAM(lockedCopy, 16)
+BENCHMARK_RELATIVE_PARAM(threadCached, 16)
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/SwSwitch.h"
+#include "fboss/agent/state/StateUpdateHelpers.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <future>
+#include <mutex>
+
+using namespace facebook::fboss;
+using ::testing::_;
+using ::testing::Return;
+using ::testing::Throw;
+using folly::make_unique;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+DECLARE_int32(state_update_pipeline_depth);
+
+namespace {
+
+// Records the order in which updates are applied
+class UpdateLog {
+ public:
+  SwSwitch::StateUpdateFn record(const string& name) {
+    return [this, name](const shared_ptr<SwitchState>&) {
+      std::lock_guard<std::mutex> g(lock_);
+      names_.push_back(name);
+      return shared_ptr<SwitchState>();
+    };
+  }
+
+  vector<string> getNames() {
+    std::lock_guard<std::mutex> g(lock_);
+    return names_;
+  }
+
+ private:
+  std::mutex lock_;
+  vector<string> names_;
+};
+
+// Hold up the update thread until the returned promise is fulfilled, so
+// that the updates scheduled in the meantime are pending together.
+std::shared_ptr<std::promise<void>> blockUpdates(SwSwitch* sw) {
+  auto started = std::make_shared<std::promise<void>>();
+  auto release = std::make_shared<std::promise<void>>();
+  auto blockFn = [started, release](const shared_ptr<SwitchState>&) {
+    started->set_value();
+    release->get_future().wait();
+    return shared_ptr<SwitchState>();
+  };
+  sw->updateState("block updates", blockFn);
+  started->get_future().wait();
+  return release;
+}
+
+// Schedule an update that adds a second to the ARP timeout, as a batch of
+// its own, and count its failures
+void addArpSecond(SwSwitch* sw, std::atomic<int>* failures) {
+  auto fn = [](const shared_ptr<SwitchState>& state) {
+    auto newState = state->clone();
+    newState->setArpTimeout(state->getArpTimeout() + std::chrono::seconds(1));
+    return newState;
+  };
+  auto done = [failures](const std::exception_ptr& ex) {
+    if (ex) {
+      ++*failures;
+    }
+  };
+  auto update = make_unique<CallbackStateUpdate>("add arp second", fn, done);
+  update->setEndsBatch(true);
+  sw->updateState(std::move(update));
+}
+
+struct ComposedCalls {
+  std::atomic<int> calls{0};
+  std::atomic<int> published{0};
+  std::atomic<int> failures{0};
+};
+
+// Schedule a composable update that adds a second to the ARP timeout in
+// place.  If fail is set, it changes the state and then throws.
+void addArpSecondComposed(SwSwitch* sw, ComposedCalls* calls,
+                          bool fail = false) {
+  auto fn = [calls, fail](const shared_ptr<SwitchState>& state) {
+    ++calls->calls;
+    if (state->isPublished()) {
+      ++calls->published;
+    }
+    auto newState = state;
+    SwitchState::modify(&newState);
+    newState->setArpTimeout(state->getArpTimeout() + std::chrono::seconds(1));
+    if (fail) {
+      throw FbossError("failed part way");
+    }
+    return newState;
+  };
+  auto done = [calls](const std::exception_ptr& ex) {
+    if (ex) {
+      ++calls->failures;
+    }
+  };
+  auto update = make_unique<CallbackStateUpdate>("composed", fn, done);
+  update->setComposable(true);
+  sw->updateState(std::move(update));
+}
+
+} // unnamed namespace
+
+TEST(StateUpdatePriority, PriorityOrder) {
+  auto sw = createMockSw(testStateA());
+  UpdateLog log;
+
+  auto release = blockUpdates(sw.get());
+  sw->updateState("housekeeping", log.record("housekeeping"),
+                  StateUpdatePriority::HOUSEKEEPING);
+  sw->updateState("config", log.record("config"));
+  sw->updateState("route1", log.record("route1"),
+                  StateUpdatePriority::ROUTE);
+  sw->updateState("neighbor", log.record("neighbor"),
+                  StateUpdatePriority::NEIGHBOR);
+  sw->updateState("route2", log.record("route2"),
+                  StateUpdatePriority::ROUTE);
+  release->set_value();
+  waitForStateUpdates(sw.get());
+
+  vector<string> expected{
+    "neighbor", "route1", "route2", "config", "housekeeping"};
+  EXPECT_EQ(expected, log.getNames());
+}
+
+TEST(StateUpdatePriority, EndsBatch) {
+  auto sw = createMockSw(testStateA());
+  UpdateLog log;
+
+  // The first chunk schedules a neighbor update while it is being applied,
+  // which gets in before the second chunk since the first ends its batch.
+  auto* swPtr = sw.get();
+  auto chunk1Fn = [&log, swPtr](const shared_ptr<SwitchState>& state) {
+    swPtr->updateState("neighbor", log.record("neighbor"),
+                       StateUpdatePriority::NEIGHBOR);
+    return log.record("chunk1")(state);
+  };
+
+  auto release = blockUpdates(sw.get());
+  auto chunk1 = make_unique<FunctionStateUpdate>(
+      "chunk1", chunk1Fn, StateUpdatePriority::ROUTE);
+  chunk1->setEndsBatch(true);
+  sw->updateState(std::move(chunk1));
+  sw->updateState("chunk2", log.record("chunk2"),
+                  StateUpdatePriority::ROUTE);
+  release->set_value();
+  waitForStateUpdates(sw.get());
+
+  vector<string> expected{"chunk1", "neighbor", "chunk2"};
+  EXPECT_EQ(expected, log.getNames());
+}
+
+TEST(StateUpdatePriority, Pipelined) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_state_update_pipeline_depth = 1;
+  auto sw = createMockSw(testStateA());
+  auto arpTimeout = sw->getState()->getArpTimeout();
+  std::atomic<int> failures{0};
+
+  // Each batch is prepared on top of the one before it, even while that
+  // one is still being programmed
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(4);
+  for (int i = 0; i < 4; ++i) {
+    addArpSecond(sw.get(), &failures);
+  }
+  waitForStateUpdates(sw.get());
+  EXPECT_EQ(0, failures);
+  EXPECT_EQ(arpTimeout + std::chrono::seconds(4),
+            sw->getState()->getArpTimeout());
+}
+
+TEST(StateUpdatePriority, PipelinedRollback) {
+  gflags::FlagSaver flagSaver;
+  FLAGS_state_update_pipeline_depth = 1;
+  auto sw = createMockSw(testStateA());
+  auto arpTimeout = sw->getState()->getArpTimeout();
+  std::atomic<int> failures{0};
+
+  // The first batch is rolled back by the hardware, and the ones prepared
+  // on top of it are prepared again from the old state
+  EXPECT_HW_CALL(sw, stateChanged(_))
+    .WillOnce(Throw(FbossHwRolledBackError("rolled back")))
+    .WillRepeatedly(Return());
+  auto release = blockUpdates(sw.get());
+  for (int i = 0; i < 4; ++i) {
+    addArpSecond(sw.get(), &failures);
+  }
+  release->set_value();
+  waitForStateUpdates(sw.get());
+  EXPECT_EQ(1, failures);
+  EXPECT_EQ(arpTimeout + std::chrono::seconds(3),
+            sw->getState()->getArpTimeout());
+}
+
+TEST(StateUpdatePriority, Composed) {
+  auto sw = createMockSw(testStateA());
+  auto arpTimeout = sw->getState()->getArpTimeout();
+  ComposedCalls calls;
+
+  // Only the first update of the run is given a published state; the
+  // others change its copy in place
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  auto release = blockUpdates(sw.get());
+  for (int i = 0; i < 3; ++i) {
+    addArpSecondComposed(sw.get(), &calls);
+  }
+  release->set_value();
+  waitForStateUpdates(sw.get());
+  EXPECT_EQ(3, calls.calls);
+  EXPECT_EQ(1, calls.published);
+  EXPECT_EQ(0, calls.failures);
+  EXPECT_TRUE(sw->getState()->isPublished());
+  EXPECT_EQ(arpTimeout + std::chrono::seconds(3),
+            sw->getState()->getArpTimeout());
+}
+
+TEST(StateUpdatePriority, ComposedFailure) {
+  auto sw = createMockSw(testStateA());
+  auto arpTimeout = sw->getState()->getArpTimeout();
+  ComposedCalls calls;
+
+  // The failed update leaves its change in the working copy, so the two
+  // updates before it are applied again to the published state, and the
+  // one after it goes on top of that
+  EXPECT_HW_CALL(sw, stateChanged(_)).Times(1);
+  auto release = blockUpdates(sw.get());
+  addArpSecondComposed(sw.get(), &calls);
+  addArpSecondComposed(sw.get(), &calls);
+  addArpSecondComposed(sw.get(), &calls, true);
+  addArpSecondComposed(sw.get(), &calls);
+  release->set_value();
+  waitForStateUpdates(sw.get());
+  EXPECT_EQ(6, calls.calls);
+  EXPECT_EQ(1, calls.failures);
+  EXPECT_EQ(arpTimeout + std::chrono::seconds(3),
+            sw->getState()->getArpTimeout());
+}
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/StateUpdateProfile.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::chrono::microseconds;
+
+namespace {
+
+StateUpdateProfile makeProfile(int64_t generation, int64_t totalUs) {
+  StateUpdateProfile profile;
+  profile.names.push_back("test update");
+  profile.numUpdates = 1;
+  profile.generation = generation;
+  profile.total = microseconds(totalUs);
+  profile.addStage(StateUpdateStage::HW, microseconds(totalUs));
+  return profile;
+}
+
+} // unnamed namespace
+
+TEST(StateUpdateProfile, Name) {
+  StateUpdateProfile profile;
+  EXPECT_EQ("", profile.getName());
+  profile.names.push_back("add ARP entry");
+  EXPECT_EQ("add ARP entry", profile.getName());
+  profile.names.push_back("add unicast route");
+  EXPECT_EQ("coalesced", profile.getName());
+}
+
+TEST(StateUpdateProfile, Stages) {
+  StateUpdateProfile profile;
+  profile.addStage(StateUpdateStage::PREPARE, microseconds(10));
+  profile.addStage(StateUpdateStage::PREPARE, microseconds(5));
+  EXPECT_EQ(microseconds(15), profile.getStage(StateUpdateStage::PREPARE));
+  EXPECT_EQ(microseconds(0), profile.getStage(StateUpdateStage::HW));
+  EXPECT_STREQ("hw_lock", getStateUpdateStageName(StateUpdateStage::HW_LOCK));
+}
+
+TEST(StateUpdateHistory, Slowest) {
+  StateUpdateHistory history(3);
+  EXPECT_TRUE(history.getSlowest(10).empty());
+
+  history.record(makeProfile(1, 100));
+  history.record(makeProfile(2, 300));
+  history.record(makeProfile(3, 200));
+  auto slowest = history.getSlowest(2);
+  ASSERT_EQ(2, slowest.size());
+  EXPECT_EQ(2, slowest[0].generation);
+  EXPECT_EQ(3, slowest[1].generation);
+  EXPECT_EQ(microseconds(300), slowest[0].getStage(StateUpdateStage::HW));
+
+  // Only the most recent updates are kept
+  history.record(makeProfile(4, 50));
+  history.record(makeProfile(5, 60));
+  slowest = history.getSlowest(10);
+  ASSERT_EQ(3, slowest.size());
+  EXPECT_EQ(3, slowest[0].generation);
+  EXPECT_EQ(5, slowest[1].generation);
+  EXPECT_EQ(4, slowest[2].generation);
+}
+
+TEST(StateUpdateHistory, Disabled) {
+  StateUpdateHistory history(0);
+  history.record(makeProfile(1, 100));
+  EXPECT_TRUE(history.getSlowest(10).empty());
+}
@@ -0,0 +1,307 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/IPAddressV4.h>
+#include <folly/IPAddressV6.h>
+#include <folly/MacAddress.h>
+#include <gflags/gflags.h>
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/NdpTable.h"
+#include "fboss/agent/state/NodeBase-defs.h"
+#include "fboss/agent/state/NodeMap-defs.h"
+#include "fboss/agent/state/PortMap.h"
+#include "fboss/agent/state/Route.h"
+#include "fboss/agent/state/RouteTable.h"
+#include "fboss/agent/state/RouteTableRib.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ * Measure what clone(), publish(), toFollyDynamic() and fromFollyDynamic()
+ * cost for each type of node in a large synthetic SwitchState, so that
+ * changes to NodeMapT, Route and the neighbor tables can be compared
+ * against a baseline.
+ *
+ * The report printed before the benchmarks gives the time, the number of
+ * heap allocations and the bytes allocated per operation on each node
+ * type.  The allocations are counted by replacing the global operator new
+ * in this binary.  clone() of a published node is shallow, as it is when
+ * the state is updated, so publish() is measured on the unpublished copy
+ * returned by fromFollyDynamic(), which publishes every node under it.
+ */
+
+DEFINE_int32(switch_state_ports, 64, "The number of ports in the state");
+DEFINE_int32(switch_state_vlans, 16,
+             "The number of VLANs, which the ports are spread across");
+DEFINE_int32(switch_state_neighbors, 4000,
+             "The number of ARP and of NDP entries, spread across the VLANs");
+DEFINE_int32(switch_state_routes, 100000,
+             "The number of IPv4 and of IPv6 routes in the RIB");
+DEFINE_int32(switch_state_reps, 10,
+             "The number of times each operation is run for the report");
+
+namespace {
+
+std::atomic<uint64_t> numAllocs{0};
+std::atomic<uint64_t> allocBytes{0};
+
+} // unnamed namespace
+
+void* operator new(size_t size) {
+  numAllocs.fetch_add(1, std::memory_order_relaxed);
+  allocBytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* ptr = malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using folly::MacAddress;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace {
+
+const ClientID kClient(1);
+const AdminDistance kDistance(20);
+const RouterID kRouter(0);
+
+uint32_t flagCount(int32_t value) {
+  return std::max(0, value);
+}
+
+// The address with n in the 4 bytes at offset, added to base
+IPAddressV6 v6Address(const char* base, size_t offset, uint32_t n) {
+  auto bytes = IPAddressV6(base).toByteArray();
+  bytes[offset] = n >> 24;
+  bytes[offset + 1] = n >> 16;
+  bytes[offset + 2] = n >> 8;
+  bytes[offset + 3] = n;
+  return IPAddressV6::fromBinary(folly::ByteRange(bytes.data(),
+                                                  bytes.size()));
+}
+
+template<typename AddrT>
+void addRoute(RouteTableRib<AddrT>* rib, RoutePrefix<AddrT> prefix,
+              const RouteNextHops& nexthops,
+              const RouteForwardNexthops& fwd) {
+  auto route = make_shared<Route<AddrT>>(
+      prefix, kClient, RouteNextHopEntry(nexthops, kDistance));
+  route->setResolved(fwd);
+  rib->addRoute(route);
+}
+
+shared_ptr<SwitchState> makeState() {
+  auto state = make_shared<SwitchState>();
+  uint32_t numVlans = std::max(1u, flagCount(FLAGS_switch_state_vlans));
+  std::vector<shared_ptr<Vlan>> vlans;
+  for (uint32_t v = 1; v <= numVlans; ++v) {
+    vlans.push_back(make_shared<Vlan>(VlanID(v),
+                                      folly::to<std::string>("vlan", v)));
+    vlans.back()->setArpTable(make_shared<ArpTable>());
+    vlans.back()->setNdpTable(make_shared<NdpTable>());
+    state->addVlan(vlans.back());
+  }
+  for (uint32_t p = 1; p <= flagCount(FLAGS_switch_state_ports); ++p) {
+    state->registerPort(PortID(p), folly::to<std::string>("port", p));
+    vlans[p % numVlans]->addPort(PortID(p), false);
+  }
+
+  MacAddress mac("02:00:00:00:00:01");
+  for (uint32_t n = 0; n < flagCount(FLAGS_switch_state_neighbors); ++n) {
+    const auto& vlan = vlans[n % numVlans];
+    PortID port(1 + n % std::max(1u, flagCount(FLAGS_switch_state_ports)));
+    InterfaceID intf(1 + n % numVlans);
+    vlan->getArpTable()->addEntry(IPAddressV4::fromLongHBO(0x0a000000 + n),
+                                  mac, port, intf);
+    vlan->getNdpTable()->addEntry(v6Address("2401:db00::", 12, n),
+                                  mac, port, intf);
+  }
+
+  // The routes share a handful of ECMP groups, as they would in a fabric
+  RouteNextHops nexthops;
+  RouteForwardNexthops fwd;
+  for (uint32_t n = 1; n <= 4; ++n) {
+    IPAddress nhop(v6Address("2401:db01::", 12, n));
+    nexthops.insert(nhop);
+    fwd.emplace(InterfaceID(n), nhop);
+  }
+  auto ribV4 = make_shared<RouteTable::RibTypeV4>();
+  auto ribV6 = make_shared<RouteTable::RibTypeV6>();
+  for (uint32_t n = 0; n < flagCount(FLAGS_switch_state_routes); ++n) {
+    addRoute(ribV4.get(),
+             RoutePrefixV4{IPAddressV4::fromLongHBO(0x0b000000 + (n << 8)),
+                           24},
+             nexthops, fwd);
+    addRoute(ribV6.get(), RoutePrefixV6{v6Address("2401:db10::", 4, n), 64},
+             nexthops, fwd);
+  }
+  auto routeTable = make_shared<RouteTable>(kRouter);
+  routeTable->setRib(ribV4);
+  routeTable->setRib(ribV6);
+  state->addRouteTable(routeTable);
+
+  state->publish();
+  return state;
+}
+
+const shared_ptr<SwitchState>& getState() {
+  static auto state = makeState();
+  return state;
+}
+
+struct OpCost {
+  double nsec{0};
+  double allocs{0};
+  double bytes{0};
+};
+
+/*
+ * Run op FLAGS_switch_state_reps times and return its average cost.  Each
+ * run gets its input from setup(), which is not counted, and the result of
+ * op is freed after the measurement.
+ */
+template<typename SetupFn, typename Op>
+OpCost measure(SetupFn setup, Op op) {
+  OpCost cost;
+  uint32_t reps = std::max(1u, flagCount(FLAGS_switch_state_reps));
+  for (uint32_t rep = 0; rep < reps; ++rep) {
+    auto input = setup();
+    auto allocs = numAllocs.load();
+    auto bytes = allocBytes.load();
+    auto start = std::chrono::steady_clock::now();
+    auto result = op(input);
+    auto end = std::chrono::steady_clock::now();
+    cost.allocs += numAllocs.load() - allocs;
+    cost.bytes += allocBytes.load() - bytes;
+    cost.nsec += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count();
+    folly::doNotOptimizeAway(result);
+  }
+  cost.nsec /= reps;
+  cost.allocs /= reps;
+  cost.bytes /= reps;
+  return cost;
+}
+
+void printCost(const char* type, size_t numNodes, const char* opName,
+               const OpCost& cost) {
+  printf("%-14s %8zu  %-16s %12.0f %10.0f %12.0f\n", type, numNodes, opName,
+         cost.nsec, cost.allocs, cost.bytes);
+}
+
+template<typename NodeT>
+void report(const char* type, size_t numNodes,
+            const shared_ptr<NodeT>& node) {
+  auto json = node->toFollyDynamic();
+  auto none = [] { return 0; };
+
+  printCost(type, numNodes, "clone", measure(none, [&](int) {
+    return node->clone();
+  }));
+  printCost(type, numNodes, "publish", measure(
+      [&] { return NodeT::fromFollyDynamic(json); },
+      [](const shared_ptr<NodeT>& copy) -> bool {
+        copy->publish();
+        return copy->isPublished();
+      }));
+  printCost(type, numNodes, "toFollyDynamic", measure(none, [&](int) {
+    return node->toFollyDynamic();
+  }));
+  printCost(type, numNodes, "fromFollyDynamic", measure(none, [&](int) {
+    return NodeT::fromFollyDynamic(json);
+  }));
+}
+
+void printReport() {
+  const auto& state = getState();
+  auto vlan = *state->getVlans()->begin();
+  const auto& routeTable = state->getRouteTables()->getRouteTable(kRouter);
+
+  printf("%-14s %8s  %-16s %12s %10s %12s\n", "node", "children", "op",
+         "ns", "allocs", "bytes");
+  report("SwitchState", 1, state);
+  report("PortMap", state->getPorts()->size(), state->getPorts());
+  report("VlanMap", state->getVlans()->size(), state->getVlans());
+  report("ArpTable", vlan->getArpTable()->size(), vlan->getArpTable());
+  report("NdpTable", vlan->getNdpTable()->size(), vlan->getNdpTable());
+  report("RibV4", routeTable->getRibV4()->size(), routeTable->getRibV4());
+  report("RibV6", routeTable->getRibV6()->size(), routeTable->getRibV6());
+}
+
+} // unnamed namespace
+
+BENCHMARK(cloneState, numIters) {
+  const auto& state = getState();
+  for (size_t n = 0; n < numIters; ++n) {
+    folly::doNotOptimizeAway(state->clone());
+  }
+}
+
+BENCHMARK(publishState, numIters) {
+  folly::dynamic json = nullptr;
+  BENCHMARK_SUSPEND {
+    json = getState()->toFollyDynamic();
+  }
+  for (size_t n = 0; n < numIters; ++n) {
+    shared_ptr<SwitchState> copy;
+    BENCHMARK_SUSPEND {
+      copy = SwitchState::fromFollyDynamic(json);
+    }
+    copy->publish();
+    // Freeing the copy is not part of publishing it
+    BENCHMARK_SUSPEND {
+      copy.reset();
+    }
+  }
+}
+
+BENCHMARK(serializeState, numIters) {
+  const auto& state = getState();
+  for (size_t n = 0; n < numIters; ++n) {
+    folly::doNotOptimizeAway(state->toFollyDynamic());
+  }
+}
+
+BENCHMARK(deserializeState, numIters) {
+  folly::dynamic json = nullptr;
+  BENCHMARK_SUSPEND {
+    json = getState()->toFollyDynamic();
+  }
+  for (size_t n = 0; n < numIters; ++n) {
+    folly::doNotOptimizeAway(SwitchState::fromFollyDynamic(json));
+  }
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  printReport();
+  folly::runBenchmarks();
+  return 0;
+}
@@ -120,13 +120,14 @@ MockPlatform* getMockPlatform(SwSwitch* sw) {
 
 void waitForStateUpdates(SwSwitch* sw) {
   // All StateUpdates scheduled from this thread will be applied in order,
-  // so we can simply perform a blocking no-op update.  When it is done
-  // we can be sure that all previously scheduled updates have also been
-  // applied.
+  // within each priority class, so we can simply perform a blocking no-op
+  // update of the lowest priority.  When it is done we can be sure that all
+  // previously scheduled updates have also been applied.
   auto noopUpdate = [](const shared_ptr<SwitchState>& state) {
     return shared_ptr<SwitchState>();
   };
-  sw->updateStateBlocking("waitForStateUpdates", noopUpdate);
+  sw->updateStateBlocking("waitForStateUpdates", noopUpdate,
+                          StateUpdatePriority::HOUSEKEEPING);
 }
 
 
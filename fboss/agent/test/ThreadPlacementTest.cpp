@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThreadPlacement.h"
+
+#include "fboss/agent/FbossError.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::vector;
+
+TEST(ThreadPlacement, parse) {
+  auto placements = ThreadPlacement::parse(
+      "fbossUpdateThread:cpus=2-3,5:nice=-5; sdk_rx:cpus=1:fifo=10;"
+      "rxDispatch*:rr=1");
+  ASSERT_EQ(3, placements.size());
+
+  EXPECT_EQ("fbossUpdateThread", placements[0].name);
+  EXPECT_EQ(vector<int>({2, 3, 5}), placements[0].cpus);
+  EXPECT_TRUE(placements[0].setNice);
+  EXPECT_EQ(-5, placements[0].nice);
+  EXPECT_EQ(SCHED_OTHER, placements[0].policy);
+
+  EXPECT_EQ("sdk_rx", placements[1].name);
+  EXPECT_EQ(vector<int>({1}), placements[1].cpus);
+  EXPECT_FALSE(placements[1].setNice);
+  EXPECT_EQ(SCHED_FIFO, placements[1].policy);
+  EXPECT_EQ(10, placements[1].priority);
+
+  EXPECT_TRUE(placements[2].cpus.empty());
+  EXPECT_EQ(SCHED_RR, placements[2].policy);
+
+  EXPECT_TRUE(ThreadPlacement::parse("").empty());
+}
+
+TEST(ThreadPlacement, parseErrors) {
+  EXPECT_THROW(ThreadPlacement::parse("fbossBgThread"), FbossError);
+  EXPECT_THROW(ThreadPlacement::parse("fbossBgThread:cpus"), FbossError);
+  EXPECT_THROW(ThreadPlacement::parse("fbossBgThread:cpus=3-1"), FbossError);
+  EXPECT_THROW(ThreadPlacement::parse("fbossBgThread:cpus=x"), FbossError);
+  EXPECT_THROW(ThreadPlacement::parse("fbossBgThread:nice=20"), FbossError);
+  EXPECT_THROW(ThreadPlacement::parse("fbossBgThread:fifo=0"), FbossError);
+  EXPECT_THROW(ThreadPlacement::parse("fbossBgThread:mem=1"), FbossError);
+}
+
+TEST(ThreadPlacement, find) {
+  auto placements = ThreadPlacement::parse(
+      "fbossBgThread:cpus=0;rxDispatch*:cpus=1;rxDispatchHigh:cpus=2");
+  EXPECT_EQ(&placements[0],
+            ThreadPlacement::find(placements, "fbossBgThread"));
+  EXPECT_EQ(nullptr, ThreadPlacement::find(placements, "fbossBg"));
+  // The first match wins
+  EXPECT_EQ(&placements[1],
+            ThreadPlacement::find(placements, "rxDispatchHigh"));
+  EXPECT_EQ(&placements[1], ThreadPlacement::find(placements, "rxDispatch"));
+  EXPECT_EQ(nullptr, ThreadPlacement::find(placements, "sdk_rx"));
+}
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThreadSampler.h"
+
+#include <gtest/gtest.h>
+#include <time.h>
+
+using namespace facebook::fboss;
+using std::chrono::milliseconds;
+
+namespace {
+
+// Use up CPU on the calling thread, so its clock moves
+void spin(milliseconds duration) {
+  struct timespec start;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  while (true) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    auto elapsedNs = (now.tv_sec - start.tv_sec) * 1000000000L +
+      (now.tv_nsec - start.tv_nsec);
+    if (elapsedNs >= milliseconds(duration).count() * 1000000L) {
+      return;
+    }
+  }
+}
+
+} // unnamed namespace
+
+TEST(ThreadSampler, Intern) {
+  auto a = ThreadSampler::intern("update.Add Neighbor");
+  EXPECT_EQ("update_add_neighbor", *a);
+  EXPECT_EQ(a, ThreadSampler::intern("update.add neighbor"));
+  EXPECT_NE(a, ThreadSampler::intern("rx.arp"));
+}
+
+TEST(ThreadSampler, ChargesActivity) {
+  ThreadSampler sampler(milliseconds(10));
+  std::thread worker([&] {
+    ThreadSampler::registerThread("worker");
+    auto arp = ThreadSampler::intern("rx.arp");
+    auto ndp = ThreadSampler::intern("rx.ndp");
+    {
+      ThreadSampler::Scope scope(arp);
+      spin(milliseconds(20));
+      sampler.sample();
+      {
+        // Nested scopes restore the outer activity when they end
+        ThreadSampler::Scope inner(ndp);
+        spin(milliseconds(20));
+        sampler.sample();
+      }
+      spin(milliseconds(20));
+      sampler.sample();
+    }
+    spin(milliseconds(20));
+    sampler.sample();
+  });
+  worker.join();
+
+  auto totals = sampler.getTotals();
+  auto arpTotal = totals[std::make_pair("worker", "rx_arp")];
+  auto ndpTotal = totals[std::make_pair("worker", "rx_ndp")];
+  auto otherTotal = totals[std::make_pair("worker", "unattributed")];
+  EXPECT_EQ(2, arpTotal.samples);
+  EXPECT_EQ(1, ndpTotal.samples);
+  EXPECT_EQ(1, otherTotal.samples);
+  EXPECT_GE(arpTotal.cpu, milliseconds(40));
+  EXPECT_GE(ndpTotal.cpu, milliseconds(20));
+  EXPECT_GE(otherTotal.cpu, milliseconds(20));
+}
+
+TEST(ThreadSampler, UnregisteredThread) {
+  ThreadSampler sampler(milliseconds(10));
+  std::thread worker([&] {
+    // Scopes on threads that are not registered do nothing
+    ThreadSampler::Scope scope(ThreadSampler::intern("rx.lldp"));
+    sampler.sample();
+  });
+  worker.join();
+  for (const auto& entry : sampler.getTotals()) {
+    EXPECT_NE("rx_lldp", entry.first.second);
+  }
+}
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThriftResponseCache.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+
+TEST(ThriftResponseCache, generations) {
+  ThriftResponseCache<int> cache(10);
+  int response = 0;
+  EXPECT_FALSE(cache.get(1, "a", &response));
+
+  cache.put(1, "a", 11);
+  cache.put(1, "b", 12);
+  EXPECT_TRUE(cache.get(1, "a", &response));
+  EXPECT_EQ(11, response);
+  EXPECT_TRUE(cache.get(1, "b", &response));
+  EXPECT_EQ(12, response);
+
+  // A newer generation empties the cache
+  EXPECT_FALSE(cache.get(2, "a", &response));
+  cache.put(2, "a", 21);
+  EXPECT_TRUE(cache.get(2, "a", &response));
+  EXPECT_EQ(21, response);
+
+  // Responses built from an older state are not cached or returned
+  cache.put(1, "b", 12);
+  EXPECT_FALSE(cache.get(2, "b", &response));
+  EXPECT_FALSE(cache.get(1, "a", &response));
+}
+
+TEST(ThriftResponseCache, maxEntries) {
+  ThriftResponseCache<int> cache(2);
+  int response = 0;
+  cache.put(1, "a", 1);
+  cache.put(1, "b", 2);
+  // The cache is full, so it starts over
+  cache.put(1, "c", 3);
+  EXPECT_FALSE(cache.get(1, "a", &response));
+  EXPECT_TRUE(cache.get(1, "c", &response));
+  EXPECT_EQ(3, response);
+
+  ThriftResponseCache<int> disabled(0);
+  disabled.put(1, "a", 1);
+  EXPECT_FALSE(disabled.get(1, "a", &response));
+}
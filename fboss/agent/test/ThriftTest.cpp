@@ -10,6 +10,10 @@
 #include "fboss/agent/AddressUtil.h"
 #include "fboss/agent/SwSwitch.h"
 #include "fboss/agent/ThriftHandler.h"
+#include "fboss/agent/state/ArpTable.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/state/Vlan.h"
+#include "fboss/agent/state/VlanMap.h"
 #include "fboss/agent/test/TestUtils.h"
 
 #include <folly/IPAddress.h>
@@ -17,15 +21,19 @@
 
 using namespace facebook::fboss;
 using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::MacAddress;
 using folly::StringPiece;
 using std::unique_ptr;
 using testing::UnorderedElementsAreArray;
+using facebook::network::toAddress;
 using facebook::network::toBinaryAddress;
+using facebook::network::toIPAddress;
 
 namespace {
 
-unique_ptr<SwSwitch> setupSwitch() {
-  auto state = testStateA();
+unique_ptr<SwSwitch> setupSwitch(
+    std::shared_ptr<SwitchState> state = testStateA()) {
   auto sw = createMockSw(state);
   sw->initialConfigApplied();
   return sw;
@@ -76,3 +84,91 @@ TEST(ThriftTest, getInterfaceDetail) {
   // interface should throw an FbossError.
   EXPECT_THROW(handler.getInterfaceDetail(info, 123), FbossError);
 }
+
+TEST(ThriftTest, getIpRoutes) {
+  auto sw = setupSwitch();
+  ThriftHandler handler(sw.get());
+
+  auto addrs = folly::make_unique<std::vector<ThriftHandler::Address>>();
+  addrs->push_back(toAddress(IPAddress("10.0.0.5")));
+  addrs->push_back(toAddress(IPAddress("2401:db00:2110:3055::5")));
+  addrs->push_back(toAddress(IPAddress("8.8.8.8")));
+  std::vector<UnicastRoute> routes;
+  handler.getIpRoutes(routes, std::move(addrs), 0);
+  ASSERT_EQ(3, routes.size());
+  EXPECT_EQ(ipPrefix("10.0.0.0", 24), routes[0].dest);
+  EXPECT_EQ(ipPrefix("2401:db00:2110:3055::", 64), routes[1].dest);
+  // No route matches, not even a default route
+  EXPECT_EQ(ipPrefix("0.0.0.0", 0), routes[2].dest);
+  EXPECT_TRUE(routes[2].nextHopAddrs.empty());
+
+  addrs = folly::make_unique<std::vector<ThriftHandler::Address>>();
+  EXPECT_THROW(handler.getIpRoutes(routes, std::move(addrs), 123),
+               FbossError);
+}
+
+TEST(ThriftTest, getArpTablePage) {
+  auto state = testStateA();
+  auto arp = std::make_shared<ArpTable>();
+  MacAddress mac("00:02:00:00:00:02");
+  arp->addEntry(IPAddressV4("10.0.0.2"), mac, PortID(1), InterfaceID(1));
+  arp->addEntry(IPAddressV4("10.0.0.3"), mac, PortID(2), InterfaceID(1));
+  arp->addEntry(IPAddressV4("192.168.0.2"), mac, PortID(1), InterfaceID(1));
+  arp->addPendingEntry(IPAddressV4("10.0.0.4"), InterfaceID(1));
+  state->getVlans()->getVlan(VlanID(1))->setArpTable(arp);
+  auto sw = setupSwitch(state);
+  ThriftHandler handler(sw.get());
+
+  auto getPage = [&](const NeighborQuery& query,
+                     const NeighborCursor& cursor, int32_t maxEntries) {
+    ArpTablePage page;
+    handler.getArpTablePage(page, folly::make_unique<NeighborQuery>(query),
+                            folly::make_unique<NeighborCursor>(cursor),
+                            maxEntries);
+    return page;
+  };
+  auto ip = [](const ArpEntryThrift& entry) {
+    return toIPAddress(entry.ip).str();
+  };
+
+  // Page through the reachable entries, two at a time
+  NeighborQuery query;
+  query.state = NeighborStateFilter::REACHABLE;
+  auto page = getPage(query, NeighborCursor(), 2);
+  ASSERT_EQ(2, page.entries.size());
+  EXPECT_EQ("10.0.0.2", ip(page.entries[0]));
+  EXPECT_EQ("10.0.0.3", ip(page.entries[1]));
+  ASSERT_TRUE(page.__isset.next);
+  EXPECT_EQ(1, page.next.vlanId);
+  auto last = getPage(query, page.next, 2);
+  ASSERT_EQ(1, last.entries.size());
+  EXPECT_EQ("192.168.0.2", ip(last.entries[0]));
+  EXPECT_FALSE(last.__isset.next);
+  EXPECT_EQ(page.generation, last.generation);
+
+  // The same query is answered the same from the cache
+  auto cached = getPage(query, NeighborCursor(), 2);
+  EXPECT_EQ(page, cached);
+
+  // Filter by port and prefix
+  query.__isset.port = true;
+  query.port = 1;
+  query.__isset.prefix = true;
+  query.prefix = ipPrefix("10.0.0.0", 24);
+  page = getPage(query, NeighborCursor(), 10);
+  ASSERT_EQ(1, page.entries.size());
+  EXPECT_EQ("10.0.0.2", ip(page.entries[0]));
+
+  NeighborQuery pending;
+  pending.state = NeighborStateFilter::PENDING;
+  page = getPage(pending, NeighborCursor(), 10);
+  ASSERT_EQ(1, page.entries.size());
+  EXPECT_EQ("10.0.0.4", ip(page.entries[0]));
+
+  NeighborQuery otherVlan;
+  otherVlan.__isset.vlanId = true;
+  otherVlan.vlanId = 55;
+  EXPECT_TRUE(getPage(otherVlan, NeighborCursor(), 10).entries.empty());
+
+  EXPECT_THROW(getPage(NeighborQuery(), NeighborCursor(), 0), FbossError);
+}
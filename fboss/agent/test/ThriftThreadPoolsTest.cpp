@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/ThriftThreadPools.h"
+
+#include "thrift/lib/cpp/concurrency/FunctionRunner.h"
+
+#include <folly/Baton.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+DECLARE_int32(thrift_update_threads);
+DECLARE_int32(thrift_query_threads);
+
+using namespace facebook::fboss;
+using apache::thrift::concurrency::FunctionRunner;
+namespace concurrency = apache::thrift::concurrency;
+
+TEST(ThriftThreadPools, Sizes) {
+  FLAGS_thrift_update_threads = 2;
+  FLAGS_thrift_query_threads = 3;
+  ThriftThreadPools pools;
+  pools.start();
+  auto tm = pools.getThreadManager();
+  EXPECT_EQ(2, tm->workerCount(concurrency::HIGH));
+  EXPECT_EQ(3, tm->workerCount(concurrency::NORMAL));
+  EXPECT_EQ(1, tm->workerCount(concurrency::BEST_EFFORT));
+  EXPECT_STREQ("update", ThriftThreadPools::getPoolName(concurrency::HIGH));
+  EXPECT_STREQ("query", ThriftThreadPools::getPoolName(concurrency::NORMAL));
+  pools.stop();
+}
+
+TEST(ThriftThreadPools, UpdatesDontWaitForQueries) {
+  FLAGS_thrift_update_threads = 1;
+  FLAGS_thrift_query_threads = 1;
+  ThriftThreadPools pools;
+  pools.start();
+  auto tm = pools.getThreadManager();
+
+  // Tie up the query pool, and queue another query behind it
+  folly::Baton<> queryStarted;
+  folly::Baton<> releaseQuery;
+  std::atomic<int> queriesDone{0};
+  tm->add(concurrency::NORMAL, FunctionRunner::create([&] {
+    queryStarted.post();
+    releaseQuery.wait();
+    ++queriesDone;
+  }));
+  folly::Baton<> queriesFinished;
+  tm->add(concurrency::NORMAL, FunctionRunner::create([&] {
+    ++queriesDone;
+    queriesFinished.post();
+  }));
+  queryStarted.wait();
+  EXPECT_EQ(1, tm->pendingTaskCount(concurrency::NORMAL));
+
+  // The update still runs right away
+  folly::Baton<> updateDone;
+  tm->add(concurrency::HIGH, FunctionRunner::create([&] {
+    updateDone.post();
+  }));
+  updateDone.wait();
+  EXPECT_EQ(0, queriesDone.load());
+
+  releaseQuery.post();
+  queriesFinished.wait();
+  EXPECT_EQ(2, queriesDone.load());
+  pools.stop();
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/TimerWheel.h"
+
+#include <gtest/gtest.h>
+#include <map>
+
+using namespace facebook::fboss;
+
+namespace {
+
+// Advance one tick at a time, recording the tick each key expired at
+std::map<int, uint64_t> runUntil(TimerWheel<int>* wheel, uint64_t toTick) {
+  std::map<int, uint64_t> expired;
+  while (wheel->getCurrentTick() < toTick) {
+    auto tick = wheel->getCurrentTick() + 1;
+    wheel->advance(tick, [&](int key) {
+      EXPECT_TRUE(expired.emplace(key, tick).second);
+    });
+  }
+  return expired;
+}
+
+}
+
+TEST(TimerWheel, ExpiryOrder) {
+  TimerWheel<int> wheel;
+  // Keys in every level of the wheel
+  const std::vector<uint64_t> ticks = {
+    1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 300000, 16777215,
+  };
+  for (size_t i = 0; i < ticks.size(); ++i) {
+    wheel.schedule(i, ticks[i]);
+  }
+  EXPECT_EQ(ticks.size(), wheel.size());
+
+  auto expired = runUntil(&wheel, 16777215);
+  ASSERT_EQ(ticks.size(), expired.size());
+  for (size_t i = 0; i < ticks.size(); ++i) {
+    EXPECT_EQ(ticks[i], expired[i]) << "key " << i;
+  }
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheel, AdvanceInBulk) {
+  TimerWheel<int> wheel(1000);
+  wheel.schedule(1, 1010);
+  wheel.schedule(2, 5000);
+  // Ticks in the past expire on the next advance
+  wheel.schedule(3, 10);
+
+  std::vector<int> expired;
+  wheel.advance(1010, [&](int key) { expired.push_back(key); });
+  EXPECT_EQ((std::vector<int>{3, 1}), expired);
+  EXPECT_EQ(1, wheel.size());
+
+  expired.clear();
+  wheel.advance(4999, [&](int key) { expired.push_back(key); });
+  EXPECT_TRUE(expired.empty());
+  wheel.advance(5000, [&](int key) { expired.push_back(key); });
+  EXPECT_EQ((std::vector<int>{2}), expired);
+
+  // An empty wheel jumps straight to the requested tick
+  wheel.advance(1000000, [&](int key) { FAIL(); });
+  EXPECT_EQ(1000000, wheel.getCurrentTick());
+}
+
+TEST(TimerWheel, BeyondRange) {
+  TimerWheel<int> wheel;
+  uint64_t far = (uint64_t(1) << 24) * 3 + 5;
+  wheel.schedule(1, far);
+  std::vector<uint64_t> expired;
+  wheel.advance(far - 1, [&](int key) { expired.push_back(key); });
+  EXPECT_TRUE(expired.empty());
+  wheel.advance(far, [&](int key) { expired.push_back(key); });
+  EXPECT_EQ(1, expired.size());
+}
+
+TEST(TimerWheel, NextEventTick) {
+  TimerWheel<int> wheel;
+  // Keys in coarser levels need an event when their slot cascades
+  wheel.schedule(1, 100);
+  EXPECT_EQ(64, wheel.getNextEventTick());
+  wheel.schedule(2, 5);
+  EXPECT_EQ(5, wheel.getNextEventTick());
+
+  // Sleeping from one event to the next never skips an expiry
+  const std::vector<uint64_t> ticks = {
+    37, 4095, 4096, 4160, 70000, 300000, 16777215,
+  };
+  for (size_t i = 0; i < ticks.size(); ++i) {
+    wheel.schedule(i + 10, ticks[i]);
+  }
+  std::map<int, uint64_t> expired;
+  while (!wheel.empty()) {
+    auto tick = wheel.getNextEventTick();
+    wheel.advance(tick, [&](int key) { expired.emplace(key, tick); });
+  }
+  EXPECT_EQ(5, expired[2]);
+  EXPECT_EQ(100, expired[1]);
+  for (size_t i = 0; i < ticks.size(); ++i) {
+    EXPECT_EQ(ticks[i], expired[i + 10]) << "key " << i + 10;
+  }
+}
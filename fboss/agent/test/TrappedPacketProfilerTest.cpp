@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/TrappedPacketProfiler.h"
+
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+
+#include <folly/io/Cursor.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using folly::MacAddress;
+using folly::io::Cursor;
+using std::chrono::seconds;
+
+namespace {
+
+const MacAddress kSrcMac("02:00:02:01:02:03");
+
+// A packet from kSrcMac with the given ethertype and payload
+std::unique_ptr<MockRxPacket> makePkt(const std::string& hex) {
+  return MockRxPacket::fromHex(
+      // dst mac, src mac
+      "02 00 01 00 00 01  02 00 02 01 02 03" + hex);
+}
+
+// Skip the MAC addresses, and read the ethertype
+uint16_t readEthertype(Cursor* cursor) {
+  *cursor += 12;
+  return cursor->readBE<uint16_t>();
+}
+
+TrappedProto classifyHex(const std::string& hex) {
+  auto pkt = makePkt(hex);
+  Cursor c(pkt->buf());
+  auto ethertype = readEthertype(&c);
+  return TrappedPacketProfiler::classify(ethertype, c);
+}
+
+std::string ipv4Hex(const char* proto, const char* src) {
+  return std::string(
+      "08 00"
+      // Version, DSCP, length, id, fragment offset, TTL
+      "45 00 00 40  00 00 00 00  40") +
+    proto +
+    // Checksum
+    "00 00" +
+    src +
+    // Destination address
+    "0a 00 00 01";
+}
+
+void recordHex(TrappedPacketProfiler* profiler, const std::string& hex,
+               std::chrono::steady_clock::time_point now) {
+  auto pkt = makePkt(hex);
+  Cursor c(pkt->buf());
+  auto ethertype = readEthertype(&c);
+  auto proto = TrappedPacketProfiler::classify(ethertype, c);
+  profiler->recordSample(PortID(3), kSrcMac, ethertype, proto, c,
+                         pkt->getLength(), now);
+}
+
+}
+
+TEST(TrappedPacketProfiler, classify) {
+  EXPECT_EQ(TrappedProto::ARP, classifyHex("08 06  00 01 08 00 06 04 00 01"));
+  EXPECT_EQ(TrappedProto::LLDP, classifyHex("88 cc"));
+  EXPECT_EQ(TrappedProto::IPV4_TCP, classifyHex(ipv4Hex("06", "0a 00 00 02")));
+  EXPECT_EQ(TrappedProto::IPV4_UDP, classifyHex(ipv4Hex("11", "0a 00 00 02")));
+  EXPECT_EQ(TrappedProto::IPV4_ICMP,
+            classifyHex(ipv4Hex("01", "0a 00 00 02")));
+  EXPECT_EQ(TrappedProto::IPV4_OTHER,
+            classifyHex(ipv4Hex("59", "0a 00 00 02")));
+  // Version, traffic class, flow label, payload length, then next header
+  EXPECT_EQ(TrappedProto::IPV6_ICMP,
+            classifyHex("86 dd  60 00 00 00  00 20  3a"));
+  EXPECT_EQ(TrappedProto::IPV6_UDP,
+            classifyHex("86 dd  60 00 00 00  00 20  11"));
+  EXPECT_EQ(TrappedProto::OTHER, classifyHex("88 47"));
+
+  // A truncated IPv4 header
+  EXPECT_EQ(TrappedProto::OTHER, classifyHex("08 00  45 00"));
+}
+
+TEST(TrappedPacketProfiler, topTalkers) {
+  TrappedPacketProfiler profiler(4, 16, seconds(10));
+  auto now = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < 3; ++i) {
+    recordHex(&profiler, ipv4Hex("11", "0a 00 00 02"), now);
+  }
+  recordHex(&profiler, ipv4Hex("11", "0a 00 00 03"), now);
+  // ARP requests are identified by their sender address
+  recordHex(&profiler,
+            "08 06  00 01 08 00 06 04 00 01  02 00 02 01 02 03  0a 00 00 03",
+            now);
+  recordHex(&profiler, "88 cc", now);
+
+  auto talkers = profiler.getTopTalkers(10, now);
+  ASSERT_EQ(3, talkers.size());
+  EXPECT_EQ(kSrcMac, talkers[0].mac);
+  EXPECT_EQ(IPAddress("10.0.0.2"), talkers[0].ip);
+  EXPECT_EQ(PortID(3), talkers[0].port);
+  EXPECT_EQ(TrappedProto::IPV4_UDP, talkers[0].proto);
+  // Counts are scaled up by the sample rate
+  EXPECT_EQ(12, talkers[0].packets);
+  EXPECT_EQ(IPAddress("10.0.0.3"), talkers[1].ip);
+  EXPECT_EQ(8, talkers[1].packets);
+  EXPECT_TRUE(talkers[2].ip.empty());
+  EXPECT_EQ(4, talkers[2].packets);
+
+  EXPECT_EQ(1, profiler.getTopTalkers(1, now).size());
+
+  // The counts halve every half life, and sources that stopped are dropped
+  talkers = profiler.getTopTalkers(10, now + seconds(10));
+  ASSERT_EQ(3, talkers.size());
+  EXPECT_EQ(6, talkers[0].packets);
+  talkers = profiler.getTopTalkers(10, now + seconds(40));
+  EXPECT_EQ(0, talkers.size());
+}
+
+TEST(TrappedPacketProfiler, evictLowest) {
+  TrappedPacketProfiler profiler(1, 2, seconds(10));
+  auto now = std::chrono::steady_clock::now();
+
+  recordHex(&profiler, ipv4Hex("11", "0a 00 00 02"), now);
+  recordHex(&profiler, ipv4Hex("11", "0a 00 00 02"), now);
+  recordHex(&profiler, ipv4Hex("11", "0a 00 00 03"), now);
+  // The table is full, so this replaces 10.0.0.3
+  recordHex(&profiler, ipv4Hex("11", "0a 00 00 04"), now);
+
+  auto talkers = profiler.getTopTalkers(10, now);
+  ASSERT_EQ(2, talkers.size());
+  EXPECT_EQ(IPAddress("10.0.0.2"), talkers[0].ip);
+  EXPECT_EQ(IPAddress("10.0.0.4"), talkers[1].ip);
+}
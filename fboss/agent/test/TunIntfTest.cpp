@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/TunIntf.h"
+
+#include "fboss/agent/packet/PktUtil.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+DECLARE_string(host_intf_ring_routers);
+
+using namespace facebook::fboss;
+
+namespace {
+
+uint64_t hashHex(const std::string& hex) {
+  auto buf = PktUtil::parseHexData(hex);
+  return TunIntf::flowHash(&buf);
+}
+
+// An IPv4 UDP packet between the given addresses and ports
+std::string udpV4(const char* src, const char* dst, const char* ports,
+                  const char* frag = "00 00") {
+  return std::string(
+      // Version, DSCP, length, id
+      "45 00 00 20  00 01") + frag +
+    // TTL, protocol, checksum
+    "40 11 00 00" + src + dst + ports +
+    // UDP length and checksum, then some payload
+    "00 0c 00 00  01 02 03 04";
+}
+
+std::string udpV6(const char* src, const char* ports) {
+  return std::string(
+      // Version, traffic class, flow label, payload length, next header,
+      // hop limit
+      "60 00 00 00  00 0c 11 40") + src +
+    // Destination address
+    "fe 80 00 00 00 00 00 00  00 00 00 00 00 00 00 01" + ports +
+    "00 0c 00 00  01 02 03 04";
+}
+
+}
+
+TEST(TunIntf, flowHashV4) {
+  auto flow = udpV4("0a 00 00 01", "0a 00 00 02", "0b 3a 00 b3");
+  EXPECT_EQ(hashHex(flow), hashHex(flow));
+  // Each part of the flow changes the hash
+  EXPECT_NE(hashHex(flow),
+            hashHex(udpV4("0a 00 00 03", "0a 00 00 02", "0b 3a 00 b3")));
+  EXPECT_NE(hashHex(flow),
+            hashHex(udpV4("0a 00 00 01", "0a 00 00 03", "0b 3a 00 b3")));
+  EXPECT_NE(hashHex(flow),
+            hashHex(udpV4("0a 00 00 01", "0a 00 00 02", "0b 3b 00 b3")));
+  // Only the first fragment has the ports, so later ones hash without them
+  auto noPorts = hashHex(
+      udpV4("0a 00 00 01", "0a 00 00 02", "0b 3a 00 b3", "00 10"));
+  EXPECT_EQ(noPorts, hashHex(
+      udpV4("0a 00 00 01", "0a 00 00 02", "0b 3b 00 b3", "00 10")));
+}
+
+TEST(TunIntf, flowHashV6) {
+  const char* src = "fe 80 00 00 00 00 00 00  00 00 00 00 00 00 00 02";
+  auto flow = udpV6(src, "0b 3a 00 b3");
+  EXPECT_EQ(hashHex(flow), hashHex(flow));
+  EXPECT_NE(hashHex(flow), hashHex(udpV6(src, "0b 3b 00 b3")));
+}
+
+TEST(TunIntf, flowHashOther) {
+  // Not IP
+  EXPECT_EQ(0, hashHex("00 01 02 03"));
+  // A truncated header hashes consistently
+  EXPECT_EQ(hashHex("45 00 00 20 00 01"), hashHex("45 00 00 20 00 01"));
+}
+
+TEST(TunIntf, usesPacketRing) {
+  gflags::FlagSaver flagSaver;
+  EXPECT_FALSE(TunIntf::usesPacketRing(RouterID(0)));
+  FLAGS_host_intf_ring_routers = "0,12,";
+  EXPECT_TRUE(TunIntf::usesPacketRing(RouterID(0)));
+  EXPECT_TRUE(TunIntf::usesPacketRing(RouterID(12)));
+  EXPECT_FALSE(TunIntf::usesPacketRing(RouterID(1)));
+  FLAGS_host_intf_ring_routers = "0,x";
+  EXPECT_THROW(TunIntf::usesPacketRing(RouterID(1)), std::range_error);
+}
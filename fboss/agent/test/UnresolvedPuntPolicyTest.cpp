@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/UnresolvedPuntPolicy.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using folly::IPAddress;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+namespace {
+
+typedef UnresolvedPuntPolicy::Verdict Verdict;
+
+RouteCounterConfig makeClass(const std::string& name,
+                             const std::string& prefix,
+                             uint32_t puntRate, uint32_t dropAfter) {
+  RouteCounterConfig config;
+  config.name = name;
+  config.prefixes.push_back(IPAddress::createNetwork(prefix));
+  config.unresolvedPuntRate = puntRate;
+  config.unresolvedDropAfter = dropAfter;
+  config.unresolvedDropSeconds = 30;
+  return config;
+}
+
+}
+
+TEST(UnresolvedPuntPolicy, unclassified) {
+  UnresolvedPuntPolicy policy(seconds(60));
+  policy.setClasses({makeClass("storage", "10.1.0.0/16", 1, 1)});
+  auto now = std::chrono::steady_clock::now();
+  // Destinations in no class are always resolved
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.2.0.1"), now));
+    EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("2401:db00::1"), now));
+    policy.requested(IPAddress("10.2.0.1"), now);
+  }
+}
+
+TEST(UnresolvedPuntPolicy, puntRate) {
+  UnresolvedPuntPolicy policy(seconds(60));
+  policy.setClasses({makeClass("storage", "10.1.0.0/16", 10, 0)});
+  auto now = std::chrono::steady_clock::now();
+  // A second's worth is punted in a burst, and the rest dropped
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.1.0.1"), now));
+  }
+  EXPECT_EQ(Verdict::RATE_DROP, policy.admit(IPAddress("10.1.2.3"), now));
+  // The class refills at its rate
+  now += milliseconds(100);
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.1.0.1"), now));
+  EXPECT_EQ(Verdict::RATE_DROP, policy.admit(IPAddress("10.1.0.1"), now));
+}
+
+TEST(UnresolvedPuntPolicy, dropAfterFailures) {
+  UnresolvedPuntPolicy policy(seconds(60));
+  policy.setClasses({makeClass("storage", "10.1.0.0/16", 0, 2)});
+  IPAddress dest("10.1.0.1");
+  auto now = std::chrono::steady_clock::now();
+  // The first request, and the first failure
+  policy.requested(dest, now);
+  now += seconds(5);
+  policy.requested(dest, now);
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(dest, now));
+  // The second failure gives up on the destination
+  now += seconds(5);
+  policy.requested(dest, now);
+  EXPECT_EQ(Verdict::FAILED_DROP, policy.admit(dest, now));
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.1.0.2"), now));
+  // Until it is tried again
+  now += seconds(30);
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(dest, now));
+
+  // Requests further apart than the window are not failures in a row
+  IPAddress other("10.1.0.3");
+  policy.requested(other, now);
+  now += seconds(61);
+  policy.requested(other, now);
+  now += seconds(61);
+  policy.requested(other, now);
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(other, now));
+}
+
+TEST(UnresolvedPuntPolicy, firstClassWins) {
+  UnresolvedPuntPolicy policy(seconds(60));
+  policy.setClasses({
+    makeClass("vips", "10.1.1.0/24", 1, 0),
+    makeClass("storage", "10.1.0.0/16", 0, 0),
+  });
+  auto now = std::chrono::steady_clock::now();
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.1.1.1"), now));
+  EXPECT_EQ(Verdict::RATE_DROP, policy.admit(IPAddress("10.1.1.1"), now));
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.1.2.1"), now));
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.1.2.1"), now));
+
+  // Removing the class removes its policy
+  policy.setClasses({makeClass("storage", "10.1.0.0/16", 0, 0)});
+  EXPECT_EQ(Verdict::RESOLVE, policy.admit(IPAddress("10.1.1.1"), now));
+}
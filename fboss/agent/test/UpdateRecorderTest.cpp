@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/UpdateRecorder.h"
+
+#include "fboss/agent/AddressUtil.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/hw/mock/MockRxPacket.h"
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/IPAddress.h>
+#include <folly/ScopeGuard.h>
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using facebook::network::toBinaryAddress;
+using folly::IPAddress;
+using folly::StringPiece;
+typedef UpdateLogRecord::Type RecordType;
+
+namespace {
+
+UnicastRoute makeRoute(StringPiece network, int16_t len, StringPiece nh) {
+  UnicastRoute route;
+  route.dest.ip = toBinaryAddress(IPAddress(network));
+  route.dest.prefixLength = len;
+  route.nextHopAddrs.push_back(toBinaryAddress(IPAddress(nh)));
+  return route;
+}
+
+} // unnamed namespace
+
+TEST(UpdateRecorderTest, ReadBack) {
+  char tmpPath[] = "fbossUpdateLogTest.XXXXXX";
+  int tmpFD = mkstemp(tmpPath);
+  folly::checkUnixError(tmpFD, "failed to create temporary file");
+  SCOPE_EXIT {
+    close(tmpFD);
+    unlink(tmpPath);
+  };
+
+  std::vector<UnicastRoute> routes{
+    makeRoute("10.1.0.0", 16, "10.0.0.2"),
+    makeRoute("2401:db00:1::", 48, "2401:db00::2"),
+  };
+  IpPrefix prefix;
+  prefix.ip = toBinaryAddress(IPAddress("10.1.0.0"));
+  prefix.prefixLength = 16;
+  NeighborToFlush neighbor;
+  neighbor.ip = toBinaryAddress(IPAddress("10.0.0.2"));
+  neighbor.vlanId = 5;
+  MockRxPacket pkt(folly::IOBuf::copyBuffer("trapped packet"));
+  pkt.setSrcPort(PortID(3));
+  pkt.setSrcVlan(VlanID(5));
+  {
+    UpdateRecorder recorder(tmpPath);
+    recorder.recordAddRoutes(1, 20, folly::range(routes));
+    recorder.recordDeleteRoutes(1, folly::Range<const IpPrefix*>(&prefix, 1));
+    recorder.recordFlushNeighbors(
+        folly::Range<const NeighborToFlush*>(&neighbor, 1));
+    recorder.recordPacket(&pkt);
+    recorder.recordStateUpdate("add neighbor");
+    EXPECT_EQ(5, recorder.numRecords());
+  }
+
+  UpdateLogReader reader(tmpPath);
+  UpdateLogRecord record;
+  ASSERT_TRUE(reader.readRecord(&record));
+  EXPECT_EQ(RecordType::ADD_ROUTES, record.type);
+  EXPECT_EQ(1, record.arg1);
+  EXPECT_EQ(20, record.arg2);
+  EXPECT_EQ(routes, record.getRoutes());
+  auto lastTime = record.time;
+
+  ASSERT_TRUE(reader.readRecord(&record));
+  EXPECT_EQ(RecordType::DELETE_ROUTES, record.type);
+  EXPECT_EQ(std::vector<IpPrefix>{prefix}, record.getPrefixes());
+  EXPECT_LE(lastTime, record.time);
+  lastTime = record.time;
+
+  ASSERT_TRUE(reader.readRecord(&record));
+  EXPECT_EQ(RecordType::FLUSH_NEIGHBORS, record.type);
+  EXPECT_EQ(std::vector<NeighborToFlush>{neighbor}, record.getNeighbors());
+
+  ASSERT_TRUE(reader.readRecord(&record));
+  EXPECT_EQ(RecordType::PACKET, record.type);
+  EXPECT_EQ(3, record.arg1);
+  EXPECT_EQ(5, record.arg2);
+  EXPECT_EQ("trapped packet", record.payload);
+
+  ASSERT_TRUE(reader.readRecord(&record));
+  EXPECT_EQ(RecordType::STATE_UPDATE, record.type);
+  EXPECT_EQ("add neighbor", record.payload);
+  EXPECT_LE(lastTime, record.time);
+
+  EXPECT_FALSE(reader.readRecord(&record));
+}
+
+TEST(UpdateRecorderTest, Corrupt) {
+  char tmpPath[] = "fbossUpdateLogTest.XXXXXX";
+  int tmpFD = mkstemp(tmpPath);
+  folly::checkUnixError(tmpFD, "failed to create temporary file");
+  SCOPE_EXIT {
+    close(tmpFD);
+    unlink(tmpPath);
+  };
+
+  ASSERT_TRUE(folly::writeFile(std::string("not an update log"), tmpPath));
+  EXPECT_THROW(UpdateLogReader reader(tmpPath), FbossError);
+
+  {
+    UpdateRecorder recorder(tmpPath);
+    recorder.recordStateUpdate("a state update with a long enough name");
+  }
+  // Cut the record short
+  std::string data;
+  ASSERT_TRUE(folly::readFile(tmpPath, data));
+  data.resize(data.size() - 5);
+  ASSERT_TRUE(folly::writeFile(data, tmpPath));
+  UpdateLogReader reader(tmpPath);
+  UpdateLogRecord record;
+  EXPECT_THROW(reader.readRecord(&record), FbossError);
+}
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/UpdateWatchdog.h"
+
+#include "fboss/agent/state/StateDelta.h"
+#include "fboss/agent/state/SwitchState.h"
+#include "fboss/agent/test/TestUtils.h"
+
+#include <gtest/gtest.h>
+
+using namespace facebook::fboss;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+TEST(UpdateWatchdog, ReportsStall) {
+  UpdateWatchdog watchdog(milliseconds(20));
+  watchdog.start();
+  {
+    // Under the threshold
+    UpdateWatchdog::Scope scope(&watchdog, "quick update", "prepare", 1);
+  }
+  std::thread worker([&] {
+    UpdateWatchdog::Scope scope(&watchdog, "slow update", "program", 3);
+    // Wait to be reported, rather than for a fixed time, so a slow test
+    // machine doesn't fail the test
+    auto deadline = steady_clock::now() + std::chrono::seconds(5);
+    while (watchdog.getNumStalls() == 0 && steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(milliseconds(5));
+    }
+  });
+  worker.join();
+  watchdog.stop();
+
+  EXPECT_EQ(1, watchdog.getNumStalls());
+  auto stall = watchdog.getLastStall();
+  EXPECT_EQ("slow update", stall.name);
+  EXPECT_EQ("program", stall.stage);
+  EXPECT_EQ(3, stall.numUpdates);
+  EXPECT_GE(stall.duration, milliseconds(20));
+  EXPECT_TRUE(stall.delta.empty());
+  EXPECT_FALSE(stall.stack.empty());
+}
+
+TEST(UpdateWatchdog, NullWatchdog) {
+  // Does nothing, rather than crash
+  UpdateWatchdog::Scope scope(nullptr, "update", "prepare", 1);
+}
+
+TEST(UpdateWatchdog, DescribeDelta) {
+  auto state = testStateA();
+  EXPECT_EQ("0 port, 0 vlan, 0 interface, 0 neighbor and 0 route changes",
+            UpdateWatchdog::describeDelta(StateDelta(state, state)));
+  auto description = UpdateWatchdog::describeDelta(
+      StateDelta(std::make_shared<SwitchState>(), state));
+  EXPECT_EQ(0, description.find("19 port, 2 vlan, 2 interface, 0 neighbor"))
+    << description;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/Utils.h"
+
+#include "fboss/agent/FbossError.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+
+using namespace facebook::fboss;
+
+TEST(Utils, runInParallel) {
+  for (size_t threads : {0, 1, 4, 100}) {
+    std::vector<std::atomic<int>> calls(50);
+    runInParallel(calls.size(), threads, [&] (size_t i) { ++calls[i]; });
+    for (const auto& count : calls) {
+      EXPECT_EQ(1, count.load());
+    }
+  }
+  runInParallel(0, 4, [] (size_t i) { FAIL(); });
+}
+
+TEST(Utils, runInParallelThrows) {
+  std::atomic<int> calls{0};
+  EXPECT_THROW(runInParallel(1000, 4, [&] (size_t i) {
+    ++calls;
+    if (i == 10) {
+      throw FbossError("failed");
+    }
+  }), FbossError);
+  // No calls are started once one has failed
+  EXPECT_LT(calls.load(), 1000);
+}
@@ -0,0 +1,400 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "fboss/agent/AddressUtil.h"
+#include "fboss/agent/FbossError.h"
+#include "fboss/agent/if/gen-cpp2/FbossCtrl.h"
+#include "thrift/lib/cpp/async/TAsyncSocket.h"
+#include "thrift/lib/cpp/async/TEventBase.h"
+#include "thrift/lib/cpp2/async/HeaderClientChannel.h"
+
+#include <folly/Conv.h>
+#include <folly/IPAddress.h>
+#include <folly/String.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+/*
+ * Drive the route thrift API of a running agent with batches of generated
+ * routes, to benchmark how quickly the FIB converges end to end.
+ *
+ * Each batch is sent with addUnicastRoutes, deleteUnicastRoutes or syncFib,
+ * paced to --rate routes per second.  The latency of every call is recorded,
+ * as is the time from sending the batch until getIpRoute shows its last
+ * route installed, or removed.  A summary of both is printed at the end.
+ *
+ * The routes come from a pool of --num_routes prefixes, split between IPv4
+ * and IPv6 by --v4_percent, with prefix lengths drawn from --v4_prefix_lens
+ * and --v6_prefix_lens.  Each length gets its own address range, so the
+ * generated prefixes never overlap.  Every route gets --ecmp_width next hops
+ * out of --nexthops, which must be reachable from the agent's interfaces
+ * for the routes to be resolved.
+ */
+
+DEFINE_string(host, "::1", "The host running the agent");
+DEFINE_int32(port, 5909, "The agent's thrift port");
+DEFINE_int32(client_id, 1, "The client ID to add and delete routes as");
+DEFINE_string(mode, "churn",
+              "What to do with the routes: \"add\" them, \"delete\" them, "
+              "\"churn\" them by adding then deleting each batch, or "
+              "\"sync\" the FIB to alternately all of them and half of them");
+DEFINE_int32(num_routes, 10000, "The number of routes in the pool");
+DEFINE_int32(batch_size, 100, "The number of routes sent per call");
+DEFINE_double(rate, 0,
+              "The number of routes to send per second.  0 sends batches "
+              "back to back");
+DEFINE_int32(iterations, 1, "How many times to go through the pool");
+DEFINE_int32(v4_percent, 50, "The percentage of routes that are IPv4");
+DEFINE_string(v4_prefix_lens, "24:80,32:20",
+              "Comma separated IPv4 prefix lengths, each with an optional "
+              ":weight");
+DEFINE_string(v6_prefix_lens, "48:20,64:80",
+              "Comma separated IPv6 prefix lengths, each with an optional "
+              ":weight");
+DEFINE_string(nexthops, "10.0.0.1,10.0.0.2,10.0.0.3,10.0.0.4",
+              "Comma separated next hops to spread the routes over");
+DEFINE_int32(ecmp_width, 1, "The number of next hops for each route");
+DEFINE_int32(verify_timeout_ms, 10000,
+             "How long to wait for a batch to show up in getIpRoute.  0 "
+             "skips checking for convergence");
+DEFINE_int32(verify_interval_ms, 1,
+             "How long to wait between getIpRoute calls");
+
+using namespace facebook::fboss;
+using apache::thrift::HeaderClientChannel;
+using apache::thrift::async::TAsyncSocket;
+using apache::thrift::async::TEventBase;
+using facebook::network::toAddress;
+using facebook::network::toBinaryAddress;
+using facebook::network::toIPAddress;
+using folly::IPAddress;
+using folly::IPAddressV4;
+using folly::IPAddressV6;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::vector;
+
+namespace {
+
+struct PrefixLen {
+  uint8_t len;
+  uint32_t weight;
+};
+
+vector<PrefixLen> parsePrefixLens(const std::string& spec, uint8_t minLen,
+                                  uint8_t maxLen) {
+  vector<std::string> entries;
+  folly::split(',', spec, entries, true);
+  vector<PrefixLen> lens;
+  for (const auto& entry : entries) {
+    std::string len;
+    uint32_t weight = 1;
+    std::string weightStr;
+    if (folly::split(':', entry, len, weightStr)) {
+      weight = folly::to<uint32_t>(weightStr);
+    } else {
+      len = entry;
+    }
+    auto prefixLen = folly::to<uint32_t>(len);
+    if (prefixLen < minLen || prefixLen > maxLen) {
+      throw FbossError("prefix length ", prefixLen, " is not between ",
+                       static_cast<int>(minLen), " and ",
+                       static_cast<int>(maxLen));
+    }
+    lens.push_back({static_cast<uint8_t>(prefixLen), weight});
+  }
+  if (lens.empty()) {
+    throw FbossError("no prefix lengths in \"", spec, "\"");
+  }
+  return lens;
+}
+
+// Pick the length of prefix n, spreading the lengths by weight
+size_t pickLen(const vector<PrefixLen>& lens, uint32_t n) {
+  uint32_t total = 0;
+  for (const auto& len : lens) {
+    total += len.weight;
+  }
+  auto slot = n % std::max<uint32_t>(total, 1);
+  for (size_t i = 0; i < lens.size(); ++i) {
+    if (slot < lens[i].weight) {
+      return i;
+    }
+    slot -= lens[i].weight;
+  }
+  return lens.size() - 1;
+}
+
+// The count'th IPv4 prefix of the given length.  The first octet tells the
+// lengths apart.
+IpPrefix makeV4Prefix(size_t lenIndex, uint8_t len, uint32_t count) {
+  uint32_t addr = (100 + lenIndex) << 24;
+  addr |= (count << (32 - len)) & 0x00ffffff;
+  IpPrefix prefix;
+  prefix.ip = toBinaryAddress(IPAddress(IPAddressV4::fromLongHBO(addr)));
+  prefix.prefixLength = len;
+  return prefix;
+}
+
+// The count'th IPv6 prefix of the given length.  The fourth byte tells the
+// lengths apart.
+IpPrefix makeV6Prefix(size_t lenIndex, uint8_t len, uint32_t count) {
+  IPAddressV6::ByteArray bytes{};
+  bytes[0] = 0x24;
+  bytes[1] = 0x01;
+  bytes[2] = 0xdb;
+  bytes[3] = lenIndex;
+  // Write count so that its lowest bit is the last bit of the prefix
+  uint64_t value = count;
+  for (int bit = len - 1; bit >= 32 && value; --bit, value >>= 1) {
+    if (value & 1) {
+      bytes[bit / 8] |= 0x80 >> (bit % 8);
+    }
+  }
+  IpPrefix prefix;
+  prefix.ip = toBinaryAddress(IPAddress(IPAddressV6(bytes)));
+  prefix.prefixLength = len;
+  return prefix;
+}
+
+vector<UnicastRoute> makeRoutes() {
+  auto v4Lens = parsePrefixLens(FLAGS_v4_prefix_lens, 9, 32);
+  auto v6Lens = parsePrefixLens(FLAGS_v6_prefix_lens, 33, 128);
+  vector<std::string> nhStrs;
+  folly::split(',', FLAGS_nexthops, nhStrs, true);
+  vector<facebook::network::thrift::BinaryAddress> nexthops;
+  for (const auto& nh : nhStrs) {
+    nexthops.push_back(toBinaryAddress(IPAddress(nh)));
+  }
+  if (FLAGS_ecmp_width < 1 ||
+      FLAGS_ecmp_width > static_cast<int>(nexthops.size())) {
+    throw FbossError("--ecmp_width must be between 1 and the number of "
+                     "--nexthops");
+  }
+
+  vector<uint32_t> v4Counts(v4Lens.size()), v6Counts(v6Lens.size());
+  uint32_t numV4 = 0, numV6 = 0;
+  vector<UnicastRoute> routes(FLAGS_num_routes);
+  for (uint32_t i = 0; i < routes.size(); ++i) {
+    auto& route = routes[i];
+    // Interleave the families, so every batch has the same mix
+    bool v4 = static_cast<int>(i % 100) < FLAGS_v4_percent;
+    if (v4) {
+      auto idx = pickLen(v4Lens, numV4++);
+      route.dest = makeV4Prefix(idx, v4Lens[idx].len, v4Counts[idx]++);
+    } else {
+      auto idx = pickLen(v6Lens, numV6++);
+      route.dest = makeV6Prefix(idx, v6Lens[idx].len, v6Counts[idx]++);
+    }
+    // Rotate through the next hops, so the routes use different ECMP groups
+    for (int j = 0; j < FLAGS_ecmp_width; ++j) {
+      route.nextHopAddrs.push_back(nexthops[(i + j) % nexthops.size()]);
+    }
+  }
+  return routes;
+}
+
+class LatencyStats {
+ public:
+  explicit LatencyStats(const char* name) : name_(name) {}
+
+  void add(microseconds latency) {
+    samples_.push_back(latency);
+  }
+
+  void print() {
+    if (samples_.empty()) {
+      return;
+    }
+    std::sort(samples_.begin(), samples_.end());
+    auto pct = [&](double p) {
+      auto idx = static_cast<size_t>(p * (samples_.size() - 1));
+      return samples_[idx].count();
+    };
+    printf("%-20s %8zu %10ld %10ld %10ld %10ld %10ld\n", name_,
+           samples_.size(), samples_.front().count(), pct(0.5), pct(0.9),
+           pct(0.99), samples_.back().count());
+  }
+
+ private:
+  const char* name_;
+  vector<microseconds> samples_;
+};
+
+class RouteChurn {
+ public:
+  RouteChurn(FbossCtrlAsyncClient* client, vector<UnicastRoute> routes)
+    : client_(client),
+      routes_(std::move(routes)),
+      addLatency_("addUnicastRoutes"),
+      deleteLatency_("deleteUnicastRoutes"),
+      syncLatency_("syncFib"),
+      addConverge_("add converged"),
+      deleteConverge_("delete converged") {}
+
+  void run() {
+    start_ = steady_clock::now();
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      if (FLAGS_mode == "sync") {
+        // Alternate between installing the whole pool and dropping half
+        // of it again
+        bool all = (i % 2) == 0;
+        size_t count = all ? routes_.size() : routes_.size() / 2;
+        sync(count, all);
+        continue;
+      }
+      for (size_t begin = 0; begin < routes_.size();
+           begin += FLAGS_batch_size) {
+        auto end = std::min(routes_.size(), begin + FLAGS_batch_size);
+        if (FLAGS_mode != "delete") {
+          add(begin, end);
+        }
+        if (FLAGS_mode != "add") {
+          remove(begin, end);
+        }
+      }
+    }
+    auto elapsed = steady_clock::now() - start_;
+    printf("%lu routes in %.3f seconds\n", sent_,
+           duration_cast<microseconds>(elapsed).count() / 1000000.0);
+    printf("%-20s %8s %10s %10s %10s %10s %10s\n", "microseconds", "count",
+           "min", "p50", "p90", "p99", "max");
+    addLatency_.print();
+    deleteLatency_.print();
+    syncLatency_.print();
+    addConverge_.print();
+    deleteConverge_.print();
+    if (timeouts_) {
+      printf("%lu batches did not converge within %d ms\n", timeouts_,
+             FLAGS_verify_timeout_ms);
+    }
+  }
+
+ private:
+  // Forbidden copy constructor and assignment operator
+  RouteChurn(RouteChurn const &) = delete;
+  RouteChurn& operator=(RouteChurn const &) = delete;
+
+  void add(size_t begin, size_t end) {
+    vector<UnicastRoute> batch(routes_.begin() + begin, routes_.begin() + end);
+    pace(batch.size());
+    auto sendTime = steady_clock::now();
+    client_->sync_addUnicastRoutes(FLAGS_client_id, batch);
+    addLatency_.add(since(sendTime));
+    waitFor(routes_[end - 1].dest, true, sendTime, &addConverge_);
+  }
+
+  void remove(size_t begin, size_t end) {
+    vector<IpPrefix> batch;
+    batch.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      batch.push_back(routes_[i].dest);
+    }
+    pace(batch.size());
+    auto sendTime = steady_clock::now();
+    client_->sync_deleteUnicastRoutes(FLAGS_client_id, batch);
+    deleteLatency_.add(since(sendTime));
+    waitFor(routes_[end - 1].dest, false, sendTime, &deleteConverge_);
+  }
+
+  void sync(size_t count, bool all) {
+    vector<UnicastRoute> batch(routes_.begin(), routes_.begin() + count);
+    pace(batch.size());
+    auto sendTime = steady_clock::now();
+    client_->sync_syncFib(FLAGS_client_id, batch);
+    syncLatency_.add(since(sendTime));
+    // The last route of the pool comes and goes with every sync
+    waitFor(routes_.back().dest, all, sendTime,
+            all ? &addConverge_ : &deleteConverge_);
+  }
+
+  // Wait until sending another count routes keeps us within --rate
+  void pace(size_t count) {
+    if (FLAGS_rate > 0) {
+      auto due = start_ + duration_cast<steady_clock::duration>(
+          std::chrono::duration<double>(sent_ / FLAGS_rate));
+      std::this_thread::sleep_until(due);
+    }
+    sent_ += count;
+  }
+
+  // Poll getIpRoute until the prefix is, or is not, the longest match for
+  // its own address
+  void waitFor(const IpPrefix& prefix, bool present,
+               steady_clock::time_point sendTime, LatencyStats* stats) {
+    if (FLAGS_verify_timeout_ms <= 0) {
+      return;
+    }
+    auto addr = toAddress(toIPAddress(prefix.ip));
+    auto deadline = sendTime + milliseconds(FLAGS_verify_timeout_ms);
+    while (true) {
+      UnicastRoute match;
+      client_->sync_getIpRoute(match, addr, 0);
+      bool found = match.dest.ip.addr == prefix.ip.addr &&
+        match.dest.prefixLength == prefix.prefixLength;
+      if (found == present) {
+        stats->add(since(sendTime));
+        return;
+      }
+      if (steady_clock::now() >= deadline) {
+        ++timeouts_;
+        return;
+      }
+      std::this_thread::sleep_for(milliseconds(FLAGS_verify_interval_ms));
+    }
+  }
+
+  static microseconds since(steady_clock::time_point then) {
+    return duration_cast<microseconds>(steady_clock::now() - then);
+  }
+
+  FbossCtrlAsyncClient* client_;
+  const vector<UnicastRoute> routes_;
+  steady_clock::time_point start_;
+  uint64_t sent_{0};
+  uint64_t timeouts_{0};
+  LatencyStats addLatency_;
+  LatencyStats deleteLatency_;
+  LatencyStats syncLatency_;
+  LatencyStats addConverge_;
+  LatencyStats deleteConverge_;
+};
+
+} // unnamed namespace
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_mode != "add" && FLAGS_mode != "delete" &&
+      FLAGS_mode != "churn" && FLAGS_mode != "sync") {
+    LOG(ERROR) << "unknown --mode " << FLAGS_mode;
+    return 1;
+  }
+  if (FLAGS_num_routes <= 0 || FLAGS_batch_size <= 0) {
+    LOG(ERROR) << "--num_routes and --batch_size must be positive";
+    return 1;
+  }
+
+  TEventBase evb;
+  auto socket = TAsyncSocket::newSocket(&evb, FLAGS_host, FLAGS_port);
+  FbossCtrlAsyncClient client(HeaderClientChannel::newChannel(socket));
+
+  RouteChurn churn(&client, makeRoutes());
+  churn.run();
+  return 0;
+}
@@ -33,6 +33,22 @@ FBOSS_STRONG_TYPE(uint16_t, VlanID)
 FBOSS_STRONG_TYPE(uint32_t, RouterID)
 FBOSS_STRONG_TYPE(uint32_t, InterfaceID)
 
+/*
+ * The ID of a link aggregation group (LAG) of ports.
+ */
+FBOSS_STRONG_TYPE(uint16_t, AggregatePortID)
+
+/*
+ * The ID of an ACL entry, which is also its precedence: where several
+ * entries match a packet, the one with the lowest ID wins.
+ */
+FBOSS_STRONG_TYPE(uint32_t, AclEntryID)
+
+/*
+ * The ID a routing client, e.g. a routing daemon, uses when it adds routes.
+ */
+FBOSS_STRONG_TYPE(int16_t, ClientID)
+
 /*
  * A unique ID identifying a node in our state tree.
  */
@@ -9,11 +9,40 @@
  */
 #pragma once
 
+#include "common/fb303/if/gen-cpp2/FacebookService.h"
+#include "common/stats/ServiceData.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace facebook { namespace fb303 {
 
-class FacebookBase2 {
+class FacebookBase2 : virtual public cpp2::FacebookServiceSvIf {
 public:
   explicit FacebookBase2(const char*) {}
+
+  /*
+   * The counters of fbData.  Call flushCountersNow() first to include the
+   * thread local stats updated since they were last published.
+   */
+  void getCounters(std::map<std::string, int64_t>& counters) override {
+    fbData->getCounters(counters);
+  }
+  void getSelectedCounters(
+      std::map<std::string, int64_t>& counters,
+      std::unique_ptr<std::vector<std::string>> keys) override {
+    fbData->getSelectedCounters(counters, *keys);
+  }
+  void getRegexCounters(std::map<std::string, int64_t>& counters,
+                        std::unique_ptr<std::string> regex) override {
+    fbData->getRegexCounters(counters, *regex);
+  }
+  void getPrefixCounters(std::map<std::string, int64_t>& counters,
+                         std::unique_ptr<std::string> prefix) override {
+    fbData->getPrefixCounters(counters, *prefix);
+  }
 };
 
 }}
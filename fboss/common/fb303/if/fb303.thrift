@@ -45,4 +45,20 @@ service FacebookService {
    */
   map<string, i64> getCounters(),
 
+  /**
+   * Gets the counters with the given names, skipping those that do not
+   * exist
+   */
+  map<string, i64> getSelectedCounters(1: list<string> keys),
+
+  /**
+   * Gets the counters whose whole names match the regex
+   */
+  map<string, i64> getRegexCounters(1: string regex),
+
+  /**
+   * Gets the counters whose names start with the prefix
+   */
+  map<string, i64> getPrefixCounters(1: string prefix),
+
 } (priority = 'IMPORTANT')
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "common/stats/ExportedHistogram.h"
+
+#include <folly/Conv.h>
+#include <folly/stats/TimeseriesHistogram-defs.h>
+#include <vector>
+
+using std::chrono::seconds;
+
+namespace facebook { namespace stats {
+
+namespace {
+
+const int kExportedPercentiles[] = {50, 90, 99};
+
+} // unnamed namespace
+
+ExportedHistogram::ExportedHistogram(int64_t bucketWidth, int64_t min,
+                                     int64_t max)
+  : TimeseriesHistogram<int64_t>(bucketWidth, min, max, ExportedStat()) {
+}
+
+ExportedHistogramMap::LockAndHistogram
+ExportedHistogramMap::getOrCreateUnlocked(folly::StringPiece name,
+                                          const ExportedHistogram* copyMe,
+                                          bool* createdPtr) {
+  std::lock_guard<std::mutex> g(mutex_);
+  auto& entry = histograms_[name.str()];
+  bool created = !entry.first;
+  if (created) {
+    entry.first = std::make_shared<SpinLock>();
+    entry.second = std::make_shared<ExportedHistogram>(*copyMe);
+    generation_.fetch_add(1, std::memory_order_release);
+  }
+  if (createdPtr) {
+    *createdPtr = created;
+  }
+  return entry;
+}
+
+void ExportedHistogramMap::getCounterIndex(
+    std::map<std::string, Counter>* index) {
+  std::lock_guard<std::mutex> g(mutex_);
+  for (const auto& entry : histograms_) {
+    for (size_t level = 0; level < ExportedStat::kNumLevels; ++level) {
+      auto suffix = ExportedStat::levelSuffix(level);
+      index->emplace(folly::to<std::string>(entry.first, ".avg", suffix),
+                     Counter{entry.second, 0, level});
+      for (auto pct : kExportedPercentiles) {
+        index->emplace(folly::to<std::string>(entry.first, ".p", pct, suffix),
+                       Counter{entry.second, pct, level});
+      }
+    }
+  }
+}
+
+int64_t ExportedHistogramMap::getValue(const Counter& counter, seconds now) {
+  auto& hist = *counter.item.second;
+  SpinLockHolder guard(counter.item.first.get());
+  hist.update(now);
+  if (counter.percentile == 0) {
+    return hist.avg<int64_t>(counter.level);
+  }
+  return hist.getPercentileEstimate(
+      static_cast<double>(counter.percentile), counter.level);
+}
+
+}}
@@ -11,26 +11,62 @@
 
 #include "common/stats/ExportedTimeseries.h"
 
+#include <folly/stats/TimeseriesHistogram.h>
+
 namespace facebook { namespace stats {
 
-class ExportedHistogram {
+/*
+ * A histogram of values in buckets of bucketWidth between min and max,
+ * aggregated over the same levels as an ExportedStat.  Values below min or
+ * at or above max are counted in one extra bucket each.
+ */
+class ExportedHistogram : public folly::TimeseriesHistogram<int64_t> {
 public:
-  ExportedHistogram(int, int, size_t) {}
-  void addValue(std::chrono::seconds, int, int64_t) {}
+  ExportedHistogram(int64_t bucketWidth, int64_t min, int64_t max);
 };
 
+/*
+ * The histograms exported through fb303, by name.  Each histogram is
+ * exported as its average and its 50th, 90th and 99th percentile estimates
+ * at each level, for example "foo.p99.60" and "foo.avg".
+ */
 class ExportedHistogramMap {
 public:
-  struct LockAndHistogram {
-    std::shared_ptr<SpinLock> first;
-    std::shared_ptr<ExportedHistogram> second;
+  typedef std::pair<std::shared_ptr<SpinLock>,
+                    std::shared_ptr<ExportedHistogram>> LockAndHistogram;
+
+  /*
+   * Get the histogram, creating it as a copy of copyMe if it doesn't exist
+   * yet.  The histogram is returned unlocked; hold its lock while updating
+   * it.
+   */
+  LockAndHistogram getOrCreateUnlocked(folly::StringPiece name,
+                                       const ExportedHistogram* copyMe,
+                                       bool* createdPtr = nullptr);
+
+  /*
+   * One of the counters a histogram is exported as.
+   */
+  struct Counter {
+    LockAndHistogram item;
+    // The percentile, or 0 for the average
+    int percentile;
+    size_t level;
   };
-  LockAndHistogram getOrCreateUnlocked(folly::StringPiece,
-                                       const ExportedHistogram*,
-                                       bool* createdPtr = nullptr) {
-    if (createdPtr) *createdPtr = true;
-    return LockAndHistogram();
+  /*
+   * Like ExportedStatMap::getCounterIndex().  The names only change when a
+   * histogram is created.
+   */
+  void getCounterIndex(std::map<std::string, Counter>* index);
+  uint64_t getGeneration() const {
+    return generation_.load(std::memory_order_acquire);
   }
+  static int64_t getValue(const Counter& counter, std::chrono::seconds now);
+
+private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, LockAndHistogram> histograms_;
+  std::atomic<uint64_t> generation_{0};
 };
 
 }}
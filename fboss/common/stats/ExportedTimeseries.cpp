@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "common/stats/ExportedTimeseries.h"
+
+#include <folly/Conv.h>
+#include <folly/stats/MultiLevelTimeSeries-defs.h>
+#include <vector>
+
+using std::chrono::seconds;
+
+namespace facebook { namespace stats {
+
+namespace {
+
+// The number of buckets each level is divided into
+const size_t kNumBuckets = 60;
+// A duration of 0 aggregates over all time
+const seconds kLevelDurations[ExportedStat::kNumLevels] = {
+  seconds(60), seconds(600), seconds(3600), seconds(0),
+};
+
+const char* exportTypeName(ExportType type) {
+  switch (type) {
+    case SUM: return "sum";
+    case COUNT: return "count";
+    case AVG: return "avg";
+    case RATE: return "rate";
+    case PERCENT: return "pct";
+    case NUM_TYPES: break;
+  }
+  return "unknown";
+}
+
+int64_t exportedValue(const ExportedStat& stat, ExportType type,
+                      size_t level) {
+  switch (type) {
+    case SUM: return stat.sum(level);
+    case COUNT: return stat.count(level);
+    case AVG: return stat.avg<int64_t>(level);
+    case RATE: return stat.rate<int64_t>(level);
+    case PERCENT: return 100 * stat.avg<double>(level);
+    case NUM_TYPES: break;
+  }
+  return 0;
+}
+
+} // unnamed namespace
+
+ExportedStat::ExportedStat()
+  : MultiLevelTimeSeries<int64_t>(kNumBuckets, kNumLevels, kLevelDurations) {
+}
+
+std::string ExportedStat::levelSuffix(size_t level) {
+  auto duration = kLevelDurations[level].count();
+  return duration ? folly::to<std::string>(".", duration) : std::string();
+}
+
+ExportedStatMap::LockAndStatItem ExportedStatMap::getLockAndStatItem(
+    folly::StringPiece name, const ExportType* type) {
+  std::lock_guard<std::mutex> g(mutex_);
+  auto& entry = stats_[name.str()];
+  if (!entry.item.first) {
+    entry.item.first = std::make_shared<SpinLock>();
+    entry.item.second = std::make_shared<ExportedStat>();
+  }
+  auto types = entry.types | (1 << (type ? *type : AVG));
+  if (types != entry.types) {
+    entry.types = types;
+    generation_.fetch_add(1, std::memory_order_release);
+  }
+  return entry.item;
+}
+
+void ExportedStatMap::getCounterIndex(std::map<std::string, Counter>* index) {
+  std::lock_guard<std::mutex> g(mutex_);
+  for (const auto& entry : stats_) {
+    for (int type = 0; type < NUM_TYPES; ++type) {
+      if (!(entry.second.types & (1 << type))) {
+        continue;
+      }
+      auto prefix = folly::to<std::string>(
+          entry.first, ".", exportTypeName(ExportType(type)));
+      for (size_t level = 0; level < ExportedStat::kNumLevels; ++level) {
+        index->emplace(prefix + ExportedStat::levelSuffix(level),
+                       Counter{entry.second.item, ExportType(type), level});
+      }
+    }
+  }
+}
+
+int64_t ExportedStatMap::getValue(const Counter& counter, seconds now) {
+  auto& stat = *counter.item.second;
+  SpinLockHolder guard(counter.item.first.get());
+  stat.update(now);
+  return exportedValue(stat, counter.type, counter.level);
+}
+
+}}
@@ -10,16 +10,51 @@
 #pragma once
 
 #include <folly/Range.h>
+#include <folly/SpinLock.h>
+#include <folly/stats/MultiLevelTimeSeries.h>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 namespace facebook {
 
+/*
+ * The lock of an exported stat or histogram.  Whoever updates the stat
+ * holds it with a SpinLockHolder; the updates are short.
+ */
 class SpinLock {
+public:
+  void lock() {
+    lock_.lock();
+  }
+  void unlock() {
+    lock_.unlock();
+  }
+
+private:
+  folly::SpinLock lock_;
 };
 
 class SpinLockHolder {
 public:
-  explicit SpinLockHolder(SpinLock*) {}
+  explicit SpinLockHolder(SpinLock* lock) : lock_(lock) {
+    lock_->lock();
+  }
+  ~SpinLockHolder() {
+    lock_->unlock();
+  }
+
+private:
+  SpinLockHolder(SpinLockHolder const &) = delete;
+  SpinLockHolder& operator=(SpinLockHolder const &) = delete;
+
+  SpinLock* lock_;
 };
 
 namespace stats {
@@ -33,24 +68,72 @@ enum ExportType {
   NUM_TYPES,
 };
 
-struct ExportedStat {
-  void addValue(std::chrono::seconds, int64_t) {}
+/*
+ * A timeseries of values, aggregated over the last minute, 10 minutes and
+ * hour, and over all time.  The times passed to it are seconds since the
+ * epoch.
+ */
+class ExportedStat : public folly::MultiLevelTimeSeries<int64_t> {
+public:
+  ExportedStat();
+
+  enum : size_t {
+    kNumLevels = 4,
+  };
+  // The counter name suffix of each level: ".60", ".600", ".3600" and ""
+  static std::string levelSuffix(size_t level);
 };
 
+/*
+ * The stats exported through fb303, by name.  Each stat is exported as one
+ * counter per ExportType it was registered with and level, for example
+ * "foo.sum.60" for the sum over the last minute and "foo.sum" for the sum
+ * over all time.
+ */
 class ExportedStatMap {
 public:
-  class LockAndStatItem {
-  public:
-    std::shared_ptr<SpinLock> first;
-    std::shared_ptr<ExportedStat> second;
+  typedef std::pair<std::shared_ptr<SpinLock>, std::shared_ptr<ExportedStat>>
+    LockAndStatItem;
+
+  /*
+   * Get the stat, creating it if it doesn't exist yet, and export it as the
+   * given type too (AVG if none is given).
+   */
+  LockAndStatItem getLockAndStatItem(folly::StringPiece name,
+                                     const ExportType* type = nullptr);
+
+  /*
+   * One of the counters a stat is exported as.
+   */
+  struct Counter {
+    LockAndStatItem item;
+    ExportType type;
+    size_t level;
   };
-  LockAndStatItem getLockAndStatItem(folly::StringPiece,
-                                     const ExportType* = nullptr) {
-    static LockAndStatItem it = {
-      std::make_shared<SpinLock>(), std::make_shared<ExportedStat>()
-    };
-    return it;
+  /*
+   * Add every counter to the index, by name.  The names only change when a
+   * stat is created or exported as another type, which changes
+   * getGeneration(), so the index can be kept until then.
+   */
+  void getCounterIndex(std::map<std::string, Counter>* index);
+  uint64_t getGeneration() const {
+    return generation_.load(std::memory_order_acquire);
   }
+  /*
+   * The current value of one counter from the index.
+   */
+  static int64_t getValue(const Counter& counter, std::chrono::seconds now);
+
+private:
+  struct Entry {
+    LockAndStatItem item;
+    // The ExportTypes the stat is exported as, as a bit mask
+    uint32_t types{0};
+  };
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, Entry> stats_;
+  std::atomic<uint64_t> generation_{0};
 };
 
 }}
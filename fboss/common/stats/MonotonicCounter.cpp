@@ -0,0 +1,34 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "common/stats/MonotonicCounter.h"
+#include "common/stats/ServiceData.h"
+
+namespace facebook { namespace stats {
+
+MonotonicCounter::MonotonicCounter(folly::StringPiece name, ExportType type1,
+                                   ExportType type2) {
+  auto statMap = fbData->getStatMap();
+  stat_ = statMap->getLockAndStatItem(name, &type1);
+  statMap->getLockAndStatItem(name, &type2);
+}
+
+void MonotonicCounter::updateValue(std::chrono::seconds now, int64_t value) {
+  bool haveValue = haveValue_;
+  int64_t delta = value >= prev_ ? value - prev_ : value;
+  haveValue_ = true;
+  prev_ = value;
+  if (!haveValue) {
+    return;
+  }
+  SpinLockHolder guard(stat_.first.get());
+  stat_.second->addValue(now, delta);
+}
+
+}}
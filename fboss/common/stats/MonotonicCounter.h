@@ -14,10 +14,23 @@
 
 namespace facebook { namespace stats {
 
+/*
+ * Exports a counter that only ever goes up, such as a HW packet counter, as
+ * a stat of its increments.  The first value is only taken as the starting
+ * point, and a value lower than the previous one is taken as the counter
+ * having been reset.
+ */
 class MonotonicCounter {
 public:
-  MonotonicCounter(folly::StringPiece, ExportType, ExportType) {}
-  void updateValue(std::chrono::seconds, int64_t) {}
+  MonotonicCounter(folly::StringPiece name, ExportType type1,
+                   ExportType type2);
+
+  void updateValue(std::chrono::seconds now, int64_t value);
+
+private:
+  ExportedStatMap::LockAndStatItem stat_;
+  bool haveValue_{false};
+  int64_t prev_{0};
 };
 
 }}
@@ -9,8 +9,180 @@
  */
 #include "common/stats/ServiceData.h"
 
+#include <regex>
+
+using folly::StringPiece;
+using std::chrono::duration_cast;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
 static facebook::stats::ServiceData payload;
 
 namespace facebook {
 facebook::stats::ServiceData* fbData = &payload;
+
+namespace stats {
+
+namespace {
+
+seconds getNow() {
+  return duration_cast<seconds>(system_clock::now().time_since_epoch());
+}
+
+bool isDisabled(StringPiece name, const std::set<std::string>& sets) {
+  for (const auto& prefix : sets) {
+    if (name.startsWith(prefix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Call fn for each entry of the map whose name starts with prefix.
+ */
+template<typename MapT, typename Fn>
+void forEachWithPrefix(const MapT& map, StringPiece prefix, Fn fn) {
+  for (auto it = map.lower_bound(prefix.str());
+       it != map.end() && StringPiece(it->first).startsWith(prefix); ++it) {
+    fn(*it);
+  }
+}
+
+template<typename MapT>
+void eraseWithPrefix(MapT* map, StringPiece prefix) {
+  auto begin = map->lower_bound(prefix.str());
+  auto end = begin;
+  while (end != map->end() && StringPiece(end->first).startsWith(prefix)) {
+    ++end;
+  }
+  map->erase(begin, end);
+}
+
+} // unnamed namespace
+
+void ServiceData::getCounters(std::map<std::string, int64_t>& counters) {
+  getFilteredCounters(counters, "",
+                      [](const std::string& name) { return true; });
+}
+
+void ServiceData::getPrefixCounters(std::map<std::string, int64_t>& counters,
+                                    StringPiece prefix) {
+  getFilteredCounters(counters, prefix,
+                      [](const std::string& name) { return true; });
+}
+
+void ServiceData::getRegexCounters(std::map<std::string, int64_t>& counters,
+                                   const std::string& regex) {
+  std::regex re(regex);
+  getFilteredCounters(counters, "", [&](const std::string& name) {
+    return std::regex_match(name, re);
+  });
+}
+
+void ServiceData::getSelectedCounters(
+    std::map<std::string, int64_t>& counters,
+    const std::vector<std::string>& keys) {
+  auto index = getIndex();
+  auto disabled = getDisabledCounterSets();
+  auto now = getNow();
+  for (const auto& key : keys) {
+    auto statIt = index->stats.find(key);
+    if (statIt != index->stats.end()) {
+      counters[key] = ExportedStatMap::getValue(statIt->second, now);
+      continue;
+    }
+    auto histIt = index->histograms.find(key);
+    if (histIt != index->histograms.end()) {
+      counters[key] = ExportedHistogramMap::getValue(histIt->second, now);
+      continue;
+    }
+    if (isDisabled(key, disabled)) {
+      continue;
+    }
+    std::lock_guard<std::mutex> g(countersLock_);
+    auto it = counters_.find(key);
+    if (it != counters_.end()) {
+      counters[key] = it->second;
+    }
+  }
 }
+
+template<typename Filter>
+void ServiceData::getFilteredCounters(
+    std::map<std::string, int64_t>& counters, StringPiece prefix,
+    Filter filter) {
+  auto index = getIndex();
+  auto disabled = getDisabledCounterSets();
+  auto now = getNow();
+  {
+    std::lock_guard<std::mutex> g(countersLock_);
+    forEachWithPrefix(counters_, prefix,
+                      [&](const std::pair<const std::string, int64_t>& c) {
+      if (!isDisabled(c.first, disabled) && filter(c.first)) {
+        counters[c.first] = c.second;
+      }
+    });
+  }
+  typedef std::pair<const std::string, ExportedStatMap::Counter> StatEntry;
+  forEachWithPrefix(index->stats, prefix, [&](const StatEntry& entry) {
+    if (filter(entry.first)) {
+      counters[entry.first] = ExportedStatMap::getValue(entry.second, now);
+    }
+  });
+  typedef std::pair<const std::string, ExportedHistogramMap::Counter>
+    HistEntry;
+  forEachWithPrefix(index->histograms, prefix, [&](const HistEntry& entry) {
+    if (filter(entry.first)) {
+      counters[entry.first] =
+        ExportedHistogramMap::getValue(entry.second, now);
+    }
+  });
+}
+
+std::shared_ptr<const ServiceData::CounterIndex> ServiceData::getIndex() {
+  auto statGeneration = statMap_.getGeneration();
+  auto histGeneration = histMap_.getGeneration();
+  std::lock_guard<std::mutex> g(indexLock_);
+  if (index_ && index_->statGeneration == statGeneration &&
+      index_->histGeneration == histGeneration &&
+      index_->setsGeneration == setsGeneration_) {
+    return index_;
+  }
+
+  // A stat added while this runs bumps the generation again, so the next
+  // call picks it up
+  auto index = std::make_shared<CounterIndex>();
+  index->statGeneration = statGeneration;
+  index->histGeneration = histGeneration;
+  index->setsGeneration = setsGeneration_;
+  statMap_.getCounterIndex(&index->stats);
+  histMap_.getCounterIndex(&index->histograms);
+  for (const auto& prefix : disabledSets_) {
+    eraseWithPrefix(&index->stats, prefix);
+    eraseWithPrefix(&index->histograms, prefix);
+  }
+  index_ = index;
+  return index_;
+}
+
+void ServiceData::setCounter(StringPiece name, int64_t value) {
+  std::lock_guard<std::mutex> g(countersLock_);
+  counters_[name.str()] = value;
+}
+
+void ServiceData::setCounterSetEnabled(StringPiece prefix, bool enabled) {
+  std::lock_guard<std::mutex> g(indexLock_);
+  bool changed = enabled ? disabledSets_.erase(prefix.str()) :
+    disabledSets_.insert(prefix.str()).second;
+  if (changed) {
+    ++setsGeneration_;
+  }
+}
+
+std::set<std::string> ServiceData::getDisabledCounterSets() {
+  std::lock_guard<std::mutex> g(indexLock_);
+  return disabledSets_;
+}
+
+}}
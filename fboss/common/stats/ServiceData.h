@@ -12,22 +12,81 @@
 #include "common/stats/ExportedTimeseries.h"
 #include "common/stats/ExportedHistogram.h"
 #include <map>
+#include <set>
+#include <vector>
 
 namespace facebook { namespace stats {
 
 class ServiceData {
 public:
   ExportedStatMap* getStatMap() {
-    static ExportedStatMap it;
-    return &it;
+    return &statMap_;
   }
   ExportedHistogramMap* getHistogramMap() {
-    static ExportedHistogramMap it;
-    return &it;
+    return &histMap_;
   }
-  void getCounters(std::map<std::string, int64_t>&) {}
+  /*
+   * Get the counters set with setCounter(), and those of the exported
+   * stats and histograms, as of now.
+   */
+  void getCounters(std::map<std::string, int64_t>& counters);
+  /*
+   * Like getCounters(), but only the counters with the given names, those
+   * whose names start with prefix, or those whose whole names match the
+   * regex.  The names are looked up in an index of the counter names,
+   * which is only rebuilt when stats are added, so only the counters
+   * returned are computed.  getRegexCounters() throws std::regex_error if
+   * the regex is invalid.
+   */
+  void getSelectedCounters(std::map<std::string, int64_t>& counters,
+                           const std::vector<std::string>& keys);
+  void getPrefixCounters(std::map<std::string, int64_t>& counters,
+                         folly::StringPiece prefix);
+  void getRegexCounters(std::map<std::string, int64_t>& counters,
+                        const std::string& regex);
   void setUseOptionsAsFlags(bool) {}
-  void setCounter(folly::StringPiece, uint32_t) {}
+  void setCounter(folly::StringPiece name, int64_t value);
+
+  /*
+   * A counter set is the counters of one subsystem, such as "port" for the
+   * per port counters, identified by the prefix of their names.  The
+   * counters of a disabled set are left out of all of the calls above,
+   * which saves computing and serializing them, but are still kept up to
+   * date, so enabling the set again brings them straight back.
+   */
+  void setCounterSetEnabled(folly::StringPiece prefix, bool enabled);
+  std::set<std::string> getDisabledCounterSets();
+
+private:
+  struct CounterIndex {
+    // The generations of the maps, and of the counter sets, the index was
+    // built from
+    uint64_t statGeneration{0};
+    uint64_t histGeneration{0};
+    uint64_t setsGeneration{0};
+    // The counters of the stats and histograms that are not in a disabled
+    // set, sorted by name so that prefixes can be looked up
+    std::map<std::string, ExportedStatMap::Counter> stats;
+    std::map<std::string, ExportedHistogramMap::Counter> histograms;
+  };
+
+  std::shared_ptr<const CounterIndex> getIndex();
+  /*
+   * Add the counters whose names start with prefix and pass the filter.
+   */
+  template<typename Filter>
+  void getFilteredCounters(std::map<std::string, int64_t>& counters,
+                           folly::StringPiece prefix, Filter filter);
+
+  ExportedStatMap statMap_;
+  ExportedHistogramMap histMap_;
+  std::mutex countersLock_;
+  std::map<std::string, int64_t> counters_;
+  // Protects the index and the counter sets
+  std::mutex indexLock_;
+  std::shared_ptr<const CounterIndex> index_;
+  std::set<std::string> disabledSets_;
+  uint64_t setsGeneration_{0};
 };
 
 }
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2004-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "common/stats/ThreadCachedServiceData.h"
+#include "common/stats/ServiceData.h"
+
+#include <glog/logging.h>
+
+using std::chrono::duration_cast;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+namespace facebook { namespace stats {
+
+namespace {
+
+seconds wallNow() {
+  return duration_cast<seconds>(system_clock::now().time_since_epoch());
+}
+
+} // unnamed namespace
+
+void ThreadCachedServiceData::ThreadLocalStatsMap::publish(seconds now) {
+  std::lock_guard<std::mutex> g(mutex_);
+  for (auto* stat : stats_) {
+    stat->publish(now);
+  }
+}
+
+void ThreadCachedServiceData::ThreadLocalStatsMap::registerStat(
+    TLStat* stat) {
+  std::lock_guard<std::mutex> g(mutex_);
+  stats_.insert(stat);
+}
+
+void ThreadCachedServiceData::ThreadLocalStatsMap::unregisterStat(
+    TLStat* stat) {
+  std::lock_guard<std::mutex> g(mutex_);
+  // Don't lose what was added since the last publish
+  stat->publish(wallNow());
+  stats_.erase(stat);
+}
+
+ThreadCachedServiceData::TLTimeseries::TLTimeseries(ThreadLocalStatsMap* map,
+                                                    folly::StringPiece name,
+                                                    ExportType type1,
+                                                    ExportType type2)
+  : TLStat(map) {
+  auto statMap = fbData->getStatMap();
+  stat_ = statMap->getLockAndStatItem(name, &type1);
+  statMap->getLockAndStatItem(name, &type2);
+  registerStat();
+}
+
+ThreadCachedServiceData::TLTimeseries::~TLTimeseries() {
+  unregisterStat();
+}
+
+void ThreadCachedServiceData::TLTimeseries::publish(seconds now) {
+  // sum_ and count_ may be read between the two updates of an addValue();
+  // the next publish catches up.
+  auto sum = sum_.load(std::memory_order_relaxed);
+  auto count = count_.load(std::memory_order_relaxed);
+  if (count == publishedCount_ && sum == publishedSum_) {
+    return;
+  }
+  {
+    SpinLockHolder guard(stat_.first.get());
+    stat_.second->addValueAggregated(now, sum - publishedSum_,
+                                     count - publishedCount_);
+  }
+  publishedSum_ = sum;
+  publishedCount_ = count;
+}
+
+ThreadCachedServiceData::TLHistogram::TLHistogram(ThreadLocalStatsMap* map,
+                                                  folly::StringPiece name,
+                                                  int bucketWidth,
+                                                  int min, int max)
+  : TLStat(map),
+    bucketWidth_(bucketWidth),
+    min_(min),
+    max_(max),
+    numBuckets_(2 + (max - min + bucketWidth - 1) / bucketWidth),
+    buckets_(new Bucket[numBuckets_]) {
+  CHECK_GT(bucketWidth, 0);
+  CHECK_LT(min, max);
+  ExportedHistogram tmpl(bucketWidth, min, max);
+  hist_ = fbData->getHistogramMap()->getOrCreateUnlocked(name, &tmpl);
+  registerStat();
+}
+
+ThreadCachedServiceData::TLHistogram::~TLHistogram() {
+  unregisterStat();
+}
+
+void ThreadCachedServiceData::TLHistogram::publish(seconds now) {
+  bool locked = false;
+  for (size_t idx = 0; idx < numBuckets_; ++idx) {
+    auto& bucket = buckets_[idx];
+    auto sum = bucket.sum.load(std::memory_order_relaxed);
+    auto count = bucket.count.load(std::memory_order_relaxed);
+    if (count == bucket.publishedCount) {
+      continue;
+    }
+    if (!locked) {
+      hist_.first->lock();
+      locked = true;
+    }
+    // The values within a bucket are added as their average, which lands
+    // them in the same bucket of the exported histogram.
+    auto newCount = count - bucket.publishedCount;
+    hist_.second->addValue(now, (sum - bucket.publishedSum) / newCount,
+                           newCount);
+    bucket.publishedSum = sum;
+    bucket.publishedCount = count;
+  }
+  if (locked) {
+    hist_.first->unlock();
+  }
+}
+
+ThreadCachedServiceData* ThreadCachedServiceData::get() {
+  // Never destroyed, since thread local stats may outlive static objects
+  static ThreadCachedServiceData* it = new ThreadCachedServiceData();
+  return it;
+}
+
+void ThreadCachedServiceData::publishStats() {
+  statsMap_.publish(wallNow());
+}
+
+}}
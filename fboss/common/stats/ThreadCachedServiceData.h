@@ -9,44 +9,164 @@
  */
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
 #include <folly/Range.h>
 #include "common/stats/ExportedTimeseries.h"
+#include "common/stats/ExportedHistogram.h"
 
 namespace facebook { namespace stats {
 
+/*
+ * Stats that are cheap enough to update on the packet path.
+ *
+ * Each TLTimeseries and TLHistogram is only ever updated by the thread that
+ * created it (they live in thread local objects such as SwitchStats), so an
+ * update is a couple of plain loads and stores of its own counters, with no
+ * locks or atomic read-modify-writes.  The counters only ever go up.
+ * publishStats() adds what changed since the last publish to the exported
+ * stats and histograms in fbData, from whatever thread calls it.
+ */
 class ThreadCachedServiceData {
 public:
+  class TLStat;
+
+  /*
+   * The thread local stats that publishStats() aggregates.  It is shared by
+   * all threads; each stat registers itself on creation, and publishes what
+   * it has left when it is destroyed.
+   */
   class ThreadLocalStatsMap {
+  public:
+    void publish(std::chrono::seconds now);
+
+  private:
+    friend class TLStat;
+
+    void registerStat(TLStat* stat);
+    void unregisterStat(TLStat* stat);
+
+    std::mutex mutex_;
+    std::unordered_set<TLStat*> stats_;
+  };
+
+  class TLStat {
+  public:
+    virtual ~TLStat() {}
+
+  protected:
+    explicit TLStat(ThreadLocalStatsMap* map) : map_(map) {}
+
+    // Add the values since the last publish to the exported stat
+    virtual void publish(std::chrono::seconds now) = 0;
+
+    // Increment a counter that only the owning thread writes
+    static void increment(std::atomic<int64_t>* counter, int64_t value) {
+      counter->store(counter->load(std::memory_order_relaxed) + value,
+                     std::memory_order_relaxed);
+    }
+
+    // Called by the derived classes once they are fully constructed, and
+    // before they are destroyed, so that publish() never runs on a partial
+    // object
+    void registerStat() {
+      map_->registerStat(this);
+    }
+    void unregisterStat() {
+      map_->unregisterStat(this);
+    }
+
+  private:
+    friend class ThreadLocalStatsMap;
+
+    ThreadLocalStatsMap* const map_;
   };
 
-  class TLTimeseries {
+  class TLTimeseries : public TLStat {
   public:
-    TLTimeseries(ThreadLocalStatsMap*, folly::StringPiece,
-                 ExportType, ExportType = ExportType()) {}
-    void addValue(int64_t) {}
+    TLTimeseries(ThreadLocalStatsMap* map, folly::StringPiece name,
+                 ExportType type1, ExportType type2 = ExportType());
+    ~TLTimeseries() override;
+
+    void addValue(int64_t value) {
+      increment(&sum_, value);
+      increment(&count_, 1);
+    }
+
+  private:
+    void publish(std::chrono::seconds now) override;
+
+    ExportedStatMap::LockAndStatItem stat_;
+    std::atomic<int64_t> sum_{0};
+    std::atomic<int64_t> count_{0};
+    // The values as of the last publish, only accessed by the publisher
+    int64_t publishedSum_{0};
+    int64_t publishedCount_{0};
   };
 
-  class TLHistogram {
+  class TLHistogram : public TLStat {
   public:
-    TLHistogram(ThreadLocalStatsMap*, folly::StringPiece, int, int, int) {}
-    void addValue(int64_t) {}
-    void addRepeatedValue(int64_t /*value*/, int64_t /*nsamples*/) {}
+    TLHistogram(ThreadLocalStatsMap* map, folly::StringPiece name,
+                int bucketWidth, int min, int max);
+    ~TLHistogram() override;
+
+    void addValue(int64_t value) {
+      addRepeatedValue(value, 1);
+    }
+    void addRepeatedValue(int64_t value, int64_t nsamples) {
+      auto& bucket = buckets_[bucketIndex(value)];
+      increment(&bucket.sum, value * nsamples);
+      increment(&bucket.count, nsamples);
+    }
+
+  private:
+    struct Bucket {
+      std::atomic<int64_t> sum{0};
+      std::atomic<int64_t> count{0};
+      int64_t publishedSum{0};
+      int64_t publishedCount{0};
+    };
+
+    // The same buckets as the ExportedHistogram: below min, then the ones
+    // between min and max, then at or above max
+    size_t bucketIndex(int64_t value) const {
+      if (value < min_) {
+        return 0;
+      }
+      if (value >= max_) {
+        return numBuckets_ - 1;
+      }
+      return 1 + (value - min_) / bucketWidth_;
+    }
+
+    void publish(std::chrono::seconds now) override;
+
+    ExportedHistogramMap::LockAndHistogram hist_;
+    const int64_t bucketWidth_;
+    const int64_t min_;
+    const int64_t max_;
+    const size_t numBuckets_;
+    std::unique_ptr<Bucket[]> buckets_;
   };
 
-  static ThreadCachedServiceData* get() {
-    static ThreadCachedServiceData it;
-    return &it;
-  }
+  static ThreadCachedServiceData* get();
   ThreadLocalStatsMap* getThreadStats() {
-    static ThreadLocalStatsMap it;
-    return &it;
+    return &statsMap_;
   }
+  /*
+   * The stats are published by whoever calls publishStats(), which in the
+   * agent is the StatsPublisher timeout in the main thread.
+   */
   bool publishThreadRunning() const {
     return false;
   }
-  void publishStats() {
-  }
+  void publishStats();
+
+private:
+  ThreadLocalStatsMap statsMap_;
 };
 
 }}